@@ -14,11 +14,15 @@
  * limitations under the License.
  */
 #include <assert.h>
+#include <fcntl.h>
 #include <png.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <sys/mman.h>
+#include <unistd.h>
 
 #include <string>
+#include <thread>
 #include <vector>
 
 /// This is an example demonstrating how to use auto-generated bundles and
@@ -33,6 +37,9 @@
 //===----------------------------------------------------------------------===//
 std::vector<std::string> inputImageFilenames;
 
+/// The number of threads that run the bundle concurrently.
+unsigned numThreads = 1;
+
 /// \returns the index of the element at x,y,z,w.
 size_t getXYZW(const size_t *dims, size_t x, size_t y, size_t z, size_t w) {
   return (x * dims[1] * dims[2] * dims[3]) + (y * dims[2] * dims[3]) +
@@ -203,6 +210,11 @@ static void loadImagesAndPreprocess(const std::vector<std::string> &filenames,
 void parseCommandLineOptions(int argc, char **argv) {
   int arg = 1;
   while (arg < argc) {
+    if (!strncmp(argv[arg], "-threads=", strlen("-threads="))) {
+      numThreads = atoi(argv[arg++] + strlen("-threads="));
+      assert(numThreads > 0 && "Expected at least one thread");
+      continue;
+    }
     inputImageFilenames.push_back(argv[arg++]);
   }
 }
@@ -237,6 +249,12 @@ struct BundleConfig {
   size_t numSymbols;
   // Symbol table.
   const SymbolTableEntry *symbolTable;
+  // The page size the weights file is padded to, if the bundle was produced
+  // with the -bundle-mmap-weights option, and 0 otherwise.
+  size_t weightsPageSize;
+  // The constant weights, if the bundle was produced with the
+  // -bundle-embed-weights option, and null otherwise.
+  const uint8_t *constantWeights;
 };
 
 // These two external symbols are auto-generated by means of the -bundle option.
@@ -282,10 +300,46 @@ void *alignedAlloc(const BundleConfig &config, size_t size) {
   return ptr;
 }
 
+/// Map the weights file read-only into memory. The pages of the weights are
+/// loaded lazily and shared by all of the processes that run the bundle.
+static uint8_t *mapConstantWeights(const char *weightsFileName,
+                                   const BundleConfig &config) {
+  int weightsFile = open(weightsFileName, O_RDONLY);
+  if (weightsFile < 0) {
+    fprintf(stderr, "Could not open the weights file: %s\n", weightsFileName);
+    exit(1);
+  }
+  size_t fileSize = lseek(weightsFile, 0, SEEK_END);
+  printf("Expected weights of size: %lu\n", config.constantWeightVarsMemSize);
+  assert(fileSize >= config.constantWeightVarsMemSize &&
+         fileSize % config.weightsPageSize == 0 && "Wrong weights file size");
+  void *addr = mmap(nullptr, fileSize, PROT_READ, MAP_SHARED, weightsFile, 0);
+  close(weightsFile);
+  if (addr == MAP_FAILED) {
+    perror("Could not map the weights file");
+    exit(1);
+  }
+  assert((size_t)addr % config.alignment == 0 && "Wrong alignment");
+  printf("Mapped weights of size: %lu from the file %s\n", fileSize,
+         weightsFileName);
+  return static_cast<uint8_t *>(addr);
+}
+
 /// Initialize the constant weights memory block by loading the weights from the
-/// weights file.
+/// weights file. The weights file is mapped into memory, if the bundle allows
+/// it.
 static uint8_t *initConstantWeights(const char *weightsFileName,
                                     const BundleConfig &config) {
+  // The bundle does not write to the embedded weights.
+  if (config.constantWeights) {
+    printf("Using the embedded weights of size: %lu\n",
+           config.constantWeightVarsMemSize);
+    return const_cast<uint8_t *>(config.constantWeights);
+  }
+  if (config.weightsPageSize) {
+    return mapConstantWeights(weightsFileName, config);
+  }
+
   // Load weights.
   FILE *weightsFile = fopen(weightsFileName, "rb");
   if (!weightsFile) {
@@ -312,6 +366,22 @@ static uint8_t *initConstantWeights(const char *weightsFileName,
   return baseConstantWeightVarsAddr;
 }
 
+/// Release the constant weights memory block \p constantWeightVarsAddr.
+static void freeConstantWeights(uint8_t *constantWeightVarsAddr,
+                                const BundleConfig &config) {
+  if (config.constantWeights) {
+    return;
+  }
+  if (!config.weightsPageSize) {
+    free(constantWeightVarsAddr);
+    return;
+  }
+  size_t fileSize =
+      (config.constantWeightVarsMemSize + config.weightsPageSize - 1) /
+      config.weightsPageSize * config.weightsPageSize;
+  munmap(constantWeightVarsAddr, fileSize);
+}
+
 /// The assumed layout of the area for mutable WeightVars is:
 /// data | gpu_0/data | results
 static uint8_t *allocateMutableWeightVars(const BundleConfig &config) {
@@ -322,10 +392,10 @@ static uint8_t *allocateMutableWeightVars(const BundleConfig &config) {
   return weights;
 }
 
-/// Dump the result of the inference by looking at the results vector and
+/// \returns the result of the inference by looking at the results vector and
 /// finding the index of the max element.
-static void dumpInferenceResults(const BundleConfig &config,
-                                 uint8_t *mutableWeightVars) {
+static int getInferenceResult(const BundleConfig &config,
+                              uint8_t *mutableWeightVars) {
   const SymbolTableEntry &outputWeights = getMutableWeightVar(config, "output");
   int maxIdx = 0;
   float maxValue = 0;
@@ -336,7 +406,13 @@ static void dumpInferenceResults(const BundleConfig &config,
       maxIdx = i;
     }
   }
-  printf("Result: %u\n", maxIdx);
+  return maxIdx;
+}
+
+/// Dump the result of the inference.
+static void dumpInferenceResults(const BundleConfig &config,
+                                 uint8_t *mutableWeightVars) {
+  printf("Result: %u\n", getInferenceResult(config, mutableWeightVars));
 }
 
 /// The assumed layout of the area for mutable WeightVars is:
@@ -364,6 +440,46 @@ static uint8_t *initActivations(const BundleConfig &config) {
       alignedAlloc(config, config.activationsMemSize));
 }
 
+/// Run the bundle concurrently on \p numThreads threads that share the
+/// constant weights \p constantWeightVarsAddr. Every thread has its own copy
+/// of the inputs \p mutableWeightVarsAddr and its own activations. \returns
+/// true if all of the threads compute the result \p expected.
+static bool runConcurrently(uint8_t *constantWeightVarsAddr,
+                            const uint8_t *mutableWeightVarsAddr,
+                            int expected) {
+  const BundleConfig &config = resnet50_config;
+  std::vector<uint8_t *> mutableAreas(numThreads);
+  std::vector<uint8_t *> activationAreas(numThreads);
+  for (unsigned t = 0; t < numThreads; t++) {
+    mutableAreas[t] = static_cast<uint8_t *>(
+        alignedAlloc(config, config.mutableWeightVarsMemSize));
+    memcpy(mutableAreas[t], mutableWeightVarsAddr,
+           config.mutableWeightVarsMemSize);
+    activationAreas[t] = initActivations(config);
+  }
+
+  std::vector<std::thread> threads;
+  for (unsigned t = 0; t < numThreads; t++) {
+    threads.emplace_back([&, t]() {
+      resnet50(constantWeightVarsAddr, mutableAreas[t], activationAreas[t]);
+    });
+  }
+  bool ok = true;
+  for (unsigned t = 0; t < numThreads; t++) {
+    threads[t].join();
+    int result = getInferenceResult(config, mutableAreas[t]);
+    if (result != expected) {
+      printf("Thread %u computed the result %d instead of %d\n", t, result,
+             expected);
+      ok = false;
+    }
+    free(mutableAreas[t]);
+    free(activationAreas[t]);
+  }
+  printf("Ran the bundle on %u threads concurrently\n", numThreads);
+  return ok;
+}
+
 int main(int argc, char **argv) {
   parseCommandLineOptions(argc, argv);
   // Allocate and initialize constant and mutable weights.
@@ -378,8 +494,17 @@ int main(int argc, char **argv) {
   // Report the results.
   dumpInferenceResults(resnet50_config, mutableWeightVarsAddr);
 
+  // Check that the concurrent invocations compute the same result.
+  bool ok = true;
+  if (numThreads > 1) {
+    ok = runConcurrently(
+        constantWeightVarsAddr, mutableWeightVarsAddr,
+        getInferenceResult(resnet50_config, mutableWeightVarsAddr));
+  }
+
   // Free all resources.
   free(activationsAddr);
-  free(constantWeightVarsAddr);
+  freeConstantWeights(constantWeightVarsAddr, resnet50_config);
   free(mutableWeightVarsAddr);
+  return ok ? 0 : 1;
 }
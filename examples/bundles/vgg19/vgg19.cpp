@@ -14,9 +14,12 @@
  * limitations under the License.
  */
 #include <assert.h>
+#include <fcntl.h>
 #include <png.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <sys/mman.h>
+#include <unistd.h>
 
 #include <string>
 #include <vector>
@@ -237,6 +240,12 @@ struct BundleConfig {
   size_t numSymbols;
   // Symbol table.
   const SymbolTableEntry *symbolTable;
+  // The page size the weights file is padded to, if the bundle was produced
+  // with the -bundle-mmap-weights option, and 0 otherwise.
+  size_t weightsPageSize;
+  // The constant weights, if the bundle was produced with the
+  // -bundle-embed-weights option, and null otherwise.
+  const uint8_t *constantWeights;
 };
 
 // These two external symbols are auto-generated by means of the -bundle option.
@@ -282,10 +291,46 @@ void *alignedAlloc(const BundleConfig &config, size_t size) {
   return ptr;
 }
 
+/// Map the weights file read-only into memory. The pages of the weights are
+/// loaded lazily and shared by all of the processes that run the bundle.
+static uint8_t *mapConstantWeights(const char *weightsFileName,
+                                   const BundleConfig &config) {
+  int weightsFile = open(weightsFileName, O_RDONLY);
+  if (weightsFile < 0) {
+    fprintf(stderr, "Could not open the weights file: %s\n", weightsFileName);
+    exit(1);
+  }
+  size_t fileSize = lseek(weightsFile, 0, SEEK_END);
+  printf("Expected weights of size: %lu\n", config.constantWeightVarsMemSize);
+  assert(fileSize >= config.constantWeightVarsMemSize &&
+         fileSize % config.weightsPageSize == 0 && "Wrong weights file size");
+  void *addr = mmap(nullptr, fileSize, PROT_READ, MAP_SHARED, weightsFile, 0);
+  close(weightsFile);
+  if (addr == MAP_FAILED) {
+    perror("Could not map the weights file");
+    exit(1);
+  }
+  assert((size_t)addr % config.alignment == 0 && "Wrong alignment");
+  printf("Mapped weights of size: %lu from the file %s\n", fileSize,
+         weightsFileName);
+  return static_cast<uint8_t *>(addr);
+}
+
 /// Initialize the constant weights memory block by loading the weights from the
-/// weights file.
+/// weights file. The weights file is mapped into memory, if the bundle allows
+/// it.
 static uint8_t *initConstantWeights(const char *weightsFileName,
                                     const BundleConfig &config) {
+  // The bundle does not write to the embedded weights.
+  if (config.constantWeights) {
+    printf("Using the embedded weights of size: %lu\n",
+           config.constantWeightVarsMemSize);
+    return const_cast<uint8_t *>(config.constantWeights);
+  }
+  if (config.weightsPageSize) {
+    return mapConstantWeights(weightsFileName, config);
+  }
+
   // Load weights.
   FILE *weightsFile = fopen(weightsFileName, "rb");
   if (!weightsFile) {
@@ -312,6 +357,22 @@ static uint8_t *initConstantWeights(const char *weightsFileName,
   return baseConstantWeightVarsAddr;
 }
 
+/// Release the constant weights memory block \p constantWeightVarsAddr.
+static void freeConstantWeights(uint8_t *constantWeightVarsAddr,
+                                const BundleConfig &config) {
+  if (config.constantWeights) {
+    return;
+  }
+  if (!config.weightsPageSize) {
+    free(constantWeightVarsAddr);
+    return;
+  }
+  size_t fileSize =
+      (config.constantWeightVarsMemSize + config.weightsPageSize - 1) /
+      config.weightsPageSize * config.weightsPageSize;
+  munmap(constantWeightVarsAddr, fileSize);
+}
+
 /// The assumed layout of the area for mutable WeightVars is:
 /// data | gpu_0/data | results
 static uint8_t *allocateMutableWeightVars(const BundleConfig &config) {
@@ -379,6 +440,6 @@ int main(int argc, char **argv) {
 
   // Free all resources.
   free(activationsAddr);
-  free(constantWeightVarsAddr);
+  freeConstantWeights(constantWeightVarsAddr, vgg19_config);
   free(mutableWeightVarsAddr);
 }
@@ -22,6 +22,7 @@
 #include "llvm/Support/raw_ostream.h"
 
 #include <cassert>
+#include <chrono>
 #include <fstream>
 #include <iostream>
 
@@ -36,6 +37,18 @@ llvm::cl::opt<BackendKind> executionBackend(
                      clEnumValN(BackendKind::CPU, "cpu", "Use CPU"),
                      clEnumValN(BackendKind::OpenCL, "opencl", "Use OpenCL")),
     llvm::cl::init(BackendKind::Interpreter), llvm::cl::cat(cifarCat));
+
+llvm::cl::opt<unsigned> numWorkers(
+    "num-workers",
+    llvm::cl::desc("The number of the threads that train in parallel, each on "
+                   "a mini-batch of its own"),
+    llvm::cl::init(1), llvm::cl::cat(cifarCat));
+
+llvm::cl::opt<unsigned> numBenchIterations(
+    "bench-iterations",
+    llvm::cl::desc("Only measure the training throughput over this number of "
+                   "iterations and exit"),
+    llvm::cl::init(0), llvm::cl::cat(cifarCat));
 } // namespace
 
 /// The CIFAR file format is structured as one byte label in the range 0..9.
@@ -98,6 +111,7 @@ void testCIFAR10() {
   EE.getConfig().momentum = 0.9;
   EE.getConfig().L2Decay = 0.0001;
   EE.getConfig().batchSize = minibatchSize;
+  EE.getConfig().numWorkers = numWorkers;
 
   auto &mod = EE.getModule();
   Function *F = mod.createFunction("main");
@@ -133,6 +147,20 @@ void testCIFAR10() {
   // Report progress every this number of training iterations.
   int reportRate = 256;
 
+  if (numBenchIterations) {
+    // Warm up, then time the training loop alone.
+    EE.runBatch(1, {A, E}, {&images, &labels});
+    auto start = std::chrono::steady_clock::now();
+    EE.runBatch(numBenchIterations, {A, E}, {&images, &labels});
+    std::chrono::duration<double> elapsed =
+        std::chrono::steady_clock::now() - start;
+    size_t numImages = size_t(numBenchIterations) * minibatchSize * numWorkers;
+    llvm::outs() << "Trained " << numImages << " images with " << numWorkers
+                 << " workers in " << elapsed.count() << " s: "
+                 << numImages / elapsed.count() << " images/s\n";
+    return;
+  }
+
   llvm::outs() << "Training.\n";
 
   for (int iter = 0; iter < 100000; iter++) {
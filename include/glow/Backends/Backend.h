@@ -19,16 +19,23 @@
 #include "glow/Base/Traits.h"
 #include "glow/Optimizer/Optimizer.h"
 
+#include <llvm/ADT/ArrayRef.h>
 #include <llvm/ADT/StringRef.h>
 
+#include <functional>
+#include <memory>
+#include <vector>
+
 namespace glow {
 
+class ActivationArena;
 class Context;
 class IRFunction;
 class Value;
 class Tensor;
 class Variable;
 class Function;
+class Module;
 class Node;
 
 enum class BackendKind {
@@ -37,6 +44,44 @@ enum class BackendKind {
   CPU,         // Compile and run the code on the host.
 };
 
+/// The memory of an execution of the compiled code: the activations and the
+/// mutable variables, i.e. the inputs and the outputs. The sessions of a
+/// backend share its compiled code and constant weights, so that several
+/// sessions can run inference concurrently on different threads.
+class ExecutionSession {
+public:
+  /// Dtor.
+  virtual ~ExecutionSession() = default;
+
+  /// \returns the tensor that holds the value of the mutable variable \p v in
+  /// this session.
+  virtual Tensor &getTensor(const Variable *v) = 0;
+
+  /// Use the tensor \p T, owned by the caller, to hold the value of the
+  /// mutable variable \p v in this session. The code reads and writes \p T in
+  /// place. A null \p T restores the tensor of the session.
+  virtual void bind(const Variable *v, Tensor *T) = 0;
+
+  /// Perform a single forward scan of the network in the memory of this
+  /// session.
+  virtual void doForwardPass() = 0;
+
+  /// Compute only the first \p batchSize samples of the compiled batch in the
+  /// next forward passes of this session. See Backend::setBatchSize.
+  virtual void setBatchSize(size_t batchSize) {}
+
+  /// Keep the activations of the next forward passes of this session in
+  /// \p arena instead of the memory of the session, which is released. See
+  /// Backend::setActivationArena.
+  virtual void setActivationArena(ActivationArena *arena) {}
+
+  /// Call \p fn between the kernels of the next forward passes of this
+  /// session, on the thread of the pass, which may block in \p fn to let a
+  /// more urgent request use the cores, see ModelExecutor. The backends that
+  /// run the code in one piece never call it. A null \p fn removes the call.
+  virtual void setPreemptionPoint(std::function<void()> fn) {}
+};
+
 // This is the interface that glow backends need to implement.
 class Backend {
 public:
@@ -52,10 +97,86 @@ public:
   /// Save the bundle for a later standalone execution.
   virtual void save(llvm::StringRef outputDir);
 
+  /// Save the bundle named \p bundleName with an entry point for every IR
+  /// function of \p entries. The IR functions must belong to the graphs of
+  /// the same module, so that they have the same weights.
+  virtual void save(llvm::ArrayRef<IRFunction *> entries,
+                    llvm::StringRef outputDir, llvm::StringRef bundleName);
+
+  /// Save the code compiled by init(), its memory layout and its constant
+  /// weights into the file \p path, which loadCompiled() makes ready to run
+  /// without the graph and the IR.
+  virtual void saveCompiled(llvm::StringRef path);
+
+  /// Make the code saved by saveCompiled() into the file \p path ready to
+  /// run, instead of calling init(). The public variables that the code reads
+  /// and writes are created in \p M with their names and types.
+  virtual void loadCompiled(llvm::StringRef path, Module &M);
+
   /// Perform a single forward scan of the network, interpreting all of the
   /// instructions.
   virtual void doForwardPass() = 0;
 
+  /// Print the time spent in the parts of the network during the forward
+  /// passes so far, if the backend was asked to profile them.
+  virtual void dumpProfile() {}
+
+  /// Compute only the first \p batchSize samples of the compiled batch in the
+  /// next forward passes. This only holds for the networks whose samples are
+  /// independent, as in inference. The results of the other samples are
+  /// undefined. The backends that don't support it compute the whole batch,
+  /// whose first samples are the same.
+  virtual void setBatchSize(size_t batchSize) {}
+
+  /// \returns the size in bytes of the memory of the activations of the code
+  /// compiled by init(), or 0 if the backend doesn't manage that memory.
+  virtual size_t getActivationsSize() const { return 0; }
+
+  /// Keep the activations of the next forward passes in \p arena instead of
+  /// the memory of the backend, which is released. The arena grows to
+  /// getActivationsSize(), and must not be used by another forward pass at
+  /// the same time. A null \p arena gives the backend memory of its own
+  /// again. The backends that don't manage the memory of the activations
+  /// ignore the arena.
+  virtual void setActivationArena(ActivationArena *arena) {}
+
+  /// Fault in the pages of the memory of the activations and of the constant
+  /// weights of the code compiled by init() or loaded by loadCompiled(), so
+  /// that the first forward pass doesn't wait for them. The backends that
+  /// don't manage that memory need nothing.
+  virtual void prefault() {}
+
+  /// Wait until the optimized code that the backend compiles in the
+  /// background, if any, replaces the code compiled by init(). \returns true
+  /// if the optimized code runs from now on, and false if the code compiled
+  /// by init() was final.
+  virtual bool waitForOptimizedCode() { return false; }
+
+  /// Make the code use the current content of the payloads of the constant
+  /// variables, which were updated in place after init(). The backends that
+  /// read the payloads themselves need nothing.
+  virtual void reloadConstantWeights() {}
+
+  /// Copy the value of the state variable \p v, which the backend may keep in
+  /// the memory of the device between the runs, into its payload. The
+  /// backends that read and write the payloads themselves need nothing.
+  virtual void readState(const Variable *v) {}
+
+  /// Make the next runs use the payload of the state variable \p v, which
+  /// was updated in place, as the value of the state.
+  virtual void writeState(const Variable *v) {}
+
+  /// Replace every row of the state variable \p v, i.e. every slice of its
+  /// first dimension, by the row of the state with the index at the same
+  /// position in \p rows, e.g. for the hypotheses that a beam search keeps.
+  /// The payload of \p v is not updated if the backend keeps the state on
+  /// the device.
+  virtual void reorderState(Variable *v, llvm::ArrayRef<size_t> rows);
+
+  /// \returns a new session for running the compiled code concurrently with
+  /// other sessions, or nullptr if the backend doesn't support sessions.
+  virtual std::unique_ptr<ExecutionSession> createSession() { return nullptr; }
+
   /// @name Backend transform methods for different phases.
   /// These methods are called by the compiler before code generation and gives
   /// the backend an opportunity to transform the graph before IRGen. The
@@ -71,6 +192,14 @@ public:
   }
   /// @}
 
+  /// \returns the chains of nodes that the backend fuses into nodes of its
+  /// own, which are applied after transformPostLowering() in the order of
+  /// the patterns.
+  virtual std::vector<FusionPattern>
+  getFusionPatterns(CompilationMode mode) const {
+    return {};
+  }
+
   /// \returns true if backend supports given kind of operation with
   /// the given \p elementTy element type.
   virtual bool isOpSupported(Kinded::Kind opKind, ElemKind elementTy) const = 0;
@@ -83,6 +212,16 @@ public:
 /// Create a backend of kind \p kind, to run the IR function \p M.
 Backend *createBackend(BackendKind backendKind, IRFunction *M);
 
+/// \returns true if the backends of kind \p backendKind support the operation
+/// \p opKind with the element type \p elementTy, as Backend::isOpSupported()
+/// does, without creating a backend, e.g. the context of a device.
+bool isOpSupported(BackendKind backendKind, Kinded::Kind opKind,
+                   ElemKind elementTy);
+
+/// \returns true if the backends of kind \p backendKind lower the node \p N,
+/// as Backend::shouldLower() does, without creating a backend.
+bool shouldLower(BackendKind backendKind, const Node *N);
+
 } // namespace glow
 
 #endif // GLOW_BACKENDS_BACKEND_H
@@ -0,0 +1,108 @@
+/**
+ * Copyright (c) 2017-present, Facebook, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#ifndef GLOW_BASE_FLOAT16_H
+#define GLOW_BASE_FLOAT16_H
+
+#include <cstdint>
+#include <cstring>
+
+namespace glow {
+
+/// A 16-bit IEEE 754 half-precision floating point number. This is a storage
+/// type: the values convert implicitly to and from float, and all of the
+/// arithmetic is performed in float.
+class float16 final {
+  /// The bits of the number: 1 sign bit, 5 exponent bits and 10 mantissa bits.
+  uint16_t bits_{0};
+
+  static uint32_t floatToBits(float f) {
+    uint32_t bits;
+    memcpy(&bits, &f, sizeof(bits));
+    return bits;
+  }
+
+  static float bitsToFloat(uint32_t bits) {
+    float f;
+    memcpy(&f, &bits, sizeof(f));
+    return f;
+  }
+
+public:
+  float16() = default;
+
+  /// Convert \p f to the nearest half, with ties to even. The values that are
+  /// out of range become infinities.
+  /*implicit*/ float16(float f) {
+    // Scale the number so that the float addition below rounds the mantissa
+    // to the precision of the half, including the subnormal halves.
+    float base = (f < 0 ? -f : f) * bitsToFloat(0x77800000) /* 2^112 */;
+    base *= bitsToFloat(0x08800000) /* 2^-110 */;
+    uint32_t w = floatToBits(f);
+    uint32_t shl1W = w + w;
+    uint32_t sign = w & 0x80000000;
+    uint32_t bias = shl1W & 0xFF000000;
+    if (bias < 0x71000000) {
+      bias = 0x71000000;
+    }
+    base = bitsToFloat((bias >> 1) + 0x07800000) + base;
+    uint32_t bits = floatToBits(base);
+    uint32_t expBits = (bits >> 13) & 0x00007C00;
+    uint32_t mantissaBits = bits & 0x00000FFF;
+    uint32_t nonSign = expBits + mantissaBits;
+    // NaNs stay (quiet) NaNs.
+    bits_ = (sign >> 16) | (shl1W > 0xFF000000 ? 0x7E00 : nonSign);
+  }
+
+  /// \returns the value of the half as a float. This conversion is exact.
+  /*implicit*/ operator float() const {
+    uint32_t w = uint32_t(bits_) << 16;
+    uint32_t sign = w & 0x80000000;
+    uint32_t twoW = w + w;
+    // Rebias the exponent of the normal numbers.
+    float normalized =
+        bitsToFloat((twoW >> 4) + (0xE0 << 23)) * bitsToFloat(0x07800000);
+    // Subnormal halves are normal floats: compute them with a magic number.
+    float denormalized = bitsToFloat((twoW >> 17) | (126 << 23)) - 0.5f;
+    uint32_t denormalizedCutoff = 1 << 27;
+    return bitsToFloat(sign | (twoW < denormalizedCutoff
+                                   ? floatToBits(denormalized)
+                                   : floatToBits(normalized)));
+  }
+
+  /// \returns the bits of the half.
+  uint16_t getBits() const { return bits_; }
+
+  /// \returns the half with the bits \p bits.
+  static float16 fromBits(uint16_t bits) {
+    float16 h;
+    h.bits_ = bits;
+    return h;
+  }
+
+  /// Arithmetic assignment operators, which compute in float.
+  /// @{
+  float16 &operator+=(float other) { return *this = float(*this) + other; }
+  float16 &operator-=(float other) { return *this = float(*this) - other; }
+  float16 &operator*=(float other) { return *this = float(*this) * other; }
+  float16 &operator/=(float other) { return *this = float(*this) / other; }
+  /// @}
+};
+
+static_assert(sizeof(float16) == 2, "float16 must be 16 bits wide");
+
+} // namespace glow
+
+#endif // GLOW_BASE_FLOAT16_H
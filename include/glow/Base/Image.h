@@ -35,6 +35,41 @@ bool readPngImage(Tensor *T, const char *filename,
 bool writePngImage(Tensor *T, const char *filename,
                    std::pair<float, float> range);
 
+/// The preprocessing of the images that loadImage() fuses with their decoding.
+struct ImagePreprocessing {
+  /// The size of the shorter side of the resized image, or 0 to keep the size
+  /// of the image. The image is resized with a bilinear filter.
+  size_t resizeShorterSide{0};
+  /// The size of the center crop of the resized image, or 0 to keep its
+  /// height or width.
+  size_t cropHeight{0};
+  size_t cropWidth{0};
+  /// The range of the values of the pixels.
+  std::pair<float, float> range{0, 1};
+  /// Whether the channels are in the BGR order instead of RGB.
+  bool bgr{false};
+  /// Whether the layout is CHW instead of HWC.
+  bool chw{false};
+};
+
+/// Reads the header of the png or jpeg image \p filename and \returns a tuple
+/// containing height, width, and a bool if it is grayscale or not.
+std::tuple<size_t, size_t, bool> getImageInfo(const char *filename);
+
+/// \returns the height and the width of an image of \p height x \p width
+/// pixels after the preprocessing \p pp.
+std::pair<size_t, size_t> getPreprocessedSize(size_t height, size_t width,
+                                              const ImagePreprocessing &pp);
+
+/// Decode the png or jpeg image \p filename, and resize, crop and normalize it
+/// as \p pp says, straight into the \p height x \p width x \p numChannels
+/// floats at \p dest, e.g. a slot of a batch of images. The jpeg images are
+/// scaled down in the DCT domain while they are decoded, as far as the resized
+/// size allows. \returns True if an error occurred, e.g. if the preprocessed
+/// image doesn't have the given size and number of channels.
+bool loadImage(float *dest, size_t height, size_t width, size_t numChannels,
+               const char *filename, const ImagePreprocessing &pp);
+
 } // namespace glow
 
 #endif // GLOW_BASE_IMAGE_H
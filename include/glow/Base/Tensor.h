@@ -16,7 +16,11 @@
 #ifndef GLOW_BASE_TENSOR_H
 #define GLOW_BASE_TENSOR_H
 
+#include <atomic>
 #include <cassert>
+#include <cmath>
+#include <memory>
+#include <type_traits>
 #include <vector>
 
 #include "glow/Base/Type.h"
@@ -44,20 +48,105 @@ void broadcastToNewShapeImpl(Tensor *src, Tensor *dest,
                              llvm::ArrayRef<size_t> otherDims, unsigned axis);
 
 /// A class that represents a contiguous n-dimensional array (a tensor).
+/// The copies of a tensor made by clone() and copyFrom() share its buffer
+/// until one of them is written or hands out the address of its data, e.g.
+/// to a handle (copy-on-write). The copies that are only read through the
+/// const getRawDataPointer() or copied again don't cost memory.
+///
+/// A tensor is not thread-safe, with one exception: pinning it through
+/// getUnsafePtr() or getUnowned() may happen on several threads at once, e.g.
+/// when several functions take the address of the same const weight. Pinning
+/// may move a shared buffer, so it must not race with the other accesses of
+/// the tensor.
 class Tensor final {
-  /// A pointer to the tensor data and the unowned flag.
-  llvm::PointerIntPair<void *, 1, bool> data_{nullptr};
+  /// A pointer to the tensor data. The views of the int8 tensors may start at
+  /// any byte, so the unowned flag can't live in the low bits of the pointer.
+  /// The pointer and the buffer are mutable, because handing out the address
+  /// of a shared buffer gives the tensor a copy of its own first.
+  mutable char *data_{nullptr};
+
+  /// The buffer that the tensor owns, which its copies share until they are
+  /// written. This is null for the unowned tensors.
+  mutable std::shared_ptr<char> buffer_;
+
+  /// Whether the tensor does not own its data.
+  bool isUnowned_{false};
+
+  /// Whether the address of the buffer was handed out by getUnsafePtr(),
+  /// getUnowned(), the non-const getRawDataPointer() or a handle. The writes
+  /// through that address would bypass the copy-on-write, so the buffer is
+  /// not shared anymore and stays in place. The unowned tensors are always
+  /// pinned.
+  mutable std::atomic<bool> isPinned_{false};
 
   /// The type of the tensor.
   Type type_;
 
   template <class ElemTy> friend class Handle;
 
-  /// \returns a pointer to the tensor data buffer.
-  char *getData() const { return reinterpret_cast<char *>(data_.getPointer()); }
+  /// \returns a pointer to the tensor data buffer for reading it.
+  char *getData() const { return data_; }
+
+  /// \returns a pointer to the tensor data buffer for writing it. A shared
+  /// buffer is copied first.
+  char *getMutableData() {
+    if (isShared()) {
+      unshare(/* keepContent */ true);
+    }
+    return data_;
+  }
 
   /// \returns true if it is an unowned tensor.
-  bool isUnowned() const { return data_.getInt(); }
+  bool isUnowned() const { return isUnowned_; }
+
+  /// \returns true if other tensors share the buffer of the tensor.
+  bool isShared() const { return buffer_ && buffer_.use_count() > 1; }
+
+  /// \returns true if the copies of the tensor may share its buffer.
+  bool isShareable() const { return buffer_ && !isPinned_; }
+
+  /// Allocate a buffer of \p size bytes.
+  static std::shared_ptr<char> allocateBuffer(size_t size) {
+    return std::shared_ptr<char>(
+        reinterpret_cast<char *>(alignedAlloc(size, TensorAlignment)),
+        alignedFree);
+  }
+
+  /// Give the tensor a buffer of its own instead of the shared one, with the
+  /// current content if \p keepContent is set.
+  void unshare(bool keepContent) const {
+    size_t bufferSize = type_.getSizeInBytes();
+    auto buffer = allocateBuffer(bufferSize);
+    if (keepContent) {
+      std::copy(&data_[0], &data_[bufferSize], buffer.get());
+    }
+    buffer_ = std::move(buffer);
+    data_ = buffer_.get();
+  }
+
+  /// Keep the buffer of the tensor in place and never share it again,
+  /// because its address is handed out. This is the only const operation
+  /// that changes the tensor, and it may run on several threads at once.
+  void pin() const {
+    if (!isPinned_.load(std::memory_order_acquire)) {
+      pinSlow();
+    }
+  }
+
+  /// Pin the tensor under a lock, for the first call of pin().
+  void pinSlow() const;
+
+  /// \returns true if the tensor may drop its buffer and share the one of
+  /// \p other instead of copying the data of \p other into it.
+  bool canShareBufferOf(const Tensor *other) const {
+    return other->isShareable() && !isUnowned() && !isPinned_;
+  }
+
+  /// Drop the buffer of the tensor and share the one of \p other.
+  void shareBufferOf(const Tensor *other) {
+    buffer_ = other->buffer_;
+    data_ = other->data_;
+  }
 
 public:
   /// \returns the type of the tensor.
@@ -79,6 +168,10 @@ public:
 
   /// Set the content of the tensor to zero.
   void zero() {
+    // The old content of a shared buffer doesn't need to be copied.
+    if (isShared()) {
+      unshare(/* keepContent */ false);
+    }
     std::fill(&getData()[0], &getData()[0] + size() * type_.getElementSize(),
               0);
   }
@@ -89,10 +182,19 @@ public:
   /// \returns the number of elements in the tensor.
   size_t size() const { return type_.size(); }
 
-  /// \returns a pointer to the raw data, of type \p ElemTy.
+  /// \returns a pointer to the raw data, of type \p ElemTy, for writing it.
+  /// The tensor is pinned, so the pointer stays valid and its writes don't
+  /// leak into the copies of the tensor.
   template <class ElemTy> ElemTy *getRawDataPointer() {
     assert(type_.isType<ElemTy>() && "Asking for the wrong ptr type.");
-    return reinterpret_cast<ElemTy *>(data_.getPointer());
+    pin();
+    return reinterpret_cast<ElemTy *>(data_);
+  }
+
+  /// \returns a pointer to the raw data, of type \p ElemTy, for reading it.
+  template <class ElemTy> const ElemTy *getRawDataPointer() const {
+    assert(type_.isType<ElemTy>() && "Asking for the wrong ptr type.");
+    return reinterpret_cast<const ElemTy *>(data_);
   }
 
   /// Initialize an empty tensor.
@@ -101,7 +203,7 @@ public:
   /// Initialize from a list of float literals.
   Tensor(const std::initializer_list<float> &vec) {
     reset(ElemKind::FloatTy, {vec.size()});
-    auto *data = getRawDataPointer<float>();
+    auto *data = reinterpret_cast<float *>(getMutableData());
     int i = 0;
     for (auto &f : vec) {
       data[i++] = f;
@@ -123,10 +225,9 @@ public:
   /// Construct an unowned tensor provided an existing payload buffer.
   /// This constructor can be used when there is a need to work with
   /// "externally" managed payload buffers using Tensor APIs.
-  Tensor(void *data, TypeRef ty) : data_(data), type_(*ty) {
-    // Mark as unowned.
-    data_.setInt(1);
-  }
+  Tensor(void *data, TypeRef ty)
+      : data_(reinterpret_cast<char *>(data)), isUnowned_(true),
+        isPinned_(true), type_(*ty) {}
 
   /// Allocate and initialize a new integer tensor with \p scale and \p offset.
   Tensor(ElemKind elemTy, llvm::ArrayRef<size_t> dims, float scale,
@@ -149,6 +250,8 @@ public:
   /// outlive its parent tensor.
   Tensor getUnowned(llvm::ArrayRef<size_t> dims,
                     llvm::ArrayRef<size_t> offsets = {}) const {
+    // The view may write the data.
+    pin();
     Tensor unownedTensor;
 
     auto *firstElemPtr = getData();
@@ -165,8 +268,9 @@ public:
       firstElemPtr = &firstElemPtr[index * type_.getElementSize()];
     }
 
-    unownedTensor.data_.setPointer(firstElemPtr);
-    unownedTensor.data_.setInt(1);
+    unownedTensor.data_ = firstElemPtr;
+    unownedTensor.isUnowned_ = true;
+    unownedTensor.isPinned_ = true;
     unownedTensor.type_ = Type::newShape(getType(), dims);
     if (offsets.size() == 0) {
       assert(size() == unownedTensor.size() && "The size of the unowned tensor "
@@ -205,33 +309,33 @@ public:
       return;
     }
 
-    // Delete the old buffer, update the shape, and allocate a new one.
-    if (!isUnowned())
-      alignedFree(getData());
+    // Drop the old buffer, update the shape, and allocate a new one.
+    buffer_.reset();
+    data_ = nullptr;
+    isUnowned_ = false;
+    isPinned_ = false;
     type_ = T;
 
     if (size()) {
-      size_t count = size() * type_.getElementSize();
-      data_.setPointer(alignedAlloc(count, TensorAlignment));
+      buffer_ = allocateBuffer(size() * type_.getElementSize());
+      data_ = buffer_.get();
       zero();
     }
   }
 
-  ~Tensor() {
-    if (!isUnowned()) {
-      alignedFree(getData());
-    }
-  }
+  ~Tensor() = default;
 
   // Move ctor.
-  Tensor(Tensor &&other) noexcept {
-    std::swap(data_, other.data_);
-    std::swap(type_, other.type_);
-  }
+  Tensor(Tensor &&other) noexcept { *this = std::move(other); }
 
   /// Move assignment operator.
   Tensor &operator=(Tensor &&other) noexcept {
     std::swap(data_, other.data_);
+    std::swap(buffer_, other.buffer_);
+    std::swap(isUnowned_, other.isUnowned_);
+    bool isPinned = isPinned_;
+    isPinned_ = other.isPinned_.load();
+    other.isPinned_ = isPinned;
     std::swap(type_, other.type_);
     return *this;
   }
@@ -246,16 +350,26 @@ public:
     switch (getElementType()) {
     case ElemKind::FloatTy:
       return isEqualImpl<float>(other, allowedError);
+    case ElemKind::Float16Ty:
+      return isEqualImpl<float16>(other, allowedError);
     case ElemKind::Int8QTy:
       assert(getType().getScale() == other.getType().getScale() &&
              "Scales must match.");
       assert(getType().getOffset() == other.getType().getOffset() &&
              "Offsets must match.");
       return isEqualImpl<int8_t>(other, allowedError);
+    case ElemKind::Int16QTy:
+      assert(getType().getScale() == other.getType().getScale() &&
+             "Scales must match.");
+      assert(getType().getOffset() == other.getType().getOffset() &&
+             "Offsets must match.");
+      return isEqualImpl<int16_t>(other, allowedError);
     case ElemKind::Int32QTy:
       return isEqualImpl<int32_t>(other, allowedError);
     case ElemKind::IndexTy:
       return isEqualImpl<size_t>(other, allowedError);
+    case ElemKind::Int32ITy:
+      return isEqualImpl<int32_t>(other, allowedError);
     }
 
     // This is to make compiler happy. It can never reach this point as switch
@@ -263,21 +377,33 @@ public:
     llvm_unreachable("unreachable");
   }
 
-  /// Update the content of the tensor from the tensor \p t.
+  /// Update the content of the tensor from the tensor \p t. The tensor
+  /// shares the buffer of \p t until one of them is written, unless the
+  /// buffer of either of them must stay in place.
   void copyFrom(const Tensor *t) {
     assert(this != t && "Copying to self");
+    if (canShareBufferOf(t)) {
+      type_ = t->type_;
+      shareBufferOf(t);
+      return;
+    }
     reset(t);
     size_t bufferSize = size() * type_.getElementSize();
-    std::copy(&t->getData()[0], &t->getData()[bufferSize], getData());
+    std::copy(&t->getData()[0], &t->getData()[bufferSize], getMutableData());
   }
 
-  /// Update the raw data of the tensor from the tensor \p t.
+  /// Update the raw data of the tensor from the tensor \p t. The buffer is
+  /// shared as in copyFrom.
   void copyRawFrom(const Tensor *t) {
     assert(this != t && "Copying to self");
     assert(size() == t->size());
     assert(getElementType() == t->getElementType() && "Invalid element type");
+    if (canShareBufferOf(t)) {
+      shareBufferOf(t);
+      return;
+    }
     size_t bufferSize = size() * type_.getElementSize();
-    std::copy(&t->getData()[0], &t->getData()[bufferSize], getData());
+    std::copy(&t->getData()[0], &t->getData()[bufferSize], getMutableData());
   }
 
   /// Update the content of the tensor with a slice from tensor \p t. A slice
@@ -290,7 +416,7 @@ public:
 
     size_t bufferSize = size() * type_.getElementSize();
     std::copy(&t->getData()[bufferSize * slice],
-              &t->getData()[bufferSize * (slice + 1)], getData());
+              &t->getData()[bufferSize * (slice + 1)], getMutableData());
   }
 
   /// Update the content of the tensor with a sequence of slices from the
@@ -309,11 +435,12 @@ public:
     size_t bufferSize = numElementsInSlice * type_.getElementSize();
 
     // For each outer slice in the current tensor:
+    char *data = getMutableData();
     for (size_t n = 0, e = dims()[0]; n < e; n++) {
       size_t startIdx = (startSliceIdx + n) % numSlicesInInput;
       std::copy(&t->getData()[bufferSize * startIdx],
                 &t->getData()[bufferSize * (startIdx + 1)],
-                &getData()[bufferSize * n]);
+                &data[bufferSize * n]);
     }
   }
 
@@ -336,23 +463,29 @@ public:
     broadcastToNewShapeImpl(this, dest, otherDims, axis);
   }
 
-  /// Create a new copy of the current tensor.
+  /// Create a new copy of the current tensor, which shares the buffer until
+  /// either of them is written.
   Tensor clone() const {
     Tensor slice;
     slice.copyFrom(this);
     return slice;
   }
 
-  /// Return the raw unsafe pointer to the tensor payload.
-  char *getUnsafePtr() const { return getData(); }
+  /// Return the raw unsafe pointer to the tensor payload. The pointer may be
+  /// kept and used for writing the payload, so the buffer of the tensor stays
+  /// in place and is not shared with the copies of the tensor anymore.
+  char *getUnsafePtr() const {
+    pin();
+    return getData();
+  }
 
   /// \return a new handle that points and manages this tensor.
   template <class ElemTy = float> Handle<ElemTy> getHandle();
 
 private:
   template <class ElemTy> bool isEqualImpl(Tensor &other, float allowedError) {
-    auto *myData = getRawDataPointer<ElemTy>();
-    auto *otherData = other.getRawDataPointer<ElemTy>();
+    auto *myData = reinterpret_cast<const ElemTy *>(getData());
+    auto *otherData = reinterpret_cast<const ElemTy *>(other.getData());
     for (size_t i = 0, e = size(); i < e; i++) {
       double delta = myData[i] - otherData[i];
       if (std::abs(delta) > allowedError) {
@@ -396,6 +529,9 @@ template <class ElemTy> class Handle final {
   /// only be used by the static factory method below.
   Handle() = default;
 
+  /// \returns the tensor for reading it, which doesn't copy a shared buffer.
+  const Tensor *getConstTensor() const { return tensor_; }
+
 public:
   /// Allocate a new invalid handle.
   static Handle createInvalidHandle() { return Handle(); }
@@ -428,8 +564,10 @@ public:
 
   ElemKind getElementType() const { return tensor_->getElementType(); }
 
-  /// Construct a Tensor handle.
+  /// Construct a Tensor handle. The handle pins the tensor, so its accessors
+  /// read and write the buffer of the tensor in place.
   explicit Handle(Tensor *tensor) : tensor_(tensor) {
+    tensor->pin();
     auto sizes = tensor->dims();
     numDims_ = sizes.size();
 
@@ -474,7 +612,7 @@ public:
   }
 
   void clear(ElemTy value = 0) {
-    auto *data = tensor_->getRawDataPointer<ElemTy>();
+    auto *data = reinterpret_cast<ElemTy *>(tensor_->getData());
     std::fill(&data[0], &data[0] + size(), value);
   }
 
@@ -482,7 +620,7 @@ public:
     assert(tensor_->isInBounds(indices));
     size_t index = getElementPtr(indices);
     assert(index < size() && "Out of bounds");
-    auto *data = tensor_->getRawDataPointer<ElemTy>();
+    auto *data = reinterpret_cast<ElemTy *>(tensor_->getData());
     return data[index];
   }
 
@@ -490,21 +628,21 @@ public:
     assert(tensor_->isInBounds(indices));
     size_t index = getElementPtr(indices);
     assert(index < size() && "Out of bounds");
-    auto *data = tensor_->getRawDataPointer<ElemTy>();
+    auto *data = getConstTensor()->template getRawDataPointer<ElemTy>();
     return data[index];
   }
 
   /// \returns the element at offset \p idx without any size calculations.
   ElemTy &raw(size_t index) {
     assert(index < size() && "Out of bounds");
-    auto *data = tensor_->getRawDataPointer<ElemTy>();
+    auto *data = reinterpret_cast<ElemTy *>(tensor_->getData());
     return data[index];
   }
 
   /// \returns the element at offset \p idx without any size calculations.
   const ElemTy &raw(size_t index) const {
     assert(index < size() && "Out of bounds");
-    auto *data = tensor_->getRawDataPointer<ElemTy>();
+    auto *data = getConstTensor()->template getRawDataPointer<ElemTy>();
     return data[index];
   }
 
@@ -519,7 +657,8 @@ public:
 
     // Extract the whole slice.
     size_t startIdx = sizeIntegral_[0] * idx;
-    ElemTy *base = tensor_->getRawDataPointer<ElemTy>() + startIdx;
+    const ElemTy *base =
+        getConstTensor()->template getRawDataPointer<ElemTy>() + startIdx;
     auto *dest = slice.getRawDataPointer<ElemTy>();
     std::copy(base, base + sizeIntegral_[0], dest);
 
@@ -585,20 +724,15 @@ public:
   /// row of \p input equals to norm of corresponding row of \p result.
   void initXavier(size_t filterSize) {
     assert(filterSize > 0 && "invalid filter size");
-    double scale = std::sqrt(3.0 / double(filterSize));
-    for (size_t i = 0, e = size(); i < e; i++) {
-      raw(i) = (nextRand()) * scale;
-    }
+    float scale = std::sqrt(3.0 / double(filterSize));
+    fillRandUniformImpl(-scale, scale);
   }
 
   /// Fill the tensor with uniformly distributed values in the range
   /// [low .. high].
   void randomize(float low, float high) {
     assert(low < high && "invalid range");
-    float range = (high - low);
-    for (size_t i = 0, e = size(); i < e; i++) {
-      raw(i) = (std::abs(nextRand())) * range + low;
-    }
+    fillRandUniformImpl(low, high);
   }
 
   /// \returns the mean and variance of the tensor.
@@ -630,9 +764,7 @@ public:
   /// tensor at {d_0 + O_0, d_1 + O_1, ... d_n + O_n}, where O is the offset
   /// vector. The tensors must be of the right dimensions.
   void insertTensors(Handle<ElemTy> &slice, llvm::ArrayRef<size_t> offset) {
-    auto sliceCoor = slice.dims().vec();
-    auto fusedCoor = dims().vec();
-    insertTensorsImpl(sliceCoor, fusedCoor, slice, true, offset, 0);
+    insertTensorsImpl(slice, true, offset);
   }
 
   /// Extract the tensor \p slice at location \p offset. This operation is
@@ -641,43 +773,79 @@ public:
   /// tensor at {d_0 + O_0, d_1 + O_1, ... d_n + O_n}, where O is the offset
   /// vector. The tensors must be of the right dimensions.
   void extractTensors(Handle<ElemTy> &slice, llvm::ArrayRef<size_t> offset) {
-    auto sliceCoor = slice.dims().vec();
-    auto fusedCoor = dims().vec();
-    insertTensorsImpl(sliceCoor, fusedCoor, slice, false, offset, 0);
+    insertTensorsImpl(slice, false, offset);
   }
 
 private:
+  /// Fill the tensor with the next numbers of the stream of fillRandUniform in
+  /// the range [low .. high]. The float tensors are filled in place, and the
+  /// others are converted from a float buffer.
+  void fillRandUniformImpl(float low, float high) {
+    if (std::is_same<ElemTy, float>::value) {
+      fillRandUniform(reinterpret_cast<float *>(tensor_->getData()),
+                      size(), low, high);
+      return;
+    }
+    std::vector<float> values(size());
+    fillRandUniform(values.data(), values.size(), low, high);
+    auto *data = reinterpret_cast<ElemTy *>(tensor_->getData());
+    for (size_t i = 0, e = values.size(); i < e; i++) {
+      data[i] = values[i];
+    }
+  }
+
   /// Concats or splits tensors.
-  /// This method concats or extracts a slice from a tensor.
-  /// \p sliceCoor and \p fusedCoor are temporary storage that the function uses
-  /// to construct the coordinates to access the tensor. They must be
-  /// initialized to be the size of the shape of the tensor. \p slice and \p
-  /// fused are the tensors to concat or extract. \p offset is the offset of the
-  /// slice to add or extract along the dimension \p offsetDim. \p d is the
-  /// recursion depth parameter that's following the number of the axis. if \p
-  /// isInsert is set then data is copied from \p slice to \p fused. Otherwise
-  /// data is copied from \p fused to \p slice.
-  void insertTensorsImpl(llvm::MutableArrayRef<size_t> sliceCoor,
-                         llvm::MutableArrayRef<size_t> fusedCoor,
-                         Handle<ElemTy> &slice, bool isInsert,
-                         llvm::ArrayRef<size_t> offset, unsigned d) {
-    bool isDone = (d == slice.dims().size());
-
-    if (isDone) {
-      if (isInsert) {
-        at(fusedCoor) = slice.at(sliceCoor);
-      } else {
-        slice.at(sliceCoor) = at(fusedCoor);
-      }
+  /// This method concats or extracts a slice from a tensor. \p slice is the
+  /// tensor to concat or extract. \p offset is the offset of the slice in
+  /// the fused tensor. If \p isInsert is set then data is copied from \p
+  /// slice to the fused tensor. Otherwise data is copied from the fused tensor
+  /// to \p slice. The inner dimensions that the slice spans entirely are
+  /// contiguous in both tensors, so they are copied as a single run, and only
+  /// the outer dimensions are iterated.
+  void insertTensorsImpl(Handle<ElemTy> &slice, bool isInsert,
+                         llvm::ArrayRef<size_t> offset) {
+    auto sliceDims = slice.dims();
+    size_t numDims = sliceDims.size();
+    assert(numDims == dims().size() && offset.size() == numDims &&
+           "Invalid slice dimensions");
+    if (slice.size() == 0) {
       return;
     }
 
-    for (size_t i = 0, e = slice.dims()[d]; i < e; i++) {
-      // Construct the coordinates for the slice and for the joint shape.
-      // Add the 'offset' to the dimension that we concat the shapes on.
-      sliceCoor[d] = i;
-      fusedCoor[d] = i + offset[d];
-      insertTensorsImpl(sliceCoor, fusedCoor, slice, isInsert, offset, d + 1);
+    // Find the outermost dimension of the contiguous run.
+    size_t runDim = numDims - 1;
+    size_t run = sliceDims[runDim];
+    while (runDim > 0 && sliceDims[runDim] == dims()[runDim]) {
+      run *= sliceDims[--runDim];
+    }
+
+    size_t fusedIdx = 0;
+    for (size_t i = 0; i < numDims; i++) {
+      fusedIdx += offset[i] * sizeIntegral_[i];
+    }
+    auto *fused = reinterpret_cast<ElemTy *>(tensor_->getData());
+    auto *sliced = reinterpret_cast<ElemTy *>(slice.tensor_->getData());
+
+    // The coordinates of the slice in the dimensions above the run.
+    size_t coor[max_tensor_dimensions] = {0};
+    for (size_t sliceIdx = 0, e = slice.size(); sliceIdx < e;
+         sliceIdx += run) {
+      if (isInsert) {
+        std::copy(sliced + sliceIdx, sliced + sliceIdx + run,
+                  fused + fusedIdx);
+      } else {
+        std::copy(fused + fusedIdx, fused + fusedIdx + run,
+                  sliced + sliceIdx);
+      }
+      // Move to the next run, like an odometer.
+      for (size_t d = runDim; d > 0; d--) {
+        fusedIdx += sizeIntegral_[d - 1];
+        if (++coor[d - 1] < sliceDims[d - 1]) {
+          break;
+        }
+        fusedIdx -= sliceDims[d - 1] * sizeIntegral_[d - 1];
+        coor[d - 1] = 0;
+      }
     }
   }
 };
@@ -34,6 +34,16 @@ struct TrainingConfig {
   float learningRate{0.01};
   float momentum{0.0};
   unsigned batchSize{1};
+  /// The number of the threads that train on consecutive mini-batches in
+  /// parallel. See ExecutionEngine::runBatch.
+  unsigned numWorkers{1};
+  /// The number of bytes of activations that may be live at once during
+  /// training. Above it the activations are recomputed in the backward pass
+  /// instead of being kept. Zero keeps all the activations.
+  size_t activationBudget{0};
+  /// The max number of instructions that are recomputed for one dropped
+  /// activation. The activations of the other instructions are kept.
+  unsigned recomputeDepth{3};
 };
 
 } // namespace glow
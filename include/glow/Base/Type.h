@@ -16,6 +16,7 @@
 #ifndef GLOW_BASE_TYPE_H
 #define GLOW_BASE_TYPE_H
 
+#include "glow/Base/Float16.h"
 #include "glow/Support/Compiler.h"
 
 #include "llvm/ADT/ArrayRef.h"
@@ -98,9 +99,12 @@ inline bool operator==(const ShapeNHWC &LHS, const ShapeNHWC &RHS) {
 
 enum class ElemKind : unsigned char {
   FloatTy,
+  Float16Ty,
   Int8QTy,
+  Int16QTy,
   Int32QTy,
   IndexTy,
+  Int32ITy, // A 32-bit index, for the index tensors that fit in it.
 };
 
 /// A class that represents a type of a tensor.
@@ -218,12 +222,18 @@ struct Type final {
     switch (Ty) {
     case ElemKind::FloatTy:
       return std::is_same<ElemTy, float>::value;
+    case ElemKind::Float16Ty:
+      return std::is_same<ElemTy, float16>::value;
     case ElemKind::Int8QTy:
       return std::is_same<ElemTy, int8_t>::value;
+    case ElemKind::Int16QTy:
+      return std::is_same<ElemTy, int16_t>::value;
     case ElemKind::Int32QTy:
       return std::is_same<ElemTy, int32_t>::value;
     case ElemKind::IndexTy:
       return std::is_same<ElemTy, size_t>::value;
+    case ElemKind::Int32ITy:
+      return std::is_same<ElemTy, int32_t>::value;
     }
     GLOW_UNREACHABLE("Invalid type.");
   }
@@ -231,7 +241,19 @@ struct Type final {
   /// \returns true if the type of this Tensor is one of the integer types.
   /// Notice that we don't consider IndexTy as an integer because we are not
   /// performing calculations on this type.
-  bool isQuantizedType() const { return isType<int8_t>() || isType<int32_t>(); }
+  bool isQuantizedType() const {
+    return elementType_ == ElemKind::Int8QTy ||
+           elementType_ == ElemKind::Int16QTy ||
+           elementType_ == ElemKind::Int32QTy;
+  }
+
+  /// \returns true if the type of this Tensor is one of the index types.
+  bool isIndexType() const { return isIndexType(elementType_); }
+
+  /// \returns true if \p Ty is one of the index types.
+  static bool isIndexType(ElemKind Ty) {
+    return Ty == ElemKind::IndexTy || Ty == ElemKind::Int32ITy;
+  }
 
   /// \return the size of the type element.
   unsigned getElementSize() const { return getElementSize(elementType_); }
@@ -244,12 +266,18 @@ struct Type final {
     switch (Ty) {
     case ElemKind::FloatTy:
       return sizeof(float);
+    case ElemKind::Float16Ty:
+      return sizeof(float16);
     case ElemKind::Int8QTy:
       return sizeof(int8_t);
+    case ElemKind::Int16QTy:
+      return sizeof(int16_t);
     case ElemKind::Int32QTy:
       return sizeof(int32_t);
     case ElemKind::IndexTy:
       return sizeof(size_t);
+    case ElemKind::Int32ITy:
+      return sizeof(int32_t);
     }
     GLOW_UNREACHABLE("Invalid type.");
   }
@@ -263,9 +291,12 @@ struct Type final {
   static llvm::StringRef getElementName(ElemKind Ty) {
     static const char *names[] = {
         "float",
+        "float16",
         "i8",
+        "i16",
         "i32",
         "index",
+        "index32",
     };
     return names[(int)Ty];
   }
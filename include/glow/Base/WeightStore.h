@@ -0,0 +1,60 @@
+/**
+ * Copyright (c) 2017-present, Facebook, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#ifndef GLOW_BASE_WEIGHTSTORE_H
+#define GLOW_BASE_WEIGHTSTORE_H
+
+#include "glow/Base/Tensor.h"
+
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+namespace glow {
+
+/// A content-addressed store of constant tensors, e.g. the weights of the
+/// fine-tuned variants or of the replicas of a model loaded into several
+/// modules. The tensors with the same type and content are kept in memory
+/// once, and are shared by all of their users. The store does not keep the
+/// tensors alive: a tensor is freed when its last user drops its reference,
+/// even if the store outlives it. The store is thread-safe.
+class WeightStore final {
+  /// The tensors of the store by the hash of their content. The tensors with
+  /// the same hash are told apart by their type and their content.
+  std::unordered_map<size_t, std::vector<std::weak_ptr<Tensor>>> tensors_;
+  /// Serializes the accesses to the store.
+  mutable std::mutex mutex_;
+
+public:
+  /// A reference to a tensor of the store, which keeps it alive.
+  using TensorRef = std::shared_ptr<const Tensor>;
+
+  /// \returns a reference to the tensor of the store that has the type and
+  /// the content of \p T. If there is no such tensor, \p T is moved into the
+  /// store and becomes that tensor.
+  TensorRef intern(Tensor &&T);
+
+  /// \returns the number of tensors in the store that are still referenced.
+  size_t getNumTensors() const;
+
+  /// \returns the size in bytes of the tensors in the store that are still
+  /// referenced.
+  size_t getSizeInBytes() const;
+};
+
+} // namespace glow
+
+#endif // GLOW_BASE_WEIGHTSTORE_H
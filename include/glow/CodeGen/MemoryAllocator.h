@@ -18,6 +18,9 @@
 #include <cstddef>
 #include <cstdint>
 #include <list>
+#include <vector>
+
+#include "llvm/ADT/ArrayRef.h"
 
 namespace glow {
 
@@ -80,6 +83,37 @@ public:
   size_t getMaxMemoryUsage() const { return maxMemoryAllocated_; }
 };
 
+/// A buffer for the offline memory allocation. The buffer is live during the
+/// half-open interval [start .. end) of program points.
+struct LiveBuffer {
+  /// The size of the buffer.
+  size_t size_;
+  /// The first program point at which the buffer is live.
+  size_t start_;
+  /// The buffer is dead from this program point on.
+  size_t end_;
+
+  LiveBuffer(size_t size, size_t start, size_t end)
+      : size_(size), start_(start), end_(end) {}
+
+  /// \returns True if this buffer and \p other are live at the same time.
+  bool interferesWith(const LiveBuffer &other) const {
+    return start_ < other.end_ && other.start_ < end_;
+  }
+};
+
+/// Assign addresses to the \p buffers, whose live intervals are all known up
+/// front, so that the buffers that are live at the same time don't overlap.
+/// Unlike the MemoryAllocator, which serves the requests in program order,
+/// this places the buffers in the order of decreasing size, every buffer into
+/// the smallest gap that it fits between the already placed buffers that are
+/// live at the same time. This avoids most of the fragmentation of the first
+/// fit allocation. The address of the i-th buffer is stored into the i-th
+/// element of \p addresses.
+/// \returns the peak memory usage.
+size_t allocateOffline(llvm::ArrayRef<LiveBuffer> buffers,
+                       std::vector<size_t> &addresses);
+
 } // namespace glow
 
 #endif // GLOW_CODEGEN_MEMORYALLOCATOR_H
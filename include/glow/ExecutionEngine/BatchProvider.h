@@ -0,0 +1,80 @@
+/**
+ * Copyright (c) 2017-present, Facebook, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#ifndef GLOW_EXECUTIONENGINE_BATCHPROVIDER_H
+#define GLOW_EXECUTIONENGINE_BATCHPROVIDER_H
+
+#include "llvm/ADT/ArrayRef.h"
+
+#include <fstream>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace glow {
+
+class Tensor;
+
+/// A source of the mini-batches of ExecutionEngine::runBatch(), which
+/// streams them instead of slicing them out of tensors that hold the whole
+/// data set, e.g. from files larger than the memory.
+class BatchProvider {
+public:
+  virtual ~BatchProvider() = default;
+
+  /// Fill the tensors \p batch, one for every input variable of runBatch()
+  /// and with its type, with the next mini-batch. \returns false if the data
+  /// set is exhausted. runBatch() calls this on a background thread while the
+  /// previous mini-batch trains, but never concurrently with itself.
+  virtual bool next(llvm::ArrayRef<Tensor *> batch) = 0;
+};
+
+/// Provides the consecutive slices of the tensors \p inputs that hold the
+/// whole data set, one tensor for every input variable, like runBatch() on
+/// tensors does. The slices wrap around, so this is never exhausted.
+class TensorBatchProvider final : public BatchProvider {
+  /// The data set, one tensor for every input variable.
+  std::vector<Tensor *> inputs_;
+  /// The index of the first sample of the next mini-batch.
+  size_t sampleIdx_{0};
+
+public:
+  explicit TensorBatchProvider(llvm::ArrayRef<Tensor *> inputs)
+      : inputs_(inputs.begin(), inputs.end()) {}
+
+  bool next(llvm::ArrayRef<Tensor *> batch) override;
+};
+
+/// Reads the mini-batches from the files \p paths, one file for every input
+/// variable. A file holds the raw samples of its input one after the other,
+/// in the element type and the layout of the variable without its batch
+/// dimension. The files are read sequentially as the training consumes them.
+/// With \p loop the files are read again from the start when they end, and
+/// otherwise the data set is exhausted at the first incomplete mini-batch.
+class FileBatchProvider final : public BatchProvider {
+  /// The open files, one for every input variable.
+  std::vector<std::unique_ptr<std::ifstream>> files_;
+  /// Whether the files are read again from the start when they end.
+  bool loop_;
+
+public:
+  FileBatchProvider(llvm::ArrayRef<std::string> paths, bool loop);
+
+  bool next(llvm::ArrayRef<Tensor *> batch) override;
+};
+
+} // namespace glow
+
+#endif // GLOW_EXECUTIONENGINE_BATCHPROVIDER_H
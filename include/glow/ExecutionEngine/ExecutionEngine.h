@@ -23,18 +23,45 @@
 
 #include "llvm/ADT/ArrayRef.h"
 
+#include <functional>
+#include <future>
 #include <memory>
 #include <unordered_map>
+#include <vector>
 
 namespace glow {
 
 class Function;
 class Node;
 class Interpreter;
+class SaveNode;
 class Variable;
 class Tensor;
 class Module;
 class Value;
+class WeightStore;
+class BatchProvider;
+enum class SchedulerKind;
+
+/// The latencies of the warm-up of a compiled function, see
+/// ExecutionEngine::setWarmUp().
+struct WarmUpReport {
+  /// The time of the first run in seconds, which faults in the pages that
+  /// were not prefaulted and warms the caches, or 0 if there was no run.
+  double coldSeconds{0};
+  /// The time of the fastest of the later runs in seconds, or 0 if there was
+  /// at most one run.
+  double warmSeconds{0};
+};
+
+/// The place of an input or an output of the compiled function in the memory
+/// of ExecutionEngine::bindIO().
+struct IOSlot {
+  /// The public variable of the input or output.
+  Variable *var;
+  /// The offset of its tensor in the memory, in bytes.
+  size_t offset;
+};
 
 /// This is the ExecutionEngine. It owns the Graph, the IR, and the backends.
 /// The Graph, IR, etc in this class are defined as pointers, in order to
@@ -49,12 +76,111 @@ class ExecutionEngine final {
   std::unique_ptr<Backend> IP_;
   /// The training configuration.
   TrainingConfig config_;
+  /// The index of the sample that the next iteration of runBatch() starts
+  /// at. Every engine counts its own samples, so the mini-batches of one
+  /// engine don't depend on the training that other engines did before.
+  size_t trainCounter_{0};
+  /// The store that the constant weights of the compiled functions are
+  /// shared through, if any.
+  std::shared_ptr<WeightStore> weightStore_;
   /// The kind of the backend being currently used.
   BackendKind backendKind_;
+  /// Whether the backend runs the code loaded by loadCompiled(), which has no
+  /// IR.
+  bool isCompiledLoaded_{false};
+  /// Whether the functions compiled for inference keep the source of their
+  /// constant weights, see updateWeights().
+  bool updatableWeights_{false};
+  /// The max number of bytes of the activations of the compiled functions,
+  /// or 0 for no limit. See setActivationsLimit().
+  size_t activationsLimit_{0};
+  /// The scheduler of the nodes of the compiled functions, see
+  /// setScheduler().
+  SchedulerKind scheduler_;
+  /// Whether the compiled functions fault in their memory, see setWarmUp().
+  bool warmUpPrefault_{false};
+  /// The number of the warm-up runs of the compiled functions.
+  unsigned warmUpRuns_{0};
+  /// The latencies of the last warm-up.
+  WarmUpReport warmUpReport_;
+  /// A copy of the function compiled for inference and of its variables,
+  /// before the optimizations transformed them. This is null unless the
+  /// weights are updatable.
+  std::unique_ptr<Module> weightsSource_;
+  /// A function that was compiled for a backend of its own.
+  struct CompiledFunction {
+    std::unique_ptr<IRFunction> IR;
+    std::unique_ptr<Backend> backend;
+  };
+  /// The partitions of the function compiled for several backends, in the
+  /// order in which they run. This is empty if the function was compiled for
+  /// the single backend of the engine.
+  std::vector<CompiledFunction> partitions_;
+  /// The functions that the partitions were split into, and the public
+  /// variables through which they exchange the values. reset() erases them
+  /// from the module.
+  std::vector<Function *> partitionFunctions_;
+  std::vector<Variable *> transferVars_;
+  /// The entry points of the function, which compute some of its outputs
+  /// only, see compileEntries().
+  std::vector<CompiledFunction> entries_;
+  /// A copy of the train function that trains on mini-batches of its own.
+  struct Replica {
+    CompiledFunction code;
+    /// Maps the variables of the original function to the copies that this
+    /// replica reads and writes instead.
+    std::unordered_map<Variable *, Variable *> vars;
+  };
+  /// The replicas of the train function beside the function of the engine
+  /// itself, see TrainingConfig::numWorkers.
+  std::vector<Replica> replicas_;
+  /// The queue and the threads that run the asynchronous requests.
+  struct AsyncQueue;
+  /// Created by the first asynchronous request. This is declared last, so the
+  /// threads finish the pending requests before the backend is destroyed.
+  std::unique_ptr<AsyncQueue> async_;
+
+  /// Optimize the graph, lower it and let the backend \p B transform it.
+  void optimizeFunction(CompilationMode mode, Function *F, Backend *B);
+
+  /// Share the constant weights of the module through the weight store, if
+  /// the engine has one and the code is compiled for inference.
+  void shareWeights(CompilationMode mode);
 
   /// Optimize the graph, generate IR, and optimize the IR.
   void generateIR(CompilationMode mode, Function *F);
 
+  /// Generate the IR of the optimized function \p F into \p IR and optimize
+  /// it, within the limit of the activations, if any.
+  void generateFunctionIR(CompilationMode mode, Function *F, IRFunction &IR);
+
+  /// Abort with a report of the activations live at their peak in \p IR if
+  /// the backend \p B allocated more memory for them than the limit.
+  void checkActivationsLimit(IRFunction &IR, const Backend &B) const;
+
+  /// Warm up the function that was compiled for inference or loaded, as
+  /// setWarmUp() asks.
+  void warmUp();
+
+  /// Compile \p F for a new backend of the kind \p kind. \returns the IR and
+  /// the initialized backend.
+  CompiledFunction compileFunction(CompilationMode mode, Function *F,
+                                   BackendKind kind);
+
+  /// Compile the parts \p parts that \p F was split into, each for the backend
+  /// of its kind, as the partitions of the engine. The parts and their
+  /// transfer variables are erased by the next reset().
+  void compilePartitions(
+      CompilationMode mode, Function *F,
+      llvm::ArrayRef<std::pair<Function *, BackendKind>> parts);
+
+  /// Compile the copies of the train function \p F for the additional workers
+  /// of the training configuration.
+  void createReplicas(CompilationMode mode, Function *F);
+
+  /// Replace the variables that the replicas update by their averages.
+  void averageReplicas();
+
 public:
   ExecutionEngine(BackendKind backendKind = BackendKind::Interpreter);
 
@@ -78,15 +204,137 @@ public:
     return IP_->isOpSupported(opKind, elementTy);
   }
 
+  /// Convert the nodes of \p F that the backend supports in float16 to
+  /// float16. This should be invoked before the compile method.
+  void convertToFloat16(Function *F) { ::glow::convertToFloat16(F, *IP_); }
+
   /// Optimize the graph, generate IR, optimize IR and compile it for a
   /// specific target. This method should be invoked before the run method.
   void compile(CompilationMode mode, Function *F);
 
+  /// Split \p F into parts that run on the backends \p backends, in the
+  /// order of preference, and compile every part for its backend. The nodes
+  /// that the first backends don't support run on the later ones, so that
+  /// e.g. an accelerator runs all of the layers that it supports. The parts
+  /// exchange their values through the host memory. The parts are added to
+  /// the module until the next compilation. Sessions are not supported for
+  /// the partitioned functions.
+  void compile(CompilationMode mode, Function *F,
+               llvm::ArrayRef<BackendKind> backends);
+
+  /// Compile \p F as compile() does, and an entry point for every list of
+  /// saves of \p F in \p entries, which computes only these outputs and the
+  /// nodes that they need, e.g. the logits of a network without its
+  /// intermediate features. The entries run with run(entry, ...). They read
+  /// and write the variables of the module, so they share the weights with
+  /// \p F. Sessions are not supported for the entries.
+  void compileEntries(CompilationMode mode, Function *F,
+                      llvm::ArrayRef<std::vector<SaveNode *>> entries);
+
+  /// \returns the number of the entry points compiled by compileEntries().
+  size_t getNumEntries() const { return entries_.size(); }
+
+  /// Split \p F into at most \p numStages stages of about the same cost and
+  /// compile every stage for the backend of the engine, see
+  /// splitIntoStages(). The stages run one after the other in run(), and as
+  /// a pipeline in runPipeline().
+  void compilePipeline(CompilationMode mode, Function *F, unsigned numStages);
+
+  /// \returns the number of the parts of the function compiled for several
+  /// backends, or 1 if it was compiled for the backend of the engine.
+  size_t getNumPartitions() const {
+    return partitions_.empty() ? 1 : partitions_.size();
+  }
+
   /// Save a bundle for a standalone execution. This method takes care of
   /// everything when preparing the bundle for saving. There is no need to
   /// invoke the compile method before it.
   void save(CompilationMode mode, Function *F, llvm::StringRef outputDir);
 
+  /// Save a bundle named \p bundleName with an entry point for every function
+  /// of \p functions, e.g. for the variants of a network with different batch
+  /// sizes. The identical constant weights of the functions are merged, and
+  /// all of the entry points share one constant weights area.
+  void save(CompilationMode mode, llvm::ArrayRef<Function *> functions,
+            llvm::StringRef outputDir, llvm::StringRef bundleName);
+
+  /// Compile \p F for inference and save the compiled code, its memory layout
+  /// and its constant weights into the file \p path, which loadCompiled()
+  /// makes ready to run in a fraction of the time of the compilation. There
+  /// is no need to invoke the compile method before it, and the engine runs
+  /// \p F afterwards.
+  void saveCompiled(Function *F, llvm::StringRef path);
+
+  /// Load the code saved by saveCompiled() into the file \p path, instead of
+  /// compiling a function. The module of the engine is replaced by a module
+  /// with the inputs and outputs of the code, i.e. the public variables of
+  /// the saved function, which keep their names. The backend of the engine
+  /// must be the one that saved the code.
+  void loadCompiled(llvm::StringRef path);
+
+  /// Share the constant weights of the functions compiled for inference
+  /// from now on through \p store, so that the weights with the same type
+  /// and content as the weights of other modules that use \p store, e.g. of
+  /// other engines that load the same model, are kept in memory once. The
+  /// weights of the private variables that are not trained become read-only
+  /// views of the tensors of the store. A null \p store stops the sharing.
+  void setWeightStore(std::shared_ptr<WeightStore> store) {
+    weightStore_ = std::move(store);
+  }
+
+  /// Keep a copy of the functions compiled for inference from now on, so that
+  /// their constant weights can be replaced by updateWeights(). The copies of
+  /// the weights share their buffers with the variables of the module until
+  /// the compilation transforms them.
+  void setUpdatableWeights(bool enable) { updatableWeights_ = enable; }
+
+  /// Compile the functions from now on so that at most \p bytes bytes of
+  /// activations are live at once, e.g. for a device with little memory. When
+  /// the activations exceed \p bytes, the nodes are scheduled again to
+  /// minimize the peak of the live results, and then activations are
+  /// recomputed before their late uses instead of being kept. If they still
+  /// don't fit, the compilation aborts with a report of the activations live
+  /// at the peak. Zero removes the limit.
+  void setActivationsLimit(size_t bytes) { activationsLimit_ = bytes; }
+
+  /// Order the nodes of the functions compiled from now on with the scheduler
+  /// \p kind instead of the one of -graph-scheduler. A limit on the
+  /// activations may still reschedule them, see setActivationsLimit().
+  void setScheduler(SchedulerKind kind) { scheduler_ = kind; }
+
+  /// Warm up the functions compiled for inference, or loaded by
+  /// loadCompiled(), from now on, so that the first request doesn't pay for
+  /// the cold memory and caches. If \p prefault is set, the pages of the
+  /// activations and of the constant weights of the backends are faulted in.
+  /// Then the function runs \p numRuns times on the current content of its
+  /// inputs, which writes its outputs, and its states are reset afterwards.
+  /// The latencies of the runs are found in getWarmUpReport().
+  void setWarmUp(bool prefault, unsigned numRuns = 0) {
+    warmUpPrefault_ = prefault;
+    warmUpRuns_ = numRuns;
+  }
+
+  /// \returns the latencies of the warm-up runs of the last compilation.
+  const WarmUpReport &getWarmUpReport() const { return warmUpReport_; }
+
+  /// Wait until the backends run the optimized code that they compile in the
+  /// background, if any. \returns true if the code of a backend was replaced.
+  bool waitForOptimizedCode();
+
+  /// Replace the weights named \p names of the function compiled for
+  /// inference by \p weights, without recompiling the function. The names
+  /// are the ones of the private variables before the compilation, and the
+  /// weights must have their types. The weights that the compilation derived
+  /// from them, e.g. the filters that batch normalizations were folded into,
+  /// the reformatted filters of the backend and the quantized weights, are
+  /// derived again by the graph optimizations, and the IR, the code and the
+  /// memory allocation of the function are kept. The quantized weights keep
+  /// the quantization parameters of the compilation. The weights that are
+  /// shared through a weight store can't be updated. setUpdatableWeights()
+  /// must be set before compile(), and no run may be in progress.
+  void updateWeights(llvm::ArrayRef<llvm::StringRef> names,
+                     llvm::ArrayRef<Tensor *> weights);
+
   /// Provides access to the training configuration.
   TrainingConfig &getConfig() { return config_; }
 
@@ -94,18 +342,171 @@ public:
   /// values \p inputs.
   void run(llvm::ArrayRef<Variable *> vars, llvm::ArrayRef<Tensor *> inputs);
 
+  /// Runs the entry point with the index \p entry of compileEntries() in a
+  /// forward pass, after updating the variables \p vars with \p inputs.
+  /// Only the outputs of the entry are computed.
+  void run(size_t entry, llvm::ArrayRef<Variable *> vars,
+           llvm::ArrayRef<Tensor *> inputs);
+
+  /// Stream the requests \p inputs through the stages of the function
+  /// compiled by compilePipeline(), or through the parts of a partitioned
+  /// function. Request i sets the variables \p vars to the tensors inputs[i],
+  /// and its values of the variables \p outputs are copied into results[i].
+  /// Every stage runs on a thread of its own, which is pinned to the
+  /// processors coreGroups[stage % coreGroups.size()] if any are given, and
+  /// computes a request while the earlier stages compute the next ones, so
+  /// the throughput is set by the slowest stage. There are as many requests
+  /// in flight as stages, and each has its own values between the stages.
+  /// The backends must support sessions. Returns when all of the requests
+  /// are done.
+  void runPipeline(llvm::ArrayRef<Variable *> vars,
+                   llvm::ArrayRef<std::vector<Tensor *>> inputs,
+                   llvm::ArrayRef<Variable *> outputs,
+                   llvm::ArrayRef<std::vector<Tensor *>> results,
+                   llvm::ArrayRef<std::vector<int>> coreGroups = {});
+
+  /// Use the tensor \p T, owned by the caller, as the payload of the public
+  /// variable \p v. The compiled code reads and writes \p T in place, so
+  /// running with \p T as the input of \p v doesn't copy it. \p T must have
+  /// the type of \p v and must outlive the binding. A null \p T gives \p v a
+  /// payload of its own again, with the current content.
+  void bind(Variable *v, Tensor *T);
+
+  /// \returns the layout of the inputs and outputs of the module, i.e. of its
+  /// public variables that are not states, in the memory of bindIO(). The
+  /// tensors are in the order of the variables, and aligned to
+  /// TensorAlignment bytes. Every module with the same public variables, e.g.
+  /// that of a frontend that loads the same model, has the same layout.
+  std::vector<IOSlot> getIOLayout() const;
+
+  /// \returns the size in bytes of the memory of bindIO().
+  size_t getIOSize() const;
+
+  /// Bind the inputs and outputs of the module to the tensors in the \p size
+  /// bytes of \p memory at the places of getIOLayout(), see bind(). The
+  /// memory may be shared with another process, e.g. a SharedMemory segment
+  /// of a frontend, which then writes the inputs of a request and reads its
+  /// outputs in place, without copies. The runs then take no inputs. A null
+  /// \p memory gives the variables payloads of their own again.
+  void bindIO(void *memory, size_t size);
+
+  /// \returns the payload of the state variable \p v, see
+  /// Module::createState(), with the value that the last run left. The
+  /// backends that keep the state on the device copy it into the payload.
+  /// The states of the sessions are the tensors of the sessions instead.
+  /// States are not supported for the partitioned functions.
+  Tensor &readState(Variable *v);
+
+  /// Make the next runs use the payload of the state variable \p v, which
+  /// the caller updated in place, as the value of the state.
+  void writeState(Variable *v);
+
+  /// Set the state variable \p v to zero, e.g. before a new sequence.
+  void resetState(Variable *v);
+
+  /// Replace every row of the state variable \p v, i.e. every slice of its
+  /// first dimension, by the row of the state with the index at the same
+  /// position in \p rows, without copying the state out of the device. A
+  /// beam search calls this after every step with the hypotheses that it
+  /// keeps. The payload of \p v is only up to date after readState().
+  void reorderState(Variable *v, llvm::ArrayRef<size_t> rows);
+
+  /// Create a session for running the compiled function. Every session has its
+  /// own copies of the inputs and outputs and its own activations, so several
+  /// sessions can run inference concurrently on different threads. The
+  /// backend must support sessions.
+  std::unique_ptr<ExecutionSession> createSession();
+
+  /// Runs the program in a forward pass in \p session. Update the tensors of
+  /// the variables \p vars in the session with the values \p inputs. The
+  /// results are found in the tensors of the output variables in the session.
+  /// This method can be called concurrently for different sessions.
+  void run(ExecutionSession &session, llvm::ArrayRef<Variable *> vars,
+           llvm::ArrayRef<Tensor *> inputs);
+
+  /// Start a forward pass in \p session and return without waiting for it.
+  /// The tensors of the variables \p vars in the session are updated with the
+  /// values \p inputs before returning, so the caller may reuse \p inputs
+  /// right away. The pass runs on a thread of the engine and calls \p done,
+  /// if given, on that thread when the results are ready. Requests in
+  /// different sessions run concurrently, and the engine copies the inputs
+  /// of a request while the earlier ones compute. A session must not be used
+  /// again before its request is done. \returns a future that becomes ready
+  /// after \p done returns.
+  std::future<void> runAsync(ExecutionSession &session,
+                             llvm::ArrayRef<Variable *> vars,
+                             llvm::ArrayRef<Tensor *> inputs,
+                             std::function<void()> done = nullptr);
+
+  /// Print the per-layer profile of the runs so far. The backend must have
+  /// been asked to profile the code, e.g. by -cpu-profile for the CPU backend.
+  void dumpProfile();
+
+  /// Compute only the first \p batchSize samples of the inputs and outputs
+  /// in the next runs, without recompiling. \p batchSize must not exceed the
+  /// batch that the network was compiled for. The CPU backend needs
+  /// -cpu-dynamic-batch for this, the other backends compute the whole batch.
+  void setBatchSize(size_t batchSize);
+
+  /// \returns the size in bytes of the memory of the activations of the
+  /// compiled function, which an arena of setActivationArena grows to. The
+  /// parts of a partitioned function and the entry points run one at a time,
+  /// so this is the size of the largest one.
+  size_t getActivationsSize() const;
+
+  /// Keep the activations of the compiled function in \p arena, which the
+  /// functions of other engines that never run at the same time may share,
+  /// instead of in memory of its own. The entry points of the function share
+  /// the arena too. This holds until the next compilation. A null \p arena
+  /// gives the function memory of its own again. See
+  /// Backend::setActivationArena.
+  void setActivationArena(ActivationArena *arena);
+
   /// Train the network. Perform \p iterations in the training loop. Each
   /// iteration does a full forward and backward pass of a whole batch.
   /// The method updates the variables in \p vars with the tensors \p inputs.
+  /// With several workers in the training configuration, every iteration
+  /// trains the workers on consecutive mini-batches in parallel and then
+  /// averages their weights, which applies the average of their gradients.
   void runBatch(size_t iterations, llvm::ArrayRef<Variable *> vars,
                 llvm::ArrayRef<Tensor *> inputs);
 
+  /// Train the network for at most \p iterations iterations on the
+  /// mini-batches of \p provider, like runBatch() on tensors, for the data
+  /// sets that are streamed, e.g. from disk. The provider fills a tensor for
+  /// every variable of \p vars, and the variables are bound to these tensors,
+  /// so the batches are not copied again. The next mini-batches are fetched
+  /// on a background thread while the current one trains. Afterwards the
+  /// variables hold the last mini-batch in payloads of their own. \returns the
+  /// number of the iterations done, which is less than \p iterations if the
+  /// provider was exhausted.
+  size_t runBatch(size_t iterations, llvm::ArrayRef<Variable *> vars,
+                  BatchProvider &provider);
+
 private:
+  /// Run the forward pass of the compiled function on its backends.
+  void doForwardPass();
+
+  /// Update the tensors of the variables \p vars in \p session with the values
+  /// \p inputs.
+  void loadSessionInputs(ExecutionSession &session,
+                         llvm::ArrayRef<Variable *> vars,
+                         llvm::ArrayRef<Tensor *> inputs);
+
   /// Update the inputs for all variables \p vars with data from the inputs \p
   /// inputs at offset \p sampleIdx. Then perform a forward and backwards scan.
   void updateForwardBackward(llvm::ArrayRef<Variable *> vars,
                              llvm::ArrayRef<Tensor *> inputs, size_t sampleIdx);
 
+  /// Perform a forward and backwards scan of every worker on the mini-batch
+  /// in its input variables, and average the weights of the workers.
+  void doTrainingStep();
+
+  /// \returns the variable that the worker \p worker of the training reads
+  /// and writes instead of \p v, or null if it doesn't use \p v. The worker 0
+  /// is the function of the engine itself.
+  Variable *getWorkerVar(size_t worker, Variable *v);
+
   /// Update the content of the tensor \p v with some slices that from \p input.
   /// The data starts at slice \p sampleIdx and wraps around until the
   /// data in \p v is filled. All dimensions, except for the first (batch)
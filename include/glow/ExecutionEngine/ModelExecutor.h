@@ -0,0 +1,132 @@
+/**
+ * Copyright (c) 2017-present, Facebook, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#ifndef GLOW_EXECUTIONENGINE_MODELEXECUTOR_H
+#define GLOW_EXECUTIONENGINE_MODELEXECUTOR_H
+
+#include "llvm/ADT/ArrayRef.h"
+
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+namespace glow {
+
+class ExecutionEngine;
+class Tensor;
+class Variable;
+
+/// The quality of service of a model of a ModelExecutor.
+struct ModelQoS {
+  /// The requests of the models with a higher priority run first. When they
+  /// wait for cores, the running requests of the models with a lower priority
+  /// are preempted at their next kernel boundary.
+  int priority{0};
+  /// The number of cores that a request of the model holds while it runs: its
+  /// own thread and the other threads of its parallel kernels.
+  unsigned coresPerRequest{1};
+  /// The number of cores that the running requests of the model hold
+  /// together, which is a multiple of coresPerRequest. 0 is all of the cores
+  /// of the executor.
+  unsigned coreQuota{0};
+};
+
+/// Runs the requests of several compiled models that share the cores of the
+/// process. The requests of a model run in the sessions of its engine, each
+/// on a thread of its own, as long as the model stays within its core quota
+/// and the executor has free cores. The requests that wait for cores start in
+/// the order of the priorities of their models and then in the order of
+/// their submission. A request that waits for cores preempts the running
+/// requests of the models with a lower priority, which give up their cores
+/// at their next preemption point, see ExecutionSession::setPreemptionPoint,
+/// and resume where they stopped once the cores are free again. The CPU
+/// backend has preemption points between the kernels with -cpu-preemptible,
+/// and the code that runs in one piece is only preempted between requests.
+class ModelExecutor final {
+  /// A submitted request.
+  struct Request;
+  /// A thread of a model and its session.
+  struct Runner;
+  /// A model and its queue of requests.
+  struct Model;
+
+  std::mutex mutex_;
+  /// Signals the runners on new requests, on freed cores and on shutdown.
+  std::condition_variable wakeup_;
+  /// The number of cores of the executor and the number of the free ones.
+  unsigned numCores_;
+  unsigned freeCores_;
+  /// The number given to the next request, which orders the requests of
+  /// the same priority.
+  uint64_t nextSeq_{0};
+  bool shutdown_{false};
+  std::vector<std::unique_ptr<Model>> models_;
+
+  /// The main loop of the runner \p R of the model \p M.
+  void runnerLoop(Model &M, Runner &R);
+  /// Called by the runner \p R of the model \p M between the kernels of its
+  /// request. Blocks while a request of a higher priority needs the cores.
+  void preemptionPoint(Model &M, Runner &R);
+  /// \returns whether a request of the priority \p priority and the number
+  /// \p seq that needs \p cores cores can run now, i.e. the cores are free
+  /// and no other request that waits for cores comes before it. The mutex
+  /// must be held.
+  bool canRun(int priority, uint64_t seq, unsigned cores) const;
+  /// \returns whether a request of a higher priority than \p priority waits
+  /// for more cores than are free. The mutex must be held.
+  bool isPreempted(int priority) const;
+
+public:
+  /// Create an executor for \p numCores cores, or for all of the threads of
+  /// the pool of glow_parallel_for if 0.
+  explicit ModelExecutor(unsigned numCores = 0);
+
+  /// Finish the submitted requests and join the threads.
+  ~ModelExecutor();
+
+  /// \returns the number of the cores of the executor.
+  unsigned getNumCores() const { return numCores_; }
+
+  /// Add the function compiled for inference by \p EE as a model with the
+  /// quality of service \p qos, which creates a session and a thread for
+  /// every request that may run at once. \p EE must outlive the executor.
+  /// \returns the index of the model.
+  unsigned addModel(ExecutionEngine &EE, const ModelQoS &qos);
+
+  /// Submit a request of the model \p model, which sets the variables \p vars
+  /// to \p inputs and copies the values of the variables \p outputs into
+  /// \p results. The inputs are copied before returning, so the caller may
+  /// reuse them right away, and \p results must stay alive until the request
+  /// is done. \p done, if given, is called on the thread of the request when
+  /// the results are ready. \returns a future that becomes ready after \p done
+  /// returns.
+  std::future<void> submit(unsigned model, llvm::ArrayRef<Variable *> vars,
+                           llvm::ArrayRef<Tensor *> inputs,
+                           llvm::ArrayRef<Variable *> outputs,
+                           llvm::ArrayRef<Tensor *> results,
+                           std::function<void()> done = nullptr);
+
+  /// \returns the number of times that the requests of the model \p model
+  /// were preempted.
+  size_t getNumPreemptions(unsigned model);
+};
+
+} // namespace glow
+
+#endif // GLOW_EXECUTIONENGINE_MODELEXECUTOR_H
@@ -0,0 +1,75 @@
+/**
+ * Copyright (c) 2017-present, Facebook, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#ifndef GLOW_GRAPH_COST_H
+#define GLOW_GRAPH_COST_H
+
+#include "llvm/Support/raw_ostream.h"
+
+#include <cstddef>
+#include <cstdint>
+
+namespace glow {
+
+class Node;
+class Function;
+
+/// The analytic cost of an operation: the number of floating point (or
+/// integer) operations that it performs, where a multiply-add counts as two,
+/// and the number of bytes that it reads and writes. The cost is derived from
+/// the shapes alone, so it doesn't depend on the backend or on the data.
+struct OpCost {
+  /// The number of arithmetic operations.
+  uint64_t flops{0};
+  /// The number of bytes of the operands that are read and written.
+  uint64_t bytes{0};
+
+  OpCost() = default;
+  OpCost(uint64_t flops, uint64_t bytes) : flops(flops), bytes(bytes) {}
+
+  OpCost &operator+=(const OpCost &other) {
+    flops += other.flops;
+    bytes += other.bytes;
+    return *this;
+  }
+
+  /// \returns the arithmetic intensity, in operations per byte.
+  double getIntensity() const { return bytes ? double(flops) / bytes : 0; }
+};
+
+/// Print \p cost to \p os.
+llvm::raw_ostream &operator<<(llvm::raw_ostream &os, const OpCost &cost);
+
+/// \returns the operations of a convolution with a result of \p resultSize
+/// elements, whose filter of \p filterSize elements in any layout computes
+/// \p depth output channels. Every element of the result is the dot product
+/// of a window of the input with a filter of filterSize / depth elements.
+uint64_t getConvolutionFlops(size_t resultSize, size_t filterSize,
+                             size_t depth);
+
+/// \returns the operations of a matrix multiplication with a result of
+/// \p resultSize elements and the inner dimension \p innerSize.
+uint64_t getMatMulFlops(size_t resultSize, size_t innerSize);
+
+/// \returns the analytic cost of \p N. The variables cost nothing, and the
+/// nodes that only move data perform no operations.
+OpCost getCost(const Node *N);
+
+/// \returns the sum of the costs of the nodes of \p F.
+OpCost getCost(const Function *F);
+
+} // namespace glow
+
+#endif // GLOW_GRAPH_COST_H
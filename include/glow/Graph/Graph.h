@@ -22,6 +22,7 @@
 
 #include "llvm/ADT/ArrayRef.h"
 #include "llvm/ADT/DenseMap.h"
+#include "llvm/ADT/StringMap.h"
 #include "llvm/ADT/StringSet.h"
 
 #include <list>
@@ -31,7 +32,9 @@
 namespace glow {
 
 using TypesList = std::list<Type>;
-using NodesList = std::list<Node *>;
+using NodesList = IntrusiveList<Node>;
+/// A list of nodes that are owned by their function, e.g. a schedule.
+using NodesPtrList = std::vector<Node *>;
 using FunctionList = std::list<Function *>;
 using VariablesList = std::list<Variable *>;
 using UnsignedArrayRef = llvm::ArrayRef<size_t>;
@@ -44,6 +47,9 @@ class Module final {
   TypesList types_{};
   /// Stores a list of unique names that were used by the module at one point.
   llvm::StringSet<> uniqueNames_{};
+  /// The next suffix to try for each of the names that are made unique. This
+  /// keeps the naming of many nodes with the same name linear.
+  llvm::StringMap<unsigned> nextSuffixes_{};
   /// A list of variables that the Module owns.
   VariablesList vars_;
 
@@ -90,6 +96,8 @@ public:
   Function *getFunction(llvm::StringRef name);
   /// \returns a new function with the name \p name.
   Function *createFunction(llvm::StringRef name);
+  /// Erase the function \p F from the Module.
+  void eraseFunction(Function *F);
   /// \returns the list of Functions that the Module owns.
   FunctionList &getFunctions() { return functions_; }
 
@@ -131,6 +139,17 @@ public:
                  VisibilityKind visibility = VisibilityKind::Private,
                  Variable::TrainKind train = Variable::TrainKind::Broadcast,
                  float val = 0.0);
+
+  /// Create a state variable named \p name of the type \p T, initialized to
+  /// zero. A state persists between the runs of the functions, which read it
+  /// and update it in place by saving the new value into it, e.g. the hidden
+  /// state of a decoder that runs once per token. The backends keep the
+  /// state in the memory of the device between the runs. See
+  /// ExecutionEngine::readState().
+  Variable *createState(TypeRef T, llvm::StringRef name);
+
+  Variable *createState(ElemKind T, llvm::ArrayRef<size_t> dims,
+                        llvm::StringRef name);
   ///@}
 
   /// Verify the correctness of the Module.
@@ -203,12 +222,33 @@ public:
   FullyConnectedNode *createFullyConnected(llvm::StringRef name,
                                            NodeValue input, size_t outDepth);
 
+  /// Create a fully connected node of the 2D \p input with the sparse weights
+  /// in the compressed column format: the nonzero weights of the column d are
+  /// \p values[\p offsets[d]] to \p values[\p offsets[d + 1] - 1], and \p
+  /// indices holds their rows. The int32 \p indices and \p offsets are
+  /// quantized with the scale 1 and the offset 0.
+  SparseFullyConnectedNode *
+  createSparseFullyConnected(llvm::StringRef name, NodeValue input,
+                             NodeValue values, NodeValue indices,
+                             NodeValue offsets, NodeValue bias, TypeRef outTy);
+
   ReluNode *createRELU(llvm::StringRef name, NodeValue input);
 
   SigmoidNode *createSigmoid(llvm::StringRef name, NodeValue input);
 
   TanhNode *createTanh(llvm::StringRef name, NodeValue input);
 
+  /// Create a node that computes one step of an LSTM cell from the [B, 4H]
+  /// gate pre-activations \p input and the [B, H] cell state \p C.
+  LSTMUnitNode *createLSTMUnit(llvm::StringRef name, NodeValue input,
+                               NodeValue C);
+
+  /// Create a node that runs an LSTM cell over the first \p numSteps steps of
+  /// the [T, B, 4H] input projections of the gates \p gates, with the [H, 4H]
+  /// hidden state projection \p Wh, and returns the [T, B, H] hidden states.
+  LSTMSequenceNode *createLSTMSequence(llvm::StringRef name, NodeValue gates,
+                                       NodeValue Wh, NodeValue numSteps);
+
   SoftMaxNode *createSoftMax(llvm::StringRef name, NodeValue input,
                              NodeValue selected);
 
@@ -291,10 +331,15 @@ public:
 
   SplatNode *createSplat(llvm::StringRef name, TypeRef ty, float value);
 
-  MatMulNode *createMatMul(llvm::StringRef name, NodeValue lhs, NodeValue rhs);
+  /// Create a matrix multiplication of \p lhs and \p rhs. If \p transposeLHS
+  /// or \p transposeRHS is set then the operand is multiplied transposed.
+  MatMulNode *createMatMul(llvm::StringRef name, NodeValue lhs, NodeValue rhs,
+                           bool transposeLHS = false,
+                           bool transposeRHS = false);
 
   MatMulNode *createMatMul(llvm::StringRef name, TypeRef outTy, NodeValue lhs,
-                           NodeValue rhs);
+                           NodeValue rhs, bool transposeLHS = false,
+                           bool transposeRHS = false);
 
   BatchedReduceAddNode *createBatchedReduceAdd(llvm::StringRef name,
                                                NodeValue batch);
@@ -302,6 +347,13 @@ public:
   BatchedReduceAddNode *createBatchedReduceAdd(llvm::StringRef name,
                                                TypeRef outTy, NodeValue batch);
 
+  /// Create a node that reduces \p input over the dimensions \p axes with
+  /// \p mode. The reduced dimensions are removed from the result, or are set
+  /// to 1 when \p keepDims is set.
+  ReduceNode *createReduce(llvm::StringRef name, NodeValue input,
+                           llvm::ArrayRef<size_t> axes, ReduceMode mode,
+                           bool keepDims = false);
+
   BatchedAddNode *createBatchedAdd(llvm::StringRef name, NodeValue batch,
                                    NodeValue sample);
 
@@ -315,12 +367,51 @@ public:
   /// original node can be replaced during lowering phase.
   QuantizationProfileNode *createQuantizationProfile(llvm::StringRef name,
                                                      NodeValue input);
+  /// Create the node named \p name that accumulates the statistics of the
+  /// float tensor \p input at every run, into new private variables.
+  TensorStatsNode *createTensorStats(llvm::StringRef name, NodeValue input);
 
-  TopKNode *createTopK(llvm::StringRef name, NodeValue input, size_t k);
+  /// Create the node named \p name that selects the \p k largest elements
+  /// of the last dimension of \p input. The indices have the element kind
+  /// \p indexKind, which is IndexTy or Int32ITy.
+  TopKNode *createTopK(llvm::StringRef name, NodeValue input, size_t k,
+                       ElemKind indexKind = ElemKind::IndexTy);
 
   GatherNode *createGather(llvm::StringRef name, NodeValue data,
                            NodeValue indices);
 
+  /// Create a node that sums the slices of the outer-most dimension of \p
+  /// data gathered at \p indices, in consecutive segments: the slice i of
+  /// the result is the sum of the next \p lengths[i] gathered slices. This is
+  /// the Caffe2 SparseLengthsSum, the pooling of an embedding table.
+  SparseLengthsWeightedSumNode *createSparseLengthsSum(llvm::StringRef name,
+                                                       NodeValue data,
+                                                       NodeValue indices,
+                                                       NodeValue lengths);
+
+  /// Create a node like createSparseLengthsSum, where every gathered slice is
+  /// scaled by the element of \p weights at the position of its index.
+  SparseLengthsWeightedSumNode *
+  createSparseLengthsWeightedSum(llvm::StringRef name, NodeValue data,
+                                 NodeValue weights, NodeValue indices,
+                                 NodeValue lengths);
+
+  /// Create a node like createSparseLengthsWeightedSum of the int8 2D \p
+  /// data, where every row r is quantized with the scale \p scales[r] and the
+  /// offset \p offsets[r]. The result is float.
+  RowwiseQuantizedSparseLengthsWeightedSumNode *
+  createRowwiseQuantizedSparseLengthsWeightedSum(
+      llvm::StringRef name, NodeValue data, NodeValue scales, NodeValue offsets,
+      NodeValue weights, NodeValue indices, NodeValue lengths);
+
+  /// Create a gather of the rows of the int8 2D \p data at \p indices, where
+  /// every row r is quantized with the scale \p scales[r] and the offset \p
+  /// offsets[r]. The gathered rows are dequantized to the float result.
+  RowwiseQuantizedGatherNode *
+  createRowwiseQuantizedGather(llvm::StringRef name, NodeValue data,
+                               NodeValue scales, NodeValue offsets,
+                               NodeValue indices);
+
   /// Create quantization node which transforms floating point tensor to a
   /// quantized one with given Scale and Offset. Scale and Offset params are
   /// part of the \p outTy.
@@ -337,6 +428,34 @@ public:
   RescaleQuantizedNode *createRescaleQuantized(llvm::StringRef name,
                                                NodeValue input, TypeRef outTy);
 
+  /// Create a quantized convolution of the int8 \p input with the int8 \p
+  /// filter, where the output channel d of the filter is quantized with the
+  /// scale \p filterScales[d] and the offset \p filterOffsets[d]. The int32
+  /// \p bias is quantized with the scale of \p input times \p
+  /// filterScales[d] and the offset 0.
+  ChannelwiseQuantizedConvolutionNode *createChannelwiseQuantizedConv(
+      llvm::StringRef name, NodeValue input, NodeValue filter, NodeValue bias,
+      NodeValue filterScales, NodeValue filterOffsets, TypeRef outTy,
+      size_t kernel, size_t stride, size_t pad, size_t group);
+
+  /// Create a quantized fully connected node of the int8 2D \p input and
+  /// the int8 \p weights, where the column d of the weights is quantized with
+  /// the scale \p weightScales[d] and the offset \p weightOffsets[d]. The
+  /// int32 \p bias is quantized with the scale of \p input times \p
+  /// weightScales[d] and the offset 0.
+  ChannelwiseQuantizedFullyConnectedNode *
+  createChannelwiseQuantizedFullyConnected(llvm::StringRef name,
+                                           NodeValue input, NodeValue weights,
+                                           NodeValue bias,
+                                           NodeValue weightScales,
+                                           NodeValue weightOffsets,
+                                           TypeRef outTy);
+
+  /// Create a node that converts the floating point tensor \p input to the
+  /// floating point element kind \p elemTy, e.g. from float to float16.
+  ConvertToNode *createConvertTo(llvm::StringRef name, NodeValue input,
+                                 ElemKind elemTy);
+
   /// Create an unrolled single-layer Simple RNN cell with \p hiddenSize
   /// dimensionality of the hidden state and \p outputSize dimensionality of the
   /// output state. \p inputs define the input for the cell at each time step
@@ -391,6 +510,20 @@ public:
   Function *clone(llvm::StringRef newName,
                   llvm::DenseMap<Node *, Node *> *map = nullptr);
 
+  /// Clone the function into a new function named \p newName that keeps
+  /// only the saves of \p outputs, which are saves of this function, and
+  /// the nodes that they need. The new function computes only these outputs,
+  /// e.g. as an entry point of a bundle or an engine.
+  Function *cloneForOutputs(llvm::StringRef newName,
+                            llvm::ArrayRef<SaveNode *> outputs);
+
+  /// Copy the nodes of the function and the variables that they use into a
+  /// new function named \p newName of the module \p M, which must not hold
+  /// the names of the nodes yet, so that the copies keep their names. The
+  /// payloads of the copied variables share the buffers of the originals
+  /// until either of them is written.
+  Function *cloneInto(Module &M, llvm::StringRef newName);
+
   /// Verify the correctness of the Function.
   void verify() const;
 
@@ -22,6 +22,7 @@
 #include "glow/Base/Traits.h"
 #include "glow/Base/Type.h"
 #include "glow/IR/UseDef.h"
+#include "glow/Support/IntrusiveList.h"
 
 #include <list>
 
@@ -136,10 +137,12 @@ struct NodeUse {
   void setOperand(NodeValue &site);
 };
 
-/// Represents a node in the compute graph.
+/// Represents a node in the compute graph. The node is linked into the list
+/// of nodes of its function.
 class Node : public Named,
              public Kinded,
-             public UseDef<Node, NodeValue, NodeUse> {
+             public UseDef<Node, NodeValue, NodeUse>,
+             public IntrusiveListNode<Node> {
 protected:
   /// This is the maximum number of results that a node may have.
   static constexpr unsigned maxNodeResno_ = 6;
@@ -220,6 +223,13 @@ public:
   /// \returns the n'th result type of the node.
   TypeRef getType(unsigned idx = -1) const;
 
+  /// Set the type of the result \p idx to \p ty. This is used by the
+  /// transformations that change the element kind of a node in place, e.g.
+  /// the conversion to float16, and by the ones that change the shape of a
+  /// copy, e.g. the blocked layout of the CPU backend and the batch
+  /// splitting. \p ty must be uniqued by the module.
+  void setType(unsigned idx, TypeRef ty);
+
   /// Methods that forward to the result type (that must be valid):
   /// @{
   ElemKind getElementType(unsigned resNo = -1) const;
@@ -18,6 +18,7 @@
 
 #include "glow/Base/Tensor.h"
 #include "glow/Base/Traits.h"
+#include "glow/Base/WeightStore.h"
 #include "glow/Graph/Grad.h"
 #include "glow/Graph/Node.h"
 
@@ -48,8 +49,14 @@ private:
   TrainKind train_;
   /// Specifies the visibility of the variable.
   VisibilityKind visibility_;
+  /// Whether the variable is a state of the functions, which persists between
+  /// the runs.
+  bool state_{false};
   /// The tensor payload that the variable holds.
   Tensor payload_;
+  /// The tensor of a weight store that the payload is a view of, if the
+  /// payload is shared with other variables.
+  WeightStore::TensorRef sharedPayload_;
 
   /// Initialize the content of the tensor.
   /// Payload is initialized to zero for 'None' TrainKind, and user
@@ -78,6 +85,18 @@ public:
   /// \returns True if the Variable is private.
   bool isPrivate() const { return visibility_ == VisibilityKind::Private; }
 
+  /// \returns True if the Variable is a state that persists between the runs
+  /// and that the functions update in place, see Module::createState.
+  bool isState() const { return state_; }
+
+  /// Make the public variable a state of the functions, or a plain public
+  /// variable again if \p state is false.
+  void setState(bool state) {
+    assert(visibility_ == VisibilityKind::Public &&
+           "Only a public variable can be a state");
+    state_ = state;
+  }
+
   static bool classof(const Kinded *k) {
     return k->getKind() == Kinded::Kind::VariableNodeKind;
   }
@@ -85,6 +104,9 @@ public:
   /// \returns the original training mode of the variable.
   TrainKind getTrainKind() const { return train_; }
 
+  /// \returns the value that the variable was initialized with.
+  float getVal() const { return val_; }
+
   /// \returns the visibility of the variable.
   VisibilityKind getVisibilityKind() const { return visibility_; }
 
@@ -96,6 +118,15 @@ public:
 
   void copyFrom(const Tensor *t) { payload_.copyFrom(t); }
 
+  /// Replace the payload by the tensor of \p store with the same type and
+  /// content, which is shared by all of the variables with that payload.
+  /// The shared payload must not be modified.
+  void sharePayload(WeightStore &store);
+
+  /// \returns True if the payload is shared with other variables through a
+  /// weight store.
+  bool isPayloadShared() const { return sharedPayload_ != nullptr; }
+
   unsigned getNumInputs() const;
   llvm::StringRef getInputName(unsigned idx) const;
   NodeValue &getNthInput(unsigned idx);
@@ -124,6 +155,23 @@ inline std::pair<size_t, size_t> calculateConvOutputDims(size_t sx, size_t sy,
   return {outsx, outsy};
 }
 
+/// The reductions that a Reduce node computes over its axes. The values
+/// must match the libjit and OpenCL reduction kernels.
+enum class ReduceMode : unsigned {
+  Sum = 0,
+  Mean = 1,
+  Max = 2,
+};
+
+/// Collapses the adjacent dimensions of \p dims that a reduction over \p
+/// axes either all reduces or all keeps, and drops the dimensions of size 1,
+/// so that the collapsed dimensions alternate between reduced and kept ones.
+/// The collapsed dimensions are appended to \p collapsed, and \p reduced is
+/// set to 1 for the reduced ones and to 0 for the kept ones.
+void collapseReduceDims(llvm::ArrayRef<size_t> dims,
+                        llvm::ArrayRef<size_t> axes, ShapeVector &collapsed,
+                        ShapeVector &reduced);
+
 /// Support for hashing the Nodes. This is required for using
 /// llvm::hash_combine.
 class Node;
@@ -19,6 +19,7 @@
 #include "glow/Base/Traits.h"
 #include "glow/Base/Type.h"
 #include "glow/IR/UseDef.h"
+#include "glow/Support/IntrusiveList.h"
 
 #include "llvm/ADT/ArrayRef.h"
 #include "llvm/ADT/SmallVector.h"
@@ -101,7 +102,8 @@ public:
 };
 
 /// This represents an instruction in our IR.
-class Instruction : public Value {
+/// An instruction is linked into the list of instructions of its function.
+class Instruction : public Value, public IntrusiveListNode<Instruction> {
 public:
   using Operand = InstructionOperand;
 
@@ -193,6 +195,11 @@ public:
   /// The instruction can be inserted elsewhere afterwards.
   void removeFromParent();
 
+  /// \returns a copy of the instruction, with the same operands. Notice that
+  /// the copy is not inserted into the function. The caller of this method
+  /// should insert it.
+  Instruction *clone() const;
+
   static bool classof(const Value *V);
 
   static bool classof(const Instruction *I) { return true; }
@@ -206,11 +213,26 @@ class WeightVar;
 class Value;
 class Node;
 
+/// The algorithms that order the nodes of a graph before the IR is generated.
+enum class SchedulerKind {
+  /// Schedule first the children that free the most memory.
+  ChildMemSize,
+  /// Simulate the live results and minimize their peak size with a bounded
+  /// lookahead.
+  MinPeakMemory,
+  /// Start first the nodes on the longest path of the remaining computation,
+  /// within a ceiling on the peak size of the live results.
+  CriticalPath,
+};
+
+/// \returns the scheduler selected by -graph-scheduler.
+SchedulerKind getDefaultScheduler();
+
 /// A function that represents the compilation unit.
 class IRFunction final {
 public:
   using VariableMap = std::unordered_map<const Node *, Value *>;
-  using InstListTy = std::list<Instruction *>;
+  using InstListTy = IntrusiveList<Instruction>;
   using InstrIterator = InstListTy::iterator;
   using InstrConstIterator = InstListTy::const_iterator;
   using WeightVarListTy = std::list<WeightVar *>;
@@ -232,9 +254,9 @@ private:
   /// Assign the instructions in the function a unique name.
   void nameInstructions();
 
-  /// Perform scheduling on the graph.
+  /// Perform scheduling on the graph with the scheduler \p kind.
   /// \returns computed schedule in the \p Schedule parameter.
-  void scheduleGraph(std::list<Node *> &Schedule);
+  void scheduleGraph(std::vector<Node *> &Schedule, SchedulerKind kind);
 
 public:
   /// Add an instruction to the instr stream.
@@ -246,8 +268,12 @@ public:
 
   /// Generate IR from the graph nodes. If the compilation mode is 'training'
   /// then this procedure will also generate the code for the backward pass.
+  /// The nodes are ordered by the scheduler of -graph-scheduler.
   void generateIR();
 
+  /// Generate IR from the graph nodes, ordered by the scheduler \p kind.
+  void generateIR(SchedulerKind kind);
+
   /// Wipe out the content of the function. This allows the function to be used
   /// again for another round of code generation.
   void clear();
@@ -261,6 +287,10 @@ public:
   /// Verify the correctness of the function.
   void verify() const;
 
+  /// \returns true if the function contains loops, i.e. LoopStart and LoopEnd
+  /// instructions around the instructions that run several times.
+  bool hasLoops() const;
+
   /// Dump a textual representation of the function.
   void dump();
 
@@ -287,6 +317,8 @@ public:
 
   /// \returns the list of weights.
   WeightVarListTy &getWeights() { return weights_; }
+  /// \returns the list of weights.
+  const WeightVarListTy &getWeights() const { return weights_; }
 
   /// Erase the instruction from the function.
   void eraseInstruction(Instruction *I);
@@ -364,6 +396,10 @@ Value *getAllocationOrigin(Value *V);
 /// \returns peels off the layers of tensorviews from a value \p V.
 Value *getOrigin(Value *V);
 
+/// \returns the number of the elements of the origin of \p V that precede the
+/// first element of \p V. It is nonzero for the views with offsets.
+size_t getOriginOffset(const Value *V);
+
 } // namespace glow
 
 #endif // GLOW_IR_IR_H
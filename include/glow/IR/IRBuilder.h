@@ -63,7 +63,8 @@ public:
                                      float alpha = 1e-4, float beta = 0.75,
                                      float k = 2.0);
 
-  TopKInst *createTopKOp(Value *input, size_t k);
+  TopKInst *createTopKOp(Value *input, size_t k,
+                         ElemKind indexKind = ElemKind::IndexTy);
 
   Value *createReturnOp(Value *input);
 
@@ -0,0 +1,37 @@
+/**
+ * Copyright (c) 2017-present, Facebook, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#ifndef GLOW_IR_IRCOST_H
+#define GLOW_IR_IRCOST_H
+
+#include "glow/Graph/Cost.h"
+
+namespace glow {
+
+class Instruction;
+class IRFunction;
+
+/// \returns the analytic cost of \p I. The bytes are those of the operands
+/// that \p I reads and writes, where an InOut operand counts twice. The
+/// allocations and the tensor views cost nothing.
+OpCost getCost(const Instruction *I);
+
+/// \returns the sum of the costs of the instructions of \p F. The
+/// instructions in a loop are counted once.
+OpCost getCost(const IRFunction *F);
+
+} // namespace glow
+
+#endif // GLOW_IR_IRCOST_H
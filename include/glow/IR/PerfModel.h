@@ -0,0 +1,108 @@
+/**
+ * Copyright (c) 2017-present, Facebook, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#ifndef GLOW_IR_PERFMODEL_H
+#define GLOW_IR_PERFMODEL_H
+
+#include "glow/Graph/Cost.h"
+
+#include "llvm/Support/raw_ostream.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace glow {
+
+class Instruction;
+class IRFunction;
+
+/// The description of a device for the analytic performance model. The
+/// bandwidths are in GB/s, and the sizes are in bytes.
+struct DeviceInfo {
+  /// The number of cores that run a kernel in parallel.
+  unsigned cores{4};
+  /// The number of float lanes of a vector instruction.
+  unsigned simdWidth{8};
+  /// The number of vector multiply-adds that a core issues every cycle.
+  unsigned fmaPerCycle{2};
+  /// The clock of the cores, in GHz.
+  double clockGHz{2.5};
+  /// The size and the bandwidth of the private cache of every core.
+  size_t l2Size{256 << 10};
+  double l2Bandwidth{100};
+  /// The size and the bandwidth of the last level cache that the cores share.
+  size_t llcSize{8 << 20};
+  double llcBandwidth{200};
+  /// The bandwidth of the main memory.
+  double memBandwidth{20};
+  /// The time it takes to start a kernel, in microseconds.
+  double kernelOverheadUs{0};
+
+  /// \returns the peak of the arithmetic operations per second.
+  double getPeakFlops() const {
+    return 2e9 * cores * simdWidth * fmaPerCycle * clockGHz;
+  }
+};
+
+/// The predicted execution of an instruction.
+struct InstrEstimate {
+  const Instruction *instr;
+  /// The analytic cost of the instruction, see getCost(const Instruction *).
+  OpCost cost;
+  /// The bytes of the operands that come from the private caches, from the
+  /// shared cache and from the main memory.
+  uint64_t l2Bytes{0};
+  uint64_t llcBytes{0};
+  uint64_t memBytes{0};
+  /// The seconds that the arithmetic and the transfers take at the peak of
+  /// the device. The instruction takes the longer of the two, as in the
+  /// roofline model, and the overhead of its kernel.
+  double computeTime{0};
+  double memoryTime{0};
+  double time{0};
+};
+
+/// The predicted execution of a function.
+struct PerfEstimate {
+  /// The estimates of the instructions, in the order of the function. The
+  /// allocations and the tensor views are omitted.
+  std::vector<InstrEstimate> instrs;
+  /// The predicted latency of the function, in seconds.
+  double time{0};
+  /// The bytes of the weights, and the peak of the bytes of the activations
+  /// that are live at once.
+  size_t weightsSize{0};
+  size_t activationsPeak{0};
+
+  /// \returns the peak of the memory that the function uses.
+  size_t getPeakMemory() const { return weightsSize + activationsPeak; }
+};
+
+/// \returns the predicted execution of \p F on the device \p device. Every
+/// instruction runs on all the cores at the peak of their arithmetic or at
+/// the bandwidth of the level of the memory hierarchy that holds each of its
+/// operands, whichever takes longer. The caches are simulated as LRU caches
+/// of whole tensors, so an operand hits if the earlier instructions touched
+/// it recently enough. The instructions in a loop are counted once.
+PerfEstimate estimatePerf(const IRFunction *F, const DeviceInfo &device);
+
+/// Print the estimate \p estimate of every instruction and of the whole
+/// function to \p os.
+void dumpPerfEstimate(const PerfEstimate &estimate, llvm::raw_ostream &os);
+
+} // namespace glow
+
+#endif // GLOW_IR_PERFMODEL_H
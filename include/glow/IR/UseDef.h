@@ -18,15 +18,21 @@
 
 #include "llvm/ADT/SmallVector.h"
 
-#include <list>
+#include <algorithm>
 
 namespace glow {
 
 /// A UseDef is something that can be an operand for an instruction.
 template <typename UserTy, typename UseTy, typename Use> class UseDef {
+public:
+  /// The list of users. It is stored inline in the value while it is short,
+  /// and changing the list invalidates its iterators.
+  using UseListTy = llvm::SmallVector<Use, 2>;
+
+private:
   /// A list of users. Notice that the same user may appear twice in the list.
   /// This is typically a very short list.
-  std::list<Use> users_{};
+  UseListTy users_{};
 
 public:
   UseDef() = default;
@@ -60,10 +66,10 @@ public:
   }
 
   /// \returns the list of users for this value.
-  std::list<Use> &getUsers() { return users_; }
+  UseListTy &getUsers() { return users_; }
 
   /// \returns the list of users for this value.
-  const std::list<Use> &getUsers() const { return users_; }
+  const UseListTy &getUsers() const { return users_; }
 };
 
 } // namespace glow
@@ -16,11 +16,26 @@
 #ifndef GLOW_OPTIMIZER_OPTIMIZER_H
 #define GLOW_OPTIMIZER_OPTIMIZER_H
 
+#include "glow/Base/Traits.h"
+
+#include "llvm/ADT/ArrayRef.h"
+
+#include <functional>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace llvm {
+class raw_ostream;
+}
+
 namespace glow {
 
 class IRFunction;
 class Function;
 class Backend;
+class Node;
+enum class BackendKind;
 
 enum class CompilationMode {
   Train, /// Compile the graph in preperation for training.
@@ -30,17 +45,143 @@ enum class CompilationMode {
 
 /// Perform optimizations on the IR representation.
 void optimize(IRFunction &M, CompilationMode mode);
+/// Reduce the peak of the activations live in \p M to \p budget bytes, if
+/// possible, by recomputing activations right before their uses in the
+/// backward pass. At most \p maxDepth instructions are recomputed for one
+/// activation.
+void recomputeActivations(IRFunction &M, size_t budget, unsigned maxDepth);
+/// \returns the number of bytes of the activations of \p M that are live at
+/// once at the peak of their memory.
+size_t getActivationsPeak(IRFunction &M);
+/// Print the instruction of \p M where the memory of the live activations
+/// peaks, and the activations live there, the largest first, to \p os.
+void dumpActivationsPeak(IRFunction &M, llvm::raw_ostream &os);
 /// Perform optimizations on the graph representation.
 void optimize(Function *F, CompilationMode mode);
 
 /// Lower the high-level neural network operators into low-level lineal algebra
 /// operators.
 void lower(Function *F, CompilationMode mode, Backend *B = nullptr);
+/// Lower \p F as lower() does for a backend of kind \p backendKind, without
+/// creating the backend.
+void lower(Function *F, CompilationMode mode, BackendKind backendKind);
+
+/// Evaluate the nodes of \p F whose inputs are all private variables that are
+/// not trained, and replace their results by new private variables. The nodes
+/// are evaluated by the Interpreter at compile time.
+void constantFold(Function *F);
 
 /// Instrument function \p F by inserting quantization profile nodes
 /// for capturing stats for quantization.
 void profileQuantization(Function *F);
 
+/// The statistics of a result of a node, accumulated over the runs by the
+/// TensorStats node that observes it.
+struct TensorStatsInfo {
+  /// The name of the node and the number of the result.
+  std::string nodeName;
+  unsigned resNo{0};
+  /// The number of runs, and of the elements, NaNs, infinities and zeros
+  /// seen over all of the runs.
+  size_t runs{0};
+  size_t elements{0};
+  size_t nans{0};
+  size_t infs{0};
+  size_t zeros{0};
+  /// The range of the finite elements. The min is above the max if there
+  /// were none.
+  float min{0};
+  float max{0};
+
+  /// \returns the fraction of the elements that are zeros.
+  double getSparsity() const {
+    return elements ? double(zeros) / elements : 0.0;
+  }
+};
+
+/// Observe the float results of the nodes of \p F with TensorStats nodes, if
+/// -instrument-stats is set and the backend \p B supports them. This runs
+/// after the optimizations, so that the results of the nodes that the
+/// backend runs are observed. \returns true if \p F was changed.
+bool instrumentTensorStats(Function *F, const Backend &B);
+
+/// \returns the statistics accumulated so far by the TensorStats nodes of
+/// \p F, which keep them in their variables.
+std::vector<TensorStatsInfo> getTensorStats(const Function *F);
+
+/// Print the statistics of the TensorStats nodes of \p F to \p os.
+void dumpTensorStats(const Function *F, llvm::raw_ostream &os);
+
+/// Convert the float nodes of the function \p F that the backend \p B
+/// supports in float16 to float16. The weights are converted at compile time,
+/// and the inputs and the outputs of \p F remain float.
+void convertToFloat16(Function *F, const Backend &B);
+
+/// Replace the fully connected nodes of \p F whose private float weights are
+/// mostly zeros, above the sparse-weights-threshold fraction, by sparse fully
+/// connected nodes that store only the nonzero weights, if the backend \p B
+/// supports them. \returns true if \p F was changed.
+bool sparsifyWeights(Function *F, const Backend &B);
+
+/// Replace the lowered arithmetic of \p F that has a splat operand, e.g. the
+/// Max of a ReLU or the Mul by the learning rate of SGD, by the nodes that
+/// take the value of the splat as an immediate, if the backend \p B supports
+/// them, so that the splat tensor is neither computed nor read. The splats
+/// are left to the DCE. \returns true if \p F was changed.
+bool foldSplatOperands(Function *F, const Backend &B);
+
+/// Run the chains of layers of \p F that compute every sample of the batch
+/// independently, e.g. convolutions, pools and activations, on micro-batches
+/// whose activations fit in \p cacheSize bytes, one micro-batch through the
+/// whole chain at a time, instead of running every layer on the whole batch.
+/// The batched inputs of a chain are sliced and its results concatenated.
+/// \returns true if \p F was changed.
+bool splitBatches(Function *F, size_t cacheSize);
+
+/// Split the batches of \p F with the cache size of -split-batch-cache-kb, if
+/// it is set. \returns true if \p F was changed.
+bool splitBatches(Function *F);
+
+/// A chain of nodes that a backend computes with a single node of its own,
+/// e.g. a matrix multiplication followed by the addition of a bias and by an
+/// activation. Every node of the chain is the first input of the next one
+/// with its kind and has no other users, and none of the nodes is predicated.
+struct FusionPattern {
+  /// The kinds of the nodes of the chain, from the first producer to the
+  /// root, whose results are replaced.
+  std::vector<Kinded::Kind> kinds;
+  /// Add the fused node of the nodes \p chain, in the order of the kinds, to
+  /// the function \p F, or return nullptr if they can't be fused, e.g.
+  /// because of their types or their members. The results of the fused node
+  /// replace the results of the root in order.
+  std::function<Node *(Function *F, llvm::ArrayRef<Node *> chain)> fuse;
+};
+
+/// Replace the chains of nodes of \p F that match \p patterns by the fused
+/// nodes. The patterns are applied one after the other to the whole function,
+/// so that a pattern can extend the nodes fused by the earlier ones. The
+/// replaced nodes are left to the DCE. \returns true if \p F was changed.
+bool fuse(Function *F, llvm::ArrayRef<FusionPattern> patterns);
+
+/// Split the function \p F into functions that each run on one of the backends
+/// \p backends, in the order of preference. Every node goes to the first
+/// backend that supports all of the nodes that it is lowered to for that
+/// backend in the mode \p mode, unless it computes too little to pay for
+/// moving its inputs and results from and to the other backends. The
+/// functions exchange the values through new public variables. \returns the
+/// functions and their backends, in the order in which they must run. \p F
+/// itself is returned when it runs on a single backend.
+std::vector<std::pair<Function *, BackendKind>>
+partition(Function *F, CompilationMode mode,
+          llvm::ArrayRef<BackendKind> backends);
+
+/// Split the function \p F into at most \p numStages functions of about the
+/// same cost, which run one after the other, e.g. as the stages of a pipeline
+/// that computes several inputs at once. The functions exchange the values
+/// through new public variables, as in partition(). \returns the functions in
+/// the order in which they must run, or \p F itself for a single stage.
+std::vector<Function *> splitIntoStages(Function *F, unsigned numStages);
+
 } // namespace glow
 
 #endif // GLOW_OPTIMIZER_OPTIMIZER_H
@@ -19,6 +19,7 @@
 
 #include "glow/Graph/Graph.h"
 
+#include <cmath>
 #include <string>
 #include <tuple>
 #include <vector>
@@ -39,15 +40,30 @@ struct TensorQuantizationParams {
 struct NodeQuantizationInfo {
   std::string nodeOutputName_;
   TensorQuantizationParams tensorQuantizationParams_;
+  /// The estimated error of the int8 quantization of the profiled values: the
+  /// ratio of the RMS of the quantization noise to the RMS of the values.
+  float int8Error_{0};
+  /// The histogram of the profiled values, which covers the range
+  /// [histogramMin_, histogramMax_]. It allows choosing a narrower range for
+  /// the quantization after the profile is loaded.
+  float histogramMin_{0};
+  float histogramMax_{0};
+  std::vector<float> histogram_;
+  /// Whether the node that computes the value is quantized. The profile keeps
+  /// the nodes whose quantization does not pay off in float.
+  bool quantize_{true};
 
   NodeQuantizationInfo() = default;
   NodeQuantizationInfo(const std::string &nodeOutputName,
-                       const TensorQuantizationParams &tensorQuantizationParams)
+                       const TensorQuantizationParams &tensorQuantizationParams,
+                       float int8Error = 0)
       : nodeOutputName_(nodeOutputName),
-        tensorQuantizationParams_(tensorQuantizationParams) {}
+        tensorQuantizationParams_(tensorQuantizationParams),
+        int8Error_(int8Error) {}
 
   float Scale() const { return tensorQuantizationParams_.scale_; }
   int32_t Offset() const { return tensorQuantizationParams_.offset_; }
+  float Int8Error() const { return int8Error_; }
 
   /// Get the full node output name based on the node name and output number.
   /// The following format is used: nodename:outputNumber
@@ -81,9 +97,27 @@ struct QuantizationTransform32To8 {
 
 namespace quantization {
 
-/// Generate NodeQuantizationInfo for all required nodes from graph \p G.
-std::vector<NodeQuantizationInfo>
-generateNodeQuantizationInfos(const Function *F);
+/// The methods of choosing the quantized range of a value from its profile.
+enum class CalibrationKind {
+  /// Cover the whole profiled range of the value.
+  None,
+  /// Clip the range to the one that minimizes the Kullback-Leibler divergence
+  /// between the profiled distribution of the value and its quantized
+  /// distribution. The outliers then do not waste the quantized values.
+  KLMinimization,
+};
+
+/// Generate NodeQuantizationInfo for all required nodes from graph \p G. The
+/// quantization parameters are chosen with the method \p calibration.
+std::vector<NodeQuantizationInfo> generateNodeQuantizationInfos(
+    const Function *F, CalibrationKind calibration = CalibrationKind::None);
+
+/// Recompute the quantization parameters of \p quantizationInfos from their
+/// histograms with the method \p calibration. The infos without a histogram
+/// are kept as they are.
+void calibrateQuantizationInfos(
+    std::vector<NodeQuantizationInfo> &quantizationInfos,
+    CalibrationKind calibration);
 
 /// Convert the floating point quantization parameters \p scale and \p offset
 /// into the integer sequence of:
@@ -93,14 +127,6 @@ generateNodeQuantizationInfos(const Function *F);
 QuantizationTransform32To8 quantizeScaleOffset32To8(float scale,
                                                     int32_t offset);
 
-/// Converts floating point value to int8 based on the quantization
-/// parameters \p TQP.
-int8_t quantize(float input, const TensorQuantizationParams &TQP);
-
-/// Converts int8 quantized value back to floating point number based on
-/// the quantization parameters \p TQP.
-float dequantize(int8_t input, const TensorQuantizationParams &TQP);
-
 /// \returns the value \p in as clipped to the range of \p DestTy.
 template <class SrcTy, class DestTy> DestTy clip(SrcTy in) {
   assert(sizeof(SrcTy) >= sizeof(DestTy) && "Invalid types");
@@ -110,12 +136,74 @@ template <class SrcTy, class DestTy> DestTy clip(SrcTy in) {
   return std::max<SrcTy>(mn, std::min<SrcTy>(mx, in));
 }
 
+/// Converts floating point value to the integer type \p DestTy based on the
+/// quantization parameters \p TQP.
+template <class DestTy = int8_t>
+DestTy quantize(float input, const TensorQuantizationParams &TQP) {
+  float result = input / TQP.scale_ + TQP.offset_;
+  return quantization::clip<int64_t, DestTy>(std::round(result));
+}
+
+/// Converts the quantized value \p input back to floating point number based
+/// on the quantization parameters \p TQP.
+template <class SrcTy = int8_t>
+float dequantize(SrcTy input, const TensorQuantizationParams &TQP) {
+  return TQP.scale_ * (input - TQP.offset_);
+}
+
 /// Converts floating point graph to a quantized one.
 /// Note, if not all operators have a conversion support graph ends up being
-/// hybrid.
+/// hybrid. If \p enableChannelwise is set then the weights of the convolutions
+/// and the fully connected nodes are quantized with a separate scale and
+/// offset for every output channel, and the embedding tables of the gathers
+/// and the sparse lengths sums with a separate scale and offset for every row,
+/// when the backend supports it. If \p maxInt8Error is positive then the
+/// convolutions, the fully connected nodes and the matrix multiplications
+/// whose profiled input or result has a larger int8Error_ get int16
+/// activations and int8 weights, when the backend supports it.
+/// The nodes whose first result has quantize_ unset in \p quantizationInfos
+/// stay in float.
 void generateQuantizedGraph(
     const ExecutionEngine &EE, Function *F,
-    llvm::ArrayRef<NodeQuantizationInfo> quantizationInfos);
+    llvm::ArrayRef<NodeQuantizationInfo> quantizationInfos,
+    bool enableChannelwise = false, float maxInt8Error = 0);
+
+/// The measured effect of quantizing a single node of a function.
+struct NodeQuantizationEffect {
+  /// The name of the node.
+  std::string nodeName_;
+  /// The ratio of the RMS of the change of the results of the function to the
+  /// RMS of the float results.
+  float error_{0};
+  /// The wall time in seconds that quantizing the node saves per run. It is
+  /// negative if the quantized function is slower.
+  double timeSaved_{0};
+};
+
+/// Measure the effect of quantizing every node of \p F that
+/// generateQuantizedGraph quantizes with the backend of \p EE, one node at a
+/// time. Copies of \p F run in \p EE on the \p inputs of the public
+/// variables \p vars, \p timingRuns times for the time, and their results are
+/// compared with the ones of the float copy. \p quantizationInfos,
+/// \p enableChannelwise and \p maxInt8Error are passed to the quantization,
+/// except that quantize_ is ignored. \p F is not changed, and \p EE must be
+/// compiled again before it runs.
+std::vector<NodeQuantizationEffect> measureQuantizationEffects(
+    ExecutionEngine &EE, Function *F,
+    llvm::ArrayRef<NodeQuantizationInfo> quantizationInfos,
+    llvm::ArrayRef<Variable *> vars, llvm::ArrayRef<Tensor *> inputs,
+    unsigned timingRuns, bool enableChannelwise = false,
+    float maxInt8Error = 0);
+
+/// Select the nodes of \p effects that stay quantized: the ones that save the
+/// most time per unit of error, as long as the square root of the sum of the
+/// squares of their errors stays within \p maxError. The nodes that don't
+/// save time are never selected.
+/// The selection is recorded in quantize_ of the \p quantizationInfos of the
+/// results of the nodes.
+void selectQuantizedNodes(llvm::ArrayRef<NodeQuantizationEffect> effects,
+                          float maxError,
+                          std::vector<NodeQuantizationInfo> &quantizationInfos);
 
 } // namespace quantization
 
@@ -0,0 +1,205 @@
+/**
+ * Copyright (c) 2017-present, Facebook, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#ifndef GLOW_SUPPORT_INTRUSIVELIST_H
+#define GLOW_SUPPORT_INTRUSIVELIST_H
+
+#include <cassert>
+#include <cstddef>
+#include <iterator>
+#include <utility>
+
+namespace glow {
+
+template <typename T> class IntrusiveList;
+
+/// The links of an object of type T, which derives from this class, into an
+/// IntrusiveList<T>. An object is in at most one list at a time. The links
+/// are not copied with the object, so the copy of an object in a list is not
+/// in any list.
+template <typename T> class IntrusiveListNode {
+  friend class IntrusiveList<T>;
+  IntrusiveListNode *prev_{nullptr};
+  IntrusiveListNode *next_{nullptr};
+
+public:
+  IntrusiveListNode() = default;
+  IntrusiveListNode(const IntrusiveListNode &) {}
+  IntrusiveListNode &operator=(const IntrusiveListNode &) { return *this; }
+
+  /// \returns true if the object is in a list.
+  bool isLinked() const { return next_ != nullptr; }
+};
+
+/// A doubly-linked list of the objects of type T, which derive from
+/// IntrusiveListNode<T>. The links are stored in the objects, so inserting
+/// and removing an object doesn't allocate, and an object is found in and
+/// removed from the list in constant time. The list does not own the objects.
+/// The iterators dereference to pointers to the objects, like the iterators of
+/// a std::list<T *>, and stay valid until their object is removed.
+template <typename T> class IntrusiveList {
+  using NodeTy = IntrusiveListNode<T>;
+
+  /// The head and the tail of the list are linked to the sentinel, which is
+  /// the end of the list.
+  NodeTy sentinel_;
+  /// The number of objects in the list.
+  size_t size_{0};
+
+  /// Link \p node before \p where.
+  static void link(NodeTy *where, NodeTy *node) {
+    assert(!node->isLinked() && "The object is in a list already");
+    node->prev_ = where->prev_;
+    node->next_ = where;
+    where->prev_->next_ = node;
+    where->prev_ = node;
+  }
+
+  /// Unlink \p node from its list.
+  static void unlink(NodeTy *node) {
+    assert(node->isLinked() && "The object is not in a list");
+    node->prev_->next_ = node->next_;
+    node->next_->prev_ = node->prev_;
+    node->prev_ = nullptr;
+    node->next_ = nullptr;
+  }
+
+public:
+  template <bool isReverse> class Iterator {
+    friend class IntrusiveList;
+    NodeTy *node_{nullptr};
+
+    explicit Iterator(NodeTy *node) : node_(node) {}
+
+  public:
+    using iterator_category = std::bidirectional_iterator_tag;
+    using value_type = T *;
+    using difference_type = std::ptrdiff_t;
+    using pointer = T **;
+    using reference = T *;
+
+    Iterator() = default;
+
+    T *operator*() const { return static_cast<T *>(node_); }
+
+    Iterator &operator++() {
+      node_ = isReverse ? node_->prev_ : node_->next_;
+      return *this;
+    }
+    Iterator operator++(int) {
+      Iterator it = *this;
+      ++*this;
+      return it;
+    }
+    Iterator &operator--() {
+      node_ = isReverse ? node_->next_ : node_->prev_;
+      return *this;
+    }
+    Iterator operator--(int) {
+      Iterator it = *this;
+      --*this;
+      return it;
+    }
+
+    bool operator==(const Iterator &other) const {
+      return node_ == other.node_;
+    }
+    bool operator!=(const Iterator &other) const {
+      return node_ != other.node_;
+    }
+  };
+
+  /// The objects are reached through the const iterators of a const list as
+  /// well, like through the pointers of a const std::list<T *>.
+  using iterator = Iterator<false>;
+  using const_iterator = iterator;
+  using reverse_iterator = Iterator<true>;
+  using const_reverse_iterator = reverse_iterator;
+  using value_type = T *;
+  using size_type = size_t;
+
+  IntrusiveList() { sentinel_.prev_ = sentinel_.next_ = &sentinel_; }
+  IntrusiveList(const IntrusiveList &) = delete;
+  IntrusiveList &operator=(const IntrusiveList &) = delete;
+  ~IntrusiveList() { clear(); }
+
+  iterator begin() const { return iterator(sentinel_.next_); }
+  iterator end() const { return iterator(const_cast<NodeTy *>(&sentinel_)); }
+  reverse_iterator rbegin() const { return reverse_iterator(sentinel_.prev_); }
+  reverse_iterator rend() const {
+    return reverse_iterator(const_cast<NodeTy *>(&sentinel_));
+  }
+
+  size_t size() const { return size_; }
+  bool empty() const { return size_ == 0; }
+
+  T *front() const {
+    assert(!empty() && "The list is empty");
+    return *begin();
+  }
+  T *back() const {
+    assert(!empty() && "The list is empty");
+    return *rbegin();
+  }
+
+  /// \returns the iterator of \p obj, which must be in this list.
+  iterator getIterator(T *obj) const {
+    assert(static_cast<NodeTy *>(obj)->isLinked() && "Object not in a list");
+    return iterator(obj);
+  }
+
+  /// Insert \p obj before \p where. \returns the iterator of \p obj.
+  iterator insert(iterator where, T *obj) {
+    link(where.node_, obj);
+    size_++;
+    return iterator(obj);
+  }
+  void push_back(T *obj) { insert(end(), obj); }
+  void push_front(T *obj) { insert(begin(), obj); }
+
+  /// Remove the object at \p it from the list, without destroying it.
+  /// \returns the iterator of the next object.
+  iterator erase(iterator it) {
+    iterator next = std::next(it);
+    unlink(it.node_);
+    size_--;
+    return next;
+  }
+  /// Remove \p obj, which must be in this list, without destroying it.
+  void remove(T *obj) { erase(getIterator(obj)); }
+
+  void pop_back() { erase(getIterator(back())); }
+  void pop_front() { erase(begin()); }
+
+  /// Reverse the order of the objects in the list.
+  void reverse() {
+    NodeTy *node = &sentinel_;
+    do {
+      std::swap(node->prev_, node->next_);
+      node = node->prev_;
+    } while (node != &sentinel_);
+  }
+
+  /// Remove all of the objects from the list, without destroying them.
+  void clear() {
+    while (!empty()) {
+      pop_back();
+    }
+  }
+};
+
+} // namespace glow
+
+#endif // GLOW_SUPPORT_INTRUSIVELIST_H
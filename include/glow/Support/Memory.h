@@ -18,6 +18,8 @@
 
 #include <cassert>
 #include <cstdlib>
+#include <memory>
+#include <string>
 
 namespace glow {
 
@@ -45,6 +47,140 @@ inline size_t alignedSize(size_t size, size_t alignment) {
   return (size + alignment - 1) & ~(alignment - 1);
 }
 
+/// The size of the huge pages that back the memory of the large buffers.
+constexpr size_t HugePageSize = 2 << 20;
+
+/// The pages that back the memory of the large buffers.
+enum class HugePageMode {
+  /// The regular pages of the system.
+  None,
+  /// Transparent huge pages, which the kernel uses when it can.
+  Transparent,
+  /// The huge pages reserved by the system, or the transparent ones if none
+  /// are left.
+  Explicit,
+};
+
+/// How the large buffers, e.g. the weights and the activations of the
+/// compiled code, are placed in memory.
+struct MemoryPolicy {
+  /// The pages that back the buffers.
+  HugePageMode hugePages{HugePageMode::None};
+  /// The NUMA node that the buffers are bound to, or -1 for the default
+  /// placement of the system.
+  int numaNode{-1};
+
+  /// \returns true if the buffers are placed as any other memory.
+  bool isDefault() const {
+    return hugePages == HugePageMode::None && numaNode < 0;
+  }
+};
+
+/// Allocate \p size bytes of memory aligned to TensorAlignment bytes and
+/// placed according to \p policy. The memory must be released with
+/// freeMemory with the same size and policy. Aborts if the memory can't be
+/// mapped.
+void *allocateMemory(size_t size, const MemoryPolicy &policy);
+
+/// Free the memory \p p of \p size bytes allocated by allocateMemory with
+/// \p policy.
+void freeMemory(void *p, size_t size, const MemoryPolicy &policy);
+
+/// Place the pages that lie entirely within the \p size bytes of memory at
+/// \p p according to \p policy, moving them if needed. This applies the
+/// policy to memory that is allocated by someone else, e.g. to the payload of
+/// a tensor. \returns false if the system could not apply the policy, in
+/// which case the memory stays where it is.
+bool applyMemoryPolicy(void *p, size_t size, const MemoryPolicy &policy);
+
+/// Fault in the pages of the \p size bytes of memory at \p p for reading
+/// them, e.g. the constant weights of the compiled code, so that the first
+/// run doesn't wait for them. The pages of a mapped file are read ahead.
+void prefaultForRead(const void *p, size_t size);
+
+/// Fault in the pages of the \p size bytes of memory at \p p for writing
+/// them, e.g. the activations of the compiled code. The content is kept.
+void prefaultForWrite(void *p, size_t size);
+
+/// A scratch memory for the activations of the compiled functions that never
+/// run at the same time, e.g. the models served by one worker thread. The
+/// functions share the memory instead of keeping their own, mostly idle,
+/// memory. The arena grows to the largest size that was asked for. It is not
+/// thread-safe, so every concurrent worker needs an arena of its own.
+class ActivationArena {
+  /// The memory and its size in bytes.
+  void *memory_{nullptr};
+  size_t size_{0};
+  /// The placement of the memory.
+  MemoryPolicy policy_;
+
+public:
+  explicit ActivationArena(const MemoryPolicy &policy = MemoryPolicy())
+      : policy_(policy) {}
+
+  ~ActivationArena() { freeMemory(memory_, size_, policy_); }
+
+  ActivationArena(const ActivationArena &) = delete;
+  ActivationArena &operator=(const ActivationArena &) = delete;
+
+  /// Grow the arena to at least \p size bytes. The content is lost when the
+  /// arena grows.
+  void reserve(size_t size);
+
+  /// \returns the memory of the arena, grown to at least \p size bytes and
+  /// aligned to TensorAlignment bytes.
+  void *get(size_t size) {
+    reserve(size);
+    return memory_;
+  }
+
+  /// \returns the size of the arena in bytes.
+  size_t getSize() const { return size_; }
+};
+
+/// A segment of POSIX shared memory, e.g. for the inputs and outputs of the
+/// compiled code of a worker process, which the frontend that sends it the
+/// requests writes and reads in place. The memory is aligned to the page
+/// size.
+class SharedMemory {
+  /// The name of the segment.
+  std::string name_;
+  /// The memory of the segment and its size in bytes.
+  void *memory_{nullptr};
+  size_t size_{0};
+  /// Whether the segment was created by this object, which removes it.
+  bool isOwner_{false};
+
+  SharedMemory() = default;
+
+public:
+  ~SharedMemory();
+
+  SharedMemory(const SharedMemory &) = delete;
+  SharedMemory &operator=(const SharedMemory &) = delete;
+
+  /// Create the segment named \p name, e.g. "/glow-worker0", of \p size
+  /// bytes, which are zero. The segment is removed when the object is
+  /// destroyed, and the processes that opened it keep their mappings.
+  /// \returns null if the segment could not be created, e.g. because it
+  /// exists.
+  static std::unique_ptr<SharedMemory> create(const std::string &name,
+                                              size_t size);
+
+  /// Open the existing segment named \p name. \returns null if it could not
+  /// be opened.
+  static std::unique_ptr<SharedMemory> open(const std::string &name);
+
+  /// \returns the memory of the segment.
+  void *getData() const { return memory_; }
+
+  /// \returns the size of the segment in bytes.
+  size_t getSize() const { return size_; }
+
+  /// \returns the name of the segment.
+  const std::string &getName() const { return name_; }
+};
+
 } // end namespace glow
 
 #endif // GLOW_SUPPORT_MEMORY_H
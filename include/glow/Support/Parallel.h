@@ -0,0 +1,70 @@
+/**
+ * Copyright (c) 2017-present, Facebook, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#ifndef GLOW_SUPPORT_PARALLEL_H
+#define GLOW_SUPPORT_PARALLEL_H
+
+// The parallel runtime of the process. It is compiled into the host, where the
+// Interpreter and all of the code jitted by the CPU backend share it, and into
+// libjit, so that every bundle carries it. It depends on nothing but the C
+// library and pthreads, and its API is plain C.
+
+#include <stddef.h>
+
+/// The max number of threads of the pool, including the calling thread.
+#define GLOW_PARALLEL_MAX_THREADS 64
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/// A unit of work for glow_parallel_for. \p ctx is the opaque context that
+/// was passed to glow_parallel_for and \p task is the index of the task.
+typedef void (*glow_parallel_task_fn)(void *ctx, size_t task);
+
+/// Run the tasks [0 .. \p numTasks) using up to \p numThreads threads. The
+/// calling thread runs tasks as well, and the other threads are the idle
+/// workers of the pool, so nested or concurrent calls never use more threads
+/// than the pool has. The threads take the next task from a shared counter.
+/// Returns when all of the tasks are done.
+void glow_parallel_for(size_t numTasks, size_t numThreads,
+                       glow_parallel_task_fn fn, void *ctx);
+
+/// Set the number of threads of the pool, including the calling thread, to
+/// \p numThreads. The default is the number of online processors.
+void glow_parallel_set_num_threads(size_t numThreads);
+
+/// \returns the number of threads of the pool, including the calling thread.
+size_t glow_parallel_get_num_threads();
+
+/// Pin the worker \p i of the pool to the processor \p cpus[i % numCpus].
+/// The workers are not pinned if \p numCpus is 0, which is the default.
+void glow_parallel_set_affinity(const int *cpus, size_t numCpus);
+
+/// Limit the calls of glow_parallel_for that the calling thread makes to
+/// \p numThreads threads, the calling thread included, e.g. to the cores that
+/// the request that it runs was given. 0 removes the limit, which is the
+/// default. The limit holds for the calling thread only.
+void glow_parallel_set_thread_limit(size_t numThreads);
+
+/// Set the number of times that an idle worker polls for work before it
+/// sleeps until it is woken up.
+void glow_parallel_set_spin_count(size_t spinCount);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // GLOW_SUPPORT_PARALLEL_H
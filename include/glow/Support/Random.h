@@ -16,6 +16,9 @@
 #ifndef GLOW_SUPPORT_RANDOM_H
 #define GLOW_SUPPORT_RANDOM_H
 
+#include <cstddef>
+#include <cstdint>
+
 namespace glow {
 
 /// \returns the next uniform random number in the range -1..1.
@@ -24,6 +27,17 @@ double nextRand();
 /// \returns the next uniform random integer in the closed interval [a, b].
 int nextRandInt(int a, int b);
 
+/// Set the seed of the stream of fillRandUniform to \p seed, and rewind the
+/// stream.
+void seedRandStream(uint64_t seed);
+
+/// Fill the \p size elements at \p dest with the next uniform random numbers
+/// in the range [low .. high) of a counter-based (Philox4x32-10) stream. The
+/// elements are filled in parallel. Every number is a function of the seed and
+/// of its position in the stream only, so the results don't depend on the
+/// number of threads.
+void fillRandUniform(float *dest, size_t size, float low, float high);
+
 } // namespace glow
 
 #endif // GLOW_SUPPORT_RANDOM_H
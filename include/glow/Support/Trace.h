@@ -0,0 +1,74 @@
+/**
+ * Copyright (c) 2017-present, Facebook, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#ifndef GLOW_SUPPORT_TRACE_H
+#define GLOW_SUPPORT_TRACE_H
+
+#include "llvm/ADT/StringRef.h"
+
+#include <cstdint>
+#include <string>
+
+namespace glow {
+
+// The timeline of the process: the phases of the compilation and the
+// executions of the instructions by the backends. The events are recorded
+// while tracing is enabled, by -trace-file or by enableTrace, and the
+// timeline is written in the Chrome trace format, which chrome://tracing and
+// Perfetto display.
+
+/// The categories of the events.
+constexpr const char *TraceCompile = "compile";
+constexpr const char *TraceRun = "run";
+constexpr const char *TraceKernel = "kernel";
+
+/// \returns whether the events are recorded.
+bool isTraceEnabled();
+
+/// Start or stop recording the events.
+void enableTrace(bool enable);
+
+/// \returns the current time of the timeline in nanoseconds. The clock is the
+/// monotonic clock, which the timestamps of the jitted code use as well.
+uint64_t getTraceTime();
+
+/// Record the event \p name of \p category, which ran from \p begin to \p end
+/// on the calling thread. The times are those of getTraceTime. Does nothing
+/// if tracing is disabled.
+void traceEvent(llvm::StringRef name, const char *category, uint64_t begin,
+                uint64_t end);
+
+/// Write the events recorded so far into the file \p path in the Chrome trace
+/// format. \returns false if the file can't be written.
+bool writeTrace(llvm::StringRef path);
+
+/// Drop the events recorded so far.
+void clearTrace();
+
+/// Records an event for the lifetime of the object, if tracing is enabled
+/// when it is created.
+class TraceScope {
+  std::string name_;
+  const char *category_;
+  uint64_t begin_{0};
+
+public:
+  TraceScope(llvm::StringRef name, const char *category);
+  ~TraceScope();
+};
+
+} // namespace glow
+
+#endif // GLOW_SUPPORT_TRACE_H
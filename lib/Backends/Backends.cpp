@@ -29,6 +29,8 @@
 
 #include "llvm/Support/Casting.h"
 
+#include <cstring>
+
 using namespace glow;
 
 Backend *glow::createBackend(BackendKind backendKind, IRFunction *F) {
@@ -54,6 +56,75 @@ Backend *glow::createBackend(BackendKind backendKind, IRFunction *F) {
   llvm_unreachable("unreachable");
 }
 
+bool glow::isOpSupported(BackendKind backendKind, Kinded::Kind opKind,
+                         ElemKind elementTy) {
+  switch (backendKind) {
+  case BackendKind::Interpreter:
+    return Interpreter::supportsOp(opKind, elementTy);
+  case BackendKind::OpenCL:
+#ifndef GLOW_WITH_OPENCL
+    GLOW_UNREACHABLE("Must compile with OpenCL support");
+#else
+    return OCLBackend::supportsOp(opKind, elementTy);
+#endif
+  case BackendKind::CPU:
+#ifndef GLOW_WITH_CPU
+    GLOW_UNREACHABLE("Must compile with CPU support");
+#else
+    return CPUBackend::supportsOp(opKind, elementTy);
+#endif
+  }
+  llvm_unreachable("unreachable");
+}
+
+bool glow::shouldLower(BackendKind backendKind, const Node *N) {
+  switch (backendKind) {
+  case BackendKind::Interpreter:
+    return Interpreter::lowersNode(N);
+  case BackendKind::OpenCL:
+#ifndef GLOW_WITH_OPENCL
+    GLOW_UNREACHABLE("Must compile with OpenCL support");
+#else
+    return OCLBackend::lowersNode(N);
+#endif
+  case BackendKind::CPU:
+#ifndef GLOW_WITH_CPU
+    GLOW_UNREACHABLE("Must compile with CPU support");
+#else
+    return CPUBackend::lowersNode(N);
+#endif
+  }
+  llvm_unreachable("unreachable");
+}
+
 void Backend::save(llvm::StringRef outputDir) {
   GLOW_UNREACHABLE("Saving a bundle is not supported by the backend");
 }
+
+void Backend::save(llvm::ArrayRef<IRFunction *> entries,
+                   llvm::StringRef outputDir, llvm::StringRef bundleName) {
+  GLOW_UNREACHABLE("Saving a bundle is not supported by the backend");
+}
+
+void Backend::saveCompiled(llvm::StringRef path) {
+  GLOW_UNREACHABLE("Saving the compiled code is not supported by the backend");
+}
+
+void Backend::loadCompiled(llvm::StringRef path, Module &M) {
+  GLOW_UNREACHABLE("Loading the compiled code is not supported by the backend");
+}
+
+void Backend::reorderState(Variable *v, llvm::ArrayRef<size_t> rows) {
+  auto &payload = v->getPayload();
+  assert(rows.size() == payload.dims()[0] && "Invalid number of rows");
+  readState(v);
+  // Gather the rows into a copy, as a row may be read after it was replaced.
+  Tensor old = payload.clone();
+  size_t rowSize = payload.getType().getSizeInBytes() / rows.size();
+  for (size_t i = 0, e = rows.size(); i < e; i++) {
+    assert(rows[i] < e && "Invalid row");
+    memcpy(payload.getUnsafePtr() + i * rowSize,
+           old.getUnsafePtr() + rows[i] * rowSize, rowSize);
+  }
+  writeState(v);
+}
@@ -32,14 +32,15 @@ using llvm::dyn_cast;
 using llvm::isa;
 using llvm::StringRef;
 
-void AllocationsInfo::allocateWeightVars(IRFunction *F, bool reuseAddresses) {
+void AllocationsInfo::allocateWeightVars(IRFunction *F, bool reuseAddresses,
+                                         bool allocateUnusedMutable) {
   // Use two different allocators, because constant weights and mutable weights
   // may use different memory blocks.
   MemoryAllocator constantWeightVarsAllocator(0);
   MemoryAllocator mutableWeightVarsAllocator(0);
 
-  // Compute the new offsets for all the weights, do not reuse their current
-  // addresses. Process all constant WeightVars first.
+  // Compute the new offsets for all the weights. Process all constant
+  // WeightVars first.
   for (auto &v : F->getGraph()->getParent()->getVars()) {
     assert(isa<WeightVar>(F->getWeightForNode(v)));
     auto *w = cast<WeightVar>(F->getWeightForNode(v));
@@ -62,15 +63,10 @@ void AllocationsInfo::allocateWeightVars(IRFunction *F, bool reuseAddresses) {
     auto *w = cast<WeightVar>(F->getWeightForNode(v));
     if (v->getVisibilityKind() != VisibilityKind::Public)
       continue;
+    if (!allocateUnusedMutable && !w->hasUsers())
+      continue;
     auto numBytes = w->getSizeInBytes();
-    size_t addr = mutableWeightVarsAllocator.allocate(numBytes);
-    if (!reuseAddresses) {
-      allocatedAddressed_[w] = addr;
-    } else {
-      // Reuse the address used by the payload.
-      allocatedAddressed_[w] =
-          v->getPayload().getUnsafePtr() - static_cast<char *>(nullptr);
-    }
+    allocatedAddressed_[w] = mutableWeightVarsAllocator.allocate(numBytes);
   }
 
   // Remember that max required memory size for each kind of weights.
@@ -103,13 +99,24 @@ void AllocationsInfo::allocateActivations(IRFunction *F) {
   // Maps activations and views to some offset within the heap.
   llvm::DenseMap<Value *, size_t> activationAddr;
 
+  // The live intervals of the activations for the offline allocation, and the
+  // activations they belong to.
+  std::vector<LiveBuffer> buffers;
+  std::vector<AllocActivationInst *> bufferActivations;
+  llvm::DenseMap<AllocActivationInst *, size_t> bufferIndices;
+
   // Assign device-space addresses to the activations.
-  for (auto &I : F->getInstrs()) {
+  size_t instrIdx = 0;
+  for (auto *I : F->getInstrs()) {
+    instrIdx++;
     if (auto *A = dyn_cast<AllocActivationInst>(I)) {
       auto numBytes = I->getSizeInBytes();
       size_t addr = activationsAllocator.allocate(numBytes);
       assert(!activationAddr.count(A) && "Allocation already made!");
       activationAddr[A] = addr;
+      bufferIndices[A] = buffers.size();
+      buffers.emplace_back(numBytes, instrIdx, F->getInstrs().size() + 1);
+      bufferActivations.push_back(A);
       continue;
     }
 
@@ -117,12 +124,27 @@ void AllocationsInfo::allocateActivations(IRFunction *F) {
       auto *A = D->getAlloc();
       assert(activationAddr.count(A) && "Invalid deallocation!");
       activationsAllocator.deallocate(activationAddr[A]);
+      buffers[bufferIndices[A]].end_ = instrIdx;
       continue;
     }
   }
 
   activationsMemSize_ = activationsAllocator.getMaxMemoryUsage();
 
+  // Place the activations again, this time knowing all of their live
+  // intervals, and keep the placement that needs less memory.
+  std::vector<size_t> offlineAddrs;
+  size_t offlineMemSize = allocateOffline(buffers, offlineAddrs);
+  DEBUG(llvm::dbgs() << "Peak activations memory: first fit "
+                     << activationsMemSize_ << " bytes, offline best fit "
+                     << offlineMemSize << " bytes\n");
+  if (offlineMemSize < activationsMemSize_) {
+    activationsMemSize_ = offlineMemSize;
+    for (size_t i = 0, e = buffers.size(); i < e; i++) {
+      activationAddr[bufferActivations[i]] = offlineAddrs[i];
+    }
+  }
+
   // Register specific addresses within the heap to activations.
   for (auto &A : activationAddr) {
     allocatedAddressed_[A.first] = A.second;
@@ -150,7 +172,7 @@ void AllocationsInfo::numberValues(IRFunction *F) {
     valueNumbers_[w] = std::make_pair(kind, valueIdx++);
   }
   // Assign numbers to all activations.
-  for (auto &I : F->getInstrs()) {
+  for (auto *I : F->getInstrs()) {
     if (auto *A = dyn_cast<AllocActivationInst>(I)) {
       valueNumbers_[A] = std::make_pair(ValueKind::Activation, valueIdx++);
       continue;
@@ -54,10 +54,16 @@ struct AllocationsInfo {
 
   /// Assign offsets to all WeightVars of \p M.
   /// If the \p reuseAddresses is true, simply reuse the addresses already used
-  /// by the payloads of tensors corresponding to those WeightVars as offsets.
-  /// This is useful in a JIT setup. If \p reuseAddresses is false, then all the
-  /// WeightVars will get new offsets assigned.
-  void allocateWeightVars(IRFunction *F, bool reuseAddresses);
+  /// by the payloads of tensors corresponding to the constant WeightVars as
+  /// offsets. This is useful in a JIT setup. If \p reuseAddresses is false,
+  /// then the constant WeightVars will get new offsets assigned. The mutable
+  /// WeightVars always get new offsets, so that every execution of the code
+  /// can provide its own memory for the inputs and outputs. If \p
+  /// allocateUnusedMutable is false, the mutable WeightVars that \p F does not
+  /// use get no offsets, e.g. the inputs and outputs of the other entries of a
+  /// bundle.
+  void allocateWeightVars(IRFunction *F, bool reuseAddresses,
+                          bool allocateUnusedMutable = true);
   /// Assign offsets to all activations.
   /// No actual memory allocation is performed. All the allocations should be
   /// performed by the client based on the information provided by the
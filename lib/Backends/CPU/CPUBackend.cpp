@@ -16,20 +16,40 @@
 
 #define DEBUG_TYPE "jit"
 #include "CPUBackend.h"
+#include "CommandLine.h"
+#include "KernelCache.h"
+#include "ObjectCache.h"
 #include "glow/Graph/Graph.h"
+#include "glow/IR/IRBuilder.h"
 #include "glow/IR/Instrs.h"
+#include "glow/Support/Trace.h"
 
 #include "llvm/ADT/DenseMap.h"
 #include "llvm/ADT/STLExtras.h"
 #include "llvm/ADT/SmallVector.h"
+#include "llvm/Bitcode/BitcodeReader.h"
 #include "llvm/Bitcode/BitcodeWriter.h"
 #include "llvm/IR/Constants.h"
 #include "llvm/IR/IRBuilder.h"
 #include "llvm/IR/LLVMContext.h"
+#include "llvm/IR/LegacyPassManager.h"
 #include "llvm/IR/Module.h"
+#include "llvm/Linker/Linker.h"
 #include "llvm/Support/Casting.h"
 #include "llvm/Support/Debug.h"
+#include "llvm/Support/Format.h"
+#include "llvm/Support/MemoryBuffer.h"
 #include "llvm/Support/raw_ostream.h"
+#include "llvm/Transforms/IPO.h"
+#include "llvm/Transforms/IPO/Internalize.h"
+#include "llvm/Transforms/Utils/ModuleUtils.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <unistd.h>
+#include <vector>
 
 using namespace glow;
 using llvm::cast;
@@ -37,113 +57,1105 @@ using llvm::dyn_cast;
 using llvm::isa;
 using llvm::StringRef;
 
+extern llvm::cl::opt<bool> emitDebugInfo;
+
 static llvm::cl::opt<std::string> target("target", llvm::cl::desc("target"));
 
+static llvm::cl::opt<unsigned>
+    numThreads("cpu-num-threads",
+               llvm::cl::desc("The maximal number of threads used by the "
+                              "multi-threaded CPU kernels"),
+               llvm::cl::init(1), llvm::cl::cat(CPUBackendCat));
+
+static llvm::cl::opt<unsigned> numTaskThreads(
+    "cpu-task-threads",
+    llvm::cl::desc("The number of threads used for running independent "
+                   "instructions of the jitted code concurrently. The default "
+                   "of 1 runs the instructions serially in program order"),
+    llvm::cl::init(1), llvm::cl::cat(CPUBackendCat));
+
+static llvm::cl::opt<bool> preemptible(
+    "cpu-preemptible",
+    llvm::cl::desc("Emit every kernel of the jitted code as a task, so that "
+                   "the sessions can be preempted between the kernels, e.g. "
+                   "by a ModelExecutor that runs a more urgent model"),
+    llvm::cl::init(false), llvm::cl::cat(CPUBackendCat));
+
+static llvm::cl::opt<unsigned> numCodeGenThreads(
+    "cpu-codegen-threads",
+    llvm::cl::desc("The number of modules that the code is split into, which "
+                   "are optimized and compiled concurrently. The instructions "
+                   "are then emitted as tasks"),
+    llvm::cl::init(1), llvm::cl::cat(CPUBackendCat));
+
+static llvm::cl::opt<bool> tieredJIT(
+    "cpu-tiered-jit",
+    llvm::cl::desc("Compile quick code without inlining and specializing "
+                   "libjit first, and replace it with the optimized code "
+                   "that is compiled in the background"),
+    llvm::cl::init(false), llvm::cl::cat(CPUBackendCat));
+
+static llvm::cl::opt<bool> lazyJIT(
+    "cpu-lazy-jit",
+    llvm::cl::desc("Compile every function of the jitted code on its first "
+                   "call instead of when the code is loaded. The first run "
+                   "then runs alone and serially"),
+    llvm::cl::init(false), llvm::cl::cat(CPUBackendCat));
+
+static llvm::cl::opt<bool> shareKernels(
+    "cpu-share-kernels",
+    llvm::cl::desc("Compile every specialization of the libjit kernels once "
+                   "per process and call it from all of the jitted code "
+                   "instead of compiling it into every network. The kernels "
+                   "are stored in the object cache, if any"),
+    llvm::cl::init(false), llvm::cl::cat(CPUBackendCat));
+
+static llvm::cl::opt<std::string> objectCacheDir(
+    "cpu-object-cache-dir",
+    llvm::cl::desc("The directory of a persistent cache of the jitted object "
+                   "code. Networks that were compiled before are loaded from "
+                   "the cache instead of being optimized and compiled again. "
+                   "The cache is not used by default"),
+    llvm::cl::cat(CPUBackendCat));
+
+static llvm::cl::list<unsigned> cacheSizes(
+    "cpu-cache-sizes",
+    llvm::cl::desc("The sizes of the L1, L2 and L3 data caches in KB, used for "
+                   "choosing the matrix multiplication block sizes. By "
+                   "default the caches of the host are used, unless -target "
+                   "is specified"),
+    llvm::cl::CommaSeparated, llvm::cl::cat(CPUBackendCat));
+
+static llvm::cl::opt<HugePageMode> hugePages(
+    "cpu-huge-pages",
+    llvm::cl::desc("The pages that back the activations and the constant "
+                   "weights of the jitted code"),
+    llvm::cl::values(
+        clEnumValN(HugePageMode::None, "none", "Regular pages"),
+        clEnumValN(HugePageMode::Transparent, "transparent",
+                   "Transparent huge pages, if the system enables them"),
+        clEnumValN(HugePageMode::Explicit, "explicit",
+                   "The huge pages reserved by the system, or the "
+                   "transparent ones if none are left")),
+    llvm::cl::init(HugePageMode::None), llvm::cl::cat(CPUBackendCat));
+
+static llvm::cl::opt<int> numaNode(
+    "cpu-numa-node",
+    llvm::cl::desc("The NUMA node that the activations and the constant "
+                   "weights of the jitted code are bound to. It should be the "
+                   "node of the threads that run the code. By default the "
+                   "system places the memory"),
+    llvm::cl::init(-1), llvm::cl::cat(CPUBackendCat));
+
+static llvm::cl::opt<bool> bundleMmapWeights(
+    "bundle-mmap-weights",
+    llvm::cl::desc("Pad the weights file of the bundle to whole pages, so that "
+                   "the clients can map it into memory read-only instead of "
+                   "reading it"),
+    llvm::cl::init(false), llvm::cl::cat(CPUBackendCat));
+
+static llvm::cl::opt<bool> bundleEmbedWeights(
+    "bundle-embed-weights",
+    llvm::cl::desc("Emit the constant weights of the bundle into its object "
+                   "file instead of a separate weights file"),
+    llvm::cl::init(false), llvm::cl::cat(CPUBackendCat));
+
+/// The CPU variants of the code of bundles. The level of a variant is the one
+/// that libjit_cpu_level reports for the hosts that support its features.
+enum class BundleCPULevel : unsigned {
+  Generic = 0,
+  SSE42 = 1,
+  AVX2 = 2,
+  AVX512 = 3,
+};
+
+/// The description of a CPU variant of the code of a bundle.
+struct BundleCPUVariant {
+  /// The suffix of the entry point of the variant.
+  const char *suffix;
+  /// The x86 features that the variant is compiled for.
+  std::vector<std::string> features;
+};
+
+/// The CPU variants of bundles, indexed by their level. The baseline is the
+/// generic x86-64 CPU.
+static const BundleCPUVariant bundleCPUVariantInfo[] = {
+    {"_generic", {}},
+    {"_sse4_2", {"+sse4.2", "+popcnt"}},
+    {"_avx2", {"+avx2", "+fma"}},
+    {"_avx512", {"+avx512f", "+avx512bw", "+avx512dq", "+avx512vl", "+fma"}},
+};
+
+static llvm::cl::list<BundleCPULevel> bundleCPUVariants(
+    "bundle-cpu-variants",
+    llvm::cl::desc("Compile the code of the bundle for the generic x86-64 CPU "
+                   "and for each one of these feature sets. The bundle "
+                   "selects the best variant that the host supports when it "
+                   "is loaded"),
+    llvm::cl::values(
+        clEnumValN(BundleCPULevel::SSE42, "sse4.2", "SSE4.2 and POPCNT"),
+        clEnumValN(BundleCPULevel::AVX2, "avx2", "AVX2 and FMA"),
+        clEnumValN(BundleCPULevel::AVX512, "avx512",
+                   "AVX-512 F, BW, DQ and VL")),
+    llvm::cl::CommaSeparated, llvm::cl::cat(CPUBackendCat));
+
+/// The page size that the mappable weights files are padded to. It is the
+/// largest page size in common use, so the padded files are mappable on all of
+/// the hosts.
+static constexpr size_t bundleWeightsPageSize = 64 * 1024;
+
+/// \returns the size in bytes of the data cache of the host at \p level, or 0
+/// if it is unknown.
+static size_t getHostCacheSize(unsigned level) {
+#if defined(_SC_LEVEL1_DCACHE_SIZE) && defined(_SC_LEVEL2_CACHE_SIZE) &&       \
+    defined(_SC_LEVEL3_CACHE_SIZE)
+  static const int names[] = {_SC_LEVEL1_DCACHE_SIZE, _SC_LEVEL2_CACHE_SIZE,
+                              _SC_LEVEL3_CACHE_SIZE};
+  assert(level >= 1 && level <= 3 && "Invalid cache level");
+  long size = sysconf(names[level - 1]);
+  return size > 0 ? size : 0;
+#else
+  (void)level;
+  return 0;
+#endif
+}
+
+/// \returns the cache block sizes for the libjit matrix multiplication. The
+/// sizes are derived from the cache sizes provided by -cpu-cache-sizes, or
+/// from the caches of the host when compiling for the host.
+static GemmBlockSizes getGemmBlockSizes() {
+  // The defaults correspond to a 32KB L1, a 256KB L2 and an 8MB L3.
+  size_t caches[3] = {32 << 10, 256 << 10, 8 << 20};
+  for (unsigned level = 0; level < 3; level++) {
+    if (level < cacheSizes.size()) {
+      caches[level] = size_t(cacheSizes[level]) << 10;
+    } else if (target.empty()) {
+      if (size_t size = getHostCacheSize(level + 1)) {
+        caches[level] = size;
+      }
+    }
+  }
+
+  // The register tile of the libjit kernel is mr x nr. The AVX-512 kernel
+  // has 8 rows.
+  const size_t mr = target.empty() && LLVMIRGen::useHostAVX512() ? 8 : 3;
+  constexpr size_t nr = 32;
+  GemmBlockSizes sizes;
+  // A kc x nr micro-panel of B should occupy about half of the L1 cache.
+  sizes.kc = caches[0] / 2 / (nr * sizeof(float));
+  sizes.kc = std::min<size_t>(std::max<size_t>(sizes.kc, 32), 512);
+  // A mc x kc block of A should occupy about half of the L2 cache.
+  sizes.mc = caches[1] / 2 / (sizes.kc * sizeof(float));
+  sizes.mc = std::max(sizes.mc - sizes.mc % mr, mr);
+  // A kc x nc block of B should occupy about a quarter of the (shared) L3.
+  sizes.nc = caches[2] / 4 / (sizes.kc * sizeof(float));
+  sizes.nc = std::max(sizes.nc - sizes.nc % nr, nr);
+  return sizes;
+}
+
+unsigned CPUBackend::getConvBlockWidth() {
+  return target.empty() && LLVMIRGen::useHostAVX512() ? 16 : 8;
+}
+
 CPUBackend::CPUBackend(IRFunction *F)
-    : F_(F), irgen_(F_, allocationsInfo_, "") {}
+    : F_(F), irgen_(F_, allocationsInfo_, "") {
+  irgen_.setNumThreads(std::max(1u, numThreads.getValue()));
+  irgen_.setGemmBlockSizes(getGemmBlockSizes());
+  irgen_.setKernelTuningDB(&KernelTuningDB::get());
+  memoryPolicy_.hugePages = hugePages;
+  memoryPolicy_.numaNode = numaNode;
+}
 
 CPUBackend::~CPUBackend() {
   clear();
-  alignedFree(heap_);
+  freeMemory(heap_, heapSize_, memoryPolicy_);
+  freeMemory(loadedWeights_, loadedWeightsSize_, memoryPolicy_);
 }
 
-void CPUBackend::clear() { F_->clear(); }
+void CPUBackend::clear() {
+  // The optimizer thread reads the IR function.
+  waitForOptimizedCode();
+  F_->clear();
+}
 
 //===----------------------------------------------------------------------===//
 //                   Functions for executing code using JIT
 //===----------------------------------------------------------------------===//
 
 /// Emit the entry point for JIT called "jitmain". It simply calls the main
-/// entry of the module with the constant concrete addresses of all the memory
-/// areas. Since these addresses are constants, the LLVM optimizer will constant
-/// propagate them into relative addressing computations and the like and
-/// produce a very efficient code that uses absolute addressing whenever
-/// possible.
-void CPUBackend::emitJitMain() {
-  llvm::Type *voidTy = llvm::Type::getVoidTy(irgen_.getLLVMContext());
-  llvm::FunctionType *jitFuncTy = llvm::FunctionType::get(voidTy, {}, false);
+/// entry of the module with the memory area of the activations and the array
+/// of offsets, which it gets as arguments. The offsets of the weights are
+/// their absolute addresses, so the code reads and writes the payloads of the
+/// variables, or any other tensors bound to them, in place. Unless the code
+/// embeds the offsets (see LLVMIRGen::setEmbedOffsets), it loads all of them
+/// from the array and doesn't depend on the process that produced it.
+void CPUBackend::emitJitMain(LLVMIRGen &irgen) {
+  llvm::Type *voidTy = llvm::Type::getVoidTy(irgen.getLLVMContext());
+  auto int8PtrTy = llvm::Type::getInt8PtrTy(irgen.getLLVMContext());
+  // Get the integer type having the same size in bits as size_t.
+  auto *sizeTType =
+      llvm::Type::getIntNTy(irgen.getLLVMContext(), sizeof(size_t) * 8);
+  llvm::FunctionType *jitFuncTy = llvm::FunctionType::get(
+      voidTy, {int8PtrTy, sizeTType->getPointerTo()}, false);
   auto *func =
       llvm::Function::Create(jitFuncTy, llvm::Function::ExternalLinkage,
-                             "jitmain", &irgen_.getModule());
+                             "jitmain", &irgen.getModule());
   llvm::BasicBlock *entry_bb =
-      llvm::BasicBlock::Create(irgen_.getLLVMContext(), "entry", func);
+      llvm::BasicBlock::Create(irgen.getLLVMContext(), "entry", func);
   llvm::IRBuilder<> builder(entry_bb);
 
-  // Prepare arguments for the "main" function.
-  llvm::SmallVector<llvm::Value *, 4> initFunctionCallArgs;
-  // Get the integer type having the same size in bits as size_t.
-  auto *sizeTType = builder.getIntNTy(sizeof(size_t) * 8);
-  auto int8PtrTy = llvm::Type::getInt8PtrTy(irgen_.getLLVMContext());
-
-  initFunctionCallArgs.push_back(builder.CreateIntToPtr(
-      llvm::ConstantInt::get(
-          sizeTType, reinterpret_cast<size_t>(
-                         allocationsInfo_.baseConstantWeightVarsAddress_)),
-      int8PtrTy));
-  initFunctionCallArgs.push_back(builder.CreateIntToPtr(
-      llvm::ConstantInt::get(
-          sizeTType, reinterpret_cast<size_t>(
-                         allocationsInfo_.baseMutableWeightVarsAddress_)),
-      int8PtrTy));
-  initFunctionCallArgs.push_back(builder.CreateIntToPtr(
-      llvm::ConstantInt::get(
-          sizeTType,
-          reinterpret_cast<size_t>(allocationsInfo_.baseActivationsAddress_)),
-      int8PtrTy));
-  // Now form the offsets array and pass it as the last argument.
-  auto offsetsArray =
-      irgen_.emitConstOffsetsArray(irgen_.getBuilder(), allocationsInfo_);
-  initFunctionCallArgs.push_back(offsetsArray);
-  // Invoke the main entry with constant arguments and let LLVM optimizer make
-  // use of it.
-  auto *entryF = irgen_.getModule().getFunction(irgen_.getMainEntryName());
+  // Prepare arguments for the "main" function. The weights are addressed
+  // relative to null.
+  auto *nullPtr = llvm::ConstantPointerNull::get(int8PtrTy);
+  llvm::Value *initFunctionCallArgs[] = {nullPtr, nullPtr,
+                                         func->args().begin(),
+                                         func->args().begin() + 1};
+  auto *entryF = irgen.getModule().getFunction(irgen.getMainEntryName());
   entryF->setLinkage(llvm::Function::InternalLinkage);
   builder.CreateCall(entryF, initFunctionCallArgs);
   // Terminate the function.
   builder.CreateRetVoid();
 }
 
+/// \returns the address of the jitted symbol \p name.
+static void *getJitSymbolAddress(llvm::orc::GlowJIT &JIT,
+                                 const std::string &name) {
+  auto sym = JIT.findSymbol(name);
+  assert(sym && "Unable to find the jitted symbol!");
+  auto address = sym.getAddress();
+  GLOW_ASSERT(address && "Error getting the address of a jitted symbol.");
+  return reinterpret_cast<void *>(address.get());
+}
+
+void CPUBackend::setJitMain(llvm::orc::GlowJIT &JIT) {
+  // Looking up the entry point links the machine code of the modules. The
+  // lazy JIT only links the stubs of the functions at this point.
+  TraceScope trace("JIT link", TraceCompile);
+  // The trace is present only if the code was compiled while tracing.
+  KernelTraceEntry *kernelTrace = nullptr;
+  if (auto sym = JIT.findSymbol(irgen_.getMainEntryName() + "_trace")) {
+    auto address = sym.getAddress();
+    GLOW_ASSERT(address && "Error getting the address of the trace.");
+    kernelTrace = reinterpret_cast<KernelTraceEntry *>(address.get());
+  }
+  kernelTrace_ = kernelTrace;
+  jitMain_ =
+      reinterpret_cast<JitMainType>(getJitSymbolAddress(JIT, "jitmain"));
+}
+
+void CPUBackend::traceKernels() const {
+  auto *entry = kernelTrace_.load();
+  if (!entry || !isTraceEnabled()) {
+    return;
+  }
+  // Every kernel keeps the times of its last call. They are cleared once
+  // recorded, so that the kernels that didn't run since are skipped.
+  for (; entry->name; entry++) {
+    if (entry->begin) {
+      traceEvent(entry->name, TraceKernel, entry->begin, entry->end);
+      entry->begin = 0;
+    }
+  }
+}
+
+void CPUBackend::allocateHeap() {
+  freeMemory(heap_, heapSize_, memoryPolicy_);
+  heap_ = nullptr;
+  heapSize_ = 0;
+  if (arena_) {
+    arena_->reserve(allocationsInfo_.activationsMemSize_);
+  } else if (allocationsInfo_.activationsMemSize_ > 0) {
+    // Allocate the heap to match the max memory usage for activations.
+    heapSize_ = allocationsInfo_.activationsMemSize_;
+    heap_ = allocateMemory(heapSize_, memoryPolicy_);
+  }
+  allocationsInfo_.baseActivationsAddress_ = (uint8_t *)heap_;
+}
+
+uint8_t *CPUBackend::getActivations() const {
+  if (arena_) {
+    return static_cast<uint8_t *>(
+        arena_->get(allocationsInfo_.activationsMemSize_));
+  }
+  return allocationsInfo_.baseActivationsAddress_;
+}
+
+void CPUBackend::setActivationArena(ActivationArena *arena) {
+  arena_ = arena;
+  allocateHeap();
+}
+
+void CPUBackend::prefault() {
+  prefaultForWrite(getActivations(), allocationsInfo_.activationsMemSize_);
+  if (loadedWeightsData_) {
+    prefaultForRead(loadedWeightsData_, loadedWeightsDataSize_);
+    return;
+  }
+  // The constant weights are read in place from the payloads of their
+  // variables.
+  for (auto *W : F_->getWeights()) {
+    if (W->getMutability() != WeightVar::MutabilityKind::Constant) {
+      continue;
+    }
+    auto address = allocationsInfo_.allocatedAddressed_.lookup(W);
+    prefaultForRead(reinterpret_cast<const void *>(address),
+                    W->getSizeInBytes());
+  }
+}
+
 void CPUBackend::performJITMemoryAllocation() {
+  loadedWeightsData_ = nullptr;
+  loadedWeightsDataSize_ = 0;
   allocationsInfo_.clear();
   allocationsInfo_.numberValues(F_);
   allocationsInfo_.allocateActivations(F_);
   // Tell the allocateWeightVars to reuse existing addresses for weights.
   allocationsInfo_.allocateWeightVars(F_, true);
+  allocateHeap();
 
-  // Allocate the heap to match the max memory usage for activations.
-  if (allocationsInfo_.activationsMemSize_ > 0) {
-    alignedFree(heap_);
-    heap_ = alignedAlloc(allocationsInfo_.activationsMemSize_, TensorAlignment);
-    allocationsInfo_.baseActivationsAddress_ = (uint8_t *)heap_;
+  // The constant weights stay in the payloads of their variables, which are
+  // moved to the pages of the memory policy instead.
+  if (!memoryPolicy_.isDefault()) {
+    for (auto *v : F_->getGraph()->getParent()->getVars()) {
+      if (v->getVisibilityKind() == VisibilityKind::Public)
+        continue;
+      auto &payload = v->getPayload();
+      if (!applyMemoryPolicy(payload.getUnsafePtr(),
+                             payload.getType().getSizeInBytes(),
+                             memoryPolicy_)) {
+        DEBUG(llvm::dbgs() << "Could not apply the memory policy to the "
+                           << "weights of " << v->getName() << "\n");
+      }
+    }
   }
+
+  // The offsets of the mutable weights are set to the addresses of their
+  // tensors before every run. The offsets are followed by the batch size.
+  maxBatchSize_ = irgen_.getMaxBatchSize();
+  offsets_.assign(allocationsInfo_.valueNumbers_.size() + 1, 0);
+  offsets_.back() = maxBatchSize_;
+  mutableVars_.clear();
+  for (auto &I : allocationsInfo_.valueNumbers_) {
+    offsets_[I.second.second] =
+        allocationsInfo_.allocatedAddressed_.lookup(I.first);
+  }
+  for (auto *v : F_->getGraph()->getParent()->getVars()) {
+    if (v->getVisibilityKind() != VisibilityKind::Public)
+      continue;
+    auto it = allocationsInfo_.valueNumbers_.find(F_->getWeightForNode(v));
+    if (it == allocationsInfo_.valueNumbers_.end())
+      continue;
+    mutableVars_.push_back({v, it->second.second});
+  }
+}
+
+void CPUBackend::initJitTasks() {
+  taskFuncs_.clear();
+  taskGraph_.clear();
+  for (const auto &task : irgen_.getTasks()) {
+    taskFuncs_.push_back(
+        reinterpret_cast<TaskFuncType>(getJitSymbolAddress(*JIT_, task.name)));
+    taskGraph_.addTask(task.deps);
+  }
+  if (taskFuncs_.empty()) {
+    return;
+  }
+  if (!threadPool_ || threadPool_->getNumThreads() != numTaskThreads) {
+    threadPool_.reset(new ThreadPool(numTaskThreads));
+  }
+  DEBUG(llvm::dbgs() << "Running " << taskFuncs_.size() << " tasks on "
+                     << threadPool_->getNumThreads() << " threads\n");
+}
+
+void CPUBackend::compilePartitions(unsigned numPartitions) {
+  // Every partition has its own code generator, with its own LLVM context
+  // and target machine. They are set up on this thread, which initializes the
+  // LLVM targets, and the first partition uses irgen_, whose list of tasks is
+  // complete.
+  std::vector<std::unique_ptr<LLVMIRGen>> irgens;
+  for (unsigned p = 1; p < numPartitions; p++) {
+    auto *irgen = new LLVMIRGen(F_, allocationsInfo_, "");
+    irgens.emplace_back(irgen);
+    irgen->initTargetMachine(target.empty() ? "" : target.getValue(),
+                             llvm::CodeModel::Model::Large);
+    irgen->setNumThreads(irgen_.getNumThreads());
+    irgen->setGemmBlockSizes(irgen_.getGemmBlockSizes());
+    irgen->setKernelTuningDB(irgen_.getKernelTuningDB());
+    irgen->setEmitTasks(true);
+    irgen->setShareKernels(irgen_.getShareKernels());
+    irgen->setEmbedOffsets(irgen_.getEmbedOffsets());
+    irgen->findBatchedValues();
+    irgen->setPartition(p, numPartitions);
+  }
+  irgen_.setPartition(0, numPartitions);
+
+  std::vector<std::unique_ptr<llvm::MemoryBuffer>> objects(numPartitions);
+  auto compile = [&](LLVMIRGen &irgen, unsigned p) {
+    irgen.initCodeGen();
+    // The main entry is empty when emitting tasks, but the code without any
+    // task runs through "jitmain".
+    if (p == 0) {
+      emitJitMain(irgen);
+    }
+    irgen.performCodeGen();
+    objects[p] = llvm::orc::GlowJIT::compileModule(irgen.getModule(),
+                                                   irgen.getTargetMachine());
+  };
+  std::vector<std::thread> threads;
+  for (unsigned p = 1; p < numPartitions; p++) {
+    threads.emplace_back(compile, std::ref(*irgens[p - 1]), p);
+  }
+  compile(irgen_, 0);
+  for (auto &thread : threads) {
+    thread.join();
+  }
+
+  // The JIT links the tasks of all of the partitions.
+  for (auto &object : objects) {
+    GLOW_ASSERT(object && "Unable to generate the machine code.");
+    bool added = JIT_->addObject(std::move(object));
+    (void)added;
+    assert(added && "Unable to load the generated machine code.");
+  }
+  setJitMain(*JIT_);
+  DEBUG(llvm::dbgs() << "Compiled the code in " << numPartitions
+                     << " partitions\n");
+}
+
+void CPUBackend::compileOptimizedCode(const std::string &cacheKey) {
+  TraceScope trace("JIT optimized code", TraceCompile);
+  auto &irgen = *optimizedIRGen_;
+  irgen.initCodeGen();
+  emitJitMain(irgen);
+  irgen.performCodeGen();
+  if (cacheKey.empty()) {
+    optimizedJIT_->addModule(irgen.borrowModule());
+  } else {
+    auto object = optimizedJIT_->compileModule(irgen.getModule());
+    GLOW_ASSERT(object && "Unable to generate the machine code.");
+    JITObjectCache(objectCacheDir).storeObject(cacheKey, object->getBuffer());
+    bool added = optimizedJIT_->addObject(std::move(object));
+    (void)added;
+    assert(added && "Unable to load the generated machine code.");
+  }
+  // The quick code stays in its JIT, so the runs that are using it finish.
+  setJitMain(*optimizedJIT_);
+  DEBUG(llvm::dbgs() << "Switched to the optimized code\n");
+}
+
+bool CPUBackend::waitForOptimizedCode() {
+  if (optimizer_.joinable()) {
+    optimizer_.join();
+  }
+  return bool(optimizedJIT_);
+}
+
+void CPUBackend::tuneKernels() {
+  if (isBenchmark_ || !isKernelAutotuningEnabled() || !target.empty()) {
+    return;
+  }
+  auto &db = KernelTuningDB::get();
+  StringRef cpu = irgen_.getTargetMachine().getTargetCPU();
+  bool tuned = false;
+  for (const auto *I : F_->getInstrs()) {
+    std::string key = getKernelTuningKey(I, cpu);
+    KernelParams best;
+    if (key.empty() || db.lookup(key, best)) {
+      continue;
+    }
+    double bestTime = 0;
+    for (const auto &params :
+         getKernelTuningCandidates(I, irgen_.getDefaultKernelParams(I))) {
+      double time = benchmarkKernel(I, key, params);
+      DEBUG({
+        llvm::dbgs() << "Tuning " << key << ":";
+        for (size_t param : params) {
+          llvm::dbgs() << " " << param;
+        }
+        llvm::dbgs() << " " << llvm::format("%.3f", time * 1e3) << " ms\n";
+      });
+      if (best.empty() || time < bestTime) {
+        best = params;
+        bestTime = time;
+      }
+    }
+    db.insert(key, best);
+    tuned = true;
+  }
+  if (tuned) {
+    saveKernelTuningDB();
+  }
+}
+
+double CPUBackend::benchmarkKernel(const Instruction *I,
+                                   const std::string &key,
+                                   const KernelParams &params) {
+  // Run a copy of the instruction alone. Its operands are the public
+  // variables of a new module, with random values.
+  Module M;
+  IRFunction F(M.createFunction("tune"));
+  IRBuilder builder(&F);
+  Instruction *copy = I->clone();
+  llvm::DenseMap<Value *, WeightVar *> weights;
+  for (unsigned i = 0, e = I->getNumOperands(); i < e; i++) {
+    Value *op = I->getOperand(i).first;
+    WeightVar *&W = weights[op];
+    if (!W) {
+      auto *V = M.createVariable(op->getType(), op->getName(),
+                                 VisibilityKind::Public,
+                                 Variable::TrainKind::None);
+      if (op->getElementType() == ElemKind::FloatTy) {
+        V->getPayload().getHandle().randomize(-1, 1);
+      }
+      W = builder.createWeightVar(V->getType(), op->getName(),
+                                  WeightVar::MutabilityKind::Mutable,
+                                  VisibilityKind::Public);
+      F.getVariableMap()[V] = W;
+    }
+    copy->setOperand(i, W);
+  }
+  copy->setParent(&F);
+  F.pushInstr(copy);
+
+  KernelTuningDB db;
+  db.insert(key, params);
+  CPUBackend backend(&F);
+  backend.isBenchmark_ = true;
+  backend.irgen_.setKernelTuningDB(&db);
+  backend.init();
+
+  // Warm up the caches, then run the kernel for at least a few milliseconds.
+  using Clock = std::chrono::steady_clock;
+  backend.doForwardPass();
+  auto start = Clock::now();
+  std::chrono::duration<double> elapsed(0);
+  size_t runs = 0;
+  do {
+    backend.doForwardPass();
+    runs++;
+    elapsed = Clock::now() - start;
+  } while (runs < 3 || elapsed < std::chrono::milliseconds(20));
+  return elapsed.count() / runs;
 }
 
 void CPUBackend::init() {
+  waitForOptimizedCode();
+  optimizedJIT_.reset();
+  optimizedIRGen_.reset();
   irgen_.initTargetMachine(target.empty() ? "" : target.getValue(),
                            llvm::CodeModel::Model::Large);
-  JIT_ = llvm::make_unique<llvm::orc::GlowJIT>(irgen_.getTargetMachine());
-  irgen_.initCodeGen();
+  tuneKernels();
+  // The lazy JIT doesn't compile the debug info of the functions that it
+  // splits apart.
+  JIT_ = llvm::make_unique<llvm::orc::GlowJIT>(irgen_.getTargetMachine(),
+                                               lazyJIT && !emitDebugInfo);
+  compilesOnFirstRun_ = false;
+  // Split the code into partitions that are compiled concurrently, if the
+  // instructions can be emitted as tasks.
+  unsigned numPartitions =
+      irgen_.canPartition() ? std::max(1u, numCodeGenThreads.getValue()) : 1;
+  irgen_.setPartition(0, 1);
+  // Emit every instruction as a separate task if the tasks run concurrently,
+  // if they are split into partitions or if the sessions are preempted
+  // between them.
+  bool emitTasks = numTaskThreads > 1 || numPartitions > 1 || preemptible;
+  irgen_.setEmitTasks(emitTasks);
+  irgen_.setFastCompile(false);
+  // The specializations are shared unless they carry the debug info of the
+  // code. The cache is set up before any code is loaded, because the cached
+  // object files of the code call the shared kernels as well.
+  bool share = shareKernels && !emitDebugInfo;
+  if (share) {
+    SharedKernelCache::get().init(irgen_.getTargetMachine(),
+                                  irgen_.getStandardLibraryPath(),
+                                  objectCacheDir);
+  }
+  irgen_.setShareKernels(share);
+  // The code that stays in this process embeds the offsets of the activations
+  // and the addresses of the constant weights. The code that is cached, and
+  // the shared kernels that its constant arguments may specialize, load them
+  // from the offsets array instead.
+  irgen_.setEmbedOffsets(!share);
+  // Find the batch that the code computes at run time, if any, which the
+  // offsets passed to the code end with.
+  irgen_.findBatchedValues();
   // Perform the address assignment for activations and WeightVars.
   performJITMemoryAllocation();
-  // Create the jitmain function to be invoked by JIT.
-  emitJitMain();
-  // Emit the code for the body of the entry function.
+
+  // The cache doesn't store the graph of the tasks and the files produced
+  // for the debug info, so it is used only for the serial code without debug
+  // info. The same goes for the tiered code, which only swaps "jitmain".
+  bool isSerial = !emitTasks && !emitDebugInfo;
+  if (numPartitions > 1) {
+    compilePartitions(numPartitions);
+    initJitTasks();
+    return;
+  }
+  if (!isSerial || isBenchmark_ || (objectCacheDir.empty() && !tieredJIT)) {
+    irgen_.initCodeGen();
+    // Create the jitmain function to be invoked by JIT.
+    emitJitMain(irgen_);
+    // Emit the code for the body of the entry function.
+    irgen_.performCodeGen();
+    // Hand over the module to JIT for the machine code generation.
+    JIT_->addModule(irgen_.borrowModule());
+    compilesOnFirstRun_ = JIT_->isLazy();
+    setJitMain(*JIT_);
+    // Find the tasks to run concurrently, if any.
+    initJitTasks();
+    return;
+  }
+
+  // The cached code loads all of the offsets.
+  irgen_.setEmbedOffsets(false);
+  std::string key;
+  if (!objectCacheDir.empty()) {
+    llvm::MD5 hash;
+    irgen_.hashCodeGenInputs(hash);
+    key = JITObjectCache::getKey(hash);
+    auto object = JITObjectCache(objectCacheDir).getObject(key);
+    if (object && JIT_->addObject(std::move(object))) {
+      DEBUG(llvm::dbgs() << "Loaded the jitted code from the cache: " << key
+                         << "\n");
+      setJitMain(*JIT_);
+      return;
+    }
+  }
+
+  if (tieredJIT) {
+    // Set up the optimized code generator on this thread, which initializes
+    // the LLVM targets, and generate the optimized code in the background.
+    optimizedIRGen_.reset(new LLVMIRGen(F_, allocationsInfo_, ""));
+    optimizedIRGen_->initTargetMachine(target.empty() ? "" : target.getValue(),
+                                       llvm::CodeModel::Model::Large);
+    optimizedIRGen_->setNumThreads(irgen_.getNumThreads());
+    optimizedIRGen_->setGemmBlockSizes(irgen_.getGemmBlockSizes());
+    optimizedIRGen_->setKernelTuningDB(irgen_.getKernelTuningDB());
+    optimizedIRGen_->setShareKernels(irgen_.getShareKernels());
+    optimizedIRGen_->setEmbedOffsets(!share && key.empty());
+    optimizedIRGen_->findBatchedValues();
+    optimizedJIT_ = llvm::make_unique<llvm::orc::GlowJIT>(
+        optimizedIRGen_->getTargetMachine());
+
+    // The quick code is ready to run in a fraction of the time. It is never
+    // cached.
+    irgen_.setFastCompile(true);
+    irgen_.setEmbedOffsets(!share);
+    irgen_.getTargetMachine().setOptLevel(llvm::CodeGenOpt::None);
+    irgen_.initCodeGen();
+    emitJitMain(irgen_);
+    irgen_.performCodeGen();
+    JIT_->addModule(irgen_.borrowModule());
+    compilesOnFirstRun_ = JIT_->isLazy();
+    setJitMain(*JIT_);
+    optimizer_ = std::thread([this, key]() { compileOptimizedCode(key); });
+    return;
+  }
+
+  irgen_.initCodeGen();
+  emitJitMain(irgen_);
   irgen_.performCodeGen();
-  // Hand over the module to JIT for the machine code generation.
-  JIT_->addModule(irgen_.borrowModule());
+  auto object = JIT_->compileModule(irgen_.getModule());
+  GLOW_ASSERT(object && "Unable to generate the machine code.");
+  JITObjectCache(objectCacheDir).storeObject(key, object->getBuffer());
+  bool added = JIT_->addObject(std::move(object));
+  (void)added;
+  assert(added && "Unable to load the generated machine code.");
+  setJitMain(*JIT_);
+}
+
+void CPUBackend::runJitCode(
+    uint8_t *activations, size_t *offsets, bool useThreadPool,
+    const std::function<void()> &preemptionPoint) const {
+  if (compilesOnFirstRun_) {
+    // The compile callbacks of the lazy JIT are not thread-safe, so the run
+    // that compiles the functions runs alone and calls the tasks in program
+    // order. The JIT compiles a function with every function that it may
+    // call or hand to the pool, so only the calls of the tasks or of the main
+    // function compile, and the threads of the kernels never do. This run
+    // makes all of those calls, so the later runs don't compile. It is not
+    // preempted while it holds the mutex.
+    std::lock_guard<std::mutex> lock(firstRunMutex_);
+    if (compilesOnFirstRun_) {
+      TraceScope trace("JIT first run", TraceCompile);
+      runCompiledCode(activations, offsets, /* useThreadPool */ false);
+      compilesOnFirstRun_ = false;
+      return;
+    }
+  }
+  runCompiledCode(activations, offsets, useThreadPool, preemptionPoint);
+}
+
+void CPUBackend::runCompiledCode(
+    uint8_t *activations, size_t *offsets, bool useThreadPool,
+    const std::function<void()> &preemptionPoint) const {
+  if (taskFuncs_.empty()) {
+    jitMain_.load()(activations, offsets);
+    return;
+  }
+
+  if (!useThreadPool) {
+    // The tasks are numbered in the program order, which satisfies their
+    // dependencies.
+    for (size_t idx = 0, e = taskFuncs_.size(); idx < e; idx++) {
+      if (idx && preemptionPoint) {
+        preemptionPoint();
+      }
+      taskFuncs_[idx](nullptr, nullptr, activations, offsets);
+    }
+    return;
+  }
+  threadPool_->run(taskGraph_, [&](unsigned idx) {
+    taskFuncs_[idx](nullptr, nullptr, activations, offsets);
+  });
 }
 
 void CPUBackend::doForwardPass() {
-  auto sym = JIT_->findSymbol("jitmain");
-  assert(sym && "Unable to JIT the code!");
-  using JitFuncType = void (*)(void);
-  auto address = sym.getAddress();
-  if (address) {
-    JitFuncType funcPtr = reinterpret_cast<JitFuncType>(address.get());
-    funcPtr();
-  } else {
-    GLOW_ASSERT(false && "Error getting address.");
+  // Use the current payloads of the variables, which may have been bound to
+  // tensors of the client.
+  for (const auto &MV : mutableVars_) {
+    offsets_[MV.number] =
+        MV.var->getPayload().getUnsafePtr() - static_cast<char *>(nullptr);
+  }
+  runJitCode(getActivations(), offsets_.data(), /* useThreadPool */ true);
+  traceKernels();
+}
+
+void CPUBackend::setBatchSize(size_t batchSize) {
+  if (!maxBatchSize_) {
+    return;
   }
+  GLOW_ASSERT(batchSize >= 1 && batchSize <= maxBatchSize_ &&
+              "The batch size exceeds the compiled batch");
+  offsets_.back() = batchSize;
+}
+
+CPUSession::CPUSession(const CPUBackend &backend)
+    : backend_(backend), offsets_(backend.offsets_) {
+  const auto &allocs = backend_.allocationsInfo_;
+  if (allocs.activationsMemSize_ > 0) {
+    activationsSize_ = allocs.activationsMemSize_;
+    activations_ = static_cast<uint8_t *>(
+        allocateMemory(activationsSize_, backend_.memoryPolicy_));
+  }
+  // The tensors of the session start with the values of the variables.
+  for (const auto &MV : backend_.mutableVars_) {
+    auto *T = new Tensor();
+    T->copyFrom(&MV.var->getPayload());
+    tensors_[MV.var].reset(T);
+    bind(MV.var, T);
+  }
+}
+
+CPUSession::~CPUSession() {
+  freeMemory(activations_, activationsSize_, backend_.memoryPolicy_);
+}
+
+Tensor &CPUSession::getTensor(const Variable *v) {
+  auto it = bound_.find(v);
+  GLOW_ASSERT(it != bound_.end() && "Not a mutable variable of the session");
+  return *it->second;
+}
+
+void CPUSession::bind(const Variable *v, Tensor *T) {
+  auto it = tensors_.find(v);
+  GLOW_ASSERT(it != tensors_.end() && "Not a mutable variable of the session");
+  if (!T) {
+    T = it->second.get();
+  }
+  assert(T->getType().isEqual(v->getType()) && "Invalid tensor type");
+  assert(size_t(T->getUnsafePtr()) % TensorAlignment == 0 &&
+         "The tensor is not aligned");
+  bound_[v] = T;
+  for (const auto &MV : backend_.mutableVars_) {
+    if (MV.var == v) {
+      offsets_[MV.number] = T->getUnsafePtr() - static_cast<char *>(nullptr);
+    }
+  }
+}
+
+void CPUSession::setBatchSize(size_t batchSize) {
+  size_t maxBatchSize = backend_.maxBatchSize_;
+  if (!maxBatchSize) {
+    return;
+  }
+  GLOW_ASSERT(batchSize >= 1 && batchSize <= maxBatchSize &&
+              "The batch size exceeds the compiled batch");
+  offsets_.back() = batchSize;
+}
+
+void CPUSession::setActivationArena(ActivationArena *arena) {
+  arena_ = arena;
+  freeMemory(activations_, activationsSize_, backend_.memoryPolicy_);
+  activations_ = nullptr;
+  if (arena_) {
+    arena_->reserve(activationsSize_);
+  } else if (activationsSize_ > 0) {
+    activations_ = static_cast<uint8_t *>(
+        allocateMemory(activationsSize_, backend_.memoryPolicy_));
+  }
+}
+
+void CPUSession::doForwardPass() {
+  uint8_t *activations =
+      arena_ ? static_cast<uint8_t *>(arena_->get(activationsSize_))
+             : activations_;
+  backend_.runJitCode(activations, offsets_.data(),
+                      /* useThreadPool */ false, preemptionPoint_);
+  backend_.traceKernels();
+}
+
+std::unique_ptr<ExecutionSession> CPUBackend::createSession() {
+  return std::unique_ptr<ExecutionSession>(new CPUSession(*this));
+}
+
+void CPUBackend::dumpProfile() {
+  // With the tiered code, the runs are split between the quick and the
+  // optimized code, which keep separate profiles.
+  waitForOptimizedCode();
+  for (auto *JIT : {JIT_.get(), optimizedJIT_.get()}) {
+    if (!JIT) {
+      continue;
+    }
+    // The profile is present only if the code was compiled with -cpu-profile.
+    auto sym = JIT->findSymbol(irgen_.getMainEntryName() + "_dump_profile");
+    if (!sym) {
+      continue;
+    }
+    using DumpFuncType = void (*)(void);
+    auto address = sym.getAddress();
+    GLOW_ASSERT(address && "Error getting the address of the profile dump.");
+    // The profile is printed by the jitted code, so flush our own output
+    // first.
+    llvm::outs().flush();
+    reinterpret_cast<DumpFuncType>(address.get())();
+    fflush(stdout);
+  }
+}
+
+//===----------------------------------------------------------------------===//
+//                   Functions for saving and loading compiled code
+//===----------------------------------------------------------------------===//
+
+/// The start of the first line of the files of compiled code, which goes on
+/// with the sizes of the manifest, of the object file and of the constant
+/// weights that follow it. The constant weights start at a page boundary.
+static const char compiledCodeMagic[] = "glow-cpu-compiled-code 1";
+
+/// Write \p size zero bytes into \p os.
+static void writeZeros(llvm::raw_ostream &os, size_t size) {
+  for (; size > 0; size--) {
+    os.write(0);
+  }
+}
+
+/// \returns the number \p str, which must be valid.
+static size_t parseCompiledSize(llvm::StringRef str) {
+  size_t size;
+  bool failed = str.getAsInteger(10, size);
+  (void)failed;
+  GLOW_ASSERT(!failed && "The file of the compiled code is corrupt");
+  return size;
+}
+
+void CPUBackend::saveCompiled(llvm::StringRef path) {
+  waitForOptimizedCode();
+  GLOW_ASSERT(jitMain_ && "The code must be compiled before it is saved");
+  // The serial code doesn't depend on the process, as in the object cache,
+  // as long as it doesn't call the shared kernels.
+  LLVMIRGen irgen(F_, allocationsInfo_, "");
+  irgen.initTargetMachine(target.empty() ? "" : target.getValue(),
+                          llvm::CodeModel::Model::Large);
+  irgen.setNumThreads(irgen_.getNumThreads());
+  irgen.setGemmBlockSizes(irgen_.getGemmBlockSizes());
+  irgen.setKernelTuningDB(irgen_.getKernelTuningDB());
+  irgen.findBatchedValues();
+  irgen.initCodeGen();
+  emitJitMain(irgen);
+  irgen.performCodeGen();
+  auto object = llvm::orc::GlowJIT::compileModule(irgen.getModule(),
+                                                  irgen.getTargetMachine());
+  GLOW_ASSERT(object && "Unable to generate the machine code.");
+
+  // The manifest lists the offsets passed to the code, one per line. The
+  // constant weights are at offsets from the start of the weights in the
+  // file, the activations at offsets from the heap, and the inputs and
+  // outputs are the public variables with the given number, type and name.
+  std::string manifest;
+  llvm::raw_string_ostream os(manifest);
+  auto &TM = irgen.getTargetMachine();
+  os << "target " << TM.getTargetTriple().str() << " " << TM.getTargetCPU()
+     << "\n";
+  os << "activations " << allocationsInfo_.activationsMemSize_ << "\n";
+  os << "batch " << irgen.getMaxBatchSize() << "\n";
+  os << "offsets " << allocationsInfo_.valueNumbers_.size() << "\n";
+  std::vector<Variable *> constants;
+  size_t weightsSize = 0;
+  for (auto *v : F_->getGraph()->getParent()->getVars()) {
+    auto it = allocationsInfo_.valueNumbers_.find(F_->getWeightForNode(v));
+    if (it == allocationsInfo_.valueNumbers_.end())
+      continue;
+    size_t number = it->second.second;
+    if (v->getVisibilityKind() == VisibilityKind::Public) {
+      auto *T = v->getType();
+      bool isQuantized = T->isQuantizedType();
+      os << "m " << number << " " << unsigned(T->getElementType()) << " "
+         << llvm::format("%.9g", isQuantized ? T->getScale() : 0.0f) << " "
+         << (isQuantized ? T->getOffset() : 0) << " ";
+      for (size_t i = 0, e = T->dims().size(); i < e; i++) {
+        os << (i ? "," : "") << T->dims()[i];
+      }
+      os << " " << v->getName() << "\n";
+      continue;
+    }
+    os << "c " << number << " " << weightsSize << "\n";
+    constants.push_back(v);
+    weightsSize +=
+        alignedSize(v->getType()->getSizeInBytes(), TensorAlignment);
+  }
+  for (auto &I : allocationsInfo_.valueNumbers_) {
+    if (I.second.first != AllocationsInfo::ValueKind::Activation)
+      continue;
+    os << "a " << I.second.second << " "
+       << allocationsInfo_.allocatedAddressed_.lookup(I.first) << "\n";
+  }
+  os.flush();
+
+  std::error_code EC;
+  llvm::raw_fd_ostream file(path, EC, llvm::sys::fs::F_None);
+  GLOW_ASSERT(!EC &&
+              "Could not open the output file for saving the compiled code");
+  file << compiledCodeMagic << " " << manifest.size() << " "
+       << object->getBufferSize() << " " << weightsSize << "\n";
+  file << manifest << object->getBuffer();
+  // The weights start at a page boundary, so that the code reads them from
+  // the mapping of the file.
+  size_t pos = file.tell();
+  writeZeros(file, alignedSize(pos, bundleWeightsPageSize) - pos);
+  for (auto *v : constants) {
+    auto &payload = v->getPayload();
+    size_t numBytes = payload.getType().getSizeInBytes();
+    file.write(payload.getUnsafePtr(), numBytes);
+    writeZeros(file, alignedSize(numBytes, TensorAlignment) - numBytes);
+  }
+  file.close();
+  GLOW_ASSERT(!file.has_error() && "Could not save the compiled code");
+}
+
+void CPUBackend::loadCompiled(llvm::StringRef path, Module &M) {
+  waitForOptimizedCode();
+  auto buffer = llvm::MemoryBuffer::getFile(path, -1,
+                                            /* RequiresNullTerminator */ false);
+  GLOW_ASSERT(buffer && "Could not open the file of the compiled code");
+  std::unique_ptr<llvm::MemoryBuffer> file = std::move(*buffer);
+
+  StringRef header = file->getBuffer().split('\n').first;
+  GLOW_ASSERT(header.startswith(compiledCodeMagic) &&
+              "Not a file of compiled code");
+  llvm::SmallVector<StringRef, 3> sizes;
+  header.drop_front(sizeof(compiledCodeMagic)).split(sizes, ' ');
+  GLOW_ASSERT(sizes.size() == 3 && "The file of the compiled code is corrupt");
+  size_t manifestSize = parseCompiledSize(sizes[0]);
+  size_t objectSize = parseCompiledSize(sizes[1]);
+  size_t weightsSize = parseCompiledSize(sizes[2]);
+  size_t manifestPos = header.size() + 1;
+  size_t objectPos = manifestPos + manifestSize;
+  size_t weightsPos = alignedSize(objectPos + objectSize, bundleWeightsPageSize);
+  GLOW_ASSERT(weightsPos + weightsSize <= file->getBufferSize() &&
+              "The file of the compiled code is truncated");
+
+  // The constant weights are read in place if the file is mapped into
+  // memory, and copied into the memory of the policy otherwise.
+  freeMemory(loadedWeights_, loadedWeightsSize_, memoryPolicy_);
+  loadedWeights_ = nullptr;
+  loadedWeightsSize_ = 0;
+  const char *weights = file->getBufferStart() + weightsPos;
+  if (!memoryPolicy_.isDefault() || size_t(weights) % TensorAlignment != 0) {
+    loadedWeightsSize_ = weightsSize;
+    loadedWeights_ = allocateMemory(weightsSize, memoryPolicy_);
+    memcpy(loadedWeights_, weights, weightsSize);
+    weights = static_cast<const char *>(loadedWeights_);
+  }
+  loadedWeightsData_ = weights;
+  loadedWeightsDataSize_ = weightsSize;
+
+  irgen_.initTargetMachine(target.empty() ? "" : target.getValue(),
+                           llvm::CodeModel::Model::Large);
+  auto &TM = irgen_.getTargetMachine();
+  allocationsInfo_.clear();
+  mutableVars_.clear();
+  offsets_.clear();
+  maxBatchSize_ = 0;
+  StringRef manifest = file->getBuffer().substr(manifestPos, manifestSize);
+  while (!manifest.empty()) {
+    StringRef line;
+    std::tie(line, manifest) = manifest.split('\n');
+    // The name of a variable is the rest of its line.
+    llvm::SmallVector<StringRef, 7> fields;
+    line.split(fields, ' ', /* MaxSplit */ 6);
+    if (fields[0] == "target") {
+      GLOW_ASSERT(fields.size() == 3 &&
+                  fields[1] == TM.getTargetTriple().str() &&
+                  fields[2] == TM.getTargetCPU() &&
+                  "The code was compiled for another target");
+    } else if (fields[0] == "activations") {
+      allocationsInfo_.activationsMemSize_ = parseCompiledSize(fields[1]);
+    } else if (fields[0] == "batch") {
+      maxBatchSize_ = parseCompiledSize(fields[1]);
+    } else if (fields[0] == "offsets") {
+      offsets_.assign(parseCompiledSize(fields[1]) + 1, 0);
+    } else if (fields[0] == "c" || fields[0] == "a") {
+      size_t number = parseCompiledSize(fields[1]);
+      size_t offset = parseCompiledSize(fields[2]);
+      GLOW_ASSERT(number + 1 < offsets_.size() &&
+                  "The file of the compiled code is corrupt");
+      offsets_[number] = fields[0] == "a"
+                             ? offset
+                             : weights + offset - static_cast<char *>(nullptr);
+    } else if (fields[0] == "m") {
+      GLOW_ASSERT(fields.size() == 7 &&
+                  "The file of the compiled code is corrupt");
+      size_t number = parseCompiledSize(fields[1]);
+      auto elemKind = static_cast<ElemKind>(parseCompiledSize(fields[2]));
+      double scale;
+      int offset;
+      bool failed =
+          fields[3].getAsDouble(scale) || fields[4].getAsInteger(10, offset);
+      (void)failed;
+      GLOW_ASSERT(!failed && "The file of the compiled code is corrupt");
+      llvm::SmallVector<StringRef, 6> dimFields;
+      fields[5].split(dimFields, ',');
+      std::vector<size_t> dims;
+      for (auto dim : dimFields) {
+        dims.push_back(parseCompiledSize(dim));
+      }
+      bool isQuantized = elemKind == ElemKind::Int8QTy ||
+                         elemKind == ElemKind::Int16QTy ||
+                         elemKind == ElemKind::Int32QTy;
+      auto T = isQuantized ? M.uniqueType(elemKind, dims, scale, offset)
+                           : M.uniqueType(elemKind, dims);
+      auto *v = M.createVariable(T, fields[6], VisibilityKind::Public,
+                                 Variable::TrainKind::None);
+      mutableVars_.push_back({v, number});
+    } else {
+      GLOW_UNREACHABLE("The file of the compiled code is corrupt");
+    }
+  }
+  GLOW_ASSERT(!offsets_.empty() && "The file of the compiled code is corrupt");
+  offsets_.back() = maxBatchSize_;
+  allocateHeap();
+
+  JIT_ = llvm::make_unique<llvm::orc::GlowJIT>(TM);
+  compilesOnFirstRun_ = false;
+  optimizedJIT_.reset();
+  optimizedIRGen_.reset();
+  taskFuncs_.clear();
+  taskGraph_.clear();
+  StringRef object = file->getBuffer().substr(objectPos, objectSize);
+  bool added = JIT_->addObject(llvm::MemoryBuffer::getMemBufferCopy(object));
+  GLOW_ASSERT(added && "Unable to load the compiled code.");
+  setJitMain(*JIT_);
+  compiledFile_ = std::move(file);
 }
 
 //===----------------------------------------------------------------------===//
@@ -178,15 +1190,51 @@ void CPUBackend::saveWeights(llvm::StringRef weightsFileName) {
     maxPos = std::max(pos, maxPos);
   }
   // Make sure that the file is as long as the constantWeightVarsMemSize_.
-  // This is needed to properly handle alignments.
+  // This is needed to properly handle alignments. The mappable files are
+  // padded to whole pages, so that the mapping of the file covers all of it.
+  size_t endPos = irgen_.getAllocationsInfo().constantWeightVarsMemSize_;
+  if (bundleMmapWeights) {
+    endPos = alignedSize(endPos, bundleWeightsPageSize);
+  }
   weightsFile.seek(maxPos);
-  for (size_t endPos = irgen_.getAllocationsInfo().constantWeightVarsMemSize_;
-       maxPos < endPos; maxPos++) {
+  for (; maxPos < endPos; maxPos++) {
     weightsFile.write(0);
   }
   weightsFile.close();
 }
 
+void CPUBackend::emitConstantWeights(const std::string &name,
+                                     llvm::GlobalValue::LinkageTypes linkage,
+                                     bool isDefinition) {
+  size_t size = irgen_.getAllocationsInfo().constantWeightVarsMemSize_;
+  if (!isDefinition) {
+    constantWeights_ = new llvm::GlobalVariable(
+        irgen_.getModule(),
+        llvm::ArrayType::get(irgen_.getBuilder().getInt8Ty(), size),
+        /* isConst */ true, linkage, nullptr, name);
+    constantWeights_->setAlignment(TensorAlignment);
+    return;
+  }
+
+  // Lay out the constant weights like the weights file does.
+  std::vector<uint8_t> weights(size);
+  for (auto &v : F_->getGraph()->getParent()->getVars()) {
+    auto *w = cast<WeightVar>(F_->getWeightForNode(v));
+    if (v->getVisibilityKind() == VisibilityKind::Public)
+      continue;
+    auto payload = v->getPayload().getUnsafePtr();
+    auto addr = allocationsInfo_.allocatedAddressed_[getOrigin(w)];
+    std::copy(payload, payload + w->getSizeInBytes(), weights.begin() + addr);
+  }
+
+  auto *init = llvm::ConstantDataArray::get(irgen_.getLLVMContext(),
+                                            llvm::ArrayRef<uint8_t>(weights));
+  constantWeights_ =
+      new llvm::GlobalVariable(irgen_.getModule(), init->getType(),
+                               /* isConst */ true, linkage, init, name);
+  constantWeights_->setAlignment(TensorAlignment);
+}
+
 void CPUBackend::emitSymbolTable() {
   // Define a struct for symbol table entries:
   // struct SymbolTableEntry {
@@ -208,6 +1256,10 @@ void CPUBackend::emitSymbolTable() {
   for (auto &v : F_->getGraph()->getParent()->getVars()) {
     auto *w = cast<WeightVar>(F_->getWeightForNode(v));
     bool isConstWeight = v->getVisibilityKind() != VisibilityKind::Public;
+    // The inputs and outputs of the other entries have no memory here.
+    if (isMultiEntryBundle_ && !isConstWeight && !w->hasUsers()) {
+      continue;
+    }
     auto size = w->getType()->size();
     auto addr = allocationsInfo_.allocatedAddressed_[getOrigin(w)];
     // Create an SymbolTableEntry.
@@ -235,14 +1287,9 @@ void CPUBackend::emitSymbolTable() {
                            irgen_.getMainEntryName() + "SymbolTable");
 }
 
-void CPUBackend::produceBundle(llvm::StringRef outputDir) {
-  // Emit the symbol table for weight variables.
-  emitSymbolTable();
-  // Emit the config for the bundle.
-  emitBundleConfig();
-
+void CPUBackend::produceBundle(llvm::StringRef outputDir,
+                               llvm::StringRef bundleName) {
   auto &M = irgen_.getModule();
-  auto bundleName = irgen_.getMainEntryName();
   auto bundleCodeOutput = (outputDir + "/" + bundleName + ".o").str();
   auto bundleWeightsOutput = (outputDir + "/" + bundleName + ".weights").str();
   DEBUG(llvm::outs() << "Producing a bundle:\n"
@@ -266,8 +1313,10 @@ void CPUBackend::produceBundle(llvm::StringRef outputDir) {
     PM.run(M);
   }
   outputFile.close();
-  // Output weights.
-  saveWeights(bundleWeightsOutput);
+  // Output weights, unless they are in the object file.
+  if (!bundleEmbedWeights) {
+    saveWeights(bundleWeightsOutput);
+  }
 }
 
 /// Emit the entry function for the bundle. It simply calls the main entry of
@@ -284,16 +1333,28 @@ void CPUBackend::emitBundleEntryFunction() {
   auto int8PtrTy = llvm::Type::getInt8PtrTy(irgen_.getLLVMContext());
   llvm::FunctionType *bundleFuncTy =
       llvm::FunctionType::get(voidTy, {int8PtrTy, int8PtrTy, int8PtrTy}, false);
-  auto *func =
-      llvm::Function::Create(bundleFuncTy, llvm::Function::ExternalLinkage,
-                             irgen_.getMainEntryName(), &irgen_.getModule());
+  // The baseline code of a bundle with CPU variants is the generic variant,
+  // and the entry point dispatches to the selected variant.
+  bool isDispatched = !bundleCPUVariants.empty() && cpuVariant_ == 0;
+  auto *func = llvm::Function::Create(
+      bundleFuncTy, llvm::Function::ExternalLinkage,
+      irgen_.getMainEntryName() +
+          (isDispatched ? bundleCPUVariantInfo[0].suffix : ""),
+      &irgen_.getModule());
   llvm::BasicBlock *entry_bb =
       llvm::BasicBlock::Create(irgen_.getLLVMContext(), "entry", func);
   llvm::IRBuilder<> builder(entry_bb);
 
-  // Prepare arguments for the "main" function.
+  // Prepare arguments for the "main" function. The embedded constant weights
+  // replace the first argument, so their addresses are known constants for
+  // the optimizer.
   llvm::SmallVector<llvm::Value *, 4> initFunctionCallArgs;
-  initFunctionCallArgs.push_back(func->args().begin());
+  if (constantWeights_) {
+    initFunctionCallArgs.push_back(
+        builder.CreateBitCast(constantWeights_, int8PtrTy));
+  } else {
+    initFunctionCallArgs.push_back(func->args().begin());
+  }
   initFunctionCallArgs.push_back(func->args().begin() + 1);
   initFunctionCallArgs.push_back(func->args().begin() + 2);
   // Now form the offsets array and pass it as the last argument.
@@ -308,6 +1369,66 @@ void CPUBackend::emitBundleEntryFunction() {
   builder.CreateRetVoid();
   // Create the debug info for the bundle entry point function.
   irgen_.generateFunctionDebugInfo(func);
+  if (isDispatched) {
+    emitCPUDispatcher(func);
+  }
+}
+
+/// \returns the levels of the CPU variants of bundles, in increasing order.
+static std::vector<unsigned> getCPUVariantLevels() {
+  std::vector<unsigned> levels;
+  for (auto level : bundleCPUVariants) {
+    levels.push_back(unsigned(level));
+  }
+  std::sort(levels.begin(), levels.end());
+  levels.erase(std::unique(levels.begin(), levels.end()), levels.end());
+  return levels;
+}
+
+void CPUBackend::emitCPUDispatcher(llvm::Function *generic) {
+  auto &M = irgen_.getModule();
+  auto &ctx = irgen_.getLLVMContext();
+  auto *entryTy = generic->getFunctionType();
+  auto *entryPtrTy = entryTy->getPointerTo();
+  std::string name = irgen_.getMainEntryName();
+  generic->setLinkage(llvm::Function::InternalLinkage);
+
+  // The code of the selected variant.
+  auto *selected =
+      new llvm::GlobalVariable(M, entryPtrTy, /* isConst */ false,
+                               llvm::GlobalValue::InternalLinkage, generic,
+                               name + "_selected");
+
+  // The entry point forwards its arguments to the selected code.
+  auto *entry = llvm::Function::Create(
+      entryTy, llvm::Function::ExternalLinkage, name, &M);
+  llvm::IRBuilder<> builder(llvm::BasicBlock::Create(ctx, "entry", entry));
+  llvm::SmallVector<llvm::Value *, 3> args;
+  for (auto &arg : entry->args()) {
+    args.push_back(&arg);
+  }
+  builder.CreateCall(builder.CreateLoad(selected), args);
+  builder.CreateRetVoid();
+
+  // The constructor of the bundle selects the most capable variant that the
+  // host supports. The variants are defined by the modules that are linked
+  // into this one.
+  auto *select = llvm::Function::Create(
+      llvm::FunctionType::get(builder.getVoidTy(), false),
+      llvm::Function::InternalLinkage, name + "_select_cpu_variant", &M);
+  builder.SetInsertPoint(llvm::BasicBlock::Create(ctx, "entry", select));
+  auto *hostLevel = builder.CreateCall(irgen_.getFunction("cpu_level"));
+  llvm::Value *code = generic;
+  for (auto level : getCPUVariantLevels()) {
+    auto *variant = llvm::cast<llvm::Function>(M.getOrInsertFunction(
+        name + bundleCPUVariantInfo[level].suffix, entryTy));
+    auto *isSupported = builder.CreateICmpUGE(
+        hostLevel, llvm::ConstantInt::get(hostLevel->getType(), level));
+    code = builder.CreateSelect(isSupported, variant, code);
+  }
+  builder.CreateStore(code, selected);
+  builder.CreateRetVoid();
+  llvm::appendToGlobalCtors(M, select, 0);
 }
 
 // Create a config for this network. It will be exposed to the clients,
@@ -320,18 +1441,27 @@ void CPUBackend::emitBundleEntryFunction() {
 //   size_t alignment;
 //   size_t numSymbols;
 //   SymbolTableEntry *symbolTable;
+//   size_t weightsPageSize;
+//   const uint8_t *constantWeights;
 // };
+// The weightsPageSize is the page size the weights file is padded to, or 0 if
+// the file is not meant to be mapped into memory. The constantWeights are the
+// constant weights embedded into the bundle, or null if they are in the
+// weights file.
 void CPUBackend::emitBundleConfig() {
   auto symbolTable = irgen_.getModule().getGlobalVariable(
       irgen_.getMainEntryName() + "SymbolTable", true);
   GLOW_ASSERT(symbolTable &&
               "Expected to find a symbol table for the AOT bundle");
+  auto *weights = constantWeights_;
   // Get the integer type having the same size in bits as size_t.
   auto *SizeTType = irgen_.getBuilder().getIntNTy(sizeof(size_t) * 8);
+  auto *int8PtrTy = irgen_.getBuilder().getInt8PtrTy();
   auto symbolTableEntryTy = symbolTable->getType()->getPointerElementType();
   auto *bundleConfigTy = llvm::StructType::get(
-      irgen_.getLLVMContext(), {SizeTType, SizeTType, SizeTType, SizeTType,
-                                SizeTType, symbolTableEntryTy->getPointerTo()});
+      irgen_.getLLVMContext(),
+      {SizeTType, SizeTType, SizeTType, SizeTType, SizeTType,
+       symbolTableEntryTy->getPointerTo(), SizeTType, int8PtrTy});
   auto config = new llvm::GlobalVariable(
       irgen_.getModule(), bundleConfigTy, /* isConst */ true,
       llvm::GlobalValue::LinkageTypes::ExternalLinkage, nullptr,
@@ -345,9 +1475,15 @@ void CPUBackend::emitBundleConfig() {
       llvm::ConstantInt::get(SizeTType,
                              irgen_.getAllocationsInfo().activationsMemSize_),
       llvm::ConstantInt::get(SizeTType, TensorAlignment),
-      llvm::ConstantInt::get(SizeTType,
-                             F_->getGraph()->getParent()->getVars().size()),
-      symbolTable));
+      llvm::ConstantInt::get(
+          SizeTType, llvm::cast<llvm::ArrayType>(symbolTable->getValueType())
+                         ->getNumElements()),
+      symbolTable,
+      llvm::ConstantInt::get(SizeTType, bundleMmapWeights && !weights
+                                            ? bundleWeightsPageSize
+                                            : 0),
+      weights ? llvm::ConstantExpr::getBitCast(weights, int8PtrTy)
+              : llvm::ConstantPointerNull::get(int8PtrTy)));
 }
 
 void CPUBackend::performBundleMemoryAllocation() {
@@ -356,27 +1492,226 @@ void CPUBackend::performBundleMemoryAllocation() {
   allocationsInfo_.allocateActivations(F_);
   // Tell the allocateWeightVars to not reuse any existing addresses for weights
   // and to assign new ones.
-  allocationsInfo_.allocateWeightVars(F_, false);
+  allocationsInfo_.allocateWeightVars(F_, false, !isMultiEntryBundle_);
 }
 
-void CPUBackend::save(llvm::StringRef outputDir) {
-  // Object files generation works properly only in small mode.
-  irgen_.initTargetMachine(target.empty() ? "" : target.getValue(),
-                           llvm::CodeModel::Model::Small);
-  irgen_.setMainEntryName(F_->getGraph()->getName());
+void CPUBackend::generateBundleCode(llvm::StringRef outputDir) {
+  // Object files generation works properly only in small mode. The bundles
+  // with CPU variants are compiled for the generic x86-64 CPU, with the
+  // features of the variant.
+  if (bundleCPUVariants.empty()) {
+    irgen_.initTargetMachine(target.empty() ? "" : target.getValue(),
+                             llvm::CodeModel::Model::Small);
+    tuneKernels();
+  } else {
+    llvm::SmallVector<std::string, 8> features(
+        bundleCPUVariantInfo[cpuVariant_].features.begin(),
+        bundleCPUVariantInfo[cpuVariant_].features.end());
+    irgen_.initTargetMachine(target.empty() ? "" : target.getValue(), "x86-64",
+                             features, llvm::CodeModel::Model::Small);
+    auto arch = irgen_.getTargetMachine().getTargetTriple().getArch();
+    GLOW_ASSERT((arch == llvm::Triple::x86_64 || arch == llvm::Triple::x86) &&
+                "The CPU variants of bundles are for x86 targets only");
+  }
+  // The entry point of a CPU variant is named after the variant.
+  irgen_.setMainEntryName(
+      F_->getGraph()->getName().str() +
+      (cpuVariant_ ? bundleCPUVariantInfo[cpuVariant_].suffix : ""));
   irgen_.setOutputDir(outputDir);
+  // The bundle is fully optimized and defines all of its kernels.
+  irgen_.setFastCompile(false);
+  irgen_.setShareKernels(false);
+  irgen_.setEmbedOffsets(false);
+  // Only the first module of the bundle defines the pool of threads.
+  irgen_.setDefinesRuntime(definesConstantWeights_);
   irgen_.initCodeGen();
   // Perform the address assignment for activations and WeightVars.
   performBundleMemoryAllocation();
+  // The bundle always computes the whole batch, which ends its offsets.
+  irgen_.findBatchedValues();
+  // Embed the constant weights before the entry function refers to them. The
+  // entries of a multi-entry bundle share them: the first entry defines them
+  // and the other ones refer to them.
+  if (bundleEmbedWeights && multiEntryBundleName_.empty()) {
+    emitConstantWeights(irgen_.getMainEntryName() + "ConstantWeights",
+                        llvm::GlobalValue::InternalLinkage,
+                        /* isDefinition */ true);
+  } else if (bundleEmbedWeights) {
+    emitConstantWeights(multiEntryBundleName_ + "ConstantWeights",
+                        llvm::GlobalValue::ExternalLinkage,
+                        definesConstantWeights_);
+  }
   // Create the bundle entry function.
   emitBundleEntryFunction();
   // Emit the code for the body of the entry function.
   irgen_.performCodeGen();
+  // Emit the symbol table for weight variables.
+  emitSymbolTable();
+  // Emit the config for the bundle.
+  emitBundleConfig();
+  // Keep the target of the code when it is linked with the code of the other
+  // CPU variants, which is compiled for other features.
+  if (!bundleCPUVariants.empty()) {
+    auto &TM = irgen_.getTargetMachine();
+    for (auto &FF : irgen_.getModule()) {
+      if (!FF.isDeclaration()) {
+        FF.addFnAttr("target-cpu", TM.getTargetCPU());
+        FF.addFnAttr("target-features", TM.getTargetFeatureString());
+      }
+    }
+  }
+}
+
+void CPUBackend::saveWithCPUVariants(llvm::StringRef outputDir) {
+  irgen_.setMainEntryName(F_->getGraph()->getName());
+  std::string name = irgen_.getMainEntryName();
+  std::string weightsName = name + "ConstantWeights";
+  // The variants refer to the constant weights embedded by the baseline
+  // code, like the entries of a multi-entry bundle do.
+  multiEntryBundleName_ = name;
+
+  // Generate the code of every variant into its own module, and the baseline
+  // code last, so that the bundle is produced with its target machine.
+  std::vector<std::pair<std::string, std::unique_ptr<llvm::Module>>> variants;
+  for (auto level : getCPUVariantLevels()) {
+    cpuVariant_ = level;
+    definesConstantWeights_ = false;
+    generateBundleCode(outputDir);
+    // Only the code of the variant is linked in. The config and the symbol
+    // table are the ones of the baseline code.
+    std::string entry = irgen_.getMainEntryName();
+    llvm::internalizeModule(
+        irgen_.getModule(), [&](const llvm::GlobalValue &GV) {
+          return GV.getName() == entry || GV.getName() == weightsName;
+        });
+    llvm::legacy::PassManager PM;
+    PM.add(llvm::createGlobalDCEPass());
+    PM.run(irgen_.getModule());
+    variants.emplace_back(entry, irgen_.borrowModule());
+  }
+  cpuVariant_ = 0;
+  definesConstantWeights_ = true;
+  generateBundleCode(outputDir);
+
+  // The modules share the LLVM context of the code generator.
+  auto &M = irgen_.getModule();
+  for (auto &variant : variants) {
+    GLOW_ASSERT(!llvm::Linker::linkModules(M, std::move(variant.second)) &&
+                "Cannot link the CPU variants of the bundle");
+    M.getFunction(variant.first)
+        ->setLinkage(llvm::GlobalValue::InternalLinkage);
+  }
+  if (auto *weights = M.getGlobalVariable(weightsName)) {
+    weights->setLinkage(llvm::GlobalValue::InternalLinkage);
+  }
+  multiEntryBundleName_.clear();
+  produceBundle(outputDir, name);
+}
+
+void CPUBackend::save(llvm::StringRef outputDir) {
+  if (!bundleCPUVariants.empty()) {
+    saveWithCPUVariants(outputDir);
+    return;
+  }
+  generateBundleCode(outputDir);
   // Produce the bundle.
-  produceBundle(outputDir);
+  produceBundle(outputDir, irgen_.getMainEntryName());
+}
+
+void CPUBackend::save(llvm::ArrayRef<IRFunction *> entries,
+                      llvm::StringRef outputDir, llvm::StringRef bundleName) {
+  GLOW_ASSERT(!entries.empty() && "The bundle has no entries");
+  GLOW_ASSERT(bundleCPUVariants.empty() &&
+              "The multi-entry bundles have no CPU variants");
+  // Compile every entry into its own LLVM module.
+  std::vector<std::unique_ptr<CPUBackend>> backends;
+  for (auto *F : entries) {
+    backends.emplace_back(new CPUBackend(F));
+    backends.back()->isMultiEntryBundle_ = true;
+    backends.back()->multiEntryBundleName_ = bundleName.str();
+    backends.back()->definesConstantWeights_ = backends.size() == 1;
+  }
+
+  std::string weightsName = (bundleName + "ConstantWeights").str();
+  for (auto &B : backends) {
+    B->generateBundleCode(outputDir);
+    // Every entry module defines its own copy of "main" and of the other
+    // helpers. Only keep the API of the entry visible, so that the modules
+    // link together.
+    std::string entry = B->irgen_.getMainEntryName();
+    llvm::internalizeModule(
+        B->irgen_.getModule(), [&](const llvm::GlobalValue &GV) {
+          auto name = GV.getName();
+          return name == entry || name == entry + "_config" ||
+                 name == entry + "_dump_profile" || name == weightsName ||
+                 name.startswith("glow_parallel_");
+        });
+    GLOW_ASSERT(B->irgen_.getAllocationsInfo().constantWeightVarsMemSize_ ==
+                    backends[0]
+                        ->irgen_.getAllocationsInfo()
+                        .constantWeightVarsMemSize_ &&
+                "The entries must share the constant weights");
+  }
+
+  // Link the modules of the other entries into the module of the first one.
+  // The modules live in different contexts, so move them through bitcode.
+  auto &M = backends[0]->irgen_.getModule();
+  for (size_t i = 1, e = backends.size(); i < e; i++) {
+    llvm::SmallVector<char, 0> buffer;
+    llvm::raw_svector_ostream OS(buffer);
+    llvm::WriteBitcodeToFile(&backends[i]->irgen_.getModule(), OS);
+    auto src = llvm::parseBitcodeFile(
+        llvm::MemoryBufferRef(llvm::StringRef(buffer.data(), buffer.size()),
+                              bundleName),
+        M.getContext());
+    GLOW_ASSERT(src && "Cannot read the module of a bundle entry");
+    GLOW_ASSERT(!llvm::Linker::linkModules(M, std::move(src.get())) &&
+                "Cannot link the entries of the bundle");
+  }
+  if (auto *weights = M.getGlobalVariable(weightsName)) {
+    weights->setLinkage(llvm::GlobalValue::InternalLinkage);
+  }
+  backends[0]->produceBundle(outputDir, bundleName);
 }
 
-bool CPUBackend::isOpSupported(Kinded::Kind opKind, ElemKind elementTy) const {
+bool CPUBackend::lowersNode(const Node *N) {
+  // The library has fused kernels for the LSTM cell step, for the batch
+  // normalization of training and for the weight update, and a grouped
+  // convolution kernel that is much faster than one convolution per group.
+  switch (N->getKind()) {
+  case Kinded::Kind::BatchNormalizationGradNodeKind:
+  case Kinded::Kind::BatchNormalizationNodeKind:
+  case Kinded::Kind::ConvolutionNodeKind:
+  case Kinded::Kind::LSTMUnitNodeKind:
+  case Kinded::Kind::SGDNodeKind:
+    return false;
+  default:
+    return true;
+  }
+}
+
+bool CPUBackend::supportsOp(Kinded::Kind opKind, ElemKind elementTy) {
+  // The kernels of the library are not specialized for float16.
+  if (elementTy == ElemKind::Float16Ty) {
+    return false;
+  }
+
+  // Check for the support of the int16 activations, which are used with the
+  // int8 weights and the int32 accumulators.
+  if (elementTy == ElemKind::Int16QTy) {
+    switch (opKind) {
+    case Kinded::Kind::ConvolutionNodeKind:
+    case Kinded::Kind::DequantizeNodeKind:
+    case Kinded::Kind::FullyConnectedNodeKind:
+    case Kinded::Kind::MatMulNodeKind:
+    case Kinded::Kind::QuantizeNodeKind:
+    case Kinded::Kind::RescaleQuantizedNodeKind:
+      return true;
+    default:
+      return false;
+    }
+  }
+
   // Check for quantization support.
   if (elementTy == ElemKind::Int8QTy) {
     switch (opKind) {
@@ -384,6 +1719,8 @@ bool CPUBackend::isOpSupported(Kinded::Kind opKind, ElemKind elementTy) const {
     case Kinded::Kind::BatchedAddNodeKind:
     case Kinded::Kind::BatchedReduceAddNodeKind:
     case Kinded::Kind::BroadcastNodeKind:
+    case Kinded::Kind::ChannelwiseQuantizedConvolutionNodeKind:
+    case Kinded::Kind::ChannelwiseQuantizedFullyConnectedNodeKind:
     case Kinded::Kind::CmpLTENodeKind:
     case Kinded::Kind::ConcatNodeKind:
     case Kinded::Kind::ConvolutionNodeKind:
@@ -392,6 +1729,7 @@ bool CPUBackend::isOpSupported(Kinded::Kind opKind, ElemKind elementTy) const {
     case Kinded::Kind::FullyConnectedNodeKind:
     case Kinded::Kind::MatMulNodeKind:
     case Kinded::Kind::MaxNodeKind:
+    case Kinded::Kind::MaxSplatNodeKind:
     case Kinded::Kind::MinNodeKind:
     case Kinded::Kind::MulNodeKind:
     case Kinded::Kind::PoolAvgNodeKind:
@@ -400,6 +1738,8 @@ bool CPUBackend::isOpSupported(Kinded::Kind opKind, ElemKind elementTy) const {
     case Kinded::Kind::ReluNodeKind:
     case Kinded::Kind::RescaleQuantizedNodeKind:
     case Kinded::Kind::ReshapeNodeKind:
+    case Kinded::Kind::RowwiseQuantizedGatherNodeKind:
+    case Kinded::Kind::RowwiseQuantizedSparseLengthsWeightedSumNodeKind:
     case Kinded::Kind::SelectNodeKind:
     case Kinded::Kind::SubNodeKind:
     case Kinded::Kind::TopKNodeKind:
@@ -19,13 +19,22 @@
 #include "AllocationsInfo.h"
 #include "GlowJIT.h"
 #include "LLVMIRGen.h"
+#include "ThreadPool.h"
 #include "glow/Backends/Backend.h"
 #include "glow/Base/Tensor.h"
+#include "glow/Support/Memory.h"
 
 #include "llvm/ADT/ArrayRef.h"
 #include "llvm/IR/DerivedTypes.h"
 #include "llvm/IR/IRBuilder.h"
 #include "llvm/IR/Module.h"
+#include "llvm/Support/MemoryBuffer.h"
+
+#include <atomic>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
 
 namespace glow {
 
@@ -37,8 +46,21 @@ class Variable;
 class Instruction;
 class WeightVar;
 struct AllocationsInfo;
+class CPUSession;
+
+/// The activations that the CPU-specific convolution and matrix
+/// multiplication nodes apply to their results. The values must match
+/// libjit_activation.
+enum class CPUActivation : unsigned {
+  None = 0,
+  MaxSplat = 1,
+  Sigmoid = 2,
+  Tanh = 3,
+};
 
 class CPUBackend final : public Backend {
+  friend class CPUSession;
+
   /// The Module that holds the glow IR. This does not own the module.
   IRFunction *F_;
   /// Information about allocations.
@@ -49,24 +71,167 @@ class CPUBackend final : public Backend {
 
   /// The LLVM IR code generator.
   LLVMIRGen irgen_;
+  /// The LLVM IR code generator and the JIT of the optimized code, when the
+  /// quick code is replaced by the optimized code compiled in the background.
+  std::unique_ptr<LLVMIRGen> optimizedIRGen_;
+  std::unique_ptr<llvm::orc::GlowJIT> optimizedJIT_;
+  /// The thread that compiles the optimized code in the background.
+  std::thread optimizer_;
   /// This represents the heap, that stores the activations at runtime.
   void *heap_{nullptr};
-  /// Produce the main entry point for JIT execution.
-  void emitJitMain();
+  /// The size of the heap in bytes.
+  size_t heapSize_{0};
+  /// The arena that holds the activations instead of the heap, if any.
+  ActivationArena *arena_{nullptr};
+  /// The placement of the heap and of the constant weights in memory.
+  MemoryPolicy memoryPolicy_;
+  /// The file of the compiled code loaded by loadCompiled(), whose constant
+  /// weights the code reads in place if they are mapped into memory.
+  std::unique_ptr<llvm::MemoryBuffer> compiledFile_;
+  /// The copy of the constant weights of the loaded code, if they are not
+  /// read from the file, and its size in bytes.
+  void *loadedWeights_{nullptr};
+  size_t loadedWeightsSize_{0};
+  /// The constant weights that the loaded code reads, in the file or in
+  /// loadedWeights_, and their size in bytes.
+  const char *loadedWeightsData_{nullptr};
+  size_t loadedWeightsDataSize_{0};
+  /// The batch that the code computes at run time, or 0 if it always
+  /// computes the whole batch.
+  size_t maxBatchSize_{0};
+  /// A mutable weight, i.e. an input or an output of the code.
+  struct MutableVar {
+    /// The variable of the weight.
+    Variable *var;
+    /// The number of the weight in the array of offsets.
+    size_t number;
+  };
+  /// The mutable weights.
+  std::vector<MutableVar> mutableVars_;
+  /// The constant weights embedded into the bundle, if any.
+  llvm::GlobalVariable *constantWeights_{nullptr};
+  /// Whether the bundle has several entries. The inputs and outputs of the
+  /// other entries are then left out of the memory and the symbol table of
+  /// the entry.
+  bool isMultiEntryBundle_{false};
+  /// The name of the multi-entry bundle.
+  std::string multiEntryBundleName_;
+  /// Whether the entry defines the constant weights embedded into the
+  /// multi-entry bundle. The other entries only declare them.
+  bool definesConstantWeights_{true};
+  /// The level of the CPU variant of the bundle code that is generated, or 0
+  /// for the baseline code, which dispatches to the variants if there are
+  /// any.
+  unsigned cpuVariant_{0};
+  /// The offsets passed to the jitted code. The entries of the mutable
+  /// weights are the addresses of their tensors.
+  std::vector<size_t> offsets_;
+  /// The type of the jitted entry point "jitmain".
+  using JitMainType = void (*)(uint8_t *, size_t *);
+  /// The jitted entry point. It is replaced by the optimized code while runs
+  /// may be in flight, which finish with the code they started with.
+  std::atomic<JitMainType> jitMain_{nullptr};
+  /// An element of the trace of the kernels, see
+  /// LLVMIRGen::emitProfileDumpFunction. The times are those of the last call
+  /// of the kernel, in nanoseconds of the monotonic clock.
+  struct KernelTraceEntry {
+    const char *name;
+    uint64_t begin;
+    uint64_t end;
+  };
+  /// The trace of the kernels of the code that jitMain_ runs, or null if the
+  /// code wasn't compiled while tracing.
+  std::atomic<KernelTraceEntry *> kernelTrace_{nullptr};
+  /// The type of the jitted task functions.
+  using TaskFuncType = void (*)(uint8_t *, uint8_t *, uint8_t *, size_t *);
+  /// The entry points of the jitted tasks. This is empty if the code is
+  /// executed serially through "jitmain".
+  std::vector<TaskFuncType> taskFuncs_;
+  /// The dependencies between the jitted tasks.
+  TaskGraph taskGraph_;
+  /// The pool of threads that runs the independent tasks concurrently.
+  std::unique_ptr<ThreadPool> threadPool_;
+  /// Whether the functions of the jitted code are compiled on their first
+  /// call, which the next run makes. That run holds firstRunMutex_.
+  mutable std::atomic<bool> compilesOnFirstRun_{false};
+  mutable std::mutex firstRunMutex_;
+  /// Whether the backend benchmarks a candidate of the kernel tuning. It
+  /// neither tunes its kernels nor uses the object cache.
+  bool isBenchmark_{false};
+  /// Benchmark the candidate parameters of the tunable kernels of the code
+  /// that are not in the tuning database, and add the fastest ones to it.
+  /// This does nothing unless -cpu-autotune is set and the code is compiled
+  /// for the host.
+  void tuneKernels();
+  /// \returns the time in seconds of a run of a copy of \p I alone, whose
+  /// kernel has the parameters \p params. \p key is the key of \p I in the
+  /// tuning database.
+  static double benchmarkKernel(const Instruction *I, const std::string &key,
+                                const KernelParams &params);
+  /// \returns the number of the output channels in a block of the filters
+  /// of the DKKC convolutions: 16 for the AVX-512 kernels of the host, else 8.
+  static unsigned getConvBlockWidth();
+  /// Produce the main entry point for JIT execution into the module of
+  /// \p irgen.
+  void emitJitMain(LLVMIRGen &irgen);
+  /// Split the code into \p numPartitions modules of tasks, compile them
+  /// concurrently and add them to the JIT.
+  void compilePartitions(unsigned numPartitions);
+  /// Compile the optimized code and switch the entry point to it. The object
+  /// file is stored into the object cache under \p cacheKey, unless it is
+  /// empty. This runs on the optimizer thread.
+  void compileOptimizedCode(const std::string &cacheKey);
+  /// Look up the entry points of the jitted tasks and build their graph.
+  void initJitTasks();
+  /// Run the jitted code with the memory area \p activations and the array
+  /// of \p offsets. The tasks, if any, run on the thread pool if \p
+  /// useThreadPool is set and serially otherwise, with a call of
+  /// \p preemptionPoint between them if it is given.
+  void runJitCode(uint8_t *activations, size_t *offsets, bool useThreadPool,
+                  const std::function<void()> &preemptionPoint = nullptr) const;
+  /// Run the jitted code like runJitCode, once its functions are compiled.
+  void
+  runCompiledCode(uint8_t *activations, size_t *offsets, bool useThreadPool,
+                  const std::function<void()> &preemptionPoint = nullptr) const;
+  /// Switch the runs to the jitted code of \p JIT, and to its trace of the
+  /// kernels.
+  void setJitMain(llvm::orc::GlowJIT &JIT);
+  /// Record the calls of the kernels of the last run in the timeline, if
+  /// tracing is enabled.
+  void traceKernels() const;
+  /// Allocate the heap for the activations, unless they are kept in the
+  /// arena.
+  void allocateHeap();
+  /// \returns the memory of the activations of the next forward pass.
+  uint8_t *getActivations() const;
   /// Perform memory allocation for a JIT execution.
   void performJITMemoryAllocation();
   /// Perform memory allocation for a bundle.
   void performBundleMemoryAllocation();
   /// Save weights for the bundle.
   void saveWeights(llvm::StringRef weightsFileName);
-  /// Produce a bundle.
-  void produceBundle(llvm::StringRef outputDir);
+  /// Emit the constant weights of the bundle as the read-only global variable
+  /// \p name with the linkage \p linkage. If \p isDefinition is false, only
+  /// declare the variable, which another module of the bundle defines.
+  void emitConstantWeights(const std::string &name,
+                           llvm::GlobalValue::LinkageTypes linkage,
+                           bool isDefinition);
+  /// Emit the entry point of the bundle, its code, its symbol table and its
+  /// config into the LLVM module.
+  void generateBundleCode(llvm::StringRef outputDir);
+  /// Produce the files of the bundle \p bundleName from the LLVM module.
+  void produceBundle(llvm::StringRef outputDir, llvm::StringRef bundleName);
   /// Emit config for a bundle.
   void emitBundleConfig();
   /// Emit the symbol table for a bundle.
   void emitSymbolTable();
   /// Emit the entry function for the bundle.
   void emitBundleEntryFunction();
+  /// Emit the entry point of the bundle that calls the CPU variant selected
+  /// when the bundle is loaded, or the baseline code \p generic.
+  void emitCPUDispatcher(llvm::Function *generic);
+  /// Produce the bundle with the baseline code and its CPU variants.
+  void saveWithCPUVariants(llvm::StringRef outputDir);
 
 public:
   /// Ctor.
@@ -83,14 +248,92 @@ public:
 
   void save(llvm::StringRef outputDir) override;
 
+  void save(llvm::ArrayRef<IRFunction *> entries, llvm::StringRef outputDir,
+            llvm::StringRef bundleName) override;
+
+  void saveCompiled(llvm::StringRef path) override;
+
+  void loadCompiled(llvm::StringRef path, Module &M) override;
+
   void doForwardPass() override;
 
+  void dumpProfile() override;
+
+  void setBatchSize(size_t batchSize) override;
+
+  size_t getActivationsSize() const override {
+    return allocationsInfo_.activationsMemSize_;
+  }
+
+  void setActivationArena(ActivationArena *arena) override;
+
+  void prefault() override;
+
+  bool waitForOptimizedCode() override;
+
+  std::unique_ptr<ExecutionSession> createSession() override;
+
   bool transformPostLowering(Function *F, CompilationMode mode) override;
 
-  bool isOpSupported(Kinded::Kind opKind, ElemKind elementTy) const override;
+  std::vector<FusionPattern>
+  getFusionPatterns(CompilationMode mode) const override;
+
+  bool isOpSupported(Kinded::Kind opKind, ElemKind elementTy) const override {
+    return supportsOp(opKind, elementTy);
+  }
+
+  bool shouldLower(Node *N) override { return lowersNode(N); }
+  /// @}
+
+  /// The answers of isOpSupported() and shouldLower(), which don't depend on
+  /// a backend object, see glow::isOpSupported() and glow::shouldLower().
+  /// @{
+  static bool supportsOp(Kinded::Kind opKind, ElemKind elementTy);
+  static bool lowersNode(const Node *N);
   /// @}
 };
 
+/// A session of the jitted code, with its own tensors for the mutable weights
+/// and its own memory for the activations. The sessions of a backend share its
+/// code and its constant weights. Sessions run the tasks of the code serially,
+/// so that they don't compete for the thread pool of the backend.
+class CPUSession final : public ExecutionSession {
+  /// The backend that compiled the code.
+  const CPUBackend &backend_;
+  /// The memory of the activations and its size in bytes.
+  uint8_t *activations_{nullptr};
+  size_t activationsSize_{0};
+  /// The arena that holds the activations instead, if any.
+  ActivationArena *arena_{nullptr};
+  /// The offsets passed to the jitted code by this session.
+  std::vector<size_t> offsets_;
+  /// The tensors owned by the session for its mutable weights.
+  std::unordered_map<const Variable *, std::unique_ptr<Tensor>> tensors_;
+  /// The tensors that the mutable weights are bound to.
+  std::unordered_map<const Variable *, Tensor *> bound_;
+  /// Called between the tasks of the forward passes, if set.
+  std::function<void()> preemptionPoint_;
+
+public:
+  explicit CPUSession(const CPUBackend &backend);
+
+  ~CPUSession() override;
+
+  Tensor &getTensor(const Variable *v) override;
+
+  void bind(const Variable *v, Tensor *T) override;
+
+  void setBatchSize(size_t batchSize) override;
+
+  void setActivationArena(ActivationArena *arena) override;
+
+  void setPreemptionPoint(std::function<void()> fn) override {
+    preemptionPoint_ = std::move(fn);
+  }
+
+  void doForwardPass() override;
+};
+
 /// Create a new instance of the JITBackend backend.
 inline Backend *createCPUBackend(IRFunction *M) { return new CPUBackend(M); }
 
@@ -17,9 +17,11 @@
 
 #include "CPUBackend.h"
 #include "CommandLine.h"
+#include "KernelCache.h"
 
 #include "glow/IR/Instrs.h"
 
+#include "llvm/ADT/STLExtras.h"
 #include "llvm/ADT/Statistic.h"
 #include "llvm/Support/Debug.h"
 
@@ -30,16 +32,17 @@ using llvm::dyn_cast;
 using llvm::isa;
 using llvm::StringRef;
 
-namespace {
 /// Perform function specialization with constant arguments taking into account
 /// only dimensions, but not the buffer addresses. This allows for faster JIT
-/// compilation and the does degrade performance.
-static llvm::cl::opt<bool>
+/// compilation and the does degrade performance. This is not static, because
+/// the object cache hashes it.
+llvm::cl::opt<bool>
     jitSpecializeDims("jit-specialize",
                       llvm::cl::desc("Create specialized functions for "
                                      "operations with constant dimensions"),
                       llvm::cl::init(true), llvm::cl::cat(CPUBackendCat));
 
+namespace {
 STATISTIC(NumSpecializations, "Number of created specializations");
 STATISTIC(NumSharedSpecializations, "Number of shared specializations");
 
@@ -147,6 +150,7 @@ class FunctionSpecializer {
     // Create the invocation of the original function.
     builder.CreateCall(F, forwardedArgs);
     builder.CreateRetVoid();
+    specializedFuncs_.push_back(specializedF);
     DEBUG(llvm::dbgs() << "\n\nCreated specialized function " << specializedName
                        << "\n";
           specializedF->print(llvm::errs(), nullptr));
@@ -207,9 +211,9 @@ class FunctionSpecializer {
     // arguments, its code size, etc.
     const auto *caller = call->getFunction();
     const auto *callee = call->getCalledFunction();
-    // Specialized only calls inside main.
-    assert(caller == entryF_ &&
-           "Only calls inside the entry function are specialized");
+    // Specialized only calls inside the entry functions.
+    assert(llvm::is_contained(entryFuncs_, caller) &&
+           "Only calls inside the entry functions are specialized");
     (void)caller;
     // Do not specialize any LLVM internal functions.
     if (callee && callee->getName().startswith("llvm."))
@@ -221,7 +225,14 @@ class FunctionSpecializer {
   }
 
 public:
-  FunctionSpecializer(llvm::Function *entryF) : entryF_(entryF) {}
+  FunctionSpecializer(llvm::ArrayRef<llvm::Function *> entryFuncs)
+      : entryFuncs_(entryFuncs.begin(), entryFuncs.end()) {}
+
+  /// \returns the specialized functions created by run().
+  llvm::ArrayRef<llvm::Function *> getSpecializedFunctions() const {
+    return specializedFuncs_;
+  }
+
   void run() {
     // Bail if there is nothing to be specialized.
     if (!jitSpecializeDims && !jitSpecializeAllArguments_)
@@ -230,17 +241,18 @@ public:
     // The removal should happen after all specializations are done, because
     // these call instructions are used by the keys in Specializations_ map.
     llvm::SmallVector<llvm::Instruction *, 32> erasedInstructions;
-    auto *F = entryF_;
-    // Collect all eligable calls in the current function.
+    // Collect all eligable calls in the entry functions.
     llvm::SmallVector<llvm::CallInst *, 64> calls;
-    for (auto &BB : *F) {
-      for (auto &I : BB) {
-        auto *CI = dyn_cast<llvm::CallInst>(&I);
-        if (!CI)
-          continue;
-        if (!isEligableForSpecialization(CI))
-          continue;
-        calls.push_back(CI);
+    for (auto *F : entryFuncs_) {
+      for (auto &BB : *F) {
+        for (auto &I : BB) {
+          auto *CI = dyn_cast<llvm::CallInst>(&I);
+          if (!CI)
+            continue;
+          if (!isEligableForSpecialization(CI))
+            continue;
+          calls.push_back(CI);
+        }
       }
     }
     // Try to specialize all the collected calls.
@@ -320,12 +332,14 @@ private:
     }
   };
 
-  /// The entry function of the module.
-  llvm::Function *entryF_;
+  /// The entry functions of the module.
+  llvm::SmallVector<llvm::Function *, 1> entryFuncs_;
   /// Mapping from specialization keys to the specialized functions.
   std::unordered_map<SpecializationKey, llvm::Function *,
                      SpecializationKeyHasher, SpecializationKeyEq>
       specializations_;
+  /// The specialized functions, in the order of their creation.
+  std::vector<llvm::Function *> specializedFuncs_;
 
   /// An index to create unique specialization names.
   unsigned uniqueIdx_{0};
@@ -338,8 +352,21 @@ private:
 } // namespace
 
 void LLVMIRGen::performSpecialization() {
-  FunctionSpecializer FuncSpecializer(llmodule_->getFunction("main"));
+  // The task functions are entry functions as well.
+  llvm::SmallVector<llvm::Function *, 1> entryFuncs{
+      llmodule_->getFunction("main")};
+  for (const auto &task : tasks_) {
+    entryFuncs.push_back(llmodule_->getFunction(task.name));
+  }
+  FunctionSpecializer FuncSpecializer(entryFuncs);
   FuncSpecializer.run();
+  // Replace the specializations by calls of the kernels shared by all of the
+  // code compiled by the process.
+  if (shareKernels_) {
+    for (auto *specializedF : FuncSpecializer.getSpecializedFunctions()) {
+      SharedKernelCache::get().share(specializedF, getTargetMachine());
+    }
+  }
   // Add debug info to all the newly created functions, i.e. to the created
   // specialized functions.
   for (auto &FF : getModule()) {
@@ -15,45 +15,261 @@
  */
 
 #include "GlowJIT.h"
+#include "CommandLine.h"
+#include "KernelCache.h"
+
+#include "glow/Support/Parallel.h"
+#include "glow/Support/Trace.h"
+
+#include "llvm/Config/llvm-config.h"
+#include "llvm/IR/Constants.h"
+#include "llvm/Object/SymbolSize.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/Format.h"
+
+#include <mutex>
+#include <unistd.h>
 
 using GlowJIT = llvm::orc::GlowJIT;
 
-GlowJIT::GlowJIT(llvm::TargetMachine &TM)
+static llvm::cl::opt<bool> perfMap(
+    "cpu-perf-map",
+    llvm::cl::desc("Register the jitted code with perf: write its functions "
+                   "into /tmp/perf-<pid>.map, and into the jitdump file if "
+                   "LLVM is built with perf support, so that perf attributes "
+                   "the samples to the kernels"),
+    llvm::cl::init(false), llvm::cl::cat(CPUBackendCat));
+
+namespace {
+/// Appends the functions of the jitted objects to /tmp/perf-<pid>.map, the
+/// symbol map that perf reads for the code of the process that no file
+/// backs.
+class PerfMapListener : public llvm::JITEventListener {
+  std::mutex mutex_;
+  std::unique_ptr<llvm::raw_fd_ostream> os_;
+
+public:
+  PerfMapListener() {
+    std::error_code EC;
+    std::string path = "/tmp/perf-" + std::to_string(getpid()) + ".map";
+    os_ = llvm::make_unique<llvm::raw_fd_ostream>(
+        path, EC, llvm::sys::fs::F_Text | llvm::sys::fs::F_Append);
+    if (EC) {
+      llvm::errs() << "Can't write the perf map " << path << "\n";
+      os_.reset();
+    }
+  }
+
+  void NotifyObjectEmitted(
+      const llvm::object::ObjectFile &obj,
+      const llvm::RuntimeDyld::LoadedObjectInfo &info) override {
+    if (!os_) {
+      return;
+    }
+    // The symbols of the debug object are at their load addresses.
+    auto debugObj = info.getObjectForDebug(obj);
+    const auto *loaded = debugObj.getBinary() ? debugObj.getBinary() : &obj;
+    std::lock_guard<std::mutex> lock(mutex_);
+    for (const auto &symSize : llvm::object::computeSymbolSizes(*loaded)) {
+      const auto &sym = symSize.first;
+      auto type = sym.getType();
+      auto name = sym.getName();
+      auto address = sym.getAddress();
+      if (!type || !name || !address) {
+        llvm::consumeError(type.takeError());
+        llvm::consumeError(name.takeError());
+        llvm::consumeError(address.takeError());
+        continue;
+      }
+      if (*type != llvm::object::SymbolRef::ST_Function || !symSize.second) {
+        continue;
+      }
+      *os_ << llvm::format("%llx %llx ", (unsigned long long)*address,
+                           (unsigned long long)symSize.second)
+           << *name << "\n";
+    }
+    os_->flush();
+  }
+};
+} // namespace
+
+/// \returns the listeners that are notified of the jitted objects.
+static llvm::ArrayRef<llvm::JITEventListener *> getEventListeners() {
+  static std::vector<llvm::JITEventListener *> listeners = []() {
+    std::vector<llvm::JITEventListener *> listeners;
+    if (!perfMap) {
+      return listeners;
+    }
+    static PerfMapListener perfMapListener;
+    listeners.push_back(&perfMapListener);
+#if LLVM_VERSION_MAJOR >= 6
+    // The jitdump file, which also holds the code, for "perf inject --jit".
+    if (auto *perfListener =
+            llvm::JITEventListener::createPerfJITEventListener()) {
+      listeners.push_back(perfListener);
+    }
+#endif
+    return listeners;
+  }();
+  return listeners;
+}
+
+GlowJIT::GlowJIT(llvm::TargetMachine &TM, bool lazy)
     : TM_(TM), DL_(TM_.createDataLayout()),
-      objectLayer_([]() { return std::make_shared<SectionMemoryManager>(); }),
+      objectLayer_([]() { return std::make_shared<SectionMemoryManager>(); },
+                   [](RTDyldObjectLinkingLayer::ObjHandleT,
+                      const RTDyldObjectLinkingLayer::ObjectPtr &obj,
+                      const RuntimeDyld::LoadedObjectInfo &info) {
+                     for (auto *listener : getEventListeners()) {
+                       listener->NotifyObjectEmitted(*obj->getBinary(), info);
+                     }
+                   }),
       compileLayer_(objectLayer_, SimpleCompiler(TM)) {
   llvm::sys::DynamicLibrary::LoadLibraryPermanently(nullptr);
+  // The jitted code calls the parallel runtime of the process, which the
+  // executable may not export.
+  using llvm::sys::DynamicLibrary;
+  DynamicLibrary::AddSymbol("glow_parallel_for",
+                            reinterpret_cast<void *>(&glow_parallel_for));
+  DynamicLibrary::AddSymbol(
+      "glow_parallel_set_num_threads",
+      reinterpret_cast<void *>(&glow_parallel_set_num_threads));
+  DynamicLibrary::AddSymbol(
+      "glow_parallel_get_num_threads",
+      reinterpret_cast<void *>(&glow_parallel_get_num_threads));
+  DynamicLibrary::AddSymbol(
+      "glow_parallel_set_affinity",
+      reinterpret_cast<void *>(&glow_parallel_set_affinity));
+  DynamicLibrary::AddSymbol(
+      "glow_parallel_set_spin_count",
+      reinterpret_cast<void *>(&glow_parallel_set_spin_count));
+  DynamicLibrary::AddSymbol(
+      "glow_parallel_set_thread_limit",
+      reinterpret_cast<void *>(&glow_parallel_set_thread_limit));
+
+  if (!lazy) {
+    return;
+  }
+  compileCallbackManager_ =
+      createLocalCompileCallbackManager(TM_.getTargetTriple(), 0);
+  auto stubsManagerBuilder =
+      createLocalIndirectStubsManagerBuilder(TM_.getTargetTriple());
+  if (!compileCallbackManager_ || !stubsManagerBuilder) {
+    compileCallbackManager_.reset();
+    return;
+  }
+  // A function is compiled the first time that it is called through its
+  // stub, together with the functions that it refers to.
+  codLayer_ = llvm::make_unique<CompileOnDemandLayer<decltype(compileLayer_)>>(
+      compileLayer_, [this](Function &F) { return getPartition(F); },
+      *compileCallbackManager_, std::move(stubsManagerBuilder));
+}
+
+std::set<llvm::Function *> GlowJIT::getPartition(Function &F) {
+  std::lock_guard<std::mutex> lock(partitionMutex_);
+  std::set<Function *> partition{&F};
+  partitioned_.insert(&F);
+  // Walk the constants that the partition refers to: the functions that it
+  // calls or passes around, the globals and their initializers.
+  std::vector<const Constant *> worklist;
+  std::unordered_set<const Constant *> visited;
+  auto visitOperands = [&](const User &U) {
+    for (const Use &op : U.operands()) {
+      auto *C = dyn_cast<Constant>(op.get());
+      if (C && visited.insert(C).second) {
+        worklist.push_back(C);
+      }
+    }
+  };
+  auto visitBody = [&](const Function &fn) {
+    for (const auto &BB : fn) {
+      for (const auto &I : BB) {
+        visitOperands(I);
+      }
+    }
+  };
+  visitBody(F);
+  while (!worklist.empty()) {
+    const Constant *C = worklist.back();
+    worklist.pop_back();
+    if (auto *fn = dyn_cast<Function>(C)) {
+      if (!fn->isDeclaration() && partitioned_.insert(fn).second) {
+        partition.insert(const_cast<Function *>(fn));
+        visitBody(*fn);
+      }
+      continue;
+    }
+    visitOperands(*C);
+  }
+  return partition;
 }
 
-GlowJIT::ModuleHandle GlowJIT::addModule(std::unique_ptr<Module> M) {
+std::shared_ptr<llvm::JITSymbolResolver> GlowJIT::createResolver() {
   // Build our symbol resolver:
   // Lambda 1: Look back into the JIT itself to find symbols that are part of
   //           the same "logical dylib".
-  // Lambda 2: Search for external symbols in the host process.
-  auto resolver = createLambdaResolver(
+  // Lambda 2: Search for external symbols in the host process and for the
+  //           kernels shared by the jitted code of the process.
+  return createLambdaResolver(
       [&](const std::string &name) {
-        if (auto sym = compileLayer_.findSymbol(name, false))
+        if (codLayer_) {
+          if (auto sym = codLayer_->findSymbol(name, false))
+            return sym;
+        } else if (auto sym = compileLayer_.findSymbol(name, false)) {
           return sym;
+        }
         return JITSymbol(nullptr);
       },
       [](const std::string &name) {
         if (auto symAddr = RTDyldMemoryManager::getSymbolAddressInProcess(name))
           return JITSymbol(symAddr, JITSymbolFlags::Exported);
+        if (auto symAddr = glow::SharedKernelCache::get().findKernel(name))
+          return JITSymbol(symAddr, JITSymbolFlags::Exported);
         return JITSymbol(nullptr);
       });
+}
 
-  // Add the set to the JIT with the resolver we created above and a newly
-  // created SectionMemoryManager.
-  return cantFail(compileLayer_.addModule(std::move(M), std::move(resolver)));
+void GlowJIT::addModule(std::unique_ptr<Module> M) {
+  // Add the set to the JIT with a new resolver and a newly created
+  // SectionMemoryManager.
+  if (codLayer_) {
+    cantFail(codLayer_->addModule(std::move(M), createResolver()));
+    return;
+  }
+  cantFail(compileLayer_.addModule(std::move(M), createResolver()));
+}
+
+std::unique_ptr<llvm::MemoryBuffer> GlowJIT::compileModule(Module &M) {
+  return compileModule(M, TM_);
+}
+
+std::unique_ptr<llvm::MemoryBuffer> GlowJIT::compileModule(Module &M,
+                                                           TargetMachine &TM) {
+  glow::TraceScope trace("codegen", glow::TraceCompile);
+  SimpleCompiler compiler(TM);
+  auto object = compiler(M).takeBinary();
+  return std::move(object.second);
+}
+
+bool GlowJIT::addObject(std::unique_ptr<MemoryBuffer> object) {
+  auto file = object::ObjectFile::createObjectFile(object->getMemBufferRef());
+  if (!file) {
+    consumeError(file.takeError());
+    return false;
+  }
+  auto binary = std::make_shared<object::OwningBinary<object::ObjectFile>>(
+      std::move(*file), std::move(object));
+  cantFail(objectLayer_.addObject(std::move(binary), createResolver()));
+  return true;
 }
 
 llvm::JITSymbol GlowJIT::findSymbol(const std::string name) {
   std::string mangledName;
   raw_string_ostream MangledNameStream(mangledName);
   Mangler::getNameWithPrefix(MangledNameStream, name, DL_);
+  // The lazy layer also finds the symbols of the compile layer.
+  if (codLayer_) {
+    return codLayer_->findSymbol(MangledNameStream.str(), true);
+  }
   return compileLayer_.findSymbol(MangledNameStream.str(), true);
 }
-
-void GlowJIT::removeModule(GlowJIT::ModuleHandle H) {
-  cantFail(compileLayer_.removeModule(H));
-}
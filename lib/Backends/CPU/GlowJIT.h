@@ -19,8 +19,10 @@
 #include "llvm/ADT/STLExtras.h"
 #include "llvm/ExecutionEngine/ExecutionEngine.h"
 #include "llvm/ExecutionEngine/JITSymbol.h"
+#include "llvm/ExecutionEngine/Orc/CompileOnDemandLayer.h"
 #include "llvm/ExecutionEngine/Orc/CompileUtils.h"
 #include "llvm/ExecutionEngine/Orc/IRCompileLayer.h"
+#include "llvm/ExecutionEngine/Orc/IndirectionUtils.h"
 #include "llvm/ExecutionEngine/Orc/LambdaResolver.h"
 #include "llvm/ExecutionEngine/Orc/RTDyldObjectLinkingLayer.h"
 #include "llvm/ExecutionEngine/RTDyldMemoryManager.h"
@@ -28,11 +30,15 @@
 #include "llvm/IR/DataLayout.h"
 #include "llvm/IR/Mangler.h"
 #include "llvm/Support/DynamicLibrary.h"
+#include "llvm/Support/MemoryBuffer.h"
 #include "llvm/Support/raw_ostream.h"
 #include "llvm/Target/TargetMachine.h"
 #include <algorithm>
 #include <memory>
+#include <mutex>
+#include <set>
 #include <string>
+#include <unordered_set>
 #include <vector>
 
 namespace llvm {
@@ -46,19 +52,61 @@ private:
   const DataLayout DL_;
   RTDyldObjectLinkingLayer objectLayer_;
   IRCompileLayer<decltype(objectLayer_), SimpleCompiler> compileLayer_;
+  /// The compile callbacks and the layer that compile every function of the
+  /// modules on its first call, if the JIT is lazy.
+  std::unique_ptr<JITCompileCallbackManager> compileCallbackManager_;
+  std::unique_ptr<CompileOnDemandLayer<decltype(compileLayer_)>> codLayer_;
+  /// The functions that the lazy JIT compiled or is compiling, and the lock
+  /// that guards them.
+  std::unordered_set<const Function *> partitioned_;
+  std::mutex partitionMutex_;
 
-public:
-  using ModuleHandle = decltype(compileLayer_)::ModuleHandleT;
+  /// \returns the resolver for the symbols referenced by the jitted code.
+  std::shared_ptr<JITSymbolResolver> createResolver();
+
+  /// \returns the functions that the lazy JIT compiles when the stub of \p F
+  /// is first called: \p F and every function that it may call, directly or
+  /// through the pointers that it passes around, like the task bodies that
+  /// the libjit kernels hand to the pool, unless they are compiled already.
+  /// The code that a stub runs then never calls another stub, so the threads
+  /// of the pool never compile, and only the calls into the jitted code from
+  /// outside do.
+  std::set<Function *> getPartition(Function &F);
 
-  GlowJIT(llvm::TargetMachine &TM);
+public:
+  /// Creates a JIT for the target machine \p TM. If \p lazy is set, the
+  /// functions of the modules are compiled on their first call from outside
+  /// the jitted code, which is then not thread-safe, instead of when they are
+  /// added. The JIT is not lazy on
+  /// the targets that LLVM has no compile callbacks for.
+  GlowJIT(llvm::TargetMachine &TM, bool lazy = false);
 
   TargetMachine &getTargetMachine() { return TM_; }
 
-  ModuleHandle addModule(std::unique_ptr<Module> M);
+  /// \returns true if the functions of the modules are compiled on their
+  /// first call.
+  bool isLazy() const { return codLayer_ != nullptr; }
 
-  JITSymbol findSymbol(const std::string name);
+  /// Add the module \p M to the JIT, which compiles it now or, if the JIT is
+  /// lazy, function by function on their first call.
+  void addModule(std::unique_ptr<Module> M);
 
-  void removeModule(ModuleHandle H);
+  /// Generate the machine code for \p M without adding it to the JIT.
+  /// \returns the object file.
+  std::unique_ptr<MemoryBuffer> compileModule(Module &M);
+
+  /// Generate the machine code for \p M with the target machine \p TM, which
+  /// must match the one of the JIT. This doesn't access the JIT, so modules
+  /// of different contexts can be compiled concurrently. \returns the object
+  /// file.
+  static std::unique_ptr<MemoryBuffer> compileModule(Module &M,
+                                                     TargetMachine &TM);
+
+  /// Add the object file \p object to the JIT. \returns false if \p object is
+  /// not a valid object file.
+  bool addObject(std::unique_ptr<MemoryBuffer> object);
+
+  JITSymbol findSymbol(const std::string name);
 };
 
 } // end namespace orc
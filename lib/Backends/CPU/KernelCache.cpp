@@ -0,0 +1,398 @@
+/**
+ * Copyright (c) 2017-present, Facebook, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#define DEBUG_TYPE "jit-kernel-cache"
+
+#include "KernelCache.h"
+#include "LLVMIRGen.h"
+#include "ObjectCache.h"
+#include "glow/Support/Compiler.h"
+
+#include "llvm/ADT/DenseMap.h"
+#include "llvm/ADT/SmallPtrSet.h"
+#include "llvm/ADT/Statistic.h"
+#include "llvm/Config/llvm-config.h"
+#include "llvm/IR/Constants.h"
+#include "llvm/IR/DebugInfo.h"
+#include "llvm/IR/InstIterator.h"
+#include "llvm/IR/Instructions.h"
+#include "llvm/IR/Module.h"
+#include "llvm/Support/Debug.h"
+#include "llvm/Support/MD5.h"
+#include "llvm/Support/raw_ostream.h"
+#include "llvm/Transforms/Utils/Cloning.h"
+
+#include <cstring>
+#include <vector>
+
+using namespace glow;
+
+using llvm::cast;
+using llvm::dyn_cast;
+using llvm::isa;
+using llvm::StringRef;
+
+STATISTIC(NumCompiledKernels, "Number of compiled shared kernels");
+STATISTIC(NumLoadedKernels, "Number of shared kernels loaded from the cache");
+STATISTIC(NumReusedKernels, "Number of reused shared kernels");
+
+namespace {
+
+/// \returns the description of the target machine \p TM.
+std::string getTargetId(const llvm::TargetMachine &TM) {
+  return (llvm::Twine(TM.getTargetTriple().str()) + "/" + TM.getTargetCPU() +
+          "/" + TM.getTargetFeatureString() + "/" +
+          llvm::Twine(unsigned(TM.getCodeModel())) + "/" +
+          llvm::Twine(unsigned(TM.getOptLevel())))
+      .str();
+}
+
+/// Hashes the code of a specialization and everything that it references,
+/// and collects the global values that it references. The hash doesn't depend
+/// on the names of the constant global variables, which differ between the
+/// modules, but on their contents. The libjit functions are hashed by name,
+/// because the hash of the libjit bitcode covers their code.
+class KernelHasher {
+  llvm::MD5 &hash_;
+  /// The global values referenced by the specialization, in the order in
+  /// which they were found. The specialization comes first.
+  std::vector<const llvm::GlobalValue *> globals_;
+  llvm::DenseMap<const llvm::GlobalValue *, unsigned> numbers_;
+
+  void hashString(StringRef str) {
+    hash_.update(str);
+    hash_.update(StringRef("", 1));
+  }
+
+  void hashType(llvm::Type *T) {
+    std::string str;
+    llvm::raw_string_ostream os(str);
+    T->print(os);
+    hashString(os.str());
+  }
+
+  /// \returns the number of \p GV, which is found if it is new.
+  unsigned getNumber(const llvm::GlobalValue *GV) {
+    auto it = numbers_.find(GV);
+    if (it != numbers_.end()) {
+      return it->second;
+    }
+    numbers_[GV] = globals_.size();
+    globals_.push_back(GV);
+    return globals_.size() - 1;
+  }
+
+  /// Find the global values referenced by the constant \p C.
+  void findGlobals(const llvm::Constant *C) {
+    if (auto *GV = dyn_cast<llvm::GlobalValue>(C)) {
+      getNumber(GV);
+      return;
+    }
+    for (auto &op : C->operands()) {
+      findGlobals(cast<llvm::Constant>(op));
+    }
+  }
+
+  /// Hash the operand \p V of the specialization. \returns false if it is not
+  /// an argument or a constant.
+  bool hashValue(const llvm::Value *V) {
+    if (auto *GV = dyn_cast<llvm::GlobalValue>(V)) {
+      hashString("@" + std::to_string(getNumber(GV)));
+      return true;
+    }
+    if (auto *arg = dyn_cast<llvm::Argument>(V)) {
+      hashString("%" + std::to_string(arg->getArgNo()));
+      return true;
+    }
+    if (auto *data = dyn_cast<llvm::ConstantData>(V)) {
+      std::string str;
+      llvm::raw_string_ostream os(str);
+      data->print(os);
+      hashString(os.str());
+      return true;
+    }
+    if (!isa<llvm::ConstantExpr>(V) && !isa<llvm::ConstantAggregate>(V)) {
+      return false;
+    }
+    auto *C = cast<llvm::Constant>(V);
+    hashType(C->getType());
+    if (auto *CE = dyn_cast<llvm::ConstantExpr>(C)) {
+      hashString(CE->getOpcodeName());
+      hashString(std::to_string(CE->getRawSubclassOptionalData()));
+      if (CE->isCompare()) {
+        hashString(std::to_string(CE->getPredicate()));
+      }
+    }
+    hashString(std::to_string(C->getNumOperands()));
+    for (auto &op : C->operands()) {
+      if (!hashValue(op)) {
+        return false;
+      }
+    }
+    return true;
+  }
+
+  /// Hash the global value \p GV. \returns false if it cannot be shared.
+  bool hashGlobal(const llvm::GlobalValue *GV) {
+    hashType(GV->getType());
+    if (auto *var = dyn_cast<llvm::GlobalVariable>(GV)) {
+      // The kernels must not share the state of the networks.
+      if (!var->isConstant() || !var->hasInitializer()) {
+        return false;
+      }
+      return hashValue(var->getInitializer());
+    }
+    auto *F = dyn_cast<llvm::Function>(GV);
+    if (!F) {
+      return false;
+    }
+    if (F != globals_[0] || F->isDeclaration()) {
+      hashString(F->getName());
+      // Find the globals referenced by the libjit function.
+      for (auto &I : llvm::instructions(F)) {
+        for (auto &op : I.operands()) {
+          if (auto *C = dyn_cast<llvm::Constant>(op)) {
+            findGlobals(C);
+          }
+        }
+      }
+      return true;
+    }
+    // The specialization is a single block that calls the kernel.
+    if (F->size() != 1) {
+      return false;
+    }
+    for (auto &I : F->front()) {
+      hashString(I.getOpcodeName());
+      hashType(I.getType());
+      hashString(std::to_string(I.getNumOperands()));
+      for (auto &op : I.operands()) {
+        if (!hashValue(op)) {
+          return false;
+        }
+      }
+    }
+    return true;
+  }
+
+public:
+  explicit KernelHasher(llvm::MD5 &hash) : hash_(hash) {}
+
+  /// Hash the specialization \p F and everything that it references.
+  /// \returns false if it cannot be shared.
+  bool run(const llvm::Function *F) {
+    getNumber(F);
+    for (size_t i = 0; i < globals_.size(); i++) {
+      if (!hashGlobal(globals_[i])) {
+        return false;
+      }
+    }
+    return true;
+  }
+
+  /// \returns the global values referenced by the specialization.
+  llvm::ArrayRef<const llvm::GlobalValue *> getGlobals() const {
+    return globals_;
+  }
+};
+
+/// \returns the callee of the specialization \p F.
+StringRef getKernelName(const llvm::Function *F) {
+  for (auto &I : F->front()) {
+    if (auto *call = dyn_cast<llvm::CallInst>(&I)) {
+      if (auto *callee = call->getCalledFunction()) {
+        return callee->getName();
+      }
+    }
+  }
+  return "kernel";
+}
+
+/// Compile the specialization \p F with \p TM as the kernel \p name, which
+/// references \p globals. \returns the object file.
+std::unique_ptr<llvm::MemoryBuffer>
+compileKernel(const llvm::Function *F, StringRef name,
+              llvm::ArrayRef<const llvm::GlobalValue *> globals,
+              llvm::TargetMachine &TM) {
+  llvm::SmallPtrSet<const llvm::GlobalValue *, 16> definitions(globals.begin(),
+                                                               globals.end());
+  llvm::ValueToValueMapTy VMap;
+  auto M = llvm::CloneModule(
+      F->getParent(), VMap,
+      [&](const llvm::GlobalValue *GV) { return definitions.count(GV) != 0; });
+  auto *kernel = cast<llvm::Function>(VMap[F]);
+  llvm::StripDebugInfo(*M);
+
+  // Only the kernel is exported, and the libjit functions are inlined into it.
+  for (auto &GV : M->global_values()) {
+    if (!GV.isDeclaration()) {
+      GV.setLinkage(llvm::GlobalValue::InternalLinkage);
+    }
+  }
+  kernel->setName(name);
+  kernel->setLinkage(llvm::GlobalValue::ExternalLinkage);
+  llvm::AttributeList AL;
+  for (auto &FF : *M) {
+    if (FF.isDeclaration()) {
+      continue;
+    }
+    FF.setAttributes(AL);
+    FF.addFnAttr(&FF == kernel ? llvm::Attribute::AttrKind::NoInline
+                               : llvm::Attribute::AttrKind::AlwaysInline);
+    FF.addFnAttr("no-frame-pointer-elim", "true");
+  }
+  M->setTargetTriple(TM.getTargetTriple().normalize());
+  M->setDataLayout(TM.createDataLayout());
+  runLLVMOptimizations(*M, TM, /* fastCompile */ false);
+  return llvm::orc::GlowJIT::compileModule(*M, TM);
+}
+
+} // namespace
+
+SharedKernelCache &SharedKernelCache::get() {
+  static SharedKernelCache cache;
+  return cache;
+}
+
+void SharedKernelCache::init(llvm::TargetMachine &TM, StringRef libjitPath,
+                             StringRef objectCacheDir) {
+  std::lock_guard<std::recursive_mutex> lock(mutex_);
+  objectCacheDir_ = objectCacheDir;
+  if (JIT_) {
+    return;
+  }
+
+  TM_.reset(TM.getTarget().createTargetMachine(
+      TM.getTargetTriple().str(), TM.getTargetCPU(),
+      TM.getTargetFeatureString(), TM.Options, TM.getRelocationModel(),
+      TM.getCodeModel(), TM.getOptLevel()));
+  targetId_ = getTargetId(TM);
+  JIT_ = llvm::make_unique<llvm::orc::GlowJIT>(*TM_);
+
+  auto libjit = llvm::MemoryBuffer::getFile(libjitPath);
+  GLOW_ASSERT(libjit && "Unable to read the JIT library.");
+  llvm::MD5 hash;
+  hash.update((*libjit)->getBuffer());
+  libjitHash_ = JITObjectCache::getKey(hash);
+}
+
+bool SharedKernelCache::loadKernel(StringRef name, StringRef key) {
+  if (objectCacheDir_.empty()) {
+    return false;
+  }
+  auto object = JITObjectCache(objectCacheDir_).getObject(key);
+  if (!object || !JIT_->addObject(std::move(object))) {
+    return false;
+  }
+  kernels_.insert(name);
+  NumLoadedKernels++;
+  return true;
+}
+
+bool SharedKernelCache::share(llvm::Function *F, llvm::TargetMachine &TM) {
+  std::string targetId = getTargetId(TM);
+  std::string libjitHash;
+  {
+    std::lock_guard<std::recursive_mutex> lock(mutex_);
+    if (!JIT_ || targetId != targetId_) {
+      return false;
+    }
+    libjitHash = libjitHash_;
+  }
+
+  llvm::MD5 hash;
+  hash.update(StringRef(LLVM_VERSION_STRING));
+  hash.update(StringRef("", 1));
+  hash.update(targetId);
+  hash.update(StringRef("", 1));
+  hash.update(libjitHash);
+  hash.update(StringRef("", 1));
+  KernelHasher hasher(hash);
+  if (!hasher.run(F)) {
+    DEBUG(llvm::dbgs() << "Could not share " << F->getName() << "\n");
+    return false;
+  }
+  std::string key = JITObjectCache::getKey(hash);
+  std::string name = (getKernelName(F) + "_shared_" + key).str();
+
+  bool isCached;
+  {
+    std::lock_guard<std::recursive_mutex> lock(mutex_);
+    isCached = kernels_.count(name) || loadKernel(name, key);
+  }
+  if (isCached) {
+    NumReusedKernels++;
+  } else {
+    // The kernel is compiled without holding the lock, so that the modules
+    // that are compiled concurrently don't wait for each other. If another
+    // thread compiles the same kernel meanwhile, its object file is used.
+    auto object = compileKernel(F, name, hasher.getGlobals(), TM);
+    GLOW_ASSERT(object && "Unable to generate the machine code.");
+    std::lock_guard<std::recursive_mutex> lock(mutex_);
+    if (!kernels_.count(name)) {
+      if (!objectCacheDir_.empty()) {
+        JITObjectCache(objectCacheDir_).storeObject(key, object->getBuffer());
+      }
+      bool added = JIT_->addObject(std::move(object));
+      (void)added;
+      assert(added && "Unable to load the generated machine code.");
+      kernels_.insert(name);
+      NumCompiledKernels++;
+    }
+  }
+
+  // Call the shared kernel instead of the specialization.
+  F->deleteBody();
+  if (auto *kernel = F->getParent()->getFunction(name)) {
+    F->replaceAllUsesWith(kernel);
+    F->eraseFromParent();
+  } else {
+    F->setName(name);
+  }
+  DEBUG(llvm::dbgs() << "Shared the kernel " << name << "\n");
+  return true;
+}
+
+llvm::JITTargetAddress SharedKernelCache::findKernel(const std::string &name) {
+  std::lock_guard<std::recursive_mutex> lock(mutex_);
+  if (!JIT_) {
+    return 0;
+  }
+  // The JIT mangles the names of the symbols it looks up.
+  StringRef unmangled = name;
+  char prefix = TM_->createDataLayout().getGlobalPrefix();
+  if (prefix && unmangled.startswith(StringRef(&prefix, 1))) {
+    unmangled = unmangled.drop_front();
+  }
+  // The code loaded from the object cache calls the kernels that it was
+  // compiled with, which are loaded from the cache as well.
+  if (!kernels_.count(unmangled)) {
+    auto pos = unmangled.rfind("_shared_");
+    if (pos == StringRef::npos ||
+        !loadKernel(unmangled, unmangled.substr(pos + strlen("_shared_")))) {
+      return 0;
+    }
+  }
+  auto sym = JIT_->findSymbol(unmangled);
+  if (!sym) {
+    return 0;
+  }
+  auto address = sym.getAddress();
+  if (!address) {
+    llvm::consumeError(address.takeError());
+    return 0;
+  }
+  return *address;
+}
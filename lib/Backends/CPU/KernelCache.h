@@ -0,0 +1,87 @@
+/**
+ * Copyright (c) 2017-present, Facebook, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#ifndef GLOW_BACKENDS_JIT_KERNELCACHE_H
+#define GLOW_BACKENDS_JIT_KERNELCACHE_H
+
+#include "GlowJIT.h"
+
+#include "llvm/ADT/StringRef.h"
+#include "llvm/ADT/StringSet.h"
+#include "llvm/IR/Function.h"
+#include "llvm/Target/TargetMachine.h"
+
+#include <memory>
+#include <mutex>
+#include <string>
+
+namespace glow {
+
+/// A process-wide cache of the compiled specializations of the libjit
+/// kernels. The specializations for the same kernel and the same constant
+/// arguments are compiled once and called by the code of every network that
+/// needs them, instead of being specialized, optimized and compiled again for
+/// every network. Every kernel is named after the hash of its code and of
+/// everything that it references, so that it can also be stored in the
+/// persistent object cache and loaded by later processes.
+class SharedKernelCache {
+  /// Serializes the accesses to the cache. The JIT resolves the symbols of
+  /// the kernels through findKernel while the cache is locked.
+  std::recursive_mutex mutex_;
+  /// The target machine of the kernels and its description. The kernels are
+  /// shared only by the code compiled for the same target machine.
+  std::unique_ptr<llvm::TargetMachine> TM_;
+  std::string targetId_;
+  /// The hash of the libjit bitcode that the kernels are compiled from.
+  std::string libjitHash_;
+  /// The JIT that holds the compiled kernels.
+  std::unique_ptr<llvm::orc::GlowJIT> JIT_;
+  /// The names of the kernels added to the JIT.
+  llvm::StringSet<> kernels_;
+  /// The directory of the persistent object cache, if any.
+  std::string objectCacheDir_;
+
+  SharedKernelCache() = default;
+
+  /// Load the kernel \p name with the hash \p key from the object cache.
+  /// \returns false if it is not cached.
+  bool loadKernel(llvm::StringRef name, llvm::StringRef key);
+
+public:
+  /// \returns the cache of the process.
+  static SharedKernelCache &get();
+
+  /// Set up the cache for the code compiled by \p TM from the libjit bitcode
+  /// at \p libjitPath, and store the kernels in the object cache
+  /// \p objectCacheDir unless it is empty. The first target machine is the
+  /// one whose code shares the kernels.
+  void init(llvm::TargetMachine &TM, llvm::StringRef libjitPath,
+            llvm::StringRef objectCacheDir);
+
+  /// Compile the specialization \p F with \p TM into a shared kernel, unless
+  /// the same kernel is in the cache already, and turn \p F into the
+  /// declaration of the shared kernel. \returns false if \p F cannot be
+  /// shared, e.g. because it references a mutable global variable, and is
+  /// left unchanged.
+  bool share(llvm::Function *F, llvm::TargetMachine &TM);
+
+  /// \returns the address of the kernel with the mangled name \p name, or 0
+  /// if there is no such kernel.
+  llvm::JITTargetAddress findKernel(const std::string &name);
+};
+
+} // namespace glow
+
+#endif // GLOW_BACKENDS_JIT_KERNELCACHE_H
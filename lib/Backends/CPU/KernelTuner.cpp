@@ -0,0 +1,251 @@
+/**
+ * Copyright (c) 2017-present, Facebook, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "KernelTuner.h"
+#include "CommandLine.h"
+#include "glow/IR/Instrs.h"
+
+#include "llvm/ADT/SmallString.h"
+#include "llvm/ADT/SmallVector.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/MemoryBuffer.h"
+#include "llvm/Support/Path.h"
+#include "llvm/Support/raw_ostream.h"
+
+#include <algorithm>
+
+using namespace glow;
+using llvm::cast;
+using llvm::dyn_cast;
+using llvm::StringRef;
+
+static llvm::cl::opt<std::string> tuningDBPath(
+    "cpu-tuning-db",
+    llvm::cl::desc("The file of the tuning database, which holds the best "
+                   "parameters of the convolution and matrix multiplication "
+                   "kernels for every host CPU and shape. The kernels that "
+                   "are not in the database use the default parameters"),
+    llvm::cl::cat(CPUBackendCat));
+
+static llvm::cl::opt<bool> autotune(
+    "cpu-autotune",
+    llvm::cl::desc("Benchmark the candidate parameters of the convolution and "
+                   "matrix multiplication kernels that are not in the tuning "
+                   "database when the code is compiled for the host, and add "
+                   "the fastest ones to the database"),
+    llvm::cl::init(false), llvm::cl::cat(CPUBackendCat));
+
+bool KernelTuningDB::lookup(const std::string &key,
+                            KernelParams &params) const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  auto it = params_.find(key);
+  if (it == params_.end()) {
+    return false;
+  }
+  params = it->second;
+  return true;
+}
+
+void KernelTuningDB::insert(const std::string &key,
+                            const KernelParams &params) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  params_[key] = params;
+}
+
+bool KernelTuningDB::load(StringRef path) {
+  auto buffer = llvm::MemoryBuffer::getFile(path);
+  if (!buffer) {
+    return false;
+  }
+  llvm::SmallVector<StringRef, 64> lines;
+  (*buffer)->getBuffer().split(lines, '\n', -1, /* KeepEmpty */ false);
+  std::lock_guard<std::mutex> lock(mutex_);
+  for (StringRef line : lines) {
+    line = line.trim();
+    if (line.empty() || line.startswith("#")) {
+      continue;
+    }
+    auto fields = line.split('\t');
+    if (fields.second.empty()) {
+      continue;
+    }
+    llvm::SmallVector<StringRef, 4> values;
+    fields.second.split(values, ',');
+    KernelParams params;
+    for (StringRef value : values) {
+      size_t param;
+      if (value.trim().getAsInteger(10, param)) {
+        params.clear();
+        break;
+      }
+      params.push_back(param);
+    }
+    if (!params.empty()) {
+      params_[fields.first.rtrim()] = params;
+    }
+  }
+  return true;
+}
+
+bool KernelTuningDB::save(StringRef path) const {
+  StringRef dir = llvm::sys::path::parent_path(path);
+  if (!dir.empty() && llvm::sys::fs::create_directories(dir)) {
+    return false;
+  }
+  llvm::SmallString<256> tmpPath(path);
+  tmpPath += "-%%%%%%.tmp";
+  int fd;
+  if (llvm::sys::fs::createUniqueFile(tmpPath, fd, tmpPath)) {
+    return false;
+  }
+  {
+    llvm::raw_fd_ostream tmpFile(fd, /* shouldClose */ true);
+    tmpFile << "# The tuning database of the CPU backend.\n";
+    std::lock_guard<std::mutex> lock(mutex_);
+    for (const auto &entry : params_) {
+      tmpFile << entry.first << '\t';
+      for (size_t i = 0, e = entry.second.size(); i < e; i++) {
+        tmpFile << (i ? "," : "") << entry.second[i];
+      }
+      tmpFile << '\n';
+    }
+    tmpFile.close();
+    if (tmpFile.has_error()) {
+      tmpFile.clear_error();
+      llvm::sys::fs::remove(tmpPath);
+      return false;
+    }
+  }
+  if (llvm::sys::fs::rename(tmpPath, path)) {
+    llvm::sys::fs::remove(tmpPath);
+    return false;
+  }
+  return true;
+}
+
+KernelTuningDB &KernelTuningDB::get() {
+  static KernelTuningDB *db = []() {
+    auto *db = new KernelTuningDB();
+    if (!tuningDBPath.empty()) {
+      db->load(tuningDBPath);
+    }
+    return db;
+  }();
+  return *db;
+}
+
+/// \returns whether \p I is the convolution whose kernel has the tunable
+/// parameters. The quantized and the grouped convolutions have their own
+/// kernels.
+static bool isTunableConvolution(const Instruction *I) {
+  auto *CI = dyn_cast<ConvolutionInst>(I);
+  return CI && CI->getGroup() == 1 &&
+         CI->getSrc()->getElementType() == ElemKind::FloatTy;
+}
+
+/// \returns whether the kernel of \p I is blocked by the matrix multiplication
+/// block sizes.
+static bool isTunableMatMul(const Instruction *I) {
+  switch (I->getKind()) {
+  case Kinded::Kind::MatMulInstKind:
+  case Kinded::Kind::CPUMatMulPackedInstKind:
+  case Kinded::Kind::CPUFullyConnectedPackedInstKind:
+  case Kinded::Kind::CPUWinogradMultiplyInstKind:
+    return true;
+  default:
+    return false;
+  }
+}
+
+std::string glow::getKernelTuningKey(const Instruction *I, StringRef cpu) {
+  if (!isTunableMatMul(I) && !isTunableConvolution(I)) {
+    return "";
+  }
+  std::string key;
+  llvm::raw_string_ostream os(key);
+  os << cpu << ' ' << I->getKindName();
+  for (const auto &op : I->getOperands()) {
+    os << ' ' << op.first->getType()->getElementName() << '<';
+    auto dims = op.first->dims();
+    for (size_t i = 0, e = dims.size(); i < e; i++) {
+      os << (i ? "x" : "") << dims[i];
+    }
+    os << '>';
+  }
+  if (auto *CI = dyn_cast<ConvolutionInst>(I)) {
+    os << " kernel=" << CI->getKernel() << " stride=" << CI->getStride()
+       << " pad=" << CI->getPad();
+  }
+  return os.str();
+}
+
+bool glow::isValidKernelParams(const Instruction *I,
+                               const KernelParams &defaults,
+                               const KernelParams &params) {
+  if (params.size() != defaults.size() ||
+      std::find(params.begin(), params.end(), 0) != params.end()) {
+    return false;
+  }
+  if (isTunableConvolution(I)) {
+    // The kernel computes up to 8 output channels together, and the number
+    // must divide the output channels.
+    size_t unroll = params[0];
+    size_t depth = cast<ConvolutionInst>(I)->getDest()->dims()[3];
+    return unroll <= 8 && (unroll & (unroll - 1)) == 0 && depth % unroll == 0;
+  }
+  return true;
+}
+
+std::vector<KernelParams>
+glow::getKernelTuningCandidates(const Instruction *I,
+                                const KernelParams &defaults) {
+  std::vector<KernelParams> candidates{defaults};
+  auto add = [&](const KernelParams &params) {
+    if (isValidKernelParams(I, defaults, params) &&
+        std::find(candidates.begin(), candidates.end(), params) ==
+            candidates.end()) {
+      candidates.push_back(params);
+    }
+  };
+
+  if (isTunableConvolution(I)) {
+    for (size_t unroll : {8, 4, 1}) {
+      for (size_t cbSize : {128, 256, 512}) {
+        add({unroll, cbSize});
+      }
+    }
+    return candidates;
+  }
+
+  // Scale the block sizes of A and of the micro-panels of B around the
+  // defaults, which are derived from the sizes of the caches.
+  size_t mc = defaults[0], kc = defaults[1], nc = defaults[2];
+  for (size_t mcScale : {2, 4, 8}) {
+    for (size_t kcScale : {2, 4, 8}) {
+      add({mc * mcScale / 4, kc * kcScale / 4, nc});
+    }
+  }
+  add({mc, kc, nc / 2});
+  return candidates;
+}
+
+bool glow::isKernelAutotuningEnabled() { return autotune; }
+
+void glow::saveKernelTuningDB() {
+  if (!tuningDBPath.empty()) {
+    KernelTuningDB::get().save(tuningDBPath);
+  }
+}
@@ -0,0 +1,94 @@
+/**
+ * Copyright (c) 2017-present, Facebook, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#ifndef GLOW_BACKENDS_JIT_KERNELTUNER_H
+#define GLOW_BACKENDS_JIT_KERNELTUNER_H
+
+#include "llvm/ADT/StringRef.h"
+
+#include <map>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace glow {
+
+class Instruction;
+
+/// The values of the tunable parameters of a libjit kernel, which are passed
+/// to the kernel as constant arguments and folded by the specializer:
+/// - The matrix multiplications: the block sizes {mc, kc, nc}.
+/// - The convolution: the number of output channels computed together and
+///   the number of input channels in a block {depthUnroll, cbSize}.
+using KernelParams = std::vector<size_t>;
+
+/// A database of the best parameters of the kernels. The key of an entry is
+/// the host CPU, the kernel and the shape of its operands. The database is
+/// stored in a text file with an entry per line: the key, a tab and the
+/// comma-separated parameters.
+class KernelTuningDB {
+  /// Protects the entries.
+  mutable std::mutex mutex_;
+  /// The parameters, by key.
+  std::map<std::string, KernelParams> params_;
+
+public:
+  /// Look up the parameters of \p key. \returns true and sets \p params if
+  /// they are in the database.
+  bool lookup(const std::string &key, KernelParams &params) const;
+
+  /// Set the parameters of \p key to \p params.
+  void insert(const std::string &key, const KernelParams &params);
+
+  /// Add the entries of the file \p path, which replace the existing entries
+  /// with the same keys. \returns false if the file can't be read. The lines
+  /// that can't be parsed are skipped.
+  bool load(llvm::StringRef path);
+
+  /// Write the entries into the file \p path. The file is replaced
+  /// atomically, so that the processes that tune concurrently never observe a
+  /// partially written file. \returns false if it can't be written.
+  bool save(llvm::StringRef path) const;
+
+  /// \returns the database of the process, which is loaded from the file of
+  /// -cpu-tuning-db, if any, when it is first used.
+  static KernelTuningDB &get();
+};
+
+/// \returns the key of the tuning database for the kernel of \p I on the CPU
+/// \p cpu, or an empty string if the kernel has no tunable parameters.
+std::string getKernelTuningKey(const Instruction *I, llvm::StringRef cpu);
+
+/// \returns whether \p params are valid parameters for the kernel of \p I,
+/// which has the default parameters \p defaults.
+bool isValidKernelParams(const Instruction *I, const KernelParams &defaults,
+                         const KernelParams &params);
+
+/// \returns the parameters to benchmark for the kernel of \p I, starting with
+/// its default parameters \p defaults.
+std::vector<KernelParams>
+getKernelTuningCandidates(const Instruction *I, const KernelParams &defaults);
+
+/// \returns whether the kernels of the host are benchmarked at compile time
+/// (-cpu-autotune).
+bool isKernelAutotuningEnabled();
+
+/// Write the database of the process into the file of -cpu-tuning-db, if
+/// any.
+void saveKernelTuningDB();
+
+} // namespace glow
+
+#endif // GLOW_BACKENDS_JIT_KERNELTUNER_H
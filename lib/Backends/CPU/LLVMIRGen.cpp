@@ -19,14 +19,19 @@
 #include "CommandLine.h"
 
 #include "glow/Graph/Graph.h"
+#include "glow/IR/IRCost.h"
 #include "glow/IR/Instrs.h"
 #include "glow/Quantization/Quantization.h"
+#include "glow/Support/Trace.h"
 
 #include "llvm/ExecutionEngine/ExecutionEngine.h"
 #include "llvm/IR/LegacyPassManager.h"
 #include "llvm/IR/Verifier.h"
 #include "llvm/IRReader/IRReader.h"
+#include "llvm/Config/llvm-config.h"
 #include "llvm/Support/FileSystem.h"
+#include "llvm/Support/Host.h"
+#include "llvm/Support/MemoryBuffer.h"
 #include "llvm/Support/Path.h"
 #include "llvm/Support/SourceMgr.h"
 #include "llvm/Support/TargetSelect.h"
@@ -50,20 +55,59 @@ static llvm::cl::opt<bool>
                llvm::cl::desc("Dump the textual assembly of the jitted code"),
                llvm::cl::init(false), llvm::cl::cat(CPUBackendCat));
 
+static llvm::cl::opt<unsigned> stackedKernelChunkSize(
+    "cpu-stacked-kernel-chunk-size",
+    llvm::cl::desc("The minimal number of elements that a thread of a "
+                   "multi-threaded stacked kernel processes. Stacked kernels "
+                   "with fewer elements per thread run on fewer threads, "
+                   "small kernels on a single thread. 0 disables the "
+                   "multi-threading of stacked kernels"),
+    llvm::cl::init(1 << 16), llvm::cl::cat(CPUBackendCat));
+
+static llvm::cl::opt<bool> profileKernels(
+    "cpu-profile",
+    llvm::cl::desc("Measure the wall-clock time of every kernel of the "
+                   "jitted code or bundle. The jitted code reports it through "
+                   "ExecutionEngine::dumpProfile, a bundle through the "
+                   "<bundle>_dump_profile function"),
+    llvm::cl::init(false), llvm::cl::cat(CPUBackendCat));
+
+/// \returns whether the kernels measure their time, for the profile or for the
+/// timeline of the kernels when tracing is enabled.
+static bool instrumentKernels() { return profileKernels || isTraceEnabled(); }
+
+static llvm::cl::opt<bool> dynamicBatch(
+    "cpu-dynamic-batch",
+    llvm::cl::desc("Read the batch size at run time, so that the code "
+                   "compiled for a batch can compute fewer samples set by "
+                   "ExecutionEngine::setBatchSize. The batch must be the "
+                   "first dimension of all of the inputs and outputs"),
+    llvm::cl::init(false), llvm::cl::cat(CPUBackendCat));
+
+extern llvm::cl::opt<bool> jitSpecializeDims;
+
 llvm::cl::opt<bool>
     emitDebugInfo("g", llvm::cl::desc("Emit debug information for debuggers"),
                   llvm::cl::init(false), llvm::cl::cat(CPUBackendCat));
 
-/// Generate the LLVM MAttr list of attributes.
-static llvm::SmallVector<std::string, 0> getMachineAttributes() {
+static llvm::cl::opt<bool> avx512(
+    "cpu-avx512",
+    llvm::cl::desc("Generate AVX-512 code and link in the AVX-512 variant of "
+                   "libjit when the host supports it"),
+    llvm::cl::init(true), llvm::cl::cat(CPUBackendCat));
+
+/// Generate the LLVM MAttr list of attributes. The avx512 attributes are kept
+/// only if \p keepAVX512 is set.
+static llvm::SmallVector<std::string, 0>
+getMachineAttributes(bool keepAVX512) {
   llvm::SmallVector<std::string, 0> result;
   llvm::StringMap<bool> hostFeatures;
   if (llvm::sys::getHostCPUFeatures(hostFeatures)) {
     for (auto &feature : hostFeatures) {
       if (feature.second) {
         llvm::StringRef fn = feature.first();
-        // Skip avx512 because LLVM does not support it well.
-        if (fn.startswith("avx512")) {
+        // Skip avx512 unless the AVX-512 variant of libjit is linked in.
+        if (fn.startswith("avx512") && !keepAVX512) {
           continue;
         }
         result.push_back(fn);
@@ -74,10 +118,11 @@ static llvm::SmallVector<std::string, 0> getMachineAttributes() {
 }
 
 /// Returns the CPU hostname.
-static llvm::StringRef getHostCpuName() {
+static llvm::StringRef getHostCpuName(bool keepAVX512) {
   auto cpu_name = llvm::sys::getHostCPUName();
-  // Skip avx512 because LLVM does not support it well.
-  cpu_name.consume_back("-avx512");
+  if (!keepAVX512) {
+    cpu_name.consume_back("-avx512");
+  }
   return cpu_name;
 }
 
@@ -91,16 +136,31 @@ void LLVMIRGen::initTargetMachine(StringRef T,
   llvm::InitializeAllTargetMCs();
   llvm::InitializeAllAsmPrinters();
 
-  if (T.empty())
+  if (T.empty()) {
+    bool keepAVX512 = useHostAVX512();
     TM_.reset(llvm::EngineBuilder().setCodeModel(codeModel).selectTarget(
-        llvm::Triple(), "", getHostCpuName(), getMachineAttributes()));
-  else
+        llvm::Triple(), "", getHostCpuName(keepAVX512),
+        getMachineAttributes(keepAVX512)));
+  } else {
     TM_.reset(llvm::EngineBuilder().setCodeModel(codeModel).selectTarget(
         llvm::Triple(T), "", "", llvm::SmallVector<std::string, 0>()));
+  }
+}
+
+void LLVMIRGen::initTargetMachine(
+    StringRef T, StringRef cpu,
+    const llvm::SmallVectorImpl<std::string> &features,
+    llvm::CodeModel::Model codeModel) {
+  llvm::InitializeAllTargets();
+  llvm::InitializeAllTargetMCs();
+  llvm::InitializeAllAsmPrinters();
+
+  TM_.reset(llvm::EngineBuilder().setCodeModel(codeModel).selectTarget(
+      llvm::Triple(T), "", cpu, features));
 }
 
 std::string LLVMIRGen::getMainEntryName() const {
-  StringRef name = mainEntryName_.empty() ? "main" : F_->getGraph()->getName();
+  StringRef name = mainEntryName_.empty() ? "main" : mainEntryName_;
   auto delimPos = name.rfind('/');
   if (delimPos != StringRef::npos)
     name = name.substr(delimPos + 1);
@@ -126,37 +186,95 @@ void LLVMIRGen::loadBaseAddresses(llvm::IRBuilder<> &builder) {
   offsetsArray_ = F->args().begin() + 3;
 }
 
-// Search for the standard library bitcode file on disk and load it into an
-// LLVM module. We search for the standard library around the current executable
-// and also in the current directory.
-static std::unique_ptr<llvm::Module> loadStandardLibrary(llvm::LLVMContext *ctx,
-                                                         StringRef filename) {
+// Search for the standard library bitcode file on disk. We search for the
+// standard library around the current executable and also in the current
+// directory. \returns the path of the library.
+static std::string findStandardLibrary(StringRef filename) {
   using llvm::sys::path::append;
   using llvm::sys::path::parent_path;
 
-  llvm::SMDiagnostic Err;
   auto mainExec =
-      llvm::sys::fs::getMainExecutable(nullptr, (void *)&loadStandardLibrary);
+      llvm::sys::fs::getMainExecutable(nullptr, (void *)&findStandardLibrary);
   StringRef basePath = parent_path(mainExec);
 
   for (int i = 0; i < 3; i++) {
     llvm::SmallString<256> libPath(basePath);
     append(libPath, filename);
     if (llvm::sys::fs::exists(libPath)) {
-      return llvm::parseIRFile(libPath, Err, *ctx);
+      return libPath.str();
     }
 
     basePath = parent_path(basePath);
   }
 
-  return llvm::parseIRFile(filename, Err, *ctx);
+  return filename;
+}
+
+bool LLVMIRGen::useHostAVX512() {
+  static const bool hostAVX512 = [] {
+    llvm::StringMap<bool> hostFeatures;
+    if (!llvm::sys::getHostCPUFeatures(hostFeatures)) {
+      return false;
+    }
+    for (const char *feature : {"avx512f", "avx512bw", "avx512dq", "avx512vl",
+                                "fma"}) {
+      if (!hostFeatures.lookup(feature)) {
+        return false;
+      }
+    }
+    return llvm::sys::fs::exists(findStandardLibrary("libjit_avx512.bc"));
+  }();
+  return avx512 && hostAVX512;
+}
+
+/// \returns the name of the standard library bitcode file for the target of
+/// \p TM. The default libjit.bc is built for the host, so a target with a
+/// different architecture uses the libjit_<arch>.bc variant that is built for
+/// its architecture, when there is one. A host target with AVX-512 uses the
+/// libjit_avx512.bc variant.
+static std::string getStandardLibraryName(const llvm::TargetMachine &TM) {
+  auto arch = TM.getTargetTriple().getArch();
+  if (arch == llvm::Triple(llvm::sys::getProcessTriple()).getArch()) {
+    if (TM.getTargetFeatureString().find("+avx512f") != StringRef::npos &&
+        llvm::sys::fs::exists(findStandardLibrary("libjit_avx512.bc"))) {
+      return "libjit_avx512.bc";
+    }
+    return "libjit.bc";
+  }
+  std::string variant =
+      ("libjit_" + llvm::Triple::getArchTypeName(arch) + ".bc").str();
+  if (llvm::sys::fs::exists(findStandardLibrary(variant))) {
+    return variant;
+  }
+  return "libjit.bc";
+}
+
+std::string LLVMIRGen::getStandardLibraryPath() const {
+  return findStandardLibrary(getStandardLibraryName(*TM_));
+}
+
+// Load the standard library bitcode file into an LLVM module.
+static std::unique_ptr<llvm::Module> loadStandardLibrary(llvm::LLVMContext *ctx,
+                                                         StringRef filename) {
+  llvm::SMDiagnostic Err;
+  return llvm::parseIRFile(findStandardLibrary(filename), Err, *ctx);
 }
 
 void LLVMIRGen::initCodeGen() {
   instrNumbering_.reset(new InstructionNumbering(*F_));
   // Load the jit library as a new module.
-  llmodule_ = loadStandardLibrary(&ctx_, "libjit.bc");
+  llmodule_ =
+      loadStandardLibrary(&ctx_, getStandardLibraryName(getTargetMachine()));
   GLOW_ASSERT(llmodule_.get() && "Unable to load the JIT library.");
+  libjitKernels_.clear();
+  if (!definesRuntime_) {
+    // Call the single pool of threads of the process or of the bundle.
+    for (auto &F : *llmodule_) {
+      if (F.getName().startswith("glow_parallel_")) {
+        F.deleteBody();
+      }
+    }
+  }
 
   // Assign the target information to the module.
   llmodule_->setDataLayout(getTargetMachine().createDataLayout());
@@ -187,10 +305,16 @@ llvm::Type *LLVMIRGen::getElementType(llvm::IRBuilder<> &builder, Value *val) {
   switch (val->getElementType()) {
   case ElemKind::IndexTy:
     return builder.getIntNTy(sizeof(size_t) * 8);
+  case ElemKind::Int32ITy:
+    return builder.getInt32Ty();
   case ElemKind::FloatTy:
     return builder.getFloatTy();
+  case ElemKind::Float16Ty:
+    return builder.getHalfTy();
   case ElemKind::Int8QTy:
     return builder.getInt8Ty();
+  case ElemKind::Int16QTy:
+    return builder.getInt16Ty();
   case ElemKind::Int32QTy:
     return builder.getInt32Ty();
   }
@@ -201,7 +325,10 @@ void LLVMIRGen::performCodeGen() {
   auto *func = builder_->GetInsertBlock()->getParent();
   loadBaseAddresses(*builder_);
 
-  generateLLVMIRForModule(*builder_);
+  {
+    TraceScope trace("LLVM IRGen", TraceCompile);
+    generateLLVMIRForModule(*builder_);
+  }
 
   // Terminate the function.
   builder_->CreateRetVoid();
@@ -224,7 +351,10 @@ void LLVMIRGen::performCodeGen() {
   }
 
   // Optimize the module.
-  optimizeLLVMModule(func, getTargetMachine());
+  {
+    TraceScope trace("LLVM opt", TraceCompile);
+    optimizeLLVMModule(func, getTargetMachine());
+  }
 
   // Generate debug information.
   generateDebugInfo();
@@ -247,8 +377,97 @@ void LLVMIRGen::performCodeGen() {
   }
 }
 
+void LLVMIRGen::hashCodeGenInputs(llvm::MD5 &hash) {
+  auto hashSize = [&hash](size_t val) {
+    hash.update(llvm::ArrayRef<uint8_t>(reinterpret_cast<uint8_t *>(&val),
+                                        sizeof(val)));
+  };
+  // The string fields are separated by the null character, which they cannot
+  // contain.
+  auto hashString = [&hash](llvm::StringRef str) {
+    hash.update(str);
+    hash.update(llvm::StringRef("", 1));
+  };
+
+  std::string irText;
+  llvm::raw_string_ostream irStream(irText);
+  F_->dump(irStream);
+  hashString(irStream.str());
+
+  auto &TM = getTargetMachine();
+  hashString(LLVM_VERSION_STRING);
+  hashString(TM.getTargetTriple().str());
+  hashString(TM.getTargetCPU());
+  hashString(TM.getTargetFeatureString());
+  hashSize(TM.getCodeModel());
+
+  auto libjit = llvm::MemoryBuffer::getFile(getStandardLibraryPath());
+  GLOW_ASSERT(libjit && "Unable to read the JIT library.");
+  hashString((*libjit)->getBuffer());
+
+  hashString(getMainEntryName());
+  hashSize(numThreads_);
+  hashSize(gemmBlockSizes_.mc);
+  hashSize(gemmBlockSizes_.kc);
+  hashSize(gemmBlockSizes_.nc);
+  hashSize(stackedKernelChunkSize);
+  hashSize(emitTasks_);
+  hashSize(emitDebugInfo);
+  hashSize(jitSpecializeDims);
+  hashSize(profileKernels);
+  hashSize(isTraceEnabled());
+  hashSize(dynamicBatch);
+  hashSize(fastCompile_);
+  hashSize(shareKernels_);
+  hashSize(embedOffsets_);
+
+  // The tuned parameters of the kernels.
+  if (tuningDB_) {
+    for (const auto *I : F_->getInstrs()) {
+      for (size_t param : getKernelParams(I)) {
+        hashSize(param);
+      }
+    }
+  }
+}
+
+KernelParams LLVMIRGen::getDefaultKernelParams(const Instruction *I) const {
+  if (getKernelTuningKey(I, "").empty()) {
+    return {};
+  }
+  if (auto *CI = dyn_cast<ConvolutionInst>(I)) {
+    // Try to 'block' the convolution on the 'depth' dimension. We will process
+    // this number output slices each iteration.
+    size_t unrollDFactor = (CI->getDest()->dims()[3] % 8) == 0 ? 8 : 1;
+    // The size of the input-channel tile. High channel count allow for SIMD
+    // parallelism but create register pressure. Low channel count reduces the
+    // memory pressure and allows things to fit in cache, but require
+    // additional compute (horizontal add) to sum the values in the block.
+    // This value is a compromise between the two.
+    size_t cbSize = 512;
+    return {unrollDFactor, cbSize};
+  }
+  return {gemmBlockSizes_.mc, gemmBlockSizes_.kc, gemmBlockSizes_.nc};
+}
+
+KernelParams LLVMIRGen::getKernelParams(const Instruction *I) const {
+  KernelParams defaults = getDefaultKernelParams(I);
+  if (!tuningDB_ || defaults.empty()) {
+    return defaults;
+  }
+  KernelParams params;
+  if (!tuningDB_->lookup(getKernelTuningKey(I, TM_->getTargetCPU()), params) ||
+      !isValidKernelParams(I, defaults, params)) {
+    return defaults;
+  }
+  return params;
+}
+
 llvm::Value *LLVMIRGen::emitValueAddress(llvm::IRBuilder<> &builder,
                                          glow::Value *val) {
+  // The views with offsets start inside of their origin.
+  size_t viewOffset =
+      getOriginOffset(val) * val->getType()->getElementSize();
   val = getOrigin(val);
   assert(allocationsInfo_.allocatedAddressed_.count(val) &&
          "Value address was not allocated");
@@ -262,9 +481,18 @@ llvm::Value *LLVMIRGen::emitValueAddress(llvm::IRBuilder<> &builder,
   case ElemKind::Int8QTy:
     T = llvm::Type::getInt8PtrTy(ctx_);
     break;
+  case ElemKind::Int16QTy:
+    T = llvm::Type::getInt16PtrTy(ctx_);
+    break;
+  case ElemKind::Int32QTy:
+    T = llvm::Type::getInt32PtrTy(ctx_);
+    break;
   case ElemKind::IndexTy:
     T = sizeTTy->getPointerTo();
     break;
+  case ElemKind::Int32ITy:
+    T = llvm::Type::getInt32PtrTy(ctx_);
+    break;
   default:
     llvm_unreachable("Unimplemented");
     break;
@@ -289,11 +517,21 @@ llvm::Value *LLVMIRGen::emitValueAddress(llvm::IRBuilder<> &builder,
 
   // Use relative addressing.
   // Get offset.
-  auto valueIdx = llvm::ConstantInt::get(sizeTTy, kindAndValue.second);
-  auto offsetAddr = builder.CreateGEP(sizeTTy, offsetsArray_, valueIdx);
-  auto offsetValue = builder.CreateLoad(sizeTTy, offsetAddr);
+  llvm::Value *offsetValue;
+  if (embedOffsets_ &&
+      kindAndValue.first != AllocationsInfo::ValueKind::MutableWeight) {
+    offsetValue = llvm::ConstantInt::get(
+        sizeTTy, allocationsInfo_.allocatedAddressed_.lookup(val));
+  } else {
+    auto valueIdx = llvm::ConstantInt::get(sizeTTy, kindAndValue.second);
+    auto offsetAddr = builder.CreateGEP(sizeTTy, offsetsArray_, valueIdx);
+    offsetValue = builder.CreateLoad(sizeTTy, offsetAddr);
+  }
   // Add offset to the base address.
   llvm::Value *addr = builder.CreateAdd(baseAddrValue, offsetValue);
+  if (viewOffset) {
+    addr = builder.CreateAdd(addr, llvm::ConstantInt::get(sizeTTy, viewOffset));
+  }
   return builder.CreateIntToPtr(addr, T);
 }
 
@@ -302,13 +540,16 @@ LLVMIRGen::emitConstOffsetsArray(llvm::IRBuilder<> &builder,
                                  const AllocationsInfo &allocationsInfo) {
 
   auto sizeTType = builder.getIntNTy(sizeof(size_t) * 8);
-  std::vector<llvm::Constant *> elems(allocationsInfo.valueNumbers_.size());
+  // The offsets are followed by the batch size.
+  size_t numValues = allocationsInfo.valueNumbers_.size();
+  std::vector<llvm::Constant *> elems(numValues + 1);
   for (auto &I : allocationsInfo.valueNumbers_) {
     auto *V = I.first;
     auto offset = I.second.second;
     elems[offset] = llvm::ConstantInt::get(
         sizeTType, allocationsInfo.allocatedAddressed_.lookup(V));
   }
+  elems[numValues] = llvm::ConstantInt::get(sizeTType, maxBatchSize_);
   auto *arr = llvm::ConstantArray::get(
       llvm::ArrayType::get(sizeTType, elems.size()), elems);
   // Ensure that the same casted global variable is used for the equivalent
@@ -365,7 +606,33 @@ llvm::Value *LLVMIRGen::emitConstArray(llvm::IRBuilder<> &builder,
 llvm::Value *LLVMIRGen::emitValueDims(llvm::IRBuilder<> &builder,
                                       glow::Value *val) {
   auto dims = val->dims();
-  return emitConstArray(builder, dims);
+  if (!emitBatchedDims_ || !batchedValues_.count(val)) {
+    return emitConstArray(builder, dims);
+  }
+
+  // The first dimension of a batched value is the run-time batch size. The
+  // array is allocated in the entry block, so that the loops don't grow the
+  // stack.
+  auto *sizeTTy = builder.getIntNTy(sizeof(size_t) * 8);
+  auto &entryBB = builder.GetInsertBlock()->getParent()->getEntryBlock();
+  llvm::IRBuilder<> allocaBuilder(&entryBB, entryBB.begin());
+  auto *arrTy = llvm::ArrayType::get(sizeTTy, dims.size());
+  auto *arr = allocaBuilder.CreateAlloca(arrTy);
+  builder.CreateStore(emitBatchSize(builder),
+                      builder.CreateConstGEP2_32(arrTy, arr, 0, 0));
+  for (unsigned i = 1, e = dims.size(); i < e; i++) {
+    builder.CreateStore(emitConstSizeT(builder, dims[i]),
+                        builder.CreateConstGEP2_32(arrTy, arr, 0, i));
+  }
+  return builder.CreateConstGEP2_32(arrTy, arr, 0, 0);
+}
+
+llvm::Value *LLVMIRGen::emitBatchSize(llvm::IRBuilder<> &builder) {
+  auto *sizeTTy = builder.getIntNTy(sizeof(size_t) * 8);
+  auto *idx =
+      llvm::ConstantInt::get(sizeTTy, allocationsInfo_.valueNumbers_.size());
+  return builder.CreateLoad(sizeTTy,
+                            builder.CreateGEP(sizeTTy, offsetsArray_, idx));
 }
 
 llvm::Value *LLVMIRGen::emitValueSize(llvm::IRBuilder<> &builder,
@@ -394,16 +661,32 @@ llvm::Value *LLVMIRGen::emitConst(llvm::IRBuilder<> &builder, float val,
   switch (kind) {
   case ElemKind::FloatTy:
     return llvm::ConstantFP::get(llvm::Type::getFloatTy(ctx_), val);
+  case ElemKind::Float16Ty:
+    return llvm::ConstantFP::get(llvm::Type::getHalfTy(ctx_), val);
   case ElemKind::IndexTy:
     return builder.getIntN(sizeof(size_t) * 8, static_cast<size_t>(val));
+  case ElemKind::Int32ITy:
+    return builder.getInt32(static_cast<int32_t>(val));
   case ElemKind::Int8QTy:
     return builder.getInt8(static_cast<int8_t>(val));
+  case ElemKind::Int16QTy:
+    return builder.getInt16(static_cast<int16_t>(val));
   case ElemKind::Int32QTy:
     return builder.getInt32(static_cast<int32_t>(val));
   }
   llvm_unreachable("Unknown element type");
 }
 
+llvm::Value *LLVMIRGen::emitTripCount(llvm::IRBuilder<> &builder,
+                                      llvm::Value *tripCountPtr,
+                                      size_t maxTripCount) {
+  auto *sizeTTy = builder.getIntNTy(sizeof(size_t) * 8);
+  auto *tripCount = builder.CreateLoad(sizeTTy, tripCountPtr);
+  auto *maxCount = emitConstSizeT(builder, maxTripCount);
+  return builder.CreateSelect(builder.CreateICmpULT(tripCount, maxCount),
+                              tripCount, maxCount);
+}
+
 llvm::Value *LLVMIRGen::emitStringConst(llvm::IRBuilder<> &builder,
                                         llvm::StringRef str) {
   llvm::Constant *constStrArray =
@@ -443,6 +726,8 @@ llvm::Function *LLVMIRGen::getFunction(const std::string &name,
     return get("libjit_" + name + "_f");
   case ElemKind::Int8QTy:
     return get("libjit_" + name + "_i8");
+  case ElemKind::Int16QTy:
+    return get("libjit_" + name + "_i16");
   case ElemKind::Int32QTy:
     return get("libjit_" + name + "_i32");
   case ElemKind::IndexTy:
@@ -452,15 +737,48 @@ llvm::Function *LLVMIRGen::getFunction(const std::string &name,
   }
 }
 
+/// \returns the name of the libjit kernel of the instructions of the kind
+/// \p kind, without the prefix and the suffix of the element type, or nullptr
+/// if they have none.
+static const char *getLibjitKernelName(Kinded::Kind kind) {
+  switch (kind) {
+#define DEF_VALUE(CLASS, NAME)
+#define DEF_INSTR(CLASS, NAME)
+#define DEF_BACKEND_SPECIFIC_INSTR(CLASS, NAME)
+#define DEF_LIBJIT_KERNEL(CLASS, KERNEL)                                       \
+  case Kinded::Kind::CLASS##Kind:                                              \
+    return #KERNEL;
+#define DEF_LIBJIT_KERNEL_WITH_IMM(CLASS, KERNEL, IMM)                         \
+  DEF_LIBJIT_KERNEL(CLASS, KERNEL)
+#include "AutoGenInstr.def"
+  default:
+    return nullptr;
+  }
+}
+
+llvm::Function *LLVMIRGen::getLibjitKernel(const Instruction *I,
+                                           ElemKind elemTy) {
+  auto &F = libjitKernels_[{unsigned(I->getKind()), unsigned(elemTy)}];
+  if (!F) {
+    const char *name = getLibjitKernelName(I->getKind());
+    GLOW_ASSERT(name && "The instruction has no libjit kernel");
+    F = getFunction(name, elemTy);
+  }
+  return F;
+}
+
 /// Create LLVM IR for the for loop with a loop count specified by the only
-/// parameter of the enclosing function.
+/// parameter of the enclosing function. The loop index starts at \p initVal,
+/// or at zero if it is not provided.
 /// \returns a pair of basic blocks. The first BB is the BB of the loop body,
 /// the second BB is the loop exit BB.
 static std::pair<llvm::BasicBlock *, llvm::BasicBlock *>
 createLoop(llvm::IRBuilder<> &builder, llvm::LLVMContext &ctx,
-           llvm::Value *numElements) {
+           llvm::Value *numElements, llvm::Value *initVal = nullptr) {
   auto sizeTTy = builder.getIntNTy(sizeof(size_t) * 8);
-  auto *initVal = llvm::ConstantInt::get(sizeTTy, 0);
+  if (!initVal) {
+    initVal = llvm::ConstantInt::get(sizeTTy, 0);
+  }
 
   // Make the new basic block for the loop header. Insert it after current
   // block.
@@ -524,9 +842,364 @@ static llvm::Value *
 emitBufferAddress(llvm::IRBuilder<> &builder, Value *val,
                   llvm::Function *kernel,
                   llvm::DenseMap<Value *, int> &bufferToArgNum) {
+  size_t viewOffset = getOriginOffset(val);
   val = getOrigin(val);
   assert(bufferToArgNum.count(val) && "Buffer should be in the map");
-  return kernel->args().begin() + bufferToArgNum[val];
+  llvm::Value *buffer = kernel->args().begin() + bufferToArgNum[val];
+  if (!viewOffset) {
+    return buffer;
+  }
+  // The views with offsets start inside of their origin.
+  return builder.CreateGEP(
+      buffer->getType()->getPointerElementType(), buffer,
+      builder.getIntN(sizeof(size_t) * 8, viewOffset));
+}
+
+/// Computes the number of elements of \p dims before the dimension
+/// \p channelIdx into \p outer, and after it into \p inner.
+static void getChannelStrides(llvm::ArrayRef<size_t> dims, size_t channelIdx,
+                              size_t &outer, size_t &inner) {
+  outer = 1;
+  inner = 1;
+  for (size_t i = 0; i < channelIdx; i++) {
+    outer *= dims[i];
+  }
+  for (size_t i = channelIdx + 1; i < dims.size(); i++) {
+    inner *= dims[i];
+  }
+}
+
+/// \returns the operand of the instruction \p I that is not read at the
+/// index of the stacked loop, but at a position computed from it, or null.
+/// These instructions broadcast their operand over their result.
+static Value *getGatheredOperand(const Instruction *I) {
+  if (auto *BA = dyn_cast<BatchedAddInst>(I)) {
+    return getOrigin(BA->getSlice());
+  }
+  if (auto *BI = dyn_cast<BroadcastInst>(I)) {
+    return getOrigin(BI->getSrc());
+  }
+  return nullptr;
+}
+
+/// \returns true if the instruction \p I can be emitted as a part of a stacked
+/// kernel. Besides the data parallel instructions, this includes the float
+/// BatchedAdd and Broadcast, which compute the index of their gathered operand
+/// from the loop index.
+static bool isStackable(const Instruction *I) {
+  if (I->isDataParallel()) {
+    return true;
+  }
+  return getGatheredOperand(I) &&
+         I->getOperand(0).first->getElementType() == ElemKind::FloatTy;
+}
+
+/// \returns true if the stackable instruction \p I can be added to the
+/// stacked kernel \p bundle. Every iteration of the stacked loop computes one
+/// element for all of the instructions, so the gathered operands, whose
+/// elements are read by many iterations, must not be written by the kernel.
+static bool canJoinBundle(llvm::ArrayRef<Instruction *> bundle,
+                          Instruction *I) {
+  if (I->getOperand(0).first->size() !=
+      bundle.back()->getOperand(0).first->size()) {
+    return false;
+  }
+  llvm::SmallVector<Instruction *, 32> instrs(bundle.begin(), bundle.end());
+  instrs.push_back(I);
+  // The kernel accesses every buffer at the index of the loop, so the views of
+  // a buffer at different offsets would read the elements of other iterations.
+  llvm::DenseMap<Value *, size_t> offsets;
+  for (const auto *BI : instrs) {
+    for (const auto &Op : BI->getOperands()) {
+      size_t offset = getOriginOffset(Op.first);
+      auto it = offsets.insert({getOrigin(Op.first), offset});
+      if (it.first->second != offset) {
+        return false;
+      }
+    }
+  }
+  for (const auto *GI : instrs) {
+    auto *gathered = getGatheredOperand(GI);
+    if (!gathered) {
+      continue;
+    }
+    for (const auto *WI : instrs) {
+      for (const auto &Op : WI->getOperands()) {
+        if (Op.second != OperandKind::In && getOrigin(Op.first) == gathered) {
+          return false;
+        }
+      }
+    }
+  }
+  return true;
+}
+
+/// \returns true if the instruction \p I is float arithmetic, whose kernel
+/// can read its operands from registers.
+static bool isFusableArithmetic(const Instruction *I) {
+  switch (I->getKind()) {
+  case Kinded::Kind::ElementAddInstKind:
+  case Kinded::Kind::ElementSubInstKind:
+  case Kinded::Kind::ElementMulInstKind:
+  case Kinded::Kind::ElementDivInstKind:
+  case Kinded::Kind::ElementMaxInstKind:
+  case Kinded::Kind::ElementMinInstKind:
+    return I->getOperand(0).first->getElementType() == ElemKind::FloatTy;
+  default:
+    return false;
+  }
+}
+
+/// Collects into \p uses the uses of the buffer \p buf, also through its
+/// tensor views.
+static void getBufferUses(Value *buf, llvm::SmallVectorImpl<Use> &uses) {
+  for (const auto &U : buf->getUsers()) {
+    if (auto *TV = dyn_cast<TensorViewInst>(U.get())) {
+      getBufferUses(TV, uses);
+      continue;
+    }
+    uses.push_back(U);
+  }
+}
+
+/// Finds the broadcasts of the stacked kernel \p bundle whose results are
+/// only read by the float arithmetic of the kernel, like the broadcasts of
+/// the lowered batch normalization. They are added to \p fusedElems, and the
+/// reads of their results to \p fusedReads. Such a broadcast passes the
+/// element that it computes from the loop index to the arithmetic in a
+/// register, so that its result is neither stored nor loaded, as if the
+/// arithmetic read the source of the broadcast with strides of 0.
+static void findFusedBroadcasts(
+    llvm::ArrayRef<Instruction *> bundle,
+    llvm::DenseMap<std::pair<const Instruction *, unsigned>,
+                   const BroadcastInst *> &fusedReads,
+    llvm::DenseMap<const BroadcastInst *, llvm::Value *> &fusedElems) {
+  llvm::DenseMap<const Instruction *, size_t> positions;
+  for (size_t i = 0, e = bundle.size(); i < e; i++) {
+    positions[bundle[i]] = i;
+  }
+  for (size_t i = 0, e = bundle.size(); i < e; i++) {
+    auto *BI = dyn_cast<BroadcastInst>(bundle[i]);
+    if (!BI || BI->getDest()->getElementType() != ElemKind::FloatTy ||
+        !isa<AllocActivationInst>(getOrigin(BI->getDest()))) {
+      continue;
+    }
+    llvm::SmallVector<Use, 8> uses;
+    getBufferUses(getOrigin(BI->getDest()), uses);
+
+    // The result of the broadcast lives until the first instruction of the
+    // kernel that overwrites the buffer, and the instructions outside of the
+    // kernel see the other values of the buffer then. Otherwise they must not
+    // use the buffer.
+    size_t end = e;
+    for (const auto &U : uses) {
+      auto it = positions.find(U.get());
+      if (it != positions.end() && it->second > i &&
+          U.getOperand().second != OperandKind::In) {
+        end = std::min(end, it->second);
+      }
+    }
+    bool canFuse = true;
+    llvm::SmallVector<std::pair<const Instruction *, unsigned>, 4> reads;
+    for (const auto &U : uses) {
+      auto *user = U.get();
+      if (user == BI || isa<AllocActivationInst>(user) ||
+          isa<DeallocActivationInst>(user)) {
+        continue;
+      }
+      auto it = positions.find(user);
+      if (it == positions.end()) {
+        canFuse &= end < e;
+        continue;
+      }
+      size_t pos = it->second;
+      if (pos < i || pos > end ||
+          (pos == end && U.getOperand().second != OperandKind::In)) {
+        continue;
+      }
+      if (U.getOperand().second != OperandKind::In ||
+          !isFusableArithmetic(user)) {
+        canFuse = false;
+        continue;
+      }
+      reads.push_back({user, U.idx_});
+    }
+    if (!canFuse) {
+      continue;
+    }
+    fusedElems[BI] = nullptr;
+    for (const auto &read : reads) {
+      fusedReads[read] = BI;
+    }
+  }
+}
+
+/// Computes the dimensions \p destDims and \p srcDims of the destination and
+/// of the source of the broadcast \p BI, with the source dimensions padded by
+/// 1s to the rank of the destination. If \p collapse is true, the dimensions
+/// of size 1 of the destination are dropped, and the neighbouring dimensions
+/// that are both broadcast or both copied are merged. The kernels then see the
+/// common broadcasts of a scalar, of a row, of a column or of the channels of
+/// an image as one or two loops.
+static void getBroadcastDims(const BroadcastInst *BI, bool collapse,
+                             ShapeVector &destDims, ShapeVector &srcDims) {
+  auto dest = BI->getDest()->dims();
+  ShapeVector src(BI->getSrc()->dims().begin(), BI->getSrc()->dims().end());
+  src.insert(src.begin(), BI->getAxis(), 1);
+  src.insert(src.end(), dest.size() - src.size(), 1);
+  if (!collapse) {
+    destDims.assign(dest.begin(), dest.end());
+    srcDims = src;
+    return;
+  }
+  for (size_t i = 0, e = dest.size(); i < e; i++) {
+    if (dest[i] == 1) {
+      continue;
+    }
+    if (!destDims.empty() && (srcDims.back() == 1) == (src[i] == 1)) {
+      destDims.back() *= dest[i];
+      srcDims.back() *= src[i];
+      continue;
+    }
+    destDims.push_back(dest[i]);
+    srcDims.push_back(src[i]);
+  }
+  if (destDims.empty()) {
+    destDims.push_back(1);
+    srcDims.push_back(1);
+  }
+}
+
+/// \returns true if the transpose of a tensor with the dimensions \p dims by
+/// \p shuffle swaps two consecutive groups of dimensions after some leading
+/// dimensions that stay in place, like the 2D transpose and the NCHW <-> NHWC
+/// permutations. The transpose is then a batch of \p batch transposes of
+/// \p rows x \p cols matrices.
+static bool isBatchedTranspose(llvm::ArrayRef<unsigned> shuffle,
+                               llvm::ArrayRef<size_t> dims, size_t &batch,
+                               size_t &rows, size_t &cols) {
+  size_t n = shuffle.size();
+  size_t b = 0;
+  while (b < n && shuffle[b] == b) {
+    b++;
+  }
+  if (b == n) {
+    return false;
+  }
+  // The dimensions that move to position b are the columns.
+  size_t p = shuffle[b];
+  for (size_t i = b; i < n; i++) {
+    size_t expected = i < b + n - p ? p + (i - b) : b + (i - b - (n - p));
+    if (shuffle[i] != expected) {
+      return false;
+    }
+  }
+  batch = rows = cols = 1;
+  for (size_t i = 0; i < n; i++) {
+    (i < b ? batch : i < p ? rows : cols) *= dims[i];
+  }
+  return true;
+}
+
+/// \returns true if the kernel of the instruction \p I reads the number of
+/// samples from the first dimension of its operands, so that it can compute
+/// the first samples of the batch.
+static bool canScaleBatch(const Instruction *I) {
+  switch (I->getKind()) {
+  case Kinded::Kind::MatMulInstKind: {
+    // The first dimension of the transposed operands is not the batch.
+    auto *MM = cast<MatMulInst>(I);
+    return !MM->getTransposeLHS() && !MM->getTransposeRHS();
+  }
+  case Kinded::Kind::CPUMatMulPackedInstKind:
+  case Kinded::Kind::CPUFullyConnectedPackedInstKind:
+  case Kinded::Kind::ConvolutionInstKind:
+  case Kinded::Kind::PoolMaxInstKind:
+  case Kinded::Kind::PoolAvgInstKind:
+  case Kinded::Kind::SoftMaxInstKind:
+  case Kinded::Kind::BatchedAddInstKind:
+    return true;
+  default:
+    return isStackable(I);
+  }
+}
+
+/// \returns the first dimension of the value \p V.
+static size_t getFirstDim(const Value *V) {
+  auto dims = V->dims();
+  return dims.empty() ? 0 : dims[0];
+}
+
+void LLVMIRGen::findBatchedValues() {
+  maxBatchSize_ = 0;
+  batchedValues_.clear();
+  batchedInstrs_.clear();
+  // The loops may read the values before the instructions that write them.
+  if (!dynamicBatch || F_->hasLoops()) {
+    return;
+  }
+
+  // The batch is the first dimension of all of the inputs and outputs.
+  size_t batchSize = 0;
+  for (auto *W : F_->getWeights()) {
+    if (W->getVisibility() != VisibilityKind::Public) {
+      continue;
+    }
+    if (batchSize && getFirstDim(W) != batchSize) {
+      batchedValues_.clear();
+      return;
+    }
+    batchSize = getFirstDim(W);
+    batchedValues_.insert(W);
+  }
+  if (batchSize <= 1) {
+    batchedValues_.clear();
+    return;
+  }
+
+  // An instruction computes the first samples if all of its inputs that have
+  // the batch are batched, and its results are batched then. The others
+  // compute the whole batch, whose first samples are still valid, because
+  // the samples are independent.
+  for (const auto &I : F_->getInstrs()) {
+    if (auto *TV = dyn_cast<TensorViewInst>(I)) {
+      if (batchedValues_.count(TV->getSrc()) && getFirstDim(TV) == batchSize &&
+          getOriginOffset(TV) == 0) {
+        batchedValues_.insert(TV);
+      }
+      continue;
+    }
+    if (!canScaleBatch(I) || getFirstDim(I->getOperand(0).first) != batchSize) {
+      continue;
+    }
+    bool hasBatchedInput = false;
+    bool canScale = true;
+    for (const auto &Op : I->getOperands()) {
+      if (Op.second == OperandKind::Out || getFirstDim(Op.first) != batchSize) {
+        continue;
+      }
+      if (batchedValues_.count(Op.first)) {
+        hasBatchedInput = true;
+      } else {
+        canScale = false;
+      }
+    }
+    if (!canScale || !hasBatchedInput) {
+      continue;
+    }
+    batchedInstrs_.insert(I);
+    for (const auto &Op : I->getOperands()) {
+      if (Op.second == OperandKind::In) {
+        continue;
+      }
+      for (const Value *V : {Op.first, getOrigin(Op.first)}) {
+        if (getFirstDim(V) == batchSize) {
+          batchedValues_.insert(V);
+        }
+      }
+    }
+  }
+  maxBatchSize_ = batchSize;
 }
 
 /// Emit the function that implements a data-parallel kernel and calls it.
@@ -540,6 +1213,9 @@ void LLVMIRGen::emitDataParallelKernel(llvm::IRBuilder<> &builder,
                                        llvm::ArrayRef<Instruction *> bundle) {
   if (bundle.empty())
     return;
+  fusedBroadcastReads_.clear();
+  fusedBroadcastElems_.clear();
+  findFusedBroadcasts(bundle, fusedBroadcastReads_, fusedBroadcastElems_);
   llvm::Type *voidTy = llvm::Type::getVoidTy(ctx_);
   // Types of arguments for the kernel function being generated.
   llvm::SmallVector<llvm::Type *, 32> argTypes;
@@ -561,6 +1237,45 @@ void LLVMIRGen::emitDataParallelKernel(llvm::IRBuilder<> &builder,
     }
   }
 
+  // Large kernels are split into chunks of elements that run on multiple
+  // threads. Every chunk should have at least stackedKernelChunkSize elements.
+  // The chunks are rounded up to whole cache lines, so that the threads don't
+  // write to the same cache lines.
+  size_t numElements = bundle[0]->getOperand(0).first->size();
+  size_t numTasks = 1;
+  size_t chunkSize = numElements;
+  if (numThreads_ > 1 && stackedKernelChunkSize > 0) {
+    numTasks = std::min<size_t>(numThreads_,
+                                numElements / stackedKernelChunkSize);
+  }
+  if (numTasks > 1) {
+    chunkSize = (numElements + numTasks - 1) / numTasks;
+    chunkSize = (chunkSize + 15) / 16 * 16;
+    numTasks = (numElements + chunkSize - 1) / chunkSize;
+  }
+  auto *sizeTTy = builder.getIntNTy(sizeof(size_t) * 8);
+  size_t numBuffers = argTypes.size();
+
+  // The kernel of the batched instructions processes the elements of the
+  // samples of the run-time batch.
+  bool isBatched = maxBatchSize_ > 0;
+  for (const auto I : bundle) {
+    isBatched &= batchedInstrs_.count(I) != 0;
+  }
+  llvm::Value *batchElements = nullptr;
+  if (isBatched) {
+    batchElements = builder.CreateMul(
+        emitBatchSize(builder),
+        emitConstSizeT(builder, numElements / maxBatchSize_));
+  }
+
+  bool hasRange = numTasks > 1 || isBatched;
+  if (hasRange) {
+    // The kernel processes the elements [begin, end).
+    argTypes.push_back(sizeTTy);
+    argTypes.push_back(sizeTTy);
+  }
+
   // Create stacked kernel function type.
   llvm::FunctionType *kernelFuncTy =
       llvm::FunctionType::get(voidTy, argTypes, false);
@@ -569,7 +1284,7 @@ void LLVMIRGen::emitDataParallelKernel(llvm::IRBuilder<> &builder,
                              "libjit_stacked_kernel", llmodule_.get());
   // Mark all kernel function buffer parameters as no-alias, because above
   // we ensured that they are uniqued.
-  for (unsigned paramIdx = 0; paramIdx < bufferToArgNum.size(); ++paramIdx) {
+  for (unsigned paramIdx = 0; paramIdx < numBuffers; ++paramIdx) {
     kernelFunc->addParamAttr(paramIdx, llvm::Attribute::AttrKind::NoAlias);
   }
 
@@ -577,11 +1292,18 @@ void LLVMIRGen::emitDataParallelKernel(llvm::IRBuilder<> &builder,
   llvm::BasicBlock *entryBB =
       llvm::BasicBlock::Create(ctx_, "entry", kernelFunc);
   llvm::IRBuilder<> kernelBuilder(entryBB);
-  // Number of tensor elements.
-  auto *numElements =
-      emitValueSize(kernelBuilder, bundle[0]->getOperand(0).first);
   // Create a loop inside the stacked kernel function being generated.
-  auto loopBBs = createLoop(kernelBuilder, ctx_, numElements);
+  std::pair<llvm::BasicBlock *, llvm::BasicBlock *> loopBBs;
+  if (hasRange) {
+    auto *begin = kernelFunc->args().begin() + numBuffers;
+    auto *end = kernelFunc->args().begin() + numBuffers + 1;
+    loopBBs = createLoop(kernelBuilder, ctx_, end, begin);
+  } else {
+    // Number of tensor elements.
+    auto *numElementsVal =
+        emitValueSize(kernelBuilder, bundle[0]->getOperand(0).first);
+    loopBBs = createLoop(kernelBuilder, ctx_, numElementsVal);
+  }
 
   // Get the index parameter of the loop.
   // This is the PHI node of the BB.
@@ -593,7 +1315,7 @@ void LLVMIRGen::emitDataParallelKernel(llvm::IRBuilder<> &builder,
   // instruction.
   for (auto &BI : bundle) {
     // Name of the stacked operation to be invoked.
-    assert(BI->isDataParallel() && "Data parallel operation is expected");
+    assert(isStackable(BI) && "Data parallel operation is expected");
     generateLLVMIRForDataParallelInstr(kernelBuilder, BI, kernelFunc,
                                        bufferToArgNum, kernelLoopIdx);
   }
@@ -601,97 +1323,507 @@ void LLVMIRGen::emitDataParallelKernel(llvm::IRBuilder<> &builder,
   // Add a return.
   kernelBuilder.CreateRetVoid();
 
-  // Emit a call of the kernel.
-  builder.CreateCall(kernelFunc, buffers);
   generateFunctionDebugInfo(kernelFunc);
+
+  // Emit a call of the kernel.
+  if (numTasks <= 1) {
+    if (isBatched) {
+      buffers.push_back(emitConstSizeT(builder, 0));
+      buffers.push_back(batchElements);
+    }
+    builder.CreateCall(kernelFunc, buffers);
+    return;
+  }
+
+  // Pass the buffers to the chunks through a context on the stack, followed
+  // by the number of the elements of the run-time batch.
+  llvm::SmallVector<llvm::Type *, 32> bufferTypes(
+      argTypes.begin(), argTypes.begin() + numBuffers);
+  llvm::SmallVector<llvm::Type *, 32> contextTypes(bufferTypes);
+  if (isBatched) {
+    contextTypes.push_back(sizeTTy);
+  }
+  auto *contextTy = llvm::StructType::get(ctx_, contextTypes);
+  auto *context = builder.CreateAlloca(contextTy);
+  for (unsigned idx = 0; idx < numBuffers; idx++) {
+    builder.CreateStore(buffers[idx],
+                        builder.CreateStructGEP(contextTy, context, idx));
+  }
+  if (isBatched) {
+    auto *batchElementsPtr =
+        builder.CreateStructGEP(contextTy, context, numBuffers);
+    builder.CreateStore(batchElements, batchElementsPtr);
+  }
+
+  // Emit the task function that runs a single chunk of the kernel:
+  // void task(void *context, size_t task);
+  auto *int8PtrTy = llvm::Type::getInt8PtrTy(ctx_);
+  llvm::FunctionType *taskFuncTy =
+      llvm::FunctionType::get(voidTy, {int8PtrTy, sizeTTy}, false);
+  auto *taskFunc =
+      llvm::Function::Create(taskFuncTy, llvm::Function::InternalLinkage,
+                             "libjit_stacked_kernel_task", llmodule_.get());
+  llvm::IRBuilder<> taskBuilder(
+      llvm::BasicBlock::Create(ctx_, "entry", taskFunc));
+  auto *taskContext = taskBuilder.CreateBitCast(taskFunc->args().begin(),
+                                                contextTy->getPointerTo());
+  llvm::SmallVector<llvm::Value *, 32> args;
+  for (unsigned idx = 0; idx < numBuffers; idx++) {
+    args.push_back(taskBuilder.CreateLoad(
+        bufferTypes[idx],
+        taskBuilder.CreateStructGEP(contextTy, taskContext, idx)));
+  }
+  auto *chunkSizeVal = emitConstSizeT(taskBuilder, chunkSize);
+  llvm::Value *numElementsVal = emitConstSizeT(taskBuilder, numElements);
+  if (isBatched) {
+    numElementsVal = taskBuilder.CreateLoad(
+        sizeTTy, taskBuilder.CreateStructGEP(contextTy, taskContext,
+                                             numBuffers));
+  }
+  auto *begin =
+      taskBuilder.CreateMul(taskFunc->args().begin() + 1, chunkSizeVal);
+  auto *end = taskBuilder.CreateAdd(begin, chunkSizeVal);
+  end = taskBuilder.CreateSelect(
+      taskBuilder.CreateICmpULT(end, numElementsVal), end, numElementsVal);
+  args.push_back(begin);
+  args.push_back(end);
+  if (isBatched) {
+    // The chunks past the run-time batch are empty, and the loop of the
+    // kernel runs at least once.
+    auto *runBB = llvm::BasicBlock::Create(ctx_, "run", taskFunc);
+    auto *doneBB = llvm::BasicBlock::Create(ctx_, "done", taskFunc);
+    taskBuilder.CreateCondBr(taskBuilder.CreateICmpULT(begin, end), runBB,
+                             doneBB);
+    taskBuilder.SetInsertPoint(runBB);
+    taskBuilder.CreateCall(kernelFunc, args);
+    taskBuilder.CreateBr(doneBB);
+    taskBuilder.SetInsertPoint(doneBB);
+  } else {
+    taskBuilder.CreateCall(kernelFunc, args);
+  }
+  taskBuilder.CreateRetVoid();
+  generateFunctionDebugInfo(taskFunc);
+
+  // Run the chunks on multiple threads.
+  auto *F = getFunction("parallel_for");
+  builder.CreateCall(F, {emitConstSizeT(builder, numTasks),
+                         emitConstSizeT(builder, numThreads_), taskFunc,
+                         builder.CreateBitCast(context, int8PtrTy)});
+}
+
+void LLVMIRGen::emitKernel(llvm::IRBuilder<> &builder,
+                           llvm::ArrayRef<Instruction *> instrs) {
+  llvm::Value *start = nullptr;
+  if (instrumentKernels()) {
+    start = builder.CreateCall(getFunction("profile_timestamp"));
+  }
+
+  // A single BatchedAdd or Broadcast is faster with its regular kernel.
+  if (instrs.size() > 1 || instrs[0]->isDataParallel()) {
+    emitDataParallelKernel(builder, instrs);
+  } else {
+    emitBatchedDims_ = batchedInstrs_.count(instrs[0]) != 0;
+    generateLLVMIRForInstr(builder, instrs[0]);
+    emitBatchedDims_ = false;
+  }
+
+  if (!instrumentKernels()) {
+    return;
+  }
+  auto *end = builder.CreateCall(getFunction("profile_timestamp"));
+
+  // Name the kernel after its instructions, which are named after the graph
+  // nodes they were generated from.
+  std::string name = instrs.size() == 1 ? instrs[0]->getKindName() : "stacked";
+  for (size_t i = 0, e = instrs.size(); i < e; i++) {
+    name += (i == 0 ? " " : ", ") + instrs[i]->getName().str();
+  }
+  unsigned idx = profileNames_.size();
+  profileNames_.push_back(name);
+  OpCost cost;
+  for (auto *I : instrs) {
+    cost += getCost(I);
+  }
+  profileCosts_.push_back(cost.flops);
+  profileCosts_.push_back(cost.bytes);
+
+  // Accumulate the time spent in the kernel and the number of its calls. The
+  // bundle entry points may run concurrently, so update the profile
+  // atomically.
+  auto *profileTy = profile_->getValueType();
+  auto *timePtr = builder.CreateConstGEP2_32(profileTy, profile_, 0, 2 * idx);
+  auto *countPtr =
+      builder.CreateConstGEP2_32(profileTy, profile_, 0, 2 * idx + 1);
+  builder.CreateAtomicRMW(llvm::AtomicRMWInst::Add, timePtr,
+                          builder.CreateSub(end, start),
+                          llvm::AtomicOrdering::Monotonic);
+  builder.CreateAtomicRMW(llvm::AtomicRMWInst::Add, countPtr,
+                          builder.getInt64(1),
+                          llvm::AtomicOrdering::Monotonic);
+
+  // Keep the times of the last call for the timeline.
+  auto *traceTy = trace_->getValueType();
+  builder.CreateStore(start, builder.CreateInBoundsGEP(
+                                 traceTy, trace_,
+                                 {builder.getInt32(0), builder.getInt32(idx),
+                                  builder.getInt32(1)}));
+  builder.CreateStore(end, builder.CreateInBoundsGEP(
+                               traceTy, trace_,
+                               {builder.getInt32(0), builder.getInt32(idx),
+                                builder.getInt32(2)}));
+}
+
+void LLVMIRGen::emitProfileDumpFunction() {
+  auto *int64Ty = llvm::Type::getInt64Ty(ctx_);
+  auto *int8PtrTy = llvm::Type::getInt8PtrTy(ctx_);
+  size_t numKernels = profileNames_.size();
+
+  // Replace the placeholder by the profile of the emitted kernels.
+  auto *profileTy = llvm::ArrayType::get(int64Ty, 2 * numKernels);
+  auto *profile = new llvm::GlobalVariable(
+      *llmodule_, profileTy, false, llvm::GlobalValue::InternalLinkage,
+      llvm::ConstantAggregateZero::get(profileTy),
+      getMainEntryName() + "_profile");
+  profile_->replaceAllUsesWith(
+      llvm::ConstantExpr::getBitCast(profile, profile_->getType()));
+  profile_->eraseFromParent();
+  profile_ = nullptr;
+
+  // Replace the placeholder by the trace, which the host reads after the
+  // runs.
+  auto *entryTy = llvm::StructType::get(ctx_, {int8PtrTy, int64Ty, int64Ty});
+  auto *traceTy = llvm::ArrayType::get(entryTy, numKernels + 1);
+  std::vector<llvm::Constant *> entries;
+  auto *zero = llvm::ConstantInt::get(int64Ty, 0);
+  for (const auto &name : profileNames_) {
+    auto *str = llvm::cast<llvm::Constant>(emitStringConst(*builder_, name));
+    entries.push_back(llvm::ConstantStruct::get(
+        entryTy, {llvm::ConstantExpr::getBitCast(str, int8PtrTy), zero, zero}));
+  }
+  entries.push_back(llvm::ConstantAggregateZero::get(entryTy));
+  auto *trace = new llvm::GlobalVariable(
+      *llmodule_, traceTy, false, llvm::GlobalValue::ExternalLinkage,
+      llvm::ConstantArray::get(traceTy, entries),
+      getMainEntryName() + "_trace");
+  trace_->replaceAllUsesWith(
+      llvm::ConstantExpr::getBitCast(trace, trace_->getType()));
+  trace_->eraseFromParent();
+  trace_ = nullptr;
+
+  // The function has the API:
+  // void <entry>_dump_profile();
+  auto *func = llvm::Function::Create(
+      llvm::FunctionType::get(llvm::Type::getVoidTy(ctx_), {}, false),
+      llvm::Function::ExternalLinkage, getMainEntryName() + "_dump_profile",
+      llmodule_.get());
+  llvm::IRBuilder<> builder(llvm::BasicBlock::Create(ctx_, "entry", func));
+  std::vector<llvm::Constant *> names;
+  for (const auto &name : profileNames_) {
+    names.push_back(llvm::cast<llvm::Constant>(emitStringConst(builder, name)));
+  }
+  auto *namesArray = emitConstArray(builder, names, int8PtrTy);
+  std::vector<llvm::Constant *> costs;
+  for (uint64_t cost : profileCosts_) {
+    costs.push_back(llvm::ConstantInt::get(int64Ty, cost));
+  }
+  auto *costsArray = emitConstArray(builder, costs, int64Ty);
+  builder.CreateCall(getFunction("dump_profile"),
+                     {namesArray,
+                      builder.CreateBitCast(profile, int64Ty->getPointerTo()),
+                      costsArray, emitConstSizeT(builder, numKernels)});
+  builder.CreateRetVoid();
+}
+
+void LLVMIRGen::emitTask(llvm::IRBuilder<> &builder,
+                         llvm::ArrayRef<Instruction *> instrs) {
+  if (instrs.empty())
+    return;
+  assert((instrs.size() == 1 || isStackable(instrs[0])) &&
+         "Only data parallel instructions can be stacked");
+
+  // The debug locations of the instructions refer to the main entry, so the
+  // instructions can't be moved into task functions with debug info.
+  if (!emitTasks_ || emitDebugInfo) {
+    emitKernel(builder, instrs);
+    return;
+  }
+
+  // Collect the memory areas accessed by the task.
+  std::vector<MemoryAccess> accesses;
+  for (const auto I : instrs) {
+    for (const auto &Op : I->getOperands()) {
+      auto *buf = getOrigin(Op.first);
+      size_t begin = allocationsInfo_.allocatedAddressed_.lookup(buf);
+      accesses.push_back({allocationsInfo_.valueNumbers_[buf].first, begin,
+                          begin + buf->getSizeInBytes(),
+                          Op.second != OperandKind::In});
+    }
+  }
+
+  // The task depends on every earlier task that writes the memory that it
+  // accesses, or that accesses the memory that it writes. Since the
+  // activations share memory, this includes the anti-dependencies through
+  // reused buffers.
+  LLVMIRTask task;
+  for (unsigned idx = 0, e = taskAccesses_.size(); idx < e; idx++) {
+    bool conflicts = false;
+    for (const auto &A : accesses) {
+      for (const auto &B : taskAccesses_[idx]) {
+        if (A.kind == B.kind && A.begin < B.end && B.begin < A.end &&
+            (A.isWrite || B.isWrite)) {
+          conflicts = true;
+          break;
+        }
+      }
+      if (conflicts)
+        break;
+    }
+    if (conflicts) {
+      task.deps.push_back(idx);
+    }
+  }
+
+  // Emit the task function, unless it belongs to another partition.
+  task.name = getMainEntryName() + "_task" + std::to_string(tasks_.size());
+  if (tasks_.size() % numPartitions_ != partition_) {
+    tasks_.push_back(std::move(task));
+    taskAccesses_.push_back(std::move(accesses));
+    return;
+  }
+  auto int8PtrTy = llvm::Type::getInt8PtrTy(ctx_);
+  auto *sizeTPtrTy =
+      llvm::Type::getIntNTy(ctx_, sizeof(size_t) * 8)->getPointerTo();
+  llvm::FunctionType *taskFuncTy =
+      llvm::FunctionType::get(llvm::Type::getVoidTy(ctx_),
+                              {int8PtrTy, int8PtrTy, int8PtrTy, sizeTPtrTy},
+                              false);
+  auto *taskFunc = llvm::Function::Create(
+      taskFuncTy, llvm::Function::ExternalLinkage, task.name, llmodule_.get());
+  llvm::BasicBlock *entryBB = llvm::BasicBlock::Create(ctx_, "entry", taskFunc);
+  llvm::IRBuilder<> taskBuilder(entryBB);
+
+  // The task function computes the addresses from its own arguments.
+  auto *savedActivationsAddr = baseActivationsAddr_;
+  auto *savedConstantWeightVarsAddr = baseConstantWeightVarsAddr_;
+  auto *savedMutableWeightVarsAddr = baseMutableWeightVarsAddr_;
+  auto *savedOffsetsArray = offsetsArray_;
+  baseConstantWeightVarsAddr_ = taskBuilder.CreatePtrToInt(
+      taskFunc->args().begin(), llvm::Type::getInt64Ty(ctx_));
+  baseMutableWeightVarsAddr_ = taskBuilder.CreatePtrToInt(
+      taskFunc->args().begin() + 1, llvm::Type::getInt64Ty(ctx_));
+  baseActivationsAddr_ = taskBuilder.CreatePtrToInt(
+      taskFunc->args().begin() + 2, llvm::Type::getInt64Ty(ctx_));
+  offsetsArray_ = taskFunc->args().begin() + 3;
+
+  emitKernel(taskBuilder, instrs);
+  taskBuilder.CreateRetVoid();
+
+  baseActivationsAddr_ = savedActivationsAddr;
+  baseConstantWeightVarsAddr_ = savedConstantWeightVarsAddr;
+  baseMutableWeightVarsAddr_ = savedMutableWeightVarsAddr;
+  offsetsArray_ = savedOffsetsArray;
+
+  tasks_.push_back(std::move(task));
+  taskAccesses_.push_back(std::move(accesses));
+}
+
+bool LLVMIRGen::canPartition() const {
+  return !emitDebugInfo && !instrumentKernels() && !F_->hasLoops();
 }
 
 void LLVMIRGen::generateLLVMIRForModule(llvm::IRBuilder<> &builder) {
+  tasks_.clear();
+  taskAccesses_.clear();
+  profileNames_.clear();
+  profileCosts_.clear();
+  findBatchedValues();
+  // The kernels accumulate their profile and their trace into placeholders
+  // until the number of kernels is known.
+  if (instrumentKernels()) {
+    auto *profileTy = llvm::ArrayType::get(builder.getInt64Ty(), 0);
+    profile_ = new llvm::GlobalVariable(*llmodule_, profileTy, false,
+                                        llvm::GlobalValue::InternalLinkage,
+                                        nullptr);
+    auto *entryTy = llvm::StructType::get(
+        ctx_, {builder.getInt8PtrTy(), builder.getInt64Ty(),
+               builder.getInt64Ty()});
+    trace_ = new llvm::GlobalVariable(
+        *llmodule_, llvm::ArrayType::get(entryTy, 0), false,
+        llvm::GlobalValue::InternalLinkage, nullptr);
+  }
+
+  // The tasks run the instructions once each, so the loops are emitted
+  // inline into the main entry.
+  bool emitTasks = emitTasks_;
+  if (F_->hasLoops()) {
+    emitTasks_ = false;
+  }
+
   // Go over the instructions and try to group them into bundles.
   auto &instrs = F_->getInstrs();
 
   // Group instructions into bundles of shape compatible data parallel
-  // instructions and emit them.
+  // instructions and emit them. The bundles can also contain the
+  // instructions that broadcast an operand, like the BatchedAdd of a bias.
   llvm::SmallVector<Instruction *, 32> bundle;
   for (auto I : instrs) {
-    if (!I->isDataParallel()) {
+    // The loops move the insertion point, so they end the current bundle
+    // and are never wrapped into a kernel.
+    if (isa<LoopStartInst>(I) || isa<LoopEndInst>(I)) {
+      emitTask(builder, bundle);
+      bundle.clear();
+      generateLLVMIRForInstr(builder, I);
+      continue;
+    }
+    if (!isStackable(I)) {
       // Ignore memory management instructions as they are handled by the
       // MemoryManager and are NOPs for a JIT.
       if (isa<AllocActivationInst>(I) || isa<DeallocActivationInst>(I) ||
           isa<TensorViewInst>(I))
         continue;
-      emitDataParallelKernel(builder, bundle);
+      emitTask(builder, bundle);
       bundle.clear();
-      generateLLVMIRForInstr(builder, I);
+      emitTask(builder, I);
       continue;
     }
 
     // This is a data parallel instruction.
 
-    // Check if the current instruction is shape compatible with the bundle.
-    bool isShapeCompatible = true;
-    if (!bundle.empty()) {
-      auto val = I->getOperand(0).first;
-      auto bundleVal = bundle.back()->getOperand(0).first;
-      // Check if shapes have the same amount of elements.
-      isShapeCompatible = val->size() == bundleVal->size();
-    }
-
-    // If the instruction is not shape-compatible, emit the kernel for the
-    // current bundle and start a new bundle.
-    if (!isShapeCompatible) {
-      emitDataParallelKernel(builder, bundle);
+    // If the instruction is not shape-compatible with the bundle, or if it
+    // conflicts with the gathered operands of the bundle, emit the kernel for
+    // the current bundle and start a new bundle.
+    if (!bundle.empty() && !canJoinBundle(bundle, I)) {
+      emitTask(builder, bundle);
       bundle.clear();
     }
     // Add a data parallel instruction to the bundle.
     bundle.push_back(I);
   }
 
-  emitDataParallelKernel(builder, bundle);
+  emitTask(builder, bundle);
+  taskAccesses_.clear();
+  emitTasks_ = emitTasks;
+  assert(loops_.empty() && "LoopStart without a LoopEnd");
+
+  if (instrumentKernels()) {
+    emitProfileDumpFunction();
+  }
+}
+
+bool LLVMIRGen::emitLibjitKernelCall(
+    llvm::IRBuilder<> &builder, glow::Instruction *I, llvm::Function *kernel,
+    llvm::DenseMap<Value *, int> &bufferToArgNum, llvm::Value *loopCount) {
+  auto *dest = I->getOperand(0).first;
+  if (dest->getType()->isQuantizedType()) {
+    return false;
+  }
+  // The immediate is converted to the element type of the kernel.
+  llvm::Value *imm = nullptr;
+  switch (I->getKind()) {
+#define DEF_VALUE(CLASS, NAME)
+#define DEF_INSTR(CLASS, NAME)
+#define DEF_BACKEND_SPECIFIC_INSTR(CLASS, NAME)
+#define DEF_LIBJIT_KERNEL(CLASS, KERNEL)                                       \
+  case Kinded::Kind::CLASS##Kind:                                              \
+    break;
+#define DEF_LIBJIT_KERNEL_WITH_IMM(CLASS, KERNEL, IMM)                         \
+  case Kinded::Kind::CLASS##Kind:                                              \
+    imm = emitConst(builder, cast<CLASS>(I)->get##IMM(),                       \
+                    dest->getElementType());                                   \
+    break;
+#include "AutoGenInstr.def"
+  default:
+    return false;
+  }
+
+  auto *F = getLibjitKernel(I, dest->getElementType());
+  auto *elementTy = getElementType(builder, dest);
+  auto *destPtr = emitBufferAddress(builder, dest, kernel, bufferToArgNum);
+  // The input operands follow the destination.
+  llvm::SmallVector<llvm::Value *, 3> ptrs;
+  bool hasFusedOperand = false;
+  for (unsigned i = 1, e = I->getNumOperands(); i < e; i++) {
+    assert(I->getOperand(i).second == OperandKind::In &&
+           "The kernels only read their operands");
+    ptrs.push_back(emitBufferAddress(builder, I->getOperand(i).first, kernel,
+                                     bufferToArgNum));
+    hasFusedOperand |= fusedBroadcastReads_.count({I, i}) != 0;
+  }
+
+  llvm::Value *index = loopCount;
+  if (hasFusedOperand) {
+    // The kernel reads all of its operands at the same index, so they are
+    // passed in slots of one element that are read at the index 0. The
+    // optimizer promotes the slots to registers.
+    llvm::IRBuilder<> entryBuilder(&kernel->getEntryBlock(),
+                                   kernel->getEntryBlock().begin());
+    for (unsigned i = 0, e = ptrs.size(); i < e; i++) {
+      llvm::Value *elem;
+      auto it = fusedBroadcastReads_.find({I, i + 1});
+      if (it != fusedBroadcastReads_.end()) {
+        elem = fusedBroadcastElems_[it->second];
+        assert(elem && "The broadcast is emitted before its readers");
+      } else {
+        elem = builder.CreateLoad(
+            elementTy, builder.CreateGEP(elementTy, ptrs[i], loopCount));
+      }
+      ptrs[i] = entryBuilder.CreateAlloca(elementTy);
+      builder.CreateStore(elem, ptrs[i]);
+    }
+    index = emitConstSizeT(builder, 0);
+  }
+
+  // The kernels take the index and three more arguments, the immediate first
+  // if they have one, and ignore the unused pointers.
+  llvm::SmallVector<llvm::Value *, 4> args{index};
+  if (imm) {
+    args.push_back(imm);
+  }
+  args.append(ptrs.begin(), ptrs.end());
+  auto *pointerNull = llvm::ConstantPointerNull::get(elementTy->getPointerTo());
+  while (args.size() < 4) {
+    args.push_back(pointerNull);
+  }
+  auto *stackedOpCall = builder.CreateCall(F, args);
+  auto *destAddr = builder.CreateGEP(elementTy, destPtr, loopCount,
+                                     "buffer.element.addr");
+  builder.CreateStore(stackedOpCall, destAddr);
+  return true;
 }
 
 void LLVMIRGen::generateLLVMIRForDataParallelInstr(
     llvm::IRBuilder<> &builder, glow::Instruction *I, llvm::Function *kernel,
     llvm::DenseMap<Value *, int> &bufferToArgNum, llvm::Value *loopCount) {
   setCurrentDebugLocation(builder, I);
-  assert(I->isDataParallel() && "Expected a data parallel instruction");
+  assert(isStackable(I) && "Expected a data parallel instruction");
+  // The calls of the kernels of the unquantized element types are emitted
+  // from their bindings in InstrGen. The quantized kernels take the scales
+  // and the offsets of the operands, which are computed below.
+  if (emitLibjitKernelCall(builder, I, kernel, bufferToArgNum, loopCount)) {
+    return;
+  }
   switch (I->getKind()) {
-
-#define ARITHMETIC_UNARY_OP_WITH_IMM_CASE(INST_NAME_, FUN_NAME_, VALUE_)       \
-  case Kinded::Kind::INST_NAME_##InstKind: {                                   \
-    auto *AN = cast<INST_NAME_##Inst>(I);                                      \
-    auto *dest = AN->getDest();                                                \
-    auto *destPtr = emitBufferAddress(builder, dest, kernel, bufferToArgNum);  \
-    auto *elementTy = getElementType(builder, dest);                           \
-    auto value = AN->get##VALUE_();                                            \
-    auto *F = getFunction(FUN_NAME_ "_kernel", dest->getElementType());        \
-    auto *pointerNull =                                                        \
-        llvm::ConstantPointerNull::get(elementTy->getPointerTo());             \
-    if (dest->getType()->isQuantizedType()) {                                  \
-      auto *destTy = dest->getType();                                          \
-      /* Quantize value based on the output type. */                           \
-      /* Perform this early and let jit library to work */                     \
-      /* with quantized number. */                                             \
-      TensorQuantizationParams TQP{destTy->getScale(), destTy->getOffset()};   \
-      auto quantizedValue = quantization::quantize(value, TQP);                \
-      auto *val = emitConstI8(builder, quantizedValue);                        \
-      auto *stackedOpCall =                                                    \
-          builder.CreateCall(F, {loopCount, val, pointerNull, pointerNull});   \
-      auto *destAddr = builder.CreateGEP(elementTy, destPtr, loopCount,        \
-                                         "buffer.element.addr");               \
-      builder.CreateStore(stackedOpCall, destAddr);                            \
-    } else {                                                                   \
-      auto *val = emitConst(builder, value, dest->getElementType());           \
-      auto *stackedOpCall =                                                    \
-          builder.CreateCall(F, {loopCount, val, pointerNull, pointerNull});   \
-      auto *destAddr = builder.CreateGEP(elementTy, destPtr, loopCount,        \
-                                         "buffer.element.addr");               \
-      builder.CreateStore(stackedOpCall, destAddr);                            \
-    }                                                                          \
-    break;                                                                     \
+  case Kinded::Kind::SplatInstKind: {
+    auto *SI = cast<SplatInst>(I);
+    auto *dest = SI->getDest();
+    auto *destTy = dest->getType();
+    auto *destPtr = emitBufferAddress(builder, dest, kernel, bufferToArgNum);
+    auto *elementTy = getElementType(builder, dest);
+    auto *F = getLibjitKernel(I, dest->getElementType());
+    auto *pointerNull =
+        llvm::ConstantPointerNull::get(elementTy->getPointerTo());
+    // Quantize the value based on the output type, so that the jit library
+    // works with the quantized number.
+    TensorQuantizationParams TQP{destTy->getScale(), destTy->getOffset()};
+    auto *val =
+        emitConstI8(builder, quantization::quantize(SI->getValue(), TQP));
+    auto *stackedOpCall =
+        builder.CreateCall(F, {loopCount, val, pointerNull, pointerNull});
+    auto *destAddr = builder.CreateGEP(elementTy, destPtr, loopCount,
+                                       "buffer.element.addr");
+    builder.CreateStore(stackedOpCall, destAddr);
+    break;
   }
-    ARITHMETIC_UNARY_OP_WITH_IMM_CASE(Splat, "splat", Value);
-#undef ARITHMETIC_UNARY_OP_WITH_IMM_CASE
 
   case Kinded::Kind::ElementSelectInstKind: {
     ElementSelectInst *ES = cast<ElementSelectInst>(I);
@@ -703,77 +1835,43 @@ void LLVMIRGen::generateLLVMIRForDataParallelInstr(
     auto *condPtr = emitBufferAddress(builder, cond, kernel, bufferToArgNum);
     auto *lhsPtr = emitBufferAddress(builder, lhs, kernel, bufferToArgNum);
     auto *rhsPtr = emitBufferAddress(builder, rhs, kernel, bufferToArgNum);
-
-    // Need _kernel suffix since these operations are implemented as
-    // "data-parallel" kernels in libjit.
-    auto *F = getFunction("elementselect_kernel", dest->getElementType());
-
-    if (lhs->getType()->isQuantizedType()) {
-      auto *destTy = dest->getType();
-      auto *lhsTy = lhs->getType();
-      auto *rhsTy = rhs->getType();
-
-      auto *destOffset = emitConstI32(builder, destTy->getOffset());
-      auto *lhsOffset = emitConstI32(builder, lhsTy->getOffset());
-      auto *rhsOffset = emitConstI32(builder, rhsTy->getOffset());
-
-      // The selected value will be either lhs = s_l * (i_l - o_l) or
-      // rhs = s_r * (i_r - o_r); the stored result that must be computed is
-      // therefore one of:
-      // (i)  i_d = (s_l / s_d) * (i_l - o_l) + o_d
-      // (ii) i_d = (s_r / s_d) * (i_r - o_r) + o_d
-      float destScale = destTy->getScale();
-      auto lhsScaleParams = quantization::quantizeScaleOffset32To8(
-          lhsTy->getScale() / destScale, lhsTy->getOffset());
-      auto rhsScaleParams = quantization::quantizeScaleOffset32To8(
-          rhsTy->getScale() / destScale, rhsTy->getOffset());
-
-      auto *lhsPre = emitConstI32(builder, lhsScaleParams.pre_);
-      auto *lhsPost = emitConstI32(builder, lhsScaleParams.post_);
-      auto *lhsScale = emitConstI32(builder, lhsScaleParams.scale_);
-      auto *rhsPre = emitConstI32(builder, rhsScaleParams.pre_);
-      auto *rhsPost = emitConstI32(builder, rhsScaleParams.post_);
-      auto *rhsScale = emitConstI32(builder, rhsScaleParams.scale_);
-
-      auto *stackedOpCall = builder.CreateCall(
-          F, {loopCount, condPtr, lhsPtr, rhsPtr, destOffset, lhsOffset,
-              rhsOffset, lhsPre, lhsPost, lhsScale, rhsPre, rhsPost, rhsScale});
-      auto *destAddr = builder.CreateGEP(builder.getInt8Ty(), destPtr,
-                                         loopCount, "buffer.element.addr");
-      builder.CreateStore(stackedOpCall, destAddr);
-    } else {
-      auto *stackedOpCall =
-          builder.CreateCall(F, {loopCount, condPtr, lhsPtr, rhsPtr});
-      auto *destAddr = builder.CreateGEP(builder.getFloatTy(), destPtr,
-                                         loopCount, "buffer.element.addr");
-      builder.CreateStore(stackedOpCall, destAddr);
-    }
+    auto *F = getLibjitKernel(I, dest->getElementType());
+
+    auto *destTy = dest->getType();
+    auto *lhsTy = lhs->getType();
+    auto *rhsTy = rhs->getType();
+
+    auto *destOffset = emitConstI32(builder, destTy->getOffset());
+    auto *lhsOffset = emitConstI32(builder, lhsTy->getOffset());
+    auto *rhsOffset = emitConstI32(builder, rhsTy->getOffset());
+
+    // The selected value will be either lhs = s_l * (i_l - o_l) or
+    // rhs = s_r * (i_r - o_r); the stored result that must be computed is
+    // therefore one of:
+    // (i)  i_d = (s_l / s_d) * (i_l - o_l) + o_d
+    // (ii) i_d = (s_r / s_d) * (i_r - o_r) + o_d
+    float destScale = destTy->getScale();
+    auto lhsScaleParams = quantization::quantizeScaleOffset32To8(
+        lhsTy->getScale() / destScale, lhsTy->getOffset());
+    auto rhsScaleParams = quantization::quantizeScaleOffset32To8(
+        rhsTy->getScale() / destScale, rhsTy->getOffset());
+
+    auto *lhsPre = emitConstI32(builder, lhsScaleParams.pre_);
+    auto *lhsPost = emitConstI32(builder, lhsScaleParams.post_);
+    auto *lhsScale = emitConstI32(builder, lhsScaleParams.scale_);
+    auto *rhsPre = emitConstI32(builder, rhsScaleParams.pre_);
+    auto *rhsPost = emitConstI32(builder, rhsScaleParams.post_);
+    auto *rhsScale = emitConstI32(builder, rhsScaleParams.scale_);
+
+    auto *stackedOpCall = builder.CreateCall(
+        F, {loopCount, condPtr, lhsPtr, rhsPtr, destOffset, lhsOffset,
+            rhsOffset, lhsPre, lhsPost, lhsScale, rhsPre, rhsPost, rhsScale});
+    auto *destAddr = builder.CreateGEP(builder.getInt8Ty(), destPtr,
+                                       loopCount, "buffer.element.addr");
+    builder.CreateStore(stackedOpCall, destAddr);
     break;
   }
 
-#define ARITHMETIC_UNARY_OP_CASE(INST_NAME_, FUN_NAME_)                        \
-  case Kinded::Kind::INST_NAME_##InstKind: {                                   \
-    auto *AN = cast<INST_NAME_##Inst>(I);                                      \
-    auto *dest = AN->getDest();                                                \
-    auto *destPtr = emitBufferAddress(builder, dest, kernel, bufferToArgNum);  \
-    auto *srcPtr =                                                             \
-        emitBufferAddress(builder, AN->getSrc(), kernel, bufferToArgNum);      \
-    auto *F = getFunction(FUN_NAME_ "_kernel", dest->getElementType());        \
-    auto *elementTy = getElementType(builder, dest);                           \
-    auto *pointerNull =                                                        \
-        llvm::ConstantPointerNull::get(elementTy->getPointerTo());             \
-    auto *stackedOpCall =                                                      \
-        builder.CreateCall(F, {loopCount, srcPtr, pointerNull, pointerNull});  \
-    auto *destAddr = builder.CreateGEP(builder.getFloatTy(), destPtr,          \
-                                       loopCount, "buffer.element.addr");      \
-    builder.CreateStore(stackedOpCall, destAddr);                              \
-    break;                                                                     \
-  }
-
-    ARITHMETIC_UNARY_OP_CASE(Sigmoid, "sigmoid");
-    ARITHMETIC_UNARY_OP_CASE(Tanh, "tanh");
-#undef ARITHMETIC_UNARY_OP_CASE
-
   case Kinded::Kind::CopyInstKind: {
     CopyInst *CI = cast<CopyInst>(I);
     auto *dest = CI->getDest();
@@ -791,44 +1889,90 @@ void LLVMIRGen::generateLLVMIRForDataParallelInstr(
     builder.CreateStore(stackedOpCall, destAddr);
     break;
   }
-  case Kinded::Kind::CPUMaxSplatInstKind: {
-    auto *AN = cast<CPUMaxSplatInst>(I);
-    auto *dest = AN->getDest();
-    auto V = AN->getSplatValue();
+  case Kinded::Kind::BatchedAddInstKind: {
+    BatchedAddInst *BA = cast<BatchedAddInst>(I);
+    auto *dest = BA->getDest();
+    auto *destPtr = emitBufferAddress(builder, dest, kernel, bufferToArgNum);
+    auto *batchPtr =
+        emitBufferAddress(builder, BA->getBatch(), kernel, bufferToArgNum);
+    auto *slicePtr =
+        emitBufferAddress(builder, BA->getSlice(), kernel, bufferToArgNum);
+    auto *sliceSize = emitConstSizeT(builder, BA->getSlice()->size());
+    auto *F = getFunction("batchedadd_kernel", dest->getElementType());
+    auto *stackedOpCall =
+        builder.CreateCall(F, {loopCount, batchPtr, slicePtr, sliceSize});
+    auto *destAddr = builder.CreateGEP(getElementType(builder, dest), destPtr,
+                                       loopCount, "buffer.element.addr");
+    builder.CreateStore(stackedOpCall, destAddr);
+    break;
+  }
+  case Kinded::Kind::BroadcastInstKind: {
+    BroadcastInst *BI = cast<BroadcastInst>(I);
+    auto *dest = BI->getDest();
+    auto *src = BI->getSrc();
     auto *destPtr = emitBufferAddress(builder, dest, kernel, bufferToArgNum);
-    auto *lhs = AN->getSrc();
-    auto *lhsPtr = emitBufferAddress(builder, lhs, kernel, bufferToArgNum);
-    auto *F = getFunction("element_maxsplat_kernel", dest->getElementType());
-    auto *elementTy = getElementType(builder, dest);
-    auto *pointerNull =
-        llvm::ConstantPointerNull::get(elementTy->getPointerTo());
+    auto *srcPtr = emitBufferAddress(builder, src, kernel, bufferToArgNum);
 
-    if (lhs->getType()->isQuantizedType()) {
-      // Quantize value from the splat to the {S,O} of the lhs param.
-      TensorQuantizationParams TQP{lhs->getType()->getScale(),
-                                   lhs->getType()->getOffset()};
-      auto quantizedValue = quantization::quantize(V, TQP);
-      auto *val = emitConst(builder, quantizedValue, lhs->getElementType());
-      auto *stackedOpCall =
-          builder.CreateCall(F, {loopCount, val, lhsPtr, pointerNull});
-      auto *destAddr = builder.CreateGEP(builder.getInt8Ty(), destPtr,
-                                         loopCount, "buffer.element.addr");
-      builder.CreateStore(stackedOpCall, destAddr);
+    ShapeVector destDims, srcDims;
+    getBroadcastDims(BI, /* collapse */ true, destDims, srcDims);
+
+    // When a single group of dimensions is copied, the source element is
+    // found with a division by the size of the broadcast dimensions below it
+    // and a remainder, which the constant operands turn into cheap code.
+    size_t numCopied = 0;
+    for (auto d : srcDims) {
+      numCopied += d != 1;
+    }
+    llvm::CallInst *stackedOpCall;
+    if (numCopied <= 1) {
+      size_t inner = 1;
+      for (size_t i = srcDims.size(); i-- > 0 && srcDims[i] == 1;) {
+        inner *= destDims[i];
+      }
+      auto *F = getFunction("broadcast_slice_kernel", dest->getElementType());
+      stackedOpCall = builder.CreateCall(
+          F, {loopCount, srcPtr, emitConstSizeT(builder, inner),
+              emitConstSizeT(builder, src->size())});
     } else {
-      auto *val = emitConst(builder, V, lhs->getElementType());
-      auto *stackedOpCall =
-          builder.CreateCall(F, {loopCount, val, lhsPtr, pointerNull});
-      auto *destAddr = builder.CreateGEP(builder.getFloatTy(), destPtr,
-                                         loopCount, "buffer.element.addr");
-      builder.CreateStore(stackedOpCall, destAddr);
+      auto *F = getFunction("broadcast_kernel", dest->getElementType());
+      stackedOpCall = builder.CreateCall(
+          F, {loopCount, srcPtr, emitConstArray(builder, destDims),
+              emitConstArray(builder, srcDims),
+              emitConstSizeT(builder, destDims.size())});
     }
-
+    auto fused = fusedBroadcastElems_.find(BI);
+    if (fused != fusedBroadcastElems_.end()) {
+      fused->second = stackedOpCall;
+      break;
+    }
+    auto *destAddr = builder.CreateGEP(getElementType(builder, dest), destPtr,
+                                       loopCount, "buffer.element.addr");
+    builder.CreateStore(stackedOpCall, destAddr);
+    break;
+  }
+  case Kinded::Kind::ElementMaxSplatInstKind: {
+    auto *MS = cast<ElementMaxSplatInst>(I);
+    auto *dest = MS->getDest();
+    auto *src = MS->getSrc();
+    auto *srcTy = src->getType();
+    auto *destPtr = emitBufferAddress(builder, dest, kernel, bufferToArgNum);
+    auto *srcPtr = emitBufferAddress(builder, src, kernel, bufferToArgNum);
+    auto *F = getLibjitKernel(I, dest->getElementType());
+    auto *pointerNull =
+        llvm::ConstantPointerNull::get(builder.getInt8Ty()->getPointerTo());
+    // Quantize the value of the splat to the scale of the source.
+    TensorQuantizationParams TQP{srcTy->getScale(), srcTy->getOffset()};
+    auto *val =
+        emitConstI8(builder, quantization::quantize(MS->getSplatValue(), TQP));
+    auto *stackedOpCall =
+        builder.CreateCall(F, {loopCount, val, srcPtr, pointerNull});
+    auto *destAddr = builder.CreateGEP(builder.getInt8Ty(), destPtr,
+                                       loopCount, "buffer.element.addr");
+    builder.CreateStore(stackedOpCall, destAddr);
     break;
   }
 
-#undef ARITHMETIC_UNARY_OP_CASE
-
-#define ARITHMETIC_BINARY_OP_CASE(INST_NAME_, FUN_NAME_)                       \
+#define ARITHMETIC_BINARY_OP_CASE(INST_NAME_)                                  \
   case Kinded::Kind::INST_NAME_##InstKind: {                                   \
     auto *AN = cast<INST_NAME_##Inst>(I);                                      \
     auto *dest = AN->getDest();                                                \
@@ -838,53 +1982,42 @@ void LLVMIRGen::generateLLVMIRForDataParallelInstr(
     auto *lhsPtr = emitBufferAddress(builder, lhs, kernel, bufferToArgNum);    \
     auto *rhsPtr = emitBufferAddress(builder, rhs, kernel, bufferToArgNum);    \
                                                                                \
-    auto *F = getFunction(FUN_NAME_ "_kernel", dest->getElementType());        \
-    auto *elementTy = getElementType(builder, dest);                           \
-    auto *pointerNull =                                                        \
-        llvm::ConstantPointerNull::get(elementTy->getPointerTo());             \
+    auto *F = getLibjitKernel(I, dest->getElementType());                      \
                                                                                \
-    if (lhs->getType()->isQuantizedType()) {                                   \
-      auto *destTy = dest->getType();                                          \
-      auto *lhsTy = lhs->getType();                                            \
-      auto *rhsTy = rhs->getType();                                            \
+    auto *destTy = dest->getType();                                            \
+    auto *lhsTy = lhs->getType();                                              \
+    auto *rhsTy = rhs->getType();                                              \
                                                                                \
-      auto *destOffset = emitConstI32(builder, destTy->getOffset());           \
-      auto *lhsOffset = emitConstI32(builder, lhsTy->getOffset());             \
-      auto *rhsOffset = emitConstI32(builder, rhsTy->getOffset());             \
+    auto *destOffset = emitConstI32(builder, destTy->getOffset());             \
+    auto *lhsOffset = emitConstI32(builder, lhsTy->getOffset());               \
+    auto *rhsOffset = emitConstI32(builder, rhsTy->getOffset());               \
                                                                                \
-      float destScale = destTy->getScale();                                    \
+    float destScale = destTy->getScale();                                      \
                                                                                \
-      auto lhsScaleParams = quantization::quantizeScaleOffset32To8(            \
-          lhsTy->getScale() / destScale, lhsTy->getOffset());                  \
-      auto rhsScaleParams = quantization::quantizeScaleOffset32To8(            \
-          rhsTy->getScale() / destScale, rhsTy->getOffset());                  \
+    auto lhsScaleParams = quantization::quantizeScaleOffset32To8(              \
+        lhsTy->getScale() / destScale, lhsTy->getOffset());                    \
+    auto rhsScaleParams = quantization::quantizeScaleOffset32To8(              \
+        rhsTy->getScale() / destScale, rhsTy->getOffset());                    \
                                                                                \
-      auto *lhsPre = emitConstI32(builder, lhsScaleParams.pre_);               \
-      auto *lhsPost = emitConstI32(builder, lhsScaleParams.post_);             \
-      auto *lhsScale = emitConstI32(builder, lhsScaleParams.scale_);           \
-      auto *rhsPre = emitConstI32(builder, rhsScaleParams.pre_);               \
-      auto *rhsPost = emitConstI32(builder, rhsScaleParams.post_);             \
-      auto *rhsScale = emitConstI32(builder, rhsScaleParams.scale_);           \
+    auto *lhsPre = emitConstI32(builder, lhsScaleParams.pre_);                 \
+    auto *lhsPost = emitConstI32(builder, lhsScaleParams.post_);               \
+    auto *lhsScale = emitConstI32(builder, lhsScaleParams.scale_);             \
+    auto *rhsPre = emitConstI32(builder, rhsScaleParams.pre_);                 \
+    auto *rhsPost = emitConstI32(builder, rhsScaleParams.post_);               \
+    auto *rhsScale = emitConstI32(builder, rhsScaleParams.scale_);             \
                                                                                \
-      auto *stackedOpCall = builder.CreateCall(                                \
-          F, {loopCount, lhsPtr, rhsPtr, destOffset, lhsOffset, rhsOffset,     \
-              lhsPre, lhsPost, lhsScale, rhsPre, rhsPost, rhsScale});          \
-      auto *destAddr = builder.CreateGEP(builder.getInt8Ty(), destPtr,         \
-                                         loopCount, "buffer.element.addr");    \
-      builder.CreateStore(stackedOpCall, destAddr);                            \
-    } else {                                                                   \
-      auto *stackedOpCall =                                                    \
-          builder.CreateCall(F, {loopCount, lhsPtr, rhsPtr, pointerNull});     \
-      auto *destAddr = builder.CreateGEP(builder.getFloatTy(), destPtr,        \
-                                         loopCount, "buffer.element.addr");    \
-      builder.CreateStore(stackedOpCall, destAddr);                            \
-    }                                                                          \
+    auto *stackedOpCall = builder.CreateCall(                                  \
+        F, {loopCount, lhsPtr, rhsPtr, destOffset, lhsOffset, rhsOffset,       \
+            lhsPre, lhsPost, lhsScale, rhsPre, rhsPost, rhsScale});            \
+    auto *destAddr = builder.CreateGEP(builder.getInt8Ty(), destPtr,           \
+                                       loopCount, "buffer.element.addr");      \
+    builder.CreateStore(stackedOpCall, destAddr);                              \
     break;                                                                     \
   }
-    ARITHMETIC_BINARY_OP_CASE(ElementAdd, "element_add");
-    ARITHMETIC_BINARY_OP_CASE(ElementSub, "element_sub");
-    ARITHMETIC_BINARY_OP_CASE(ElementMax, "elementmax");
-    ARITHMETIC_BINARY_OP_CASE(ElementMin, "elementmin");
+    ARITHMETIC_BINARY_OP_CASE(ElementAdd);
+    ARITHMETIC_BINARY_OP_CASE(ElementSub);
+    ARITHMETIC_BINARY_OP_CASE(ElementMax);
+    ARITHMETIC_BINARY_OP_CASE(ElementMin);
 #undef ARITHMETIC_BINARY_OP_CASE
 
   case Kinded::Kind::ElementCmpLTEInstKind: {
@@ -896,44 +2029,31 @@ void LLVMIRGen::generateLLVMIRForDataParallelInstr(
     auto *lhsPtr = emitBufferAddress(builder, lhs, kernel, bufferToArgNum);
     auto *rhsPtr = emitBufferAddress(builder, rhs, kernel, bufferToArgNum);
 
-    // Need _kernel suffix since these operations are implemented as
-    // "data-parallel" kernels in libjit.
-    auto *F = getFunction("element_cmp_lte_kernel", dest->getElementType());
-    auto *elementTy = getElementType(builder, dest);
+    auto *F = getLibjitKernel(I, dest->getElementType());
 
-    if (lhs->getType()->isQuantizedType()) {
-      auto *lhsTy = lhs->getType();
-      auto *rhsTy = rhs->getType();
+    auto *lhsTy = lhs->getType();
+    auto *rhsTy = rhs->getType();
 
-      auto *lhsOffset = emitConstI32(builder, lhsTy->getOffset());
-      auto *rhsOffset = emitConstI32(builder, rhsTy->getOffset());
+    auto *lhsOffset = emitConstI32(builder, lhsTy->getOffset());
+    auto *rhsOffset = emitConstI32(builder, rhsTy->getOffset());
 
-      // We can divide both sides of the comparison by the rhs scale since it is
-      // strictly positive; this saves one rescale within the backend. The
-      // inequalities are:
-      //     s_l * (i_l - o_l) <= s_r * (i_r - o_r)
-      // <=> (s_l / s_r) * (i_l - o_l) <= i_r - o_r
-      float scale = lhsTy->getScale() / rhsTy->getScale();
-      auto scaleParams = quantization::quantizeScaleOffset32To8(scale, 0);
-      auto *cmpPre = emitConstI32(builder, scaleParams.pre_);
-      auto *cmpPost = emitConstI32(builder, scaleParams.post_);
-      auto *cmpScale = emitConstI32(builder, scaleParams.scale_);
-
-      auto *stackedOpCall =
-          builder.CreateCall(F, {loopCount, lhsPtr, rhsPtr, lhsOffset,
-                                 rhsOffset, cmpPre, cmpPost, cmpScale});
-      auto *destAddr = builder.CreateGEP(builder.getInt8Ty(), destPtr,
-                                         loopCount, "buffer.element.addr");
-      builder.CreateStore(stackedOpCall, destAddr);
-    } else {
-      auto *pointerNull =
-          llvm::ConstantPointerNull::get(elementTy->getPointerTo());
-      auto *stackedOpCall =
-          builder.CreateCall(F, {loopCount, lhsPtr, rhsPtr, pointerNull});
-      auto *destAddr = builder.CreateGEP(builder.getFloatTy(), destPtr,
-                                         loopCount, "buffer.element.addr");
-      builder.CreateStore(stackedOpCall, destAddr);
-    }
+    // We can divide both sides of the comparison by the rhs scale since it is
+    // strictly positive; this saves one rescale within the backend. The
+    // inequalities are:
+    //     s_l * (i_l - o_l) <= s_r * (i_r - o_r)
+    // <=> (s_l / s_r) * (i_l - o_l) <= i_r - o_r
+    float scale = lhsTy->getScale() / rhsTy->getScale();
+    auto scaleParams = quantization::quantizeScaleOffset32To8(scale, 0);
+    auto *cmpPre = emitConstI32(builder, scaleParams.pre_);
+    auto *cmpPost = emitConstI32(builder, scaleParams.post_);
+    auto *cmpScale = emitConstI32(builder, scaleParams.scale_);
+
+    auto *stackedOpCall =
+        builder.CreateCall(F, {loopCount, lhsPtr, rhsPtr, lhsOffset,
+                               rhsOffset, cmpPre, cmpPost, cmpScale});
+    auto *destAddr = builder.CreateGEP(builder.getInt8Ty(), destPtr,
+                                       loopCount, "buffer.element.addr");
+    builder.CreateStore(stackedOpCall, destAddr);
     break;
   }
 
@@ -946,44 +2066,31 @@ void LLVMIRGen::generateLLVMIRForDataParallelInstr(
     auto *lhsPtr = emitBufferAddress(builder, lhs, kernel, bufferToArgNum);
     auto *rhsPtr = emitBufferAddress(builder, rhs, kernel, bufferToArgNum);
 
-    // Need _kernel suffix since these operations are implemented as
-    // "data-parallel" kernels in libjit.
-    auto *F = getFunction("element_mul_kernel", dest->getElementType());
-    auto *elementTy = getElementType(builder, dest);
-    auto *pointerNull =
-        llvm::ConstantPointerNull::get(elementTy->getPointerTo());
-
-    if (lhs->getType()->isQuantizedType()) {
-      auto *destTy = dest->getType();
-      auto *lhsTy = lhs->getType();
-      auto *rhsTy = rhs->getType();
-
-      auto *destOffset = emitConstI32(builder, destTy->getOffset());
-      auto *lhsOffset = emitConstI32(builder, lhsTy->getOffset());
-      auto *rhsOffset = emitConstI32(builder, rhsTy->getOffset());
-
-      // The multiplicative scale factor is s_l * s_r / s_d due to the equation
-      //    s_d * (i_d - o_d) = s_l * (i_l - o_l) * s_r * (i_r - o_r)
-      // => i_d = (s_l * s_r / s_d) * (i_l - o_l) * (i_r - o_r) + o_d
-      float scale = lhsTy->getScale() * rhsTy->getScale() / destTy->getScale();
-      auto scaleParams = quantization::quantizeScaleOffset32To8(scale, 0);
-      auto *mulPre = emitConstI32(builder, scaleParams.pre_);
-      auto *mulPost = emitConstI32(builder, scaleParams.post_);
-      auto *mulScale = emitConstI32(builder, scaleParams.scale_);
-
-      auto *stackedOpCall = builder.CreateCall(
-          F, {loopCount, lhsPtr, rhsPtr, destOffset, lhsOffset, rhsOffset,
-              mulPre, mulPost, mulScale});
-      auto *destAddr = builder.CreateGEP(builder.getInt8Ty(), destPtr,
-                                         loopCount, "buffer.element.addr");
-      builder.CreateStore(stackedOpCall, destAddr);
-    } else {
-      auto *stackedOpCall =
-          builder.CreateCall(F, {loopCount, lhsPtr, rhsPtr, pointerNull});
-      auto *destAddr = builder.CreateGEP(builder.getFloatTy(), destPtr,
-                                         loopCount, "buffer.element.addr");
-      builder.CreateStore(stackedOpCall, destAddr);
-    }
+    auto *F = getLibjitKernel(I, dest->getElementType());
+
+    auto *destTy = dest->getType();
+    auto *lhsTy = lhs->getType();
+    auto *rhsTy = rhs->getType();
+
+    auto *destOffset = emitConstI32(builder, destTy->getOffset());
+    auto *lhsOffset = emitConstI32(builder, lhsTy->getOffset());
+    auto *rhsOffset = emitConstI32(builder, rhsTy->getOffset());
+
+    // The multiplicative scale factor is s_l * s_r / s_d due to the equation
+    //    s_d * (i_d - o_d) = s_l * (i_l - o_l) * s_r * (i_r - o_r)
+    // => i_d = (s_l * s_r / s_d) * (i_l - o_l) * (i_r - o_r) + o_d
+    float scale = lhsTy->getScale() * rhsTy->getScale() / destTy->getScale();
+    auto scaleParams = quantization::quantizeScaleOffset32To8(scale, 0);
+    auto *mulPre = emitConstI32(builder, scaleParams.pre_);
+    auto *mulPost = emitConstI32(builder, scaleParams.post_);
+    auto *mulScale = emitConstI32(builder, scaleParams.scale_);
+
+    auto *stackedOpCall = builder.CreateCall(
+        F, {loopCount, lhsPtr, rhsPtr, destOffset, lhsOffset, rhsOffset,
+            mulPre, mulPost, mulScale});
+    auto *destAddr = builder.CreateGEP(builder.getInt8Ty(), destPtr,
+                                       loopCount, "buffer.element.addr");
+    builder.CreateStore(stackedOpCall, destAddr);
     break;
   }
 
@@ -996,71 +2103,34 @@ void LLVMIRGen::generateLLVMIRForDataParallelInstr(
     auto *lhsPtr = emitBufferAddress(builder, lhs, kernel, bufferToArgNum);
     auto *rhsPtr = emitBufferAddress(builder, rhs, kernel, bufferToArgNum);
 
-    // Need _kernel suffix since these operations are implemented as
-    // "data-parallel" kernels in libjit.
-    auto *F = getFunction("element_div_kernel", dest->getElementType());
-    auto *elementTy = getElementType(builder, dest);
-    auto *pointerNull =
-        llvm::ConstantPointerNull::get(elementTy->getPointerTo());
-
-    if (lhs->getType()->isQuantizedType()) {
-      auto *destTy = dest->getType();
-      auto *lhsTy = lhs->getType();
-      auto *rhsTy = rhs->getType();
-
-      auto *destOffset = emitConstI32(builder, destTy->getOffset());
-      auto *lhsOffset = emitConstI32(builder, lhsTy->getOffset());
-      auto *rhsOffset = emitConstI32(builder, rhsTy->getOffset());
-
-      // The division scale factor is s_l / (s_r * s_d) due to the equation
-      //    s_d * (i_d - o_d) = (s_l * (i_l - o_l)) / (s_r * (i_r - o_r))
-      // => i_d = (s_l / (s_r * s_d)) * ((i_l - o_l) / (i_r - o_r)) + o_d
-      float scale =
-          lhsTy->getScale() / (rhsTy->getScale() * destTy->getScale());
-      auto scaleParams = quantization::quantizeScaleOffset32To8(scale, 0);
-      auto *divPre = emitConstI32(builder, scaleParams.pre_);
-      auto *divPost = emitConstI32(builder, scaleParams.post_);
-      auto *divScale = emitConstI32(builder, scaleParams.scale_);
-
-      auto *stackedOpCall = builder.CreateCall(
-          F, {loopCount, lhsPtr, rhsPtr, destOffset, lhsOffset, rhsOffset,
-              divPre, divPost, divScale});
-      auto *destAddr = builder.CreateGEP(builder.getInt8Ty(), destPtr,
-                                         loopCount, "buffer.element.addr");
-      builder.CreateStore(stackedOpCall, destAddr);
-    } else {
-      auto *stackedOpCall =
-          builder.CreateCall(F, {loopCount, lhsPtr, rhsPtr, pointerNull});
-      auto *destAddr = builder.CreateGEP(builder.getFloatTy(), destPtr,
-                                         loopCount, "buffer.element.addr");
-      builder.CreateStore(stackedOpCall, destAddr);
-    }
+    auto *F = getLibjitKernel(I, dest->getElementType());
+
+    auto *destTy = dest->getType();
+    auto *lhsTy = lhs->getType();
+    auto *rhsTy = rhs->getType();
+
+    auto *destOffset = emitConstI32(builder, destTy->getOffset());
+    auto *lhsOffset = emitConstI32(builder, lhsTy->getOffset());
+    auto *rhsOffset = emitConstI32(builder, rhsTy->getOffset());
+
+    // The division scale factor is s_l / (s_r * s_d) due to the equation
+    //    s_d * (i_d - o_d) = (s_l * (i_l - o_l)) / (s_r * (i_r - o_r))
+    // => i_d = (s_l / (s_r * s_d)) * ((i_l - o_l) / (i_r - o_r)) + o_d
+    float scale = lhsTy->getScale() / (rhsTy->getScale() * destTy->getScale());
+    auto scaleParams = quantization::quantizeScaleOffset32To8(scale, 0);
+    auto *divPre = emitConstI32(builder, scaleParams.pre_);
+    auto *divPost = emitConstI32(builder, scaleParams.post_);
+    auto *divScale = emitConstI32(builder, scaleParams.scale_);
+
+    auto *stackedOpCall = builder.CreateCall(
+        F, {loopCount, lhsPtr, rhsPtr, destOffset, lhsOffset, rhsOffset,
+            divPre, divPost, divScale});
+    auto *destAddr = builder.CreateGEP(builder.getInt8Ty(), destPtr,
+                                       loopCount, "buffer.element.addr");
+    builder.CreateStore(stackedOpCall, destAddr);
     break;
   }
 
-#define ARITHMETIC_BINARY_OP_WITH_IMM_CASE(INST_NAME_, FUN_NAME_, SRC_,        \
-                                           VALUE_)                             \
-  case Kinded::Kind::INST_NAME_##InstKind: {                                   \
-    auto *AN = cast<INST_NAME_##Inst>(I);                                      \
-    auto *dest = AN->getDest();                                                \
-    auto *destPtr = emitBufferAddress(builder, dest, kernel, bufferToArgNum);  \
-    auto *val = emitConstF32(builder, AN->get##VALUE_());                      \
-    auto *lhsPtr =                                                             \
-        emitBufferAddress(builder, AN->get##SRC_(), kernel, bufferToArgNum);   \
-    auto *F = getFunction(FUN_NAME_ "_kernel", dest->getElementType());        \
-    auto *elementTy = getElementType(builder, dest);                           \
-    auto *pointerNull =                                                        \
-        llvm::ConstantPointerNull::get(elementTy->getPointerTo());             \
-    auto *stackedOpCall =                                                      \
-        builder.CreateCall(F, {loopCount, val, lhsPtr, pointerNull});          \
-    auto *destAddr = builder.CreateGEP(builder.getFloatTy(), destPtr,          \
-                                       loopCount, "buffer.element.addr");      \
-    builder.CreateStore(stackedOpCall, destAddr);                              \
-    break;                                                                     \
-  }
-    ARITHMETIC_BINARY_OP_WITH_IMM_CASE(ElementPow, "element_pow", Base, Exp);
-#undef ARITHMETIC_BINARY_OP_WITH_IMM_CASE
-
   default:
 #ifndef NDEBUG
     llvm::errs() << "Cannot select the instruction:\n";
@@ -1071,6 +2141,58 @@ void LLVMIRGen::generateLLVMIRForDataParallelInstr(
   }
 }
 
+template <class ConvInstTy>
+void LLVMIRGen::emitConvDKKC8(llvm::IRBuilder<> &builder, ConvInstTy *CI,
+                              glow::Value *residual) {
+  auto *dest = CI->getDest();
+  auto *src = CI->getSrc();
+  auto *filter = CI->getFilter();
+  auto *bias = CI->getBias();
+  auto *destPtr = emitValueAddress(builder, dest);
+  auto *srcPtr = emitValueAddress(builder, src);
+  auto *filterPtr = emitValueAddress(builder, filter);
+  auto *biasPtr = emitValueAddress(builder, bias);
+  // The plain convolution passes a null residual.
+  auto *residualPtr =
+      residual ? emitValueAddress(builder, residual)
+               : llvm::ConstantPointerNull::get(
+                     llvm::cast<llvm::PointerType>(biasPtr->getType()));
+
+  auto *destDims = emitValueDims(builder, dest);
+  auto *srcDims = emitValueDims(builder, src);
+
+  auto *kernel = emitConstSizeT(builder, CI->getKernel());
+  auto *stride = emitConstSizeT(builder, CI->getStride());
+  auto *pad = emitConstSizeT(builder, CI->getPad());
+
+  // The kernel keeps a tile of sizeGroupY output pixels x numDepthRegs groups
+  // of 8 output channels in registers. The accumulators, the filter vectors
+  // of an input channel and a broadcast input fit in the 16 AVX2 registers,
+  // or in the 32 NEON registers, which hold half as many floats. The filter
+  // in groups of 16 channels is for the 32 AVX-512 registers.
+  unsigned groupWidth = filter->dims()[4];
+  unsigned numDepthRegs = (dest->dims()[3] % (2 * groupWidth)) == 0 ? 2 : 1;
+  unsigned sizeGroupY = numDepthRegs == 2 ? 6 : 8;
+  if (groupWidth == 16) {
+    sizeGroupY = numDepthRegs == 2 ? 12 : 16;
+  }
+  // The tile is no wider than the rows of the output.
+  sizeGroupY = std::min<size_t>(sizeGroupY, dest->dims()[2]);
+
+  auto *numDepthRegsVal = emitConstI32(builder, numDepthRegs);
+  auto *sizeGroupYVal = emitConstI32(builder, sizeGroupY);
+  auto *activation = emitConstI32(builder, CI->getActivation());
+  auto *activationParam = emitConstF32(builder, CI->getActivationParam());
+
+  const char *kernelName = groupWidth == 16 ? "convDKKC16" : "convDKKC8";
+  auto *F = getFunction(kernelName, dest->getElementType());
+
+  builder.CreateCall(F, {destPtr, srcPtr, filterPtr, biasPtr, residualPtr,
+                         destDims, srcDims, kernel, stride, pad,
+                         numDepthRegsVal, sizeGroupYVal, activation,
+                         activationParam});
+}
+
 void LLVMIRGen::generateLLVMIRForInstr(llvm::IRBuilder<> &builder,
                                        glow::Instruction *I) {
   setCurrentDebugLocation(builder, I);
@@ -1090,31 +2212,154 @@ void LLVMIRGen::generateLLVMIRForInstr(llvm::IRBuilder<> &builder,
     auto *lhsDims = emitValueDims(builder, lhs);
     auto *rhsDims = emitValueDims(builder, rhs);
 
-    auto *F = getFunction("matmul", dest->getElementType());
+    auto *blocking = emitConstArray(builder, getKernelParams(I));
+    auto *numThreads = emitConstSizeT(builder, numThreads_);
+
+    // The int16 activations are multiplied by the int8 rhs into the int32
+    // accumulator.
+    if (lhs->getElementType() == ElemKind::Int16QTy) {
+      auto *lhsOffset = emitConstI32(builder, lhs->getType()->getOffset());
+      auto *rhsOffset = emitConstI32(builder, rhs->getType()->getOffset());
+      auto *F = getFunction("matmul_i16_i8");
+      builder.CreateCall(F, {destPtr, lhsPtr, rhsPtr, destDims, lhsDims,
+                             rhsDims, lhsOffset, rhsOffset, blocking,
+                             numThreads});
+      break;
+    }
+
+    auto *F = getFunction("matmul", dest->getElementType());
+
+    if (lhs->getType()->isQuantizedType()) {
+      auto *destTy = dest->getType();
+      auto *lhsTy = lhs->getType();
+      auto *rhsTy = rhs->getType();
+
+      auto *destOffset = emitConstI32(builder, destTy->getOffset());
+      auto *lhsOffset = emitConstI32(builder, lhsTy->getOffset());
+      auto *rhsOffset = emitConstI32(builder, rhsTy->getOffset());
+
+      auto outScaleParams = quantization::quantizeScaleOffset32To8(
+          lhsTy->getScale() * rhsTy->getScale() / destTy->getScale(), 0);
+
+      auto *outPre = emitConstI32(builder, outScaleParams.pre_);
+      auto *outPost = emitConstI32(builder, outScaleParams.post_);
+      auto *outScale = emitConstI32(builder, outScaleParams.scale_);
+
+      builder.CreateCall(F, {destPtr, lhsPtr, rhsPtr, destDims, lhsDims,
+                             rhsDims, destOffset, lhsOffset, rhsOffset, outPre,
+                             outPost, outScale, blocking, numThreads});
+    } else {
+      auto *transposeLHS = emitConstI32(builder, MM->getTransposeLHS());
+      auto *transposeRHS = emitConstI32(builder, MM->getTransposeRHS());
+      builder.CreateCall(F, {destPtr, lhsPtr, rhsPtr, destDims, lhsDims,
+                             rhsDims, blocking, numThreads, transposeLHS,
+                             transposeRHS});
+    }
+    break;
+  }
+
+  case Kinded::Kind::ChannelwiseQuantizedFullyConnectedInstKind: {
+    auto *FC = cast<ChannelwiseQuantizedFullyConnectedInst>(I);
+    auto *dest = FC->getDest();
+    auto *src = FC->getSrc();
+    auto *weights = FC->getWeights();
+    auto *destPtr = emitValueAddress(builder, dest);
+    auto *srcPtr = emitValueAddress(builder, src);
+    auto *weightsPtr = emitValueAddress(builder, weights);
+    auto *biasPtr = emitValueAddress(builder, FC->getBias());
+    auto *scalesPtr = emitValueAddress(builder, FC->getWeightScales());
+    auto *offsetsPtr = emitValueAddress(builder, FC->getWeightOffsets());
+
+    auto *destDims = emitValueDims(builder, dest);
+    auto *srcDims = emitValueDims(builder, src);
+    auto *weightsDims = emitValueDims(builder, weights);
+
+    auto *destTy = dest->getType();
+    auto *srcTy = src->getType();
+    auto *destOffset = emitConstI32(builder, destTy->getOffset());
+    auto *srcOffset = emitConstI32(builder, srcTy->getOffset());
+    auto *srcScale = emitConstF32(builder, srcTy->getScale());
+    auto *destScale = emitConstF32(builder, destTy->getScale());
+
+    // The layer is computed on the int8 GEMM, with its default blocking.
+    auto *blocking = emitConstArray(
+        builder, {gemmBlockSizes_.mc, gemmBlockSizes_.kc, gemmBlockSizes_.nc});
+    auto *numThreads = emitConstSizeT(builder, numThreads_);
+
+    auto *F = getFunction("channelwise_fc_i8");
+    builder.CreateCall(F, {destPtr, srcPtr, weightsPtr, biasPtr, scalesPtr,
+                           offsetsPtr, destDims, srcDims, weightsDims,
+                           destOffset, srcOffset, srcScale, destScale,
+                           blocking, numThreads});
+    break;
+  }
+
+  case Kinded::Kind::SparseFullyConnectedInstKind: {
+    auto *FC = cast<SparseFullyConnectedInst>(I);
+    auto *dest = FC->getDest();
+    auto *src = FC->getSrc();
+    auto *destPtr = emitValueAddress(builder, dest);
+    auto *srcPtr = emitValueAddress(builder, src);
+    auto *valuesPtr = emitValueAddress(builder, FC->getValues());
+    auto *indicesPtr = emitValueAddress(builder, FC->getIndices());
+    auto *offsetsPtr = emitValueAddress(builder, FC->getOffsets());
+    auto *biasPtr = emitValueAddress(builder, FC->getBias());
+
+    auto *destDims = emitValueDims(builder, dest);
+    auto *srcDims = emitValueDims(builder, src);
+    auto *numThreads = emitConstSizeT(builder, numThreads_);
+
+    auto *F = getFunction("sparse_fc", dest->getElementType());
+    builder.CreateCall(F, {destPtr, srcPtr, valuesPtr, indicesPtr, offsetsPtr,
+                           biasPtr, destDims, srcDims, numThreads});
+    break;
+  }
+
+  case Kinded::Kind::CPUMatMulPackedInstKind: {
+    CPUMatMulPackedInst *MM = cast<CPUMatMulPackedInst>(I);
+    auto *dest = MM->getDest();
+    auto *lhs = MM->getLHS();
+    auto *rhs = MM->getRHS();
+    auto *destPtr = emitValueAddress(builder, dest);
+    auto *lhsPtr = emitValueAddress(builder, lhs);
+    auto *rhsPtr = emitValueAddress(builder, rhs);
+
+    auto *destDims = emitValueDims(builder, dest);
+    auto *lhsDims = emitValueDims(builder, lhs);
+    auto *rhsDims = emitValueDims(builder, rhs);
+
+    auto *blocking = emitConstArray(builder, getKernelParams(I));
+    auto *numThreads = emitConstSizeT(builder, numThreads_);
 
-    if (lhs->getType()->isQuantizedType()) {
-      auto *destTy = dest->getType();
-      auto *lhsTy = lhs->getType();
-      auto *rhsTy = rhs->getType();
+    auto *F = getFunction("matmul_packed", dest->getElementType());
+    builder.CreateCall(F, {destPtr, lhsPtr, rhsPtr, destDims, lhsDims, rhsDims,
+                           blocking, numThreads});
+    break;
+  }
 
-      auto *destOffset = emitConstI32(builder, destTy->getOffset());
-      auto *lhsOffset = emitConstI32(builder, lhsTy->getOffset());
-      auto *rhsOffset = emitConstI32(builder, rhsTy->getOffset());
+  case Kinded::Kind::CPUFullyConnectedPackedInstKind: {
+    CPUFullyConnectedPackedInst *FC = cast<CPUFullyConnectedPackedInst>(I);
+    auto *dest = FC->getDest();
+    auto *lhs = FC->getLHS();
+    auto *rhs = FC->getRHS();
+    auto *destPtr = emitValueAddress(builder, dest);
+    auto *lhsPtr = emitValueAddress(builder, lhs);
+    auto *rhsPtr = emitValueAddress(builder, rhs);
+    auto *biasPtr = emitValueAddress(builder, FC->getBias());
 
-      auto outScaleParams = quantization::quantizeScaleOffset32To8(
-          lhsTy->getScale() * rhsTy->getScale() / destTy->getScale(), 0);
+    auto *destDims = emitValueDims(builder, dest);
+    auto *lhsDims = emitValueDims(builder, lhs);
+    auto *rhsDims = emitValueDims(builder, rhs);
 
-      auto *outPre = emitConstI32(builder, outScaleParams.pre_);
-      auto *outPost = emitConstI32(builder, outScaleParams.post_);
-      auto *outScale = emitConstI32(builder, outScaleParams.scale_);
+    auto *blocking = emitConstArray(builder, getKernelParams(I));
+    auto *numThreads = emitConstSizeT(builder, numThreads_);
+    auto *activation = emitConstI32(builder, FC->getActivation());
+    auto *activationParam = emitConstF32(builder, FC->getActivationParam());
 
-      builder.CreateCall(F, {destPtr, lhsPtr, rhsPtr, destDims, lhsDims,
-                             rhsDims, destOffset, lhsOffset, rhsOffset, outPre,
-                             outPost, outScale});
-    } else {
-      builder.CreateCall(F,
-                         {destPtr, lhsPtr, rhsPtr, destDims, lhsDims, rhsDims});
-    }
+    auto *F = getFunction("fc_packed", dest->getElementType());
+    builder.CreateCall(F, {destPtr, lhsPtr, rhsPtr, biasPtr, destDims, lhsDims,
+                           rhsDims, blocking, numThreads, activation,
+                           activationParam});
     break;
   }
 
@@ -1128,11 +2373,21 @@ void LLVMIRGen::generateLLVMIRForInstr(llvm::IRBuilder<> &builder,
     auto *slicePtr = emitValueAddress(builder, slice);
 
     auto bdim = flattenCdr(batch->dims());
-    auto *numSlice = emitConstSizeT(builder, bdim.first);
+    auto *numSlice = emitBatchedDims_ && batchedValues_.count(batch)
+                         ? emitBatchSize(builder)
+                         : emitConstSizeT(builder, bdim.first);
     auto *sliceSize = emitConstSizeT(builder, bdim.second);
 
     auto *F = getFunction("batchedadd", dest->getElementType());
 
+    // The int32 accumulators of the same scale are added without rescaling.
+    if (batch->getElementType() == ElemKind::Int32QTy) {
+      assert(batch->getType()->getScale() == slice->getType()->getScale() &&
+             "The accumulators must have the same scale");
+      builder.CreateCall(F, {destPtr, batchPtr, slicePtr, numSlice, sliceSize});
+      break;
+    }
+
     if (batch->getType()->isQuantizedType()) {
       auto *destTy = dest->getType();
       auto *batchTy = batch->getType();
@@ -1209,6 +2464,38 @@ void LLVMIRGen::generateLLVMIRForInstr(llvm::IRBuilder<> &builder,
     break;
   }
 
+  case Kinded::Kind::ReduceInstKind: {
+    auto *RI = cast<ReduceInst>(I);
+    auto *dest = RI->getDest();
+    auto *src = RI->getSrc();
+    auto *destPtr = emitValueAddress(builder, dest);
+    auto *srcPtr = emitValueAddress(builder, src);
+
+    // The adjacent reduced and kept dimensions are merged at compile time, so
+    // that the kernel sees the reductions of rows, of columns and of the
+    // spatial dimensions of an image as one or two loops.
+    ShapeVector dims, reduced;
+    collapseReduceDims(src->dims(), RI->getAxes(), dims, reduced);
+
+    const char *kernelName = nullptr;
+    switch (static_cast<ReduceMode>(RI->getMode())) {
+    case ReduceMode::Sum:
+      kernelName = "reduce_sum";
+      break;
+    case ReduceMode::Mean:
+      kernelName = "reduce_mean";
+      break;
+    case ReduceMode::Max:
+      kernelName = "reduce_max";
+      break;
+    }
+    auto *F = getFunction(kernelName, dest->getElementType());
+    builder.CreateCall(F, {destPtr, srcPtr, emitConstArray(builder, dims),
+                           emitConstArray(builder, reduced),
+                           emitConstSizeT(builder, dims.size())});
+    break;
+  }
+
   case Kinded::Kind::BroadcastInstKind: {
     BroadcastInst *BI = cast<BroadcastInst>(I);
     auto *dest = BI->getDest();
@@ -1216,18 +2503,18 @@ void LLVMIRGen::generateLLVMIRForInstr(llvm::IRBuilder<> &builder,
     auto *destPtr = emitValueAddress(builder, dest);
     auto *srcPtr = emitValueAddress(builder, src);
 
-    auto *destDims = emitValueDims(builder, dest);
-    auto *nDims = emitConstSizeT(builder, dest->dims().size());
-
-    // Pad src dims with 1s to match axis and dest dims.
-    ShapeVector newDims(src->dims().begin(), src->dims().end());
-    newDims.insert(newDims.begin(), BI->getAxis(), 1);
-    newDims.insert(newDims.end(),
-                   dest->dims().size() - src->dims().size() - BI->getAxis(), 1);
-    auto *srcDims = emitConstArray(builder, newDims);
+    // The first dimension of a batched destination is read at run time, so it
+    // is not merged with the others.
+    bool isBatched = emitBatchedDims_ && batchedValues_.count(dest);
+    ShapeVector destDims, srcDims;
+    getBroadcastDims(BI, /* collapse */ !isBatched, destDims, srcDims);
+    auto *destDimsPtr = isBatched ? emitValueDims(builder, dest)
+                                  : emitConstArray(builder, destDims);
+    auto *srcDimsPtr = emitConstArray(builder, srcDims);
+    auto *nDims = emitConstSizeT(builder, destDims.size());
 
     auto *F = getFunction("broadcast", dest->getElementType());
-    builder.CreateCall(F, {destPtr, srcPtr, destDims, srcDims, nDims});
+    builder.CreateCall(F, {destPtr, srcPtr, destDimsPtr, srcDimsPtr, nDims});
     break;
   }
 
@@ -1251,20 +2538,52 @@ void LLVMIRGen::generateLLVMIRForInstr(llvm::IRBuilder<> &builder,
     auto *stride = emitConstSizeT(builder, CI->getStride());
     auto *pad = emitConstSizeT(builder, CI->getPad());
 
+    // The int16 activations are convolved with the int8 filter, and the int32
+    // bias is added to the accumulator.
+    if (src->getElementType() == ElemKind::Int16QTy) {
+      auto *destTy = dest->getType();
+      auto *srcTy = src->getType();
+      auto *filterTy = filter->getType();
+      auto *group = emitConstSizeT(builder, CI->getGroup());
+      auto *destOffset = emitConstI32(builder, destTy->getOffset());
+      auto *srcOffset = emitConstI32(builder, srcTy->getOffset());
+      auto *filterOffset = emitConstI32(builder, filterTy->getOffset());
+      auto *scale = emitConstF32(builder, srcTy->getScale() *
+                                              filterTy->getScale() /
+                                              destTy->getScale());
+      auto *F = getFunction("convolution", ElemKind::Int16QTy);
+      builder.CreateCall(F, {destPtr, srcPtr, filterPtr, biasPtr, destDims,
+                             srcDims, filterDims, kernel, stride, pad, group,
+                             destOffset, srcOffset, filterOffset, scale});
+      break;
+    }
+
     const char *kernelName = "convolution";
 
     auto destDepth = dest->dims()[3];
 
     // Try to 'block' the convolution on the 'depth' dimension. We will process
-    // this number output slices each iteration.
+    // this number output slices each iteration. The float kernel is tuned.
     unsigned unrollDFactor = 1;
 
     if ((destDepth % 8) == 0) {
       unrollDFactor = 8;
     }
+    auto params = getKernelParams(I);
+    if (!params.empty()) {
+      unrollDFactor = params[0];
+    }
 
     auto *unrollD = emitConstI32(builder, unrollDFactor);
 
+    // The grouped convolutions are not lowered into one convolution per
+    // group, and have their own kernel.
+    bool isGrouped = CI->getGroup() > 1;
+    auto *group = emitConstSizeT(builder, CI->getGroup());
+    if (isGrouped) {
+      kernelName = "grouped_convolution";
+    }
+
     auto *F = getFunction(kernelName, dest->getElementType());
 
     if (src->getType()->isQuantizedType()) {
@@ -1297,86 +2616,242 @@ void LLVMIRGen::generateLLVMIRForInstr(llvm::IRBuilder<> &builder,
       auto *outPost = emitConstI32(builder, outScaleParam.post_);
       auto *outScale = emitConstI32(builder, outScaleParam.scale_);
 
-      builder.CreateCall(F, {destPtr,   srcPtr,       filterPtr,  biasPtr,
-                             destDims,  srcDims,      filterDims, biasDims,
-                             kernel,    stride,       pad,        destOffset,
-                             srcOffset, filterOffset, biasOffset, biasPre,
-                             biasPost,  biasScale,    outPre,     outPost,
-                             outScale,  unrollD});
+      if (isGrouped) {
+        builder.CreateCall(F, {destPtr,    srcPtr,       filterPtr,
+                               biasPtr,    destDims,     srcDims,
+                               filterDims, kernel,       stride,
+                               pad,        group,        destOffset,
+                               srcOffset,  filterOffset, biasOffset,
+                               biasPre,    biasPost,     biasScale,
+                               outPre,     outPost,      outScale});
+      } else {
+        builder.CreateCall(F, {destPtr,   srcPtr,       filterPtr,  biasPtr,
+                               destDims,  srcDims,      filterDims, biasDims,
+                               kernel,    stride,       pad,        destOffset,
+                               srcOffset, filterOffset, biasOffset, biasPre,
+                               biasPost,  biasScale,    outPre,     outPost,
+                               outScale,  unrollD});
+      }
+    } else if (isGrouped) {
+      builder.CreateCall(F, {destPtr, srcPtr, filterPtr, biasPtr, destDims,
+                             srcDims, filterDims, kernel, stride, pad, group});
     } else {
       builder.CreateCall(F, {destPtr, srcPtr, filterPtr, biasPtr, destDims,
                              srcDims, filterDims, biasDims, kernel, stride, pad,
-                             unrollD});
+                             unrollD, emitConstI32(builder, params[1])});
     }
     break;
   }
 
+  case Kinded::Kind::ChannelwiseQuantizedConvolutionInstKind: {
+    auto *CI = cast<ChannelwiseQuantizedConvolutionInst>(I);
+    auto *dest = CI->getDest();
+    auto *src = CI->getSrc();
+    auto *filter = CI->getFilter();
+    auto *destPtr = emitValueAddress(builder, dest);
+    auto *srcPtr = emitValueAddress(builder, src);
+    auto *filterPtr = emitValueAddress(builder, filter);
+    auto *biasPtr = emitValueAddress(builder, CI->getBias());
+    auto *scalesPtr = emitValueAddress(builder, CI->getFilterScales());
+    auto *offsetsPtr = emitValueAddress(builder, CI->getFilterOffsets());
+
+    auto *destDims = emitValueDims(builder, dest);
+    auto *srcDims = emitValueDims(builder, src);
+    auto *filterDims = emitValueDims(builder, filter);
+
+    auto *kernel = emitConstSizeT(builder, CI->getKernel());
+    auto *stride = emitConstSizeT(builder, CI->getStride());
+    auto *pad = emitConstSizeT(builder, CI->getPad());
+    auto *group = emitConstSizeT(builder, CI->getGroup());
+
+    auto *destTy = dest->getType();
+    auto *srcTy = src->getType();
+    auto *destOffset = emitConstI32(builder, destTy->getOffset());
+    auto *srcOffset = emitConstI32(builder, srcTy->getOffset());
+    auto *srcScale = emitConstF32(builder, srcTy->getScale());
+    auto *destScale = emitConstF32(builder, destTy->getScale());
+
+    // The convolution is computed on the int8 GEMM, with its default
+    // blocking.
+    auto *blocking = emitConstArray(
+        builder, {gemmBlockSizes_.mc, gemmBlockSizes_.kc, gemmBlockSizes_.nc});
+    auto *numThreads = emitConstSizeT(builder, numThreads_);
+
+    auto *F = getFunction("channelwise_convolution_i8");
+    builder.CreateCall(F, {destPtr, srcPtr, filterPtr, biasPtr, scalesPtr,
+                           offsetsPtr, destDims, srcDims, filterDims, kernel,
+                           stride, pad, group, destOffset, srcOffset, srcScale,
+                           destScale, blocking, numThreads});
+    break;
+  }
+
   case Kinded::Kind::CPUConvDKKC8InstKind: {
-    CPUConvDKKC8Inst *CI = cast<CPUConvDKKC8Inst>(I);
+    emitConvDKKC8(builder, cast<CPUConvDKKC8Inst>(I), nullptr);
+    break;
+  }
+
+  case Kinded::Kind::CPUResidualConvDKKC8InstKind: {
+    auto *CI = cast<CPUResidualConvDKKC8Inst>(I);
+    emitConvDKKC8(builder, CI, CI->getResidual());
+    break;
+  }
+
+  case Kinded::Kind::CPUQuantizedConvDKKC8InstKind: {
+    auto *CI = cast<CPUQuantizedConvDKKC8Inst>(I);
     auto *dest = CI->getDest();
     auto *src = CI->getSrc();
     auto *filter = CI->getFilter();
+    auto *tapSums = CI->getTapSums();
     auto *bias = CI->getBias();
     auto *destPtr = emitValueAddress(builder, dest);
     auto *srcPtr = emitValueAddress(builder, src);
     auto *filterPtr = emitValueAddress(builder, filter);
+    auto *tapSumsPtr = emitValueAddress(builder, tapSums);
     auto *biasPtr = emitValueAddress(builder, bias);
 
     auto *destDims = emitValueDims(builder, dest);
     auto *srcDims = emitValueDims(builder, src);
-    auto *filterDims = emitValueDims(builder, filter);
-    auto *biasDims = emitValueDims(builder, bias);
 
     auto *kernel = emitConstSizeT(builder, CI->getKernel());
     auto *stride = emitConstSizeT(builder, CI->getStride());
     auto *pad = emitConstSizeT(builder, CI->getPad());
 
-    size_t inChannels = src->dims()[3];
-    size_t outChannels = src->dims()[3];
-
-    // Select a method for iterating on the image in the pixel (filter-first, or
-    // input-first). Perform convolutions with a high channel count by scanning
-    // the input image multiple times, once for each filter entry. Scan images
-    // with a low channel count by scanning the image once because the filter
-    // scan will fall in the cache.
-    bool pixelScanFirst = (inChannels < 16);
-
-    // The number of float8 registers that we use to process the depth channel.
-    unsigned numDepthRegs = (pixelScanFirst ? 8 : 2);
-    // The number of y pixels to process at once.
-    unsigned sizeGroupY = (pixelScanFirst ? 1 : 5);
-
-    // When producing output pixels process this many times of depth-strips,
-    // where each chunk is float8 * numDepthRegs. This is a form of tiling. It's
-    // profitable to scan multiple depth-strips of the filter if the scanned
-    // memory fits in the cahce and does not get evicted before the next
-    // iteration. By increasing the number strips (and using more cache memory)
-    // we reduce the number of times that we iterate over the input. However, we
-    // also increase the pressure on the cache that has to store the filter so
-    // we can't process too many strips at once.
-    unsigned depthStrips = 1;
-    unsigned stripSize = 8 * numDepthRegs * inChannels;
-    unsigned tileSize = 16384;
-    // Increase the number of strips until we reach the output-tensor depth size
-    // or until we exceed some threashold.
-    while (2 * depthStrips * stripSize <= tileSize &&
-           2 * depthStrips * numDepthRegs * 8 <= outChannels &&
-           depthStrips < 8) {
-      depthStrips *= 2;
-    }
+    auto *destTy = dest->getType();
+    auto *srcTy = src->getType();
+    auto *biasTy = bias->getType();
+
+    // The filter has the scale of the original filter and the offset zero.
+    float matMulScale = srcTy->getScale() * filter->getType()->getScale();
+    auto biasScaleParam = quantization::quantizeScaleOffset32To8(
+        biasTy->getScale() / matMulScale, biasTy->getOffset());
+    auto outScaleParam = quantization::quantizeScaleOffset32To8(
+        matMulScale / destTy->getScale(), 0);
+
+    auto *destOffset = emitConstI32(builder, destTy->getOffset());
+    auto *srcOffset = emitConstI32(builder, srcTy->getOffset());
+    auto *biasOffset = emitConstI32(builder, biasTy->getOffset());
+    auto *biasPre = emitConstI32(builder, biasScaleParam.pre_);
+    auto *biasPost = emitConstI32(builder, biasScaleParam.post_);
+    auto *biasScale = emitConstI32(builder, biasScaleParam.scale_);
+    auto *outPre = emitConstI32(builder, outScaleParam.pre_);
+    auto *outPost = emitConstI32(builder, outScaleParam.post_);
+    auto *outScale = emitConstI32(builder, outScaleParam.scale_);
+
+    auto *F = getFunction("convDKKC8", ElemKind::Int8QTy);
+    builder.CreateCall(F, {destPtr,    srcPtr,     filterPtr,
+                           tapSumsPtr, biasPtr,    destDims,
+                           srcDims,    kernel,     stride,
+                           pad,        destOffset, srcOffset,
+                           biasOffset, biasPre,    biasPost,
+                           biasScale,  outPre,     outPost,
+                           outScale});
+    break;
+  }
+
+  case Kinded::Kind::CPUConvNCHWcInstKind: {
+    CPUConvNCHWcInst *CI = cast<CPUConvNCHWcInst>(I);
+    auto *dest = CI->getDest();
+    auto *src = CI->getSrc();
+    auto *filter = CI->getFilter();
+    auto *destPtr = emitValueAddress(builder, dest);
+    auto *srcPtr = emitValueAddress(builder, src);
+    auto *filterPtr = emitValueAddress(builder, filter);
+    auto *biasPtr = emitValueAddress(builder, CI->getBias());
 
-    auto *pixelScanFirstVal = emitConstI32(builder, pixelScanFirst);
-    auto *numDepthRegsVal = emitConstI32(builder, numDepthRegs);
-    auto *sizeGroupYVal = emitConstI32(builder, sizeGroupY);
-    auto *depthStripsVal = emitConstI32(builder, depthStrips);
+    auto *destDims = emitValueDims(builder, dest);
+    auto *srcDims = emitValueDims(builder, src);
+    auto *filterDims = emitValueDims(builder, filter);
 
-    const char *kernelName = "convDKKC8";
-    auto *F = getFunction(kernelName, dest->getElementType());
+    auto *kernel = emitConstSizeT(builder, CI->getKernel());
+    auto *stride = emitConstSizeT(builder, CI->getStride());
+    auto *pad = emitConstSizeT(builder, CI->getPad());
+    auto *activation = emitConstI32(builder, CI->getActivation());
+    auto *activationParam = emitConstF32(builder, CI->getActivationParam());
 
+    auto *F = getFunction("conv_nchwc", dest->getElementType());
     builder.CreateCall(F, {destPtr, srcPtr, filterPtr, biasPtr, destDims,
-                           srcDims, filterDims, biasDims, kernel, stride, pad,
-                           pixelScanFirstVal, numDepthRegsVal, sizeGroupYVal,
-                           depthStripsVal});
+                           srcDims, filterDims, kernel, stride, pad,
+                           activation, activationParam});
+    break;
+  }
+
+  case Kinded::Kind::CPUIm2ColInstKind: {
+    CPUIm2ColInst *CI = cast<CPUIm2ColInst>(I);
+    auto *dest = CI->getDest();
+    auto *src = CI->getSrc();
+    auto *destPtr = emitValueAddress(builder, dest);
+    auto *srcPtr = emitValueAddress(builder, src);
+
+    auto *destDims = emitValueDims(builder, dest);
+    auto *srcDims = emitValueDims(builder, src);
+
+    auto *kernel = emitConstSizeT(builder, CI->getKernel());
+    auto *stride = emitConstSizeT(builder, CI->getStride());
+    auto *pad = emitConstSizeT(builder, CI->getPad());
+
+    auto *F = getFunction("im2col", dest->getElementType());
+    builder.CreateCall(
+        F, {destPtr, srcPtr, destDims, srcDims, kernel, stride, pad});
+    break;
+  }
+
+  case Kinded::Kind::CPUWinogradInputInstKind: {
+    CPUWinogradInputInst *WI = cast<CPUWinogradInputInst>(I);
+    auto *dest = WI->getDest();
+    auto *src = WI->getSrc();
+    auto *destPtr = emitValueAddress(builder, dest);
+    auto *srcPtr = emitValueAddress(builder, src);
+
+    auto *destDims = emitValueDims(builder, dest);
+    auto *srcDims = emitValueDims(builder, src);
+
+    auto *pad = emitConstSizeT(builder, WI->getPad());
+
+    auto *F = getFunction("winograd_input", dest->getElementType());
+    builder.CreateCall(F, {destPtr, srcPtr, destDims, srcDims, pad});
+    break;
+  }
+
+  case Kinded::Kind::CPUWinogradMultiplyInstKind: {
+    CPUWinogradMultiplyInst *WM = cast<CPUWinogradMultiplyInst>(I);
+    auto *dest = WM->getDest();
+    auto *src = WM->getSrc();
+    auto *filter = WM->getFilter();
+    auto *destPtr = emitValueAddress(builder, dest);
+    auto *srcPtr = emitValueAddress(builder, src);
+    auto *filterPtr = emitValueAddress(builder, filter);
+
+    auto *destDims = emitValueDims(builder, dest);
+    auto *srcDims = emitValueDims(builder, src);
+    auto *filterDims = emitValueDims(builder, filter);
+
+    auto *blocking = emitConstArray(builder, getKernelParams(I));
+    auto *numThreads = emitConstSizeT(builder, numThreads_);
+
+    auto *F = getFunction("winograd_multiply", dest->getElementType());
+    builder.CreateCall(F, {destPtr, srcPtr, filterPtr, destDims, srcDims,
+                           filterDims, blocking, numThreads});
+    break;
+  }
+
+  case Kinded::Kind::CPUWinogradOutputInstKind: {
+    CPUWinogradOutputInst *WO = cast<CPUWinogradOutputInst>(I);
+    auto *dest = WO->getDest();
+    auto *src = WO->getSrc();
+    auto *bias = WO->getBias();
+    auto *destPtr = emitValueAddress(builder, dest);
+    auto *srcPtr = emitValueAddress(builder, src);
+    auto *biasPtr = emitValueAddress(builder, bias);
+
+    auto *destDims = emitValueDims(builder, dest);
+    auto *srcDims = emitValueDims(builder, src);
+
+    auto *activation = emitConstI32(builder, WO->getActivation());
+    auto *activationParam = emitConstF32(builder, WO->getActivationParam());
+
+    auto *F = getFunction("winograd_output", dest->getElementType());
+    builder.CreateCall(F, {destPtr, srcPtr, biasPtr, destDims, srcDims,
+                           activation, activationParam});
     break;
   }
 
@@ -1400,11 +2875,16 @@ void LLVMIRGen::generateLLVMIRForInstr(llvm::IRBuilder<> &builder,
     auto *kernel = emitConstSizeT(builder, CG->getKernel());
     auto *stride = emitConstSizeT(builder, CG->getStride());
     auto *pad = emitConstSizeT(builder, CG->getPad());
+    // The gradients are computed on the GEMM, with its default blocking.
+    auto *blocking = emitConstArray(
+        builder, {gemmBlockSizes_.mc, gemmBlockSizes_.kc, gemmBlockSizes_.nc});
+    auto *numThreads = emitConstSizeT(builder, numThreads_);
 
     auto *F = getFunction("convolution_grad", srcGrad->getElementType());
     builder.CreateCall(F, {srcGradPtr, destGradPtr, srcPtr, filterGradPtr,
                            biasGradPtr, filterPtr, destGradDims, srcDims,
-                           filterGradDims, kernel, stride, pad});
+                           filterGradDims, kernel, stride, pad, blocking,
+                           numThreads});
     break;
   }
 
@@ -1455,6 +2935,58 @@ void LLVMIRGen::generateLLVMIRForInstr(llvm::IRBuilder<> &builder,
     break;
   }
 
+  case Kinded::Kind::BatchNormalizationInstKind: {
+    auto *BN = cast<BatchNormalizationInst>(I);
+    auto *src = BN->getSrc();
+    auto *destPtr = emitValueAddress(builder, BN->getDest());
+    auto *srcPtr = emitValueAddress(builder, src);
+    auto *scalePtr = emitValueAddress(builder, BN->getScale());
+    auto *biasPtr = emitValueAddress(builder, BN->getBias());
+    auto *meanPtr = emitValueAddress(builder, BN->getMean());
+    auto *varPtr = emitValueAddress(builder, BN->getVar());
+
+    // The kernel sees the input as the elements before the channels, the
+    // channels and the elements after them.
+    size_t outer, inner;
+    getChannelStrides(src->dims(), BN->getChannelIdx(), outer, inner);
+    auto *outerV = emitConstSizeT(builder, outer);
+    auto *channels = emitConstSizeT(builder, src->dims()[BN->getChannelIdx()]);
+    auto *innerV = emitConstSizeT(builder, inner);
+    auto *epsilon = emitConstF32(builder, BN->getEpsilon());
+    auto *momentum = emitConstF32(builder, BN->getMomentum());
+
+    auto *F = getFunction("batchnorm", src->getElementType());
+    builder.CreateCall(F, {destPtr, srcPtr, scalePtr, biasPtr, meanPtr, varPtr,
+                           outerV, channels, innerV, epsilon, momentum});
+    break;
+  }
+
+  case Kinded::Kind::BatchNormalizationGradInstKind: {
+    auto *BNG = cast<BatchNormalizationGradInst>(I);
+    auto *src = BNG->getSrc();
+    auto *srcPtr = emitValueAddress(builder, src);
+    auto *scalePtr = emitValueAddress(builder, BNG->getScale());
+    auto *meanPtr = emitValueAddress(builder, BNG->getMean());
+    auto *varPtr = emitValueAddress(builder, BNG->getVar());
+    auto *destGradPtr = emitValueAddress(builder, BNG->getDestGrad());
+    auto *srcGradPtr = emitValueAddress(builder, BNG->getSrcGrad());
+    auto *scaleGradPtr = emitValueAddress(builder, BNG->getScaleGrad());
+    auto *biasGradPtr = emitValueAddress(builder, BNG->getBiasGrad());
+
+    size_t outer, inner;
+    getChannelStrides(src->dims(), BNG->getChannelIdx(), outer, inner);
+    auto *outerV = emitConstSizeT(builder, outer);
+    auto *channels = emitConstSizeT(builder, src->dims()[BNG->getChannelIdx()]);
+    auto *innerV = emitConstSizeT(builder, inner);
+    auto *epsilon = emitConstF32(builder, BNG->getEpsilon());
+
+    auto *F = getFunction("batchnorm_grad", src->getElementType());
+    builder.CreateCall(F, {srcPtr, scalePtr, meanPtr, varPtr, destGradPtr,
+                           srcGradPtr, scaleGradPtr, biasGradPtr, outerV,
+                           channels, innerV, epsilon});
+    break;
+  }
+
   case Kinded::Kind::PoolMaxInstKind: {
     PoolMaxInst *PM = cast<PoolMaxInst>(I);
     auto *dest = PM->getDest();
@@ -1601,7 +3133,9 @@ void LLVMIRGen::generateLLVMIRForInstr(llvm::IRBuilder<> &builder,
     auto *scale = emitConstF32(builder, srcType->getScale());
     auto *offset = emitConstI32(builder, srcType->getOffset());
 
-    auto *F = getFunction("dequantize", dest->getElementType());
+    auto *F = src->getElementType() == ElemKind::Int16QTy
+                  ? getFunction("dequantize_i16")
+                  : getFunction("dequantize", dest->getElementType());
     builder.CreateCall(F, {destPtr, srcPtr, numElem, scale, offset});
     break;
   }
@@ -1617,6 +3151,22 @@ void LLVMIRGen::generateLLVMIRForInstr(llvm::IRBuilder<> &builder,
     auto *srcType = src->getType();
     auto *numElem = emitConstSizeT(builder, destType->size());
 
+    // The int16 and int32 tensors are rescaled in float, because the integer
+    // transformation only has the precision of an 8-bit result.
+    if (srcType->getElementType() != ElemKind::Int8QTy ||
+        destType->getElementType() != ElemKind::Int8QTy) {
+      auto *destOffset = emitConstI32(builder, destType->getOffset());
+      auto *srcOffset = emitConstI32(builder, srcType->getOffset());
+      auto *scale =
+          emitConstF32(builder, srcType->getScale() / destType->getScale());
+      auto *F = getFunction(("rescale_" + srcType->getElementName() + "_" +
+                             destType->getElementName())
+                                .str());
+      builder.CreateCall(
+          F, {destPtr, srcPtr, numElem, destOffset, srcOffset, scale});
+      break;
+    }
+
     auto rescaleParams = quantization::quantizeScaleOffset32To8(
         srcType->getScale() / destType->getScale(), srcType->getOffset());
 
@@ -1664,21 +3214,93 @@ void LLVMIRGen::generateLLVMIRForInstr(llvm::IRBuilder<> &builder,
     break;
   }
 
+  case Kinded::Kind::LSTMUnitInstKind: {
+    LSTMUnitInst *LU = cast<LSTMUnitInst>(I);
+    auto *C = LU->getC();
+    auto *newCPtr = emitValueAddress(builder, LU->getNewC());
+    auto *newHPtr = emitValueAddress(builder, LU->getNewH());
+    auto *inputPtr = emitValueAddress(builder, LU->getInput());
+    auto *cPtr = emitValueAddress(builder, C);
+    auto *batch = emitConstSizeT(builder, C->dims()[0]);
+    auto *hidden = emitConstSizeT(builder, C->dims()[1]);
+
+    auto *F = getFunction("lstm_unit", C->getElementType());
+    builder.CreateCall(F, {newCPtr, newHPtr, inputPtr, cPtr, batch, hidden});
+    break;
+  }
+
+  case Kinded::Kind::SGDInstKind: {
+    SGDInst *SGD = cast<SGDInst>(I);
+    auto *W = SGD->getWeight();
+    auto *weightPtr = emitValueAddress(builder, W);
+    // Without momentum the gsum is void and the kernel does not access it.
+    auto *gsumPtr = SGD->getMomentum() > 0
+                        ? emitValueAddress(builder, SGD->getGsum())
+                        : weightPtr;
+    auto *gradientPtr = emitValueAddress(builder, SGD->getGradient());
+    auto *numElem = emitConstSizeT(builder, W->size());
+    auto *L1Decay = emitConstF32(builder, SGD->getL1Decay());
+    auto *L2Decay = emitConstF32(builder, SGD->getL2Decay());
+    auto *learningRate = emitConstF32(builder, SGD->getLearningRate());
+    auto *momentum = emitConstF32(builder, SGD->getMomentum());
+    auto *batchSize = emitConstF32(
+        builder, std::max<unsigned>(SGD->getBatchSize(), 1));
+
+    auto *F = getFunction("sgd", W->getElementType());
+    builder.CreateCall(F, {weightPtr, gsumPtr, gradientPtr, numElem, L1Decay,
+                           L2Decay, learningRate, momentum, batchSize});
+    break;
+  }
+
   case Kinded::Kind::TopKInstKind: {
     TopKInst *TI = cast<TopKInst>(I);
     auto *input = TI->getInput();
     auto *valuesPtr = emitValueAddress(builder, TI->getValues());
     auto *indicesPtr = emitValueAddress(builder, TI->getIndices());
     auto *inputPtr = emitValueAddress(builder, input);
-    auto *scratchPtr = emitValueAddress(builder, TI->getScratch());
 
     auto *k = emitConstSizeT(builder, TI->getK());
     auto *n = emitConstSizeT(builder, input->dims().back());
     auto *size = emitConstSizeT(builder, input->size());
+    auto *numThreads = emitConstSizeT(builder, numThreads_);
 
-    auto *F = getFunction("topk", input->getElementType());
+    // The kernels of the 32-bit indices have the suffix 32.
+    bool idx32 = TI->getIndices()->getElementType() == ElemKind::Int32ITy;
+    auto *F = getFunction(idx32 ? "topk32" : "topk", input->getElementType());
     builder.CreateCall(
-        F, {valuesPtr, indicesPtr, inputPtr, scratchPtr, k, n, size});
+        F, {valuesPtr, indicesPtr, inputPtr, k, n, size, numThreads});
+    break;
+  }
+
+  case Kinded::Kind::CPUSoftMaxTopKInstKind: {
+    auto *STK = cast<CPUSoftMaxTopKInst>(I);
+    auto *input = STK->getInput();
+    auto *valuesPtr = emitValueAddress(builder, STK->getValues());
+    auto *indicesPtr = emitValueAddress(builder, STK->getIndices());
+    auto *inputPtr = emitValueAddress(builder, input);
+
+    auto *k = emitConstSizeT(builder, STK->getK());
+    auto *n = emitConstSizeT(builder, input->dims().back());
+    auto *size = emitConstSizeT(builder, input->size());
+    auto *numThreads = emitConstSizeT(builder, numThreads_);
+
+    auto *F = getFunction("softmax_topk", input->getElementType());
+    builder.CreateCall(
+        F, {valuesPtr, indicesPtr, inputPtr, k, n, size, numThreads});
+    break;
+  }
+
+  case Kinded::Kind::CPUSoftMaxCrossEntropyLossInstKind: {
+    auto *SCE = cast<CPUSoftMaxCrossEntropyLossInst>(I);
+    auto *input = SCE->getInput();
+    auto *CEPtr = emitValueAddress(builder, SCE->getCE());
+    auto *inputPtr = emitValueAddress(builder, input);
+    auto *labelsPtr = emitValueAddress(builder, SCE->getLabels());
+    auto *inputDims = emitValueDims(builder, input);
+
+    auto *F =
+        getFunction("softmax_cross_entropy_loss", input->getElementType());
+    builder.CreateCall(F, {CEPtr, inputPtr, labelsPtr, inputDims});
     break;
   }
 
@@ -1689,6 +3311,15 @@ void LLVMIRGen::generateLLVMIRForInstr(llvm::IRBuilder<> &builder,
     auto *destPtr = emitValueAddress(builder, dest);
     auto *srcPtr = emitValueAddress(builder, src);
 
+    size_t batch, rows, cols;
+    if (isBatchedTranspose(TI->getShuffle(), src->dims(), batch, rows, cols)) {
+      auto *F = getFunction("transpose_batched", dest->getElementType());
+      builder.CreateCall(F, {srcPtr, destPtr, emitConstSizeT(builder, batch),
+                             emitConstSizeT(builder, rows),
+                             emitConstSizeT(builder, cols)});
+      break;
+    }
+
     auto *destDims = emitValueDims(builder, dest);
     auto *srcDims = emitValueDims(builder, src);
 
@@ -1774,12 +3405,177 @@ void LLVMIRGen::generateLLVMIRForInstr(llvm::IRBuilder<> &builder,
     auto *sliceSize =
         emitConstSizeT(builder, dataType->size() / dataType->dims()[0]);
 
-    auto *F = getFunction("gather", dest->getElementType());
+    bool idx32 = indices->getElementType() == ElemKind::Int32ITy;
+    auto *F =
+        getFunction(idx32 ? "gather32" : "gather", dest->getElementType());
     builder.CreateCall(F,
                        {destPtr, dataPtr, indicesPtr, indicesSize, sliceSize});
     break;
   }
 
+  case Kinded::Kind::SparseLengthsWeightedSumInstKind: {
+    auto *SI = cast<SparseLengthsWeightedSumInst>(I);
+    auto *dest = SI->getDest();
+    auto *data = SI->getData();
+    auto *indices = SI->getIndices();
+    auto *lengths = SI->getLengths();
+
+    auto *destPtr = emitValueAddress(builder, dest);
+    auto *dataPtr = emitValueAddress(builder, data);
+    auto *weightsPtr = emitValueAddress(builder, SI->getWeights());
+    auto *indicesPtr = emitValueAddress(builder, indices);
+    auto *lengthsPtr = emitValueAddress(builder, lengths);
+
+    auto *numSegments = emitConstSizeT(builder, lengths->size());
+    auto *numIndices = emitConstSizeT(builder, indices->size());
+    auto *dataType = data->getType();
+    auto *lineSize =
+        emitConstSizeT(builder, dataType->size() / dataType->dims()[0]);
+
+    auto *F =
+        getFunction("sparse_lengths_weighted_sum", dest->getElementType());
+    builder.CreateCall(F, {destPtr, dataPtr, weightsPtr, indicesPtr,
+                           lengthsPtr, numSegments, numIndices, lineSize});
+    break;
+  }
+
+  case Kinded::Kind::RowwiseQuantizedSparseLengthsWeightedSumInstKind: {
+    auto *SI = cast<RowwiseQuantizedSparseLengthsWeightedSumInst>(I);
+    auto *data = SI->getData();
+    auto *indices = SI->getIndices();
+    auto *lengths = SI->getLengths();
+
+    auto *destPtr = emitValueAddress(builder, SI->getDest());
+    auto *dataPtr = emitValueAddress(builder, data);
+    auto *scalesPtr = emitValueAddress(builder, SI->getScales());
+    auto *offsetsPtr = emitValueAddress(builder, SI->getOffsets());
+    auto *weightsPtr = emitValueAddress(builder, SI->getWeights());
+    auto *indicesPtr = emitValueAddress(builder, indices);
+    auto *lengthsPtr = emitValueAddress(builder, lengths);
+
+    auto *numSegments = emitConstSizeT(builder, lengths->size());
+    auto *numIndices = emitConstSizeT(builder, indices->size());
+    auto *lineSize = emitConstSizeT(builder, data->dims()[1]);
+
+    auto *F = getFunction("rowwise_quantized_sparse_lengths_weighted_sum_i8");
+    builder.CreateCall(F, {destPtr, dataPtr, scalesPtr, offsetsPtr, weightsPtr,
+                           indicesPtr, lengthsPtr, numSegments, numIndices,
+                           lineSize});
+    break;
+  }
+
+  case Kinded::Kind::RowwiseQuantizedGatherInstKind: {
+    auto *GI = cast<RowwiseQuantizedGatherInst>(I);
+    auto *data = GI->getData();
+    auto *indices = GI->getIndices();
+
+    auto *destPtr = emitValueAddress(builder, GI->getDest());
+    auto *dataPtr = emitValueAddress(builder, data);
+    auto *scalesPtr = emitValueAddress(builder, GI->getScales());
+    auto *offsetsPtr = emitValueAddress(builder, GI->getOffsets());
+    auto *indicesPtr = emitValueAddress(builder, indices);
+
+    auto *numIndices = emitConstSizeT(builder, indices->size());
+    auto *lineSize = emitConstSizeT(builder, data->dims()[1]);
+
+    auto *F = getFunction("rowwise_quantized_gather_i8");
+    builder.CreateCall(F, {destPtr, dataPtr, scalesPtr, offsetsPtr, indicesPtr,
+                           numIndices, lineSize});
+    break;
+  }
+
+  case Kinded::Kind::ScatterAssignInstKind: {
+    ScatterAssignInst *SAI = llvm::cast<ScatterAssignInst>(I);
+    auto *data = SAI->getData();
+    auto *indices = SAI->getIndices();
+    auto *slices = SAI->getSlices();
+
+    auto *dataPtr = emitValueAddress(builder, data);
+    auto *indicesPtr = emitValueAddress(builder, indices);
+    auto *slicesPtr = emitValueAddress(builder, slices);
+
+    auto *indicesSize = emitConstSizeT(builder, indices->size());
+
+    auto *dataType = data->getType();
+    auto *sliceSize =
+        emitConstSizeT(builder, dataType->size() / dataType->dims()[0]);
+
+    auto *F = getFunction("scatter_assign", data->getElementType());
+    builder.CreateCall(
+        F, {dataPtr, indicesPtr, slicesPtr, indicesSize, sliceSize});
+    break;
+  }
+
+  case Kinded::Kind::LoopStartInstKind: {
+    LoopStartInst *LS = llvm::cast<LoopStartInst>(I);
+    auto *counterPtr = emitValueAddress(builder, LS->getCounter());
+    auto *tripCountPtr = emitValueAddress(builder, LS->getTripCount());
+    builder.CreateStore(emitConstSizeT(builder, 0), counterPtr);
+    auto *tripCount = emitTripCount(builder, tripCountPtr,
+                                    LS->getMaxTripCount());
+
+    // The exit block is placed after the body by the matching LoopEnd.
+    auto *func = builder.GetInsertBlock()->getParent();
+    auto *bodyBB = llvm::BasicBlock::Create(ctx_, "loop.body", func);
+    auto *exitBB = llvm::BasicBlock::Create(ctx_, "loop.exit");
+    // Skip the body of a loop that runs zero times.
+    auto *enter = builder.CreateICmpNE(tripCount, emitConstSizeT(builder, 0));
+    builder.CreateCondBr(enter, bodyBB, exitBB);
+    builder.SetInsertPoint(bodyBB);
+    loops_.push_back({bodyBB, exitBB});
+    break;
+  }
+
+  case Kinded::Kind::LoopEndInstKind: {
+    LoopEndInst *LE = llvm::cast<LoopEndInst>(I);
+    assert(!loops_.empty() && "LoopEnd without a LoopStart");
+    auto loop = loops_.back();
+    loops_.pop_back();
+    auto *sizeTTy = builder.getIntNTy(sizeof(size_t) * 8);
+    auto *counterPtr = emitValueAddress(builder, LE->getCounter());
+    auto *tripCountPtr = emitValueAddress(builder, LE->getTripCount());
+    auto *counter = builder.CreateAdd(builder.CreateLoad(sizeTTy, counterPtr),
+                                      emitConstSizeT(builder, 1));
+    builder.CreateStore(counter, counterPtr);
+    auto *tripCount = emitTripCount(builder, tripCountPtr,
+                                    LE->getMaxTripCount());
+
+    // Run the body again while the counter is below the trip count.
+    auto *repeat = builder.CreateICmpULT(counter, tripCount);
+    loop.second->insertInto(builder.GetInsertBlock()->getParent());
+    builder.CreateCondBr(repeat, loop.first, loop.second);
+    builder.SetInsertPoint(loop.second);
+    break;
+  }
+
+  case Kinded::Kind::TensorStatsInstKind: {
+    auto *TSI = cast<TensorStatsInst>(I);
+    auto *src = TSI->getSrc();
+    auto *srcPtr = emitValueAddress(builder, src);
+    auto *countersPtr = emitValueAddress(builder, TSI->getCounters());
+    auto *rangePtr = emitValueAddress(builder, TSI->getRange());
+    auto *size = emitConstSizeT(builder, src->size());
+
+    auto *F = getFunction("tensor_stats", src->getElementType());
+    builder.CreateCall(F, {srcPtr, size, countersPtr, rangePtr});
+    break;
+  }
+
+  case Kinded::Kind::QuantizationProfileInstKind: {
+    auto *QPI = cast<QuantizationProfileInst>(I);
+    auto *input = QPI->getInputTensor();
+    auto *histogram = QPI->getHistogram();
+    auto *inputPtr = emitValueAddress(builder, input);
+    auto *histogramPtr = emitValueAddress(builder, histogram);
+    auto *infoPtr = emitValueAddress(builder, QPI->getComputationInfo());
+    auto *size = emitConstSizeT(builder, input->size());
+    auto *numBins = emitConstSizeT(builder, histogram->size());
+
+    auto *F = getFunction("quantization_profile", input->getElementType());
+    builder.CreateCall(F, {inputPtr, size, histogramPtr, numBins, infoPtr});
+    break;
+  }
+
   case Kinded::Kind::DebugPrintInstKind: {
     DebugPrintInst *DPI = llvm::cast<DebugPrintInst>(I);
     auto *src = DPI->getSrc();
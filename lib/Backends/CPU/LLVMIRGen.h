@@ -17,14 +17,17 @@
 #define GLOW_BACKENDS_JIT_LLVMIRGEN_H
 
 #include "AllocationsInfo.h"
+#include "KernelTuner.h"
 #include "glow/Base/Tensor.h"
 #include "glow/IR/IR.h"
 
 #include "llvm/ADT/ArrayRef.h"
+#include "llvm/ADT/DenseSet.h"
 #include "llvm/IR/DIBuilder.h"
 #include "llvm/IR/DerivedTypes.h"
 #include "llvm/IR/IRBuilder.h"
 #include "llvm/IR/Module.h"
+#include "llvm/Support/MD5.h"
 #include "llvm/Target/TargetMachine.h"
 
 namespace glow {
@@ -35,9 +38,31 @@ class Value;
 class Tensor;
 class Variable;
 class Instruction;
+class BroadcastInst;
 class WeightVar;
 struct AllocationsInfo;
 
+/// Cache block sizes used by the libjit matrix multiplication. A is processed
+/// in mc x kc blocks and B is processed in kc x nc blocks.
+struct GemmBlockSizes {
+  size_t mc{252};
+  size_t kc{128};
+  size_t nc{4096};
+};
+
+/// A part of the generated code that is emitted as a separate function, so
+/// that it can run concurrently with the tasks that it doesn't depend on. The
+/// task function has the API:
+/// void task(uint8_t *baseConstantWeightVars, uint8_t *baseInoutWeightVars,
+/// uint8_t *baseActivations, size_t *offsets);
+struct LLVMIRTask {
+  /// The name of the function that implements the task.
+  std::string name;
+  /// The indices of the earlier tasks that must be done before this task can
+  /// start, because they access the same memory and one of them writes it.
+  std::vector<unsigned> deps;
+};
+
 /// This is a class containing a common logic for the generation of the LLVM IR
 /// from an IRFunction. The primary clients of this class are JITs and bundlers.
 class LLVMIRGen {
@@ -71,6 +96,85 @@ class LLVMIRGen {
   std::unique_ptr<llvm::IRBuilder<>> builder_;
   /// Output directory for bundles, debug info files, etc.
   llvm::StringRef outputDir_;
+  /// The maximal number of threads that multi-threaded libjit kernels may use.
+  unsigned numThreads_{1};
+  /// Cache block sizes used by the libjit matrix multiplication.
+  GemmBlockSizes gemmBlockSizes_;
+  /// The database of the tuned parameters of the kernels, if any.
+  const KernelTuningDB *tuningDB_{nullptr};
+  /// If set, every instruction (or stacked kernel) is emitted as a separate
+  /// task function instead of being inlined into the main entry.
+  bool emitTasks_{false};
+  /// The tasks emitted for the IR function, in the order of the instructions.
+  std::vector<LLVMIRTask> tasks_;
+  /// The body and the exit blocks of the loops around the instructions that
+  /// are being emitted, the innermost last.
+  std::vector<std::pair<llvm::BasicBlock *, llvm::BasicBlock *>> loops_;
+  /// The batch that the IR function was compiled for, if the code computes
+  /// the batch size at run time, and 0 otherwise.
+  size_t maxBatchSize_{0};
+  /// The values whose first dimension is the batch.
+  llvm::DenseSet<const Value *> batchedValues_;
+  /// The instructions that compute only the samples of the run-time batch.
+  llvm::DenseSet<const Instruction *> batchedInstrs_;
+  /// If set, the dimensions of the batched values are emitted with the
+  /// run-time batch size.
+  bool emitBatchedDims_{false};
+  /// The operands of the float arithmetic of the stacked kernel being emitted
+  /// that read the result of a broadcast of the same kernel, as pairs of the
+  /// instruction and of the operand number, mapped to the broadcast. The
+  /// broadcast passes its element to them in a register and doesn't store it.
+  llvm::DenseMap<std::pair<const Instruction *, unsigned>,
+                 const BroadcastInst *>
+      fusedBroadcastReads_;
+  /// The elements of the fused broadcasts at the current loop index.
+  llvm::DenseMap<const BroadcastInst *, llvm::Value *> fusedBroadcastElems_;
+  /// The libjit kernels of the data-parallel instructions that were looked up
+  /// in the module, by the kind of the instruction and the element type.
+  llvm::DenseMap<std::pair<unsigned, unsigned>, llvm::Function *>
+      libjitKernels_;
+  /// The tasks whose number is partition_ modulo numPartitions_ are emitted
+  /// into this module. The others are emitted into the modules of the other
+  /// partitions, which are compiled concurrently.
+  unsigned partition_{0};
+  unsigned numPartitions_{1};
+  /// If set, the module is optimized for the compile time: libjit is neither
+  /// specialized nor inlined and LLVM runs only the quick passes.
+  bool fastCompile_{false};
+  /// If set, the specializations of libjit are replaced by calls of the
+  /// kernels in the SharedKernelCache of the process.
+  bool shareKernels_{false};
+  /// If set, the offsets of the activations and the addresses of the constant
+  /// weights are emitted as immediates instead of being loaded from the
+  /// offsets array. Only the entries of the mutable weights, which may be
+  /// rebound, and the batch size are loaded at run time.
+  bool embedOffsets_{false};
+  /// If set, the module defines the parallel runtime (glow_parallel_for) that
+  /// is compiled into libjit. Otherwise it calls the runtime of the process,
+  /// or of the module of the bundle that defines it.
+  bool definesRuntime_{false};
+  /// A memory area [begin, end) in one of the memory kinds, accessed by a task.
+  struct MemoryAccess {
+    AllocationsInfo::ValueKind kind;
+    size_t begin;
+    size_t end;
+    bool isWrite;
+  };
+  /// The memory areas accessed by every emitted task.
+  std::vector<std::vector<MemoryAccess>> taskAccesses_;
+  /// The names of the profiled kernels, in the order of their profile entries.
+  std::vector<std::string> profileNames_;
+  /// The analytic cost of a call of every profiled kernel: the operations and
+  /// the bytes, in two consecutive elements.
+  std::vector<uint64_t> profileCosts_;
+  /// The placeholder for the profile while the kernels are emitted. Every
+  /// kernel accumulates its time in nanoseconds and its number of calls into
+  /// two consecutive elements.
+  llvm::GlobalVariable *profile_{nullptr};
+  /// The placeholder for the trace while the kernels are emitted. Every
+  /// kernel stores the times of its last call into its element, see
+  /// emitProfileDumpFunction.
+  llvm::GlobalVariable *trace_{nullptr};
   /// Debug info emission support.
   struct DebugInfo {
     /// Source file for the main function.
@@ -116,6 +220,10 @@ class LLVMIRGen {
   /// the type specified by \p kind.
   llvm::Value *emitConst(llvm::IRBuilder<> &builder, float val,
                          glow::ElemKind kind);
+  /// Generates LLVM IR that loads the trip count of a loop from
+  /// \p tripCountPtr and bounds it by \p maxTripCount.
+  llvm::Value *emitTripCount(llvm::IRBuilder<> &builder,
+                             llvm::Value *tripCountPtr, size_t maxTripCount);
   /// Generates LLVM IR that materializes the constant array \p vals.
   llvm::Value *emitConstArray(llvm::IRBuilder<> &builder,
                               llvm::ArrayRef<size_t> vals);
@@ -128,6 +236,9 @@ class LLVMIRGen {
   /// Generates LLVM IR that computes the dimensions of \p val using \p builder.
   /// The result type is "size_t*".
   llvm::Value *emitValueDims(llvm::IRBuilder<> &builder, glow::Value *val);
+  /// Generates LLVM IR that loads the run-time batch size, which follows the
+  /// offsets of the values in the offsets array.
+  llvm::Value *emitBatchSize(llvm::IRBuilder<> &builder);
   /// Load base addresses of different memory areas (activations, const
   /// weightvars, mutable weight vars) so that they can be reused inside the
   /// body of the function.
@@ -136,6 +247,25 @@ class LLVMIRGen {
   /// in \p stackedInstrs.
   void emitDataParallelKernel(llvm::IRBuilder<> &builder,
                               llvm::ArrayRef<Instruction *> stackedInstrs);
+  /// Emit the code for \p instrs, which is either a single instruction or a
+  /// bundle of stacked data parallel instructions. When emitting tasks, the
+  /// code is placed into a new task function.
+  void emitTask(llvm::IRBuilder<> &builder,
+                llvm::ArrayRef<Instruction *> instrs);
+  /// Emit the code for \p instrs, like emitTask, into the current function.
+  /// When profiling, the code is bracketed by timestamp reads.
+  void emitKernel(llvm::IRBuilder<> &builder,
+                  llvm::ArrayRef<Instruction *> instrs);
+  /// Emit the call of the libjit convDKKC8 kernel for \p CI, a
+  /// CPUConvDKKC8Inst or a CPUResidualConvDKKC8Inst. The output starts with
+  /// the sum of the bias and \p residual, or with the bias if it is null.
+  template <class ConvInstTy>
+  void emitConvDKKC8(llvm::IRBuilder<> &builder, ConvInstTy *CI,
+                     glow::Value *residual);
+  /// Emit the profile of the kernels, the function that dumps it and the
+  /// trace of their last calls, "<entry>_trace". The trace is an array of
+  /// {name, begin, end} elements, one per kernel, that ends with a null name.
+  void emitProfileDumpFunction();
   /// Emit IR for the data parallel instruction \p I which is invoked inside the
   /// stacked \p kernel. The current loop count is described by \p loopCount.
   /// The \p bufferToArgNum map can be used to find the required buffers, which
@@ -143,6 +273,15 @@ class LLVMIRGen {
   void generateLLVMIRForDataParallelInstr(
       llvm::IRBuilder<> &builder, glow::Instruction *I, llvm::Function *kernel,
       llvm::DenseMap<Value *, int> &bufferToArgNum, llvm::Value *loopCount);
+  /// Emit the call of the libjit kernel that InstrGen binds to the
+  /// data-parallel instruction \p I for the element \p loopCount of the
+  /// stacked \p kernel, and store its result. The operands that are fused
+  /// broadcasts are not loaded from memory. \returns false if \p I has no
+  /// binding or is quantized, in which case nothing is emitted.
+  bool emitLibjitKernelCall(llvm::IRBuilder<> &builder, glow::Instruction *I,
+                            llvm::Function *kernel,
+                            llvm::DenseMap<Value *, int> &bufferToArgNum,
+                            llvm::Value *loopCount);
   /// \returns the llvm type of the glow vale \p val.
   llvm::Type *getElementType(llvm::IRBuilder<> &builder, Value *val);
   /// Create a debug information for a given LLVM type \p ty.
@@ -177,6 +316,16 @@ public:
 
   /// Init the TargetMachine using a given target and code model.
   void initTargetMachine(llvm::StringRef T, llvm::CodeModel::Model CM);
+  /// Init the TargetMachine for the target \p T, or the host if it is
+  /// empty, with the CPU \p cpu, the features \p features and the code model
+  /// \p CM.
+  void initTargetMachine(llvm::StringRef T, llvm::StringRef cpu,
+                         const llvm::SmallVectorImpl<std::string> &features,
+                         llvm::CodeModel::Model CM);
+  /// \returns whether the code for the host uses AVX-512 and links in the
+  /// AVX-512 variant of libjit: the host supports it, the variant was built
+  /// and -cpu-avx512 is set.
+  static bool useHostAVX512();
 
   /// Emit LLVM-IR for the instruction \p I, using the builder \p builder.
   void generateLLVMIRForInstr(llvm::IRBuilder<> &builder, glow::Instruction *I);
@@ -186,6 +335,9 @@ public:
   llvm::Function *getFunction(const std::string &name);
   /// \returns a libjit API function by name and tensor element type.
   llvm::Function *getFunction(const std::string &name, glow::ElemKind elemTy);
+  /// \returns the libjit kernel of the data-parallel instruction \p I for the
+  /// element type \p elemTy.
+  llvm::Function *getLibjitKernel(const Instruction *I, glow::ElemKind elemTy);
   /// Creates global variables for the base addresses of different memory areas
   /// and invokes a library function to set their values.
   void
@@ -208,6 +360,10 @@ public:
   void initCodeGen();
   /// Emits the code of the entry function, performs optimizations, etc.
   void performCodeGen();
+  /// Update \p hash with everything that determines the code produced by
+  /// performCodeGen: the IR function, the target machine, the libjit bitcode
+  /// and the code generation options.
+  void hashCodeGenInputs(llvm::MD5 &hash);
   /// \returns the current builder.
   llvm::IRBuilder<> &getBuilder() { return *builder_; }
   /// \returns the target machine description.
@@ -225,6 +381,74 @@ public:
   void setOutputDir(llvm::StringRef outputDir) { outputDir_ = outputDir; }
   /// Get output directory for bundles, debug info files, etc.
   llvm::StringRef getOutputDir() const { return outputDir_; }
+  /// Set the maximal number of threads used by multi-threaded libjit kernels.
+  void setNumThreads(unsigned numThreads) { numThreads_ = numThreads; }
+  /// \returns the maximal number of threads used by multi-threaded kernels.
+  unsigned getNumThreads() const { return numThreads_; }
+  /// Set whether the instructions are emitted as separate task functions. The
+  /// main entry is left empty in this mode and the client is responsible for
+  /// invoking the tasks according to their dependencies.
+  void setEmitTasks(bool emitTasks) { emitTasks_ = emitTasks; }
+  /// \returns the emitted tasks. This is empty if the instructions were
+  /// emitted into the main entry.
+  llvm::ArrayRef<LLVMIRTask> getTasks() const { return tasks_; }
+  /// Set the cache block sizes used by the libjit matrix multiplication.
+  void setGemmBlockSizes(const GemmBlockSizes &sizes) {
+    gemmBlockSizes_ = sizes;
+  }
+  /// \returns the cache block sizes used by the libjit matrix multiplication.
+  const GemmBlockSizes &getGemmBlockSizes() const { return gemmBlockSizes_; }
+  /// Set the database of the tuned parameters of the kernels. The kernels
+  /// that are not in \p db use the default parameters.
+  void setKernelTuningDB(const KernelTuningDB *db) { tuningDB_ = db; }
+  /// \returns the database of the tuned parameters of the kernels, if any.
+  const KernelTuningDB *getKernelTuningDB() const { return tuningDB_; }
+  /// \returns the default parameters of the kernel of \p I, or an empty list
+  /// if the kernel has no tunable parameters.
+  KernelParams getDefaultKernelParams(const Instruction *I) const;
+  /// \returns the parameters of the kernel of \p I, which are the tuned ones
+  /// for the target CPU if the tuning database has them.
+  KernelParams getKernelParams(const Instruction *I) const;
+  /// Find the values whose first dimension is the batch of the inputs and the
+  /// instructions that can compute only the samples of the run-time batch.
+  /// This does nothing unless -cpu-dynamic-batch is set.
+  void findBatchedValues();
+  /// Emit only the code of the tasks whose number is \p partition modulo
+  /// \p numPartitions. The other tasks are still recorded, so that every
+  /// partition has the complete list of the tasks and their dependencies.
+  void setPartition(unsigned partition, unsigned numPartitions) {
+    partition_ = partition;
+    numPartitions_ = numPartitions;
+  }
+  /// \returns whether the code can be split into partitions. The
+  /// instructions must be emitted as tasks, and every partition would define
+  /// the profile and the trace.
+  bool canPartition() const;
+  /// Set whether the module is optimized for the compile time rather than for
+  /// the speed of the code.
+  void setFastCompile(bool fastCompile) { fastCompile_ = fastCompile; }
+  /// Set whether the specializations of libjit call the kernels shared by all
+  /// of the code jitted by the process. The code of a bundle must not.
+  void setShareKernels(bool shareKernels) { shareKernels_ = shareKernels; }
+  /// \returns whether the specializations call the shared kernels.
+  bool getShareKernels() const { return shareKernels_; }
+  /// Set whether the code embeds the offsets of the activations and the
+  /// addresses of the constant weights. The code then depends on the process
+  /// that produced it, so it must not be cached or saved.
+  void setEmbedOffsets(bool embedOffsets) { embedOffsets_ = embedOffsets; }
+  /// \returns whether the code embeds the offsets.
+  bool getEmbedOffsets() const { return embedOffsets_; }
+  /// Set whether the module defines the parallel runtime of libjit. All of
+  /// the code jitted by the process shares the runtime of the process, and
+  /// only one of the modules of a bundle defines it.
+  void setDefinesRuntime(bool definesRuntime) {
+    definesRuntime_ = definesRuntime;
+  }
+  /// \returns the path of the libjit bitcode for the target machine.
+  std::string getStandardLibraryPath() const;
+  /// \returns the batch that the code was compiled for, if the code computes
+  /// the batch size at run time, and 0 otherwise.
+  size_t getMaxBatchSize() const { return maxBatchSize_; }
   /// Emit the array of constant offsets as provided by the \p allocationsInfo.
   llvm::Value *emitConstOffsetsArray(llvm::IRBuilder<> &builder,
                                      const AllocationsInfo &allocationsInfo);
@@ -234,6 +458,11 @@ public:
   llvm::Value *emitStringConst(llvm::IRBuilder<> &builder, llvm::StringRef str);
 };
 
+/// Run the LLVM optimizations over the module \p M for the target machine
+/// \p TM. Only the quick passes run if \p fastCompile is set.
+void runLLVMOptimizations(llvm::Module &M, llvm::TargetMachine &TM,
+                          bool fastCompile);
+
 } // namespace glow
 
 #endif // GLOW_BACKENDS_JIT_LLVMIRGEN_H
@@ -0,0 +1,74 @@
+/**
+ * Copyright (c) 2017-present, Facebook, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include "ObjectCache.h"
+
+#include "llvm/ADT/SmallString.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/Path.h"
+#include "llvm/Support/raw_ostream.h"
+
+using namespace glow;
+
+std::string JITObjectCache::getPath(llvm::StringRef key) const {
+  llvm::SmallString<256> path(dir_);
+  llvm::sys::path::append(path, key + ".o");
+  return path.str();
+}
+
+std::string JITObjectCache::getKey(llvm::MD5 &hash) {
+  llvm::MD5::MD5Result result;
+  hash.final(result);
+  llvm::SmallString<32> key;
+  llvm::MD5::stringifyResult(result, key);
+  return key.str();
+}
+
+std::unique_ptr<llvm::MemoryBuffer>
+JITObjectCache::getObject(llvm::StringRef key) const {
+  auto buffer = llvm::MemoryBuffer::getFile(getPath(key), -1,
+                                            /* RequiresNullTerminator */ false);
+  if (!buffer) {
+    return nullptr;
+  }
+  return std::move(*buffer);
+}
+
+void JITObjectCache::storeObject(llvm::StringRef key,
+                                 llvm::StringRef object) const {
+  if (llvm::sys::fs::create_directories(dir_)) {
+    return;
+  }
+
+  llvm::SmallString<256> tmpPath(dir_);
+  llvm::sys::path::append(tmpPath, key + "-%%%%%%.tmp");
+  int fd;
+  if (llvm::sys::fs::createUniqueFile(tmpPath, fd, tmpPath)) {
+    return;
+  }
+  {
+    llvm::raw_fd_ostream tmpFile(fd, /* shouldClose */ true);
+    tmpFile << object;
+    tmpFile.close();
+    if (tmpFile.has_error()) {
+      tmpFile.clear_error();
+      llvm::sys::fs::remove(tmpPath);
+      return;
+    }
+  }
+  if (llvm::sys::fs::rename(tmpPath, getPath(key))) {
+    llvm::sys::fs::remove(tmpPath);
+  }
+}
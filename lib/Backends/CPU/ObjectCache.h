@@ -0,0 +1,60 @@
+/**
+ * Copyright (c) 2017-present, Facebook, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#ifndef GLOW_BACKENDS_JIT_OBJECTCACHE_H
+#define GLOW_BACKENDS_JIT_OBJECTCACHE_H
+
+#include "llvm/ADT/StringRef.h"
+#include "llvm/Support/MD5.h"
+#include "llvm/Support/MemoryBuffer.h"
+
+#include <memory>
+#include <string>
+
+namespace glow {
+
+/// A persistent cache of jitted object files. Every object file is stored in
+/// its own file in the cache directory, named after the hash of everything
+/// that went into producing it. The cache allows a process to skip the LLVM
+/// optimizations and the machine code generation when it compiles a network
+/// that has been compiled before.
+class JITObjectCache {
+  /// The directory where the object files are stored.
+  std::string dir_;
+
+  /// \returns the path of the object file for \p key.
+  std::string getPath(llvm::StringRef key) const;
+
+public:
+  /// Create a cache that stores the object files in \p dir. The directory is
+  /// created when the first object file is stored.
+  explicit JITObjectCache(llvm::StringRef dir) : dir_(dir) {}
+
+  /// \returns the key for the hash \p hash of the inputs of the compilation.
+  static std::string getKey(llvm::MD5 &hash);
+
+  /// \returns the object file cached for \p key, or nullptr if there is none.
+  std::unique_ptr<llvm::MemoryBuffer> getObject(llvm::StringRef key) const;
+
+  /// Store the object file \p object for \p key. The file is written to a
+  /// temporary file first and then renamed, so that concurrent processes
+  /// never observe a partially written object file. Failures to write the
+  /// cache are not fatal, the object file is simply not cached.
+  void storeObject(llvm::StringRef key, llvm::StringRef object) const;
+};
+
+} // namespace glow
+
+#endif // GLOW_BACKENDS_JIT_OBJECTCACHE_H
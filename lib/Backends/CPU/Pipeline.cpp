@@ -64,6 +64,11 @@ void LLVMIRGen::optimizeLLVMModule(llvm::Function *F, llvm::TargetMachine &TM) {
     // Do not internalize declarations.
     if (GV.isDeclaration())
       return true;
+    // The partitions of the code export only their tasks and "jitmain", so
+    // that the definitions that they share don't clash.
+    if (numPartitions_ > 1)
+      return name == "jitmain" ||
+             name.startswith(getMainEntryName() + "_task");
     // Do not preserve any internal symbols, which typically have no name or
     // start with jit_
     if (name.empty() || name.startswith("libjit_"))
@@ -82,16 +87,17 @@ void LLVMIRGen::optimizeLLVMModule(llvm::Function *F, llvm::TargetMachine &TM) {
     FF.removeFnAttr(llvm::Attribute::AttrKind::NoInline);
   }
 
-  // Perform specialization of functions for constant arguments before anything
-  // else.
-  performSpecialization();
-
-  llvm::PassManagerBuilder PMB;
-  PMB.OptLevel = 2;
-  PMB.SizeLevel = 0;
-  PMB.LoopVectorize = true;
-  PMB.SLPVectorize = false;
-  PMB.Inliner = llvm::createFunctionInliningPass();
+  if (fastCompile_) {
+    // Drop the libjit functions that the code doesn't call before running the
+    // function passes over the module.
+    llvm::legacy::PassManager DCE;
+    DCE.add(llvm::createGlobalDCEPass());
+    DCE.run(*M);
+  } else {
+    // Perform specialization of functions for constant arguments before
+    // anything else.
+    performSpecialization();
+  }
 
   M->setTargetTriple(TM.getTargetTriple().normalize());
   M->setDataLayout(TM.createDataLayout());
@@ -108,7 +114,7 @@ void LLVMIRGen::optimizeLLVMModule(llvm::Function *F, llvm::TargetMachine &TM) {
     // Clear all attributes.
     FF.setAttributes(AL);
     // Force inline all non-no-inline functions.
-    if (!dontInline) {
+    if (!dontInline && !fastCompile_) {
       FF.addFnAttr(llvm::Attribute::AttrKind::AlwaysInline);
     }
     if (dontInline) {
@@ -125,7 +131,20 @@ void LLVMIRGen::optimizeLLVMModule(llvm::Function *F, llvm::TargetMachine &TM) {
   // inlined.
   M->getFunction("main")->addFnAttr(llvm::Attribute::AttrKind::AlwaysInline);
 
-  llvm::legacy::FunctionPassManager FPM(M);
+  runLLVMOptimizations(*M, TM, fastCompile_);
+}
+
+void glow::runLLVMOptimizations(llvm::Module &M, llvm::TargetMachine &TM,
+                                bool fastCompile) {
+  llvm::PassManagerBuilder PMB;
+  PMB.OptLevel = fastCompile ? 1 : 2;
+  PMB.SizeLevel = 0;
+  PMB.LoopVectorize = !fastCompile;
+  PMB.SLPVectorize = false;
+  // The quick code calls the libjit functions instead of inlining them.
+  PMB.Inliner = fastCompile ? nullptr : llvm::createFunctionInliningPass();
+
+  llvm::legacy::FunctionPassManager FPM(&M);
   llvm::legacy::PassManager PM;
 
   // Add internal analysis passes from the target machine.
@@ -135,10 +154,10 @@ void LLVMIRGen::optimizeLLVMModule(llvm::Function *F, llvm::TargetMachine &TM) {
   PMB.populateFunctionPassManager(FPM);
   PMB.populateModulePassManager(PM);
   FPM.doInitialization();
-  PM.run(*M);
-  for (auto &FF : *M) {
+  PM.run(M);
+  for (auto &FF : M) {
     FPM.run(FF);
   }
   FPM.doFinalization();
-  PM.run(*M);
+  PM.run(M);
 }
@@ -0,0 +1,180 @@
+/**
+ * Copyright (c) 2017-present, Facebook, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include "ThreadPool.h"
+
+#include <algorithm>
+#include <cassert>
+
+using namespace glow;
+
+unsigned TaskGraph::addTask(llvm::ArrayRef<unsigned> deps) {
+  unsigned idx = numDeps_.size();
+  numDeps_.push_back(deps.size());
+  successors_.emplace_back();
+  for (auto dep : deps) {
+    assert(dep < idx && "Tasks may only depend on earlier tasks");
+    successors_[dep].push_back(idx);
+  }
+  return idx;
+}
+
+void TaskGraph::clear() {
+  numDeps_.clear();
+  successors_.clear();
+}
+
+ThreadPool::ThreadPool(unsigned numThreads) {
+  numThreads = std::max(1u, numThreads);
+  for (unsigned i = 0; i < numThreads; i++) {
+    queues_.push_back(std::unique_ptr<WorkQueue>(new WorkQueue));
+  }
+  for (unsigned i = 1; i < numThreads; i++) {
+    workers_.emplace_back(&ThreadPool::workerLoop, this, i);
+  }
+}
+
+ThreadPool::~ThreadPool() {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    shutdown_ = true;
+  }
+  wakeup_.notify_all();
+  for (auto &worker : workers_) {
+    worker.join();
+  }
+}
+
+void ThreadPool::push(unsigned id, unsigned task) {
+  auto &queue = *queues_[id];
+  std::lock_guard<std::mutex> lock(queue.mutex);
+  queue.tasks.push_back(task);
+}
+
+bool ThreadPool::pop(unsigned id, unsigned &task) {
+  // Take the most recent task from our own queue.
+  {
+    auto &queue = *queues_[id];
+    std::lock_guard<std::mutex> lock(queue.mutex);
+    if (!queue.tasks.empty()) {
+      task = queue.tasks.back();
+      queue.tasks.pop_back();
+      return true;
+    }
+  }
+
+  // Steal the oldest task from one of the other queues.
+  for (size_t i = 1, e = queues_.size(); i < e; i++) {
+    auto &queue = *queues_[(id + i) % e];
+    std::lock_guard<std::mutex> lock(queue.mutex);
+    if (!queue.tasks.empty()) {
+      task = queue.tasks.front();
+      queue.tasks.pop_front();
+      return true;
+    }
+  }
+  return false;
+}
+
+void ThreadPool::work(unsigned id) {
+  while (remaining_.load() != 0) {
+    unsigned task;
+    if (!pop(id, task)) {
+      // The remaining tasks are running on other threads or wait for them.
+      std::this_thread::yield();
+      continue;
+    }
+
+    (*fn_)(task);
+
+    // Release the tasks that only waited for this task.
+    for (auto succ : graph_->getSuccessors(task)) {
+      if (pendingDeps_[succ].fetch_sub(1) == 1) {
+        push(id, succ);
+      }
+    }
+    remaining_.fetch_sub(1);
+  }
+}
+
+void ThreadPool::workerLoop(unsigned id) {
+  unsigned generation = 0;
+  while (true) {
+    {
+      std::unique_lock<std::mutex> lock(mutex_);
+      wakeup_.wait(lock,
+                   [&] { return shutdown_ || generation_ != generation; });
+      if (shutdown_) {
+        return;
+      }
+      generation = generation_;
+    }
+
+    work(id);
+
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      if (--activeWorkers_ == 0) {
+        done_.notify_one();
+      }
+    }
+  }
+}
+
+void ThreadPool::run(const TaskGraph &graph,
+                     const std::function<void(unsigned)> &fn) {
+  size_t numTasks = graph.size();
+  if (numTasks == 0) {
+    return;
+  }
+
+  // Without workers simply run the tasks in order.
+  if (workers_.empty()) {
+    for (unsigned i = 0; i < numTasks; i++) {
+      fn(i);
+    }
+    return;
+  }
+
+  graph_ = &graph;
+  fn_ = &fn;
+  pendingDeps_.reset(new std::atomic<unsigned>[numTasks]);
+  remaining_ = numTasks;
+
+  // Spread the tasks that are ready from the start over all of the queues.
+  unsigned next = 0;
+  for (unsigned i = 0; i < numTasks; i++) {
+    pendingDeps_[i] = graph.getNumDeps(i);
+    if (graph.getNumDeps(i) == 0) {
+      push(next, i);
+      next = (next + 1) % queues_.size();
+    }
+  }
+
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    activeWorkers_ = workers_.size();
+    generation_++;
+  }
+  wakeup_.notify_all();
+
+  work(0);
+
+  // Wait for the workers to leave the graph before releasing it.
+  std::unique_lock<std::mutex> lock(mutex_);
+  done_.wait(lock, [&] { return activeWorkers_ == 0; });
+  graph_ = nullptr;
+  fn_ = nullptr;
+}
@@ -0,0 +1,130 @@
+/**
+ * Copyright (c) 2017-present, Facebook, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#ifndef GLOW_BACKENDS_JIT_THREADPOOL_H
+#define GLOW_BACKENDS_JIT_THREADPOOL_H
+
+#include "llvm/ADT/ArrayRef.h"
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace glow {
+
+/// A directed acyclic graph of tasks, which are identified by their index.
+/// Tasks may only depend on tasks with a lower index, so running the tasks in
+/// the order of their indices is always valid.
+class TaskGraph {
+  /// The number of tasks that every task depends on.
+  std::vector<unsigned> numDeps_;
+  /// The tasks that depend on every task.
+  std::vector<std::vector<unsigned>> successors_;
+
+public:
+  /// Add a new task that can start once all of the tasks in \p deps are done.
+  /// \returns the index of the new task.
+  unsigned addTask(llvm::ArrayRef<unsigned> deps);
+
+  /// \returns the number of tasks in the graph.
+  size_t size() const { return numDeps_.size(); }
+
+  /// \returns the number of tasks that the task \p idx depends on.
+  unsigned getNumDeps(unsigned idx) const { return numDeps_[idx]; }
+
+  /// \returns the tasks that depend on the task \p idx.
+  llvm::ArrayRef<unsigned> getSuccessors(unsigned idx) const {
+    return successors_[idx];
+  }
+
+  /// Remove all of the tasks.
+  void clear();
+};
+
+/// A pool of threads that runs task graphs. Every thread owns a queue of the
+/// tasks that are ready to run. A thread pushes the tasks that it makes ready
+/// to its own queue and takes the most recent task from it, which keeps the
+/// producers and the consumers of the data on the same core. A thread with an
+/// empty queue steals the oldest task from the queue of another thread.
+class ThreadPool {
+  /// A queue of the tasks that are ready to run.
+  struct WorkQueue {
+    std::mutex mutex;
+    std::deque<unsigned> tasks;
+  };
+
+  /// The worker threads. The thread that calls run() works as well.
+  std::vector<std::thread> workers_;
+  /// The queues of ready tasks. The queue at index 0 belongs to the thread
+  /// that calls run() and the other queues belong to the workers.
+  std::vector<std::unique_ptr<WorkQueue>> queues_;
+
+  /// Protects the state that the workers sleep on.
+  std::mutex mutex_;
+  /// Wakes up the workers when a new graph is submitted or on shutdown.
+  std::condition_variable wakeup_;
+  /// Signals the end of the run to the thread that called run().
+  std::condition_variable done_;
+  /// Incremented for every graph submitted to the workers.
+  unsigned generation_{0};
+  /// The number of workers that haven't finished the current graph yet.
+  unsigned activeWorkers_{0};
+  /// Set when the pool is destroyed.
+  bool shutdown_{false};
+
+  /// The graph that is currently running.
+  const TaskGraph *graph_{nullptr};
+  /// The function that runs a single task of the current graph.
+  const std::function<void(unsigned)> *fn_{nullptr};
+  /// The number of unfinished dependencies of every task in the graph.
+  std::unique_ptr<std::atomic<unsigned>[]> pendingDeps_;
+  /// The number of tasks in the graph that haven't finished yet.
+  std::atomic<size_t> remaining_{0};
+
+  /// The main loop of the worker thread \p id.
+  void workerLoop(unsigned id);
+  /// Run the tasks of the current graph on the thread \p id until all of them
+  /// are done.
+  void work(unsigned id);
+  /// Push the ready task \p task to the queue of the thread \p id.
+  void push(unsigned id, unsigned task);
+  /// Take a task from the queue of the thread \p id, or steal one from the
+  /// queue of another thread. \returns false if no task was found.
+  bool pop(unsigned id, unsigned &task);
+
+public:
+  /// Create a pool of \p numThreads threads, which includes the thread that
+  /// calls run(). A pool of a single thread runs the tasks serially.
+  explicit ThreadPool(unsigned numThreads);
+
+  ~ThreadPool();
+
+  /// \returns the number of threads that run the tasks.
+  unsigned getNumThreads() const { return queues_.size(); }
+
+  /// Run all of the tasks in \p graph by calling \p fn with the index of every
+  /// task. A task starts only after all of its dependencies are done. Returns
+  /// once all of the tasks are done.
+  void run(const TaskGraph &graph, const std::function<void(unsigned)> &fn);
+};
+
+} // namespace glow
+
+#endif // GLOW_BACKENDS_JIT_THREADPOOL_H
@@ -15,92 +15,850 @@
  */
 
 #include "CPUBackend.h"
+#include "CommandLine.h"
 
 #include "glow/Graph/Graph.h"
 #include "glow/Graph/Nodes.h"
+#include "glow/Graph/Utils.h"
+
+#include <algorithm>
+#include <unordered_map>
+#include <vector>
 
 using namespace glow;
+using llvm::cast;
 using llvm::dyn_cast;
 using llvm::isa;
+using llvm::dyn_cast_or_null;
+
+static llvm::cl::opt<bool> blockedLayout(
+    "cpu-blocked-layout",
+    llvm::cl::desc("Keep the activations between the convolutions in the "
+                   "blocked layout [N, C/8, H, W, 8] and run the element-wise "
+                   "operations and the pooling on it. The activations are "
+                   "converted from and to NHWC only where the blocked "
+                   "region ends"),
+    llvm::cl::init(false), llvm::cl::cat(CPUBackendCat));
+
+namespace {
+/// The weights that the transforms below derived from the private variables
+/// of a function, by the variable. The nodes that read the same variable, e.g.
+/// the copies of a layer that run on micro-batches, read the same derived
+/// weights.
+struct DerivedWeights {
+  /// The number of the uses of every variable as the filter of a convolution
+  /// or the RHS of a matrix multiplication, which the transforms replace.
+  std::unordered_map<Variable *, unsigned> uses;
+  std::unordered_map<Variable *, Variable *> dkkc;
+  std::unordered_map<Variable *, std::pair<Variable *, Variable *>> quantized;
+  std::unordered_map<Variable *, Variable *> winograd;
+  std::unordered_map<Variable *, Variable *> im2col;
+  /// The packed RHS, by whether it is read transposed.
+  std::unordered_map<Variable *, Variable *> packed[2];
+  std::unordered_map<Variable *, Variable *> blocked;
+
+  /// Count the uses of the variables by the nodes of \p F.
+  void countUses(Function *F) {
+    uses.clear();
+    for (auto *N : F->getNodes()) {
+      Node *W = nullptr;
+      if (auto *CN = dyn_cast<ConvolutionNode>(N)) {
+        W = CN->getFilter().getNode();
+      } else if (auto *MM = dyn_cast<MatMulNode>(N)) {
+        W = MM->getRHS().getNode();
+      }
+      if (auto *V = dyn_cast_or_null<Variable>(W)) {
+        uses[V]++;
+      }
+    }
+  }
+
+  /// \returns true if the layout of \p W may be changed at compile time: it
+  /// is a private variable that only the nodes that the transforms replace
+  /// read, so that the variable is deleted once they are replaced.
+  bool canTransform(Node *W) const {
+    auto *V = dyn_cast_or_null<Variable>(W);
+    if (!V || !V->isPrivate()) {
+      return false;
+    }
+    // The variables that the transforms create are used once.
+    auto it = uses.find(V);
+    unsigned numUses = it != uses.end() ? it->second : 1;
+    return numUses == V->getNumUsers();
+  }
+};
+} // namespace
 
 /// Try to optimize the regular Convolution into a target-specific convolution
 /// with a different filter memory layout. This optimization adds a new kind of
 /// cpu-specific convolution that operates on filter weight data in a
 /// non-standard format. The default format is DKKC, where D is the output
 /// depth of the filter and C is the input channel, and K is the kernel size.
-/// This optimization changes the data layout to [D/8, K, K, C, 8].  We
-/// pre-swizzle the data in the weights to make the access pattern more
-/// efficient.
-static Node *optimizeCPUConv(ConvolutionNode *CN, Function *F) {
+/// This optimization changes the data layout to [D/B, K, K, C, B], where the
+/// block B is \p blockWidth output channels, or 8 if the depth is not a
+/// multiple of it. We pre-swizzle the data in the weights to make the access
+/// pattern more efficient.
+static Node *optimizeCPUConv(ConvolutionNode *CN, Function *F,
+                             DerivedWeights &W, size_t blockWidth) {
   auto depth = CN->getFilter().dims()[0];
   auto *M = F->getParent();
 
-  // The depth dimension must be a multiple of 64 to perform the
-  // transformation. This transformation is currently only profitable on
-  // low-channel convolutions.
-  if (depth < 64 || (depth % 64) != 0) {
+  // The kernel computes groups of 8 output channels, so the depth dimension
+  // must be a multiple of 8. The grouped convolutions have their own kernel.
+  if ((depth % 8) != 0 || CN->getGroup() != 1) {
     return nullptr;
   }
+  if ((depth % blockWidth) != 0) {
+    blockWidth = 8;
+  }
 
-  Variable *filter = dyn_cast<Variable>(CN->getFilter());
-  if (!filter || filter->getNumUsers() != 1 || !filter->isPrivate()) {
+  if (!W.canTransform(CN->getFilter())) {
     // Can't mutate the filter.
     return nullptr;
   }
+  auto *filter = cast<Variable>(CN->getFilter());
 
   // We only support Floats for now.
   if (filter->getElementType() != ElemKind::FloatTy) {
     return nullptr;
   }
 
-  // Create a new variable filter with the layout [D/8, K, K, C, 8];
-  TypeRef filterTy = filter->getType();
-  auto dims = filterTy->dims();
-  assert(dims.size() == 4 && "Invalid filter size");
-  auto *filter8 = M->createVariable(
-      filterTy->getElementType(), {dims[0] / 8, dims[1], dims[2], dims[3], 8},
-      filter->getName(), VisibilityKind::Private, Variable::TrainKind::None);
+  // Create a new variable filter with the layout [D/B, K, K, C, B];
+  Variable *&blockedFilter = W.dkkc[filter];
+  if (!blockedFilter) {
+    TypeRef filterTy = filter->getType();
+    auto dims = filterTy->dims();
+    assert(dims.size() == 4 && "Invalid filter size");
+    blockedFilter = M->createVariable(
+        filterTy->getElementType(),
+        {dims[0] / blockWidth, dims[1], dims[2], dims[3], blockWidth},
+        filter->getName(), VisibilityKind::Private, Variable::TrainKind::None);
 
-  auto F8H = filter8->getHandle();
-  auto FH = filter->getHandle();
+    auto BFH = blockedFilter->getHandle();
+    auto FH = filter->getHandle();
 
-  // Transpose the weights into the format [D/8, K, K, C, 8], where the depth
-  // dimension is consecutive in memory.
-  for (size_t c0 = 0; c0 < dims[0]; c0++)
-    for (size_t c1 = 0; c1 < dims[1]; c1++)
-      for (size_t c2 = 0; c2 < dims[2]; c2++)
-        for (size_t c3 = 0; c3 < dims[3]; c3++) {
-          F8H.at({c0 / 8, c1, c2, c3, c0 % 8}) = FH.at({c0, c1, c2, c3});
-        }
+    // Transpose the weights into the format [D/B, K, K, C, B], where the depth
+    // dimension is consecutive in memory.
+    for (size_t c0 = 0; c0 < dims[0]; c0++)
+      for (size_t c1 = 0; c1 < dims[1]; c1++)
+        for (size_t c2 = 0; c2 < dims[2]; c2++)
+          for (size_t c3 = 0; c3 < dims[3]; c3++) {
+            BFH.at({c0 / blockWidth, c1, c2, c3, c0 % blockWidth}) =
+                FH.at({c0, c1, c2, c3});
+          }
+  }
 
   return F->addNode(new CPUConvDKKC8Node(
-      CN->getName(), CN->getType(), CN->getInput(), filter8, CN->getBias(),
-      CN->getKernel(), CN->getStride(), CN->getPad()));
+      CN->getName(), CN->getType(), CN->getInput(), blockedFilter,
+      CN->getBias(), CN->getKernel(), CN->getStride(), CN->getPad(),
+      unsigned(CPUActivation::None), 0));
+}
+
+/// Try to optimize the int8 Convolution into the CPU-specific convolution with
+/// the filter layout [D/8, K, K, C, 8], like optimizeCPUConv. The filter
+/// offset is subtracted at compile time, which widens the filter to int16, so
+/// that the kernel accumulates the plain products of the filter and the input
+/// in int32. The input offset is corrected once per filter tap, with the sums
+/// of the filter over the input channels of every tap, instead of once per
+/// multiplication. The correction has to be per tap because the taps in the
+/// padding don't contribute.
+static Node *optimizeCPUQuantizedConv(ConvolutionNode *CN, Function *F,
+                                      DerivedWeights &W) {
+  auto depth = CN->getFilter().dims()[0];
+  auto *M = F->getParent();
+
+  if (CN->getGroup() != 1 || (depth % 8) != 0 ||
+      CN->getInput().getElementType() != ElemKind::Int8QTy ||
+      CN->getBias().getElementType() != ElemKind::Int8QTy) {
+    return nullptr;
+  }
+
+  if (!W.canTransform(CN->getFilter()) ||
+      CN->getFilter().getElementType() != ElemKind::Int8QTy) {
+    // Can't mutate the filter.
+    return nullptr;
+  }
+  auto *filter = cast<Variable>(CN->getFilter());
+
+  auto &derived = W.quantized[filter];
+  Variable *&filter8 = derived.first;
+  Variable *&tapSums = derived.second;
+  if (!filter8) {
+    TypeRef filterTy = filter->getType();
+    auto dims = filterTy->dims();
+    assert(dims.size() == 4 && "Invalid filter size");
+    filter8 = M->createVariable(
+        ElemKind::Int16QTy, {dims[0] / 8, dims[1], dims[2], dims[3], 8},
+        filterTy->getScale(), 0, filter->getName(), VisibilityKind::Private,
+        Variable::TrainKind::None);
+    tapSums = M->createVariable(
+        ElemKind::Int32QTy, {dims[0] / 8, dims[1], dims[2], 8}, 1, 0,
+        filter->getName().str() + "_tap_sums", VisibilityKind::Private,
+        Variable::TrainKind::None);
+
+    auto F8H = filter8->getHandle<int16_t>();
+    auto TSH = tapSums->getHandle<int32_t>();
+    auto FH = filter->getHandle<int8_t>();
+    int32_t filterOffset = filterTy->getOffset();
+
+    for (size_t c0 = 0; c0 < dims[0]; c0++)
+      for (size_t c1 = 0; c1 < dims[1]; c1++)
+        for (size_t c2 = 0; c2 < dims[2]; c2++) {
+          int32_t sum = 0;
+          for (size_t c3 = 0; c3 < dims[3]; c3++) {
+            int32_t w = int32_t(FH.at({c0, c1, c2, c3})) - filterOffset;
+            F8H.at({c0 / 8, c1, c2, c3, c0 % 8}) = w;
+            sum += w;
+          }
+          TSH.at({c0 / 8, c1, c2, c0 % 8}) = sum;
+        }
+  }
+
+  return F->addNode(new CPUQuantizedConvDKKC8Node(
+      CN->getName(), CN->getType(), CN->getInput(), filter8, tapSums,
+      CN->getBias(), CN->getKernel(), CN->getStride(), CN->getPad()));
+}
+
+/// The width of the panels of a packed matrix. This must match the panel width
+/// used by the libjit matrix multiplication.
+static constexpr size_t matMulPanelWidth = 32;
+
+/// The smallest output depth for which the GEMM-based convolutions are
+/// profitable. Narrower outputs don't fill the register block of the matrix
+/// multiplication micro-kernel.
+static constexpr size_t gemmConvMinDepth = 16;
+
+/// The smallest filter slice (K * K * C) for which the GEMM-based convolution
+/// is profitable. Shorter dot products don't amortize the cost of unfolding
+/// the input.
+static constexpr size_t im2colMinSliceSize = 32;
+
+/// The largest number of elements that we allow in a scratch tensor of the
+/// GEMM-based convolutions. This keeps the buffers that the activation
+/// allocator has to provide at 256MB or less.
+static constexpr size_t convMaxScratchSize = 64 * 1024 * 1024;
+
+/// The smallest number of input channels for which the Winograd convolution
+/// is profitable. The transformation of the input costs a fixed number of
+/// operations per channel and per tile that the reduced multiplication has
+/// to amortize.
+static constexpr size_t winogradMinChannels = 16;
+
+/// Try to optimize the regular 3x3 Convolution with a unit stride into a
+/// Winograd F(2x2, 3x3) convolution. Each 2x2 output tile is computed from a
+/// 4x4 input tile with 16 multiplications per channel pair instead of 36.
+/// The convolution is split into three nodes: the input tiles are transformed
+/// into a [16, T, C] tensor, where T is the number of tiles, then each one of
+/// the 16 tile elements is multiplied as a [T, C] matrix with the [C, D]
+/// transformed filter, which is computed at compile time and pre-packed into
+/// the shape [16, D/32, C, 32], and finally the [16, T, D] products are
+/// transformed back into the output tiles. The intermediate tensors are
+/// regular activations.
+static Node *optimizeCPUConvWinograd(ConvolutionNode *CN, Function *F,
+                                     DerivedWeights &W) {
+  auto *M = F->getParent();
+
+  if (CN->getKernel() != 3 || CN->getStride() != 1 || CN->getGroup() != 1) {
+    return nullptr;
+  }
+
+  if (!W.canTransform(CN->getFilter())) {
+    // Can't mutate the filter.
+    return nullptr;
+  }
+  auto *filter = cast<Variable>(CN->getFilter());
+
+  // We only support Floats for now.
+  if (filter->getElementType() != ElemKind::FloatTy ||
+      CN->getInput().getElementType() != ElemKind::FloatTy) {
+    return nullptr;
+  }
+
+  ShapeNHWC idim(CN->getInput().dims());
+  ShapeNHWC odim(CN->getResult().dims());
+  size_t depth = odim.c;
+  size_t numTiles = odim.n * ((odim.h + 1) / 2) * ((odim.w + 1) / 2);
+
+  if (depth < gemmConvMinDepth || idim.c < winogradMinChannels ||
+      16 * numTiles * std::max(idim.c, depth) > convMaxScratchSize) {
+    return nullptr;
+  }
+
+  // Create a new variable filter with the layout [16, D/32, C, 32], where the
+  // last panel is padded with zeros.
+  Variable *&filterW = W.winograd[filter];
+  if (!filterW) {
+    auto dims = filter->getType()->dims();
+    assert(dims.size() == 4 && "Invalid filter size");
+    size_t numPanels = (depth + matMulPanelWidth - 1) / matMulPanelWidth;
+    filterW = M->createVariable(
+        filter->getElementType(), {16, numPanels, idim.c, matMulPanelWidth},
+        filter->getName(), VisibilityKind::Private, Variable::TrainKind::None);
+
+    auto FWH = filterW->getHandle();
+    auto FH = filter->getHandle();
+
+    // Transform every 3x3 filter slice g into the 4x4 tile U = G * g * G^T.
+    for (size_t d = 0; d < dims[0]; d++)
+      for (size_t c = 0; c < dims[3]; c++) {
+        float g[3][3];
+        for (size_t i = 0; i < 3; i++)
+          for (size_t j = 0; j < 3; j++) {
+            g[i][j] = FH.at({d, i, j, c});
+          }
+
+        // tmp = G * g.
+        float tmp[4][3];
+        for (size_t j = 0; j < 3; j++) {
+          tmp[0][j] = g[0][j];
+          tmp[1][j] = (g[0][j] + g[1][j] + g[2][j]) / 2;
+          tmp[2][j] = (g[0][j] - g[1][j] + g[2][j]) / 2;
+          tmp[3][j] = g[2][j];
+        }
+
+        // U = tmp * G^T.
+        for (size_t i = 0; i < 4; i++) {
+          float u[4] = {tmp[i][0], (tmp[i][0] + tmp[i][1] + tmp[i][2]) / 2,
+                        (tmp[i][0] - tmp[i][1] + tmp[i][2]) / 2, tmp[i][2]};
+          for (size_t j = 0; j < 4; j++) {
+            FWH.at(
+                {i * 4 + j, d / matMulPanelWidth, c, d % matMulPanelWidth}) =
+                u[j];
+          }
+        }
+      }
+  }
+
+  auto inTy = M->uniqueTypeWithNewShape(CN->getInput().getType(),
+                                        {16, numTiles, idim.c});
+  auto *in = F->addNode(new CPUWinogradInputNode(CN->getName(), inTy,
+                                                 CN->getInput(), CN->getPad()));
+  auto mulTy = M->uniqueTypeWithNewShape(CN->getType(), {16, numTiles, depth});
+  auto *mul = F->addNode(
+      new CPUWinogradMultiplyNode(CN->getName(), mulTy, in, filterW));
+  return F->addNode(new CPUWinogradOutputNode(
+      CN->getName(), CN->getType(), mul, CN->getBias(),
+      unsigned(CPUActivation::None), 0));
+}
+
+/// Try to optimize the regular Convolution into a matrix multiplication that
+/// runs on the optimized libjit GEMM. The input is unfolded (im2col) into a
+/// matrix with one row per output pixel and one column per filter tap, of the
+/// shape [N * OH * OW, K * K * C]. The filter is transposed at compile time
+/// into a [K * K * C, D] matrix, so the convolution becomes a MatMul followed
+/// by a BatchedAdd of the bias. The unfolded input is a regular activation and
+/// its memory is managed by the activation allocator. 1x1 convolutions with a
+/// unit stride and no padding don't need the unfolding and just reshape the
+/// input.
+static Node *optimizeCPUConvIm2Col(ConvolutionNode *CN, Function *F,
+                                   DerivedWeights &W) {
+  auto *M = F->getParent();
+
+  // Grouped convolutions are lowered into a series of regular convolutions.
+  if (CN->getGroup() != 1) {
+    return nullptr;
+  }
+
+  if (!W.canTransform(CN->getFilter())) {
+    // Can't mutate the filter.
+    return nullptr;
+  }
+  auto *filter = cast<Variable>(CN->getFilter());
+
+  // We only support Floats for now.
+  if (filter->getElementType() != ElemKind::FloatTy ||
+      CN->getInput().getElementType() != ElemKind::FloatTy) {
+    return nullptr;
+  }
+
+  ShapeNHWC idim(CN->getInput().dims());
+  ShapeNHWC odim(CN->getResult().dims());
+  size_t kernel = CN->getKernel();
+  size_t depth = odim.c;
+  size_t sliceSize = kernel * kernel * idim.c;
+  size_t numRows = odim.n * odim.h * odim.w;
+
+  // Don't transform the convolutions that the GEMM doesn't handle well, and
+  // don't allocate huge scratch buffers.
+  if (depth < gemmConvMinDepth || sliceSize < im2colMinSliceSize ||
+      numRows * sliceSize > convMaxScratchSize) {
+    return nullptr;
+  }
+
+  // Create a new variable filter with the layout [K * K * C, D].
+  Variable *&filterT = W.im2col[filter];
+  if (!filterT) {
+    auto dims = filter->getType()->dims();
+    assert(dims.size() == 4 && "Invalid filter size");
+    filterT = M->createVariable(
+        filter->getElementType(), {sliceSize, depth}, filter->getName(),
+        VisibilityKind::Private, Variable::TrainKind::None);
+
+    auto FTH = filterT->getHandle();
+    auto FH = filter->getHandle();
+
+    // The row of the transposed filter is the position of the tap in the
+    // filter slice [K, K, C], which matches the columns of the unfolded input.
+    for (size_t d = 0; d < dims[0]; d++)
+      for (size_t fx = 0; fx < dims[1]; fx++)
+        for (size_t fy = 0; fy < dims[2]; fy++)
+          for (size_t c = 0; c < dims[3]; c++) {
+            size_t row = (fx * dims[2] + fy) * dims[3] + c;
+            FTH.at({row, d}) = FH.at({d, fx, fy, c});
+          }
+  }
+  // The new MatMul may be packed too.
+  W.uses[filterT]++;
+
+  Node *cols;
+  if (kernel == 1 && CN->getStride() == 1 && CN->getPad() == 0) {
+    cols = F->createReshape(CN->getName(), CN->getInput(), {numRows, idim.c});
+  } else {
+    auto colsTy = M->uniqueTypeWithNewShape(CN->getInput().getType(),
+                                            {numRows, sliceSize});
+    cols = F->addNode(new CPUIm2ColNode(CN->getName(), colsTy, CN->getInput(),
+                                        kernel, CN->getStride(),
+                                        CN->getPad()));
+  }
+
+  auto mmTy = M->uniqueTypeWithNewShape(CN->getType(), {numRows, depth});
+  auto *MM = F->createMatMul(CN->getName(), mmTy, cols, filterT);
+  auto *BA = F->createBatchedAdd(CN->getName(), mmTy, MM, CN->getBias());
+  return F->createReshape(CN->getName(), BA, CN->getResult().dims());
+}
+
+/// Try to optimize the regular MatMul with a constant RHS matrix into a
+/// target-specific matrix multiplication that operates on a pre-packed RHS.
+/// The default layout of the RHS is [K, N]. This optimization changes the
+/// layout to [N/32, K, 32], where the last panel is padded with zeros. This
+/// is the format that the libjit matrix multiplication packs the RHS into
+/// before every multiplication, so doing it once at compile time removes the
+/// packing cost from every inference. A transposed RHS with the layout [N, K]
+/// is transposed by the packing.
+static Node *optimizeCPUMatMul(MatMulNode *MM, Function *F,
+                               DerivedWeights &W) {
+  auto *M = F->getParent();
+
+  // The packed kernels read the LHS in the regular layout.
+  if (MM->getTransposeLHS()) {
+    return nullptr;
+  }
+
+  if (!W.canTransform(MM->getRHS())) {
+    // Can't mutate the weights.
+    return nullptr;
+  }
+  auto *rhs = cast<Variable>(MM->getRHS());
+
+  // We only support Floats for now.
+  if (rhs->getElementType() != ElemKind::FloatTy) {
+    return nullptr;
+  }
+
+  // Create a new variable with the layout [N/32, K, 32]. The RHS is read
+  // either transposed or not by all of its users, because the packed layout
+  // is computed once.
+  bool transposed = MM->getTransposeRHS();
+  auto &packedMap = W.packed[transposed];
+  Variable *&packed = packedMap[rhs];
+  if (!packed) {
+    TypeRef rhsTy = rhs->getType();
+    auto dims = rhsTy->dims();
+    assert(dims.size() == 2 && "Invalid matrix size");
+    size_t K = transposed ? dims[1] : dims[0];
+    size_t N = transposed ? dims[0] : dims[1];
+    size_t numPanels = (N + matMulPanelWidth - 1) / matMulPanelWidth;
+    packed = M->createVariable(
+        rhsTy->getElementType(), {numPanels, K, matMulPanelWidth},
+        rhs->getName(), VisibilityKind::Private, Variable::TrainKind::None);
+
+    auto PH = packed->getHandle();
+    auto RH = rhs->getHandle();
+
+    // The new variable is zero-initialized, so the padding of the last panel
+    // is already in place.
+    for (size_t k = 0; k < K; k++)
+      for (size_t n = 0; n < N; n++) {
+        PH.at({n / matMulPanelWidth, k, n % matMulPanelWidth}) =
+            transposed ? RH.at({n, k}) : RH.at({k, n});
+      }
+  }
+
+  return F->addNode(new CPUMatMulPackedNode(MM->getName(), MM->getType(),
+                                            MM->getLHS(), packed));
+}
+
+/// The number of channels in a block of the blocked activation layout.
+static constexpr size_t channelBlock = 8;
+
+/// \returns the blocked shape [N, C/8, H, W, 8] of the NHWC shape \p dims.
+static std::vector<size_t> getBlockedDims(llvm::ArrayRef<size_t> dims) {
+  ShapeNHWC dim(dims);
+  return {dim.n, dim.c / channelBlock, dim.h, dim.w, channelBlock};
+}
+
+/// \returns true if \p NV is a float NHWC tensor whose channels divide into
+/// blocks.
+static bool isBlockableTensor(NodeValue NV) {
+  return NV.dims().size() == 4 && NV.getElementType() == ElemKind::FloatTy &&
+         NV.dims()[3] % channelBlock == 0;
+}
+
+/// Try to convert the regular Convolution \p CN into a CPUConvNCHWc with the
+/// blocked input \p input. The filter is transposed at compile time from DKKC
+/// into the layout [D/8, C/8, K, K, 8, 8], so that the 8 x 8 block of the
+/// filter that multiplies an input channel block into an output channel block
+/// is consecutive in memory.
+static Node *optimizeCPUConvNCHWc(ConvolutionNode *CN, NodeValue input,
+                                  Function *F, DerivedWeights &W) {
+  auto *M = F->getParent();
+  ShapeNHWC odim(CN->getResult().dims());
+  ShapeNHWC idim(CN->getInput().dims());
+  auto dims = CN->getFilter().dims();
+  size_t kernel = CN->getKernel();
+
+  auto *filter = cast<Variable>(CN->getFilter());
+  Variable *&filterB = W.blocked[filter];
+  if (!filterB) {
+    filterB = M->createVariable(ElemKind::FloatTy,
+                                {odim.c / channelBlock, idim.c / channelBlock,
+                                 kernel, kernel, channelBlock, channelBlock},
+                                filter->getName(), VisibilityKind::Private,
+                                Variable::TrainKind::None);
+
+    auto FBH = filterB->getHandle();
+    auto FH = filter->getHandle();
+    for (size_t d = 0; d < dims[0]; d++)
+      for (size_t fx = 0; fx < dims[1]; fx++)
+        for (size_t fy = 0; fy < dims[2]; fy++)
+          for (size_t c = 0; c < dims[3]; c++) {
+            FBH.at({d / channelBlock, c / channelBlock, fx, fy,
+                    c % channelBlock, d % channelBlock}) =
+                FH.at({d, fx, fy, c});
+          }
+  }
+
+  auto outDims = getBlockedDims(CN->getResult().dims());
+  auto outTy = M->uniqueTypeWithNewShape(CN->getType(), outDims);
+  return F->addNode(new CPUConvNCHWcNode(
+      CN->getName(), outTy, input, filterB, CN->getBias(), kernel,
+      CN->getStride(), CN->getPad(), unsigned(CPUActivation::None), 0));
+}
+
+/// \returns true if the node \p N runs on the blocked layout when it is
+/// reached by a blocked value: the element-wise operations, which don't
+/// depend on the layout, and the pooling.
+static bool isLayoutAgnostic(const Node *N) {
+  if (N->isArithmetic()) {
+    return true;
+  }
+  switch (N->getKind()) {
+  case Kinded::Kind::SigmoidNodeKind:
+  case Kinded::Kind::TanhNodeKind:
+  case Kinded::Kind::PoolMaxNodeKind:
+  case Kinded::Kind::PoolAvgNodeKind:
+    return true;
+  default:
+    return false;
+  }
+}
+
+/// Convert the regions of \p F between the convolutions into the blocked
+/// layout [N, C/8, H, W, 8]. The CPUConvNCHWc vectorizes over the 8 output
+/// channels of a block and reads the 8 input channels of a pixel from one
+/// cache line, and the layout is kept through the element-wise operations
+/// and the pooling that follow it, so that the next convolution reads the
+/// blocked activations directly. The values are converted from NHWC where a
+/// blocked region begins, with a Reshape and a Transpose, and back to NHWC
+/// where it ends. \returns true if \p F was changed.
+static bool convertToBlockedLayout(Function *F, DerivedWeights &W) {
+  auto *M = F->getParent();
+  // The blocked nodes that replace the nodes of F.
+  std::unordered_map<Node *, Node *> blocked;
+  // The conversions of the NHWC results of the nodes of F that are read by
+  // a blocked node.
+  std::unordered_map<Node *, Node *> reorders;
+  // The nodes that were replaced by a blocked node, in post order.
+  std::vector<Node *> replaced;
+
+  auto toBlocked = [&](NodeValue NV) -> Node * {
+    if (NV.getResNo() == 0) {
+      for (auto *map : {&blocked, &reorders}) {
+        auto it = map->find(NV.getNode());
+        if (it != map->end()) {
+          return it->second;
+        }
+      }
+    }
+    auto blockedDims = getBlockedDims(NV.dims());
+    Node *N;
+    if (auto *SN = dyn_cast<SplatNode>(NV.getNode())) {
+      N = F->createSplat(
+          SN->getName(), M->uniqueTypeWithNewShape(SN->getType(), blockedDims),
+          SN->getValue());
+    } else {
+      ShapeNHWC dim(NV.dims());
+      auto *R = F->createReshape(
+          "blocked", NV, {dim.n, dim.h, dim.w, blockedDims[1], channelBlock});
+      N = F->createTranspose("blocked", R, {0, 3, 1, 2, 4});
+    }
+    if (NV.getResNo() == 0) {
+      reorders[NV.getNode()] = N;
+    }
+    return N;
+  };
+
+  // Copy the order, because the new nodes are added to F.
+  GraphPostOrderVisitor visitor(*F);
+  std::vector<Node *> order(visitor.getPostOrder().begin(),
+                            visitor.getPostOrder().end());
+  for (auto *N : order) {
+    if (N->hasPredicate() || N->getNumResults() != 1 ||
+        !isBlockableTensor(N->getNthResult(0))) {
+      continue;
+    }
+
+    Node *B = nullptr;
+    if (auto *CN = dyn_cast<ConvolutionNode>(N)) {
+      // The convolutions start the blocked regions, so their inputs don't
+      // have to be blocked.
+      if (CN->getGroup() == 1 && isBlockableTensor(CN->getInput()) &&
+          W.canTransform(CN->getFilter()) &&
+          CN->getFilter().getElementType() == ElemKind::FloatTy) {
+        B = optimizeCPUConvNCHWc(CN, toBlocked(CN->getInput()), F, W);
+      }
+    } else if (isLayoutAgnostic(N)) {
+      // The other nodes are converted only if one of their inputs is
+      // blocked.
+      bool hasBlockedInput = false;
+      for (unsigned i = 0, e = N->getNumInputs(); i < e; i++) {
+        NodeValue in = N->getNthInput(i);
+        hasBlockedInput |= in.getResNo() == 0 && blocked.count(in.getNode());
+      }
+      if (!hasBlockedInput) {
+        continue;
+      }
+
+      if (auto *PM = dyn_cast<PoolMaxNode>(N)) {
+        // The pooling runs on the blocks as NHWC images of 8 channels.
+        auto in = PM->getInput().dims();
+        auto *R = F->createReshape(PM->getName(), toBlocked(PM->getInput()),
+                                   {in[0] * in[3] / channelBlock, in[1], in[2],
+                                    channelBlock});
+        auto *P = F->createPoolMax(PM->getName(), R, PM->getKernel(),
+                                   PM->getStride(), PM->getPad());
+        B = F->createReshape(PM->getName(), P,
+                             getBlockedDims(PM->getResult().dims()));
+      } else if (auto *PA = dyn_cast<PoolAvgNode>(N)) {
+        auto in = PA->getInput().dims();
+        auto *R = F->createReshape(PA->getName(), toBlocked(PA->getInput()),
+                                   {in[0] * in[3] / channelBlock, in[1], in[2],
+                                    channelBlock});
+        auto *P = F->createPoolAvg(PA->getName(), R, PA->getKernel(),
+                                   PA->getStride(), PA->getPad());
+        B = F->createReshape(PA->getName(), P,
+                             getBlockedDims(PA->getResult().dims()));
+      } else {
+        // The element-wise operations only change their shape.
+        B = F->addNode(N->clone());
+        for (unsigned i = 0, e = B->getNumInputs(); i < e; i++) {
+          B->getNthInput(i) = toBlocked(N->getNthInput(i));
+        }
+        B->setType(0, M->uniqueTypeWithNewShape(
+                          N->getType(0), getBlockedDims(N->dims(0))));
+      }
+    }
+
+    if (B) {
+      blocked[N] = B;
+      replaced.push_back(N);
+    }
+  }
+
+  // The users are visited before the nodes that they use, so the remaining
+  // users of a replaced node are outside of the blocked regions and read the
+  // result in NHWC.
+  for (auto it = replaced.rbegin(), e = replaced.rend(); it != e; ++it) {
+    Node *N = *it;
+    if (N->hasUsers()) {
+      Node *B = blocked[N];
+      auto *T = F->createTranspose(N->getName(), B, {0, 2, 3, 1, 4});
+      auto *R = F->createReshape(N->getName(), T, N->dims(0));
+      NodeValue(N, 0).replaceAllUsesOfWith(R);
+    }
+    F->eraseNode(N);
+  }
+  return !replaced.empty();
+}
+
+/// Fuse the BatchedAdd of a bias to the result of a CPUMatMulPacked, the
+/// \p chain [CPUMatMulPacked, BatchedAdd], into a CPUFullyConnectedPacked. Its
+/// kernel adds the bias to the blocks of the result while they are still in
+/// the cache, instead of scanning the whole result again.
+static Node *fuseCPUMatMulBias(Function *F, llvm::ArrayRef<Node *> chain) {
+  auto *MM = cast<CPUMatMulPackedNode>(chain[0]);
+  auto *BA = cast<BatchedAddNode>(chain[1]);
+  if (BA->getBatch().getNode() != MM) {
+    return nullptr;
+  }
+  return F->addNode(new CPUFullyConnectedPackedNode(
+      BA->getName(), BA->getType(), MM->getLHS(), MM->getRHS(),
+      BA->getSlice(), unsigned(CPUActivation::None), 0));
+}
+
+/// Fuse the Add of \p chain [CPUConvDKKC8, Add], e.g. of the shortcut of a
+/// residual block, into the convolution. The output of the convolution then
+/// starts with the sum of the other operand of the Add and the bias, instead
+/// of being read again together with the residual by the Add.
+static Node *fuseCPUResidualConv(Function *F, llvm::ArrayRef<Node *> chain) {
+  auto *CN = cast<CPUConvDKKC8Node>(chain[0]);
+  auto *AN = cast<AddNode>(chain[1]);
+  NodeValue residual =
+      AN->getLHS().getNode() == CN ? AN->getRHS() : AN->getLHS();
+  if (CN->getActivation() != unsigned(CPUActivation::None) ||
+      residual.getType() != CN->getResult().getType() ||
+      AN->getResult().getType() != CN->getResult().getType()) {
+    return nullptr;
+  }
+  return F->addNode(new CPUResidualConvDKKC8Node(
+      AN->getName(), AN->getResult().getType(), CN->getInput(),
+      CN->getFilter(), CN->getBias(), residual, CN->getKernel(),
+      CN->getStride(), CN->getPad(), unsigned(CPUActivation::None), 0));
+}
+
+/// \returns the CPUActivation computed by the node \p AN and its parameter.
+static std::pair<CPUActivation, float> getCPUActivation(const Node *AN) {
+  if (auto *MSN = dyn_cast<MaxSplatNode>(AN)) {
+    return {CPUActivation::MaxSplat, MSN->getSplatValue()};
+  }
+  if (isa<SigmoidNode>(AN)) {
+    return {CPUActivation::Sigmoid, 0};
+  }
+  assert(isa<TanhNode>(AN) && "Not an activation of the CPU kernels");
+  return {CPUActivation::Tanh, 0};
+}
+
+/// Fuse the activation that ends \p chain into the CPU convolution or matrix
+/// multiplication that starts it. The activation is then applied by the
+/// kernel when it stores its results and the separate scan of the whole
+/// tensor disappears. The chain may have a Reshape between the two nodes,
+/// like the one of the GEMM-based convolution.
+static Node *fuseCPUActivation(Function *F, llvm::ArrayRef<Node *> chain) {
+  Node *producer = chain.front();
+  auto *RN = chain.size() == 3 ? cast<ReshapeNode>(chain[1]) : nullptr;
+  auto act = getCPUActivation(chain.back());
+  auto actKind = unsigned(act.first);
+  float param = act.second;
+  auto noneKind = unsigned(CPUActivation::None);
+  Node *fused = nullptr;
+  if (auto *CN = dyn_cast<CPUConvDKKC8Node>(producer)) {
+    if (CN->getActivation() == noneKind) {
+      fused = F->addNode(new CPUConvDKKC8Node(
+          CN->getName(), CN->getType(), CN->getInput(), CN->getFilter(),
+          CN->getBias(), CN->getKernel(), CN->getStride(), CN->getPad(),
+          actKind, param));
+    }
+  } else if (auto *CN = dyn_cast<CPUResidualConvDKKC8Node>(producer)) {
+    if (CN->getActivation() == noneKind) {
+      fused = F->addNode(new CPUResidualConvDKKC8Node(
+          CN->getName(), CN->getType(), CN->getInput(), CN->getFilter(),
+          CN->getBias(), CN->getResidual(), CN->getKernel(), CN->getStride(),
+          CN->getPad(), actKind, param));
+    }
+  } else if (auto *CN = dyn_cast<CPUConvNCHWcNode>(producer)) {
+    if (CN->getActivation() == noneKind) {
+      fused = F->addNode(new CPUConvNCHWcNode(
+          CN->getName(), CN->getType(), CN->getInput(), CN->getFilter(),
+          CN->getBias(), CN->getKernel(), CN->getStride(), CN->getPad(),
+          actKind, param));
+    }
+  } else if (auto *WO = dyn_cast<CPUWinogradOutputNode>(producer)) {
+    if (WO->getActivation() == noneKind) {
+      fused = F->addNode(new CPUWinogradOutputNode(WO->getName(), WO->getType(),
+                                                   WO->getInput(),
+                                                   WO->getBias(), actKind,
+                                                   param));
+    }
+  } else if (auto *FC = dyn_cast<CPUFullyConnectedPackedNode>(producer)) {
+    if (FC->getActivation() == noneKind) {
+      fused = F->addNode(new CPUFullyConnectedPackedNode(
+          FC->getName(), FC->getType(), FC->getLHS(), FC->getRHS(),
+          FC->getBias(), actKind, param));
+    }
+  }
+
+  if (!fused || !RN) {
+    return fused;
+  }
+  return F->createReshape(RN->getName(), fused, RN->getResult().dims());
+}
+
+/// \returns true if the SoftMax \p SM can be fused into its consumer, which
+/// only needs a part of the distribution and computes that part from the
+/// logits.
+static bool isFusibleSoftMax(const SoftMaxNode *SM) {
+  return SM->getResult().getElementType() == ElemKind::FloatTy &&
+         SM->getResult().dims().size() == 2;
+}
+
+/// Fuse the SoftMax that feeds the TopK or the CrossEntropyLoss of \p chain
+/// into it. The fused kernels find the maximum and the sum of the
+/// exponentials of every row, and then normalize only the selected elements,
+/// or compute the loss from the logit of the label, without writing the
+/// distribution.
+static Node *fuseCPUSoftMax(Function *F, llvm::ArrayRef<Node *> chain) {
+  auto *SM = cast<SoftMaxNode>(chain[0]);
+  if (!isFusibleSoftMax(SM)) {
+    return nullptr;
+  }
+  if (auto *TK = dyn_cast<TopKNode>(chain[1])) {
+    return F->addNode(new CPUSoftMaxTopKNode(
+        TK->getName(), TK->getValues().getType(), TK->getIndices().getType(),
+        SM->getInput(), TK->getK()));
+  }
+  auto *CE = cast<CrossEntropyLossNode>(chain[1]);
+  if (CE->getP().getNode() != SM) {
+    return nullptr;
+  }
+  return F->addNode(new CPUSoftMaxCrossEntropyLossNode(
+      CE->getName(), CE->getCE().getType(), SM->getInput(), CE->getLabels()));
 }
 
 bool CPUBackend::transformPostLowering(Function *F, CompilationMode mode) {
   bool changed = false;
+  DerivedWeights W;
+  if (blockedLayout && mode == CompilationMode::Infer) {
+    W.countUses(F);
+    changed |= convertToBlockedLayout(F, W);
+  }
+  W.countUses(F);
   for (auto node : F->getNodes()) {
 
     if (auto *CN = dyn_cast<ConvolutionNode>(node)) {
-      if (Node *NCN = optimizeCPUConv(CN, F)) {
+      if (Node *NCN = optimizeCPUConvWinograd(CN, F, W)) {
         NodeValue(node, 0).replaceAllUsesOfWith(NCN);
         changed = true;
         continue;
       }
-    }
-    if (auto *MN = dyn_cast<MaxNode>(node)) {
-      if (auto *splat = dyn_cast<SplatNode>(MN->getLHS())) {
-        auto MSN = F->addNode(new CPUMaxSplatNode(MN->getName(), MN->getRHS(),
-                                                  splat->getValue()));
-        NodeValue(node, 0).replaceAllUsesOfWith(MSN);
+      if (Node *NCN = optimizeCPUConv(CN, F, W, getConvBlockWidth())) {
+        NodeValue(node, 0).replaceAllUsesOfWith(NCN);
+        changed = true;
+        continue;
+      }
+      if (Node *NCN = optimizeCPUQuantizedConv(CN, F, W)) {
+        NodeValue(node, 0).replaceAllUsesOfWith(NCN);
+        changed = true;
+        continue;
+      }
+      if (Node *NCN = optimizeCPUConvIm2Col(CN, F, W)) {
+        NodeValue(node, 0).replaceAllUsesOfWith(NCN);
         changed = true;
         continue;
       }
-      if (auto *splat = dyn_cast<SplatNode>(MN->getRHS())) {
-        auto MSN = F->addNode(new CPUMaxSplatNode(MN->getName(), MN->getLHS(),
-                                                  splat->getValue()));
-        NodeValue(node, 0).replaceAllUsesOfWith(MSN);
+    }
+    if (auto *MM = dyn_cast<MatMulNode>(node)) {
+      if (Node *NMM = optimizeCPUMatMul(MM, F, W)) {
+        NodeValue(node, 0).replaceAllUsesOfWith(NMM);
         changed = true;
         continue;
       }
@@ -109,3 +867,35 @@ bool CPUBackend::transformPostLowering(Function *F, CompilationMode mode) {
 
   return changed;
 }
+
+std::vector<FusionPattern>
+CPUBackend::getFusionPatterns(CompilationMode mode) const {
+  using Kind = Kinded::Kind;
+  // The bias and the residual additions are fused first and then the
+  // activations, into the kernels that transformPostLowering selected.
+  std::vector<FusionPattern> patterns;
+  patterns.push_back({{Kind::CPUMatMulPackedNodeKind, Kind::BatchedAddNodeKind},
+                      fuseCPUMatMulBias});
+  patterns.push_back(
+      {{Kind::CPUConvDKKC8NodeKind, Kind::AddNodeKind}, fuseCPUResidualConv});
+  for (auto act : {Kind::MaxSplatNodeKind, Kind::SigmoidNodeKind,
+                   Kind::TanhNodeKind}) {
+    for (auto producer :
+         {Kind::CPUConvDKKC8NodeKind, Kind::CPUResidualConvDKKC8NodeKind,
+          Kind::CPUConvNCHWcNodeKind, Kind::CPUWinogradOutputNodeKind,
+          Kind::CPUFullyConnectedPackedNodeKind}) {
+      patterns.push_back({{producer, act}, fuseCPUActivation});
+      patterns.push_back(
+          {{producer, Kind::ReshapeNodeKind, act}, fuseCPUActivation});
+    }
+  }
+  // At inference the SoftMax has no gradient that needs the distribution.
+  if (mode == CompilationMode::Infer) {
+    patterns.push_back(
+        {{Kind::SoftMaxNodeKind, Kind::TopKNodeKind}, fuseCPUSoftMax});
+    patterns.push_back(
+        {{Kind::SoftMaxNodeKind, Kind::CrossEntropyLossNodeKind},
+         fuseCPUSoftMax});
+  }
+  return patterns;
+}
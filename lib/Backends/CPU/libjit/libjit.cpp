@@ -14,12 +14,14 @@
  * limitations under the License.
  */
 #include <cassert>
+#include <cfloat>
 #include <cmath>
 #include <cstddef>
 #include <cstdint>
 #include <cstdio>
 #include <cstdlib>
 #include <cstring>
+#include <ctime>
 #include <sys/types.h>
 
 #include "libjit_defs.h"
@@ -114,49 +116,55 @@ static void libjit_dump_tensor_impl(ElemTy *tensor, size_t *dims,
   printf("]\n");
 }
 
+/// Copies the slice \p slice into the tensor \p tensor at \p offset if
+/// \p isInsert is set, and the part of \p tensor at \p offset into \p slice
+/// otherwise. The inner dimensions that the slice spans entirely are
+/// contiguous in both tensors, so they are copied with a single memcpy, and
+/// only the outer dimensions are iterated.
 template <typename ElemTy>
-static size_t get_element_ptr(const ElemTy *tensor, const size_t *dims,
-                              size_t numDims, const size_t *indices,
-                              size_t numIndices) {
-  size_t index = 0;
-  size_t subdimensionSize = 1;
+static void libjit_insert_tensor_impl(ElemTy *tensor, ElemTy *slice,
+                                      const size_t *offset,
+                                      const size_t *tensorDim,
+                                      const size_t *sliceDim, size_t numDims,
+                                      unsigned isInsert) {
+  // Reserve statically enough memory to avoid dynamic memory allocation.
+  size_t tensorSizes[10];
+  size_t coor[10];
+  size_t sliceSize = 1;
+  size_t tensorIdx = 0;
   for (size_t i = numDims; i > 0; i--) {
-    size_t curIndicesValue = (i <= numIndices) ? indices[i - 1] : 0;
-    index += subdimensionSize * curIndicesValue;
-    subdimensionSize *= dims[i - 1];
+    tensorSizes[i - 1] = i == numDims ? 1 : tensorSizes[i] * tensorDim[i];
+    tensorIdx += offset[i - 1] * tensorSizes[i - 1];
+    sliceSize *= sliceDim[i - 1];
+    coor[i - 1] = 0;
+  }
+  if (sliceSize == 0) {
+    return;
   }
-  return index;
-}
 
-template <typename ElemTy>
-static void libjit_insert_tensor_impl(ElemTy *tensor, ElemTy *slice,
-                                      size_t *offset, size_t *sliceCoor,
-                                      size_t *fusedCoor, size_t *tensorDim,
-                                      size_t *sliceDim, size_t numDimsTensor,
-                                      size_t numDimsSliceCoor,
-                                      size_t numDimsFusedCoor,
-                                      unsigned isInsert, unsigned d) {
-  unsigned isDone = (d == numDimsSliceCoor);
-
-  if (isDone) {
+  // Find the outermost dimension of the contiguous run.
+  size_t runDim = numDims - 1;
+  size_t run = sliceDim[runDim];
+  while (runDim > 0 && sliceDim[runDim] == tensorDim[runDim]) {
+    run *= sliceDim[--runDim];
+  }
+  size_t runBytes = run * sizeof(ElemTy);
+
+  for (size_t sliceIdx = 0; sliceIdx < sliceSize; sliceIdx += run) {
     if (isInsert) {
-      AT(tensor, tensorDim, numDimsTensor, fusedCoor, numDimsFusedCoor) =
-          AT(slice, sliceDim, numDimsSliceCoor, sliceCoor, numDimsSliceCoor);
+      memcpy(tensor + tensorIdx, slice + sliceIdx, runBytes);
     } else {
-      AT(slice, sliceDim, numDimsSliceCoor, sliceCoor, numDimsSliceCoor) =
-          AT(tensor, tensorDim, numDimsTensor, fusedCoor, numDimsFusedCoor);
+      memcpy(slice + sliceIdx, tensor + tensorIdx, runBytes);
+    }
+    // Move to the next run, like an odometer.
+    for (size_t d = runDim; d > 0; d--) {
+      tensorIdx += tensorSizes[d - 1];
+      if (++coor[d - 1] < sliceDim[d - 1]) {
+        break;
+      }
+      tensorIdx -= sliceDim[d - 1] * tensorSizes[d - 1];
+      coor[d - 1] = 0;
     }
-    return;
-  }
-
-  for (size_t i = 0, e = sliceDim[d]; i < e; i++) {
-    // Construct the coordinates for the slice and for the joint shape.
-    // Add the 'offset' to the dimension that we concat the shapes on.
-    sliceCoor[d] = i;
-    fusedCoor[d] = i + offset[d];
-    libjit_insert_tensor_impl(
-        tensor, slice, offset, sliceCoor, fusedCoor, tensorDim, sliceDim,
-        numDimsTensor, numDimsSliceCoor, numDimsFusedCoor, isInsert, d + 1);
   }
 }
 
@@ -165,14 +173,8 @@ void libjit_insert_tensor(ElemTy *tensor, ElemTy *slice, size_t *offset,
                           size_t *tensorDim, size_t *sliceDim,
                           size_t numDimsTensor, size_t numDimsSlice,
                           size_t offsetDim) {
-  // Reserve statically enough memory to avoid dynamic memory allocation.
-  size_t sliceCoor[10];
-  size_t fusedCoor[10];
-  memcpy(sliceCoor, sliceDim, sizeof(*sliceDim) * numDimsSlice);
-  memcpy(fusedCoor, tensorDim, sizeof(*tensorDim) * numDimsTensor);
-  libjit_insert_tensor_impl(tensor, slice, offset, sliceCoor, fusedCoor,
-                            tensorDim, sliceDim, numDimsTensor, numDimsSlice,
-                            offsetDim, 1, 0);
+  libjit_insert_tensor_impl(tensor, slice, offset, tensorDim, sliceDim,
+                            numDimsSlice, 1);
 }
 
 template <typename ElemTy>
@@ -180,105 +182,234 @@ void libjit_extract_tensor(ElemTy *tensor, ElemTy *slice, size_t *offset,
                            size_t *tensorDim, size_t *sliceDim,
                            size_t numDimsTensor, size_t numDimsSlice,
                            size_t offsetDim) {
-  // Reserve statically enough memory to avoid dynamic memory allocation.
-  size_t sliceCoor[10];
-  size_t fusedCoor[10];
-  memcpy(sliceCoor, sliceDim, sizeof(*sliceDim) * numDimsSlice);
-  memcpy(fusedCoor, tensorDim, sizeof(*tensorDim) * numDimsTensor);
-  libjit_insert_tensor_impl(tensor, slice, offset, sliceCoor, fusedCoor,
-                            tensorDim, sliceDim, numDimsTensor, numDimsSlice,
-                            offsetDim, 0, 0);
-}
-
-/// Helper struct for TopK
-template <typename T> struct value_index {
-  size_t index;
-  T value;
-};
-
-/// Helper function for TopK
-template <typename T> int value_index_sort(const void *va, const void *vb) {
-  value_index<T> *a = (value_index<T> *)va;
-  value_index<T> *b = (value_index<T> *)vb;
-  if (a->value != b->value)
-    return a->value > b->value ? -1 : 1;
-  return a->index < b->index ? -1 : 1;
+  libjit_insert_tensor_impl(tensor, slice, offset, tensorDim, sliceDim,
+                            numDimsSlice, 0);
 }
 
-/// Generic Top-K function. Here, \p scratch is some allocated buffer space, \p
-/// size is the size of the input, and \p n is the size of the last dimension of
-/// the input.
-template <typename T>
-void libjit_topk(T *values, size_t *indices, const T *input, size_t *scratch,
-                 size_t k, size_t n, size_t size) {
-  size_t in = 0;
-  size_t out = 0;
+/// \returns true if the element (\p va, \p ia) of a TopK row ranks below the
+/// element (\p vb, \p ib): its value is smaller, or the values are equal and
+/// its index is larger. The indices are of type \p I, size_t or int32_t.
+template <typename T, typename I>
+bool libjit_topk_ranks_below(T va, I ia, T vb, I ib) {
+  return va < vb || (va == vb && ia > ib);
+}
 
-  value_index<T> *buffer = (value_index<T> *)scratch;
-  while (in < size) {
-    for (size_t i = 0; i < n; i++) {
-      buffer[i].index = i;
-      buffer[i].value = input[in++];
+/// Restores the heap below the position \p pos of the heap of \p size
+/// elements that is stored in \p values and \p indices. The element at the
+/// root of the heap ranks below all of the others.
+template <typename T, typename I>
+void libjit_topk_sift_down(T *values, I *indices, size_t pos, size_t size) {
+  T value = values[pos];
+  I index = indices[pos];
+  for (size_t child = 2 * pos + 1; child < size; child = 2 * pos + 1) {
+    if (child + 1 < size &&
+        libjit_topk_ranks_below(values[child + 1], indices[child + 1],
+                                values[child], indices[child])) {
+      child++;
     }
-    qsort(buffer, n, sizeof(value_index<T>), value_index_sort<T>);
-    for (size_t i = 0; i < k; i++) {
-      indices[out] = buffer[i].index;
-      values[out] = buffer[i].value;
-      out++;
+    if (!libjit_topk_ranks_below(values[child], indices[child], value,
+                                 index)) {
+      break;
     }
+    values[pos] = values[child];
+    indices[pos] = indices[child];
+    pos = child;
   }
+  values[pos] = value;
+  indices[pos] = index;
 }
 
-/// Helper function for Broadcast. Increments an "index" dimension vector, \p
-/// dest_i, with respect to \p dest_dims.  This corresponds to striding through
-/// all \p n dimensions using \p n nested for-loops.
-///
-/// \returns false when the index equals the dimension.
-bool increment_and_check_dims(size_t *dest_i, const size_t *dest_dims,
-                              size_t n) {
-  for (size_t i = 0; i < n; i++) {
-    dest_i[i] += 1;
-    if (dest_i[i] == dest_dims[i]) {
-      dest_i[i] = 0;
-    } else {
-      return true;
+/// The number of elements of a TopK row that are compared to the current
+/// threshold at once.
+constexpr size_t topkBlockSize = 16;
+
+/// Selects the \p k largest of the \p n elements of \p input into \p values
+/// and \p indices, in decreasing order. The selection keeps a heap of the
+/// best k elements in the outputs, which takes O(n log k) time.
+template <typename T, typename I>
+void libjit_topk_row(T *values, I *indices, const T *input, size_t k,
+                     size_t n) {
+  if (!k) {
+    return;
+  }
+  for (size_t i = 0; i < k; i++) {
+    values[i] = input[i];
+    indices[i] = i;
+  }
+  for (size_t i = k / 2; i-- > 0;) {
+    libjit_topk_sift_down(values, indices, i, k);
+  }
+
+  // The later elements have larger indices, so they enter the heap only if
+  // they are greater than its root. In a wide row most of the elements are
+  // not, and the blocks that are all below the root are skipped with a test
+  // that vectorizes.
+  for (size_t i = k; i < n;) {
+    T threshold = values[0];
+    if (i + topkBlockSize <= n) {
+      bool any = false;
+      for (size_t j = 0; j < topkBlockSize; j++) {
+        any |= input[i + j] > threshold;
+      }
+      if (!any) {
+        i += topkBlockSize;
+        continue;
+      }
+    }
+    for (size_t e = MIN(i + topkBlockSize, n); i < e; i++) {
+      if (input[i] > values[0]) {
+        values[0] = input[i];
+        indices[0] = i;
+        libjit_topk_sift_down(values, indices, 0, k);
+      }
     }
   }
-  return false;
+
+  // Sort the heap by moving the lowest ranked element to the back.
+  for (size_t size = k - 1; size > 0; size--) {
+    T value = values[0];
+    I index = indices[0];
+    values[0] = values[size];
+    indices[0] = indices[size];
+    values[size] = value;
+    indices[size] = index;
+    libjit_topk_sift_down(values, indices, 0, size);
+  }
+}
+
+/// The context of the tasks of libjit_topk. Every task selects a row.
+template <typename T, typename I> struct libjit_topk_tasks {
+  T *values;
+  I *indices;
+  const T *input;
+  size_t k;
+  size_t n;
+};
+
+template <typename T, typename I>
+void libjit_topk_task(void *ctx, size_t row) {
+  const auto *tasks = (const libjit_topk_tasks<T, I> *)ctx;
+  size_t k = tasks->k;
+  size_t n = tasks->n;
+  libjit_topk_row(tasks->values + row * k, tasks->indices + row * k,
+                  tasks->input + row * n, k, n);
+}
+
+/// The number of input elements that justifies the use of an additional
+/// thread in libjit_topk.
+constexpr size_t topkWorkPerThread = 1 << 16;
+
+/// Generic Top-K function. Here, \p size is the size of the input, and \p n is
+/// the size of the last dimension of the input. The rows are split between up
+/// to \p numThreads threads.
+template <typename T, typename I>
+void libjit_topk(T *values, I *indices, const T *input, size_t k, size_t n,
+                 size_t size, size_t numThreads) {
+  libjit_topk_tasks<T, I> tasks = {values, indices, input, k, n};
+  libjit_parallel_for(size / n, MIN(numThreads, size / topkWorkPerThread),
+                      libjit_topk_task<T, I>, &tasks);
 }
 
-/// Helper function for Broadcast. Given a destination index \p dest_i of a
-/// broadcast operation, compute the source index \p src_i given a source tensor
-/// with dimensions \p src_dims.
-///
-/// Any source dimension containing a 1 is broadcast to all other dimensions by
-/// selecting index 0 in that dimension.
-void get_src_dim(size_t *src_i, const size_t *dest_i, const size_t *src_dims,
-                 size_t n) {
+/// Helper function for Broadcast. Broadcasts the \p src to the \p dest from
+/// the dimension \p dim on. The slices below each dimension have
+/// \p destSizes and \p srcSizes elements. The dimensions that are 1 in
+/// \p srcDims are broadcast: their first slice is computed once and then
+/// replicated with memcpy. The innermost dimension is a contiguous copy or a
+/// fill, which vectorize.
+template <typename T>
+void libjit_broadcast_dims(T *dest, const T *src, const size_t *destDims,
+                           const size_t *srcDims, const size_t *destSizes,
+                           const size_t *srcSizes, size_t dim, size_t nDims) {
+  size_t n = destDims[dim];
+  if (dim + 1 == nDims) {
+    if (srcDims[dim] == 1) {
+      T value = src[0];
+      for (size_t i = 0; i < n; i++) {
+        dest[i] = value;
+      }
+    } else {
+      memcpy(dest, src, n * sizeof(T));
+    }
+    return;
+  }
+  if (srcDims[dim] == 1) {
+    libjit_broadcast_dims(dest, src, destDims, srcDims, destSizes, srcSizes,
+                          dim + 1, nDims);
+    for (size_t i = 1; i < n; i++) {
+      memcpy(dest + i * destSizes[dim], dest, destSizes[dim] * sizeof(T));
+    }
+    return;
+  }
   for (size_t i = 0; i < n; i++) {
-    src_i[i] = (src_dims[i] == 1) ? 0 : dest_i[i];
+    libjit_broadcast_dims(dest + i * destSizes[dim], src + i * srcSizes[dim],
+                          destDims, srcDims, destSizes, srcSizes, dim + 1,
+                          nDims);
   }
 }
 
 template <typename T>
 void libjit_broadcast(T *dest, const T *src, const size_t *destDims,
                       const size_t *srcDims, size_t nDims) {
-  size_t destI[6] = {0};
-  size_t srcI[6] = {0};
-  do {
-    get_src_dim(srcI, destI, srcDims, nDims);
-    size_t sptr = get_element_ptr(src, srcDims, nDims, srcI, nDims);
-    size_t dptr = get_element_ptr(dest, destDims, nDims, destI, nDims);
-    dest[dptr] = src[sptr];
-  } while (increment_and_check_dims(destI, destDims, nDims));
+  size_t destSizes[6];
+  size_t srcSizes[6];
+  size_t destSize = 1;
+  size_t srcSize = 1;
+  for (size_t i = nDims; i-- > 0;) {
+    destSizes[i] = destSize;
+    srcSizes[i] = srcSize;
+    destSize *= destDims[i];
+    srcSize *= srcDims[i];
+  }
+  if (destSize) {
+    libjit_broadcast_dims(dest, src, destDims, srcDims, destSizes, srcSizes, 0,
+                          nDims);
+  }
 }
 
-template <typename T>
-void libjit_gather(T *dest, const T *data, const size_t *indices,
+/// The number of the slices ahead of the current one that libjit_gather
+/// prefetches.
+constexpr size_t gatherPrefetchDistance = 4;
+
+/// The max number of cache lines of a slice that libjit_gather prefetches.
+constexpr size_t gatherPrefetchLines = 8;
+
+/// Prefetches the first cache lines of the slice of \p data, of \p sliceSize
+/// elements, that is gathered gatherPrefetchDistance indices after the index
+/// \p i of the \p numIndices \p indices.
+template <typename T, typename I>
+void libjit_prefetch_gathered(const T *data, const I *indices, size_t i,
+                              size_t numIndices, size_t sliceSize) {
+  if (i + gatherPrefetchDistance >= numIndices) {
+    return;
+  }
+  const T *next = data + indices[i + gatherPrefetchDistance] * sliceSize;
+  size_t prefetchBytes = MIN(sliceSize * sizeof(T), gatherPrefetchLines * 64);
+  for (size_t offset = 0; offset < prefetchBytes; offset += 64) {
+    __builtin_prefetch((const char *)next + offset);
+  }
+}
+
+/// Copies the slices of \p data selected by \p indices to \p dest. The
+/// slices are at random places, like the rows of an embedding table, so the
+/// first cache lines of the slices a few indices ahead are prefetched while
+/// the current slice is copied. The indices are of type \p I, size_t or
+/// int32_t.
+template <typename T, typename I>
+void libjit_gather(T *dest, const T *data, const I *indices,
                    size_t numIndices, size_t sliceSize) {
+  size_t sliceBytes = sliceSize * sizeof(T);
+  for (size_t i = 0; i < numIndices; i++) {
+    libjit_prefetch_gathered(data, indices, i, numIndices, sliceSize);
+    memcpy(dest + i * sliceSize, data + indices[i] * sliceSize, sliceBytes);
+  }
+}
+
+template <typename T>
+void libjit_scatter_assign(T *data, const size_t *indices, const T *slices,
+                           size_t numIndices, size_t sliceSize) {
   for (size_t i = 0; i < numIndices; i++) {
-    size_t slice = indices[i];
-    memcpy(dest + i * sliceSize, data + slice * sliceSize,
+    size_t destDataIdx = indices[i];
+    memcpy(data + destDataIdx * sliceSize, slices + i * sliceSize,
            sliceSize * sizeof(T));
   }
 }
@@ -343,103 +474,362 @@ void libjit_transpose_generic(const T *inW, T *outW, const size_t *idim,
   }
 }
 
+/// Transposes the 8x8 block at \p in, whose rows are \p ldi elements apart,
+/// into the block at \p out, whose rows are \p ldo elements apart.
+template <typename T>
+void libjit_transpose_8x8(const T *in, size_t ldi, T *out, size_t ldo) {
+  for (size_t i = 0; i < 8; i++) {
+    for (size_t j = 0; j < 8; j++) {
+      out[j * ldo + i] = in[i * ldi + j];
+    }
+  }
+}
+
+/// Transposes the 8x8 block of floats in registers: the rows are interleaved
+/// by pairs of elements, then by pairs of pairs, then by halves.
+void libjit_transpose_8x8(const float *in, size_t ldi, float *out,
+                          size_t ldo) {
+  float8 r[8], t[8], u[8];
+  for (size_t i = 0; i < 8; i++) {
+    r[i] = LoaduFloat8(in + i * ldi);
+  }
+  for (size_t i = 0; i < 8; i += 2) {
+    t[i] = __builtin_shufflevector(r[i], r[i + 1], 0, 8, 1, 9, 4, 12, 5, 13);
+    t[i + 1] =
+        __builtin_shufflevector(r[i], r[i + 1], 2, 10, 3, 11, 6, 14, 7, 15);
+  }
+  for (size_t i = 0; i < 8; i += 4) {
+    for (size_t j = 0; j < 2; j++) {
+      u[i + 2 * j] = __builtin_shufflevector(t[i + j], t[i + j + 2], 0, 1, 8,
+                                             9, 4, 5, 12, 13);
+      u[i + 2 * j + 1] = __builtin_shufflevector(t[i + j], t[i + j + 2], 2, 3,
+                                                 10, 11, 6, 7, 14, 15);
+    }
+  }
+  for (size_t i = 0; i < 4; i++) {
+    StoreuFloat8(out + i * ldo, __builtin_shufflevector(u[i], u[i + 4], 0, 1,
+                                                        2, 3, 8, 9, 10, 11));
+    StoreuFloat8(out + (i + 4) * ldo,
+                 __builtin_shufflevector(u[i], u[i + 4], 4, 5, 6, 7, 12, 13,
+                                         14, 15));
+  }
+}
+
+/// The size of the square tiles of libjit_transpose_batched. A tile of the
+/// input and a tile of the output fit in the L1 cache.
+constexpr size_t transposeTileSize = 32;
+
+/// Transposes \p batch consecutive \p rows x \p cols matrices at \p in into
+/// the \p cols x \p rows matrices at \p out. The matrices are processed in
+/// tiles, so that both the reads and the writes stay in the cache, and the
+/// tiles in 8x8 blocks.
+template <typename T>
+void libjit_transpose_batched(const T *in, T *out, size_t batch, size_t rows,
+                              size_t cols) {
+  for (size_t b = 0; b < batch; b++) {
+    for (size_t ib = 0; ib < rows; ib += transposeTileSize) {
+      for (size_t jb = 0; jb < cols; jb += transposeTileSize) {
+        size_t ie = MIN(ib + transposeTileSize, rows);
+        size_t je = MIN(jb + transposeTileSize, cols);
+        size_t i = ib;
+        for (; i + 8 <= ie; i += 8) {
+          size_t j = jb;
+          for (; j + 8 <= je; j += 8) {
+            libjit_transpose_8x8(in + i * cols + j, cols, out + j * rows + i,
+                                 rows);
+          }
+          for (; j < je; j++) {
+            for (size_t ii = i; ii < i + 8; ii++) {
+              out[j * rows + ii] = in[ii * cols + j];
+            }
+          }
+        }
+        for (; i < ie; i++) {
+          for (size_t j = jb; j < je; j++) {
+            out[j * rows + i] = in[i * cols + j];
+          }
+        }
+      }
+    }
+    in += rows * cols;
+    out += rows * cols;
+  }
+}
+
+/// The pooling kernels are channel-innermost: for every output pixel the
+/// window is clipped to the input once, so that the loops over the filter
+/// taps have no bounds checks, and every tap is reduced over the contiguous
+/// channels of NHWC, which vectorizes.
 template <typename T>
 void libjit_pool_max_generic(const T *inW, T *outW, const size_t *inWdims,
                              const size_t *outWdims, size_t filterSize,
                              size_t stride, size_t pad) {
-  // For each sample in the batch:
+  size_t C = inWdims[3];
   for (size_t n = 0; n < outWdims[0]; n++) {
-    // For each (x,y) step in the input/output tensor:
     ssize_t x = -(ssize_t)pad;
     for (size_t ax = 0; ax < outWdims[1]; x += stride, ax++) {
+      size_t x0, x1;
+      libjit_clip_window(x, filterSize, inWdims[1], x0, x1);
       ssize_t y = -(ssize_t)pad;
       for (size_t ay = 0; ay < outWdims[2]; y += stride, ay++) {
+        size_t y0, y1;
+        libjit_clip_window(y, filterSize, inWdims[2], y0, y1);
+        T *out = outW + libjit_getXYZW(outWdims, n, ax, ay, 0);
+        if (x0 == x1 || y0 == y1) {
+          for (size_t z = 0; z < C; z++) {
+            out[z] = 0;
+          }
+          continue;
+        }
 
-        // For each layer in the output tensor:
-        for (size_t z = 0; z < inWdims[3]; z++) {
-          int first = 1;
-          T max = 0;
-
-          // For each element in the pool filter:
-          for (size_t fx = 0; fx < filterSize; fx++) {
-            for (size_t fy = 0; fy < filterSize; fy++) {
-              ssize_t ox = x + fx;
-              ssize_t oy = y + fy;
-
-              // Ignore index access below zero (this is due to padding).
-              if (ox < 0 || oy < 0 || ox >= (ssize_t)inWdims[1] ||
-                  oy >= (ssize_t)inWdims[2]) {
-                continue;
-              }
-
-              float val =
-                  inW[libjit_getXYZW(inWdims, n, (size_t)ox, (size_t)oy, z)];
-
-              if (first || (val >= max)) {
-                first = 0;
-                max = val;
-              }
+        const T *first = inW + libjit_getXYZW(inWdims, n, x0, y0, 0);
+        for (size_t z = 0; z < C; z++) {
+          out[z] = first[z];
+        }
+        for (size_t ox = x0; ox < x1; ox++) {
+          for (size_t oy = y0; oy < y1; oy++) {
+            const T *in = inW + libjit_getXYZW(inWdims, n, ox, oy, 0);
+            for (size_t z = 0; z < C; z++) {
+              out[z] = MAX(out[z], in[z]);
             }
           }
-
-          outW[libjit_getXYZW(outWdims, n, ax, ay, z)] = max;
-        } // C
-      }   // W
-    }     // H
-  }       // N
+        }
+      } // W
+    }   // H
+  }     // N
 }
 
 template <typename T>
 void libjit_pool_max_xy_generic(const T *inW, T *outW, size_t *inXY,
                                 const size_t *inWdims, const size_t *outWdims,
                                 size_t kernel, size_t stride, size_t pad) {
-  // For each input in the batch:
+  size_t C = inWdims[3];
   for (size_t n = 0; n < outWdims[0]; n++) {
-
-    // For each (x,y) step in the input/output tensor:
     ssize_t x = -(ssize_t)pad;
     for (size_t ax = 0; ax < outWdims[1]; x += stride, ax++) {
+      size_t x0, x1;
+      libjit_clip_window(x, kernel, inWdims[1], x0, x1);
       ssize_t y = -(ssize_t)pad;
       for (size_t ay = 0; ay < outWdims[2]; y += stride, ay++) {
+        size_t y0, y1;
+        libjit_clip_window(y, kernel, inWdims[2], y0, y1);
+        T *out = outW + libjit_getXYZW(outWdims, n, ax, ay, 0);
+        // For the x and y argmax's, we use a 5-dimensional
+        // tensor whose fifth dimension has size 2:
+        size_t *xy = inXY + 2 * libjit_getXYZW(outWdims, n, ax, ay, 0);
+        if (x0 == x1 || y0 == y1) {
+          for (size_t z = 0; z < C; z++) {
+            out[z] = 0;
+            xy[2 * z] = x;
+            xy[2 * z + 1] = y;
+          }
+          continue;
+        }
 
-        // For each channel in the output tensor:
-        for (size_t z = 0; z < outWdims[3]; z++) {
-          size_t maxX = x;
-          size_t maxY = y;
-          int first = 1;
-          T max = 0;
+        const T *first = inW + libjit_getXYZW(inWdims, n, x0, y0, 0);
+        for (size_t z = 0; z < C; z++) {
+          out[z] = first[z];
+          xy[2 * z] = x0;
+          xy[2 * z + 1] = y0;
+        }
+        // The last of the equal maxima wins, like in the other backends.
+        for (size_t ox = x0; ox < x1; ox++) {
+          for (size_t oy = y0; oy < y1; oy++) {
+            const T *in = inW + libjit_getXYZW(inWdims, n, ox, oy, 0);
+            for (size_t z = 0; z < C; z++) {
+              bool isMax = in[z] >= out[z];
+              out[z] = isMax ? in[z] : out[z];
+              xy[2 * z] = isMax ? ox : xy[2 * z];
+              xy[2 * z + 1] = isMax ? oy : xy[2 * z + 1];
+            }
+          }
+        }
+      } // W
+    }   // H
+  }     // N
+}
 
-          for (size_t kx = 0; kx < kernel; kx++) {
-            for (size_t ky = 0; ky < kernel; ky++) {
-              ssize_t ox = x + kx;
-              ssize_t oy = y + ky;
+/// Quantize the \p numElem floats of \p inW into \p outW, clipping the
+/// results to [\p minVal, \p maxVal].
+template <typename T>
+void libjit_quantize_generic(T *outW, const float *inW, size_t numElem,
+                             float scale, int32_t offset, float minVal,
+                             float maxVal) {
+  for (size_t i = 0; i < numElem; i++) {
+    float result = roundf(inW[i] / scale + offset);
+    outW[i] = (T)MAX(minVal, MIN(maxVal, result));
+  }
+}
 
-              if (ox < 0 || oy < 0 || ox >= (ssize_t)inWdims[1] ||
-                  oy >= (ssize_t)inWdims[2]) {
-                continue;
-              }
+/// Requantize the \p numElem elements of \p inW into \p outW, where the
+/// ratio of the scales of the input and of the output is \p scale. The
+/// results are clipped to [\p minVal, \p maxVal].
+template <typename DestTy, typename SrcTy>
+void libjit_rescale_generic(DestTy *outW, const SrcTy *inW, size_t numElem,
+                            int32_t outOffset, int32_t inOffset, float scale,
+                            float minVal, float maxVal) {
+  for (size_t i = 0; i < numElem; i++) {
+    float result = roundf(((float)inW[i] - inOffset) * scale) + outOffset;
+    outW[i] = (DestTy)MAX(minVal, MIN(maxVal, result));
+  }
+}
 
-              T val =
-                  inW[libjit_getXYZW(inWdims, n, (size_t)ox, (size_t)oy, z)];
-              if (first || (val >= max)) {
-                first = 0;
-                max = val;
-                maxX = ox;
-                maxY = oy;
-              }
-            }
-          }
+/// The number of elements of a SoftMax row whose maximum is found before
+/// their exponentials are summed. The block is still in the cache for the
+/// second loop, so the row is read from memory once for both.
+constexpr size_t softmaxBlockSize = 256;
+
+/// Computes the maximum \p max of the \p n elements of \p row and the sum
+/// \p sum of exp(row[i] - max) in a single pass over the row. The running sum
+/// is rescaled whenever the maximum of a block exceeds the running maximum.
+void libjit_softmax_max_sum(const float *row, size_t n, float &max,
+                            float &sum) {
+  max = row[0];
+  sum = 0;
+  for (size_t b = 0; b < n; b += softmaxBlockSize) {
+    size_t e = MIN(b + softmaxBlockSize, n);
+    float blockMax = row[b];
+    for (size_t i = b + 1; i < e; i++) {
+      blockMax = MAX(blockMax, row[i]);
+    }
+    if (blockMax > max) {
+      sum *= libjit_exp(max - blockMax);
+      max = blockMax;
+    }
+    float blockSum = 0;
+    for (size_t i = b; i < e; i++) {
+      blockSum += libjit_exp(row[i] - max);
+    }
+    sum += blockSum;
+  }
+}
 
-          outW[libjit_getXYZW(outWdims, n, ax, ay, z)] = max;
-          // For the x and y argmax's, we use a 5-dimensional
-          // tensor whose fifth dimension has size 2:
-          size_t ix = 2 * libjit_getXYZW(outWdims, n, ax, ay, z);
-          inXY[ix] = maxX;
-          inXY[ix + 1] = maxY;
-        } // C
-      }   // W
-    }     // H
-  }       // N
+/// Selects the top k elements of a row of the input of a SoftMax and
+/// normalizes only them. SoftMax preserves the order of the elements, so
+/// the selection is the same, and the rest of the distribution is never
+/// written.
+void libjit_softmax_topk_task(void *ctx, size_t row) {
+  const auto *tasks = (const libjit_topk_tasks<float, size_t> *)ctx;
+  size_t k = tasks->k;
+  size_t n = tasks->n;
+  const float *input = tasks->input + row * n;
+  float *values = tasks->values + row * k;
+  libjit_topk_row(values, tasks->indices + row * k, input, k, n);
+
+  float max, sum;
+  libjit_softmax_max_sum(input, n, max, sum);
+  float inv = 1 / sum;
+  for (size_t i = 0; i < k; i++) {
+    values[i] = libjit_exp(values[i] - max) * inv;
+  }
+}
+
+/// The maximum number of dimensions of a reduction. The collapsed
+/// dimensions alternate between reduced and kept ones, so there are never
+/// more of them than dimensions of a tensor.
+constexpr size_t reduceMaxDims = 6;
+
+/// The number of int8 columns that are summed at once in int32 registers.
+constexpr size_t reduceBlockSize = 256;
+
+/// Combines \p a and \p b with a max when \p IsMax, or with a sum.
+template <bool IsMax> inline float libjit_reduce_op(float a, float b) {
+  return IsMax ? MAX(a, b) : a + b;
+}
+
+/// Reduces the dimensions \p dims of \p src into \p dest. The dimensions
+/// marked in \p reduced advance \p src by \p srcStrides and do not advance
+/// \p dest, and the kept ones advance both. The innermost dimension is
+/// accumulated into a single element when it is reduced, or element-wise into
+/// a contiguous row of \p dest when it is kept; both loops vectorize, so
+/// strided axes are reduced without a transpose.
+template <bool IsMax>
+void libjit_reduce_dims(float *dest, const float *src, const size_t *dims,
+                        const size_t *reduced, const size_t *srcStrides,
+                        const size_t *destStrides, size_t nDims) {
+  size_t n = dims[0];
+  if (nDims == 1) {
+    if (reduced[0]) {
+      float acc = dest[0];
+      for (size_t i = 0; i < n; i++) {
+        acc = libjit_reduce_op<IsMax>(acc, src[i]);
+      }
+      dest[0] = acc;
+    } else {
+      for (size_t i = 0; i < n; i++) {
+        dest[i] = libjit_reduce_op<IsMax>(dest[i], src[i]);
+      }
+    }
+    return;
+  }
+  size_t destStride = reduced[0] ? 0 : destStrides[0];
+  for (size_t i = 0; i < n; i++) {
+    libjit_reduce_dims<IsMax>(dest + i * destStride, src + i * srcStrides[0],
+                              dims + 1, reduced + 1, srcStrides + 1,
+                              destStrides + 1, nDims - 1);
+  }
+}
+
+/// Reduces \p src into \p dest over the collapsed dimensions \p dims that
+/// are marked in \p reduced, starting from \p init. \returns the number of
+/// elements that are reduced into every element of \p dest.
+template <bool IsMax>
+size_t libjit_reduce(float *dest, const float *src, const size_t *dims,
+                     const size_t *reduced, size_t nDims, float init) {
+  size_t srcStrides[reduceMaxDims];
+  size_t destStrides[reduceMaxDims];
+  size_t srcSize = 1;
+  size_t destSize = 1;
+  for (size_t i = nDims; i-- > 0;) {
+    srcStrides[i] = srcSize;
+    destStrides[i] = destSize;
+    srcSize *= dims[i];
+    destSize *= reduced[i] ? 1 : dims[i];
+  }
+  for (size_t i = 0; i < destSize; i++) {
+    dest[i] = init;
+  }
+  libjit_reduce_dims<IsMax>(dest, src, dims, reduced, srcStrides, destStrides,
+                            nDims);
+  return srcSize / destSize;
+}
+
+/// \returns the bin of \p value in a histogram of \p nBins bins of the width
+/// \p binWidth that starts at \p min.
+static size_t libjit_histogram_bin(size_t nBins, float binWidth, float min,
+                                   float value) {
+  return binWidth == 0 ? 0 : MIN((size_t)((value - min) / binWidth), nBins - 1);
+}
+
+/// Move the counts of the histogram \p hist of \p nBins bins over the range
+/// [\p min, \p max] to the bins of the larger range [\p newMin, \p newMax],
+/// like quantization::generateTensorHistogram. A bin is split between the two
+/// bins that it overlaps in proportion to the overlap.
+static void libjit_rescale_histogram(float *hist, size_t nBins, float min,
+                                     float max, float newMin, float newMax) {
+  float destBinWidth = (newMax - newMin) / nBins;
+  float srcBinWidth = (max - min) / nBins;
+  float *scaled = (float *)calloc(nBins, sizeof(float));
+  for (size_t i = 0; i < nBins; i++) {
+    float count = hist[i];
+    if (count == 0) {
+      continue;
+    }
+    float srcBinBegin = min + srcBinWidth * i;
+    size_t destBin = (srcBinBegin - newMin) / destBinWidth;
+    float destBinEnd = newMin + destBinWidth * (destBin + 1);
+    float destCount =
+        MIN(roundf((destBinEnd - srcBinBegin) / srcBinWidth * count), count);
+    scaled[libjit_histogram_bin(nBins, destBinWidth, newMin, srcBinBegin)] +=
+        destCount;
+    if (destCount < count) {
+      scaled[libjit_histogram_bin(nBins, destBinWidth, newMin,
+                                  srcBinBegin + destBinWidth)] +=
+          count - destCount;
+    }
+  }
+  memcpy(hist, scaled, nBins * sizeof(float));
+  free(scaled);
 }
 
 } // namespace
@@ -545,11 +935,8 @@ int8_t libjit_element_cmp_lte_kernel_i8(size_t idx, const int8_t *LHS,
 
 // tanh cannot be vectorized by LLVM yet. Therefore we use the following
 // formula instead: 1 - 2 / (exp(x * 2) + 1), which is also used by Caffe2 and
-// provides a good accuracy.
-// Once LLVM supports the vectorization of tanh, we can replace this
-// approximation by a direct tanh call.
-DEFINE_DATA_PARALLEL_KERNEL(libjit_tanh_kernel_f, float,
-                            1 - 2 / (expf(LHS[idx] * 2) + 1))
+// provides a good accuracy. See libjit_tanh.
+DEFINE_DATA_PARALLEL_KERNEL(libjit_tanh_kernel_f, float, libjit_tanh(LHS[idx]))
 DEFINE_DATA_PARALLEL_KERNEL(libjit_elementselect_kernel_f, float,
                             (LHS[idx] != 0.0) ? RHS[idx] : op3[idx])
 
@@ -568,13 +955,38 @@ int8_t libjit_elementselect_kernel_i8(size_t idx, const int8_t *cond,
 }
 
 DEFINE_DATA_PARALLEL_KERNEL_FUNC(libjit_sigmoid_kernel_f) {
-  float e = expf(LHS[idx]);
-  return e / (e + 1);
+  return libjit_sigmoid(LHS[idx]);
 }
-DEFINE_DATA_PARALLEL_KERNEL_WITH_IMM_OPERAND(libjit_element_maxsplat_kernel_f,
+DEFINE_DATA_PARALLEL_KERNEL_WITH_IMM_OPERAND(libjit_element_add_splat_kernel_f,
+                                             float, LHS[idx] + val)
+DEFINE_DATA_PARALLEL_KERNEL_WITH_IMM_OPERAND(libjit_element_mul_splat_kernel_f,
+                                             float, LHS[idx] * val)
+DEFINE_DATA_PARALLEL_KERNEL_WITH_IMM_OPERAND(libjit_element_max_splat_kernel_f,
                                              float, MAX(LHS[idx], val))
-DEFINE_DATA_PARALLEL_KERNEL_WITH_IMM_OPERAND(libjit_element_maxsplat_kernel_i8,
+DEFINE_DATA_PARALLEL_KERNEL_WITH_IMM_OPERAND(libjit_element_max_splat_kernel_i8,
                                              int8_t, MAX(LHS[idx], val))
+DEFINE_DATA_PARALLEL_KERNEL_WITH_IMM_OPERAND(libjit_element_min_splat_kernel_f,
+                                             float, MIN(LHS[idx], val))
+DEFINE_DATA_PARALLEL_KERNEL_WITH_IMM_OPERAND(
+    libjit_element_sub_splat_lhs_kernel_f, float, val - LHS[idx])
+DEFINE_DATA_PARALLEL_KERNEL_WITH_IMM_OPERAND(
+    libjit_element_div_splat_lhs_kernel_f, float, val / LHS[idx])
+DEFINE_DATA_PARALLEL_KERNEL_WITH_IMM_OPERAND(
+    libjit_element_div_splat_rhs_kernel_f, float, LHS[idx] / val)
+DEFINE_DATA_PARALLEL_KERNEL_WITH_IMM_OPERAND(
+    libjit_element_cmp_lte_splat_lhs_kernel_f, float,
+    val <= LHS[idx] ? 1.0 : 0.0)
+DEFINE_DATA_PARALLEL_KERNEL_WITH_IMM_OPERAND(
+    libjit_element_cmp_lte_splat_rhs_kernel_f, float,
+    LHS[idx] <= val ? 1.0 : 0.0)
+/// The condition of the select with a splat operand is LHS, and the other
+/// operand RHS.
+DEFINE_DATA_PARALLEL_KERNEL_WITH_IMM_OPERAND(
+    libjit_element_select_splat_lhs_kernel_f, float,
+    (LHS[idx] != 0.0) ? val : RHS[idx])
+DEFINE_DATA_PARALLEL_KERNEL_WITH_IMM_OPERAND(
+    libjit_element_select_splat_rhs_kernel_f, float,
+    (LHS[idx] != 0.0) ? RHS[idx] : val)
 DEFINE_DATA_PARALLEL_KERNEL_WITH_IMM_OPERAND(libjit_element_pow_kernel_f, float,
                                              pow(LHS[idx], val))
 DEFINE_DATA_PARALLEL_KERNEL_WITH_IMM_OPERAND(libjit_splat_kernel_f, float, val)
@@ -587,6 +999,40 @@ DEFINE_DATA_PARALLEL_KERNEL_WITH_IMM_OPERAND(libjit_splat_kernel_i8, int8_t,
 #undef DEFINE_DATA_PARALLEL_KERNEL_FUNC
 #undef DEFINE_DATA_PARALLEL_KERNEL_WITH_IMM_OPERAND
 
+/// The mini-kernel of BatchedAdd in a stacked kernel. The slice of \p
+/// sliceSize elements is added to every slice of the batch.
+float libjit_batchedadd_kernel_f(size_t idx, const float *batch,
+                                 const float *slice, size_t sliceSize) {
+  return batch[idx] + slice[idx % sliceSize];
+}
+
+/// The mini-kernel of Broadcast in a stacked kernel. \returns the element of
+/// \p src that is broadcast to the element \p idx of the destination. The
+/// dimensions \p srcDims are padded to \p nDims like in libjit_broadcast.
+float libjit_broadcast_kernel_f(size_t idx, const float *src,
+                                const size_t *destDims, const size_t *srcDims,
+                                size_t nDims) {
+  size_t srcIdx = 0;
+  size_t srcStride = 1;
+  for (size_t i = nDims; i-- > 0;) {
+    size_t coord = idx % destDims[i];
+    idx /= destDims[i];
+    if (srcDims[i] != 1) {
+      srcIdx += coord * srcStride;
+    }
+    srcStride *= srcDims[i];
+  }
+  return src[srcIdx];
+}
+
+/// The mini-kernel of a Broadcast that copies a single group of dimensions
+/// in a stacked kernel. The elements of \p src of \p size elements are
+/// repeated \p inner times, and the result is repeated as a whole.
+float libjit_broadcast_slice_kernel_f(size_t idx, const float *src,
+                                      size_t inner, size_t size) {
+  return src[idx / inner % size];
+}
+
 void libjit_broadcast_f(float *dest, const float *src, const size_t *destDims,
                         const size_t *srcDims, size_t nDims) {
   libjit_broadcast(dest, src, destDims, srcDims, nDims);
@@ -629,6 +1075,19 @@ void libjit_batchedadd_i8(int8_t *dest, const int8_t *batch,
   }
 }
 
+/// Adds the int32 accumulators \p slice to every slice of \p batch. All of
+/// the accumulators have the same scale and no offset.
+void libjit_batchedadd_i32(int32_t *dest, const int32_t *batch,
+                           const int32_t *slice, size_t numSlice,
+                           size_t sliceSize) {
+  for (size_t n = 0; n < numSlice; n++) {
+    size_t base = n * sliceSize;
+    for (size_t i = 0; i < sliceSize; i++) {
+      dest[base + i] = batch[base + i] + slice[i];
+    }
+  }
+}
+
 void libjit_batchedreduceadd_f(float *dest, const float *batch, size_t destSize,
                                size_t numSlice, size_t sliceSize) {
   for (size_t i = 0; i < destSize; i++) {
@@ -647,17 +1106,51 @@ void libjit_batchedreduceadd_i8(int8_t *dest, const int8_t *batch,
                                 size_t sliceSize, int32_t destOffset,
                                 int32_t batchOffset, int32_t batchPre,
                                 int32_t batchPost, int32_t batchScale) {
-  for (size_t i = 0; i < sliceSize; i++) {
-    int32_t sum = 0;
+  // The slices are summed row by row into a block of int32 accumulators, so
+  // the batch is read contiguously.
+  int32_t sums[reduceBlockSize];
+  for (size_t i0 = 0; i0 < sliceSize; i0 += reduceBlockSize) {
+    size_t len = MIN(reduceBlockSize, sliceSize - i0);
+    for (size_t i = 0; i < len; i++) {
+      sums[i] = 0;
+    }
     for (size_t n = 0; n < numSlice; n++) {
-      sum += batch[n * sliceSize + i] - batchOffset;
+      const int8_t *row = batch + n * sliceSize + i0;
+      for (size_t i = 0; i < len; i++) {
+        sums[i] += row[i] - batchOffset;
+      }
+    }
+    for (size_t i = 0; i < len; i++) {
+      int32_t q = libjit_scale_i32i8(sums[i], batchPre, batchPost, batchScale,
+                                     destOffset);
+      dest[i0 + i] = libjit_clip(q);
     }
-    int32_t q =
-        libjit_scale_i32i8(sum, batchPre, batchPost, batchScale, destOffset);
-    dest[i] = libjit_clip(q);
   }
 }
 
+void libjit_reduce_sum_f(float *dest, const float *src, const size_t *dims,
+                         const size_t *reduced, size_t nDims) {
+  libjit_reduce<false>(dest, src, dims, reduced, nDims, 0);
+}
+
+void libjit_reduce_mean_f(float *dest, const float *src, const size_t *dims,
+                          const size_t *reduced, size_t nDims) {
+  size_t count = libjit_reduce<false>(dest, src, dims, reduced, nDims, 0);
+  size_t destSize = 1;
+  for (size_t i = 0; i < nDims; i++) {
+    destSize *= reduced[i] ? 1 : dims[i];
+  }
+  float inv = 1.0f / count;
+  for (size_t i = 0; i < destSize; i++) {
+    dest[i] *= inv;
+  }
+}
+
+void libjit_reduce_max_f(float *dest, const float *src, const size_t *dims,
+                         const size_t *reduced, size_t nDims) {
+  libjit_reduce<true>(dest, src, dims, reduced, nDims, -FLT_MAX);
+}
+
 void libjit_gather_f(float *dest, const float *data, const size_t *indices,
                      size_t numIndices, size_t sliceSize) {
   libjit_gather(dest, data, indices, numIndices, sliceSize);
@@ -668,6 +1161,102 @@ void libjit_gather_i8(int8_t *dest, const int8_t *data, const size_t *indices,
   libjit_gather(dest, data, indices, numIndices, sliceSize);
 }
 
+void libjit_gather32_f(float *dest, const float *data, const int32_t *indices,
+                       size_t numIndices, size_t sliceSize) {
+  libjit_gather(dest, data, indices, numIndices, sliceSize);
+}
+
+void libjit_gather32_i8(int8_t *dest, const int8_t *data,
+                        const int32_t *indices, size_t numIndices,
+                        size_t sliceSize) {
+  libjit_gather(dest, data, indices, numIndices, sliceSize);
+}
+
+/// Sums the slices of \p data, of \p lineSize elements, gathered at the
+/// \p numIndices \p indices and scaled by \p weights, into the \p
+/// numSegments slices of \p dest. The slice i of \p dest sums the next
+/// \p lengths[i] gathered slices. The slices are accumulated in place, as
+/// they are gathered.
+void libjit_sparse_lengths_weighted_sum_f(float *dest, const float *data,
+                                          const float *weights,
+                                          const size_t *indices,
+                                          const size_t *lengths,
+                                          size_t numSegments, size_t numIndices,
+                                          size_t lineSize) {
+  memset(dest, 0, numSegments * lineSize * sizeof(float));
+  size_t curIndex = 0;
+  for (size_t i = 0; i < numSegments; i++) {
+    float *out = dest + i * lineSize;
+    for (size_t j = 0; j < lengths[i]; j++, curIndex++) {
+      libjit_prefetch_gathered(data, indices, curIndex, numIndices, lineSize);
+      const float *line = data + indices[curIndex] * lineSize;
+      float weight = weights[curIndex];
+      for (size_t k = 0; k < lineSize; k++) {
+        out[k] += weight * line[k];
+      }
+    }
+  }
+}
+
+/// Performs libjit_sparse_lengths_weighted_sum_f of the int8 \p data, where
+/// the row r is quantized with the scale \p scales[r] and the offset \p
+/// offsets[r]. The gathered rows are dequantized as they are accumulated.
+void libjit_rowwise_quantized_sparse_lengths_weighted_sum_i8(
+    float *dest, const int8_t *data, const float *scales,
+    const int32_t *offsets, const float *weights, const size_t *indices,
+    const size_t *lengths, size_t numSegments, size_t numIndices,
+    size_t lineSize) {
+  memset(dest, 0, numSegments * lineSize * sizeof(float));
+  size_t curIndex = 0;
+  for (size_t i = 0; i < numSegments; i++) {
+    float *out = dest + i * lineSize;
+    for (size_t j = 0; j < lengths[i]; j++, curIndex++) {
+      libjit_prefetch_gathered(data, indices, curIndex, numIndices, lineSize);
+      size_t row = indices[curIndex];
+      const int8_t *line = data + row * lineSize;
+      float scale = weights[curIndex] * scales[row];
+      int32_t offset = offsets[row];
+      for (size_t k = 0; k < lineSize; k++) {
+        out[k] += scale * (line[k] - offset);
+      }
+    }
+  }
+}
+
+/// Gathers the rows of \p lineSize elements of the int8 \p data at the
+/// \p numIndices \p indices into \p dest, where the row r is quantized with
+/// the scale \p scales[r] and the offset \p offsets[r]. The rows are
+/// dequantized as they are copied.
+void libjit_rowwise_quantized_gather_i8(float *dest, const int8_t *data,
+                                        const float *scales,
+                                        const int32_t *offsets,
+                                        const size_t *indices,
+                                        size_t numIndices, size_t lineSize) {
+  for (size_t i = 0; i < numIndices; i++) {
+    libjit_prefetch_gathered(data, indices, i, numIndices, lineSize);
+    size_t row = indices[i];
+    const int8_t *line = data + row * lineSize;
+    float *out = dest + i * lineSize;
+    float scale = scales[row];
+    int32_t offset = offsets[row];
+    for (size_t k = 0; k < lineSize; k++) {
+      out[k] = scale * (line[k] - offset);
+    }
+  }
+}
+
+void libjit_scatter_assign_f(float *data, const size_t *indices,
+                             const float *slices, size_t numIndices,
+                             size_t sliceSize) {
+  libjit_scatter_assign(data, indices, slices, numIndices, sliceSize);
+}
+
+void libjit_scatter_assign_i8(int8_t *data, const size_t *indices,
+                              const int8_t *slices, size_t numIndices,
+                              size_t sliceSize) {
+  libjit_scatter_assign(data, indices, slices, numIndices, sliceSize);
+}
+
 void libjit_local_response_normalization_f(float *outW, const float *inW,
                                            float *scaleCache,
                                            const size_t *outWdims,
@@ -676,27 +1265,39 @@ void libjit_local_response_normalization_f(float *outW, const float *inW,
                                            float beta, float k) {
   size_t window = 2 * halfWindow + 1;
   float normedAlpha = alpha / window;
+  size_t C = inWdims[3];
+  size_t numPixels = inWdims[0] * inWdims[1] * inWdims[2];
+
+  // The squared sum of every pixel slides along the channels: the channel
+  // that enters the window is added and the one that leaves it is
+  // subtracted, so every channel costs O(1) instead of O(window).
+  for (size_t p = 0; p < numPixels; p++) {
+    const float *in = inW + p * C;
+    float *scale = scaleCache + p * C;
+    float m2 = 0;
+    for (size_t i = 0, e = MIN(halfWindow, C); i < e; i++) {
+      m2 += in[i] * in[i];
+    }
+    for (size_t c = 0; c < C; c++) {
+      if (c + halfWindow < C) {
+        float val = in[c + halfWindow];
+        m2 += val * val;
+      }
+      if (c > halfWindow) {
+        float val = in[c - halfWindow - 1];
+        m2 -= val * val;
+      }
+      // The subtractions may leave a tiny negative rounding error.
+      scale[c] = k + normedAlpha * MAX(m2, 0.0f);
+    }
+  }
 
-  for (size_t n = 0; n < inWdims[0]; n++) {
-    for (size_t h = 0; h < inWdims[1]; h++) {
-      for (size_t w = 0; w < inWdims[2]; w++) {
-        for (size_t c = 0; c < inWdims[3]; c++) {
-          float m2 = 0.0;
-          for (size_t i = (c >= halfWindow ? c - halfWindow : 0);
-               i <= MIN(c + halfWindow, inWdims[3] - 1); i++) {
-            float val = inW[libjit_getXYZW(inWdims, n, h, w, i)];
-            m2 += val * val;
-          }
-
-          float scale = k + normedAlpha * m2;
-          scaleCache[libjit_getXYZW(inWdims, n, h, w, c)] = scale;
-          float normFactor = pow(scale, -beta);
-          outW[libjit_getXYZW(outWdims, n, h, w, c)] =
-              inW[libjit_getXYZW(inWdims, n, h, w, c)] * normFactor;
-        } // C
-      }   // W
-    }     // H
-  }       // N
+  // The powers are element-wise, so they are computed in one loop over all
+  // of the pixels and channels, which vectorizes. The output may alias the
+  // input, which is only read before it is overwritten.
+  for (size_t i = 0, e = numPixels * C; i < e; i++) {
+    outW[i] = inW[i] * libjit_exp(-beta * libjit_log(scaleCache[i]));
+  }
 }
 
 void libjit_local_response_normalization_grad_f(
@@ -706,45 +1307,159 @@ void libjit_local_response_normalization_grad_f(
   size_t window = 2 * halfWindow + 1;
   float normedAlpha = alpha / window;
   float coeff = 2 * normedAlpha * beta;
+  size_t C = outWdims[3];
+  size_t numPixels = outWdims[0] * outWdims[1] * outWdims[2];
 
-  for (size_t n = 0; n < outWdims[0]; n++) {
-    for (size_t h = 0; h < outWdims[1]; h++) {
-      for (size_t w = 0; w < outWdims[2]; w++) {
-        // Prepare right half of sliding window based at c = 0
-        float sum = 0.0;
-        for (size_t i = 0; i < MIN(halfWindow, outWdims[3]); i++) {
-          float outg = outG[libjit_getXYZW(outWdims, n, h, w, i)];
-          float outw = outW[libjit_getXYZW(outWdims, n, h, w, i)];
-          float scale = scaleCache[libjit_getXYZW(outWdims, n, h, w, i)];
-          sum += outg * (outw / scale);
-        }
+  // The element-wise term vectorizes over all of the pixels and channels.
+  for (size_t i = 0, e = numPixels * C; i < e; i++) {
+    inG[i] = outG[i] * libjit_exp(-beta * libjit_log(scaleCache[i]));
+  }
 
-        for (size_t c = 0; c < outWdims[3]; c++) {
-          if (c > halfWindow) {
-            size_t j = c - halfWindow - 1;
-            float outg = outG[libjit_getXYZW(outWdims, n, h, w, j)];
-            float outw = outW[libjit_getXYZW(outWdims, n, h, w, j)];
-            float scale = scaleCache[libjit_getXYZW(outWdims, n, h, w, j)];
-            sum -= outg * (outw / scale);
-          }
+  // The window sum of outG * outW / scale slides along the channels of
+  // every pixel.
+  for (size_t p = 0; p < numPixels; p++) {
+    size_t base = p * C;
+    float sum = 0;
+    for (size_t i = 0, e = MIN(halfWindow, C); i < e; i++) {
+      sum += outG[base + i] * (outW[base + i] / scaleCache[base + i]);
+    }
+    for (size_t c = 0; c < C; c++) {
+      if (c + halfWindow < C) {
+        size_t j = base + c + halfWindow;
+        sum += outG[j] * (outW[j] / scaleCache[j]);
+      }
+      if (c > halfWindow) {
+        size_t j = base + c - halfWindow - 1;
+        sum -= outG[j] * (outW[j] / scaleCache[j]);
+      }
+      inG[base + c] -= coeff * inW[base + c] * sum;
+    }
+  }
+}
 
-          size_t j = c + halfWindow;
-          if (j < outWdims[3]) {
-            float outg = outG[libjit_getXYZW(outWdims, n, h, w, j)];
-            float outw = outW[libjit_getXYZW(outWdims, n, h, w, j)];
-            float scale = scaleCache[libjit_getXYZW(outWdims, n, h, w, j)];
-            sum += outg * (outw / scale);
-          }
+/// Normalizes \p src, of \p outer x \p numChannels x \p inner elements,
+/// into \p dest with the statistics of the batch, for training. The
+/// statistics of every channel are blended into \p mean and \p var with
+/// \p momentum, and the blended ones normalize the input. The first pass
+/// accumulates the statistics of the data shifted by its first element,
+/// which keeps the subtraction of the variance accurate, and the second one
+/// normalizes. Both passes vectorize over the channels or over the inner
+/// elements.
+void libjit_batchnorm_f(float *dest, const float *src, const float *scale,
+                        const float *bias, float *mean, float *var,
+                        size_t outer, size_t numChannels, size_t inner,
+                        float epsilon, float momentum) {
+  float *shift = (float *)malloc(3 * numChannels * sizeof(float));
+  float *sum = shift + numChannels;
+  float *sumSq = sum + numChannels;
+  for (size_t c = 0; c < numChannels; c++) {
+    shift[c] = src[c * inner];
+    sum[c] = 0;
+    sumSq[c] = 0;
+  }
+  for (size_t o = 0; o < outer; o++) {
+    const float *in = src + o * numChannels * inner;
+    if (inner == 1) {
+      for (size_t c = 0; c < numChannels; c++) {
+        float d = in[c] - shift[c];
+        sum[c] += d;
+        sumSq[c] += d * d;
+      }
+      continue;
+    }
+    for (size_t c = 0; c < numChannels; c++) {
+      float s = 0, sq = 0;
+      for (size_t i = 0; i < inner; i++) {
+        float d = in[c * inner + i] - shift[c];
+        s += d;
+        sq += d * d;
+      }
+      sum[c] += s;
+      sumSq[c] += sq;
+    }
+  }
 
-          float outg = outG[libjit_getXYZW(outWdims, n, h, w, c)];
-          float inw = inW[libjit_getXYZW(outWdims, n, h, w, c)];
-          float scale = scaleCache[libjit_getXYZW(outWdims, n, h, w, c)];
-          inG[libjit_getXYZW(outWdims, n, h, w, c)] =
-              outg * pow(scale, -beta) - coeff * inw * sum;
-        }
-      } // W
-    }   // H
-  }     // N
+  // Turn the statistics into the coefficient and the offset of every channel:
+  // out = (in - mean) * scale / sqrt(var + eps) + bias.
+  float *coef = sum;
+  float *offset = sumSq;
+  float samples = outer * inner;
+  for (size_t c = 0; c < numChannels; c++) {
+    float m = sum[c] / samples;
+    float localVar = MAX(sumSq[c] / samples - m * m, 0);
+    float localMean = shift[c] + m;
+    float newMean = momentum * localMean + (1 - momentum) * mean[c];
+    float newVar = momentum * localVar + (1 - momentum) * var[c];
+    mean[c] = newMean;
+    var[c] = newVar;
+    coef[c] = scale[c] / sqrtf(newVar + epsilon);
+    offset[c] = bias[c] - newMean * coef[c];
+  }
+
+  for (size_t o = 0; o < outer; o++) {
+    const float *in = src + o * numChannels * inner;
+    float *out = dest + o * numChannels * inner;
+    for (size_t c = 0; c < numChannels; c++) {
+      for (size_t i = 0; i < inner; i++) {
+        out[c * inner + i] = in[c * inner + i] * coef[c] + offset[c];
+      }
+    }
+  }
+  free(shift);
+}
+
+/// Computes the gradients of libjit_batchnorm_f, with the blended \p mean
+/// and \p var, in two passes over \p src and \p destG. The first pass
+/// accumulates sum(dy) into \p biasG and sum(dy * (x - mu)) into \p scaleG.
+void libjit_batchnorm_grad_f(const float *src, const float *scale,
+                             const float *mean, const float *var,
+                             const float *destG, float *srcG, float *scaleG,
+                             float *biasG, size_t outer, size_t numChannels,
+                             size_t inner, float epsilon) {
+  for (size_t c = 0; c < numChannels; c++) {
+    biasG[c] = 0;
+    scaleG[c] = 0;
+  }
+  for (size_t o = 0; o < outer; o++) {
+    const float *in = src + o * numChannels * inner;
+    const float *dy = destG + o * numChannels * inner;
+    for (size_t c = 0; c < numChannels; c++) {
+      float s = 0, sh = 0;
+      for (size_t i = 0; i < inner; i++) {
+        s += dy[c * inner + i];
+        sh += dy[c * inner + i] * (in[c * inner + i] - mean[c]);
+      }
+      biasG[c] += s;
+      scaleG[c] += sh;
+    }
+  }
+
+  // dx = gamma / sqrt(var + eps) / N *
+  //      (N * dy - sum(dy) - (x - mu) / (var + eps) * sum(dy * (x - mu)))
+  float *coef1 = (float *)malloc(2 * numChannels * sizeof(float));
+  float *coef2 = coef1 + numChannels;
+  float samples = outer * inner;
+  for (size_t c = 0; c < numChannels; c++) {
+    float invVar = 1 / (var[c] + epsilon);
+    float invVarSqrt = sqrtf(invVar);
+    coef1[c] = scale[c] * invVarSqrt / samples;
+    coef2[c] = invVar * scaleG[c];
+    scaleG[c] *= invVarSqrt;
+  }
+
+  for (size_t o = 0; o < outer; o++) {
+    const float *in = src + o * numChannels * inner;
+    const float *dy = destG + o * numChannels * inner;
+    float *dx = srcG + o * numChannels * inner;
+    for (size_t c = 0; c < numChannels; c++) {
+      for (size_t i = 0; i < inner; i++) {
+        size_t j = c * inner + i;
+        dx[j] = coef1[c] * (samples * dy[j] - biasG[c] -
+                            (in[j] - mean[c]) * coef2[c]);
+      }
+    }
+  }
+  free(coef1);
 }
 
 void libjit_pool_max_i8(const int8_t *inW, int8_t *outW, const size_t *inWdims,
@@ -803,82 +1518,82 @@ void libjit_pool_max_xy_grad_f(float *inG, const float *outG,
   }       // N
 }
 
+/// The number of channels whose int32 sums libjit_pool_avg_i8 keeps at once.
+constexpr size_t poolAvgI8Channels = 64;
+
 void libjit_pool_avg_i8(const int8_t *inW, int8_t *outW, const size_t *inWdims,
                         const size_t *outWdims, size_t filterSize,
                         size_t stride, size_t pad, int32_t outOffset,
                         int32_t inOffset, int32_t outPre, int32_t outPost,
                         int32_t outScale) {
-  // For each input in the batch:
+  size_t C = inWdims[3];
+  int32_t sum[poolAvgI8Channels];
   for (size_t n = 0; n < outWdims[0]; n++) {
-    // For each (x,y) step in the input/output tensor:
-    ssize_t x = -ssize_t(pad);
+    ssize_t x = -(ssize_t)pad;
     for (size_t ax = 0; ax < outWdims[1]; x += stride, ax++) {
-      ssize_t y = -ssize_t(pad);
+      size_t x0, x1;
+      libjit_clip_window(x, filterSize, inWdims[1], x0, x1);
+      ssize_t y = -(ssize_t)pad;
       for (size_t ay = 0; ay < outWdims[2]; y += stride, ay++) {
-        // For each layer in the output tensor:
-        for (size_t z = 0; z < inWdims[3]; z++) {
-          int32_t sum = 0;
-
-          for (size_t fx = 0; fx < filterSize; fx++) {
-            for (size_t fy = 0; fy < filterSize; fy++) {
-              ssize_t ox = x + fx;
-              ssize_t oy = y + fy;
-
-              // Ignore index access below zero (this is due to padding).
-              if (ox < 0 || oy < 0 || ox >= (ssize_t)inWdims[1] ||
-                  oy >= (ssize_t)inWdims[2]) {
-                continue;
+        size_t y0, y1;
+        libjit_clip_window(y, filterSize, inWdims[2], y0, y1);
+        int8_t *out = outW + libjit_getXYZW(outWdims, n, ax, ay, 0);
+        for (size_t zb = 0; zb < C; zb += poolAvgI8Channels) {
+          size_t numZ = MIN(poolAvgI8Channels, C - zb);
+          for (size_t z = 0; z < numZ; z++) {
+            sum[z] = 0;
+          }
+          for (size_t ox = x0; ox < x1; ox++) {
+            for (size_t oy = y0; oy < y1; oy++) {
+              const int8_t *in =
+                  inW + libjit_getXYZW(inWdims, n, ox, oy, zb);
+              for (size_t z = 0; z < numZ; z++) {
+                sum[z] += in[z] - inOffset;
               }
-              sum +=
-                  inW[libjit_getXYZW(inWdims, n, (size_t)ox, (size_t)oy, z)] -
-                  inOffset;
             }
           }
-
-          outW[libjit_getXYZW(outWdims, n, ax, ay, z)] = libjit_clip(
-              libjit_scale_i32i8(sum, outPre, outPost, outScale, outOffset));
-        } // C
-      }   // W
-    }     // H
-  }       // N
+          for (size_t z = 0; z < numZ; z++) {
+            out[zb + z] = libjit_clip(libjit_scale_i32i8(
+                sum[z], outPre, outPost, outScale, outOffset));
+          }
+        }
+      } // W
+    }   // H
+  }     // N
 }
 
 void libjit_pool_avg_f(const float *inW, float *outW, const size_t *inWdims,
                        const size_t *outWdims, size_t filterSize, size_t stride,
                        size_t pad) {
   float filterArea = filterSize * filterSize;
-  // For each input in the batch:
+  size_t C = inWdims[3];
   for (size_t n = 0; n < outWdims[0]; n++) {
-    // For each (x,y) step in the input/output tensor:
     ssize_t x = -(ssize_t)pad;
     for (size_t ax = 0; ax < outWdims[1]; x += stride, ax++) {
+      size_t x0, x1;
+      libjit_clip_window(x, filterSize, inWdims[1], x0, x1);
       ssize_t y = -(ssize_t)pad;
       for (size_t ay = 0; ay < outWdims[2]; y += stride, ay++) {
-        // For each layer in the output tensor:
-        for (size_t z = 0; z < inWdims[3]; z++) {
-
-          float sum = 0;
-
-          for (size_t fx = 0; fx < filterSize; fx++) {
-            for (size_t fy = 0; fy < filterSize; fy++) {
-              ssize_t ox = x + fx;
-              ssize_t oy = y + fy;
-
-              // Ignore index access below zero (this is due to padding).
-              if (ox < 0 || oy < 0 || ox >= (ssize_t)inWdims[1] ||
-                  oy >= (ssize_t)inWdims[2]) {
-                continue;
-              }
-
-              sum += inW[libjit_getXYZW(inWdims, n, (size_t)ox, (size_t)oy, z)];
+        size_t y0, y1;
+        libjit_clip_window(y, filterSize, inWdims[2], y0, y1);
+        float *out = outW + libjit_getXYZW(outWdims, n, ax, ay, 0);
+        for (size_t z = 0; z < C; z++) {
+          out[z] = 0;
+        }
+        for (size_t ox = x0; ox < x1; ox++) {
+          for (size_t oy = y0; oy < y1; oy++) {
+            const float *in = inW + libjit_getXYZW(inWdims, n, ox, oy, 0);
+            for (size_t z = 0; z < C; z++) {
+              out[z] += in[z];
             }
           }
-
-          outW[libjit_getXYZW(outWdims, n, ax, ay, z)] = sum / filterArea;
-        } // C
-      }   // W
-    }     // H
-  }       // N
+        }
+        for (size_t z = 0; z < C; z++) {
+          out[z] /= filterArea;
+        }
+      } // W
+    }   // H
+  }     // N
 }
 
 void libjit_pool_avg_grad_f(float *inG, const float *outG,
@@ -918,9 +1633,29 @@ void libjit_pool_avg_grad_f(float *inG, const float *outG,
   }       // N
 }
 
+/// The quantization kernels process blocks of 8 elements with the vector
+/// types, and the remaining elements with the scalar code. The vector code
+/// produces the same results as the scalar code: the values are clipped to
+/// the range of int8 before they are converted to integers, and rounded half
+/// away from zero like roundf, which has no vector instruction and would
+/// otherwise be called for every element.
 void libjit_quantize_i8(int8_t *outW, const float *inW, size_t numElem,
                         float scale, int32_t offset) {
-  for (size_t i = 0; i < numElem; i++) {
+  size_t i = 0;
+  for (; i + 8 <= numElem; i += 8) {
+    float8 x = LoaduFloat8(&inW[i]) / scale + (float)offset;
+    int32x8 bits = (int32x8)x;
+    bits = SelectInt32x8(x < -128.0f, (int32x8)BroadcastFloat8(-128.0f), bits);
+    bits = SelectInt32x8(x > 127.0f, (int32x8)BroadcastFloat8(127.0f), bits);
+    x = (float8)bits;
+    // Truncate toward zero, and move the values whose fraction is at least
+    // one half away from zero. The comparisons return -1 for true.
+    int32x8 result = __builtin_convertvector(x, int32x8);
+    float8 frac = x - __builtin_convertvector(result, float8);
+    result = result - (frac >= 0.5f) + (frac <= -0.5f);
+    StoreuInt8x8(&outW[i], result);
+  }
+  for (; i < numElem; i++) {
     int32_t result = (int32_t)roundf(inW[i] / scale + offset);
     outW[i] = MAX(INT8_MIN, MIN(INT8_MAX, result));
   }
@@ -928,7 +1663,12 @@ void libjit_quantize_i8(int8_t *outW, const float *inW, size_t numElem,
 
 void libjit_dequantize_f(float *outW, const int8_t *inW, size_t numElem,
                          float scale, int32_t offset) {
-  for (size_t i = 0; i < numElem; i++) {
+  size_t i = 0;
+  for (; i + 8 <= numElem; i += 8) {
+    int32x8 x = LoaduInt8x8(&inW[i]) - offset;
+    StoreuFloat8(&outW[i], scale * __builtin_convertvector(x, float8));
+  }
+  for (; i < numElem; i++) {
     outW[i] = scale * (inW[i] - offset);
   }
 }
@@ -936,39 +1676,123 @@ void libjit_dequantize_f(float *outW, const int8_t *inW, size_t numElem,
 void libjit_rescale_i8(int8_t *outW, const int8_t *inW, size_t numElem,
                        int32_t outOffset, int32_t inOffset, int32_t pre,
                        int32_t post, int32_t scale) {
-  for (size_t i = 0; i < numElem; i++) {
+  // See libjit_scale_i32i8.
+  int32_t rtn = (post > 0) ? (1 << (post - 1)) : 0;
+  size_t i = 0;
+  for (; i + 8 <= numElem; i += 8) {
+    int32x8 x = LoaduInt8x8(&inW[i]) - inOffset;
+    x = ((((x >> pre) * scale) + rtn) >> post) + outOffset;
+    StoreuInt8x8(&outW[i], ClipInt32x8(x));
+  }
+  for (; i < numElem; i++) {
     int32_t s =
         libjit_scale_i32i8(inW[i] - inOffset, pre, post, scale, outOffset);
     outW[i] = libjit_clip(s);
   }
 }
 
-void libjit_softmax_f(const float *inW, float *outW, const size_t *idim,
-                      const size_t *odim) {
-  for (size_t n = 0; n < idim[0]; n++) {
-    float max = inW[libjit_getXY(idim, n, 0)];
+void libjit_quantize_i16(int16_t *outW, const float *inW, size_t numElem,
+                         float scale, int32_t offset) {
+  libjit_quantize_generic(outW, inW, numElem, scale, offset, INT16_MIN,
+                          INT16_MAX);
+}
 
-    // Find Max.
-    for (size_t i = 1; i < idim[1]; i++) {
-      max = MAX(max, inW[libjit_getXY(idim, n, i)]);
-    }
+void libjit_quantize_i32(int32_t *outW, const float *inW, size_t numElem,
+                         float scale, int32_t offset) {
+  // INT32_MAX is not a float, clip to the largest float below it.
+  libjit_quantize_generic(outW, inW, numElem, scale, offset, INT32_MIN,
+                          2147483520.0f);
+}
 
-    float sum = 0;
+/// Dequantizes the int16 tensor \p inW into the float tensor \p outW.
+void libjit_dequantize_i16(float *outW, const int16_t *inW, size_t numElem,
+                           float scale, int32_t offset) {
+  for (size_t i = 0; i < numElem; i++) {
+    outW[i] = scale * (inW[i] - offset);
+  }
+}
 
-    // Compute exp.
-    for (size_t i = 0; i < idim[1]; i++) {
-      float e = expf(inW[libjit_getXY(idim, n, i)] - max);
-      sum += e;
-      outW[libjit_getXY(odim, n, i)] = e;
-    }
+/// The rescale kernels of the int16 and int32 tensors, named after the source
+/// and the destination types. \p scale is the ratio of the source scale to
+/// the destination scale.
+/// @{
+void libjit_rescale_i8_i16(int16_t *outW, const int8_t *inW, size_t numElem,
+                           int32_t outOffset, int32_t inOffset, float scale) {
+  libjit_rescale_generic(outW, inW, numElem, outOffset, inOffset, scale,
+                         INT16_MIN, INT16_MAX);
+}
 
-    // Normalize the output.
-    for (size_t i = 0; i < idim[1]; i++) {
-      outW[libjit_getXY(odim, n, i)] = outW[libjit_getXY(odim, n, i)] / sum;
+void libjit_rescale_i16_i8(int8_t *outW, const int16_t *inW, size_t numElem,
+                           int32_t outOffset, int32_t inOffset, float scale) {
+  libjit_rescale_generic(outW, inW, numElem, outOffset, inOffset, scale,
+                         INT8_MIN, INT8_MAX);
+}
+
+void libjit_rescale_i16_i16(int16_t *outW, const int16_t *inW, size_t numElem,
+                            int32_t outOffset, int32_t inOffset, float scale) {
+  libjit_rescale_generic(outW, inW, numElem, outOffset, inOffset, scale,
+                         INT16_MIN, INT16_MAX);
+}
+
+void libjit_rescale_i32_i8(int8_t *outW, const int32_t *inW, size_t numElem,
+                           int32_t outOffset, int32_t inOffset, float scale) {
+  libjit_rescale_generic(outW, inW, numElem, outOffset, inOffset, scale,
+                         INT8_MIN, INT8_MAX);
+}
+
+void libjit_rescale_i32_i16(int16_t *outW, const int32_t *inW, size_t numElem,
+                            int32_t outOffset, int32_t inOffset, float scale) {
+  libjit_rescale_generic(outW, inW, numElem, outOffset, inOffset, scale,
+                         INT16_MIN, INT16_MAX);
+}
+/// @}
+
+void libjit_softmax_f(const float *inW, float *outW, const size_t *idim,
+                      const size_t *odim) {
+  size_t n = idim[1];
+  for (size_t r = 0; r < idim[0]; r++) {
+    const float *in = inW + r * n;
+    float *out = outW + r * odim[1];
+
+    // Find the max and the sum of the exponentials in one pass, then write the
+    // normalized exponentials in a second one.
+    float max, sum;
+    libjit_softmax_max_sum(in, n, max, sum);
+    float inv = 1 / sum;
+    for (size_t i = 0; i < n; i++) {
+      out[i] = libjit_exp(in[i] - max) * inv;
     }
   } // N
 }
 
+/// Computes the cross entropy loss of the SoftMax of \p inW, whose rows are
+/// the logits of the classes, for the \p labels into \p CE. The log of the
+/// probability of the label is computed from the logits, without computing
+/// the distribution.
+void libjit_softmax_cross_entropy_loss_f(float *CE, const float *inW,
+                                         const size_t *labels,
+                                         const size_t *idim) {
+  size_t n = idim[1];
+  float loss = 0;
+  for (size_t r = 0; r < idim[0]; r++) {
+    const float *in = inW + r * n;
+    float max, sum;
+    libjit_softmax_max_sum(in, n, max, sum);
+    loss -= in[labels[r]] - max - libjit_log(sum);
+  }
+  CE[0] = loss;
+}
+
+/// Selects the top \p k elements of the SoftMax of the rows of \p input, like
+/// libjit_topk_f. The SoftMax is computed only for the selected elements.
+void libjit_softmax_topk_f(float *values, size_t *indices, const float *input,
+                           size_t k, size_t n, size_t size,
+                           size_t numThreads) {
+  libjit_topk_tasks<float, size_t> tasks = {values, indices, input, k, n};
+  libjit_parallel_for(size / n, MIN(numThreads, size / topkWorkPerThread),
+                      libjit_softmax_topk_task, &tasks);
+}
+
 void libjit_softmax_grad_f(float *inG, float *outW, const size_t *selectedW,
                            const size_t *idim, const size_t *selectdim) {
   for (size_t n = 0; n < idim[0]; n++) {
@@ -981,19 +1805,73 @@ void libjit_softmax_grad_f(float *inG, float *outW, const size_t *selectedW,
 
 void libjit_sigmoid_f(const float *inW, float *outW, size_t numElem) {
   for (size_t i = 0; i < numElem; i++) {
-    float e = expf(inW[i]);
-    outW[i] = e / (e + 1);
+    outW[i] = libjit_sigmoid(inW[i]);
+  }
+}
+
+/// Compute one step of an LSTM cell. \p gates holds the [batch, 4 * hidden]
+/// pre-activations of the forget, input, output and cell gates, and \p C is
+/// the [batch, hidden] cell state. The activations of the gates are fused with
+/// the computation of the new states \p newC and \p newH.
+void libjit_lstm_unit_f(float *newC, float *newH, const float *gates,
+                        const float *C, size_t batch, size_t hidden) {
+  for (size_t n = 0; n < batch; n++) {
+    const float *g = gates + n * 4 * hidden;
+    for (size_t j = 0; j < hidden; j++) {
+      float f = libjit_sigmoid(g[j]);
+      float i = libjit_sigmoid(g[hidden + j]);
+      float o = libjit_sigmoid(g[2 * hidden + j]);
+      float u = libjit_tanh(g[3 * hidden + j]);
+      float c = f * C[n * hidden + j] + i * u;
+      newC[n * hidden + j] = c;
+      newH[n * hidden + j] = o * libjit_tanh(c);
+    }
+  }
+}
+
+/// Update the weights \p W from the gradients \p G in a single pass, with the
+/// L1 and L2 decay, the batch size and the learning rate applied to every
+/// gradient. With momentum, \p gsum accumulates the previous updates;
+/// otherwise it is not accessed.
+void libjit_sgd_f(float *W, float *gsum, const float *G, size_t numElem,
+                  float L1Decay, float L2Decay, float learningRate,
+                  float momentum, float batchSize) {
+  float negLearningRate = -learningRate;
+  if (momentum > 0) {
+    for (size_t i = 0; i < numElem; i++) {
+      float w = W[i];
+      float g = G[i] + L1Decay * (w >= 0 ? 1 : -1) + L2Decay * w;
+      float dx = negLearningRate * (g / batchSize) + momentum * gsum[i];
+      gsum[i] = dx;
+      W[i] = w + dx;
+    }
+    return;
+  }
+  for (size_t i = 0; i < numElem; i++) {
+    float w = W[i];
+    float g = G[i] + L1Decay * (w >= 0 ? 1 : -1) + L2Decay * w;
+    W[i] = w + negLearningRate * (g / batchSize);
   }
 }
 
 void libjit_topk_f(float *values, size_t *indices, const float *input,
-                   size_t *scratch, size_t k, size_t n, size_t size) {
-  libjit_topk(values, indices, input, scratch, k, n, size);
+                   size_t k, size_t n, size_t size, size_t numThreads) {
+  libjit_topk(values, indices, input, k, n, size, numThreads);
 }
 
 void libjit_topk_i8(int8_t *values, size_t *indices, const int8_t *input,
-                    size_t *scratch, size_t k, size_t n, size_t size) {
-  libjit_topk(values, indices, input, scratch, k, n, size);
+                    size_t k, size_t n, size_t size, size_t numThreads) {
+  libjit_topk(values, indices, input, k, n, size, numThreads);
+}
+
+void libjit_topk32_f(float *values, int32_t *indices, const float *input,
+                     size_t k, size_t n, size_t size, size_t numThreads) {
+  libjit_topk(values, indices, input, k, n, size, numThreads);
+}
+
+void libjit_topk32_i8(int8_t *values, int32_t *indices, const int8_t *input,
+                      size_t k, size_t n, size_t size, size_t numThreads) {
+  libjit_topk(values, indices, input, k, n, size, numThreads);
 }
 
 void libjit_transpose_i8(const int8_t *inW, int8_t *outW, const size_t *idim,
@@ -1014,6 +1892,21 @@ void libjit_transpose_u(const size_t *inW, size_t *outW, const size_t *idim,
   libjit_transpose_generic(inW, outW, idim, odim, shuffle, numDims);
 }
 
+void libjit_transpose_batched_i8(const int8_t *inW, int8_t *outW,
+                                 size_t batch, size_t rows, size_t cols) {
+  libjit_transpose_batched(inW, outW, batch, rows, cols);
+}
+
+void libjit_transpose_batched_f(const float *inW, float *outW, size_t batch,
+                                size_t rows, size_t cols) {
+  libjit_transpose_batched(inW, outW, batch, rows, cols);
+}
+
+void libjit_transpose_batched_u(const size_t *inW, size_t *outW, size_t batch,
+                                size_t rows, size_t cols) {
+  libjit_transpose_batched(inW, outW, batch, rows, cols);
+}
+
 void libjit_insert_tensor_f(float *tensor, float *slice, size_t *offset,
                             size_t *tensorDim, size_t *sliceDim,
                             size_t numDimsTensor, size_t numDimsSlice,
@@ -1062,6 +1955,173 @@ void libjit_insert_tensor_i8(int8_t *tensor, int8_t *slice, size_t *offset,
                        numDimsTensor, numDimsSlice, offsetDim);
 }
 
+uint64_t libjit_profile_timestamp() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return uint64_t(ts.tv_sec) * 1000000000 + ts.tv_nsec;
+}
+
+/// Print the profile of the \p numKernels kernels named \p names. The profile
+/// holds the total time in nanoseconds and the number of calls of every kernel.
+/// \p costs holds the analytic operations and bytes of a call of every kernel,
+/// from which the achieved GFLOP/s and GB/s are derived. The kernels are listed
+/// in the order of decreasing total time.
+__attribute__((noinline)) void libjit_dump_profile(const char **names,
+                                                   const uint64_t *profile,
+                                                   const uint64_t *costs,
+                                                   size_t numKernels) {
+  uint64_t total = 0;
+  size_t *order = (size_t *)malloc(numKernels * sizeof(size_t));
+  for (size_t i = 0; i < numKernels; i++) {
+    total += profile[2 * i];
+    // Insertion sort by the decreasing total time.
+    size_t j = i;
+    for (; j > 0 && profile[2 * order[j - 1]] < profile[2 * i]; j--) {
+      order[j] = order[j - 1];
+    }
+    order[j] = i;
+  }
+
+  printf("%12s %12s %10s %7s %9s %9s  %s\n", "total (ms)", "avg (ms)", "calls",
+         "%", "GFLOP/s", "GB/s", "kernel");
+  for (size_t i = 0; i < numKernels; i++) {
+    size_t k = order[i];
+    uint64_t time = profile[2 * k];
+    uint64_t calls = profile[2 * k + 1];
+    // The operations and bytes per nanosecond are the GFLOP/s and GB/s.
+    double flops = time ? double(costs[2 * k]) * calls / time : 0.0;
+    double bytes = time ? double(costs[2 * k + 1]) * calls / time : 0.0;
+    printf("%12.3f %12.3f %10llu %6.2f%% %9.2f %9.2f  %s\n", time / 1e6,
+           calls ? time / 1e6 / calls : 0.0, (unsigned long long)calls,
+           total ? 100.0 * time / total : 0.0, flops, bytes, names[k]);
+  }
+  printf("%12.3f ms in total\n", total / 1e6);
+  free(order);
+}
+
+/// \returns the most capable of the CPU variants of a bundle that the host
+/// supports: 3 for AVX-512, 2 for AVX2, 1 for SSE4.2 and 0 for the baseline.
+/// The levels and their features must match the -bundle-cpu-variants of the
+/// CPU backend.
+unsigned libjit_cpu_level(void) {
+#if defined(__x86_64__) || defined(__i386__)
+  __builtin_cpu_init();
+  if (__builtin_cpu_supports("avx512f") && __builtin_cpu_supports("avx512bw") &&
+      __builtin_cpu_supports("avx512dq") &&
+      __builtin_cpu_supports("avx512vl") && __builtin_cpu_supports("fma")) {
+    return 3;
+  }
+  if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma")) {
+    return 2;
+  }
+  if (__builtin_cpu_supports("sse4.2") && __builtin_cpu_supports("popcnt")) {
+    return 1;
+  }
+#endif
+  return 0;
+}
+
+/// Accumulate the statistics of the \p size elements of \p src: \p counters
+/// holds the number of calls, of elements, of NaNs, of infinities and of
+/// zeros, and \p range the min and the max of the finite elements. The library
+/// is built with -ffast-math, which folds the comparisons with NaNs, so the
+/// elements are classified by their bits.
+void libjit_tensor_stats_f(const float *src, size_t size, size_t *counters,
+                           float *range) {
+  size_t nans = 0, infs = 0, zeros = 0;
+  float min = range[0];
+  float max = range[1];
+  for (size_t i = 0; i < size; i++) {
+    uint32_t bits;
+    memcpy(&bits, &src[i], sizeof(bits));
+    uint32_t abs = bits & 0x7fffffffu;
+    bool isFinite = abs < 0x7f800000u;
+    nans += abs > 0x7f800000u;
+    infs += abs == 0x7f800000u;
+    zeros += abs == 0;
+    if (isFinite) {
+      min = MIN(min, src[i]);
+      max = MAX(max, src[i]);
+    }
+  }
+  counters[0] += 1;
+  counters[1] += size;
+  counters[2] += nans;
+  counters[3] += infs;
+  counters[4] += zeros;
+  range[0] = min;
+  range[1] = max;
+}
+
+/// Add the \p size elements of \p inW to the histogram \p hist of \p nBins
+/// bins over the range [\p info[0], \p info[1]], and extend the range to the
+/// elements, like quantization::generateTensorHistogram of the Interpreter.
+/// The min and the max of the elements and their bins are computed 8
+/// elements at a time, and only the counting is scalar. The histogram is
+/// rescaled only when the elements leave its range.
+void libjit_quantization_profile_f(const float *inW, size_t size, float *hist,
+                                   size_t nBins, float *info) {
+  float minInput = inW[0];
+  float maxInput = inW[0];
+  size_t i = 0;
+  if (size >= 8) {
+    float8 min8 = LoaduFloat8(inW);
+    float8 max8 = min8;
+    for (i = 8; i + 8 <= size; i += 8) {
+      float8 x = LoaduFloat8(&inW[i]);
+      min8 = (float8)SelectInt32x8(x < min8, (int32x8)x, (int32x8)min8);
+      max8 = (float8)SelectInt32x8(x > max8, (int32x8)x, (int32x8)max8);
+    }
+    for (unsigned l = 0; l < 8; l++) {
+      minInput = MIN(minInput, min8[l]);
+      maxInput = MAX(maxInput, max8[l]);
+    }
+  }
+  for (; i < size; i++) {
+    minInput = MIN(minInput, inW[i]);
+    maxInput = MAX(maxInput, inW[i]);
+  }
+
+  // An empty histogram takes the range of the first elements.
+  float min = info[0];
+  float max = info[1];
+  bool isEmpty = true;
+  for (size_t b = 0; b < nBins && isEmpty; b++) {
+    isEmpty = hist[b] == 0;
+  }
+  if (isEmpty) {
+    min = minInput;
+    max = maxInput;
+  }
+  if (minInput < min || maxInput > max) {
+    float newMin = MIN(minInput, min);
+    float newMax = MAX(maxInput, max);
+    libjit_rescale_histogram(hist, nBins, min, max, newMin, newMax);
+    min = newMin;
+    max = newMax;
+  }
+  info[0] = min;
+  info[1] = max;
+
+  float binWidth = (max - min) / nBins;
+  if (binWidth == 0) {
+    hist[0] += size;
+    return;
+  }
+  int32x8 lastBin = BroadcastInt32x8((int32_t)nBins - 1);
+  for (i = 0; i + 8 <= size; i += 8) {
+    float8 x = (LoaduFloat8(&inW[i]) - min) / binWidth;
+    int32x8 bins = __builtin_convertvector(x, int32x8);
+    bins = SelectInt32x8(bins > lastBin, lastBin, bins);
+    for (unsigned l = 0; l < 8; l++) {
+      hist[bins[l]]++;
+    }
+  }
+  for (; i < size; i++) {
+    hist[libjit_histogram_bin(nBins, binWidth, min, inW[i])]++;
+  }
+}
+
 __attribute__((noinline)) void
 libjit_dump_tensor(uint8_t *tensor, size_t *tensorDim, size_t numDimsTensor,
                    size_t elemKind, const char *name) {
@@ -1069,7 +2129,9 @@ libjit_dump_tensor(uint8_t *tensor, size_t *tensorDim, size_t numDimsTensor,
   /// This definition should match the defintion in Glow.
   enum ElemKind {
     FloatTy,
+    Float16Ty,
     Int8QTy,
+    Int16QTy,
     Int32QTy,
     IndexTy,
   };
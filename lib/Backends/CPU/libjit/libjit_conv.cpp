@@ -26,250 +26,626 @@
 
 namespace {
 // Initialize the convolution output frame for slice \p N with the bias \p
-// biasW.
+// biasW, plus the residual \p residualW of the same shape as the output if it
+// is not null. The residual may be the output itself.
 void libjit_conv_init_output_with_bias(size_t N, float *outW,
                                        const float *biasW,
+                                       const float *residualW,
                                        const size_t *outWdims,
                                        const size_t *biasWdims) {
   // For each (x,y) step in the output tensor:
   for (size_t ax = 0; ax < outWdims[1]; ax++) {
     for (size_t ay = 0; ay < outWdims[2]; ay++) {
-      // For each output channel:
-      for (size_t d = 0; d < outWdims[3]; d++) {
-        // Store the results to the output buffer.
-        float bias = biasW[d];
-        auto outIdx = libjit_getXYZW(outWdims, N, ax, ay, d);
-        outW[outIdx] = bias;
-      } // For each depth in the output.
-    }   // For each Y in the output.
-  }     // For each X in the output.
+      auto outIdx = libjit_getXYZW(outWdims, N, ax, ay, 0);
+      // For each output channel, store the results to the output buffer.
+      if (residualW) {
+        for (size_t d = 0; d < outWdims[3]; d++) {
+          outW[outIdx + d] = residualW[outIdx + d] + biasW[d];
+        }
+      } else {
+        for (size_t d = 0; d < outWdims[3]; d++) {
+          outW[outIdx + d] = biasW[d];
+        }
+      }
+    } // For each Y in the output.
+  }   // For each X in the output.
 }
 
-/// Perform the heart of the convolution. Load \p ywidth scalars in a specific
-/// channel, broadcast them, and multiply them with
-/// [ywidth * float8 * numDepthRegs] depth values and accumulate them to create
-/// [ywidth * float8 * numDepthRegs] depth result values.
-void libjit_convDKKC8_convolve_channel(
-    float *outW, const float *inW, const float *filterW, const size_t *outWdims,
-    const size_t *inWdims, const size_t *filterWdims, size_t sampleN,
-    size_t outChannel, unsigned numDepthRegs, unsigned ywidth,
-    size_t numChannels, ssize_t inX, ssize_t inY, size_t outX, size_t outY,
-    size_t filterX, size_t filterY, size_t stride) {
-
-  // Process N * YWidth * 8 output pixels at once. Each value here is a
-  // scalar that represents the sum for (x,y..y+ywidth) and the filter. The
-  // SIMD dimension represents multiple layers of the depth
-  // (output channel).
-  float8 sum[numDepthRegs][ywidth];
-  for (unsigned wu = 0; wu < ywidth; wu++) {
-    for (unsigned du = 0; du < numDepthRegs; du++) {
-      sum[du][wu] = 0;
+/// The float vector that the DKKC kernels with groups of groupWidth output
+/// channels accumulate in: the native floatv, unless it is wider than the
+/// group.
+template <unsigned groupWidth> struct libjit_dkkc_vec { typedef floatv type; };
+#if defined(__AVX512F__)
+template <> struct libjit_dkkc_vec<8> { typedef float8 type; };
+#endif
+
+/// Compute the output tile of \p tileY pixels (\p outX, \p outY .. outY +
+/// tileY) and the \p numGroups groups of groupWidth output channels that start
+/// at \p outChannel. The accumulators of the tile stay in registers for all of
+/// the filter taps and the input channels, so the output is written once. They
+/// start with the bias and the residual \p residualW, if it is not null. The
+/// filter window of the first pixel starts at the input pixel (\p x, \p y),
+/// which is negative in the padding, and the taps inside the input are
+/// [\p x0, \p x1) x [\p y0, \p y1). The windows of the other pixels of the
+/// tile are the same window moved by the stride in Y, so the tiles of several
+/// pixels must not cross the border in Y. The filter has the layout
+/// [D/groupWidth, K, K, C, groupWidth], and a group is processed as several
+/// vectors if the registers are narrower, e.g. as two float4 halves of a group
+/// of 8 channels on NEON.
+template <unsigned groupWidth>
+void libjit_convDKKC_tile(float *outW, const float *inW, const float *filterW,
+                          const float *biasW, const float *residualW,
+                          const size_t *outWdims, const size_t *inWdims,
+                          size_t filterSize, size_t stride, size_t sampleN,
+                          size_t outChannel, unsigned numGroups,
+                          unsigned tileY, size_t outX, size_t outY, ssize_t x,
+                          ssize_t y, size_t x0, size_t x1, size_t y0,
+                          size_t y1, const libjit_epilogue &epilogue) {
+  typedef typename libjit_dkkc_vec<groupWidth>::type vec;
+  constexpr unsigned vecWidth = sizeof(vec) / sizeof(float);
+  // The number of vectors that hold the channels of a group.
+  constexpr unsigned vecsPerGroup = groupWidth / vecWidth;
+  unsigned numVecs = numGroups * vecsPerGroup;
+  size_t C = inWdims[3];
+  // The distance between the inputs of the consecutive pixels of the tile.
+  size_t inStep = stride * C;
+  // The distance between the groups of the filter.
+  size_t groupStep = filterSize * filterSize * C * groupWidth;
+
+  vec sum[numVecs][tileY];
+  for (unsigned wu = 0; wu < tileY; wu++) {
+    auto outIdx =
+        libjit_getXYZW(outWdims, sampleN, outX, outY + wu, outChannel);
+    for (unsigned dv = 0; dv < numVecs; dv++) {
+      memcpy(&sum[dv][wu], &biasW[outChannel + dv * vecWidth], sizeof(vec));
+      if (residualW) {
+        vec residual;
+        memcpy(&residual, &residualW[outIdx + dv * vecWidth], sizeof(vec));
+        sum[dv][wu] += residual;
+      }
     }
   }
 
-  // Perform the heart of the convolution.
+  // For each tap of the filter that is inside the input:
+  for (size_t ix = x0; ix < x1; ix++) {
+    for (size_t iy = y0; iy < y1; iy++) {
+      const float *in = inW + libjit_getXYZW(inWdims, sampleN, ix, iy, 0);
+      const float *filter =
+          filterW + (outChannel / groupWidth) * groupStep +
+          ((ix - x) * filterSize + (iy - y)) * C * groupWidth;
 
-  // For each input channel:
-  for (size_t fd = 0; fd < numChannels; fd++) {
-    // First, load and broadcast the scalar data from the input buffer.
-    float8 in8[ywidth];
-    for (unsigned wu = 0; wu < ywidth; wu++) {
-      // Load a single pixel from the input image and broadcast it.
-      auto inIdx = libjit_getXYZW(inWdims, sampleN, inX, inY + wu * stride, fd);
-      in8[wu] = inW[inIdx];
+      // For each input channel, multiply the groups of the filter by the
+      // broadcast input of every pixel of the tile.
+      for (size_t c = 0; c < C; c++) {
+        vec filterV[numVecs];
+        for (unsigned g = 0; g < numGroups; g++) {
+          for (unsigned v = 0; v < vecsPerGroup; v++) {
+            memcpy(&filterV[g * vecsPerGroup + v],
+                   &filter[g * groupStep + c * groupWidth + v * vecWidth],
+                   sizeof(vec));
+          }
+        }
+        for (unsigned wu = 0; wu < tileY; wu++) {
+          vec inV = (vec)(in[wu * inStep + c]);
+          for (unsigned dv = 0; dv < numVecs; dv++) {
+            sum[dv][wu] += filterV[dv] * inV;
+          }
+        }
+      }
     }
+  }
 
-    // For each y pixel:
-    for (unsigned wu = 0; wu < ywidth; wu++) {
-      // Load N x 8 elements from the filter layer. The filter is
-      // pre-swizzled to ensure efficient access.
-      for (unsigned du = 0; du < numDepthRegs; du++) {
-        auto filterIdx = libjit_getXYZWQ(filterWdims, outChannel / 8 + du,
-                                         filterX, filterY, fd, 0);
-        float8 ff0 = LoadFloat8(&filterW[filterIdx]);
-        sum[du][wu] += ff0 * in8[wu];
-      }
+  // Store the complete outputs and apply the activation while they are in
+  // the cache.
+  for (unsigned wu = 0; wu < tileY; wu++) {
+    auto outIdx =
+        libjit_getXYZW(outWdims, sampleN, outX, outY + wu, outChannel);
+    for (unsigned dv = 0; dv < numVecs; dv++) {
+      memcpy(&outW[outIdx + dv * vecWidth], &sum[dv][wu], sizeof(vec));
     }
+    epilogue.apply(1, numGroups * groupWidth, &outW[outIdx], 0, outChannel);
   }
+}
 
-  // Store the results to the output buffer.
-  for (unsigned wu = 0; wu < ywidth; wu++) {
-    for (unsigned du = 0; du < numDepthRegs; du++) {
-      // Add the partial sum to the tile.
-      auto outIdx = libjit_getXYZW(outWdims, sampleN, outX, outY + wu,
-                                   outChannel + du * 8);
-      AddFloat8(&outW[outIdx], sum[du][wu]);
+/// Compute the outputs of the sample \p sampleN in the \p numGroups groups of
+/// groupWidth output channels that start at \p outChannel. The rows of the
+/// output are processed in tiles of \p sizeGroupY pixels, whose filter windows
+/// are inside the input in Y and need no bounds checks. The pixels at the
+/// borders in Y, whose windows are clipped, and the rest of the row are
+/// processed one at a time. The windows are clipped in X for whole tiles.
+template <unsigned groupWidth>
+void libjit_convDKKC_channels(float *outW, const float *inW,
+                              const float *filterW, const float *biasW,
+                              const float *residualW, const size_t *outWdims,
+                              const size_t *inWdims, size_t filterSize,
+                              size_t stride, size_t pad, size_t sampleN,
+                              size_t outChannel, unsigned numGroups,
+                              unsigned sizeGroupY,
+                              const libjit_epilogue &epilogue) {
+  // The first and the last output pixels in Y whose windows are inside the
+  // input in Y are [interiorBegin, interiorEnd).
+  size_t interiorBegin = (pad + stride - 1) / stride;
+  size_t interiorEnd = 0;
+  if (inWdims[2] + pad >= filterSize) {
+    interiorEnd = MIN((inWdims[2] + pad - filterSize) / stride + 1,
+                      outWdims[2]);
+  }
+  interiorEnd = MAX(interiorEnd, interiorBegin);
+
+  ssize_t x = -(ssize_t)pad;
+  for (size_t outx = 0; outx < outWdims[1]; x += stride, outx++) {
+    size_t x0, x1;
+    libjit_clip_window(x, filterSize, inWdims[1], x0, x1);
+
+    size_t outy = 0;
+    while (outy < outWdims[2]) {
+      ssize_t y = (ssize_t)(outy * stride) - (ssize_t)pad;
+      if (outy >= interiorBegin && outy + sizeGroupY <= interiorEnd) {
+        // A tile of the interior.
+        libjit_convDKKC_tile<groupWidth>(
+            outW, inW, filterW, biasW, residualW, outWdims, inWdims,
+            filterSize, stride, sampleN, outChannel, numGroups, sizeGroupY,
+            outx, outy, x, y, x0, x1, y, y + filterSize, epilogue);
+        outy += sizeGroupY;
+        continue;
+      }
+      // A single pixel, whose window is clipped in Y.
+      size_t y0, y1;
+      libjit_clip_window(y, filterSize, inWdims[2], y0, y1);
+      libjit_convDKKC_tile<groupWidth>(outW, inW, filterW, biasW, residualW,
+                                       outWdims, inWdims, filterSize, stride,
+                                       sampleN, outChannel, numGroups, 1, outx,
+                                       outy, x, y, x0, x1, y0, y1, epilogue);
+      outy++;
     }
   }
 }
 
-/// Process the input buffer in the convolution by iterating on the filter and
-/// then on the pixels. This means that we process the whole input image for
-/// each pixel in the filter. We try to unroll and process multiple inputs on
-/// the Y row together.
-void libjit_convDKKC8_foreach_xy_filter_pixels(
-    size_t sampleN, size_t outChannel, unsigned numDepthRegs,
-    unsigned depthStrips, unsigned sizeGroupY, size_t numChannels, float *outW,
-    const float *inW, const float *filterW, const float *biasW,
-    const size_t *outWdims, const size_t *inWdims, const size_t *filterWdims,
-    const size_t *biasWdims, size_t filterSize, size_t stride, size_t pad) {
+/// Performs the convolution with the filter \p filterW of the layout
+/// [D/groupWidth, K, K, C, groupWidth], \p numDepthRegs groups of output
+/// channels at a time.
+template <unsigned groupWidth>
+void libjit_convDKKC(float *outW, const float *inW, const float *filterW,
+                     const float *biasW, const float *residualW,
+                     const size_t *outWdims, const size_t *inWdims,
+                     size_t filterSize, size_t stride, size_t pad,
+                     unsigned numDepthRegs, unsigned sizeGroupY,
+                     unsigned activation, float param) {
+  // The bias is added by the initialization of the accumulators, so the
+  // epilogue only applies the activation.
+  libjit_epilogue epilogue = {nullptr, activation, param};
+  size_t D = outWdims[3];
+  size_t blockSize = groupWidth * numDepthRegs;
 
-  // The loops below look scary but the the idea is simple. We iterate over
-  // the pixels in the output tensor and calculate the coordinate of the source
-  // tensor. When we process the Y row we try to process [sizeGroupY] elements
-  // at once. After we finish the row we handle the odd cases by handling one y
-  // value at a time.
+  // For each input in the batch:
+  for (size_t n = 0; n < inWdims[0]; n++) {
+    // For each output channel, process numDepthRegs groups of channels. The
+    // groups that are left are processed one at a time.
+    size_t d = 0;
+    for (; d + blockSize <= D; d += blockSize) {
+      libjit_convDKKC_channels<groupWidth>(
+          outW, inW, filterW, biasW, residualW, outWdims, inWdims, filterSize,
+          stride, pad, n, d, numDepthRegs, sizeGroupY, epilogue);
+    }
+    for (; d < D; d += groupWidth) {
+      libjit_convDKKC_channels<groupWidth>(
+          outW, inW, filterW, biasW, residualW, outWdims, inWdims, filterSize,
+          stride, pad, n, d, 1, sizeGroupY, epilogue);
+    }
+  } // For each N, the sample in the batch.
+}
 
-  // For each element in the convolution-filter:
-  for (size_t fx = 0; fx < filterSize; fx++) {
-    for (size_t fy = 0; fy < filterSize; fy++) {
+/// The number of channels that the depthwise kernels accumulate together. The
+/// filter taps of a block of channels are transposed, so that every tap is a
+/// contiguous vector of weights, like the input pixels of NHWC.
+constexpr size_t depthwiseChannels = 64;
 
-      // For each x step in the input/output tensor:
-      for (size_t outx = 0; outx < outWdims[1]; outx++) {
-        ssize_t inx = (ssize_t)outx * stride - pad + fx;
+/// The largest filter area, a 7x7 filter, of the depthwise kernels. The
+/// transposed taps of a block of channels are kept on the stack.
+constexpr size_t depthwiseMaxTaps = 49;
 
-        // Ignore out-of-bounds X values.
-        if (inx < 0 || inx >= (ssize_t)inWdims[1]) {
-          continue;
-        }
+/// Convolves every input channel with its own filter of the shape
+/// [C, filterSize, filterSize, 1]. The loops are channel-innermost, and the
+/// window is clipped to the input once for every output pixel, so that the
+/// loops over the taps have no bounds checks and vectorize over channels.
+void libjit_depthwise_convolution_f(float *outW, const float *inW,
+                                    const float *filterW, const float *biasW,
+                                    const size_t *outWdims,
+                                    const size_t *inWdims, size_t filterSize,
+                                    size_t stride, size_t pad) {
+  size_t C = inWdims[3];
+  size_t taps = filterSize * filterSize;
+  float filterBlock[depthwiseMaxTaps * depthwiseChannels];
 
-        // For each y step in the input/output tensor, in steps of \p
-        // sizeGroupY. We process \p sizeGroupY pixels of Y in one iteration.
-        size_t outy = 0;
-        for (; outy < outWdims[2]; outy += sizeGroupY) {
-          ssize_t iny = (ssize_t)outy * stride - pad + fy;
+  for (size_t cb = 0; cb < C; cb += depthwiseChannels) {
+    size_t cn = MIN(depthwiseChannels, C - cb);
+    for (size_t c = 0; c < cn; c++) {
+      for (size_t t = 0; t < taps; t++) {
+        filterBlock[t * depthwiseChannels + c] = filterW[(cb + c) * taps + t];
+      }
+    }
 
-          // Ignore out of bound indices.
-          if (iny < 0 ||
-              (iny + (ssize_t)stride * sizeGroupY) >= (ssize_t)inWdims[2]) {
-            continue;
-          }
+    for (size_t n = 0; n < outWdims[0]; n++) {
+      ssize_t x = -(ssize_t)pad;
+      for (size_t ax = 0; ax < outWdims[1]; x += stride, ax++) {
+        size_t x0, x1;
+        libjit_clip_window(x, filterSize, inWdims[1], x0, x1);
+        ssize_t y = -(ssize_t)pad;
+        for (size_t ay = 0; ay < outWdims[2]; y += stride, ay++) {
+          size_t y0, y1;
+          libjit_clip_window(y, filterSize, inWdims[2], y0, y1);
 
-          // Convolve the (x,y .. y + ywidth) values.
-          for (unsigned strip = 0; strip < depthStrips; strip++) {
-            libjit_convDKKC8_convolve_channel(
-                outW, inW, filterW, outWdims, inWdims, filterWdims, sampleN,
-                outChannel + strip * numDepthRegs * 8, numDepthRegs, sizeGroupY,
-                numChannels, inx, iny, outx, outy, fx, fy, stride);
+          float sum[depthwiseChannels];
+          for (size_t c = 0; c < cn; c++) {
+            sum[c] = biasW[cb + c];
+          }
+          for (size_t ix = x0; ix < x1; ix++) {
+            for (size_t iy = y0; iy < y1; iy++) {
+              const float *in = inW + libjit_getXYZW(inWdims, n, ix, iy, cb);
+              const float *filter =
+                  filterBlock + ((ix - x) * filterSize + (iy - y)) *
+                                    depthwiseChannels;
+              for (size_t c = 0; c < cn; c++) {
+                sum[c] += in[c] * filter[c];
+              }
+            }
           }
-        } // For each Y group in the output.
 
-        // Handle the remaining Y in the row in groups of size 1.
-        for (; outy < outWdims[2]; outy++) {
-          ssize_t iny = (ssize_t)outy * stride - pad + fy;
-          // Ignore out of bound indices.
-          if (iny < 0 || iny >= (ssize_t)inWdims[2]) {
-            continue;
+          float *out = outW + libjit_getXYZW(outWdims, n, ax, ay, cb);
+          for (size_t c = 0; c < cn; c++) {
+            out[c] = sum[c];
           }
+        }
+      }
+    }
+  }
+}
+
+/// The quantized version of libjit_depthwise_convolution_f. The offsets are
+/// subtracted from the filter when its taps are transposed.
+void libjit_depthwise_convolution_i8(
+    int8_t *outW, const int8_t *inW, const int8_t *filterW, const int8_t *biasW,
+    const size_t *outWdims, const size_t *inWdims, size_t filterSize,
+    size_t stride, size_t pad, int32_t outOffset, int32_t inOffset,
+    int32_t filterOffset, int32_t biasOffset, int32_t biasPre, int32_t biasPost,
+    int32_t biasScale, int32_t outPre, int32_t outPost, int32_t outScale) {
+  size_t C = inWdims[3];
+  size_t taps = filterSize * filterSize;
+  int32_t filterBlock[depthwiseMaxTaps * depthwiseChannels];
 
-          // Convolve a single (x,y) value.
-          for (unsigned strip = 0; strip < depthStrips; strip++) {
-            libjit_convDKKC8_convolve_channel(
-                outW, inW, filterW, outWdims, inWdims, filterWdims, sampleN,
-                outChannel + strip * numDepthRegs * 8, numDepthRegs, 1,
-                numChannels, inx, iny, outx, outy, fx, fy, stride);
+  for (size_t cb = 0; cb < C; cb += depthwiseChannels) {
+    size_t cn = MIN(depthwiseChannels, C - cb);
+    for (size_t c = 0; c < cn; c++) {
+      for (size_t t = 0; t < taps; t++) {
+        filterBlock[t * depthwiseChannels + c] =
+            (int32_t)filterW[(cb + c) * taps + t] - filterOffset;
+      }
+    }
+
+    for (size_t n = 0; n < outWdims[0]; n++) {
+      ssize_t x = -(ssize_t)pad;
+      for (size_t ax = 0; ax < outWdims[1]; x += stride, ax++) {
+        size_t x0, x1;
+        libjit_clip_window(x, filterSize, inWdims[1], x0, x1);
+        ssize_t y = -(ssize_t)pad;
+        for (size_t ay = 0; ay < outWdims[2]; y += stride, ay++) {
+          size_t y0, y1;
+          libjit_clip_window(y, filterSize, inWdims[2], y0, y1);
+
+          // Scale the bias to match the scale of the matrix multiplication.
+          int32_t sum[depthwiseChannels];
+          for (size_t c = 0; c < cn; c++) {
+            sum[c] = libjit_scale_i32i8((int32_t)biasW[cb + c] - biasOffset,
+                                        biasPre, biasPost, biasScale, 0);
+          }
+          for (size_t ix = x0; ix < x1; ix++) {
+            for (size_t iy = y0; iy < y1; iy++) {
+              const int8_t *in = inW + libjit_getXYZW(inWdims, n, ix, iy, cb);
+              const int32_t *filter =
+                  filterBlock + ((ix - x) * filterSize + (iy - y)) *
+                                    depthwiseChannels;
+              for (size_t c = 0; c < cn; c++) {
+                sum[c] += ((int32_t)in[c] - inOffset) * filter[c];
+              }
+            }
           }
-        } // For each Y, in step of 1, in the output.
 
-      } // For each X in the output.
-    }   // For each Y in the filter.
-  }     // For each X in the filter.
+          // Scale the result back to the expected destination scale.
+          int8_t *out = outW + libjit_getXYZW(outWdims, n, ax, ay, cb);
+          for (size_t c = 0; c < cn; c++) {
+            out[c] = libjit_clip(libjit_scale_i32i8(sum[c], outPre, outPost,
+                                                    outScale, outOffset));
+          }
+        }
+      }
+    }
+  }
 }
 
-// Process the input buffer in the convolution by iterating on the input buffer
-// and then on the filter. This means that we process the whole input filter for
-// each pixel in the input buffer.
-void libjit_convDKKC8_foreach_xy_pixels_filter(
-    size_t sampleN, size_t outChannel, unsigned numDepthRegs,
-    unsigned depthStrips, unsigned sizeGroupY, size_t numChannels, float *outW,
-    const float *inW, const float *filterW, const float *biasW,
-    const size_t *outWdims, const size_t *inWdims, const size_t *filterWdims,
-    const size_t *biasWdims, size_t filterSize, size_t stride, size_t pad) {
-  // For each (x,y) step in the input/output tensor:
-  for (size_t outx = 0; outx < outWdims[1]; outx++) {
-    for (size_t outy = 0; outy < outWdims[2]; outy++) {
-
-      // For each element in the convolution-filter:
-      for (size_t fx = 0; fx < filterSize; fx++) {
-        for (size_t fy = 0; fy < filterSize; fy++) {
-
-          // Calculate the specific input x,y that we process in this
-          // iteration.
-          ssize_t inx = (ssize_t)outx * stride - pad + fx;
-          ssize_t iny = (ssize_t)outy * stride - pad + fy;
-
-          // Ignore index access below zero (this is due to padding).
-          if (inx < 0 || iny < 0 || inx >= (ssize_t)inWdims[1] ||
-              iny >= (ssize_t)inWdims[2]) {
+/// The col2im pass of libjit_convolution_grad_f. The patch gradients
+/// \p patchG are ordered like the rows of libjit_im2col_f.
+struct libjit_col2im_tasks {
+  float *inG;
+  const float *patchG;
+  const size_t *inGdims;
+  const size_t *outGdims;
+  size_t kernel;
+  size_t stride;
+  size_t pad;
+};
+
+/// Add the patch gradients of the sample \p n back to the pixels of the input
+/// gradient that the patches were read from. Taps that fall into the padding
+/// are dropped. The samples write disjoint slices of the input gradient, so
+/// they run as independent tasks.
+void libjit_col2im_task(void *ctx, size_t n) {
+  const libjit_col2im_tasks *T = (const libjit_col2im_tasks *)ctx;
+  const size_t *inGdims = T->inGdims;
+  const size_t *outGdims = T->outGdims;
+  size_t inChannels = inGdims[3];
+  size_t rowSize = T->kernel * T->kernel * inChannels;
+  const float *row = T->patchG + n * outGdims[1] * outGdims[2] * rowSize;
+  for (size_t ox = 0; ox < outGdims[1]; ox++) {
+    for (size_t oy = 0; oy < outGdims[2]; oy++, row += rowSize) {
+      const float *col = row;
+      for (size_t fx = 0; fx < T->kernel; fx++) {
+        ssize_t x = (ssize_t)(ox * T->stride + fx) - (ssize_t)T->pad;
+        for (size_t fy = 0; fy < T->kernel; fy++, col += inChannels) {
+          ssize_t y = (ssize_t)(oy * T->stride + fy) - (ssize_t)T->pad;
+          if (x < 0 || y < 0 || x >= (ssize_t)inGdims[1] ||
+              y >= (ssize_t)inGdims[2]) {
             continue;
           }
+          float *in = T->inG + libjit_getXYZW(inGdims, n, x, y, 0);
+          for (size_t c = 0; c < inChannels; c++) {
+            in[c] += col[c];
+          }
+        }
+      }
+    }
+  }
+}
+
+/// Unfold the channels [firstChannel, firstChannel + numChannels) of the NHWC
+/// input \p inW into the matrix \p outW of the shape
+/// [N * OH * OW, K * K * numChannels], where each row holds the input patch
+/// that the filter sees at one output pixel. The columns are ordered like the
+/// filter slice [K, K, numChannels]. Taps that fall into the padding are
+/// filled with \p padValue.
+template <typename ElemTy>
+void libjit_im2col(ElemTy *outW, const ElemTy *inW, const size_t *inWdims,
+                   size_t firstChannel, size_t numChannels, size_t kernel,
+                   size_t stride, size_t pad, ElemTy padValue) {
+  size_t rowSize = kernel * kernel * numChannels;
+  size_t patchSize = numChannels * sizeof(ElemTy);
+  size_t outHeight = (inWdims[1] + 2 * pad - kernel) / stride + 1;
+  size_t outWidth = (inWdims[2] + 2 * pad - kernel) / stride + 1;
 
-          for (unsigned strip = 0; strip < depthStrips; strip++) {
-            libjit_convDKKC8_convolve_channel(
-                outW, inW, filterW, outWdims, inWdims, filterWdims, sampleN,
-                outChannel + strip * numDepthRegs * 8, numDepthRegs, 1,
-                numChannels, inx, iny, outx, outy, fx, fy, stride);
+  ElemTy *row = outW;
+  for (size_t n = 0; n < inWdims[0]; n++) {
+    for (size_t ox = 0; ox < outHeight; ox++) {
+      for (size_t oy = 0; oy < outWidth; oy++, row += rowSize) {
+        ElemTy *col = row;
+        for (size_t fx = 0; fx < kernel; fx++) {
+          ssize_t x = (ssize_t)(ox * stride + fx) - (ssize_t)pad;
+          for (size_t fy = 0; fy < kernel; fy++, col += numChannels) {
+            ssize_t y = (ssize_t)(oy * stride + fy) - (ssize_t)pad;
+            if (x < 0 || y < 0 || x >= (ssize_t)inWdims[1] ||
+                y >= (ssize_t)inWdims[2]) {
+              for (size_t c = 0; c < numChannels; c++) {
+                col[c] = padValue;
+              }
+              continue;
+            }
+            memcpy(col, inW + libjit_getXYZW(inWdims, n, x, y, firstChannel),
+                   patchSize);
           }
-        } // For each Y in the filter.
-      }   // For each X in the filter.
-    }     // For each Y in the output.
-  }       // For each X in the output.
+        }
+      }
+    }
+  }
 }
 
 } // namespace
 
 extern "C" {
 void libjit_convDKKC8_f(float *outW, const float *inW, const float *filterW,
-                        const float *biasW, const size_t *outWdims,
-                        const size_t *inWdims, const size_t *filterWdims,
-                        const size_t *biasWdims, size_t filterSize,
-                        size_t stride, size_t pad, unsigned pixelScanFirst,
+                        const float *biasW, const float *residualW,
+                        const size_t *outWdims, const size_t *inWdims,
+                        size_t filterSize, size_t stride, size_t pad,
                         unsigned numDepthRegs, unsigned sizeGroupY,
-                        unsigned depthStrips) {
-  // Select the order in which we iterate over the pixels in the picture.
-  auto eachPixelConv =
-      (pixelScanFirst ? &libjit_convDKKC8_foreach_xy_pixels_filter
-                      : &libjit_convDKKC8_foreach_xy_filter_pixels);
+                        unsigned activation, float param) {
+  libjit_convDKKC<8>(outW, inW, filterW, biasW, residualW, outWdims, inWdims,
+                     filterSize, stride, pad, numDepthRegs, sizeGroupY,
+                     activation, param);
+}
 
-  // For each input in the batch:
-  for (size_t n = 0; n < inWdims[0]; n++) {
+/// The libjit_convDKKC8_f of the filter layout [D/16, K, K, C, 16], whose
+/// groups fill the AVX-512 registers.
+void libjit_convDKKC16_f(float *outW, const float *inW, const float *filterW,
+                         const float *biasW, const float *residualW,
+                         const size_t *outWdims, const size_t *inWdims,
+                         size_t filterSize, size_t stride, size_t pad,
+                         unsigned numDepthRegs, unsigned sizeGroupY,
+                         unsigned activation, float param) {
+  libjit_convDKKC<16>(outW, inW, filterW, biasW, residualW, outWdims, inWdims,
+                      filterSize, stride, pad, numDepthRegs, sizeGroupY,
+                      activation, param);
+}
 
-    // Initialize the output frame for the N'th slice with the bias.
-    // Later we will accumulate values into this slice.
-    libjit_conv_init_output_with_bias(n, outW, biasW, outWdims, biasWdims);
+/// Performs the int8 convolution with the filter \p filterW, whose offset is
+/// subtracted and which is transposed to the shape [D/8, K, K, C, 8]. The
+/// products of the filter and the input are accumulated in int32 for eight
+/// output channels at a time, without offsets. \p tapSums holds the sums of
+/// the filter over the input channels for every tap, in the shape
+/// [D/8, K, K, 8], so that the input offset is corrected once per tap that is
+/// inside the input.
+void libjit_convDKKC8_i8(
+    int8_t *outW, const int8_t *inW, const int16_t *filterW,
+    const int32_t *tapSums, const int8_t *biasW, const size_t *outWdims,
+    const size_t *inWdims, size_t filterSize, size_t stride, size_t pad,
+    int32_t outOffset, int32_t inOffset, int32_t biasOffset, int32_t biasPre,
+    int32_t biasPost, int32_t biasScale, int32_t outPre, int32_t outPost,
+    int32_t outScale) {
+  size_t C = inWdims[3];
+  size_t D = outWdims[3];
 
-    // For each output channel, process [numDepthRegs x float8] elements.
-    for (size_t d = 0; d < outWdims[3]; d += 8 * numDepthRegs * depthStrips) {
+  for (size_t n = 0; n < outWdims[0]; n++) {
+    ssize_t x = -(ssize_t)pad;
+    for (size_t ax = 0; ax < outWdims[1]; x += stride, ax++) {
+      size_t x0, x1;
+      libjit_clip_window(x, filterSize, inWdims[1], x0, x1);
+      ssize_t y = -(ssize_t)pad;
+      for (size_t ay = 0; ay < outWdims[2]; y += stride, ay++) {
+        size_t y0, y1;
+        libjit_clip_window(y, filterSize, inWdims[2], y0, y1);
+        int8_t *out = outW + libjit_getXYZW(outWdims, n, ax, ay, 0);
 
-      // Perform the convolution for each pixel.
-      eachPixelConv(n, d, numDepthRegs, depthStrips, sizeGroupY, inWdims[3],
-                    outW, inW, filterW, biasW, outWdims, inWdims, filterWdims,
-                    biasWdims, filterSize, stride, pad);
+        // For each block of eight output channels:
+        for (size_t d = 0; d < D; d += 8) {
+          int32_t sum[8] = {0};
+          int32_t tapSum[8] = {0};
+          for (size_t ix = x0; ix < x1; ix++) {
+            for (size_t iy = y0; iy < y1; iy++) {
+              size_t tap = (d / 8 * filterSize + (ix - x)) * filterSize +
+                           (iy - y);
+              const int8_t *in = inW + libjit_getXYZW(inWdims, n, ix, iy, 0);
+              const int16_t *filter = filterW + tap * C * 8;
+              for (size_t c = 0; c < C; c++) {
+                int32_t v = in[c];
+                for (unsigned i = 0; i < 8; i++) {
+                  sum[i] += filter[c * 8 + i] * v;
+                }
+              }
+              for (unsigned i = 0; i < 8; i++) {
+                tapSum[i] += tapSums[tap * 8 + i];
+              }
+            }
+          }
 
-    } // For each D (the depth, or the output channel).
-  }   // For each N, the sample in the batch.
+          for (unsigned i = 0; i < 8; i++) {
+            // Correct the input offset and add the bias, which is scaled to
+            // match the scale of the matrix multiplication.
+            int32_t acc = sum[i] - inOffset * tapSum[i] +
+                          libjit_scale_i32i8((int32_t)biasW[d + i] - biasOffset,
+                                             biasPre, biasPost, biasScale, 0);
+            // Scale the result back to the expected destination scale.
+            out[d + i] = libjit_clip(
+                libjit_scale_i32i8(acc, outPre, outPost, outScale, outOffset));
+          }
+        }
+      }
+    }
+  }
+}
+
+/// The number of the output pixels of a row that the blocked convolution
+/// accumulates at once. Every vector of the filter is loaded once for all of
+/// them.
+#define NCHWC_ROW_BLOCK 4
+
+/// Perform the convolution of the blocked input [N, C/8, H, W, 8] with the
+/// blocked filter [D/8, C/8, K, K, 8, 8] into the blocked output
+/// [N, D/8, OH, OW, 8]. The 8 output channels of a block are the lanes of a
+/// float8, and every input channel is broadcast and multiplied with the 8
+/// filter values of its row in the block, which are consecutive in memory.
+void libjit_conv_nchwc_f(float *outW, const float *inW, const float *filterW,
+                         const float *biasW, const size_t *outWdims,
+                         const size_t *inWdims, const size_t *filterWdims,
+                         size_t filterSize, size_t stride, size_t pad,
+                         unsigned activation, float param) {
+  size_t inBlocks = inWdims[1];
+  // The distance between the filters of two consecutive input channel blocks.
+  size_t filterBlockSize = filterSize * filterSize * 64;
+
+  for (size_t n = 0; n < outWdims[0]; n++) {
+    for (size_t db = 0; db < outWdims[1]; db++) {
+      float8 bias = LoaduFloat8(&biasW[db * 8]);
+      const float *filterD = &filterW[db * inBlocks * filterBlockSize];
+
+      // For each row of output pixels:
+      for (size_t ax = 0; ax < outWdims[2]; ax++) {
+        ssize_t x = (ssize_t)(ax * stride) - (ssize_t)pad;
+        for (size_t ay = 0; ay < outWdims[3]; ay += NCHWC_ROW_BLOCK) {
+          size_t rowSize = MIN(NCHWC_ROW_BLOCK, outWdims[3] - ay);
+          float8 sum[NCHWC_ROW_BLOCK];
+          for (size_t i = 0; i < rowSize; i++) {
+            sum[i] = bias;
+          }
+
+          for (size_t fx = 0; fx < filterSize; fx++) {
+            ssize_t ox = x + fx;
+            // Ignore index access below zero (this is due to padding).
+            if (ox < 0 || ox >= (ssize_t)inWdims[2]) {
+              continue;
+            }
+            for (size_t fy = 0; fy < filterSize; fy++) {
+              // The input column of every output pixel of the block, or -1
+              // if it falls into the padding.
+              ssize_t oy[NCHWC_ROW_BLOCK];
+              for (size_t i = 0; i < rowSize; i++) {
+                oy[i] = (ssize_t)((ay + i) * stride) - (ssize_t)pad + fy;
+                if (oy[i] >= (ssize_t)inWdims[3]) {
+                  oy[i] = -1;
+                }
+              }
+
+              for (size_t cb = 0; cb < inBlocks; cb++) {
+                const float *filterB =
+                    &filterD[cb * filterBlockSize +
+                             (fx * filterSize + fy) * 64];
+                const float *inRow =
+                    &inW[libjit_getXYZWQ(inWdims, n, cb, ox, 0, 0)];
+                for (size_t c = 0; c < 8; c++) {
+                  float8 ff = LoaduFloat8(&filterB[c * 8]);
+                  for (size_t i = 0; i < rowSize; i++) {
+                    if (oy[i] >= 0) {
+                      sum[i] += BroadcastFloat8(inRow[oy[i] * 8 + c]) * ff;
+                    }
+                  }
+                }
+              }
+            }
+          }
+
+          // Apply the activation and store the results to the output buffer.
+          for (size_t i = 0; i < rowSize; i++) {
+            if (activation != LIBJIT_ACTIVATION_NONE) {
+              for (unsigned lane = 0; lane < 8; lane++) {
+                sum[i][lane] = libjit_activate(sum[i][lane], activation, param);
+              }
+            }
+            StoreuFloat8(&outW[libjit_getXYZWQ(outWdims, n, db, ax, ay + i, 0)],
+                         sum[i]);
+          }
+        }
+      }
+    }
+  }
 }
 
 void libjit_convolution_f(float *outW, const float *inW, const float *filterW,
                           const float *biasW, const size_t *outWdims,
                           const size_t *inWdims, const size_t *filterWdims,
                           const size_t *biasWdims, size_t filterSize,
-                          size_t stride, size_t pad, unsigned depthUnroll) {
+                          size_t stride, size_t pad, unsigned depthUnroll,
+                          unsigned cbSize) {
   size_t inChannels = inWdims[3];
 
-  // The size of the input-channel tile. High channel count allow for SIMD
-  // parallelism but create register pressure. Low channel count reduces the
-  // memory pressure and allows things to fit in cache, but require additional
-  // compute (horizontal add) to sum the values in the block. This value is a
-  // compromise between the two.
-  constexpr unsigned cbSize = 512;
+  // The input channels are processed in tiles of cbSize channels. High channel
+  // count allow for SIMD parallelism but create register pressure. Low
+  // channel count reduces the memory pressure and allows things to fit in
+  // cache, but require additional compute (horizontal add) to sum the values
+  // in the block. The code generator passes a constant, which is tuned for
+  // the host and the shape of the layer.
 
   // For each input in the batch:
   for (size_t n = 0; n < inWdims[0]; n++) {
 
     // Initialize the output frame for the N'th slice with the bias.
     // Later we will accumulate values into this slice.
-    libjit_conv_init_output_with_bias(n, outW, biasW, outWdims, biasWdims);
+    libjit_conv_init_output_with_bias(n, outW, biasW, nullptr, outWdims,
+                                      biasWdims);
 
     // Process the body of the loop in tiles of "channel-block".
     for (size_t cb = 0; cb < inChannels; cb += cbSize) {
@@ -433,52 +809,438 @@ void libjit_convolution_i8(
   }       // N
 }
 
-void libjit_convolution_grad_f(float *inG, const float *outG, const float *inW,
-                               float *filterG, float *biasG,
-                               const float *filterW, const size_t *outGdims,
-                               const size_t *inWdims, const size_t *filterGdims,
-                               const size_t kernel, const size_t stride,
-                               const size_t pad) {
-  // NHWC format is assumed
-  // Clear inG, filterG, and biasG
-  size_t p = sizeof(float) * inWdims[3];
-  memset(inG, 0, inWdims[0] * inWdims[1] * inWdims[2] * p);
-  memset(filterG, 0, outGdims[3] * kernel * kernel * p);
-  memset(biasG, 0, sizeof(float) * outGdims[3]);
+/// Performs the convolution of the int16 activations \p inW with the int8
+/// filter \p filterW. The int32 bias \p biasW has the scale of the accumulator,
+/// the product of the input and the filter scales, and the offset zero. \p
+/// scale is the ratio of the scale of the accumulator to the output scale.
+void libjit_convolution_i16(
+    int16_t *outW, const int16_t *inW, const int8_t *filterW,
+    const int32_t *biasW, const size_t *outWdims, const size_t *inWdims,
+    const size_t *filterWdims, size_t filterSize, size_t stride, size_t pad,
+    size_t group, int32_t outOffset, int32_t inOffset, int32_t filterOffset,
+    float scale) {
+  size_t inCperG = inWdims[3] / group;
+  size_t outCperG = outWdims[3] / group;
 
   // For each input in the batch:
-  for (size_t n = 0; n < outGdims[0]; n++) {
-    for (size_t d = 0; d < outGdims[3]; d++) {
-      ssize_t x = -(ssize_t)pad;
-      for (size_t bx = 0; bx < outGdims[1]; bx++, x += stride) {
-        ssize_t y = -(ssize_t)pad;
-        for (size_t by = 0; by < outGdims[2]; by++, y += stride) {
-          float grad = outG[libjit_getXYZW(outGdims, n, bx, by, d)];
+  for (size_t n = 0; n < inWdims[0]; n++) {
+    // For each group of input channels:
+    for (size_t g = 0; g < group; g++) {
+      // For each output channel in the group:
+      for (size_t d = g * outCperG; d < (g + 1) * outCperG; d++) {
+        // For each convolution 'jump' in the input tensor:
+        ssize_t x = -(ssize_t)pad;
+        for (size_t ax = 0; ax < outWdims[1]; x += stride, ax++) {
+          ssize_t y = -(ssize_t)pad;
+          for (size_t ay = 0; ay < outWdims[2]; y += stride, ay++) {
+            int32_t sum = biasW[d];
 
-          for (size_t kx = 0; kx < kernel; kx++) {
-            for (size_t ky = 0; ky < kernel; ky++) {
-              ssize_t ax = x + kx;
-              ssize_t ay = y + ky;
+            // For each element in the convolution-filter:
+            for (size_t fx = 0; fx < filterSize; fx++) {
+              for (size_t fy = 0; fy < filterSize; fy++) {
+                ssize_t ox = x + fx;
+                ssize_t oy = y + fy;
 
-              if (ax < 0 || ay < 0 || ax >= (ssize_t)inWdims[1] ||
-                  ay >= (ssize_t)inWdims[2]) {
-                continue;
+                // Ignore index access below zero (this is due to padding).
+                if (ox < 0 || oy < 0 || ox >= (ssize_t)inWdims[1] ||
+                    oy >= (ssize_t)inWdims[2]) {
+                  continue;
+                }
+
+                size_t inIdx = libjit_getXYZW(inWdims, n, (size_t)ox,
+                                              (size_t)oy, g * inCperG);
+                size_t filterIdx = libjit_getXYZW(filterWdims, d, fx, fy, 0);
+                for (size_t fd = 0; fd < inCperG; fd++) {
+                  sum += (filterW[filterIdx + fd] - filterOffset) *
+                         (inW[inIdx + fd] - inOffset);
+                }
               }
+            }
+
+            // Scale the result back to the expected destination scale.
+            float result = roundf(sum * scale + outOffset);
+            outW[libjit_getXYZW(outWdims, n, ax, ay, d)] =
+                (int16_t)MAX(INT16_MIN, MIN(INT16_MAX, result));
+          } // W
+        }   // H
+      }     // C
+    }       // G
+  }         // N
+}
+
+/// Performs the convolution whose input and output channels are split into
+/// \p group groups, where the output channels of a group only read the input
+/// channels of the same group. Depthwise convolutions, with one input and one
+/// output channel per group, use a kernel that vectorizes over the channels.
+void libjit_grouped_convolution_f(float *outW, const float *inW,
+                                  const float *filterW, const float *biasW,
+                                  const size_t *outWdims, const size_t *inWdims,
+                                  const size_t *filterWdims, size_t filterSize,
+                                  size_t stride, size_t pad, size_t group) {
+  size_t inCperG = inWdims[3] / group;
+  size_t outCperG = outWdims[3] / group;
+
+  if (inCperG == 1 && outCperG == 1 &&
+      filterSize * filterSize <= depthwiseMaxTaps) {
+    libjit_depthwise_convolution_f(outW, inW, filterW, biasW, outWdims,
+                                   inWdims, filterSize, stride, pad);
+    return;
+  }
 
-              for (size_t c = 0; c < inWdims[3]; c++) {
-                inG[libjit_getXYZW(inWdims, n, (size_t)ax, (size_t)ay, c)] +=
-                    filterW[libjit_getXYZW(filterGdims, d, kx, ky, c)] * grad;
-                filterG[libjit_getXYZW(filterGdims, d, kx, ky, c)] +=
-                    inW[libjit_getXYZW(inWdims, n, (size_t)ax, (size_t)ay, c)] *
-                    grad;
+  for (size_t n = 0; n < outWdims[0]; n++) {
+    ssize_t x = -(ssize_t)pad;
+    for (size_t ax = 0; ax < outWdims[1]; x += stride, ax++) {
+      size_t x0, x1;
+      libjit_clip_window(x, filterSize, inWdims[1], x0, x1);
+      ssize_t y = -(ssize_t)pad;
+      for (size_t ay = 0; ay < outWdims[2]; y += stride, ay++) {
+        size_t y0, y1;
+        libjit_clip_window(y, filterSize, inWdims[2], y0, y1);
+
+        // For each output channel, which reads the input channels of its
+        // group:
+        for (size_t d = 0; d < outWdims[3]; d++) {
+          size_t g = d / outCperG;
+          float sum = biasW[d];
+          for (size_t ix = x0; ix < x1; ix++) {
+            for (size_t iy = y0; iy < y1; iy++) {
+              const float *in =
+                  inW + libjit_getXYZW(inWdims, n, ix, iy, g * inCperG);
+              const float *filter =
+                  filterW + libjit_getXYZW(filterWdims, d, ix - x, iy - y, 0);
+              for (size_t fd = 0; fd < inCperG; fd++) {
+                sum += in[fd] * filter[fd];
               }
             }
           }
+          outW[libjit_getXYZW(outWdims, n, ax, ay, d)] = sum;
+        }
+      }
+    }
+  }
+}
 
-          biasG[d] += grad;
-        } // W
-      }   // H
-    }     // C
-  }       // N
+void libjit_grouped_convolution_i8(
+    int8_t *outW, const int8_t *inW, const int8_t *filterW, const int8_t *biasW,
+    const size_t *outWdims, const size_t *inWdims, const size_t *filterWdims,
+    size_t filterSize, size_t stride, size_t pad, size_t group,
+    int32_t outOffset, int32_t inOffset, int32_t filterOffset,
+    int32_t biasOffset, int32_t biasPre, int32_t biasPost, int32_t biasScale,
+    int32_t outPre, int32_t outPost, int32_t outScale) {
+  size_t inCperG = inWdims[3] / group;
+  size_t outCperG = outWdims[3] / group;
+
+  if (inCperG == 1 && outCperG == 1 &&
+      filterSize * filterSize <= depthwiseMaxTaps) {
+    libjit_depthwise_convolution_i8(
+        outW, inW, filterW, biasW, outWdims, inWdims, filterSize, stride, pad,
+        outOffset, inOffset, filterOffset, biasOffset, biasPre, biasPost,
+        biasScale, outPre, outPost, outScale);
+    return;
+  }
+
+  for (size_t n = 0; n < outWdims[0]; n++) {
+    ssize_t x = -(ssize_t)pad;
+    for (size_t ax = 0; ax < outWdims[1]; x += stride, ax++) {
+      size_t x0, x1;
+      libjit_clip_window(x, filterSize, inWdims[1], x0, x1);
+      ssize_t y = -(ssize_t)pad;
+      for (size_t ay = 0; ay < outWdims[2]; y += stride, ay++) {
+        size_t y0, y1;
+        libjit_clip_window(y, filterSize, inWdims[2], y0, y1);
+
+        // For each output channel, which reads the input channels of its
+        // group:
+        for (size_t d = 0; d < outWdims[3]; d++) {
+          size_t g = d / outCperG;
+          // Scale the bias to match the scale of the matrix multiplication.
+          int32_t sum = libjit_scale_i32i8((int32_t)biasW[d] - biasOffset,
+                                           biasPre, biasPost, biasScale, 0);
+          for (size_t ix = x0; ix < x1; ix++) {
+            for (size_t iy = y0; iy < y1; iy++) {
+              const int8_t *in =
+                  inW + libjit_getXYZW(inWdims, n, ix, iy, g * inCperG);
+              const int8_t *filter =
+                  filterW + libjit_getXYZW(filterWdims, d, ix - x, iy - y, 0);
+              for (size_t fd = 0; fd < inCperG; fd++) {
+                sum += ((int32_t)filter[fd] - filterOffset) *
+                       ((int32_t)in[fd] - inOffset);
+              }
+            }
+          }
+          // Scale the result back to the expected destination scale.
+          outW[libjit_getXYZW(outWdims, n, ax, ay, d)] = libjit_clip(
+              libjit_scale_i32i8(sum, outPre, outPost, outScale, outOffset));
+        }
+      }
+    }
+  }
+}
+
+/// Performs the quantized convolution with the per-channel quantized filter
+/// \p filterW. The output channel d of the filter has the scale
+/// filterScales[d] and the offset filterOffsets[d]. The int32 bias \p biasW is
+/// quantized with the scale inScale * filterScales[d] and the offset zero, so
+/// it is added to the accumulator as is. Every group is computed on the
+/// blocked int8 GEMM: the input channels of the group are unfolded into
+/// patches, whose padding taps hold the input offset, and multiplied by the
+/// transposed filter of the group with the scale of each output channel.
+/// \p blocking = {mc, kc, nc} are the cache block sizes of the GEMM and the
+/// computation is split between up to \p numThreads threads.
+void libjit_channelwise_convolution_i8(
+    int8_t *outW, const int8_t *inW, const int8_t *filterW,
+    const int32_t *biasW, const float *filterScales,
+    const int32_t *filterOffsets, const size_t *outWdims,
+    const size_t *inWdims, const size_t *filterWdims, size_t filterSize,
+    size_t stride, size_t pad, size_t group, int32_t outOffset,
+    int32_t inOffset, float inScale, float outScale, const size_t *blocking,
+    size_t numThreads) {
+  size_t inCperG = inWdims[3] / group;
+  size_t outChannels = outWdims[3];
+  size_t outCperG = outChannels / group;
+  size_t numPixels = outWdims[0] * outWdims[1] * outWdims[2];
+  size_t rowSize = filterSize * filterSize * inCperG;
+  assert(filterWdims[1] * filterWdims[2] * filterWdims[3] == rowSize &&
+         "Invalid filter shape");
+  (void)filterWdims;
+
+  // The patches and the transposed filter of one group share one buffer.
+  int8_t *patches = (int8_t *)malloc(numPixels * rowSize + rowSize * outCperG);
+  int8_t *groupFilter = patches + numPixels * rowSize;
+  for (size_t g = 0; g < group; g++) {
+    libjit_im2col(patches, inW, inWdims, g * inCperG, inCperG, filterSize,
+                  stride, pad, (int8_t)inOffset);
+    const int8_t *filter = filterW + g * outCperG * rowSize;
+    for (size_t d = 0; d < outCperG; d++) {
+      for (size_t p = 0; p < rowSize; p++) {
+        groupFilter[p * outCperG + d] = filter[d * rowSize + p];
+      }
+    }
+    size_t first = g * outCperG;
+    libjit_channelwise_matmul_i8(
+        outW + first, patches, groupFilter, biasW + first, filterScales + first,
+        filterOffsets + first, numPixels, outCperG, rowSize, outChannels,
+        outOffset, inOffset, inScale, outScale, blocking, numThreads);
+  }
+  free(patches);
+}
+
+/// Unfold the NHWC input \p inW into the matrix \p outW of the shape
+/// [N * OH * OW, K * K * C], where each row holds the input patch that the
+/// filter sees at one output pixel. The columns are ordered like the filter
+/// slice [K, K, C], so the convolution becomes a matrix multiplication of
+/// this matrix with the transposed filter. Taps that fall into the padding
+/// are filled with zeros.
+void libjit_im2col_f(float *outW, const float *inW, const size_t *outWdims,
+                     const size_t *inWdims, size_t kernel, size_t stride,
+                     size_t pad) {
+  size_t outHeight = (inWdims[1] + 2 * pad - kernel) / stride + 1;
+  size_t outWidth = (inWdims[2] + 2 * pad - kernel) / stride + 1;
+  assert(outWdims[0] == inWdims[0] * outHeight * outWidth &&
+         "Invalid row count");
+  assert(outWdims[1] == kernel * kernel * inWdims[3] && "Invalid row size");
+  (void)outWdims;
+  (void)outHeight;
+  (void)outWidth;
+  libjit_im2col(outW, inW, inWdims, 0, inWdims[3], kernel, stride, pad, 0.0f);
+}
+
+/// Transform the 4x4 input tiles of a 3x3 Winograd F(2x2, 3x3) convolution
+/// with unit stride. Tile t starts at the input pixel (2 * tx - pad,
+/// 2 * ty - pad) and neighbouring tiles overlap by two pixels. The output
+/// \p outW has the shape [16, T, C], where T is the number of tiles, so every
+/// one of the 16 tile elements is a [T, C] matrix: V = B^T * d * B.
+void libjit_winograd_input_f(float *outW, const float *inW,
+                             const size_t *outWdims, const size_t *inWdims,
+                             size_t pad) {
+  size_t inChannels = inWdims[3];
+  size_t tilesH = (inWdims[1] + 2 * pad - 1) / 2;
+  size_t tilesW = (inWdims[2] + 2 * pad - 1) / 2;
+  size_t numTiles = outWdims[1];
+  assert(numTiles == inWdims[0] * tilesH * tilesW && "Invalid tile count");
+  assert(outWdims[2] == inChannels && "Invalid channel count");
+
+  size_t t = 0;
+  for (size_t n = 0; n < inWdims[0]; n++) {
+    for (size_t tx = 0; tx < tilesH; tx++) {
+      for (size_t ty = 0; ty < tilesW; ty++, t++) {
+        // Find the rows of the input tile. Pixels in the padding are null.
+        const float *tile[4][4];
+        for (size_t i = 0; i < 4; i++) {
+          for (size_t j = 0; j < 4; j++) {
+            ssize_t x = (ssize_t)(2 * tx + i) - (ssize_t)pad;
+            ssize_t y = (ssize_t)(2 * ty + j) - (ssize_t)pad;
+            bool inBounds = x >= 0 && y >= 0 && x < (ssize_t)inWdims[1] &&
+                            y < (ssize_t)inWdims[2];
+            tile[i][j] =
+                inBounds ? inW + libjit_getXYZW(inWdims, n, x, y, 0) : nullptr;
+          }
+        }
+
+        for (size_t c = 0; c < inChannels; c++) {
+          float d[4][4];
+          for (size_t i = 0; i < 4; i++) {
+            for (size_t j = 0; j < 4; j++) {
+              d[i][j] = tile[i][j] ? tile[i][j][c] : 0;
+            }
+          }
+
+          // tmp = B^T * d.
+          float tmp[4][4];
+          for (size_t j = 0; j < 4; j++) {
+            tmp[0][j] = d[0][j] - d[2][j];
+            tmp[1][j] = d[1][j] + d[2][j];
+            tmp[2][j] = d[2][j] - d[1][j];
+            tmp[3][j] = d[1][j] - d[3][j];
+          }
+
+          // V = tmp * B.
+          float *out = outW + t * inChannels + c;
+          size_t step = numTiles * inChannels;
+          for (size_t i = 0; i < 4; i++) {
+            out[(i * 4 + 0) * step] = tmp[i][0] - tmp[i][2];
+            out[(i * 4 + 1) * step] = tmp[i][1] + tmp[i][2];
+            out[(i * 4 + 2) * step] = tmp[i][2] - tmp[i][1];
+            out[(i * 4 + 3) * step] = tmp[i][1] - tmp[i][3];
+          }
+        }
+      }
+    }
+  }
+}
+
+/// Multiply the transformed input tiles \p inW [16, T, C] with the
+/// transformed filter \p filterW, which holds the 16 pre-packed [C, D]
+/// matrices of the shape [16, ceil(D/32), C, 32]. The result \p outW has the
+/// shape [16, T, D]. The 16 multiplications run on the blocked libjit GEMM.
+void libjit_winograd_multiply_f(float *outW, const float *inW,
+                                const float *filterW, const size_t *outWdims,
+                                const size_t *inWdims,
+                                const size_t *filterWdims,
+                                const size_t *blocking, size_t numThreads) {
+  size_t numTiles = inWdims[1];
+  size_t outSize = numTiles * outWdims[2];
+  size_t inSize = numTiles * inWdims[2];
+  size_t filterSize = filterWdims[1] * filterWdims[2] * filterWdims[3];
+  size_t cDims[] = {numTiles, outWdims[2]};
+  size_t aDims[] = {numTiles, inWdims[2]};
+  const size_t *bDims = filterWdims + 1;
+
+  for (size_t xi = 0; xi < 16; xi++) {
+    libjit_matmul_packed_f(outW + xi * outSize, inW + xi * inSize,
+                           filterW + xi * filterSize, cDims, aDims, bDims,
+                           blocking, numThreads);
+  }
+}
+
+/// Transform the products \p inW [16, T, D] of a Winograd F(2x2, 3x3)
+/// convolution back into 2x2 output tiles, Y = A^T * M * A, add the bias
+/// \p biasW and apply the activation \p activation with the parameter \p
+/// param, which is one of libjit_activation. Tile elements that fall outside
+/// of the output are dropped.
+void libjit_winograd_output_f(float *outW, const float *inW,
+                              const float *biasW, const size_t *outWdims,
+                              const size_t *inWdims, unsigned activation,
+                              float param) {
+  size_t outChannels = outWdims[3];
+  size_t tilesH = (outWdims[1] + 1) / 2;
+  size_t tilesW = (outWdims[2] + 1) / 2;
+  size_t numTiles = inWdims[1];
+  assert(numTiles == outWdims[0] * tilesH * tilesW && "Invalid tile count");
+  assert(inWdims[2] == outChannels && "Invalid channel count");
+
+  size_t t = 0;
+  size_t step = numTiles * outChannels;
+  for (size_t n = 0; n < outWdims[0]; n++) {
+    for (size_t tx = 0; tx < tilesH; tx++) {
+      for (size_t ty = 0; ty < tilesW; ty++, t++) {
+        size_t rows = MIN(2, outWdims[1] - 2 * tx);
+        size_t cols = MIN(2, outWdims[2] - 2 * ty);
+        for (size_t d = 0; d < outChannels; d++) {
+          const float *in = inW + t * outChannels + d;
+          float m[4][4];
+          for (size_t i = 0; i < 4; i++) {
+            for (size_t j = 0; j < 4; j++) {
+              m[i][j] = in[(i * 4 + j) * step];
+            }
+          }
+
+          // tmp = A^T * m.
+          float tmp[2][4];
+          for (size_t j = 0; j < 4; j++) {
+            tmp[0][j] = m[0][j] + m[1][j] + m[2][j];
+            tmp[1][j] = m[1][j] - m[2][j] - m[3][j];
+          }
+
+          // Y = tmp * A.
+          float y[2][2];
+          for (size_t i = 0; i < 2; i++) {
+            y[i][0] = tmp[i][0] + tmp[i][1] + tmp[i][2];
+            y[i][1] = tmp[i][1] - tmp[i][2] - tmp[i][3];
+          }
+
+          for (size_t i = 0; i < rows; i++) {
+            for (size_t j = 0; j < cols; j++) {
+              outW[libjit_getXYZW(outWdims, n, 2 * tx + i, 2 * ty + j, d)] =
+                  libjit_activate(y[i][j] + biasW[d], activation, param);
+            }
+          }
+        }
+      }
+    }
+  }
+}
+
+/// Computes the gradients of a convolution on the blocked libjit GEMM. With
+/// the input unfolded by libjit_im2col_f into the patches [N * OH * OW, K * K
+/// * C] and the output gradient viewed as the matrix [N * OH * OW, D]:
+///   filterG = outG^T * patches
+///   patchG = outG * filter
+/// and the patch gradients are folded back onto inG, one sample per task. The
+/// patches and the patch gradients share one scratch buffer.
+/// \p blocking = {mc, kc, nc} are the cache block sizes of the GEMM and the
+/// computation is split between up to \p numThreads threads.
+void libjit_convolution_grad_f(float *inG, const float *outG, const float *inW,
+                               float *filterG, float *biasG,
+                               const float *filterW, const size_t *outGdims,
+                               const size_t *inWdims, const size_t *filterGdims,
+                               const size_t kernel, const size_t stride,
+                               const size_t pad, const size_t *blocking,
+                               size_t numThreads) {
+  // NHWC format is assumed
+  size_t numPixels = outGdims[0] * outGdims[1] * outGdims[2];
+  size_t outChannels = outGdims[3];
+  size_t rowSize = kernel * kernel * inWdims[3];
+  assert(filterGdims[0] == outChannels &&
+         filterGdims[1] * filterGdims[2] * filterGdims[3] == rowSize &&
+         "Invalid filter gradient shape");
+  (void)filterGdims;
+
+  // The bias gradient is the sum of the output gradient over the pixels.
+  memset(biasG, 0, outChannels * sizeof(float));
+  for (size_t i = 0; i < numPixels; i++) {
+    const float *row = outG + i * outChannels;
+    for (size_t d = 0; d < outChannels; d++) {
+      biasG[d] += row[d];
+    }
+  }
+
+  size_t patchDims[] = {numPixels, rowSize};
+  size_t outGmatDims[] = {numPixels, outChannels};
+  size_t filterMatDims[] = {outChannels, rowSize};
+  float *patches = (float *)malloc(numPixels * rowSize * sizeof(float));
+
+  libjit_im2col_f(patches, inW, patchDims, inWdims, kernel, stride, pad);
+  libjit_matmul_f(filterG, outG, patches, filterMatDims, outGmatDims,
+                  patchDims, blocking, numThreads, 1, 0);
+
+  libjit_matmul_f(patches, outG, filterW, patchDims, outGmatDims,
+                  filterMatDims, blocking, numThreads, 0, 0);
+  memset(inG, 0,
+         inWdims[0] * inWdims[1] * inWdims[2] * inWdims[3] * sizeof(float));
+  libjit_col2im_tasks tasks = {inG,    patches, inWdims, outGdims,
+                               kernel, stride,  pad};
+  libjit_parallel_for(outGdims[0], numThreads, libjit_col2im_task, &tasks);
+  free(patches);
 }
 }
@@ -16,11 +16,16 @@
 #ifndef GLOW_BACKENDS_CPU_LIBJIT_DEFS_H
 #define GLOW_BACKENDS_CPU_LIBJIT_DEFS_H
 
+#include <math.h>
 #include <stdint.h>
 #include <string.h>
+#include <sys/types.h>
 
 typedef float float4 __attribute__((ext_vector_type(4)));
 typedef float float8 __attribute__((ext_vector_type(8)));
+typedef float float16 __attribute__((ext_vector_type(16)));
+typedef int8_t int8x8 __attribute__((ext_vector_type(8)));
+typedef int32_t int32x8 __attribute__((ext_vector_type(8)));
 
 /// Loads a simd float8 value from \p ptr.
 #define LoadFloat8(PTR) *((const float8 *)(PTR))
@@ -34,10 +39,11 @@ typedef float float8 __attribute__((ext_vector_type(8)));
 /// Broadcast the input value to a float8.
 #define BroadcastFloat8(VAL) ((float8)(VAL))
 
+/// Broadcast the input value to a int32x8.
+#define BroadcastInt32x8(VAL) ((int32x8)(VAL))
+
 #define MIN(a, b) (((a) < (b)) ? (a) : (b))
 #define MAX(a, b) (((a) > (b)) ? (a) : (b))
-#define AT(tensor, dims, numDims, indices, numIndices)                         \
-  tensor[get_element_ptr(tensor, dims, numDims, indices, numIndices)]
 
 /// Perform an unaligned load of a float8 from a float pointer.
 inline float8 LoaduFloat8(const float *p) {
@@ -54,6 +60,94 @@ inline void AdduFloat8(float *p, float8 v) {
   StoreuFloat8(p, LoaduFloat8(p) + v);
 }
 
+/// Perform an unaligned load of a float16 from a float pointer.
+inline float16 LoaduFloat16(const float *p) {
+  float16 res;
+  memcpy(&res, p, sizeof(float16));
+  return res;
+}
+
+/// Perform an unaligned store of a float16 to a float pointer.
+inline void StoreuFloat16(float *p, float16 v) {
+  memcpy(p, &v, sizeof(float16));
+}
+
+/// Perform an unaligned addition of a float16 to a float pointer.
+inline void AdduFloat16(float *p, float16 v) {
+  StoreuFloat16(p, LoaduFloat16(p) + v);
+}
+
+/// Perform an unaligned load of a float4 from a float pointer.
+inline float4 LoaduFloat4(const float *p) {
+  float4 res;
+  memcpy(&res, p, sizeof(float4));
+  return res;
+}
+
+/// Perform an unaligned store of a float4 to a float pointer.
+inline void StoreuFloat4(float *p, float4 v) { memcpy(p, &v, sizeof(float4)); }
+
+/// Perform an unaligned addition of a float4 to a float pointer.
+inline void AdduFloat4(float *p, float4 v) {
+  StoreuFloat4(p, LoaduFloat4(p) + v);
+}
+
+/// The native float vector of the target, which the register-blocked kernels
+/// use for their accumulators. The NEON registers of aarch64 hold four floats,
+/// and an 8-wide vector would be split into two registers by the compiler and
+/// double the register pressure of the kernels that are tuned for AVX2. The
+/// libjit_avx512.bc variant is built with AVX-512, whose registers hold 16.
+#if defined(__aarch64__)
+typedef float4 floatv;
+#define LoaduFloatV LoaduFloat4
+#define StoreuFloatV StoreuFloat4
+#define AdduFloatV AdduFloat4
+#elif defined(__AVX512F__)
+typedef float16 floatv;
+#define LoaduFloatV LoaduFloat16
+#define StoreuFloatV StoreuFloat16
+#define AdduFloatV AdduFloat16
+#else
+typedef float8 floatv;
+#define LoaduFloatV LoaduFloat8
+#define StoreuFloatV StoreuFloat8
+#define AdduFloatV AdduFloat8
+#endif
+
+/// The number of floats in a floatv.
+#define FLOATV_WIDTH ((int)(sizeof(floatv) / sizeof(float)))
+
+/// Broadcast the input value to a floatv.
+#define BroadcastFloatV(VAL) ((floatv)(VAL))
+
+/// Perform an unaligned load of 8 int8 values from \p p and widen them to a
+/// int32x8.
+inline int32x8 LoaduInt8x8(const int8_t *p) {
+  int8x8 res;
+  memcpy(&res, p, sizeof(int8x8));
+  return __builtin_convertvector(res, int32x8);
+}
+
+/// Narrow the int32x8 \p v to 8 int8 values and perform an unaligned store of
+/// them to \p p. The values must fit into int8.
+inline void StoreuInt8x8(int8_t *p, int32x8 v) {
+  int8x8 res = __builtin_convertvector(v, int8x8);
+  memcpy(p, &res, sizeof(int8x8));
+}
+
+/// \returns the lanes of \p a where the lanes of \p mask are all ones, and
+/// the lanes of \p b where they are zero. The masks are the results of the
+/// vector comparisons.
+inline int32x8 SelectInt32x8(int32x8 mask, int32x8 a, int32x8 b) {
+  return (a & mask) | (b & ~mask);
+}
+
+/// \returns the lanes of \p v clipped to the range of int8.
+inline int32x8 ClipInt32x8(int32x8 v) {
+  v = SelectInt32x8(v < -128, BroadcastInt32x8(-128), v);
+  return SelectInt32x8(v > 127, BroadcastInt32x8(127), v);
+}
+
 /// \returns the index of the element at x,y,z,w,q.
 inline size_t libjit_getXYZWQ(const size_t *dims, size_t x, size_t y, size_t z,
                               size_t w, size_t q) {
@@ -79,6 +173,170 @@ inline size_t libjit_getXY(const size_t *dims, size_t x, size_t y) {
   return (x * dims[1]) + y;
 }
 
+/// The transcendental functions of the kernels. The libm calls are opaque to
+/// the loop vectorizer, so when LIBJIT_FAST_MATH is set the functions are
+/// branch-free polynomial approximations that the loops which call them can
+/// vectorize. The relative error of libjit_exp is below 2e-7 for x in
+/// [-87, 88], and the result saturates outside of this range. The relative
+/// error of libjit_log is below 2e-7 for the positive normal floats. The
+/// absolute errors of libjit_tanh and libjit_sigmoid are below 3e-7.
+/// @{
+#ifdef LIBJIT_FAST_MATH
+inline float libjit_exp(float x) {
+  x = MIN(MAX(x, -87.0f), 88.0f);
+  // exp(x) = 2^n * exp(r), where n = round(x / ln(2)) and |r| <= ln(2) / 2.
+  // ln(2) is split in two parts, so that r is computed exactly.
+  float n = floorf(x * 1.44269504088896341f + 0.5f);
+  float r = x - n * 0.693359375f;
+  r = r + n * 2.12194440e-4f;
+  float p = 1.9875691500e-4f;
+  p = p * r + 1.3981999507e-3f;
+  p = p * r + 8.3334519073e-3f;
+  p = p * r + 4.1665795894e-2f;
+  p = p * r + 1.6666665459e-1f;
+  p = p * r + 5.0000001201e-1f;
+  p = p * r * r + r + 1.0f;
+  // Multiply by 2^n by constructing its exponent bits.
+  int32_t bits = ((int32_t)n + 127) << 23;
+  float scale;
+  memcpy(&scale, &bits, sizeof(float));
+  return p * scale;
+}
+
+inline float libjit_log(float x) {
+  // log(x) = log(m) + e * ln(2), where x = m * 2^e and sqrt(0.5) <= m <
+  // sqrt(2).
+  int32_t bits;
+  memcpy(&bits, &x, sizeof(float));
+  float e = (float)(((bits >> 23) & 0xff) - 126);
+  bits = (bits & 0x807fffff) | 0x3f000000;
+  float m;
+  memcpy(&m, &bits, sizeof(float));
+  bool small = m < 0.707106781186547524f;
+  e = small ? e - 1 : e;
+  m = small ? m + m - 1 : m - 1;
+  float z = m * m;
+  float p = 7.0376836292e-2f;
+  p = p * m - 1.1514610310e-1f;
+  p = p * m + 1.1676998740e-1f;
+  p = p * m - 1.2420140846e-1f;
+  p = p * m + 1.4249322787e-1f;
+  p = p * m - 1.6668057665e-1f;
+  p = p * m + 2.0000714765e-1f;
+  p = p * m - 2.4999993993e-1f;
+  p = p * m + 3.3333331174e-1f;
+  float y = p * m * z - e * 2.12194440e-4f - 0.5f * z;
+  return m + y + e * 0.693359375f;
+}
+#else
+inline float libjit_exp(float x) { return expf(x); }
+
+inline float libjit_log(float x) { return logf(x); }
+#endif
+
+inline float libjit_tanh(float x) { return 1 - 2 / (libjit_exp(x * 2) + 1); }
+
+inline float libjit_sigmoid(float x) { return 1 / (1 + libjit_exp(-x)); }
+/// @}
+
+/// The activations that the convolution and matrix multiplication kernels
+/// apply to their results before storing them. The values must match
+/// CPUActivation in the CPU backend.
+enum libjit_activation : unsigned {
+  LIBJIT_ACTIVATION_NONE = 0,
+  LIBJIT_ACTIVATION_MAX_SPLAT = 1,
+  LIBJIT_ACTIVATION_SIGMOID = 2,
+  LIBJIT_ACTIVATION_TANH = 3,
+};
+
+/// \returns the activation \p activation with the parameter \p param applied to
+/// \p x. The parameter is the splat value of LIBJIT_ACTIVATION_MAX_SPLAT. The
+/// formulas match the standalone activation kernels.
+inline float libjit_activate(float x, unsigned activation, float param) {
+  switch (activation) {
+  case LIBJIT_ACTIVATION_MAX_SPLAT:
+    return MAX(x, param);
+  case LIBJIT_ACTIVATION_SIGMOID:
+    return libjit_sigmoid(x);
+  case LIBJIT_ACTIVATION_TANH:
+    return libjit_tanh(x);
+  default:
+    return x;
+  }
+}
+
+/// The fused epilogue of a kernel, which computes act(x + bias) for every
+/// element x of the result once it is complete.
+struct libjit_epilogue {
+  /// The bias that is added to the columns (the innermost dimension) of the
+  /// result, or null.
+  const float *bias;
+  unsigned activation;
+  float param;
+
+  /// Apply the epilogue to the \p m x \p n block \p c with the leading
+  /// dimension \p ldc. The first column of the block is the column \p col of
+  /// the result.
+  void apply(int m, int n, float *c, int ldc, int col) const {
+    if (!bias && activation == LIBJIT_ACTIVATION_NONE) {
+      return;
+    }
+    for (int i = 0; i < m; i++) {
+      float *row = c + (size_t)i * ldc;
+      for (int j = 0; j < n; j++) {
+        float x = bias ? row[j] + bias[col + j] : row[j];
+        row[j] = libjit_activate(x, activation, param);
+      }
+    }
+  }
+};
+
+/// A unit of work for libjit_parallel_for. \p ctx is the opaque context that
+/// was passed to libjit_parallel_for and \p task is the index of the task.
+typedef void (*libjit_parallel_task_fn)(void *ctx, size_t task);
+
+extern "C" {
+/// Run the tasks [0 .. \p numTasks) using up to \p numThreads threads of the
+/// pool of glow_parallel_for. The calling thread participates in the
+/// computation. Returns when all of the tasks are done.
+void libjit_parallel_for(size_t numTasks, size_t numThreads,
+                         libjit_parallel_task_fn fn, void *ctx);
+
+/// Performs the matrix multiplication c = a * b, where a and b are optionally
+/// transposed as selected by \p transposeA and \p transposeB.
+void libjit_matmul_f(float *c, const float *a, const float *b,
+                     const size_t *cDims, const size_t *aDims,
+                     const size_t *bDims, const size_t *blocking,
+                     size_t numThreads, unsigned transposeA,
+                     unsigned transposeB);
+
+/// Performs the quantized matrix multiplication c = a * b + bias, where the
+/// columns of b have their own scales and offsets.
+void libjit_channelwise_matmul_i8(
+    int8_t *c, const int8_t *a, const int8_t *b, const int32_t *bias,
+    const float *rhsScales, const int32_t *rhsOffsets, size_t m, size_t n,
+    size_t k, size_t ldc, int32_t outOffset, int32_t lhsOffset, float lhsScale,
+    float outScale, const size_t *blocking, size_t numThreads);
+
+/// Performs the matrix multiplication c = a * b, where b is pre-packed into
+/// panels of the shape [ceil(N/32), K, 32].
+void libjit_matmul_packed_f(float *c, const float *a, const float *b,
+                            const size_t *cDims, const size_t *aDims,
+                            const size_t *bDims, const size_t *blocking,
+                            size_t numThreads);
+}
+
+/// Computes the part [\p begin, \p end) of the pooling or convolution window
+/// of \p filterSize that starts at \p pos, which is negative in the padding,
+/// that is inside a dimension of \p size. The window is empty if it is all
+/// in the padding.
+inline void libjit_clip_window(ssize_t pos, size_t filterSize, size_t size,
+                               size_t &begin, size_t &end) {
+  ssize_t last = MIN(pos + (ssize_t)filterSize, (ssize_t)size);
+  begin = MAX(pos, 0);
+  end = MAX(last, (ssize_t)begin);
+}
+
 inline int8_t libjit_clip(int32_t val) {
   return (int8_t)MIN(MAX(val, -128), 127);
 }
@@ -13,6 +13,8 @@
  * See the License for the specific language governing permissions and
  * limitations under the License.
  */
+#include <cstdlib>
+
 #include "libjit_defs.h"
 
 namespace {
@@ -22,32 +24,46 @@ namespace {
 #define B(i, j) b[(i)*ldb + (j)]
 #define C(i, j) c[(i)*ldc + (j)]
 
-/// Naive gemm helper to handle oddly-sized matrices.
-void libjit_matmul_odd(int m, int n, int k, const float *a, int lda,
-                       const float *b, int ldb, float *c, int ldc) {
-  for (int p = 0; p < k; p++) {
-    for (int i = 0; i < m; i++) {
-      for (int j = 0; j < n; j++) {
-        C(i, j) += A(i, p) * B(p, j);
-      }
-    }
-  }
-}
+/// The height of the register tile (the number of rows of A in a micro-panel).
+/// The AVX-512 registers are twice as wide and twice as many as those of AVX2,
+/// so the tile has more rows.
+#if defined(__AVX512F__)
+constexpr int mr = 8;
+#else
+constexpr int mr = 3;
+#endif
+/// The width of the register tile (the number of columns of B in a
+/// micro-panel). It must match the panel width used by the CPU backend when it
+/// pre-packs constant weights for libjit_matmul_packed_f.
+constexpr int nr = 32;
+/// The number of floatv registers loaded from the B panel by the micro-kernel.
+/// The 3x32 tile of C takes 12 of the 16 AVX2 registers, or 24 of the 32 NEON
+/// registers, and the 8x32 tile takes 16 of the 32 AVX-512 registers, leaving
+/// room for the broadcasts of A and the loads of B.
+constexpr int regsB = nr / FLOATV_WIDTH;
+
+/// The block sizes are provided by the compiler, and are clamped to these upper
+/// bounds so that the packed blocks stay in the caches.
+constexpr int maxKC = 512;
+constexpr int maxPackedA = 128 * 1024;
 
-/// Compute a RAxRB block of C using a vectorized dot product, where RA is the
-/// number of registers to load from matrix A, and RB is the number of registers
-/// to load from matrix B.
+/// Compute a RAxRB block of C using a vectorized dot product, where RA is
+/// the number of rows of the packed micro-panel of A, and RB is the number of
+/// registers to load from the packed micro-panel of B. The micro-panel of A
+/// \p a has the shape [k, regsA] and the micro-panel of B \p b has the shape
+/// [k, regsB * FLOATV_WIDTH].
 template <unsigned int regsA, unsigned int regsB>
-void libjit_matmul_dot(int k, const float *a, int lda, const float *b, int ldb,
-                       float *c, int ldc) {
-  float8 csum[regsA][regsB] = {{0.0}};
+void libjit_matmul_dot(int k, const float *a, const float *b, float *c,
+                       int ldc) {
+  constexpr int w = FLOATV_WIDTH;
+  floatv csum[regsA][regsB] = {{0.0}};
   for (int p = 0; p < k; p++) {
 
     // Perform the DOT product.
     for (int bi = 0; bi < regsB; bi++) {
-      float8 bb = LoaduFloat8(&B(p, bi * 8));
+      floatv bb = LoaduFloatV(&b[p * regsB * w + bi * w]);
       for (int ai = 0; ai < regsA; ai++) {
-        float8 aa = BroadcastFloat8(A(ai, p));
+        floatv aa = BroadcastFloatV(a[p * regsA + ai]);
         csum[ai][bi] += aa * bb;
       }
     }
@@ -56,80 +72,627 @@ void libjit_matmul_dot(int k, const float *a, int lda, const float *b, int ldb,
   // Accumulate the results into C.
   for (int ai = 0; ai < regsA; ai++) {
     for (int bi = 0; bi < regsB; bi++) {
-      AdduFloat8(&C(ai, bi * 8), csum[ai][bi]);
+      AdduFloatV(&C(ai, bi * w), csum[ai][bi]);
     }
   }
 }
 
-/// Compute a portion of C one block at a time.  Handle ragged edges with calls
-/// to a slow but general helper.
-void libjit_matmul_inner(int m, int n, int k, const float *a, int lda,
-                         const float *b, int ldb, float *c, int ldc) {
-  constexpr int regsA = 3;
-  constexpr int regsB = 4;
+/// Multiply the packed \p mb x \p k micro-panel of A by the packed k x nr
+/// micro-panel of B and accumulate the result into C. \p mb must not be
+/// greater than mr.
+void libjit_matmul_micro(int mb, int k, const float *a, const float *b,
+                         float *c, int ldc) {
+  switch (mb) {
+#if defined(__AVX512F__)
+  case 8:
+    libjit_matmul_dot<8, regsB>(k, a, b, c, ldc);
+    break;
+  case 7:
+    libjit_matmul_dot<7, regsB>(k, a, b, c, ldc);
+    break;
+  case 6:
+    libjit_matmul_dot<6, regsB>(k, a, b, c, ldc);
+    break;
+  case 5:
+    libjit_matmul_dot<5, regsB>(k, a, b, c, ldc);
+    break;
+  case 4:
+    libjit_matmul_dot<4, regsB>(k, a, b, c, ldc);
+    break;
+#endif
+  case 3:
+    libjit_matmul_dot<3, regsB>(k, a, b, c, ldc);
+    break;
+  case 2:
+    libjit_matmul_dot<2, regsB>(k, a, b, c, ldc);
+    break;
+  default:
+    libjit_matmul_dot<1, regsB>(k, a, b, c, ldc);
+    break;
+  }
+}
+
+/// Describes the A operand of the matrix multiplication. A is a row-major
+/// matrix with the leading dimension lda. If isTransposed is set then the
+/// element (i, p) of the operand is stored at the row p and the column i.
+struct libjit_matmul_a {
+  const float *a;
+  int lda;
+  bool isTransposed;
 
-  constexpr int mc = regsA;
-  constexpr int nr = regsB * 8;
-  // The tiling scheme naturally divides the input matrices into 2 parts each;
-  // one tiled section, and three "ragged" edges.
-  //
-  // --------------------    -------
-  // | A00*B00 | A00*B01|    | A00 |   -------------
-  // -------------------- += ------- * | B00 | B01 |
-  // | A10*B00 | A10*B01|    | A10 |   -------------
-  // --------------------    -------
-  //
-  // We can process this as 4 separate matrix multiplications.  A00*B00 is the
-  // perfectly-tiled portion, which we handly with a 4x16 dot-product kernel.
-  // The ragged edges are (ideally) less critical, so we handle them with a call
-  // to a general matrix-multiplication for odd sizes.
-  for (int j = 0; j < n - nr + 1; j += nr) {
-    for (int i = 0; i < m - mc + 1; i += mc) {
-      libjit_matmul_dot<regsA, regsB>(k, &A(i, 0), lda, &B(0, j), ldb, &C(i, j),
-                                      ldc);
-    }
-  }
-  int i = (m / mc) * mc;
-  int j = (n / nr) * nr;
-  if (i < m) {
-    libjit_matmul_odd(m - i, j, k, &A(i, 0), lda, &B(0, 0), ldb, &C(i, 0), ldc);
-  }
-  if (j < n) {
-    libjit_matmul_odd(i, n - j, k, &A(0, 0), lda, &B(0, j), ldb, &C(0, j), ldc);
-  }
-  if (i < m && j < n) {
-    libjit_matmul_odd(m - i, n - j, k, &A(i, 0), lda, &B(0, j), ldb, &C(i, j),
-                      ldc);
-  }
-}
-
-/// Tile A into mc * kc blocks, where mc and kc are chosen to approximately fit
-/// the L2 cache on recent Intel processors (e.g., 256 KB for Skylake).  Stream
-/// kc * n panels of B through memory to compute each mc * n block of C.
-/// \p a is an \p m x \p k row-major matrix;
-/// \p b is a \p k x \p n row-major matrix;
-/// \p c is a \p m x \p n row-major matrix.
-/// \p lda, \p ldb, and \p ldc are the leading dimensions of A, B, and C,
-/// respectively.
-void libjit_matmul_outer(int m, int n, int k, const float *a, int lda,
-                         const float *b, int ldb, float *c, int ldc) {
-  // TODO: Generalize these parameters for other cache sizes.
-  constexpr int mc = 256;
-  constexpr int kc = 128;
-  for (int p = 0; p < k; p += kc) {
-    int pb = MIN(k - p, kc);
+  /// \returns the A operand that starts at row \p i and column \p p of this
+  /// operand.
+  libjit_matmul_a offset(int i, int p) const {
+    libjit_matmul_a res = *this;
+    res.a = isTransposed ? a + p * lda + i : a + i * lda + p;
+    return res;
+  }
+};
+
+/// Describes the B operand of the matrix multiplication. B is either a regular
+/// row-major matrix with the leading dimension ldb, which is read transposed
+/// like A if isTransposed is set, or a matrix that was pre-packed into
+/// micro-panels of the shape [k, nr], where consecutive panels are panelStride
+/// elements apart.
+struct libjit_matmul_b {
+  const float *b;
+  int ldb;
+  bool isTransposed;
+  bool isPacked;
+  size_t panelStride;
+
+  /// \returns the B operand that starts at row \p p and column \p j of this
+  /// operand. If the operand is packed then \p j must be a multiple of nr.
+  libjit_matmul_b offset(int p, int j) const {
+    libjit_matmul_b res = *this;
+    if (isPacked) {
+      res.b = b + (j / nr) * panelStride + p * nr;
+    } else if (isTransposed) {
+      res.b = b + j * ldb + p;
+    } else {
+      res.b = b + p * ldb + j;
+    }
+    return res;
+  }
+};
+
+/// Pack the \p m x \p k block of A into consecutive micro-panels of mr rows.
+/// Each micro-panel is stored in the column-major order [k, mr], so that the
+/// micro-kernel reads A sequentially. The last micro-panel may have fewer than
+/// mr rows. The transposed A is transposed by the packing.
+void libjit_matmul_pack_a(int m, int k, libjit_matmul_a lhs, float *packed) {
+  const float *a = lhs.a;
+  int lda = lhs.lda;
+  for (int i = 0; i < m; i += mr) {
+    int rows = MIN(m - i, mr);
+    for (int p = 0; p < k; p++) {
+      for (int r = 0; r < rows; r++) {
+        *packed++ = lhs.isTransposed ? A(p, i + r) : A(i + r, p);
+      }
+    }
+  }
+}
+
+/// Pack the \p k x \p n panel of B into the micro-panel \p packed with the
+/// shape [k, nr]. Columns past \p n are padded with zeros. The transposed B
+/// is transposed by the packing.
+void libjit_matmul_pack_b(int k, int n, libjit_matmul_b rhs, float *packed) {
+  const float *b = rhs.b;
+  int ldb = rhs.ldb;
+  for (int p = 0; p < k; p++) {
+    for (int j = 0; j < n; j++) {
+      packed[p * nr + j] = rhs.isTransposed ? B(j, p) : B(p, j);
+    }
+    for (int j = n; j < nr; j++) {
+      packed[p * nr + j] = 0;
+    }
+  }
+}
+
+/// Compute the \p m x \p n block of C using the packed \p m x \p k block of A
+/// and the \p k x \p n block of B one register tile at a time. Ragged edges are
+/// handled by smaller micro-kernels (in the M dimension) and by the zero
+/// padding of the B micro-panels (in the N dimension). Unless B is pre-packed,
+/// its micro-panels are packed into \p packedB, which holds \p k x nr floats.
+void libjit_matmul_inner(int m, int n, int k, const float *packedA,
+                         libjit_matmul_b rhs, float *c, int ldc,
+                         float *packedB) {
+  // The B micro-panel is reused by all of the micro-panels of A.
+  for (int j = 0; j < n; j += nr) {
+    int nb = MIN(n - j, nr);
+    const float *panel;
+    if (rhs.isPacked) {
+      panel = rhs.offset(0, j).b;
+    } else {
+      libjit_matmul_pack_b(k, nb, rhs.offset(0, j), packedB);
+      panel = packedB;
+    }
+
+    for (int i = 0; i < m; i += mr) {
+      int mb = MIN(m - i, mr);
+      const float *panelA = &packedA[i * k];
+      if (nb == nr) {
+        libjit_matmul_micro(mb, k, panelA, panel, &C(i, j), ldc);
+        continue;
+      }
+      // Compute the partial register tile into a temporary buffer and only
+      // copy the valid columns to C.
+      float tile[mr * nr] = {0};
+      libjit_matmul_micro(mb, k, panelA, panel, tile, nr);
+      for (int ii = 0; ii < mb; ii++) {
+        for (int jj = 0; jj < nb; jj++) {
+          C(i + ii, j + jj) += tile[ii * nr + jj];
+        }
+      }
+    }
+  }
+}
+
+/// Compute C += A * B one cache block at a time. The kc x nc blocks of B are
+/// streamed through the L3 cache, the mc x kc blocks of A are packed and kept
+/// in the L2 cache and the kc x nr micro-panels of B are kept in the L1 cache.
+/// The block sizes are provided by \p blocking = {mc, kc, nc}.
+/// \p lhs is the \p m x \p k matrix A;
+/// \p rhs is the \p k x \p n matrix B;
+/// \p c is a \p m x \p n row-major matrix with the leading dimension \p ldc.
+/// The \p epilogue, if any, is applied to every mc x nc block of C right after
+/// its last kc block is accumulated, while the block is still in the cache.
+/// The first column of C is the column \p col of the complete result.
+void libjit_matmul_outer(int m, int n, int k, libjit_matmul_a lhs,
+                         libjit_matmul_b rhs, float *c, int ldc,
+                         const size_t *blocking,
+                         const libjit_epilogue *epilogue = nullptr,
+                         int col = 0) {
+  int kc = MAX(MIN((int)blocking[1], maxKC), 1);
+  int mc = MIN((int)blocking[0], maxPackedA / kc);
+  mc = MAX(mc - mc % mr, mr);
+  int nc = MAX((int)blocking[2] - (int)blocking[2] % nr, nr);
+
+  // The packing buffers are too large for the stacks of the threads that run
+  // the compiled code, so they are allocated on the heap for the whole call,
+  // which amortizes the allocation over the m x n x k multiply-adds.
+  int maxMB = MIN(m, mc);
+  int maxPB = MIN(k, kc);
+  float *packedA = (float *)malloc((maxMB + nr) * maxPB * sizeof(float));
+  float *packedB = packedA + maxMB * maxPB;
+  for (int j = 0; j < n; j += nc) {
+    int jb = MIN(n - j, nc);
+    for (int p = 0; p < k; p += kc) {
+      int pb = MIN(k - p, kc);
+      for (int i = 0; i < m; i += mc) {
+        int ib = MIN(m - i, mc);
+        libjit_matmul_pack_a(ib, pb, lhs.offset(i, p), packedA);
+        libjit_matmul_inner(ib, jb, pb, packedA, rhs.offset(p, j), &C(i, j),
+                            ldc, packedB);
+        if (epilogue && p + pb == k) {
+          epilogue->apply(ib, jb, &C(i, j), ldc, col + j);
+        }
+      }
+    }
+  }
+  free(packedA);
+}
+
+/// The amount of multiply-accumulate operations that justifies the use of an
+/// additional thread in libjit_matmul_parallel.
+constexpr size_t parallelWorkPerThread = 1 << 20;
+
+/// Describes the partitioning of a m x n matrix C into a grid of
+/// tilesM x tilesN independent blocks.
+struct libjit_matmul_grid {
+  int m;
+  int n;
+  /// The number of rows of C computed by each task.
+  int mb;
+  /// The number of columns of C computed by each task.
+  int nb;
+  /// The number of tasks in the M dimension.
+  int tilesM;
+  /// The number of tasks in the N dimension.
+  int tilesN;
+
+  /// Compute the coordinates \p i, \p j and the size \p ib x \p jb of the
+  /// block of C that corresponds to the task \p task. \returns false if the
+  /// block is empty.
+  bool getBlock(size_t task, int &i, int &j, int &ib, int &jb) const {
+    i = (task / tilesN) * mb;
+    j = (task % tilesN) * nb;
+    if (i >= m || j >= n) {
+      return false;
+    }
+    ib = MIN(m - i, mb);
+    jb = MIN(n - j, nb);
+    return true;
+  }
+};
+
+/// Split the \p m x \p n matrix C that is computed with \p k long dot products
+/// into a grid of disjoint blocks for up to \p numThreads threads. The blocks
+/// are multiples of the \p regM x \p regN register tile, so that the split does
+/// not introduce new ragged edges. The grid is chosen to keep the blocks as
+/// square as possible, which maximizes the reuse of the A and B panels inside
+/// each thread. \returns the number of tasks in the grid \p grid.
+size_t libjit_matmul_split(int m, int n, int k, int regM, int regN,
+                           size_t numThreads, libjit_matmul_grid &grid) {
+  // Don't wake up more threads than the amount of work justifies.
+  size_t work = (size_t)m * n * k;
+  numThreads = MIN(numThreads, work / parallelWorkPerThread);
+
+  int rowTiles = (m + regM - 1) / regM;
+  int colTiles = (n + regN - 1) / regN;
+  int tilesM = 1;
+  int tilesN = 1;
+  float bestRatio = 0;
+  // Use fewer threads if the requested number can't be factored into a grid
+  // that fits the matrix.
+  for (int T = numThreads; T > 1 && bestRatio == 0; T--) {
+    for (int tm = 1; tm <= T; tm++) {
+      if (T % tm) {
+        continue;
+      }
+      int tn = T / tm;
+      if (tm > rowTiles || tn > colTiles) {
+        continue;
+      }
+      float rows = (float)m / tm;
+      float cols = (float)n / tn;
+      float ratio = rows < cols ? rows / cols : cols / rows;
+      if (ratio > bestRatio) {
+        bestRatio = ratio;
+        tilesM = tm;
+        tilesN = tn;
+      }
+    }
+  }
+
+  grid.m = m;
+  grid.n = n;
+  grid.mb = ((rowTiles + tilesM - 1) / tilesM) * regM;
+  grid.nb = ((colTiles + tilesN - 1) / tilesN) * regN;
+  grid.tilesM = tilesM;
+  grid.tilesN = tilesN;
+  return tilesM * tilesN;
+}
+
+/// Describes the operands of a matrix multiplication that is split between
+/// multiple threads.
+struct libjit_matmul_tasks {
+  libjit_matmul_grid grid;
+  int k;
+  libjit_matmul_a lhs;
+  libjit_matmul_b rhs;
+  float *c;
+  int ldc;
+  const size_t *blocking;
+  const libjit_epilogue *epilogue;
+};
+
+/// Compute the block of C that corresponds to the task \p task. The tasks are
+/// described by \p ctx.
+void libjit_matmul_task(void *ctx, size_t task) {
+  const libjit_matmul_tasks *T = (const libjit_matmul_tasks *)ctx;
+  float *c = T->c;
+  int ldc = T->ldc;
+  int i, j, ib, jb;
+  if (!T->grid.getBlock(task, i, j, ib, jb)) {
+    return;
+  }
+  libjit_matmul_outer(ib, jb, T->k, T->lhs.offset(i, 0), T->rhs.offset(0, j),
+                      &C(i, j), ldc, T->blocking, T->epilogue, j);
+}
+
+/// Split C into a grid of disjoint blocks and compute them using up to
+/// \p numThreads threads. Each thread runs the single-threaded tiled kernel on
+/// its own M and N panels, so no synchronization is needed besides the final
+/// join. The \p epilogue, if any, is applied to C by the threads that compute
+/// it.
+void libjit_matmul_parallel(int m, int n, int k, libjit_matmul_a lhs,
+                            libjit_matmul_b rhs, float *c, int ldc,
+                            const size_t *blocking, size_t numThreads,
+                            const libjit_epilogue *epilogue = nullptr) {
+  libjit_matmul_tasks tasks;
+  size_t numTasks =
+      libjit_matmul_split(m, n, k, mr, nr, numThreads, tasks.grid);
+  if (numTasks <= 1) {
+    libjit_matmul_outer(m, n, k, lhs, rhs, c, ldc, blocking, epilogue);
+    return;
+  }
+  tasks.k = k;
+  tasks.lhs = lhs;
+  tasks.rhs = rhs;
+  tasks.c = c;
+  tasks.ldc = ldc;
+  tasks.blocking = blocking;
+  tasks.epilogue = epilogue;
+  libjit_parallel_for(numTasks, numTasks, libjit_matmul_task, &tasks);
+}
+
+/// The number of int32x8 accumulators per row used by the int8 micro-kernel.
+constexpr int regsBI8 = 4;
+/// The width of the register tile of the int8 micro-kernel.
+constexpr int nrI8 = regsBI8 * 8;
+/// The height of the register tile of the int8 micro-kernel, whose int32x8
+/// accumulators don't depend on the width of floatv.
+constexpr int mrI8 = 3;
+
+/// The outputs of the int8 matrix multiplication kernels, which store the
+/// int32 sums of C. Each output provides the quantization offset of the
+/// columns of B (getRhsOffset), stores the sums (store) and creates the
+/// output of the block of C that starts at a given row and column (at).
+
+/// Requantizes the sums into the int8 C, with one scale and one offset for
+/// all of the columns.
+struct libjit_i8_output {
+  int8_t *c;
+  int ldc;
+  int32_t rhsOffset;
+  int32_t outOffset;
+  int32_t outPre;
+  int32_t outPost;
+  int32_t outScale;
+
+  libjit_i8_output at(int i, int j) const {
+    libjit_i8_output out = *this;
+    out.c = &C(i, j);
+    return out;
+  }
+  int32_t getRhsOffset(int j) const { return rhsOffset; }
+  void store(int i, int j, int32_t sum) const {
+    C(i, j) = libjit_clip(
+        libjit_scale_i32i8(sum, outPre, outPost, outScale, outOffset));
+  }
+};
+
+/// Stores the sums into the int32 C as they are.
+struct libjit_i32_output {
+  int32_t *c;
+  int ldc;
+  int32_t rhsOffset;
+
+  libjit_i32_output at(int i, int j) const {
+    libjit_i32_output out = *this;
+    out.c = &C(i, j);
+    return out;
+  }
+  int32_t getRhsOffset(int j) const { return rhsOffset; }
+  void store(int i, int j, int32_t sum) const { C(i, j) = sum; }
+};
+
+/// Adds the int32 bias to the sums and requantizes them into the int8 C, with
+/// the scale rhsScales[j] and the offset rhsOffsets[j] of the column j of B.
+struct libjit_channelwise_output {
+  int8_t *c;
+  int ldc;
+  const int32_t *bias;
+  const float *rhsScales;
+  const int32_t *rhsOffsets;
+  int32_t outOffset;
+  float lhsScale;
+  float outScale;
+
+  libjit_channelwise_output at(int i, int j) const {
+    libjit_channelwise_output out = *this;
+    out.c = &C(i, j);
+    out.bias += j;
+    out.rhsScales += j;
+    out.rhsOffsets += j;
+    return out;
+  }
+  int32_t getRhsOffset(int j) const { return rhsOffsets[j]; }
+  void store(int i, int j, int32_t sum) const {
+    float scale = lhsScale * rhsScales[j] / outScale;
+    C(i, j) = libjit_clip((int32_t)roundf((sum + bias[j]) * scale + outOffset));
+  }
+};
+
+/// Compute the raw int32 dot products of a regsA x nrI8 block of C into \p c
+/// and the sums of the regsA rows of A into \p rowSums. The products are
+/// computed without the quantization offsets; the offsets are corrected by
+/// the caller using the row and column sums. A is either int8 or int16.
+template <unsigned int regsA, typename ElemTy>
+void libjit_matmul_i8_dot(int k, const ElemTy *a, int lda, const int8_t *b,
+                          int ldb, int32_t *c, int32_t *rowSums) {
+  int32x8 csum[regsA][regsBI8] = {{0}};
+  int32_t rsum[regsA] = {0};
+  for (int p = 0; p < k; p++) {
+    for (int bi = 0; bi < regsBI8; bi++) {
+      int32x8 bb = LoaduInt8x8(&B(p, bi * 8));
+      for (int ai = 0; ai < regsA; ai++) {
+        csum[ai][bi] += BroadcastInt32x8((int32_t)A(ai, p)) * bb;
+      }
+    }
+    for (int ai = 0; ai < regsA; ai++) {
+      rsum[ai] += A(ai, p);
+    }
+  }
+
+  for (int ai = 0; ai < regsA; ai++) {
+    for (int bi = 0; bi < regsBI8; bi++) {
+      memcpy(&c[ai * nrI8 + bi * 8], &csum[ai][bi], sizeof(int32x8));
+    }
+    rowSums[ai] = rsum[ai];
+  }
+}
+
+/// Compute the \p m x \p n block of the quantized matrix C = A * B into
+/// \p out, where A is a \p m x \p k matrix of int8 or int16 values and B is a
+/// \p k x \p n matrix of int8 values. Full register tiles are computed by the
+/// vectorized micro-kernel, and the product of the offsets is factored out of
+/// the inner loop:
+///   sum((a - ao) * (b - bo)) =
+///       sum(a * b) - bo * sum(a) - ao * sum(b) + k * ao * bo
+/// The last n % nrI8 columns are handled by a scalar loop.
+template <typename ElemTy, typename Output>
+void libjit_matmul_i8_inner(int m, int n, int k, const ElemTy *a, int lda,
+                            const int8_t *b, int ldb, int32_t lhsOffset,
+                            const Output &out) {
+  int j = 0;
+  for (; j + nrI8 <= n; j += nrI8) {
+    // The column sums are shared by all of the rows of the block.
+    int32_t colSums[nrI8] = {0};
+    for (int p = 0; p < k; p++) {
+      for (int jj = 0; jj < nrI8; jj++) {
+        colSums[jj] += B(p, j + jj);
+      }
+    }
+
+    for (int i = 0; i < m; i += mrI8) {
+      int mb = MIN(m - i, mrI8);
+      int32_t tile[mrI8 * nrI8];
+      int32_t rowSums[mrI8];
+      switch (mb) {
+      case 3:
+        libjit_matmul_i8_dot<3>(k, &A(i, 0), lda, &B(0, j), ldb, tile, rowSums);
+        break;
+      case 2:
+        libjit_matmul_i8_dot<2>(k, &A(i, 0), lda, &B(0, j), ldb, tile, rowSums);
+        break;
+      default:
+        libjit_matmul_i8_dot<1>(k, &A(i, 0), lda, &B(0, j), ldb, tile, rowSums);
+        break;
+      }
+      for (int ii = 0; ii < mb; ii++) {
+        for (int jj = 0; jj < nrI8; jj++) {
+          int32_t rhsOffset = out.getRhsOffset(j + jj);
+          int32_t sum = tile[ii * nrI8 + jj] + k * lhsOffset * rhsOffset -
+                        rhsOffset * rowSums[ii] - lhsOffset * colSums[jj];
+          out.store(i + ii, j + jj, sum);
+        }
+      }
+    }
+  }
+
+  // Handle the ragged columns.
+  for (int i = 0; i < m; i++) {
+    for (int jj = j; jj < n; jj++) {
+      int32_t rhsOffset = out.getRhsOffset(jj);
+      int32_t sum = 0;
+      for (int p = 0; p < k; p++) {
+        sum += (A(i, p) - lhsOffset) * (B(p, jj) - rhsOffset);
+      }
+      out.store(i, jj, sum);
+    }
+  }
+}
+
+/// Compute the quantized matrix multiplication one mc x k block of A at a
+/// time, using the same block sizes \p blocking = {mc, kc, nc} as the float
+/// kernel. The K dimension is not blocked, because the complete int32 dot
+/// product is needed before it can be requantized.
+template <typename ElemTy, typename Output>
+void libjit_matmul_i8_outer(int m, int n, int k, const ElemTy *a, int lda,
+                            const int8_t *b, int ldb, int32_t lhsOffset,
+                            const Output &out, const size_t *blocking) {
+  int mc = MAX((int)blocking[0] - (int)blocking[0] % mrI8, mrI8);
+  int nc = MAX((int)blocking[2] - (int)blocking[2] % nrI8, nrI8);
+  for (int j = 0; j < n; j += nc) {
+    int jb = MIN(n - j, nc);
     for (int i = 0; i < m; i += mc) {
       int ib = MIN(m - i, mc);
-      libjit_matmul_inner(ib, n, pb, &A(i, p), lda, &B(p, 0), ldb, &C(i, 0),
-                          ldc);
+      libjit_matmul_i8_inner(ib, jb, k, &A(i, 0), lda, &B(0, j), ldb,
+                             lhsOffset, out.at(i, j));
     }
   }
 }
 
+/// Describes the operands of a quantized matrix multiplication that is split
+/// between multiple threads.
+template <typename ElemTy, typename Output> struct libjit_matmul_i8_tasks {
+  libjit_matmul_grid grid;
+  int k;
+  const ElemTy *a;
+  int lda;
+  const int8_t *b;
+  int ldb;
+  int32_t lhsOffset;
+  Output out;
+  const size_t *blocking;
+};
+
+/// Compute the block of the quantized C that corresponds to the task \p task.
+/// The tasks are described by \p ctx.
+template <typename ElemTy, typename Output>
+void libjit_matmul_i8_task(void *ctx, size_t task) {
+  const auto *T = (const libjit_matmul_i8_tasks<ElemTy, Output> *)ctx;
+  const ElemTy *a = T->a;
+  const int8_t *b = T->b;
+  int lda = T->lda;
+  int ldb = T->ldb;
+  int i, j, ib, jb;
+  if (!T->grid.getBlock(task, i, j, ib, jb)) {
+    return;
+  }
+  libjit_matmul_i8_outer(ib, jb, T->k, &A(i, 0), lda, &B(0, j), ldb,
+                         T->lhsOffset, T->out.at(i, j), T->blocking);
+}
+
+/// Compute the \p m x \p n quantized matrix C = A * B into \p out, split into
+/// a grid of disjoint blocks for up to \p numThreads threads.
+template <typename ElemTy, typename Output>
+void libjit_matmul_i8_parallel(int m, int n, int k, const ElemTy *a, int lda,
+                               const int8_t *b, int ldb, int32_t lhsOffset,
+                               const Output &out, const size_t *blocking,
+                               size_t numThreads) {
+  libjit_matmul_i8_tasks<ElemTy, Output> tasks;
+  size_t numTasks =
+      libjit_matmul_split(m, n, k, mrI8, nrI8, numThreads, tasks.grid);
+  if (numTasks <= 1) {
+    libjit_matmul_i8_outer(m, n, k, a, lda, b, ldb, lhsOffset, out, blocking);
+    return;
+  }
+  tasks.k = k;
+  tasks.a = a;
+  tasks.lda = lda;
+  tasks.b = b;
+  tasks.ldb = ldb;
+  tasks.lhsOffset = lhsOffset;
+  tasks.out = out;
+  tasks.blocking = blocking;
+  libjit_parallel_for(numTasks, numTasks,
+                      libjit_matmul_i8_task<ElemTy, Output>, &tasks);
+}
+
 #undef C
 #undef B
 #undef A
 
+/// The number of nonzero weights times rows of the input that justifies the
+/// use of an additional thread in libjit_sparse_fc_f.
+constexpr size_t sparseFCWorkPerThread = 1 << 16;
+
+/// Describes the operands of a sparse fully connected layer whose columns are
+/// split between multiple threads.
+struct libjit_sparse_fc_tasks {
+  float *c;
+  const float *a;
+  const float *values;
+  const int32_t *indices;
+  const int32_t *offsets;
+  const float *bias;
+  size_t m;
+  size_t n;
+  size_t k;
+  size_t numTasks;
+};
+
+/// Compute the columns of C that correspond to the task \p task. The tasks
+/// are described by \p ctx.
+void libjit_sparse_fc_task(void *ctx, size_t task) {
+  const libjit_sparse_fc_tasks *T = (const libjit_sparse_fc_tasks *)ctx;
+  size_t begin = T->n * task / T->numTasks;
+  size_t end = T->n * (task + 1) / T->numTasks;
+  for (size_t i = 0; i < T->m; i++) {
+    const float *row = T->a + i * T->k;
+    for (size_t j = begin; j < end; j++) {
+      float sum = T->bias[j];
+      for (int32_t p = T->offsets[j], e = T->offsets[j + 1]; p < e; p++) {
+        sum += row[T->indices[p]] * T->values[p];
+      }
+      T->c[i * T->n + j] = sum;
+    }
+  }
+}
+
 } // namespace
 
 extern "C" {
@@ -139,9 +702,17 @@ extern "C" {
 /// \p c is a m x n matrix, so \p cDims = {m, n}
 /// \p a is a m x k matrix, so \p aDims = {m, k}
 /// \p b is a k x n matrix, so \p bDims = {k, n}
+/// If \p transposeA is set then a is stored as a k x m matrix and is
+/// multiplied transposed, and likewise if \p transposeB is set then b is
+/// stored as a n x k matrix. The packing of the blocks transposes them, so the
+/// transposed operands don't need an additional copy.
+/// \p blocking = {mc, kc, nc} are the cache block sizes.
+/// The computation is split between up to \p numThreads threads.
 void libjit_matmul_f(float *c, const float *a, const float *b,
                      const size_t *cDims, const size_t *aDims,
-                     const size_t *bDims) {
+                     const size_t *bDims, const size_t *blocking,
+                     size_t numThreads, unsigned transposeA,
+                     unsigned transposeB) {
   memset(c, 0, cDims[0] * cDims[1] * sizeof(float));
   // Call the matrix multiplication routine with appropriate dimensions and
   // leading dimensions. The "leading dimension" for a row-major matrix is equal
@@ -150,26 +721,141 @@ void libjit_matmul_f(float *c, const float *a, const float *b,
   //
   // The matrix multiplication routine is heavily inspired by:
   // https://github.com/flame/how-to-optimize-gemm
-  libjit_matmul_outer(cDims[0], cDims[1], aDims[1], a, aDims[1], b, bDims[1], c,
-                      cDims[1]);
+  libjit_matmul_a lhs = {a, (int)aDims[1], transposeA != 0};
+  libjit_matmul_b rhs = {b, (int)bDims[1], transposeB != 0, false, 0};
+  int k = transposeA ? aDims[0] : aDims[1];
+  libjit_matmul_parallel(cDims[0], cDims[1], k, lhs, rhs, c, cDims[1],
+                         blocking, numThreads);
+}
+
+/// Performs the matrix multiplication c = a * b, where c and a are row-major
+/// matrices and b was pre-packed into micro-panels.
+/// \p c is a m x n matrix, so \p cDims = {m, n}
+/// \p a is a m x k matrix, so \p aDims = {m, k}
+/// \p b is a k x n matrix stored as ceil(n / 32) panels of the shape [k, 32].
+/// The columns past n in the last panel are zero. \p bDims = {n / 32, k, 32}.
+/// \p blocking = {mc, kc, nc} are the cache block sizes.
+/// The computation is split between up to \p numThreads threads.
+void libjit_matmul_packed_f(float *c, const float *a, const float *b,
+                            const size_t *cDims, const size_t *aDims,
+                            const size_t *bDims, const size_t *blocking,
+                            size_t numThreads) {
+  memset(c, 0, cDims[0] * cDims[1] * sizeof(float));
+  libjit_matmul_a lhs = {a, (int)aDims[1], false};
+  libjit_matmul_b rhs = {b, nr, false, true, bDims[1] * bDims[2]};
+  libjit_matmul_parallel(cDims[0], cDims[1], aDims[1], lhs, rhs, c, cDims[1],
+                         blocking, numThreads);
+}
+
+/// Performs c = act(a * b + bias), where c and a are row-major matrices, b
+/// was pre-packed into micro-panels like in libjit_matmul_packed_f and \p bias
+/// has n elements. The activation \p activation with the parameter \p param
+/// is one of libjit_activation. The bias and the activation are applied to
+/// the blocks of c as soon as they are complete.
+void libjit_fc_packed_f(float *c, const float *a, const float *b,
+                        const float *bias, const size_t *cDims,
+                        const size_t *aDims, const size_t *bDims,
+                        const size_t *blocking, size_t numThreads,
+                        unsigned activation, float param) {
+  memset(c, 0, cDims[0] * cDims[1] * sizeof(float));
+  libjit_matmul_a lhs = {a, (int)aDims[1], false};
+  libjit_matmul_b rhs = {b, nr, false, true, bDims[1] * bDims[2]};
+  libjit_epilogue epilogue = {bias, activation, param};
+  libjit_matmul_parallel(cDims[0], cDims[1], aDims[1], lhs, rhs, c, cDims[1],
+                         blocking, numThreads, &epilogue);
 }
 
+/// Performs the quantized matrix multiplication outW = lhsW * rhsW, where all
+/// of the matrices are row-major. \p blocking = {mc, kc, nc} are the cache
+/// block sizes. The computation is split between up to \p numThreads threads.
 void libjit_matmul_i8(int8_t *outW, const int8_t *lhsW, const int8_t *rhsW,
                       const size_t *outWdims, const size_t *lhsWdims,
                       const size_t *rhsWdims, int32_t outOffset,
                       int32_t lhsOffset, int32_t rhsOffset, int32_t outPre,
-                      int32_t outPost, int32_t outScale) {
-  for (size_t x = 0; x < outWdims[0]; x++) {
-    for (size_t y = 0; y < outWdims[1]; y++) {
-      int32_t sum = 0;
-      for (size_t i = 0; i < lhsWdims[1]; i++) {
-        int32_t lhs = lhsW[libjit_getXY(lhsWdims, x, i)] - lhsOffset;
-        int32_t rhs = rhsW[libjit_getXY(rhsWdims, i, y)] - rhsOffset;
-        sum += lhs * rhs;
-      }
-      int32_t s = libjit_scale_i32i8(sum, outPre, outPost, outScale, outOffset);
-      outW[libjit_getXY(outWdims, x, y)] = libjit_clip(s);
-    }
-  }
+                      int32_t outPost, int32_t outScale, const size_t *blocking,
+                      size_t numThreads) {
+  int m = outWdims[0];
+  int n = outWdims[1];
+  int k = lhsWdims[1];
+  libjit_i8_output out = {outW,   n,       rhsOffset, outOffset,
+                          outPre, outPost, outScale};
+  libjit_matmul_i8_parallel(m, n, k, lhsW, k, rhsW, n, lhsOffset, out,
+                            blocking, numThreads);
+}
+
+/// Multiplies the int16 activations \p lhsW by the int8 matrix \p rhsW into
+/// the int32 accumulators \p outW, which have the product of the scales of the
+/// operands and no offset. \p blocking = {mc, kc, nc} are the cache block
+/// sizes. The computation is split between up to \p numThreads threads.
+void libjit_matmul_i16_i8(int32_t *outW, const int16_t *lhsW,
+                          const int8_t *rhsW, const size_t *outWdims,
+                          const size_t *lhsWdims, const size_t *rhsWdims,
+                          int32_t lhsOffset, int32_t rhsOffset,
+                          const size_t *blocking, size_t numThreads) {
+  int m = outWdims[0];
+  int n = outWdims[1];
+  int k = lhsWdims[1];
+  libjit_i32_output out = {outW, n, rhsOffset};
+  libjit_matmul_i8_parallel(m, n, k, lhsW, k, rhsW, n, lhsOffset, out,
+                            blocking, numThreads);
+}
+
+/// Performs the quantized matrix multiplication c = a * b + bias, where the
+/// column j of the int8 matrix \p b has the scale rhsScales[j] and the offset
+/// rhsOffsets[j]. \p a is a \p m x \p k row-major matrix and \p b is a
+/// \p k x \p n row-major matrix. The rows of \p c are \p ldc apart. The
+/// int32 bias is quantized with the scale lhsScale * rhsScales[j] and the
+/// offset zero. \p blocking = {mc, kc, nc} are the cache block sizes. The
+/// computation is split between up to \p numThreads threads.
+void libjit_channelwise_matmul_i8(
+    int8_t *c, const int8_t *a, const int8_t *b, const int32_t *bias,
+    const float *rhsScales, const int32_t *rhsOffsets, size_t m, size_t n,
+    size_t k, size_t ldc, int32_t outOffset, int32_t lhsOffset, float lhsScale,
+    float outScale, const size_t *blocking, size_t numThreads) {
+  libjit_channelwise_output out = {c,          (int)ldc,  bias,
+                                   rhsScales,  rhsOffsets, outOffset,
+                                   lhsScale,   outScale};
+  libjit_matmul_i8_parallel((int)m, (int)n, (int)k, a, (int)k, b, (int)n,
+                            lhsOffset, out, blocking, numThreads);
+}
+
+/// Performs the fully connected layer c = a * w + bias, where c and a are
+/// row-major matrices and only the nonzero weights of w are stored: the
+/// column j of w has the weights \p values[\p offsets[j]] to
+/// \p values[\p offsets[j + 1] - 1] in the rows \p indices of the same
+/// positions. \p cDims = {m, n} and \p aDims = {m, k}. The columns of c are
+/// split between up to \p numThreads threads.
+void libjit_sparse_fc_f(float *c, const float *a, const float *values,
+                        const int32_t *indices, const int32_t *offsets,
+                        const float *bias, const size_t *cDims,
+                        const size_t *aDims, size_t numThreads) {
+  size_t m = cDims[0];
+  size_t n = cDims[1];
+  size_t work = m * offsets[n];
+  size_t numTasks = MAX(MIN(MIN(numThreads, work / sparseFCWorkPerThread), n),
+                        (size_t)1);
+  libjit_sparse_fc_tasks tasks = {c, a, values, indices, offsets, bias, m, n,
+                                  aDims[1], numTasks};
+  libjit_parallel_for(numTasks, numTasks, libjit_sparse_fc_task, &tasks);
+}
+
+/// Performs the quantized fully connected layer outW = lhsW * rhsW + biasW
+/// with the per-column quantized weights \p rhsW. The column j of the weights
+/// has the scale rhsScales[j] and the offset rhsOffsets[j]. The int32 bias
+/// \p biasW is quantized with the scale lhsScale * rhsScales[j] and the offset
+/// zero. \p blocking = {mc, kc, nc} are the cache block sizes. The
+/// computation is split between up to \p numThreads threads.
+void libjit_channelwise_fc_i8(int8_t *outW, const int8_t *lhsW,
+                              const int8_t *rhsW, const int32_t *biasW,
+                              const float *rhsScales, const int32_t *rhsOffsets,
+                              const size_t *outWdims, const size_t *lhsWdims,
+                              const size_t *rhsWdims, int32_t outOffset,
+                              int32_t lhsOffset, float lhsScale,
+                              float outScale, const size_t *blocking,
+                              size_t numThreads) {
+  libjit_channelwise_matmul_i8(outW, lhsW, rhsW, biasW, rhsScales, rhsOffsets,
+                               outWdims[0], outWdims[1], lhsWdims[1],
+                               outWdims[1], outOffset, lhsOffset, lhsScale,
+                               outScale, blocking, numThreads);
 }
 }
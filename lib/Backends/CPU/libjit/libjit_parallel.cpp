@@ -0,0 +1,29 @@
+/**
+ * Copyright (c) 2017-present, Facebook, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "glow/Support/Parallel.h"
+
+#include "libjit_defs.h"
+
+extern "C" {
+
+void libjit_parallel_for(size_t numTasks, size_t numThreads,
+                         libjit_parallel_task_fn fn, void *ctx) {
+  // The bundles carry the pool, which is compiled into libjit. The code that
+  // the process jits calls the pool of the process.
+  glow_parallel_for(numTasks, numThreads, fn, ctx);
+}
+}
@@ -0,0 +1,272 @@
+/**
+ * Copyright (c) 2017-present, Facebook, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "FastKernels.h"
+
+#include "glow/Base/Float16.h"
+#include "glow/Support/Parallel.h"
+
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <cstdint>
+#include <sys/types.h>
+#include <vector>
+
+using namespace glow;
+
+llvm::cl::opt<bool> interpreterFastKernels(
+    "interpreter-fast-kernels",
+    llvm::cl::desc("Run the optimized multi-threaded floating point kernels "
+                   "in the Interpreter instead of the reference kernels"),
+    llvm::cl::init(false));
+
+/// The work below which a thread is not worth starting.
+static constexpr size_t minWorkPerThread = 1 << 16;
+
+/// The number of the columns of the rhs of a matrix multiplication that are
+/// accumulated at once, so that they stay in the cache.
+static constexpr size_t matMulBlockN = 256;
+
+namespace {
+/// The ranges of fast::parallelFor, which are the tasks of glow_parallel_for.
+struct ParallelRanges {
+  llvm::function_ref<void(size_t, size_t)> fn;
+  size_t numTasks;
+  size_t numRanges;
+};
+} // namespace
+
+/// Run the range \p range of the ParallelRanges \p ctx.
+static void runParallelRange(void *ctx, size_t range) {
+  auto *ranges = static_cast<ParallelRanges *>(ctx);
+  size_t tasksPerRange = ranges->numTasks / ranges->numRanges;
+  size_t extraTasks = ranges->numTasks % ranges->numRanges;
+  size_t begin = range * tasksPerRange + std::min(range, extraTasks);
+  size_t end = begin + tasksPerRange + (range < extraTasks ? 1 : 0);
+  ranges->fn(begin, end);
+}
+
+void fast::parallelFor(size_t numTasks, size_t workPerTask,
+                       llvm::function_ref<void(size_t, size_t)> fn) {
+  size_t numThreads = glow_parallel_get_num_threads();
+  numThreads = std::min(numThreads, numTasks * workPerTask / minWorkPerThread);
+  numThreads = std::min(numThreads, numTasks);
+  if (numThreads <= 1) {
+    fn(0, numTasks);
+    return;
+  }
+
+  // Every thread of the pool that is idle takes a range.
+  ParallelRanges ranges{fn, numTasks, numThreads};
+  glow_parallel_for(numThreads, numThreads, runParallelRange, &ranges);
+}
+
+template <class ElemTy>
+void fast::matMul(ElemTy *dest, const ElemTy *lhs, const ElemTy *rhs, size_t m,
+                  size_t n, size_t k) {
+  parallelFor(m, n * k, [&](size_t begin, size_t end) {
+    // Accumulate a block of each row of the result over the rows of the rhs,
+    // which the inner loop reads contiguously.
+    std::vector<float> acc(std::min(n, matMulBlockN));
+    for (size_t x = begin; x < end; x++) {
+      for (size_t y0 = 0; y0 < n; y0 += matMulBlockN) {
+        size_t yn = std::min(n - y0, matMulBlockN);
+        std::fill(acc.begin(), acc.begin() + yn, 0);
+        for (size_t i = 0; i < k; i++) {
+          float l = lhs[x * k + i];
+          const ElemTy *r = &rhs[i * n + y0];
+          for (size_t y = 0; y < yn; y++) {
+            acc[y] += l * float(r[y]);
+          }
+        }
+        for (size_t y = 0; y < yn; y++) {
+          dest[x * n + y0 + y] = acc[y];
+        }
+      }
+    }
+  });
+}
+
+template <class ElemTy>
+void fast::convolution(ElemTy *out, const ElemTy *in, const ElemTy *filter,
+                       const ElemTy *bias, ShapeNHWC odim, ShapeNHWC idim,
+                       size_t filterSize, size_t stride, size_t pad,
+                       size_t group) {
+  size_t inCperG = idim.c / group;
+  size_t outCperG = odim.c / group;
+  size_t work = odim.w * odim.c * filterSize * filterSize * inCperG;
+
+  // Every task computes a row of the output of one of the images.
+  parallelFor(odim.n * odim.h, work, [&](size_t begin, size_t end) {
+    std::vector<float> acc(odim.c);
+    for (size_t task = begin; task < end; task++) {
+      size_t n = task / odim.h;
+      size_t ax = task % odim.h;
+      ssize_t x = ssize_t(ax * stride) - ssize_t(pad);
+      ssize_t y = -ssize_t(pad);
+      for (size_t ay = 0; ay < odim.w; y += stride, ay++) {
+        for (size_t d = 0; d < odim.c; d++) {
+          acc[d] = 0;
+        }
+        for (size_t fx = 0; fx < filterSize; fx++) {
+          for (size_t fy = 0; fy < filterSize; fy++) {
+            ssize_t ox = x + fx;
+            ssize_t oy = y + fy;
+            // Ignore index access below zero (this is due to padding).
+            if (ox < 0 || oy < 0 || ox >= ssize_t(idim.h) ||
+                oy >= ssize_t(idim.w)) {
+              continue;
+            }
+            const ElemTy *pixel =
+                &in[((n * idim.h + ox) * idim.w + oy) * idim.c];
+            for (size_t d = 0; d < odim.c; d++) {
+              const ElemTy *inG = &pixel[(d / outCperG) * inCperG];
+              const ElemTy *filterD =
+                  &filter[((d * filterSize + fx) * filterSize + fy) * inCperG];
+              float sum = 0;
+              for (size_t fd = 0; fd < inCperG; fd++) {
+                sum += float(filterD[fd]) * float(inG[fd]);
+              }
+              acc[d] += sum;
+            }
+          }
+        }
+        ElemTy *outPixel = &out[((n * odim.h + ax) * odim.w + ay) * odim.c];
+        for (size_t d = 0; d < odim.c; d++) {
+          outPixel[d] = acc[d] + float(bias[d]);
+        }
+      }
+    }
+  });
+}
+
+template <class ElemTy>
+void fast::poolMax(ElemTy *out, const ElemTy *in, ShapeNHWC odim,
+                   ShapeNHWC idim, size_t filterSize, size_t stride,
+                   size_t pad) {
+  size_t work = odim.w * odim.c * filterSize * filterSize;
+  parallelFor(odim.n * odim.h, work, [&](size_t begin, size_t end) {
+    for (size_t task = begin; task < end; task++) {
+      size_t n = task / odim.h;
+      size_t ax = task % odim.h;
+      ssize_t x = ssize_t(ax * stride) - ssize_t(pad);
+      ssize_t y = -ssize_t(pad);
+      for (size_t ay = 0; ay < odim.w; y += stride, ay++) {
+        ElemTy *outPixel = &out[((n * odim.h + ax) * odim.w + ay) * odim.c];
+        bool first = true;
+        for (size_t fx = 0; fx < filterSize; fx++) {
+          for (size_t fy = 0; fy < filterSize; fy++) {
+            ssize_t ox = x + fx;
+            ssize_t oy = y + fy;
+            // Ignore index access below zero (this is due to padding).
+            if (ox < 0 || oy < 0 || ox >= ssize_t(idim.h) ||
+                oy >= ssize_t(idim.w)) {
+              continue;
+            }
+            const ElemTy *pixel =
+                &in[((n * idim.h + ox) * idim.w + oy) * idim.c];
+            for (size_t z = 0; z < odim.c; z++) {
+              if (first || float(pixel[z]) > float(outPixel[z])) {
+                outPixel[z] = pixel[z];
+              }
+            }
+            first = false;
+          }
+        }
+        assert(!first && "Max value is uninitialized");
+      }
+    }
+  });
+}
+
+void fast::poolAvg(float *out, const float *in, ShapeNHWC odim,
+                   ShapeNHWC idim, size_t filterSize, size_t stride,
+                   size_t pad) {
+  float filterArea = filterSize * filterSize;
+  size_t work = odim.w * odim.c * filterSize * filterSize;
+  parallelFor(odim.n * odim.h, work, [&](size_t begin, size_t end) {
+    std::vector<float> acc(odim.c);
+    for (size_t task = begin; task < end; task++) {
+      size_t n = task / odim.h;
+      size_t ax = task % odim.h;
+      ssize_t x = ssize_t(ax * stride) - ssize_t(pad);
+      ssize_t y = -ssize_t(pad);
+      for (size_t ay = 0; ay < odim.w; y += stride, ay++) {
+        std::fill(acc.begin(), acc.end(), 0);
+        for (size_t fx = 0; fx < filterSize; fx++) {
+          for (size_t fy = 0; fy < filterSize; fy++) {
+            ssize_t ox = x + fx;
+            ssize_t oy = y + fy;
+            // Ignore index access below zero (this is due to padding).
+            if (ox < 0 || oy < 0 || ox >= ssize_t(idim.h) ||
+                oy >= ssize_t(idim.w)) {
+              continue;
+            }
+            const float *pixel =
+                &in[((n * idim.h + ox) * idim.w + oy) * idim.c];
+            for (size_t z = 0; z < odim.c; z++) {
+              acc[z] += pixel[z];
+            }
+          }
+        }
+        float *outPixel = &out[((n * odim.h + ax) * odim.w + ay) * odim.c];
+        for (size_t z = 0; z < odim.c; z++) {
+          outPixel[z] = acc[z] / filterArea;
+        }
+      }
+    }
+  });
+}
+
+void fast::softMax(float *out, const float *in, size_t rows, size_t cols) {
+  parallelFor(rows, cols, [&](size_t begin, size_t end) {
+    for (size_t n = begin; n < end; n++) {
+      const float *inRow = &in[n * cols];
+      float *outRow = &out[n * cols];
+      float max = *std::max_element(inRow, inRow + cols);
+      float sum = 0;
+      for (size_t i = 0; i < cols; i++) {
+        outRow[i] = std::exp(inRow[i] - max);
+        sum += outRow[i];
+      }
+      for (size_t i = 0; i < cols; i++) {
+        outRow[i] = outRow[i] / sum;
+      }
+    }
+  });
+}
+
+namespace glow {
+namespace fast {
+template void matMul<float>(float *, const float *, const float *, size_t,
+                            size_t, size_t);
+template void matMul<float16>(float16 *, const float16 *, const float16 *,
+                              size_t, size_t, size_t);
+template void convolution<float>(float *, const float *, const float *,
+                                 const float *, ShapeNHWC, ShapeNHWC, size_t,
+                                 size_t, size_t, size_t);
+template void convolution<float16>(float16 *, const float16 *,
+                                   const float16 *, const float16 *, ShapeNHWC,
+                                   ShapeNHWC, size_t, size_t, size_t, size_t);
+template void poolMax<float>(float *, const float *, ShapeNHWC, ShapeNHWC,
+                             size_t, size_t, size_t);
+template void poolMax<float16>(float16 *, const float16 *, ShapeNHWC,
+                               ShapeNHWC, size_t, size_t, size_t);
+template void poolMax<int8_t>(int8_t *, const int8_t *, ShapeNHWC, ShapeNHWC,
+                              size_t, size_t, size_t);
+} // namespace fast
+} // namespace glow
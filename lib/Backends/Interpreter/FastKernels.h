@@ -0,0 +1,95 @@
+/**
+ * Copyright (c) 2017-present, Facebook, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#ifndef GLOW_INTERPRETER_FASTKERNELS_H
+#define GLOW_INTERPRETER_FASTKERNELS_H
+
+#include "glow/Base/Type.h"
+
+#include "llvm/ADT/STLExtras.h"
+#include "llvm/Support/CommandLine.h"
+
+#include <cstddef>
+
+/// Whether the Interpreter runs the optimized kernels of this file instead of
+/// its reference kernels, which remain the numerical reference of the tests.
+extern llvm::cl::opt<bool> interpreterFastKernels;
+
+namespace glow {
+
+/// The optimized floating point kernels of the Interpreter. They operate on
+/// raw pointers and split the work across threads. All of them compute in
+/// float for all of the floating point element types \p ElemTy.
+namespace fast {
+
+/// Call \p fn on the ranges [begin, end) that partition [0, numTasks), on the
+/// threads of the pool of glow_parallel_for. \p workPerTask estimates the
+/// cost of a task, and the small amounts of work are not split.
+void parallelFor(size_t numTasks, size_t workPerTask,
+                 llvm::function_ref<void(size_t begin, size_t end)> fn);
+
+/// Store \p op of the \p size elements of \p in into \p out.
+template <class ElemTy, class Op>
+void unaryOp(ElemTy *out, const ElemTy *in, size_t size, Op op) {
+  parallelFor(size, 1, [&](size_t begin, size_t end) {
+    for (size_t i = begin; i < end; i++) {
+      out[i] = op(float(in[i]));
+    }
+  });
+}
+
+/// Store \p op of the \p size elements of \p lhs and \p rhs into \p out.
+template <class ElemTy, class Op>
+void binaryOp(ElemTy *out, const ElemTy *lhs, const ElemTy *rhs, size_t size,
+              Op op) {
+  parallelFor(size, 1, [&](size_t begin, size_t end) {
+    for (size_t i = begin; i < end; i++) {
+      out[i] = op(float(lhs[i]), float(rhs[i]));
+    }
+  });
+}
+
+/// Multiply the \p m x \p k matrix \p lhs by the \p k x \p n matrix \p rhs
+/// into the \p m x \p n matrix \p dest.
+template <class ElemTy>
+void matMul(ElemTy *dest, const ElemTy *lhs, const ElemTy *rhs, size_t m,
+            size_t n, size_t k);
+
+/// Convolve the NHWC tensor \p in of the shape \p idim with the \p filter into
+/// the NHWC tensor \p out of the shape \p odim, and add the \p bias.
+template <class ElemTy>
+void convolution(ElemTy *out, const ElemTy *in, const ElemTy *filter,
+                 const ElemTy *bias, ShapeNHWC odim, ShapeNHWC idim,
+                 size_t filterSize, size_t stride, size_t pad, size_t group);
+
+/// Max pool the NHWC tensor \p in of the shape \p idim into the NHWC tensor
+/// \p out of the shape \p odim.
+template <class ElemTy>
+void poolMax(ElemTy *out, const ElemTy *in, ShapeNHWC odim, ShapeNHWC idim,
+             size_t filterSize, size_t stride, size_t pad);
+
+/// Average pool the NHWC tensor \p in of the shape \p idim into the NHWC
+/// tensor \p out of the shape \p odim. The padding counts as zeros.
+void poolAvg(float *out, const float *in, ShapeNHWC odim, ShapeNHWC idim,
+             size_t filterSize, size_t stride, size_t pad);
+
+/// Compute the softmax of each of the \p rows rows of \p cols elements of
+/// \p in into \p out.
+void softMax(float *out, const float *in, size_t rows, size_t cols);
+
+} // namespace fast
+} // namespace glow
+
+#endif // GLOW_INTERPRETER_FASTKERNELS_H
@@ -16,13 +16,19 @@
 
 #include "Interpreter.h"
 
+#include "glow/CodeGen/MemoryAllocator.h"
 #include "glow/Graph/Graph.h"
 #include "glow/Graph/Nodes.h"
 #include "glow/IR/Instrs.h"
+#include "glow/Support/Trace.h"
 
+#include "llvm/ADT/DenseMap.h"
 #include "llvm/Support/Casting.h"
 
+#include <vector>
+
 using namespace glow;
+using llvm::dyn_cast;
 using llvm::isa;
 
 Interpreter::~Interpreter() { clear(); }
@@ -35,6 +41,9 @@ void Interpreter::clear() {
 
   tensors_.clear();
   externalTensors_.clear();
+  instrs_.clear();
+  alignedFree(activations_);
+  activations_ = nullptr;
 }
 
 void Interpreter::init() {
@@ -47,9 +56,102 @@ void Interpreter::init() {
   for (auto *W : F_->getWeights()) {
     getOrCreateTensor(W);
   }
+
+  prepareInstrs();
+}
+
+void Interpreter::allocateActivations() {
+  // The live intervals of the activations and their addresses in the arena.
+  MemoryAllocator allocator(0);
+  std::vector<LiveBuffer> buffers;
+  std::vector<size_t> addrs;
+  std::vector<const AllocActivationInst *> activations;
+  llvm::DenseMap<const AllocActivationInst *, size_t> indices;
+
+  size_t instrIdx = 0;
+  for (auto *I : F_->getInstrs()) {
+    instrIdx++;
+    if (auto *A = dyn_cast<AllocActivationInst>(I)) {
+      indices[A] = buffers.size();
+      addrs.push_back(allocator.allocate(A->getSizeInBytes()));
+      buffers.emplace_back(A->getSizeInBytes(), instrIdx,
+                           F_->getInstrs().size() + 1);
+      activations.push_back(A);
+    } else if (auto *D = dyn_cast<DeallocActivationInst>(I)) {
+      assert(indices.count(D->getAlloc()) && "Invalid deallocation!");
+      size_t idx = indices[D->getAlloc()];
+      allocator.deallocate(addrs[idx]);
+      buffers[idx].end_ = instrIdx;
+    }
+  }
+
+  // Keep the placement that needs less memory.
+  size_t size = allocator.getMaxMemoryUsage();
+  std::vector<size_t> offlineAddrs;
+  size_t offlineSize = allocateOffline(buffers, offlineAddrs);
+  if (offlineSize < size) {
+    size = offlineSize;
+    addrs = offlineAddrs;
+  }
+
+  if (size) {
+    activations_ = static_cast<uint8_t *>(alignedAlloc(size, TensorAlignment));
+  }
+  for (size_t i = 0, e = activations.size(); i < e; i++) {
+    auto *A = activations[i];
+    assert(!tensors_.count(A) && "The activation is already allocated");
+    tensors_[A] = new Tensor(activations_ + addrs[i], A->getType());
+  }
+}
+
+void Interpreter::prepareInstrs() {
+  // The activations live as long as the backend. The views are re-pointed at
+  // their source on every run, because the payloads of the variables may be
+  // rebound between the runs.
+  allocateActivations();
+  for (auto *I : F_->getInstrs()) {
+    if (isa<TensorViewInst>(I)) {
+      assert(!tensors_.count(I) && "The view is already allocated");
+      tensors_[I] = new Tensor();
+    }
+  }
+
+  for (auto *I : F_->getInstrs()) {
+    PreparedInstr P;
+    P.I = I;
+    auto it = tensors_.find(I);
+    if (it != tensors_.end()) {
+      P.tensors.push_back({I, it->second});
+    }
+    for (const auto &op : I->getOperands()) {
+      P.tensors.push_back({op.first, getTensor(op.first)});
+    }
+    instrs_.push_back(std::move(P));
+  }
+
+  // Pair the loop instructions, which are properly nested.
+  std::vector<size_t> loops;
+  for (size_t i = 0, e = instrs_.size(); i < e; i++) {
+    if (isa<LoopStartInst>(instrs_[i].I)) {
+      loops.push_back(i);
+    } else if (isa<LoopEndInst>(instrs_[i].I)) {
+      assert(!loops.empty() && "LoopEnd without a LoopStart");
+      instrs_[i].loopPair = loops.back();
+      instrs_[loops.back()].loopPair = i;
+      loops.pop_back();
+    }
+  }
 }
 
 Tensor *Interpreter::getTensor(const Value *v) const {
+  if (current_) {
+    for (const auto &p : current_->tensors) {
+      if (p.first == v) {
+        return p.second;
+      }
+    }
+  }
+
   auto it = tensors_.find(v);
   if (it != tensors_.end()) {
     return it->second;
@@ -76,35 +178,77 @@ Tensor *Interpreter::getOrCreateTensor(const Value *v) {
   return it->second;
 }
 
-Tensor *Interpreter::getOrCreateUnownedTensor(const Value *v,
-                                              const Value *src) {
-  assert(isa<TensorViewInst>(v) && "Expected a tensor view");
-
-  // Pick the tensor.
-  auto it = tensors_.find(v);
-
-  // Release unowned tensors before re-creating them.
-  if (it != tensors_.end()) {
-    deleteTensor(v);
+bool Interpreter::lowersNode(const Node *N) {
+  // The reference implementations of the LSTM cell step, of the batch
+  // normalization of training and of the weight update are the fused ones.
+  // Grouped convolutions are computed directly instead of being split into
+  // one convolution per group.
+  switch (N->getKind()) {
+  case Kinded::Kind::BatchNormalizationGradNodeKind:
+  case Kinded::Kind::BatchNormalizationNodeKind:
+  case Kinded::Kind::ConvolutionNodeKind:
+  case Kinded::Kind::LSTMUnitNodeKind:
+  case Kinded::Kind::SGDNodeKind:
+    return false;
+  default:
+    return true;
   }
-
-  auto *T = new Tensor();
-  *T = getTensor(src)->getUnowned(v->dims());
-  tensors_[v] = T;
-  return T;
 }
 
-void Interpreter::deleteTensor(const Value *v) {
-  auto it = tensors_.find(v);
-  if (it == tensors_.end()) {
-    return;
+bool Interpreter::supportsOp(Kinded::Kind opKind, ElemKind elementTy) {
+  // Check for float16 support. The computations are performed in float.
+  if (elementTy == ElemKind::Float16Ty) {
+    switch (opKind) {
+    case Kinded::Kind::AddNodeKind:
+    case Kinded::Kind::AddSplatNodeKind:
+    case Kinded::Kind::BatchedAddNodeKind:
+    case Kinded::Kind::BroadcastNodeKind:
+    case Kinded::Kind::ConvertToNodeKind:
+    case Kinded::Kind::ConvolutionNodeKind:
+    case Kinded::Kind::DivNodeKind:
+    case Kinded::Kind::DivSplatLHSNodeKind:
+    case Kinded::Kind::DivSplatRHSNodeKind:
+    case Kinded::Kind::FullyConnectedNodeKind:
+    case Kinded::Kind::GatherNodeKind:
+    case Kinded::Kind::MatMulNodeKind:
+    case Kinded::Kind::MaxNodeKind:
+    case Kinded::Kind::MaxSplatNodeKind:
+    case Kinded::Kind::MinNodeKind:
+    case Kinded::Kind::MinSplatNodeKind:
+    case Kinded::Kind::MulNodeKind:
+    case Kinded::Kind::MulSplatNodeKind:
+    case Kinded::Kind::PoolMaxNodeKind:
+    case Kinded::Kind::ReluNodeKind:
+    case Kinded::Kind::ReshapeNodeKind:
+    case Kinded::Kind::SigmoidNodeKind:
+    case Kinded::Kind::SparseLengthsWeightedSumNodeKind:
+    case Kinded::Kind::SplatNodeKind:
+    case Kinded::Kind::SubNodeKind:
+    case Kinded::Kind::SubSplatLHSNodeKind:
+    case Kinded::Kind::TanhNodeKind:
+    case Kinded::Kind::TransposeNodeKind:
+      return true;
+    default:
+      return false;
+    }
   }
 
-  delete it->second;
-  tensors_.erase(it);
-}
+  // Check for the support of the int16 activations, which are used with the
+  // int8 weights and the int32 accumulators.
+  if (elementTy == ElemKind::Int16QTy) {
+    switch (opKind) {
+    case Kinded::Kind::ConvolutionNodeKind:
+    case Kinded::Kind::DequantizeNodeKind:
+    case Kinded::Kind::FullyConnectedNodeKind:
+    case Kinded::Kind::MatMulNodeKind:
+    case Kinded::Kind::QuantizeNodeKind:
+    case Kinded::Kind::RescaleQuantizedNodeKind:
+      return true;
+    default:
+      return false;
+    }
+  }
 
-bool Interpreter::isOpSupported(Kinded::Kind opKind, ElemKind elementTy) const {
   // Check quantization support.
   if (elementTy == ElemKind::Int8QTy) {
     switch (opKind) {
@@ -112,6 +256,8 @@ bool Interpreter::isOpSupported(Kinded::Kind opKind, ElemKind elementTy) const {
     case Kinded::Kind::BatchedAddNodeKind:
     case Kinded::Kind::BatchedReduceAddNodeKind:
     case Kinded::Kind::BroadcastNodeKind:
+    case Kinded::Kind::ChannelwiseQuantizedConvolutionNodeKind:
+    case Kinded::Kind::ChannelwiseQuantizedFullyConnectedNodeKind:
     case Kinded::Kind::CmpLTENodeKind:
     case Kinded::Kind::ConcatNodeKind:
     case Kinded::Kind::ConvolutionNodeKind:
@@ -129,6 +275,8 @@ bool Interpreter::isOpSupported(Kinded::Kind opKind, ElemKind elementTy) const {
     case Kinded::Kind::ReluNodeKind:
     case Kinded::Kind::RescaleQuantizedNodeKind:
     case Kinded::Kind::ReshapeNodeKind:
+    case Kinded::Kind::RowwiseQuantizedGatherNodeKind:
+    case Kinded::Kind::RowwiseQuantizedSparseLengthsWeightedSumNodeKind:
     case Kinded::Kind::SelectNodeKind:
     case Kinded::Kind::SliceNodeKind:
     case Kinded::Kind::SubNodeKind:
@@ -152,13 +300,22 @@ void Interpreter::doForwardPass() {
     break;                                                                     \
   }
 #define DEF_BACKEND_SPECIFIC_INSTR(CLASS, NAME)
+  bool trace = isTraceEnabled();
   // Dispatch the interpreter on each instruction in the program:
-  for (auto *I : F_->getInstrs()) {
+  for (size_t idx = 0, e = instrs_.size(); idx < e; idx = nextInstr_) {
+    nextInstr_ = idx + 1;
+    current_ = &instrs_[idx];
+    auto *I = current_->I;
+    uint64_t begin = trace ? getTraceTime() : 0;
     switch (I->getKind()) {
 #include "AutoGenInstr.def"
 
     default:
       llvm_unreachable("Invalid instruction.");
     }
+    if (trace) {
+      traceEvent(I->getName(), TraceKernel, begin, getTraceTime());
+    }
   }
+  current_ = nullptr;
 }
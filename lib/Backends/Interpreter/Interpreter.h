@@ -20,12 +20,16 @@
 #include "glow/Base/Tensor.h"
 
 #include "llvm/ADT/ArrayRef.h"
+#include "llvm/ADT/SmallVector.h"
 
 #include <unordered_map>
+#include <utility>
+#include <vector>
 
 namespace glow {
 
 class Context;
+class Instruction;
 class IRFunction;
 class Value;
 class Tensor;
@@ -48,6 +52,30 @@ class Interpreter final : public Backend {
   /// Maps values to Tensors, that are *not* owned by this class.
   std::unordered_map<const Value *, Tensor *> externalTensors_;
 
+  /// The memory of all of the activations, which the activation tensors are
+  /// carved out of.
+  uint8_t *activations_{nullptr};
+
+  /// An instruction together with the tensors of its operands and of its own
+  /// result, which are resolved once by init().
+  struct PreparedInstr {
+    const Instruction *I;
+    llvm::SmallVector<std::pair<const Value *, Tensor *>, 6> tensors;
+    /// The index of the matching LoopEnd of a LoopStart, and of the matching
+    /// LoopStart of a LoopEnd.
+    size_t loopPair{0};
+  };
+
+  /// The instructions of the function, in execution order.
+  std::vector<PreparedInstr> instrs_;
+
+  /// The instruction that the forward pass executes, if any.
+  const PreparedInstr *current_{nullptr};
+
+  /// The index of the instruction that the forward pass executes next. The
+  /// loop instructions jump by setting it.
+  size_t nextInstr_{0};
+
 public:
   /// Ctor.
   explicit Interpreter(IRFunction *F) : F_(F) {}
@@ -63,11 +91,23 @@ public:
 
   void doForwardPass() override;
 
-  bool isOpSupported(Kinded::Kind opKind, ElemKind elementTy) const override;
+  bool isOpSupported(Kinded::Kind opKind, ElemKind elementTy) const override {
+    return supportsOp(opKind, elementTy);
+  }
+
+  bool shouldLower(Node *N) override { return lowersNode(N); }
+  /// @}
+
+  /// The answers of isOpSupported() and shouldLower(), which don't depend on
+  /// a backend object, see glow::isOpSupported() and glow::shouldLower().
+  /// @{
+  static bool supportsOp(Kinded::Kind opKind, ElemKind elementTy);
+  static bool lowersNode(const Node *N);
   /// @}
 
 private:
-  /// \returns a pointer to the tensor that is saved under \p v.
+  /// \returns a pointer to the tensor that is saved under \p v. The operands
+  /// of the executing instruction are found without any hashing.
   Tensor *getTensor(const Value *v) const;
 
   /// Allocate a tensor to back the value \p v. Do not allocate anything if a
@@ -75,13 +115,15 @@ private:
   /// \returns a tensor for \p v.
   Tensor *getOrCreateTensor(const Value *v);
 
-  /// Allocate an unowned tensor to back the value \p v. The source tensor of
-  /// the unowned tensor is provided by \p src.
-  /// \returns a tensor for \p v.
-  Tensor *getOrCreateUnownedTensor(const Value *v, const Value *src);
+  /// Place the activations of the function in a single arena. The
+  /// activations that are not live at the same time share memory, like they
+  /// do in the CPU backend.
+  void allocateActivations();
 
-  /// If a tensor is allocated for \p v then delete it.
-  void deleteTensor(const Value *v);
+  /// Allocate the activations and the tensor views of the function, and
+  /// resolve the tensors of all of the instructions, so that the forward
+  /// passes neither allocate memory nor look up tensors in maps.
+  void prepareInstrs();
 
   /// \returns a typed handle to the tensor that is stored at \p v.
   template <class ElemTy = float>
@@ -100,7 +142,11 @@ private:
 
   void fwdConvolutionInst_I8Impl(Value *inV, Value *outV, Value *filterV,
                                  Value *biasV, size_t filterSize, size_t stride,
-                                 size_t pad);
+                                 size_t pad, size_t group);
+  void fwdConvolutionInst_I16Impl(Value *inV, Value *outV, Value *filterV,
+                                  Value *biasV, size_t filterSize,
+                                  size_t stride, size_t pad, size_t group);
+  template <typename ElemTy>
   void fwdConvolutionInst_FloatImpl(Value *inV, Value *outV, Value *filterV,
                                     Value *biasV, size_t filterSize,
                                     size_t stride, size_t pad, size_t group);
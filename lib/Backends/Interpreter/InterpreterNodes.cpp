@@ -15,6 +15,7 @@
  */
 
 #include "Interpreter.h"
+#include "FastKernels.h"
 
 #include "glow/IR/Instrs.h"
 #include "glow/Quantization/Profile.h"
@@ -24,6 +25,10 @@
 #include "llvm/Support/Casting.h"
 #include "llvm/Support/raw_ostream.h"
 
+#include <cmath>
+#include <cstring>
+#include <limits>
+
 using namespace glow;
 
 //===----------------------------------------------------------------------===//
@@ -36,22 +41,34 @@ void Interpreter::fwdCopyInst(const CopyInst *I) {
   outT->copyRawFrom(inT);
 }
 
-// This is the floating point implementation of Convolution.
+// This is the floating point implementation of Convolution. The sums are
+// computed in float for all of the floating point element types.
+template <typename ElemTy>
 void Interpreter::fwdConvolutionInst_FloatImpl(Value *inV, Value *outV,
                                                Value *filterV, Value *biasV,
                                                size_t filterSize, size_t stride,
                                                size_t pad, size_t group) {
 
-  auto inW = getWeightHandle(inV);
-  auto outW = getWeightHandle(outV);
-  auto filterW = getWeightHandle(filterV);
-  auto biasW = getWeightHandle(biasV);
+  auto inW = getWeightHandle<ElemTy>(inV);
+  auto outW = getWeightHandle<ElemTy>(outV);
+  auto filterW = getWeightHandle<ElemTy>(filterV);
+  auto biasW = getWeightHandle<ElemTy>(biasV);
 
   ShapeNHWC odim(outW.dims());
   ShapeNHWC idim(inW.dims());
 
   assert(idim.c % group == 0 && "Input channels must be divisible by group.");
   assert(odim.c % group == 0 && "Output channels must be divisible by group.");
+
+  if (interpreterFastKernels) {
+    fast::convolution<ElemTy>(
+        getTensor(outV)->getRawDataPointer<ElemTy>(),
+        getTensor(inV)->getRawDataPointer<ElemTy>(),
+        getTensor(filterV)->getRawDataPointer<ElemTy>(),
+        getTensor(biasV)->getRawDataPointer<ElemTy>(), odim, idim, filterSize,
+        stride, pad, group);
+    return;
+  }
   size_t inCperG = idim.c / group;
   size_t outCperG = odim.c / group;
 
@@ -102,7 +119,7 @@ void Interpreter::fwdConvolutionInst_FloatImpl(Value *inV, Value *outV,
 void Interpreter::fwdConvolutionInst_I8Impl(Value *inV, Value *outV,
                                             Value *filterV, Value *biasV,
                                             size_t filterSize, size_t stride,
-                                            size_t pad) {
+                                            size_t pad, size_t group) {
   auto inW = getWeightHandle<int8_t>(inV);
   auto outW = getWeightHandle<int8_t>(outV);
   auto filterW = getWeightHandle<int8_t>(filterV);
@@ -130,57 +147,133 @@ void Interpreter::fwdConvolutionInst_I8Impl(Value *inV, Value *outV,
   // multiplication part of the calculation.
   float matMulScale = inScale * filterScale;
 
-  size_t inChannels = idim.c;
+  size_t inCperG = idim.c / group;
+  size_t outCperG = odim.c / group;
 
   // For each input in the batch:
   for (size_t n = 0; n < idim.n; n++) {
+    // For each group of input channels:
+    for (size_t g = 0; g < group; g++) {
+      // For each output channel in the group:
+      for (size_t d = g * outCperG; d < (g + 1) * outCperG; d++) {
 
-    // For each layer in the output tensor:
-    for (size_t d = 0; d < odim.c; d++) {
-
-      // For each convolution 'jump' in the input tensor:
-      ssize_t x = -ssize_t(pad);
-      for (size_t ax = 0; ax < odim.h; x += stride, ax++) {
-        ssize_t y = -ssize_t(pad);
-        for (size_t ay = 0; ay < odim.w; y += stride, ay++) {
+        // For each convolution 'jump' in the input tensor:
+        ssize_t x = -ssize_t(pad);
+        for (size_t ax = 0; ax < odim.h; x += stride, ax++) {
+          ssize_t y = -ssize_t(pad);
+          for (size_t ay = 0; ay < odim.w; y += stride, ay++) {
 
-          // For each element in the convolution-filter:
-          int32_t sum = 0;
-          for (size_t fx = 0; fx < filterSize; fx++) {
-            for (size_t fy = 0; fy < filterSize; fy++) {
-              ssize_t ox = x + fx;
-              ssize_t oy = y + fy;
+            // For each element in the convolution-filter:
+            int32_t sum = 0;
+            for (size_t fx = 0; fx < filterSize; fx++) {
+              for (size_t fy = 0; fy < filterSize; fy++) {
+                ssize_t ox = x + fx;
+                ssize_t oy = y + fy;
 
-              // Ignore index access below zero (this is due to padding).
-              if (ox < 0 || oy < 0 || ox >= ssize_t(idim.h) ||
-                  oy >= ssize_t(idim.w)) {
-                continue;
-              }
-              for (size_t fd = 0; fd < inChannels; fd++) {
+                // Ignore index access below zero (this is due to padding).
+                if (ox < 0 || oy < 0 || ox >= ssize_t(idim.h) ||
+                    oy >= ssize_t(idim.w)) {
+                  continue;
+                }
+                for (size_t fd = 0; fd < inCperG; fd++) {
 
-                int32_t F = filterW.at({d, fx, fy, fd});
-                int32_t I = inW.at({n, (size_t)ox, (size_t)oy, fd});
-                // We represent the element multiplication with offset as
-                // (value - offset).
-                sum += (F - filterOffset) * (I - inOffset);
+                  int32_t F = filterW.at({d, fx, fy, fd});
+                  int32_t I =
+                      inW.at({n, (size_t)ox, (size_t)oy, g * inCperG + fd});
+                  // We represent the element multiplication with offset as
+                  // (value - offset).
+                  sum += (F - filterOffset) * (I - inOffset);
+                }
               }
             }
-          }
 
-          // Scale the bias to match the scale of the matrix multiplication.
-          int32_t B = std::round(float(biasW.at({d}) - biasOffset) *
-                                 (biasScale / matMulScale));
+            // Scale the bias to match the scale of the matrix multiplication.
+            int32_t B = std::round(float(biasW.at({d}) - biasOffset) *
+                                   (biasScale / matMulScale));
 
-          // Add the bias:
-          sum += B;
+            // Add the bias:
+            sum += B;
 
-          // Scale the result back to the expected destination scale.
-          outW.at({n, ax, ay, d}) = quantization::clip<int32_t, int8_t>(
-              std::round(float(sum) * (matMulScale / outScale) + outOffset));
-        } // W
-      }   // H
-    }     // C
-  }       // N
+            // Scale the result back to the expected destination scale.
+            outW.at({n, ax, ay, d}) = quantization::clip<int32_t, int8_t>(
+                std::round(float(sum) * (matMulScale / outScale) + outOffset));
+          } // W
+        }   // H
+      }     // C
+    }       // G
+  }         // N
+}
+
+// This is the implementation of Convolution with the int16 activations, the
+// int8 filter and the int32 bias, which has the scale of the accumulator.
+void Interpreter::fwdConvolutionInst_I16Impl(Value *inV, Value *outV,
+                                             Value *filterV, Value *biasV,
+                                             size_t filterSize, size_t stride,
+                                             size_t pad, size_t group) {
+  auto inW = getWeightHandle<int16_t>(inV);
+  auto outW = getWeightHandle<int16_t>(outV);
+  auto filterW = getWeightHandle<int8_t>(filterV);
+  auto biasW = getWeightHandle<int32_t>(biasV);
+
+  ShapeNHWC odim(outW.dims());
+  ShapeNHWC idim(inW.dims());
+
+  auto outTy = outV->getType();
+  auto inTy = inV->getType();
+  auto filterTy = filterV->getType();
+
+  int32_t outOffset = outTy->getOffset();
+  int32_t inOffset = inTy->getOffset();
+  int32_t filterOffset = filterTy->getOffset();
+
+  // The scale of the accumulator is the scale of the bias.
+  float matMulScale = inTy->getScale() * filterTy->getScale();
+  float scale = matMulScale / outTy->getScale();
+
+  size_t inCperG = idim.c / group;
+  size_t outCperG = odim.c / group;
+
+  // For each input in the batch:
+  for (size_t n = 0; n < idim.n; n++) {
+    // For each group of input channels:
+    for (size_t g = 0; g < group; g++) {
+      // For each output channel in the group:
+      for (size_t d = g * outCperG; d < (g + 1) * outCperG; d++) {
+        // For each convolution 'jump' in the input tensor:
+        ssize_t x = -ssize_t(pad);
+        for (size_t ax = 0; ax < odim.h; x += stride, ax++) {
+          ssize_t y = -ssize_t(pad);
+          for (size_t ay = 0; ay < odim.w; y += stride, ay++) {
+
+            // For each element in the convolution-filter:
+            int32_t sum = biasW.at({d});
+            for (size_t fx = 0; fx < filterSize; fx++) {
+              for (size_t fy = 0; fy < filterSize; fy++) {
+                ssize_t ox = x + fx;
+                ssize_t oy = y + fy;
+
+                // Ignore index access below zero (this is due to padding).
+                if (ox < 0 || oy < 0 || ox >= ssize_t(idim.h) ||
+                    oy >= ssize_t(idim.w)) {
+                  continue;
+                }
+                for (size_t fd = 0; fd < inCperG; fd++) {
+                  int32_t F = filterW.at({d, fx, fy, fd});
+                  int32_t In =
+                      inW.at({n, (size_t)ox, (size_t)oy, g * inCperG + fd});
+                  sum += (F - filterOffset) * (In - inOffset);
+                }
+              }
+            }
+
+            // Scale the result back to the expected destination scale.
+            outW.at({n, ax, ay, d}) = quantization::clip<int32_t, int16_t>(
+                std::round(float(sum) * scale + outOffset));
+          } // W
+        }   // H
+      }     // C
+    }       // G
+  }         // N
 }
 
 void Interpreter::fwdConvolutionInst(const ConvolutionInst *I) {
@@ -189,14 +282,104 @@ void Interpreter::fwdConvolutionInst(const ConvolutionInst *I) {
   size_t stride = I->getStride();
   size_t group = I->getGroup();
 
+  if (I->getSrc()->getElementType() == ElemKind::Int16QTy) {
+    fwdConvolutionInst_I16Impl(I->getSrc(), I->getDest(), I->getFilter(),
+                               I->getBias(), filterSize, stride, pad, group);
+    return;
+  }
+
   if (I->getSrc()->getType()->isQuantizedType()) {
     fwdConvolutionInst_I8Impl(I->getSrc(), I->getDest(), I->getFilter(),
-                              I->getBias(), filterSize, stride, pad);
+                              I->getBias(), filterSize, stride, pad, group);
     return;
   }
 
-  fwdConvolutionInst_FloatImpl(I->getSrc(), I->getDest(), I->getFilter(),
-                               I->getBias(), filterSize, stride, pad, group);
+  if (I->getSrc()->getElementType() == ElemKind::Float16Ty) {
+    fwdConvolutionInst_FloatImpl<float16>(I->getSrc(), I->getDest(),
+                                          I->getFilter(), I->getBias(),
+                                          filterSize, stride, pad, group);
+    return;
+  }
+
+  fwdConvolutionInst_FloatImpl<float>(I->getSrc(), I->getDest(),
+                                      I->getFilter(), I->getBias(), filterSize,
+                                      stride, pad, group);
+}
+
+void Interpreter::fwdChannelwiseQuantizedConvolutionInst(
+    const ChannelwiseQuantizedConvolutionInst *I) {
+  auto inW = getWeightHandle<int8_t>(I->getSrc());
+  auto outW = getWeightHandle<int8_t>(I->getDest());
+  auto filterW = getWeightHandle<int8_t>(I->getFilter());
+  auto biasW = getWeightHandle<int32_t>(I->getBias());
+  auto scalesW = getWeightHandle<float>(I->getFilterScales());
+  auto offsetsW = getWeightHandle<int32_t>(I->getFilterOffsets());
+
+  size_t filterSize = I->getKernel();
+  size_t pad = I->getPad();
+  size_t stride = I->getStride();
+  size_t group = I->getGroup();
+
+  ShapeNHWC odim(outW.dims());
+  ShapeNHWC idim(inW.dims());
+  size_t inCperG = idim.c / group;
+  size_t outCperG = odim.c / group;
+
+  auto *outTy = I->getDest()->getType();
+  auto *inTy = I->getSrc()->getType();
+  int32_t outOffset = outTy->getOffset();
+  int32_t inOffset = inTy->getOffset();
+  float outScale = outTy->getScale();
+  float inScale = inTy->getScale();
+
+  // For each input in the batch:
+  for (size_t n = 0; n < idim.n; n++) {
+
+    // For each group of input channels:
+    for (size_t g = 0; g < group; g++) {
+
+      // For each output channel in the group:
+      for (size_t d = g * outCperG; d < (g + 1) * outCperG; d++) {
+        int32_t filterOffset = offsetsW.at({d});
+        // The scale of the values that come out of the matrix multiplication
+        // part of the calculation, relative to the destination scale.
+        float matMulScale = inScale * scalesW.at({d}) / outScale;
+
+        // For each convolution 'jump' in the input tensor:
+        ssize_t x = -ssize_t(pad);
+        for (size_t ax = 0; ax < odim.h; x += stride, ax++) {
+          ssize_t y = -ssize_t(pad);
+          for (size_t ay = 0; ay < odim.w; y += stride, ay++) {
+
+            // The bias has the scale of the matrix multiplication.
+            int32_t sum = biasW.at({d});
+            for (size_t fx = 0; fx < filterSize; fx++) {
+              for (size_t fy = 0; fy < filterSize; fy++) {
+                ssize_t ox = x + fx;
+                ssize_t oy = y + fy;
+
+                // Ignore index access below zero (this is due to padding).
+                if (ox < 0 || oy < 0 || ox >= ssize_t(idim.h) ||
+                    oy >= ssize_t(idim.w)) {
+                  continue;
+                }
+                for (size_t fd = 0; fd < inCperG; fd++) {
+                  int32_t F = filterW.at({d, fx, fy, fd});
+                  int32_t In =
+                      inW.at({n, (size_t)ox, (size_t)oy, g * inCperG + fd});
+                  sum += (F - filterOffset) * (In - inOffset);
+                }
+              }
+            }
+
+            // Scale the result back to the expected destination scale.
+            outW.at({n, ax, ay, d}) = quantization::clip<int32_t, int8_t>(
+                std::round(float(sum) * matMulScale + outOffset));
+          } // W
+        }   // H
+      }     // C
+    }       // G
+  }         // N
 }
 
 void Interpreter::fwdConvolutionGradInst(const ConvolutionGradInst *I) {
@@ -272,6 +455,12 @@ static void fwdPoolMax(Tensor *inW, Tensor *outW, Handle<size_t> *SXY,
   Handle<T> inHandle = inW->getHandle<T>();
   Handle<T> outHandle = outW->getHandle<T>();
 
+  if (interpreterFastKernels && !SXY) {
+    fast::poolMax<T>(outW->getRawDataPointer<T>(), inW->getRawDataPointer<T>(),
+                     odim, idim, filterSize, stride, pad);
+    return;
+  }
+
   // For each input in the batch:
   for (size_t n = 0; n < odim.n; n++) {
 
@@ -329,6 +518,9 @@ void Interpreter::fwdPoolMaxInst(const PoolMaxInst *I) {
   if (inW->getType().isQuantizedType()) {
     fwdPoolMax<int8_t>(inW, outW, nullptr, I->getKernel(), I->getStride(),
                        I->getPad());
+  } else if (inW->getElementType() == ElemKind::Float16Ty) {
+    fwdPoolMax<float16>(inW, outW, nullptr, I->getKernel(), I->getStride(),
+                        I->getPad());
   } else {
     fwdPoolMax<float>(inW, outW, nullptr, I->getKernel(), I->getStride(),
                       I->getPad());
@@ -406,6 +598,13 @@ void Interpreter::fwdPoolAvgInst(const PoolAvgInst *I) {
     return;
   }
 
+  if (interpreterFastKernels) {
+    fast::poolAvg(getTensor(I->getDest())->getRawDataPointer<float>(),
+                  getTensor(I->getSrc())->getRawDataPointer<float>(), odim,
+                  idim, filterSize, stride, pad);
+    return;
+  }
+
   auto inW = getWeightHandle(I->getSrc());
   auto outW = getWeightHandle(I->getDest());
 
@@ -526,23 +725,60 @@ void Interpreter::fwdPoolAvgGradInst(const PoolAvgGradInst *I) {
 //                       Activation functions
 //===----------------------------------------------------------------------===//
 
-void Interpreter::fwdSigmoidInst(const SigmoidInst *I) {
-  auto inW = getWeightHandle(I->getSrc());
-  auto outW = getWeightHandle(I->getDest());
+/// Store \p op of the elements of the tensor \p in of the floating point type
+/// \p ElemTy into the tensor \p out. \p op computes in float.
+template <class ElemTy, class Op>
+static void fwdFloatUnaryOpImpl(Tensor *out, Tensor *in, Op op) {
+  if (interpreterFastKernels) {
+    return fast::unaryOp(out->getRawDataPointer<ElemTy>(),
+                         in->getRawDataPointer<ElemTy>(), out->size(), op);
+  }
+  auto inW = in->getHandle<ElemTy>();
+  auto outW = out->getHandle<ElemTy>();
 
   for (size_t i = 0, e = outW.size(); i < e; i++) {
-    float val = inW.raw(i);
-    outW.raw(i) = 1 / (1 + std::exp(-val));
+    outW.raw(i) = op(float(inW.raw(i)));
   }
 }
 
+/// Store \p op of the elements of the floating point tensor \p in into \p
+/// out, for all of the floating point element types.
+template <class Op>
+static void fwdFloatUnaryOp(Tensor *out, Tensor *in, Op op) {
+  if (in->getElementType() == ElemKind::Float16Ty) {
+    return fwdFloatUnaryOpImpl<float16>(out, in, op);
+  }
+  fwdFloatUnaryOpImpl<float>(out, in, op);
+}
+
+void Interpreter::fwdSigmoidInst(const SigmoidInst *I) {
+  fwdFloatUnaryOp(getTensor(I->getDest()), getTensor(I->getSrc()),
+                  [](float val) { return 1 / (1 + std::exp(-val)); });
+}
+
 void Interpreter::fwdTanhInst(const TanhInst *I) {
-  auto inW = getWeightHandle(I->getSrc());
-  auto outW = getWeightHandle(I->getDest());
+  fwdFloatUnaryOp(getTensor(I->getDest()), getTensor(I->getSrc()),
+                  [](float val) { return std::tanh(val); });
+}
 
-  for (size_t i = 0, e = inW.size(); i < e; i++) {
-    float val = inW.raw(i);
-    outW.raw(i) = std::tanh(val);
+void Interpreter::fwdLSTMUnitInst(const LSTMUnitInst *I) {
+  auto gatesW = getWeightHandle(I->getInput());
+  auto cW = getWeightHandle(I->getC());
+  auto newCW = getWeightHandle(I->getNewC());
+  auto newHW = getWeightHandle(I->getNewH());
+  size_t hidden = cW.dims()[1];
+
+  auto sigmoid = [](float val) { return 1 / (1 + std::exp(-val)); };
+  for (size_t n = 0, e = cW.dims()[0]; n < e; n++) {
+    for (size_t j = 0; j < hidden; j++) {
+      float f = sigmoid(gatesW.at({n, j}));
+      float i = sigmoid(gatesW.at({n, hidden + j}));
+      float o = sigmoid(gatesW.at({n, 2 * hidden + j}));
+      float g = std::tanh(gatesW.at({n, 3 * hidden + j}));
+      float c = f * cW.at({n, j}) + i * g;
+      newCW.at({n, j}) = c;
+      newHW.at({n, j}) = o * std::tanh(c);
+    }
   }
 }
 
@@ -555,6 +791,13 @@ void Interpreter::fwdSoftMaxInst(const SoftMaxInst *I) {
   auto outW = getWeightHandle(I->getDest());
   auto idim = inW.dims();
 
+  if (interpreterFastKernels) {
+    fast::softMax(getTensor(I->getDest())->getRawDataPointer<float>(),
+                  getTensor(I->getSrc())->getRawDataPointer<float>(), idim[0],
+                  idim[1]);
+    return;
+  }
+
   for (size_t n = 0; n < idim[0]; n++) {
     // Find Max.
     float max = inW.at({n, 0});
@@ -647,7 +890,9 @@ void Interpreter::fwdBroadcastInst(const BroadcastInst *I) {
 }
 
 void Interpreter::fwdTensorViewInst(const TensorViewInst *I) {
-  getOrCreateUnownedTensor(I, I->getSrc());
+  // Re-point the view at its source. This does not allocate any memory.
+  *getTensor(I) =
+      getTensor(I->getSrc())->getUnowned(I->dims(), I->getOffsets());
 }
 
 void Interpreter::fwdSplatInst(const glow::SplatInst *I) {
@@ -662,6 +907,10 @@ void Interpreter::fwdSplatInst(const glow::SplatInst *I) {
     return T->getHandle<float>().clear(I->getValue());
   }
 
+  if (k == ElemKind::Float16Ty) {
+    return T->getHandle<float16>().clear(I->getValue());
+  }
+
   if (k == ElemKind::Int8QTy) {
     // Quantize the requested floating point splat value into the correct
     // integer representation.
@@ -720,8 +969,10 @@ void Interpreter::fwdGatherInst(const glow::GatherInst *I) {
   size_t out_p = 0;
   size_t dataSliceSize =
       dataT->size() / dataT->dims()[0] * dataT->getType().getElementSize();
+  bool idx32 = indicesT->getElementType() == ElemKind::Int32ITy;
   for (size_t i = 0, end = indicesT->size(); i < end; i++) {
-    size_t slice = indicesT->getHandle<size_t>().raw(i);
+    size_t slice = idx32 ? indicesT->getHandle<int32_t>().raw(i)
+                         : indicesT->getHandle<size_t>().raw(i);
     std::copy(&dataT->getUnsafePtr()[dataSliceSize * slice],
               &dataT->getUnsafePtr()[dataSliceSize * (slice + 1)],
               &outT->getUnsafePtr()[out_p]);
@@ -729,6 +980,103 @@ void Interpreter::fwdGatherInst(const glow::GatherInst *I) {
   }
 }
 
+/// Sums the slices of \p dataT gathered at \p indicesT and scaled by \p
+/// weightsT into the segments of \p lengthsT slices of \p destT, of the
+/// floating point type \p ElemTy. Every segment is accumulated in float.
+template <class ElemTy>
+static void fwdSparseLengthsWeightedSum(Tensor *destT, Tensor *dataT,
+                                        Tensor *weightsT, Tensor *indicesT,
+                                        Tensor *lengthsT) {
+  auto data = dataT->getHandle<ElemTy>();
+  auto weights = weightsT->getHandle<ElemTy>();
+  auto indices = indicesT->getHandle<size_t>();
+  auto lengths = lengthsT->getHandle<size_t>();
+  auto dest = destT->getHandle<ElemTy>();
+
+  size_t lineSize = data.size() / data.dims()[0];
+  std::vector<float> sum(lineSize);
+
+  size_t curIndex = 0;
+  for (size_t i = 0, e = lengths.size(); i < e; i++) {
+    std::fill(sum.begin(), sum.end(), 0);
+    for (size_t j = 0, n = lengths.raw(i); j < n; j++, curIndex++) {
+      size_t base = indices.raw(curIndex) * lineSize;
+      float weight = weights.raw(curIndex);
+      for (size_t k = 0; k < lineSize; k++) {
+        sum[k] += weight * float(data.raw(base + k));
+      }
+    }
+    for (size_t k = 0; k < lineSize; k++) {
+      dest.raw(i * lineSize + k) = sum[k];
+    }
+  }
+  assert(curIndex == indices.size() && "The lengths must cover the indices");
+}
+
+void Interpreter::fwdSparseLengthsWeightedSumInst(
+    const glow::SparseLengthsWeightedSumInst *I) {
+  if (I->getData()->getElementType() == ElemKind::Float16Ty) {
+    fwdSparseLengthsWeightedSum<float16>(
+        getTensor(I->getDest()), getTensor(I->getData()),
+        getTensor(I->getWeights()), getTensor(I->getIndices()),
+        getTensor(I->getLengths()));
+    return;
+  }
+
+  fwdSparseLengthsWeightedSum<float>(
+      getTensor(I->getDest()), getTensor(I->getData()),
+      getTensor(I->getWeights()), getTensor(I->getIndices()),
+      getTensor(I->getLengths()));
+}
+
+void Interpreter::fwdRowwiseQuantizedSparseLengthsWeightedSumInst(
+    const glow::RowwiseQuantizedSparseLengthsWeightedSumInst *I) {
+  auto data = getWeightHandle<int8_t>(I->getData());
+  auto scales = getWeightHandle<float>(I->getScales());
+  auto offsets = getWeightHandle<int32_t>(I->getOffsets());
+  auto weights = getWeightHandle<float>(I->getWeights());
+  auto indices = getWeightHandle<size_t>(I->getIndices());
+  auto lengths = getWeightHandle<size_t>(I->getLengths());
+  auto dest = getWeightHandle<float>(I->getDest());
+
+  size_t lineSize = data.dims()[1];
+  dest.clear(0);
+
+  // Dequantize the gathered rows with their own scale and offset.
+  size_t curIndex = 0;
+  for (size_t i = 0, e = lengths.size(); i < e; i++) {
+    for (size_t j = 0, n = lengths.raw(i); j < n; j++, curIndex++) {
+      size_t row = indices.raw(curIndex);
+      TensorQuantizationParams TQP = {scales.raw(row), offsets.raw(row)};
+      float weight = weights.raw(curIndex);
+      for (size_t k = 0; k < lineSize; k++) {
+        dest.at({i, k}) +=
+            weight * quantization::dequantize(data.at({row, k}), TQP);
+      }
+    }
+  }
+  assert(curIndex == indices.size() && "The lengths must cover the indices");
+}
+
+void Interpreter::fwdRowwiseQuantizedGatherInst(
+    const glow::RowwiseQuantizedGatherInst *I) {
+  auto data = getWeightHandle<int8_t>(I->getData());
+  auto scales = getWeightHandle<float>(I->getScales());
+  auto offsets = getWeightHandle<int32_t>(I->getOffsets());
+  auto indices = getWeightHandle<size_t>(I->getIndices());
+  auto dest = getWeightHandle<float>(I->getDest());
+
+  size_t lineSize = data.dims()[1];
+  for (size_t i = 0, e = indices.size(); i < e; i++) {
+    size_t row = indices.raw(i);
+    TensorQuantizationParams TQP = {scales.raw(row), offsets.raw(row)};
+    for (size_t k = 0; k < lineSize; k++) {
+      dest.raw(i * lineSize + k) =
+          quantization::dequantize(data.at({row, k}), TQP);
+    }
+  }
+}
+
 //===----------------------------------------------------------------------===//
 //                      Local Response Normalization
 //===----------------------------------------------------------------------===//
@@ -766,21 +1114,36 @@ void Interpreter::fwdLocalResponseNormalizationInst(
       // For every column:
       for (size_t w = 0; w < idim.w; w++) {
 
-        // For every channel:
+        // Compute the squared sum of the window of the first channel,
+        // without its last element, which is added below.
+        float squareSum = 0.0;
+        for (size_t c = 0; c < halfWindowSize && c < idim.c; c++) {
+          auto val = inW.at({n, h, w, c});
+          squareSum += val * val;
+        }
+
+        // For every channel, slide the window by one channel:
         for (size_t c = 0; c < idim.c; c++) {
-          float squareSum = 0.0;
-          for (size_t i = (c >= halfWindowSize ? c - halfWindowSize : 0);
-               i <= std::min(c + halfWindowSize, idim.c - 1); i++) {
-            auto val = inW.at({n, h, w, i});
+          if (c + halfWindowSize < idim.c) {
+            auto val = inW.at({n, h, w, c + halfWindowSize});
             squareSum += val * val;
           }
+          if (c > halfWindowSize) {
+            auto val = inW.at({n, h, w, c - halfWindowSize - 1});
+            squareSum -= val * val;
+          }
 
-          auto scale = k + normedAlpha * squareSum;
+          // The subtractions may leave a tiny negative rounding error.
+          auto scale = k + normedAlpha * std::max(squareSum, 0.0f);
 
           // This will be used to accelerate the backward pass.
           scaleCache.at({n, h, w, c}) = scale;
+        }
 
-          auto normFactor = std::pow(scale, -beta);
+        // The output may alias the input, so it is written after the
+        // windows of the pixel have been read.
+        for (size_t c = 0; c < idim.c; c++) {
+          auto normFactor = std::pow(scaleCache.at({n, h, w, c}), -beta);
           outW.at({n, h, w, c}) = inW.at({n, h, w, c}) * normFactor;
         }
       }
@@ -858,10 +1221,146 @@ void Interpreter::fwdLocalResponseNormalizationGradInst(
   }
 }
 
+//===----------------------------------------------------------------------===//
+//                      Batch Normalization
+//===----------------------------------------------------------------------===//
+
+/// Calls \p fn with the index and the channel of every element of a tensor
+/// of the dimensions \p dims, whose channels are the dimension \p channelIdx.
+template <typename Fn>
+static void forEachInChannels(llvm::ArrayRef<size_t> dims, size_t channelIdx,
+                              Fn fn) {
+  size_t outer = 1, inner = 1;
+  for (size_t i = 0; i < channelIdx; i++) {
+    outer *= dims[i];
+  }
+  for (size_t i = channelIdx + 1; i < dims.size(); i++) {
+    inner *= dims[i];
+  }
+  size_t idx = 0;
+  for (size_t o = 0; o < outer; o++) {
+    for (size_t c = 0, e = dims[channelIdx]; c < e; c++) {
+      for (size_t i = 0; i < inner; i++) {
+        fn(idx++, c);
+      }
+    }
+  }
+}
+
+void Interpreter::fwdBatchNormalizationInst(const BatchNormalizationInst *I) {
+  auto src = getWeightHandle(I->getSrc());
+  auto dest = getWeightHandle(I->getDest());
+  auto scale = getWeightHandle(I->getScale());
+  auto bias = getWeightHandle(I->getBias());
+  auto mean = getWeightHandle(I->getMean());
+  auto var = getWeightHandle(I->getVar());
+  size_t channelIdx = I->getChannelIdx();
+  float momentum = I->getMomentum();
+  size_t numChannels = src.dims()[channelIdx];
+  double samples = src.size() / numChannels;
+
+  // Accumulate the sums and the sums of the squares of the channels.
+  std::vector<double> sum(numChannels), sumSq(numChannels);
+  forEachInChannels(src.dims(), channelIdx, [&](size_t idx, size_t c) {
+    double x = src.raw(idx);
+    sum[c] += x;
+    sumSq[c] += x * x;
+  });
+
+  // Blend the statistics of the batch into the running ones, which then
+  // normalize the input: out = (in - mean) * scale / sqrt(var + eps) + bias.
+  std::vector<float> coef(numChannels), offset(numChannels);
+  for (size_t c = 0; c < numChannels; c++) {
+    double localMean = sum[c] / samples;
+    double localVar = std::max(sumSq[c] / samples - localMean * localMean, 0.);
+    float m = momentum * localMean + (1 - momentum) * mean.raw(c);
+    float v = momentum * localVar + (1 - momentum) * var.raw(c);
+    mean.raw(c) = m;
+    var.raw(c) = v;
+    coef[c] = scale.raw(c) / std::sqrt(v + I->getEpsilon());
+    offset[c] = bias.raw(c) - m * coef[c];
+  }
+
+  forEachInChannels(src.dims(), channelIdx, [&](size_t idx, size_t c) {
+    dest.raw(idx) = src.raw(idx) * coef[c] + offset[c];
+  });
+}
+
+void Interpreter::fwdBatchNormalizationGradInst(
+    const BatchNormalizationGradInst *I) {
+  auto src = getWeightHandle(I->getSrc());
+  auto destG = getWeightHandle(I->getDestGrad());
+  auto srcG = getWeightHandle(I->getSrcGrad());
+  auto scaleG = getWeightHandle(I->getScaleGrad());
+  auto biasG = getWeightHandle(I->getBiasGrad());
+  auto scale = getWeightHandle(I->getScale());
+  auto mean = getWeightHandle(I->getMean());
+  auto var = getWeightHandle(I->getVar());
+  size_t channelIdx = I->getChannelIdx();
+  size_t numChannels = src.dims()[channelIdx];
+  float samples = src.size() / numChannels;
+
+  // Accumulate sum(dy) and sum(dy * (x - mu)) of the channels.
+  std::vector<double> sumDy(numChannels), sumDyhmu(numChannels);
+  forEachInChannels(src.dims(), channelIdx, [&](size_t idx, size_t c) {
+    sumDy[c] += destG.raw(idx);
+    sumDyhmu[c] += destG.raw(idx) * (src.raw(idx) - mean.raw(c));
+  });
+
+  // dbeta = sum(dy)
+  // dgamma = sum(dy * (x - mu)) / sqrt(var + eps)
+  // dx = gamma / sqrt(var + eps) / N *
+  //      (N * dy - sum(dy) - (x - mu) / (var + eps) * sum(dy * (x - mu)))
+  std::vector<float> coef1(numChannels), coef2(numChannels);
+  for (size_t c = 0; c < numChannels; c++) {
+    float invVar = 1 / (var.raw(c) + I->getEpsilon());
+    float invVarSqrt = std::sqrt(invVar);
+    biasG.raw(c) = sumDy[c];
+    scaleG.raw(c) = sumDyhmu[c] * invVarSqrt;
+    coef1[c] = scale.raw(c) * invVarSqrt / samples;
+    coef2[c] = invVar * sumDyhmu[c];
+  }
+
+  forEachInChannels(src.dims(), channelIdx, [&](size_t idx, size_t c) {
+    float hmu = src.raw(idx) - mean.raw(c);
+    srcG.raw(idx) =
+        coef1[c] * (samples * destG.raw(idx) - biasG.raw(c) - hmu * coef2[c]);
+  });
+}
+
 //===----------------------------------------------------------------------===//
 //                       Arithmetic operations
 //===----------------------------------------------------------------------===//
 
+/// Store \p op of the elements of the tensors \p lhs and \p rhs of the
+/// floating point type \p ElemTy into the tensor \p out. \p op computes in
+/// float.
+template <class ElemTy, class Op>
+static void fwdFloatBinaryOpImpl(Tensor *out, Tensor *lhs, Tensor *rhs,
+                                 Op op) {
+  if (interpreterFastKernels) {
+    return fast::binaryOp(out->getRawDataPointer<ElemTy>(),
+                          lhs->getRawDataPointer<ElemTy>(),
+                          rhs->getRawDataPointer<ElemTy>(), out->size(), op);
+  }
+  auto outW = out->getHandle<ElemTy>();
+  auto lhsW = lhs->getHandle<ElemTy>();
+  auto rhsW = rhs->getHandle<ElemTy>();
+  for (size_t i = 0, e = outW.size(); i < e; i++) {
+    outW.raw(i) = op(float(lhsW.raw(i)), float(rhsW.raw(i)));
+  }
+}
+
+/// Store \p op of the elements of the floating point tensors \p lhs and \p
+/// rhs into \p out, for all of the floating point element types.
+template <class Op>
+static void fwdFloatBinaryOp(Tensor *out, Tensor *lhs, Tensor *rhs, Op op) {
+  if (lhs->getElementType() == ElemKind::Float16Ty) {
+    return fwdFloatBinaryOpImpl<float16>(out, lhs, rhs, op);
+  }
+  fwdFloatBinaryOpImpl<float>(out, lhs, rhs, op);
+}
+
 void Interpreter::fwdElementAddInst(const ElementAddInst *I) {
   if (getTensor(I->getLHS())->getType().isQuantizedType()) {
     auto lhsTy = I->getLHS()->getType();
@@ -895,12 +1394,9 @@ void Interpreter::fwdElementAddInst(const ElementAddInst *I) {
     return;
   }
 
-  auto outW = getWeightHandle(I->getDest());
-  auto lhsW = getWeightHandle(I->getLHS());
-  auto rhsW = getWeightHandle(I->getRHS());
-  for (size_t i = 0, e = outW.size(); i < e; i++) {
-    outW.raw(i) = lhsW.raw(i) + rhsW.raw(i);
-  }
+  fwdFloatBinaryOp(getTensor(I->getDest()), getTensor(I->getLHS()),
+                   getTensor(I->getRHS()),
+                   [](float l, float r) { return l + r; });
 }
 
 void Interpreter::fwdElementSubInst(const ElementSubInst *I) {
@@ -931,12 +1427,9 @@ void Interpreter::fwdElementSubInst(const ElementSubInst *I) {
     return;
   }
 
-  auto outW = getWeightHandle(I->getDest());
-  auto lhsW = getWeightHandle(I->getLHS());
-  auto rhsW = getWeightHandle(I->getRHS());
-  for (size_t i = 0, e = outW.size(); i < e; i++) {
-    outW.raw(i) = lhsW.raw(i) - rhsW.raw(i);
-  }
+  fwdFloatBinaryOp(getTensor(I->getDest()), getTensor(I->getLHS()),
+                   getTensor(I->getRHS()),
+                   [](float l, float r) { return l - r; });
 }
 
 void Interpreter::fwdElementMulInst(const ElementMulInst *I) {
@@ -961,12 +1454,9 @@ void Interpreter::fwdElementMulInst(const ElementMulInst *I) {
     return;
   }
 
-  auto outW = getWeightHandle(I->getDest());
-  auto lhsW = getWeightHandle(I->getLHS());
-  auto rhsW = getWeightHandle(I->getRHS());
-  for (size_t i = 0, e = outW.size(); i < e; i++) {
-    outW.raw(i) = lhsW.raw(i) * rhsW.raw(i);
-  }
+  fwdFloatBinaryOp(getTensor(I->getDest()), getTensor(I->getLHS()),
+                   getTensor(I->getRHS()),
+                   [](float l, float r) { return l * r; });
 }
 
 void Interpreter::fwdElementDivInst(const ElementDivInst *I) {
@@ -997,12 +1487,9 @@ void Interpreter::fwdElementDivInst(const ElementDivInst *I) {
     return;
   }
 
-  auto outW = getWeightHandle(I->getDest());
-  auto lhsW = getWeightHandle(I->getLHS());
-  auto rhsW = getWeightHandle(I->getRHS());
-  for (size_t i = 0, e = outW.size(); i < e; i++) {
-    outW.raw(i) = lhsW.raw(i) / rhsW.raw(i);
-  }
+  fwdFloatBinaryOp(getTensor(I->getDest()), getTensor(I->getLHS()),
+                   getTensor(I->getRHS()),
+                   [](float l, float r) { return l / r; });
 }
 
 void Interpreter::fwdElementMaxInst(const ElementMaxInst *I) {
@@ -1030,15 +1517,9 @@ void Interpreter::fwdElementMaxInst(const ElementMaxInst *I) {
     return;
   }
 
-  auto *lhs = getTensor(I->getLHS());
-  auto *rhs = getTensor(I->getRHS());
-  auto *out = getTensor(I->getDest());
-  auto outW = out->getHandle();
-  auto lhsW = lhs->getHandle();
-  auto rhsW = rhs->getHandle();
-  for (size_t i = 0, e = outW.size(); i < e; i++) {
-    outW.raw(i) = std::max(lhsW.raw(i), rhsW.raw(i));
-  }
+  fwdFloatBinaryOp(getTensor(I->getDest()), getTensor(I->getLHS()),
+                   getTensor(I->getRHS()),
+                   [](float l, float r) { return std::max(l, r); });
 }
 
 void Interpreter::fwdElementMinInst(const ElementMinInst *I) {
@@ -1066,12 +1547,9 @@ void Interpreter::fwdElementMinInst(const ElementMinInst *I) {
     return;
   }
 
-  auto outW = getWeightHandle(I->getDest());
-  auto lhsW = getWeightHandle(I->getLHS());
-  auto rhsW = getWeightHandle(I->getRHS());
-  for (size_t i = 0, e = outW.size(); i < e; i++) {
-    outW.raw(i) = std::min(lhsW.raw(i), rhsW.raw(i));
-  }
+  fwdFloatBinaryOp(getTensor(I->getDest()), getTensor(I->getLHS()),
+                   getTensor(I->getRHS()),
+                   [](float l, float r) { return std::min(l, r); });
 }
 
 // For both quantized and non-quantized CmpLTE, we set the result to 1.0/0.0.
@@ -1152,7 +1630,110 @@ void Interpreter::fwdElementSelectInst(const glow::ElementSelectInst *I) {
   }
 }
 
+#define SPLAT_OPERAND_INST(INST_NAME_, EXPR_)                                  \
+  void Interpreter::fwd##INST_NAME_##Inst(const INST_NAME_##Inst *I) {         \
+    float v = I->getSplatValue();                                              \
+    fwdFloatUnaryOp(getTensor(I->getDest()), getTensor(I->getSrc()),           \
+                    [=](float x) { return EXPR_; });                           \
+  }
+SPLAT_OPERAND_INST(ElementAddSplat, x + v)
+SPLAT_OPERAND_INST(ElementMulSplat, x * v)
+SPLAT_OPERAND_INST(ElementMaxSplat, std::max(x, v))
+SPLAT_OPERAND_INST(ElementMinSplat, std::min(x, v))
+SPLAT_OPERAND_INST(ElementSubSplatLHS, v - x)
+SPLAT_OPERAND_INST(ElementDivSplatLHS, v / x)
+SPLAT_OPERAND_INST(ElementDivSplatRHS, x / v)
+SPLAT_OPERAND_INST(ElementCmpLTESplatLHS, v <= x ? 1.0f : 0.0f)
+SPLAT_OPERAND_INST(ElementCmpLTESplatRHS, x <= v ? 1.0f : 0.0f)
+#undef SPLAT_OPERAND_INST
+
+void Interpreter::fwdElementSelectSplatLHSInst(
+    const glow::ElementSelectSplatLHSInst *I) {
+  float v = I->getSplatValue();
+  fwdFloatBinaryOp(getTensor(I->getDest()), getTensor(I->getCond()),
+                   getTensor(I->getSrc()),
+                   [=](float c, float x) { return c != 0 ? v : x; });
+}
+
+void Interpreter::fwdElementSelectSplatRHSInst(
+    const glow::ElementSelectSplatRHSInst *I) {
+  float v = I->getSplatValue();
+  fwdFloatBinaryOp(getTensor(I->getDest()), getTensor(I->getCond()),
+                   getTensor(I->getSrc()),
+                   [=](float c, float x) { return c != 0 ? x : v; });
+}
+
+/// Store the product of the matrices \p lhs and \p rhs of the floating point
+/// type \p ElemTy into \p dest. The sums are computed in float. If
+/// \p transposeLHS or \p transposeRHS is set then the operand is read
+/// transposed.
+template <class ElemTy>
+static void fwdMatMul(Tensor *destT, Tensor *lhsT, Tensor *rhsT,
+                      bool transposeLHS, bool transposeRHS) {
+  auto lhs = lhsT->getHandle<ElemTy>();
+  auto rhs = rhsT->getHandle<ElemTy>();
+  auto dest = destT->getHandle<ElemTy>();
+
+  auto destDim = dest.dims();
+  auto lhsDim = lhs.dims();
+  size_t K = lhsDim[transposeLHS ? 0 : 1];
+
+  if (interpreterFastKernels && !transposeLHS && !transposeRHS) {
+    fast::matMul<ElemTy>(destT->getRawDataPointer<ElemTy>(),
+                         lhsT->getRawDataPointer<ElemTy>(),
+                         rhsT->getRawDataPointer<ElemTy>(), destDim[0],
+                         destDim[1], lhsDim[1]);
+    return;
+  }
+
+  dest.clear(0);
+
+  // For each (x,y) in the destination matrix:
+  for (size_t x = 0; x < destDim[0]; x++) {
+    for (size_t y = 0; y < destDim[1]; y++) {
+
+      // Perform DOT on the row an column.
+      float sum = 0;
+      for (size_t i = 0; i < K; i++) {
+        float L = transposeLHS ? lhs.at({i, x}) : lhs.at({x, i});
+        float R = transposeRHS ? rhs.at({y, i}) : rhs.at({i, y});
+        sum += L * R;
+      }
+      dest.at({x, y}) = sum;
+    }
+  }
+}
+
 void Interpreter::fwdMatMulInst(const glow::MatMulInst *I) {
+  if (I->getLHS()->getElementType() == ElemKind::Int16QTy) {
+    // Multiply the int16 activations by the int8 rhs into the int32
+    // accumulator, which has the product of their scales and no offset.
+    auto lhs = getWeightHandle<int16_t>(I->getLHS());
+    auto rhs = getWeightHandle<int8_t>(I->getRHS());
+    auto dest = getWeightHandle<int32_t>(I->getDest());
+    assert(I->getDest()->getType()->getOffset() == 0 &&
+           "The accumulator has no offset");
+
+    int32_t lhsOffset = I->getLHS()->getType()->getOffset();
+    int32_t rhsOffset = I->getRHS()->getType()->getOffset();
+    auto destDim = dest.dims();
+    auto lhsDim = lhs.dims();
+
+    // For each (x,y) in the destination matrix:
+    for (size_t x = 0; x < destDim[0]; x++) {
+      for (size_t y = 0; y < destDim[1]; y++) {
+        int32_t sum = 0;
+        for (size_t i = 0; i < lhsDim[1]; i++) {
+          int32_t L = lhs.at({x, i});
+          int32_t R = rhs.at({i, y});
+          sum += (L - lhsOffset) * (R - rhsOffset);
+        }
+        dest.at({x, y}) = sum;
+      }
+    }
+    return;
+  }
+
   if (getTensor(I->getLHS())->getType().isQuantizedType()) {
     auto lhs = getTensor(I->getLHS())->getHandle<int8_t>();
     auto rhs = getTensor(I->getRHS())->getHandle<int8_t>();
@@ -1197,30 +1778,127 @@ void Interpreter::fwdMatMulInst(const glow::MatMulInst *I) {
     return;
   }
 
-  auto lhs = getWeightHandle(I->getLHS());
-  auto rhs = getWeightHandle(I->getRHS());
-  auto dest = getWeightHandle(I->getDest());
+  if (I->getLHS()->getElementType() == ElemKind::Float16Ty) {
+    fwdMatMul<float16>(getTensor(I->getDest()), getTensor(I->getLHS()),
+                       getTensor(I->getRHS()), I->getTransposeLHS(),
+                       I->getTransposeRHS());
+    return;
+  }
+
+  fwdMatMul<float>(getTensor(I->getDest()), getTensor(I->getLHS()),
+                   getTensor(I->getRHS()), I->getTransposeLHS(),
+                   I->getTransposeRHS());
+}
+
+void Interpreter::fwdChannelwiseQuantizedFullyConnectedInst(
+    const glow::ChannelwiseQuantizedFullyConnectedInst *I) {
+  auto lhs = getWeightHandle<int8_t>(I->getSrc());
+  auto rhs = getWeightHandle<int8_t>(I->getWeights());
+  auto dest = getWeightHandle<int8_t>(I->getDest());
+  auto bias = getWeightHandle<int32_t>(I->getBias());
+  auto scales = getWeightHandle<float>(I->getWeightScales());
+  auto offsets = getWeightHandle<int32_t>(I->getWeightOffsets());
 
   auto destDim = dest.dims();
   auto lhsDim = lhs.dims();
 
-  dest.clear(0);
+  auto *destTy = I->getDest()->getType();
+  auto *lhsTy = I->getSrc()->getType();
+  int32_t lhsOffset = lhsTy->getOffset();
+  int32_t destOffset = destTy->getOffset();
 
   // For each (x,y) in the destination matrix:
-  for (size_t x = 0; x < destDim[0]; x++) {
-    for (size_t y = 0; y < destDim[1]; y++) {
+  for (size_t y = 0; y < destDim[1]; y++) {
+    int32_t rhsOffset = offsets.at({y});
+    float scale = lhsTy->getScale() * scales.at({y}) / destTy->getScale();
+    for (size_t x = 0; x < destDim[0]; x++) {
 
-      // Perform DOT on the row an column.
-      float sum = 0;
+      // Perform DOT on the row an column. The bias has the scale of the
+      // product.
+      int32_t sum = bias.at({y});
       for (size_t i = 0; i < lhsDim[1]; i++) {
-        sum += lhs.at({x, i}) * rhs.at({i, y});
+        int32_t L = lhs.at({x, i});
+        int32_t R = rhs.at({i, y});
+        sum += (L - lhsOffset) * (R - rhsOffset);
+      }
+
+      dest.at({x, y}) = quantization::clip<int32_t, int8_t>(
+          std::round(scale * sum + destOffset));
+    }
+  }
+}
+
+void Interpreter::fwdSparseFullyConnectedInst(
+    const glow::SparseFullyConnectedInst *I) {
+  auto src = getWeightHandle<float>(I->getSrc());
+  auto dest = getWeightHandle<float>(I->getDest());
+  auto values = getWeightHandle<float>(I->getValues());
+  auto indices = getWeightHandle<int32_t>(I->getIndices());
+  auto offsets = getWeightHandle<int32_t>(I->getOffsets());
+  auto bias = getWeightHandle<float>(I->getBias());
+
+  auto destDim = dest.dims();
+
+  // Only the nonzero weights of the column y multiply the row x of the source.
+  for (size_t y = 0; y < destDim[1]; y++) {
+    for (size_t x = 0; x < destDim[0]; x++) {
+      float sum = bias.at({y});
+      for (int32_t k = offsets.at({y}), e = offsets.at({y + 1}); k < e; k++) {
+        sum += src.at({x, size_t(indices.raw(k))}) * values.raw(k);
       }
       dest.at({x, y}) = sum;
     }
   }
 }
 
+/// Store the sum of every layer of \p batch and \p slice, of the floating
+/// point type \p ElemTy, into \p dest.
+template <class ElemTy>
+static void fwdBatchedAdd(Tensor *destT, Tensor *batchT, Tensor *sliceT) {
+  auto batch = batchT->getHandle<ElemTy>();
+  auto slice = sliceT->getHandle<ElemTy>();
+  auto dest = destT->getHandle<ElemTy>();
+
+  auto bdim = flattenCdr(batch.dims());
+  assert(slice.size() == bdim.second && "Invalid slice size");
+  assert(batch.dims().drop_front() == slice.dims() && "Invalid batch size");
+
+  // For each layer in the batch:
+  for (size_t n = 0; n < bdim.first; n++) {
+    size_t base = batch.getElementPtr({n});
+
+    // For each element in the slice.
+    for (size_t i = 0; i < bdim.second; i++) {
+      dest.raw(base + i) = float(batch.raw(base + i)) + float(slice.raw(i));
+    }
+  }
+}
+
 void Interpreter::fwdBatchedAddInst(const glow::BatchedAddInst *I) {
+  if (I->getBatch()->getElementType() == ElemKind::Int32QTy) {
+    // The int32 accumulators of the same scale are added without rescaling.
+    assert(I->getBatch()->getType()->getScale() ==
+               I->getSlice()->getType()->getScale() &&
+           I->getBatch()->getType()->getScale() ==
+               I->getDest()->getType()->getScale() &&
+           "The accumulators must have the same scale");
+    assert(I->getBatch()->getType()->getOffset() == 0 &&
+           I->getSlice()->getType()->getOffset() == 0 &&
+           I->getDest()->getType()->getOffset() == 0 &&
+           "The accumulators have no offset");
+    auto batch = getWeightHandle<int32_t>(I->getBatch());
+    auto slice = getWeightHandle<int32_t>(I->getSlice());
+    auto dest = getWeightHandle<int32_t>(I->getDest());
+    auto bdim = flattenCdr(batch.dims());
+    for (size_t n = 0; n < bdim.first; n++) {
+      size_t base = batch.getElementPtr({n});
+      for (size_t i = 0; i < bdim.second; i++) {
+        dest.raw(base + i) = batch.raw(base + i) + slice.raw(i);
+      }
+    }
+    return;
+  }
+
   if (getTensor(I->getBatch())->getType().isQuantizedType()) {
     auto batch = getTensor(I->getBatch())->getHandle<int8_t>();
     auto slice = getTensor(I->getSlice())->getHandle<int8_t>();
@@ -1266,23 +1944,14 @@ void Interpreter::fwdBatchedAddInst(const glow::BatchedAddInst *I) {
     return;
   }
 
-  auto batch = getWeightHandle(I->getBatch());
-  auto slice = getWeightHandle(I->getSlice());
-  auto dest = getWeightHandle(I->getDest());
-
-  auto bdim = flattenCdr(batch.dims());
-  assert(slice.size() == bdim.second && "Invalid slice size");
-  assert(batch.dims().drop_front() == slice.dims() && "Invalid batch size");
-
-  // For each layer in the batch:
-  for (size_t n = 0; n < bdim.first; n++) {
-    size_t base = batch.getElementPtr({n});
-
-    // For each element in the slice.
-    for (size_t i = 0; i < bdim.second; i++) {
-      dest.raw(base + i) = batch.raw(base + i) + slice.raw(i);
-    }
+  if (I->getBatch()->getElementType() == ElemKind::Float16Ty) {
+    fwdBatchedAdd<float16>(getTensor(I->getDest()), getTensor(I->getBatch()),
+                           getTensor(I->getSlice()));
+    return;
   }
+
+  fwdBatchedAdd<float>(getTensor(I->getDest()), getTensor(I->getBatch()),
+                       getTensor(I->getSlice()));
 }
 
 void Interpreter::fwdBatchedReduceAddInst(const glow::BatchedReduceAddInst *I) {
@@ -1338,13 +2007,60 @@ void Interpreter::fwdBatchedReduceAddInst(const glow::BatchedReduceAddInst *I) {
   }
 }
 
+void Interpreter::fwdReduceInst(const glow::ReduceInst *I) {
+  auto src = getWeightHandle(I->getSrc());
+  auto dest = getWeightHandle(I->getDest());
+  auto dims = src.dims();
+  auto axes = I->getAxes();
+  auto mode = static_cast<ReduceMode>(I->getMode());
+
+  llvm::SmallVector<bool, max_tensor_dimensions> isReduced(dims.size(), false);
+  for (auto axis : axes) {
+    isReduced[axis] = true;
+  }
+
+  // The destination has the layout of the source without the reduced
+  // dimensions, so every source element is accumulated into the element that
+  // is addressed by its kept coordinates.
+  for (size_t i = 0, e = dest.size(); i < e; i++) {
+    dest.raw(i) =
+        mode == ReduceMode::Max ? std::numeric_limits<float>::lowest() : 0;
+  }
+  for (size_t i = 0, e = src.size(); i < e; i++) {
+    size_t rem = i;
+    size_t destIdx = 0;
+    size_t destStride = 1;
+    for (size_t d = dims.size(); d-- > 0;) {
+      size_t coord = rem % dims[d];
+      rem /= dims[d];
+      if (!isReduced[d]) {
+        destIdx += coord * destStride;
+        destStride *= dims[d];
+      }
+    }
+    float val = src.raw(i);
+    if (mode == ReduceMode::Max) {
+      dest.raw(destIdx) = std::max(dest.raw(destIdx), val);
+    } else {
+      dest.raw(destIdx) += val;
+    }
+  }
+
+  if (mode == ReduceMode::Mean) {
+    float count = float(src.size()) / dest.size();
+    for (size_t i = 0, e = dest.size(); i < e; i++) {
+      dest.raw(i) /= count;
+    }
+  }
+}
+
 //===----------------------------------------------------------------------===//
 //                Instructions used by RNN
 //===----------------------------------------------------------------------===//
-template <typename T>
+template <typename T, typename I>
 static void fwdTopK(Tensor *outW, Tensor *indW, Tensor *inW, size_t k) {
   auto values = outW->getHandle<T>();
-  auto indices = indW->getHandle<size_t>();
+  auto indices = indW->getHandle<I>();
   auto in = inW->getHandle<T>();
   size_t n = in.dims().back();
 
@@ -1358,12 +2074,12 @@ static void fwdTopK(Tensor *outW, Tensor *indW, Tensor *inW, size_t k) {
       buf[i].first = in.raw(in_p++);
       buf[i].second = i;
     }
-    // NOTE: it's possible to do N + KlogK, while this version is NlogN
-    std::sort(buf.begin(), buf.end(), [](const pairType &a, const pairType &b) {
-      if (a.first != b.first)
-        return a.first > b.first;
-      return a.second < b.second;
-    });
+    std::partial_sort(buf.begin(), buf.begin() + k, buf.end(),
+                      [](const pairType &a, const pairType &b) {
+                        if (a.first != b.first)
+                          return a.first > b.first;
+                        return a.second < b.second;
+                      });
     for (size_t i = 0; i < k; i++) {
       values.raw(out_p) = buf[i].first;
       indices.raw(out_p) = buf[i].second;
@@ -1378,10 +2094,89 @@ void Interpreter::fwdTopKInst(const TopKInst *I) {
   auto inW = getTensor(I->getInput());
   size_t k = I->getK();
 
+  bool idx32 = indW->getElementType() == ElemKind::Int32ITy;
   if (inW->getType().isQuantizedType()) {
-    fwdTopK<int8_t>(outW, indW, inW, k);
+    if (idx32) {
+      fwdTopK<int8_t, int32_t>(outW, indW, inW, k);
+    } else {
+      fwdTopK<int8_t, size_t>(outW, indW, inW, k);
+    }
+  } else if (idx32) {
+    fwdTopK<float, int32_t>(outW, indW, inW, k);
   } else {
-    fwdTopK<float>(outW, indW, inW, k);
+    fwdTopK<float, size_t>(outW, indW, inW, k);
+  }
+}
+
+void Interpreter::fwdScatterAssignInst(const glow::ScatterAssignInst *I) {
+  Tensor *dataT = getTensor(I->getData());
+  Tensor *indicesT = getTensor(I->getIndices());
+  Tensor *slicesT = getTensor(I->getSlices());
+
+  size_t dataSliceSize =
+      dataT->size() / dataT->dims()[0] * dataT->getType().getElementSize();
+  for (size_t i = 0, end = indicesT->size(); i < end; i++) {
+    size_t slice = indicesT->getHandle<size_t>().raw(i);
+    assert(slice < dataT->dims()[0] && "The index is out of range");
+    std::copy(&slicesT->getUnsafePtr()[dataSliceSize * i],
+              &slicesT->getUnsafePtr()[dataSliceSize * (i + 1)],
+              &dataT->getUnsafePtr()[dataSliceSize * slice]);
+  }
+}
+
+//===----------------------------------------------------------------------===//
+//                Instructions used for network training
+//===----------------------------------------------------------------------===//
+
+void Interpreter::fwdSGDInst(const SGDInst *I) {
+  auto W = getWeightHandle(I->getWeight());
+  auto G = getWeightHandle(I->getGradient());
+  float L1Decay = I->getL1Decay();
+  float L2Decay = I->getL2Decay();
+  float negLearningRate = -I->getLearningRate();
+  float momentum = I->getMomentum();
+  float batchSize = std::max(I->getBatchSize(), 1u);
+  if (momentum > 0) {
+    auto gsum = getWeightHandle(I->getGsum());
+    for (size_t i = 0, e = W.size(); i < e; i++) {
+      float w = W.raw(i);
+      float g = G.raw(i) + L1Decay * (w >= 0 ? 1 : -1) + L2Decay * w;
+      float dx = negLearningRate * (g / batchSize) + momentum * gsum.raw(i);
+      gsum.raw(i) = dx;
+      W.raw(i) = w + dx;
+    }
+    return;
+  }
+
+  for (size_t i = 0, e = W.size(); i < e; i++) {
+    float w = W.raw(i);
+    float g = G.raw(i) + L1Decay * (w >= 0 ? 1 : -1) + L2Decay * w;
+    W.raw(i) = w + negLearningRate * (g / batchSize);
+  }
+}
+
+//===----------------------------------------------------------------------===//
+//                       Control flow
+//===----------------------------------------------------------------------===//
+
+void Interpreter::fwdLoopStartInst(const LoopStartInst *I) {
+  auto counter = getWeightHandle<size_t>(I->getCounter());
+  auto tripCount = getWeightHandle<size_t>(I->getTripCount());
+  counter.raw(0) = 0;
+  // Skip the body of a loop that runs zero times.
+  if (std::min(tripCount.raw(0), I->getMaxTripCount()) == 0) {
+    nextInstr_ = current_->loopPair + 1;
+  }
+}
+
+void Interpreter::fwdLoopEndInst(const LoopEndInst *I) {
+  auto counter = getWeightHandle<size_t>(I->getCounter());
+  auto tripCount = getWeightHandle<size_t>(I->getTripCount());
+  counter.raw(0)++;
+  // Run the body again, right after the matching LoopStart. The trip count
+  // is bounded by the size of the buffers of the body.
+  if (counter.raw(0) < std::min(tripCount.raw(0), I->getMaxTripCount())) {
+    nextInstr_ = current_->loopPair + 1;
   }
 }
 
@@ -1390,11 +2185,15 @@ void Interpreter::fwdTopKInst(const TopKInst *I) {
 //===----------------------------------------------------------------------===//
 
 void Interpreter::fwdAllocActivationInst(const AllocActivationInst *I) {
-  getOrCreateTensor(I);
+  // The tensor is carved out of the activations arena by init(), and shares
+  // its memory with the activations that are dead by now. Every run starts
+  // from a zeroed activation, like a freshly allocated one.
+  getTensor(I)->zero();
 }
 
 void Interpreter::fwdDeallocActivationInst(const DeallocActivationInst *I) {
-  deleteTensor(I->getSrc());
+  // The memory of the activation is reused by the later activations, and
+  // released together with the backend.
 }
 
 /// Prints a value of the instruction's operand.
@@ -1410,6 +2209,40 @@ void Interpreter::fwdDebugPrintInst(const DebugPrintInst *I) {
   llvm::outs() << "\n";
 }
 
+/// Accumulate the statistics of the instruction's source into its counters
+/// and its range. The release builds use -ffast-math, which folds std::isnan
+/// and std::isinf to false, so the elements are classified by their bits.
+void Interpreter::fwdTensorStatsInst(const TensorStatsInst *I) {
+  auto srcH = getWeightHandle(I->getSrc());
+  auto countersH = getWeightHandle<size_t>(I->getCounters());
+  auto rangeH = getWeightHandle(I->getRange());
+
+  size_t nans = 0, infs = 0, zeros = 0;
+  float min = rangeH.raw(0);
+  float max = rangeH.raw(1);
+  for (size_t i = 0, e = srcH.size(); i < e; i++) {
+    float val = srcH.raw(i);
+    uint32_t bits;
+    memcpy(&bits, &val, sizeof(bits));
+    uint32_t abs = bits & 0x7fffffffu;
+    if (abs >= 0x7f800000u) {
+      nans += abs > 0x7f800000u;
+      infs += abs == 0x7f800000u;
+      continue;
+    }
+    zeros += abs == 0;
+    min = std::min(min, val);
+    max = std::max(max, val);
+  }
+  countersH.raw(0) += 1;
+  countersH.raw(1) += srcH.size();
+  countersH.raw(2) += nans;
+  countersH.raw(3) += infs;
+  countersH.raw(4) += zeros;
+  rangeH.raw(0) = min;
+  rangeH.raw(1) = max;
+}
+
 //===----------------------------------------------------------------------===//
 //                Instructions used by Quantization
 //===----------------------------------------------------------------------===//
@@ -1427,49 +2260,141 @@ void Interpreter::fwdQuantizationProfileInst(
   quantization::generateTensorHistogram(inputTensor, currentHistogram, min,
                                         max);
 }
+/// Quantize the float tensor \p src into the tensor \p dest of the quantized
+/// type \p DestTy, with the scale and offset of \p dest.
+template <class DestTy> static void fwdQuantize(Tensor *dest, Tensor *src) {
+  TensorQuantizationParams params{dest->getType().getScale(),
+                                  dest->getType().getOffset()};
+  auto srcHandle = src->getHandle<float>();
+  auto destHandle = dest->getHandle<DestTy>();
+  for (size_t i = 0, e = destHandle.size(); i < e; ++i) {
+    destHandle.raw(i) =
+        quantization::quantize<DestTy>(srcHandle.raw(i), params);
+  }
+}
+
 /// Quantize floating point tensor. Scale and Offset are based on return type
 /// of the instruction \p I.
 void Interpreter::fwdQuantizeInst(const glow::QuantizeInst *I) {
-  auto srcHandle = getWeightHandle(I->getSrc());
+  auto *srcTensor = getTensor(I->getSrc());
   auto *destTensor = getTensor(I->getDest());
+  switch (destTensor->getElementType()) {
+  case ElemKind::Int8QTy:
+    return fwdQuantize<int8_t>(destTensor, srcTensor);
+  case ElemKind::Int16QTy:
+    return fwdQuantize<int16_t>(destTensor, srcTensor);
+  case ElemKind::Int32QTy:
+    return fwdQuantize<int32_t>(destTensor, srcTensor);
+  default:
+    llvm_unreachable("Type is not supported");
+  }
+}
 
-  TensorQuantizationParams params{destTensor->getType().getScale(),
-                                  destTensor->getType().getOffset()};
-
-  auto destHandle = destTensor->getHandle<int8_t>();
+/// Dequantize the tensor \p src of the quantized type \p SrcTy into the float
+/// tensor \p dest, with the scale and offset of \p src.
+template <class SrcTy> static void fwdDequantize(Tensor *dest, Tensor *src) {
+  TensorQuantizationParams params{src->getType().getScale(),
+                                  src->getType().getOffset()};
+  auto srcHandle = src->getHandle<SrcTy>();
+  auto destHandle = dest->getHandle<float>();
   for (size_t i = 0, e = destHandle.size(); i < e; ++i) {
-    destHandle.raw(i) = quantization::quantize(srcHandle.raw(i), params);
+    destHandle.raw(i) = quantization::dequantize(srcHandle.raw(i), params);
   }
 }
+
 /// Dequantize integer tensor. Scale and Offset are based
 /// on the source tensor type.
 void Interpreter::fwdDequantizeInst(const glow::DequantizeInst *I) {
   auto *srcTensor = getTensor(I->getSrc());
-  auto destHandle = getWeightHandle(I->getDest());
+  auto *destTensor = getTensor(I->getDest());
+  switch (srcTensor->getElementType()) {
+  case ElemKind::Int8QTy:
+    return fwdDequantize<int8_t>(destTensor, srcTensor);
+  case ElemKind::Int16QTy:
+    return fwdDequantize<int16_t>(destTensor, srcTensor);
+  case ElemKind::Int32QTy:
+    return fwdDequantize<int32_t>(destTensor, srcTensor);
+  default:
+    llvm_unreachable("Type is not supported");
+  }
+}
 
-  TensorQuantizationParams params{srcTensor->getType().getScale(),
-                                  srcTensor->getType().getOffset()};
+/// Requantize the tensor \p src of the quantized type \p SrcTy into the
+/// tensor \p dest of the quantized type \p DestTy.
+template <class DestTy, class SrcTy>
+static void fwdRescaleQuantized(Tensor *dest, Tensor *src) {
+  TensorQuantizationParams srcQ{src->getType().getScale(),
+                                src->getType().getOffset()};
+  TensorQuantizationParams destQ{dest->getType().getScale(),
+                                 dest->getType().getOffset()};
 
-  auto srcHandle = srcTensor->getHandle<int8_t>();
-  for (size_t i = 0, e = destHandle.size(); i < e; ++i) {
-    destHandle.raw(i) = quantization::dequantize(srcHandle.raw(i), params);
+  auto srcH = src->getHandle<SrcTy>();
+  auto destH = dest->getHandle<DestTy>();
+
+  for (size_t i = 0, e = destH.size(); i < e; ++i) {
+    float val = quantization::dequantize(srcH.raw(i), srcQ);
+    destH.raw(i) = quantization::quantize<DestTy>(val, destQ);
+  }
+}
+
+/// Requantize the tensor \p src of the quantized type \p SrcTy into \p dest.
+template <class SrcTy>
+static void fwdRescaleQuantizedFrom(Tensor *dest, Tensor *src) {
+  switch (dest->getElementType()) {
+  case ElemKind::Int8QTy:
+    return fwdRescaleQuantized<int8_t, SrcTy>(dest, src);
+  case ElemKind::Int16QTy:
+    return fwdRescaleQuantized<int16_t, SrcTy>(dest, src);
+  case ElemKind::Int32QTy:
+    return fwdRescaleQuantized<int32_t, SrcTy>(dest, src);
+  default:
+    llvm_unreachable("Type is not supported");
   }
 }
 
 void Interpreter::fwdRescaleQuantizedInst(const glow::RescaleQuantizedInst *I) {
-  auto src = I->getSrc();
-  auto dest = I->getDest();
-  auto srcTy = src->getType();
-  auto destTy = dest->getType();
+  auto *srcTensor = getTensor(I->getSrc());
+  auto *destTensor = getTensor(I->getDest());
+  switch (srcTensor->getElementType()) {
+  case ElemKind::Int8QTy:
+    return fwdRescaleQuantizedFrom<int8_t>(destTensor, srcTensor);
+  case ElemKind::Int16QTy:
+    return fwdRescaleQuantizedFrom<int16_t>(destTensor, srcTensor);
+  case ElemKind::Int32QTy:
+    return fwdRescaleQuantizedFrom<int32_t>(destTensor, srcTensor);
+  default:
+    llvm_unreachable("Type is not supported");
+  }
+}
 
-  TensorQuantizationParams srcQ{srcTy->getScale(), srcTy->getOffset()};
-  TensorQuantizationParams destQ{destTy->getScale(), destTy->getOffset()};
+/// Convert the elements of \p src of the type \p SrcTy to the type \p DestTy
+/// and store them into \p dest.
+template <class DestTy, class SrcTy>
+static void fwdConvertTo(Tensor *dest, Tensor *src) {
+  auto srcH = src->getHandle<SrcTy>();
+  auto destH = dest->getHandle<DestTy>();
+  for (size_t i = 0, e = destH.size(); i < e; ++i) {
+    destH.raw(i) = float(srcH.raw(i));
+  }
+}
 
-  auto srcH = getWeightHandle<int8_t>(src);
-  auto destH = getWeightHandle<int8_t>(dest);
+void Interpreter::fwdConvertToInst(const glow::ConvertToInst *I) {
+  auto *src = getTensor(I->getSrc());
+  auto *dest = getTensor(I->getDest());
+  auto srcKind = src->getElementType();
+  auto destKind = dest->getElementType();
 
-  for (size_t i = 0, e = destH.size(); i < e; ++i) {
-    float val = quantization::dequantize(srcH.raw(i), srcQ);
-    destH.raw(i) = quantization::quantize(val, destQ);
+  if (srcKind == destKind) {
+    dest->copyRawFrom(src);
+    return;
+  }
+  if (srcKind == ElemKind::FloatTy && destKind == ElemKind::Float16Ty) {
+    fwdConvertTo<float16, float>(dest, src);
+    return;
+  }
+  if (srcKind == ElemKind::Float16Ty && destKind == ElemKind::FloatTy) {
+    fwdConvertTo<float, float16>(dest, src);
+    return;
   }
+  llvm_unreachable("Unsupported conversion");
 }
@@ -20,7 +20,11 @@
 #include "glow/Graph/Graph.h"
 #include "glow/Graph/Nodes.h"
 #include "glow/IR/Instrs.h"
+#include "glow/Quantization/Quantization.h"
+#include "glow/Support/Trace.h"
 
+#include "llvm/ADT/Hashing.h"
+#include "llvm/ADT/Optional.h"
 #include "llvm/ADT/SmallVector.h"
 #include "llvm/Support/Casting.h"
 #include "llvm/Support/CommandLine.h"
@@ -28,6 +32,14 @@
 #include "llvm/Support/Format.h"
 #include "llvm/Support/raw_ostream.h"
 
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <unistd.h>
+#include <unordered_set>
+
 using namespace glow;
 using llvm::format;
 
@@ -50,6 +62,43 @@ static llvm::cl::opt<bool> doProfile("opencl-profile",
                                      llvm::cl::desc("Profile OpenCL kernels"),
                                      llvm::cl::init(false),
                                      llvm::cl::cat(OpenCLBackendCat));
+static llvm::cl::opt<unsigned> tileSize(
+    "opencl-tile-size",
+    llvm::cl::desc("The size of the square tiles of the matrix multiplication "
+                   "and the convolution kernels. The default of 0 selects the "
+                   "largest tile that the device supports"),
+    llvm::cl::init(0), llvm::cl::cat(OpenCLBackendCat));
+static llvm::cl::opt<unsigned> workPerThread(
+    "opencl-work-per-thread",
+    llvm::cl::desc("The number of the output rows of a tile that a work-item "
+                   "of the matrix multiplication and the convolution kernels "
+                   "accumulates in registers"),
+    llvm::cl::init(4), llvm::cl::cat(OpenCLBackendCat));
+static llvm::cl::opt<unsigned> numQueues(
+    "opencl-num-queues",
+    llvm::cl::desc("The number of the command queues across which the "
+                   "independent kernels and transfers are spread, so that "
+                   "they overlap"),
+    llvm::cl::init(1), llvm::cl::cat(OpenCLBackendCat));
+static llvm::cl::opt<bool> fuseElementwise(
+    "opencl-fuse-elementwise",
+    llvm::cl::desc("Generate a kernel for every run of consecutive float "
+                   "element-wise instructions of the same size, which keeps "
+                   "the intermediate values in registers, instead of "
+                   "launching a kernel per instruction"),
+    llvm::cl::init(true), llvm::cl::cat(OpenCLBackendCat));
+static llvm::cl::opt<bool> specializeShapes(
+    "opencl-specialize-shapes",
+    llvm::cl::desc("Build the convolution, pooling and matrix multiplication "
+                   "kernels for every shape with its dimensions, filter size, "
+                   "stride and pad as constants, which the OpenCL compiler "
+                   "folds and unrolls"),
+    llvm::cl::init(true), llvm::cl::cat(OpenCLBackendCat));
+static llvm::cl::opt<std::string> programCacheDir(
+    "opencl-program-cache",
+    llvm::cl::desc("The directory in which the built OpenCL programs are "
+                   "cached across processes. The cache is disabled if empty"),
+    llvm::cl::init(""), llvm::cl::cat(OpenCLBackendCat));
 } // namespace
 
 Backend *glow::createOCLBackend(IRFunction *F) { return new OCLBackend(F); }
@@ -90,21 +139,72 @@ OCLBackend::OCLBackend(IRFunction *F) : F_(F), allocator_(0xFFFFFFFF) {
   deviceId_ = devices[deviceId];
   context_ = clCreateContext(nullptr, 1, &deviceId_, nullptr, nullptr, nullptr);
   GLOW_ASSERT(context_ && "clCreateContext Failed.");
+  // The timeline of the kernels is recorded from the profiling information of
+  // their events as well.
+  profiling_ = doProfile || isTraceEnabled();
   commands_ = clCreateCommandQueue(
-      context_, deviceId_, (doProfile) ? CL_QUEUE_PROFILING_ENABLE : 0, &err);
+      context_, deviceId_, profiling_ ? CL_QUEUE_PROFILING_ENABLE : 0, &err);
   GLOW_ASSERT(commands_ && "clCreateCommandQueue Failed.");
+  GLOW_ASSERT(numQueues > 0 && "Invalid number of command queues");
+  queues_.push_back(commands_);
+  for (unsigned i = 1; i < numQueues; i++) {
+    cl_command_queue queue = clCreateCommandQueue(
+        context_, deviceId_, profiling_ ? CL_QUEUE_PROFILING_ENABLE : 0, &err);
+    GLOW_ASSERT(queue && "clCreateCommandQueue Failed.");
+    queues_.push_back(queue);
+  }
+
+  selectTileSize();
 
   err = CL_SUCCESS;
   /// Create the program from the source.
-  createProgram(SHADER_CODE, {}, commands_);
+  programOptions_ = {"-DTILE_SIZE=" + std::to_string(tileSize_),
+                     "-DWORK_PER_THREAD=" + std::to_string(workPerThread_)};
+  mainProgram_ = createProgram(SHADER_CODE, programOptions_, commands_);
+}
+
+void OCLBackend::selectTileSize() {
+  size_t WGS;
+  clGetDeviceInfo(deviceId_, CL_DEVICE_MAX_WORK_GROUP_SIZE, sizeof(WGS), &WGS,
+                  nullptr);
+  size_t WIS[3];
+  clGetDeviceInfo(deviceId_, CL_DEVICE_MAX_WORK_ITEM_SIZES, sizeof(WIS), &WIS,
+                  nullptr);
+  cl_ulong localMemSize;
+  clGetDeviceInfo(deviceId_, CL_DEVICE_LOCAL_MEM_SIZE, sizeof(localMemSize),
+                  &localMemSize, nullptr);
+
+  workPerThread_ = workPerThread;
+  GLOW_ASSERT(workPerThread_ > 0 && "Invalid work per thread");
+  if (tileSize) {
+    tileSize_ = tileSize;
+  } else {
+    // Halve the tile until its work-group and its two tiles of local memory
+    // fit into the device.
+    tileSize_ = 32;
+    while (tileSize_ > workPerThread_ &&
+           (tileSize_ * tileSize_ / workPerThread_ > WGS ||
+            tileSize_ > WIS[0] || tileSize_ / workPerThread_ > WIS[1] ||
+            2 * tileSize_ * tileSize_ * sizeof(float) > localMemSize)) {
+      tileSize_ /= 2;
+    }
+  }
+  GLOW_ASSERT(tileSize_ % workPerThread_ == 0 &&
+              "The work per thread must divide the tile size");
+  DEBUG(llvm::dbgs() << "Selected the OpenCL tile size " << tileSize_
+                     << " with " << workPerThread_ << " rows per work-item\n");
 }
 
 OCLBackend::~OCLBackend() {
+  releaseLaunches();
+  freeStagingBuffer();
   for (auto &kv : programsCache_) {
     auto prog = kv.second;
     clReleaseProgram(prog);
   }
-  clReleaseCommandQueue(commands_);
+  for (auto queue : queues_) {
+    clReleaseCommandQueue(queue);
+  }
   clReleaseContext(context_);
   if (deviceBuffer_) {
     freeDeviceBuffer(deviceBuffer_);
@@ -131,23 +231,148 @@ static std::string getKernelName(const char *baseName, ElemKind elemTy) {
 
 cl_kernel OCLBackend::createKernel(const std::string &name,
                                    cl_program program) {
+  // The specialized programs define the same kernels for a single shape, so
+  // the kernels are looked up in the generic program by default.
+  if (!program) {
+    program = mainProgram_;
+  }
   cl_int err = CL_SUCCESS;
-  cl_kernel kernel = nullptr;
-  if (program) {
-    cl_kernel kernel = clCreateKernel(program, name.c_str(), &err);
-    GLOW_ASSERT((kernel && err == CL_SUCCESS) && "clCreateKernel Failed.");
-    return kernel;
+  cl_kernel kernel = clCreateKernel(program, name.c_str(), &err);
+  GLOW_ASSERT((kernel && err == CL_SUCCESS) && "clCreateKernel Failed.");
+  return kernel;
+}
+
+/// Appends the definitions of the dimensions of the shape \p dim, with the
+/// names prefixed by \p prefix, to \p defines.
+static void addShapeDefines(std::vector<std::string> &defines,
+                            const std::string &prefix, const ShapeNHWC &dim) {
+  defines.push_back("-D" + prefix + "_N=" + std::to_string(dim.n));
+  defines.push_back("-D" + prefix + "_H=" + std::to_string(dim.h));
+  defines.push_back("-D" + prefix + "_W=" + std::to_string(dim.w));
+  defines.push_back("-D" + prefix + "_C=" + std::to_string(dim.c));
+}
+
+/// Appends the definitions of the window of a convolution or a pooling, with
+/// the filter size \p kernel, the stride \p stride, the pad \p pad, the
+/// output shape \p odim and the input shape \p idim, to \p defines.
+static void addWindowDefines(std::vector<std::string> &defines, size_t kernel,
+                             size_t stride, size_t pad, const ShapeNHWC &odim,
+                             const ShapeNHWC &idim) {
+  defines.push_back("-DSPEC_FILTER_SIZE=" + std::to_string(kernel));
+  defines.push_back("-DSPEC_STRIDE=" + std::to_string(stride));
+  defines.push_back("-DSPEC_PAD=" + std::to_string(pad));
+  addShapeDefines(defines, "SPEC_ODIM", odim);
+  addShapeDefines(defines, "SPEC_IDIM", idim);
+}
+
+cl_kernel
+OCLBackend::createSpecializedKernel(const std::string &name,
+                                    llvm::ArrayRef<std::string> defines) {
+  if (!specializeShapes) {
+    return createKernel(name);
   }
-  // Inspect all programs.
-  for (auto &kv : programsCache_) {
-    auto prog = kv.second;
-    cl_kernel kernel = clCreateKernel(prog, name.c_str(), &err);
-    if (err == CL_SUCCESS) {
-      return kernel;
+  std::vector<std::string> options = programOptions_;
+  options.push_back("-DSPECIALIZE_" + name);
+  options.insert(options.end(), defines.begin(), defines.end());
+  return createKernel(name, createProgram(SHADER_CODE, options, commands_));
+}
+
+/// \returns the string parameter \p param of the device \p dev.
+static std::string getDeviceString(cl_device_id dev, cl_device_info param) {
+  size_t size = 0;
+  if (clGetDeviceInfo(dev, param, 0, nullptr, &size) != CL_SUCCESS || !size) {
+    return "";
+  }
+  std::string str(size, '\0');
+  clGetDeviceInfo(dev, param, size, &str[0], nullptr);
+  return str;
+}
+
+/// \returns the path of the file in the program cache that holds the binary
+/// of the program built from \p source with \p options for \p dev. The key
+/// includes the driver version, because the binaries are specific to it.
+static std::string getProgramCachePath(const std::string &source,
+                                       const std::string &options,
+                                       cl_device_id dev) {
+  llvm::hash_code hash =
+      llvm::hash_combine(source, options, getDeviceString(dev, CL_DEVICE_NAME),
+                         getDeviceString(dev, CL_DEVICE_VENDOR),
+                         getDeviceString(dev, CL_DRIVER_VERSION));
+  std::string name;
+  llvm::raw_string_ostream OS(name);
+  OS << programCacheDir << "/glow-" << llvm::format_hex_no_prefix(hash, 16)
+     << ".clbin";
+  return OS.str();
+}
+
+/// \returns the program built from the binary in the file \p path for the
+/// device \p dev in the context \p ctx, or nullptr if there is no usable
+/// binary in the file.
+static cl_program loadProgramBinary(const std::string &path, cl_context ctx,
+                                    cl_device_id dev,
+                                    const std::string &options) {
+  std::ifstream file(path, std::ios::binary);
+  if (!file) {
+    return nullptr;
+  }
+  std::vector<unsigned char> binary((std::istreambuf_iterator<char>(file)),
+                                    std::istreambuf_iterator<char>());
+  if (binary.empty()) {
+    return nullptr;
+  }
+  const unsigned char *data = binary.data();
+  size_t size = binary.size();
+  cl_int status, err;
+  cl_program program = clCreateProgramWithBinary(ctx, 1, &dev, &size, &data,
+                                                 &status, &err);
+  if (!program) {
+    return nullptr;
+  }
+  // The binary may be stale or corrupt, in which case the program is rebuilt
+  // from the source.
+  if (err != CL_SUCCESS || status != CL_SUCCESS ||
+      clBuildProgram(program, 1, &dev, options.c_str(), nullptr, nullptr) !=
+          CL_SUCCESS) {
+    clReleaseProgram(program);
+    return nullptr;
+  }
+  DEBUG(llvm::dbgs() << "Loaded the OpenCL program from " << path << "\n");
+  return program;
+}
+
+/// Write the binary of the built \p program into the file \p path. The
+/// binary is written into a temporary file first, so that the processes that
+/// run at the same time never read a partial binary.
+static void saveProgramBinary(const std::string &path, cl_program program) {
+  size_t size = 0;
+  if (clGetProgramInfo(program, CL_PROGRAM_BINARY_SIZES, sizeof(size), &size,
+                       nullptr) != CL_SUCCESS ||
+      !size) {
+    return;
+  }
+  std::vector<unsigned char> binary(size);
+  unsigned char *data = binary.data();
+  if (clGetProgramInfo(program, CL_PROGRAM_BINARIES, sizeof(data), &data,
+                       nullptr) != CL_SUCCESS) {
+    return;
+  }
+  std::string tmpPath = path + ".tmp" + std::to_string(getpid());
+  {
+    std::ofstream file(tmpPath, std::ios::binary);
+    if (!file) {
+      return;
+    }
+    file.write((const char *)data, size);
+    if (!file) {
+      std::remove(tmpPath.c_str());
+      return;
     }
   }
-  GLOW_ASSERT(kernel && "clCreateKernel Failed.");
-  return kernel;
+  if (std::rename(tmpPath.c_str(), path.c_str())) {
+    std::remove(tmpPath.c_str());
+    return;
+  }
+  DEBUG(llvm::dbgs() << "Saved the OpenCL program into " << path << "\n");
 }
 
 cl_program OCLBackend::createProgram(const std::string &source,
@@ -175,14 +400,27 @@ cl_program OCLBackend::createProgram(const std::string &source,
   if (program) {
     return program;
   }
+  // Reuse the binary that an earlier process built, if there is one.
+  std::string cachePath;
+  if (!programCacheDir.empty()) {
+    cachePath = getProgramCachePath(source, combinedOptions, deviceId);
+    program = loadProgramBinary(cachePath, ctx, deviceId, combinedOptions);
+    if (program) {
+      return program;
+    }
+  }
   // Create a new compiled program.
   program = clCreateProgramWithSource(context_, 1, &src, nullptr, &err);
   GLOW_ASSERT(program && "clCreateProgramWithSource Failed.");
-  err = clBuildProgram(program, 0, nullptr, nullptr, nullptr, nullptr);
+  err = clBuildProgram(program, 0, nullptr, combinedOptions.c_str(), nullptr,
+                       nullptr);
   if (err) {
     dumpCompileLog(deviceId, program);
   }
   GLOW_ASSERT(err == CL_SUCCESS && "clBuildProgram Failed.");
+  if (!cachePath.empty()) {
+    saveProgramBinary(cachePath, program);
+  }
   // Add this program to the program cache.
   return program;
 }
@@ -193,6 +431,70 @@ void setKernelArg(cl_kernel kernel, unsigned argIdx, T value) {
   GLOW_ASSERT(err == CL_SUCCESS && "Unable to set parameter");
 }
 
+/// Set the pre-shift, the post-shift and the integer scale that approximate the
+/// multiplication by \p scale as the arguments \p argIdx to \p argIdx + 2 of
+/// \p kernel. \returns the index of the next argument.
+static unsigned setScaleArgs(cl_kernel kernel, unsigned argIdx, float scale) {
+  auto params = quantization::quantizeScaleOffset32To8(scale, 0);
+  setKernelArg<cl_int>(kernel, argIdx, params.pre_);
+  setKernelArg<cl_int>(kernel, argIdx + 1, params.post_);
+  setKernelArg<cl_int>(kernel, argIdx + 2, params.scale_);
+  return argIdx + 3;
+}
+
+/// Set the offsets and the scaling parameters of the quantized data-parallel
+/// instruction \p I as the arguments of \p kernel that start at \p argIdx.
+/// They follow the libjit kernels of the same instructions.
+static void setQuantizedDataParallelArgs(cl_kernel kernel, unsigned argIdx,
+                                         const Instruction *I) {
+  if (auto *SI = dyn_cast<SplatInst>(I)) {
+    // Pass the quantized value of the splat.
+    auto *destTy = SI->getDest()->getType();
+    TensorQuantizationParams TQP{destTy->getScale(), destTy->getOffset()};
+    setKernelArg<cl_int>(kernel, argIdx,
+                         quantization::quantize(SI->getValue(), TQP));
+    return;
+  }
+
+  auto *destTy = I->getOperand(0).first->getType();
+  auto *lhsTy = I->getOperand(I->getNumOperands() - 2).first->getType();
+  auto *rhsTy = I->getOperand(I->getNumOperands() - 1).first->getType();
+  if (isa<ElementCmpLTEInst>(I)) {
+    // The lhs is scaled to the scale of the rhs.
+    setKernelArg<cl_int>(kernel, argIdx++, lhsTy->getOffset());
+    setKernelArg<cl_int>(kernel, argIdx++, rhsTy->getOffset());
+    setScaleArgs(kernel, argIdx, lhsTy->getScale() / rhsTy->getScale());
+    return;
+  }
+
+  setKernelArg<cl_int>(kernel, argIdx++, destTy->getOffset());
+  setKernelArg<cl_int>(kernel, argIdx++, lhsTy->getOffset());
+  setKernelArg<cl_int>(kernel, argIdx++, rhsTy->getOffset());
+  float destScale = destTy->getScale();
+  switch (I->getKind()) {
+  case Kinded::Kind::ElementMulInstKind:
+    setScaleArgs(kernel, argIdx,
+                 lhsTy->getScale() * rhsTy->getScale() / destScale);
+    return;
+  case Kinded::Kind::ElementDivInstKind:
+    setScaleArgs(kernel, argIdx,
+                 lhsTy->getScale() / (rhsTy->getScale() * destScale));
+    return;
+  case Kinded::Kind::ElementAddInstKind:
+  case Kinded::Kind::ElementSubInstKind:
+  case Kinded::Kind::ElementMaxInstKind:
+  case Kinded::Kind::ElementMinInstKind:
+  case Kinded::Kind::ElementSelectInstKind:
+    // Both operands are scaled to the scale of the result.
+    argIdx = setScaleArgs(kernel, argIdx, lhsTy->getScale() / destScale);
+    setScaleArgs(kernel, argIdx, rhsTy->getScale() / destScale);
+    return;
+  default:
+    llvm::errs() << "Cannot select: " << I->getKindName() << "\n";
+    GLOW_UNREACHABLE("Unsupported quantized instruction");
+  }
+}
+
 /// \returns the max local workgroup size for each dimension, under the
 /// opencl constraints, with the global workgroup sizes of \p global;
 void getMaxLocalWorkgroupSize(cl_kernel kernel, cl_device_id device,
@@ -235,27 +537,57 @@ void getMaxLocalWorkgroupSize(cl_kernel kernel, cl_device_id device,
   }
 }
 
-/// Enqueue a \p kernel for execution on the command queue \p commands on a
-/// given \p device. The information about the launched kernel will be added to
-/// \p kernelLaunches list.
-void OCLBackend::enqueueKernel(cl_command_queue commands, cl_kernel kernel,
-                               cl_device_id device,
-                               llvm::ArrayRef<size_t> global,
-                               std::vector<KernelLaunch> &kernelLaunches) {
-  llvm::SmallVector<size_t, 4> local(global.size(), 0);
-  getMaxLocalWorkgroupSize(kernel, device, global, local);
+void OCLBackend::addKernelLaunch(cl_kernel kernel,
+                                 llvm::ArrayRef<size_t> global,
+                                 llvm::ArrayRef<size_t> local) {
+  LaunchCommand launch(LaunchCommand::Kind::Kernel);
+  launch.global_.assign(global.begin(), global.end());
+  if (local.empty()) {
+    launch.local_.resize(global.size(), 0);
+    getMaxLocalWorkgroupSize(kernel, deviceId_, global, launch.local_);
+  } else {
+    assert(local.size() == global.size() && "Invalid workgroup size");
+    size_t L;
+    cl_int err =
+        clGetKernelWorkGroupInfo(kernel, deviceId_, CL_KERNEL_WORK_GROUP_SIZE,
+                                 sizeof(L), &L, nullptr);
+    GLOW_ASSERT(err == CL_SUCCESS && "Error in clGetKernelWorkGroupInfo.");
+    size_t workGroupSize = 1;
+    for (auto l : local) {
+      workGroupSize *= l;
+    }
+    (void)workGroupSize;
+    GLOW_ASSERT(workGroupSize <= L &&
+                "The tile is too large for the kernel on this device");
+    launch.local_.assign(local.begin(), local.end());
+  }
   char kernelName[128];
   size_t retSize;
   cl_int err = clGetKernelInfo(kernel, CL_KERNEL_FUNCTION_NAME,
                                sizeof(kernelName), &kernelName, &retSize);
   GLOW_ASSERT(err == CL_SUCCESS && "Error in clGetKernelInfo.");
+  launch.kernel_ = kernel;
+  launch.name_ = kernelName;
+  launch.instr_ = currentInstr_;
+  launches_.push_back(std::move(launch));
+}
 
-  cl_event event{nullptr};
-  err = clEnqueueNDRangeKernel(commands, kernel, global.size(), nullptr,
-                               &global[0], &local[0], 0, nullptr,
-                               doProfile ? &event : nullptr);
-  GLOW_ASSERT(err == CL_SUCCESS && "Error in clEnqueueNDRangeKernel.");
-  kernelLaunches.push_back(KernelLaunch(kernel, kernelName, event));
+void OCLBackend::addTiledKernelLaunch(cl_kernel kernel, size_t rows,
+                                      size_t cols) {
+  size_t numCols = (cols + tileSize_ - 1) / tileSize_;
+  size_t numRows = (rows + tileSize_ - 1) / tileSize_;
+  size_t tileRows = tileSize_ / workPerThread_;
+  addKernelLaunch(kernel, {numCols * tileSize_, numRows * tileRows},
+                  {tileSize_, tileRows});
+}
+
+void OCLBackend::releaseLaunches() {
+  for (auto &launch : launches_) {
+    if (launch.kernel_) {
+      clReleaseKernel(launch.kernel_);
+    }
+  }
+  launches_.clear();
 }
 
 /// Analyze and dump the collected profiling information about the execution of
@@ -307,13 +639,370 @@ static void dumpProfileInfo(const std::vector<KernelLaunch> &kernelLaunches) {
   }
 }
 
-void OCLBackend::doForwardPass() {
-  auto copiedToDeviceBytes = copyMutableWeightsToDevice();
-  (void)copiedToDeviceBytes;
-  DEBUG(llvm::dbgs() << "Copied " << copiedToDeviceBytes
-                     << " bytes to OpenCL device\n");
+/// Record the executions of the kernels of \p kernelLaunches in the timeline.
+/// The clock of the device is unrelated to the one of the host, so the first
+/// kernel is placed at \p hostBegin, the time at which the run started.
+static void traceKernelLaunches(const std::vector<KernelLaunch> &kernelLaunches,
+                                uint64_t hostBegin) {
+  std::vector<std::pair<cl_ulong, cl_ulong>> times;
+  times.reserve(kernelLaunches.size());
+  cl_ulong deviceBegin = ~cl_ulong(0);
+  for (auto &kl : kernelLaunches) {
+    cl_ulong time_start;
+    cl_ulong time_end;
+    clGetEventProfilingInfo(kl.event_, CL_PROFILING_COMMAND_START,
+                            sizeof(time_start), &time_start, NULL);
+    clGetEventProfilingInfo(kl.event_, CL_PROFILING_COMMAND_END,
+                            sizeof(time_end), &time_end, NULL);
+    times.emplace_back(time_start, time_end);
+    deviceBegin = std::min(deviceBegin, time_start);
+  }
+  for (size_t i = 0, e = kernelLaunches.size(); i < e; i++) {
+    traceEvent(kernelLaunches[i].name_, TraceKernel,
+               hostBegin + (times[i].first - deviceBegin),
+               hostBegin + (times[i].second - deviceBegin));
+  }
+}
 
-  for (auto &I : F_->getInstrs()) {
+/// The max number of the instructions that a fused kernel computes, which
+/// bounds the number of its arguments.
+static constexpr size_t maxFusedInstrs = 32;
+
+/// \returns true if the instruction \p I can be computed by a fused kernel.
+static bool isFusableElementwise(const Instruction *I) {
+  switch (I->getKind()) {
+  case Kind::ElementAddInstKind:
+  case Kind::ElementSubInstKind:
+  case Kind::ElementMulInstKind:
+  case Kind::ElementDivInstKind:
+  case Kind::ElementMaxInstKind:
+  case Kind::ElementMinInstKind:
+  case Kind::ElementCmpLTEInstKind:
+  case Kind::ElementSelectInstKind:
+  case Kind::ElementAddSplatInstKind:
+  case Kind::ElementMulSplatInstKind:
+  case Kind::ElementMaxSplatInstKind:
+  case Kind::ElementMinSplatInstKind:
+  case Kind::ElementSubSplatLHSInstKind:
+  case Kind::ElementDivSplatLHSInstKind:
+  case Kind::ElementDivSplatRHSInstKind:
+  case Kind::ElementCmpLTESplatLHSInstKind:
+  case Kind::ElementCmpLTESplatRHSInstKind:
+  case Kind::ElementSelectSplatLHSInstKind:
+  case Kind::ElementSelectSplatRHSInstKind:
+  case Kind::SigmoidInstKind:
+  case Kind::TanhInstKind:
+  case Kind::SplatInstKind:
+    break;
+  default:
+    return false;
+  }
+  for (const auto &op : I->getOperands()) {
+    if (op.first->getElementType() != ElemKind::FloatTy) {
+      return false;
+    }
+  }
+  return true;
+}
+
+/// \returns the value of the splat, or of the splat operand, of the
+/// element-wise instruction \p I, which is passed to its kernel as a
+/// parameter, or None if \p I has none.
+static llvm::Optional<float> getSplatImmediate(const Instruction *I) {
+  if (auto *SI = dyn_cast<SplatInst>(I)) {
+    return SI->getValue();
+  }
+  switch (I->getKind()) {
+#define SPLAT_OPERAND_IMM(INST_NAME_)                                          \
+  case Kind::INST_NAME_##InstKind:                                             \
+    return cast<INST_NAME_##Inst>(I)->getSplatValue();
+    SPLAT_OPERAND_IMM(ElementAddSplat)
+    SPLAT_OPERAND_IMM(ElementMulSplat)
+    SPLAT_OPERAND_IMM(ElementMaxSplat)
+    SPLAT_OPERAND_IMM(ElementMinSplat)
+    SPLAT_OPERAND_IMM(ElementSubSplatLHS)
+    SPLAT_OPERAND_IMM(ElementDivSplatLHS)
+    SPLAT_OPERAND_IMM(ElementDivSplatRHS)
+    SPLAT_OPERAND_IMM(ElementCmpLTESplatLHS)
+    SPLAT_OPERAND_IMM(ElementCmpLTESplatRHS)
+    SPLAT_OPERAND_IMM(ElementSelectSplatLHS)
+    SPLAT_OPERAND_IMM(ElementSelectSplatRHS)
+#undef SPLAT_OPERAND_IMM
+  default:
+    return llvm::None;
+  }
+}
+
+/// \returns the OpenCL expression that computes the element-wise instruction
+/// \p I of the type \p vtype from the values \p ops of its inputs. The value
+/// of the splat operand, if any, is the first of \p ops.
+static std::string getFusedExpr(const Instruction *I, const std::string &vtype,
+                                llvm::ArrayRef<std::string> ops) {
+  switch (I->getKind()) {
+  case Kind::ElementAddInstKind:
+    return ops[0] + " + " + ops[1];
+  case Kind::ElementSubInstKind:
+    return ops[0] + " - " + ops[1];
+  case Kind::ElementMulInstKind:
+    return ops[0] + " * " + ops[1];
+  case Kind::ElementDivInstKind:
+    return ops[0] + " / " + ops[1];
+  case Kind::ElementMaxInstKind:
+    return "max(" + ops[0] + ", " + ops[1] + ")";
+  case Kind::ElementMinInstKind:
+    return "min(" + ops[0] + ", " + ops[1] + ")";
+  case Kind::ElementCmpLTEInstKind:
+    return "select((" + vtype + ")0, (" + vtype + ")1, islessequal(" + ops[0] +
+           ", " + ops[1] + "))";
+  case Kind::ElementSelectInstKind:
+    return "select(" + ops[2] + ", " + ops[1] + ", isnotequal(" + ops[0] +
+           ", (" + vtype + ")0))";
+  case Kind::SigmoidInstKind:
+    return "1 / (1 + exp(-" + ops[0] + "))";
+  case Kind::TanhInstKind:
+    return "1 - 2 / (exp(" + ops[0] + " * 2) + 1)";
+  case Kind::SplatInstKind:
+    return "(" + vtype + ")" + ops[0];
+  case Kind::ElementAddSplatInstKind:
+    return ops[1] + " + " + ops[0];
+  case Kind::ElementMulSplatInstKind:
+    return ops[1] + " * " + ops[0];
+  case Kind::ElementMaxSplatInstKind:
+    return "max(" + ops[1] + ", (" + vtype + ")" + ops[0] + ")";
+  case Kind::ElementMinSplatInstKind:
+    return "min(" + ops[1] + ", (" + vtype + ")" + ops[0] + ")";
+  case Kind::ElementSubSplatLHSInstKind:
+    return ops[0] + " - " + ops[1];
+  case Kind::ElementDivSplatLHSInstKind:
+    return ops[0] + " / " + ops[1];
+  case Kind::ElementDivSplatRHSInstKind:
+    return ops[1] + " / " + ops[0];
+  case Kind::ElementCmpLTESplatLHSInstKind:
+    return "select((" + vtype + ")0, (" + vtype + ")1, islessequal((" + vtype +
+           ")" + ops[0] + ", " + ops[1] + "))";
+  case Kind::ElementCmpLTESplatRHSInstKind:
+    return "select((" + vtype + ")0, (" + vtype + ")1, islessequal(" + ops[1] +
+           ", (" + vtype + ")" + ops[0] + "))";
+  case Kind::ElementSelectSplatLHSInstKind:
+    return "select(" + ops[2] + ", (" + vtype + ")" + ops[0] + ", isnotequal(" +
+           ops[1] + ", (" + vtype + ")0))";
+  case Kind::ElementSelectSplatRHSInstKind:
+    return "select((" + vtype + ")" + ops[0] + ", " + ops[2] + ", isnotequal(" +
+           ops[1] + ", (" + vtype + ")0))";
+  default:
+    GLOW_UNREACHABLE("Not a fusable instruction");
+  }
+}
+
+/// \returns true if the buffer \p buf, or a view of it, is used by an
+/// instruction that is not in \p run, besides its deallocation.
+static bool isUsedOutside(Value *buf, llvm::ArrayRef<const Instruction *> run) {
+  for (const auto &U : buf->getUsers()) {
+    auto *user = U.get();
+    if (auto *TV = dyn_cast<TensorViewInst>(user)) {
+      if (isUsedOutside(TV, run)) {
+        return true;
+      }
+      continue;
+    }
+    if (!isa<DeallocActivationInst>(user) &&
+        std::find(run.begin(), run.end(), user) == run.end()) {
+      return true;
+    }
+  }
+  return false;
+}
+
+bool OCLBackend::canFuse(llvm::ArrayRef<const Instruction *> run,
+                         const Instruction *I) {
+  if (run.size() >= maxFusedInstrs ||
+      I->getOperand(0).first->size() != run[0]->getOperand(0).first->size()) {
+    return false;
+  }
+  // Every work-item computes the elements at its index for all of the
+  // instructions, so it must not write an element that another work-item
+  // reads. This holds if the operands that overlap in the device memory,
+  // e.g. the views of a buffer or the activations that reuse the memory of a
+  // dead one, start at the same address.
+  for (const auto &op : I->getOperands()) {
+    size_t begin = tensors_[op.first];
+    size_t end = begin + op.first->getSizeInBytes();
+    for (const auto *RI : run) {
+      for (const auto &runOp : RI->getOperands()) {
+        size_t runBegin = tensors_[runOp.first];
+        size_t runEnd = runBegin + runOp.first->getSizeInBytes();
+        if (begin < runEnd && runBegin < end && begin != runBegin) {
+          return false;
+        }
+      }
+    }
+  }
+  return true;
+}
+
+std::vector<std::vector<const Instruction *>> OCLBackend::findFusedRuns() {
+  std::vector<std::vector<const Instruction *>> runs;
+  if (!fuseElementwise) {
+    return runs;
+  }
+  std::vector<const Instruction *> run;
+  auto endRun = [&]() {
+    if (run.size() > 1) {
+      runs.push_back(run);
+    }
+    run.clear();
+  };
+  for (auto *I : F_->getInstrs()) {
+    // The memory allocation instructions are NOPs and don't end the run.
+    if (isa<AllocActivationInst>(I) || isa<DeallocActivationInst>(I) ||
+        isa<TensorViewInst>(I)) {
+      continue;
+    }
+    if (!isFusableElementwise(I)) {
+      endRun();
+      continue;
+    }
+    if (!run.empty() && !canFuse(run, I)) {
+      endRun();
+    }
+    run.push_back(I);
+  }
+  endRun();
+  return runs;
+}
+
+void OCLBackend::addFusedKernelLaunch(llvm::ArrayRef<const Instruction *> run) {
+  // A work-item computes 8 elements with vector instructions if the size
+  // allows it.
+  size_t global = run[0]->getOperand(0).first->size();
+  bool isVector = global % 8 == 0;
+  std::string vtype = isVector ? "float8" : "float";
+  if (isVector) {
+    global /= 8;
+  }
+
+  // The kernel takes the offset of every distinct buffer and the values of
+  // the splats. The buffers are identified by their address, so the values
+  // written by the run are read from the registers that hold them.
+  std::vector<size_t> buffers;
+  std::vector<float> splats;
+  std::unordered_map<size_t, std::string> registers;
+  std::string body;
+  llvm::raw_string_ostream OS(body);
+  auto getBuffer = [&](size_t addr) {
+    auto it = std::find(buffers.begin(), buffers.end(), addr);
+    size_t idx = it - buffers.begin();
+    if (it == buffers.end()) {
+      buffers.push_back(addr);
+    }
+    return "p" + std::to_string(idx);
+  };
+  unsigned numRegisters = 0;
+  auto newRegister = [&]() { return "r" + std::to_string(numRegisters++); };
+
+  std::string name = "fused";
+  for (const auto *I : run) {
+    name += "_" + std::string(I->getKindName());
+    std::vector<std::string> ops;
+    if (auto imm = getSplatImmediate(I)) {
+      ops.push_back("s" + std::to_string(splats.size()));
+      splats.push_back(*imm);
+    }
+    for (unsigned i = 1, e = I->getNumOperands(); i < e; i++) {
+      size_t addr = tensors_[I->getOperand(i).first];
+      auto it = registers.find(addr);
+      if (it != registers.end()) {
+        ops.push_back(it->second);
+        continue;
+      }
+      std::string reg = newRegister();
+      std::string buf = getBuffer(addr);
+      OS << "  " << vtype << " " << reg << " = "
+         << (isVector ? "vload8(i, " + buf + ")" : buf + "[i]") << ";\n";
+      registers[addr] = reg;
+      ops.push_back(reg);
+    }
+
+    Value *dest = I->getOperand(0).first;
+    size_t addr = tensors_[dest];
+    std::string reg = newRegister();
+    OS << "  " << vtype << " " << reg << " = " << getFusedExpr(I, vtype, ops)
+       << ";\n";
+    registers[addr] = reg;
+    // The activations that only the run uses are never written to memory.
+    Value *origin = getOrigin(dest);
+    if (!isa<AllocActivationInst>(origin) || isUsedOutside(origin, run)) {
+      std::string buf = getBuffer(addr);
+      OS << "  "
+         << (isVector ? "vstore8(" + reg + ", i, " + buf + ")"
+                      : buf + "[i] = " + reg)
+         << ";\n";
+    }
+  }
+
+  std::string source;
+  llvm::raw_string_ostream SS(source);
+  SS << "__kernel void fusedW(__global void *mem";
+  for (size_t i = 0, e = buffers.size(); i < e; i++) {
+    SS << ", uint b" << i;
+  }
+  for (size_t i = 0, e = splats.size(); i < e; i++) {
+    SS << ", float s" << i;
+  }
+  SS << ") {\n  size_t i = get_global_id(0);\n";
+  for (size_t i = 0, e = buffers.size(); i < e; i++) {
+    SS << "  __global float *p" << i
+       << " = (__global float *)((__global char *)mem + b" << i << ");\n";
+  }
+  SS << OS.str() << "}\n";
+
+  cl_program program = createProgram(SS.str(), {}, commands_);
+  cl_kernel kernel = createKernel("fusedW", program);
+  setKernelArg(kernel, 0, deviceBuffer_);
+  unsigned arg = 1;
+  for (size_t addr : buffers) {
+    setKernelArg<cl_uint>(kernel, arg++, addr);
+  }
+  for (float val : splats) {
+    setKernelArg(kernel, arg++, val);
+  }
+
+  currentInstr_ = run[0];
+  addKernelLaunch(kernel, {global});
+  auto &launch = launches_.back();
+  launch.name_ = name;
+  launch.fused_.assign(run.begin() + 1, run.end());
+}
+
+void OCLBackend::recordLaunches() {
+  releaseLaunches();
+  for (auto *v : uploads_) {
+    LaunchCommand upload(LaunchCommand::Kind::Upload);
+    upload.value_ = v;
+    launches_.push_back(std::move(upload));
+  }
+
+  // The runs of element-wise instructions are computed by a fused kernel,
+  // which is launched in place of the first instruction of the run.
+  auto runs = findFusedRuns();
+  std::unordered_map<const Instruction *, size_t> fusedInstrs;
+  for (size_t i = 0, e = runs.size(); i < e; i++) {
+    for (const auto *I : runs[i]) {
+      fusedInstrs[I] = i;
+    }
+  }
+
+  for (auto *I : F_->getInstrs()) {
+    auto fused = fusedInstrs.find(I);
+    if (fused != fusedInstrs.end()) {
+      auto &run = runs[fused->second];
+      if (run[0] == I) {
+        addFusedKernelLaunch(run);
+      }
+      continue;
+    }
+
+    currentInstr_ = I;
     // The kernels are named after the name of the instruction, plus the "W"
     // suffix to prevent name colissions for functions like 'tanh' that are also
     // a part of the OpenCL runtime.
@@ -331,9 +1020,13 @@ void OCLBackend::doForwardPass() {
     if (I->isDataParallel() && !isa<CopyInst>(I)) {
       // Figure out how many element-wise elements are there to process:
       size_t global;
+      // The quantized kernels are not vectorized.
+      bool isQuantized = elemTy == ElemKind::Int8QTy;
       if (I->isDataParallel()) {
         global = I->getOperand(0).first->getType()->size();
-        if (global % 16 == 0) {
+        if (isQuantized) {
+          // Process one element per kernel.
+        } else if (global % 16 == 0) {
           // Start less kernels and let each kernel do more work using vector
           // instructions.
           global /= 16;
@@ -357,12 +1050,14 @@ void OCLBackend::doForwardPass() {
                               tensors_[I->getOperand(arg).first]);
       }
 
-      if (auto *SI = dyn_cast<SplatInst>(I)) {
-        // Pass the splat as a parameter.
-        setKernelArg(kernel, numArgs + 1, SI->getValue());
+      if (isQuantized) {
+        setQuantizedDataParallelArgs(kernel, numArgs + 1, I);
+      } else if (auto imm = getSplatImmediate(I)) {
+        // Pass the splat, or the splat operand, as a parameter.
+        setKernelArg(kernel, numArgs + 1, *imm);
       }
 
-      enqueueKernel(commands_, kernel, deviceId_, {global}, kernelLaunches_);
+      addKernelLaunch(kernel, {global});
       continue;
     }
 
@@ -387,7 +1082,7 @@ void OCLBackend::doForwardPass() {
       // Pass the slice size (size of each sample in the batch) as a parameter.
       setKernelArg<cl_uint>(kernel, numArgs + 1, flattenCdr(inputDims).second);
 
-      enqueueKernel(commands_, kernel, deviceId_, {numSlices}, kernelLaunches_);
+      addKernelLaunch(kernel, {numSlices});
       continue;
     }
 
@@ -412,7 +1107,28 @@ void OCLBackend::doForwardPass() {
       // Pass the slice size (size of each sample in the batch) as a parameter.
       setKernelArg<cl_uint>(kernel, numArgs + 1, flattenCdr(inputDims).second);
 
-      enqueueKernel(commands_, kernel, deviceId_, {numSlices}, kernelLaunches_);
+      addKernelLaunch(kernel, {numSlices});
+      continue;
+    }
+
+    if (auto *SGD = dyn_cast<SGDInst>(I)) {
+      // Update every element of the weight in a separate work item.
+      cl_kernel kernel = createKernel(kernelName);
+      setKernelArg(kernel, 0, deviceBuffer_);
+
+      auto *W = SGD->getWeight();
+      // Without momentum the gsum is void and the kernel does not access it.
+      Value *gsum = SGD->getMomentum() > 0 ? SGD->getGsum() : W;
+      setKernelArg<cl_uint>(kernel, 1, tensors_[W]);
+      setKernelArg<cl_uint>(kernel, 2, tensors_[gsum]);
+      setKernelArg<cl_uint>(kernel, 3, tensors_[SGD->getGradient()]);
+      setKernelArg(kernel, 4, SGD->getL1Decay());
+      setKernelArg(kernel, 5, SGD->getL2Decay());
+      setKernelArg(kernel, 6, SGD->getLearningRate());
+      setKernelArg(kernel, 7, SGD->getMomentum());
+      setKernelArg<float>(kernel, 8, std::max(SGD->getBatchSize(), 1u));
+
+      addKernelLaunch(kernel, {W->size()});
       continue;
     }
 
@@ -456,7 +1172,7 @@ void OCLBackend::doForwardPass() {
       setKernelArg(kernel, 3, odim);
       setKernelArg(kernel, 4, idim);
       setKernelArg(kernel, 5, offset);
-      enqueueKernel(commands_, kernel, deviceId_, {odim.n}, kernelLaunches_);
+      addKernelLaunch(kernel, {odim.n});
       continue;
     }
 
@@ -499,14 +1215,30 @@ void OCLBackend::doForwardPass() {
       setKernelArg(kernel, 3, odim);
       setKernelArg(kernel, 4, idim);
       setKernelArg(kernel, 5, offset);
-      enqueueKernel(commands_, kernel, deviceId_, {idim.n}, kernelLaunches_);
+      addKernelLaunch(kernel, {idim.n});
       continue;
     }
 
     if (auto *BMM = dyn_cast<MatMulInst>(I)) {
       // This is a naive implementation that parallelizes using three dims:
       // batch, X and Y in the output filter.
-      cl_kernel kernel = createKernel(kernelName);
+      auto ddim = ShapeNHWC::fromXY(BMM->getDest()->getType()->dims());
+      auto ldim = ShapeNHWC::fromXY(BMM->getLHS()->getType()->dims());
+      auto rdim = ShapeNHWC::fromXY(BMM->getRHS()->getType()->dims());
+
+      cl_kernel kernel;
+      if (BMM->getLHS()->getType()->isQuantizedType()) {
+        kernel = createKernel(kernelName);
+      } else {
+        std::vector<std::string> defines;
+        addShapeDefines(defines, "SPEC_DDIM", ddim);
+        addShapeDefines(defines, "SPEC_LDIM", ldim);
+        defines.push_back("-DSPEC_TRANS_LHS=" +
+                          std::to_string(BMM->getTransposeLHS()));
+        defines.push_back("-DSPEC_TRANS_RHS=" +
+                          std::to_string(BMM->getTransposeRHS()));
+        kernel = createSpecializedKernel(kernelName, defines);
+      }
       setKernelArg(kernel, 0, deviceBuffer_);
 
       unsigned numArgs = I->getNumOperands();
@@ -515,18 +1247,27 @@ void OCLBackend::doForwardPass() {
                               tensors_[I->getOperand(arg).first]);
       }
 
-      auto ddim = ShapeNHWC::fromXY(BMM->getDest()->getType()->dims());
-      auto ldim = ShapeNHWC::fromXY(BMM->getLHS()->getType()->dims());
-      auto rdim = ShapeNHWC::fromXY(BMM->getRHS()->getType()->dims());
-
       setKernelArg(kernel, 4, ddim);
       setKernelArg(kernel, 5, ldim);
       setKernelArg(kernel, 6, rdim);
+      if (BMM->getLHS()->getType()->isQuantizedType()) {
+        auto *destTy = BMM->getDest()->getType();
+        auto *lhsTy = BMM->getLHS()->getType();
+        auto *rhsTy = BMM->getRHS()->getType();
+        setKernelArg<cl_int>(kernel, 7, destTy->getOffset());
+        setKernelArg<cl_int>(kernel, 8, lhsTy->getOffset());
+        setKernelArg<cl_int>(kernel, 9, rhsTy->getOffset());
+        setScaleArgs(kernel, 10,
+                     lhsTy->getScale() * rhsTy->getScale() /
+                         destTy->getScale());
+      } else {
+        setKernelArg<cl_uint>(kernel, 7, BMM->getTransposeLHS());
+        setKernelArg<cl_uint>(kernel, 8, BMM->getTransposeRHS());
+      }
 
-      // Use a 3D grid where the first dimension is the N and the second and
-      // third dimensions are the X and Y in the output buffer.
-      enqueueKernel(commands_, kernel, deviceId_, {ddim.n, ddim.h, ddim.w},
-                    kernelLaunches_);
+      // Every work-group computes a tile of the result. The first dimension
+      // of the grid is the columns and the second one is the rows.
+      addTiledKernelLaunch(kernel, ddim.n, ddim.h);
       continue;
     }
 
@@ -543,10 +1284,24 @@ void OCLBackend::doForwardPass() {
       auto bdim = flattenCdr(BA->getBatch()->dims());
       setKernelArg<cl_uint>(kernel, 4, bdim.first);
       setKernelArg<cl_uint>(kernel, 5, bdim.second);
+      if (BA->getBatch()->getType()->isQuantizedType()) {
+        auto *destTy = BA->getDest()->getType();
+        auto *batchTy = BA->getBatch()->getType();
+        auto *sliceTy = BA->getSlice()->getType();
+        GLOW_ASSERT(sliceTy->getElementType() == ElemKind::Int8QTy &&
+                    "Unsupported quantized slice");
+        setKernelArg<cl_int>(kernel, 6, destTy->getOffset());
+        setKernelArg<cl_int>(kernel, 7, batchTy->getOffset());
+        setKernelArg<cl_int>(kernel, 8, sliceTy->getOffset());
+        // Both summands are scaled to the scale of the result.
+        float destScale = destTy->getScale();
+        unsigned argIdx =
+            setScaleArgs(kernel, 9, batchTy->getScale() / destScale);
+        setScaleArgs(kernel, argIdx, sliceTy->getScale() / destScale);
+      }
 
       // Parallelize on each element in the slice.
-      enqueueKernel(commands_, kernel, deviceId_, {bdim.second},
-                    kernelLaunches_);
+      addKernelLaunch(kernel, {bdim.second});
       continue;
     }
 
@@ -563,16 +1318,20 @@ void OCLBackend::doForwardPass() {
       auto bdim = flattenCdr(BRA->getBatch()->dims());
       setKernelArg<cl_uint>(kernel, 3, bdim.first);
       setKernelArg<cl_uint>(kernel, 4, bdim.second);
+      if (BRA->getBatch()->getType()->isQuantizedType()) {
+        auto *destTy = BRA->getDest()->getType();
+        auto *batchTy = BRA->getBatch()->getType();
+        setKernelArg<cl_int>(kernel, 5, destTy->getOffset());
+        setKernelArg<cl_int>(kernel, 6, batchTy->getOffset());
+        setScaleArgs(kernel, 7, batchTy->getScale() / destTy->getScale());
+      }
 
       // Parallelize on each element in the slice.
-      enqueueKernel(commands_, kernel, deviceId_, {bdim.second},
-                    kernelLaunches_);
+      addKernelLaunch(kernel, {bdim.second});
       continue;
     }
 
-    if (auto *CC = dyn_cast<ConvolutionInst>(I)) {
-      // This is a naive implementation that parallelizes using three dims:
-      // the X and the Y in the output filter.
+    if (auto *RI = dyn_cast<ReduceInst>(I)) {
       cl_kernel kernel = createKernel(kernelName);
       setKernelArg(kernel, 0, deviceBuffer_);
 
@@ -582,27 +1341,86 @@ void OCLBackend::doForwardPass() {
                               tensors_[I->getOperand(arg).first]);
       }
 
+      // The collapsed dimensions are padded at the front with kept
+      // dimensions of size 1.
+      ShapeVector dims, reduced;
+      collapseReduceDims(RI->getSrc()->dims(), RI->getAxes(), dims, reduced);
+      assert(dims.size() <= 4 && "Unsupported tensor dimension");
+      dims.insert(dims.begin(), 4 - dims.size(), 1);
+      reduced.insert(reduced.begin(), 4 - reduced.size(), 0);
+      setKernelArg(kernel, 3, ShapeNHWC(dims));
+      setKernelArg(kernel, 4, ShapeNHWC(reduced));
+      setKernelArg<cl_uint>(kernel, 5, RI->getMode());
+
+      // Parallelize on each element of the result.
+      addKernelLaunch(kernel, {RI->getDest()->size()});
+      continue;
+    }
+
+    if (auto *CC = dyn_cast<ConvolutionInst>(I)) {
+      // This is a naive implementation that parallelizes using three dims:
+      // the X and the Y in the output filter.
       auto odim = ShapeNHWC(CC->getDest()->getType()->dims());
       auto idim = ShapeNHWC(CC->getSrc()->getType()->dims());
 
+      cl_kernel kernel;
+      if (CC->getSrc()->getType()->isQuantizedType()) {
+        kernel = createKernel(kernelName);
+      } else {
+        std::vector<std::string> defines;
+        addWindowDefines(defines, CC->getKernel(), CC->getStride(),
+                         CC->getPad(), odim, idim);
+        kernel = createSpecializedKernel(kernelName, defines);
+      }
+      setKernelArg(kernel, 0, deviceBuffer_);
+
+      unsigned numArgs = I->getNumOperands();
+      for (unsigned arg = 0; arg < numArgs; arg++) {
+        setKernelArg<cl_uint>(kernel, arg + 1,
+                              tensors_[I->getOperand(arg).first]);
+      }
+
       setKernelArg<cl_uint>(kernel, 5, CC->getKernel());
       setKernelArg<cl_uint>(kernel, 6, CC->getStride());
       setKernelArg<cl_uint>(kernel, 7, CC->getPad());
       setKernelArg(kernel, 8, odim);
       setKernelArg(kernel, 9, idim);
       setKernelArg(kernel, 10, ShapeNHWC(CC->getFilter()->getType()->dims()));
+      if (CC->getSrc()->getType()->isQuantizedType()) {
+        auto *destTy = CC->getDest()->getType();
+        auto *srcTy = CC->getSrc()->getType();
+        auto *filterTy = CC->getFilter()->getType();
+        auto *biasTy = CC->getBias()->getType();
+        GLOW_ASSERT(biasTy->getElementType() == ElemKind::Int8QTy &&
+                    "Unsupported quantized bias");
+        setKernelArg<cl_int>(kernel, 11, destTy->getOffset());
+        setKernelArg<cl_int>(kernel, 12, srcTy->getOffset());
+        setKernelArg<cl_int>(kernel, 13, filterTy->getOffset());
+        setKernelArg<cl_int>(kernel, 14, biasTy->getOffset());
+        // The bias is scaled to the scale of the accumulators, which is the
+        // product of the scales of the input and the filter.
+        float matMulScale = srcTy->getScale() * filterTy->getScale();
+        unsigned argIdx =
+            setScaleArgs(kernel, 15, biasTy->getScale() / matMulScale);
+        setScaleArgs(kernel, argIdx, matMulScale / destTy->getScale());
+      }
 
-      // Use a 3D grid where the first dimension is the depth and the second
-      // dimension is the slice index in the batch.
-      enqueueKernel(commands_, kernel, deviceId_, {odim.h, odim.w, odim.c},
-                    kernelLaunches_);
+      // Every work-group computes a tile of the output pixels and the output
+      // channels.
+      addTiledKernelLaunch(kernel, odim.n * odim.h * odim.w, odim.c);
       continue;
     }
 
     if (auto *PM = dyn_cast<PoolMaxInst>(I)) {
       // This is a naive implementation that parallelizes using three dims:
       // the X and the Y in the output filter.
-      cl_kernel kernel = createKernel(kernelName);
+      auto odim = ShapeNHWC(PM->getDest()->getType()->dims());
+      auto idim = ShapeNHWC(PM->getSrc()->getType()->dims());
+
+      std::vector<std::string> defines;
+      addWindowDefines(defines, PM->getKernel(), PM->getStride(), PM->getPad(),
+                       odim, idim);
+      cl_kernel kernel = createSpecializedKernel(kernelName, defines);
       setKernelArg(kernel, 0, deviceBuffer_);
 
       unsigned numArgs = I->getNumOperands();
@@ -611,17 +1429,13 @@ void OCLBackend::doForwardPass() {
                               tensors_[I->getOperand(arg).first]);
       }
 
-      auto odim = ShapeNHWC(PM->getDest()->getType()->dims());
-      auto idim = ShapeNHWC(PM->getSrc()->getType()->dims());
-
       setKernelArg<cl_uint>(kernel, numArgs + 1, PM->getKernel());
       setKernelArg<cl_uint>(kernel, numArgs + 2, PM->getStride());
       setKernelArg<cl_uint>(kernel, numArgs + 3, PM->getPad());
       setKernelArg(kernel, numArgs + 4, odim);
       setKernelArg(kernel, numArgs + 5, idim);
 
-      enqueueKernel(commands_, kernel, deviceId_, {odim.h, odim.w, odim.c},
-                    kernelLaunches_);
+      addKernelLaunch(kernel, {odim.h, odim.w, odim.c});
       continue;
     }
 
@@ -646,14 +1460,33 @@ void OCLBackend::doForwardPass() {
       setKernelArg(kernel, numArgs + 4, odim);
       setKernelArg(kernel, numArgs + 5, idim);
 
-      enqueueKernel(commands_, kernel, deviceId_, {odim.h, odim.w, odim.c},
-                    kernelLaunches_);
+      addKernelLaunch(kernel, {odim.h, odim.w, odim.c});
       continue;
     }
 
-    if (auto *PA = dyn_cast<PoolAvgInst>(I)) {
-      // This is a naive implementation that parallelizes using three dims:
-      // the X and the Y in the output filter.
+    if (auto *LRN = dyn_cast<LocalResponseNormalizationInst>(I)) {
+      // Every pixel is normalized by a different work item.
+      cl_kernel kernel = createKernel(kernelName);
+      setKernelArg(kernel, 0, deviceBuffer_);
+
+      unsigned numArgs = I->getNumOperands();
+      for (unsigned arg = 0; arg < numArgs; arg++) {
+        setKernelArg<cl_uint>(kernel, arg + 1,
+                              tensors_[I->getOperand(arg).first]);
+      }
+
+      auto dim = ShapeNHWC(LRN->getDest()->getType()->dims());
+      setKernelArg<cl_uint>(kernel, numArgs + 1, LRN->getHalfWindowSize());
+      setKernelArg(kernel, numArgs + 2, LRN->getAlpha());
+      setKernelArg(kernel, numArgs + 3, LRN->getBeta());
+      setKernelArg(kernel, numArgs + 4, LRN->getK());
+      setKernelArg(kernel, numArgs + 5, dim);
+
+      addKernelLaunch(kernel, {dim.n * dim.h * dim.w});
+      continue;
+    }
+
+    if (auto *LRNG = dyn_cast<LocalResponseNormalizationGradInst>(I)) {
       cl_kernel kernel = createKernel(kernelName);
       setKernelArg(kernel, 0, deviceBuffer_);
 
@@ -663,17 +1496,89 @@ void OCLBackend::doForwardPass() {
                               tensors_[I->getOperand(arg).first]);
       }
 
+      auto dim = ShapeNHWC(LRNG->getDest()->getType()->dims());
+      setKernelArg<cl_uint>(kernel, numArgs + 1, LRNG->getHalfWindowSize());
+      setKernelArg(kernel, numArgs + 2, LRNG->getAlpha());
+      setKernelArg(kernel, numArgs + 3, LRNG->getBeta());
+      setKernelArg(kernel, numArgs + 4, dim);
+
+      addKernelLaunch(kernel, {dim.n * dim.h * dim.w});
+      continue;
+    }
+
+    if (auto *PA = dyn_cast<PoolAvgInst>(I)) {
+      // This is a naive implementation that parallelizes using three dims:
+      // the X and the Y in the output filter.
       auto odim = ShapeNHWC(PA->getDest()->getType()->dims());
       auto idim = ShapeNHWC(PA->getSrc()->getType()->dims());
 
+      cl_kernel kernel;
+      if (PA->getSrc()->getType()->isQuantizedType()) {
+        kernel = createKernel(kernelName);
+      } else {
+        std::vector<std::string> defines;
+        addWindowDefines(defines, PA->getKernel(), PA->getStride(),
+                         PA->getPad(), odim, idim);
+        kernel = createSpecializedKernel(kernelName, defines);
+      }
+      setKernelArg(kernel, 0, deviceBuffer_);
+
+      unsigned numArgs = I->getNumOperands();
+      for (unsigned arg = 0; arg < numArgs; arg++) {
+        setKernelArg<cl_uint>(kernel, arg + 1,
+                              tensors_[I->getOperand(arg).first]);
+      }
+
       setKernelArg<cl_uint>(kernel, 3, PA->getKernel());
       setKernelArg<cl_uint>(kernel, 4, PA->getStride());
       setKernelArg<cl_uint>(kernel, 5, PA->getPad());
       setKernelArg(kernel, 6, odim);
       setKernelArg(kernel, 7, idim);
+      if (PA->getSrc()->getType()->isQuantizedType()) {
+        auto *destTy = PA->getDest()->getType();
+        auto *srcTy = PA->getSrc()->getType();
+        setKernelArg<cl_int>(kernel, 8, destTy->getOffset());
+        setKernelArg<cl_int>(kernel, 9, srcTy->getOffset());
+        // The sum is divided by the area of the filter.
+        float area = PA->getKernel() * PA->getKernel();
+        setScaleArgs(kernel, 10, srcTy->getScale() / destTy->getScale() / area);
+      }
+
+      addKernelLaunch(kernel, {odim.h, odim.w, odim.c});
+      continue;
+    }
 
-      enqueueKernel(commands_, kernel, deviceId_, {odim.h, odim.w, odim.c},
-                    kernelLaunches_);
+    if (isa<QuantizeInst>(I) || isa<DequantizeInst>(I)) {
+      // The quantization parameters are the ones of the quantized operand.
+      auto *dest = I->getOperand(0).first;
+      auto *src = I->getOperand(1).first;
+      auto *QTy = isa<QuantizeInst>(I) ? dest->getType() : src->getType();
+      GLOW_ASSERT(QTy->getElementType() == ElemKind::Int8QTy &&
+                  "Unsupported quantized type");
+      cl_kernel kernel = createKernel(kernelName);
+      setKernelArg(kernel, 0, deviceBuffer_);
+      setKernelArg<cl_uint>(kernel, 1, tensors_[dest]);
+      setKernelArg<cl_uint>(kernel, 2, tensors_[src]);
+      setKernelArg<float>(kernel, 3, QTy->getScale());
+      setKernelArg<cl_int>(kernel, 4, QTy->getOffset());
+      addKernelLaunch(kernel, {dest->getType()->size()});
+      continue;
+    }
+
+    if (auto *RQ = dyn_cast<RescaleQuantizedInst>(I)) {
+      auto *destTy = RQ->getDest()->getType();
+      auto *srcTy = RQ->getSrc()->getType();
+      GLOW_ASSERT(destTy->getElementType() == ElemKind::Int8QTy &&
+                  srcTy->getElementType() == ElemKind::Int8QTy &&
+                  "Only the int8 rescales are supported");
+      cl_kernel kernel = createKernel(kernelName);
+      setKernelArg(kernel, 0, deviceBuffer_);
+      setKernelArg<cl_uint>(kernel, 1, tensors_[RQ->getDest()]);
+      setKernelArg<cl_uint>(kernel, 2, tensors_[RQ->getSrc()]);
+      setKernelArg<cl_int>(kernel, 3, destTy->getOffset());
+      setKernelArg<cl_int>(kernel, 4, srcTy->getOffset());
+      setScaleArgs(kernel, 5, srcTy->getScale() / destTy->getScale());
+      addKernelLaunch(kernel, {destTy->size()});
       continue;
     }
 
@@ -713,14 +1618,17 @@ void OCLBackend::doForwardPass() {
       ShapeNHWC shuff(mask[0], mask[1], mask[2], mask[3]);
       setKernelArg(kernel, 5, shuff);
 
-      enqueueKernel(commands_, kernel, deviceId_, {idim.n}, kernelLaunches_);
+      addKernelLaunch(kernel, {idim.n});
       continue;
     }
 
     if (auto *TV = dyn_cast<TensorViewInst>(I)) {
-      assert(tensors_[TV] == tensors_[TV->getSrc()] &&
-             "Memory address for a tensor_view should be the same as the "
-             "address of its origin");
+      assert(tensors_[TV] == tensors_[TV->getSrc()] +
+                                 (getOriginOffset(TV) -
+                                  getOriginOffset(TV->getSrc())) *
+                                     TV->getType()->getElementSize() &&
+             "Memory address for a tensor_view should be the address of its "
+             "elements in its origin");
       (void)TV;
       continue;
     }
@@ -732,18 +1640,18 @@ void OCLBackend::doForwardPass() {
       if (src == dest) {
         continue;
       }
-      size_t destOff = tensors_[dest];
-      size_t srcOff = tensors_[src];
-      size_t sizeInBytes = dest->getSizeInBytes();
-
-      cl_int err =
-          clEnqueueCopyBuffer(commands_, deviceBuffer_, deviceBuffer_, srcOff,
-                              destOff, sizeInBytes, 0, nullptr, nullptr);
-      GLOW_ASSERT(err == CL_SUCCESS && "Error in clEnqueueCopyBuffer.");
+      LaunchCommand copy(LaunchCommand::Kind::Copy);
+      copy.destOffset_ = tensors_[dest];
+      copy.srcOffset_ = tensors_[src];
+      copy.sizeInBytes_ = dest->getSizeInBytes();
+      copy.instr_ = C;
+      launches_.push_back(std::move(copy));
       continue;
     }
 
     if (auto *GI = dyn_cast<GatherInst>(I)) {
+      GLOW_ASSERT(GI->getIndices()->getElementType() == ElemKind::IndexTy &&
+                  "The gather kernel takes size_t indices");
       cl_kernel kernel = createKernel(kernelName);
       setKernelArg(kernel, 0, deviceBuffer_);
 
@@ -759,41 +1667,232 @@ void OCLBackend::doForwardPass() {
       setKernelArg<cl_uint>(kernel, numArgs + 1, numIndices);
       setKernelArg<cl_uint>(kernel, numArgs + 2, dataSliceSize);
 
-      enqueueKernel(commands_, kernel, deviceId_, {numIndices},
-                    kernelLaunches_);
+      addKernelLaunch(kernel, {numIndices});
       continue;
     }
 
     if (auto *DP = dyn_cast<DebugPrintInst>(I)) {
-      clFinish(commands_);
-      auto *V = DP->getSrc();
-      // Allocate a temporary tensor to hold the value.
-      Tensor T(V->getType());
-      // Load the current value of the variable into host memory.
-      copyValueFromDevice(V, T.getUnsafePtr());
-      clFinish(commands_);
-      llvm::outs() << I->getName() << ": ";
-      // Dump the content of a value.
-      V->dump();
-      llvm::outs() << "\n";
-      dumpImpl(&T);
-      llvm::outs() << "\n";
-      llvm::outs().flush();
+      LaunchCommand print(LaunchCommand::Kind::DebugPrint);
+      print.debugPrint_ = DP;
+      print.instr_ = DP;
+      launches_.push_back(std::move(print));
       continue;
     }
     llvm::errs() << "Cannot select: " << I->getKindName() << "\n";
     GLOW_UNREACHABLE("compilation failed");
   }
+  currentInstr_ = nullptr;
 
-  clFinish(commands_);
+  for (auto *v : downloads_) {
+    LaunchCommand download(LaunchCommand::Kind::Download);
+    download.value_ = v;
+    launches_.push_back(std::move(download));
+  }
+  scheduleLaunches();
+}
+
+namespace {
+/// A range of the device buffer that a command reads or writes.
+struct MemoryAccess {
+  size_t begin;
+  size_t end;
+  bool isWrite;
+};
+} // namespace
+
+/// \returns true if the accesses \p A and \p B must not be reordered.
+static bool conflict(llvm::ArrayRef<MemoryAccess> A,
+                     llvm::ArrayRef<MemoryAccess> B) {
+  for (auto &a : A) {
+    for (auto &b : B) {
+      if ((a.isWrite || b.isWrite) && a.begin < b.end && b.begin < a.end) {
+        return true;
+      }
+    }
+  }
+  return false;
+}
+
+void OCLBackend::scheduleLaunches() {
+  // Collect the ranges of the device buffer that the commands access. The
+  // activations share the memory, so the ranges are compared and not the
+  // values.
+  std::vector<llvm::SmallVector<MemoryAccess, 4>> accesses(launches_.size());
+  for (size_t i = 0, e = launches_.size(); i < e; i++) {
+    auto &launch = launches_[i];
+    if (launch.value_) {
+      size_t begin = tensors_[launch.value_];
+      size_t end = begin + launch.value_->getSizeInBytes();
+      bool isUpload = launch.kind_ == LaunchCommand::Kind::Upload;
+      accesses[i].push_back({begin, end, isUpload});
+      continue;
+    }
+    llvm::SmallVector<const Instruction *, 4> instrs{launch.instr_};
+    instrs.append(launch.fused_.begin(), launch.fused_.end());
+    for (const auto *I : instrs) {
+      for (auto &op : I->getOperands()) {
+        size_t begin = tensors_[op.first];
+        size_t end = begin + op.first->getSizeInBytes();
+        if (op.second != OperandKind::Out) {
+          accesses[i].push_back({begin, end, false});
+        }
+        if (op.second != OperandKind::In) {
+          accesses[i].push_back({begin, end, true});
+        }
+      }
+    }
+  }
+
+  // A command goes to the queue of the latest command that it depends on, so
+  // that the chains stay on one queue, and the independent commands go to the
+  // queues in turn. The commands are in order on each queue, so a command
+  // only waits for the latest of its dependencies on each of the other
+  // queues. A debug print waits for all of the queues when it runs.
+  unsigned nextQueue = 0;
+  size_t barrier = 0;
+  for (size_t i = 0, e = launches_.size(); i < e; i++) {
+    auto &launch = launches_[i];
+    if (launch.kind_ == LaunchCommand::Kind::DebugPrint) {
+      launch.queue_ = 0;
+      barrier = i + 1;
+      continue;
+    }
+    std::vector<ssize_t> latest(queues_.size(), -1);
+    ssize_t last = -1;
+    for (size_t j = barrier; j < i; j++) {
+      if (conflict(accesses[i], accesses[j])) {
+        latest[launches_[j].queue_] = j;
+        last = j;
+      }
+    }
+    if (last >= 0) {
+      launch.queue_ = launches_[last].queue_;
+    } else {
+      launch.queue_ = nextQueue;
+      nextQueue = (nextQueue + 1) % queues_.size();
+    }
+    for (unsigned q = 0, e = queues_.size(); q < e; q++) {
+      if (q != launch.queue_ && latest[q] >= 0) {
+        launch.waitFor_.push_back(latest[q]);
+        launches_[latest[q]].signals_ = true;
+      }
+    }
+  }
+}
+
+void OCLBackend::enqueueLaunch(const LaunchCommand &launch,
+                               llvm::ArrayRef<cl_event> waitList,
+                               cl_event *event) {
+  cl_command_queue queue = queues_[launch.queue_];
+  const cl_event *events = waitList.empty() ? nullptr : waitList.data();
+  switch (launch.kind_) {
+  case LaunchCommand::Kind::Kernel: {
+    cl_int err = clEnqueueNDRangeKernel(
+        queue, launch.kernel_, launch.global_.size(), nullptr,
+        &launch.global_[0], &launch.local_[0], waitList.size(), events, event);
+    GLOW_ASSERT(err == CL_SUCCESS && "Error in clEnqueueNDRangeKernel.");
+    break;
+  }
+  case LaunchCommand::Kind::Copy: {
+    cl_int err = clEnqueueCopyBuffer(queue, deviceBuffer_, deviceBuffer_,
+                                     launch.srcOffset_, launch.destOffset_,
+                                     launch.sizeInBytes_, waitList.size(),
+                                     events, event);
+    GLOW_ASSERT(err == CL_SUCCESS && "Error in clEnqueueCopyBuffer.");
+    break;
+  }
+  case LaunchCommand::Kind::Upload:
+  case LaunchCommand::Kind::Download: {
+    // The transfers go through the staging buffer if there is one.
+    auto *v = launch.value_;
+    size_t offset = tensors_[v];
+    size_t sizeInBytes = v->getSizeInBytes();
+    void *buf = stagingPtr_ ? stagingPtr_ + stagingOffsets_[v]
+                            : externalTensors_[v]->getUnsafePtr();
+    cl_int err;
+    if (launch.kind_ == LaunchCommand::Kind::Upload) {
+      err = clEnqueueWriteBuffer(queue, deviceBuffer_,
+                                 /* blocking_write */ CL_FALSE, offset,
+                                 sizeInBytes, buf, waitList.size(), events,
+                                 event);
+    } else {
+      err = clEnqueueReadBuffer(queue, deviceBuffer_,
+                                /* blocking_read */ CL_FALSE, offset,
+                                sizeInBytes, buf, waitList.size(), events,
+                                event);
+    }
+    GLOW_ASSERT(err == CL_SUCCESS && "Unable to copy a weight");
+    break;
+  }
+  case LaunchCommand::Kind::DebugPrint: {
+    finishQueues();
+    auto *DP = launch.debugPrint_;
+    auto *V = DP->getSrc();
+    // Allocate a temporary tensor to hold the value.
+    Tensor T(V->getType());
+    // Load the current value of the variable into host memory.
+    copyValueFromDevice(V, T.getUnsafePtr());
+    clFinish(commands_);
+    llvm::outs() << DP->getName() << ": ";
+    // Dump the content of a value.
+    V->dump();
+    llvm::outs() << "\n";
+    dumpImpl(&T);
+    llvm::outs() << "\n";
+    llvm::outs().flush();
+    break;
+  }
+  }
+}
+
+void OCLBackend::finishQueues() {
+  for (auto queue : queues_) {
+    clFinish(queue);
+  }
+}
+
+void OCLBackend::doForwardPass() {
+  bool trace = profiling_ && isTraceEnabled();
+  uint64_t traceBegin = trace ? getTraceTime() : 0;
+  auto copiedToDeviceBytes = copyMutableWeightsToDevice();
+  (void)copiedToDeviceBytes;
+  DEBUG(llvm::dbgs() << "Copied " << copiedToDeviceBytes
+                     << " bytes to OpenCL device\n");
+
+  // Replay the launch list. The kernels and their arguments don't change
+  // between the runs, only the events that order the queues do.
+  std::vector<cl_event> events(launches_.size(), nullptr);
+  for (size_t i = 0, e = launches_.size(); i < e; i++) {
+    auto &launch = launches_[i];
+    llvm::SmallVector<cl_event, 4> waitList;
+    for (auto j : launch.waitFor_) {
+      waitList.push_back(events[j]);
+    }
+    bool isProfiled =
+        (doProfile || trace) && launch.kind_ == LaunchCommand::Kind::Kernel;
+    bool needsEvent = launch.signals_ || isProfiled;
+    enqueueLaunch(launch, waitList, needsEvent ? &events[i] : nullptr);
+    if (isProfiled) {
+      kernelLaunches_.push_back(
+          KernelLaunch(launch.kernel_, launch.name_, events[i]));
+    }
+  }
+
+  finishQueues();
 
   // Output profiling information.
+  if (trace) {
+    traceKernelLaunches(kernelLaunches_, traceBegin);
+  }
   dumpProfileInfo(kernelLaunches_);
+  kernelLaunches_.clear();
 
-  for (auto &kl : kernelLaunches_) {
-    clReleaseKernel(kl.kernel_);
+  // The kernels belong to the launch list, only the events are released.
+  for (auto event : events) {
+    if (event) {
+      clReleaseEvent(event);
+    }
   }
-  kernelLaunches_.clear();
 
   auto copiedFromDeviceBytes = copyMutableWeightsFromDevice();
   (void)copiedFromDeviceBytes;
@@ -851,18 +1950,15 @@ size_t OCLBackend::copyValueFromDevice(const Value *v, void *buf) {
 
 size_t OCLBackend::copyMutableWeightsToDevice() {
   size_t copiedBytes = 0;
-  for (auto it : tensors_) {
-    if (!externalTensors_.count(it.first)) {
-      continue;
-    }
-    if (auto *W = dyn_cast<WeightVar>(it.first)) {
-      if (W->getMutability() == WeightVar::MutabilityKind::Constant)
-        continue;
+  for (auto *v : uploads_) {
+    size_t sizeInBytes = v->getType()->getSizeInBytes();
+    // Without the staging buffer, the launch list uploads the tensor itself.
+    if (stagingPtr_) {
+      memcpy(stagingPtr_ + stagingOffsets_[v],
+             externalTensors_[v]->getUnsafePtr(), sizeInBytes);
     }
-    copiedBytes += copyValueToDevice(it.first);
+    copiedBytes += sizeInBytes;
   }
-  // Do it!
-  clFinish(commands_);
   return copiedBytes;
 }
 
@@ -885,20 +1981,99 @@ size_t OCLBackend::copyConstantWeightsToDevice() {
 
 size_t OCLBackend::copyMutableWeightsFromDevice() {
   size_t copiedBytes = 0;
-  clFinish(commands_);
-
-  for (auto it : tensors_) {
-    if (!externalTensors_.count(it.first)) {
-      continue;
+  for (auto *v : downloads_) {
+    size_t sizeInBytes = v->getType()->getSizeInBytes();
+    if (stagingPtr_) {
+      memcpy(externalTensors_[v]->getUnsafePtr(),
+             stagingPtr_ + stagingOffsets_[v], sizeInBytes);
     }
-    if (auto *W = dyn_cast<WeightVar>(it.first)) {
-      if (W->getMutability() == WeightVar::MutabilityKind::Constant)
+    copiedBytes += sizeInBytes;
+  }
+  return copiedBytes;
+}
+
+void OCLBackend::selectTransfers() {
+  uploads_.clear();
+  downloads_.clear();
+  stagingOffsets_.clear();
+  freeStagingBuffer();
+
+  // Scan the instructions in order. A weight has to be uploaded if it is read
+  // before an instruction writes all of its elements. The writes through the
+  // views may be partial.
+  std::unordered_set<const Value *> written;
+  std::unordered_set<const Value *> uploads;
+  std::unordered_set<const Value *> downloads;
+  for (auto *I : F_->getInstrs()) {
+    for (auto &op : I->getOperands()) {
+      auto *W = dyn_cast<WeightVar>(getOrigin(op.first));
+      if (!W || W->getMutability() == WeightVar::MutabilityKind::Constant ||
+          !externalTensors_.count(W) || states_.count(W)) {
         continue;
+      }
+      if (op.second != OperandKind::Out && !written.count(W)) {
+        uploads.insert(W);
+      }
+      if (op.second != OperandKind::In) {
+        downloads.insert(W);
+        if (op.second == OperandKind::Out && op.first == W) {
+          written.insert(W);
+        }
+      }
     }
-    copiedBytes += copyValueFromDevice(it.first);
   }
-  clFinish(commands_);
-  return copiedBytes;
+
+  // Keep the order of the weights of the function, so that the transfers are
+  // deterministic. The transferred weights are packed in the staging buffer.
+  size_t stagingSize = 0;
+  for (auto *W : F_->getWeights()) {
+    if (uploads.count(W)) {
+      uploads_.push_back(W);
+    }
+    if (downloads.count(W)) {
+      downloads_.push_back(W);
+    }
+    if (uploads.count(W) || downloads.count(W)) {
+      stagingOffsets_[W] = stagingSize;
+      stagingSize += alignedSize(W->getType()->getSizeInBytes(), 64);
+    }
+  }
+  DEBUG(llvm::dbgs() << "Transferring " << uploads_.size()
+                     << " weights to and " << downloads_.size()
+                     << " weights from the OpenCL device\n");
+
+  if (!stagingSize) {
+    return;
+  }
+  // If the pinned memory can't be allocated, the tensors are transferred
+  // directly.
+  cl_int err;
+  stagingBuffer_ =
+      clCreateBuffer(context_, CL_MEM_READ_WRITE | CL_MEM_ALLOC_HOST_PTR,
+                     stagingSize, nullptr, &err);
+  if (err != CL_SUCCESS) {
+    stagingBuffer_ = nullptr;
+    return;
+  }
+  stagingPtr_ = (char *)clEnqueueMapBuffer(
+      commands_, stagingBuffer_, /* blocking_map */ CL_TRUE,
+      CL_MAP_READ | CL_MAP_WRITE, 0, stagingSize, 0, nullptr, nullptr, &err);
+  if (err != CL_SUCCESS) {
+    freeStagingBuffer();
+  }
+}
+
+void OCLBackend::freeStagingBuffer() {
+  if (stagingPtr_) {
+    clEnqueueUnmapMemObject(commands_, stagingBuffer_, stagingPtr_, 0, nullptr,
+                            nullptr);
+    clFinish(commands_);
+    stagingPtr_ = nullptr;
+  }
+  if (stagingBuffer_) {
+    clReleaseMemObject(stagingBuffer_);
+    stagingBuffer_ = nullptr;
+  }
 }
 
 void OCLBackend::init() {
@@ -906,6 +2081,9 @@ void OCLBackend::init() {
     auto *w = F_->getWeightForNode(v);
     assert(!externalTensors_.count(w) && "The tensor is already registered");
     externalTensors_[w] = &v->getPayload();
+    if (v->isState()) {
+      states_.insert(w);
+    }
   }
 
   // Assign device-space addresses to the weights.
@@ -918,7 +2096,7 @@ void OCLBackend::init() {
   }
 
   // Assign device-space addresses to the activations.
-  for (auto &I : F_->getInstrs()) {
+  for (auto *I : F_->getInstrs()) {
     if (auto *A = llvm::dyn_cast<AllocActivationInst>(I)) {
       auto numBytes = I->getSizeInBytes();
       size_t addr = allocator_.allocate(numBytes);
@@ -929,7 +2107,10 @@ void OCLBackend::init() {
 
     if (auto *TV = llvm::dyn_cast<TensorViewInst>(I)) {
       assert(!tensors_.count(TV) && "Allocation already made!");
-      tensors_[TV] = tensors_[TV->getSrc()];
+      // The views with offsets start inside of their source.
+      size_t offset = getOriginOffset(TV) - getOriginOffset(TV->getSrc());
+      tensors_[TV] =
+          tensors_[TV->getSrc()] + offset * TV->getType()->getElementSize();
       continue;
     }
 
@@ -956,9 +2137,129 @@ void OCLBackend::init() {
   deviceBuffer_ = allocDeviceBuffer(requiredSpace);
   // Copy constant weights just once.
   copyConstantWeightsToDevice();
+  // The states are copied once too, and then stay on the device.
+  for (auto *w : states_) {
+    copyValueToDevice(w);
+  }
+  clFinish(commands_);
+  selectTransfers();
+  // Create the kernels once. They refer to the new device buffer.
+  recordLaunches();
 }
 
-void OCLBackend::clear() { externalTensors_.clear(); }
+void OCLBackend::clear() {
+  externalTensors_.clear();
+  states_.clear();
+}
+
+void OCLBackend::reloadConstantWeights() { copyConstantWeightsToDevice(); }
+
+void OCLBackend::readState(const Variable *v) {
+  auto *w = F_->getWeightForNode(v);
+  assert(states_.count(w) && "Not a state variable");
+  copyValueFromDevice(w);
+  clFinish(commands_);
+}
+
+void OCLBackend::writeState(const Variable *v) {
+  auto *w = F_->getWeightForNode(v);
+  assert(states_.count(w) && "Not a state variable");
+  copyValueToDevice(w);
+  clFinish(commands_);
+}
+
+void OCLBackend::reorderState(Variable *v, llvm::ArrayRef<size_t> rows) {
+  auto *w = F_->getWeightForNode(v);
+  assert(states_.count(w) && "Not a state variable");
+  assert(rows.size() == w->getType()->dims()[0] &&
+         "Invalid number of rows");
+  // Gather the rows on the device into a temporary buffer, as a row may be
+  // read after it was replaced, and copy them back, without a transfer.
+  size_t sizeInBytes = w->getType()->getSizeInBytes();
+  size_t rowSize = sizeInBytes / rows.size();
+  size_t offset = tensors_[w];
+  cl_mem gathered = allocDeviceBuffer(sizeInBytes);
+  for (size_t i = 0, e = rows.size(); i < e; i++) {
+    assert(rows[i] < e && "Invalid row");
+    cl_int err = clEnqueueCopyBuffer(commands_, deviceBuffer_, gathered,
+                                     offset + rows[i] * rowSize, i * rowSize,
+                                     rowSize, 0, nullptr, nullptr);
+    GLOW_ASSERT(err == CL_SUCCESS && "Unable to gather the state");
+  }
+  cl_int err = clEnqueueCopyBuffer(commands_, gathered, deviceBuffer_, 0,
+                                   offset, sizeInBytes, 0, nullptr, nullptr);
+  GLOW_ASSERT(err == CL_SUCCESS && "Unable to gather the state");
+  clFinish(commands_);
+  freeDeviceBuffer(gathered);
+}
+
+bool OCLBackend::lowersNode(const Node *N) {
+  // The weight update runs as a single kernel.
+  return N->getKind() != Kinded::Kind::SGDNodeKind;
+}
+
+bool OCLBackend::supportsOp(Kinded::Kind opKind, ElemKind elementTy) {
+  if (elementTy == ElemKind::Int16QTy || elementTy == ElemKind::Float16Ty) {
+    return false;
+  }
+
+  // The int8 kernels follow the libjit kernels of the CPU backend.
+  if (elementTy == ElemKind::Int8QTy) {
+    switch (opKind) {
+    case Kinded::Kind::AddNodeKind:
+    case Kinded::Kind::BatchedAddNodeKind:
+    case Kinded::Kind::BatchedReduceAddNodeKind:
+    case Kinded::Kind::CmpLTENodeKind:
+    case Kinded::Kind::ConcatNodeKind:
+    case Kinded::Kind::ConvolutionNodeKind:
+    case Kinded::Kind::DequantizeNodeKind:
+    case Kinded::Kind::DivNodeKind:
+    case Kinded::Kind::FullyConnectedNodeKind:
+    case Kinded::Kind::GatherNodeKind:
+    case Kinded::Kind::InsertTensorNodeKind:
+    case Kinded::Kind::MatMulNodeKind:
+    case Kinded::Kind::MaxNodeKind:
+    case Kinded::Kind::MinNodeKind:
+    case Kinded::Kind::MulNodeKind:
+    case Kinded::Kind::PoolAvgNodeKind:
+    case Kinded::Kind::PoolMaxNodeKind:
+    case Kinded::Kind::QuantizeNodeKind:
+    case Kinded::Kind::ReluNodeKind:
+    case Kinded::Kind::RescaleQuantizedNodeKind:
+    case Kinded::Kind::ReshapeNodeKind:
+    case Kinded::Kind::SelectNodeKind:
+    case Kinded::Kind::SliceNodeKind:
+    case Kinded::Kind::SplatNodeKind:
+    case Kinded::Kind::SubNodeKind:
+    case Kinded::Kind::TransposeNodeKind:
+      return true;
+    default:
+      return false;
+    }
+  }
+
+  // There are no float kernels for these nodes, and they are not lowered.
+  // The loops of the recurrent nodes are not supported either.
+  switch (opKind) {
+  case Kinded::Kind::BroadcastNodeKind:
+  case Kinded::Kind::ConvertToNodeKind:
+  case Kinded::Kind::ConvolutionGradNodeKind:
+  case Kinded::Kind::CrossEntropyLossGradNodeKind:
+  case Kinded::Kind::CrossEntropyLossNodeKind:
+  case Kinded::Kind::LSTMSequenceNodeKind:
+  case Kinded::Kind::PoolAvgGradNodeKind:
+  case Kinded::Kind::PoolMaxGradNodeKind:
+  case Kinded::Kind::PowNodeKind:
+  case Kinded::Kind::QuantizationProfileNodeKind:
+  case Kinded::Kind::SparseFullyConnectedNodeKind:
+  case Kinded::Kind::SparseLengthsWeightedSumNodeKind:
+  case Kinded::Kind::TensorStatsNodeKind:
+  case Kinded::Kind::TopKNodeKind:
+    return false;
+  default:
+    return true;
+  }
+}
 
 Tensor *OCLBackend::getTensor(const Value *v) const {
   assert(externalTensors_.count(v) && "Unknown value");
@@ -22,8 +22,10 @@
 #include "glow/CodeGen/MemoryAllocator.h"
 
 #include "llvm/ADT/ArrayRef.h"
+#include "llvm/ADT/SmallVector.h"
 
 #include <unordered_map>
+#include <unordered_set>
 
 #if defined(__APPLE__) || defined(__MACOSX)
 #include "OpenCL/opencl.h"
@@ -34,6 +36,8 @@
 namespace glow {
 class IRFunction;
 class Backend;
+class DebugPrintInst;
+class Instruction;
 /// A helper struct with information about kernels launches.
 struct KernelLaunch {
   /// Kernel that was launched.
@@ -52,6 +56,53 @@ struct KernelLaunch {
       : kernel_(nullptr), name_(name), event_(event) {}
 };
 
+/// A command of the launch list that the OpenCL backend records once when it
+/// is initialized and replays on every run.
+struct LaunchCommand {
+  enum class Kind {
+    /// Launch a kernel whose arguments are all bound.
+    Kernel,
+    /// Copy a range of the device buffer.
+    Copy,
+    /// Print the value of an instruction.
+    DebugPrint,
+    /// Copy a mutable weight to the device.
+    Upload,
+    /// Copy a mutable weight from the device.
+    Download,
+  };
+  Kind kind_;
+  /// The instruction that the command executes, or nullptr for the transfers.
+  const Instruction *instr_{nullptr};
+  /// The instructions after instr_ that a fused kernel computes, in order.
+  llvm::SmallVector<const Instruction *, 4> fused_;
+  /// The weight of a transfer.
+  const Value *value_{nullptr};
+  /// The kernel to launch and its name.
+  cl_kernel kernel_{nullptr};
+  std::string name_;
+  /// The global and the local workgroup sizes of the kernel.
+  llvm::SmallVector<size_t, 4> global_;
+  llvm::SmallVector<size_t, 4> local_;
+  /// The offsets in bytes of the source and the destination of a copy, and
+  /// its size in bytes.
+  size_t srcOffset_{0};
+  size_t destOffset_{0};
+  size_t sizeInBytes_{0};
+  /// The instruction that prints its operand.
+  const DebugPrintInst *debugPrint_{nullptr};
+  /// The index of the command queue that the command is enqueued to.
+  unsigned queue_{0};
+  /// The indices of the earlier commands on the other queues that the command
+  /// waits for.
+  llvm::SmallVector<size_t, 4> waitFor_;
+  /// Whether a command on another queue waits for this command, which then
+  /// has to return an event.
+  bool signals_{false};
+
+  explicit LaunchCommand(Kind kind) : kind_(kind) {}
+};
+
 /// This is the OpenCL backend.
 class OCLBackend final : public Backend {
   /// A helper type representing a key for the program's cache.
@@ -73,21 +124,55 @@ class OCLBackend final : public Backend {
   std::unordered_map<const Value *, size_t> tensors_;
   /// Maps values to Tensors, that are *not* owned by this class.
   std::unordered_map<const Value *, Tensor *> externalTensors_;
+  /// The weights of the state variables, which stay on the device between
+  /// the runs instead of being transferred around every run.
+  std::unordered_set<const Value *> states_;
   /// CL compute device id.
   cl_device_id deviceId_;
   /// CL compute context.
   cl_context context_;
   /// CL compute command queue.
   cl_command_queue commands_;
+  /// All of the command queues, starting with commands_. The independent
+  /// commands of a run are spread across them, so that they overlap.
+  std::vector<cl_command_queue> queues_;
+  /// The instruction whose kernels are being recorded.
+  const Instruction *currentInstr_{nullptr};
   /// Cache of compiled programs.
   /// The same source code can be compile with different options (e.g. with
   /// different set of macro definitions) and/or for a different device and
   /// would result in different programs.
   std::unordered_map<ProgramKey, cl_program, ProgramKeyHash> programsCache_;
+  /// The program of the generic kernels, and the options it is built with.
+  cl_program mainProgram_{nullptr};
+  std::vector<std::string> programOptions_;
   /// A pointer to the on-device memory buffer.
   cl_mem deviceBuffer_{0};
+  /// The mutable weights that are copied to the device before every run: the
+  /// ones that the function reads before it writes all of their elements.
+  std::vector<const Value *> uploads_;
+  /// The mutable weights that are copied from the device after every run:
+  /// the ones that the function writes.
+  std::vector<const Value *> downloads_;
+  /// A buffer in pinned host memory that stages the transfers of the mutable
+  /// weights, and its mapping into the address space of the host.
+  cl_mem stagingBuffer_{nullptr};
+  char *stagingPtr_{nullptr};
+  /// The offsets of the transferred weights in the staging buffer, where they
+  /// are packed one after the other.
+  std::unordered_map<const Value *, size_t> stagingOffsets_;
+  /// The size of the square tiles of the tiled kernels, and the number of the
+  /// rows of a tile that a work-item computes.
+  size_t tileSize_{16};
+  size_t workPerThread_{4};
+  /// Whether the queues record the profiling information of the commands.
+  bool profiling_{false};
   /// Information about kernel launches.
   std::vector<KernelLaunch> kernelLaunches_;
+  /// The commands that run the function, in order. The kernels are created
+  /// and their arguments are set once by init(), so that a run only enqueues
+  /// them.
+  std::vector<LaunchCommand> launches_;
 
 public:
   /// Ctor.
@@ -104,13 +189,26 @@ public:
 
   void doForwardPass() override;
 
+  void reloadConstantWeights() override;
+
+  void readState(const Variable *v) override;
+
+  void writeState(const Variable *v) override;
+
+  void reorderState(Variable *v, llvm::ArrayRef<size_t> rows) override;
+
   bool isOpSupported(Kinded::Kind opKind, ElemKind elementTy) const override {
-    if (elementTy == ElemKind::Int8QTy) {
-      return false;
-    }
+    return supportsOp(opKind, elementTy);
+  }
 
-    return true;
-  };
+  bool shouldLower(Node *N) override { return lowersNode(N); }
+  /// @}
+
+  /// The answers of isOpSupported() and shouldLower(), which don't depend on
+  /// a backend object, see glow::isOpSupported() and glow::shouldLower().
+  /// @{
+  static bool supportsOp(Kinded::Kind opKind, ElemKind elementTy);
+  static bool lowersNode(const Node *N);
   /// @}
 
 private:
@@ -122,15 +220,22 @@ private:
   /// If \p buf is nullptr, the payload of the underlying tensor is used.
   /// \returns number of copied bytes.
   size_t copyValueToDevice(const Value *v, void *buf = nullptr);
-  /// Copy mutable weights to the device.
+  /// Copy the mutable weights that the function reads into the staging
+  /// buffer, from which the launch list uploads them.
   /// \returns number of copied bytes.
   size_t copyMutableWeightsToDevice();
   /// Copy constant weights to the device.
   /// \returns number of copied bytes.
   size_t copyConstantWeightsToDevice();
-  /// Copy mutable weights from the device.
+  /// Copy the mutable weights that the function writes from the staging
+  /// buffer, into which the launch list downloaded them.
   /// \returns number of copied bytes.
   size_t copyMutableWeightsFromDevice();
+  /// Find the mutable weights that have to be copied to and from the device
+  /// around a run, and allocate the pinned staging buffer for them.
+  void selectTransfers();
+  /// Release the pinned staging buffer.
+  void freeStagingBuffer();
 
   /// Allocate a device buffer of required \p size.
   cl_mem allocDeviceBuffer(size_t size);
@@ -138,18 +243,57 @@ private:
   void freeDeviceBuffer(cl_mem buf);
 
   /// Create kernel with a given \p name from a \p program.
-  /// If \p program is nullptr, try to find the kernel with a given \p name
-  /// in any of compiled programs.
+  /// If \p program is nullptr, the kernel is created from the program of the
+  /// generic kernels.
   cl_kernel createKernel(const std::string &name, cl_program program = nullptr);
 
+  /// Create the kernel \p name from a build of the kernels that defines
+  /// SPECIALIZE_<name> and the constants \p defines of a single shape, or the
+  /// generic kernel if the specialization is disabled. The builds are cached
+  /// like the other programs, so the instructions of the same shape share one.
+  cl_kernel createSpecializedKernel(const std::string &name,
+                                    llvm::ArrayRef<std::string> defines);
+
   /// Create a program from the \p source using provided \p options.
   cl_program createProgram(const std::string &source,
                            const std::vector<std::string> &options,
                            cl_command_queue queue);
-  /// Enqueue a \p kernel on a provided \p commands queue. 
-  void enqueueKernel(cl_command_queue commands, cl_kernel kernel,
-                     cl_device_id device, llvm::ArrayRef<size_t> global,
-                     std::vector<KernelLaunch> &kernelLaunches);
+  /// Append the launch of the \p kernel with the global workgroup sizes
+  /// \p global to the launch list. The arguments of the kernel must be set.
+  /// The local workgroup sizes are \p local, or the largest sizes that fit
+  /// if \p local is empty.
+  void addKernelLaunch(cl_kernel kernel, llvm::ArrayRef<size_t> global,
+                       llvm::ArrayRef<size_t> local = {});
+  /// Append the launch of the tiled matrix multiplication \p kernel, whose
+  /// result has \p rows rows and \p cols columns, to the launch list.
+  void addTiledKernelLaunch(cl_kernel kernel, size_t rows, size_t cols);
+  /// \returns true if the element-wise instruction \p I can join the
+  /// instructions \p run, which are computed by a fused kernel.
+  bool canFuse(llvm::ArrayRef<const Instruction *> run, const Instruction *I);
+  /// \returns the runs of consecutive element-wise instructions of the
+  /// function that are computed by fused kernels.
+  std::vector<std::vector<const Instruction *>> findFusedRuns();
+  /// Generate the kernel that computes the element-wise instructions \p run,
+  /// compile it and append its launch to the launch list.
+  void addFusedKernelLaunch(llvm::ArrayRef<const Instruction *> run);
+  /// Select the tile size and the work per thread of the tiled kernels for
+  /// the device.
+  void selectTileSize();
+  /// Create the kernels of the instructions of the function, set their
+  /// arguments and record the launch list.
+  void recordLaunches();
+  /// Release the kernels of the launch list and clear it.
+  void releaseLaunches();
+  /// Assign the commands of the launch list to the command queues, and make
+  /// every command wait for the earlier commands on the other queues that
+  /// access the same memory.
+  void scheduleLaunches();
+  /// Enqueue the command \p launch, which waits for the events \p waitList,
+  /// and return its event in \p event if it is not nullptr.
+  void enqueueLaunch(const LaunchCommand &launch,
+                     llvm::ArrayRef<cl_event> waitList, cl_event *event);
+  /// Wait for all of the commands of all of the queues.
+  void finishQueues();
 
   /// \returns a pointer to the tensor that is saved under \p v.
   Tensor *getTensor(const Value *v) const;
@@ -21,6 +21,48 @@ size_t getNHWC(ShapeNHWC s, cl_uint32_t n, cl_uint32_t h, cl_uint32_t w,
   return (n * s.c * s.w * s.h) + (h * s.c * s.w) + (w * s.c) + c;
 }
 
+/// A program that is built for a single shape of a hot kernel defines
+/// SPECIALIZE_<kernel> and the SPEC_* constants of the shape. The kernel
+/// overwrites its arguments with the constants, so that the compiler folds
+/// them into the index arithmetic and unrolls the loops over the filter.
+/// Sets the shape \p s to the constants with the prefix \p P.
+#define SPECIALIZE_SHAPE(s, P)                                                 \
+  s.n = P##_N;                                                                 \
+  s.h = P##_H;                                                                 \
+  s.w = P##_W;                                                                 \
+  s.c = P##_C
+/// Sets the filter size, the stride, the pad, the output shape and the input
+/// shape of a convolution or a pooling to their constants.
+#define SPECIALIZE_WINDOW()                                                    \
+  filterSize = SPEC_FILTER_SIZE;                                               \
+  stride = SPEC_STRIDE;                                                        \
+  pad = SPEC_PAD;                                                              \
+  SPECIALIZE_SHAPE(odim, SPEC_ODIM);                                           \
+  SPECIALIZE_SHAPE(idim, SPEC_IDIM)
+
+/// Scales the 32-bit integer \p input using the integer shift-mult-shift
+/// method and adds \p offset. See QuantizationTransform32To8 for more
+/// details.
+int scale_i32i8(int input, int pre, int post, int scale, int offset) {
+  // The operation x >> y is rounded down to negative infinity. To get to
+  // round-nearest we add (1 << (shift - 1)) to the value prior to shifting.
+  int rtn = (post > 0) ? (1 << (post - 1)) : 0;
+  return ((((input >> pre) * scale) + rtn) >> post) + offset;
+}
+
+/// \returns \p val clipped to the range of int8.
+char clip_i8(int val) { return (char)clamp(val, -128, 127); }
+
+/// \returns the float buffer at the byte offset \p offset of \p mem.
+__global float *getFloatBuffer(__global void *mem, cl_uint32_t offset) {
+  return (__global float *)((__global char *)mem + offset);
+}
+
+/// \returns the int8 buffer at the byte offset \p offset of \p mem.
+__global char *getInt8Buffer(__global void *mem, cl_uint32_t offset) {
+  return (__global char *)mem + offset;
+}
+
 /// Macro to define a kernel for data-parallel ternay operations. The body of
 /// the kernel is auto-generated by the macro.
 /// Defines vectorized kernels for vector sizes 1, 8 and 16.
@@ -227,6 +269,114 @@ size_t getNHWC(ShapeNHWC s, cl_uint32_t n, cl_uint32_t h, cl_uint32_t w,
     name##K(&mem[dest], (type)val);                                            \
   }
 
+/// Macro to define a kernel for data-parallel unary operations with the
+/// value of a splat operand as an immediate, which the body reads as IMM.
+/// Defines vectorized kernels for vector sizes 1, 8 and 16.
+/// \p name the name of the kernel
+/// \p body the operation to be performed
+#define DEFINE_OPENCL_SPLAT_OPERAND_DATA_PARALLEL_KERNEL(name, body)           \
+  __kernel void name##K##16(__global float *dest, __global float *src,         \
+                            float val) {                                       \
+    typedef float8 vtype;                                                      \
+    size_t i = get_global_id(0);                                               \
+    vtype IMM = (vtype)val;                                                    \
+    {                                                                          \
+      vtype SRC = vload8(i * 2, src);                                          \
+      vtype VAL = body;                                                        \
+      vstore8(VAL, i * 2, dest);                                               \
+    }                                                                          \
+    {                                                                          \
+      vtype SRC = vload8(i * 2 + 1, src);                                      \
+      vtype VAL = body;                                                        \
+      vstore8(VAL, i * 2 + 1, dest);                                           \
+    }                                                                          \
+  }                                                                            \
+  __kernel void name##W##16(__global void *mem, cl_uint32_t dest,              \
+                            cl_uint32_t src, float val) {                      \
+    name##K##16(&mem[dest], &mem[src], val);                                   \
+  }                                                                            \
+  __kernel void name##K##8(__global float *dest, __global float *src,          \
+                           float val) {                                        \
+    typedef float8 vtype;                                                      \
+    size_t i = get_global_id(0);                                               \
+    vtype IMM = (vtype)val;                                                    \
+    vtype SRC = vload8(i, src);                                                \
+    vtype VAL = body;                                                          \
+    vstore8(VAL, i, dest);                                                     \
+  }                                                                            \
+  __kernel void name##W##8(__global void *mem, cl_uint32_t dest,               \
+                           cl_uint32_t src, float val) {                       \
+    name##K##8(&mem[dest], &mem[src], val);                                    \
+  }                                                                            \
+  __kernel void name##K(__global float *dest, __global float *src,             \
+                        float val) {                                           \
+    typedef float vtype;                                                       \
+    size_t i = get_global_id(0);                                               \
+    vtype IMM = val;                                                           \
+    vtype SRC = src[i];                                                        \
+    dest[i] = body;                                                            \
+  }                                                                            \
+  __kernel void name##W(__global void *mem, cl_uint32_t dest,                  \
+                        cl_uint32_t src, float val) {                          \
+    name##K(&mem[dest], &mem[src], val);                                       \
+  }
+
+/// Macro to define a kernel for data-parallel selections between a tensor and
+/// the value of a splat operand, which the body reads as IMM.
+/// Defines vectorized kernels for vector sizes 1, 8 and 16.
+/// \p name the name of the kernel
+/// \p body the operation to be performed
+#define DEFINE_OPENCL_SPLAT_OPERAND_SELECT_KERNEL(name, body)                  \
+  __kernel void name##K##16(__global float *dest, __global float *cond,        \
+                            __global float *src, float val) {                  \
+    typedef float8 vtype;                                                      \
+    size_t i = get_global_id(0);                                               \
+    vtype IMM = (vtype)val;                                                    \
+    {                                                                          \
+      vtype COND = vload8(i * 2, cond);                                        \
+      vtype SRC = vload8(i * 2, src);                                          \
+      vtype VAL = body;                                                        \
+      vstore8(VAL, i * 2, dest);                                               \
+    }                                                                          \
+    {                                                                          \
+      vtype COND = vload8(i * 2 + 1, cond);                                    \
+      vtype SRC = vload8(i * 2 + 1, src);                                      \
+      vtype VAL = body;                                                        \
+      vstore8(VAL, i * 2 + 1, dest);                                           \
+    }                                                                          \
+  }                                                                            \
+  __kernel void name##W##16(__global void *mem, cl_uint32_t dest,              \
+                            cl_uint32_t cond, cl_uint32_t src, float val) {    \
+    name##K##16(&mem[dest], &mem[cond], &mem[src], val);                       \
+  }                                                                            \
+  __kernel void name##K##8(__global float *dest, __global float *cond,         \
+                           __global float *src, float val) {                   \
+    typedef float8 vtype;                                                      \
+    size_t i = get_global_id(0);                                               \
+    vtype IMM = (vtype)val;                                                    \
+    vtype COND = vload8(i, cond);                                              \
+    vtype SRC = vload8(i, src);                                                \
+    vtype VAL = body;                                                          \
+    vstore8(VAL, i, dest);                                                     \
+  }                                                                            \
+  __kernel void name##W##8(__global void *mem, cl_uint32_t dest,               \
+                           cl_uint32_t cond, cl_uint32_t src, float val) {     \
+    name##K##8(&mem[dest], &mem[cond], &mem[src], val);                        \
+  }                                                                            \
+  __kernel void name##K(__global float *dest, __global float *cond,            \
+                        __global float *src, float val) {                      \
+    typedef float vtype;                                                       \
+    size_t i = get_global_id(0);                                               \
+    vtype IMM = val;                                                           \
+    vtype COND = cond[i];                                                      \
+    vtype SRC = src[i];                                                        \
+    dest[i] = body;                                                            \
+  }                                                                            \
+  __kernel void name##W(__global void *mem, cl_uint32_t dest,                  \
+                        cl_uint32_t cond, cl_uint32_t src, float val) {        \
+    name##K(&mem[dest], &mem[cond], &mem[src], val);                           \
+  }
+
 DEFINE_OPENCL_BINARY_DATA_PARALLEL_KERNEL(elementadd, float, LHS + RHS)
 DEFINE_OPENCL_BINARY_DATA_PARALLEL_KERNEL(elementsub, float, LHS - RHS)
 DEFINE_OPENCL_BINARY_DATA_PARALLEL_KERNEL(elementmul, float, LHS *RHS)
@@ -244,10 +394,130 @@ DEFINE_OPENCL_TERNARY_DATA_PARALLEL_KERNEL(elementselect, float,
 DEFINE_OPENCL_UNARY_DATA_PARALLEL_KERNEL_WITH_IMM_OPERAND(splat, float, SRC)
 DEFINE_OPENCL_UNARY_DATA_PARALLEL_KERNEL_WITH_IMM_OPERAND(splat_u, ulong, SRC)
 
+DEFINE_OPENCL_SPLAT_OPERAND_DATA_PARALLEL_KERNEL(elementaddsplat, SRC + IMM)
+DEFINE_OPENCL_SPLAT_OPERAND_DATA_PARALLEL_KERNEL(elementmulsplat, SRC *IMM)
+DEFINE_OPENCL_SPLAT_OPERAND_DATA_PARALLEL_KERNEL(elementmaxsplat, max(SRC, IMM))
+DEFINE_OPENCL_SPLAT_OPERAND_DATA_PARALLEL_KERNEL(elementminsplat, min(SRC, IMM))
+DEFINE_OPENCL_SPLAT_OPERAND_DATA_PARALLEL_KERNEL(elementsubsplatlhs, IMM - SRC)
+DEFINE_OPENCL_SPLAT_OPERAND_DATA_PARALLEL_KERNEL(elementdivsplatlhs, IMM / SRC)
+DEFINE_OPENCL_SPLAT_OPERAND_DATA_PARALLEL_KERNEL(elementdivsplatrhs, SRC / IMM)
+DEFINE_OPENCL_SPLAT_OPERAND_DATA_PARALLEL_KERNEL(
+    elementcmpltesplatlhs,
+    select((vtype)0, (vtype)1, islessequal(IMM, SRC)))
+DEFINE_OPENCL_SPLAT_OPERAND_DATA_PARALLEL_KERNEL(
+    elementcmpltesplatrhs,
+    select((vtype)0, (vtype)1, islessequal(SRC, IMM)))
+
+DEFINE_OPENCL_SPLAT_OPERAND_SELECT_KERNEL(elementselectsplatlhs,
+                                          (COND != (vtype)0.0) ? IMM : SRC)
+DEFINE_OPENCL_SPLAT_OPERAND_SELECT_KERNEL(elementselectsplatrhs,
+                                          (COND != (vtype)0.0) ? SRC : IMM)
+
+#undef DEFINE_OPENCL_SPLAT_OPERAND_SELECT_KERNEL
+#undef DEFINE_OPENCL_SPLAT_OPERAND_DATA_PARALLEL_KERNEL
 #undef DEFINE_OPENCL_UNARY_DATA_PARALLEL_KERNEL_WITH_IMM_OPERAND
 #undef DEFINE_OPENCL_BINARY_DATA_PARALLEL_KERNEL
 #undef DEFINE_OPENCL_UNARY_DATA_PARALLEL_KERNEL
 
+/// Macro to define a kernel for data-parallel additive quantized operations.
+/// Both operands are scaled to the scale of the result before \p body is
+/// applied to them.
+/// \p name the name of the kernel
+/// \p body the operation to be performed
+#define DEFINE_OPENCL_BINARY_DATA_PARALLEL_KERNEL_QUANTIZED(name, body)        \
+  __kernel void name##_i8W(__global void *mem, cl_uint32_t dest,              \
+                           cl_uint32_t lhs, cl_uint32_t rhs, int destOffset,   \
+                           int lhsOffset, int rhsOffset, int lhsPre,           \
+                           int lhsPost, int lhsScale, int rhsPre, int rhsPost, \
+                           int rhsScale) {                                     \
+    size_t i = get_global_id(0);                                               \
+    int LHS = scale_i32i8(getInt8Buffer(mem, lhs)[i] - lhsOffset, lhsPre,      \
+                          lhsPost, lhsScale, 0);                               \
+    int RHS = scale_i32i8(getInt8Buffer(mem, rhs)[i] - rhsOffset, rhsPre,      \
+                          rhsPost, rhsScale, 0);                               \
+    getInt8Buffer(mem, dest)[i] = clip_i8((body) + destOffset);                \
+  }
+
+/// Macro to define a kernel for data-parallel multiplicative quantized
+/// operations. The result of \p body is scaled to the scale of the result.
+/// \p name the name of the kernel
+/// \p body the operation to be performed
+#define DEFINE_OPENCL_BINARY_DATA_PARALLEL_KERNEL_QUANTIZED_M(name, body)      \
+  __kernel void name##_i8W(__global void *mem, cl_uint32_t dest,              \
+                           cl_uint32_t lhs, cl_uint32_t rhs, int destOffset,   \
+                           int lhsOffset, int rhsOffset, int pre, int post,    \
+                           int scale) {                                        \
+    size_t i = get_global_id(0);                                               \
+    int LHS = getInt8Buffer(mem, lhs)[i] - lhsOffset;                          \
+    int RHS = getInt8Buffer(mem, rhs)[i] - rhsOffset;                          \
+    getInt8Buffer(mem, dest)[i] =                                              \
+        clip_i8(scale_i32i8((body), pre, post, scale, destOffset));            \
+  }
+
+DEFINE_OPENCL_BINARY_DATA_PARALLEL_KERNEL_QUANTIZED(elementadd, LHS + RHS)
+DEFINE_OPENCL_BINARY_DATA_PARALLEL_KERNEL_QUANTIZED(elementsub, LHS - RHS)
+DEFINE_OPENCL_BINARY_DATA_PARALLEL_KERNEL_QUANTIZED(elementmax, max(LHS, RHS))
+DEFINE_OPENCL_BINARY_DATA_PARALLEL_KERNEL_QUANTIZED(elementmin, min(LHS, RHS))
+DEFINE_OPENCL_BINARY_DATA_PARALLEL_KERNEL_QUANTIZED_M(elementmul, LHS *RHS)
+DEFINE_OPENCL_BINARY_DATA_PARALLEL_KERNEL_QUANTIZED_M(elementdiv, LHS / RHS)
+
+#undef DEFINE_OPENCL_BINARY_DATA_PARALLEL_KERNEL_QUANTIZED_M
+#undef DEFINE_OPENCL_BINARY_DATA_PARALLEL_KERNEL_QUANTIZED
+
+/// The lhs is scaled to the scale of the rhs, so that the integers compare like
+/// the real values.
+__kernel void elementcmplte_i8W(__global void *mem, cl_uint32_t dest,
+                                cl_uint32_t lhs, cl_uint32_t rhs, int lhsOffset,
+                                int rhsOffset, int pre, int post, int scale) {
+  size_t i = get_global_id(0);
+  int LHS = getInt8Buffer(mem, lhs)[i] - lhsOffset;
+  int RHS = getInt8Buffer(mem, rhs)[i] - rhsOffset;
+  getInt8Buffer(mem, dest)[i] = scale_i32i8(LHS, pre, post, scale, 0) <= RHS;
+}
+
+__kernel void elementselect_i8W(__global void *mem, cl_uint32_t dest,
+                                cl_uint32_t cond, cl_uint32_t lhs,
+                                cl_uint32_t rhs, int destOffset, int lhsOffset,
+                                int rhsOffset, int lhsPre, int lhsPost,
+                                int lhsScale, int rhsPre, int rhsPost,
+                                int rhsScale) {
+  size_t i = get_global_id(0);
+  int val = getInt8Buffer(mem, cond)[i]
+                ? scale_i32i8(getInt8Buffer(mem, lhs)[i] - lhsOffset, lhsPre,
+                              lhsPost, lhsScale, destOffset)
+                : scale_i32i8(getInt8Buffer(mem, rhs)[i] - rhsOffset, rhsPre,
+                              rhsPost, rhsScale, destOffset);
+  getInt8Buffer(mem, dest)[i] = clip_i8(val);
+}
+
+/// The value of the splat is quantized by the backend.
+__kernel void splat_i8W(__global void *mem, cl_uint32_t dest, int val) {
+  getInt8Buffer(mem, dest)[get_global_id(0)] = (char)val;
+}
+
+__kernel void quantize_i8W(__global void *mem, cl_uint32_t dest,
+                           cl_uint32_t src, float scale, int offset) {
+  size_t i = get_global_id(0);
+  int val = (int)round(getFloatBuffer(mem, src)[i] / scale + offset);
+  getInt8Buffer(mem, dest)[i] = clip_i8(val);
+}
+
+__kernel void dequantizeW(__global void *mem, cl_uint32_t dest,
+                          cl_uint32_t src, float scale, int offset) {
+  size_t i = get_global_id(0);
+  getFloatBuffer(mem, dest)[i] = scale * (getInt8Buffer(mem, src)[i] - offset);
+}
+
+__kernel void rescalequantized_i8W(__global void *mem, cl_uint32_t dest,
+                                   cl_uint32_t src, int destOffset,
+                                   int srcOffset, int pre, int post,
+                                   int scale) {
+  size_t i = get_global_id(0);
+  int val = getInt8Buffer(mem, src)[i] - srcOffset;
+  getInt8Buffer(mem, dest)[i] =
+      clip_i8(scale_i32i8(val, pre, post, scale, destOffset));
+}
+
 __kernel void elementcmplteK16(__global float *dest, __global float *LHS,
                                __global float *RHS) {
   size_t i = get_global_id(0);
@@ -283,6 +553,29 @@ __kernel void elementcmplteW(__global void *mem, cl_uint32_t dest,
   elementcmplteK(&mem[dest], &mem[LHS], &mem[RHS]);
 }
 
+/// Updates one element of the weights \p W with the gradient \p G and, with
+/// momentum, accumulates the update in \p gsum.
+__kernel void sgdK(__global float *W, __global float *gsum, __global float *G,
+                   float L1Decay, float L2Decay, float learningRate,
+                   float momentum, float batchSize) {
+  size_t i = get_global_id(0);
+  float w = W[i];
+  float g = G[i] + L1Decay * (w >= 0 ? 1 : -1) + L2Decay * w;
+  float dx = -learningRate * (g / batchSize);
+  if (momentum > 0) {
+    dx += momentum * gsum[i];
+    gsum[i] = dx;
+  }
+  W[i] = w + dx;
+}
+
+__kernel void sgdW(__global void *mem, cl_uint32_t W, cl_uint32_t gsum,
+                   cl_uint32_t G, float L1Decay, float L2Decay,
+                   float learningRate, float momentum, float batchSize) {
+  sgdK(&mem[W], &mem[gsum], &mem[G], L1Decay, L2Decay, learningRate, momentum,
+       batchSize);
+}
+
 __kernel void batchedreduceaddK(__global float *dest, __global float *batch,
                                 cl_uint32_t numSlice, cl_uint32_t sliceSize) {
   size_t s = get_global_id(0);
@@ -298,6 +591,48 @@ __kernel void batchedreduceaddW(__global void *mem, cl_uint32_t dest,
   batchedreduceaddK(&mem[dest], &mem[batch], numSlice, sliceSize);
 }
 
+/// Reduces the collapsed dimensions \p dims of \p src that are marked in \p
+/// reduced into the element of \p dest of this work item. \p mode is a
+/// ReduceMode: 0 is a sum, 1 is a mean and 2 is a max.
+__kernel void reduceK(__global float *dest, __global float *src,
+                      ShapeNHWC dims, ShapeNHWC reduced, cl_uint32_t mode) {
+  size_t d = get_global_id(0);
+  size_t dim[4] = {dims.n, dims.h, dims.w, dims.c};
+  size_t red[4] = {reduced.n, reduced.h, reduced.w, reduced.c};
+
+  // Find the first source element from the kept coordinates of the result,
+  // and the number of elements that are reduced into it.
+  size_t base = 0;
+  size_t count = 1;
+  for (size_t i = 4, stride = 1, rem = d; i-- > 0; stride *= dim[i]) {
+    if (red[i]) {
+      count *= dim[i];
+    } else {
+      base += (rem % dim[i]) * stride;
+      rem /= dim[i];
+    }
+  }
+
+  float acc = (mode == 2) ? -FLT_MAX : 0;
+  for (size_t r = 0; r < count; r++) {
+    size_t offset = 0;
+    for (size_t i = 4, stride = 1, rem = r; i-- > 0; stride *= dim[i]) {
+      if (red[i]) {
+        offset += (rem % dim[i]) * stride;
+        rem /= dim[i];
+      }
+    }
+    float val = src[base + offset];
+    acc = (mode == 2) ? max(acc, val) : acc + val;
+  }
+  dest[d] = (mode == 1) ? acc / count : acc;
+}
+
+__kernel void reduceW(__global void *mem, cl_uint32_t dest, cl_uint32_t src,
+                      ShapeNHWC dims, ShapeNHWC reduced, cl_uint32_t mode) {
+  reduceK(&mem[dest], &mem[src], dims, reduced, mode);
+}
+
 __kernel void batchedaddK(__global float *dest, __global float *batch,
                           __global float *slice, cl_uint32_t numSlice,
                           cl_uint32_t sliceSize) {
@@ -313,27 +648,158 @@ __kernel void batchedaddW(__global void *mem, cl_uint32_t dest,
   batchedaddK(&mem[dest], &mem[batch], &mem[slice], numSlice, sliceSize);
 }
 
-__kernel void matmulK(__global float *dest, __global float *lhs,
-                      __global float *rhs, ShapeNHWC ddim, ShapeNHWC ldim,
-                      ShapeNHWC rdim) {
-  // For each X in the destination matrix.
-  size_t x = get_global_id(0);
-  // For each Y in the destination matrix.
-  size_t y = get_global_id(1);
+__kernel void batchedadd_i8W(__global void *mem, cl_uint32_t destIdx,
+                             cl_uint32_t batchIdx, cl_uint32_t sliceIdx,
+                             cl_uint32_t numSlice, cl_uint32_t sliceSize,
+                             int destOffset, int batchOffset, int sliceOffset,
+                             int batchPre, int batchPost, int batchScale,
+                             int slicePre, int slicePost, int sliceScale) {
+  __global char *dest = getInt8Buffer(mem, destIdx);
+  __global char *batch = getInt8Buffer(mem, batchIdx);
+  size_t s = get_global_id(0);
+  int y = scale_i32i8(getInt8Buffer(mem, sliceIdx)[s] - sliceOffset, slicePre,
+                      slicePost, sliceScale, 0);
+  for (size_t n = 0; n < numSlice; n++) {
+    int x = scale_i32i8(batch[n * sliceSize + s] - batchOffset, batchPre,
+                        batchPost, batchScale, 0);
+    dest[n * sliceSize + s] = clip_i8(x + y + destOffset);
+  }
+}
 
-  // Perform DOT on the row an column.
-  float sum = 0;
-  for (size_t i = 0; i < ldim.h; i++) {
-    sum += lhs[getNHWC(ldim, x, i, 0, 0)] * rhs[getNHWC(rdim, i, y, 0, 0)];
+__kernel void batchedreduceadd_i8W(__global void *mem, cl_uint32_t destIdx,
+                                   cl_uint32_t batchIdx, cl_uint32_t numSlice,
+                                   cl_uint32_t sliceSize, int destOffset,
+                                   int batchOffset, int batchPre,
+                                   int batchPost, int batchScale) {
+  __global char *batch = getInt8Buffer(mem, batchIdx);
+  size_t s = get_global_id(0);
+  int sum = 0;
+  for (size_t n = 0; n < numSlice; n++) {
+    sum += batch[n * sliceSize + s] - batchOffset;
   }
+  getInt8Buffer(mem, destIdx)[s] = clip_i8(
+      scale_i32i8(sum, batchPre, batchPost, batchScale, destOffset));
+}
 
-  dest[getNHWC(ddim, x, y, 0, 0)] = sum;
+/// The tile size TILE_SIZE and the number of the output rows of a tile that a
+/// work-item computes, WORK_PER_THREAD, are defined by the backend when it
+/// builds the program for a device.
+#ifndef TILE_SIZE
+#define TILE_SIZE 16
+#endif
+#ifndef WORK_PER_THREAD
+#define WORK_PER_THREAD 4
+#endif
+/// The number of work-items along the rows of a tile.
+#define TILE_ROWS (TILE_SIZE / WORK_PER_THREAD)
+
+/// Compute the TILE_SIZE x TILE_SIZE tile of the matrix multiplication
+/// sum(lhs[m, k] * rhs[k, n]) that belongs to the work-group, accumulating in
+/// the type \p T, and pass every accumulated element (m, n) of the tile to
+/// STORE(m, n, acc). The work-group has TILE_SIZE x TILE_ROWS work-items, and
+/// each one of them accumulates WORK_PER_THREAD rows of one column in
+/// registers. The blocks of lhs and rhs are staged in local memory. The
+/// element (m, k) of lhs is loaded by LOAD_LHS, so that the convolution can
+/// read its input patches directly, and LOAD_RHS_TILE(r, k0) stores the
+/// elements of the r'th row of the work-group into the block of rhs that
+/// starts at the row k0, so that the reads of the work-group are consecutive
+/// in memory for the layouts of both rhs.
+#define DEFINE_TILED_MATMUL_BODY(T, LOAD_LHS, LOAD_RHS_TILE, STORE)            \
+  size_t lx = get_local_id(0);                                                 \
+  size_t ly = get_local_id(1);                                                 \
+  size_t col = get_group_id(0) * TILE_SIZE + lx;                               \
+  size_t tileRow = get_group_id(1) * TILE_SIZE;                                \
+  __local T lhsTile[TILE_SIZE][TILE_SIZE];                                     \
+  __local T rhsTile[TILE_SIZE][TILE_SIZE];                                     \
+  T acc[WORK_PER_THREAD];                                                      \
+  for (size_t w = 0; w < WORK_PER_THREAD; w++) {                               \
+    acc[w] = 0;                                                                \
+  }                                                                            \
+  for (size_t k0 = 0; k0 < K; k0 += TILE_SIZE) {                               \
+    for (size_t w = 0; w < WORK_PER_THREAD; w++) {                             \
+      size_t r = ly + w * TILE_ROWS;                                           \
+      size_t m = tileRow + r;                                                  \
+      size_t k = k0 + lx;                                                      \
+      lhsTile[r][lx] = (m < M && k < K) ? LOAD_LHS(m, k) : 0;                  \
+      LOAD_RHS_TILE(r, k0);                                                    \
+    }                                                                          \
+    barrier(CLK_LOCAL_MEM_FENCE);                                              \
+    for (size_t k = 0; k < TILE_SIZE; k++) {                                   \
+      T b = rhsTile[k][lx];                                                    \
+      for (size_t w = 0; w < WORK_PER_THREAD; w++) {                           \
+        acc[w] += lhsTile[ly + w * TILE_ROWS][k] * b;                          \
+      }                                                                        \
+    }                                                                          \
+    barrier(CLK_LOCAL_MEM_FENCE);                                              \
+  }                                                                            \
+  if (col < N) {                                                               \
+    for (size_t w = 0; w < WORK_PER_THREAD; w++) {                             \
+      size_t m = tileRow + ly + w * TILE_ROWS;                                 \
+      if (m < M) {                                                             \
+        STORE(m, col, acc[w]);                                                 \
+      }                                                                        \
+    }                                                                          \
+  }
+
+/// The tiled kernels declare their local memory, so they are not split into
+/// a K kernel that is called by the W kernel.
+/// If \p transLHS or \p transRHS is set then the operand is stored transposed,
+/// with the shape [K, M] or [N, K], respectively.
+__kernel void matmulW(__global void *mem, cl_uint32_t destIdx,
+                      cl_uint32_t lhsIdx, cl_uint32_t rhsIdx, ShapeNHWC ddim,
+                      ShapeNHWC ldim, ShapeNHWC rdim, cl_uint32_t transLHS,
+                      cl_uint32_t transRHS) {
+#ifdef SPECIALIZE_matmulW
+  SPECIALIZE_SHAPE(ddim, SPEC_DDIM);
+  SPECIALIZE_SHAPE(ldim, SPEC_LDIM);
+  transLHS = SPEC_TRANS_LHS;
+  transRHS = SPEC_TRANS_RHS;
+#endif
+  __global float *dest = getFloatBuffer(mem, destIdx);
+  __global float *lhs = getFloatBuffer(mem, lhsIdx);
+  __global float *rhs = getFloatBuffer(mem, rhsIdx);
+  size_t M = ddim.n;
+  size_t N = ddim.h;
+  size_t K = transLHS ? ldim.n : ldim.h;
+#define LOAD_MATRIX_LHS(m, k) (transLHS ? lhs[(k)*M + (m)] : lhs[(m)*K + (k)])
+#define LOAD_MATRIX_RHS_TILE(r, k0)                                            \
+  rhsTile[r][lx] = (k0 + r < K && col < N)                                     \
+                       ? (transRHS ? rhs[col * K + k0 + r]                     \
+                                   : rhs[(k0 + r) * N + col])                  \
+                       : 0
+#define STORE_MATRIX(m, n, acc) dest[(m)*N + (n)] = acc
+  DEFINE_TILED_MATMUL_BODY(float, LOAD_MATRIX_LHS, LOAD_MATRIX_RHS_TILE,
+                           STORE_MATRIX)
+#undef STORE_MATRIX
+#undef LOAD_MATRIX_RHS_TILE
+#undef LOAD_MATRIX_LHS
 }
 
-__kernel void matmulW(__global void *mem, cl_uint32_t dest, cl_uint32_t lhs,
-                      cl_uint32_t rhs, ShapeNHWC ddim, ShapeNHWC ldim,
-                      ShapeNHWC rdim) {
-  matmulK(&mem[dest], &mem[lhs], &mem[rhs], ddim, ldim, rdim);
+/// The operands of the quantized matrix multiplication are accumulated
+/// without their offsets, and the sums are scaled to the result.
+__kernel void matmul_i8W(__global void *mem, cl_uint32_t destIdx,
+                         cl_uint32_t lhsIdx, cl_uint32_t rhsIdx, ShapeNHWC ddim,
+                         ShapeNHWC ldim, ShapeNHWC rdim, int destOffset,
+                         int lhsOffset, int rhsOffset, int outPre, int outPost,
+                         int outScale) {
+  __global char *dest = getInt8Buffer(mem, destIdx);
+  __global char *lhs = getInt8Buffer(mem, lhsIdx);
+  __global char *rhs = getInt8Buffer(mem, rhsIdx);
+  size_t M = ddim.n;
+  size_t N = ddim.h;
+  size_t K = ldim.h;
+#define LOAD_MATRIX_LHS(m, k) (lhs[(m)*K + (k)] - lhsOffset)
+#define LOAD_MATRIX_RHS_TILE(r, k0)                                            \
+  rhsTile[r][lx] =                                                             \
+      (k0 + r < K && col < N) ? rhs[(k0 + r) * N + col] - rhsOffset : 0
+#define STORE_MATRIX(m, n, acc)                                                \
+  dest[(m)*N + (n)] =                                                          \
+      clip_i8(scale_i32i8(acc, outPre, outPost, outScale, destOffset))
+  DEFINE_TILED_MATMUL_BODY(int, LOAD_MATRIX_LHS, LOAD_MATRIX_RHS_TILE,
+                           STORE_MATRIX)
+#undef STORE_MATRIX
+#undef LOAD_MATRIX_RHS_TILE
+#undef LOAD_MATRIX_LHS
 }
 
 __kernel void softmaxK(__global float *dest, __global float *src,
@@ -379,55 +845,197 @@ __kernel void softmaxgradW(__global void *mem,
   softmaxgradK(&mem[srcGrad], &mem[origDest], &mem[selected], sliceSize);
 }
 
-__kernel void convolutionK(__global float *dest, __global float *src,
-                           __global float *filter, __global float *bias,
-                           cl_uint32_t filterSize, cl_uint32_t stride,
-                           cl_uint32_t pad, ShapeNHWC odim, ShapeNHWC idim,
-                           ShapeNHWC filterDim) {
-  size_t ax = get_global_id(0);
-  size_t ay = get_global_id(1);
-  size_t d = get_global_id(2);
+/// Normalizes the channels of the pixel of this work item. The squared sum
+/// slides along the channels, so every channel costs O(1).
+__kernel void localresponsenormalizationK(__global float *dest,
+                                          __global float *src,
+                                          __global float *scaleCache,
+                                          cl_uint32_t halfWindow, float alpha,
+                                          float beta, float k, ShapeNHWC dim) {
+  size_t C = dim.c;
+  size_t base = get_global_id(0) * C;
+  float normedAlpha = alpha / (2 * halfWindow + 1);
+
+  float m2 = 0;
+  for (size_t i = 0; i < halfWindow && i < C; i++) {
+    m2 += src[base + i] * src[base + i];
+  }
+  for (size_t c = 0; c < C; c++) {
+    if (c + halfWindow < C) {
+      float val = src[base + c + halfWindow];
+      m2 += val * val;
+    }
+    if (c > halfWindow) {
+      float val = src[base + c - halfWindow - 1];
+      m2 -= val * val;
+    }
+    scaleCache[base + c] = k + normedAlpha * max(m2, 0.0f);
+  }
+  // The destination may alias the source, so it is written last.
+  for (size_t c = 0; c < C; c++) {
+    dest[base + c] = src[base + c] * pow(scaleCache[base + c], -beta);
+  }
+}
 
-  typedef int ssize_t;
-  // For each convolution 'jump' in the input tensor:
-  ssize_t x = -(ssize_t)pad + ax * stride;
-  ssize_t y = -(ssize_t)pad + ay * stride;
+__kernel void localresponsenormalizationW(__global void *mem, cl_uint32_t dest,
+                                          cl_uint32_t src, cl_uint32_t scale,
+                                          cl_uint32_t halfWindow, float alpha,
+                                          float beta, float k, ShapeNHWC dim) {
+  localresponsenormalizationK(&mem[dest], &mem[src], &mem[scale], halfWindow,
+                              alpha, beta, k, dim);
+}
 
-  // For each input in the batch:
-  for (size_t n = 0; n < idim.n; n++) {
+/// Computes the gradient of the channels of the pixel of this work item. The
+/// window sum of destGrad * dest / scale slides along the channels.
+__kernel void localresponsenormalizationgradK(
+    __global float *dest, __global float *src, __global float *scaleCache,
+    __global float *destGrad, __global float *srcGrad, cl_uint32_t halfWindow,
+    float alpha, float beta, ShapeNHWC dim) {
+  size_t C = dim.c;
+  size_t base = get_global_id(0) * C;
+  float coeff = 2 * alpha / (2 * halfWindow + 1) * beta;
 
-    // For each element in the convolution-filter:
-    float sum = 0;
-    for (size_t fx = 0; fx < filterSize; fx++) {
-      for (size_t fy = 0; fy < filterSize; fy++) {
-        ssize_t ox = x + fx;
-        ssize_t oy = y + fy;
+  float sum = 0;
+  for (size_t i = 0; i < halfWindow && i < C; i++) {
+    size_t j = base + i;
+    sum += destGrad[j] * (dest[j] / scaleCache[j]);
+  }
+  for (size_t c = 0; c < C; c++) {
+    if (c + halfWindow < C) {
+      size_t j = base + c + halfWindow;
+      sum += destGrad[j] * (dest[j] / scaleCache[j]);
+    }
+    if (c > halfWindow) {
+      size_t j = base + c - halfWindow - 1;
+      sum -= destGrad[j] * (dest[j] / scaleCache[j]);
+    }
+    size_t i = base + c;
+    srcGrad[i] =
+        destGrad[i] * pow(scaleCache[i], -beta) - coeff * src[i] * sum;
+  }
+}
 
-        // Ignore index access below zero (this is due to padding).
-        if (ox < 0 || oy < 0 || ox >= (ssize_t)idim.h ||
-            oy >= (ssize_t)idim.w) {
-          continue;
-        }
+__kernel void localresponsenormalizationgradW(
+    __global void *mem, cl_uint32_t dest, cl_uint32_t src, cl_uint32_t scale,
+    cl_uint32_t destGrad, cl_uint32_t srcGrad, cl_uint32_t halfWindow,
+    float alpha, float beta, ShapeNHWC dim) {
+  localresponsenormalizationgradK(&mem[dest], &mem[src], &mem[scale],
+                                  &mem[destGrad], &mem[srcGrad], halfWindow,
+                                  alpha, beta, dim);
+}
 
-        for (size_t fd = 0; fd < idim.c; fd++) {
-          sum += filter[getNHWC(filterDim, d, fx, fy, fd)] *
-                 src[getNHWC(idim, n, (size_t)ox, (size_t)oy, fd)];
-        }
-      }
-    }
+/// \returns the input element of the convolution that the tap \p k of the
+/// output pixel \p m reads, or zero if it falls into the padding. The output
+/// pixels are the rows and the taps of the filter [K, K, C] are the columns of
+/// the implicit GEMM.
+float loadConvPatch(__global float *src, size_t m, size_t k,
+                    cl_uint32_t filterSize, cl_uint32_t stride, cl_uint32_t pad,
+                    ShapeNHWC odim, ShapeNHWC idim) {
+  typedef int ssize_t;
+  size_t ay = m % odim.w;
+  size_t ax = (m / odim.w) % odim.h;
+  size_t n = m / (odim.w * odim.h);
+  size_t c = k % idim.c;
+  size_t fy = (k / idim.c) % filterSize;
+  size_t fx = k / (idim.c * filterSize);
+  ssize_t ox = -(ssize_t)pad + ax * stride + fx;
+  ssize_t oy = -(ssize_t)pad + ay * stride + fy;
+  // Ignore index access below zero (this is due to padding).
+  if (ox < 0 || oy < 0 || ox >= (ssize_t)idim.h || oy >= (ssize_t)idim.w) {
+    return 0;
+  }
+  return src[getNHWC(idim, n, (size_t)ox, (size_t)oy, c)];
+}
 
-    sum += bias[d];
-    dest[getNHWC(odim, n, ax, ay, d)] = sum;
-  } // N
+/// \returns the input element of the quantized convolution that the tap \p k
+/// of the output pixel \p m reads, without the offset \p srcOffset, or zero if
+/// it falls into the padding.
+int loadConvPatch_i8(__global char *src, size_t m, size_t k,
+                     cl_uint32_t filterSize, cl_uint32_t stride,
+                     cl_uint32_t pad, ShapeNHWC odim, ShapeNHWC idim,
+                     int srcOffset) {
+  typedef int ssize_t;
+  size_t ay = m % odim.w;
+  size_t ax = (m / odim.w) % odim.h;
+  size_t n = m / (odim.w * odim.h);
+  size_t c = k % idim.c;
+  size_t fy = (k / idim.c) % filterSize;
+  size_t fx = k / (idim.c * filterSize);
+  ssize_t ox = -(ssize_t)pad + ax * stride + fx;
+  ssize_t oy = -(ssize_t)pad + ay * stride + fy;
+  // Ignore index access below zero (this is due to padding).
+  if (ox < 0 || oy < 0 || ox >= (ssize_t)idim.h || oy >= (ssize_t)idim.w) {
+    return 0;
+  }
+  return src[getNHWC(idim, n, (size_t)ox, (size_t)oy, c)] - srcOffset;
 }
 
-__kernel void convolutionW(__global void *mem, cl_uint32_t dest,
-                           cl_uint32_t src, cl_uint32_t filter,
-                           cl_uint32_t bias, cl_uint32_t filterSize,
+/// The convolution is computed as the implicit GEMM of the input patches
+/// [N * OH * OW, K * K * C] with the transposed filter [K * K * C, D]. The
+/// filter [D, K, K, C] is read in place as the rhs, along its columns.
+__kernel void convolutionW(__global void *mem, cl_uint32_t destIdx,
+                           cl_uint32_t srcIdx, cl_uint32_t filterIdx,
+                           cl_uint32_t biasIdx, cl_uint32_t filterSize,
                            cl_uint32_t stride, cl_uint32_t pad, ShapeNHWC odim,
                            ShapeNHWC idim, ShapeNHWC filterDim) {
-  convolutionK(&mem[dest], &mem[src], &mem[filter], &mem[bias], filterSize,
-               stride, pad, odim, idim, filterDim);
+#ifdef SPECIALIZE_convolutionW
+  SPECIALIZE_WINDOW();
+#endif
+  __global float *dest = getFloatBuffer(mem, destIdx);
+  __global float *src = getFloatBuffer(mem, srcIdx);
+  __global float *filter = getFloatBuffer(mem, filterIdx);
+  __global float *bias = getFloatBuffer(mem, biasIdx);
+  size_t M = odim.n * odim.h * odim.w;
+  size_t N = odim.c;
+  size_t K = filterSize * filterSize * idim.c;
+  size_t tileCol = get_group_id(0) * TILE_SIZE;
+#define LOAD_CONV_LHS(m, k)                                                    \
+  loadConvPatch(src, m, k, filterSize, stride, pad, odim, idim)
+#define LOAD_CONV_RHS_TILE(r, k0)                                              \
+  rhsTile[lx][r] = (tileCol + r < N && k0 + lx < K)                            \
+                       ? filter[(tileCol + r) * K + k0 + lx]                   \
+                       : 0
+#define STORE_CONV(m, n, acc) dest[(m)*N + (n)] = acc + bias[n]
+  DEFINE_TILED_MATMUL_BODY(float, LOAD_CONV_LHS, LOAD_CONV_RHS_TILE,
+                           STORE_CONV)
+#undef STORE_CONV
+#undef LOAD_CONV_RHS_TILE
+#undef LOAD_CONV_LHS
+}
+
+/// The quantized convolution accumulates the input and the filter without
+/// their offsets. The bias is scaled to the scale of the accumulators, and
+/// the sums are scaled to the output.
+__kernel void convolution_i8W(
+    __global void *mem, cl_uint32_t destIdx, cl_uint32_t srcIdx,
+    cl_uint32_t filterIdx, cl_uint32_t biasIdx, cl_uint32_t filterSize,
+    cl_uint32_t stride, cl_uint32_t pad, ShapeNHWC odim, ShapeNHWC idim,
+    ShapeNHWC filterDim, int destOffset, int srcOffset, int filterOffset,
+    int biasOffset, int biasPre, int biasPost, int biasScale, int outPre,
+    int outPost, int outScale) {
+  __global char *dest = getInt8Buffer(mem, destIdx);
+  __global char *src = getInt8Buffer(mem, srcIdx);
+  __global char *filter = getInt8Buffer(mem, filterIdx);
+  __global char *bias = getInt8Buffer(mem, biasIdx);
+  size_t M = odim.n * odim.h * odim.w;
+  size_t N = odim.c;
+  size_t K = filterSize * filterSize * idim.c;
+  size_t tileCol = get_group_id(0) * TILE_SIZE;
+#define LOAD_CONV_LHS(m, k)                                                    \
+  loadConvPatch_i8(src, m, k, filterSize, stride, pad, odim, idim, srcOffset)
+#define LOAD_CONV_RHS_TILE(r, k0)                                              \
+  rhsTile[lx][r] = (tileCol + r < N && k0 + lx < K)                            \
+                       ? filter[(tileCol + r) * K + k0 + lx] - filterOffset    \
+                       : 0
+#define STORE_CONV(m, n, acc)                                                  \
+  dest[(m)*N + (n)] = clip_i8(                                                 \
+      scale_i32i8(acc + scale_i32i8(bias[n] - biasOffset, biasPre, biasPost,   \
+                                    biasScale, 0),                             \
+                  outPre, outPost, outScale, destOffset))
+  DEFINE_TILED_MATMUL_BODY(int, LOAD_CONV_LHS, LOAD_CONV_RHS_TILE, STORE_CONV)
+#undef STORE_CONV
+#undef LOAD_CONV_RHS_TILE
+#undef LOAD_CONV_LHS
 }
 
 __kernel void poolmaxK(__global float *dest, __global float *src,
@@ -474,6 +1082,9 @@ __kernel void poolmaxK(__global float *dest, __global float *src,
 __kernel void poolmaxW(__global void *mem, cl_uint32_t dest, cl_uint32_t src,
                        cl_uint32_t filterSize, cl_uint32_t stride,
                        cl_uint32_t pad, ShapeNHWC odim, ShapeNHWC idim) {
+#ifdef SPECIALIZE_poolmaxW
+  SPECIALIZE_WINDOW();
+#endif
   poolmaxK(&mem[dest], &mem[src], filterSize, stride, pad, odim, idim);
 }
 
@@ -574,112 +1185,200 @@ __kernel void poolavgK(__global float *dest, __global float *src,
 __kernel void poolavgW(__global void *mem, cl_uint32_t dest, cl_uint32_t src,
                        cl_uint32_t filterSize, cl_uint32_t stride,
                        cl_uint32_t pad, ShapeNHWC odim, ShapeNHWC idim) {
+#ifdef SPECIALIZE_poolavgW
+  SPECIALIZE_WINDOW();
+#endif
   poolavgK(&mem[dest], &mem[src], filterSize, stride, pad, odim, idim);
 }
 
-__kernel void transposeK(__global float *dest, __global float *src,
-                         ShapeNHWC odim, ShapeNHWC idim, ShapeNHWC shuffle) {
-  size_t d0 = get_global_id(0);
-  size_t res[4];
-  res[0] = d0;
-  for (size_t d1 = 0; d1 < idim.h; d1++) {
-    res[1] = d1;
-    for (size_t d2 = 0; d2 < idim.w; d2++) {
-      res[2] = d2;
-      for (size_t d3 = 0; d3 < idim.c; d3++) {
-        res[3] = d3;
-        size_t dstIdx = getNHWC(odim, res[shuffle.n], res[shuffle.h],
-                                res[shuffle.w], res[shuffle.c]);
-        size_t srcIdx = getNHWC(idim, d0, d1, d2, d3);
-        dest[dstIdx] = src[srcIdx];
-      }
-    }
-  }
-}
+/// The input and the output of the quantized max pooling have the same scale
+/// and offset, so the integers are compared directly.
+__kernel void poolmax_i8W(__global void *mem, cl_uint32_t destIdx,
+                          cl_uint32_t srcIdx, cl_uint32_t filterSize,
+                          cl_uint32_t stride, cl_uint32_t pad, ShapeNHWC odim,
+                          ShapeNHWC idim) {
+  __global char *dest = getInt8Buffer(mem, destIdx);
+  __global char *src = getInt8Buffer(mem, srcIdx);
+  size_t ax = get_global_id(0);
+  size_t ay = get_global_id(1);
+  size_t d = get_global_id(2);
 
-__kernel void transposeW(__global void *mem, cl_uint32_t dest, cl_uint32_t src,
-                         ShapeNHWC odim, ShapeNHWC idim, ShapeNHWC shuffle) {
-  transposeK(&mem[dest], &mem[src], odim, idim, shuffle);
-}
-
-__kernel void inserttensorK(__global float *dest, __global float *src,
-                            ShapeNHWC odim, ShapeNHWC idim, ShapeNHWC offset) {
-  size_t d0 = get_global_id(0);
-  size_t offset_w = ((odim.w > 1) ? offset.w : 0);
-  size_t offset_c = ((odim.c > 1) ? offset.c : 0);
-  for (size_t d1 = 0; d1 < idim.h; d1++) {
-    for (size_t d2 = 0; d2 < idim.w; d2++) {
-      for (size_t d3 = 0; d3 < idim.c; d3++) {
-        size_t r0 = d0 + offset.n;
-        size_t r1 = d1 + offset.h;
-        size_t r2 = d2 + offset_w;
-        size_t r3 = d3 + offset_c;
-        size_t srcIdx = getNHWC(idim, d0, d1, d2, d3);
-        size_t destIdx = getNHWC(odim, r0, r1, r2, r3);
-        dest[destIdx] = src[srcIdx];
-      }
-    }
-  }
-}
+  typedef int ssize_t;
+  // For each convolution 'jump' in the input tensor:
+  ssize_t x = -(ssize_t)pad + ax * stride;
+  ssize_t y = -(ssize_t)pad + ay * stride;
 
-__kernel void inserttensorW(__global void *mem, cl_uint32_t dest,
-                            cl_uint32_t src, ShapeNHWC odim, ShapeNHWC idim,
-                            ShapeNHWC offset) {
-  inserttensorK(&mem[dest], &mem[src], odim, idim, offset);
-}
-
-__kernel void extracttensorK(__global float *dest,
-                             __global float *src,
-                             ShapeNHWC odim,
-                             ShapeNHWC idim,
-                             ShapeNHWC offset) {
-  size_t d0 = get_global_id(0);
-  size_t offset_w = ((odim.w > 1) ? offset.w : 0);
-  size_t offset_c = ((odim.c > 1) ? offset.c : 0);
-  for (size_t d1 = 0; d1 < odim.h; d1++) {
-    for (size_t d2 = 0; d2 < odim.w; d2++) {
-      for (size_t d3 = 0; d3 < odim.c; d3++) {
-        size_t r0 = d0 + offset.n;
-        size_t r1 = d1 + offset.h;
-        size_t r2 = d2 + offset_w;
-        size_t r3 = d3 + offset_c;
-        size_t destIdx = getNHWC(odim, d0, d1, d2, d3);
-        size_t srcIdx = getNHWC(idim, r0, r1, r2, r3);
-        dest[destIdx] = src[srcIdx];
+  // For each input in the batch:
+  for (size_t n = 0; n < idim.n; n++) {
+    char maxVal = 0;
+    bool first = true;
+
+    // For each element in the convolution-filter:
+    for (size_t fx = 0; fx < filterSize; fx++) {
+      for (size_t fy = 0; fy < filterSize; fy++) {
+        ssize_t ox = x + fx;
+        ssize_t oy = y + fy;
+
+        // Ignore index access below zero (this is due to padding).
+        if (ox < 0 || oy < 0 || ox >= (ssize_t)idim.h ||
+            oy >= (ssize_t)idim.w) {
+          continue;
+        }
+
+        char val = src[getNHWC(idim, n, (size_t)ox, (size_t)oy, d)];
+
+        if (first || (val >= maxVal)) {
+          first = false;
+          maxVal = val;
+        }
       }
     }
-  }
+    dest[getNHWC(odim, n, ax, ay, d)] = maxVal;
+  } // N
 }
 
-__kernel void extracttensorW(__global void *mem, cl_uint32_t dest,
-                             cl_uint32_t src, ShapeNHWC odim, ShapeNHWC idim,
-                             ShapeNHWC offset) {
-  extracttensorK(&mem[dest], &mem[src], odim, idim, offset);
-}
+/// The sum of the quantized average pooling is scaled by the ratio of the
+/// scales divided by the area of the filter.
+__kernel void poolavg_i8W(__global void *mem, cl_uint32_t destIdx,
+                          cl_uint32_t srcIdx, cl_uint32_t filterSize,
+                          cl_uint32_t stride, cl_uint32_t pad, ShapeNHWC odim,
+                          ShapeNHWC idim, int destOffset, int srcOffset,
+                          int outPre, int outPost, int outScale) {
+  __global char *dest = getInt8Buffer(mem, destIdx);
+  __global char *src = getInt8Buffer(mem, srcIdx);
+  size_t ax = get_global_id(0);
+  size_t ay = get_global_id(1);
+  size_t d = get_global_id(2);
+
+  typedef int ssize_t;
+  // For each convolution 'jump' in the input tensor:
+  ssize_t x = -(ssize_t)pad + ax * stride;
+  ssize_t y = -(ssize_t)pad + ay * stride;
+
+  // For each input in the batch:
+  for (size_t n = 0; n < idim.n; n++) {
+    int sum = 0;
+    // For each element in the convolution-filter:
+    for (size_t fx = 0; fx < filterSize; fx++) {
+      for (size_t fy = 0; fy < filterSize; fy++) {
+        ssize_t ox = x + fx;
+        ssize_t oy = y + fy;
+
+        // Ignore index access below zero (this is due to padding).
+        if (ox < 0 || oy < 0 || ox >= (ssize_t)idim.h ||
+            oy >= (ssize_t)idim.w) {
+          continue;
+        }
 
-void memcpy_float(__global float *dest, const __global float *src, int len) {
-    for(int i=0;i<len;i++) {
-      dest[i]=src[i];
+        sum += src[getNHWC(idim, n, (size_t)ox, (size_t)oy, d)] - srcOffset;
+      }
     }
+    dest[getNHWC(odim, n, ax, ay, d)] =
+        clip_i8(scale_i32i8(sum, outPre, outPost, outScale, destOffset));
+  } // N
 }
 
-__kernel void gatherK(__global float *dest,
-                      __global const float *src,
-                      __global cl_uint64_t *indices,
-                      cl_uint32_t numIndices,
-                      cl_uint32_t sliceSize) {
-  int idx = get_global_id(0);
-  cl_uint64_t slice = indices[idx];
-  memcpy_float(dest + idx * sliceSize, src + slice * sliceSize, sliceSize);
-}
+/// Macro to define the kernels that move the elements of the type \p type
+/// without changing them: transpose, inserttensor, extracttensor and gather,
+/// with the suffix \p suffix.
+#define DEFINE_OPENCL_DATA_MOVEMENT_KERNELS(suffix, type)                      \
+  __kernel void transpose##suffix##K(__global type *dest, __global type *src,  \
+                                     ShapeNHWC odim, ShapeNHWC idim,           \
+                                     ShapeNHWC shuffle) {                      \
+    size_t d0 = get_global_id(0);                                              \
+    size_t res[4];                                                             \
+    res[0] = d0;                                                               \
+    for (size_t d1 = 0; d1 < idim.h; d1++) {                                   \
+      res[1] = d1;                                                             \
+      for (size_t d2 = 0; d2 < idim.w; d2++) {                                 \
+        res[2] = d2;                                                           \
+        for (size_t d3 = 0; d3 < idim.c; d3++) {                               \
+          res[3] = d3;                                                         \
+          size_t dstIdx = getNHWC(odim, res[shuffle.n], res[shuffle.h],        \
+                                  res[shuffle.w], res[shuffle.c]);             \
+          size_t srcIdx = getNHWC(idim, d0, d1, d2, d3);                       \
+          dest[dstIdx] = src[srcIdx];                                          \
+        }                                                                      \
+      }                                                                        \
+    }                                                                          \
+  }                                                                            \
+  __kernel void transpose##suffix##W(__global void *mem, cl_uint32_t dest,     \
+                                     cl_uint32_t src, ShapeNHWC odim,          \
+                                     ShapeNHWC idim, ShapeNHWC shuffle) {      \
+    transpose##suffix##K(&mem[dest], &mem[src], odim, idim, shuffle);          \
+  }                                                                            \
+  __kernel void inserttensor##suffix##K(__global type *dest,                   \
+                                        __global type *src, ShapeNHWC odim,    \
+                                        ShapeNHWC idim, ShapeNHWC offset) {    \
+    size_t d0 = get_global_id(0);                                              \
+    size_t offset_w = ((odim.w > 1) ? offset.w : 0);                           \
+    size_t offset_c = ((odim.c > 1) ? offset.c : 0);                           \
+    for (size_t d1 = 0; d1 < idim.h; d1++) {                                   \
+      for (size_t d2 = 0; d2 < idim.w; d2++) {                                 \
+        for (size_t d3 = 0; d3 < idim.c; d3++) {                               \
+          size_t r0 = d0 + offset.n;                                           \
+          size_t r1 = d1 + offset.h;                                           \
+          size_t r2 = d2 + offset_w;                                           \
+          size_t r3 = d3 + offset_c;                                           \
+          size_t srcIdx = getNHWC(idim, d0, d1, d2, d3);                       \
+          size_t destIdx = getNHWC(odim, r0, r1, r2, r3);                      \
+          dest[destIdx] = src[srcIdx];                                         \
+        }                                                                      \
+      }                                                                        \
+    }                                                                          \
+  }                                                                            \
+  __kernel void inserttensor##suffix##W(__global void *mem, cl_uint32_t dest,  \
+                                        cl_uint32_t src, ShapeNHWC odim,       \
+                                        ShapeNHWC idim, ShapeNHWC offset) {    \
+    inserttensor##suffix##K(&mem[dest], &mem[src], odim, idim, offset);        \
+  }                                                                            \
+  __kernel void extracttensor##suffix##K(__global type *dest,                  \
+                                         __global type *src, ShapeNHWC odim,   \
+                                         ShapeNHWC idim, ShapeNHWC offset) {   \
+    size_t d0 = get_global_id(0);                                              \
+    size_t offset_w = ((odim.w > 1) ? offset.w : 0);                           \
+    size_t offset_c = ((odim.c > 1) ? offset.c : 0);                           \
+    for (size_t d1 = 0; d1 < odim.h; d1++) {                                   \
+      for (size_t d2 = 0; d2 < odim.w; d2++) {                                 \
+        for (size_t d3 = 0; d3 < odim.c; d3++) {                               \
+          size_t r0 = d0 + offset.n;                                           \
+          size_t r1 = d1 + offset.h;                                           \
+          size_t r2 = d2 + offset_w;                                           \
+          size_t r3 = d3 + offset_c;                                           \
+          size_t destIdx = getNHWC(odim, d0, d1, d2, d3);                      \
+          size_t srcIdx = getNHWC(idim, r0, r1, r2, r3);                       \
+          dest[destIdx] = src[srcIdx];                                         \
+        }                                                                      \
+      }                                                                        \
+    }                                                                          \
+  }                                                                            \
+  __kernel void extracttensor##suffix##W(__global void *mem, cl_uint32_t dest, \
+                                         cl_uint32_t src, ShapeNHWC odim,      \
+                                         ShapeNHWC idim, ShapeNHWC offset) {   \
+    extracttensor##suffix##K(&mem[dest], &mem[src], odim, idim, offset);       \
+  }                                                                            \
+  __kernel void gather##suffix##K(__global type *dest,                         \
+                                  __global const type *src,                    \
+                                  __global cl_uint64_t *indices,               \
+                                  cl_uint32_t numIndices,                      \
+                                  cl_uint32_t sliceSize) {                     \
+    int idx = get_global_id(0);                                                \
+    cl_uint64_t slice = indices[idx];                                          \
+    for (int i = 0; i < sliceSize; i++) {                                      \
+      dest[idx * sliceSize + i] = src[slice * sliceSize + i];                  \
+    }                                                                          \
+  }                                                                            \
+  __kernel void gather##suffix##W(__global void *mem, cl_uint32_t dest,        \
+                                  cl_uint32_t src, cl_uint32_t indices,        \
+                                  cl_uint32_t numIndices,                      \
+                                  cl_uint32_t sliceSize) {                     \
+    gather##suffix##K(&mem[dest], &mem[src], &mem[indices], numIndices,        \
+                      sliceSize);                                              \
+  }
 
-__kernel void gatherW(__global void *mem,
-                      cl_uint32_t dest,
-                      cl_uint32_t src,
-                      cl_uint32_t indices,
-                      cl_uint32_t numIndices,
-                      cl_uint32_t sliceSize) {
-   gatherK(&mem[dest], &mem[src], &mem[indices], numIndices, sliceSize);
-}
+DEFINE_OPENCL_DATA_MOVEMENT_KERNELS(, float)
+DEFINE_OPENCL_DATA_MOVEMENT_KERNELS(_i8, char)
+
+#undef DEFINE_OPENCL_DATA_MOVEMENT_KERNELS
 
 )";
@@ -18,6 +18,13 @@
 #include "glow/Base/Tensor.h"
 #include "glow/Support/Support.h"
 
+#include <algorithm>
+#include <cmath>
+#include <csetjmp>
+#include <cstdio>
+#include <cstring>
+#include <vector>
+
 using namespace glow;
 
 #if WITH_PNG
@@ -253,6 +260,10 @@ bool glow::writePngImage(Tensor *T, const char *filename,
 }
 
 #else
+std::tuple<size_t, size_t, bool> glow::getPngInfo(const char *filename) {
+  GLOW_ASSERT(false && "Not configured with libpng");
+}
+
 bool glow::readPngImage(Tensor *T, const char *filename,
                         std::pair<float, float> range) {
   GLOW_ASSERT(false && "Not configured with libpng");
@@ -263,3 +274,317 @@ bool glow::writePngImage(Tensor *T, const char *filename,
   GLOW_ASSERT(false && "Not configured with libpng");
 }
 #endif
+
+//===----------------------------------------------------------------------===//
+//                    The fused image pipeline
+//===----------------------------------------------------------------------===//
+
+#if WITH_JPEG
+#include <jpeglib.h>
+#endif
+
+namespace {
+
+/// An image decoded into 8-bit pixels with interleaved channels.
+struct DecodedImage {
+  std::vector<uint8_t> pixels;
+  size_t height{0};
+  size_t width{0};
+  size_t numChannels{0};
+  /// The size of the image in the file, which is larger than the decoded size
+  /// if the image was scaled down while it was decoded.
+  size_t fileHeight{0};
+  size_t fileWidth{0};
+};
+
+enum class ImageFormat { Unknown, Png, Jpeg };
+
+/// \returns the format of the image \p filename, from its signature.
+ImageFormat getImageFormat(const char *filename) {
+  FILE *fp = fopen(filename, "rb");
+  if (!fp) {
+    return ImageFormat::Unknown;
+  }
+  unsigned char header[8];
+  size_t size = fread(header, 1, 8, fp);
+  fclose(fp);
+  if (size >= 3 && header[0] == 0xFF && header[1] == 0xD8 &&
+      header[2] == 0xFF) {
+    return ImageFormat::Jpeg;
+  }
+  if (size == 8 && !memcmp(header, "\x89PNG\r\n\x1a\n", 8)) {
+    return ImageFormat::Png;
+  }
+  return ImageFormat::Unknown;
+}
+
+/// \returns the size of an image of \p height x \p width pixels resized as
+/// \p pp says, before it is cropped.
+std::pair<size_t, size_t> getResizedSize(size_t height, size_t width,
+                                         const ImagePreprocessing &pp) {
+  if (!pp.resizeShorterSide) {
+    return {height, width};
+  }
+  size_t shorter = std::min(height, width);
+  return {(height * pp.resizeShorterSide + shorter / 2) / shorter,
+          (width * pp.resizeShorterSide + shorter / 2) / shorter};
+}
+
+#if WITH_PNG
+/// Decode the png image \p filename into \p img. The 16-bit channels are
+/// reduced to 8 bits, the palettes are expanded and the alpha channel is
+/// dropped. \returns True if an error occurred.
+bool decodePng(const char *filename, DecodedImage &img) {
+  FILE *fp = fopen(filename, "rb");
+  if (!fp) {
+    return true;
+  }
+  png_structp png_ptr =
+      png_create_read_struct(PNG_LIBPNG_VER_STRING, nullptr, nullptr, nullptr);
+  png_infop info_ptr = png_ptr ? png_create_info_struct(png_ptr) : nullptr;
+  // The rows are declared before the jump, which doesn't destroy them.
+  std::vector<png_bytep> rows;
+  if (!info_ptr || setjmp(png_jmpbuf(png_ptr))) {
+    png_destroy_read_struct(&png_ptr, &info_ptr, nullptr);
+    fclose(fp);
+    return true;
+  }
+
+  png_init_io(png_ptr, fp);
+  png_read_info(png_ptr, info_ptr);
+  png_set_strip_16(png_ptr);
+  png_set_strip_alpha(png_ptr);
+  png_set_palette_to_rgb(png_ptr);
+  png_set_expand_gray_1_2_4_to_8(png_ptr);
+  png_set_interlace_handling(png_ptr);
+  png_read_update_info(png_ptr, info_ptr);
+
+  img.height = img.fileHeight = png_get_image_height(png_ptr, info_ptr);
+  img.width = img.fileWidth = png_get_image_width(png_ptr, info_ptr);
+  img.numChannels = png_get_channels(png_ptr, info_ptr);
+  size_t rowSize = png_get_rowbytes(png_ptr, info_ptr);
+  img.pixels.resize(img.height * rowSize);
+  rows.resize(img.height);
+  for (size_t y = 0; y < img.height; y++) {
+    rows[y] = &img.pixels[y * rowSize];
+  }
+  png_read_image(png_ptr, rows.data());
+  png_read_end(png_ptr, nullptr);
+  png_destroy_read_struct(&png_ptr, &info_ptr, nullptr);
+  fclose(fp);
+  return false;
+}
+#else
+bool decodePng(const char *filename, DecodedImage &img) { return true; }
+#endif
+
+#if WITH_JPEG
+/// The error handler of libjpeg, which jumps back to the decoder instead of
+/// exiting.
+struct JpegErrorManager {
+  jpeg_error_mgr pub;
+  jmp_buf jump;
+};
+
+void jpegErrorExit(j_common_ptr cinfo) {
+  longjmp(reinterpret_cast<JpegErrorManager *>(cinfo->err)->jump, 1);
+}
+
+/// Decode the jpeg image \p filename into \p img. The image is scaled down
+/// in the DCT domain by the largest factor N/8 that keeps it at least as
+/// large as the size that \p pp resizes it to, which skips most of the work
+/// of the inverse DCT and of the upsampling of the chroma. \returns True if
+/// an error occurred.
+bool decodeJpeg(const char *filename, const ImagePreprocessing &pp,
+                DecodedImage &img) {
+  FILE *fp = fopen(filename, "rb");
+  if (!fp) {
+    return true;
+  }
+  jpeg_decompress_struct cinfo;
+  JpegErrorManager err;
+  cinfo.err = jpeg_std_error(&err.pub);
+  err.pub.error_exit = jpegErrorExit;
+  jpeg_create_decompress(&cinfo);
+  if (setjmp(err.jump)) {
+    jpeg_destroy_decompress(&cinfo);
+    fclose(fp);
+    return true;
+  }
+
+  jpeg_stdio_src(&cinfo, fp);
+  jpeg_read_header(&cinfo, TRUE);
+  cinfo.out_color_space = cinfo.num_components == 1 ? JCS_GRAYSCALE : JCS_RGB;
+  img.fileHeight = cinfo.image_height;
+  img.fileWidth = cinfo.image_width;
+  auto resized = getResizedSize(img.fileHeight, img.fileWidth, pp);
+  cinfo.scale_denom = 8;
+  for (unsigned num = 1; num <= 8; num++) {
+    cinfo.scale_num = num;
+    jpeg_calc_output_dimensions(&cinfo);
+    if (cinfo.output_height >= resized.first &&
+        cinfo.output_width >= resized.second) {
+      break;
+    }
+  }
+
+  jpeg_start_decompress(&cinfo);
+  img.height = cinfo.output_height;
+  img.width = cinfo.output_width;
+  img.numChannels = cinfo.output_components;
+  size_t rowSize = img.width * img.numChannels;
+  img.pixels.resize(img.height * rowSize);
+  while (cinfo.output_scanline < cinfo.output_height) {
+    JSAMPROW row = &img.pixels[cinfo.output_scanline * rowSize];
+    jpeg_read_scanlines(&cinfo, &row, 1);
+  }
+  jpeg_finish_decompress(&cinfo);
+  jpeg_destroy_decompress(&cinfo);
+  fclose(fp);
+  return false;
+}
+
+/// Reads the header of the jpeg image \p filename. \returns True if an error
+/// occurred.
+bool getJpegInfo(const char *filename, size_t &height, size_t &width,
+                 bool &isGray) {
+  FILE *fp = fopen(filename, "rb");
+  if (!fp) {
+    return true;
+  }
+  jpeg_decompress_struct cinfo;
+  JpegErrorManager err;
+  cinfo.err = jpeg_std_error(&err.pub);
+  err.pub.error_exit = jpegErrorExit;
+  jpeg_create_decompress(&cinfo);
+  if (setjmp(err.jump)) {
+    jpeg_destroy_decompress(&cinfo);
+    fclose(fp);
+    return true;
+  }
+  jpeg_stdio_src(&cinfo, fp);
+  jpeg_read_header(&cinfo, TRUE);
+  height = cinfo.image_height;
+  width = cinfo.image_width;
+  isGray = cinfo.num_components == 1;
+  jpeg_destroy_decompress(&cinfo);
+  fclose(fp);
+  return false;
+}
+#else
+bool decodeJpeg(const char *filename, const ImagePreprocessing &pp,
+                DecodedImage &img) {
+  return true;
+}
+
+bool getJpegInfo(const char *filename, size_t &height, size_t &width,
+                 bool &isGray) {
+  return true;
+}
+#endif
+
+/// The two source pixels of an output pixel along an axis of the image, and
+/// the weight of the second one.
+struct Tap {
+  size_t first;
+  size_t second;
+  float weight;
+};
+
+/// \returns the taps of the \p size output pixels from \p offset on of an
+/// axis of \p srcSize pixels that is resized to \p resizedSize pixels. The
+/// pixel centers are aligned, so an axis that keeps its size is copied.
+std::vector<Tap> getTaps(size_t srcSize, size_t resizedSize, size_t offset,
+                         size_t size) {
+  std::vector<Tap> taps(size);
+  double scale = double(srcSize) / resizedSize;
+  for (size_t i = 0; i < size; i++) {
+    double pos = (i + offset + 0.5) * scale - 0.5;
+    pos = std::min(std::max(pos, 0.0), double(srcSize - 1));
+    size_t first = pos;
+    taps[i] = {first, std::min(first + 1, srcSize - 1), float(pos - first)};
+  }
+  return taps;
+}
+
+} // namespace
+
+std::tuple<size_t, size_t, bool> glow::getImageInfo(const char *filename) {
+  if (getImageFormat(filename) != ImageFormat::Jpeg) {
+    return getPngInfo(filename);
+  }
+  size_t height, width;
+  bool isGray;
+  bool failed = getJpegInfo(filename, height, width, isGray);
+  (void)failed;
+  GLOW_ASSERT(!failed && "Can't read the jpeg image header.");
+  return std::make_tuple(height, width, isGray);
+}
+
+std::pair<size_t, size_t>
+glow::getPreprocessedSize(size_t height, size_t width,
+                          const ImagePreprocessing &pp) {
+  auto resized = getResizedSize(height, width, pp);
+  return {pp.cropHeight ? pp.cropHeight : resized.first,
+          pp.cropWidth ? pp.cropWidth : resized.second};
+}
+
+bool glow::loadImage(float *dest, size_t height, size_t width,
+                     size_t numChannels, const char *filename,
+                     const ImagePreprocessing &pp) {
+  DecodedImage img;
+  switch (getImageFormat(filename)) {
+  case ImageFormat::Png:
+    if (decodePng(filename, img)) {
+      return true;
+    }
+    break;
+  case ImageFormat::Jpeg:
+    if (decodeJpeg(filename, pp, img)) {
+      return true;
+    }
+    break;
+  default:
+    return true;
+  }
+
+  auto resized = getResizedSize(img.fileHeight, img.fileWidth, pp);
+  if (getPreprocessedSize(img.fileHeight, img.fileWidth, pp) !=
+          std::make_pair(height, width) ||
+      img.numChannels != numChannels || height > resized.first ||
+      width > resized.second) {
+    return true;
+  }
+
+  // Resize, crop, normalize and lay out the pixels in one pass over the
+  // output. The crop is centered in the resized image.
+  auto rowTaps = getTaps(img.height, resized.first,
+                         (resized.first - height) / 2, height);
+  auto colTaps = getTaps(img.width, resized.second,
+                         (resized.second - width) / 2, width);
+  float scale = (pp.range.second - pp.range.first) / 255.0;
+  float bias = pp.range.first;
+  size_t C = numChannels;
+  size_t rowSize = img.width * C;
+  for (size_t y = 0; y < height; y++) {
+    const Tap &ty = rowTaps[y];
+    const uint8_t *row0 = &img.pixels[ty.first * rowSize];
+    const uint8_t *row1 = &img.pixels[ty.second * rowSize];
+    for (size_t x = 0; x < width; x++) {
+      const Tap &tx = colTaps[x];
+      for (size_t c = 0; c < C; c++) {
+        size_t i0 = tx.first * C + c, i1 = tx.second * C + c;
+        float top = row0[i0] + tx.weight * (row0[i1] - row0[i0]);
+        float bottom = row1[i0] + tx.weight * (row1[i1] - row1[i0]);
+        float value = (top + ty.weight * (bottom - top)) * scale + bias;
+        size_t outC = pp.bgr && C == 3 ? C - 1 - c : c;
+        if (pp.chw) {
+          dest[(outC * height + y) * width + x] = value;
+        } else {
+          dest[(y * width + x) * C + outC] = value;
+        }
+      }
+    }
+  }
+  return false;
+}
@@ -19,6 +19,8 @@
 #include "llvm/Support/NativeFormatting.h"
 #include "llvm/Support/raw_ostream.h"
 
+#include <mutex>
+
 using namespace glow;
 
 namespace {
@@ -399,18 +401,39 @@ static void broadcastToNewShapeGenericImpl(Tensor *src, Tensor *dest,
 
   dest->copyFrom(&intermediate);
 }
+/// The lock that serializes the pinning of the tensors. Every tensor is pinned
+/// at most once between its resets, so one lock for all of them is enough.
+std::mutex pinMutex;
+
 } // namespace
 
+void Tensor::pinSlow() const {
+  std::lock_guard<std::mutex> lock(pinMutex);
+  if (isPinned_) {
+    return;
+  }
+  if (isShared()) {
+    unshare(/* keepContent */ true);
+  }
+  isPinned_.store(true, std::memory_order_release);
+}
+
 void glow::dumpAsciiImpl(Tensor *T) {
   switch (T->getElementType()) {
   case ElemKind::FloatTy:
     return dumpAsciiGenericImpl(T->getHandle<float>());
+  case ElemKind::Float16Ty:
+    return dumpAsciiGenericImpl(T->getHandle<float16>());
   case ElemKind::Int8QTy:
     return dumpAsciiGenericImpl(T->getHandle<int8_t>());
+  case ElemKind::Int16QTy:
+    return dumpAsciiGenericImpl(T->getHandle<int16_t>());
   case ElemKind::Int32QTy:
     return dumpAsciiGenericImpl(T->getHandle<int32_t>());
   case ElemKind::IndexTy:
     return dumpAsciiGenericImpl(T->getHandle<size_t>());
+  case ElemKind::Int32ITy:
+    return dumpAsciiGenericImpl(T->getHandle<int32_t>());
   }
 }
 
@@ -418,12 +441,18 @@ void glow::dumpImpl(Tensor *T) {
   switch (T->getElementType()) {
   case ElemKind::FloatTy:
     return dumpGenericImpl(T->getHandle<float>());
+  case ElemKind::Float16Ty:
+    return dumpGenericImpl(T->getHandle<float16>());
   case ElemKind::Int8QTy:
     return dumpGenericImpl(T->getHandle<int8_t>());
+  case ElemKind::Int16QTy:
+    return dumpGenericImpl(T->getHandle<int16_t>());
   case ElemKind::Int32QTy:
     return dumpGenericImpl(T->getHandle<int32_t>());
   case ElemKind::IndexTy:
     return dumpGenericImpl(T->getHandle<size_t>());
+  case ElemKind::Int32ITy:
+    return dumpGenericImpl(T->getHandle<int32_t>());
   }
 }
 
@@ -450,12 +479,24 @@ void glow::genericTranspose(Tensor *src, Tensor *dest,
     transposeSelectImpl(srcH, destH, shuffle);
     return;
   }
+  case ElemKind::Float16Ty: {
+    auto srcH = src->getHandle<float16>();
+    auto destH = dest->getHandle<float16>();
+    transposeSelectImpl(srcH, destH, shuffle);
+    return;
+  }
   case ElemKind::Int8QTy: {
     auto srcH = src->getHandle<int8_t>();
     auto destH = dest->getHandle<int8_t>();
     transposeSelectImpl(srcH, destH, shuffle);
     return;
   }
+  case ElemKind::Int16QTy: {
+    auto srcH = src->getHandle<int16_t>();
+    auto destH = dest->getHandle<int16_t>();
+    transposeSelectImpl(srcH, destH, shuffle);
+    return;
+  }
   case ElemKind::Int32QTy: {
     auto srcH = src->getHandle<int32_t>();
     auto destH = dest->getHandle<int32_t>();
@@ -468,6 +509,12 @@ void glow::genericTranspose(Tensor *src, Tensor *dest,
     transposeSelectImpl(srcH, destH, shuffle);
     return;
   }
+  case ElemKind::Int32ITy: {
+    auto srcH = src->getHandle<int32_t>();
+    auto destH = dest->getHandle<int32_t>();
+    transposeSelectImpl(srcH, destH, shuffle);
+    return;
+  }
   }
 }
 
@@ -479,10 +526,18 @@ void glow::broadcastToNewShapeImpl(Tensor *src, Tensor *dest,
     broadcastToNewShapeGenericImpl<float>(src, dest, otherDims, axis);
     return;
   }
+  case ElemKind::Float16Ty: {
+    broadcastToNewShapeGenericImpl<float16>(src, dest, otherDims, axis);
+    return;
+  }
   case ElemKind::Int8QTy: {
     broadcastToNewShapeGenericImpl<int8_t>(src, dest, otherDims, axis);
     return;
   }
+  case ElemKind::Int16QTy: {
+    broadcastToNewShapeGenericImpl<int16_t>(src, dest, otherDims, axis);
+    return;
+  }
   case ElemKind::Int32QTy: {
     broadcastToNewShapeGenericImpl<int32_t>(src, dest, otherDims, axis);
     return;
@@ -491,5 +546,9 @@ void glow::broadcastToNewShapeImpl(Tensor *src, Tensor *dest,
     broadcastToNewShapeGenericImpl<size_t>(src, dest, otherDims, axis);
     return;
   }
+  case ElemKind::Int32ITy: {
+    broadcastToNewShapeGenericImpl<int32_t>(src, dest, otherDims, axis);
+    return;
+  }
   }
 }
@@ -0,0 +1,74 @@
+/**
+ * Copyright (c) 2017-present, Facebook, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "glow/Base/WeightStore.h"
+
+#include "llvm/ADT/Hashing.h"
+#include "llvm/ADT/StringRef.h"
+
+#include <cstring>
+
+using namespace glow;
+
+/// \returns the bytes of the payload of \p T.
+static llvm::StringRef getBytes(const Tensor &T) {
+  return llvm::StringRef(T.getUnsafePtr(), T.getType().getSizeInBytes());
+}
+
+WeightStore::TensorRef WeightStore::intern(Tensor &&T) {
+  auto bytes = getBytes(T);
+  std::lock_guard<std::mutex> lock(mutex_);
+  auto &candidates = tensors_[llvm::hash_value(bytes)];
+  for (auto it = candidates.begin(); it != candidates.end();) {
+    auto other = it->lock();
+    if (!other) {
+      // Drop the tensors that nobody references anymore.
+      it = candidates.erase(it);
+      continue;
+    }
+    if (other->getType().isEqual(T.getType()) && getBytes(*other) == bytes) {
+      return other;
+    }
+    ++it;
+  }
+  auto added = std::make_shared<Tensor>(std::move(T));
+  candidates.push_back(added);
+  return added;
+}
+
+size_t WeightStore::getNumTensors() const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  size_t num = 0;
+  for (const auto &candidates : tensors_) {
+    for (const auto &T : candidates.second) {
+      num += !T.expired();
+    }
+  }
+  return num;
+}
+
+size_t WeightStore::getSizeInBytes() const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  size_t size = 0;
+  for (const auto &candidates : tensors_) {
+    for (const auto &T : candidates.second) {
+      if (auto live = T.lock()) {
+        size += live->getType().getSizeInBytes();
+      }
+    }
+  }
+  return size;
+}
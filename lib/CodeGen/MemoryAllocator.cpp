@@ -19,6 +19,9 @@
 
 #include "llvm/Support/Casting.h"
 
+#include <algorithm>
+#include <numeric>
+
 using namespace glow;
 
 const size_t MemoryAllocator::npos = -1;
@@ -57,3 +60,62 @@ void MemoryAllocator::deallocate(size_t ptr) {
   }
   assert(false && "Unknown buffer to allocate");
 }
+
+size_t glow::allocateOffline(llvm::ArrayRef<LiveBuffer> buffers,
+                             std::vector<size_t> &addresses) {
+  addresses.assign(buffers.size(), MemoryAllocator::npos);
+  // Always allocate buffers properly aligned to hold values of any type.
+  std::vector<size_t> sizes(buffers.size());
+  for (size_t i = 0, e = buffers.size(); i < e; i++) {
+    sizes[i] = alignedSize(buffers[i].size_, TensorAlignment);
+  }
+
+  // Place the large buffers first and break the ties by the program order.
+  std::vector<size_t> order(buffers.size());
+  std::iota(order.begin(), order.end(), 0);
+  std::stable_sort(order.begin(), order.end(), [&](size_t a, size_t b) {
+    if (sizes[a] != sizes[b]) {
+      return sizes[a] > sizes[b];
+    }
+    return buffers[a].start_ < buffers[b].start_;
+  });
+
+  size_t maxMemoryAllocated = 0;
+  // The placed buffers that interfere with the current one, as segments.
+  std::vector<Segment> live;
+  for (size_t i = 0, e = order.size(); i < e; i++) {
+    size_t idx = order[i];
+    size_t size = sizes[idx];
+    live.clear();
+    for (size_t j = 0; j < i; j++) {
+      size_t other = order[j];
+      if (buffers[idx].interferesWith(buffers[other])) {
+        live.emplace_back(addresses[other], addresses[other] + sizes[other]);
+      }
+    }
+    std::sort(live.begin(), live.end(), [](const Segment &a, const Segment &b) {
+      return a.begin_ < b.begin_;
+    });
+
+    // Find the smallest gap that can hold the buffer. The space after the
+    // last segment is used only if there is no such gap.
+    size_t prev = 0;
+    size_t best = MemoryAllocator::npos;
+    size_t bestSize = MemoryAllocator::npos;
+    for (auto &s : live) {
+      if (s.begin_ > prev && s.begin_ - prev >= size &&
+          s.begin_ - prev < bestSize) {
+        best = prev;
+        bestSize = s.begin_ - prev;
+      }
+      prev = std::max(prev, s.end_);
+    }
+    if (best == MemoryAllocator::npos) {
+      best = prev;
+    }
+
+    addresses[idx] = best;
+    maxMemoryAllocated = std::max(maxMemoryAllocated, best + size);
+  }
+  return maxMemoryAllocated;
+}
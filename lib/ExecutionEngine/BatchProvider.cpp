@@ -0,0 +1,70 @@
+/**
+ * Copyright (c) 2017-present, Facebook, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "glow/ExecutionEngine/BatchProvider.h"
+#include "glow/Base/Tensor.h"
+#include "glow/Support/Compiler.h"
+
+using namespace glow;
+
+bool TensorBatchProvider::next(llvm::ArrayRef<Tensor *> batch) {
+  assert(batch.size() == inputs_.size() &&
+         "The number of inputs does not match the number of tensors");
+  for (size_t i = 0, e = batch.size(); i < e; i++) {
+    batch[i]->copyConsecutiveSlices(inputs_[i],
+                                    sampleIdx_ % inputs_[i]->dims()[0]);
+  }
+  sampleIdx_ += batch[0]->dims()[0];
+  return true;
+}
+
+FileBatchProvider::FileBatchProvider(llvm::ArrayRef<std::string> paths,
+                                     bool loop)
+    : loop_(loop) {
+  for (const auto &path : paths) {
+    files_.emplace_back(new std::ifstream(path, std::ios::binary));
+    GLOW_ASSERT(files_.back()->is_open() && "Can't open the data file");
+  }
+}
+
+bool FileBatchProvider::next(llvm::ArrayRef<Tensor *> batch) {
+  assert(batch.size() == files_.size() &&
+         "The number of files does not match the number of tensors");
+  for (size_t i = 0, e = batch.size(); i < e; i++) {
+    auto &file = *files_[i];
+    char *data = batch[i]->getUnsafePtr();
+    size_t size = batch[i]->getType().getSizeInBytes();
+    size_t pos = 0;
+    bool rewound = false;
+    while (true) {
+      file.read(data + pos, size - pos);
+      size_t count = file.gcount();
+      pos += count;
+      if (pos == size) {
+        break;
+      }
+      // The file ended in the middle of the mini-batch.
+      if (!loop_) {
+        return false;
+      }
+      GLOW_ASSERT((count || !rewound) && "The data file is empty");
+      file.clear();
+      file.seekg(0);
+      rewound = true;
+    }
+  }
+  return true;
+}
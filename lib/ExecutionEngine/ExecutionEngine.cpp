@@ -17,16 +17,106 @@
 #include "glow/ExecutionEngine/ExecutionEngine.h"
 
 #include "glow/Backends/Backend.h"
+#include "glow/ExecutionEngine/BatchProvider.h"
 #include "glow/Graph/Graph.h"
 #include "glow/IR/IR.h"
 #include "glow/IR/IRBuilder.h"
 #include "glow/IR/Instrs.h"
 #include "glow/Optimizer/Optimizer.h"
+#include "glow/Support/Trace.h"
+
+#include "llvm/ADT/Hashing.h"
+#include "llvm/Support/raw_ostream.h"
+
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <cstring>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_set>
+#include <vector>
+
+#ifdef __linux__
+#include <pthread.h>
+#include <sched.h>
+#endif
 
 using namespace glow;
+using llvm::cast;
+using llvm::dyn_cast;
+
+/// A FIFO queue of requests and the threads that run them.
+struct ExecutionEngine::AsyncQueue {
+  /// A request in the queue.
+  struct Request {
+    ExecutionSession *session;
+    std::function<void()> done;
+    std::promise<void> promise;
+  };
+
+  std::mutex mutex;
+  /// Signals a new request or the shutdown to the threads.
+  std::condition_variable wakeup;
+  std::deque<Request> requests;
+  bool shutdown{false};
+  std::vector<std::thread> threads;
+
+  /// Start \p numThreads threads.
+  explicit AsyncQueue(unsigned numThreads) {
+    for (unsigned i = 0; i < numThreads; i++) {
+      threads.emplace_back([this]() { loop(); });
+    }
+  }
+
+  /// Finish the pending requests and join the threads.
+  ~AsyncQueue() {
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      shutdown = true;
+    }
+    wakeup.notify_all();
+    for (auto &thread : threads) {
+      thread.join();
+    }
+  }
+
+  /// Add the request \p R to the queue.
+  void push(Request R) {
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      requests.push_back(std::move(R));
+    }
+    wakeup.notify_one();
+  }
+
+  /// The main loop of every thread.
+  void loop() {
+    for (;;) {
+      Request R;
+      {
+        std::unique_lock<std::mutex> lock(mutex);
+        wakeup.wait(lock, [this]() { return shutdown || !requests.empty(); });
+        if (requests.empty()) {
+          return;
+        }
+        R = std::move(requests.front());
+        requests.pop_front();
+      }
+      R.session->doForwardPass();
+      if (R.done) {
+        R.done();
+      }
+      R.promise.set_value();
+    }
+  }
+};
 
 ExecutionEngine::ExecutionEngine(BackendKind backendKind) {
   backendKind_ = backendKind;
+  scheduler_ = getDefaultScheduler();
   M_.reset(new Module());
   IR_.reset(new IRFunction());
   IP_.reset(createBackend(backendKind_, &*IR_));
@@ -34,11 +124,28 @@ ExecutionEngine::ExecutionEngine(BackendKind backendKind) {
 
 // Set the code generator kind to \p backendKind.
 void ExecutionEngine::setBackend(BackendKind backendKind) {
+  // Finish the pending requests before replacing the backend.
+  async_.reset();
   backendKind_ = backendKind;
   IP_.reset(createBackend(backendKind, &*IR_));
 }
 
 void ExecutionEngine::reset() {
+  // Finish the pending requests before replacing the backend.
+  async_.reset();
+  partitions_.clear();
+  for (auto *P : partitionFunctions_) {
+    M_->eraseFunction(P);
+  }
+  for (auto *V : transferVars_) {
+    M_->eraseVariable(V);
+  }
+  partitionFunctions_.clear();
+  transferVars_.clear();
+  entries_.clear();
+  replicas_.clear();
+  weightsSource_.reset();
+  isCompiledLoaded_ = false;
   if (IR_)
     IR_->clear();
   IP_.reset(createBackend(backendKind_, &*IR_));
@@ -50,7 +157,8 @@ void ExecutionEngine::run(llvm::ArrayRef<Variable *> vars,
                           llvm::ArrayRef<Tensor *> inputs) {
   assert(inputs.size() == vars.size() &&
          "The number of inputs does not match the number of variables");
-  assert(!IR_->getInstrs().empty() &&
+  assert((!partitions_.empty() || !IR_->getInstrs().empty() ||
+          isCompiledLoaded_) &&
          "Running a function with no instructions.");
 
   // Update the input variables.
@@ -58,42 +166,507 @@ void ExecutionEngine::run(llvm::ArrayRef<Variable *> vars,
     assert(vars[i]->getVisibilityKind() == VisibilityKind::Public &&
            "Trying to update a private variable");
     loadValueFromTensor(vars[i], inputs[i]);
+    if (vars[i]->isState() && partitions_.empty()) {
+      IP_->writeState(vars[i]);
+    }
   }
 
-  IP_->doForwardPass();
+  doForwardPass();
+}
+
+void ExecutionEngine::run(size_t entry, llvm::ArrayRef<Variable *> vars,
+                          llvm::ArrayRef<Tensor *> inputs) {
+  assert(inputs.size() == vars.size() &&
+         "The number of inputs does not match the number of variables");
+  GLOW_ASSERT(entry < entries_.size() && "Invalid entry point");
+
+  for (int i = 0, e = vars.size(); i < e; i++) {
+    assert(vars[i]->getVisibilityKind() == VisibilityKind::Public &&
+           "Trying to update a private variable");
+    loadValueFromTensor(vars[i], inputs[i]);
+  }
+
+  TraceScope trace("run", TraceRun);
+  entries_[entry].backend->doForwardPass();
+}
+
+void ExecutionEngine::doForwardPass() {
+  TraceScope trace("run", TraceRun);
+  if (partitions_.empty()) {
+    IP_->doForwardPass();
+    return;
+  }
+  // Every partition reads the values of the earlier ones from their public
+  // variables.
+  for (auto &P : partitions_) {
+    P.backend->doForwardPass();
+  }
+}
+
+/// Pin the thread \p thread to the processors \p cpus.
+static void pinThread(std::thread &thread, llvm::ArrayRef<int> cpus) {
+#ifdef __linux__
+  cpu_set_t set;
+  CPU_ZERO(&set);
+  for (int cpu : cpus) {
+    CPU_SET(cpu, &set);
+  }
+  pthread_setaffinity_np(thread.native_handle(), sizeof(set), &set);
+#endif
+}
+
+void ExecutionEngine::runPipeline(
+    llvm::ArrayRef<Variable *> vars,
+    llvm::ArrayRef<std::vector<Tensor *>> inputs,
+    llvm::ArrayRef<Variable *> outputs,
+    llvm::ArrayRef<std::vector<Tensor *>> results,
+    llvm::ArrayRef<std::vector<int>> coreGroups) {
+  GLOW_ASSERT(!partitions_.empty() && "The function has no stages");
+  assert(inputs.size() == results.size() &&
+         "The number of results does not match the number of requests");
+  TraceScope trace("run pipeline", TraceRun);
+  size_t numStages = partitions_.size();
+  size_t numSlots = numStages;
+  size_t numRequests = inputs.size();
+
+  // The public variables that every stage reads or writes.
+  std::vector<std::vector<Variable *>> stageVars(numStages);
+  std::vector<Variable *> allVars;
+  for (size_t s = 0; s < numStages; s++) {
+    for (auto *N : partitions_[s].IR->getGraph()->getNodes()) {
+      for (unsigned i = 0, e = N->getNumInputs(); i < e; i++) {
+        auto *V = dyn_cast<Variable>(N->getNthInput(i).getNode());
+        if (!V || V->getVisibilityKind() != VisibilityKind::Public ||
+            std::count(stageVars[s].begin(), stageVars[s].end(), V)) {
+          continue;
+        }
+        stageVars[s].push_back(V);
+        if (!std::count(allVars.begin(), allVars.end(), V)) {
+          allVars.push_back(V);
+        }
+      }
+    }
+  }
+
+  // Every request in flight has a slot with its own tensors for the public
+  // variables, which the sessions of all of the stages in the slot share.
+  struct Slot {
+    std::unordered_map<const Variable *, std::unique_ptr<Tensor>> tensors;
+    std::vector<std::unique_ptr<ExecutionSession>> sessions;
+  };
+  std::vector<Slot> slots(numSlots);
+  for (auto &slot : slots) {
+    for (auto *V : allVars) {
+      slot.tensors[V].reset(new Tensor());
+      slot.tensors[V]->copyFrom(&V->getPayload());
+    }
+    for (size_t s = 0; s < numStages; s++) {
+      auto session = partitions_[s].backend->createSession();
+      GLOW_ASSERT(session && "The backend does not support sessions");
+      for (auto *V : stageVars[s]) {
+        session->bind(V, slot.tensors[V].get());
+      }
+      slot.sessions.push_back(std::move(session));
+    }
+  }
+  for (auto *V : vars) {
+    GLOW_ASSERT(slots[0].tensors.count(V) && "The input is not used");
+  }
+  for (auto *V : outputs) {
+    GLOW_ASSERT(slots[0].tensors.count(V) && "The output is not computed");
+  }
+
+  // A stage computes a request after the previous stage is done with it, and
+  // after the last stage is done with the request that had its slot before.
+  std::mutex mutex;
+  std::condition_variable progress;
+  std::vector<size_t> done(numStages, 0);
+  auto runStage = [&](size_t s) {
+    for (size_t r = 0; r < numRequests; r++) {
+      {
+        std::unique_lock<std::mutex> lock(mutex);
+        progress.wait(lock, [&]() {
+          return (s == 0 || done[s - 1] > r) &&
+                 (r < numSlots || done[numStages - 1] > r - numSlots);
+        });
+      }
+      auto &slot = slots[r % numSlots];
+      if (s == 0) {
+        // The sessions refer to the tensors, so they are written in place.
+        for (size_t i = 0, e = vars.size(); i < e; i++) {
+          slot.tensors[vars[i]]->copyRawFrom(inputs[r][i]);
+        }
+      }
+      slot.sessions[s]->doForwardPass();
+      if (s == numStages - 1) {
+        for (size_t i = 0, e = outputs.size(); i < e; i++) {
+          results[r][i]->copyFrom(slot.tensors[outputs[i]].get());
+        }
+      }
+      {
+        std::lock_guard<std::mutex> lock(mutex);
+        done[s]++;
+      }
+      progress.notify_all();
+    }
+  };
+
+  std::vector<std::thread> threads;
+  for (size_t s = 0; s < numStages; s++) {
+    threads.emplace_back(runStage, s);
+    if (!coreGroups.empty()) {
+      pinThread(threads.back(), coreGroups[s % coreGroups.size()]);
+    }
+  }
+  for (auto &thread : threads) {
+    thread.join();
+  }
+}
+
+void ExecutionEngine::dumpProfile() {
+  if (partitions_.empty()) {
+    IP_->dumpProfile();
+    for (auto &E : entries_) {
+      E.backend->dumpProfile();
+    }
+    return;
+  }
+  for (auto &P : partitions_) {
+    P.backend->dumpProfile();
+  }
+}
+
+void ExecutionEngine::setBatchSize(size_t batchSize) {
+  if (partitions_.empty()) {
+    IP_->setBatchSize(batchSize);
+    for (auto &E : entries_) {
+      E.backend->setBatchSize(batchSize);
+    }
+    return;
+  }
+  for (auto &P : partitions_) {
+    P.backend->setBatchSize(batchSize);
+  }
+}
+
+size_t ExecutionEngine::getActivationsSize() const {
+  if (partitions_.empty()) {
+    size_t size = IP_->getActivationsSize();
+    for (auto &E : entries_) {
+      size = std::max(size, E.backend->getActivationsSize());
+    }
+    return size;
+  }
+  size_t size = 0;
+  for (auto &P : partitions_) {
+    size = std::max(size, P.backend->getActivationsSize());
+  }
+  return size;
+}
+
+void ExecutionEngine::setActivationArena(ActivationArena *arena) {
+  if (partitions_.empty()) {
+    IP_->setActivationArena(arena);
+    for (auto &E : entries_) {
+      E.backend->setActivationArena(arena);
+    }
+    return;
+  }
+  for (auto &P : partitions_) {
+    P.backend->setActivationArena(arena);
+  }
+}
+
+void ExecutionEngine::bind(Variable *v, Tensor *T) {
+  assert(v->getVisibilityKind() == VisibilityKind::Public &&
+         "Trying to bind a private variable");
+  auto &payload = v->getPayload();
+  if (!T) {
+    Tensor owned;
+    owned.copyFrom(&payload);
+    payload = std::move(owned);
+    return;
+  }
+  assert(T->getType().isEqual(v->getType()) && "Invalid tensor type");
+  assert(size_t(T->getUnsafePtr()) % TensorAlignment == 0 &&
+         "The tensor is not aligned");
+  payload = T->getUnowned(T->dims());
+}
+
+std::vector<IOSlot> ExecutionEngine::getIOLayout() const {
+  std::vector<IOSlot> layout;
+  size_t offset = 0;
+  for (auto *v : M_->getVars()) {
+    if (v->getVisibilityKind() != VisibilityKind::Public || v->isState()) {
+      continue;
+    }
+    layout.push_back({v, offset});
+    offset = alignedSize(offset + v->getType()->getSizeInBytes(),
+                         TensorAlignment);
+  }
+  return layout;
+}
+
+size_t ExecutionEngine::getIOSize() const {
+  auto layout = getIOLayout();
+  if (layout.empty()) {
+    return 0;
+  }
+  return layout.back().offset +
+         layout.back().var->getType()->getSizeInBytes();
+}
+
+void ExecutionEngine::bindIO(void *memory, size_t size) {
+  if (!memory) {
+    for (const auto &slot : getIOLayout()) {
+      bind(slot.var, nullptr);
+    }
+    return;
+  }
+  GLOW_ASSERT(size >= getIOSize() &&
+              "The memory of the inputs and outputs is too small");
+  assert(size_t(memory) % TensorAlignment == 0 && "The memory is not aligned");
+  for (const auto &slot : getIOLayout()) {
+    Tensor T(static_cast<char *>(memory) + slot.offset, slot.var->getType());
+    bind(slot.var, &T);
+  }
+}
+
+Tensor &ExecutionEngine::readState(Variable *v) {
+  GLOW_ASSERT(v->isState() && "Not a state variable");
+  GLOW_ASSERT(partitions_.empty() &&
+              "States are not supported for the partitioned functions");
+  IP_->readState(v);
+  return v->getPayload();
+}
+
+void ExecutionEngine::writeState(Variable *v) {
+  GLOW_ASSERT(v->isState() && "Not a state variable");
+  GLOW_ASSERT(partitions_.empty() &&
+              "States are not supported for the partitioned functions");
+  IP_->writeState(v);
+}
+
+void ExecutionEngine::resetState(Variable *v) {
+  v->getPayload().zero();
+  writeState(v);
+}
+
+void ExecutionEngine::reorderState(Variable *v, llvm::ArrayRef<size_t> rows) {
+  GLOW_ASSERT(v->isState() && "Not a state variable");
+  GLOW_ASSERT(partitions_.empty() &&
+              "States are not supported for the partitioned functions");
+  IP_->reorderState(v, rows);
+}
+
+std::unique_ptr<ExecutionSession> ExecutionEngine::createSession() {
+  GLOW_ASSERT(partitions_.empty() &&
+              "Sessions are not supported for the partitioned functions");
+  GLOW_ASSERT(replicas_.empty() &&
+              "Sessions are not supported for the replicated functions");
+  auto session = IP_->createSession();
+  GLOW_ASSERT(session && "The backend does not support sessions");
+  return session;
+}
+
+void ExecutionEngine::loadSessionInputs(ExecutionSession &session,
+                                        llvm::ArrayRef<Variable *> vars,
+                                        llvm::ArrayRef<Tensor *> inputs) {
+  assert(inputs.size() == vars.size() &&
+         "The number of inputs does not match the number of variables");
+
+  for (int i = 0, e = vars.size(); i < e; i++) {
+    assert(vars[i]->getVisibilityKind() == VisibilityKind::Public &&
+           "Trying to update a private variable");
+    auto &t = session.getTensor(vars[i]);
+    assert(t.dims() == inputs[i]->dims() && "Invalid input size");
+    // There is nothing to copy if the input is bound to the variable.
+    if (t.getUnsafePtr() != inputs[i]->getUnsafePtr()) {
+      t.copyRawFrom(inputs[i]);
+    }
+  }
+}
+
+void ExecutionEngine::run(ExecutionSession &session,
+                          llvm::ArrayRef<Variable *> vars,
+                          llvm::ArrayRef<Tensor *> inputs) {
+  loadSessionInputs(session, vars, inputs);
+  session.doForwardPass();
+}
+
+std::future<void> ExecutionEngine::runAsync(ExecutionSession &session,
+                                            llvm::ArrayRef<Variable *> vars,
+                                            llvm::ArrayRef<Tensor *> inputs,
+                                            std::function<void()> done) {
+  loadSessionInputs(session, vars, inputs);
+  if (!async_) {
+    async_.reset(
+        new AsyncQueue(std::max(1u, std::thread::hardware_concurrency())));
+  }
+  AsyncQueue::Request R;
+  R.session = &session;
+  R.done = std::move(done);
+  auto future = R.promise.get_future();
+  async_->push(std::move(R));
+  return future;
 }
 
 void ExecutionEngine::runBatch(size_t iterations,
                                llvm::ArrayRef<Variable *> vars,
                                llvm::ArrayRef<Tensor *> inputs) {
-  static size_t trainCounter = 0;
-
   assert(!inputs.empty() && "No inputs");
   assert(inputs.size() == vars.size() &&
          "The number of inputs does not match the number of variables");
-  assert(!IR_->getInstrs().empty() &&
+  assert((!partitions_.empty() || !IR_->getInstrs().empty()) &&
          "Running a function with no instructions.");
 
   // This is the size of one batch (the number of samples in the batch).
   size_t batchSize = vars[0]->getType()->dims()[0];
 
   for (size_t i = 0; i < iterations; i++) {
-    // Launch threads that update the different chunks in the batch:
-    updateForwardBackward(vars, inputs, trainCounter);
+    // Train on the next mini-batch, or on the next mini-batch of every worker:
+    updateForwardBackward(vars, inputs, trainCounter_);
+
+    trainCounter_ += batchSize * (replicas_.size() + 1);
+  }
+}
+
+size_t ExecutionEngine::runBatch(size_t iterations,
+                                 llvm::ArrayRef<Variable *> vars,
+                                 BatchProvider &provider) {
+  assert(!vars.empty() && "No inputs");
+  assert((!partitions_.empty() || !IR_->getInstrs().empty()) &&
+         "Running a function with no instructions.");
+
+  // The mini-batches are staged in two sets of tensors: the variables are
+  // bound to one set while the next mini-batches are fetched into the other.
+  // A set has a tensor for every worker and variable.
+  size_t numWorkers = replicas_.size() + 1;
+  size_t numVars = vars.size();
+  std::vector<Tensor> staging[2];
+  for (auto &set : staging) {
+    set.reserve(numWorkers * numVars);
+    for (size_t w = 0; w < numWorkers; w++) {
+      for (auto *v : vars) {
+        set.emplace_back(v->getType());
+      }
+    }
+  }
+  auto fetch = [&provider, numWorkers, numVars](std::vector<Tensor> *set) {
+    std::vector<Tensor *> batch(numVars);
+    for (size_t w = 0; w < numWorkers; w++) {
+      for (size_t i = 0; i < numVars; i++) {
+        batch[i] = &(*set)[w * numVars + i];
+      }
+      if (!provider.next(batch)) {
+        return false;
+      }
+    }
+    return true;
+  };
+
+  size_t done = 0;
+  bool ready = iterations && fetch(&staging[0]);
+  while (ready) {
+    auto &set = staging[done % 2];
+    for (size_t w = 0; w < numWorkers; w++) {
+      for (size_t i = 0; i < numVars; i++) {
+        if (auto *v = getWorkerVar(w, vars[i])) {
+          bind(v, &set[w * numVars + i]);
+        }
+      }
+    }
+    bool more = done + 1 < iterations;
+    std::future<bool> next;
+    if (more) {
+      next = std::async(std::launch::async, fetch, &staging[(done + 1) % 2]);
+    }
+    doTrainingStep();
+    done++;
+    ready = more && next.get();
+  }
 
-    trainCounter += batchSize;
+  // Give the variables payloads of their own again, with the last batch.
+  if (done) {
+    for (size_t w = 0; w < numWorkers; w++) {
+      for (auto *v : vars) {
+        if (auto *workerVar = getWorkerVar(w, v)) {
+          bind(workerVar, nullptr);
+        }
+      }
+    }
   }
+  return done;
 }
 
 void ExecutionEngine::updateForwardBackward(llvm::ArrayRef<Variable *> vars,
                                             llvm::ArrayRef<Tensor *> inputs,
                                             size_t sampleIdx) {
-  // Update the input variables.
-  for (int i = 0, e = vars.size(); i < e; i++) {
-    loadValueFromTensorSlice(vars[i], inputs[i], sampleIdx);
+  // Update the input variables. Every replica trains on the mini-batch that
+  // follows the one of the previous replica.
+  size_t batchSize = vars[0]->getType()->dims()[0];
+  for (size_t w = 0, numWorkers = replicas_.size() + 1; w < numWorkers; w++) {
+    for (int i = 0, e = vars.size(); i < e; i++) {
+      if (auto *v = getWorkerVar(w, vars[i])) {
+        loadValueFromTensorSlice(v, inputs[i], sampleIdx + w * batchSize);
+      }
+    }
   }
+  doTrainingStep();
+}
 
+void ExecutionEngine::doTrainingStep() {
+  if (replicas_.empty()) {
+    doForwardPass();
+    return;
+  }
+
+  std::vector<std::thread> threads;
+  for (auto &R : replicas_) {
+    threads.emplace_back([&R]() { R.code.backend->doForwardPass(); });
+  }
   IP_->doForwardPass();
+  for (auto &thread : threads) {
+    thread.join();
+  }
+  averageReplicas();
+}
+
+Variable *ExecutionEngine::getWorkerVar(size_t worker, Variable *v) {
+  if (!worker) {
+    return v;
+  }
+  auto &vars = replicas_[worker - 1].vars;
+  auto it = vars.find(v);
+  return it == vars.end() ? nullptr : it->second;
+}
+
+void ExecutionEngine::averageReplicas() {
+  // The SGD update is linear in the gradient, in the momentum and in the
+  // weight, so the average of the updated weights is the update with the
+  // average gradient of all of the mini-batches.
+  float scale = 1.0f / (replicas_.size() + 1);
+  for (auto &it : replicas_[0].vars) {
+    Variable *V = it.first;
+    // Skip the inputs, and the void gsum of the updates without momentum.
+    if (V->getVisibilityKind() == VisibilityKind::Public ||
+        !V->getType()->size()) {
+      continue;
+    }
+    auto avgH = V->getHandle<float>();
+    for (auto &R : replicas_) {
+      auto H = R.vars[V]->getHandle<float>();
+      for (size_t i = 0, e = avgH.size(); i < e; i++) {
+        avgH.raw(i) += H.raw(i);
+      }
+    }
+    for (size_t i = 0, e = avgH.size(); i < e; i++) {
+      avgH.raw(i) *= scale;
+    }
+    for (auto &R : replicas_) {
+      R.vars[V]->getPayload().copyRawFrom(&V->getPayload());
+    }
+  }
 }
 
 void ExecutionEngine::loadValueFromTensorSlice(Variable *v, Tensor *input,
@@ -114,13 +687,15 @@ void ExecutionEngine::loadValueFromTensor(Variable *v, Tensor *input) {
   auto dim = input->dims();
   (void)dim;
   assert(t.dims() == dim && "Invalid slice size");
-  t.copyFrom(input);
+  // There is nothing to copy if the input is bound to the variable.
+  if (t.getUnsafePtr() != input->getUnsafePtr()) {
+    t.copyFrom(input);
+  }
 }
 
-void ExecutionEngine::generateIR(CompilationMode mode, Function *F) {
-  // Reset the engine and start a new compilation process.
-  reset();
-
+void ExecutionEngine::optimizeFunction(CompilationMode mode, Function *F,
+                                       Backend *B) {
+  TraceScope trace("optimize", TraceCompile);
   // Verify the function pre-optimization/lowering.
   F->verify();
 
@@ -128,38 +703,407 @@ void ExecutionEngine::generateIR(CompilationMode mode, Function *F) {
   ::glow::optimize(F, mode);
 
   // Allow the backend to transform the graph prior to lowering.
-  if (IP_->transformPreLowering(F, mode)) {
+  if (B->transformPreLowering(F, mode)) {
     // Optimize the graph again after the backend transformation.
     // In particular, DCE is very likely to be useful.
     ::glow::optimize(F, mode);
   }
 
+  // Store the mostly zero weights of the fully connected layers in the sparse
+  // format, before they are lowered to dense matrix multiplications.
+  if (mode == CompilationMode::Infer && ::glow::sparsifyWeights(F, *B)) {
+    ::glow::optimize(F, mode);
+  }
+
+  // Run the chains of per-sample layers on micro-batches that stay in the
+  // cache, before the layers are lowered.
+  if (mode == CompilationMode::Infer && ::glow::splitBatches(F)) {
+    ::glow::optimize(F, mode);
+  }
+
   // Lower the graph into a sequence of low-level linear algebra operations.
-  ::glow::lower(F, mode, IP_.get());
+  {
+    TraceScope lowerTrace("lower", TraceCompile);
+    ::glow::lower(F, mode, B);
+  }
 
   // Optimized the graph again.
   ::glow::optimize(F, mode);
 
-  // Allow the backend to transform the graph after lowering.
-  if (IP_->transformPostLowering(F, mode)) {
+  // Allow the backend to transform the graph after lowering, and to fuse the
+  // nodes that it has kernels for. The arithmetic with the splat operands that
+  // lowering produces takes their values as immediates before the fusion.
+  bool changed = B->transformPostLowering(F, mode);
+  changed |= ::glow::foldSplatOperands(F, *B);
+  changed |= ::glow::fuse(F, B->getFusionPatterns(mode));
+  if (changed) {
     // Optimize the graph again after the backend transformation.
     // In particular, DCE is very likely to be useful.
     ::glow::optimize(F, mode);
   }
+}
+
+void ExecutionEngine::shareWeights(CompilationMode mode) {
+  // Share the final constant weights, after the optimizations that fold and
+  // transform them.
+  if (weightStore_ && mode != CompilationMode::Train) {
+    for (auto *V : M_->getVars()) {
+      if (V->isPrivate() && !V->isTraining()) {
+        V->sharePayload(*weightStore_);
+      }
+    }
+  }
+}
+
+void ExecutionEngine::generateIR(CompilationMode mode, Function *F) {
+  // Reset the engine and start a new compilation process.
+  reset();
+
+  optimizeFunction(mode, F, IP_.get());
+  shareWeights(mode);
+  // The statistics have variables of their own, which are not shared.
+  ::glow::instrumentTensorStats(F, *IP_);
+  generateFunctionIR(mode, F, *IR_);
+}
+
+void ExecutionEngine::generateFunctionIR(CompilationMode mode, Function *F,
+                                         IRFunction &IR) {
+  TraceScope trace("IRGen", TraceCompile);
+  size_t budget = mode == CompilationMode::Train ? config_.activationBudget : 0;
+  auto generate = [&](SchedulerKind scheduler, size_t recomputeBudget) {
+    // Prepare the IR container to handle our function.
+    IR.clear();
+    IR.setGraph(F);
+
+    // Generate IR from the graph.
+    IR.generateIR(scheduler);
+
+    // Trade compute for memory before the buffers are assigned.
+    if (recomputeBudget) {
+      recomputeActivations(IR, recomputeBudget, config_.recomputeDepth);
+    }
 
-  /// Prepare the IR container to handle our function.
-  IR_->setGraph(F);
+    // Optimize the generated IR.
+    ::glow::optimize(IR, mode);
+  };
+
+  generate(scheduler_, budget);
+  if (!activationsLimit_ || getActivationsPeak(IR) <= activationsLimit_) {
+    return;
+  }
+  // Order the nodes to lower the peak of their live results, and then recompute
+  // the activations until the peak fits in the limit.
+  generate(SchedulerKind::MinPeakMemory, budget);
+  if (getActivationsPeak(IR) <= activationsLimit_) {
+    return;
+  }
+  generate(SchedulerKind::MinPeakMemory,
+           budget ? std::min(budget, activationsLimit_) : activationsLimit_);
+  if (getActivationsPeak(IR) <= activationsLimit_) {
+    return;
+  }
+  llvm::errs() << "The activations of " << F->getName()
+               << " don't fit in the limit of " << activationsLimit_
+               << " bytes after rescheduling and recomputation. Compile a "
+                  "smaller batch or raise the limit.\n";
+  dumpActivationsPeak(IR, llvm::errs());
+  GLOW_UNREACHABLE("The activations exceed their limit");
+}
 
-  // Generate IR from the graph.
-  IR_->generateIR();
+void ExecutionEngine::checkActivationsLimit(IRFunction &IR,
+                                            const Backend &B) const {
+  if (!activationsLimit_ || B.getActivationsSize() <= activationsLimit_) {
+    return;
+  }
+  // The live activations fit, but the allocation of their memory adds
+  // padding and fragmentation.
+  llvm::errs() << "The backend allocated " << B.getActivationsSize()
+               << " bytes for the activations of " << IR.getGraph()->getName()
+               << ", above the limit of " << activationsLimit_
+               << " bytes.\n";
+  dumpActivationsPeak(IR, llvm::errs());
+  GLOW_UNREACHABLE("The activations exceed their limit");
+}
 
-  // Optimize the generated IR.
-  ::glow::optimize(*IR_, mode);
+/// Copy the payloads of the private variables that \p src uses into the
+/// ones that \p dest uses at the same places. \p src must have been optimized
+/// from a copy of the function that \p dest was optimized from, so that the
+/// nodes of both are the same.
+static void copyConstantWeights(Function *src, Function *dest) {
+  auto &srcNodes = src->getNodes();
+  auto &destNodes = dest->getNodes();
+  GLOW_ASSERT(srcNodes.size() == destNodes.size() &&
+              "The weights don't match the compiled function");
+  for (auto srcIt = srcNodes.begin(), destIt = destNodes.begin(),
+            e = srcNodes.end();
+       srcIt != e; ++srcIt, ++destIt) {
+    Node *S = *srcIt;
+    Node *D = *destIt;
+    GLOW_ASSERT(S->getKind() == D->getKind() &&
+                S->getNumInputs() == D->getNumInputs() &&
+                "The weights don't match the compiled function");
+    for (unsigned i = 0, e = D->getNumInputs(); i < e; i++) {
+      auto *DV = dyn_cast<Variable>(D->getNthInput(i).getNode());
+      if (!DV || !DV->isPrivate()) {
+        continue;
+      }
+      auto *SV = dyn_cast<Variable>(S->getNthInput(i).getNode());
+      GLOW_ASSERT(SV && SV->getType()->isEqual(DV->getType()) &&
+                  "The weights don't match the compiled function");
+      GLOW_ASSERT(!DV->isPayloadShared() &&
+                  "Can't update the weights shared through a weight store");
+      // The code may refer to the address of the payload, so the new weights
+      // are written in place.
+      auto &payload = DV->getPayload();
+      payload.getUnsafePtr();
+      payload.copyRawFrom(&SV->getPayload());
+    }
+  }
 }
 
 void ExecutionEngine::compile(CompilationMode mode, Function *F) {
+  // Keep the weights before the optimizations transform them.
+  std::unique_ptr<Module> weightsSource;
+  if (updatableWeights_ && mode == CompilationMode::Infer) {
+    weightsSource.reset(new Module());
+    F->cloneInto(*weightsSource, F->getName());
+  }
   generateIR(mode, F);
-  IP_->init();
+  weightsSource_ = std::move(weightsSource);
+  {
+    TraceScope trace("backend init", TraceCompile);
+    IP_->init();
+  }
+  checkActivationsLimit(*IR_, *IP_);
+  if (mode == CompilationMode::Train && config_.numWorkers > 1) {
+    createReplicas(mode, F);
+  }
+  if (mode == CompilationMode::Infer) {
+    warmUp();
+  }
+}
+
+void ExecutionEngine::compileEntries(
+    CompilationMode mode, Function *F,
+    llvm::ArrayRef<std::vector<SaveNode *>> entries) {
+  // Copy the entries before the optimizations transform the nodes of F.
+  std::vector<Function *> entryFunctions;
+  for (size_t i = 0, e = entries.size(); i < e; i++) {
+    entryFunctions.push_back(F->cloneForOutputs(
+        F->getName().str() + "_entry" + std::to_string(i), entries[i]));
+  }
+  compile(mode, F);
+  for (auto *EF : entryFunctions) {
+    entries_.push_back(compileFunction(mode, EF, backendKind_));
+  }
+}
+
+void ExecutionEngine::updateWeights(llvm::ArrayRef<llvm::StringRef> names,
+                                    llvm::ArrayRef<Tensor *> weights) {
+  assert(names.size() == weights.size() &&
+         "The number of weights does not match the number of names");
+  GLOW_ASSERT(weightsSource_ &&
+              "The weights of the compiled function are not updatable");
+  for (size_t i = 0, e = names.size(); i < e; i++) {
+    auto *V = weightsSource_->getVariableByName(names[i]);
+    GLOW_ASSERT(V && V->isPrivate() &&
+                "Not a weight of the compiled function");
+    assert(weights[i]->getType().isEqual(V->getType()) &&
+           "Invalid tensor type");
+    V->getPayload().copyRawFrom(weights[i]);
+  }
+
+  // The optimizations transform the weights in place, so they derive the new
+  // weights from a copy of the source.
+  Module M;
+  Function *F = weightsSource_->getFunctions().front()->cloneInto(
+      M, "update_weights");
+  optimizeFunction(CompilationMode::Infer, F, IP_.get());
+  copyConstantWeights(F, IR_->getGraph());
+  IP_->reloadConstantWeights();
+}
+
+void ExecutionEngine::saveCompiled(Function *F, llvm::StringRef path) {
+  compile(CompilationMode::Infer, F);
+  IP_->saveCompiled(path);
+}
+
+void ExecutionEngine::loadCompiled(llvm::StringRef path) {
+  reset();
+  M_.reset(new Module());
+  IP_->loadCompiled(path, *M_);
+  isCompiledLoaded_ = true;
+  warmUp();
+}
+
+bool ExecutionEngine::waitForOptimizedCode() {
+  bool replaced = false;
+  if (partitions_.empty()) {
+    replaced = IP_->waitForOptimizedCode();
+  }
+  for (auto &P : partitions_) {
+    replaced |= P.backend->waitForOptimizedCode();
+  }
+  return replaced;
+}
+
+void ExecutionEngine::warmUp() {
+  warmUpReport_ = WarmUpReport();
+  if (warmUpPrefault_) {
+    TraceScope trace("prefault", TraceCompile);
+    if (partitions_.empty()) {
+      IP_->prefault();
+    }
+    for (auto &P : partitions_) {
+      P.backend->prefault();
+    }
+  }
+  if (!warmUpRuns_) {
+    return;
+  }
+
+  for (unsigned i = 0; i < warmUpRuns_; i++) {
+    auto begin = std::chrono::steady_clock::now();
+    doForwardPass();
+    double seconds = std::chrono::duration<double>(
+                         std::chrono::steady_clock::now() - begin)
+                         .count();
+    if (i == 0) {
+      warmUpReport_.coldSeconds = seconds;
+    } else if (i == 1 || seconds < warmUpReport_.warmSeconds) {
+      warmUpReport_.warmSeconds = seconds;
+    }
+  }
+  // The runs must not leave anything behind in the states.
+  if (partitions_.empty()) {
+    for (auto *v : M_->getVars()) {
+      if (v->isState()) {
+        resetState(v);
+      }
+    }
+  }
+}
+
+ExecutionEngine::CompiledFunction
+ExecutionEngine::compileFunction(CompilationMode mode, Function *F,
+                                 BackendKind kind) {
+  CompiledFunction C;
+  C.IR.reset(new IRFunction());
+  C.backend.reset(createBackend(kind, C.IR.get()));
+  optimizeFunction(mode, F, C.backend.get());
+  shareWeights(mode);
+  ::glow::instrumentTensorStats(F, *C.backend);
+  generateFunctionIR(mode, F, *C.IR);
+  {
+    TraceScope trace("backend init", TraceCompile);
+    C.backend->init();
+  }
+  checkActivationsLimit(*C.IR, *C.backend);
+  return C;
+}
+
+void ExecutionEngine::createReplicas(CompilationMode mode, Function *F) {
+  // The weights are averaged in the host memory after every iteration.
+  GLOW_ASSERT(backendKind_ != BackendKind::OpenCL &&
+              "The backend keeps the weights in the device memory");
+
+  // The replicas share the constant weights. They have their own inputs and
+  // outputs, and their own copies of the variables that the function updates.
+  std::unordered_set<Variable *> updated;
+  for (auto *N : F->getNodes()) {
+    for (unsigned i = 0, e = N->getNumInputs(); i < e; i++) {
+      auto *V = dyn_cast<Variable>(N->getNthInput(i).getNode());
+      if (V && N->isOverwrittenNthInput(i)) {
+        updated.insert(V);
+      }
+    }
+  }
+
+  for (unsigned r = 1; r < config_.numWorkers; r++) {
+    std::string name;
+    for (unsigned suffix = r; name.empty() || M_->hasFunction(name);
+         suffix += config_.numWorkers) {
+      name = F->getName().str() + "_replica" + std::to_string(suffix);
+    }
+    Function *RF = F->clone(name);
+    Replica R;
+    for (auto *N : RF->getNodes()) {
+      for (unsigned i = 0, e = N->getNumInputs(); i < e; i++) {
+        NodeValue &in = N->getNthInput(i);
+        auto *V = dyn_cast<Variable>(in.getNode());
+        if (!V || (V->isPrivate() && !updated.count(V))) {
+          continue;
+        }
+        auto &copy = R.vars[V];
+        if (!copy) {
+          copy = M_->createVariable(V->getType(), V->getName(),
+                                    V->getVisibilityKind(), V->getTrainKind(),
+                                    V->getVal());
+          copy->getPayload().copyFrom(&V->getPayload());
+        }
+        in = NodeValue(copy, 0);
+      }
+    }
+    R.code = compileFunction(mode, RF, backendKind_);
+    replicas_.push_back(std::move(R));
+  }
+}
+
+void ExecutionEngine::compile(CompilationMode mode, Function *F,
+                              llvm::ArrayRef<BackendKind> backends) {
+  reset();
+
+  // Optimize the whole graph before splitting it, so that the partitioner
+  // sees the nodes that remain.
+  ::glow::optimize(F, mode);
+  compilePartitions(mode, F, ::glow::partition(F, mode, backends));
+  if (mode == CompilationMode::Infer) {
+    warmUp();
+  }
+}
+
+void ExecutionEngine::compilePartitions(
+    CompilationMode mode, Function *F,
+    llvm::ArrayRef<std::pair<Function *, BackendKind>> parts) {
+  if (parts.size() > 1) {
+    // The saves of F write its outputs, and the other saves of the parts
+    // write the values that the parts exchange.
+    std::unordered_set<const Variable *> outputs;
+    for (auto *N : F->getNodes()) {
+      if (auto *SN = dyn_cast<SaveNode>(N)) {
+        outputs.insert(SN->getVariable());
+      }
+    }
+    for (auto &part : parts) {
+      partitionFunctions_.push_back(part.first);
+      for (auto *N : part.first->getNodes()) {
+        auto *SN = dyn_cast<SaveNode>(N);
+        if (SN && !outputs.count(SN->getVariable())) {
+          transferVars_.push_back(SN->getVariable());
+        }
+      }
+    }
+  }
+  for (auto &part : parts) {
+    partitions_.push_back(compileFunction(mode, part.first, part.second));
+  }
+}
+
+void ExecutionEngine::compilePipeline(CompilationMode mode, Function *F,
+                                      unsigned numStages) {
+  reset();
+
+  // Optimize the whole graph before splitting it, so that the costs of the
+  // stages are those of the nodes that remain.
+  ::glow::optimize(F, mode);
+  std::vector<std::pair<Function *, BackendKind>> stages;
+  for (auto *S : ::glow::splitIntoStages(F, numStages)) {
+    stages.push_back({S, backendKind_});
+  }
+  compilePartitions(mode, F, stages);
+  if (mode == CompilationMode::Infer) {
+    warmUp();
+  }
 }
 
 void ExecutionEngine::save(CompilationMode mode, Function *F,
@@ -167,3 +1111,54 @@ void ExecutionEngine::save(CompilationMode mode, Function *F,
   generateIR(mode, F);
   IP_->save(outputDir);
 }
+
+/// Replace the uses of the private variables of \p M by the uses of the
+/// earlier private variables with the same type and payload. The variables
+/// that become unused are removed by the optimizer.
+static void shareIdenticalVariables(Module &M) {
+  std::unordered_map<size_t, std::vector<Variable *>> varsByHash;
+  for (auto *V : M.getVars()) {
+    if (V->getVisibilityKind() == VisibilityKind::Public) {
+      continue;
+    }
+    auto &T = V->getPayload();
+    llvm::StringRef bytes(T.getUnsafePtr(), T.getType().getSizeInBytes());
+    auto &candidates = varsByHash[llvm::hash_value(bytes)];
+    auto it = std::find_if(
+        candidates.begin(), candidates.end(), [&](Variable *other) {
+          return other->getType() == V->getType() &&
+                 !memcmp(other->getPayload().getUnsafePtr(), bytes.data(),
+                         bytes.size());
+        });
+    if (it == candidates.end()) {
+      candidates.push_back(V);
+      continue;
+    }
+    NodeValue(V, 0).replaceAllUsesOfWith(*it);
+  }
+}
+
+void ExecutionEngine::save(CompilationMode mode,
+                           llvm::ArrayRef<Function *> functions,
+                           llvm::StringRef outputDir,
+                           llvm::StringRef bundleName) {
+  reset();
+  shareIdenticalVariables(*M_);
+
+  // Optimize all of the functions before generating the IR of any of them,
+  // because the optimizations may replace the variables that the functions
+  // share. All of the IR functions then have the same weights.
+  for (auto *F : functions) {
+    optimizeFunction(mode, F, IP_.get());
+  }
+  shareWeights(mode);
+
+  std::vector<std::unique_ptr<IRFunction>> IRs;
+  std::vector<IRFunction *> entries;
+  for (auto *F : functions) {
+    IRs.emplace_back(new IRFunction());
+    generateFunctionIR(mode, F, *IRs.back());
+    entries.push_back(IRs.back().get());
+  }
+  IP_->save(entries, outputDir, bundleName);
+}
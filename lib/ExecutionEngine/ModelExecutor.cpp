@@ -0,0 +1,255 @@
+/**
+ * Copyright (c) 2017-present, Facebook, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "glow/ExecutionEngine/ModelExecutor.h"
+
+#include "glow/Backends/Backend.h"
+#include "glow/Base/Tensor.h"
+#include "glow/ExecutionEngine/ExecutionEngine.h"
+#include "glow/Support/Compiler.h"
+#include "glow/Support/Parallel.h"
+#include "glow/Support/Trace.h"
+
+#include <algorithm>
+#include <cassert>
+#include <deque>
+#include <thread>
+
+using namespace glow;
+
+struct ModelExecutor::Request {
+  std::vector<Variable *> vars;
+  /// The copies of the inputs.
+  std::vector<Tensor> inputs;
+  std::vector<Variable *> outputs;
+  std::vector<Tensor *> results;
+  std::function<void()> done;
+  std::promise<void> promise;
+  /// The number of the request in the order of submission.
+  uint64_t seq{0};
+};
+
+struct ModelExecutor::Runner {
+  std::unique_ptr<ExecutionSession> session;
+  std::thread thread;
+  /// Set while the request of the runner is preempted and waits for cores.
+  bool parked{false};
+  /// The number of the request that the runner runs.
+  uint64_t seq{0};
+};
+
+struct ModelExecutor::Model {
+  ExecutionEngine *EE;
+  ModelQoS qos;
+  /// The requests that haven't started yet.
+  std::deque<Request> pending;
+  std::vector<std::unique_ptr<Runner>> runners;
+  /// The number of the runners without a request.
+  unsigned idleRunners{0};
+  size_t numPreemptions{0};
+};
+
+/// Call \p fn with the priority, the number and the cores of every request of
+/// \p models that waits for cores: the preempted requests, and the pending
+/// requests that an idle runner of their model can start.
+template <class ModelList, class Fn>
+static void forEachWaitingRequest(const ModelList &models, Fn fn) {
+  for (const auto &M : models) {
+    int priority = M->qos.priority;
+    unsigned cores = M->qos.coresPerRequest;
+    for (const auto &R : M->runners) {
+      if (R->parked) {
+        fn(priority, R->seq, cores);
+      }
+    }
+    size_t numStartable = std::min<size_t>(M->pending.size(), M->idleRunners);
+    for (size_t i = 0; i < numStartable; i++) {
+      fn(priority, M->pending[i].seq, cores);
+    }
+  }
+}
+
+bool ModelExecutor::canRun(int priority, uint64_t seq, unsigned cores) const {
+  if (freeCores_ < cores) {
+    return false;
+  }
+  bool isFirst = true;
+  forEachWaitingRequest(models_, [&](int p, uint64_t s, unsigned) {
+    if (p > priority || (p == priority && s < seq)) {
+      isFirst = false;
+    }
+  });
+  return isFirst;
+}
+
+bool ModelExecutor::isPreempted(int priority) const {
+  bool preempted = false;
+  forEachWaitingRequest(models_, [&](int p, uint64_t, unsigned cores) {
+    if (p > priority && cores > freeCores_) {
+      preempted = true;
+    }
+  });
+  return preempted;
+}
+
+ModelExecutor::ModelExecutor(unsigned numCores)
+    : numCores_(numCores ? numCores : glow_parallel_get_num_threads()),
+      freeCores_(numCores_) {}
+
+ModelExecutor::~ModelExecutor() {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    shutdown_ = true;
+  }
+  wakeup_.notify_all();
+  for (auto &M : models_) {
+    for (auto &R : M->runners) {
+      R->thread.join();
+    }
+  }
+}
+
+unsigned ModelExecutor::addModel(ExecutionEngine &EE, const ModelQoS &qos) {
+  GLOW_ASSERT(qos.coresPerRequest >= 1 && qos.coresPerRequest <= numCores_ &&
+              "A request needs between 1 and all of the cores");
+  unsigned quota = qos.coreQuota ? qos.coreQuota : numCores_;
+  GLOW_ASSERT(quota <= numCores_ && quota % qos.coresPerRequest == 0 &&
+              "The core quota is not a multiple of the cores of a request");
+
+  // The model is complete before the runners of the other models see it.
+  auto *M = new Model();
+  M->EE = &EE;
+  M->qos = qos;
+  M->qos.coreQuota = quota;
+  for (unsigned i = 0, e = quota / qos.coresPerRequest; i < e; i++) {
+    auto *R = new Runner();
+    R->session = EE.createSession();
+    R->session->setPreemptionPoint([this, M, R]() { preemptionPoint(*M, *R); });
+    M->runners.emplace_back(R);
+  }
+  M->idleRunners = M->runners.size();
+
+  unsigned idx;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    idx = models_.size();
+    models_.emplace_back(M);
+  }
+  for (auto &R : M->runners) {
+    Runner *runner = R.get();
+    R->thread = std::thread([this, M, runner]() { runnerLoop(*M, *runner); });
+  }
+  return idx;
+}
+
+std::future<void> ModelExecutor::submit(unsigned model,
+                                        llvm::ArrayRef<Variable *> vars,
+                                        llvm::ArrayRef<Tensor *> inputs,
+                                        llvm::ArrayRef<Variable *> outputs,
+                                        llvm::ArrayRef<Tensor *> results,
+                                        std::function<void()> done) {
+  assert(inputs.size() == vars.size() &&
+         "The number of inputs does not match the number of variables");
+  assert(results.size() == outputs.size() &&
+         "The number of results does not match the number of outputs");
+  Request req;
+  req.vars = vars.vec();
+  for (auto *T : inputs) {
+    req.inputs.push_back(T->clone());
+  }
+  req.outputs = outputs.vec();
+  req.results = results.vec();
+  req.done = std::move(done);
+  auto future = req.promise.get_future();
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    GLOW_ASSERT(model < models_.size() && "Invalid model");
+    req.seq = nextSeq_++;
+    models_[model]->pending.push_back(std::move(req));
+  }
+  wakeup_.notify_all();
+  return future;
+}
+
+size_t ModelExecutor::getNumPreemptions(unsigned model) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  GLOW_ASSERT(model < models_.size() && "Invalid model");
+  return models_[model]->numPreemptions;
+}
+
+void ModelExecutor::runnerLoop(Model &M, Runner &R) {
+  unsigned cores = M.qos.coresPerRequest;
+  // The parallel kernels of the requests use the cores of the request only.
+  glow_parallel_set_thread_limit(cores);
+  for (;;) {
+    Request req;
+    {
+      std::unique_lock<std::mutex> lock(mutex_);
+      wakeup_.wait(lock, [&]() {
+        if (M.pending.empty()) {
+          return shutdown_;
+        }
+        return canRun(M.qos.priority, M.pending.front().seq, cores);
+      });
+      if (M.pending.empty()) {
+        return;
+      }
+      req = std::move(M.pending.front());
+      M.pending.pop_front();
+      M.idleRunners--;
+      freeCores_ -= cores;
+      R.seq = req.seq;
+    }
+
+    std::vector<Tensor *> inputs;
+    for (auto &T : req.inputs) {
+      inputs.push_back(&T);
+    }
+    M.EE->run(*R.session, req.vars, inputs);
+    for (size_t i = 0, e = req.outputs.size(); i < e; i++) {
+      req.results[i]->copyFrom(&R.session->getTensor(req.outputs[i]));
+    }
+
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      freeCores_ += cores;
+      M.idleRunners++;
+    }
+    wakeup_.notify_all();
+    if (req.done) {
+      req.done();
+    }
+    req.promise.set_value();
+  }
+}
+
+void ModelExecutor::preemptionPoint(Model &M, Runner &R) {
+  std::unique_lock<std::mutex> lock(mutex_);
+  int priority = M.qos.priority;
+  if (!isPreempted(priority)) {
+    return;
+  }
+  TraceScope trace("preempted", TraceRun);
+  // Give up the cores until the requests of the higher priorities are done.
+  unsigned cores = M.qos.coresPerRequest;
+  freeCores_ += cores;
+  R.parked = true;
+  M.numPreemptions++;
+  wakeup_.notify_all();
+  wakeup_.wait(lock, [&]() { return canRun(priority, R.seq, cores); });
+  R.parked = false;
+  freeCores_ -= cores;
+}
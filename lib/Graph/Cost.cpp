@@ -0,0 +1,194 @@
+/**
+ * Copyright (c) 2017-present, Facebook, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "glow/Graph/Cost.h"
+#include "glow/Graph/Graph.h"
+#include "glow/Graph/Nodes.h"
+
+using namespace glow;
+using llvm::cast;
+
+llvm::raw_ostream &glow::operator<<(llvm::raw_ostream &os,
+                                    const OpCost &cost) {
+  return os << cost.flops << " flops, " << cost.bytes << " bytes";
+}
+
+uint64_t glow::getConvolutionFlops(size_t resultSize, size_t filterSize,
+                                   size_t depth) {
+  return 2 * uint64_t(resultSize) * (filterSize / depth);
+}
+
+uint64_t glow::getMatMulFlops(size_t resultSize, size_t innerSize) {
+  return 2 * uint64_t(resultSize) * innerSize;
+}
+
+/// \returns the number of elements of \p V.
+static size_t sizeOf(const NodeValue &V) { return V.getType()->size(); }
+
+/// \returns the number of operations of \p N. The nodes that are not listed
+/// perform one operation for every element of their results, like the
+/// element-wise nodes do.
+static uint64_t getFlops(const Node *N) {
+  switch (N->getKind()) {
+  case Kinded::Kind::VariableNodeKind:
+  case Kinded::Kind::SaveNodeKind:
+  case Kinded::Kind::ReshapeNodeKind:
+  case Kinded::Kind::TransposeNodeKind:
+  case Kinded::Kind::BroadcastNodeKind:
+  case Kinded::Kind::ConcatNodeKind:
+  case Kinded::Kind::SliceNodeKind:
+  case Kinded::Kind::InsertTensorNodeKind:
+  case Kinded::Kind::GatherNodeKind:
+  case Kinded::Kind::SplatNodeKind:
+    return 0;
+
+  case Kinded::Kind::ConvolutionNodeKind: {
+    auto *CN = cast<ConvolutionNode>(N);
+    return getConvolutionFlops(sizeOf(CN->getResult()), sizeOf(CN->getFilter()),
+                               sizeOf(CN->getBias()));
+  }
+  case Kinded::Kind::ChannelwiseQuantizedConvolutionNodeKind: {
+    auto *CN = cast<ChannelwiseQuantizedConvolutionNode>(N);
+    return getConvolutionFlops(sizeOf(CN->getResult()), sizeOf(CN->getFilter()),
+                               sizeOf(CN->getBias()));
+  }
+  case Kinded::Kind::FullyConnectedNodeKind: {
+    auto *FC = cast<FullyConnectedNode>(N);
+    return getMatMulFlops(sizeOf(FC->getResult()),
+                          FC->getWeights().dims()[0]);
+  }
+  case Kinded::Kind::ChannelwiseQuantizedFullyConnectedNodeKind: {
+    auto *FC = cast<ChannelwiseQuantizedFullyConnectedNode>(N);
+    return getMatMulFlops(sizeOf(FC->getResult()),
+                          FC->getWeights().dims()[0]);
+  }
+  case Kinded::Kind::MatMulNodeKind: {
+    auto *MM = cast<MatMulNode>(N);
+    auto lhsDims = MM->getLHS().dims();
+    return getMatMulFlops(sizeOf(MM->getResult()),
+                          lhsDims[MM->getTransposeLHS() ? 0 : 1]);
+  }
+  case Kinded::Kind::PoolMaxNodeKind: {
+    auto *PM = cast<PoolMaxNode>(N);
+    return uint64_t(sizeOf(PM->getResult())) * PM->getKernel() *
+           PM->getKernel();
+  }
+  case Kinded::Kind::PoolAvgNodeKind: {
+    auto *PA = cast<PoolAvgNode>(N);
+    return uint64_t(sizeOf(PA->getResult())) * PA->getKernel() *
+           PA->getKernel();
+  }
+  case Kinded::Kind::LocalResponseNormalizationNodeKind: {
+    // The sum of the squares of the window, and the scaling.
+    auto *LRN = cast<LocalResponseNormalizationNode>(N);
+    return uint64_t(sizeOf(LRN->getResult())) *
+           (2 * (2 * LRN->getHalfWindowSize() + 1) + 4);
+  }
+  case Kinded::Kind::BatchNormalizationNodeKind:
+    // The scale and the shift.
+    return 2 * uint64_t(sizeOf(cast<BatchNormalizationNode>(N)->getResult()));
+  case Kinded::Kind::SoftMaxNodeKind:
+    // The max, the exponent, the sum and the division.
+    return 4 * uint64_t(sizeOf(cast<SoftMaxNode>(N)->getResult()));
+  case Kinded::Kind::BatchedReduceAddNodeKind:
+    return sizeOf(cast<BatchedReduceAddNode>(N)->getBatch());
+  case Kinded::Kind::ReduceNodeKind:
+    return sizeOf(cast<ReduceNode>(N)->getInput());
+  case Kinded::Kind::TopKNodeKind:
+    return sizeOf(cast<TopKNode>(N)->getInput());
+  case Kinded::Kind::TensorStatsNodeKind:
+    return sizeOf(cast<TensorStatsNode>(N)->getInput());
+  case Kinded::Kind::SparseLengthsWeightedSumNodeKind: {
+    // A weighted row of the data for every index.
+    auto *SLWS = cast<SparseLengthsWeightedSumNode>(N);
+    auto dataDims = SLWS->getData().dims();
+    return 2 * uint64_t(sizeOf(SLWS->getIndices())) *
+           (sizeOf(SLWS->getData()) / dataDims[0]);
+  }
+
+#ifdef GLOW_WITH_CPU
+  case Kinded::Kind::CPUIm2ColNodeKind:
+    return 0;
+  case Kinded::Kind::CPUConvDKKC8NodeKind: {
+    auto *CN = cast<CPUConvDKKC8Node>(N);
+    return getConvolutionFlops(sizeOf(CN->getResult()), sizeOf(CN->getFilter()),
+                               sizeOf(CN->getBias()));
+  }
+  case Kinded::Kind::CPUResidualConvDKKC8NodeKind: {
+    auto *CN = cast<CPUResidualConvDKKC8Node>(N);
+    return getConvolutionFlops(sizeOf(CN->getResult()), sizeOf(CN->getFilter()),
+                               sizeOf(CN->getBias())) +
+           sizeOf(CN->getResult());
+  }
+  case Kinded::Kind::CPUQuantizedConvDKKC8NodeKind: {
+    auto *CN = cast<CPUQuantizedConvDKKC8Node>(N);
+    return getConvolutionFlops(sizeOf(CN->getResult()), sizeOf(CN->getFilter()),
+                               sizeOf(CN->getBias()));
+  }
+  case Kinded::Kind::CPUConvNCHWcNodeKind: {
+    auto *CN = cast<CPUConvNCHWcNode>(N);
+    return getConvolutionFlops(sizeOf(CN->getResult()), sizeOf(CN->getFilter()),
+                               sizeOf(CN->getBias()));
+  }
+  case Kinded::Kind::CPUMatMulPackedNodeKind: {
+    auto *MM = cast<CPUMatMulPackedNode>(N);
+    return getMatMulFlops(sizeOf(MM->getResult()), MM->getLHS().dims()[1]);
+  }
+  case Kinded::Kind::CPUFullyConnectedPackedNodeKind: {
+    auto *FC = cast<CPUFullyConnectedPackedNode>(N);
+    return getMatMulFlops(sizeOf(FC->getResult()), FC->getLHS().dims()[1]);
+  }
+  case Kinded::Kind::CPUWinogradMultiplyNodeKind: {
+    // A matrix multiplication for every one of the 16 points of the tiles.
+    auto *WM = cast<CPUWinogradMultiplyNode>(N);
+    return getMatMulFlops(sizeOf(WM->getResult()), WM->getInput().dims()[2]);
+  }
+  case Kinded::Kind::CPUSoftMaxTopKNodeKind:
+    return 4 * uint64_t(sizeOf(cast<CPUSoftMaxTopKNode>(N)->getInput()));
+#endif // GLOW_WITH_CPU
+
+  default: {
+    uint64_t flops = 0;
+    for (unsigned i = 0, e = N->getNumResults(); i < e; i++) {
+      flops += N->getType(i)->size();
+    }
+    return flops;
+  }
+  }
+}
+
+OpCost glow::getCost(const Node *N) {
+  // A reshape is a view of its input in the IR.
+  if (llvm::isa<Variable>(N) || llvm::isa<ReshapeNode>(N)) {
+    return OpCost();
+  }
+  uint64_t bytes = 0;
+  for (unsigned i = 0, e = N->getNumInputs(); i < e; i++) {
+    bytes += N->getNthInput(i).getType()->getSizeInBytes();
+  }
+  for (unsigned i = 0, e = N->getNumResults(); i < e; i++) {
+    bytes += N->getType(i)->getSizeInBytes();
+  }
+  return OpCost(getFlops(N), bytes);
+}
+
+OpCost glow::getCost(const Function *F) {
+  OpCost cost;
+  for (const auto *N : F->getNodes()) {
+    cost += getCost(N);
+  }
+  return cost;
+}
@@ -77,7 +77,7 @@ Function *glow::differentiate(Function *F, TrainingConfig &conf,
   // Generate the gradient nodes for each one of the nodes in the function.
 
   PostOrderVisitor pov;
-  for (auto &N : G->getNodes()) {
+  for (auto *N : G->getNodes()) {
     N->visit(nullptr, &pov);
   }
 
@@ -112,6 +112,21 @@ Function *glow::differentiate(Function *F, TrainingConfig &conf,
     CONVERT_TO_GRAD_NODE(SigmoidNode)
     CONVERT_TO_GRAD_NODE(TanhNode)
 
+    if (N->getKind() == Kind::LSTMUnitNodeKind) {
+      // The cell state of the last step of a sequence usually has no users,
+      // so no gradient flows into it.
+      auto *LU = cast<LSTMUnitNode>(N);
+      for (NodeValue out : {LU->getNewC(), LU->getNewH()}) {
+        if (!map.hasGradient(out)) {
+          auto *zero = new SplatNode("zero", out.getType(), 0);
+          toAppend.push_back(zero);
+          map.addGradient(out, zero);
+        }
+      }
+      toAppend.push_back(LU->getGrad(map));
+      continue;
+    }
+
     if (N->getKind() == Kind::SaveNodeKind) {
       // Swap the src and dest. Send the Zero value as gradient for both sides.
       auto *X = new SplatNode(N->getName(),
@@ -155,6 +170,43 @@ Function *glow::differentiate(Function *F, TrainingConfig &conf,
       continue;
     }
 
+    if (N->getKind() == Kind::MatMulNodeKind) {
+      // The recurrent steps of the RNNs multiply the hidden state by the
+      // weights with no bias.
+      // dLHS = dOut x RHS^T, dRHS = LHS^T x dOut. The gradients of the
+      // transposed operands are the transposed products, so all of the
+      // transposes are folded into the flags of the multiplications.
+      MatMulNode *MM = cast<MatMulNode>(N);
+      NodeValue outputG = map.getGradient(MM->getResult());
+      NodeValue LHS = MM->getLHS();
+      NodeValue RHS = MM->getRHS();
+      bool TL = MM->getTransposeLHS();
+      bool TR = MM->getTransposeRHS();
+
+      MatMulNode *LG;
+      if (TL) {
+        LG = new MatMulNode("matmul.lhs.grad", LHS.getType(), RHS, outputG, TR,
+                            true);
+      } else {
+        LG = new MatMulNode("matmul.lhs.grad", LHS.getType(), outputG, RHS,
+                            false, !TR);
+      }
+      MatMulNode *RG;
+      if (TR) {
+        RG = new MatMulNode("matmul.rhs.grad", RHS.getType(), outputG, LHS,
+                            true, TL);
+      } else {
+        RG = new MatMulNode("matmul.rhs.grad", RHS.getType(), LHS, outputG,
+                            !TL, false);
+      }
+
+      toAppend.push_back(LG);
+      toAppend.push_back(RG);
+      map.addGradient(LHS, LG);
+      map.addGradient(RHS, RG);
+      continue;
+    }
+
     if (N->getKind() == Kind::SliceNodeKind) {
       SliceNode *SN = cast<SliceNode>(N);
       auto *zero = new SplatNode("expand", SN->getInput()->getType(), 0);
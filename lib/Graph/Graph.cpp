@@ -15,6 +15,7 @@
  */
 
 #include "glow/Graph/Graph.h"
+#include "glow/Graph/Cost.h"
 #include "glow/Graph/Nodes.h"
 #include "glow/Support/Support.h"
 
@@ -24,7 +25,10 @@
 #include "llvm/Support/Casting.h"
 #include "llvm/Support/raw_ostream.h"
 
+#include <algorithm>
 #include <fstream>
+#include <limits>
+#include <unordered_map>
 #include <unordered_set>
 
 using namespace glow;
@@ -50,6 +54,13 @@ Function *Module::createFunction(llvm::StringRef name) {
   return F;
 }
 
+void Module::eraseFunction(Function *F) {
+  auto it = std::find(functions_.begin(), functions_.end(), F);
+  assert(it != functions_.end() && "The function is not in the module");
+  functions_.erase(it);
+  delete F;
+}
+
 Module::~Module() {
   for (auto *F : functions_) {
     delete F;
@@ -109,7 +120,13 @@ protected:
       dumpLabelForRow(names, os);
       os << "|";
     }
-    os << "{" << escapeDottyString(N->getDebugDesc()) << "}";
+    std::string desc = N->getDebugDesc();
+    OpCost cost = getCost(N);
+    if (cost.bytes) {
+      desc += "flops : " + std::to_string(cost.flops) + "\nbytes : " +
+              std::to_string(cost.bytes) + "\n";
+    }
+    os << "{" << escapeDottyString(desc) << "}";
     if (N->getNumResults()) {
       os << "|";
       std::vector<std::string> names(N->getNumResults());
@@ -264,10 +281,9 @@ void Module::dumpDAG(const char *dotFilename) {
 }
 
 Function::~Function() {
-  // Delete all of the nodes and the variables.
-  for (auto it = nodes_.begin(), e = nodes_.end(); it != e;) {
-    auto cur = it++;
-    eraseNode(*cur);
+  // Delete all of the nodes.
+  while (!nodes_.empty()) {
+    eraseNode(nodes_.begin());
   }
 }
 
@@ -324,6 +340,18 @@ Variable *Module::createVariable(ElemKind T, llvm::ArrayRef<size_t> dims,
   return createVariable(FT, name, visibility, train, val);
 }
 
+Variable *Module::createState(TypeRef T, llvm::StringRef name) {
+  auto *V = createVariable(T, name, VisibilityKind::Public,
+                           Variable::TrainKind::None);
+  V->setState(true);
+  return V;
+}
+
+Variable *Module::createState(ElemKind T, llvm::ArrayRef<size_t> dims,
+                              llvm::StringRef name) {
+  return createState(uniqueType(T, dims), name);
+}
+
 llvm::StringRef Module::uniqueName(llvm::StringRef name) {
   std::string legalName;
 
@@ -345,17 +373,19 @@ llvm::StringRef Module::uniqueName(llvm::StringRef name) {
     return it.first->first();
   }
 
-  for (unsigned i = 1; i < 10000; i++) {
+  // The suffixes below the next one are all used, since the names are never
+  // released.
+  unsigned &nextSuffix = nextSuffixes_[legalName];
+  for (unsigned i = std::max(nextSuffix, 1u);; i++) {
     auto suffix = std::to_string(i);
 
     auto it = uniqueNames_.insert(legalName + suffix);
     if (it.second) {
       // Found a unique name!
+      nextSuffix = i + 1;
       return it.first->first();
     }
   }
-
-  llvm_unreachable("Unable to find a unique a name.");
 }
 
 void Module::assignUniqueName(Node *N) { N->setName(uniqueName(N->getName())); }
@@ -488,6 +518,14 @@ FullyConnectedNode *Function::createFullyConnected(llvm::StringRef name,
   return addNode(new FullyConnectedNode(name, OT, input, W, B));
 }
 
+SparseFullyConnectedNode *Function::createSparseFullyConnected(
+    llvm::StringRef name, NodeValue input, NodeValue values, NodeValue indices,
+    NodeValue offsets, NodeValue bias, TypeRef outTy) {
+  auto OT = getParent()->uniqueType(*outTy);
+  return addNode(new SparseFullyConnectedNode(name, OT, input, values, indices,
+                                              offsets, bias));
+}
+
 ReluNode *Function::createRELU(llvm::StringRef name, NodeValue input) {
   return addNode(new ReluNode(name, input));
 }
@@ -500,6 +538,20 @@ TanhNode *Function::createTanh(llvm::StringRef name, NodeValue input) {
   return addNode(new TanhNode(name, input));
 }
 
+LSTMUnitNode *Function::createLSTMUnit(llvm::StringRef name, NodeValue input,
+                                       NodeValue C) {
+  return addNode(new LSTMUnitNode(name, input, C));
+}
+
+LSTMSequenceNode *Function::createLSTMSequence(llvm::StringRef name,
+                                               NodeValue gates, NodeValue Wh,
+                                               NodeValue numSteps) {
+  auto dims = gates.dims();
+  auto OT = getParent()->uniqueTypeWithNewShape(
+      gates.getType(), {dims[0], dims[1], Wh.dims()[0]});
+  return addNode(new LSTMSequenceNode(name, OT, gates, Wh, numSteps));
+}
+
 SoftMaxNode *Function::createSoftMax(llvm::StringRef name, NodeValue input,
                                      NodeValue selected) {
   return addNode(new SoftMaxNode(name, input, selected));
@@ -789,22 +841,25 @@ SplatNode *Function::createSplat(llvm::StringRef name, TypeRef ty,
 }
 
 MatMulNode *Function::createMatMul(llvm::StringRef name, TypeRef outTy,
-                                   NodeValue lhs, NodeValue rhs) {
-  return addNode(
-      new MatMulNode(name, getParent()->uniqueType(*outTy), lhs, rhs));
+                                   NodeValue lhs, NodeValue rhs,
+                                   bool transposeLHS, bool transposeRHS) {
+  return addNode(new MatMulNode(name, getParent()->uniqueType(*outTy), lhs,
+                                rhs, transposeLHS, transposeRHS));
 }
 
 MatMulNode *Function::createMatMul(llvm::StringRef name, NodeValue lhs,
-                                   NodeValue rhs) {
+                                   NodeValue rhs, bool transposeLHS,
+                                   bool transposeRHS) {
   auto LT = lhs.getType();
   auto RT = rhs.getType();
   auto LDims = LT->dims();
   auto RDims = RT->dims();
   assert(lhs.getType()->getElementType() == rhs.getType()->getElementType());
 
-  auto ty =
-      getParent()->uniqueTypeWithNewShape(lhs.getType(), {LDims[0], RDims[1]});
-  return createMatMul(name, ty, lhs, rhs);
+  auto ty = getParent()->uniqueTypeWithNewShape(
+      lhs.getType(),
+      {LDims[transposeLHS ? 1 : 0], RDims[transposeRHS ? 0 : 1]});
+  return createMatMul(name, ty, lhs, rhs, transposeLHS, transposeRHS);
 }
 
 BatchedReduceAddNode *Function::createBatchedReduceAdd(llvm::StringRef name,
@@ -823,6 +878,27 @@ BatchedReduceAddNode *Function::createBatchedReduceAdd(llvm::StringRef name,
   return createBatchedReduceAdd(name, OT, batch);
 }
 
+ReduceNode *Function::createReduce(llvm::StringRef name, NodeValue input,
+                                   llvm::ArrayRef<size_t> axes,
+                                   ReduceMode mode, bool keepDims) {
+  auto inDims = input.dims();
+  ShapeVector outDims;
+  for (size_t i = 0, e = inDims.size(); i < e; i++) {
+    if (std::find(axes.begin(), axes.end(), i) == axes.end()) {
+      outDims.push_back(inDims[i]);
+    } else if (keepDims) {
+      outDims.push_back(1);
+    }
+  }
+  // Reducing every dimension yields a single element.
+  if (outDims.empty()) {
+    outDims.push_back(1);
+  }
+  auto OT = getParent()->uniqueTypeWithNewShape(input.getType(), outDims);
+  return addNode(new ReduceNode(name, OT, input, axes,
+                                static_cast<unsigned>(mode)));
+}
+
 BatchedAddNode *Function::createBatchedAdd(llvm::StringRef name,
                                            NodeValue batch, NodeValue sample) {
   return addNode(new BatchedAddNode(name, batch.getType(), batch, sample));
@@ -867,16 +943,36 @@ Function::createQuantizationProfile(llvm::StringRef name, NodeValue input) {
                                   input->getName().str(), input.getResNo()));
 }
 
+TensorStatsNode *Function::createTensorStats(llvm::StringRef name,
+                                             NodeValue input) {
+  // The number of runs, of elements, of NaNs, of infinities and of zeros.
+  auto *counters = getParent()->createVariable(
+      ElemKind::IndexTy, {5}, "statsCounters", VisibilityKind::Private,
+      Variable::TrainKind::None);
+  // The min and the max of the finite elements, which start empty, with the
+  // min above the max.
+  auto *range = getParent()->createVariable(
+      ElemKind::FloatTy, {2}, "statsRange", VisibilityKind::Private,
+      Variable::TrainKind::None);
+  auto rangeH = range->getPayload().getHandle<float>();
+  rangeH.raw(0) = std::numeric_limits<float>::max();
+  rangeH.raw(1) = std::numeric_limits<float>::lowest();
+
+  return addNode(new TensorStatsNode(name, input, counters, range,
+                                     input->getName().str(), input.getResNo()));
+}
+
 TopKNode *Function::createTopK(llvm::StringRef name, NodeValue input,
-                               size_t k) {
+                               size_t k, ElemKind indexKind) {
   auto inDims = input.dims();
   assert(inDims.size() > 0);
   assert(k <= inDims.back());
   ShapeVector outDims(inDims.begin(), inDims.end());
   outDims.back() = k;
   auto OT = getParent()->uniqueTypeWithNewShape(input.getType(), outDims);
+  assert(Type::isIndexType(indexKind) && "Invalid index kind");
   return addNode(new TopKNode(
-      name, OT, getParent()->uniqueType(ElemKind::IndexTy, outDims), input, k));
+      name, OT, getParent()->uniqueType(indexKind, outDims), input, k));
 }
 
 GatherNode *Function::createGather(llvm::StringRef name, NodeValue data,
@@ -891,12 +987,56 @@ GatherNode *Function::createGather(llvm::StringRef name, NodeValue data,
       indices));
 }
 
+SparseLengthsWeightedSumNode *
+Function::createSparseLengthsSum(llvm::StringRef name, NodeValue data,
+                                 NodeValue indices, NodeValue lengths) {
+  auto *ones = createSplat(name.str() + ".weights",
+                           getParent()->uniqueType(ElemKind::FloatTy,
+                                                   {indices.dims()[0]}),
+                           1.0);
+  return createSparseLengthsWeightedSum(name, data, ones, indices, lengths);
+}
+
+SparseLengthsWeightedSumNode *
+Function::createSparseLengthsWeightedSum(llvm::StringRef name, NodeValue data,
+                                         NodeValue weights, NodeValue indices,
+                                         NodeValue lengths) {
+  auto dDims = data.dims();
+  assert(dDims.size() > 0);
+  ShapeVector outDims(dDims.begin(), dDims.end());
+  outDims[0] = lengths.dims()[0];
+  auto OT = getParent()->uniqueTypeWithNewShape(data.getType(), outDims);
+  return addNode(new SparseLengthsWeightedSumNode(name, OT, data, weights,
+                                                  indices, lengths));
+}
+
+RowwiseQuantizedSparseLengthsWeightedSumNode *
+Function::createRowwiseQuantizedSparseLengthsWeightedSum(
+    llvm::StringRef name, NodeValue data, NodeValue scales, NodeValue offsets,
+    NodeValue weights, NodeValue indices, NodeValue lengths) {
+  auto OT = getParent()->uniqueType(ElemKind::FloatTy,
+                                    {lengths.dims()[0], data.dims()[1]});
+  return addNode(new RowwiseQuantizedSparseLengthsWeightedSumNode(
+      name, OT, data, scales, offsets, weights, indices, lengths));
+}
+
+RowwiseQuantizedGatherNode *
+Function::createRowwiseQuantizedGather(llvm::StringRef name, NodeValue data,
+                                       NodeValue scales, NodeValue offsets,
+                                       NodeValue indices) {
+  auto iDims = indices.dims();
+  ShapeVector outDims(iDims.begin(), iDims.end());
+  outDims.push_back(data.dims()[1]);
+  auto OT = getParent()->uniqueType(ElemKind::FloatTy, outDims);
+  return addNode(
+      new RowwiseQuantizedGatherNode(name, OT, data, scales, offsets, indices));
+}
+
 QuantizeNode *Function::createQuantize(llvm::StringRef name, NodeValue input,
                                        TypeRef outTy) {
   assert(input.getElementType() == ElemKind::FloatTy &&
          "Input must be a floating type");
-  assert(outTy->getElementType() == ElemKind::Int8QTy &&
-         "Output must be a quantized type");
+  assert(outTy->isQuantizedType() && "Output must be a quantized type");
   assert(input->dims().equals(outTy->dims()) &&
          "Different dimensions for input and output");
 
@@ -906,7 +1046,7 @@ QuantizeNode *Function::createQuantize(llvm::StringRef name, NodeValue input,
 
 DequantizeNode *Function::createDequantize(llvm::StringRef name,
                                            NodeValue input) {
-  assert(input.getElementType() == ElemKind::Int8QTy &&
+  assert(input.getType()->isQuantizedType() &&
          "Input must be a quantized type");
   TypeRef outTy =
       getParent()->uniqueType(Type(ElemKind::FloatTy, input.dims()));
@@ -917,10 +1057,10 @@ DequantizeNode *Function::createDequantize(llvm::StringRef name,
 RescaleQuantizedNode *Function::createRescaleQuantized(llvm::StringRef name,
                                                        NodeValue input,
                                                        TypeRef outTy) {
-  assert(input.getElementType() == ElemKind::Int8QTy &&
+  // The int32 accumulators of the int16 nodes are rescaled to int16.
+  assert(input.getType()->isQuantizedType() &&
          "Input must be a quantized type");
-  assert(outTy->getElementType() == ElemKind::Int8QTy &&
-         "Output must be a quantized type");
+  assert(outTy->isQuantizedType() && "Output must be a quantized type");
   assert(input->dims().equals(outTy->dims()) &&
          "Different dimensions for input and output");
 
@@ -928,6 +1068,63 @@ RescaleQuantizedNode *Function::createRescaleQuantized(llvm::StringRef name,
       new RescaleQuantizedNode(name, getParent()->uniqueType(*outTy), input));
 }
 
+ChannelwiseQuantizedConvolutionNode *Function::createChannelwiseQuantizedConv(
+    llvm::StringRef name, NodeValue input, NodeValue filter, NodeValue bias,
+    NodeValue filterScales, NodeValue filterOffsets, TypeRef outTy,
+    size_t kernel, size_t stride, size_t pad, size_t group) {
+  auto OT = getParent()->uniqueType(*outTy);
+  return addNode(new ChannelwiseQuantizedConvolutionNode(
+      name, OT, input, filter, bias, filterScales, filterOffsets, kernel,
+      stride, pad, group));
+}
+
+ChannelwiseQuantizedFullyConnectedNode *
+Function::createChannelwiseQuantizedFullyConnected(
+    llvm::StringRef name, NodeValue input, NodeValue weights, NodeValue bias,
+    NodeValue weightScales, NodeValue weightOffsets, TypeRef outTy) {
+  auto OT = getParent()->uniqueType(*outTy);
+  return addNode(new ChannelwiseQuantizedFullyConnectedNode(
+      name, OT, input, weights, bias, weightScales, weightOffsets));
+}
+
+ConvertToNode *Function::createConvertTo(llvm::StringRef name, NodeValue input,
+                                         ElemKind elemTy) {
+  assert((input.getElementType() == ElemKind::FloatTy ||
+          input.getElementType() == ElemKind::Float16Ty) &&
+         "Input must be a floating type");
+  assert((elemTy == ElemKind::FloatTy || elemTy == ElemKind::Float16Ty) &&
+         "Output must be a floating type");
+  TypeRef outTy = getParent()->uniqueType(Type(elemTy, input.dims()));
+  return addNode(new ConvertToNode(name, outTy, input));
+}
+
+/// \returns the fully connected layer with the weights \p W and the bias \p B
+/// applied to the \p inputs of all of the time steps of a recurrent network.
+/// The inputs don't depend on the hidden state, so a single matrix
+/// multiplication computes all of the time steps. The rows
+/// [t * batchSize, (t + 1) * batchSize) of the result belong to the step t.
+static Node *createInputProjection(Function *F, llvm::StringRef name,
+                                   llvm::ArrayRef<Node *> inputs,
+                                   unsigned batchSize, Variable *W,
+                                   Variable *B) {
+  unsigned inputSize = W->dims()[0];
+  std::vector<Node *> slices;
+  for (auto *input : inputs) {
+    slices.push_back(F->createReshape(name, input, {batchSize, inputSize}));
+  }
+  auto *X = F->createConcat(name, slices, 0);
+  return F->createFullyConnected(name, X, W, B);
+}
+
+/// \returns the columns [begin, end) of the step \p t of the \p projection
+/// that was created by createInputProjection.
+static Node *sliceInputProjection(Function *F, llvm::StringRef name,
+                                  Node *projection, unsigned batchSize,
+                                  unsigned t, unsigned begin, unsigned end) {
+  return F->createSlice(name, projection, {t * batchSize, begin},
+                        {(t + 1) * batchSize, end});
+}
+
 void Function::createSimpleRNN(llvm::StringRef namePrefix,
                                llvm::ArrayRef<Node *> inputs,
                                unsigned batchSize, unsigned hiddenSize,
@@ -966,12 +1163,16 @@ void Function::createSimpleRNN(llvm::StringRef namePrefix,
       ElemKind::FloatTy, {outputSize}, nameBase + ".Bhy",
       VisibilityKind::Private, Variable::TrainKind::Broadcast, b);
 
+  auto *XH = createInputProjection(this, nameBase + ".fc2", inputs, batchSize,
+                                   Wxh, Bxh);
+
   // Un-roll backpropogation through time as a loop with the shared parameters.
   for (unsigned t = 0; t < timeSteps; t++) {
     auto fc1Name = nameBase + ".fc1." + std::to_string(t);
     auto *FC1 = createFullyConnected(fc1Name, Ht, Whh, Bhh);
     auto fc2Name = nameBase + ".fc2." + std::to_string(t);
-    auto *FC2 = createFullyConnected(fc2Name, inputs[t], Wxh, Bxh);
+    auto *FC2 =
+        sliceInputProjection(this, fc2Name, XH, batchSize, t, 0, hiddenSize);
     auto aName = nameBase + ".add." + std::to_string(t);
     auto *A = createAdd(aName, FC1, FC2);
     auto tanhName = nameBase + ".tanh." + std::to_string(t);
@@ -1008,52 +1209,32 @@ void Function::createGRU(llvm::StringRef namePrefix,
   //    R <- sigmoid(Wxr * x + Whr * h + br)
   // Hidden state:
   //    h <- Z . h + (1 - Z) tanh (Wxh * x + Whh * (R . h) + bh)
-
-  // update gate
-  float bUpdate = 0.1;
-  auto *Wxz = getParent()->createVariable(
-      ElemKind::FloatTy, {inputSize, hiddenSize}, nameBase + ".Wxz",
-      VisibilityKind::Private, Variable::TrainKind::Xavier, inputSize);
-  auto *Whz = getParent()->createVariable(
-      ElemKind::FloatTy, {hiddenSize, hiddenSize}, nameBase + ".Whz",
-      VisibilityKind::Private, Variable::TrainKind::Xavier, hiddenSize);
-  auto *Bz1 = getParent()->createVariable(
-      ElemKind::FloatTy, {hiddenSize}, nameBase + ".bz1",
-      VisibilityKind::Private, Variable::TrainKind::Broadcast, bUpdate);
-  auto *Bz2 = getParent()->createVariable(
-      ElemKind::FloatTy, {hiddenSize}, nameBase + ".bz2",
-      VisibilityKind::Private, Variable::TrainKind::Broadcast, bUpdate);
-  float bReset = -1.0;
-  // reset gate
-  auto *Wxr = getParent()->createVariable(
-      ElemKind::FloatTy, {inputSize, hiddenSize}, nameBase + ".Wxr",
+  //
+  // The weights of the gates are concatenated, in the order Z, R, h, so that
+  // the update and reset gates take a single matrix multiplication of the
+  // hidden state per step. The matrix multiplications of the inputs of all of
+  // the steps are also computed at once.
+
+  auto *Wx = getParent()->createVariable(
+      ElemKind::FloatTy, {inputSize, 3 * hiddenSize}, nameBase + ".Wx",
       VisibilityKind::Private, Variable::TrainKind::Xavier, inputSize);
-  auto *Whr = getParent()->createVariable(
-      ElemKind::FloatTy, {hiddenSize, hiddenSize}, nameBase + ".Whr",
+  auto *Bx = getParent()->createVariable(
+      ElemKind::FloatTy, {3 * hiddenSize}, nameBase + ".bx",
+      VisibilityKind::Private, Variable::TrainKind::Broadcast, 0.2);
+  // The reset gate is biased towards resetting the hidden state.
+  auto BxH = Bx->getPayload().getHandle();
+  for (size_t i = hiddenSize; i < 2 * hiddenSize; i++) {
+    BxH.raw(i) = -2.0;
+  }
+  auto *Whzr = getParent()->createVariable(
+      ElemKind::FloatTy, {hiddenSize, 2 * hiddenSize}, nameBase + ".Whzr",
       VisibilityKind::Private, Variable::TrainKind::Xavier, hiddenSize);
-  auto *Br1 = getParent()->createVariable(
-      ElemKind::FloatTy, {hiddenSize}, nameBase + ".br1",
-      VisibilityKind::Private, Variable::TrainKind::Broadcast, bReset);
-  auto *Br2 = getParent()->createVariable(
-      ElemKind::FloatTy, {hiddenSize}, nameBase + ".br2",
-      VisibilityKind::Private, Variable::TrainKind::Broadcast, bReset);
-
-  // hidden state
-  float b = 0.1;
-  auto *Wxh = getParent()->createVariable(
-      ElemKind::FloatTy, {inputSize, hiddenSize}, nameBase + ".Wxh",
-      VisibilityKind::Private, Variable::TrainKind::Xavier, inputSize);
   auto *Whh = getParent()->createVariable(
       ElemKind::FloatTy, {hiddenSize, hiddenSize}, nameBase + ".Whh",
       VisibilityKind::Private, Variable::TrainKind::Xavier, hiddenSize);
-  auto *Bh1 = getParent()->createVariable(
-      ElemKind::FloatTy, {hiddenSize}, nameBase + ".bh1",
-      VisibilityKind::Private, Variable::TrainKind::Broadcast, b);
-  auto *Bh2 = getParent()->createVariable(
-      ElemKind::FloatTy, {hiddenSize}, nameBase + ".bh2",
-      VisibilityKind::Private, Variable::TrainKind::Broadcast, b);
 
   // output layer
+  float b = 0.1;
   auto *Why = getParent()->createVariable(
       ElemKind::FloatTy, {hiddenSize, outputSize}, nameBase + ".Why",
       VisibilityKind::Private, Variable::TrainKind::Xavier, hiddenSize);
@@ -1061,60 +1242,38 @@ void Function::createGRU(llvm::StringRef namePrefix,
       ElemKind::FloatTy, {outputSize}, nameBase + ".by",
       VisibilityKind::Private, Variable::TrainKind::Broadcast, b);
 
-  auto *Ones = getParent()->createVariable(
-      ElemKind::FloatTy, {batchSize, hiddenSize}, nameBase + ".ones",
-      VisibilityKind::Private, Variable::TrainKind::None);
-
-  Ones->getPayload().getHandle().clear(1.0);
+  auto *XG = createInputProjection(this, nameBase + ".fcx", inputs, batchSize,
+                                   Wx, Bx);
 
-  std::vector<Node *> outputNodes;
   for (unsigned t = 0; t < timeSteps; t++) {
-    auto fc1Name = nameBase + ".fc1." + std::to_string(t);
-    auto fc2Name = nameBase + ".fc2." + std::to_string(t);
-    auto add1Name = nameBase + ".add1." + std::to_string(t);
-    auto sigmoid1Name = nameBase + ".sigmoid1." + std::to_string(t);
-
-    auto *Zt = createSigmoid(
-        sigmoid1Name,
-        createAdd(add1Name, createFullyConnected(fc1Name, Ht, Whz, Bz1),
-                  createFullyConnected(fc2Name, inputs[t], Wxz, Bz2)));
-
-    auto fc3Name = nameBase + ".fc3." + std::to_string(t);
-    auto fc4Name = nameBase + ".fc4." + std::to_string(t);
-    auto add2Name = nameBase + ".add2." + std::to_string(t);
-    auto sigmoid2Name = nameBase + ".sigmoid2." + std::to_string(t);
-
-    auto *Rt = createSigmoid(
-        sigmoid2Name,
-        createAdd(add2Name, createFullyConnected(fc3Name, Ht, Whr, Br1),
-                  createFullyConnected(fc4Name, inputs[t], Wxr, Br2)));
-
-    auto zhtName = nameBase + ".zh." + std::to_string(t);
-    auto *ZHt = createMul(zhtName, Zt, Ht);
-
-    auto oneMinusZtName = nameBase + ".1-z." + std::to_string(t);
-    auto *OneMinusZt = createSub(oneMinusZtName, Ones, Zt);
-
-    auto rhtName = nameBase + ".rh." + std::to_string(t);
-    auto *RHt = createMul(rhtName, Rt, Ht);
-
-    auto fc5Name = nameBase + ".fc5." + std::to_string(t);
-    auto fc6Name = nameBase + ".fc6." + std::to_string(t);
-    auto add3Name = nameBase + ".add3." + std::to_string(t);
-    auto tanh1Name = nameBase + ".tanh1." + std::to_string(t);
-
+    auto step = "." + std::to_string(t);
+    auto *XZRt = sliceInputProjection(this, nameBase + ".xzr" + step, XG,
+                                      batchSize, t, 0, 2 * hiddenSize);
+    auto *XHt = sliceInputProjection(this, nameBase + ".xh" + step, XG,
+                                     batchSize, t, 2 * hiddenSize,
+                                     3 * hiddenSize);
+
+    auto *ZRt = createSigmoid(
+        nameBase + ".sigmoid" + step,
+        createAdd(nameBase + ".add1" + step, XZRt,
+                  createMatMul(nameBase + ".hzr" + step, Ht, Whzr)));
+    auto *Zt = createSlice(nameBase + ".z" + step, ZRt, {0, 0},
+                           {batchSize, hiddenSize});
+    auto *Rt = createSlice(nameBase + ".r" + step, ZRt, {0, hiddenSize},
+                           {batchSize, 2 * hiddenSize});
+
+    auto *RHt = createMul(nameBase + ".rh" + step, Rt, Ht);
     auto *Ut = createTanh(
-        tanh1Name,
-        createAdd(add3Name, createFullyConnected(fc5Name, RHt, Whh, Bh1),
-                  createFullyConnected(fc6Name, inputs[t], Wxh, Bh2)));
+        nameBase + ".tanh1" + step,
+        createAdd(nameBase + ".add2" + step, XHt,
+                  createMatMul(nameBase + ".hh" + step, RHt, Whh)));
 
-    auto oneMinusZtUtName = nameBase + "1.-zu." + std::to_string(t);
-    auto *OneMinusZtUt = createMul(oneMinusZtUtName, OneMinusZt, Ut);
+    // Z . h + (1 - Z) . U = U + Z . (h - U)
+    auto *ZHUt = createMul(nameBase + ".zhu" + step, Zt,
+                           createSub(nameBase + ".hu" + step, Ht, Ut));
+    Ht = createAdd(nameBase + ".H" + step, Ut, ZHUt);
 
-    auto htName = nameBase + ".H." + std::to_string(t);
-    Ht = createAdd(htName, ZHt, OneMinusZtUt);
-
-    auto outName = nameBase + ".out." + std::to_string(t);
+    auto outName = nameBase + ".out" + step;
     auto *O = createFullyConnected(outName, Ht, Why, By);
     outputs.push_back(O);
   }
@@ -1135,13 +1294,13 @@ void Function::createLSTM(llvm::StringRef namePrefix,
       ElemKind::FloatTy, {batchSize, hiddenSize}, "initial_hidden_state",
       VisibilityKind::Public, Variable::TrainKind::None);
   HInit->getPayload().zero();
-  Node *Ht = HInit;
+  NodeValue Ht = HInit;
 
   auto *CInit = getParent()->createVariable(
       ElemKind::FloatTy, {batchSize, hiddenSize}, "initial_cell_state",
       VisibilityKind::Public, Variable::TrainKind::None);
   CInit->getPayload().zero();
-  Node *Ct = CInit;
+  NodeValue Ct = CInit;
 
   // Forget gate:
   //    F <- sigmoid(Wxf * x + Whf * h + bf)
@@ -1153,65 +1312,27 @@ void Function::createLSTM(llvm::StringRef namePrefix,
   //    C <- F . C + I . tanh(Wxc  * x + Whc * h + bc)
   // Hidden state:
   //    h <- O . tanh(C)
-
-  // forget gate
-  float bForget = 1.0;
-  auto *Wxf = getParent()->createVariable(
-      ElemKind::FloatTy, {inputSize, hiddenSize}, nameBase + ".Wxf",
-      VisibilityKind::Private, Variable::TrainKind::Xavier, inputSize);
-  auto *Whf = getParent()->createVariable(
-      ElemKind::FloatTy, {hiddenSize, hiddenSize}, nameBase + ".Whf",
-      VisibilityKind::Private, Variable::TrainKind::Xavier, hiddenSize);
-  auto *Bf1 = getParent()->createVariable(
-      ElemKind::FloatTy, {hiddenSize}, nameBase + ".bf1",
-      VisibilityKind::Private, Variable::TrainKind::Broadcast, bForget);
-  auto *Bf2 = getParent()->createVariable(
-      ElemKind::FloatTy, {hiddenSize}, nameBase + ".bf2",
-      VisibilityKind::Private, Variable::TrainKind::Broadcast, bForget);
-  // input gate
-  float bInput = 0.1;
-  auto *Wxi = getParent()->createVariable(
-      ElemKind::FloatTy, {inputSize, hiddenSize}, nameBase + ".Wxi",
+  //
+  // The weights of the gates are concatenated, in the order F, I, O, C, so
+  // that all of the gates take a single matrix multiplication of the hidden
+  // state per step, and the LSTMUnit node computes the rest of the step. The
+  // matrix multiplications of the inputs of all of the steps are also
+  // computed at once.
+
+  auto *Wx = getParent()->createVariable(
+      ElemKind::FloatTy, {inputSize, 4 * hiddenSize}, nameBase + ".Wx",
       VisibilityKind::Private, Variable::TrainKind::Xavier, inputSize);
-  auto *Whi = getParent()->createVariable(
-      ElemKind::FloatTy, {hiddenSize, hiddenSize}, nameBase + ".Whi",
+  auto *Wh = getParent()->createVariable(
+      ElemKind::FloatTy, {hiddenSize, 4 * hiddenSize}, nameBase + ".Wh",
       VisibilityKind::Private, Variable::TrainKind::Xavier, hiddenSize);
-  auto *Bi1 = getParent()->createVariable(
-      ElemKind::FloatTy, {hiddenSize}, nameBase + ".bi1",
-      VisibilityKind::Private, Variable::TrainKind::Broadcast, bInput);
-  auto *Bi2 = getParent()->createVariable(
-      ElemKind::FloatTy, {hiddenSize}, nameBase + ".bi2",
-      VisibilityKind::Private, Variable::TrainKind::Broadcast, bInput);
-
-  // output gate
-  float bOutput = 0.1;
-  auto *Wxo = getParent()->createVariable(
-      ElemKind::FloatTy, {inputSize, hiddenSize}, nameBase + ".Wxo",
-      VisibilityKind::Private, Variable::TrainKind::Xavier, inputSize);
-  auto *Who = getParent()->createVariable(
-      ElemKind::FloatTy, {hiddenSize, hiddenSize}, nameBase + ".Who",
-      VisibilityKind::Private, Variable::TrainKind::Xavier, hiddenSize);
-  auto *Bo1 = getParent()->createVariable(
-      ElemKind::FloatTy, {hiddenSize}, nameBase + ".bo1",
-      VisibilityKind::Private, Variable::TrainKind::Broadcast, bOutput);
-  auto *Bo2 = getParent()->createVariable(
-      ElemKind::FloatTy, {hiddenSize}, nameBase + ".bo2",
-      VisibilityKind::Private, Variable::TrainKind::Broadcast, bOutput);
-
-  // cell state
-  float bCell = 0.1;
-  auto *Wxc = getParent()->createVariable(
-      ElemKind::FloatTy, {inputSize, hiddenSize}, nameBase + ".Wxc",
-      VisibilityKind::Private, Variable::TrainKind::Xavier, inputSize);
-  auto *Whc = getParent()->createVariable(
-      ElemKind::FloatTy, {hiddenSize, hiddenSize}, nameBase + ".Whc",
-      VisibilityKind::Private, Variable::TrainKind::Xavier, hiddenSize);
-  auto *Bc1 = getParent()->createVariable(
-      ElemKind::FloatTy, {hiddenSize}, nameBase + ".bc1",
-      VisibilityKind::Private, Variable::TrainKind::Broadcast, bCell);
-  auto *Bc2 = getParent()->createVariable(
-      ElemKind::FloatTy, {hiddenSize}, nameBase + ".bc2",
-      VisibilityKind::Private, Variable::TrainKind::Broadcast, bCell);
+  auto *B = getParent()->createVariable(
+      ElemKind::FloatTy, {4 * hiddenSize}, nameBase + ".b",
+      VisibilityKind::Private, Variable::TrainKind::Broadcast, 0.2);
+  // The forget gate is biased towards keeping the cell state.
+  auto BH = B->getPayload().getHandle();
+  for (size_t i = 0; i < hiddenSize; i++) {
+    BH.raw(i) = 2.0;
+  }
 
   // output layer
   float b = 0.1;
@@ -1222,58 +1343,20 @@ void Function::createLSTM(llvm::StringRef namePrefix,
       ElemKind::FloatTy, {outputSize}, nameBase + ".by",
       VisibilityKind::Private, Variable::TrainKind::Broadcast, b);
 
-  std::vector<Node *> outputNodes;
-  for (unsigned t = 0; t < timeSteps; t++) {
-    auto fc1Name = nameBase + ".fc1." + std::to_string(t);
-    auto fc2Name = nameBase + ".fc2." + std::to_string(t);
-    auto add1Name = nameBase + ".add1." + std::to_string(t);
-    auto sigmoid1Name = nameBase + ".sigmoid1." + std::to_string(t);
-
-    auto *Ft = createSigmoid(
-        sigmoid1Name,
-        createAdd(add1Name, createFullyConnected(fc1Name, Ht, Whf, Bf1),
-                  createFullyConnected(fc2Name, inputs[t], Wxf, Bf2)));
-
-    auto fc3Name = nameBase + ".fc3." + std::to_string(t);
-    auto fc4Name = nameBase + ".fc4." + std::to_string(t);
-    auto add2Name = nameBase + ".add2." + std::to_string(t);
-    auto sigmoid2Name = nameBase + ".sigmoid2." + std::to_string(t);
-
-    auto *It = createSigmoid(
-        sigmoid2Name,
-        createAdd(add2Name, createFullyConnected(fc3Name, Ht, Whi, Bi1),
-                  createFullyConnected(fc4Name, inputs[t], Wxi, Bi2)));
-
-    auto fc5Name = nameBase + ".fc5." + std::to_string(t);
-    auto fc6Name = nameBase + ".fc6." + std::to_string(t);
-    auto add3Name = nameBase + ".add3." + std::to_string(t);
-    auto sigmoid3Name = nameBase + ".sigmoid3." + std::to_string(t);
-
-    auto *Ot = createSigmoid(
-        sigmoid3Name,
-        createAdd(add3Name, createFullyConnected(fc5Name, Ht, Who, Bo1),
-                  createFullyConnected(fc6Name, inputs[t], Wxo, Bo2)));
-
-    auto fc7Name = nameBase + ".fc7." + std::to_string(t);
-    auto fc8Name = nameBase + ".fc8." + std::to_string(t);
-    auto add4Name = nameBase + ".add4." + std::to_string(t);
-    auto tanh1Name = nameBase + ".tanh1." + std::to_string(t);
-
-    auto *CRt = createTanh(
-        tanh1Name,
-        createAdd(add4Name, createFullyConnected(fc7Name, Ht, Whc, Bc1),
-                  createFullyConnected(fc8Name, inputs[t], Wxc, Bc2)));
-
-    auto mul1Name = nameBase + ".mul1." + std::to_string(t);
-    auto mul2Name = nameBase + ".mul2." + std::to_string(t);
-    Ct = createAdd(nameBase + ".C." + std::to_string(t),
-                   createMul(mul1Name, Ft, Ct), createMul(mul2Name, It, CRt));
-
-    auto htName = nameBase + ".H." + std::to_string(t);
-    auto tanh2Name = nameBase + ".tanh2." + std::to_string(t);
-    Ht = createMul(htName, Ot, createTanh(tanh2Name, Ct));
+  auto *XG = createInputProjection(this, nameBase + ".fcx", inputs, batchSize,
+                                   Wx, B);
 
-    auto outName = nameBase + ".out." + std::to_string(t);
+  for (unsigned t = 0; t < timeSteps; t++) {
+    auto step = "." + std::to_string(t);
+    auto *XGt = sliceInputProjection(this, nameBase + ".xgates" + step, XG,
+                                     batchSize, t, 0, 4 * hiddenSize);
+    auto *Gt = createAdd(nameBase + ".gates" + step, XGt,
+                         createMatMul(nameBase + ".hgates" + step, Ht, Wh));
+    auto *LU = createLSTMUnit(nameBase + ".unit" + step, Gt, Ct);
+    Ct = LU->getNewC();
+    Ht = LU->getNewH();
+
+    auto outName = nameBase + ".out" + step;
     auto *O = createFullyConnected(outName, Ht, Why, By);
     outputs.push_back(O);
   }
@@ -1288,6 +1371,7 @@ void Function::dump() const {
   for (auto n : nodes_) {
     llvm::outs() << n->getDebugDesc() << "\n";
   }
+  llvm::outs() << "Cost: " << getCost(this) << "\n";
 }
 
 /// We can't use NodeWalker here, because it ignores result indices, which
@@ -1372,6 +1456,7 @@ void Module::eraseVariable(VariablesList::iterator I) {
 
 void Function::eraseNode(NodesList::iterator I) {
   Node *N = *I;
+  nodes_.erase(I);
   switch (N->getKind()) {
 #define DEF_NODE(CLASS, NAME)                                                  \
   case glow::Kinded::Kind::CLASS##Kind: {                                      \
@@ -1382,8 +1467,6 @@ void Function::eraseNode(NodesList::iterator I) {
   default:
     llvm_unreachable("Unhandled node");
   }
-
-  nodes_.erase(I);
 }
 
 Variable *Module::getVariableByName(llvm::StringRef name) {
@@ -1395,7 +1478,7 @@ Variable *Module::getVariableByName(llvm::StringRef name) {
 }
 
 void Module::eraseVariable(Variable *N) {
-  auto vars = getVars();
+  auto &vars = getVars();
   auto I = std::find(vars.begin(), vars.end(), N);
   eraseVariable(I);
 }
@@ -1404,9 +1487,7 @@ void Function::eraseNode(Node *N) {
   if (Variable *V = dyn_cast<Variable>(N)) {
     return getParent()->eraseVariable(V);
   }
-  auto I = std::find(nodes_.begin(), nodes_.end(), N);
-  assert(I != nodes_.end() && "Could not find node to delete!");
-  eraseNode(I);
+  eraseNode(nodes_.getIterator(N));
 }
 
 Function *Function::clone(llvm::StringRef newName,
@@ -1457,6 +1538,69 @@ Function *Function::clone(llvm::StringRef newName,
   return newF;
 }
 
+Function *Function::cloneForOutputs(llvm::StringRef newName,
+                                    llvm::ArrayRef<SaveNode *> outputs) {
+  llvm::DenseMap<Node *, Node *> map;
+  auto *newF = clone(newName, &map);
+  std::unordered_set<Node *> kept;
+  for (auto *SN : outputs) {
+    assert(map.count(SN) && "The output is not a save of the function");
+    kept.insert(map[SN]);
+  }
+
+  // Erase the other saves, and then the nodes that are left without users.
+  // The users of a node usually follow it in the list, so erasing the nodes
+  // in the reverse order removes the dead chains in one pass. The DCE of the
+  // optimizer removes the rest, as well as the unused variables.
+  auto &nodes = newF->getNodes();
+  for (auto it = nodes.begin(); it != nodes.end();) {
+    auto cur = it++;
+    if (isa<SaveNode>(*cur) && !kept.count(*cur)) {
+      newF->eraseNode(cur);
+    }
+  }
+  auto it = nodes.end();
+  while (it != nodes.begin()) {
+    auto cur = std::prev(it);
+    if (!(*cur)->hasUsers() && !(*cur)->hasSideEffects()) {
+      newF->eraseNode(cur);
+    } else {
+      it = cur;
+    }
+  }
+  return newF;
+}
+
+Function *Function::cloneInto(Module &M, llvm::StringRef newName) {
+  Function *newF = M.createFunction(newName);
+  std::unordered_map<Node *, Node *> copies;
+  for (auto *N : getNodes()) {
+    Node *copy = N->clone();
+    for (unsigned i = 0, e = copy->getNumResults(); i < e; i++) {
+      copy->setType(i, M.uniqueType(*N->getType(i)));
+    }
+    copies[N] = newF->addNode(copy);
+  }
+
+  for (auto *N : newF->getNodes()) {
+    for (unsigned i = 0, e = N->getNumInputs(); i < e; i++) {
+      NodeValue &in = N->getNthInput(i);
+      auto &copy = copies[in.getNode()];
+      if (!copy) {
+        auto *V = cast<Variable>(in.getNode());
+        auto *newV =
+            M.createVariable(V->getType(), V->getName(),
+                             V->getVisibilityKind(), V->getTrainKind(),
+                             V->getVal());
+        newV->getPayload().copyRawFrom(&V->getPayload());
+        copy = newV;
+      }
+      in.setOperand(copy, in.getResNo());
+    }
+  }
+  return newF;
+}
+
 void Function::verify() const {
   std::unordered_map<std::string, Node *> NameToNode;
 
@@ -89,6 +89,11 @@ TypeRef Node::getType(unsigned idx) const {
   return types_[idx];
 }
 
+void Node::setType(unsigned idx, TypeRef ty) {
+  assert(idx < numRes_ && "Result number does not exist.");
+  types_[idx] = ty;
+}
+
 ElemKind Node::getElementType(unsigned resNo) const {
   TypeRef TR = getType(resNo);
   return TR->getElementType();
@@ -215,10 +220,18 @@ void Variable::initPayload() {
       payload_.getHandle<float>().clear(val_);
       break;
     }
+    case ElemKind::Float16Ty: {
+      payload_.getHandle<float16>().clear(val_);
+      break;
+    }
     case ElemKind::Int8QTy: {
       payload_.getHandle<int8_t>().clear(val_);
       break;
     };
+    case ElemKind::Int16QTy: {
+      payload_.getHandle<int16_t>().clear(val_);
+      break;
+    };
     case ElemKind::Int32QTy: {
       payload_.getHandle<int32_t>().clear(val_);
       break;
@@ -227,6 +240,10 @@ void Variable::initPayload() {
       payload_.getHandle<size_t>().clear(val_);
       break;
     }
+    case ElemKind::Int32ITy: {
+      payload_.getHandle<int32_t>().clear(val_);
+      break;
+    }
     }
     break;
   }
@@ -237,10 +254,18 @@ void Variable::initPayload() {
       payload_.getHandle<float>().initXavier(val_);
       break;
     }
+    case ElemKind::Float16Ty: {
+      payload_.getHandle<float16>().initXavier(val_);
+      break;
+    }
     case ElemKind::Int8QTy: {
       payload_.getHandle<int8_t>().initXavier(val_);
       break;
     };
+    case ElemKind::Int16QTy: {
+      payload_.getHandle<int16_t>().initXavier(val_);
+      break;
+    };
     case ElemKind::Int32QTy: {
       payload_.getHandle<int32_t>().initXavier(val_);
       break;
@@ -249,12 +274,26 @@ void Variable::initPayload() {
       payload_.getHandle<size_t>().initXavier(val_);
       break;
     }
+    case ElemKind::Int32ITy: {
+      payload_.getHandle<int32_t>().initXavier(val_);
+      break;
+    }
     }
     break;
   }
   }
 }
 
+void Variable::sharePayload(WeightStore &store) {
+  if (isPayloadShared()) {
+    return;
+  }
+  sharedPayload_ = store.intern(std::move(payload_));
+  // The store either took over the payload or has an identical one, so the
+  // variable only keeps a view of the tensor of the store.
+  payload_ = sharedPayload_->getUnowned(sharedPayload_->dims());
+}
+
 /// Equality predicate for variables.
 bool Variable::isEqual(const Variable &other) const {
   /// A variable should be equal only to itself!
@@ -450,6 +489,9 @@ std::string Variable::getDebugDesc() const {
   db.addParam("name", quote(getName()))
       .addParam("output", *getType())
       .addParam("visibility", getVariableVisibilityKindStr(visibility_));
+  if (state_) {
+    db.addParam("state", true);
+  }
   if (train_ != Variable::TrainKind::None) {
     db.addParam("init", getVariableTrainKindStr(train_)).addParam("val", val_);
   }
@@ -500,13 +542,11 @@ static void checkType(NodeValue A, ElemKind expectedType) {
   assert(A.getElementType() == expectedType && "Invalid type");
 }
 
-static void verifyConvolution(NodeValue src, NodeValue dest, NodeValue filter,
-                              NodeValue bias, size_t kernel, size_t stride,
-                              size_t pad, size_t group) {
-  assert(src.getElementType() == dest.getElementType() && "Invalid Type");
-  assert(src.getElementType() == filter.getElementType() && "Invalid Type");
-  assert(src.getElementType() == bias.getElementType() && "Invalid Type");
-
+/// Verify the shapes of the operands of a convolution.
+static void verifyConvolutionDims(NodeValue src, NodeValue dest,
+                                  NodeValue filter, NodeValue bias,
+                                  size_t kernel, size_t stride, size_t pad,
+                                  size_t group) {
   ShapeNHWC idim(src.getType()->dims());
   ShapeNHWC odim(dest.getType()->dims());
 
@@ -528,6 +568,22 @@ static void verifyConvolution(NodeValue src, NodeValue dest, NodeValue filter,
   (void)biasDims;
 }
 
+static void verifyConvolution(NodeValue src, NodeValue dest, NodeValue filter,
+                              NodeValue bias, size_t kernel, size_t stride,
+                              size_t pad, size_t group) {
+  assert(src.getElementType() == dest.getElementType() && "Invalid Type");
+  if (src.getElementType() == ElemKind::Int16QTy) {
+    // The int16 activations are convolved with the int8 filter, and the int32
+    // bias is added to the accumulator.
+    checkType(filter, ElemKind::Int8QTy);
+    checkType(bias, ElemKind::Int32QTy);
+  } else {
+    assert(src.getElementType() == filter.getElementType() && "Invalid Type");
+    assert(src.getElementType() == bias.getElementType() && "Invalid Type");
+  }
+  verifyConvolutionDims(src, dest, filter, bias, kernel, stride, pad, group);
+}
+
 static void verifyFullyConnected(NodeValue src, NodeValue weights,
                                  NodeValue bias, NodeValue dest) {
   assert(src.dims()[0] == dest.dims()[0] &&
@@ -652,11 +708,23 @@ void MatMulNode::verify() const {
   assert(DDims.size() == 2);
   auto elem = dest.getType()->getElementType();
   (void)elem;
-  assert(lhs.getType()->getElementType() == elem);
-  assert(rhs.getType()->getElementType() == elem);
+  if (lhs.getElementType() == ElemKind::Int16QTy) {
+    // The int16 activations are multiplied by the int8 right hand side into
+    // the int32 accumulator.
+    checkType(rhs, ElemKind::Int8QTy);
+    checkType(dest, ElemKind::Int32QTy);
+  } else {
+    assert(lhs.getType()->getElementType() == elem);
+    assert(rhs.getType()->getElementType() == elem);
+  }
+  assert((elem == ElemKind::FloatTy || elem == ElemKind::Float16Ty ||
+          (!TransposeLHS_ && !TransposeRHS_)) &&
+         "Only the floating point operands can be transposed");
 
-  assert(LDims[0] == DDims[0] && "Invalid matrix dims");
-  assert(RDims[1] == DDims[1] && "Invalid matrix dims");
+  assert(LDims[TransposeLHS_ ? 1 : 0] == DDims[0] && "Invalid matrix dims");
+  assert(RDims[TransposeRHS_ ? 0 : 1] == DDims[1] && "Invalid matrix dims");
+  assert(LDims[TransposeLHS_ ? 0 : 1] == RDims[TransposeRHS_ ? 1 : 0] &&
+         "Invalid matrix dims");
 }
 
 void SigmoidNode::verify() const { verifySigmoid(getInput(), getResult()); }
@@ -672,6 +740,52 @@ void TanhGradNode::verify() const {
   verifyTanh(getGradOfInputNamedInput(), getGradOfOriginalOutputNamedResult());
 }
 
+/// Verify the shapes of the operands of an LSTM cell step: the [B, 4H] gates
+/// \p input, the [B, H] cell state \p C and the new states \p newC and
+/// \p newH.
+static void verifyLSTMUnit(NodeValue input, NodeValue C, NodeValue newC,
+                           NodeValue newH) {
+  checkSameType(C, newC);
+  checkSameType(C, newH);
+  auto idim = input.dims();
+  auto cdim = C.dims();
+  assert(cdim.size() == 2 && "The cell state must be a matrix");
+  assert(idim.size() == 2 && idim[0] == cdim[0] && idim[1] == 4 * cdim[1] &&
+         "Invalid gates shape");
+  (void)idim;
+  (void)cdim;
+}
+
+void LSTMUnitNode::verify() const {
+  verifyLSTMUnit(getInput(), getC(), getNewC(), getNewH());
+}
+
+void LSTMSequenceNode::verify() const {
+  auto gdim = getGates().dims();
+  auto wdim = getWh().dims();
+  auto rdim = getResult().dims();
+  assert(gdim.size() == 3 && "The gates must be a [T, B, 4H] tensor");
+  assert(wdim.size() == 2 && wdim[1] == 4 * wdim[0] && gdim[2] == wdim[1] &&
+         "Invalid hidden state projection shape");
+  assert(rdim.size() == 3 && rdim[0] == gdim[0] && rdim[1] == gdim[1] &&
+         rdim[2] == wdim[0] && "Invalid hidden states shape");
+  assert(getNumSteps().getElementType() == ElemKind::IndexTy &&
+         getNumSteps().getType()->size() == 1 &&
+         "The number of the steps must be an index<1> tensor");
+  assert(getWh().getElementType() == getGates().getElementType() &&
+         getResult().getElementType() == getGates().getElementType() &&
+         "Invalid element type");
+  (void)gdim;
+  (void)wdim;
+  (void)rdim;
+}
+
+void LSTMUnitGradNode::verify() const {
+  verifyLSTMUnit(getGradOfInputNamedInput(), getGradOfInputNamedC(),
+                 getGradOfOriginalOutputNamedNewC(),
+                 getGradOfOriginalOutputNamedNewH());
+}
+
 void SoftMaxNode::verify() const { verifySoftMax(getInput(), getResult()); }
 
 void SoftMaxGradNode::verify() const {
@@ -819,6 +933,37 @@ VERIFY_ARITHMETIC(SubGrad);
 VERIFY_ARITHMETIC(DivGrad);
 #undef VERIFY_ARITHMETIC
 
+#define VERIFY_SPLAT_OPERAND(NODE_NAME_)                                       \
+  void NODE_NAME_##Node::verify() const {                                      \
+    assert(getResult().getElementType() == getInput().getElementType() &&      \
+           "Invalid type");                                                    \
+    checkSameShape(getResult(), getInput());                                   \
+  }
+VERIFY_SPLAT_OPERAND(AddSplat);
+VERIFY_SPLAT_OPERAND(MulSplat);
+VERIFY_SPLAT_OPERAND(MaxSplat);
+VERIFY_SPLAT_OPERAND(MinSplat);
+VERIFY_SPLAT_OPERAND(SubSplatLHS);
+VERIFY_SPLAT_OPERAND(DivSplatLHS);
+VERIFY_SPLAT_OPERAND(DivSplatRHS);
+VERIFY_SPLAT_OPERAND(CmpLTESplatLHS);
+VERIFY_SPLAT_OPERAND(CmpLTESplatRHS);
+#undef VERIFY_SPLAT_OPERAND
+
+void SelectSplatLHSNode::verify() const {
+  assert(getResult().getElementType() == getInput().getElementType() &&
+         "Invalid type");
+  checkSameShape(getResult(), getCond());
+  checkSameShape(getResult(), getInput());
+}
+
+void SelectSplatRHSNode::verify() const {
+  assert(getResult().getElementType() == getInput().getElementType() &&
+         "Invalid type");
+  checkSameShape(getResult(), getCond());
+  checkSameShape(getResult(), getInput());
+}
+
 void BatchedAddNode::verify() const {
   auto batchShape = getBatch().dims();
   auto rhsShape = getSlice().dims();
@@ -837,6 +982,51 @@ void BatchedReduceAddNode::verify() const {
   assert(getBatch().dims().size() > 1 && "Invalid shape");
 }
 
+void ReduceNode::verify() const {
+  auto inDims = getInput().dims();
+  auto axes = getAxes();
+  assert(getResult().getElementType() == getInput().getElementType() &&
+         "Mismatched element types");
+  assert(getMode() <= static_cast<unsigned>(ReduceMode::Max) &&
+         "Invalid reduce mode");
+  assert(!axes.empty() && "No axes to reduce");
+  for (auto axis : axes) {
+    assert(axis < inDims.size() && "Invalid axis");
+    (void)axis;
+  }
+  // The result keeps the order of the kept dimensions, so the reduced ones
+  // are either removed or set to 1.
+  size_t keptSize = 1;
+  for (size_t i = 0, e = inDims.size(); i < e; i++) {
+    if (std::find(axes.begin(), axes.end(), i) == axes.end()) {
+      keptSize *= inDims[i];
+    }
+  }
+  assert(getResult().getType()->size() == keptSize && "Invalid result shape");
+  (void)keptSize;
+}
+
+void glow::collapseReduceDims(llvm::ArrayRef<size_t> dims,
+                              llvm::ArrayRef<size_t> axes,
+                              ShapeVector &collapsed, ShapeVector &reduced) {
+  for (size_t i = 0, e = dims.size(); i < e; i++) {
+    if (dims[i] == 1) {
+      continue;
+    }
+    size_t isReduced = std::find(axes.begin(), axes.end(), i) != axes.end();
+    if (!collapsed.empty() && reduced.back() == isReduced) {
+      collapsed.back() *= dims[i];
+      continue;
+    }
+    collapsed.push_back(dims[i]);
+    reduced.push_back(isReduced);
+  }
+  if (collapsed.empty()) {
+    collapsed.push_back(1);
+    reduced.push_back(0);
+  }
+}
+
 void SGDNode::verify() const {
   if (Momentum_ > 0.0) {
     assert(getGradient().getType() == getGsum().getType() &&
@@ -859,9 +1049,19 @@ void QuantizationProfileNode::verify() const {
          "Computation info should contain Min and Max value only");
 }
 
+void TensorStatsNode::verify() const {
+  checkType(getInput(), ElemKind::FloatTy);
+  checkType(getCounters(), ElemKind::IndexTy);
+  checkType(getRange(), ElemKind::FloatTy);
+  assert(getCounters().dims().size() == 1 && getCounters().dims()[0] == 5 &&
+         "The counters hold the runs, elements, NaNs, infinities and zeros");
+  assert(getRange().dims().size() == 1 && getRange().dims()[0] == 2 &&
+         "The range holds the min and the max");
+}
+
 void QuantizeNode::verify() const {
   // Dest must be quantized.
-  checkType(getResult(), ElemKind::Int8QTy);
+  assert(getResult().getType()->isQuantizedType() && "Invalid type");
   // Src must be float.
   checkType(getInput(), ElemKind::FloatTy);
   checkSameShape(getResult(), getInput());
@@ -871,20 +1071,66 @@ void DequantizeNode::verify() const {
   // Dest must be float.
   checkType(getResult(), ElemKind::FloatTy);
   // Src must be quantized.
-  checkType(getInput(), ElemKind::Int8QTy);
+  assert(getInput().getType()->isQuantizedType() && "Invalid type");
   checkSameShape(getResult(), getInput());
 }
 
 void RescaleQuantizedNode::verify() const {
   // Dest must be quantized.
-  checkType(getResult(), ElemKind::Int8QTy);
+  assert(getResult().getType()->isQuantizedType() && "Invalid type");
   // Src must be quantized.
+  assert(getInput().getType()->isQuantizedType() && "Invalid type");
+  checkSameShape(getResult(), getInput());
+}
+
+/// Verify the per-channel quantization parameters \p scales and \p offsets
+/// of \p numChannels channels.
+static void verifyChannelwiseParams(NodeValue scales, NodeValue offsets,
+                                    size_t numChannels) {
+  checkType(scales, ElemKind::FloatTy);
+  checkType(offsets, ElemKind::Int32QTy);
+  auto paramDims = {numChannels};
+  assert(scales.dims().equals(paramDims) && "Invalid scales dims");
+  assert(offsets.dims().equals(paramDims) && "Invalid offsets dims");
+  (void)paramDims;
+}
+
+void ChannelwiseQuantizedConvolutionNode::verify() const {
+  checkType(getResult(), ElemKind::Int8QTy);
   checkType(getInput(), ElemKind::Int8QTy);
+  checkType(getFilter(), ElemKind::Int8QTy);
+  checkType(getBias(), ElemKind::Int32QTy);
+  verifyConvolutionDims(getInput(), getResult(), getFilter(), getBias(),
+                        Kernel_, Stride_, Pad_, Group_);
+  verifyChannelwiseParams(getFilterScales(), getFilterOffsets(),
+                          getResult().dims()[3]);
+}
+
+void ChannelwiseQuantizedFullyConnectedNode::verify() const {
+  checkType(getResult(), ElemKind::Int8QTy);
+  checkType(getInput(), ElemKind::Int8QTy);
+  checkType(getWeights(), ElemKind::Int8QTy);
+  checkType(getBias(), ElemKind::Int32QTy);
+  assert(getInput().dims().size() == 2 && "The input must be 2D");
+  verifyFullyConnected(getInput(), getWeights(), getBias(), getResult());
+  verifyChannelwiseParams(getWeightScales(), getWeightOffsets(),
+                          getResult().dims()[1]);
+}
+
+void ConvertToNode::verify() const {
+  auto isFloatType = [](NodeValue V) {
+    return V.getElementType() == ElemKind::FloatTy ||
+           V.getElementType() == ElemKind::Float16Ty;
+  };
+  (void)isFloatType;
+  assert(isFloatType(getResult()) && "Dest must be a floating type");
+  assert(isFloatType(getInput()) && "Src must be a floating type");
   checkSameShape(getResult(), getInput());
 }
 
 void TopKNode::verify() const {
   assert(getValues().dims() == getIndices().dims());
+  assert(Type::isIndexType(getIndices().getElementType()));
   if (getInput()->getType()->isQuantizedType()) {
     // Quantization scales must be identical; no rescaling is allowed.
     assert(getValues()->getType(0)->getScale() ==
@@ -896,7 +1142,7 @@ void TopKNode::verify() const {
 
 void GatherNode::verify() const {
   assert(getResult().getElementType() == getData().getElementType());
-  assert(getIndices().getElementType() == ElemKind::IndexTy);
+  assert(Type::isIndexType(getIndices().getElementType()));
   assert(getResult().dims().size() ==
          getData().dims().size() + getIndices().dims().size() - 1);
   if (getResult()->getType()->isQuantizedType()) {
@@ -908,6 +1154,56 @@ void GatherNode::verify() const {
   }
 }
 
+/// Check the operands of a SparseLengthsWeightedSum of the slices of \p data
+/// into \p result.
+static void verifySparseLengthsWeightedSum(NodeValue result, NodeValue data,
+                                           NodeValue weights, NodeValue indices,
+                                           NodeValue lengths) {
+  checkType(indices, ElemKind::IndexTy);
+  checkType(lengths, ElemKind::IndexTy);
+  assert(indices.dims().size() == 1 && "Indices must be 1D");
+  assert(lengths.dims().size() == 1 && "Lengths must be 1D");
+  assert(weights.dims() == indices.dims() &&
+         "There must be one weight per index");
+  assert(result.dims().size() == data.dims().size() &&
+         result.dims()[0] == lengths.dims()[0] &&
+         result.dims().drop_front() == data.dims().drop_front() &&
+         "Invalid result dimensions");
+}
+
+void SparseLengthsWeightedSumNode::verify() const {
+  // The float16 tables are accumulated in float by the kernels.
+  assert((getData().getElementType() == ElemKind::FloatTy ||
+          getData().getElementType() == ElemKind::Float16Ty) &&
+         "The data must be a floating type");
+  checkType(getResult(), getData().getElementType());
+  checkType(getWeights(), getData().getElementType());
+  verifySparseLengthsWeightedSum(getResult(), getData(), getWeights(),
+                                 getIndices(), getLengths());
+}
+
+void RowwiseQuantizedSparseLengthsWeightedSumNode::verify() const {
+  checkType(getData(), ElemKind::Int8QTy);
+  checkType(getResult(), ElemKind::FloatTy);
+  checkType(getWeights(), ElemKind::FloatTy);
+  assert(getData().dims().size() == 2 && "The data must be 2D");
+  verifyChannelwiseParams(getScales(), getOffsets(), getData().dims()[0]);
+  verifySparseLengthsWeightedSum(getResult(), getData(), getWeights(),
+                                 getIndices(), getLengths());
+}
+
+void RowwiseQuantizedGatherNode::verify() const {
+  checkType(getData(), ElemKind::Int8QTy);
+  checkType(getResult(), ElemKind::FloatTy);
+  checkType(getIndices(), ElemKind::IndexTy);
+  assert(getData().dims().size() == 2 && "The data must be 2D");
+  verifyChannelwiseParams(getScales(), getOffsets(), getData().dims()[0]);
+  assert(getResult().dims().size() == getIndices().dims().size() + 1 &&
+         getResult().dims().drop_back() == getIndices().dims() &&
+         getResult().dims().back() == getData().dims()[1] &&
+         "Invalid result dimensions");
+}
+
 void SaveNode::verify() const { checkSameType(getInput(), getOutput()); }
 
 void PowNode::verify() const { checkSameType(getResult(), getBase()); }
@@ -947,6 +1243,27 @@ void FullyConnectedGradNode::verify() const {
                        getGradOfOriginalOutputNamedResult());
 }
 
+void SparseFullyConnectedNode::verify() const {
+  checkType(getResult(), ElemKind::FloatTy);
+  checkType(getInput(), ElemKind::FloatTy);
+  checkType(getValues(), ElemKind::FloatTy);
+  checkType(getBias(), ElemKind::FloatTy);
+  checkType(getIndices(), ElemKind::Int32QTy);
+  checkType(getOffsets(), ElemKind::Int32QTy);
+  assert(getInput().dims().size() == 2 && "The input must be 2D");
+  assert(getResult().dims().size() == 2 && "The result must be 2D");
+  assert(getResult().dims()[0] == getInput().dims()[0] &&
+         "Invalid batch size");
+  assert(getBias().dims().size() == 1 &&
+         getBias().dims()[0] == getResult().dims()[1] && "Invalid bias size");
+  assert(getValues().dims().size() == 1 &&
+         getIndices().dims() == getValues().dims() &&
+         "There must be one index per nonzero weight");
+  assert(getOffsets().dims().size() == 1 &&
+         getOffsets().dims()[0] == getResult().dims()[1] + 1 &&
+         "There must be one offset per column and the end offset");
+}
+
 void ConcatNode::verify() const {
   auto inputs = getInputs();
   auto dimension = getDim();
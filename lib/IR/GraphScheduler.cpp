@@ -14,20 +14,53 @@
  * limitations under the License.
  */
 #define DEBUG_TYPE "graph-scheduler"
+#include "glow/Graph/Cost.h"
 #include "glow/Graph/Graph.h"
 #include "glow/Graph/Nodes.h"
 #include "glow/Graph/Utils.h"
 #include "glow/IR/IR.h"
 
 #include "llvm/Support/Casting.h"
+#include "llvm/Support/CommandLine.h"
 #include "llvm/Support/Debug.h"
 #include "llvm/Support/raw_ostream.h"
 
+#include <algorithm>
+#include <cstdint>
+#include <memory>
 #include <unordered_map>
 #include <unordered_set>
+#include <utility>
+#include <vector>
 
 using namespace glow;
 
+static llvm::cl::opt<SchedulerKind> graphScheduler(
+    "graph-scheduler", llvm::cl::desc("The scheduler of the graph nodes:"),
+    llvm::cl::values(clEnumValN(SchedulerKind::ChildMemSize, "child-mem-size",
+                                "Schedule first the children that free the "
+                                "most memory"),
+                     clEnumValN(SchedulerKind::MinPeakMemory, "min-peak-memory",
+                                "Simulate the live results and minimize their "
+                                "peak size with a bounded lookahead"),
+                     clEnumValN(SchedulerKind::CriticalPath, "critical-path",
+                                "Start first the nodes on the longest path of "
+                                "the remaining computation, for running with "
+                                "-cpu-task-threads")),
+    llvm::cl::init(SchedulerKind::ChildMemSize));
+
+static llvm::cl::opt<unsigned> schedulerLookahead(
+    "graph-scheduler-lookahead",
+    llvm::cl::desc("The number of the steps that the min-peak-memory scheduler "
+                   "looks ahead"),
+    llvm::cl::init(2));
+
+static llvm::cl::opt<unsigned> schedulerMemorySlack(
+    "graph-scheduler-memory-slack",
+    llvm::cl::desc("The percentage by which the critical-path scheduler may "
+                   "exceed the peak memory of the min-peak-memory schedule"),
+    llvm::cl::init(25));
+
 //===----------------------------------------------------------------------===//
 //                               Graph scheduler
 //===----------------------------------------------------------------------===//
@@ -43,15 +76,16 @@ protected:
   /// Graph being processed.
   const Function &G_;
   /// Scheduled nodes.
-  NodesList &scheduled_;
+  NodesPtrList &scheduled_;
 
 public:
-  Scheduler(const Function &G, NodesList &scheduled)
+  Scheduler(const Function &G, NodesPtrList &scheduled)
       : G_(G), scheduled_(scheduled) {}
+  virtual ~Scheduler() = default;
   // Create a linear execution schedule for a graph.
   virtual void schedule() = 0;
 
-  NodesList &getSchedule() { return scheduled_; }
+  NodesPtrList &getSchedule() { return scheduled_; }
 };
 
 /// This is a scheduler based on the generalized the paper "Generalizations of
@@ -66,6 +100,8 @@ class ChildMemSizeBasedScheduler : public Scheduler {
   std::unordered_map<const Node *, size_t> resultMemSize_;
   /// Max number of bytes required during the computation of a given node.
   std::unordered_map<const Node *, size_t> maxMemSize_;
+  /// The nodes that read a given variable without overwriting it.
+  std::unordered_map<const Node *, llvm::SmallVector<Node *, 4>> readers_;
 
   /// \returns true if a node \p N is scheduled already.
   bool isScheduled(const Node *N) const {
@@ -116,6 +152,21 @@ class ChildMemSizeBasedScheduler : public Scheduler {
     }
   }
 
+  /// Computes the nodes that read each variable.
+  void computeVariableReaders() {
+    for (auto *N : G_.getNodes()) {
+      for (size_t idx = 0, e = N->getNumInputs(); idx < e; ++idx) {
+        Node *in = N->getNthInput(idx);
+        if (isa<Variable>(in) && !N->isOverwrittenNthInput(idx)) {
+          readers_[in].push_back(N);
+        }
+      }
+      if (N->hasPredicate() && isa<Variable>(N->getPredicate())) {
+        readers_[N->getPredicate()].push_back(N);
+      }
+    }
+  }
+
   /// Order children by (maxSize - resultSize). It gives more
   /// priority to the nodes that free more memory after
   /// their computation.
@@ -164,6 +215,17 @@ class ChildMemSizeBasedScheduler : public Scheduler {
       orderChildNodesAndSchedule(child);
     }
 
+    // The other readers of an overwritten variable expect its old value.
+    for (size_t idx = 0, e = N->getNumInputs(); idx < e; ++idx) {
+      if (N->isOverwrittenNthInput(idx)) {
+        for (auto *reader : readers_[N->getNthInput(idx).getNode()]) {
+          if (reader != N) {
+            orderChildNodesAndSchedule(reader);
+          }
+        }
+      }
+    }
+
     // Schedule the node after all its children are scheduled.
     DEBUG(llvm::outs() << "Scheduled node: " << N->getName() << "\n");
     scheduled_.push_back(N);
@@ -178,24 +240,333 @@ class ChildMemSizeBasedScheduler : public Scheduler {
   }
 
 public:
-  ChildMemSizeBasedScheduler(const Function &G, NodesList &Schedule)
+  ChildMemSizeBasedScheduler(const Function &G, NodesPtrList &Schedule)
       : Scheduler(G, Schedule) {}
 
   void schedule() override {
     computeNodeResultsMemorySize();
     computeNodeComputationMaxMemorySize();
+    computeVariableReaders();
     scheduleNodes();
   }
 };
 
-void IRFunction::scheduleGraph(NodesList &Schedule) {
+/// This scheduler simulates the set of the live results, from the computation
+/// of a node until its last user, and picks among the nodes whose inputs are
+/// computed the one that minimizes the peak size of the live set over the next
+/// few steps. Unlike the depth first order of ChildMemSizeBasedScheduler, it
+/// interleaves the branches of a wide fan-in, e.g. the inputs of a concat, so
+/// that each branch is reduced to its result before the next one starts.
+class MinPeakMemoryScheduler : public Scheduler {
+protected:
+  /// Required number of bytes to hold the results of a given node.
+  std::unordered_map<const Node *, size_t> resultMemSize_;
+  /// The inputs of each node that are computed by the graph, including the
+  /// predicate. An input that is used twice is listed twice.
+  std::unordered_map<const Node *, llvm::SmallVector<Node *, 4>> inputs_;
+  /// The users of each node, listed once for every use.
+  std::unordered_map<const Node *, llvm::SmallVector<Node *, 4>> users_;
+  /// The number of the uses of each node whose users are not scheduled. The
+  /// results of the node are live until it drops to zero.
+  std::unordered_map<const Node *, unsigned> remainingUses_;
+  /// The nodes that overwrite a variable that is read by a given node. They
+  /// have to be scheduled after the reader, but don't use its results.
+  std::unordered_map<const Node *, llvm::SmallVector<Node *, 4>> successors_;
+  /// The number of the inputs and of the overwritten variables of each node
+  /// that are not scheduled.
+  std::unordered_map<const Node *, unsigned> remainingInputs_;
+  /// The nodes whose inputs are all scheduled, in a deterministic order.
+  std::vector<Node *> ready_;
+  /// The size of the live results.
+  size_t liveMemSize_{0};
+  /// The peak size of the live results in the schedule.
+  size_t peakMemSize_{0};
+
+  /// The state needed to revert the scheduling of a node.
+  struct Step {
+    /// The scheduled node.
+    Node *N;
+    /// The position of the node in ready_.
+    size_t readyIdx;
+    /// The number of the nodes that became ready.
+    size_t numNewReady;
+    /// The size of the live results before the step.
+    size_t liveMemSize;
+    /// The size of the live results while the node is computed.
+    size_t peakMemSize;
+  };
+
+  /// Schedule the node at position \p readyIdx of ready_ in the simulation.
+  Step apply(size_t readyIdx) {
+    Node *N = ready_[readyIdx];
+    Step step{N, readyIdx, 0, liveMemSize_, liveMemSize_ + resultMemSize_[N]};
+    ready_.erase(ready_.begin() + readyIdx);
+    liveMemSize_ += resultMemSize_[N];
+    for (auto *in : inputs_[N]) {
+      if (--remainingUses_[in] == 0) {
+        liveMemSize_ -= resultMemSize_[in];
+      }
+    }
+    if (remainingUses_[N] == 0) {
+      liveMemSize_ -= resultMemSize_[N];
+    }
+    for (auto *user : users_[N]) {
+      if (--remainingInputs_[user] == 0) {
+        ready_.push_back(user);
+        step.numNewReady++;
+      }
+    }
+    for (auto *writer : successors_[N]) {
+      if (--remainingInputs_[writer] == 0) {
+        ready_.push_back(writer);
+        step.numNewReady++;
+      }
+    }
+    return step;
+  }
+
+  /// Revert the \p step of the simulation.
+  void undo(const Step &step) {
+    for (auto *user : users_[step.N]) {
+      ++remainingInputs_[user];
+    }
+    for (auto *writer : successors_[step.N]) {
+      ++remainingInputs_[writer];
+    }
+    ready_.resize(ready_.size() - step.numNewReady);
+    for (auto *in : inputs_[step.N]) {
+      ++remainingUses_[in];
+    }
+    liveMemSize_ = step.liveMemSize;
+    ready_.insert(ready_.begin() + step.readyIdx, step.N);
+  }
+
+  /// \returns the lowest peak memory reachable in the next \p depth steps,
+  /// given the peak \p peak of the schedule so far, and the size of the live
+  /// results after these steps, which breaks the ties.
+  std::pair<size_t, size_t> lookahead(unsigned depth, size_t peak) {
+    if (depth == 0 || ready_.empty()) {
+      return {peak, liveMemSize_};
+    }
+    std::pair<size_t, size_t> best{SIZE_MAX, SIZE_MAX};
+    for (size_t i = 0, e = ready_.size(); i < e; i++) {
+      Step step = apply(i);
+      best = std::min(
+          best, lookahead(depth - 1, std::max(peak, step.peakMemSize)));
+      undo(step);
+    }
+    return best;
+  }
+
+  void initialize() {
+    // The nodes that read every variable without overwriting it.
+    std::unordered_map<const Node *, llvm::SmallVector<Node *, 4>> readers;
+    for (auto *N : G_.getNodes()) {
+      resultMemSize_[N] = 0;
+      for (size_t idx = 0, e = N->getNumResults(); idx < e; ++idx) {
+        resultMemSize_[N] += N->getType(idx)->getSizeInBytes();
+      }
+      auto &inputs = inputs_[N];
+      for (size_t idx = 0, e = N->getNumInputs(); idx < e; ++idx) {
+        inputs.push_back(N->getNthInput(idx));
+        if (isa<Variable>(inputs.back()) && !N->isOverwrittenNthInput(idx)) {
+          readers[inputs.back()].push_back(N);
+        }
+      }
+      if (N->hasPredicate()) {
+        inputs.push_back(N->getPredicate());
+        if (isa<Variable>(inputs.back())) {
+          readers[inputs.back()].push_back(N);
+        }
+      }
+      // The variables are scheduled before the nodes.
+      inputs.erase(std::remove_if(inputs.begin(), inputs.end(),
+                                  [](Node *in) { return isa<Variable>(in); }),
+                   inputs.end());
+      remainingInputs_[N] = inputs.size();
+      for (auto *in : inputs) {
+        users_[in].push_back(N);
+        remainingUses_[in]++;
+      }
+    }
+    // A node that overwrites a variable goes after the other readers of the
+    // variable, which expect its old value.
+    for (auto *W : G_.getNodes()) {
+      for (size_t idx = 0, e = W->getNumInputs(); idx < e; ++idx) {
+        if (!W->isOverwrittenNthInput(idx)) {
+          continue;
+        }
+        for (auto *R : readers[W->getNthInput(idx).getNode()]) {
+          if (R != W) {
+            successors_[R].push_back(W);
+            remainingInputs_[W]++;
+          }
+        }
+      }
+    }
+    for (auto *N : G_.getNodes()) {
+      if (remainingInputs_[N] == 0) {
+        ready_.push_back(N);
+      }
+    }
+  }
+
+public:
+  MinPeakMemoryScheduler(const Function &G, NodesPtrList &Schedule)
+      : Scheduler(G, Schedule) {}
+
+  /// \returns the peak size of the live results in the schedule.
+  size_t getPeakMemSize() const { return peakMemSize_; }
+
+  void schedule() override {
+    initialize();
+    size_t &peak = peakMemSize_;
+    unsigned depth = std::max(1u, unsigned(schedulerLookahead));
+    while (!ready_.empty()) {
+      size_t bestIdx = 0;
+      std::pair<size_t, size_t> best{SIZE_MAX, SIZE_MAX};
+      for (size_t i = 0, e = ready_.size(); i < e; i++) {
+        Step step = apply(i);
+        auto cost = lookahead(depth - 1, std::max(peak, step.peakMemSize));
+        undo(step);
+        if (cost < best) {
+          best = cost;
+          bestIdx = i;
+        }
+      }
+      Step step = apply(bestIdx);
+      peak = std::max(peak, step.peakMemSize);
+      DEBUG(llvm::outs() << "Scheduled node: " << step.N->getName()
+                         << ", live memory: " << liveMemSize_ << "\n");
+      scheduled_.push_back(step.N);
+    }
+    DEBUG(llvm::outs() << "Peak memory of the live results: " << peak
+                       << "\n");
+  }
+};
+
+/// This scheduler is meant for running the independent instructions
+/// concurrently. Every node is given the length of the longest path from it to
+/// the end of the graph, measured by the estimated cost of the nodes, and the
+/// ready node with the longest path is scheduled first, so that the long chains
+/// start early and the short branches fill the idle threads. The live results
+/// are simulated as in MinPeakMemoryScheduler, and a node is only picked if the
+/// peak stays within a ceiling of -graph-scheduler-memory-slack percent above
+/// the peak of the min-peak-memory schedule over the next few steps.
+class CriticalPathScheduler : public MinPeakMemoryScheduler {
+  /// The estimated cost of the longest path from a node to the end of the
+  /// graph, including the node.
+  std::unordered_map<const Node *, uint64_t> pathCost_;
+
+  /// \returns the estimated time of computing \p N, in flops. The memory
+  /// bound nodes are charged for the bytes that they move, assuming that the
+  /// machine does about 8 flops in the time that it moves a byte.
+  static uint64_t getNodeCost(const Node *N) {
+    OpCost cost = getCost(N);
+    return std::max(cost.flops, cost.bytes * 8) + 1;
+  }
+
+  void computePathCosts() {
+    // A topological order of the nodes along the edges of the simulation,
+    // which include the ordering of the writers of the variables after their
+    // readers.
+    std::vector<Node *> order(ready_.begin(), ready_.end());
+    auto remaining = remainingInputs_;
+    for (size_t i = 0; i < order.size(); i++) {
+      for (auto *next : users_[order[i]]) {
+        if (--remaining[next] == 0) {
+          order.push_back(next);
+        }
+      }
+      for (auto *next : successors_[order[i]]) {
+        if (--remaining[next] == 0) {
+          order.push_back(next);
+        }
+      }
+    }
+    for (auto it = order.rbegin(), e = order.rend(); it != e; ++it) {
+      const Node *N = *it;
+      uint64_t longest = 0;
+      for (auto *user : users_[N]) {
+        longest = std::max(longest, pathCost_[user]);
+      }
+      for (auto *writer : successors_[N]) {
+        longest = std::max(longest, pathCost_[writer]);
+      }
+      pathCost_[N] = getNodeCost(N) + longest;
+    }
+  }
+
+  /// \returns the memory ceiling of the schedule.
+  size_t computeMemoryCeiling() const {
+    NodesPtrList reference;
+    MinPeakMemoryScheduler minPeak(G_, reference);
+    minPeak.schedule();
+    size_t peak = minPeak.getPeakMemSize();
+    return peak + peak * schedulerMemorySlack / 100;
+  }
+
+public:
+  CriticalPathScheduler(const Function &G, NodesPtrList &Schedule)
+      : MinPeakMemoryScheduler(G, Schedule) {}
+
+  void schedule() override {
+    size_t ceiling = computeMemoryCeiling();
+    initialize();
+    computePathCosts();
+    size_t &peak = peakMemSize_;
+    unsigned depth = std::max(1u, unsigned(schedulerLookahead));
+    while (!ready_.empty()) {
+      // The ready node with the longest path that fits in the ceiling, or the
+      // one with the lowest peak if none fits.
+      size_t bestIdx = 0;
+      bool bestFits = false;
+      std::pair<size_t, size_t> bestMem{SIZE_MAX, SIZE_MAX};
+      for (size_t i = 0, e = ready_.size(); i < e; i++) {
+        Step step = apply(i);
+        auto mem = lookahead(depth - 1, std::max(peak, step.peakMemSize));
+        undo(step);
+        bool fits = mem.first <= ceiling;
+        bool longer = pathCost_[ready_[i]] > pathCost_[ready_[bestIdx]];
+        if (fits ? !bestFits || longer : !bestFits && mem < bestMem) {
+          bestIdx = i;
+          bestFits = fits;
+          bestMem = mem;
+        }
+      }
+      Step step = apply(bestIdx);
+      peak = std::max(peak, step.peakMemSize);
+      DEBUG(llvm::outs() << "Scheduled node: " << step.N->getName()
+                         << ", path cost: " << pathCost_[step.N]
+                         << ", live memory: " << liveMemSize_ << "\n");
+      scheduled_.push_back(step.N);
+    }
+    DEBUG(llvm::outs() << "Peak memory of the live results: " << peak
+                       << ", ceiling: " << ceiling << "\n");
+  }
+};
+
+SchedulerKind getDefaultScheduler() { return graphScheduler; }
+
+void IRFunction::scheduleGraph(NodesPtrList &Schedule, SchedulerKind kind) {
   Schedule.clear();
   for (auto &N : G_->getParent()->getVars()) {
     Schedule.push_back(N);
   }
-  ChildMemSizeBasedScheduler CMSBScheduler(*G_, Schedule);
-  CMSBScheduler.schedule();
-  assert(CMSBScheduler.getSchedule().size() ==
+  std::unique_ptr<Scheduler> scheduler;
+  switch (kind) {
+  case SchedulerKind::ChildMemSize:
+    scheduler.reset(new ChildMemSizeBasedScheduler(*G_, Schedule));
+    break;
+  case SchedulerKind::MinPeakMemory:
+    scheduler.reset(new MinPeakMemoryScheduler(*G_, Schedule));
+    break;
+  case SchedulerKind::CriticalPath:
+    scheduler.reset(new CriticalPathScheduler(*G_, Schedule));
+    break;
+  }
+  scheduler->schedule();
+  assert(scheduler->getSchedule().size() ==
              G_->getNodes().size() + G_->getParent()->getVars().size() &&
          "All graph nodes have to be scheduled");
 }
@@ -16,6 +16,7 @@
 
 #include "glow/IR/IR.h"
 #include "glow/Graph/Graph.h"
+#include "glow/IR/IRCost.h"
 #include "glow/IR/IRUtils.h"
 #include "glow/IR/Instrs.h"
 #include "glow/Support/Support.h"
@@ -152,40 +153,25 @@ void IRFunction::destroyInstruction(Instruction *I) {
 
 InstrIterator IRFunction::eraseInstruction(InstrIterator it) {
   auto *I = *it;
-  assert(std::find(instrs_.begin(), instrs_.end(), I) != instrs_.end() &&
+  assert(I->getParent() == this &&
          "Cannot erase an instruction not belonging to a function");
-  destroyInstruction(I);
   auto result = instrs_.erase(it);
-  assert(std::find(instrs_.begin(), instrs_.end(), I) == instrs_.end() &&
-         "Instruction should be erased");
+  destroyInstruction(I);
   return result;
 }
 
 void IRFunction::eraseInstruction(glow::Instruction *I) {
-  // find the instruction inside the function.
-  auto it = std::find(instrs_.begin(), instrs_.end(), I);
-  assert(it != instrs_.end() &&
-         "Cannot erase an instruction not belonging to a function");
-  eraseInstruction(it);
+  eraseInstruction(getInstrIterator(I));
 }
 
 InstrIterator IRFunction::removeInstruction(InstrIterator it) {
-  auto *I = *it;
-  (void)I;
-  assert(std::find(instrs_.begin(), instrs_.end(), I) != instrs_.end() &&
+  assert((*it)->getParent() == this &&
          "Cannot remove an instruction not belonging to a function");
-  auto result = instrs_.erase(it);
-  assert(std::find(instrs_.begin(), instrs_.end(), I) == instrs_.end() &&
-         "Instruction should be removed");
-  return result;
+  return instrs_.erase(it);
 }
 
 void IRFunction::removeInstruction(glow::Instruction *I) {
-  // find the instruction inside the function.
-  auto it = std::find(instrs_.begin(), instrs_.end(), I);
-  assert(it != instrs_.end() &&
-         "Cannot remove an instruction not belonging to a function");
-  removeInstruction(it);
+  removeInstruction(getInstrIterator(I));
 }
 
 void IRFunction::insertInstruction(glow::Instruction *I) {
@@ -219,16 +205,14 @@ InstrIterator IRFunction::moveInstruction(const Instruction *where,
 }
 
 InstrIterator IRFunction::getInstrIterator(const Instruction *I) {
-  auto it = std::find(instrs_.begin(), instrs_.end(), I);
-  assert(it != instrs_.end() && "Instruction should be present");
-  return it;
+  assert(I->getParent() == this && "Instruction should be present");
+  return instrs_.getIterator(const_cast<Instruction *>(I));
 }
 
 IRFunction::InstListTy::const_iterator
 IRFunction::getInstrIterator(const Instruction *I) const {
-  auto it = std::find(instrs_.begin(), instrs_.end(), I);
-  assert(it != instrs_.end() && "Instruction should be present");
-  return it;
+  assert(I->getParent() == this && "Instruction should be present");
+  return instrs_.getIterator(const_cast<Instruction *>(I));
 }
 
 IRFunction::~IRFunction() { clear(); }
@@ -239,15 +223,16 @@ void IRFunction::clear() {
 
   // Delete all of the instructions, in reverse order, to make sure that
   // we delete the users before the instructions.
-  for (auto it = instrs_.rbegin(), e = instrs_.rend(); it != e; ++it) {
-    destroyInstruction(*it);
+  while (!instrs_.empty()) {
+    auto *I = instrs_.back();
+    instrs_.pop_back();
+    destroyInstruction(I);
   }
 
   // Delete all of the weights.
   for (auto &I : weights_) {
     delete I;
   }
-  instrs_.clear();
   weights_.clear();
 
   G_ = nullptr;
@@ -336,6 +321,51 @@ static void verifyLiveness(const IRFunction &M) {
   }
 }
 
+/// Verify that the loops are properly nested, that every LoopEnd closes the
+/// LoopStart with the same counter and trip counts, and that the activations
+/// are allocated and deallocated in the same loop.
+static void verifyLoops(const IRFunction &M) {
+  std::vector<const LoopStartInst *> loops;
+  std::unordered_map<const Value *, const LoopStartInst *> allocLoops;
+  for (auto *I : M.getInstrs()) {
+    const LoopStartInst *loop = loops.empty() ? nullptr : loops.back();
+    if (auto *LS = dyn_cast<LoopStartInst>(I)) {
+      loops.push_back(LS);
+      continue;
+    }
+    if (auto *LE = dyn_cast<LoopEndInst>(I)) {
+      assert(loop && "LoopEnd without a LoopStart");
+      assert(LE->getCounter() == loop->getCounter() &&
+             LE->getTripCount() == loop->getTripCount() &&
+             LE->getMaxTripCount() == loop->getMaxTripCount() &&
+             "LoopEnd does not match the innermost LoopStart");
+      (void)LE;
+      loops.pop_back();
+      continue;
+    }
+    if (auto *AI = dyn_cast<AllocActivationInst>(I)) {
+      allocLoops[AI] = loop;
+      continue;
+    }
+    if (auto *DI = dyn_cast<DeallocActivationInst>(I)) {
+      assert(allocLoops[DI->getSrc()] == loop &&
+             "The activation is deallocated in another loop");
+      (void)DI;
+      continue;
+    }
+  }
+  assert(loops.empty() && "LoopStart without a LoopEnd");
+}
+
+bool IRFunction::hasLoops() const {
+  for (auto *I : instrs_) {
+    if (isa<LoopStartInst>(I)) {
+      return true;
+    }
+  }
+  return false;
+}
+
 void IRFunction::verify() const {
   InstructionNumbering InstrNumbering(*this);
   assert(!instrs_.empty() && "Instruction list is empty!");
@@ -346,6 +376,7 @@ void IRFunction::verify() const {
   }
 
   verifyLiveness(*this);
+  verifyLoops(*this);
 
   for (auto p : variableMap_) {
     (void)p;
@@ -503,6 +534,17 @@ bool Instruction::isInplaceOp(const Instruction *I, unsigned dstIdx,
   llvm_unreachable("Invalid instruction kind.");
 }
 
+Instruction *Instruction::clone() const {
+#define DEF_INSTR(CLASS, NAME)                                                 \
+  if (const auto *X = dyn_cast<const CLASS>(this))                             \
+    return X->clone();
+#define DEF_BACKEND_SPECIFIC_INSTR(CLASS, NAME) DEF_INSTR(CLASS, NAME)
+#define DEF_VALUE(CLASS, NAME)
+#include "AutoGenInstr.def"
+
+  llvm_unreachable("Invalid instruction kind.");
+}
+
 void Instruction::dumpOperands(llvm::raw_ostream &os) const {
   // Dump the predicate of the instruction:
   if (hasPredicate()) {
@@ -551,7 +593,7 @@ void IRFunction::nameInstructions() {
   for (auto &v : weights_) {
     nameInstr(usedNames, v, v->getKindName());
   }
-  for (auto &v : instrs_) {
+  for (auto *v : instrs_) {
     nameInstr(usedNames, v, v->getKindName());
   }
 }
@@ -586,6 +628,7 @@ void IRFunction::dump(llvm::raw_ostream &OS) {
   sb << "code {\n";
 
   // Print all of the instructions:
+  OpCost totalCost;
   for (auto it : instrs_) {
     Instruction *II = it;
     sb << "  ";
@@ -604,9 +647,15 @@ void IRFunction::dump(llvm::raw_ostream &OS) {
     }
     if (hasResultValue(II))
       dumpUsers(II, sb, InstrNumbering);
+    OpCost cost = getCost(II);
+    if (cost.bytes) {
+      sb << " // cost: " << cost;
+    }
+    totalCost += cost;
     sb << "\n";
   }
 
+  sb << "\n  ; cost = " << totalCost << "\n";
   sb << "}\n";
 
   OS << sb.str();
@@ -633,6 +682,10 @@ static std::string getDottyDesc(const Instruction *II) {
   llvm::raw_string_ostream stream(buffer);
   stream << II->getKindName();
   stream << "|" << getEscapedDottyType(II->getType()) << "|";
+  OpCost cost = getCost(II);
+  if (cost.bytes) {
+    stream << cost << "|";
+  }
 
   // Print operands:
   for (int i = 0, e = II->getNumOperands(); i < e; i++) {
@@ -686,7 +739,7 @@ void IRFunction::dumpDAG(const char *dotFilename) {
   stream << "subgraph cluster_1 {";
   stream << "  style=invis;\n";
 
-  for (auto &I : instrs_) {
+  for (auto *I : instrs_) {
     std::string desc = getDottyDesc(I);
 
     stream << '"' << I << "\"[\n";
@@ -714,7 +767,7 @@ void IRFunction::dumpDAG(const char *dotFilename) {
   stream << "  style=invis;\n";
 
   // Dump the use-def edges.
-  for (auto &I : instrs_) {
+  for (auto *I : instrs_) {
     for (int i = 0, e = I->getNumOperands(); i < e; i++) {
       auto op = I->getOperand(i);
       stream << '"' << I << "\":f" << i << "->\"" << op.first
@@ -727,7 +780,7 @@ void IRFunction::dumpDAG(const char *dotFilename) {
 
   // Dump the order edges.
   Instruction *prev = nullptr;
-  for (auto &I : instrs_) {
+  for (auto *I : instrs_) {
     if (prev) {
       stream << '"' << prev << "\"->\"" << I << "\"[color=\"blue\"];\n";
     }
@@ -106,7 +106,7 @@ TensorViewInst *IRBuilder::createTensorView(ElemKind elemKind,
                                             Value *src, llvm::StringRef name) {
   auto ty =
       getIRFunction().getGraph()->getParent()->uniqueType(Type(elemKind, dims));
-  return createTensorViewInst(name, src, ty);
+  return createTensorViewInst(name, src, ty, {});
 }
 
 LocalResponseNormalizationInst *IRBuilder::createLocalResponseNormalizationOp(
@@ -120,7 +120,8 @@ LocalResponseNormalizationInst *IRBuilder::createLocalResponseNormalizationOp(
                                               halfWindowSize, alpha, beta, k);
 }
 
-TopKInst *IRBuilder::createTopKOp(Value *input, size_t k) {
+TopKInst *IRBuilder::createTopKOp(Value *input, size_t k,
+                                  ElemKind indexKind) {
   auto inDims = input->dims();
   assert(inDims.size() > 0);
   assert(k <= inDims.back());
@@ -128,14 +129,10 @@ TopKInst *IRBuilder::createTopKOp(Value *input, size_t k) {
   outDims.back() = k;
   auto outTy = F_->getGraph()->getParent()->uniqueTypeWithNewShape(
       input->getType(), outDims);
-  // Allocate enough scratch space to hold N values and N indices.
-  auto *scratch = createAllocActivationInst("topk.scratch", ElemKind::IndexTy,
-                                            {inDims.back() * 2});
-  createSplatInst("topk.zero.scratch", scratch, 0);
   auto *values = createAllocActivationInst("topk.values", outTy);
   auto *indices =
-      createAllocActivationInst("topk.indices", ElemKind::IndexTy, outDims);
-  return createTopKInst("topk", values, indices, input, scratch, k);
+      createAllocActivationInst("topk.indices", indexKind, outDims);
+  return createTopKInst("topk", values, indices, input, k);
 }
 
 Value *IRBuilder::createReturnOp(Value *input) {
@@ -0,0 +1,174 @@
+/**
+ * Copyright (c) 2017-present, Facebook, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "glow/IR/IRCost.h"
+#include "glow/IR/IR.h"
+#include "glow/IR/Instrs.h"
+
+using namespace glow;
+using llvm::cast;
+
+/// \returns the number of elements of \p V.
+static size_t sizeOf(const Value *V) { return V->getType()->size(); }
+
+/// \returns the number of operations of \p I. The instructions that are not
+/// listed perform one operation for every element that they write, like the
+/// element-wise instructions do. The costs match those of the nodes that the
+/// instructions are generated from, see getCost(const Node *).
+static uint64_t getFlops(const Instruction *I) {
+  switch (I->getKind()) {
+  case Kinded::Kind::AllocActivationInstKind:
+  case Kinded::Kind::DeallocActivationInstKind:
+  case Kinded::Kind::TensorViewInstKind:
+  case Kinded::Kind::CopyInstKind:
+  case Kinded::Kind::TransposeInstKind:
+  case Kinded::Kind::BroadcastInstKind:
+  case Kinded::Kind::SplatInstKind:
+  case Kinded::Kind::InsertTensorInstKind:
+  case Kinded::Kind::ExtractTensorInstKind:
+  case Kinded::Kind::GatherInstKind:
+  case Kinded::Kind::RowwiseQuantizedGatherInstKind:
+  case Kinded::Kind::DebugPrintInstKind:
+  case Kinded::Kind::LoopStartInstKind:
+  case Kinded::Kind::LoopEndInstKind:
+    return 0;
+
+  case Kinded::Kind::ConvolutionInstKind: {
+    auto *CI = cast<ConvolutionInst>(I);
+    return getConvolutionFlops(sizeOf(CI->getDest()), sizeOf(CI->getFilter()),
+                               sizeOf(CI->getBias()));
+  }
+  case Kinded::Kind::ChannelwiseQuantizedConvolutionInstKind: {
+    auto *CI = cast<ChannelwiseQuantizedConvolutionInst>(I);
+    return getConvolutionFlops(sizeOf(CI->getDest()), sizeOf(CI->getFilter()),
+                               sizeOf(CI->getBias()));
+  }
+  case Kinded::Kind::ChannelwiseQuantizedFullyConnectedInstKind: {
+    auto *FC = cast<ChannelwiseQuantizedFullyConnectedInst>(I);
+    return getMatMulFlops(sizeOf(FC->getDest()), FC->getWeights()->dims()[0]);
+  }
+  case Kinded::Kind::MatMulInstKind: {
+    auto *MM = cast<MatMulInst>(I);
+    auto lhsDims = MM->getLHS()->dims();
+    return getMatMulFlops(sizeOf(MM->getDest()),
+                          lhsDims[MM->getTransposeLHS() ? 0 : 1]);
+  }
+  case Kinded::Kind::PoolMaxInstKind: {
+    auto *PM = cast<PoolMaxInst>(I);
+    return uint64_t(sizeOf(PM->getDest())) * PM->getKernel() * PM->getKernel();
+  }
+  case Kinded::Kind::PoolMaxWithXYInstKind: {
+    auto *PM = cast<PoolMaxWithXYInst>(I);
+    return uint64_t(sizeOf(PM->getDest())) * PM->getKernel() * PM->getKernel();
+  }
+  case Kinded::Kind::PoolAvgInstKind: {
+    auto *PA = cast<PoolAvgInst>(I);
+    return uint64_t(sizeOf(PA->getDest())) * PA->getKernel() * PA->getKernel();
+  }
+  case Kinded::Kind::LocalResponseNormalizationInstKind: {
+    auto *LRN = cast<LocalResponseNormalizationInst>(I);
+    return uint64_t(sizeOf(LRN->getDest())) *
+           (2 * (2 * LRN->getHalfWindowSize() + 1) + 4);
+  }
+  case Kinded::Kind::SoftMaxInstKind:
+    return 4 * uint64_t(sizeOf(cast<SoftMaxInst>(I)->getDest()));
+  case Kinded::Kind::BatchedReduceAddInstKind:
+    return sizeOf(cast<BatchedReduceAddInst>(I)->getBatch());
+  case Kinded::Kind::ReduceInstKind:
+    return sizeOf(cast<ReduceInst>(I)->getSrc());
+  case Kinded::Kind::TopKInstKind:
+    return sizeOf(cast<TopKInst>(I)->getInput());
+  case Kinded::Kind::TensorStatsInstKind:
+    return sizeOf(cast<TensorStatsInst>(I)->getSrc());
+  case Kinded::Kind::SparseLengthsWeightedSumInstKind: {
+    auto *SLWS = cast<SparseLengthsWeightedSumInst>(I);
+    auto dataDims = SLWS->getData()->dims();
+    return 2 * uint64_t(sizeOf(SLWS->getIndices())) *
+           (sizeOf(SLWS->getData()) / dataDims[0]);
+  }
+
+#ifdef GLOW_WITH_CPU
+  case Kinded::Kind::CPUIm2ColInstKind:
+    return 0;
+  case Kinded::Kind::CPUConvDKKC8InstKind: {
+    auto *CI = cast<CPUConvDKKC8Inst>(I);
+    return getConvolutionFlops(sizeOf(CI->getDest()), sizeOf(CI->getFilter()),
+                               sizeOf(CI->getBias()));
+  }
+  case Kinded::Kind::CPUResidualConvDKKC8InstKind: {
+    auto *CI = cast<CPUResidualConvDKKC8Inst>(I);
+    return getConvolutionFlops(sizeOf(CI->getDest()), sizeOf(CI->getFilter()),
+                               sizeOf(CI->getBias())) +
+           sizeOf(CI->getDest());
+  }
+  case Kinded::Kind::CPUQuantizedConvDKKC8InstKind: {
+    auto *CI = cast<CPUQuantizedConvDKKC8Inst>(I);
+    return getConvolutionFlops(sizeOf(CI->getDest()), sizeOf(CI->getFilter()),
+                               sizeOf(CI->getBias()));
+  }
+  case Kinded::Kind::CPUConvNCHWcInstKind: {
+    auto *CI = cast<CPUConvNCHWcInst>(I);
+    return getConvolutionFlops(sizeOf(CI->getDest()), sizeOf(CI->getFilter()),
+                               sizeOf(CI->getBias()));
+  }
+  case Kinded::Kind::CPUMatMulPackedInstKind: {
+    auto *MM = cast<CPUMatMulPackedInst>(I);
+    return getMatMulFlops(sizeOf(MM->getDest()), MM->getLHS()->dims()[1]);
+  }
+  case Kinded::Kind::CPUFullyConnectedPackedInstKind: {
+    auto *FC = cast<CPUFullyConnectedPackedInst>(I);
+    return getMatMulFlops(sizeOf(FC->getDest()), FC->getLHS()->dims()[1]);
+  }
+  case Kinded::Kind::CPUWinogradMultiplyInstKind: {
+    auto *WM = cast<CPUWinogradMultiplyInst>(I);
+    return getMatMulFlops(sizeOf(WM->getDest()), WM->getSrc()->dims()[2]);
+  }
+  case Kinded::Kind::CPUSoftMaxTopKInstKind:
+    return 4 * uint64_t(sizeOf(cast<CPUSoftMaxTopKInst>(I)->getInput()));
+#endif // GLOW_WITH_CPU
+
+  default: {
+    uint64_t flops = 0;
+    for (const auto &op : I->getOperands()) {
+      if (op.second != OperandKind::In) {
+        flops += sizeOf(op.first);
+      }
+    }
+    return flops;
+  }
+  }
+}
+
+OpCost glow::getCost(const Instruction *I) {
+  if (llvm::isa<AllocActivationInst>(I) ||
+      llvm::isa<DeallocActivationInst>(I) || llvm::isa<TensorViewInst>(I)) {
+    return OpCost();
+  }
+  uint64_t bytes = 0;
+  for (const auto &op : I->getOperands()) {
+    uint64_t size = op.first->getSizeInBytes();
+    bytes += op.second == OperandKind::InOut ? 2 * size : size;
+  }
+  return OpCost(getFlops(I), bytes);
+}
+
+OpCost glow::getCost(const IRFunction *F) {
+  OpCost cost;
+  for (const auto *I : F->getInstrs()) {
+    cost += getCost(I);
+  }
+  return cost;
+}
@@ -104,9 +104,9 @@ public:
     case glow::Kinded::Kind::ReshapeNodeKind: {
       auto *RN = cast<ReshapeNode>(N);
 
-      auto *TVI = builder_.createTensorViewInst("tensorview.reshape",
-                                                valueForNode(RN->getInput()),
-                                                RN->getResult()->getType());
+      auto *TVI = builder_.createTensorViewInst(
+          "tensorview.reshape", valueForNode(RN->getInput()),
+          RN->getResult()->getType(), {});
       auto *dest = builder_.createAllocActivationInst(
           "copy.reshape.res", RN->getResult()->getType());
       builder_.createCopyInst("copy.reshape", dest, TVI);
@@ -337,16 +337,150 @@ public:
                                              histogram, computationInfo);
       break;
     }
+    case glow::Kinded::Kind::TensorStatsNodeKind: {
+      auto *TSN = cast<TensorStatsNode>(N);
+      builder_.createTensorStatsInst(TSN->getName(),
+                                     valueForNode(TSN->getInput()),
+                                     valueForNode(TSN->getCountersVar()),
+                                     valueForNode(TSN->getRangeVar()));
+      break;
+    }
     case glow::Kinded::Kind::TopKNodeKind: {
       auto *TKN = cast<TopKNode>(N);
       auto *inputTensor = valueForNode(TKN->getInput());
       auto k = TKN->getK();
-      auto *V = builder_.createTopKOp(inputTensor, k);
+      auto *V = builder_.createTopKOp(inputTensor, k,
+                                      TKN->getIndices().getElementType());
       registerIR(TKN->getValues(), V->getValues());
       registerIR(TKN->getIndices(), V->getIndices());
       V->setName(N->getName());
       break;
     }
+    case glow::Kinded::Kind::SGDNodeKind: {
+      auto *SGD = cast<SGDNode>(N);
+      auto *weight = valueForNode(SGD->getWeight());
+      auto *gsum = valueForNode(SGD->getGsum());
+      auto *gradient = valueForNode(SGD->getGradient());
+      builder_.createSGDInst(N->getName(), weight, gsum, gradient,
+                             SGD->getL1Decay(), SGD->getL2Decay(),
+                             SGD->getLearningRate(), SGD->getMomentum(),
+                             SGD->getBatchSize());
+      break;
+    }
+    case glow::Kinded::Kind::BatchNormalizationNodeKind: {
+      auto *BN = cast<BatchNormalizationNode>(N);
+      auto *dest = builder_.createAllocActivationInst(
+          "bn.res", BN->getResult().getType());
+      builder_.createBatchNormalizationInst(
+          N->getName(), dest, valueForNode(BN->getInput()),
+          valueForNode(BN->getScale()), valueForNode(BN->getBias()),
+          valueForNode(BN->getMean()), valueForNode(BN->getVar()),
+          BN->getChannelIdx(), BN->getEpsilon(), BN->getMomentum());
+      registerIR(BN->getResult(), dest);
+      break;
+    }
+    case glow::Kinded::Kind::BatchNormalizationGradNodeKind: {
+      auto *BNG = cast<BatchNormalizationGradNode>(N);
+      auto *input = valueForNode(BNG->getInput());
+      auto *scale = valueForNode(BNG->getScale());
+      auto *outG = valueForNode(BNG->getGradOfOriginalOutputNamedResult());
+
+      auto *inG =
+          builder_.createAllocActivationInst("bn.input.G", input->getType());
+      auto *scaleG =
+          builder_.createAllocActivationInst("bn.scale.G", scale->getType());
+      auto *biasG =
+          builder_.createAllocActivationInst("bn.bias.G", scale->getType());
+      builder_.createBatchNormalizationGradInst(
+          N->getName(), input, scale, valueForNode(BNG->getMean()),
+          valueForNode(BNG->getVar()), outG, inG, scaleG, biasG,
+          BNG->getChannelIdx(), BNG->getEpsilon(), BNG->getMomentum());
+      registerIR(BNG->getGradOfInputNamedInput(), inG);
+      registerIR(BNG->getGradOfInputNamedScale(), scaleG);
+      registerIR(BNG->getGradOfInputNamedBias(), biasG);
+
+      // The running statistics are not trained, so their gradients are zero.
+      for (NodeValue G :
+           {BNG->getGradOfInputNamedMean(), BNG->getGradOfInputNamedVar()}) {
+        auto *zero =
+            builder_.createAllocActivationInst("bn.stats.G", G.getType());
+        builder_.createSplatInst("bn.stats.G.zero", zero, 0);
+        registerIR(G, zero);
+      }
+      break;
+    }
+    case glow::Kinded::Kind::LSTMUnitNodeKind: {
+      auto *LU = cast<LSTMUnitNode>(N);
+      auto *input = valueForNode(LU->getInput());
+      auto *C = valueForNode(LU->getC());
+      auto *newC =
+          builder_.createAllocActivationInst("lstm.c", LU->getNewC().getType());
+      auto *newH =
+          builder_.createAllocActivationInst("lstm.h", LU->getNewH().getType());
+      auto *V = builder_.createLSTMUnitInst(N->getName(), newC, newH, input, C);
+      registerIR(LU->getNewC(), V->getNewC());
+      registerIR(LU->getNewH(), V->getNewH());
+      break;
+    }
+    case glow::Kinded::Kind::LSTMSequenceNodeKind: {
+      // The steps run in a loop. The states are carried from a step to the
+      // next, so they are allocated outside of the loop, and the activations
+      // of a step are allocated in the body.
+      auto *LS = cast<LSTMSequenceNode>(N);
+      auto *gates = valueForNode(LS->getGates());
+      auto *Wh = valueForNode(LS->getWh());
+      auto *numSteps = valueForNode(LS->getNumSteps());
+      auto elemTy = gates->getElementType();
+      size_t maxSteps = gates->dims()[0];
+      size_t batch = gates->dims()[1];
+      size_t hidden = Wh->dims()[0];
+
+      auto *hiddens =
+          builder_.createAllocActivationInst("lstm.hiddens", LS->getType());
+      builder_.createSplatInst("lstm.hiddens.zero", hiddens, 0);
+      auto *H = builder_.createAllocActivationInst("lstm.h", elemTy,
+                                                   {batch, hidden});
+      builder_.createSplatInst("lstm.h.zero", H, 0);
+      auto *C = builder_.createAllocActivationInst("lstm.c", elemTy,
+                                                   {batch, hidden});
+      builder_.createSplatInst("lstm.c.zero", C, 0);
+      auto *step = builder_.createAllocActivationInst("lstm.step",
+                                                      ElemKind::IndexTy, {1});
+      builder_.createLoopStartInst("lstm.loop", step, numSteps, maxSteps);
+
+      auto *XG = builder_.createAllocActivationInst("lstm.xgates", elemTy,
+                                                    {1, batch, 4 * hidden});
+      builder_.createGatherInst("lstm.xgates.load", XG, gates, step);
+      auto *G = builder_.createAllocActivationInst("lstm.gates", elemTy,
+                                                   {batch, 4 * hidden});
+      builder_.createMatMulInst("lstm.hgates", G, H, Wh, 0, 0);
+      builder_.createElementAddInst(
+          "lstm.gates.add", G, G,
+          builder_.createTensorView(elemTy, {batch, 4 * hidden}, XG,
+                                    "lstm.xgates.view"));
+      auto *newC = builder_.createAllocActivationInst("lstm.newc", elemTy,
+                                                      {batch, hidden});
+      auto *newH = builder_.createAllocActivationInst("lstm.newh", elemTy,
+                                                      {batch, hidden});
+      builder_.createLSTMUnitInst(N->getName(), newC, newH, G, C);
+      builder_.createCopyInst("lstm.c.update", C, newC);
+      builder_.createCopyInst("lstm.h.update", H, newH);
+      builder_.createScatterAssignInst(
+          "lstm.h.store", hiddens, step,
+          builder_.createTensorView(elemTy, {1, batch, hidden}, H,
+                                    "lstm.h.view"));
+      builder_.createDeallocActivationInst("dealloc", newH);
+      builder_.createDeallocActivationInst("dealloc", newC);
+      builder_.createDeallocActivationInst("dealloc", G);
+      builder_.createDeallocActivationInst("dealloc", XG);
+
+      builder_.createLoopEndInst("lstm.loop.end", step, numSteps, maxSteps);
+      builder_.createDeallocActivationInst("dealloc", step);
+      builder_.createDeallocActivationInst("dealloc", C);
+      builder_.createDeallocActivationInst("dealloc", H);
+      registerIR(LS->getResult(), hiddens);
+      break;
+    }
     case glow::Kinded::Kind::GatherNodeKind: {
       auto *GN = cast<GatherNode>(N);
       auto *dataTensor = valueForNode(GN->getData());
@@ -365,14 +499,16 @@ public:
 
 } // namespace
 
-void IRFunction::generateIR() {
+void IRFunction::generateIR() { generateIR(getDefaultScheduler()); }
+
+void IRFunction::generateIR(SchedulerKind kind) {
   G_->verify();
   // Schedule the nodes.
-  NodesList ScheduledNodes;
-  scheduleGraph(ScheduledNodes);
+  NodesPtrList ScheduledNodes;
+  scheduleGraph(ScheduledNodes, kind);
   IRGenVisitor irgen(this);
 
-  for (auto &N : ScheduledNodes) {
+  for (auto *N : ScheduledNodes) {
     N->visit(nullptr, &irgen);
   }
 }
@@ -47,3 +47,18 @@ Value *glow::getOrigin(Value *V) {
   }
   return V;
 }
+
+size_t glow::getOriginOffset(const Value *V) {
+  size_t offset = 0;
+  while (auto *TVI = dyn_cast<TensorViewInst>(V)) {
+    auto offsets = TVI->getOffsets();
+    auto dims = TVI->getSrc()->dims();
+    size_t stride = 1;
+    for (size_t i = offsets.size(); i > 0; i--) {
+      offset += offsets[i - 1] * stride;
+      stride *= dims[i - 1];
+    }
+    V = TVI->getSrc();
+  }
+  return offset;
+}
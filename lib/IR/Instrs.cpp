@@ -62,12 +62,41 @@ void CopyInst::verify() const {
 }
 
 void TensorViewInst::verify() const {
-  assert(getSrc()->getType()->size() == getType()->size() &&
-         "TensorView view size should be the same as Src size");
+  auto offsets = getOffsets();
+  if (offsets.empty()) {
+    assert(getSrc()->getType()->size() == getType()->size() &&
+           "TensorView view size should be the same as Src size");
+  } else {
+    assert(offsets.size() == getSrc()->dims().size() &&
+           "TensorView offsets should have the rank of Src");
+    assert(getOriginOffset(this) - getOriginOffset(getSrc()) +
+                   getType()->size() <=
+               getSrc()->getType()->size() &&
+           "TensorView view should be inside of Src");
+  }
   assert(getSrc()->getElementType() == getType()->getElementType() &&
          "TensorView view element type should be the same as Src type");
 }
 
+void MatMulInst::verify() const {
+  auto destTy = getDest()->getElementType();
+  auto lhsTy = getLHS()->getElementType();
+  auto rhsTy = getRHS()->getElementType();
+  (void)destTy;
+  (void)rhsTy;
+  // The int16 activations are multiplied by the int8 right hand side into the
+  // int32 accumulator. The other matrix multiplications have a single type.
+  if (lhsTy == ElemKind::Int16QTy) {
+    assert(rhsTy == ElemKind::Int8QTy && destTy == ElemKind::Int32QTy &&
+           "Invalid Element Type");
+  } else {
+    assert(lhsTy == destTy && rhsTy == destTy && "Invalid Element Type");
+  }
+  assert((destTy == ElemKind::FloatTy || destTy == ElemKind::Float16Ty ||
+          (!getTransposeLHS() && !getTransposeRHS())) &&
+         "Only the floating point operands can be transposed");
+}
+
 void AllocActivationInst::verify() const {
   unsigned numDealloc = 0;
   for (const Use &U : getUsers()) {
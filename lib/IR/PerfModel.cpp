@@ -0,0 +1,167 @@
+/**
+ * Copyright (c) 2017-present, Facebook, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "glow/IR/PerfModel.h"
+#include "glow/IR/IR.h"
+#include "glow/IR/IRCost.h"
+#include "glow/IR/IRUtils.h"
+#include "glow/IR/Instrs.h"
+
+#include "llvm/Support/Format.h"
+
+#include <algorithm>
+#include <list>
+#include <unordered_map>
+
+using namespace glow;
+using llvm::dyn_cast;
+using llvm::isa;
+
+namespace {
+
+/// A cache of \p capacity bytes that holds whole tensors and evicts the least
+/// recently used ones.
+class TensorCache {
+  size_t capacity_;
+  size_t used_{0};
+  /// The cached tensors and their sizes, the most recently used first.
+  std::list<std::pair<const Value *, size_t>> lru_;
+  std::unordered_map<const Value *, decltype(lru_)::iterator> entries_;
+
+public:
+  explicit TensorCache(size_t capacity) : capacity_(capacity) {}
+
+  /// \returns true if \p V is in the cache.
+  bool contains(const Value *V) const { return entries_.count(V); }
+
+  /// Make \p V of \p size bytes the most recently used tensor. A tensor that
+  /// is larger than the cache is streamed through it, and stays out.
+  void touch(const Value *V, size_t size) {
+    auto it = entries_.find(V);
+    if (it != entries_.end()) {
+      lru_.splice(lru_.begin(), lru_, it->second);
+      return;
+    }
+    if (size > capacity_) {
+      return;
+    }
+    while (used_ + size > capacity_) {
+      used_ -= lru_.back().second;
+      entries_.erase(lru_.back().first);
+      lru_.pop_back();
+    }
+    lru_.emplace_front(V, size);
+    entries_[V] = lru_.begin();
+    used_ += size;
+  }
+
+  /// Remove \p V, whose memory is released, from the cache.
+  void erase(const Value *V) {
+    auto it = entries_.find(V);
+    if (it == entries_.end()) {
+      return;
+    }
+    used_ -= it->second->second;
+    lru_.erase(it->second);
+    entries_.erase(it);
+  }
+};
+
+} // namespace
+
+PerfEstimate glow::estimatePerf(const IRFunction *F,
+                                const DeviceInfo &device) {
+  PerfEstimate estimate;
+  for (const auto *W : F->getWeights()) {
+    estimate.weightsSize += W->getSizeInBytes();
+  }
+
+  // The private caches of the cores hold the parts of the tensors that their
+  // cores work on, so together they hold the tensors as one large cache.
+  TensorCache l2(size_t(device.cores) * device.l2Size);
+  TensorCache llc(device.llcSize);
+  size_t liveActivations = 0;
+  for (const auto *I : F->getInstrs()) {
+    if (auto *AA = dyn_cast<AllocActivationInst>(I)) {
+      liveActivations += AA->getSizeInBytes();
+      estimate.activationsPeak =
+          std::max(estimate.activationsPeak, liveActivations);
+      continue;
+    }
+    if (auto *DA = dyn_cast<DeallocActivationInst>(I)) {
+      liveActivations -= DA->getAlloc()->getSizeInBytes();
+      l2.erase(DA->getAlloc());
+      llc.erase(DA->getAlloc());
+      continue;
+    }
+    if (isa<TensorViewInst>(I)) {
+      continue;
+    }
+
+    InstrEstimate IE;
+    IE.instr = I;
+    IE.cost = getCost(I);
+    // The views are served from the cache lines of the tensors they view.
+    for (const auto &op : I->getOperands()) {
+      const Value *V = getOrigin(op.first);
+      uint64_t size = op.first->getSizeInBytes();
+      uint64_t bytes = op.second == OperandKind::InOut ? 2 * size : size;
+      if (l2.contains(V)) {
+        IE.l2Bytes += bytes;
+      } else if (llc.contains(V)) {
+        IE.llcBytes += bytes;
+      } else {
+        IE.memBytes += bytes;
+      }
+    }
+    for (const auto &op : I->getOperands()) {
+      const Value *V = getOrigin(op.first);
+      l2.touch(V, V->getSizeInBytes());
+      llc.touch(V, V->getSizeInBytes());
+    }
+
+    IE.computeTime = IE.cost.flops / device.getPeakFlops();
+    IE.memoryTime = (IE.l2Bytes / (device.l2Bandwidth * device.cores) +
+                     IE.llcBytes / device.llcBandwidth +
+                     IE.memBytes / device.memBandwidth) /
+                    1e9;
+    IE.time = std::max(IE.computeTime, IE.memoryTime) +
+              device.kernelOverheadUs / 1e6;
+    estimate.time += IE.time;
+    estimate.instrs.push_back(IE);
+  }
+  return estimate;
+}
+
+void glow::dumpPerfEstimate(const PerfEstimate &estimate,
+                            llvm::raw_ostream &os) {
+  os << "    time(us)  bound     GFLOP   mem(MB)  llc(MB)   l2(MB)  "
+        "instruction\n";
+  for (const auto &IE : estimate.instrs) {
+    os << llvm::format("%12.3f  %-7s %8.4f %9.3f %8.3f %8.3f  ",
+                       IE.time * 1e6,
+                       IE.computeTime >= IE.memoryTime ? "compute" : "memory",
+                       IE.cost.flops / 1e9, IE.memBytes / 1e6,
+                       IE.llcBytes / 1e6, IE.l2Bytes / 1e6)
+       << IE.instr->getKindName() << " " << IE.instr->getName() << "\n";
+  }
+  os << llvm::format("Latency: %.3f ms\n", estimate.time * 1e3);
+  os << llvm::format("Peak memory: %.3f MB (weights %.3f MB, activations "
+                     "%.3f MB)\n",
+                     estimate.getPeakMemory() / 1e6,
+                     estimate.weightsSize / 1e6,
+                     estimate.activationsPeak / 1e6);
+}
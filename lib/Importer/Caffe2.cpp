@@ -15,6 +15,7 @@
  */
 
 #include "glow/Importer/Caffe2.h"
+#include "WeightDecoder.h"
 #include "glow/Base/Tensor.h"
 #include "glow/Graph/Graph.h"
 #include "glow/Graph/Nodes.h"
@@ -153,7 +154,11 @@ Node *caffe2ModelLoader::getOrCreateNodeByName(const std::string &name) {
   auto *V = G_.getParent()->createVariable(T->getElementType(), T->dims(), name,
                                            VisibilityKind::Private,
                                            Variable::TrainKind::Broadcast);
-  V->copyFrom(T);
+  // Move the weights into the variable instead of copying them, and keep a
+  // view of the payload for the operators that read the tensor, so that the
+  // weights are only stored once.
+  V->getPayload() = std::move(*T);
+  *T = V->getPayload().getUnowned(V->dims());
   nodeByName_[name] = V;
   return V;
 }
@@ -459,6 +464,31 @@ void caffe2ModelLoader::loadOperator(const caffe2::OperatorDef &op) {
     return;
   }
 
+  if (typeName == "SparseLengthsSum" ||
+      typeName == "SparseLengthsWeightedSum") {
+    // The gathered slices are summed without being materialized. The indices
+    // and the lengths are index tensors.
+    auto *data = getOrCreateNodeByName(op.input(0));
+    Node *node = nullptr;
+    if (typeName == "SparseLengthsSum") {
+      auto *indices = getOrCreateNodeByName(op.input(1));
+      auto *lengths = getOrCreateNodeByName(op.input(2));
+      node = G_.createSparseLengthsSum(opName, data, indices, lengths);
+    } else {
+      auto *weights = getOrCreateNodeByName(op.input(1));
+      auto *indices = getOrCreateNodeByName(op.input(2));
+      auto *lengths = getOrCreateNodeByName(op.input(3));
+      node = G_.createSparseLengthsWeightedSum(opName, data, weights, indices,
+                                               lengths);
+    }
+
+    // Save the outputs:
+    for (int i = 0, e = op.output_size(); i < e; i++) {
+      nodeByName_[op.output(i)] = node;
+    }
+    return;
+  }
+
   unexpectedNodeError(op, "Unsupported operator.");
 }
 
@@ -476,7 +506,27 @@ void caffe2ModelLoader::loadNetwork(caffe2::NetDef &net) {
 }
 
 void caffe2ModelLoader::loadWeights(caffe2::NetDef &net) {
-  for (auto &op : net.op()) {
+  // The values of the tensors are decoded in parallel, in batches of
+  // WeightDecoder::batchBytes.
+  WeightDecoder decoder;
+  auto *ops = net.mutable_op();
+  int released = 0;
+  // Decode the values that the operators in [released, end) hold, and
+  // release the operators. Clearing the messages would keep their buffers
+  // allocated.
+  auto decode = [&](int end) {
+    decoder.run();
+    for (; released < end; released++) {
+      caffe2::OperatorDef empty;
+      empty.Swap(ops->Mutable(released));
+    }
+  };
+
+  for (int opIdx = 0, e = ops->size(); opIdx < e; opIdx++) {
+    if (decoder.getPendingBytes() >= WeightDecoder::batchBytes) {
+      decode(opIdx);
+    }
+    auto &op = *ops->Mutable(opIdx);
     ArgumentDictionaryTy dict = loadArgumentMap(op);
 
     /// Load tensors with values:
@@ -504,14 +554,40 @@ void caffe2ModelLoader::loadWeights(caffe2::NetDef &net) {
 
       auto dim = getShape(dict["shape"]);
       T->reset(ElemKind::FloatTy, dim);
-      auto TH = T->getHandle<>();
-      size_t i = 0;
-      for (auto f : dict["values"]->floats()) {
-        TH.raw(i++) = f;
+      const auto &values = dict["values"]->floats();
+      assert(size_t(values.size()) == T->size() &&
+             "The number of serialized values does not match the size of the "
+             "tensor.");
+      // The serialized values are released as soon as they are decoded, so
+      // that the weights are not held twice while the rest of the model
+      // loads.
+      decoder.add(T->getRawDataPointer<float>(), values.data(), T->size());
+      continue;
+    }
+
+    // Load index tensors. GivenTensorIntFill makes 32-bit indices and
+    // GivenTensorInt64Fill makes indices of the native width.
+    if (op.type() == "GivenTensorIntFill" ||
+        op.type() == "GivenTensorInt64Fill") {
+      auto *T = new Tensor();
+      for (auto &o : op.output()) {
+        tensors_[o] = T;
+      }
+
+      auto dim = getShape(dict["shape"]);
+      const auto &values = dict["values"]->ints();
+      if (op.type() == "GivenTensorIntFill") {
+        T->reset(ElemKind::Int32ITy, dim);
+        decoder.add(T->getRawDataPointer<int32_t>(), values.data(),
+                    T->size());
+      } else {
+        T->reset(ElemKind::IndexTy, dim);
+        decoder.add(T->getRawDataPointer<size_t>(), values.data(), T->size());
       }
 
-      assert(i == TH.size() && "The number of serialized values does not "
-                               "match the size of the tensor.");
+      assert(size_t(values.size()) == T->size() &&
+             "The number of serialized values does not match the size of the "
+             "tensor.");
       continue;
     }
 
@@ -546,6 +622,7 @@ void caffe2ModelLoader::loadWeights(caffe2::NetDef &net) {
 
     unexpectedNodeError(op, "Unsupported weight kind");
   }
+  decode(ops->size());
 }
 
 caffe2ModelLoader::caffe2ModelLoader(const std::string &netDescFilename,
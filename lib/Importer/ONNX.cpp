@@ -15,6 +15,7 @@
  */
 
 #include "glow/Importer/ONNX.h"
+#include "WeightDecoder.h"
 #include "glow/Base/Tensor.h"
 #include "glow/Graph/Graph.h"
 #include "glow/Graph/Nodes.h"
@@ -30,6 +31,7 @@
 #include <cassert>
 #include <cstddef>
 #include <cstdint>
+#include <cstring>
 #include <fstream>
 #include <iostream>
 #include <sstream>
@@ -117,7 +119,8 @@ bool ONNXModelLoader::loadProtoFile(onnx::GraphProto &net,
   codedstr.SetTotalBytesLimit(1e+9, 1e+9);
   onnx::ModelProto MP;
   bool parseNet = MP.ParseFromCodedStream(&codedstr);
-  net = MP.graph();
+  // Take the graph, including its initializers, without copying it.
+  net.Swap(MP.mutable_graph());
 
   GLOW_ASSERT(parseNet && "Failed to parse the network descriptor.");
   return true;
@@ -160,7 +163,11 @@ Node *ONNXModelLoader::getOrCreateNodeByName(const std::string &name) {
   auto *V = G_.getParent()->createVariable(T->getElementType(), T->dims(), name,
                                            VisibilityKind::Private,
                                            Variable::TrainKind::Broadcast);
-  V->copyFrom(T);
+  // Move the weights into the variable instead of copying them, and keep a
+  // view of the payload for the operators that read the tensor, so that the
+  // weights are only stored once.
+  V->getPayload() = std::move(*T);
+  *T = V->getPayload().getUnowned(V->dims());
   nodeByName_[name] = V;
   return V;
 }
@@ -170,7 +177,10 @@ bool ONNXModelLoader::hasNodeByName(const std::string &name) const {
   return (it != nodeByName_.end());
 }
 
-void loadTensor(const onnx::TensorProto &in, Tensor *T) {
+/// Reset \p T to the type and the shape of \p in, and add the copy of the
+/// elements of \p in into \p T to \p decoder.
+static void loadTensor(const onnx::TensorProto &in, Tensor *T,
+                       WeightDecoder &decoder) {
   std::vector<size_t> dim;
   for (auto d : in.dims()) {
     dim.push_back(d);
@@ -180,15 +190,16 @@ void loadTensor(const onnx::TensorProto &in, Tensor *T) {
     T->reset(ElemKind::FloatTy, dim);
 
     if (in.float_data_size() > 0) {
-      auto TH = T->getHandle<>();
-      size_t i = 0;
-      for (auto f : in.float_data()) {
-        TH.raw(i++) = f;
-      }
+      GLOW_ASSERT(size_t(in.float_data_size()) == T->size() &&
+                  "The number of the values does not match the tensor.");
+      decoder.add(T->getRawDataPointer<float>(), in.float_data().data(),
+                  T->size());
     } else if (in.has_raw_data()) {
-      std::istringstream inStream(in.raw_data(), std::stringstream::binary);
-      inStream.read((char *)T->getRawDataPointer<float>(),
-                    T->size() * sizeof(float));
+      GLOW_ASSERT(in.raw_data().size() == T->size() * sizeof(float) &&
+                  "The size of the raw data does not match the tensor.");
+      decoder.add(T->getRawDataPointer<float>(),
+                  reinterpret_cast<const float *>(in.raw_data().data()),
+                  T->size());
     } else {
       assert(false && "Unsupported Tensor format.");
     }
@@ -197,15 +208,35 @@ void loadTensor(const onnx::TensorProto &in, Tensor *T) {
     T->reset(ElemKind::IndexTy, dim);
 
     if (in.int64_data_size() > 0) {
-      auto TH = T->getHandle<>();
-      size_t i = 0;
-      for (auto f : in.int64_data()) {
-        TH.raw(i++) = f;
-      }
+      GLOW_ASSERT(size_t(in.int64_data_size()) == T->size() &&
+                  "The number of the values does not match the tensor.");
+      decoder.add(T->getRawDataPointer<size_t>(), in.int64_data().data(),
+                  T->size());
     } else if (in.has_raw_data()) {
-      std::istringstream inStream(in.raw_data(), std::stringstream::binary);
-      inStream.read((char *)T->getRawDataPointer<size_t>(),
-                    T->size() * sizeof(int64_t));
+      GLOW_ASSERT(in.raw_data().size() == T->size() * sizeof(int64_t) &&
+                  "The size of the raw data does not match the tensor.");
+      decoder.add(T->getRawDataPointer<size_t>(),
+                  reinterpret_cast<const int64_t *>(in.raw_data().data()),
+                  T->size());
+    } else {
+      assert(false && "Unsupported Tensor format.");
+    }
+  } else if (in.data_type() == onnx::TensorProto::INT32) {
+    // The 32-bit indices keep their width, so that the Gather and TopK
+    // kernels read and write half of the bytes.
+    T->reset(ElemKind::Int32ITy, dim);
+
+    if (in.int32_data_size() > 0) {
+      GLOW_ASSERT(size_t(in.int32_data_size()) == T->size() &&
+                  "The number of the values does not match the tensor.");
+      decoder.add(T->getRawDataPointer<int32_t>(), in.int32_data().data(),
+                  T->size());
+    } else if (in.has_raw_data()) {
+      GLOW_ASSERT(in.raw_data().size() == T->size() * sizeof(int32_t) &&
+                  "The size of the raw data does not match the tensor.");
+      decoder.add(T->getRawDataPointer<int32_t>(),
+                  reinterpret_cast<const int32_t *>(in.raw_data().data()),
+                  T->size());
     } else {
       assert(false && "Unsupported Tensor format.");
     }
@@ -214,6 +245,12 @@ void loadTensor(const onnx::TensorProto &in, Tensor *T) {
   }
 }
 
+void loadTensor(const onnx::TensorProto &in, Tensor *T) {
+  WeightDecoder decoder;
+  loadTensor(in, T, decoder);
+  decoder.run();
+}
+
 void ONNXModelLoader::loadOperator(const onnx::NodeProto &op) {
   ArgumentDictionaryTy dict = loadArgumentMap(op);
 
@@ -558,7 +595,8 @@ void ONNXModelLoader::loadOperator(const onnx::NodeProto &op) {
       B = G_.createTranspose(opName, B, {1, 0});
 
     Node *mul = G_.createMatMul(opName, A, B);
-    if (broadcastC) {
+    // A bias that was exported for a batch of one is broadcast to the batch.
+    if (broadcastC || C->dims() != mul->dims()) {
       int axis = mul->dims().size() - C->dims().size();
       C = G_.createBroadcast(opName, C, mul->dims(), axis);
     }
@@ -572,18 +610,81 @@ void ONNXModelLoader::loadOperator(const onnx::NodeProto &op) {
     return;
   }
 
+  if (typeName == "ReduceSum" || typeName == "ReduceMean" ||
+      typeName == "ReduceMax") {
+    auto *in = getOrCreateNodeByName(op.input(0));
+    size_t rank = in->getType()->dims().size();
+
+    // The axes may be negative, and all of the axes are reduced by default.
+    std::vector<size_t> axes;
+    if (dict.count("axes")) {
+      for (auto axis : dict["axes"]->ints()) {
+        axes.push_back(axis < 0 ? axis + rank : axis);
+      }
+    } else {
+      for (size_t i = 0; i < rank; i++) {
+        axes.push_back(i);
+      }
+    }
+    bool keepDims = !dict.count("keepdims") || loadInt(dict["keepdims"]);
+
+    ReduceMode mode = ReduceMode::Sum;
+    if (typeName == "ReduceMean") {
+      mode = ReduceMode::Mean;
+    } else if (typeName == "ReduceMax") {
+      mode = ReduceMode::Max;
+    }
+    auto *node = G_.createReduce(opName, in, axes, mode, keepDims);
+
+    // Save the outputs:
+    for (int i = 0, e = op.output_size(); i < e; i++) {
+      nodeByName_[op.output(i)] = node;
+    }
+    return;
+  }
+
   if (typeName == "Reshape") {
     auto *in = getOrCreateNodeByName(op.input(0));
 
-    std::vector<size_t> newDim;
+    std::vector<int64_t> shape;
     if (dict.count("shape")) {
-      newDim = getShape(dict["shape"]);
+      for (auto i : dict["shape"]->ints()) {
+        shape.push_back(i);
+      }
     } else {
       auto *T = getTensorByName(op.input(1));
       auto TH = T->getHandle<size_t>();
       for (size_t i = 0, e = T->size(); i != e; i++) {
-        newDim.push_back(TH.raw(i));
+        shape.push_back(int64_t(TH.raw(i)));
+      }
+    }
+
+    // A zero copies the dimension of the input and a -1 stands for the rest
+    // of the elements.
+    auto inDims = in->getType()->dims();
+    size_t inSize = in->getType()->size();
+    std::vector<size_t> newDim(shape.size());
+    size_t known = 1;
+    int inferred = -1;
+    for (size_t i = 0, e = shape.size(); i < e; i++) {
+      if (shape[i] == -1) {
+        assert(inferred == -1 && "Only one dimension may be inferred");
+        inferred = i;
+        continue;
       }
+      newDim[i] = shape[i] ? size_t(shape[i]) : inDims[i];
+      known *= newDim[i];
+    }
+    // The models are usually exported for a batch of one. The leading
+    // dimension of a shape of such a model follows the batch of the input.
+    if (!shape.empty() && shape[0] == 1 && inDims[0] > 1 &&
+        known * inDims[0] <= inSize && inSize % (known * inDims[0]) == 0 &&
+        (inferred != -1 || known * inDims[0] == inSize)) {
+      newDim[0] = inDims[0];
+      known *= inDims[0];
+    }
+    if (inferred != -1) {
+      newDim[inferred] = inSize / known;
     }
 
     auto *node = G_.createReshape(opName, in, newDim);
@@ -599,11 +700,27 @@ void ONNXModelLoader::loadOperator(const onnx::NodeProto &op) {
 }
 
 void ONNXModelLoader::loadInitializers(onnx::GraphProto &net) {
-  /// Load the network initializaers:
-  for (const auto &in : net.initializer()) {
+  /// Load the network initializaers. The elements are decoded in parallel,
+  /// in batches of WeightDecoder::batchBytes.
+  WeightDecoder decoder;
+  auto *initializers = net.mutable_initializer();
+  int released = 0;
+  for (int i = 0, e = initializers->size(); i < e; i++) {
+    auto &in = *initializers->Mutable(i);
     Tensor *T = new Tensor();
-    loadTensor(in, T);
+    loadTensor(in, T, decoder);
     tensors_[in.name()] = T;
+    if (decoder.getPendingBytes() < WeightDecoder::batchBytes && i + 1 < e) {
+      continue;
+    }
+    decoder.run();
+    // Release the serialized payloads as soon as they are decoded, so that
+    // the weights are not held twice while the rest of the model loads.
+    // Clearing the messages would keep their buffers allocated.
+    for (; released <= i; released++) {
+      onnx::TensorProto empty;
+      empty.Swap(initializers->Mutable(released));
+    }
   }
 }
 
@@ -0,0 +1,36 @@
+/**
+ * Copyright (c) 2017-present, Facebook, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "WeightDecoder.h"
+
+#include "glow/Support/Parallel.h"
+
+using namespace glow;
+
+constexpr size_t WeightDecoder::chunkSize;
+constexpr size_t WeightDecoder::batchBytes;
+
+void WeightDecoder::run() {
+  glow_parallel_for(
+      chunks_.size(), glow_parallel_get_num_threads(),
+      [](void *ctx, size_t task) {
+        const auto &C = (*static_cast<std::vector<Chunk> *>(ctx))[task];
+        C.copy(C.dest, C.src, C.size);
+      },
+      &chunks_);
+  chunks_.clear();
+  pendingBytes_ = 0;
+}
@@ -0,0 +1,97 @@
+/**
+ * Copyright (c) 2017-present, Facebook, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#ifndef GLOW_IMPORTER_WEIGHTDECODER_H
+#define GLOW_IMPORTER_WEIGHTDECODER_H
+
+#include <algorithm>
+#include <cstddef>
+#include <cstring>
+#include <type_traits>
+#include <vector>
+
+namespace glow {
+
+/// Copies the serialized elements of the weights of a model into the payloads
+/// of their tensors on the threads of glow_parallel_for. The importers
+/// allocate the tensors with their final type and shape and add their copies,
+/// so the elements are decoded directly into the payloads. The copies are
+/// split into chunks, so that the large weights are spread over the threads.
+/// The serialized elements must stay alive until run() returns.
+class WeightDecoder {
+  /// A copy of \p size elements from \p src to \p dest with \p copy.
+  struct Chunk {
+    void *dest;
+    const void *src;
+    size_t size;
+    void (*copy)(void *dest, const void *src, size_t size);
+  };
+
+  /// The number of elements of a chunk.
+  static constexpr size_t chunkSize = 1 << 18;
+
+  /// The copies that wait for run().
+  std::vector<Chunk> chunks_;
+  /// The bytes that the copies that wait for run() write.
+  size_t pendingBytes_{0};
+
+  /// Copy the \p size elements of the type SrcTy at \p src into the elements
+  /// of the type DestTy at \p dest. The elements are copied in bulk if they
+  /// have the same representation. \p src doesn't need to be aligned then.
+  template <class DestTy, class SrcTy>
+  static void copyElements(void *dest, const void *src, size_t size) {
+    constexpr bool sameRepr =
+        std::is_same<DestTy, SrcTy>::value ||
+        (std::is_integral<DestTy>::value && std::is_integral<SrcTy>::value &&
+         sizeof(DestTy) == sizeof(SrcTy));
+    if (sameRepr) {
+      memcpy(dest, src, size * sizeof(DestTy));
+      return;
+    }
+    auto *D = static_cast<DestTy *>(dest);
+    auto *S = static_cast<const SrcTy *>(src);
+    for (size_t i = 0; i < size; i++) {
+      D[i] = S[i];
+    }
+  }
+
+public:
+  /// The bytes of the copies that the importers add before they run them, and
+  /// release the serialized weights that the copies read. This bounds the
+  /// memory that holds the weights twice.
+  static constexpr size_t batchBytes = size_t(1) << 28;
+
+  /// Add the copy of the \p size elements at \p src to \p dest, converting
+  /// them from SrcTy to DestTy.
+  template <class DestTy, class SrcTy>
+  void add(DestTy *dest, const SrcTy *src, size_t size) {
+    for (size_t begin = 0; begin < size; begin += chunkSize) {
+      chunks_.push_back({dest + begin, src + begin,
+                         std::min(chunkSize, size - begin),
+                         &copyElements<DestTy, SrcTy>});
+    }
+    pendingBytes_ += size * sizeof(DestTy);
+  }
+
+  /// \returns the bytes that the copies that wait for run() write.
+  size_t getPendingBytes() const { return pendingBytes_; }
+
+  /// Run the added copies, and return when all of them are done.
+  void run();
+};
+
+} // namespace glow
+
+#endif // GLOW_IMPORTER_WEIGHTDECODER_H
@@ -0,0 +1,303 @@
+/**
+ * Copyright (c) 2017-present, Facebook, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "glow/Graph/Graph.h"
+#include "glow/Graph/Node.h"
+#include "glow/Graph/Nodes.h"
+#include "glow/Optimizer/Optimizer.h"
+
+#include "llvm/Support/CommandLine.h"
+
+#include <algorithm>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+using namespace glow;
+using llvm::dyn_cast;
+using llvm::isa;
+
+static llvm::cl::opt<unsigned> splitBatchCacheKB(
+    "split-batch-cache-kb",
+    llvm::cl::desc("Run the chains of per-sample layers of inference "
+                   "functions on micro-batches whose activations fit in this "
+                   "many kilobytes of cache. Zero runs every layer on the "
+                   "whole batch"),
+    llvm::cl::init(0));
+
+/// \returns true if the input number \p idx of \p N carries the samples of
+/// the batch, which are split along with the results of \p N. The other inputs
+/// are weights that every sample uses.
+static bool isBatchedInput(const Node *N, unsigned idx) {
+  switch (N->getKind()) {
+  case Kinded::Kind::ConcatNodeKind:
+  case Kinded::Kind::AddNodeKind:
+  case Kinded::Kind::SubNodeKind:
+  case Kinded::Kind::MulNodeKind:
+  case Kinded::Kind::DivNodeKind:
+  case Kinded::Kind::MaxNodeKind:
+  case Kinded::Kind::MinNodeKind:
+    return true;
+  default:
+    return idx == 0;
+  }
+}
+
+/// \returns the batch size of \p N if every sample of its result is computed
+/// from the same sample of its batched inputs alone, or 0 otherwise.
+static size_t getSplittableBatch(const Node *N) {
+  switch (N->getKind()) {
+  case Kinded::Kind::ConvolutionNodeKind:
+  case Kinded::Kind::PoolMaxNodeKind:
+  case Kinded::Kind::PoolAvgNodeKind:
+  case Kinded::Kind::FullyConnectedNodeKind:
+  case Kinded::Kind::SparseFullyConnectedNodeKind:
+  case Kinded::Kind::BatchNormalizationNodeKind:
+  case Kinded::Kind::LocalResponseNormalizationNodeKind:
+  case Kinded::Kind::ReluNodeKind:
+  case Kinded::Kind::SigmoidNodeKind:
+  case Kinded::Kind::TanhNodeKind:
+  case Kinded::Kind::AddNodeKind:
+  case Kinded::Kind::SubNodeKind:
+  case Kinded::Kind::MulNodeKind:
+  case Kinded::Kind::DivNodeKind:
+  case Kinded::Kind::MaxNodeKind:
+  case Kinded::Kind::MinNodeKind:
+  case Kinded::Kind::QuantizeNodeKind:
+  case Kinded::Kind::DequantizeNodeKind:
+  case Kinded::Kind::RescaleQuantizedNodeKind:
+    break;
+  case Kinded::Kind::TransposeNodeKind:
+    if (dyn_cast<TransposeNode>(N)->getShuffle()[0] != 0) {
+      return 0;
+    }
+    break;
+  case Kinded::Kind::ConcatNodeKind:
+    if (dyn_cast<ConcatNode>(N)->getDim() == 0) {
+      return 0;
+    }
+    break;
+  default:
+    return 0;
+  }
+
+  if (N->hasPredicate() || N->getNumResults() != 1) {
+    return 0;
+  }
+  size_t batch = N->getType(0)->dims()[0];
+  if (batch < 2) {
+    return 0;
+  }
+  for (unsigned i = 0, e = N->getNumInputs(); i < e; i++) {
+    const NodeValue &in = N->getNthInput(i);
+    if (isBatchedInput(N, i)) {
+      if (in.dims()[0] != batch) {
+        return 0;
+      }
+    } else if (!isa<Variable>(in.getNode())) {
+      // The weights must be the same for all of the micro-batches.
+      return 0;
+    }
+  }
+  return batch;
+}
+
+/// \returns the number of bytes of the result and of the batched inputs of
+/// \p N for every sample of the batch \p batch.
+static size_t getBytesPerSample(const Node *N, size_t batch) {
+  size_t bytes = N->getType(0)->getSizeInBytes();
+  for (unsigned i = 0, e = N->getNumInputs(); i < e; i++) {
+    if (isBatchedInput(N, i)) {
+      bytes += N->getNthInput(i).getType()->getSizeInBytes();
+    }
+  }
+  return bytes / batch;
+}
+
+namespace {
+/// A connected set of splittable nodes with the same batch size, where the
+/// batched inputs of every node that are computed by the graph are computed
+/// in the set.
+struct Chain {
+  std::vector<Node *> nodes;
+  size_t batch{0};
+  /// The max number of bytes of the result and the batched inputs of a node
+  /// for a single sample.
+  size_t bytesPerSample{0};
+};
+} // namespace
+
+/// \returns the chains of the splittable nodes of \p F.
+static std::vector<Chain> findChains(Function *F) {
+  std::unordered_map<Node *, size_t> batches;
+  for (auto *N : F->getNodes()) {
+    if (size_t batch = getSplittableBatch(N)) {
+      batches[N] = batch;
+    }
+  }
+
+  // Group the nodes that are linked by batched inputs.
+  std::unordered_map<Node *, Node *> leaders;
+  auto getLeader = [&](Node *N) {
+    auto it = leaders.find(N);
+    while (it != leaders.end() && it->second != N) {
+      N = it->second;
+      it = leaders.find(N);
+    }
+    return N;
+  };
+  for (const auto &entry : batches) {
+    Node *N = entry.first;
+    for (unsigned i = 0, e = N->getNumInputs(); i < e; i++) {
+      Node *in = N->getNthInput(i).getNode();
+      auto it = batches.find(in);
+      if (isBatchedInput(N, i) && it != batches.end() &&
+          it->second == entry.second) {
+        Node *L = getLeader(N);
+        Node *inL = getLeader(in);
+        if (L != inL) {
+          leaders[L] = inL;
+        }
+      }
+    }
+  }
+
+  std::unordered_map<Node *, Chain> chains;
+  for (auto *N : F->getNodes()) {
+    auto it = batches.find(N);
+    if (it == batches.end()) {
+      continue;
+    }
+    auto &chain = chains[getLeader(N)];
+    chain.nodes.push_back(N);
+    chain.batch = it->second;
+    chain.bytesPerSample =
+        std::max(chain.bytesPerSample, getBytesPerSample(N, it->second));
+  }
+  std::vector<Chain> result;
+  for (auto &entry : chains) {
+    result.push_back(std::move(entry.second));
+  }
+  return result;
+}
+
+/// Replace \p chain of \p F by copies that compute micro-batches of
+/// \p microBatch samples. The copies read slices of the batched inputs of the
+/// chain, and their results are concatenated for the nodes outside of it.
+static void splitChain(Function *F, const Chain &chain, size_t microBatch) {
+  std::unordered_set<Node *> inChain(chain.nodes.begin(), chain.nodes.end());
+  // The nodes of the chain whose results are used outside of it.
+  std::unordered_set<Node *> usedOutside;
+  for (auto *N : F->getNodes()) {
+    if (inChain.count(N)) {
+      continue;
+    }
+    for (unsigned i = 0, e = N->getNumInputs(); i < e; i++) {
+      usedOutside.insert(N->getNthInput(i).getNode());
+    }
+    if (N->hasPredicate()) {
+      usedOutside.insert(N->getPredicate().getNode());
+    }
+  }
+
+  std::vector<std::vector<Node *>> copies;
+  for (size_t begin = 0; begin < chain.batch; begin += microBatch) {
+    size_t size = std::min(microBatch, chain.batch - begin);
+    std::unordered_map<Node *, Node *> copyOf;
+    for (auto *N : chain.nodes) {
+      Node *copy = N->clone();
+      auto dims = N->getType(0)->dims().vec();
+      dims[0] = size;
+      copy->setType(0, F->getParent()->uniqueTypeWithNewShape(N->getType(0),
+                                                              dims));
+      F->addNode(copy);
+      copyOf[N] = copy;
+    }
+
+    // Link the copies, and slice the batched inputs from the outside.
+    std::unordered_map<Node *, std::unordered_map<unsigned, Node *>> slices;
+    for (auto *N : chain.nodes) {
+      Node *copy = copyOf[N];
+      for (unsigned i = 0, e = N->getNumInputs(); i < e; i++) {
+        if (!isBatchedInput(N, i)) {
+          continue;
+        }
+        const NodeValue &in = N->getNthInput(i);
+        NodeValue &copyIn = copy->getNthInput(i);
+        if (inChain.count(in.getNode())) {
+          copyIn.setOperand(copyOf[in.getNode()], 0);
+          continue;
+        }
+        Node *&slice = slices[in.getNode()][in.getResNo()];
+        if (!slice) {
+          auto start = std::vector<size_t>(in.dims().size(), 0);
+          auto end = in.dims().vec();
+          start[0] = begin;
+          end[0] = begin + size;
+          slice = F->createSlice(in.getNode()->getName().str() + ".micro", in,
+                                 start, end);
+        }
+        copyIn.setOperand(slice, 0);
+      }
+    }
+
+    std::vector<Node *> ordered;
+    for (auto *N : chain.nodes) {
+      ordered.push_back(copyOf[N]);
+    }
+    copies.push_back(std::move(ordered));
+  }
+
+  // Concatenate the micro-batches of the results that are used outside of
+  // the chain.
+  for (size_t n = 0, e = chain.nodes.size(); n < e; n++) {
+    Node *N = chain.nodes[n];
+    if (!usedOutside.count(N)) {
+      continue;
+    }
+    std::vector<Node *> parts;
+    for (const auto &copy : copies) {
+      parts.push_back(copy[n]);
+    }
+    auto *CN = F->createConcat(N->getName().str() + ".batch", parts, 0,
+                               N->getType(0));
+    N->getNthResult(0).replaceAllUsesOfWith(CN);
+  }
+}
+
+bool glow::splitBatches(Function *F, size_t cacheSize) {
+  bool changed = false;
+  for (const auto &chain : findChains(F)) {
+    // A single layer gains no locality from the split.
+    if (chain.nodes.size() < 2 || !chain.bytesPerSample) {
+      continue;
+    }
+    size_t microBatch = std::max<size_t>(cacheSize / chain.bytesPerSample, 1);
+    if (microBatch >= chain.batch) {
+      continue;
+    }
+    splitChain(F, chain, microBatch);
+    changed = true;
+  }
+  return changed;
+}
+
+bool glow::splitBatches(Function *F) {
+  if (!splitBatchCacheKB) {
+    return false;
+  }
+  return splitBatches(F, size_t(splitBatchCacheKB) * 1024);
+}
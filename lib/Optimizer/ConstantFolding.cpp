@@ -0,0 +1,172 @@
+/**
+ * Copyright (c) 2017-present, Facebook, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "glow/Backends/Backend.h"
+#include "glow/Graph/Graph.h"
+#include "glow/Graph/Node.h"
+#include "glow/Graph/Nodes.h"
+#include "glow/IR/IR.h"
+#include "glow/Optimizer/Optimizer.h"
+
+#include "llvm/Support/Casting.h"
+
+#include <memory>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+using namespace glow;
+using llvm::dyn_cast;
+using llvm::isa;
+
+/// \returns true if \p N is one of the nodes that are folded. These are the
+/// nodes that the importers produce for the weights: the shape manipulations,
+/// the conversions and the elementwise arithmetic. The nodes that expand their
+/// inputs, like Broadcast, are not folded, so that the weights don't grow.
+static bool isFoldableKind(const Node *N) {
+  if (N->isArithmetic()) {
+    return true;
+  }
+  switch (N->getKind()) {
+  case Kinded::Kind::ConcatNodeKind:
+  case Kinded::Kind::ConvertToNodeKind:
+  case Kinded::Kind::DequantizeNodeKind:
+  case Kinded::Kind::QuantizeNodeKind:
+  case Kinded::Kind::RescaleQuantizedNodeKind:
+  case Kinded::Kind::ReshapeNodeKind:
+  case Kinded::Kind::SelectNodeKind:
+  case Kinded::Kind::SigmoidNodeKind:
+  case Kinded::Kind::SliceNodeKind:
+  case Kinded::Kind::TanhNodeKind:
+  case Kinded::Kind::TransposeNodeKind:
+    return true;
+  default:
+    return false;
+  }
+}
+
+/// \returns true if \p NV is known at compile time: a private variable that
+/// is not trained or a splat.
+static bool isConstant(NodeValue NV) {
+  if (isa<SplatNode>(NV.getNode())) {
+    return true;
+  }
+  auto *V = dyn_cast<Variable>(NV.getNode());
+  return V && V->isPrivate() && !V->isTraining();
+}
+
+/// \returns true if the node \p N can be evaluated at compile time by the
+/// backend \p B. At least one of its inputs must be a variable, so that the
+/// splats are not expanded into variables.
+static bool canFold(const Node *N, const Backend &B) {
+  if (!isFoldableKind(N) || N->hasPredicate() || !N->hasUsers()) {
+    return false;
+  }
+  bool hasVariableInput = false;
+  for (unsigned i = 0, e = N->getNumInputs(); i < e; i++) {
+    NodeValue in = N->getNthInput(i);
+    if (!isConstant(in) || !B.isOpSupported(N->getKind(), in.getElementType())) {
+      return false;
+    }
+    hasVariableInput |= isa<Variable>(in.getNode());
+  }
+  for (unsigned i = 0, e = N->getNumResults(); i < e; i++) {
+    if (!B.isOpSupported(N->getKind(), N->getElementType(i))) {
+      return false;
+    }
+  }
+  return hasVariableInput;
+}
+
+/// Evaluate the nodes \p nodes of \p F with the Interpreter and replace their
+/// results by new private variables.
+static void foldNodes(Function *F, llvm::ArrayRef<Node *> nodes) {
+  // The nodes are copied into a function of their own module, whose inputs
+  // are public, so that the optimizer doesn't fold them again.
+  Module tmpM;
+  Function *tmpF = tmpM.createFunction("constant_folding");
+  std::unordered_map<Node *, Node *> inputs;
+  auto getInput = [&](Node *in) -> Node * {
+    auto &tmpIn = inputs[in];
+    if (tmpIn) {
+      return tmpIn;
+    }
+    auto *ty = tmpM.uniqueType(*in->getType(0));
+    if (auto *V = dyn_cast<Variable>(in)) {
+      auto *tmpV = tmpM.createVariable(ty, V->getName(),
+                                       VisibilityKind::Public,
+                                       Variable::TrainKind::None);
+      tmpV->getPayload().copyRawFrom(&V->getPayload());
+      tmpIn = tmpV;
+    } else {
+      tmpIn = tmpF->addNode(in->clone());
+      tmpIn->setType(0, ty);
+    }
+    return tmpIn;
+  };
+
+  // The results of the nodes and the outputs that hold their values.
+  std::vector<std::pair<NodeValue, Variable *>> results;
+  for (auto *N : nodes) {
+    Node *tmpN = tmpF->addNode(N->clone());
+    for (unsigned i = 0, e = tmpN->getNumInputs(); i < e; i++) {
+      NodeValue &in = tmpN->getNthInput(i);
+      in = NodeValue(getInput(in.getNode()), in.getResNo());
+    }
+    for (unsigned i = 0, e = tmpN->getNumResults(); i < e; i++) {
+      tmpN->setType(i, tmpM.uniqueType(*N->getType(i)));
+      auto *save = tmpF->createSave("result", tmpN->getNthResult(i));
+      results.push_back({N->getNthResult(i), save->getVariable()});
+    }
+  }
+
+  lower(tmpF, CompilationMode::Infer);
+  IRFunction IR(tmpF);
+  IR.generateIR();
+  std::unique_ptr<Backend> interpreter(
+      createBackend(BackendKind::Interpreter, &IR));
+  interpreter->init();
+  interpreter->doForwardPass();
+
+  auto *M = F->getParent();
+  for (auto &result : results) {
+    NodeValue NV = result.first;
+    auto *V = M->createVariable(NV.getType(), NV->getName(),
+                                VisibilityKind::Private,
+                                Variable::TrainKind::None);
+    V->getPayload().copyRawFrom(&result.second->getPayload());
+    NV.replaceAllUsesOfWith(V);
+  }
+}
+
+void glow::constantFold(Function *F) {
+  std::unique_ptr<Backend> interpreter(
+      createBackend(BackendKind::Interpreter, nullptr));
+  // The folded nodes lose their users, and the nodes that use their results
+  // become foldable in the next round.
+  while (true) {
+    std::vector<Node *> nodes;
+    for (auto *N : F->getNodes()) {
+      if (canFold(N, *interpreter)) {
+        nodes.push_back(N);
+      }
+    }
+    if (nodes.empty()) {
+      return;
+    }
+    foldNodes(F, nodes);
+  }
+}
@@ -0,0 +1,119 @@
+/**
+ * Copyright (c) 2017-present, Facebook, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "glow/Backends/Backend.h"
+#include "glow/Graph/Graph.h"
+#include "glow/Graph/Node.h"
+#include "glow/Graph/Nodes.h"
+#include "glow/Optimizer/Optimizer.h"
+
+#include <unordered_map>
+#include <vector>
+
+using namespace glow;
+using llvm::dyn_cast;
+
+/// \returns true if the node \p N computes in float and the backend \p B
+/// supports it in float16.
+static bool canConvertToFloat16(const Node *N, const Backend &B) {
+  if (llvm::isa<ConvertToNode>(N) ||
+      !B.isOpSupported(N->getKind(), ElemKind::Float16Ty)) {
+    return false;
+  }
+  for (unsigned i = 0, e = N->getNumResults(); i < e; i++) {
+    if (N->getNthResult(i).getElementType() != ElemKind::FloatTy) {
+      return false;
+    }
+  }
+  return true;
+}
+
+/// Remove the pairs of conversions that cancel each other in \p F and replace
+/// the conversions of the private float variables with float16 variables.
+static void foldConversions(Function *F) {
+  auto *M = F->getParent();
+  // Maps the private float variables to their float16 copies.
+  std::unordered_map<Variable *, Variable *> converted;
+
+  for (auto *node : F->getNodes()) {
+    auto *CT = dyn_cast<ConvertToNode>(node);
+    if (!CT) {
+      continue;
+    }
+    NodeValue in = CT->getInput();
+
+    // ConvertTo(ConvertTo(X)) -> X, when the type of X is the type of the
+    // result.
+    if (auto *inCT = dyn_cast<ConvertToNode>(in.getNode())) {
+      if (inCT->getInput().getType() == CT->getResult().getType()) {
+        CT->getResult().replaceAllUsesOfWith(inCT->getInput());
+      }
+      continue;
+    }
+
+    // Convert the constant weights once, at compile time.
+    auto *V = dyn_cast<Variable>(in.getNode());
+    if (!V || !V->isPrivate() ||
+        CT->getResult().getElementType() != ElemKind::Float16Ty) {
+      continue;
+    }
+    auto &V16 = converted[V];
+    if (!V16) {
+      V16 = M->createVariable(ElemKind::Float16Ty, V->dims(), V->getName(),
+                              VisibilityKind::Private, Variable::TrainKind::None);
+      auto srcH = V->getHandle<float>();
+      auto destH = V16->getHandle<float16>();
+      for (size_t i = 0, e = srcH.size(); i < e; i++) {
+        destH.raw(i) = srcH.raw(i);
+      }
+    }
+    CT->getResult().replaceAllUsesOfWith(V16);
+  }
+}
+
+void glow::convertToFloat16(Function *F, const Backend &B) {
+  // Iterate over a copy of the node list, because the conversion adds new
+  // nodes to the function.
+  std::vector<Node *> nodes(F->getNodes().begin(), F->getNodes().end());
+  auto *M = F->getParent();
+
+  for (auto *node : nodes) {
+    if (!canConvertToFloat16(node, B)) {
+      continue;
+    }
+
+    // Compute a float16 copy of the node, keeping the invariant that all of
+    // the float values in the graph remain float.
+    Node *N16 = F->addNode(node->clone());
+    for (unsigned i = 0, e = N16->getNumInputs(); i < e; i++) {
+      NodeValue &in = N16->getNthInput(i);
+      if (in.getElementType() != ElemKind::FloatTy) {
+        continue;
+      }
+      in = F->createConvertTo("convert.fp16", in, ElemKind::Float16Ty);
+    }
+
+    for (unsigned i = 0, e = N16->getNumResults(); i < e; i++) {
+      N16->setType(i, M->uniqueType(ElemKind::Float16Ty, N16->dims(i)));
+      auto *back = F->createConvertTo("convert.fp32", N16->getNthResult(i),
+                                      ElemKind::FloatTy);
+      node->getNthResult(i).replaceAllUsesOfWith(back);
+    }
+  }
+
+  // The conversions between the consecutive float16 nodes cancel each other.
+  foldConversions(F);
+}
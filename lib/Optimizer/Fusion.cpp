@@ -0,0 +1,123 @@
+/**
+ * Copyright (c) 2017-present, Facebook, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "glow/Graph/Graph.h"
+#include "glow/Graph/Node.h"
+#include "glow/Optimizer/Optimizer.h"
+
+#include "llvm/ADT/SmallVector.h"
+
+#include <algorithm>
+#include <unordered_map>
+
+using namespace glow;
+
+/// The number of the uses of the nodes by the live nodes of a function. The
+/// nodes that were replaced by earlier fusions keep their operands until the
+/// next DCE, so they are not counted.
+using LiveUsesMap = std::unordered_map<const Node *, unsigned>;
+
+/// Add \p delta to the live uses in \p liveUses of the inputs of \p user.
+static void addLiveUses(LiveUsesMap &liveUses, const Node *user, int delta) {
+  for (unsigned i = 0, e = user->getNumInputs(); i < e; i++) {
+    liveUses[user->getNthInput(i).getNode()] += delta;
+  }
+}
+
+/// \returns the live uses of the nodes of \p F.
+static LiveUsesMap countLiveUses(Function *F) {
+  LiveUsesMap liveUses;
+  for (auto *user : F->getNodes()) {
+    if (user->hasUsers() || user->hasSideEffects()) {
+      addLiveUses(liveUses, user, 1);
+    }
+  }
+  return liveUses;
+}
+
+/// Match the chain of \p pattern that ends with \p root into \p chain, from
+/// the first producer to the root. Every producer is the first input of the
+/// next node with the kind of the pattern. \returns true if the chain matches.
+static bool matchChain(Node *root, const FusionPattern &pattern,
+                       const LiveUsesMap &liveUses,
+                       llvm::SmallVectorImpl<Node *> &chain) {
+  auto &kinds = pattern.kinds;
+  if (kinds.empty() || root->getKind() != kinds.back() ||
+      root->hasPredicate()) {
+    return false;
+  }
+  chain.assign(kinds.size(), nullptr);
+  chain.back() = root;
+  for (size_t i = kinds.size() - 1; i > 0; i--) {
+    Node *next = chain[i];
+    Node *producer = nullptr;
+    for (unsigned j = 0, e = next->getNumInputs(); j < e; j++) {
+      Node *in = next->getNthInput(j).getNode();
+      if (in->getKind() == kinds[i - 1]) {
+        producer = in;
+        break;
+      }
+    }
+    // The producer is computed only for the chain, so the fused node
+    // replaces it.
+    if (!producer || producer->hasPredicate()) {
+      return false;
+    }
+    auto it = liveUses.find(producer);
+    if (it == liveUses.end() || it->second != 1) {
+      return false;
+    }
+    chain[i - 1] = producer;
+  }
+  return true;
+}
+
+bool glow::fuse(Function *F, llvm::ArrayRef<FusionPattern> patterns) {
+  bool changed = false;
+  llvm::SmallVector<Node *, 4> chain;
+  // The uses are counted once, and then kept up to date with the fusions.
+  LiveUsesMap liveUses = countLiveUses(F);
+  auto &nodes = F->getNodes();
+  for (const auto &pattern : patterns) {
+    for (auto *node : nodes) {
+      // The replaced nodes are left to the DCE.
+      if (!node->hasUsers() || !matchChain(node, pattern, liveUses, chain)) {
+        continue;
+      }
+      Node *last = nodes.back();
+      Node *fused = pattern.fuse(F, chain);
+      if (!fused) {
+        continue;
+      }
+      assert(fused->getNumResults() == node->getNumResults() &&
+             "The fused node must have the results of the root");
+      for (unsigned i = 0, e = node->getNumResults(); i < e; i++) {
+        NodeValue(node, i).replaceAllUsesOfWith(NodeValue(fused, i));
+      }
+      // The nodes of the chain are dead now, and the nodes that the fusion
+      // created, which are appended to the function, use their operands.
+      for (auto *dead : chain) {
+        addLiveUses(liveUses, dead, -1);
+      }
+      for (auto it = std::next(nodes.getIterator(last)), e = nodes.end();
+           it != e; ++it) {
+        addLiveUses(liveUses, *it, 1);
+      }
+      changed = true;
+    }
+  }
+  return changed;
+}
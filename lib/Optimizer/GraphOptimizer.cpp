@@ -20,10 +20,13 @@
 #include "glow/Optimizer/Optimizer.h"
 #include "glow/Quantization/Quantization.h"
 
+#include "PassManager.h"
+
 #include "llvm/Support/Casting.h"
 
 #include <unordered_map>
 #include <unordered_set>
+#include <vector>
 
 using namespace glow;
 using llvm::cast;
@@ -57,31 +60,32 @@ static void DCE(Function *F) {
   auto &vars = F->getParent()->getVars();
 
   std::vector<VariablesList::iterator> erasedVars{};
-  std::vector<NodesList::iterator> erasedNodes{};
-
-  // Remove unused nodes. Do not remove unused vars because they are the
-  // interface to the user program.
-  bool changedLocally = true;
-  do {
-    changedLocally = false;
-    for (auto it = nodes.begin(), e = nodes.end(); it != e;) {
-      if (!shouldDeleteNode(*it)) {
-        ++it;
-        continue;
-      }
 
-      erasedNodes.push_back(it);
-      ++it;
-      changedLocally = true;
+  // Remove unused nodes. Erasing a node may leave its inputs unused, so they
+  // are checked again. This keeps the elimination linear in the size of the
+  // graph, even for long chains of dead nodes.
+  std::unordered_map<Node *, NodesList::iterator> positions;
+  std::vector<Node *> worklist;
+  for (auto it = nodes.begin(), e = nodes.end(); it != e; ++it) {
+    positions[*it] = it;
+    worklist.push_back(*it);
+  }
+  while (!worklist.empty()) {
+    Node *N = worklist.back();
+    worklist.pop_back();
+    auto pos = positions.find(N);
+    if (pos == positions.end() || !shouldDeleteNode(N)) {
+      continue;
     }
-
-    while (!erasedNodes.empty()) {
-      auto it = erasedNodes.back();
-      F->eraseNode(it);
-      erasedNodes.pop_back();
+    for (unsigned i = 0, e = N->getNumInputs(); i < e; i++) {
+      worklist.push_back(N->getNthInput(i).getNode());
     }
-
-  } while (changedLocally);
+    if (N->hasPredicate()) {
+      worklist.push_back(N->getPredicate().getNode());
+    }
+    F->eraseNode(pos->second);
+    positions.erase(pos);
+  }
 
   // Delete unused variables.
   for (auto it = vars.begin(), e = vars.end(); it != e;) {
@@ -132,21 +136,28 @@ bool isZero(Node *N) {
 /// \returns True if the node returns a constant value.
 bool isConstant(Node *N) { return isa<SplatNode>(N); }
 
-/// \returns the new simplified node or the original node.
-static Node *simplifyNode(Node *node, Function *F) {
+/// Maps the nodes to the nodes that they were simplified to.
+using SimplifiedMap = std::unordered_map<Node *, Node *>;
 
+static Node *simplifyNode(Node *node, Function *F, SimplifiedMap &simplified);
+
+/// \returns the new simplified node or the original node.
+static Node *simplifyNodeImpl(Node *node, Function *F,
+                              SimplifiedMap &simplified) {
 // Recursively simplify the operands of arithmetic nodes.
 #define SIMPLIFY_OPERANDS(NodeKind)                                            \
   if (auto *NN = dyn_cast<NodeKind##Node>(node)) {                             \
-    Node *LHS = simplifyNode(NN->getLHS(), F);                                 \
-    Node *RHS = simplifyNode(NN->getRHS(), F);                                 \
+    Node *LHS = simplifyNode(NN->getLHS(), F, simplified);                     \
+    Node *RHS = simplifyNode(NN->getRHS(), F, simplified);                     \
     if (LHS != NN->getLHS()) {                                                 \
       return simplifyNode(                                                     \
-          F->create##NodeKind(NN->getName(), LHS, NN->getRHS()), F);           \
+          F->create##NodeKind(NN->getName(), LHS, NN->getRHS()), F,            \
+          simplified);                                                         \
     }                                                                          \
     if (RHS != NN->getRHS()) {                                                 \
       return simplifyNode(                                                     \
-          F->create##NodeKind(NN->getName(), NN->getLHS(), RHS), F);           \
+          F->create##NodeKind(NN->getName(), NN->getLHS(), RHS), F,            \
+          simplified);                                                         \
     }                                                                          \
   }
 
@@ -205,6 +216,20 @@ static Node *simplifyNode(Node *node, Function *F) {
   return node;
 }
 
+/// \returns the new simplified node or the original node. \p simplified
+/// remembers the nodes that were simplified before, so that the operands that
+/// the nodes of a long chain share, like the hidden state of an unrolled RNN,
+/// are simplified once and not once for every path to them.
+static Node *simplifyNode(Node *node, Function *F, SimplifiedMap &simplified) {
+  auto it = simplified.find(node);
+  if (it != simplified.end()) {
+    return it->second;
+  }
+  Node *result = simplifyNodeImpl(node, F, simplified);
+  simplified[node] = result;
+  return result;
+}
+
 /// Code Sinking.
 /// \returns true if code sinking was successful.
 static bool sinkCode(Function *F) {
@@ -476,6 +501,13 @@ static void optimizeBatchNorm(Function *F) {
         continue;
       }
 
+      // The filter and the bias are updated in place, so they can't be
+      // shared with other variables.
+      if (cast<Variable>(CV->getFilter())->isPayloadShared() ||
+          cast<Variable>(CV->getBias())->isPayloadShared()) {
+        continue;
+      }
+
       // First, BN computation can be phrased as follows:
       //
       // (X - mean) * (1.0 / sqrt(var + eps)) * bn_scale + bias
@@ -610,11 +642,12 @@ static void optimizeArithmeticNodes(Function *F) {
     }
   }
 
+  SimplifiedMap simplified;
   while (!worklist.empty()) {
     Node *node = worklist.back();
     worklist.pop_back();
 
-    auto *sn = simplifyNode(node, F);
+    auto *sn = simplifyNode(node, F, simplified);
     if (sn != node) {
       node->getNthResult(0).replaceAllUsesOfWith(sn);
       // The simplified node could be further simplified.
@@ -648,6 +681,47 @@ static void optimizeTranspose(Function *F) {
   }
 }
 
+/// \returns the transpose node that swaps the two dimensions of the matrix
+/// \p NV, or null if \p NV is not the result of such a transpose.
+static TransposeNode *getMatrixTranspose(NodeValue NV) {
+  auto *TN = dyn_cast<TransposeNode>(NV);
+  if (!TN || TN->getShuffle().size() != 2 || TN->getShuffle()[0] != 1) {
+    return nullptr;
+  }
+  return TN;
+}
+
+/// Fold the transposes of the operands of the floating point matrix
+/// multiplications into the flags of the multiplications, which read the
+/// original operands in the transposed order.
+static void optimizeMatMulTranspose(Function *F) {
+  for (auto *node : F->getNodes()) {
+    auto *MM = dyn_cast<MatMulNode>(node);
+    if (!MM) {
+      continue;
+    }
+    auto elem = MM->getResult().getElementType();
+    if (elem != ElemKind::FloatTy && elem != ElemKind::Float16Ty) {
+      continue;
+    }
+    auto *LT = getMatrixTranspose(MM->getLHS());
+    auto *RT = getMatrixTranspose(MM->getRHS());
+    if (!LT && !RT) {
+      continue;
+    }
+    NodeValue LHS = LT ? LT->getInput() : MM->getLHS();
+    NodeValue RHS = RT ? RT->getInput() : MM->getRHS();
+    bool transposeLHS = MM->getTransposeLHS() != (LT != nullptr);
+    bool transposeRHS = MM->getTransposeRHS() != (RT != nullptr);
+    auto *newMM = F->createMatMul(MM->getName(), MM->getResult().getType(),
+                                  LHS, RHS, transposeLHS, transposeRHS);
+    if (MM->hasPredicate()) {
+      newMM->setPredicate(MM->getPredicate());
+    }
+    MM->getResult().replaceAllUsesOfWith(newMM);
+  }
+}
+
 namespace {
 
 /// A helper type for hasing Node pointers when they are used as keys in hash
@@ -682,6 +756,10 @@ struct CSEVisitor : NodeWalker {
   /// This callback is called after visiting the children of \p N.
   /// It means that all of its dependencies are processed already.
   void post(Node *parent, Node *N) override {
+    // Variables are only equal to themselves.
+    if (isa<Variable>(N)) {
+      return;
+    }
     // Try to find a node equivalent to the current one.
     auto FoundI = cseNodes_.find(N);
     if (FoundI == cseNodes_.end()) {
@@ -802,6 +880,18 @@ static void optimizeQuantizedMaxSplat(Function *F) {
   }
 }
 
+/// Quantize the payload of the float variable \p V into the variable \p NV,
+/// which has the quantized element type \p ElemTy, with the parameters \p TQP.
+template <class ElemTy>
+static void quantizeVariable(Variable *V, Variable *NV,
+                             const TensorQuantizationParams &TQP) {
+  auto srcHandle = V->getHandle();
+  auto destHandle = NV->getHandle<ElemTy>();
+  for (size_t i = 0, e = destHandle.size(); i < e; ++i) {
+    destHandle.raw(i) = quantization::quantize<ElemTy>(srcHandle.raw(i), TQP);
+  }
+}
+
 /// Eliminate node sequences that are related to quantization.
 static void optimizeQuantization(Function *F) {
   // A worklist that contains the nodes to process.
@@ -851,12 +941,20 @@ static void optimizeQuantization(Function *F) {
                                                   V->getVisibilityKind(),
                                                   V->getTrainKind(), 1.0);
         // Quantize V into NV.
-        auto srcHandle = V->getHandle();
-        auto destHandle = NV->getHandle<int8_t>();
         TensorQuantizationParams params{Q->getType()->getScale(),
                                         Q->getType()->getOffset()};
-        for (size_t i = 0, e = destHandle.size(); i < e; ++i) {
-          destHandle.raw(i) = quantization::quantize(srcHandle.raw(i), params);
+        switch (Q->getType()->getElementType()) {
+        case ElemKind::Int8QTy:
+          quantizeVariable<int8_t>(V, NV, params);
+          break;
+        case ElemKind::Int16QTy:
+          quantizeVariable<int16_t>(V, NV, params);
+          break;
+        case ElemKind::Int32QTy:
+          quantizeVariable<int32_t>(V, NV, params);
+          break;
+        default:
+          GLOW_UNREACHABLE("Invalid quantized type");
         }
         Q->getResult().replaceAllUsesOfWith(NV);
         continue;
@@ -913,9 +1011,11 @@ static void optimizeQuantization(Function *F) {
       FUSE_RESCALE_TO_ARITHMETIC_NODE(Div);
 #undef FUSE_RESCALE_TO_ARITHMETIC_NODE
 
-      // Merge the rescale node into the convolution.
+      // Merge the rescale node into the convolution, unless the rescale
+      // changes the element type, e.g. from int16 to int8.
       // Rescale(Conv()) -> Conv()
-      if (auto *CN = dyn_cast<ConvolutionNode>(RS->getInput())) {
+      auto *CN = dyn_cast<ConvolutionNode>(RS->getInput());
+      if (CN && CN->getResult().getElementType() == RS->getElementType()) {
         // Create the exact same convolution but with a different scaling
         // return type.
         auto *newCN =
@@ -926,6 +1026,38 @@ static void optimizeQuantization(Function *F) {
         continue;
       }
 
+      // Merge the rescale node into the requantization of the product of the
+      // matrix multiplications, whose accumulators are scaled to the output
+      // type anyway. The product is only recomputed with the new type if the
+      // rescale is its only user, so that it isn't computed twice.
+      // Rescale(MatMul()) -> MatMul()
+      // Rescale(FullyConnected()) -> FullyConnected()
+      // Rescale(BatchedAdd()) -> BatchedAdd()
+      Node *producer = RS->getInput().getNode();
+      if (producer->hasOneUse() &&
+          RS->getInput().getElementType() == RS->getElementType()) {
+        if (auto *MM = dyn_cast<MatMulNode>(producer)) {
+          auto *newMM = F->createMatMul(
+              MM->getName(), RS->getType(), MM->getLHS(), MM->getRHS(),
+              MM->getTransposeLHS(), MM->getTransposeRHS());
+          RS->getResult().replaceAllUsesOfWith(newMM);
+          continue;
+        }
+        if (auto *FC = dyn_cast<FullyConnectedNode>(producer)) {
+          auto *newFC = F->createFullyConnected(FC->getName(), FC->getInput(),
+                                                FC->getWeights(), FC->getBias(),
+                                                RS->getType());
+          RS->getResult().replaceAllUsesOfWith(newFC);
+          continue;
+        }
+        if (auto *BA = dyn_cast<BatchedAddNode>(producer)) {
+          auto *newBA = F->createBatchedAdd(BA->getName(), RS->getType(),
+                                            BA->getBatch(), BA->getSlice());
+          RS->getResult().replaceAllUsesOfWith(newBA);
+          continue;
+        }
+      }
+
       // Merge splat and rescale nodes.
       // Rescale(Splat()) -> Splat()
       if (auto *SP = dyn_cast<SplatNode>(RS->getInput())) {
@@ -963,51 +1095,60 @@ static void optimizeQuantization(Function *F) {
 }
 
 void glow::optimize(Function *F, CompilationMode mode) {
+  OptimizerPassManager PM("graph", [&] { return F->getNodes().size(); });
+
   // Sink transpose operations in an attempt to cancel them out.
   // Perform code sinking until a fixed-point is reached.
   // On big functions, the number of iterations until the fixpoint
   // is usually at most 2 or 3 iterations.
-  while (sinkCode(F)) {
+  while (PM.runChanged("sink-code", [&] { return sinkCode(F); })) {
     // Perform Dead Code Elimination between rounds of code sinking.
-    DCE(F);
+    PM.run("dce", [&] { DCE(F); });
   }
 
   // Optimize the pooling operation.
-  optimizePool(F);
+  PM.run("optimize-pool", [&] { optimizePool(F); });
 
   // Perform Common Subexpression Elimination.
-  CSE(F);
+  PM.run("cse", [&] { CSE(F); });
 
   // Perform Dead Code Elimination.
-  DCE(F);
+  PM.run("dce", [&] { DCE(F); });
 
   if (mode == CompilationMode::Infer) {
     // Merge batch normalization operations.
-    optimizeBatchNorm(F);
+    PM.run("optimize-batchnorm", [&] { optimizeBatchNorm(F); });
 
     // Constant-fold transpose operations.
-    optimizeTranspose(F);
+    PM.run("optimize-transpose", [&] { optimizeTranspose(F); });
+
+    // Evaluate the computations on the weights at compile time.
+    PM.run("constant-fold", [&] { constantFold(F); });
 
-    optimizeRegression(F);
+    PM.run("optimize-regression", [&] { optimizeRegression(F); });
   }
 
   // Perform Common Subexpression Elimination.
-  CSE(F);
+  PM.run("cse", [&] { CSE(F); });
 
   // Optimize Concat nodes.
-  optimizeConcatNodes(F);
+  PM.run("optimize-concat", [&] { optimizeConcatNodes(F); });
 
   // Optimize arithmetic nodes based on algebraic identities.
-  optimizeArithmeticNodes(F);
+  PM.run("optimize-arithmetic", [&] { optimizeArithmeticNodes(F); });
+
+  // Read the transposed operands of the matrix multiplications in place. This
+  // runs after the transposes of the weights were folded into new variables.
+  PM.run("optimize-matmul-transpose", [&] { optimizeMatMulTranspose(F); });
 
   // Optimize Tensor shape transformations.
-  optimizeSliceOfSplat(F);
+  PM.run("optimize-slice-of-splat", [&] { optimizeSliceOfSplat(F); });
 
-  optimizeReshape(F);
+  PM.run("optimize-reshape", [&] { optimizeReshape(F); });
 
   // Optimize things that are related to quantization.
-  optimizeQuantization(F);
+  PM.run("optimize-quantization", [&] { optimizeQuantization(F); });
 
   // Perform Dead Code Elimination.
-  DCE(F);
+  PM.run("dce", [&] { DCE(F); });
 }
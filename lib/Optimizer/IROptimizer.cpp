@@ -21,13 +21,19 @@
 #include "glow/IR/IRUtils.h"
 #include "glow/IR/Instrs.h"
 #include "glow/Optimizer/Optimizer.h"
+#include "glow/Support/Compiler.h"
 
+#include "PassManager.h"
+
+#include "llvm/ADT/Statistic.h"
 #include "llvm/Support/Casting.h"
 #include "llvm/Support/CommandLine.h"
 #include "llvm/Support/Debug.h"
 #include "llvm/Support/raw_ostream.h"
 
+#include <algorithm>
 #include <iostream>
+#include <map>
 #include <unordered_map>
 #include <unordered_set>
 
@@ -45,6 +51,10 @@ using llvm::cast;
 using llvm::dyn_cast;
 using llvm::isa;
 
+STATISTIC(NumWeightCopies, "Number of copies into the weights removed");
+STATISTIC(NumWeightCopyBytes,
+          "Number of bytes of copies into the weights removed per run");
+
 /// Live interval of a memory buffer.
 /// It represents a sequence of instructions [begin, end) where this buffer
 /// holds a value.
@@ -171,10 +181,107 @@ llvm::raw_ostream &operator<<(llvm::raw_ostream &os, const Interval &I) {
 }
 #endif
 
+/// Returns true if RHS is enclosed inside LHS.
+static bool isEnclosedInside(const Interval &lhs, const Interval &rhs) {
+  return lhs.begin_ < rhs.begin_ && rhs.end_ <= lhs.end_;
+}
+
 /// Set of intervals for a single memory buffer. If there is only one write into
 /// a memory buffer, it would contain a single interval. If there are multiple
 /// writes, it would contain multiple live intervals, one per write.
-using Intervals = llvm::SmallVector<Interval, 4>;
+///
+/// The intervals of a buffer never overlap, also after shareBuffers merged the
+/// intervals of other buffers into it. They are kept sorted by their beginning,
+/// so that finding the interval at an instruction and checking for an overlap
+/// take logarithmic time, even for the buffers that hold most of the values of
+/// a long chain of instructions.
+class Intervals {
+  /// Maps the beginning of every interval to the interval.
+  using IntervalMap = std::map<size_t, Interval>;
+  IntervalMap intervals_;
+
+public:
+  /// Iterates over the intervals in the order of their beginning.
+  class const_iterator {
+    IntervalMap::const_iterator it_;
+
+  public:
+    explicit const_iterator(IntervalMap::const_iterator it) : it_(it) {}
+    const Interval &operator*() const { return it_->second; }
+    const Interval *operator->() const { return &it_->second; }
+    const_iterator &operator++() {
+      ++it_;
+      return *this;
+    }
+    bool operator!=(const const_iterator &other) const {
+      return it_ != other.it_;
+    }
+  };
+
+  const_iterator begin() const { return const_iterator(intervals_.begin()); }
+  const_iterator end() const { return const_iterator(intervals_.end()); }
+  size_t size() const { return intervals_.size(); }
+  bool empty() const { return intervals_.empty(); }
+
+  const Interval &front() const { return intervals_.begin()->second; }
+  /// The end of the last interval may be extended while it is computed.
+  Interval &back() { return std::prev(intervals_.end())->second; }
+  const Interval &back() const { return std::prev(intervals_.end())->second; }
+
+  /// Adds \p I after the last interval.
+  void push_back(const Interval &I) {
+    assert((empty() || back().end_ <= I.begin_) &&
+           "The intervals must be added in order");
+    intervals_.emplace_hint(intervals_.end(), I.begin_, I);
+  }
+
+  /// Adds \p I, which must not overlap any of the intervals. An interval that
+  /// begins where another one does would be dropped by the map, so this is
+  /// checked in the release builds too.
+  void insert(const Interval &I) {
+    bool inserted = !overlaps(I) && intervals_.emplace(I.begin_, I).second;
+    GLOW_ASSERT(inserted && "The intervals of a buffer must not overlap");
+  }
+
+  /// Removes the interval \p I.
+  void erase(const Interval &I) {
+    auto it = intervals_.find(I.begin_);
+    assert(it != intervals_.end() && it->second == I &&
+           "Interval should exist in the list");
+    intervals_.erase(it);
+  }
+
+  /// \returns the interval covering the instruction slot \p instIdx, or
+  /// nullptr if there is none.
+  const Interval *getEnclosing(size_t instIdx) const {
+    auto it = intervals_.upper_bound(instIdx);
+    if (it == intervals_.begin()) {
+      return nullptr;
+    }
+    --it;
+    return instIdx < it->second.end_ ? &it->second : nullptr;
+  }
+
+  /// \returns true if any of the intervals overlaps with \p I. Because the
+  /// intervals don't overlap each other, only the last one that begins before
+  /// the end of \p I may overlap with it.
+  bool overlaps(const Interval &I) const {
+    auto it = intervals_.lower_bound(I.end_);
+    if (it == intervals_.begin()) {
+      return false;
+    }
+    return std::prev(it)->second.end_ > I.begin_;
+  }
+
+  /// \returns true if \p I is enclosed inside any of the intervals.
+  bool encloses(const Interval &I) const {
+    auto it = intervals_.lower_bound(I.begin_);
+    if (it == intervals_.begin()) {
+      return false;
+    }
+    return isEnclosedInside(std::prev(it)->second, I);
+  }
+};
 /// Maping from a memory buffer to its live intervals.
 using LiveIntervalsMap = std::unordered_map<Value *, Intervals>;
 /// Set of instructions.
@@ -344,7 +451,7 @@ static void deleteDeadAllocs(IRFunction &M) {
   llvm::SmallVector<Instruction *, 16> erasedInstructions{};
 
   // Remove all unused tensorviews.
-  for (auto &I : instrs) {
+  for (auto *I : instrs) {
     if (isa<TensorViewInst>(I) && I->getNumUsers() == 0) {
       erasedInstructions.push_back(I);
     }
@@ -357,7 +464,7 @@ static void deleteDeadAllocs(IRFunction &M) {
   erasedInstructions.clear();
 
   // Remove all of the DeallocActivationInst that close unused allocs.
-  for (auto &I : instrs) {
+  for (auto *I : instrs) {
     const auto *DA = dyn_cast<const DeallocActivationInst>(I);
     if (DA && DA->getAlloc()->getNumUsers() < 2) {
       erasedInstructions.push_back(I);
@@ -370,7 +477,7 @@ static void deleteDeadAllocs(IRFunction &M) {
   erasedInstructions.clear();
 
   // Remove the unused allocs.
-  for (auto &I : instrs) {
+  for (auto *I : instrs) {
     if (isa<const AllocActivationInst>(I) && I->getNumUsers() < 2) {
       erasedInstructions.push_back(I);
     }
@@ -407,7 +514,7 @@ static void replaceAllNonDeallocUsersWith(Value *val, Value *with) {
     if (Op.first->getType() != replacement->getType()) {
       // Perform a cast if required.
       auto *tv = B.createTensorViewInst(I->getName(), replacement,
-                                        Op.first->getType());
+                                        Op.first->getType(), {});
       M.moveInstruction(I, tv);
       replacement = tv;
     }
@@ -614,51 +721,14 @@ static void calculateLiveIntervals(const IRFunction &M,
   }
 }
 
-/// Provided a set of intervals, return the interval covering
-/// a given instruction.
-static Intervals::iterator getEnclosingInterval(Intervals &liveIntervals,
-                                                size_t instIdx) {
-  for (auto I = liveIntervals.begin(), E = liveIntervals.end(); I != E; ++I) {
-    if (I->begin_ <= instIdx && instIdx < I->end_)
-      return I;
-  }
-  return liveIntervals.end();
-}
-
-/// Returns true if RHS is enclosed inside LHS.
-static bool isEnclosedInside(Interval &lhs, Interval &rhs) {
-  return lhs.begin_ < rhs.begin_ && rhs.end_ <= lhs.end_;
-}
-
-/// \returns true of any intervals from \p Ints overlap with interval \p I.
-static bool hasOverlappingIntervals(Intervals &intervals, Interval I) {
-  for (const auto &curI : intervals) {
-    if (std::max(curI.begin_, I.begin_) < std::min(curI.end_, I.end_))
-      return true;
-  }
-  return false;
-}
-
 /// Moves an interval from one interval list to another.
-static void moveInterval(Intervals &from, Intervals &to, Interval &interval) {
-  auto fromIt = std::find(from.begin(), from.end(), interval);
-  assert(fromIt != from.end() && "Interval should exist in the from list");
+static void moveInterval(Intervals &from, Intervals &to, Interval interval) {
+  from.erase(interval);
   // Nothing to do if interval is enclosed into one of to intervals.
   // Add to the to list.
-  bool isEnclosed = false;
-  for (auto &I : to) {
-    if (isEnclosedInside(I, interval)) {
-      isEnclosed = true;
-      break;
-    }
-  }
-  if (!isEnclosed) {
-    to.push_back(interval);
-    // Let sort find a right position for it.
-    // std::sort(to.begin(), to.end());
+  if (!to.encloses(interval)) {
+    to.insert(interval);
   }
-  // Delete from the from list.
-  from.erase(fromIt);
 }
 
 /// Replace all uses of \p val by \p with inside interval \p liveInterval.
@@ -707,7 +777,7 @@ static void replaceAllUsesInsideIntervalWith(
       if (op->getType() != replacement->getType()) {
         // Perform a cast if required.
         auto *tv = B.createTensorViewInst((*it)->getName(), replacement,
-                                          op->getType());
+                                          op->getType(), {});
         M.moveInstruction(it, tv);
         replacement = tv;
       }
@@ -782,10 +852,10 @@ class BufferSharingOptimizer {
   Intervals &destIntervals_;
   /// The live interval of the source buffer, which covers the current
   /// instruction.
-  Interval *srcInterval_;
+  const Interval *srcInterval_;
   /// The live interval of the destination buffer, which covers the current
   /// instruction.
-  Interval *destInterval_;
+  const Interval *destInterval_;
 
   /// Pick the buffer that can be reused. To make a decision, check
   /// which intervals intersect with each other. In most cases, the buffers
@@ -816,10 +886,10 @@ class BufferSharingOptimizer {
     // If dest interval overlaps with any srcIntervals, it cannot be replaced.
     bool destIntvalCannotBeReplaced =
         !canCopyPropagate &&
-        hasOverlappingIntervals(srcIntervals_, *destInterval_);
+        srcIntervals_.overlaps(*destInterval_);
     // If src interval overlaps with any dest Intervals, it cannot be replaced.
     bool srcIntervalCannotBeReplaced =
-        hasOverlappingIntervals(destIntervals_, *srcInterval_);
+        destIntervals_.overlaps(*srcInterval_);
 
     if (!isDestLastIntervalOfObservable && !isSrcLastIntervalOfObservable &&
         !destIntvalCannotBeReplaced && !srcIntervalCannotBeReplaced) {
@@ -898,24 +968,16 @@ public:
     assert(!destIntervals_.empty() &&
            "Set of live intervals for a memory buffer cannot be empty");
     // Find the Src live interval that encloses the current instruction.
-    auto srcIntervalIt = getEnclosingInterval(
-        srcIntervals_,
+    srcInterval_ = srcIntervals_.getEnclosing(
         LiveIntervalsInstructionNumbering::getInstrReadSlotNumber(instrIdx_));
-    assert(srcIntervalIt != srcIntervals_.end() &&
-           "Cannot share buffers: cannot "
-           "find enclosing src interval");
+    assert(srcInterval_ && "Cannot share buffers: cannot "
+                           "find enclosing src interval");
 
     // Find the Dest live interval that encloses the current instruction.
-    auto destIntervalIt = getEnclosingInterval(
-        destIntervals_,
+    destInterval_ = destIntervals_.getEnclosing(
         LiveIntervalsInstructionNumbering::getInstrWriteSlotNumber(instrIdx_));
-    assert(destIntervalIt != destIntervals_.end() &&
-           "Cannot share buffers: cannot "
-           "find enclosing dest interval");
-
-    // Remember the found src and dest intervals.
-    srcInterval_ = srcIntervalIt;
-    destInterval_ = destIntervalIt;
+    assert(destInterval_ && "Cannot share buffers: cannot "
+                            "find enclosing dest interval");
   }
 
   /// Try to share buffers used by src and dest.
@@ -1202,8 +1264,8 @@ void performPeepholeOptimizations(IRFunction &M) {
       if (auto W = getSingleWriter(src)) {
         if (isa<SplatInst>(W)) {
           if (src->getType() != dest->getType()) {
-            auto *TVI =
-                B.createTensorViewInst(TI->getName(), src, dest->getType());
+            auto *TVI = B.createTensorViewInst(TI->getName(), src,
+                                               dest->getType(), {});
             M.moveInstruction(cur, instrs.back());
             src = TVI;
           }
@@ -1253,35 +1315,741 @@ void performPeepholeOptimizations(IRFunction &M) {
   }
 }
 
+/// \returns the index of the element at \p offsets in a tensor of the
+/// dimensions \p dims.
+static size_t getLinearIndex(llvm::ArrayRef<size_t> dims,
+                             llvm::ArrayRef<size_t> offsets) {
+  size_t index = 0;
+  for (size_t i = 0, e = dims.size(); i < e; i++) {
+    index = index * dims[i] + offsets[i];
+  }
+  return index;
+}
+
+/// \returns true if a tensor of the dimensions \p srcDims that is inserted
+/// into (or extracted from) a tensor of the dimensions \p destDims covers
+/// contiguous elements: the dimensions before the first one that it splits
+/// are 1 and the ones after it are whole.
+static bool isContiguousInsert(llvm::ArrayRef<size_t> destDims,
+                               llvm::ArrayRef<size_t> srcDims) {
+  size_t i = 0;
+  while (i < srcDims.size() && srcDims[i] == 1) {
+    i++;
+  }
+  for (i++; i < srcDims.size(); i++) {
+    if (srcDims[i] != destDims[i]) {
+      return false;
+    }
+  }
+  return true;
+}
+
+/// \returns the range of the elements of the origin of the operand \p idx of
+/// \p I that the instruction may access.
+static std::pair<size_t, size_t> getAccessedRange(const Instruction *I,
+                                                  unsigned idx) {
+  auto *V = I->getOperand(idx).first;
+  size_t begin = getOriginOffset(V);
+  auto *IT = dyn_cast<InsertTensorInst>(I);
+  if (!IT || idx != 0) {
+    return {begin, begin + V->size()};
+  }
+  // The insert writes the box between the offsets and the last element of its
+  // source.
+  auto dims = IT->getDest()->dims();
+  auto offsets = IT->getOffsets();
+  llvm::SmallVector<size_t, 6> last(offsets.begin(), offsets.end());
+  auto srcDims = IT->getSrc()->dims();
+  for (size_t i = 0, e = last.size(); i < e; i++) {
+    last[i] += srcDims[i] - 1;
+  }
+  return {begin + getLinearIndex(dims, offsets),
+          begin + getLinearIndex(dims, last) + 1};
+}
+
+/// Let the instructions that compute the source of the insert \p IT write
+/// directly into a view of its destination, and erase the insert.
+/// \returns true if the insert was erased.
+static bool writeInsertedTensorInPlace(IRFunction &M, InsertTensorInst *IT) {
+  auto *src = dyn_cast<AllocActivationInst>(IT->getSrc());
+  auto *dest = IT->getDest();
+  if (!src || !(isa<AllocActivationInst>(dest) || isa<WeightVar>(dest)) ||
+      !isContiguousInsert(dest->dims(), src->dims())) {
+    return false;
+  }
+  size_t begin = getLinearIndex(dest->dims(), IT->getOffsets());
+  size_t end = begin + src->size();
+
+  // The source must die at the insert.
+  auto srcIt = M.getInstrIterator(src);
+  auto insertIt = M.getInstrIterator(IT);
+  std::unordered_set<const Instruction *> between;
+  for (auto it = std::next(srcIt); it != insertIt; ++it) {
+    between.insert(*it);
+  }
+  DeallocActivationInst *srcDealloc = nullptr;
+  for (const auto &U : src->getUsers()) {
+    auto *I = U.get();
+    if (auto *DA = dyn_cast<DeallocActivationInst>(I)) {
+      srcDealloc = DA;
+      continue;
+    }
+    if (isa<TensorViewInst>(I) || (I != IT && !between.count(I))) {
+      return false;
+    }
+  }
+
+  // The instructions that write the source must not access its elements of
+  // the destination. The allocation and the initialization of the
+  // destination move above them.
+  Instruction *destAlloc = nullptr;
+  Instruction *destInit = nullptr;
+  bool accessesDest = false;
+  for (auto it = std::next(srcIt); it != insertIt; ++it) {
+    auto *I = *it;
+    if (I == dest) {
+      destAlloc = I;
+      continue;
+    }
+    if (isa<TensorViewInst>(I)) {
+      continue;
+    }
+    auto *SI = dyn_cast<SplatInst>(I);
+    if (SI && SI->getDest() == dest && !accessesDest) {
+      destInit = I;
+      accessesDest = true;
+      continue;
+    }
+    for (unsigned idx = 0, e = I->getNumOperands(); idx < e; idx++) {
+      if (getOrigin(I->getOperand(idx).first) != dest) {
+        continue;
+      }
+      accessesDest = true;
+      auto range = getAccessedRange(I, idx);
+      if (range.first < end && begin < range.second) {
+        return false;
+      }
+    }
+  }
+
+  DEBUG(llvm::dbgs() << "Writing " << src->getName() << " in place into "
+                     << dest->getName() << "\n");
+  if (destAlloc) {
+    M.moveInstruction(src, destAlloc);
+  }
+  if (destInit) {
+    M.moveInstruction(src, destInit);
+  }
+  IRBuilder B(&M);
+  auto *view = B.createTensorViewInst(src->getName(), dest, src->getType(),
+                                      IT->getOffsets());
+  M.moveInstruction(src, view);
+  replaceAllNonDeallocUsersWith(src, view);
+  M.eraseInstruction(IT);
+  if (srcDealloc) {
+    M.eraseInstruction(srcDealloc);
+  }
+  M.eraseInstruction(src);
+  return true;
+}
+
+/// Write the tensors that are inserted into a buffer, e.g. the inputs of a
+/// concat, directly into views of the buffer, instead of into buffers of
+/// their own that are copied. This removes the copies and the buffers of the
+/// inserted tensors.
+///
+/// The views have offsets and cover only a part of the buffer, but the
+/// liveness analysis of the passes above considers every write through a view
+/// as a write of the whole buffer. Therefore this pass runs after them.
+static void writeInsertedTensorsInPlace(IRFunction &M) {
+  std::vector<InsertTensorInst *> inserts;
+  for (auto *I : M.getInstrs()) {
+    if (auto *IT = dyn_cast<InsertTensorInst>(I)) {
+      inserts.push_back(IT);
+    }
+  }
+  for (auto *IT : inserts) {
+    writeInsertedTensorInPlace(M, IT);
+  }
+}
+
+/// Let the users of the destination of the extract \p ET read the extracted
+/// elements directly through a view of its source, and erase the extract.
+/// \returns true if the extract was erased.
+static bool readExtractedTensorInPlace(IRFunction &M, ExtractTensorInst *ET) {
+  auto *dest = dyn_cast<AllocActivationInst>(ET->getDest());
+  auto *src = ET->getSrc();
+  auto *srcOrigin = getOrigin(src);
+  if (!dest ||
+      !(isa<AllocActivationInst>(srcOrigin) || isa<WeightVar>(srcOrigin)) ||
+      !isContiguousInsert(src->dims(), dest->dims())) {
+    return false;
+  }
+
+  // The extract must be the only writer of the destination.
+  DeallocActivationInst *destDealloc = nullptr;
+  std::unordered_set<const Instruction *> destUsers;
+  for (const auto &U : dest->getUsers()) {
+    auto *I = U.get();
+    if (auto *DA = dyn_cast<DeallocActivationInst>(I)) {
+      destDealloc = DA;
+      continue;
+    }
+    if (I == ET) {
+      continue;
+    }
+    if (isa<TensorViewInst>(I) || U.getOperand().second != OperandKind::In) {
+      return false;
+    }
+    destUsers.insert(I);
+  }
+
+  // The source must not be written while the destination is read, and must
+  // stay alive until then.
+  DeallocActivationInst *srcDealloc = nullptr;
+  auto it = std::next(M.getInstrIterator(ET));
+  for (auto e = M.getInstrs().end(); it != e && !destUsers.empty(); ++it) {
+    auto *I = *it;
+    destUsers.erase(I);
+    if (auto *DA = dyn_cast<DeallocActivationInst>(I)) {
+      if (DA->getSrc() == srcOrigin) {
+        srcDealloc = DA;
+      }
+      continue;
+    }
+    if (isa<TensorViewInst>(I)) {
+      continue;
+    }
+    for (const auto &op : I->getOperands()) {
+      if (op.second != OperandKind::In && getOrigin(op.first) == srcOrigin) {
+        return false;
+      }
+    }
+  }
+  // The destination must not be read before the extract.
+  if (!destUsers.empty() || (srcDealloc && !destDealloc)) {
+    return false;
+  }
+
+  DEBUG(llvm::dbgs() << "Reading " << dest->getName() << " in place from "
+                     << srcOrigin->getName() << "\n");
+  if (srcDealloc) {
+    M.moveInstruction(destDealloc, srcDealloc);
+  }
+  IRBuilder B(&M);
+  auto *view = B.createTensorViewInst(dest->getName(), src, dest->getType(),
+                                      ET->getOffsets());
+  M.moveInstruction(ET, view);
+  M.eraseInstruction(ET);
+  replaceAllNonDeallocUsersWith(dest, view);
+  if (destDealloc) {
+    M.eraseInstruction(destDealloc);
+  }
+  M.eraseInstruction(dest);
+  return true;
+}
+
+/// Read the tensors that are extracted from a buffer, e.g. the outputs of a
+/// slice, directly through views of the buffer, instead of copying them into
+/// buffers of their own. This applies to the extracts of contiguous
+/// elements, which the views can describe, and extends the lifetime of the
+/// source buffer until the last read of the extracted tensor. Like the
+/// inserts, this runs after the passes that rely on the liveness of the
+/// buffers.
+static void readExtractedTensorsInPlace(IRFunction &M) {
+  std::vector<ExtractTensorInst *> extracts;
+  for (auto *I : M.getInstrs()) {
+    if (auto *ET = dyn_cast<ExtractTensorInst>(I)) {
+      extracts.push_back(ET);
+    }
+  }
+  for (auto *ET : extracts) {
+    readExtractedTensorInPlace(M, ET);
+  }
+}
+
+/// Let the instructions that compute the source of the copy \p CI into a
+/// weight write directly into the weight, and erase the copy. \returns the
+/// number of bytes that the copy moved, or 0 if it was kept.
+static size_t writeCopiedTensorInPlace(IRFunction &M, CopyInst *CI) {
+  auto *src = dyn_cast<AllocActivationInst>(getOrigin(CI->getSrc()));
+  auto *dest = CI->getDest();
+  auto *W = dyn_cast<WeightVar>(getOrigin(dest));
+  if (!src || !W || CI->getSrc()->size() != src->size()) {
+    return 0;
+  }
+
+  // The source must die at the copy.
+  auto srcIt = M.getInstrIterator(src);
+  auto copyIt = M.getInstrIterator(CI);
+  std::unordered_set<const Instruction *> between;
+  for (auto it = std::next(srcIt); it != copyIt; ++it) {
+    between.insert(*it);
+  }
+  DeallocActivationInst *srcDealloc = nullptr;
+  llvm::SmallVector<Value *, 4> worklist = {src};
+  while (!worklist.empty()) {
+    auto *V = worklist.pop_back_val();
+    for (const auto &U : V->getUsers()) {
+      auto *I = U.get();
+      if (auto *DA = dyn_cast<DeallocActivationInst>(I)) {
+        srcDealloc = DA;
+        continue;
+      }
+      if (I != CI && !between.count(I)) {
+        return 0;
+      }
+      if (auto *TV = dyn_cast<TensorViewInst>(I)) {
+        worklist.push_back(TV);
+      }
+    }
+  }
+
+  // The instructions that write the source must not access the copied
+  // elements of the weight, which they now write earlier.
+  size_t begin = getOriginOffset(dest);
+  size_t end = begin + dest->size();
+  for (auto it = std::next(srcIt); it != copyIt; ++it) {
+    auto *I = *it;
+    if (isa<TensorViewInst>(I)) {
+      continue;
+    }
+    for (unsigned idx = 0, e = I->getNumOperands(); idx < e; idx++) {
+      if (getOrigin(I->getOperand(idx).first) != W) {
+        continue;
+      }
+      auto range = getAccessedRange(I, idx);
+      if (range.first < end && begin < range.second) {
+        return 0;
+      }
+    }
+  }
+
+  DEBUG(llvm::dbgs() << "Writing " << src->getName() << " in place into "
+                     << W->getName() << "\n");
+  // The view starts at the copied elements of the weight.
+  std::vector<size_t> offsets;
+  if (begin || src->size() != W->size()) {
+    auto dims = W->dims();
+    offsets.resize(dims.size());
+    for (size_t i = dims.size(), rem = begin; i > 0; i--) {
+      offsets[i - 1] = rem % dims[i - 1];
+      rem /= dims[i - 1];
+    }
+  }
+  IRBuilder B(&M);
+  auto *view =
+      B.createTensorViewInst(src->getName(), W, src->getType(), offsets);
+  M.moveInstruction(src, view);
+  replaceAllNonDeallocUsersWith(src, view);
+  size_t bytes = dest->getType()->getSizeInBytes();
+  auto *copySrc = CI->getSrc();
+  M.eraseInstruction(CI);
+  // The views that only the copy used are dead.
+  for (Value *V : {copySrc, dest}) {
+    if (isa<TensorViewInst>(V) && !V->hasUsers()) {
+      M.eraseInstruction(cast<TensorViewInst>(V));
+    }
+  }
+  if (srcDealloc) {
+    M.eraseInstruction(srcDealloc);
+  }
+  M.eraseInstruction(src);
+  return bytes;
+}
+
+/// Let the instructions that compute the tensors that are copied into the
+/// weights, e.g. the results that the function saves, write directly into
+/// the weights, and erase the copies. The buffer sharing propagates most of
+/// these copies, but not the copies of views, like the reshaped results, or
+/// the copies whose weight is live elsewhere. Like the inserts, this runs
+/// after the passes that rely on the liveness of the buffers.
+static void writeCopiedTensorsInPlace(IRFunction &M) {
+  std::vector<CopyInst *> copies;
+  for (auto *I : M.getInstrs()) {
+    auto *CI = dyn_cast<CopyInst>(I);
+    if (CI && isa<WeightVar>(getOrigin(CI->getDest()))) {
+      copies.push_back(CI);
+    }
+  }
+  size_t bytes = 0;
+  for (auto *CI : copies) {
+    size_t copyBytes = writeCopiedTensorInPlace(M, CI);
+    if (copyBytes) {
+      NumWeightCopies++;
+      bytes += copyBytes;
+    }
+  }
+  NumWeightCopyBytes += bytes;
+  DEBUG(llvm::dbgs() << "Removed " << bytes
+                     << " bytes of copies into the weights per run\n");
+}
+
+/// \returns the number of bytes of the activations that are live at once at
+/// the peak of their memory, according to the live intervals \p liveness, and
+/// sets \p peakIdx to the slot number where the peak begins.
+static size_t findActivationsPeak(const LiveIntervalsMap &liveness,
+                                  size_t &peakIdx) {
+  // The live memory changes at the beginning and at the end of every live
+  // interval.
+  std::map<size_t, int64_t> deltas;
+  for (const auto &entry : liveness) {
+    auto *A = dyn_cast<AllocActivationInst>(entry.first);
+    if (!A) {
+      continue;
+    }
+    int64_t size = A->getType()->getSizeInBytes();
+    for (const auto &interval : entry.second) {
+      deltas[interval.begin_] += size;
+      deltas[interval.end_] -= size;
+    }
+  }
+  int64_t live = 0;
+  size_t peakSize = 0;
+  peakIdx = 0;
+  for (const auto &delta : deltas) {
+    live += delta.second;
+    if (live > int64_t(peakSize)) {
+      peakSize = live;
+      peakIdx = delta.first;
+    }
+  }
+  return peakSize;
+}
+
+namespace {
+/// Drops an activation that is live across the peak of the memory of the live
+/// activations, and recomputes it right before its first use after the peak.
+/// The inputs of the recomputed instruction that are not live at that point
+/// are recomputed as well, up to a depth, and the remaining ones are kept live.
+class ActivationRecomputer {
+  IRFunction &M_;
+  /// The max number of instructions recomputed for a single activation.
+  unsigned maxDepth_;
+  LiveIntervalsMap liveness_;
+  LiveIntervalsInstructionNumbering numbering_;
+  /// The numbers of the instructions that write each memory location.
+  std::unordered_map<Value *, std::vector<size_t>> writes_;
+  /// The number of the read slot of the instruction where the live memory of
+  /// the activations peaks, and its size in bytes.
+  size_t peakIdx_{0};
+  size_t peakSize_{0};
+
+  /// The activations to recompute before the instruction number \p q_, in the
+  /// order of their recomputation, and the instructions that produce them.
+  size_t q_{0};
+  std::vector<AllocActivationInst *> order_;
+  std::unordered_map<Value *, Instruction *> producers_;
+  /// The activations that must stay live across the peak until \p q_.
+  std::unordered_set<AllocActivationInst *> extended_;
+
+  /// \returns true if \p loc is written after the instruction number \p begin
+  /// and before the instruction number \p end.
+  bool isWrittenBetween(Value *loc, size_t begin, size_t end) const {
+    auto it = writes_.find(loc);
+    if (it == writes_.end()) {
+      return false;
+    }
+    for (auto idx : it->second) {
+      if (begin < idx && idx < end) {
+        return true;
+      }
+    }
+    return false;
+  }
+
+  /// \returns the instruction that writes \p A, if it writes nothing else and
+  /// \p A is written only once and is not accessed through views.
+  Instruction *getRecomputableProducer(AllocActivationInst *A) {
+    auto &intervals = liveness_[A];
+    if (intervals.size() != 1 || !intervals.front().sameValue_) {
+      return nullptr;
+    }
+    Instruction *P = *numbering_.getInstr(intervals.front().begin_);
+    if (P->hasPredicate()) {
+      return nullptr;
+    }
+    for (const auto &op : P->getOperands()) {
+      if (op.second == OperandKind::InOut ||
+          (op.second == OperandKind::Out && op.first != A)) {
+        return nullptr;
+      }
+    }
+    for (const auto &U : A->getUsers()) {
+      if (isa<TensorViewInst>(U.get())) {
+        return nullptr;
+      }
+    }
+    return P;
+  }
+
+  /// Plans the recomputation of \p A before the instruction number \p q_.
+  /// \returns false if \p A can't be recomputed there.
+  bool plan(AllocActivationInst *A, unsigned depth) {
+    if (producers_.count(A)) {
+      return true;
+    }
+    Instruction *P = getRecomputableProducer(A);
+    if (!P) {
+      return false;
+    }
+    size_t p = numbering_.getInstrNumber(P);
+    for (const auto &op : P->getOperands()) {
+      if (op.second == OperandKind::Out) {
+        continue;
+      }
+      Value *origin = getOrigin(op.first);
+      if (isWrittenBetween(origin, p, q_)) {
+        return false;
+      }
+      auto *OA = dyn_cast<AllocActivationInst>(origin);
+      // The weights don't change until q_, and keeping alive the activations
+      // that are live at the peak costs nothing.
+      if (!OA || liveness_[OA].back().end_ > peakIdx_) {
+        continue;
+      }
+      if (op.first == OA && depth + 1 < maxDepth_ && plan(OA, depth + 1)) {
+        continue;
+      }
+      extended_.insert(OA);
+    }
+    order_.push_back(A);
+    producers_[A] = P;
+    return true;
+  }
+
+  /// \returns the number of bytes that the planned recomputation saves at the
+  /// peak.
+  int64_t getGain(AllocActivationInst *A) const {
+    int64_t gain = A->getType()->getSizeInBytes();
+    for (auto *OA : extended_) {
+      gain -= OA->getType()->getSizeInBytes();
+    }
+    return gain;
+  }
+
+  /// Inserts the planned recomputation of \p A and makes the uses of \p A at
+  /// or after q_ read the recomputed value.
+  void commit(AllocActivationInst *A) {
+    auto where = numbering_.getInstr(q_);
+    std::unordered_map<Value *, Value *> recomputed;
+    for (auto *OA : order_) {
+      auto *alloc = new AllocActivationInst(&M_, OA->getName(), OA->getType());
+      M_.insertInstruction(where, alloc);
+      Instruction *I = producers_[OA]->clone();
+      for (unsigned i = 0, e = I->getNumOperands(); i < e; i++) {
+        Value *op = I->getOperand(i).first;
+        if (op == OA) {
+          I->setOperand(i, alloc);
+        } else if (recomputed.count(op)) {
+          I->setOperand(i, recomputed[op]);
+        }
+      }
+      M_.insertInstruction(where, I);
+      M_.insertInstruction(new DeallocActivationInst(&M_, "dealloc", alloc));
+      recomputed[OA] = alloc;
+    }
+
+    llvm::SmallVector<Use, 8> lateUses;
+    for (const auto &U : A->getUsers()) {
+      if (!isa<DeallocActivationInst>(U.get()) &&
+          numbering_.getInstrNumber(U.get()) >= int64_t(q_)) {
+        lateUses.push_back(U);
+      }
+    }
+    for (auto &U : lateUses) {
+      U.setOperand(recomputed[A]);
+    }
+  }
+
+public:
+  ActivationRecomputer(IRFunction &M, unsigned maxDepth)
+      : M_(M), maxDepth_(std::max(maxDepth, 1u)), numbering_(M) {
+    calculateLiveIntervals(M, liveness_);
+    peakSize_ = findActivationsPeak(liveness_, peakIdx_);
+    peakIdx_ =
+        LiveIntervalsInstructionNumbering::getInstrReadSlotNumber(peakIdx_);
+
+    for (auto *I : M.getInstrs()) {
+      for (const auto &op : I->getOperands()) {
+        if (op.second != OperandKind::In && !isa<DeallocActivationInst>(I)) {
+          writes_[getOrigin(op.first)].push_back(numbering_.getInstrNumber(I));
+        }
+      }
+    }
+  }
+
+  /// \returns the number of bytes of the activations live at the peak.
+  size_t getPeakSize() const { return peakSize_; }
+
+  /// Recomputes the activation that saves the most memory at the peak.
+  /// \returns false if no activation can be recomputed.
+  bool recomputeAtPeak() {
+    AllocActivationInst *best = nullptr;
+    size_t bestQ = 0;
+    int64_t bestGain = 0;
+    for (const auto &entry : liveness_) {
+      auto *A = dyn_cast<AllocActivationInst>(entry.first);
+      if (!A || entry.second.size() != 1 ||
+          entry.second.front().begin_ >= peakIdx_ ||
+          entry.second.front().end_ <= peakIdx_ + 1) {
+        continue;
+      }
+      // Find the first use after the peak. The activations used at the peak
+      // must stay live.
+      size_t q = SIZE_MAX;
+      bool usedAtPeak = false;
+      for (const auto &U : A->getUsers()) {
+        if (isa<DeallocActivationInst>(U.get())) {
+          continue;
+        }
+        size_t idx = numbering_.getInstrNumber(U.get());
+        usedAtPeak |= idx == peakIdx_;
+        if (idx > peakIdx_) {
+          q = std::min(q, idx);
+        }
+      }
+      if (usedAtPeak || q == SIZE_MAX) {
+        continue;
+      }
+
+      q_ = q;
+      order_.clear();
+      producers_.clear();
+      extended_.clear();
+      if (plan(A, 0) && getGain(A) > bestGain) {
+        best = A;
+        bestQ = q;
+        bestGain = getGain(A);
+      }
+    }
+
+    if (!best) {
+      return false;
+    }
+    q_ = bestQ;
+    order_.clear();
+    producers_.clear();
+    extended_.clear();
+    plan(best, 0);
+    commit(best);
+    return true;
+  }
+};
+} // namespace
+
+void glow::recomputeActivations(IRFunction &M, size_t budget,
+                                unsigned maxDepth) {
+  // The live intervals are computed over the straight-line order of the
+  // instructions.
+  if (M.hasLoops()) {
+    return;
+  }
+  // Every step recomputes one activation, and the instructions are renumbered.
+  for (size_t i = 0, e = M.getInstrs().size(); i < e; i++) {
+    ActivationRecomputer recomputer(M, maxDepth);
+    if (recomputer.getPeakSize() <= budget || !recomputer.recomputeAtPeak()) {
+      break;
+    }
+  }
+  M.verify();
+}
+
+size_t glow::getActivationsPeak(IRFunction &M) {
+  LiveIntervalsMap liveness;
+  calculateLiveIntervals(M, liveness);
+  size_t peakIdx;
+  return findActivationsPeak(liveness, peakIdx);
+}
+
+void glow::dumpActivationsPeak(IRFunction &M, llvm::raw_ostream &os) {
+  LiveIntervalsMap liveness;
+  calculateLiveIntervals(M, liveness);
+  size_t peakIdx;
+  size_t peakSize = findActivationsPeak(liveness, peakIdx);
+  if (!peakSize) {
+    os << "No activations are live\n";
+    return;
+  }
+  LiveIntervalsInstructionNumbering numbering(M);
+  Instruction *I = *numbering.getInstr(peakIdx);
+
+  std::vector<AllocActivationInst *> live;
+  for (const auto &entry : liveness) {
+    auto *A = dyn_cast<AllocActivationInst>(entry.first);
+    if (!A) {
+      continue;
+    }
+    for (const auto &interval : entry.second) {
+      if (interval.begin_ <= peakIdx && peakIdx < interval.end_) {
+        live.push_back(A);
+        break;
+      }
+    }
+  }
+  std::sort(live.begin(), live.end(),
+            [](AllocActivationInst *a, AllocActivationInst *b) {
+              return a->getType()->getSizeInBytes() >
+                     b->getType()->getSizeInBytes();
+            });
+
+  os << "Peak of the activations: " << peakSize << " bytes at instruction "
+     << I->getName() << " (" << I->getKindName() << ")\n";
+  os << "Live activations at the peak:\n";
+  for (auto *A : live) {
+    os << "  " << A->getName() << ": " << A->getType()->getSizeInBytes()
+       << " bytes, " << *A->getType() << "\n";
+  }
+}
+
 /// Perform optimizations on the IR representation.
 void glow::optimize(IRFunction &M, CompilationMode mode) {
   M.verify();
   if (!optimizeIR)
     return;
 
-  performPeepholeOptimizations(M);
+  OptimizerPassManager PM("ir", [&] { return M.getInstrs().size(); });
+
+  // The liveness and the dependencies of the optimizations below are computed
+  // over the straight-line order of the instructions, which doesn't hold in
+  // the loops.
+  if (M.hasLoops()) {
+    PM.run("make-weights-const", [&] { makeWeightsConst(M); });
+    PM.run("debug-instrumentation", [&] { performDebugInstrumentation(M); });
+    M.verify();
+    return;
+  }
+
+  PM.run("peephole", [&] { performPeepholeOptimizations(M); });
 
-  eliminateDeadStores(M);
+  PM.run("dead-store-elimination", [&] { eliminateDeadStores(M); });
 
   // Reuse buffers from previous operations.
-  shareBuffers(M);
+  PM.run("share-buffers", [&] { shareBuffers(M); });
 
-  performPeepholeOptimizations(M);
+  PM.run("peephole", [&] { performPeepholeOptimizations(M); });
 
   // Shorten the lifetime of buffers.
-  hoistDealloc(M);
-  sinkAllocas(M);
+  PM.run("hoist-dealloc", [&] { hoistDealloc(M); });
+  PM.run("sink-allocas", [&] { sinkAllocas(M); });
 
   // Perform Dead Store Elimination.
-  eliminateDeadStores(M);
+  PM.run("dead-store-elimination", [&] { eliminateDeadStores(M); });
+
+  PM.run("delete-dead-allocs", [&] { deleteDeadAllocs(M); });
 
-  deleteDeadAllocs(M);
+  // Write the inserted and the copied tensors and read the extracted tensors
+  // in place. These must be the last of the optimizations that rely on the
+  // liveness of the buffers.
+  PM.run("insert-in-place", [&] { writeInsertedTensorsInPlace(M); });
+  PM.run("extract-in-place", [&] { readExtractedTensorsInPlace(M); });
+  PM.run("copy-in-place", [&] { writeCopiedTensorsInPlace(M); });
 
   // Turn read-only weights into constant weights.
-  makeWeightsConst(M);
+  PM.run("make-weights-const", [&] { makeWeightsConst(M); });
 
   // Perform a debug instrumentation if required.
-  performDebugInstrumentation(M);
+  PM.run("debug-instrumentation", [&] { performDebugInstrumentation(M); });
 
   M.verify();
 }
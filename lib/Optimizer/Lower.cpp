@@ -20,6 +20,7 @@
 #include "glow/Graph/Nodes.h"
 #include "glow/Optimizer/Optimizer.h"
 
+#include "llvm/ADT/STLExtras.h"
 #include "llvm/Support/Casting.h"
 
 using namespace glow;
@@ -97,6 +98,29 @@ void lowerFullyConnectedNode(Function *F, FullyConnectedNode &FC) {
   auto wDim = FC.getWeights().dims();
   auto *X = F->createReshape("fc.1X", FC.getInput(), {xDim.first, xDim.second});
 
+  if (X->getResult().getElementType() == ElemKind::Int16QTy) {
+    // The int16 activations are multiplied by the int8 weights into the int32
+    // accumulator, which has the product of their scales and no offset. The
+    // int32 bias has the same type, and the sum is requantized to the output.
+    TypeRef accTy = F->getParent()->uniqueType(
+        ElemKind::Int32QTy, {xDim.first, wDim[1]},
+        X->getResult().getType()->getScale() *
+            FC.getWeights().getType()->getScale(),
+        0);
+    auto *mul = F->createMatMul("fc.dot", accTy, X, FC.getWeights());
+    auto *add = F->createBatchedAdd("fc.add.bias", accTy, mul, FC.getBias());
+    auto *RS = F->createRescaleQuantized("fc.rescale", add,
+                                         FC.getResult()->getType());
+    FC.getResult().replaceAllUsesOfWith(RS);
+
+    if (FC.hasPredicate()) {
+      RS->setPredicate(FC.getPredicate());
+      add->setPredicate(FC.getPredicate());
+      mul->setPredicate(FC.getPredicate());
+    }
+    return;
+  }
+
   TypeRef outTy = F->getParent()->uniqueTypeWithNewShape(
       FC.getResult()->getType(), {xDim.first, wDim[1]});
   auto *mul = F->createMatMul("fc.dot", outTy, X, FC.getWeights());
@@ -118,16 +142,17 @@ void lowerFullyConnectedGradNode(Function *F, FullyConnectedGradNode &FCG) {
   auto xDims = flattenCdr(FCG.getInput().dims());
 
   // dx = dout * w.T
-  auto *wT = F->createTranspose("fcg.wT", FCG.getWeights(), {1, 0});
-  auto *dx2 = F->createMatMul("fcg.dot", dout, wT);
+  auto *dx2 = F->createMatMul("fcg.dot", dout, FCG.getWeights(),
+                              /* transposeLHS */ false,
+                              /* transposeRHS */ true);
   auto *dx = F->createReshape("fcg.inG", dx2, FCG.getInput().getType()->dims());
   FCG.getGradOfInputNamedInput().replaceAllUsesOfWith(dx);
 
   // dw = xT * dout.
   Node *x2 =
       F->createReshape("fcg.x", FCG.getInput(), {xDims.first, xDims.second});
-  auto *x2T = F->createTranspose("fcg.xT", x2, {1, 0});
-  auto *dw = F->createMatMul("fcg.dot", x2T, dout);
+  auto *dw = F->createMatMul("fcg.dot", x2, dout, /* transposeLHS */ true,
+                             /* transposeRHS */ false);
   FCG.getGradOfInputNamedWeights().replaceAllUsesOfWith(dw);
 
   // db = reduce(dout).
@@ -181,6 +206,78 @@ void lowerSigmoidGradNode(Function *F, SigmoidGradNode &THG) {
   THG.getGradOfInputNamedInput().replaceAllUsesOfWith(grad);
 }
 
+/// \returns the [B, H] slice of the gate \p gate of the [B, 4H] gates
+/// \p input of an LSTM cell step.
+static Node *sliceLSTMGate(Function *F, NodeValue input, unsigned gate) {
+  unsigned batch = input.dims()[0];
+  unsigned hidden = input.dims()[1] / 4;
+  return F->createSlice("lstm.gate", input, {0, gate * hidden},
+                        {batch, (gate + 1) * hidden});
+}
+
+void lowerLSTMUnitNode(Function *F, LSTMUnitNode &LU) {
+  // C' = sigmoid(F) . C + sigmoid(I) . tanh(G)
+  // H' = sigmoid(O) . tanh(C')
+  NodeValue in = LU.getInput();
+  auto *f = F->createSigmoid("lstm.f", sliceLSTMGate(F, in, 0));
+  auto *i = F->createSigmoid("lstm.i", sliceLSTMGate(F, in, 1));
+  auto *o = F->createSigmoid("lstm.o", sliceLSTMGate(F, in, 2));
+  auto *g = F->createTanh("lstm.g", sliceLSTMGate(F, in, 3));
+  auto *newC = F->createAdd("lstm.c", F->createMul("lstm.fc", f, LU.getC()),
+                            F->createMul("lstm.ig", i, g));
+  auto *newH = F->createMul("lstm.h", o, F->createTanh("lstm.tc", newC));
+  LU.getNewC().replaceAllUsesOfWith(newC);
+  LU.getNewH().replaceAllUsesOfWith(newH);
+}
+
+void lowerLSTMUnitGradNode(Function *F, LSTMUnitGradNode &LUG) {
+  // The gates and tanh(C') are recomputed from the inputs of the cell step:
+  // dC'' = dC' + dH' . O . (1 - tanh(C')^2), which is the full gradient of C'
+  // dC = dC'' . F
+  // dF = dC'' . C . F . (1 - F)
+  // dI = dC'' . G . I . (1 - I)
+  // dO = dH' . tanh(C') . O . (1 - O)
+  // dG = dC'' . I . (1 - G^2)
+  NodeValue in = LUG.getInput();
+  NodeValue C = LUG.getC();
+  NodeValue dNewC = LUG.getGradOfOriginalOutputNamedNewC();
+  NodeValue dNewH = LUG.getGradOfOriginalOutputNamedNewH();
+  auto *f = F->createSigmoid("lstm.f", sliceLSTMGate(F, in, 0));
+  auto *i = F->createSigmoid("lstm.i", sliceLSTMGate(F, in, 1));
+  auto *o = F->createSigmoid("lstm.o", sliceLSTMGate(F, in, 2));
+  auto *g = F->createTanh("lstm.g", sliceLSTMGate(F, in, 3));
+  auto *tc = F->createTanh("lstm.tc", LUG.getOriginalOutputForNewC());
+  auto *one = F->createSplat("lstm.one", C.getType(), 1.0);
+
+  // \returns x . (1 - x), the derivative of the sigmoid that computed x.
+  auto sigmoidGrad = [&](Node *x) -> Node * {
+    return F->createMul("lstm.sig.grad", x,
+                        F->createSub("lstm.sig.1x", one, x));
+  };
+  // \returns 1 - x^2, the derivative of the tanh that computed x.
+  auto tanhGrad = [&](Node *x) -> Node * {
+    return F->createSub("lstm.tanh.grad", one,
+                        F->createMul("lstm.tanh.x2", x, x));
+  };
+
+  auto *dC2 = F->createAdd(
+      "lstm.dc", dNewC,
+      F->createMul("lstm.dh.c", F->createMul("lstm.dh.o", dNewH, o),
+                   tanhGrad(tc)));
+  auto *dC = F->createMul("lstm.dc.prev", dC2, f);
+  auto *dF = F->createMul("lstm.df", F->createMul("lstm.dc.c", dC2, C),
+                          sigmoidGrad(f));
+  auto *dI = F->createMul("lstm.di", F->createMul("lstm.dc.g", dC2, g),
+                          sigmoidGrad(i));
+  auto *dO = F->createMul("lstm.do", F->createMul("lstm.dh.tc", dNewH, tc),
+                          sigmoidGrad(o));
+  auto *dG = F->createMul("lstm.dg", F->createMul("lstm.dc.i", dC2, i),
+                          tanhGrad(g));
+  auto *dIn = F->createConcat("lstm.dgates", {dF, dI, dO, dG}, 1);
+  LUG.getGradOfInputNamedInput().replaceAllUsesOfWith(dIn);
+  LUG.getGradOfInputNamedC().replaceAllUsesOfWith(dC);
+}
+
 void lowerReluNode(Function *F, ReluNode &R) {
   // Relu is a max between zero and the input value.
   SplatNode *zero = F->createSplat("zero", R.getType(), 0.0);
@@ -525,11 +622,17 @@ void lowerGroupConvolutionNode(Function *F, ConvolutionNode &BNG) {
   BNG.getResult().replaceAllUsesOfWith(result);
 }
 
-void glow::lower(Function *F, CompilationMode mode, Backend *B) {
+/// Lower the nodes of \p F for which \p shouldLower returns true.
+static void lowerNodes(Function *F, CompilationMode mode,
+                       llvm::function_ref<bool(Node *)> shouldLower) {
   auto &nodes = F->getNodes();
 
   for (auto const &node : nodes) {
-    if (B && !B->shouldLower(node)) {
+    // The backends run the batch normalization of training as a whole. In
+    // inference it is an affine transform, which is lowered so that it folds
+    // into the neighbouring arithmetic.
+    if (!shouldLower(node) && (mode == CompilationMode::Train ||
+                               !llvm::isa<BatchNormalizationNode>(node))) {
       continue;
     }
     if (auto *RN = dyn_cast<RegressionNode>(node)) {
@@ -556,6 +659,10 @@ void glow::lower(Function *F, CompilationMode mode, Backend *B) {
       lowerTanhGradNode(F, *THG);
     } else if (auto *SG = dyn_cast<SigmoidGradNode>(node)) {
       lowerSigmoidGradNode(F, *SG);
+    } else if (auto *LU = dyn_cast<LSTMUnitNode>(node)) {
+      lowerLSTMUnitNode(F, *LU);
+    } else if (auto *LUG = dyn_cast<LSTMUnitGradNode>(node)) {
+      lowerLSTMUnitGradNode(F, *LUG);
     } else if (auto *SGD = dyn_cast<SGDNode>(node)) {
       lowerSGDNode(F, *SGD);
     } else if (auto *BN = dyn_cast<BatchNormalizationNode>(node)) {
@@ -570,9 +677,20 @@ void glow::lower(Function *F, CompilationMode mode, Backend *B) {
     }
   }
 
+  // The lowered SGD nodes have no users and are erased explicitly. The
+  // backends that kept them run the fused update.
   for (auto it = F->getNodes().begin(), e = F->getNodes().end(); it != e;) {
     auto cur = *(it++);
-    if (dyn_cast<SGDNode>(cur))
+    if (dyn_cast<SGDNode>(cur) && shouldLower(cur))
       F->eraseNode(cur);
   }
 }
+
+void glow::lower(Function *F, CompilationMode mode, Backend *B) {
+  lowerNodes(F, mode, [B](Node *N) { return !B || B->shouldLower(N); });
+}
+
+void glow::lower(Function *F, CompilationMode mode, BackendKind backendKind) {
+  lowerNodes(F, mode,
+             [backendKind](Node *N) { return shouldLower(backendKind, N); });
+}
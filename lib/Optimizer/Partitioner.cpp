@@ -0,0 +1,404 @@
+/**
+ * Copyright (c) 2017-present, Facebook, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "glow/Backends/Backend.h"
+#include "glow/Graph/Graph.h"
+#include "glow/Graph/Node.h"
+#include "glow/Graph/Nodes.h"
+#include "glow/Optimizer/Optimizer.h"
+#include "glow/Support/Compiler.h"
+
+#include "llvm/Support/Casting.h"
+
+#include <algorithm>
+#include <map>
+#include <set>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+using namespace glow;
+using llvm::dyn_cast;
+using llvm::isa;
+
+/// The cost of moving a byte between two backends, in the units of
+/// getComputeCost, i.e. in arithmetic operations.
+static constexpr size_t transferCostPerByte = 4;
+
+namespace {
+/// A sequence of nodes that run on the same backend.
+struct Run {
+  /// The index of the backend.
+  unsigned backend;
+  /// The nodes, in the order in which they run.
+  std::vector<Node *> nodes;
+};
+
+/// The nodes of a function and the nodes that use their results.
+struct NodeGraph {
+  std::vector<Node *> nodes;
+  std::unordered_map<const Node *, std::vector<Node *>> users;
+
+  explicit NodeGraph(Function *F) {
+    for (auto *N : F->getNodes()) {
+      GLOW_ASSERT(!N->hasPredicate() && "Can't partition predicated nodes");
+      nodes.push_back(N);
+      for (unsigned i = 0, e = N->getNumInputs(); i < e; i++) {
+        Node *in = N->getNthInput(i).getNode();
+        if (!isa<Variable>(in)) {
+          users[in].push_back(N);
+        }
+      }
+    }
+  }
+};
+} // namespace
+
+/// \returns true if the backends of kind \p kind support the kind of the node
+/// \p N with the element types of all of its inputs and results.
+static bool isKindSupported(const Node *N, BackendKind kind) {
+  if (isa<SaveNode>(N)) {
+    return true;
+  }
+  for (unsigned i = 0, e = N->getNumInputs(); i < e; i++) {
+    if (!isOpSupported(kind, N->getKind(),
+                       N->getNthInput(i).getType()->getElementType())) {
+      return false;
+    }
+  }
+  for (unsigned i = 0, e = N->getNumResults(); i < e; i++) {
+    if (!isOpSupported(kind, N->getKind(), N->getElementType(i))) {
+      return false;
+    }
+  }
+  return true;
+}
+
+/// \returns true if the backends of kind \p kind support the node \p N of \p F
+/// once it is lowered for them in the mode \p mode, i.e. all of the nodes
+/// that the lowering replaces \p N with, e.g. the arithmetic of a batch
+/// normalization.
+static bool isSupported(Function *F, Node *N, BackendKind kind,
+                        CompilationMode mode) {
+  if (isa<SaveNode>(N)) {
+    return true;
+  }
+  // Lower a copy of the node in a scratch function. The copy reads the same
+  // inputs, and it is left without users if it is lowered.
+  auto *M = F->getParent();
+  std::string name = F->getName().str() + "_lowering";
+  for (unsigned suffix = 0; M->hasFunction(name); suffix++) {
+    name = F->getName().str() + "_lowering" + std::to_string(suffix);
+  }
+  auto *scratch = M->createFunction(name);
+  Node *copy = scratch->addNode(N->clone());
+  lower(scratch, mode, kind);
+  bool supported = true;
+  bool lowered = false;
+  for (auto *L : scratch->getNodes()) {
+    if (L != copy) {
+      supported &= isKindSupported(L, kind);
+      lowered = true;
+    }
+  }
+  if (!lowered) {
+    supported = isKindSupported(copy, kind);
+  }
+  M->eraseFunction(scratch);
+  return supported;
+}
+
+/// \returns an estimate of the number of arithmetic operations of \p N.
+static size_t getComputeCost(const Node *N) {
+  size_t size = 0;
+  for (unsigned i = 0, e = N->getNumResults(); i < e; i++) {
+    size += N->getNthResult(i).getType()->size();
+  }
+  if (auto *CN = dyn_cast<ConvolutionNode>(N)) {
+    auto *filterTy = CN->getFilter().getType();
+    return size * (filterTy->size() / filterTy->dims()[0]);
+  }
+  if (auto *FC = dyn_cast<FullyConnectedNode>(N)) {
+    return size * FC->getWeights().dims()[0];
+  }
+  if (auto *MM = dyn_cast<MatMulNode>(N)) {
+    return size * MM->getLHS().dims()[MM->getTransposeLHS() ? 0 : 1];
+  }
+  return size;
+}
+
+/// \returns the nodes of \p G in an order in which every node follows its
+/// inputs, grouped into runs by their backends \p backendOf. The ready nodes
+/// on the backend of the previous node are preferred, so that the runs are as
+/// long as possible, and then the ready nodes on the earlier backends.
+static std::vector<Run>
+scheduleRuns(const NodeGraph &G,
+             const std::unordered_map<const Node *, unsigned> &backendOf,
+             unsigned numBackends) {
+  std::unordered_map<const Node *, unsigned> numPendingInputs;
+  std::vector<std::vector<Node *>> ready(numBackends);
+  for (auto *N : G.nodes) {
+    unsigned pending = 0;
+    for (unsigned i = 0, e = N->getNumInputs(); i < e; i++) {
+      pending += !isa<Variable>(N->getNthInput(i).getNode());
+    }
+    numPendingInputs[N] = pending;
+    if (!pending) {
+      ready[backendOf.at(N)].push_back(N);
+    }
+  }
+
+  std::vector<Run> runs;
+  for (size_t scheduled = 0; scheduled < G.nodes.size(); scheduled++) {
+    unsigned backend = runs.empty() ? 0 : runs.back().backend;
+    if (ready[backend].empty()) {
+      backend = 0;
+      while (ready[backend].empty()) {
+        backend++;
+        assert(backend < numBackends && "The graph has a cycle");
+      }
+    }
+    Node *N = ready[backend].back();
+    ready[backend].pop_back();
+    if (runs.empty() || runs.back().backend != backend) {
+      runs.push_back({backend, {}});
+    }
+    runs.back().nodes.push_back(N);
+
+    auto it = G.users.find(N);
+    if (it == G.users.end()) {
+      continue;
+    }
+    for (auto *user : it->second) {
+      if (--numPendingInputs[user] == 0) {
+        ready[backendOf.at(user)].push_back(user);
+      }
+    }
+  }
+  return runs;
+}
+
+/// \returns the number of bytes that the run \p r of \p runs receives from and
+/// sends to the other runs. \p runOf maps the nodes to the indices of their
+/// runs.
+static size_t
+getTransferSize(const NodeGraph &G, const std::vector<Run> &runs, size_t r,
+                const std::unordered_map<const Node *, size_t> &runOf) {
+  std::set<std::pair<const Node *, unsigned>> values;
+  for (auto *N : runs[r].nodes) {
+    for (unsigned i = 0, e = N->getNumInputs(); i < e; i++) {
+      const NodeValue &in = N->getNthInput(i);
+      if (!isa<Variable>(in.getNode()) && runOf.at(in.getNode()) != r) {
+        values.insert({in.getNode(), in.getResNo()});
+      }
+    }
+    auto it = G.users.find(N);
+    if (it == G.users.end()) {
+      continue;
+    }
+    for (auto *user : it->second) {
+      if (runOf.at(user) == r) {
+        continue;
+      }
+      for (unsigned i = 0, e = user->getNumInputs(); i < e; i++) {
+        const NodeValue &in = user->getNthInput(i);
+        if (in.getNode() == N) {
+          values.insert({N, in.getResNo()});
+        }
+      }
+    }
+  }
+  size_t size = 0;
+  for (auto &value : values) {
+    size += value.first->getType(value.second)->getSizeInBytes();
+  }
+  return size;
+}
+
+/// Copy the runs \p runs of the nodes of \p F into functions of their own,
+/// in the same order. \p runOf maps the nodes to the indices of their runs.
+static std::vector<Function *>
+createRunFunctions(Function *F, const std::vector<Run> &runs,
+                   std::unordered_map<const Node *, size_t> &runOf) {
+  // The values that cross the runs are saved into public variables, which
+  // the later runs read.
+  auto *M = F->getParent();
+  std::vector<Function *> functions;
+  std::unordered_map<const Node *, Node *> clones;
+  std::map<std::pair<const Node *, unsigned>, Variable *> transfers;
+  for (size_t r = 0; r < runs.size(); r++) {
+    std::string name;
+    for (unsigned suffix = r; name.empty() || M->hasFunction(name);
+         suffix += runs.size()) {
+      name = F->getName().str() + "_part" + std::to_string(suffix);
+    }
+    auto *P = M->createFunction(name);
+    functions.push_back(P);
+    for (auto *N : runs[r].nodes) {
+      Node *C = P->addNode(N->clone());
+      clones[N] = C;
+      for (unsigned i = 0, e = C->getNumInputs(); i < e; i++) {
+        NodeValue &in = C->getNthInput(i);
+        Node *src = in.getNode();
+        if (isa<Variable>(src)) {
+          continue;
+        }
+        unsigned resNo = in.getResNo();
+        if (runOf[src] == r) {
+          in = NodeValue(clones[src], resNo);
+          continue;
+        }
+        auto &V = transfers[{src, resNo}];
+        if (!V) {
+          auto *srcF = functions[runOf[src]];
+          V = srcF->createSave(src->getName(), NodeValue(clones[src], resNo))
+                  ->getVariable();
+        }
+        in = NodeValue(V, 0);
+      }
+    }
+  }
+  return functions;
+}
+
+std::vector<std::pair<Function *, BackendKind>>
+glow::partition(Function *F, CompilationMode mode,
+                llvm::ArrayRef<BackendKind> backends) {
+  assert(!backends.empty() && "No backends to partition for");
+  NodeGraph G(F);
+
+  // Find the backends that support every node once it is lowered for them.
+  std::unordered_map<const Node *, std::vector<bool>> supports;
+  for (auto *N : G.nodes) {
+    for (auto kind : backends) {
+      supports[N].push_back(isSupported(F, N, kind, mode));
+    }
+  }
+
+  // Start with every node on the first backend that supports it. The saves
+  // run on the backend of the value that they save.
+  std::unordered_map<const Node *, unsigned> backendOf;
+  for (auto *N : G.nodes) {
+    unsigned b = 0;
+    while (b < backends.size() && !supports[N][b]) {
+      b++;
+    }
+    GLOW_ASSERT(b < backends.size() &&
+                "None of the backends supports the node");
+    backendOf[N] = b;
+  }
+  for (auto *N : G.nodes) {
+    if (auto *SN = dyn_cast<SaveNode>(N)) {
+      Node *in = SN->getInput().getNode();
+      backendOf[N] = isa<Variable>(in) ? 0 : backendOf[in];
+    }
+  }
+
+  // Move the runs that don't compute enough to pay for their transfers to the
+  // backend of a neighboring run that supports all of their nodes. The nodes
+  // only move to the later backends, so that this terminates.
+  std::vector<Run> runs;
+  std::unordered_map<const Node *, size_t> runOf;
+  for (bool changed = true; changed;) {
+    changed = false;
+    runs = scheduleRuns(G, backendOf, backends.size());
+    runOf.clear();
+    for (size_t r = 0; r < runs.size(); r++) {
+      for (auto *N : runs[r].nodes) {
+        runOf[N] = r;
+      }
+    }
+
+    for (size_t r = 0; r < runs.size() && !changed; r++) {
+      size_t work = 0;
+      for (auto *N : runs[r].nodes) {
+        work += getComputeCost(N);
+      }
+      if (work >= getTransferSize(G, runs, r, runOf) * transferCostPerByte) {
+        continue;
+      }
+      for (size_t nb : {r - 1, r + 1}) {
+        if (nb >= runs.size() || runs[nb].backend <= runs[r].backend) {
+          continue;
+        }
+        unsigned target = runs[nb].backend;
+        bool supported = true;
+        for (auto *N : runs[r].nodes) {
+          supported &= supports[N][target];
+        }
+        if (!supported) {
+          continue;
+        }
+        for (auto *N : runs[r].nodes) {
+          backendOf[N] = target;
+        }
+        changed = true;
+        break;
+      }
+    }
+  }
+
+  if (runs.size() <= 1) {
+    return {{F, backends[runs.empty() ? 0 : runs[0].backend]}};
+  }
+
+  std::vector<std::pair<Function *, BackendKind>> partitions;
+  auto functions = createRunFunctions(F, runs, runOf);
+  for (size_t r = 0; r < runs.size(); r++) {
+    partitions.push_back({functions[r], backends[runs[r].backend]});
+  }
+  return partitions;
+}
+
+std::vector<Function *> glow::splitIntoStages(Function *F,
+                                              unsigned numStages) {
+  assert(numStages && "No stages to split into");
+  NodeGraph G(F);
+  std::unordered_map<const Node *, unsigned> backendOf;
+  for (auto *N : G.nodes) {
+    backendOf[N] = 0;
+  }
+  auto order = scheduleRuns(G, backendOf, 1);
+  if (order.empty()) {
+    return {F};
+  }
+
+  // Cut the nodes in the order of the schedule where the cost so far crosses
+  // the next multiple of the cost of a stage. The saves cost nothing, so they
+  // stay in the stage of the value that they save when they follow it.
+  size_t total = 0;
+  for (auto *N : order[0].nodes) {
+    total += isa<SaveNode>(N) ? 0 : std::max<size_t>(getComputeCost(N), 1);
+  }
+  std::vector<Run> runs;
+  std::unordered_map<const Node *, size_t> runOf;
+  size_t cost = 0;
+  for (auto *N : order[0].nodes) {
+    if (runs.empty() ||
+        (!isa<SaveNode>(N) && runs.size() < numStages &&
+         cost * numStages >= total * runs.size())) {
+      runs.push_back({unsigned(runs.size()), {}});
+    }
+    runs.back().nodes.push_back(N);
+    runOf[N] = runs.size() - 1;
+    cost += isa<SaveNode>(N) ? 0 : std::max<size_t>(getComputeCost(N), 1);
+  }
+  if (runs.size() <= 1) {
+    return {F};
+  }
+  return createRunFunctions(F, runs, runOf);
+}
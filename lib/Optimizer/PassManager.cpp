@@ -0,0 +1,139 @@
+/**
+ * Copyright (c) 2017-present, Facebook, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#define DEBUG_TYPE "optimizer-pass-manager"
+
+#include "PassManager.h"
+
+#include "llvm/Support/CommandLine.h"
+#include "llvm/Support/Debug.h"
+#include "llvm/Support/Format.h"
+#include "llvm/Support/raw_ostream.h"
+
+#include <algorithm>
+#include <chrono>
+#include <map>
+#include <mutex>
+#include <vector>
+
+using namespace glow;
+
+static llvm::cl::list<std::string> skipPasses(
+    "skip-optimizer-passes",
+    llvm::cl::desc("The graph and IR optimizer passes that are not run, "
+                   "e.g. graph-cse,ir-share-buffers"),
+    llvm::cl::CommaSeparated, llvm::cl::ZeroOrMore, llvm::cl::Hidden);
+static llvm::cl::opt<bool> timePasses(
+    "time-optimizer-passes",
+    llvm::cl::desc("Print the wall time and the node or instruction count "
+                   "changes of the graph and IR optimizer passes at exit"),
+    llvm::cl::init(false));
+
+namespace {
+/// The statistics of a pass, accumulated over all of its runs.
+struct PassStats {
+  unsigned runs{0};
+  double seconds{0};
+  long long sizeChange{0};
+};
+
+/// The statistics of all of the passes, which are printed at exit. The
+/// functions may be compiled on several threads.
+class PassReport {
+  std::mutex mutex_;
+  std::map<std::string, PassStats> stats_;
+
+public:
+  PassReport() {
+    // Construct the stream before the report, so that it outlives it.
+    llvm::errs();
+  }
+
+  void record(const std::string &name, double seconds, long long sizeChange) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto &stats = stats_[name];
+    stats.runs++;
+    stats.seconds += seconds;
+    stats.sizeChange += sizeChange;
+  }
+
+  ~PassReport() {
+    if (stats_.empty()) {
+      return;
+    }
+    std::vector<std::pair<std::string, PassStats>> passes(stats_.begin(),
+                                                          stats_.end());
+    std::sort(passes.begin(), passes.end(), [](const auto &a, const auto &b) {
+      return a.second.seconds > b.second.seconds;
+    });
+    double total = 0;
+    for (auto &pass : passes) {
+      total += pass.second.seconds;
+    }
+
+    auto &os = llvm::errs();
+    os << "===" << std::string(73, '-') << "===\n"
+       << "                      Glow optimizer pass execution report\n"
+       << "===" << std::string(73, '-') << "===\n"
+       << llvm::format("  Total Execution Time: %.4f seconds\n\n", total)
+       << "   Wall Time    Runs   Size Change  Name\n";
+    for (auto &pass : passes) {
+      auto &stats = pass.second;
+      os << llvm::format("  %10.4f  %6u  %12lld  %s\n", stats.seconds,
+                         stats.runs, stats.sizeChange, pass.first.c_str());
+    }
+    os << llvm::format("  %10.4f                        Total\n", total);
+    os.flush();
+  }
+};
+
+PassReport &getReport() {
+  static PassReport report;
+  return report;
+}
+} // namespace
+
+void OptimizerPassManager::run(llvm::StringRef name,
+                               llvm::function_ref<void()> pass) {
+  runChanged(name, [&]() {
+    pass();
+    return true;
+  });
+}
+
+bool OptimizerPassManager::runChanged(llvm::StringRef name,
+                                      llvm::function_ref<bool()> pass) {
+  std::string fullName = optimizer_ + "-" + name.str();
+  if (std::find(skipPasses.begin(), skipPasses.end(), fullName) !=
+      skipPasses.end()) {
+    DEBUG(llvm::dbgs() << "Skipping " << fullName << "\n");
+    return false;
+  }
+
+  size_t sizeBefore = getSize_();
+  auto start = std::chrono::steady_clock::now();
+  bool changed = pass();
+  std::chrono::duration<double> elapsed =
+      std::chrono::steady_clock::now() - start;
+  size_t sizeAfter = getSize_();
+
+  DEBUG(llvm::dbgs() << fullName << ": " << sizeBefore << " -> " << sizeAfter
+                     << " in " << elapsed.count() << "s\n");
+  if (timePasses) {
+    getReport().record(fullName, elapsed.count(),
+                       (long long)sizeAfter - (long long)sizeBefore);
+  }
+  return changed;
+}
@@ -0,0 +1,53 @@
+/**
+ * Copyright (c) 2017-present, Facebook, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#ifndef GLOW_OPTIMIZER_PASSMANAGER_H
+#define GLOW_OPTIMIZER_PASSMANAGER_H
+
+#include "llvm/ADT/STLExtras.h"
+#include "llvm/ADT/StringRef.h"
+
+#include <cstddef>
+#include <functional>
+#include <string>
+
+namespace glow {
+
+/// Runs the passes of one of the optimizers, e.g. the graph or the IR
+/// optimizer, and records their wall time and their effect on the size of the
+/// optimized unit. The passes named by -skip-optimizer-passes are not run, and
+/// -time-optimizer-passes prints the statistics of all of the passes at exit.
+class OptimizerPassManager {
+  /// The name of the optimizer, which prefixes the names of its passes.
+  std::string optimizer_;
+  /// \returns the size of the optimized unit, e.g. its number of nodes.
+  std::function<size_t()> getSize_;
+
+public:
+  OptimizerPassManager(llvm::StringRef optimizer,
+                       std::function<size_t()> getSize)
+      : optimizer_(optimizer), getSize_(std::move(getSize)) {}
+
+  /// Run the pass \p name implemented by \p pass, unless it is skipped.
+  void run(llvm::StringRef name, llvm::function_ref<void()> pass);
+
+  /// Run the pass \p name implemented by \p pass, which \returns whether it
+  /// changed the unit. \returns false if the pass is skipped.
+  bool runChanged(llvm::StringRef name, llvm::function_ref<bool()> pass);
+};
+
+} // namespace glow
+
+#endif // GLOW_OPTIMIZER_PASSMANAGER_H
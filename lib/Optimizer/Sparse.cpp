@@ -0,0 +1,128 @@
+/**
+ * Copyright (c) 2017-present, Facebook, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "glow/Backends/Backend.h"
+#include "glow/Graph/Graph.h"
+#include "glow/Graph/Node.h"
+#include "glow/Graph/Nodes.h"
+#include "glow/Optimizer/Optimizer.h"
+
+#include "llvm/Support/CommandLine.h"
+
+#include <algorithm>
+#include <vector>
+
+using namespace glow;
+using llvm::dyn_cast;
+
+static llvm::cl::opt<float> sparseWeightsThreshold(
+    "sparse-weights-threshold",
+    llvm::cl::desc("The min fraction of zero weights of a fully connected "
+                   "layer for which the weights are stored in the sparse "
+                   "format. Above 1 the weights always stay dense"),
+    llvm::cl::init(0.8));
+
+/// \returns the sparse fully connected node that replaces \p FC in \p F, or
+/// nullptr if the weights of \p FC are not constant or not sparse enough.
+static Node *sparsifyFullyConnected(Function *F, FullyConnectedNode *FC) {
+  auto *W = dyn_cast<Variable>(FC->getWeights().getNode());
+  if (!W || !W->isPrivate() || !W->hasOneUse() ||
+      W->getElementType() != ElemKind::FloatTy ||
+      FC->getResult().getElementType() != ElemKind::FloatTy) {
+    return nullptr;
+  }
+
+  auto WH = W->getHandle<float>();
+  size_t numRows = W->dims()[0];
+  size_t numCols = W->dims()[1];
+  size_t numNonzeros = 0;
+  for (size_t i = 0, e = WH.size(); i < e; i++) {
+    numNonzeros += WH.raw(i) != 0;
+  }
+  if (numNonzeros > (1 - sparseWeightsThreshold) * WH.size()) {
+    return nullptr;
+  }
+
+  // Store the nonzero weights column by column, because every column computes
+  // one output channel.
+  auto *M = F->getParent();
+  // An empty tensor is not allowed, so a zero matrix keeps a zero value.
+  size_t size = std::max<size_t>(numNonzeros, 1);
+  auto *values = M->createVariable(
+      ElemKind::FloatTy, {size}, W->getName().str() + ".values",
+      VisibilityKind::Private, Variable::TrainKind::None);
+  auto *indices = M->createVariable(
+      ElemKind::Int32QTy, {size}, 1.0, 0, W->getName().str() + ".indices",
+      VisibilityKind::Private, Variable::TrainKind::None);
+  auto *offsets = M->createVariable(
+      ElemKind::Int32QTy, {numCols + 1}, 1.0, 0,
+      W->getName().str() + ".offsets", VisibilityKind::Private,
+      Variable::TrainKind::None);
+  auto valuesH = values->getHandle<float>();
+  auto indicesH = indices->getHandle<int32_t>();
+  auto offsetsH = offsets->getHandle<int32_t>();
+
+  size_t k = 0;
+  for (size_t d = 0; d < numCols; d++) {
+    offsetsH.raw(d) = k;
+    for (size_t i = 0; i < numRows; i++) {
+      float w = WH.at({i, d});
+      if (w != 0) {
+        valuesH.raw(k) = w;
+        indicesH.raw(k) = i;
+        k++;
+      }
+    }
+  }
+  offsetsH.raw(numCols) = k;
+
+  // The sparse fully connected node requires a 2D input.
+  NodeValue input = FC->getInput();
+  auto idim = flattenCdr(input.dims());
+  if (input.dims().size() != 2) {
+    input = F->createReshape("fc.2D", input, {idim.first, idim.second});
+  }
+  auto *SFC = F->createSparseFullyConnected(FC->getName(), input, values,
+                                            indices, offsets, FC->getBias(),
+                                            FC->getResult().getType());
+  if (FC->hasPredicate()) {
+    SFC->setPredicate(FC->getPredicate());
+  }
+  return SFC;
+}
+
+bool glow::sparsifyWeights(Function *F, const Backend &B) {
+  if (!B.isOpSupported(Kinded::Kind::SparseFullyConnectedNodeKind,
+                       ElemKind::FloatTy)) {
+    return false;
+  }
+
+  // Iterate over a copy of the node list, because new nodes are added to the
+  // function.
+  std::vector<Node *> nodes(F->getNodes().begin(), F->getNodes().end());
+  bool changed = false;
+  for (auto *node : nodes) {
+    auto *FC = dyn_cast<FullyConnectedNode>(node);
+    if (!FC) {
+      continue;
+    }
+    if (auto *SFC = sparsifyFullyConnected(F, FC)) {
+      FC->getResult().replaceAllUsesOfWith(SFC);
+      changed = true;
+    }
+  }
+  return changed;
+}
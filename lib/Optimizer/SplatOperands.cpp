@@ -0,0 +1,159 @@
+/**
+ * Copyright (c) 2017-present, Facebook, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "glow/Backends/Backend.h"
+#include "glow/Graph/Graph.h"
+#include "glow/Graph/Node.h"
+#include "glow/Graph/Nodes.h"
+#include "glow/Optimizer/Optimizer.h"
+
+#include <vector>
+
+using namespace glow;
+using llvm::cast;
+using llvm::dyn_cast;
+
+/// \returns the splat that computes \p V, or nullptr.
+static SplatNode *getSplat(NodeValue V) {
+  return dyn_cast<SplatNode>(V.getNode());
+}
+
+/// Replace the result of the node \p N of \p F by a new NodeTy of the kind
+/// \p kind, which computes it from the inputs \p inputs and the value of the
+/// splat operand \p value, if the backend \p B supports it. The operand that
+/// is not a splat must have the type of the result, so that the quantized
+/// kernels see the same scale in both. The index tensors keep their splats,
+/// whose values may not be represented exactly by the float immediate.
+/// \returns true if \p N was replaced.
+template <class NodeTy, class... Inputs>
+static bool replaceWithSplatOperand(Function *F, const Backend &B,
+                                    Kinded::Kind kind, Node *N,
+                                    NodeValue input, float value,
+                                    Inputs... inputs) {
+  NodeValue result(N, 0);
+  if (input.getType() != result.getType() || result.getType()->isIndexType() ||
+      !B.isOpSupported(kind, result.getElementType())) {
+    return false;
+  }
+  auto *NN = F->addNode(
+      new NodeTy(N->getName(), result.getType(), inputs..., input, value));
+  if (N->hasPredicate()) {
+    NN->setPredicate(N->getPredicate());
+  }
+  result.replaceAllUsesOfWith(NN);
+  return true;
+}
+
+/// Replace the commutative node \p N of \p F by a NodeTy of the kind \p kind
+/// if one of its operands is a splat.
+template <class NodeTy, class ArithNodeTy>
+static bool replaceCommutative(Function *F, const Backend &B,
+                               Kinded::Kind kind, ArithNodeTy *N) {
+  if (auto *splat = getSplat(N->getRHS())) {
+    return replaceWithSplatOperand<NodeTy>(F, B, kind, N, N->getLHS(),
+                                           splat->getValue());
+  }
+  if (auto *splat = getSplat(N->getLHS())) {
+    return replaceWithSplatOperand<NodeTy>(F, B, kind, N, N->getRHS(),
+                                           splat->getValue());
+  }
+  return false;
+}
+
+/// Replace the node \p N of \p F by a LHSNodeTy of the kind \p lhsKind if its
+/// LHS is a splat, or by a RHSNodeTy of the kind \p rhsKind if its RHS is.
+template <class LHSNodeTy, class RHSNodeTy, class ArithNodeTy>
+static bool replaceNonCommutative(Function *F, const Backend &B,
+                                  Kinded::Kind lhsKind, Kinded::Kind rhsKind,
+                                  ArithNodeTy *N) {
+  if (auto *splat = getSplat(N->getRHS())) {
+    return replaceWithSplatOperand<RHSNodeTy>(F, B, rhsKind, N, N->getLHS(),
+                                              splat->getValue());
+  }
+  if (auto *splat = getSplat(N->getLHS())) {
+    return replaceWithSplatOperand<LHSNodeTy>(F, B, lhsKind, N, N->getRHS(),
+                                              splat->getValue());
+  }
+  return false;
+}
+
+/// Replace the node \p N of \p F by the arithmetic with the value of its splat
+/// operand as an immediate. \returns true if \p N was replaced.
+static bool foldSplatOperand(Function *F, const Backend &B, Node *N) {
+  using Kind = Kinded::Kind;
+  switch (N->getKind()) {
+  case Kind::AddNodeKind:
+    return replaceCommutative<AddSplatNode>(F, B, Kind::AddSplatNodeKind,
+                                            cast<AddNode>(N));
+  case Kind::MulNodeKind:
+    return replaceCommutative<MulSplatNode>(F, B, Kind::MulSplatNodeKind,
+                                            cast<MulNode>(N));
+  case Kind::MaxNodeKind:
+    return replaceCommutative<MaxSplatNode>(F, B, Kind::MaxSplatNodeKind,
+                                            cast<MaxNode>(N));
+  case Kind::MinNodeKind:
+    return replaceCommutative<MinSplatNode>(F, B, Kind::MinSplatNodeKind,
+                                            cast<MinNode>(N));
+  case Kind::SubNodeKind: {
+    // X - C is computed exactly as X + (-C).
+    auto *SN = cast<SubNode>(N);
+    if (auto *splat = getSplat(SN->getRHS())) {
+      return replaceWithSplatOperand<AddSplatNode>(
+          F, B, Kind::AddSplatNodeKind, SN, SN->getLHS(), -splat->getValue());
+    }
+    if (auto *splat = getSplat(SN->getLHS())) {
+      return replaceWithSplatOperand<SubSplatLHSNode>(
+          F, B, Kind::SubSplatLHSNodeKind, SN, SN->getRHS(),
+          splat->getValue());
+    }
+    return false;
+  }
+  case Kind::DivNodeKind:
+    return replaceNonCommutative<DivSplatLHSNode, DivSplatRHSNode>(
+        F, B, Kind::DivSplatLHSNodeKind, Kind::DivSplatRHSNodeKind,
+        cast<DivNode>(N));
+  case Kind::CmpLTENodeKind:
+    return replaceNonCommutative<CmpLTESplatLHSNode, CmpLTESplatRHSNode>(
+        F, B, Kind::CmpLTESplatLHSNodeKind, Kind::CmpLTESplatRHSNodeKind,
+        cast<CmpLTENode>(N));
+  case Kind::SelectNodeKind: {
+    auto *SN = cast<SelectNode>(N);
+    if (auto *splat = getSplat(SN->getRHS())) {
+      return replaceWithSplatOperand<SelectSplatRHSNode>(
+          F, B, Kind::SelectSplatRHSNodeKind, SN, SN->getLHS(),
+          splat->getValue(), SN->getCond());
+    }
+    if (auto *splat = getSplat(SN->getLHS())) {
+      return replaceWithSplatOperand<SelectSplatLHSNode>(
+          F, B, Kind::SelectSplatLHSNodeKind, SN, SN->getRHS(),
+          splat->getValue(), SN->getCond());
+    }
+    return false;
+  }
+  default:
+    return false;
+  }
+}
+
+bool glow::foldSplatOperands(Function *F, const Backend &B) {
+  bool changed = false;
+  // The new nodes are added to the list of the nodes while it is walked.
+  std::vector<Node *> nodes(F->getNodes().begin(), F->getNodes().end());
+  for (auto *N : nodes) {
+    changed |= foldSplatOperand(F, B, N);
+  }
+  return changed;
+}
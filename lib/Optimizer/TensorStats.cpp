@@ -0,0 +1,98 @@
+/**
+ * Copyright (c) 2017-present, Facebook, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "glow/Backends/Backend.h"
+#include "glow/Graph/Graph.h"
+#include "glow/Graph/Nodes.h"
+#include "glow/Optimizer/Optimizer.h"
+
+#include "llvm/Support/CommandLine.h"
+#include "llvm/Support/Format.h"
+#include "llvm/Support/raw_ostream.h"
+
+#include <vector>
+
+using namespace glow;
+using llvm::dyn_cast;
+using llvm::isa;
+
+static llvm::cl::opt<bool> instrumentStats(
+    "instrument-stats",
+    llvm::cl::desc("Accumulate cheap statistics of the float results of the "
+                   "nodes at every run: the NaNs, the infinities, the zeros "
+                   "and the range of the values. Unlike -instrument-debug, "
+                   "nothing is printed while running"),
+    llvm::cl::init(false));
+
+bool glow::instrumentTensorStats(Function *F, const Backend &B) {
+  if (!instrumentStats ||
+      !B.isOpSupported(Kinded::Kind::TensorStatsNodeKind, ElemKind::FloatTy)) {
+    return false;
+  }
+
+  // Observe the results computed by the function, and not the variables,
+  // the other statistics or the nodes without results.
+  std::vector<NodeValue> observed;
+  for (auto *N : F->getNodes()) {
+    if (isa<TensorStatsNode>(N)) {
+      continue;
+    }
+    for (unsigned i = 0, e = N->getNumResults(); i < e; i++) {
+      if (N->getNthResult(i).getElementType() == ElemKind::FloatTy) {
+        observed.push_back(N->getNthResult(i));
+      }
+    }
+  }
+  for (const auto &NV : observed) {
+    F->createTensorStats("tensorStats", NV);
+  }
+  return !observed.empty();
+}
+
+std::vector<TensorStatsInfo> glow::getTensorStats(const Function *F) {
+  std::vector<TensorStatsInfo> stats;
+  for (auto *N : F->getNodes()) {
+    auto *TSN = dyn_cast<TensorStatsNode>(N);
+    if (!TSN) {
+      continue;
+    }
+    auto countersH = TSN->getCountersVar()->getHandle<size_t>();
+    auto rangeH = TSN->getRangeVar()->getHandle<float>();
+    TensorStatsInfo info;
+    info.nodeName = TSN->getProfiledNodeName();
+    info.resNo = TSN->getProfiledOutputNumber();
+    info.runs = countersH.raw(0);
+    info.elements = countersH.raw(1);
+    info.nans = countersH.raw(2);
+    info.infs = countersH.raw(3);
+    info.zeros = countersH.raw(4);
+    info.min = rangeH.raw(0);
+    info.max = rangeH.raw(1);
+    stats.push_back(info);
+  }
+  return stats;
+}
+
+void glow::dumpTensorStats(const Function *F, llvm::raw_ostream &os) {
+  os << "      runs     elements       NaNs       infs  sparsity"
+        "          min          max  result\n";
+  for (const auto &info : getTensorStats(F)) {
+    os << llvm::format("%10zu %12zu %10zu %10zu %8.2f%% %12g %12g  ",
+                       info.runs, info.elements, info.nans, info.infs,
+                       100 * info.getSparsity(), info.min, info.max)
+       << info.nodeName << ":" << info.resNo << "\n";
+  }
+}
@@ -18,7 +18,9 @@
 
 #include "glow/ExecutionEngine/ExecutionEngine.h"
 
+#include <chrono>
 #include <cmath>
+#include <functional>
 #include <unordered_set>
 #include <vector>
 
@@ -27,13 +29,21 @@ using llvm::cast;
 namespace glow {
 
 /// Calculate TensorQuantizationParams based on the clipped min and max float
-/// range.
-static TensorQuantizationParams chooseQuantizationParams(float min, float max) {
+/// range, for the quantized element kind \p qTy.
+static TensorQuantizationParams
+chooseQuantizationParams(float min, float max,
+                         ElemKind qTy = ElemKind::Int8QTy) {
   assert(min <= max && "min must not be bigger than max");
+  assert((qTy == ElemKind::Int8QTy || qTy == ElemKind::Int16QTy) &&
+         "Unsupported quantized element kind");
 
-  // Given 8 bit precision.
-  const int32_t qmin = std::numeric_limits<int8_t>::min();
-  const int32_t qmax = std::numeric_limits<int8_t>::max();
+  // Given 8 or 16 bit precision.
+  const int32_t qmin = qTy == ElemKind::Int8QTy
+                           ? std::numeric_limits<int8_t>::min()
+                           : std::numeric_limits<int16_t>::min();
+  const int32_t qmax = qTy == ElemKind::Int8QTy
+                           ? std::numeric_limits<int8_t>::max()
+                           : std::numeric_limits<int16_t>::max();
 
   // We extend the [min, max] interval to ensure that it contains 0.
   // Otherwise, we would not meet the requirement that 0 be an exactly
@@ -197,8 +207,155 @@ QuantizationTransform32To8 quantizeScaleOffset32To8(float scale,
                                     offset);
 }
 
+/// \returns the ratio of the RMS of the noise of the quantization with the
+/// scale of \p TQP to the RMS of the values in \p histogram, which covers the
+/// range [\p min, \p max]. The noise of the uniform quantization with the
+/// step s has the RMS s / sqrt(12).
+static float estimateQuantizationError(llvm::ArrayRef<float> histogram,
+                                       float min, float max,
+                                       const TensorQuantizationParams &TQP) {
+  size_t nBins = histogram.size();
+  float binWidth = (max - min) / nBins;
+  double count = 0;
+  double sumSquares = 0;
+  for (size_t i = 0; i < nBins; i++) {
+    double center = min + binWidth * (i + 0.5);
+    count += histogram[i];
+    sumSquares += histogram[i] * center * center;
+  }
+  if (count == 0 || sumSquares == 0) {
+    return 0;
+  }
+  double noise = TQP.scale_ / std::sqrt(12.0);
+  return noise / std::sqrt(sumSquares / count);
+}
+
+/// \returns the Kullback-Leibler divergence of the distribution \p Q from the
+/// distribution \p P. The distributions are normalized here, and the empty
+/// bins of \p Q are smoothed so that the divergence stays finite.
+static double getKLDivergence(llvm::ArrayRef<double> P,
+                              llvm::ArrayRef<double> Q) {
+  assert(P.size() == Q.size() && "The distributions must have the same size");
+  double sumP = 0;
+  double sumQ = 0;
+  for (size_t i = 0, e = P.size(); i < e; i++) {
+    sumP += P[i];
+    sumQ += Q[i];
+  }
+  if (sumP == 0 || sumQ == 0) {
+    return 0;
+  }
+
+  const double epsilon = 1e-7;
+  double divergence = 0;
+  for (size_t i = 0, e = P.size(); i < e; i++) {
+    if (P[i] == 0) {
+      continue;
+    }
+    double p = P[i] / sumP;
+    double q = std::max(Q[i] / sumQ, epsilon);
+    divergence += p * std::log(p / q);
+  }
+  return divergence;
+}
+
+/// \returns the Kullback-Leibler divergence between the distribution of the
+/// values of \p histogram and their int8 quantization in the range of the bins
+/// [\p begin, \p end). The values outside of the range are clipped to its
+/// ends.
+static double getClippedKLDivergence(llvm::ArrayRef<float> histogram,
+                                     size_t begin, size_t end) {
+  // The number of the int8 quantized values.
+  const size_t numLevels = 256;
+  size_t width = end - begin;
+  assert(width >= numLevels && "The range is narrower than the quantization");
+
+  // The profiled distribution, with the outliers clipped to the ends.
+  std::vector<double> P(histogram.begin() + begin, histogram.begin() + end);
+  for (size_t i = 0; i < begin; i++) {
+    P.front() += histogram[i];
+  }
+  for (size_t i = end, e = histogram.size(); i < e; i++) {
+    P.back() += histogram[i];
+  }
+
+  // The quantized distribution: the bins of the range are merged into the
+  // quantized values, and every value is spread uniformly over its nonempty
+  // bins.
+  std::vector<double> Q(width, 0);
+  for (size_t level = 0; level < numLevels; level++) {
+    size_t first = begin + level * width / numLevels;
+    size_t last = begin + (level + 1) * width / numLevels;
+    double sum = 0;
+    size_t numNonEmpty = 0;
+    for (size_t i = first; i < last; i++) {
+      sum += histogram[i];
+      numNonEmpty += histogram[i] != 0;
+    }
+    for (size_t i = first; i < last; i++) {
+      if (histogram[i] != 0) {
+        Q[i - begin] = sum / numNonEmpty;
+      }
+    }
+  }
+
+  return getKLDivergence(P, Q);
+}
+
+/// \returns the sub-range of the range [\p min, \p max] of \p histogram
+/// whose int8 quantization has the distribution with the smallest
+/// Kullback-Leibler divergence from the profiled one. The upper end of the
+/// range is chosen first and then the lower end, which keeps the search
+/// quadratic in the number of the bins.
+static std::pair<float, float>
+getKLMinimizingRange(llvm::ArrayRef<float> histogram, float min, float max) {
+  const size_t minWidth = 256;
+  size_t nBins = histogram.size();
+  if (nBins <= minWidth || !(min < max)) {
+    return {min, max};
+  }
+
+  // Go from the widest range, so that the ties keep the wider range.
+  size_t begin = 0;
+  size_t end = nBins;
+  double bestDivergence = getClippedKLDivergence(histogram, begin, end);
+  for (size_t e = nBins - 1; e >= begin + minWidth; e--) {
+    double divergence = getClippedKLDivergence(histogram, begin, e);
+    if (divergence < bestDivergence) {
+      bestDivergence = divergence;
+      end = e;
+    }
+  }
+  for (size_t b = 1; b + minWidth <= end; b++) {
+    double divergence = getClippedKLDivergence(histogram, b, end);
+    if (divergence < bestDivergence) {
+      bestDivergence = divergence;
+      begin = b;
+    }
+  }
+
+  float binWidth = (max - min) / nBins;
+  return {min + begin * binWidth, min + end * binWidth};
+}
+
+/// Choose the quantization parameters of \p info from its histogram with the
+/// method \p calibration.
+static void calibrateQuantizationInfo(NodeQuantizationInfo &info,
+                                      CalibrationKind calibration) {
+  float min = info.histogramMin_;
+  float max = info.histogramMax_;
+  if (calibration == CalibrationKind::KLMinimization) {
+    std::tie(min, max) = getKLMinimizingRange(info.histogram_, min, max);
+  }
+
+  TensorQuantizationParams TQP = chooseQuantizationParams(min, max);
+  info.tensorQuantizationParams_ = TQP;
+  info.int8Error_ = estimateQuantizationError(
+      info.histogram_, info.histogramMin_, info.histogramMax_, TQP);
+}
+
 std::vector<NodeQuantizationInfo>
-generateNodeQuantizationInfos(const Function *F) {
+generateNodeQuantizationInfos(const Function *F, CalibrationKind calibration) {
   std::vector<NodeQuantizationInfo> quantizationInfos;
 
   for (auto *node : F->getNodes()) {
@@ -207,31 +364,33 @@ generateNodeQuantizationInfos(const Function *F) {
     if (QPN) {
       auto CI = QPN->getComputationInfoVar()->getHandle<float>();
       auto histogram = QPN->getHistogramVar()->getHandle<float>();
-      float min = CI.raw(0);
-      float max = CI.raw(1);
 
-      std::string fullOutputName = NodeQuantizationInfo::generateNodeOutputName(
+      NodeQuantizationInfo info;
+      info.nodeOutputName_ = NodeQuantizationInfo::generateNodeOutputName(
           QPN->getProfiledNodeName(), QPN->getProfiledOutputNumber());
+      info.histogramMin_ = CI.raw(0);
+      info.histogramMax_ = CI.raw(1);
+      info.histogram_.resize(histogram.size());
+      for (size_t i = 0, e = histogram.size(); i < e; i++) {
+        info.histogram_[i] = histogram.raw(i);
+      }
+      calibrateQuantizationInfo(info, calibration);
 
-      // TODO: Ideally tensor quantization params should be calculated
-      // based on the histogram distribution. Use simplistic approach for now.
-      (void)histogram;
-      TensorQuantizationParams TQP = chooseQuantizationParams(min, max);
-
-      quantizationInfos.emplace_back(fullOutputName, TQP);
+      quantizationInfos.push_back(std::move(info));
     }
   }
 
   return quantizationInfos;
 }
 
-int8_t quantize(float input, const TensorQuantizationParams &TQP) {
-  float result = input / TQP.scale_ + TQP.offset_;
-  return quantization::clip<int32_t, int8_t>(round(result));
-}
-
-float dequantize(int8_t input, const TensorQuantizationParams &TQP) {
-  return TQP.scale_ * (input - TQP.offset_);
+void calibrateQuantizationInfos(
+    std::vector<NodeQuantizationInfo> &quantizationInfos,
+    CalibrationKind calibration) {
+  for (auto &info : quantizationInfos) {
+    if (!info.histogram_.empty()) {
+      calibrateQuantizationInfo(info, calibration);
+    }
+  }
 }
 
 /// Quantize all inputs for \p node and return back pointers to the newly
@@ -278,6 +437,14 @@ static bool canBeQuantized(const Node *node) {
     auto *gather = cast<GatherNode>(node);
     return gather->getData().getElementType() == ElemKind::FloatTy;
   }
+  case Kinded::Kind::MatMulNodeKind: {
+    // Only the floating point matrix multiplication reads transposed operands.
+    auto *MM = cast<MatMulNode>(node);
+    if (MM->getTransposeLHS() || MM->getTransposeRHS()) {
+      return false;
+    }
+    break;
+  }
   default:
     // Let the general procedure handle this node kind.
     break;
@@ -450,7 +617,8 @@ static Node *quantizeNode(Function *F, Node *node,
     assert(qParams.size() == 1 && "Invalid number of quantized outputs");
 
     quantizedNode =
-        F->createTopK(topK->getName(), quantizedInputs[0], topK->getK());
+        F->createTopK(topK->getName(), quantizedInputs[0], topK->getK(),
+                      topK->getIndices().getElementType());
     break;
   }
   default:
@@ -507,18 +675,311 @@ postProcessQuantizedNode(Function *F, Node *quantizedNode,
   return quantizedNode;
 }
 
-void generateQuantizedGraph(
-    const ExecutionEngine &EE, Function *F,
-    llvm::ArrayRef<NodeQuantizationInfo> quantizationInfos) {
+/// Quantize the private float variable \p W to int8 with a separate scale and
+/// offset for every slice of \p W along the dimension \p dim. The scales and
+/// the offsets of the slices are returned in \p scales and \p offsets.
+/// \returns the quantized variable, whose type has the placeholder scale 1 and
+/// offset 0.
+static Variable *quantizeChannelwise(Module *M, Variable *W, unsigned dim,
+                                     Variable *&scales, Variable *&offsets) {
+  auto dims = W->dims();
+  size_t numChannels = dims[dim];
+  size_t innerSize = 1;
+  for (size_t i = dim + 1; i < dims.size(); i++) {
+    innerSize *= dims[i];
+  }
+
+  // Find the range of every channel.
+  auto WH = W->getHandle<float>();
+  std::vector<float> mins(numChannels, 0), maxs(numChannels, 0);
+  for (size_t i = 0, e = WH.size(); i < e; i++) {
+    size_t c = (i / innerSize) % numChannels;
+    mins[c] = std::min(mins[c], WH.raw(i));
+    maxs[c] = std::max(maxs[c], WH.raw(i));
+  }
+
+  scales = M->createVariable(
+      ElemKind::FloatTy, {numChannels}, W->getName().str() + ".scales",
+      VisibilityKind::Private, Variable::TrainKind::None);
+  offsets = M->createVariable(ElemKind::Int32QTy, {numChannels}, 1.0, 0,
+                              W->getName().str() + ".offsets",
+                              VisibilityKind::Private,
+                              Variable::TrainKind::None);
+  auto scalesH = scales->getHandle<float>();
+  auto offsetsH = offsets->getHandle<int32_t>();
+  std::vector<TensorQuantizationParams> TQPs(numChannels);
+  for (size_t c = 0; c < numChannels; c++) {
+    TQPs[c] = chooseQuantizationParams(mins[c], maxs[c]);
+    scalesH.raw(c) = TQPs[c].scale_;
+    offsetsH.raw(c) = TQPs[c].offset_;
+  }
+
+  auto *QW = M->createVariable(ElemKind::Int8QTy, dims, 1.0, 0, W->getName(),
+                               VisibilityKind::Private,
+                               Variable::TrainKind::None);
+  auto QWH = QW->getHandle<int8_t>();
+  for (size_t i = 0, e = WH.size(); i < e; i++) {
+    QWH.raw(i) = quantize(WH.raw(i), TQPs[(i / innerSize) % numChannels]);
+  }
+  return QW;
+}
+
+/// Quantize the private float bias \p B to int32, where the element d has the
+/// scale \p inScale * \p scales[d] and the offset 0. This is the scale of the
+/// accumulator of the channel d.
+static Variable *quantizeChannelwiseBias(Module *M, Variable *B, float inScale,
+                                         Variable *scales) {
+  auto *QB = M->createVariable(ElemKind::Int32QTy, B->dims(), 1.0, 0,
+                               B->getName(), VisibilityKind::Private,
+                               Variable::TrainKind::None);
+  auto BH = B->getHandle<float>();
+  auto QBH = QB->getHandle<int32_t>();
+  auto scalesH = scales->getHandle<float>();
+  for (size_t d = 0, e = BH.size(); d < e; d++) {
+    int64_t q = std::round(BH.raw(d) / (inScale * scalesH.raw(d)));
+    QBH.raw(d) = quantization::clip<int64_t, int32_t>(q);
+  }
+  return QB;
+}
+
+/// Quantize the convolution or the fully connected \p node with per-channel
+/// quantized weights, if the backend of \p EE supports it and the weights and
+/// the bias are private variables.
+/// \returns the quantized node, or nullptr if \p node can't be quantized per
+/// channel.
+static Node *
+quantizeNodeChannelwise(const ExecutionEngine &EE, Function *F, Node *node,
+                        llvm::MutableArrayRef<Node *> quantizedInputs,
+                        llvm::ArrayRef<TensorQuantizationParams> qParams) {
+  auto *M = F->getParent();
+
+  switch (node->getKind()) {
+  case Kinded::Kind::ConvolutionNodeKind: {
+    auto *CV = cast<ConvolutionNode>(node);
+    auto *filter = llvm::dyn_cast<Variable>(CV->getFilter().getNode());
+    auto *bias = llvm::dyn_cast<Variable>(CV->getBias().getNode());
+    if (!filter || !bias || !filter->isPrivate() || !bias->isPrivate() ||
+        !EE.isOpSupported(Kinded::Kind::ChannelwiseQuantizedConvolutionNodeKind,
+                          ElemKind::Int8QTy)) {
+      return nullptr;
+    }
+    assert(qParams.size() == 1 && "Invalid number of quantized outputs");
+
+    // The output channels are the first dimension of the filter.
+    Variable *scales, *offsets;
+    auto *QF = quantizeChannelwise(M, filter, 0, scales, offsets);
+    float inScale = quantizedInputs[0]->getNthResult(0).getType()->getScale();
+    auto *QB = quantizeChannelwiseBias(M, bias, inScale, scales);
+    auto QT = M->uniqueType(ElemKind::Int8QTy, CV->getResult()->dims(),
+                            qParams[0].scale_, qParams[0].offset_);
+    return F->createChannelwiseQuantizedConv(
+        CV->getName(), quantizedInputs[0], QF, QB, scales, offsets, QT,
+        CV->getKernel(), CV->getStride(), CV->getPad(), CV->getGroup());
+  }
+  case Kinded::Kind::FullyConnectedNodeKind: {
+    auto *FC = cast<FullyConnectedNode>(node);
+    auto *weights = llvm::dyn_cast<Variable>(FC->getWeights().getNode());
+    auto *bias = llvm::dyn_cast<Variable>(FC->getBias().getNode());
+    if (!weights || !bias || !weights->isPrivate() || !bias->isPrivate() ||
+        !EE.isOpSupported(
+            Kinded::Kind::ChannelwiseQuantizedFullyConnectedNodeKind,
+            ElemKind::Int8QTy)) {
+      return nullptr;
+    }
+    assert(qParams.size() == 1 && "Invalid number of quantized outputs");
+
+    // The output channels are the columns of the weights.
+    Variable *scales, *offsets;
+    auto *QW = quantizeChannelwise(M, weights, 1, scales, offsets);
+    float inScale = quantizedInputs[0]->getNthResult(0).getType()->getScale();
+    auto *QB = quantizeChannelwiseBias(M, bias, inScale, scales);
+
+    // The quantized fully connected node requires a 2D input.
+    NodeValue input = quantizedInputs[0];
+    auto idim = flattenCdr(input.dims());
+    if (input.dims().size() != 2) {
+      input = F->createReshape("fc.2D", input, {idim.first, idim.second});
+    }
+    auto QT = M->uniqueType(ElemKind::Int8QTy, FC->getResult()->dims(),
+                            qParams[0].scale_, qParams[0].offset_);
+    return F->createChannelwiseQuantizedFullyConnected(
+        FC->getName(), input, QW, QB, scales, offsets, QT);
+  }
+  default:
+    return nullptr;
+  }
+}
+
+/// \returns true if the embedding table of the SparseLengthsWeightedSum or of
+/// the Gather \p node can be quantized row by row: the backend of \p EE
+/// supports it and the table is a private 2D float variable.
+static bool canBeQuantizedRowwise(const ExecutionEngine &EE,
+                                  const Node *node) {
+  Kinded::Kind rowwiseKind;
+  if (llvm::isa<SparseLengthsWeightedSumNode>(node)) {
+    rowwiseKind = Kinded::Kind::RowwiseQuantizedSparseLengthsWeightedSumNodeKind;
+  } else if (llvm::isa<GatherNode>(node)) {
+    rowwiseKind = Kinded::Kind::RowwiseQuantizedGatherNodeKind;
+  } else {
+    return false;
+  }
+  auto *data = llvm::dyn_cast<Variable>(node->getNthInput(0).getNode());
+  return data && data->isPrivate() && data->dims().size() == 2 &&
+         data->getElementType() == ElemKind::FloatTy &&
+         EE.isOpSupported(rowwiseKind, ElemKind::Int8QTy);
+}
+
+/// Quantize the embedding table of the SparseLengthsWeightedSum or of the
+/// Gather \p node row by row, if canBeQuantizedRowwise allows it. The rows of
+/// a table have very different ranges. The result stays float, so no profile
+/// is needed. \returns the row-wise quantized node, or nullptr if \p node
+/// can't be quantized row-wise.
+static Node *quantizeNodeRowwise(const ExecutionEngine &EE, Function *F,
+                                 Node *node) {
+  if (!canBeQuantizedRowwise(EE, node)) {
+    return nullptr;
+  }
+
+  auto *data = cast<Variable>(node->getNthInput(0).getNode());
+  Variable *scales, *offsets;
+  auto *QD = quantizeChannelwise(F->getParent(), data, 0, scales, offsets);
+  if (auto *GN = llvm::dyn_cast<GatherNode>(node)) {
+    return F->createRowwiseQuantizedGather(GN->getName(), QD, scales, offsets,
+                                           GN->getIndices());
+  }
+  auto *SLWS = cast<SparseLengthsWeightedSumNode>(node);
+  return F->createRowwiseQuantizedSparseLengthsWeightedSum(
+      SLWS->getName(), QD, scales, offsets, SLWS->getWeights(),
+      SLWS->getIndices(), SLWS->getLengths());
+}
+
+/// \returns the int16 quantization parameters of the range that the int8
+/// quantization parameters \p TQP represent.
+static TensorQuantizationParams
+getInt16Params(const TensorQuantizationParams &TQP) {
+  float min = TQP.scale_ * (std::numeric_limits<int8_t>::min() - TQP.offset_);
+  float max = TQP.scale_ * (std::numeric_limits<int8_t>::max() - TQP.offset_);
+  return chooseQuantizationParams(min, max, ElemKind::Int16QTy);
+}
+
+/// \returns true if the int8 quantization of the input or of the result of
+/// \p node loses more than \p maxInt8Error according to the profile in
+/// \p nodeToInt8Error, and the backend of \p EE supports \p node with int16
+/// activations.
+static bool
+needsInt16(const ExecutionEngine &EE, const Node *node,
+           const std::unordered_map<std::string, float> &nodeToInt8Error,
+           float maxInt8Error) {
+  if (!llvm::isa<ConvolutionNode>(node) &&
+      !llvm::isa<FullyConnectedNode>(node) && !llvm::isa<MatMulNode>(node)) {
+    return false;
+  }
+  if (maxInt8Error <= 0 ||
+      !EE.isOpSupported(node->getKind(), ElemKind::Int16QTy)) {
+    return false;
+  }
+
+  // The activations are the first input of all of these nodes.
+  const NodeValue &input = node->getNthInput(0);
+
+  auto getInt8Error = [&](const std::string &name) -> float {
+    auto it = nodeToInt8Error.find(name);
+    return it == nodeToInt8Error.end() ? 0 : it->second;
+  };
+  float inputError = getInt8Error(NodeQuantizationInfo::generateNodeOutputName(
+      input->getName(), input.getResNo()));
+  float resultError = getInt8Error(
+      NodeQuantizationInfo::generateNodeOutputName(node->getName()));
+  return std::max(inputError, resultError) > maxInt8Error;
+}
+
+/// Quantize the convolution, the fully connected node or the matrix
+/// multiplication \p node with int16 activations. The int8 weights or the
+/// right hand side are taken from \p quantizedInputs, and the int32 bias is
+/// quantized with the scale of the accumulator, which is the product of the
+/// scales of the input and of the weights.
+/// \returns the quantized node.
+static Node *
+quantizeNodeInt16(Function *F, Node *node,
+                  llvm::MutableArrayRef<Node *> quantizedInputs,
+                  llvm::ArrayRef<TensorQuantizationParams> qParams) {
+  auto *M = F->getParent();
+  assert(qParams.size() == 1 && "Invalid number of quantized outputs");
+
+  // Requantize the int8 input, which was quantized from the profile, to int16.
+  auto *quantizedInput = cast<QuantizeNode>(quantizedInputs[0]);
+  auto *int8Ty = quantizedInput->getResult().getType();
+  auto inTQP = getInt16Params({int8Ty->getScale(), int8Ty->getOffset()});
+  auto inTy = M->uniqueType(ElemKind::Int16QTy, quantizedInput->dims(),
+                            inTQP.scale_, inTQP.offset_);
+  auto *input = F->createQuantize("quantize", quantizedInput->getInput(), inTy);
+
+  auto outTQP = getInt16Params(qParams[0]);
+  auto outTy = M->uniqueType(ElemKind::Int16QTy, node->dims(0),
+                             outTQP.scale_, outTQP.offset_);
+  NodeValue weights = quantizedInputs[1];
+  float accScale = inTQP.scale_ * weights.getType()->getScale();
+
+  switch (node->getKind()) {
+  case Kinded::Kind::ConvolutionNodeKind: {
+    auto *CV = cast<ConvolutionNode>(node);
+    auto biasTy = M->uniqueType(ElemKind::Int32QTy, CV->getBias().dims(),
+                                accScale, 0);
+    auto *bias = F->createQuantize("quantize", CV->getBias(), biasTy);
+    return F->createConv(CV->getName(), input, weights, bias, outTy,
+                         CV->getKernel(), CV->getStride(), CV->getPad(),
+                         CV->getGroup());
+  }
+  case Kinded::Kind::FullyConnectedNodeKind: {
+    auto *FC = cast<FullyConnectedNode>(node);
+    auto biasTy = M->uniqueType(ElemKind::Int32QTy, FC->getBias().dims(),
+                                accScale, 0);
+    auto *bias = F->createQuantize("quantize", FC->getBias(), biasTy);
+    return F->createFullyConnected(FC->getName(), input, weights, bias, outTy);
+  }
+  case Kinded::Kind::MatMulNodeKind: {
+    auto *MM = cast<MatMulNode>(node);
+    // Accumulate into int32 and requantize the accumulator to the output.
+    auto accTy = M->uniqueType(ElemKind::Int32QTy, MM->getResult().dims(),
+                               accScale, 0);
+    auto *acc = F->createMatMul(MM->getName(), accTy, input, weights);
+    return F->createRescaleQuantized(MM->getName(), acc, outTy);
+  }
+  default:
+    GLOW_UNREACHABLE("The node type is not supported with int16 activations");
+  }
+}
+
+/// \returns true if generateQuantizedGraph quantizes \p node with the backend
+/// of \p EE, when the profile allows it.
+static bool isQuantizable(const ExecutionEngine &EE, const Node *node,
+                          bool enableChannelwise) {
+  if (enableChannelwise && canBeQuantizedRowwise(EE, node)) {
+    return true;
+  }
+  return canBeQuantized(node) &&
+         EE.isOpSupported(node->getKind(), ElemKind::Int8QTy);
+}
+
+/// Quantize the nodes of \p F for which \p shouldQuantize is true, as
+/// generateQuantizedGraph describes.
+static void
+quantizeNodes(const ExecutionEngine &EE, Function *F,
+              llvm::ArrayRef<NodeQuantizationInfo> quantizationInfos,
+              bool enableChannelwise, float maxInt8Error,
+              const std::function<bool(const Node *)> &shouldQuantize) {
   if (F->getNodes().empty()) {
     return;
   }
 
   // Build a mapping between node name and TensorQuantizatonParams.
   std::unordered_map<std::string, TensorQuantizationParams> nodeToTQP;
+  std::unordered_map<std::string, float> nodeToInt8Error;
   for (const auto &quantizationInfo : quantizationInfos) {
     nodeToTQP.emplace(quantizationInfo.nodeOutputName_,
                       quantizationInfo.tensorQuantizationParams_);
+    nodeToInt8Error.emplace(quantizationInfo.nodeOutputName_,
+                            quantizationInfo.int8Error_);
   }
 
   // For every unprocessed node in the graph we keep the invariant of having
@@ -528,6 +989,16 @@ void generateQuantizedGraph(
   do {
     --nodeIt;
     Node *node = *nodeIt;
+    if (!shouldQuantize(node)) {
+      continue;
+    }
+
+    if (enableChannelwise) {
+      if (Node *rowwise = quantizeNodeRowwise(EE, F, node)) {
+        node->getNthResult(0).replaceAllUsesOfWith(rowwise);
+        continue;
+      }
+    }
 
     // Make sure that all inputs are floats and int8 operation is suppored by
     // the backend. Not all backends support particular quantized operation and
@@ -541,7 +1012,16 @@ void generateQuantizedGraph(
       auto qParams = getQuantizationParameters(node, nodeToTQP);
 
       // 2) Quantize the node.
-      Node *quantizedNode = quantizeNode(F, node, quantizedInputs, qParams);
+      Node *quantizedNode = nullptr;
+      if (needsInt16(EE, node, nodeToInt8Error, maxInt8Error)) {
+        quantizedNode = quantizeNodeInt16(F, node, quantizedInputs, qParams);
+      } else if (enableChannelwise) {
+        quantizedNode =
+            quantizeNodeChannelwise(EE, F, node, quantizedInputs, qParams);
+      }
+      if (!quantizedNode) {
+        quantizedNode = quantizeNode(F, node, quantizedInputs, qParams);
+      }
       quantizedNode = postProcessQuantizedNode(F, quantizedNode, qParams);
       assert(quantizedNode != nullptr && "Node must be quantized");
 
@@ -551,8 +1031,7 @@ void generateQuantizedGraph(
            outNum++) {
         // Dequantize only quantized outputs.
         // In case output was not quantized we still need to relink the node.
-        if (quantizedNode->getNthResult(outNum).getElementType() !=
-            ElemKind::Int8QTy) {
+        if (!quantizedNode->getNthResult(outNum).getType()->isQuantizedType()) {
           node->getNthResult(outNum).replaceAllUsesOfWith(
               quantizedNode->getNthResult(outNum));
           continue;
@@ -567,12 +1046,178 @@ void generateQuantizedGraph(
 
         // 5) Make sure that TQP is not lost after addition of intermediate
         // dequantized node.
-        nodeToTQP[NodeQuantizationInfo::generateNodeOutputName(
-            dequantized->getName())] = qParams[qParamIndex++];
+        auto dequantizedName = NodeQuantizationInfo::generateNodeOutputName(
+            dequantized->getName());
+        nodeToTQP[dequantizedName] = qParams[qParamIndex++];
+        nodeToInt8Error[dequantizedName] =
+            nodeToInt8Error[NodeQuantizationInfo::generateNodeOutputName(
+                node->getName(), outNum)];
       }
     }
   } while (nodeIt != stopIt);
 }
 
+void generateQuantizedGraph(
+    const ExecutionEngine &EE, Function *F,
+    llvm::ArrayRef<NodeQuantizationInfo> quantizationInfos,
+    bool enableChannelwise, float maxInt8Error) {
+  // The profile names the first result of the nodes that stay in float.
+  std::unordered_set<std::string> floatNodes;
+  for (const auto &quantizationInfo : quantizationInfos) {
+    if (!quantizationInfo.quantize_) {
+      floatNodes.insert(quantizationInfo.nodeOutputName_);
+    }
+  }
+  quantizeNodes(EE, F, quantizationInfos, enableChannelwise, maxInt8Error,
+                [&](const Node *node) {
+                  return !floatNodes.count(
+                      NodeQuantizationInfo::generateNodeOutputName(
+                          node->getName()));
+                });
+}
+
+/// Run a copy of \p F in \p EE, where only the node named \p nodeName is
+/// quantized, or no node if \p nodeName is empty. The public variables of the
+/// copy with the names of \p vars get the \p inputs, and the results of the
+/// saves of the copy are copied into \p results. \returns the wall time in
+/// seconds of a run, averaged over \p timingRuns runs after the first one,
+/// or 0 if \p timingRuns is 0.
+static double runQuantizedCopy(
+    ExecutionEngine &EE, Function *F, llvm::StringRef nodeName,
+    llvm::ArrayRef<NodeQuantizationInfo> quantizationInfos,
+    bool enableChannelwise, float maxInt8Error,
+    llvm::ArrayRef<Variable *> vars, llvm::ArrayRef<Tensor *> inputs,
+    unsigned timingRuns, std::vector<Tensor> &results) {
+  // The copy doesn't share its constant weights with F, so that the backend
+  // transforms them as it does for F alone.
+  Module M;
+  Function *copy = F->cloneInto(M, F->getName());
+  if (!nodeName.empty()) {
+    quantizeNodes(EE, copy, quantizationInfos, enableChannelwise,
+                  maxInt8Error,
+                  [&](const Node *node) { return node->getName() == nodeName; });
+  }
+
+  std::vector<Variable *> copyVars;
+  for (auto *V : vars) {
+    copyVars.push_back(M.getVariableByName(V->getName()));
+    assert(copyVars.back() && "The variable is not used by the function");
+  }
+  EE.compile(CompilationMode::Infer, copy);
+  EE.run(copyVars, inputs);
+
+  double time = 0;
+  if (timingRuns) {
+    auto start = std::chrono::steady_clock::now();
+    for (unsigned i = 0; i < timingRuns; i++) {
+      EE.run(copyVars, inputs);
+    }
+    std::chrono::duration<double> elapsed =
+        std::chrono::steady_clock::now() - start;
+    time = elapsed.count() / timingRuns;
+  }
+
+  results.clear();
+  for (auto *N : copy->getNodes()) {
+    if (auto *SN = llvm::dyn_cast<SaveNode>(N)) {
+      results.emplace_back();
+      results.back().copyFrom(&SN->getVariable()->getPayload());
+    }
+  }
+  return time;
+}
+
+/// \returns the ratio of the RMS of the difference between the float
+/// \p results and the float \p reference to the RMS of \p reference.
+static float getRelativeError(std::vector<Tensor> &reference,
+                              std::vector<Tensor> &results) {
+  assert(reference.size() == results.size() && "The results don't match");
+  double diff = 0, norm = 0;
+  for (size_t i = 0, e = reference.size(); i < e; i++) {
+    if (reference[i].getElementType() != ElemKind::FloatTy) {
+      continue;
+    }
+    auto refH = reference[i].getHandle<float>();
+    auto resH = results[i].getHandle<float>();
+    for (size_t j = 0, n = refH.size(); j < n; j++) {
+      double d = resH.raw(j) - refH.raw(j);
+      diff += d * d;
+      norm += double(refH.raw(j)) * refH.raw(j);
+    }
+  }
+  return norm > 0 ? std::sqrt(diff / norm) : std::sqrt(diff);
+}
+
+std::vector<NodeQuantizationEffect> measureQuantizationEffects(
+    ExecutionEngine &EE, Function *F,
+    llvm::ArrayRef<NodeQuantizationInfo> quantizationInfos,
+    llvm::ArrayRef<Variable *> vars, llvm::ArrayRef<Tensor *> inputs,
+    unsigned timingRuns, bool enableChannelwise, float maxInt8Error) {
+  std::vector<Tensor> reference, results;
+  double floatTime =
+      runQuantizedCopy(EE, F, "", quantizationInfos, enableChannelwise,
+                       maxInt8Error, vars, inputs, timingRuns, reference);
+
+  std::vector<NodeQuantizationEffect> effects;
+  for (auto *node : F->getNodes()) {
+    if (!isQuantizable(EE, node, enableChannelwise)) {
+      continue;
+    }
+    double time = runQuantizedCopy(EE, F, node->getName(), quantizationInfos,
+                                   enableChannelwise, maxInt8Error, vars,
+                                   inputs, timingRuns, results);
+    NodeQuantizationEffect effect;
+    effect.nodeName_ = node->getName();
+    effect.error_ = getRelativeError(reference, results);
+    effect.timeSaved_ = floatTime - time;
+    effects.push_back(effect);
+  }
+  return effects;
+}
+
+void selectQuantizedNodes(llvm::ArrayRef<NodeQuantizationEffect> effects,
+                          float maxError,
+                          std::vector<NodeQuantizationInfo> &quantizationInfos) {
+  // Consider the nodes that save time, with the least error per saved second
+  // first.
+  std::vector<const NodeQuantizationEffect *> candidates;
+  for (const auto &effect : effects) {
+    if (effect.timeSaved_ > 0) {
+      candidates.push_back(&effect);
+    }
+  }
+  std::stable_sort(candidates.begin(), candidates.end(),
+                   [](const NodeQuantizationEffect *lhs,
+                      const NodeQuantizationEffect *rhs) {
+                     return lhs->error_ * rhs->timeSaved_ <
+                            rhs->error_ * lhs->timeSaved_;
+                   });
+
+  // The errors of the nodes are assumed to be independent, so that their
+  // squares add up.
+  std::unordered_set<std::string> selected;
+  double squaredError = 0;
+  for (const auto *effect : candidates) {
+    double error = double(effect->error_) * effect->error_;
+    if (squaredError + error > double(maxError) * maxError) {
+      continue;
+    }
+    squaredError += error;
+    selected.insert(effect->nodeName_);
+  }
+
+  std::unordered_set<std::string> measured;
+  for (const auto &effect : effects) {
+    measured.insert(effect.nodeName_);
+  }
+  for (auto &quantizationInfo : quantizationInfos) {
+    auto nodeName =
+        llvm::StringRef(quantizationInfo.nodeOutputName_).rsplit(':').first;
+    if (measured.count(nodeName.str())) {
+      quantizationInfo.quantize_ = selected.count(nodeName.str());
+    }
+  }
+}
+
 } // namespace quantization
 } // namespace glow
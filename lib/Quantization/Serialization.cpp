@@ -31,6 +31,11 @@ template <> struct MappingTraits<glow::NodeQuantizationInfo> {
     io.mapRequired("nodeOutputName", info.nodeOutputName_);
     io.mapRequired("scale", info.tensorQuantizationParams_.scale_);
     io.mapRequired("offset", info.tensorQuantizationParams_.offset_);
+    io.mapOptional("int8Error", info.int8Error_);
+    io.mapOptional("histogramMin", info.histogramMin_);
+    io.mapOptional("histogramMax", info.histogramMax_);
+    io.mapOptional("histogram", info.histogram_);
+    io.mapOptional("quantize", info.quantize_, true);
   }
 };
 
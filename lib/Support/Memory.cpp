@@ -0,0 +1,254 @@
+/**
+ * Copyright (c) 2017-present, Facebook, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "glow/Support/Memory.h"
+#include "glow/Support/Compiler.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <vector>
+
+#ifdef __linux__
+#include <sys/syscall.h>
+#endif
+#ifdef __unix__
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace glow {
+
+#ifdef __linux__
+namespace {
+
+/// The values of the mbind system call from <numaif.h>, which is not
+/// installed without libnuma.
+constexpr int MPOL_BIND_MODE = 2;
+constexpr unsigned MPOL_MF_MOVE_FLAG = 1 << 1;
+
+/// Bind the pages in the \p size bytes at \p p to the NUMA node \p node.
+/// If \p move is set, the pages that are already on other nodes are moved.
+bool bindToNode(void *p, size_t size, int node, bool move) {
+  constexpr size_t bitsPerWord = sizeof(unsigned long) * 8;
+  std::vector<unsigned long> mask(node / bitsPerWord + 1, 0);
+  mask[node / bitsPerWord] = 1UL << (node % bitsPerWord);
+  return syscall(SYS_mbind, p, size, MPOL_BIND_MODE, mask.data(),
+                 mask.size() * bitsPerWord + 1,
+                 move ? MPOL_MF_MOVE_FLAG : 0) == 0;
+}
+
+/// Place the pages in the \p size bytes at \p p, which are aligned to the
+/// page size, according to \p policy.
+bool placePages(void *p, size_t size, const MemoryPolicy &policy, bool move) {
+  bool placed = true;
+#ifdef MADV_HUGEPAGE
+  if (policy.hugePages != HugePageMode::None) {
+    placed &= madvise(p, size, MADV_HUGEPAGE) == 0;
+  }
+#endif
+  if (policy.numaNode >= 0) {
+    placed &= bindToNode(p, size, policy.numaNode, move);
+  }
+  return placed;
+}
+
+} // namespace
+#endif
+
+void *allocateMemory(size_t size, const MemoryPolicy &policy) {
+#ifdef __linux__
+  if (!policy.isDefault()) {
+    // The mapping covers whole huge pages, so that freeMemory knows its size
+    // whether or not the reserved huge pages were available.
+    size = alignedSize(size, HugePageSize);
+    void *p = MAP_FAILED;
+#ifdef MAP_HUGETLB
+    if (policy.hugePages == HugePageMode::Explicit) {
+      p = mmap(nullptr, size, PROT_READ | PROT_WRITE,
+               MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+    }
+#endif
+    if (p == MAP_FAILED) {
+      p = mmap(nullptr, size, PROT_READ | PROT_WRITE,
+               MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    }
+    GLOW_ASSERT(p != MAP_FAILED && "Unable to map the memory.");
+    // The pages are not touched yet, so they are allocated where the policy
+    // says when the code first writes them.
+    placePages(p, size, policy, /* move */ false);
+    return p;
+  }
+#endif
+  return alignedAlloc(size, TensorAlignment);
+}
+
+void freeMemory(void *p, size_t size, const MemoryPolicy &policy) {
+  if (!p) {
+    return;
+  }
+#ifdef __linux__
+  if (!policy.isDefault()) {
+    munmap(p, alignedSize(size, HugePageSize));
+    return;
+  }
+#endif
+  alignedFree(p);
+}
+
+bool applyMemoryPolicy(void *p, size_t size, const MemoryPolicy &policy) {
+  if (policy.isDefault()) {
+    return true;
+  }
+#ifdef __linux__
+  // Only the pages that belong to the memory as a whole are placed, since the
+  // others are shared with the neighbouring allocations.
+  size_t pageSize = sysconf(_SC_PAGESIZE);
+  uintptr_t begin = alignedSize(reinterpret_cast<uintptr_t>(p), pageSize);
+  uintptr_t end = (reinterpret_cast<uintptr_t>(p) + size) & ~(pageSize - 1);
+  if (begin >= end) {
+    return true;
+  }
+  return placePages(reinterpret_cast<void *>(begin), end - begin, policy,
+                    /* move */ true);
+#else
+  return false;
+#endif
+}
+
+/// \returns the size of the pages of the system.
+static size_t getPageSize() {
+#ifdef __linux__
+  return sysconf(_SC_PAGESIZE);
+#else
+  return 4096;
+#endif
+}
+
+void prefaultForRead(const void *p, size_t size) {
+  if (!p || !size) {
+    return;
+  }
+  size_t pageSize = getPageSize();
+  uintptr_t begin = reinterpret_cast<uintptr_t>(p) & ~(pageSize - 1);
+  uintptr_t end = reinterpret_cast<uintptr_t>(p) + size;
+#if defined(__linux__) && defined(MADV_WILLNEED)
+  madvise(reinterpret_cast<void *>(begin), end - begin, MADV_WILLNEED);
+#endif
+  // Reading a byte of every page maps it, whether or not it was read ahead.
+  auto *bytes = static_cast<const volatile char *>(p);
+  for (uintptr_t page = begin; page < end; page += pageSize) {
+    size_t offset = std::max(page, reinterpret_cast<uintptr_t>(p)) -
+                    reinterpret_cast<uintptr_t>(p);
+    (void)bytes[offset];
+  }
+}
+
+void prefaultForWrite(void *p, size_t size) {
+  if (!p || !size) {
+    return;
+  }
+  size_t pageSize = getPageSize();
+  uintptr_t begin = reinterpret_cast<uintptr_t>(p) & ~(pageSize - 1);
+  uintptr_t end = reinterpret_cast<uintptr_t>(p) + size;
+  // Writing back a byte of every page maps it writable, e.g. breaks the
+  // sharing of the zero page, and keeps the content.
+  auto *bytes = static_cast<volatile char *>(p);
+  for (uintptr_t page = begin; page < end; page += pageSize) {
+    size_t offset = std::max(page, reinterpret_cast<uintptr_t>(p)) -
+                    reinterpret_cast<uintptr_t>(p);
+    bytes[offset] = bytes[offset];
+  }
+}
+
+void ActivationArena::reserve(size_t size) {
+  if (size <= size_) {
+    return;
+  }
+  freeMemory(memory_, size_, policy_);
+  size_ = size;
+  memory_ = allocateMemory(size_, policy_);
+}
+
+SharedMemory::~SharedMemory() {
+#ifdef __unix__
+  if (memory_) {
+    munmap(memory_, size_);
+  }
+  if (isOwner_) {
+    shm_unlink(name_.c_str());
+  }
+#endif
+}
+
+std::unique_ptr<SharedMemory> SharedMemory::create(const std::string &name,
+                                                   size_t size) {
+#ifdef __unix__
+  int fd = shm_open(name.c_str(), O_RDWR | O_CREAT | O_EXCL, 0600);
+  if (fd < 0) {
+    return nullptr;
+  }
+  std::unique_ptr<SharedMemory> shm(new SharedMemory());
+  shm->name_ = name;
+  shm->isOwner_ = true;
+  // The new pages of the segment are zero.
+  if (ftruncate(fd, size) != 0) {
+    close(fd);
+    return nullptr;
+  }
+  void *p = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  close(fd);
+  if (p == MAP_FAILED) {
+    return nullptr;
+  }
+  shm->memory_ = p;
+  shm->size_ = size;
+  return shm;
+#else
+  return nullptr;
+#endif
+}
+
+std::unique_ptr<SharedMemory> SharedMemory::open(const std::string &name) {
+#ifdef __unix__
+  int fd = shm_open(name.c_str(), O_RDWR, 0);
+  if (fd < 0) {
+    return nullptr;
+  }
+  struct stat st;
+  if (fstat(fd, &st) != 0 || st.st_size == 0) {
+    close(fd);
+    return nullptr;
+  }
+  void *p =
+      mmap(nullptr, st.st_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  close(fd);
+  if (p == MAP_FAILED) {
+    return nullptr;
+  }
+  std::unique_ptr<SharedMemory> shm(new SharedMemory());
+  shm->name_ = name;
+  shm->memory_ = p;
+  shm->size_ = st.st_size;
+  return shm;
+#else
+  return nullptr;
+#endif
+}
+
+} // end namespace glow
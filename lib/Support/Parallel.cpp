@@ -0,0 +1,292 @@
+/**
+ * Copyright (c) 2017-present, Facebook, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// This file is compiled into libjit as well, so it must not use LLVM, and the
+// state of the pool is constant-initialized, without static constructors.
+
+#include "glow/Support/Parallel.h"
+
+#include <atomic>
+#include <cstdint>
+#include <pthread.h>
+#include <sched.h>
+#include <unistd.h>
+
+namespace {
+
+/// A call of glow_parallel_for that the workers help with.
+struct Job {
+  glow_parallel_task_fn fn;
+  void *ctx;
+  size_t numTasks;
+  /// The next task to run.
+  std::atomic<size_t> next;
+  /// The number of workers that haven't finished yet.
+  std::atomic<size_t> active;
+};
+
+/// A thread of the pool.
+struct Worker {
+  /// The job that the worker was given, or null if the worker is idle.
+  std::atomic<Job *> job;
+  /// Set when the worker stopped polling for a job and sleeps on cond.
+  std::atomic<bool> parked;
+  pthread_t thread;
+  pthread_mutex_t mutex;
+  pthread_cond_t cond;
+};
+
+constexpr size_t maxWorkers = GLOW_PARALLEL_MAX_THREADS - 1;
+
+/// The workers of the pool. The calling thread is not one of them.
+Worker workers[maxWorkers];
+/// The number of the workers that were started.
+std::atomic<size_t> numWorkers{0};
+/// A bit for every idle worker. A caller claims the workers that it gives its
+/// job to by clearing their bits, and a worker sets its bit when it is done.
+std::atomic<uint64_t> idleWorkers{0};
+
+/// The number of threads of the pool, or 0 before it is configured.
+std::atomic<size_t> numThreads{0};
+/// The number of times that an idle worker polls for a job before it sleeps.
+std::atomic<size_t> spinCount{1 << 14};
+/// The limit of the threads of the calls of the calling thread, or 0.
+thread_local size_t threadLimit = 0;
+
+/// Protects the start of the workers and the affinity.
+pthread_mutex_t configMutex = PTHREAD_MUTEX_INITIALIZER;
+/// The processors that the workers are pinned to.
+int affinity[maxWorkers];
+size_t affinitySize = 0;
+
+/// Tell the processor that the thread is spinning.
+inline void spinPause() {
+#if defined(__x86_64__) || defined(__i386__)
+  __builtin_ia32_pause();
+#elif defined(__aarch64__) || defined(__arm__)
+  __asm__ __volatile__("yield");
+#endif
+}
+
+/// Pin the worker \p idx to its processor. The config mutex must be held.
+void pinWorker(size_t idx) {
+#ifdef __linux__
+  cpu_set_t set;
+  CPU_ZERO(&set);
+  if (affinitySize) {
+    CPU_SET(affinity[idx % affinitySize], &set);
+  } else {
+    for (int cpu = 0; cpu < CPU_SETSIZE; cpu++) {
+      CPU_SET(cpu, &set);
+    }
+  }
+  pthread_setaffinity_np(workers[idx].thread, sizeof(set), &set);
+#endif
+}
+
+/// Run the tasks of \p job until none are left.
+void runTasks(Job &job) {
+  for (;;) {
+    size_t task = job.next.fetch_add(1, std::memory_order_relaxed);
+    if (task >= job.numTasks) {
+      return;
+    }
+    job.fn(job.ctx, task);
+  }
+}
+
+/// Wait until the worker \p W is given a job. \returns the job.
+Job *waitForJob(Worker &W) {
+  for (size_t i = 0, e = spinCount.load(std::memory_order_relaxed); i < e;
+       i++) {
+    if (Job *job = W.job.load(std::memory_order_acquire)) {
+      return job;
+    }
+    spinPause();
+  }
+
+  // The caller checks the flag after it hands out the job, so either it sees
+  // the flag and wakes the worker up, or the worker sees the job.
+  W.parked.store(true);
+  Job *job = W.job.load();
+  if (!job) {
+    pthread_mutex_lock(&W.mutex);
+    while (!(job = W.job.load())) {
+      pthread_cond_wait(&W.cond, &W.mutex);
+    }
+    pthread_mutex_unlock(&W.mutex);
+  }
+  W.parked.store(false, std::memory_order_relaxed);
+  return job;
+}
+
+/// The main loop of the worker \p arg.
+void *workerLoop(void *arg) {
+  size_t idx = (size_t)arg;
+  Worker &W = workers[idx];
+  for (;;) {
+    Job *job = waitForJob(W);
+    runTasks(*job);
+    // The worker may be claimed again as soon as it is idle, so it takes the
+    // new job only after it is done with this one.
+    W.job.store(nullptr, std::memory_order_relaxed);
+    idleWorkers.fetch_or(uint64_t(1) << idx, std::memory_order_release);
+    job->active.fetch_sub(1, std::memory_order_release);
+  }
+  return nullptr;
+}
+
+/// Give \p job to the claimed worker \p W.
+void dispatch(Worker &W, Job *job) {
+  W.job.store(job);
+  if (W.parked.load()) {
+    pthread_mutex_lock(&W.mutex);
+    pthread_cond_signal(&W.cond);
+    pthread_mutex_unlock(&W.mutex);
+  }
+}
+
+/// Start the workers up to \p count workers.
+void startWorkers(size_t count) {
+  if (numWorkers.load(std::memory_order_acquire) >= count) {
+    return;
+  }
+  pthread_mutex_lock(&configMutex);
+  size_t idx = numWorkers.load(std::memory_order_relaxed);
+  for (; idx < count; idx++) {
+    Worker &W = workers[idx];
+    pthread_mutex_init(&W.mutex, nullptr);
+    pthread_cond_init(&W.cond, nullptr);
+    pthread_attr_t attr;
+    pthread_attr_init(&attr);
+    pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+    bool started =
+        pthread_create(&W.thread, &attr, workerLoop, (void *)idx) == 0;
+    pthread_attr_destroy(&attr);
+    if (!started) {
+      // The pool keeps the workers that it has.
+      break;
+    }
+    if (affinitySize) {
+      pinWorker(idx);
+    }
+    idleWorkers.fetch_or(uint64_t(1) << idx, std::memory_order_release);
+  }
+  numWorkers.store(idx, std::memory_order_release);
+  pthread_mutex_unlock(&configMutex);
+}
+
+/// Claim up to \p count idle workers. \returns their bits.
+uint64_t claimWorkers(size_t count) {
+  size_t limit = numWorkers.load(std::memory_order_acquire);
+  uint64_t allowed =
+      limit >= 64 ? ~uint64_t(0) : (uint64_t(1) << limit) - uint64_t(1);
+  uint64_t idle = idleWorkers.load(std::memory_order_relaxed);
+  uint64_t claimed;
+  do {
+    uint64_t available = idle & allowed;
+    claimed = 0;
+    for (size_t i = 0; i < count && available; i++) {
+      uint64_t lowest = available & (~available + 1);
+      claimed |= lowest;
+      available &= available - 1;
+    }
+    if (!claimed) {
+      return 0;
+    }
+  } while (!idleWorkers.compare_exchange_weak(idle, idle & ~claimed,
+                                              std::memory_order_acquire,
+                                              std::memory_order_relaxed));
+  return claimed;
+}
+
+} // namespace
+
+extern "C" {
+
+// The definitions are weak, so that the bundles that are linked into one
+// program share a single pool.
+
+__attribute__((weak)) size_t glow_parallel_get_num_threads() {
+  size_t n = numThreads.load(std::memory_order_relaxed);
+  if (n) {
+    return n;
+  }
+  long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+  n = cpus < 1 ? 1 : size_t(cpus);
+  return n < GLOW_PARALLEL_MAX_THREADS ? n : GLOW_PARALLEL_MAX_THREADS;
+}
+
+__attribute__((weak)) void glow_parallel_set_num_threads(size_t n) {
+  n = n < 1 ? 1 : n;
+  numThreads.store(n < GLOW_PARALLEL_MAX_THREADS ? n
+                                                 : GLOW_PARALLEL_MAX_THREADS,
+                   std::memory_order_relaxed);
+}
+
+__attribute__((weak)) void glow_parallel_set_affinity(const int *cpus,
+                                                      size_t numCpus) {
+  pthread_mutex_lock(&configMutex);
+  affinitySize = numCpus < maxWorkers ? numCpus : maxWorkers;
+  for (size_t i = 0; i < affinitySize; i++) {
+    affinity[i] = cpus[i];
+  }
+  for (size_t i = 0, e = numWorkers.load(std::memory_order_relaxed); i < e;
+       i++) {
+    pinWorker(i);
+  }
+  pthread_mutex_unlock(&configMutex);
+}
+
+__attribute__((weak)) void glow_parallel_set_thread_limit(size_t n) {
+  threadLimit = n;
+}
+
+__attribute__((weak)) void glow_parallel_set_spin_count(size_t count) {
+  spinCount.store(count, std::memory_order_relaxed);
+}
+
+__attribute__((weak)) void glow_parallel_for(size_t numTasks,
+                                             size_t maxThreads,
+                                             glow_parallel_task_fn fn,
+                                             void *ctx) {
+  size_t n = glow_parallel_get_num_threads();
+  n = maxThreads < n ? maxThreads : n;
+  n = threadLimit && threadLimit < n ? threadLimit : n;
+  n = numTasks < n ? numTasks : n;
+  uint64_t claimed = 0;
+  if (n > 1) {
+    startWorkers(n - 1);
+    claimed = claimWorkers(n - 1);
+  }
+
+  Job job;
+  job.fn = fn;
+  job.ctx = ctx;
+  job.numTasks = numTasks;
+  job.next.store(0, std::memory_order_relaxed);
+  job.active.store(__builtin_popcountll(claimed), std::memory_order_relaxed);
+  for (uint64_t bits = claimed; bits; bits &= bits - 1) {
+    dispatch(workers[__builtin_ctzll(bits)], &job);
+  }
+
+  runTasks(job);
+  // The workers finish the tasks that they have started.
+  while (job.active.load(std::memory_order_acquire)) {
+    spinPause();
+  }
+}
+}
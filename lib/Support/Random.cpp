@@ -15,10 +15,90 @@
  */
 
 #include "glow/Support/Random.h"
+#include "glow/Support/Parallel.h"
 
+#include <algorithm>
+#include <atomic>
 #include <cassert>
 #include <random>
 
+namespace {
+
+/// The seed of the stream of fillRandUniform.
+uint64_t streamSeed = 0;
+
+/// The index of the next block of four numbers of the stream.
+std::atomic<uint64_t> streamPos{0};
+
+/// The number of elements that a task of fillRandUniform fills. This is a
+/// multiple of the size of a block.
+constexpr size_t fillChunkSize = 1 << 14;
+
+/// The number of blocks that a task generates before it converts them.
+constexpr size_t fillBatchBlocks = 64;
+
+/// \returns the high 32 bits of \p a * \p b, and sets \p lo to the low bits.
+inline uint32_t mulhilo(uint32_t a, uint32_t b, uint32_t &lo) {
+  uint64_t product = uint64_t(a) * b;
+  lo = uint32_t(product);
+  return uint32_t(product >> 32);
+}
+
+/// Compute the four random bits words of the block \p ctr of the stream with
+/// the key \p key into \p out. This is Philox4x32 with 10 rounds.
+inline void philox(uint64_t ctr, uint64_t key, uint32_t *out) {
+  uint32_t c0 = uint32_t(ctr), c1 = uint32_t(ctr >> 32), c2 = 0, c3 = 0;
+  uint32_t k0 = uint32_t(key), k1 = uint32_t(key >> 32);
+  for (unsigned round = 0; round < 10; round++) {
+    uint32_t lo0, lo1;
+    uint32_t hi0 = mulhilo(0xD2511F53, c0, lo0);
+    uint32_t hi1 = mulhilo(0xCD9E8D57, c2, lo1);
+    c0 = hi1 ^ c1 ^ k0;
+    c1 = lo1;
+    c2 = hi0 ^ c3 ^ k1;
+    c3 = lo0;
+    k0 += 0x9E3779B9;
+    k1 += 0xBB67AE85;
+  }
+  out[0] = c0;
+  out[1] = c1;
+  out[2] = c2;
+  out[3] = c3;
+}
+
+/// The arguments of a call to fillRandUniform.
+struct FillContext {
+  float *dest;
+  size_t size;
+  float low;
+  float range;
+  /// The block of the stream of the first element.
+  uint64_t pos;
+  uint64_t key;
+};
+
+/// Fill the chunk \p task of the elements of the FillContext \p ctx.
+void fillTask(void *ctx, size_t task) {
+  const auto &C = *static_cast<const FillContext *>(ctx);
+  size_t end = std::min((task + 1) * fillChunkSize, C.size);
+  // The top 24 bits of a word make a float in [0 .. 1) exactly.
+  float scale = C.range / float(1 << 24);
+  uint32_t bits[fillBatchBlocks * 4];
+  for (size_t i = task * fillChunkSize; i < end; i += fillBatchBlocks * 4) {
+    size_t n = std::min(fillBatchBlocks * 4, end - i);
+    for (size_t b = 0; b < n; b += 4) {
+      philox(C.pos + (i + b) / 4, C.key, &bits[b]);
+    }
+    // The conversion is a separate loop so that it is vectorized.
+    float *dest = C.dest + i;
+    for (size_t j = 0; j < n; j++) {
+      dest[j] = C.low + float(int32_t(bits[j] >> 8)) * scale;
+    }
+  }
+}
+
+} // namespace
+
 namespace glow {
 
 double nextRand() {
@@ -34,4 +114,19 @@ int nextRandInt(int a, int b) {
   return r / 2 + a;
 }
 
+void seedRandStream(uint64_t seed) {
+  streamSeed = seed;
+  streamPos = 0;
+}
+
+void fillRandUniform(float *dest, size_t size, float low, float high) {
+  assert(low <= high && "Invalid bounds");
+  FillContext ctx{dest, size, low, high - low, 0, streamSeed};
+  // Reserve the blocks of the elements, so that the next fill continues the
+  // stream after them.
+  ctx.pos = streamPos.fetch_add((size + 3) / 4);
+  size_t numTasks = (size + fillChunkSize - 1) / fillChunkSize;
+  glow_parallel_for(numTasks, glow_parallel_get_num_threads(), fillTask, &ctx);
+}
+
 } // namespace glow
@@ -0,0 +1,172 @@
+/**
+ * Copyright (c) 2017-present, Facebook, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "glow/Support/Trace.h"
+
+#include "llvm/Support/CommandLine.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/Format.h"
+#include "llvm/Support/raw_ostream.h"
+
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <vector>
+
+using namespace glow;
+
+static llvm::cl::opt<std::string> traceFile(
+    "trace-file",
+    llvm::cl::desc("Record the timeline of the compilation phases and of the "
+                   "executions of the instructions, and write it into this "
+                   "file in the Chrome trace format at exit"),
+    llvm::cl::init(""));
+
+namespace {
+/// An event of the timeline.
+struct TraceEvent {
+  std::string name;
+  const char *category;
+  uint64_t begin;
+  uint64_t end;
+  unsigned tid;
+};
+
+/// The events of the process. The file of -trace-file is written at exit.
+class TraceLog {
+  std::mutex mutex_;
+  std::vector<TraceEvent> events_;
+
+public:
+  std::atomic<bool> enabled_{false};
+
+  TraceLog() {
+    // Construct the stream before the log, so that it outlives it.
+    llvm::errs();
+  }
+
+  void record(TraceEvent event) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    events_.push_back(std::move(event));
+  }
+
+  void clear() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    events_.clear();
+  }
+
+  bool write(llvm::StringRef path);
+
+  ~TraceLog() {
+    if (!traceFile.empty() && !write(traceFile)) {
+      llvm::errs() << "Can't write the trace into " << traceFile << "\n";
+    }
+  }
+};
+
+TraceLog &getLog() {
+  static TraceLog log;
+  return log;
+}
+
+/// \returns a small number that identifies the calling thread in the trace.
+unsigned getTraceThreadId() {
+  static std::atomic<unsigned> nextId{0};
+  static thread_local unsigned id = nextId++;
+  return id;
+}
+
+/// Write \p str into \p os as a JSON string.
+void writeJSONString(llvm::raw_ostream &os, llvm::StringRef str) {
+  os << '"';
+  for (unsigned char c : str) {
+    if (c == '"' || c == '\\') {
+      os << '\\' << c;
+    } else if (c < 0x20) {
+      os << llvm::format("\\u%04x", c);
+    } else {
+      os << c;
+    }
+  }
+  os << '"';
+}
+} // namespace
+
+bool TraceLog::write(llvm::StringRef path) {
+  std::error_code EC;
+  llvm::raw_fd_ostream os(path, EC, llvm::sys::fs::F_None);
+  if (EC) {
+    return false;
+  }
+  std::lock_guard<std::mutex> lock(mutex_);
+  // The times of the events are in microseconds.
+  os << "{\"displayTimeUnit\": \"ns\", \"traceEvents\": [";
+  for (size_t i = 0, e = events_.size(); i < e; i++) {
+    const auto &event = events_[i];
+    os << (i ? ",\n" : "\n") << "{\"name\": ";
+    writeJSONString(os, event.name);
+    os << ", \"cat\": \"" << event.category << "\", \"ph\": \"X\", "
+       << llvm::format("\"ts\": %.3f, \"dur\": %.3f", event.begin / 1e3,
+                       (event.end - event.begin) / 1e3)
+       << ", \"pid\": 0, \"tid\": " << event.tid << "}";
+  }
+  os << "\n]}\n";
+  os.close();
+  if (os.has_error()) {
+    os.clear_error();
+    return false;
+  }
+  return true;
+}
+
+bool glow::isTraceEnabled() {
+  return getLog().enabled_.load(std::memory_order_relaxed) ||
+         !traceFile.empty();
+}
+
+void glow::enableTrace(bool enable) { getLog().enabled_ = enable; }
+
+uint64_t glow::getTraceTime() {
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(
+             std::chrono::steady_clock::now().time_since_epoch())
+      .count();
+}
+
+void glow::traceEvent(llvm::StringRef name, const char *category,
+                      uint64_t begin, uint64_t end) {
+  if (!isTraceEnabled()) {
+    return;
+  }
+  getLog().record({name.str(), category, begin, end, getTraceThreadId()});
+}
+
+bool glow::writeTrace(llvm::StringRef path) { return getLog().write(path); }
+
+void glow::clearTrace() { getLog().clear(); }
+
+TraceScope::TraceScope(llvm::StringRef name, const char *category)
+    : category_(category) {
+  if (isTraceEnabled()) {
+    name_ = name;
+    begin_ = getTraceTime();
+  }
+}
+
+TraceScope::~TraceScope() {
+  if (begin_) {
+    traceEvent(name_, category_, begin_, getTraceTime());
+  }
+}
@@ -18,7 +18,11 @@
 
 #include <algorithm>
 #include <chrono>
+#include <cmath>
+#include <cstdio>
 #include <limits>
+#include <string>
+#include <vector>
 
 namespace glow {
 
@@ -45,6 +49,68 @@ double bench(Benchmark *b, size_t reps) {
   return best;
 }
 
+/// The statistics of the execution times of the repetitions of a benchmark,
+/// in seconds.
+struct BenchStats {
+  double best;
+  double median;
+  double variance;
+};
+
+/// Run a benchmark once to warm it up and then \p reps times, and report the
+/// statistics of the execution times.
+BenchStats benchStats(Benchmark *b, size_t reps) {
+  std::vector<double> times;
+  b->setup();
+  b->run();
+  for (size_t i = 0; i < reps; i++) {
+    auto start = std::chrono::high_resolution_clock::now();
+    b->run();
+    auto end = std::chrono::high_resolution_clock::now();
+    times.push_back(std::chrono::duration<double>(end - start).count());
+  }
+  b->teardown();
+
+  std::sort(times.begin(), times.end());
+  double mean = 0;
+  for (double t : times) {
+    mean += t / reps;
+  }
+  double variance = 0;
+  for (double t : times) {
+    variance += (t - mean) * (t - mean) / reps;
+  }
+  double median = (times[(reps - 1) / 2] + times[reps / 2]) / 2;
+  return {times.front(), median, variance};
+}
+
+/// \returns the dimensions \p dims formatted as "AxBxC", which is used in
+/// the shape column of the reports.
+std::string formatDims(const std::vector<size_t> &dims) {
+  std::string str;
+  for (size_t i = 0; i < dims.size(); i++) {
+    str += (i ? "x" : "") + std::to_string(dims[i]);
+  }
+  return str;
+}
+
+/// Print the header of the CSV lines of reportBench.
+void printBenchHeader() {
+  printf("kernel,type,shape,reps,best_s,median_s,stddev_s,rate,unit\n");
+}
+
+/// Print a CSV line for the kernel \p kernel of the element type \p type on
+/// the shape \p shape, which performs \p work units (FLOPs or bytes) per
+/// run. The rate is reported in giga-units per second of the median time,
+/// with the name \p unit.
+void reportBench(const char *kernel, const char *type, const std::string &shape,
+                 size_t reps, double work, const char *unit,
+                 const BenchStats &stats) {
+  printf("%s,%s,%s,%zu,%.6e,%.6e,%.6e,%.3f,%s\n", kernel, type, shape.c_str(),
+         reps, stats.best, stats.median, std::sqrt(stats.variance),
+         work / stats.median / 1e9, unit);
+}
+
 } // namespace glow
 
 #endif // GLOW_TESTS_BENCHMARK_H
@@ -0,0 +1,210 @@
+/**
+ * Copyright (c) 2017-present, Facebook, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include <cstdint>
+#include <cstdlib>
+#include <random>
+#include <vector>
+
+#include "Bench.h"
+
+using namespace glow;
+
+extern "C" {
+// Forward declare functions from libjit.
+extern void libjit_convolution_f(float *outW, const float *inW,
+                                 const float *filterW, const float *biasW,
+                                 const size_t *outWdims, const size_t *inWdims,
+                                 const size_t *filterWdims,
+                                 const size_t *biasWdims, size_t filterSize,
+                                 size_t stride, size_t pad,
+                                 unsigned depthUnroll, unsigned cbSize);
+extern void libjit_convolution_i8(
+    int8_t *outW, const int8_t *inW, const int8_t *filterW, const int8_t *biasW,
+    const size_t *outWdims, const size_t *inWdims, const size_t *filterWdims,
+    const size_t *biasWdims, size_t filterSize, size_t stride, size_t pad,
+    int32_t outOffset, int32_t inOffset, int32_t filterOffset,
+    int32_t biasOffset, int32_t biasPre, int32_t biasPost, int32_t biasScale,
+    int32_t outPre, int32_t outPost, int32_t outScale, unsigned depthUnroll);
+extern void libjit_grouped_convolution_f(
+    float *outW, const float *inW, const float *filterW, const float *biasW,
+    const size_t *outWdims, const size_t *inWdims, const size_t *filterWdims,
+    size_t filterSize, size_t stride, size_t pad, size_t group);
+extern void libjit_grouped_convolution_i8(
+    int8_t *outW, const int8_t *inW, const int8_t *filterW, const int8_t *biasW,
+    const size_t *outWdims, const size_t *inWdims, const size_t *filterWdims,
+    size_t filterSize, size_t stride, size_t pad, size_t group,
+    int32_t outOffset, int32_t inOffset, int32_t filterOffset,
+    int32_t biasOffset, int32_t biasPre, int32_t biasPost, int32_t biasScale,
+    int32_t outPre, int32_t outPost, int32_t outScale);
+}
+
+/// The shape of a convolution layer in NHWC.
+struct ConvShape {
+  /// The model and layer of the shape, for the report.
+  const char *layer;
+  size_t n, h, w, c;
+  size_t depth;
+  size_t kernel;
+  size_t stride;
+  size_t pad;
+  size_t group;
+};
+
+/// Convolutions of ResNet50, VGG16 and MobileNet.
+static const ConvShape convShapes[] = {
+    {"resnet50.conv1", 1, 224, 224, 3, 64, 7, 2, 3, 1},
+    {"resnet50.res2a_branch2b", 1, 56, 56, 64, 64, 3, 1, 1, 1},
+    {"resnet50.res3a_branch2a", 1, 56, 56, 256, 128, 1, 1, 0, 1},
+    {"resnet50.res4a_branch2b", 1, 14, 14, 256, 256, 3, 1, 1, 1},
+    {"resnet50.res5a_branch2c", 1, 7, 7, 512, 2048, 1, 1, 0, 1},
+    {"vgg16.conv3_1", 1, 56, 56, 128, 256, 3, 1, 1, 1},
+    {"vgg16.conv5_1", 1, 14, 14, 512, 512, 3, 1, 1, 1},
+    {"mobilenet.conv_dw_2", 1, 112, 112, 64, 64, 3, 2, 1, 64},
+};
+
+/// Benchmark a convolution of float or int8 tensors.
+template <class ElemTy> class ConvBench : public Benchmark {
+  ConvShape shape_;
+  std::vector<ElemTy> in_;
+  std::vector<ElemTy> filter_;
+  std::vector<ElemTy> bias_;
+  std::vector<ElemTy> out_;
+
+  /// Dimensions expressed in libjit's format.
+  size_t inDims_[4];
+  size_t outDims_[4];
+  size_t filterDims_[4];
+  size_t biasDims_[1];
+
+public:
+  explicit ConvBench(const ConvShape &shape) : shape_(shape) {
+    size_t outH = (shape.h + 2 * shape.pad - shape.kernel) / shape.stride + 1;
+    size_t outW = (shape.w + 2 * shape.pad - shape.kernel) / shape.stride + 1;
+    size_t inPerGroup = shape.c / shape.group;
+    inDims_[0] = shape.n;
+    inDims_[1] = shape.h;
+    inDims_[2] = shape.w;
+    inDims_[3] = shape.c;
+    outDims_[0] = shape.n;
+    outDims_[1] = outH;
+    outDims_[2] = outW;
+    outDims_[3] = shape.depth;
+    filterDims_[0] = shape.depth;
+    filterDims_[1] = shape.kernel;
+    filterDims_[2] = shape.kernel;
+    filterDims_[3] = inPerGroup;
+    biasDims_[0] = shape.depth;
+  }
+
+  virtual void setup() override {
+    in_.resize(inDims_[0] * inDims_[1] * inDims_[2] * inDims_[3]);
+    filter_.resize(filterDims_[0] * filterDims_[1] * filterDims_[2] *
+                   filterDims_[3]);
+    bias_.resize(biasDims_[0]);
+    out_.resize(outDims_[0] * outDims_[1] * outDims_[2] * outDims_[3]);
+    randomize(in_);
+    randomize(filter_);
+    randomize(bias_);
+  }
+
+  virtual void run() override {
+    convolve(out_.data(), in_.data(), filter_.data(), bias_.data());
+  }
+
+  virtual void teardown() override {}
+
+  /// \returns the number of floating point operations of a run.
+  double flops() const {
+    return 2.0 * outDims_[0] * outDims_[1] * outDims_[2] * outDims_[3] *
+           filterDims_[1] * filterDims_[2] * filterDims_[3];
+  }
+
+private:
+  /// \returns the number of output channels that the CPU backend processes
+  /// at once.
+  unsigned depthUnroll() const { return outDims_[3] % 8 == 0 ? 8 : 1; }
+
+  void convolve(float *out, const float *in, const float *filter,
+                const float *bias) {
+    if (shape_.group > 1) {
+      libjit_grouped_convolution_f(out, in, filter, bias, outDims_, inDims_,
+                                   filterDims_, shape_.kernel, shape_.stride,
+                                   shape_.pad, shape_.group);
+      return;
+    }
+    libjit_convolution_f(out, in, filter, bias, outDims_, inDims_, filterDims_,
+                         biasDims_, shape_.kernel, shape_.stride, shape_.pad,
+                         depthUnroll(), /* cbSize */ 512);
+  }
+
+  void convolve(int8_t *out, const int8_t *in, const int8_t *filter,
+                const int8_t *bias) {
+    // Typical quantization parameters of a convolution layer, with a pre-shift
+    // that keeps the scaled sums of the deepest layers in 32 bits.
+    if (shape_.group > 1) {
+      libjit_grouped_convolution_i8(out, in, filter, bias, outDims_, inDims_,
+                                    filterDims_, shape_.kernel, shape_.stride,
+                                    shape_.pad, shape_.group, -3, 11, 2, 0, 0,
+                                    0, 1, 8, 15, 300);
+      return;
+    }
+    libjit_convolution_i8(out, in, filter, bias, outDims_, inDims_,
+                          filterDims_, biasDims_, shape_.kernel, shape_.stride,
+                          shape_.pad, -3, 11, 2, 0, 0, 0, 1, 8, 15, 300,
+                          depthUnroll());
+  }
+
+  void randomize(std::vector<float> &a) {
+    std::mt19937 gen;
+    std::uniform_real_distribution<> dis(-1.0, 1.0);
+    for (auto &v : a) {
+      v = dis(gen);
+    }
+  }
+
+  void randomize(std::vector<int8_t> &a) {
+    std::mt19937 gen;
+    std::uniform_int_distribution<> dis(-128, 127);
+    for (auto &v : a) {
+      v = dis(gen);
+    }
+  }
+};
+
+/// Run the benchmarks for the element type \p ElemTy, that is named
+/// \p typeName in the report.
+template <class ElemTy> void benchConv(const char *typeName, size_t reps) {
+  for (const auto &shape : convShapes) {
+    ConvBench<ElemTy> b(shape);
+    auto stats = benchStats(&b, reps);
+    std::string desc = std::string(shape.layer) + " " +
+                       formatDims({shape.n, shape.h, shape.w, shape.c}) +
+                       " d" + std::to_string(shape.depth) + " k" +
+                       std::to_string(shape.kernel) + " s" +
+                       std::to_string(shape.stride) + " g" +
+                       std::to_string(shape.group);
+    reportBench("convolution", typeName, desc, reps, b.flops(), "GFLOP/s",
+                stats);
+  }
+}
+
+int main(int argc, char **argv) {
+  // The number of repetitions can be provided on the command line.
+  size_t reps = argc > 1 ? atoi(argv[1]) : 10;
+  printBenchHeader();
+  benchConv<float>("float", reps);
+  benchConv<int8_t>("int8", reps);
+}
@@ -0,0 +1,128 @@
+/**
+ * Copyright (c) 2017-present, Facebook, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include <cstdlib>
+#include <string>
+#include <vector>
+
+#include "Bench.h"
+
+#include "glow/ExecutionEngine/ExecutionEngine.h"
+#include "glow/Graph/Graph.h"
+
+using namespace glow;
+
+/// The graphs of elementwise operators that are benchmarked.
+enum class ElementwiseKind {
+  /// The residual connection of ResNet50: relu(x + y).
+  Residual,
+  /// The gates of an LSTM cell: c' = sigmoid(f) * c + sigmoid(i) * tanh(g)
+  /// and h' = sigmoid(o) * tanh(c').
+  LSTMCell,
+};
+
+/// Benchmark a graph of elementwise operators. The CPU backend stacks the
+/// operators into a single loop when it generates the code, so the graph is
+/// compiled and run through the execution engine rather than by calling a
+/// libjit kernel.
+class ElementwiseBench : public Benchmark {
+  ElementwiseKind kind_;
+  std::vector<size_t> dims_;
+  ExecutionEngine EE_{BackendKind::CPU};
+
+  /// The number of tensors that a run reads and writes.
+  size_t numTensors_{0};
+
+public:
+  ElementwiseBench(ElementwiseKind kind, const std::vector<size_t> &dims)
+      : kind_(kind), dims_(dims) {}
+
+  virtual void setup() override {
+    auto &mod = EE_.getModule();
+    Function *F = mod.createFunction("elementwise");
+    switch (kind_) {
+    case ElementwiseKind::Residual: {
+      auto *x = createInput("x");
+      auto *y = createInput("y");
+      auto *add = F->createAdd("add", x, y);
+      F->createSave("save", F->createRELU("relu", add));
+      numTensors_ = 3;
+      break;
+    }
+    case ElementwiseKind::LSTMCell: {
+      auto *f = F->createSigmoid("f", createInput("forget"));
+      auto *i = F->createSigmoid("i", createInput("input"));
+      auto *o = F->createSigmoid("o", createInput("output"));
+      auto *g = F->createTanh("g", createInput("gate"));
+      auto *c = F->createAdd("c", F->createMul("fc", f, createInput("cell")),
+                             F->createMul("ig", i, g));
+      auto *h = F->createMul("h", o, F->createTanh("tanhc", c));
+      F->createSave("saveC", c);
+      F->createSave("saveH", h);
+      numTensors_ = 7;
+      break;
+    }
+    }
+    EE_.compile(CompilationMode::Infer, F);
+  }
+
+  virtual void run() override { EE_.run({}, {}); }
+
+  virtual void teardown() override {}
+
+  /// \returns the number of bytes that a run reads and writes.
+  double bytes() const {
+    size_t size = 1;
+    for (auto d : dims_) {
+      size *= d;
+    }
+    return double(size) * numTensors_ * sizeof(float);
+  }
+
+private:
+  /// \returns a new public variable with random content, named \p name.
+  Variable *createInput(llvm::StringRef name) {
+    auto *V = EE_.getModule().createVariable(ElemKind::FloatTy, dims_, name,
+                                             VisibilityKind::Public,
+                                             Variable::TrainKind::None);
+    V->getHandle().randomize(-1.0, 1.0);
+    return V;
+  }
+};
+
+int main(int argc, char **argv) {
+  // The number of repetitions can be provided on the command line.
+  size_t reps = argc > 1 ? atoi(argv[1]) : 100;
+  struct {
+    ElementwiseKind kind;
+    const char *name;
+    const char *layer;
+    std::vector<size_t> dims;
+  } cases[] = {
+      {ElementwiseKind::Residual, "add_relu", "resnet50.res2a",
+       {1, 56, 56, 256}},
+      {ElementwiseKind::Residual, "add_relu", "resnet50.res5a",
+       {8, 7, 7, 2048}},
+      {ElementwiseKind::LSTMCell, "lstm_cell", "lstm.cell", {64, 1024}},
+      {ElementwiseKind::LSTMCell, "lstm_cell", "lstm.cell", {128, 4096}},
+  };
+  printBenchHeader();
+  for (const auto &c : cases) {
+    ElementwiseBench b(c.kind, c.dims);
+    auto stats = benchStats(&b, reps);
+    std::string desc = std::string(c.layer) + " " + formatDims(c.dims);
+    reportBench(c.name, "float", desc, reps, b.bytes(), "GB/s", stats);
+  }
+}
@@ -13,8 +13,10 @@
  * See the License for the specific language governing permissions and
  * limitations under the License.
  */
+#include <cstdint>
 #include <cstdlib>
 #include <random>
+#include <vector>
 
 #include "Bench.h"
 
@@ -24,24 +26,40 @@ extern "C" {
 // Forward declare functions from libjit.
 extern void libjit_matmul_f(float *c, const float *a, const float *b,
                             const size_t *cDims, const size_t *aDims,
-                            const size_t *bDims);
+                            const size_t *bDims, const size_t *blocking,
+                            size_t numThreads, unsigned transposeA,
+                            unsigned transposeB);
+extern void libjit_matmul_i8(int8_t *c, const int8_t *a, const int8_t *b,
+                             const size_t *cDims, const size_t *aDims,
+                             const size_t *bDims, int32_t outOffset,
+                             int32_t lhsOffset, int32_t rhsOffset,
+                             int32_t outPre, int32_t outPost, int32_t outScale,
+                             const size_t *blocking, size_t numThreads);
 }
 
-/// Benchmark an (m x k) * (k x n) = (m x n) matrix multiplication.
-class GemmBench : public Benchmark {
+/// Benchmark an (m x k) * (k x n) = (m x n) matrix multiplication of float or
+/// int8 matrices.
+template <class ElemTy> class GemmBench : public Benchmark {
   /// Matrices.
-  std::vector<float> a;
-  std::vector<float> b;
-  std::vector<float> c;
+  std::vector<ElemTy> a;
+  std::vector<ElemTy> b;
+  std::vector<ElemTy> c;
 
   /// Dimensions expressed in libjit's format.
   size_t aDims[2];
   size_t bDims[2];
   size_t cDims[2];
 
+  /// The cache block sizes {mc, kc, nc}. These are the defaults that the CPU
+  /// backend uses for a 32KB L1, 256KB L2 and 8MB L3.
+  size_t blocking[3] = {252, 128, 4096};
+
+  /// The number of threads used by the matrix multiplication.
+  size_t numThreads;
+
 public:
-  GemmBench(size_t m, size_t n, size_t k)
-      : aDims{m, k}, bDims{k, n}, cDims{m, n} {}
+  GemmBench(size_t m, size_t n, size_t k, size_t numThreads)
+      : aDims{m, k}, bDims{k, n}, cDims{m, n}, numThreads(numThreads) {}
 
   virtual void setup() override {
     size_t m = cDims[0];
@@ -55,15 +73,23 @@ public:
     randomize(m, n, c.data(), n);
   }
 
-  virtual void run() override {
-    libjit_matmul_f(c.data(), a.data(), b.data(), cDims, aDims, bDims);
-  }
+  virtual void run() override { matmul(c.data(), a.data(), b.data()); }
 
   virtual void teardown() override {}
 
   double gflops() const { return 2.0 * cDims[0] * cDims[1] * aDims[1] / 1e9; }
 
 private:
+  void matmul(float *c, const float *a, const float *b) {
+    libjit_matmul_f(c, a, b, cDims, aDims, bDims, blocking, numThreads, 0, 0);
+  }
+
+  void matmul(int8_t *c, const int8_t *a, const int8_t *b) {
+    // Typical quantization parameters of a FC layer.
+    libjit_matmul_i8(c, a, b, cDims, aDims, bDims, 7, 31, -12, 2, 15, 300,
+                     blocking, numThreads);
+  }
+
   void randomize(size_t m, size_t n, float *a, size_t lda) {
     std::mt19937 gen;
     std::uniform_real_distribution<> dis(-1.0, 1.0);
@@ -73,29 +99,58 @@ private:
       }
     }
   }
+
+  void randomize(size_t m, size_t n, int8_t *a, size_t lda) {
+    std::mt19937 gen;
+    std::uniform_int_distribution<> dis(-128, 127);
+    for (size_t i = 0; i < m; i++) {
+      for (size_t j = 0; j < n; j++) {
+        a[i * lda + j] = dis(gen);
+      }
+    }
+  }
 };
 
-int main() {
+/// Run the benchmarks for the element type \p ElemTy, that is named
+/// \p typeName in the report.
+template <class ElemTy>
+void benchGemm(const char *typeName, const std::vector<size_t> &threadCounts) {
   constexpr int reps = 100;
-  printf("outX, outY, lhsX, lhsY, rhsX, rhsY, gflops/s, \n");
+  for (size_t numThreads : threadCounts) {
+    for (int i = 0; i < 2; i++) {
+      for (int j = 0; j < 2; j++) {
+        for (int p = 0; p < 2; p++) {
+          if (i == 1 && j == 1 && p == 1) {
+            break;
+          }
+          for (size_t x = 32; x <= 1024; x += 32) {
+            size_t m = i ? 32 : x;
+            size_t n = j ? 32 : x;
+            size_t k = p ? 32 : x;
 
-  for (int i = 0; i < 2; i++) {
-    for (int j = 0; j < 2; j++) {
-      for (int p = 0; p < 2; p++) {
-        if (i == 1 && j == 1 && p == 1) {
-          break;
-        }
-        for (size_t x = 32; x <= 1024; x += 32) {
-          size_t m = i ? 32 : x;
-          size_t n = j ? 32 : x;
-          size_t k = p ? 32 : x;
-
-          GemmBench b(m, 32, m);
-          auto time = bench(&b, reps);
-          printf("%4zu, %-4zu,   %4zu, %-4zu,   %4zu,  %-4zu,   %5.2lf\n", m, n,
-                 m, k, k, n, b.gflops() / time);
+            GemmBench<ElemTy> b(m, n, k, numThreads);
+            auto time = bench(&b, reps);
+            printf("%5s, %7zu, %4zu, %-4zu,   %4zu, %-4zu,   %4zu,  %-4zu,   "
+                   "%5.2lf\n",
+                   typeName, numThreads, m, n, m, k, k, n, b.gflops() / time);
+          }
         }
       }
     }
   }
 }
+
+int main(int argc, char **argv) {
+  // The thread counts to benchmark can be provided on the command line, e.g.
+  // "GemmBench 1 2 4 8". By default only the single-threaded kernel is used.
+  std::vector<size_t> threadCounts;
+  for (int i = 1; i < argc; i++) {
+    threadCounts.push_back(atoi(argv[i]));
+  }
+  if (threadCounts.empty()) {
+    threadCounts.push_back(1);
+  }
+  printf(" type, threads, outX, outY, lhsX, lhsY, rhsX, rhsY, gops/s, \n");
+  benchGemm<float>("float", threadCounts);
+  benchGemm<int8_t>("int8", threadCounts);
+}
@@ -0,0 +1,151 @@
+/**
+ * Copyright (c) 2017-present, Facebook, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include <cstdint>
+#include <cstdlib>
+#include <random>
+#include <vector>
+
+#include "Bench.h"
+
+using namespace glow;
+
+extern "C" {
+// Forward declare functions from libjit.
+extern void libjit_pool_max_f(const float *inW, float *outW,
+                              const size_t *inWdims, const size_t *outWdims,
+                              size_t filterSize, size_t stride, size_t pad);
+extern void libjit_pool_max_i8(const int8_t *inW, int8_t *outW,
+                               const size_t *inWdims, const size_t *outWdims,
+                               size_t filterSize, size_t stride, size_t pad);
+extern void libjit_pool_avg_f(const float *inW, float *outW,
+                              const size_t *inWdims, const size_t *outWdims,
+                              size_t filterSize, size_t stride, size_t pad);
+extern void libjit_pool_avg_i8(const int8_t *inW, int8_t *outW,
+                               const size_t *inWdims, const size_t *outWdims,
+                               size_t filterSize, size_t stride, size_t pad,
+                               int32_t outOffset, int32_t inOffset,
+                               int32_t outPre, int32_t outPost,
+                               int32_t outScale);
+}
+
+/// The shape of a pooling layer in NHWC.
+struct PoolShape {
+  /// The model and layer of the shape, for the report.
+  const char *layer;
+  /// Max pooling if set, average pooling otherwise.
+  bool isMax;
+  size_t n, h, w, c;
+  size_t kernel;
+  size_t stride;
+  size_t pad;
+};
+
+/// Pooling layers of ResNet50 and VGG16.
+static const PoolShape poolShapes[] = {
+    {"resnet50.pool1", true, 1, 112, 112, 64, 3, 2, 1},
+    {"resnet50.pool5", false, 1, 7, 7, 2048, 7, 1, 0},
+    {"vgg16.pool1", true, 1, 224, 224, 64, 2, 2, 0},
+    {"vgg16.pool4", true, 1, 28, 28, 512, 2, 2, 0},
+    {"googlenet.pool3", true, 1, 28, 28, 480, 3, 2, 1},
+    {"googlenet.avgpool", false, 8, 14, 14, 512, 5, 3, 0},
+};
+
+/// Benchmark a max or average pooling of float or int8 tensors.
+template <class ElemTy> class PoolBench : public Benchmark {
+  PoolShape shape_;
+  std::vector<ElemTy> in_;
+  std::vector<ElemTy> out_;
+
+  /// Dimensions expressed in libjit's format.
+  size_t inDims_[4];
+  size_t outDims_[4];
+
+public:
+  explicit PoolBench(const PoolShape &shape) : shape_(shape) {
+    inDims_[0] = shape.n;
+    inDims_[1] = shape.h;
+    inDims_[2] = shape.w;
+    inDims_[3] = shape.c;
+    outDims_[0] = shape.n;
+    outDims_[1] = (shape.h + 2 * shape.pad - shape.kernel) / shape.stride + 1;
+    outDims_[2] = (shape.w + 2 * shape.pad - shape.kernel) / shape.stride + 1;
+    outDims_[3] = shape.c;
+  }
+
+  virtual void setup() override {
+    in_.resize(inDims_[0] * inDims_[1] * inDims_[2] * inDims_[3]);
+    out_.resize(outDims_[0] * outDims_[1] * outDims_[2] * outDims_[3]);
+    std::mt19937 gen;
+    std::uniform_int_distribution<> dis(-128, 127);
+    for (auto &v : in_) {
+      v = dis(gen);
+    }
+  }
+
+  virtual void run() override { pool(out_.data(), in_.data()); }
+
+  virtual void teardown() override {}
+
+  /// \returns the number of bytes that a run reads and writes.
+  double bytes() const {
+    return double(in_.size() + out_.size()) * sizeof(ElemTy);
+  }
+
+private:
+  void pool(float *out, const float *in) {
+    if (shape_.isMax) {
+      libjit_pool_max_f(in, out, inDims_, outDims_, shape_.kernel,
+                        shape_.stride, shape_.pad);
+    } else {
+      libjit_pool_avg_f(in, out, inDims_, outDims_, shape_.kernel,
+                        shape_.stride, shape_.pad);
+    }
+  }
+
+  void pool(int8_t *out, const int8_t *in) {
+    if (shape_.isMax) {
+      libjit_pool_max_i8(in, out, inDims_, outDims_, shape_.kernel,
+                         shape_.stride, shape_.pad);
+    } else {
+      // The sum is scaled by the inverse of the area of the filter.
+      libjit_pool_avg_i8(in, out, inDims_, outDims_, shape_.kernel,
+                         shape_.stride, shape_.pad, 3, -2, 0, 15, 670);
+    }
+  }
+};
+
+/// Run the benchmarks for the element type \p ElemTy, that is named
+/// \p typeName in the report.
+template <class ElemTy> void benchPool(const char *typeName, size_t reps) {
+  for (const auto &shape : poolShapes) {
+    PoolBench<ElemTy> b(shape);
+    auto stats = benchStats(&b, reps);
+    std::string desc = std::string(shape.layer) + " " +
+                       formatDims({shape.n, shape.h, shape.w, shape.c}) +
+                       " k" + std::to_string(shape.kernel) + " s" +
+                       std::to_string(shape.stride);
+    reportBench(shape.isMax ? "pool_max" : "pool_avg", typeName, desc, reps,
+                b.bytes(), "GB/s", stats);
+  }
+}
+
+int main(int argc, char **argv) {
+  // The number of repetitions can be provided on the command line.
+  size_t reps = argc > 1 ? atoi(argv[1]) : 100;
+  printBenchHeader();
+  benchPool<float>("float", reps);
+  benchPool<int8_t>("int8", reps);
+}
@@ -0,0 +1,127 @@
+/**
+ * Copyright (c) 2017-present, Facebook, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include <cstdint>
+#include <cstdlib>
+#include <random>
+#include <vector>
+
+#include "Bench.h"
+
+using namespace glow;
+
+extern "C" {
+// Forward declare functions from libjit.
+extern void libjit_quantize_i8(int8_t *outW, const float *inW, size_t numElem,
+                               float scale, int32_t offset);
+extern void libjit_dequantize_f(float *outW, const int8_t *inW, size_t numElem,
+                                float scale, int32_t offset);
+extern void libjit_rescale_i8(int8_t *outW, const int8_t *inW, size_t numElem,
+                              int32_t outOffset, int32_t inOffset, int32_t pre,
+                              int32_t post, int32_t scale);
+}
+
+/// The shape of an activation tensor that is converted between float and
+/// int8 at the boundaries of the quantized parts of a network.
+struct QuantizeShape {
+  /// The model and layer of the shape, for the report.
+  const char *layer;
+  std::vector<size_t> dims;
+};
+
+/// Activations of ResNet50 and of LSTM language models.
+static const QuantizeShape quantizeShapes[] = {
+    {"resnet50.res2a", {1, 56, 56, 256}},
+    {"resnet50.res5c", {1, 7, 7, 2048}},
+    {"vgg16.conv1_1", {1, 224, 224, 64}},
+    {"lstm.hidden", {64, 1024}},
+};
+
+/// The conversions that are benchmarked.
+enum class QuantizeKind { Quantize, Dequantize, Rescale };
+
+/// Benchmark a conversion between float and int8 tensors, or between int8
+/// tensors of different scales.
+class QuantizeBench : public Benchmark {
+  QuantizeKind kind_;
+  size_t size_;
+  std::vector<float> float_;
+  std::vector<int8_t> in_;
+  std::vector<int8_t> out_;
+
+public:
+  QuantizeBench(QuantizeKind kind, size_t size) : kind_(kind), size_(size) {}
+
+  virtual void setup() override {
+    float_.resize(size_);
+    in_.resize(size_);
+    out_.resize(size_);
+    std::mt19937 gen;
+    std::uniform_int_distribution<> dis(-128, 127);
+    for (size_t i = 0; i < size_; i++) {
+      in_[i] = dis(gen);
+      float_[i] = in_[i] * 0.05f;
+    }
+  }
+
+  virtual void run() override {
+    switch (kind_) {
+    case QuantizeKind::Quantize:
+      libjit_quantize_i8(out_.data(), float_.data(), size_, 0.05f, 3);
+      break;
+    case QuantizeKind::Dequantize:
+      libjit_dequantize_f(float_.data(), in_.data(), size_, 0.05f, 3);
+      break;
+    case QuantizeKind::Rescale:
+      // Rescale from a scale of 0.05 to a scale of 0.1.
+      libjit_rescale_i8(out_.data(), in_.data(), size_, -2, 3, 0, 15, 16384);
+      break;
+    }
+  }
+
+  virtual void teardown() override {}
+
+  /// \returns the number of bytes that a run reads and writes.
+  double bytes() const {
+    size_t floatBytes = kind_ == QuantizeKind::Rescale ? 1 : sizeof(float);
+    return double(size_) * (floatBytes + 1);
+  }
+};
+
+int main(int argc, char **argv) {
+  // The number of repetitions can be provided on the command line.
+  size_t reps = argc > 1 ? atoi(argv[1]) : 100;
+  const std::pair<QuantizeKind, const char *> kinds[] = {
+      {QuantizeKind::Quantize, "quantize"},
+      {QuantizeKind::Dequantize, "dequantize"},
+      {QuantizeKind::Rescale, "rescale"},
+  };
+  printBenchHeader();
+  for (const auto &kind : kinds) {
+    for (const auto &shape : quantizeShapes) {
+      size_t size = 1;
+      for (auto d : shape.dims) {
+        size *= d;
+      }
+      QuantizeBench b(kind.first, size);
+      auto stats = benchStats(&b, reps);
+      std::string desc =
+          std::string(shape.layer) + " " + formatDims(shape.dims);
+      const char *type =
+          kind.first == QuantizeKind::Dequantize ? "float" : "int8";
+      reportBench(kind.second, type, desc, reps, b.bytes(), "GB/s", stats);
+    }
+  }
+}
@@ -0,0 +1,133 @@
+/**
+ * Copyright (c) 2017-present, Facebook, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include <cstdint>
+#include <cstdlib>
+#include <random>
+#include <vector>
+
+#include "Bench.h"
+
+using namespace glow;
+
+extern "C" {
+// Forward declare functions from libjit.
+extern void libjit_softmax_f(const float *inW, float *outW, const size_t *idim,
+                             const size_t *odim);
+extern void libjit_softmax_cross_entropy_loss_f(float *CE, const float *inW,
+                                                const size_t *labels,
+                                                const size_t *idim);
+extern void libjit_softmax_topk_f(float *values, size_t *indices,
+                                  const float *input, size_t k, size_t n,
+                                  size_t size, size_t numThreads);
+}
+
+/// The shape of the logits of a classifier.
+struct SoftMaxShape {
+  /// The model and layer of the shape, for the report.
+  const char *layer;
+  size_t rows;
+  size_t classes;
+};
+
+/// The classifiers of ResNet50 and of LSTM language models.
+static const SoftMaxShape softMaxShapes[] = {
+    {"resnet50.prob", 1, 1000},
+    {"resnet50.prob", 64, 1000},
+    {"lstm.vocab", 32, 10000},
+    {"lstm.vocab", 128, 32000},
+};
+
+/// The variants of the SoftMax kernels.
+enum class SoftMaxKind { SoftMax, CrossEntropyLoss, TopK };
+
+/// Benchmark a SoftMax, or a SoftMax that is fused into the cross entropy
+/// loss or into a TopK.
+class SoftMaxBench : public Benchmark {
+  SoftMaxKind kind_;
+  std::vector<float> in_;
+  std::vector<float> out_;
+  std::vector<size_t> labels_;
+  std::vector<size_t> indices_;
+
+  /// Dimensions expressed in libjit's format.
+  size_t dims_[2];
+
+  /// The number of elements that the TopK selects in every row.
+  static constexpr size_t k_ = 5;
+
+public:
+  SoftMaxBench(SoftMaxKind kind, size_t rows, size_t classes)
+      : kind_(kind), dims_{rows, classes} {}
+
+  virtual void setup() override {
+    in_.resize(dims_[0] * dims_[1]);
+    out_.resize(dims_[0] * dims_[1]);
+    labels_.resize(dims_[0]);
+    indices_.resize(dims_[0] * k_);
+    std::mt19937 gen;
+    std::uniform_real_distribution<> dis(-10.0, 10.0);
+    for (auto &v : in_) {
+      v = dis(gen);
+    }
+    for (size_t i = 0; i < dims_[0]; i++) {
+      labels_[i] = gen() % dims_[1];
+    }
+  }
+
+  virtual void run() override {
+    switch (kind_) {
+    case SoftMaxKind::SoftMax:
+      libjit_softmax_f(in_.data(), out_.data(), dims_, dims_);
+      break;
+    case SoftMaxKind::CrossEntropyLoss:
+      libjit_softmax_cross_entropy_loss_f(out_.data(), in_.data(),
+                                          labels_.data(), dims_);
+      break;
+    case SoftMaxKind::TopK:
+      libjit_softmax_topk_f(out_.data(), indices_.data(), in_.data(), k_,
+                            dims_[1], in_.size(), 1);
+      break;
+    }
+  }
+
+  virtual void teardown() override {}
+
+  /// \returns the number of bytes that a run reads and writes.
+  double bytes() const {
+    double inBytes = in_.size() * sizeof(float);
+    return kind_ == SoftMaxKind::SoftMax ? 2 * inBytes : inBytes;
+  }
+};
+
+int main(int argc, char **argv) {
+  // The number of repetitions can be provided on the command line.
+  size_t reps = argc > 1 ? atoi(argv[1]) : 100;
+  const std::pair<SoftMaxKind, const char *> kinds[] = {
+      {SoftMaxKind::SoftMax, "softmax"},
+      {SoftMaxKind::CrossEntropyLoss, "softmax_cross_entropy_loss"},
+      {SoftMaxKind::TopK, "softmax_topk"},
+  };
+  printBenchHeader();
+  for (const auto &kind : kinds) {
+    for (const auto &shape : softMaxShapes) {
+      SoftMaxBench b(kind.first, shape.rows, shape.classes);
+      auto stats = benchStats(&b, reps);
+      std::string desc = std::string(shape.layer) + " " +
+                         formatDims({shape.rows, shape.classes});
+      reportBench(kind.second, "float", desc, reps, b.bytes(), "GB/s", stats);
+    }
+  }
+}
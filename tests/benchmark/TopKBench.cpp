@@ -0,0 +1,118 @@
+/**
+ * Copyright (c) 2017-present, Facebook, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include <cstdint>
+#include <cstdlib>
+#include <random>
+#include <vector>
+
+#include "Bench.h"
+
+using namespace glow;
+
+extern "C" {
+// Forward declare functions from libjit.
+extern void libjit_topk_f(float *values, size_t *indices, const float *input,
+                          size_t k, size_t n, size_t size, size_t numThreads);
+extern void libjit_topk_i8(int8_t *values, size_t *indices,
+                           const int8_t *input, size_t k, size_t n, size_t size,
+                           size_t numThreads);
+}
+
+/// The shape of a TopK.
+struct TopKShape {
+  /// The model and layer of the shape, for the report.
+  const char *layer;
+  size_t rows;
+  size_t n;
+  size_t k;
+};
+
+/// The predictions of ResNet50 and the beam search of LSTM language models.
+static const TopKShape topKShapes[] = {
+    {"resnet50.top5", 1, 1000, 5},
+    {"resnet50.top5", 64, 1000, 5},
+    {"lstm.beam", 8, 32000, 10},
+    {"lstm.beam", 128, 32000, 10},
+};
+
+/// Benchmark a TopK over the rows of a float or int8 tensor.
+template <class ElemTy> class TopKBench : public Benchmark {
+  TopKShape shape_;
+  size_t numThreads_;
+  std::vector<ElemTy> in_;
+  std::vector<ElemTy> values_;
+  std::vector<size_t> indices_;
+
+public:
+  TopKBench(const TopKShape &shape, size_t numThreads)
+      : shape_(shape), numThreads_(numThreads) {}
+
+  virtual void setup() override {
+    in_.resize(shape_.rows * shape_.n);
+    values_.resize(shape_.rows * shape_.k);
+    indices_.resize(shape_.rows * shape_.k);
+    std::mt19937 gen;
+    std::uniform_int_distribution<> dis(-128, 127);
+    for (auto &v : in_) {
+      v = dis(gen);
+    }
+  }
+
+  virtual void run() override {
+    topk(values_.data(), indices_.data(), in_.data());
+  }
+
+  virtual void teardown() override {}
+
+  /// \returns the number of bytes that a run reads.
+  double bytes() const { return double(in_.size()) * sizeof(ElemTy); }
+
+private:
+  void topk(float *values, size_t *indices, const float *in) {
+    libjit_topk_f(values, indices, in, shape_.k, shape_.n, in_.size(),
+                  numThreads_);
+  }
+
+  void topk(int8_t *values, size_t *indices, const int8_t *in) {
+    libjit_topk_i8(values, indices, in, shape_.k, shape_.n, in_.size(),
+                   numThreads_);
+  }
+};
+
+/// Run the benchmarks for the element type \p ElemTy, that is named
+/// \p typeName in the report.
+template <class ElemTy>
+void benchTopK(const char *typeName, size_t reps, size_t numThreads) {
+  for (const auto &shape : topKShapes) {
+    TopKBench<ElemTy> b(shape, numThreads);
+    auto stats = benchStats(&b, reps);
+    std::string desc = std::string(shape.layer) + " " +
+                       formatDims({shape.rows, shape.n}) + " k" +
+                       std::to_string(shape.k) + " t" +
+                       std::to_string(numThreads);
+    reportBench("topk", typeName, desc, reps, b.bytes(), "GB/s", stats);
+  }
+}
+
+int main(int argc, char **argv) {
+  // The number of repetitions and of threads can be provided on the command
+  // line.
+  size_t reps = argc > 1 ? atoi(argv[1]) : 100;
+  size_t numThreads = argc > 2 ? atoi(argv[2]) : 1;
+  printBenchHeader();
+  benchTopK<float>("float", reps, numThreads);
+  benchTopK<int8_t>("int8", reps, numThreads);
+}
@@ -0,0 +1,164 @@
+/**
+ * Copyright (c) 2017-present, Facebook, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include <cstdint>
+#include <cstdlib>
+#include <random>
+#include <vector>
+
+#include "Bench.h"
+
+using namespace glow;
+
+extern "C" {
+// Forward declare functions from libjit.
+extern void libjit_transpose_f(const float *inW, float *outW,
+                               const size_t *idim, const size_t *odim,
+                               const size_t *shuffle, size_t numDims);
+extern void libjit_transpose_i8(const int8_t *inW, int8_t *outW,
+                                const size_t *idim, const size_t *odim,
+                                const size_t *shuffle, size_t numDims);
+extern void libjit_transpose_batched_f(const float *inW, float *outW,
+                                       size_t batch, size_t rows, size_t cols);
+extern void libjit_transpose_batched_i8(const int8_t *inW, int8_t *outW,
+                                        size_t batch, size_t rows, size_t cols);
+}
+
+/// The shape of a transpose.
+struct TransposeShape {
+  /// The model and layer of the shape, for the report.
+  const char *layer;
+  std::vector<size_t> dims;
+  std::vector<size_t> shuffle;
+};
+
+/// The layout conversions of ResNet50 and VGG16 and the transposes of the
+/// gates of LSTMs.
+static const TransposeShape transposeShapes[] = {
+    {"resnet50.nchw2nhwc", {1, 64, 112, 112}, {0, 2, 3, 1}},
+    {"resnet50.nhwc2nchw", {1, 7, 7, 2048}, {0, 3, 1, 2}},
+    {"vgg16.nchw2nhwc", {1, 3, 224, 224}, {0, 2, 3, 1}},
+    {"lstm.weights", {1024, 4096}, {1, 0}},
+    {"lstm.tbh2bth", {32, 64, 1024}, {1, 0, 2}},
+    {"resnet50.hwcn2nhwc", {7, 7, 512, 64}, {3, 0, 1, 2}},
+};
+
+/// Benchmark a transpose of a float or int8 tensor. Like the CPU backend, the
+/// shuffles that swap two groups of dimensions use the batched kernel and the
+/// others use the generic one.
+template <class ElemTy> class TransposeBench : public Benchmark {
+  TransposeShape shape_;
+  std::vector<ElemTy> in_;
+  std::vector<ElemTy> out_;
+  std::vector<size_t> outDims_;
+
+  /// The dimensions of the batched transpose, if the shuffle is batched.
+  bool isBatched_{false};
+  size_t batch_{1};
+  size_t rows_{1};
+  size_t cols_{1};
+
+public:
+  explicit TransposeBench(const TransposeShape &shape) : shape_(shape) {
+    for (auto s : shape.shuffle) {
+      outDims_.push_back(shape.dims[s]);
+    }
+
+    // The shuffle is batched if it is [0..a-1, b..n-1, a..b-1].
+    size_t n = shape.dims.size();
+    size_t a = 0;
+    while (a < n && shape.shuffle[a] == a) {
+      a++;
+    }
+    if (a == n) {
+      return;
+    }
+    size_t b = shape.shuffle[a];
+    isBatched_ = true;
+    for (size_t i = a; i < n; i++) {
+      size_t expected = i < a + n - b ? b + i - a : i - (n - b);
+      isBatched_ &= shape.shuffle[i] == expected;
+    }
+    for (size_t i = 0; i < n; i++) {
+      (i < a ? batch_ : i < b ? rows_ : cols_) *= shape.dims[i];
+    }
+  }
+
+  virtual void setup() override {
+    size_t size = 1;
+    for (auto d : shape_.dims) {
+      size *= d;
+    }
+    in_.resize(size);
+    out_.resize(size);
+    std::mt19937 gen;
+    std::uniform_int_distribution<> dis(-128, 127);
+    for (auto &v : in_) {
+      v = dis(gen);
+    }
+  }
+
+  virtual void run() override { transpose(out_.data(), in_.data()); }
+
+  virtual void teardown() override {}
+
+  /// \returns the number of bytes that a run reads and writes.
+  double bytes() const { return 2.0 * in_.size() * sizeof(ElemTy); }
+
+  /// \returns the name of the kernel, for the report.
+  const char *kernelName() const {
+    return isBatched_ ? "transpose_batched" : "transpose";
+  }
+
+private:
+  void transpose(float *out, const float *in) {
+    if (isBatched_) {
+      libjit_transpose_batched_f(in, out, batch_, rows_, cols_);
+      return;
+    }
+    libjit_transpose_f(in, out, shape_.dims.data(), outDims_.data(),
+                       shape_.shuffle.data(), shape_.dims.size());
+  }
+
+  void transpose(int8_t *out, const int8_t *in) {
+    if (isBatched_) {
+      libjit_transpose_batched_i8(in, out, batch_, rows_, cols_);
+      return;
+    }
+    libjit_transpose_i8(in, out, shape_.dims.data(), outDims_.data(),
+                        shape_.shuffle.data(), shape_.dims.size());
+  }
+};
+
+/// Run the benchmarks for the element type \p ElemTy, that is named
+/// \p typeName in the report.
+template <class ElemTy> void benchTranspose(const char *typeName, size_t reps) {
+  for (const auto &shape : transposeShapes) {
+    TransposeBench<ElemTy> b(shape);
+    auto stats = benchStats(&b, reps);
+    std::string desc = std::string(shape.layer) + " " + formatDims(shape.dims) +
+                       " " + formatDims(shape.shuffle);
+    reportBench(b.kernelName(), typeName, desc, reps, b.bytes(), "GB/s",
+                stats);
+  }
+}
+
+int main(int argc, char **argv) {
+  // The number of repetitions can be provided on the command line.
+  size_t reps = argc > 1 ? atoi(argv[1]) : 100;
+  printBenchHeader();
+  benchTranspose<float>("float", reps);
+  benchTranspose<int8_t>("int8", reps);
+}
@@ -102,6 +102,68 @@ void inferConvNet(Tensor *inputs, Tensor *filter, Tensor *bias, Tensor *out,
   out->copyFrom(&result->getVariable()->getPayload());
 }
 
+void inferPrivateFilterConvNet(Tensor *inputs, Tensor *filter, Tensor *bias,
+                               Tensor *out, size_t kernel, size_t stride,
+                               size_t pad, BackendKind kind) {
+  ExecutionEngine EE(kind);
+  auto &mod = EE.getModule();
+  Function *F = mod.createFunction("main");
+  auto *inputVar = VarFrom(inputs);
+  auto *filterVar =
+      mod.createVariable(&filter->getType(), "filter", VisibilityKind::Private,
+                         Variable::TrainKind::None);
+  auto *biasVar = mod.createVariable(&bias->getType(), "bias",
+                                     VisibilityKind::Private,
+                                     Variable::TrainKind::None);
+  filterVar->getPayload().copyFrom(filter);
+  biasVar->getPayload().copyFrom(bias);
+  auto OT = mod.uniqueType(out->getType());
+  auto *conv = F->createConv("conv", inputVar, filterVar, biasVar, OT, kernel,
+                             stride, pad, 1);
+  auto result = F->createSave("ret", conv);
+  EE.compile(CompilationMode::Infer, F);
+  EE.run({inputVar}, {inputs});
+  out->copyFrom(&result->getVariable()->getPayload());
+}
+
+std::pair<Variable *, Variable *> compileFCReluNet(ExecutionEngine &EE) {
+  auto &mod = EE.getModule();
+  Function *F = mod.createFunction("main");
+  auto *input = mod.createVariable(ElemKind::FloatTy, {4, 32}, "input",
+                                   VisibilityKind::Public,
+                                   Variable::TrainKind::None);
+  auto *fc = F->createFullyConnected("fc", input, 16);
+  auto *relu = F->createRELU("relu", fc);
+  auto *result = F->createSave("ret", relu);
+  EE.compile(CompilationMode::Infer, F);
+  return {input, result->getVariable()};
+}
+
+unsigned inferFloat16FCNet(Tensor *inputs, Tensor *weights, Tensor *bias,
+                           Tensor *out, BackendKind kind) {
+  ExecutionEngine EE(kind);
+  auto &mod = EE.getModule();
+  Function *F = mod.createFunction("main");
+  auto *inputVar = VarFrom(inputs);
+  auto *FC = F->createFullyConnected("fc", inputVar, weights->dims()[1]);
+  cast<Variable>(FC->getWeights())->getPayload().copyFrom(weights);
+  cast<Variable>(FC->getBias())->getPayload().copyFrom(bias);
+  auto *tanh = F->createTanh("tanh", FC);
+  auto result = F->createSave("ret", tanh);
+  EE.convertToFloat16(F);
+  unsigned numFloat16 = 0;
+  for (auto *N : F->getNodes()) {
+    if (N->getNumResults() == 1 &&
+        N->getElementType(0) == ElemKind::Float16Ty) {
+      numFloat16++;
+    }
+  }
+  EE.compile(CompilationMode::Infer, F);
+  EE.run({inputVar}, {inputs});
+  out->copyFrom(&result->getVariable()->getPayload());
+  return numFloat16;
+}
+
 void trainConvNet(Tensor *inputs, Tensor *kernel1, Tensor *bias1,
                   Tensor *kernel2, Tensor *bias2, Tensor *selected,
                   llvm::ArrayRef<size_t> shape1, llvm::ArrayRef<size_t> shape2,
@@ -148,6 +210,54 @@ void inferGatherNet(Tensor *data, Tensor *indices, Tensor *dest,
   dest->copyFrom(&result->getVariable()->getPayload());
 }
 
+void inferLoopNet(Tensor *inputs, size_t numSteps, Tensor *out,
+                  BackendKind kind) {
+  Module mod;
+  Function *F = mod.createFunction("main");
+  auto *inputsV = VarFrom(inputs);
+  inputsV->getPayload().copyFrom(inputs);
+  auto *numStepsV =
+      mod.createVariable(ElemKind::IndexTy, {1}, "numSteps",
+                         VisibilityKind::Public, Variable::TrainKind::None);
+  numStepsV->getHandle<size_t>().raw(0) = numSteps;
+  auto *outV = mod.createVariable(&inputs->getType(), "out",
+                                  VisibilityKind::Public,
+                                  Variable::TrainKind::None);
+  outV->getPayload().zero();
+
+  // Build the loop over the steps of the sequence by hand: the state is
+  // carried from a step to the next, so it is allocated outside of the loop.
+  IRFunction M(F);
+  M.generateIR();
+  IRBuilder bb(&M);
+  auto *inputsW = M.getWeightForNode(inputsV);
+  auto *numStepsW = M.getWeightForNode(numStepsV);
+  auto *outW = M.getWeightForNode(outV);
+  auto dims = inputs->dims();
+  auto *state = bb.createAllocActivationInst("state", ElemKind::FloatTy,
+                                             {1, dims[1], dims[2]});
+  bb.createSplatInst("zero", state, 0);
+  auto *counter =
+      bb.createAllocActivationInst("counter", ElemKind::IndexTy, {1});
+  bb.createLoopStartInst("loop", counter, numStepsW, dims[0]);
+  auto *step = bb.createAllocActivationInst("step", ElemKind::FloatTy,
+                                            {1, dims[1], dims[2]});
+  bb.createGatherInst("load", step, inputsW, counter);
+  bb.createElementAddInst("add", state, state, step);
+  bb.createTanhInst("tanh", state, state);
+  bb.createDeallocActivationInst("dealloc", step);
+  bb.createScatterAssignInst("store", outW, counter, state);
+  bb.createLoopEndInst("loop.end", counter, numStepsW, dims[0]);
+  bb.createDeallocActivationInst("dealloc", counter);
+  bb.createDeallocActivationInst("dealloc", state);
+  ::glow::optimize(M, CompilationMode::Infer);
+
+  std::unique_ptr<Backend> backend(createBackend(kind, &M));
+  backend->init();
+  backend->doForwardPass();
+  out->copyFrom(&outV->getPayload());
+}
+
 void inferLocalResponseNormalizationNet(Tensor *inputs, Tensor *out,
                                         BackendKind kind) {
   ExecutionEngine EE(kind);
@@ -193,6 +303,38 @@ void trainLocalResponseNormalizationNet(Tensor *inputs, Tensor *weights,
   out->copyFrom(&result->getVariable()->getPayload());
 }
 
+void trainBatchNormalizationNet(Tensor *inputs, Tensor *weights, Tensor *bias,
+                                Tensor *selected, llvm::ArrayRef<size_t> shape1,
+                                llvm::ArrayRef<size_t> shape2,
+                                size_t channelIdx, Tensor *out,
+                                BackendKind kind) {
+  ExecutionEngine EE(kind);
+  EE.getConfig().learningRate = 0.06;
+  EE.getConfig().momentum = 0.1;
+  auto &mod = EE.getModule();
+  Function *F = mod.createFunction("main");
+  auto *var1 = VarFrom(inputs);
+  auto *var2 = VarFrom(selected);
+  auto *fc = F->createFullyConnected("fc", var1, bias->dims()[0]);
+  cast<Variable>(fc->getWeights())->copyFrom(weights);
+  cast<Variable>(fc->getBias())->copyFrom(bias);
+  auto *reshape1 = F->createReshape("reshape1", fc, shape1);
+  auto *bn =
+      F->createBatchNormalization("bn", reshape1, channelIdx, 0.0001, 0.9);
+  auto *reshape2 = F->createReshape("reshape2", bn, shape2);
+  auto *softmax = F->createSoftMax("softmax", reshape2, var2);
+  auto result = F->createSave("ret", softmax);
+
+  Function *TF = glow::differentiate(F, EE.getConfig());
+  EE.compile(CompilationMode::Train, TF);
+  EE.runBatch(8, {var1, var2}, {inputs, selected});
+
+  // The inference normalizes with the running statistics of the training.
+  EE.compile(CompilationMode::Infer, F);
+  EE.runBatch(1, {var1, var2}, {inputs, selected});
+  out->copyFrom(&result->getVariable()->getPayload());
+}
+
 void inferMatMulNet(Tensor *lhs, Tensor *rhs, Tensor *out, BackendKind kind) {
   ExecutionEngine EE(kind);
   auto &mod = EE.getModule();
@@ -352,6 +494,21 @@ void inferQuantizeNet(Tensor *inputs, float scale, int32_t offset, Tensor *out,
   out->copyFrom(&result->getVariable()->getPayload());
 }
 
+void profileQuantizationNet(llvm::ArrayRef<Tensor *> inputs, Tensor *histogram,
+                            Tensor *computationInfo, BackendKind kind) {
+  ExecutionEngine EE(kind);
+  auto &mod = EE.getModule();
+  Function *F = mod.createFunction("main");
+  auto *var = VarFrom(inputs[0]);
+  auto *profile = F->createQuantizationProfile("profile", var);
+  EE.compile(CompilationMode::Infer, F);
+  for (auto *input : inputs) {
+    EE.run({var}, {input});
+  }
+  histogram->copyFrom(&profile->getHistogramVar()->getPayload());
+  computationInfo->copyFrom(&profile->getComputationInfoVar()->getPayload());
+}
+
 void inferReluNet(Tensor *inputs, Tensor *out, BackendKind kind) {
   ExecutionEngine EE(kind);
   auto &mod = EE.getModule();
@@ -567,4 +724,50 @@ void inferComplexNet1(Tensor *inputs1, Tensor *inputs2, Tensor *inputs3,
   out->copyFrom(&result->getVariable()->getPayload());
 }
 
+void inferElementwiseNet(Tensor *inputs1, Tensor *inputs2, Tensor *out,
+                         BackendKind kind) {
+  ExecutionEngine EE(kind);
+  auto &mod = EE.getModule();
+  Function *F = mod.createFunction("main");
+  auto *var1 = VarFrom(inputs1);
+  auto *var2 = VarFrom(inputs2);
+  auto *add = F->createAdd("add", var1, var2);
+  auto *mul = F->createMul("mul", add, var1);
+  auto *sigmoid = F->createSigmoid("sigmoid", mul);
+  auto *half = F->createSplat("half", var1->getType(), 0.5);
+  auto *max = F->createMax("max", sigmoid, half);
+  auto *cmp = F->createCmpLTE("cmp", var1, var2);
+  auto *select = F->createSelect("select", cmp, max, add);
+  auto *tanh = F->createTanh("tanh", select);
+  auto *sub = F->createSub("sub", tanh, var2);
+  auto *div = F->createDiv("div", sub, max);
+  auto *min = F->createMin("min", div, var1);
+  auto result = F->createSave("ret", min);
+  EE.compile(CompilationMode::Infer, F);
+  EE.run({var1, var2}, {inputs1, inputs2});
+  out->copyFrom(&result->getVariable()->getPayload());
+}
+
+void inferStateNet(Tensor *inputs, Tensor *out, BackendKind kind) {
+  ExecutionEngine EE(kind);
+  auto &mod = EE.getModule();
+  Function *F = mod.createFunction("main");
+  auto *var = VarFrom(inputs);
+  auto *state = mod.createState(&inputs->getType(), "state");
+  auto *add = F->createAdd("add", state, var);
+  auto *tanh = F->createTanh("tanh", add);
+  F->createSave("update", tanh, state);
+  EE.compile(CompilationMode::Infer, F);
+  EE.run({var}, {inputs});
+  EE.run({var}, {inputs});
+  // Keep the rows in the reverse order, then run once more.
+  std::vector<size_t> rows(inputs->dims()[0]);
+  for (size_t i = 0, e = rows.size(); i < e; i++) {
+    rows[i] = e - 1 - i;
+  }
+  EE.reorderState(state, rows);
+  EE.run({var}, {inputs});
+  out->copyFrom(&EE.readState(state));
+}
+
 } // namespace glow
@@ -18,6 +18,8 @@
 #include "glow/Graph/Graph.h"
 #include "glow/IR/IR.h"
 
+#include <utility>
+
 namespace glow {
 
 void inferBatchedAddNet(Tensor *inputs1, Tensor *inputs2, Tensor *out,
@@ -28,6 +30,21 @@ void inferBatchedReduceAddNet(Tensor *inputs, Tensor *out, BackendKind kind);
 void inferConvNet(Tensor *inputs, Tensor *filter, Tensor *bias, Tensor *out,
                   BackendKind kind);
 
+void inferPrivateFilterConvNet(Tensor *inputs, Tensor *filter, Tensor *bias,
+                               Tensor *out, size_t kernel, size_t stride,
+                               size_t pad, BackendKind kind);
+
+/// Creates a function in \p EE that saves the RELU of a fully connected layer
+/// of 16 outputs of a public [4, 32] input, and compiles it for inference.
+/// \returns the input and the output variables.
+std::pair<Variable *, Variable *> compileFCReluNet(ExecutionEngine &EE);
+
+/// Runs a fully connected layer with the private \p weights and \p bias and a
+/// tanh after converting the nodes that the backend \p kind supports in
+/// float16. \returns the number of float16 nodes.
+unsigned inferFloat16FCNet(Tensor *inputs, Tensor *weights, Tensor *bias,
+                           Tensor *out, BackendKind kind);
+
 void trainConvNet(Tensor *inputs, Tensor *kernel1, Tensor *bias1,
                   Tensor *kernel2, Tensor *bias2, Tensor *selected,
                   llvm::ArrayRef<size_t> shape1, llvm::ArrayRef<size_t> shape2,
@@ -36,6 +53,9 @@ void trainConvNet(Tensor *inputs, Tensor *kernel1, Tensor *bias1,
 void inferGatherNet(Tensor *data, Tensor *indices, Tensor *dest,
                     BackendKind kind);
 
+void inferLoopNet(Tensor *inputs, size_t numSteps, Tensor *out,
+                  BackendKind kind);
+
 void inferLocalResponseNormalizationNet(Tensor *inputs, Tensor *out,
                                         BackendKind kind);
 
@@ -45,6 +65,12 @@ void trainLocalResponseNormalizationNet(Tensor *inputs, Tensor *weights,
                                         llvm::ArrayRef<size_t> shape2,
                                         Tensor *out, BackendKind kind);
 
+void trainBatchNormalizationNet(Tensor *inputs, Tensor *weights, Tensor *bias,
+                                Tensor *selected, llvm::ArrayRef<size_t> shape1,
+                                llvm::ArrayRef<size_t> shape2,
+                                size_t channelIdx, Tensor *out,
+                                BackendKind kind);
+
 void inferMatMulNet(Tensor *lhs, Tensor *rhs, Tensor *out, BackendKind kind);
 
 void inferMaxNet(Tensor *inputs1, Tensor *inputs2, Tensor *out,
@@ -70,6 +96,9 @@ void trainPoolMaxNet(Tensor *inputs, Tensor *weights, Tensor *bias,
 void inferQuantizeNet(Tensor *inputs, float scale, int32_t offset, Tensor *out,
                       BackendKind kind);
 
+void profileQuantizationNet(llvm::ArrayRef<Tensor *> inputs, Tensor *histogram,
+                            Tensor *computationInfo, BackendKind kind);
+
 void inferReluNet(Tensor *inputs, Tensor *out, BackendKind kind);
 
 void inferReshapeNet(Tensor *inputs, llvm::ArrayRef<size_t> shape, Tensor *out,
@@ -100,4 +129,9 @@ void inferMixedNet(Tensor *inputs, Tensor *out, BackendKind kind);
 void inferComplexNet1(Tensor *inputs1, Tensor *inputs2, Tensor *inputs3,
                       Tensor *inputs4, Tensor *out, BackendKind kind);
 
+void inferElementwiseNet(Tensor *inputs1, Tensor *inputs2, Tensor *out,
+                         BackendKind kind);
+
+void inferStateNet(Tensor *inputs, Tensor *out, BackendKind kind);
+
 } // namespace glow
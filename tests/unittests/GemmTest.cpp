@@ -69,3 +69,66 @@ TEST(Gemm, jitTest) {
     }
   }
 }
+
+/// Check the matrix multiplication by a constant RHS, which the CPU backend
+/// pre-packs into panels at compile time.
+TEST(Gemm, jitPackedTest) {
+  for (size_t m : {1, 4, 5, 8}) {
+    for (size_t n : {1, 16, 32, 33, 70}) {
+      for (size_t k : {1, 3, 130}) {
+        Tensor lhs(ElemKind::FloatTy, {m, k});
+        Tensor rhs(ElemKind::FloatTy, {k, n});
+        lhs.getHandle().randomize(-1.0, 1.0);
+        rhs.getHandle().randomize(-1.0, 1.0);
+        Tensor out1(ElemKind::FloatTy, {m, n});
+        Tensor out2(ElemKind::FloatTy, {m, n});
+
+        auto infer = [&](Tensor *out, BackendKind kind) {
+          ExecutionEngine EE(kind);
+          auto &mod = EE.getModule();
+          Function *F = mod.createFunction("main");
+          auto lhsVar = mod.createVariable(lhs.getElementType(), lhs.dims(),
+                                           "lhs", VisibilityKind::Public);
+          auto rhsVar = mod.createVariable(rhs.getElementType(), rhs.dims(),
+                                           "rhs", VisibilityKind::Private,
+                                           Variable::TrainKind::None);
+          rhsVar->copyFrom(&rhs);
+          auto outVar = mod.createVariable(out->getElementType(), out->dims(),
+                                           "out", VisibilityKind::Public);
+          auto OT =
+              F->getParent()->uniqueType(out->getElementType(), out->dims());
+          auto *matmul = F->createMatMul("matmul", OT, lhsVar, rhsVar);
+          auto result = F->createSave("ret", matmul, outVar);
+          EE.compile(CompilationMode::Infer, F);
+          EE.run({lhsVar}, {&lhs});
+          out->copyFrom(&result->getVariable()->getPayload());
+        };
+
+        infer(&out1, BackendKind::CPU);
+        infer(&out2, BackendKind::Interpreter);
+
+        EXPECT_TRUE(out1.isEqual(out2, 0.001));
+      }
+    }
+  }
+}
+
+TEST(Gemm, quantizedJitTest) {
+  for (size_t m : {1, 4, 5, 8}) {
+    for (size_t n : {1, 32, 33, 70}) {
+      for (size_t k : {1, 3, 130}) {
+        Tensor lhs(ElemKind::Int8QTy, {m, k}, 2.7, 31);
+        Tensor rhs(ElemKind::Int8QTy, {k, n}, 3.2, -12);
+        lhs.getHandle<int8_t>().randomize(-128, 127);
+        rhs.getHandle<int8_t>().randomize(-128, 127);
+        Tensor out1(ElemKind::Int8QTy, {m, n}, 800.0, 7);
+        Tensor out2(ElemKind::Int8QTy, {m, n}, 800.0, 7);
+
+        inferMatMulNet(&lhs, &rhs, &out1, BackendKind::CPU);
+        inferMatMulNet(&lhs, &rhs, &out2, BackendKind::Interpreter);
+
+        EXPECT_TRUE(out1.isEqual(out2));
+      }
+    }
+  }
+}
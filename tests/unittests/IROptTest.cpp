@@ -17,10 +17,12 @@
 #include "glow/Graph/Graph.h"
 #include "glow/IR/IR.h"
 #include "glow/IR/IRBuilder.h"
+#include "glow/IR/IRUtils.h"
 #include "glow/IR/Instrs.h"
 #include "glow/Optimizer/Optimizer.h"
 
 #include "llvm/Support/Casting.h"
+#include "llvm/Support/raw_ostream.h"
 
 #include "gtest/gtest.h"
 
@@ -30,6 +32,7 @@
 #include <cstdint>
 #include <iostream>
 #include <string>
+#include <vector>
 
 using namespace glow;
 using llvm::cast;
@@ -79,7 +82,8 @@ TEST(Optimizer, dseDoNotRemloveLastWriteIntoWeightVar) {
   // no instruction that reads it, because it is an observable side-effect.
   bb.createElementAddInst("elem_add", output, input1, input2);
   bb.createTensorViewInst(
-      "cast", output, mod.uniqueType(Type(glow::ElemKind::FloatTy, {1, 1, 1})));
+      "cast", output, mod.uniqueType(Type(glow::ElemKind::FloatTy, {1, 1, 1})),
+      {});
 
   optimize(M, CompilationMode::Infer);
 
@@ -123,6 +127,73 @@ TEST(Optimizer, shareBuffers) {
   EXPECT_EQ(M.getInstrs().size(), 2);
 }
 
+/// Check that the buffers of a long chain of in-place instructions are all
+/// shared. The live intervals of the shared buffer grow with the chain.
+TEST(Optimizer, shareBuffersLongChain) {
+  Module mod;
+  Function *F = mod.createFunction("ShareBuffersLongChain");
+  IRFunction M(F);
+  IRBuilder bb(&M);
+
+  auto *input = bb.createWeightVar(glow::ElemKind::FloatTy, {16}, "input",
+                                   WeightVar::MutabilityKind::Constant);
+  auto *output = bb.createWeightVar(glow::ElemKind::FloatTy, {16}, "output",
+                                    WeightVar::MutabilityKind::Mutable);
+
+  Value *prev = input;
+  for (unsigned i = 0; i < 1000; i++) {
+    auto *alloc =
+        bb.createAllocActivationInst("alloc", glow::ElemKind::FloatTy, 16);
+    bb.createTanhInst("tanh", alloc, prev);
+    if (auto *prevAlloc = dyn_cast<AllocActivationInst>(prev)) {
+      bb.createDeallocActivationInst("dealloc", prevAlloc);
+    }
+    prev = alloc;
+  }
+  bb.createTanhInst("tanh", output, prev);
+  bb.createDeallocActivationInst("dealloc", cast<AllocActivationInst>(prev));
+
+  optimize(M, CompilationMode::Infer);
+
+  size_t numAllocs = std::count_if(
+      M.getInstrs().begin(), M.getInstrs().end(),
+      [](const Instruction *I) { return isa<AllocActivationInst>(I); });
+  EXPECT_LE(numAllocs, 1);
+  EXPECT_EQ(getActivationsPeak(M), numAllocs * 16 * sizeof(float));
+}
+
+/// Check that the two results of an instruction keep their own buffers. Their
+/// live intervals begin at the same write slot, so merging the buffers would
+/// have to add an interval that begins where another one does.
+TEST(Optimizer, shareBuffersSameWriteSlot) {
+  Module mod;
+  Function *F = mod.createFunction("ShareBuffersSameWriteSlot");
+  IRFunction M(F);
+  IRBuilder bb(&M);
+
+  auto *input = bb.createWeightVar(glow::ElemKind::FloatTy, {1, 16}, "input",
+                                   WeightVar::MutabilityKind::Constant);
+  auto *C = bb.createWeightVar(glow::ElemKind::FloatTy, {1, 4}, "C",
+                               WeightVar::MutabilityKind::Constant);
+  auto *output = bb.createWeightVar(glow::ElemKind::FloatTy, {1, 4}, "output",
+                                    WeightVar::MutabilityKind::Mutable);
+
+  auto *newC =
+      bb.createAllocActivationInst("newC", glow::ElemKind::FloatTy, {1, 4});
+  auto *newH =
+      bb.createAllocActivationInst("newH", glow::ElemKind::FloatTy, {1, 4});
+  auto *LU = bb.createLSTMUnitInst("lstm", newC, newH, input, C);
+  // newC is overwritten before it is read, and newH dies here.
+  bb.createTanhInst("tanh", newC, newH);
+  bb.createDeallocActivationInst("deallocH", newH);
+  bb.createCopyInst("copy", output, newC);
+  bb.createDeallocActivationInst("deallocC", newC);
+
+  optimize(M, CompilationMode::Infer);
+
+  EXPECT_NE(getOrigin(LU->getNewC()), getOrigin(LU->getNewH()));
+}
+
 TEST(Optimizer, copyPropagation) {
   Module mod;
   Function *F = mod.createFunction("ShareBuffers");
@@ -228,3 +299,211 @@ TEST(Optimizer, copyPropagationTranspose) {
                isa<DeallocActivationInst>(I);
       }));
 }
+
+/// Check that the inserted tensors are written directly into views of the
+/// buffer that they are inserted into.
+TEST(Optimizer, insertInPlace) {
+  Module mod;
+  Function *F = mod.createFunction("InsertInPlace");
+  IRFunction M(F);
+  IRBuilder bb(&M);
+
+  auto *input1 = bb.createWeightVar(glow::ElemKind::FloatTy, {4, 1}, "input1",
+                                    WeightVar::MutabilityKind::Constant);
+  auto *input2 = bb.createWeightVar(glow::ElemKind::FloatTy, {4, 1}, "input2",
+                                    WeightVar::MutabilityKind::Constant);
+  auto *output = bb.createWeightVar(glow::ElemKind::FloatTy, {2, 4}, "output",
+                                    WeightVar::MutabilityKind::Mutable);
+
+  auto *alloc1 =
+      bb.createAllocActivationInst("alloc1", glow::ElemKind::FloatTy, {1, 4});
+  auto *alloc2 =
+      bb.createAllocActivationInst("alloc2", glow::ElemKind::FloatTy, {1, 4});
+  bb.createTransposeInst("transpose1", alloc1, input1, {1, 0});
+  bb.createTransposeInst("transpose2", alloc2, input2, {1, 0});
+  auto *concat =
+      bb.createAllocActivationInst("concat", glow::ElemKind::FloatTy, {2, 4});
+  bb.createSplatInst("zero", concat, 0.0);
+  bb.createInsertTensorInst("insert1", concat, alloc1, {0, 0});
+  bb.createInsertTensorInst("insert2", concat, alloc2, {1, 0});
+  bb.createTanhInst("tanh", output, concat);
+  bb.createDeallocActivationInst("dealloc3", concat);
+  bb.createDeallocActivationInst("dealloc2", alloc2);
+  bb.createDeallocActivationInst("dealloc1", alloc1);
+
+  optimize(M, CompilationMode::Infer);
+
+  // The transposes write into the views of the concatenation at the offsets
+  // of the inserts, which are erased.
+  unsigned numInserts = 0;
+  std::vector<std::vector<size_t>> viewOffsets;
+  for (auto *I : M.getInstrs()) {
+    numInserts += isa<InsertTensorInst>(I);
+    if (auto *TV = dyn_cast<TensorViewInst>(I)) {
+      viewOffsets.emplace_back(TV->getOffsets().begin(),
+                               TV->getOffsets().end());
+    }
+  }
+  EXPECT_EQ(numInserts, 0);
+  std::vector<std::vector<size_t>> expected = {{0, 0}, {1, 0}};
+  EXPECT_EQ(viewOffsets, expected);
+}
+
+/// Check that the contiguous extracted tensors are read directly through
+/// views of their source, and that the strided ones are still copied.
+TEST(Optimizer, extractInPlace) {
+  Module mod;
+  Function *F = mod.createFunction("ExtractInPlace");
+  IRFunction M(F);
+  IRBuilder bb(&M);
+
+  auto *input = bb.createWeightVar(glow::ElemKind::FloatTy, {4, 6}, "input",
+                                   WeightVar::MutabilityKind::Mutable);
+  auto *weights1 = bb.createWeightVar(glow::ElemKind::FloatTy, {6, 2},
+                                      "weights1",
+                                      WeightVar::MutabilityKind::Constant);
+  auto *weights2 = bb.createWeightVar(glow::ElemKind::FloatTy, {3, 2},
+                                      "weights2",
+                                      WeightVar::MutabilityKind::Constant);
+  auto *output1 = bb.createWeightVar(glow::ElemKind::FloatTy, {2, 2},
+                                     "output1",
+                                     WeightVar::MutabilityKind::Mutable);
+  auto *output2 = bb.createWeightVar(glow::ElemKind::FloatTy, {4, 2},
+                                     "output2",
+                                     WeightVar::MutabilityKind::Mutable);
+
+  auto *tanh =
+      bb.createAllocActivationInst("tanh", glow::ElemKind::FloatTy, {4, 6});
+  bb.createTanhInst("tanh", tanh, input);
+  auto *rows =
+      bb.createAllocActivationInst("rows", glow::ElemKind::FloatTy, {2, 6});
+  bb.createExtractTensorInst("rows", rows, tanh, {2, 0});
+  auto *cols =
+      bb.createAllocActivationInst("cols", glow::ElemKind::FloatTy, {4, 3});
+  bb.createExtractTensorInst("cols", cols, tanh, {0, 3});
+  bb.createDeallocActivationInst("dealloc1", tanh);
+  bb.createMatMulInst("matmul1", output1, rows, weights1, 0, 0);
+  bb.createMatMulInst("matmul2", output2, cols, weights2, 0, 0);
+  bb.createDeallocActivationInst("dealloc2", rows);
+  bb.createDeallocActivationInst("dealloc3", cols);
+
+  optimize(M, CompilationMode::Infer);
+
+  // The rows are read through a view of the source, which now lives until
+  // the view is read. The columns are copied.
+  unsigned numExtracts = 0;
+  std::vector<std::vector<size_t>> viewOffsets;
+  for (auto *I : M.getInstrs()) {
+    numExtracts += isa<ExtractTensorInst>(I);
+    if (auto *TV = dyn_cast<TensorViewInst>(I)) {
+      viewOffsets.emplace_back(TV->getOffsets().begin(),
+                               TV->getOffsets().end());
+    }
+  }
+  EXPECT_EQ(numExtracts, 1);
+  std::vector<std::vector<size_t>> expected = {{2, 0}};
+  EXPECT_EQ(viewOffsets, expected);
+  auto &instrs = M.getInstrs();
+  auto isTanhDealloc = [](const Instruction *I) {
+    auto *DA = dyn_cast<DeallocActivationInst>(I);
+    return DA && DA->getSrc()->getName() == "tanh";
+  };
+  auto isMatMul1 = [](const Instruction *I) {
+    return I->getName() == "matmul1";
+  };
+  EXPECT_LT(std::distance(instrs.begin(), std::find_if(instrs.begin(),
+                                                       instrs.end(),
+                                                       isMatMul1)),
+            std::distance(instrs.begin(), std::find_if(instrs.begin(),
+                                                       instrs.end(),
+                                                       isTanhDealloc)));
+}
+
+/// Check that a tensor that is reshaped and copied into an output is written
+/// directly into the output.
+TEST(Optimizer, copyInPlace) {
+  Module mod;
+  Function *F = mod.createFunction("CopyInPlace");
+  IRFunction M(F);
+  IRBuilder bb(&M);
+
+  auto *input = bb.createWeightVar(glow::ElemKind::FloatTy, {8}, "input",
+                                   WeightVar::MutabilityKind::Constant);
+  auto *output = bb.createWeightVar(glow::ElemKind::FloatTy, {2, 4}, "output",
+                                    WeightVar::MutabilityKind::Mutable);
+
+  auto *tanh =
+      bb.createAllocActivationInst("tanh", glow::ElemKind::FloatTy, {8});
+  bb.createTanhInst("tanh", tanh, input);
+  auto *reshape = bb.createTensorViewInst(
+      "reshape", tanh, mod.uniqueType(glow::ElemKind::FloatTy, {2, 4}), {});
+  bb.createCopyInst("save", output, reshape);
+  bb.createDeallocActivationInst("dealloc", tanh);
+
+  optimize(M, CompilationMode::Infer);
+
+  // The tanh writes into a view of the output, and the copy is erased.
+  unsigned numCopies = 0;
+  const Value *tanhDest = nullptr;
+  for (auto *I : M.getInstrs()) {
+    numCopies += isa<CopyInst>(I);
+    if (auto *TI = dyn_cast<TanhInst>(I)) {
+      tanhDest = getOrigin(TI->getDest());
+    }
+  }
+  EXPECT_EQ(numCopies, 0);
+  EXPECT_EQ(tanhDest, output);
+}
+
+/// Check that an activation that is live across the peak of the live memory
+/// is recomputed before its use after the peak.
+TEST(Optimizer, recomputeActivations) {
+  Module mod;
+  Function *F = mod.createFunction("RecomputeActivations");
+  IRFunction M(F);
+  IRBuilder bb(&M);
+
+  auto *input = bb.createWeightVar(glow::ElemKind::FloatTy, {16}, "input",
+                                   WeightVar::MutabilityKind::Constant);
+  auto *output1 = bb.createWeightVar(glow::ElemKind::FloatTy, {16}, "output1",
+                                     WeightVar::MutabilityKind::Mutable);
+  auto *output2 = bb.createWeightVar(glow::ElemKind::FloatTy, {16}, "output2",
+                                     WeightVar::MutabilityKind::Mutable);
+
+  auto *alloc1 =
+      bb.createAllocActivationInst("alloc1", glow::ElemKind::FloatTy, 16);
+  bb.createTanhInst("tanh", alloc1, input);
+  auto *alloc2 =
+      bb.createAllocActivationInst("alloc2", glow::ElemKind::FloatTy, 16);
+  bb.createSplatInst("splat", alloc2, 1.0);
+  // Both activations are live here.
+  auto *add1 = bb.createElementAddInst("elem_add1", output1, alloc2, alloc2);
+  auto *add2 = bb.createElementAddInst("elem_add2", output2, alloc1, alloc1);
+  bb.createDeallocActivationInst("dealloc2", alloc2);
+  bb.createDeallocActivationInst("dealloc1", alloc1);
+
+  EXPECT_EQ(getActivationsPeak(M), 2 * 16 * sizeof(float));
+  std::string report;
+  llvm::raw_string_ostream os(report);
+  dumpActivationsPeak(M, os);
+  EXPECT_NE(os.str().find("alloc1: 64 bytes"), std::string::npos);
+  EXPECT_NE(os.str().find("alloc2: 64 bytes"), std::string::npos);
+
+  // A budget above the peak changes nothing.
+  recomputeActivations(M, 2 * 16 * sizeof(float), 1);
+  EXPECT_EQ(M.getInstrs().size(), 8);
+
+  recomputeActivations(M, 16 * sizeof(float), 1);
+  EXPECT_EQ(M.getInstrs().size(), 11);
+
+  // The tanh is recomputed right before its use.
+  auto it = std::find(M.getInstrs().begin(), M.getInstrs().end(), add1);
+  auto *recomputed = llvm::dyn_cast<AllocActivationInst>(*++it);
+  ASSERT_TRUE(recomputed);
+  auto *tanh = llvm::dyn_cast<TanhInst>(*++it);
+  ASSERT_TRUE(tanh);
+  EXPECT_EQ(tanh->getDest(), recomputed);
+  EXPECT_EQ(tanh->getSrc(), input);
+  EXPECT_EQ(add2->getLHS(), recomputed);
+  EXPECT_EQ(add2->getRHS(), recomputed);
+}
@@ -14,19 +14,27 @@
  * limitations under the License.
  */
 
+#include "glow/ExecutionEngine/BatchProvider.h"
 #include "glow/ExecutionEngine/ExecutionEngine.h"
 #include "glow/Graph/Graph.h"
 #include "glow/IR/IR.h"
 #include "glow/IR/IRBuilder.h"
 #include "glow/IR/Instrs.h"
+#include "glow/Optimizer/Optimizer.h"
 
 #include "gtest/gtest.h"
 
+#include "llvm/ADT/SmallString.h"
 #include "llvm/Support/Casting.h"
+#include "llvm/Support/FileSystem.h"
 #include "llvm/Support/raw_ostream.h"
 
+#include <algorithm>
 #include <cassert>
+#include <fstream>
 #include <string>
+#include <utility>
+#include <vector>
 
 using namespace glow;
 using llvm::isa;
@@ -172,6 +180,190 @@ TEST(Interpreter, trainASimpleNetwork) {
   EXPECT_NEAR(RNWH.at({0, 0}), 0.9, 0.05);
 }
 
+/// Train a small network with \p hiddenLayers hidden layers on three samples
+/// with \p numWorkers workers, each on mini-batches of \p batchSize samples
+/// whose gradients are averaged, for a few iterations, keeping at most \p
+/// activationBudget bytes of activations. \returns the weights of the first
+/// layer, and if \p IRStats is given, the peak of the live activations of the
+/// compiled IR and its number of instructions.
+static std::vector<float>
+trainWithWorkers(unsigned numWorkers, size_t batchSize,
+                 unsigned hiddenLayers = 0, size_t activationBudget = 0,
+                 std::pair<size_t, size_t> *IRStats = nullptr) {
+  ExecutionEngine EE;
+  EE.getConfig().learningRate = 0.05;
+  EE.getConfig().momentum = 0.5;
+  EE.getConfig().batchSize = batchSize;
+  EE.getConfig().numWorkers = numWorkers;
+  EE.getConfig().activationBudget = activationBudget;
+
+  auto &mod = EE.getModule();
+  Function *F = mod.createFunction("main");
+  auto *A = mod.createVariable(ElemKind::FloatTy, {batchSize, 4}, "A",
+                               VisibilityKind::Public,
+                               Variable::TrainKind::None);
+  auto *E = mod.createVariable(ElemKind::FloatTy, {batchSize, 4}, "E",
+                               VisibilityKind::Public,
+                               Variable::TrainKind::None);
+  auto *W = mod.createVariable(ElemKind::FloatTy, {4, 4}, "W",
+                               VisibilityKind::Private,
+                               Variable::TrainKind::Broadcast, 0.1);
+  auto *B = mod.createVariable(ElemKind::FloatTy, {4}, "B",
+                               VisibilityKind::Private,
+                               Variable::TrainKind::Broadcast, 0.1);
+
+  Node *O = F->createFullyConnected("fc", A, W, B);
+  O = F->createSigmoid("sig", O);
+  for (unsigned i = 0; i < hiddenLayers; i++) {
+    auto *HW = mod.createVariable(ElemKind::FloatTy, {4, 4}, "HW",
+                                  VisibilityKind::Private,
+                                  Variable::TrainKind::Broadcast, 0.1);
+    auto *HB = mod.createVariable(ElemKind::FloatTy, {4}, "HB",
+                                  VisibilityKind::Private,
+                                  Variable::TrainKind::Broadcast, 0.1);
+    O = F->createFullyConnected("hidden", O, HW, HB);
+    O = F->createSigmoid("sig", O);
+  }
+  O = F->createRegression("reg", O, E);
+  F->createSave("return", O);
+
+  Tensor inputs(ElemKind::FloatTy, {3, 4});
+  Tensor expected(ElemKind::FloatTy, {3, 4});
+  inputs.getHandle<>() = {0.15, 0.3,  0.45, 0.6, -0.5, 0.2,
+                          0.1,  -0.3, 0.7,  0.4, -0.2, 0.9};
+  expected.getHandle<>() = {0.9, 0.1, 0.9, 0.1, 0.2, 0.8,
+                            0.3, 0.7, 0.5, 0.5, 0.6, 0.4};
+
+  Function *TF = glow::differentiate(F, EE.getConfig());
+  EE.compile(CompilationMode::Train, TF);
+  if (IRStats) {
+    *IRStats = {getActivationsPeak(EE.getIR()), EE.getIR().getInstrs().size()};
+  }
+  EE.runBatch(20, {A, E}, {&inputs, &expected});
+
+  auto WH = W->getPayload().getHandle<>();
+  std::vector<float> weights;
+  for (size_t i = 0, e = WH.size(); i < e; i++) {
+    weights.push_back(WH.raw(i));
+  }
+  return weights;
+}
+
+/// Every worker trains on a different sample here, and the average of their
+/// updates is the update of a single worker on the three samples at once.
+TEST(Interpreter, trainDataParallel) {
+  auto single = trainWithWorkers(1, 3);
+  auto parallel = trainWithWorkers(3, 1);
+  ASSERT_EQ(single.size(), parallel.size());
+  for (size_t i = 0; i < single.size(); i++) {
+    EXPECT_NEAR(single[i], parallel[i], 0.00001);
+  }
+  // Make sure that the weights did train.
+  EXPECT_GT(std::abs(single[0] - 0.1), 0.01);
+}
+
+/// Recomputing the activations lowers their peak below the budget, and the
+/// recomputed activations have the same values as the kept ones.
+TEST(Interpreter, trainRecomputingActivations) {
+  std::pair<size_t, size_t> keptStats, recomputedStats;
+  auto kept = trainWithWorkers(1, 1, 3, 0, &keptStats);
+  size_t budget = keptStats.first - 1;
+  auto recomputed = trainWithWorkers(1, 1, 3, budget, &recomputedStats);
+  EXPECT_GT(recomputedStats.second, keptStats.second);
+  EXPECT_LE(recomputedStats.first, budget);
+  ASSERT_EQ(kept.size(), recomputed.size());
+  for (size_t i = 0; i < kept.size(); i++) {
+    EXPECT_EQ(kept[i], recomputed[i]);
+  }
+}
+
+/// Train a small network with \p numWorkers workers on mini-batches of two
+/// samples from \p provider for at most \p iterations iterations. \returns
+/// the weights of the first layer, and the number of the iterations done in
+/// \p done.
+static std::vector<float> trainFromProvider(BatchProvider &provider,
+                                            size_t iterations,
+                                            unsigned numWorkers,
+                                            size_t &done) {
+  ExecutionEngine EE;
+  EE.getConfig().learningRate = 0.05;
+  EE.getConfig().momentum = 0.5;
+  EE.getConfig().numWorkers = numWorkers;
+
+  auto &mod = EE.getModule();
+  Function *F = mod.createFunction("main");
+  auto *A =
+      mod.createVariable(ElemKind::FloatTy, {2, 4}, "A", VisibilityKind::Public,
+                         Variable::TrainKind::None);
+  auto *E =
+      mod.createVariable(ElemKind::FloatTy, {2, 4}, "E", VisibilityKind::Public,
+                         Variable::TrainKind::None);
+  auto *W = mod.createVariable(ElemKind::FloatTy, {4, 4}, "W",
+                               VisibilityKind::Private,
+                               Variable::TrainKind::Broadcast, 0.1);
+  auto *B = mod.createVariable(ElemKind::FloatTy, {4}, "B",
+                               VisibilityKind::Private,
+                               Variable::TrainKind::Broadcast, 0.1);
+
+  Node *O = F->createFullyConnected("fc", A, W, B);
+  O = F->createSigmoid("sig", O);
+  O = F->createRegression("reg", O, E);
+  F->createSave("return", O);
+
+  Function *TF = glow::differentiate(F, EE.getConfig());
+  EE.compile(CompilationMode::Train, TF);
+  done = EE.runBatch(iterations, {A, E}, provider);
+
+  auto WH = W->getPayload().getHandle<>();
+  std::vector<float> weights;
+  for (size_t i = 0, e = WH.size(); i < e; i++) {
+    weights.push_back(WH.raw(i));
+  }
+  return weights;
+}
+
+/// The mini-batches streamed from files train like the slices of tensors
+/// that hold the whole data set, and a data set that doesn't loop ends the
+/// training when it is exhausted.
+TEST(Interpreter, trainStreamedBatches) {
+  Tensor inputs(ElemKind::FloatTy, {6, 4});
+  Tensor expected(ElemKind::FloatTy, {6, 4});
+  inputs.getHandle<>().randomize(0.0, 1.0);
+  expected.getHandle<>().randomize(0.0, 1.0);
+
+  std::vector<std::string> paths;
+  for (auto *T : {&inputs, &expected}) {
+    llvm::SmallString<64> path;
+    llvm::sys::fs::createTemporaryFile("batches", "bin", path);
+    std::ofstream file(path.str(), std::ios::binary);
+    file.write(T->getUnsafePtr(), T->getType().getSizeInBytes());
+    paths.push_back(path.str());
+  }
+
+  for (unsigned numWorkers : {1, 2}) {
+    size_t done = 0;
+    TensorBatchProvider fromTensors({&inputs, &expected});
+    auto sliced = trainFromProvider(fromTensors, 9, numWorkers, done);
+    EXPECT_EQ(done, 9);
+    FileBatchProvider fromFiles(paths, /* loop */ true);
+    auto streamed = trainFromProvider(fromFiles, 9, numWorkers, done);
+    EXPECT_EQ(done, 9);
+    ASSERT_EQ(sliced.size(), streamed.size());
+    for (size_t i = 0; i < sliced.size(); i++) {
+      EXPECT_EQ(sliced[i], streamed[i]);
+    }
+  }
+
+  size_t done = 0;
+  FileBatchProvider once(paths, /* loop */ false);
+  trainFromProvider(once, 10, 1, done);
+  EXPECT_EQ(done, 3);
+
+  for (const auto &path : paths) {
+    llvm::sys::fs::remove(path);
+  }
+}
+
 TEST(Interpreter, simpleRegression) {
   // Testing the regression layer. This test takes the first element from the
   // input vector, adds one to it and places the result in the second element of
@@ -897,8 +1089,516 @@ TEST(Interpreter, nonLinearClassifier) {
   }
 }
 
+/// Compile a network whose first activation is used by its last node within
+/// the activation limit \p limit. \returns the result of the network.
+static std::vector<float> inferWithActivationsLimit(size_t limit) {
+  ExecutionEngine EE;
+  EE.setActivationsLimit(limit);
+  auto &mod = EE.getModule();
+  Function *F = mod.createFunction("main");
+  auto *X = mod.createVariable(ElemKind::FloatTy, {1, 64}, "X",
+                               VisibilityKind::Public,
+                               Variable::TrainKind::None);
+  Node *skip = F->createTanh("skip", X);
+  Node *O = X;
+  for (unsigned i = 0; i < 4; i++) {
+    O = F->createSigmoid("sig" + std::to_string(i), O);
+  }
+  O = F->createAdd("add", skip, O);
+  auto *result = F->createSave("ret", O);
+  EE.compile(CompilationMode::Infer, F);
+  if (limit) {
+    EXPECT_LE(getActivationsPeak(EE.getIR()), limit);
+  }
+
+  Tensor input(ElemKind::FloatTy, {1, 64});
+  auto IH = input.getHandle<>();
+  for (size_t i = 0; i < 64; i++) {
+    IH.raw(i) = float(i) / 64 - 0.5;
+  }
+  EE.run({X}, {&input});
+  auto RH = result->getVariable()->getPayload().getHandle<>();
+  std::vector<float> values;
+  for (size_t i = 0; i < 64; i++) {
+    values.push_back(RH.raw(i));
+  }
+  return values;
+}
+
+/// The activations fit in a limit as large as the peak of two of them, and
+/// compilation aborts below the size of a single activation.
+TEST(Interpreter, activationsLimit) {
+  auto unlimited = inferWithActivationsLimit(0);
+  auto limited = inferWithActivationsLimit(2 * 64 * sizeof(float));
+  EXPECT_EQ(unlimited, limited);
+  EXPECT_DEATH(inferWithActivationsLimit(sizeof(float)), "");
+}
+
+/// Train a network of two layers on a mini-batch for a few iterations, with
+/// the nodes ordered by the scheduler \p kind. \returns the weights of both
+/// layers.
+static std::vector<float> trainWithScheduler(SchedulerKind kind) {
+  ExecutionEngine EE;
+  EE.setScheduler(kind);
+  EE.getConfig().learningRate = 0.05;
+  EE.getConfig().momentum = 0.5;
+
+  auto &mod = EE.getModule();
+  Function *F = mod.createFunction("main");
+  auto *A =
+      mod.createVariable(ElemKind::FloatTy, {8, 4}, "A", VisibilityKind::Public,
+                         Variable::TrainKind::None);
+  auto *E =
+      mod.createVariable(ElemKind::FloatTy, {8, 1}, "E", VisibilityKind::Public,
+                         Variable::TrainKind::None);
+  auto *W1 = mod.createVariable(ElemKind::FloatTy, {4, 6}, "W1",
+                                VisibilityKind::Private,
+                                Variable::TrainKind::Broadcast, 0);
+  auto *B1 = mod.createVariable(ElemKind::FloatTy, {6}, "B1",
+                                VisibilityKind::Private,
+                                Variable::TrainKind::Broadcast, 0.1);
+  auto *W2 = mod.createVariable(ElemKind::FloatTy, {6, 1}, "W2",
+                                VisibilityKind::Private,
+                                Variable::TrainKind::Broadcast, 0);
+  auto *B2 = mod.createVariable(ElemKind::FloatTy, {1}, "B2",
+                                VisibilityKind::Private,
+                                Variable::TrainKind::Broadcast, 0.1);
+  auto W1H = W1->getPayload().getHandle<>();
+  for (size_t i = 0, e = W1H.size(); i < e; i++) {
+    W1H.raw(i) = float(i % 7) / 10 - 0.3;
+  }
+  W2->getPayload().getHandle<>() = {0.5, -0.4, 0.3, -0.2, 0.1, 0.2};
+
+  Node *O = F->createFullyConnected("fc1", A, W1, B1);
+  O = F->createSigmoid("sig", O);
+  O = F->createFullyConnected("fc2", O, W2, B2);
+  O = F->createRegression("reg", O, E);
+  F->createSave("return", O);
+
+  Tensor inputs(ElemKind::FloatTy, {8, 4});
+  Tensor expected(ElemKind::FloatTy, {8, 1});
+  auto IH = inputs.getHandle<>();
+  auto EH = expected.getHandle<>();
+  for (size_t i = 0; i < 8; i++) {
+    for (size_t j = 0; j < 4; j++) {
+      IH.at({i, j}) = float(i + j) / 10;
+    }
+    EH.at({i, 0}) = float(i % 2);
+  }
+
+  Function *TF = glow::differentiate(F, EE.getConfig());
+  EE.compile(CompilationMode::Train, TF);
+  EE.runBatch(10, {A, E}, {&inputs, &expected});
+
+  std::vector<float> weights;
+  for (auto *W : {W1, W2}) {
+    auto WH = W->getPayload().getHandle<>();
+    for (size_t i = 0, e = WH.size(); i < e; i++) {
+      weights.push_back(WH.raw(i));
+    }
+  }
+  return weights;
+}
+
+/// The weights are updated after all the nodes that read them, whatever the
+/// scheduler, so all the schedules train the same weights.
+TEST(Interpreter, trainWithSchedulers) {
+  auto childMemSize = trainWithScheduler(SchedulerKind::ChildMemSize);
+  auto minPeak = trainWithScheduler(SchedulerKind::MinPeakMemory);
+  auto criticalPath = trainWithScheduler(SchedulerKind::CriticalPath);
+  EXPECT_EQ(childMemSize, minPeak);
+  EXPECT_EQ(childMemSize, criticalPath);
+  // Make sure that the weights did train.
+  EXPECT_NE(childMemSize[0], -0.3f);
+}
+
+/// Compile a network where two small layers read a large activation, and an
+/// independent large activation is created between them, with the nodes
+/// ordered by the scheduler \p kind. \returns the peak size of the
+/// activations.
+static size_t getActivationsPeakWithScheduler(SchedulerKind kind) {
+  ExecutionEngine EE;
+  EE.setScheduler(kind);
+  auto &mod = EE.getModule();
+  Function *F = mod.createFunction("main");
+  auto *X = mod.createVariable(ElemKind::FloatTy, {1, 16}, "X",
+                               VisibilityKind::Public,
+                               Variable::TrainKind::None);
+  auto *shared = F->createFullyConnected("shared", X, 1024);
+  F->createSave("ret1", F->createFullyConnected("fc1", shared, 4));
+  auto *other = F->createFullyConnected("other", X, 1024);
+  F->createSave("ret2", F->createFullyConnected("fc2", other, 4));
+  F->createSave("ret3", F->createFullyConnected("fc3", shared, 4));
+  EE.compile(CompilationMode::Infer, F);
+  return getActivationsPeak(EE.getIR());
+}
+
+/// The default scheduler computes the outputs in turn and keeps the shared
+/// activation live while it computes the other one. The min-peak-memory
+/// scheduler finishes the readers of the shared activation first, which
+/// lowers the peak of the activations.
+TEST(Interpreter, minPeakMemoryScheduler) {
+  size_t childMemSize =
+      getActivationsPeakWithScheduler(SchedulerKind::ChildMemSize);
+  size_t minPeak =
+      getActivationsPeakWithScheduler(SchedulerKind::MinPeakMemory);
+  EXPECT_LT(minPeak, childMemSize);
+}
+
+/// The stages of a pipeline compute the results of the whole function, and
+/// the functions and the variables that the stages added to the module are
+/// erased when the engine is reset.
+TEST(Interpreter, compilePipeline) {
+  ExecutionEngine EE;
+  auto &mod = EE.getModule();
+  Function *F = mod.createFunction("main");
+  auto *input = mod.createVariable(ElemKind::FloatTy, {4, 16}, "input",
+                                   VisibilityKind::Public,
+                                   Variable::TrainKind::None);
+  auto *fc1 = F->createFullyConnected("fc1", input, 16);
+  auto *tanh = F->createTanh("tanh", fc1);
+  auto *fc2 = F->createFullyConnected("fc2", tanh, 16);
+  auto *sigmoid = F->createSigmoid("sigmoid", fc2);
+  auto *output = F->createSave("ret", sigmoid)->getVariable();
+
+  Tensor in(ElemKind::FloatTy, {4, 16});
+  in.getHandle().randomize(-1.0, 1.0);
+  EE.compile(CompilationMode::Infer, F);
+  EE.run({input}, {&in});
+  Tensor expected;
+  expected.copyFrom(&output->getPayload());
+  size_t numVars = mod.getVars().size();
+
+  EE.compilePipeline(CompilationMode::Infer, F, 2);
+  EXPECT_EQ(EE.getNumPartitions(), 2);
+  EXPECT_EQ(mod.getFunctions().size(), 3);
+  EXPECT_GT(mod.getVars().size(), numVars);
+  output->getPayload().zero();
+  EE.run({input}, {&in});
+  EXPECT_TRUE(output->getPayload().isEqual(expected));
+
+  EE.reset();
+  EXPECT_EQ(mod.getFunctions().size(), 1);
+  EXPECT_EQ(mod.getVars().size(), numVars);
+}
+
 TEST(Interpreter, NotImplementedSave) {
   ExecutionEngine EE;
 
   EXPECT_DEATH(EE.save(CompilationMode::Infer, nullptr, "output"), "");
 }
+
+/// Check that the float16 version of a small network computes the results of
+/// the float version within the precision of float16.
+TEST(Interpreter, convertToFloat16) {
+  ExecutionEngine EE;
+  auto &mod = EE.getModule();
+  Function *F = mod.createFunction("main");
+
+  auto *input = mod.createVariable(ElemKind::FloatTy, {2, 8, 8, 3}, "input",
+                                   VisibilityKind::Public,
+                                   Variable::TrainKind::None);
+  auto *conv = F->createConv("conv", input, 4, 3, 1, 1, 1);
+  auto *relu = F->createRELU("relu", conv);
+  auto *pool = F->createPoolMax("pool", relu, 2, 2, 0);
+  auto *FC = F->createFullyConnected("fc", pool, 10);
+  auto *tanh = F->createTanh("tanh", FC);
+  auto *result = F->createSave("ret", tanh);
+
+  // The clone shares the weights and the output variable with the original.
+  Function *F16 = F->clone("main16");
+
+  Tensor inputs(ElemKind::FloatTy, {2, 8, 8, 3});
+  inputs.getHandle().randomize(-1, 1);
+
+  EE.compile(CompilationMode::Infer, F);
+  EE.run({input}, {&inputs});
+  Tensor ref;
+  ref.copyFrom(&result->getVariable()->getPayload());
+
+  EE.convertToFloat16(F16);
+  unsigned numFloat16 = 0;
+  for (auto *N : F16->getNodes()) {
+    if (N->getNumResults() == 1 &&
+        N->getElementType(0) == ElemKind::Float16Ty) {
+      numFloat16++;
+    }
+  }
+  EXPECT_GT(numFloat16, 0);
+
+  EE.compile(CompilationMode::Infer, F16);
+  EE.run({input}, {&inputs});
+  auto &out = result->getVariable()->getPayload();
+  EXPECT_EQ(out.getElementType(), ElemKind::FloatTy);
+  EXPECT_TRUE(ref.isEqual(out, 0.02));
+}
+
+/// Check that running the chains of layers on micro-batches computes the
+/// results of the whole batch.
+TEST(Interpreter, splitBatches) {
+  ExecutionEngine EE;
+  auto &mod = EE.getModule();
+  Function *F = mod.createFunction("main");
+
+  auto *input = mod.createVariable(ElemKind::FloatTy, {7, 8, 8, 3}, "input",
+                                   VisibilityKind::Public,
+                                   Variable::TrainKind::None);
+  auto *conv = F->createConv("conv", input, 4, 3, 1, 1, 1);
+  auto *relu = F->createRELU("relu", conv);
+  auto *pool = F->createPoolMax("pool", relu, 2, 2, 0);
+  auto *FC = F->createFullyConnected("fc", pool, 10);
+  auto *tanh = F->createTanh("tanh", FC);
+  auto *result = F->createSave("ret", tanh);
+
+  // The clone shares the weights and the output variable with the original.
+  Function *split = F->clone("split");
+
+  Tensor inputs(ElemKind::FloatTy, {7, 8, 8, 3});
+  inputs.getHandle().randomize(-1, 1);
+
+  EE.compile(CompilationMode::Infer, F);
+  EE.run({input}, {&inputs});
+  Tensor ref;
+  ref.copyFrom(&result->getVariable()->getPayload());
+
+  // Micro-batches of 2 samples, where the last one has a single sample.
+  EXPECT_TRUE(::glow::splitBatches(split, 4096));
+  EE.compile(CompilationMode::Infer, split);
+  EE.run({input}, {&inputs});
+  EXPECT_TRUE(ref.isEqual(result->getVariable()->getPayload()));
+}
+
+/// Check that the arithmetic with a splat operand takes the value of the splat
+/// as an immediate, on either side of the non-commutative operations, and
+/// computes the results of the arithmetic with the splat tensor.
+TEST(Interpreter, foldSplatOperands) {
+  ExecutionEngine EE;
+  auto &mod = EE.getModule();
+  Function *F = mod.createFunction("main");
+
+  auto *input = mod.createVariable(ElemKind::FloatTy, {4, 8}, "input",
+                                   VisibilityKind::Public,
+                                   Variable::TrainKind::None);
+  auto *ty = input->getType();
+  auto *add = F->createAdd("add", input, F->createSplat("three", ty, 3));
+  auto *sub = F->createSub("sub", F->createSplat("one", ty, 1), input);
+  auto *div = F->createDiv("div", F->createSplat("two", ty, 2), input);
+  auto *half = F->createSplat("half", ty, 1.5);
+  auto *max = F->createMax("max", input, half);
+  auto *cmp = F->createCmpLTE("cmp", input, half);
+  auto *sel =
+      F->createSelect("sel", cmp, input, F->createSplat("zero", ty, 0));
+  auto *result1 = F->createSave("ret1", add);
+  auto *result2 = F->createSave("ret2", sub);
+  auto *result3 = F->createSave("ret3", div);
+  auto *result4 = F->createSave("ret4", max);
+  auto *result5 = F->createSave("ret5", sel);
+
+  std::unique_ptr<Backend> B(createBackend(BackendKind::Interpreter, nullptr));
+  EXPECT_TRUE(::glow::foldSplatOperands(F, *B));
+  ::glow::optimize(F, CompilationMode::Infer);
+  for (auto *N : F->getNodes()) {
+    EXPECT_FALSE(llvm::isa<SplatNode>(N));
+  }
+  EXPECT_TRUE(llvm::isa<AddSplatNode>(result1->getInput().getNode()));
+  EXPECT_TRUE(llvm::isa<SubSplatLHSNode>(result2->getInput().getNode()));
+  EXPECT_TRUE(llvm::isa<DivSplatLHSNode>(result3->getInput().getNode()));
+  EXPECT_TRUE(llvm::isa<MaxSplatNode>(result4->getInput().getNode()));
+  EXPECT_TRUE(llvm::isa<SelectSplatRHSNode>(result5->getInput().getNode()));
+
+  Tensor inputs(ElemKind::FloatTy, {4, 8});
+  inputs.getHandle().randomize(1, 2);
+  EE.compile(CompilationMode::Infer, F);
+  EE.run({input}, {&inputs});
+
+  auto IH = inputs.getHandle();
+  auto H1 = result1->getVariable()->getHandle();
+  auto H2 = result2->getVariable()->getHandle();
+  auto H3 = result3->getVariable()->getHandle();
+  auto H4 = result4->getVariable()->getHandle();
+  auto H5 = result5->getVariable()->getHandle();
+  for (size_t i = 0, e = IH.size(); i < e; i++) {
+    float x = IH.raw(i);
+    EXPECT_FLOAT_EQ(H1.raw(i), x + 3);
+    EXPECT_FLOAT_EQ(H2.raw(i), 1 - x);
+    EXPECT_FLOAT_EQ(H3.raw(i), 2 / x);
+    EXPECT_FLOAT_EQ(H4.raw(i), std::max(x, 1.5f));
+    EXPECT_FLOAT_EQ(H5.raw(i), x <= 1.5f ? x : 0);
+  }
+}
+
+/// Check that the embedding table of a sparse lengths sum and a gather is
+/// stored in float16, and that the lookups compute the results of the float
+/// version within the precision of float16.
+TEST(Interpreter, convertEmbeddingsToFloat16) {
+  ExecutionEngine EE;
+  auto &mod = EE.getModule();
+  Function *F = mod.createFunction("main");
+
+  auto *data = mod.createVariable(ElemKind::FloatTy, {16, 4}, "data",
+                                  VisibilityKind::Private,
+                                  Variable::TrainKind::None);
+  data->getHandle().randomize(-1, 1);
+  auto *indices = mod.createVariable(ElemKind::IndexTy, {6}, "indices",
+                                     VisibilityKind::Public,
+                                     Variable::TrainKind::None);
+  auto *lengths = mod.createVariable(ElemKind::IndexTy, {3}, "lengths",
+                                     VisibilityKind::Public,
+                                     Variable::TrainKind::None);
+  indices->getHandle<size_t>() = {15, 0, 3, 3, 9, 1};
+  lengths->getHandle<size_t>() = {2, 3, 1};
+  auto *SLS = F->createSparseLengthsSum("SLS", data, indices, lengths);
+  auto *gather = F->createGather("gather", data, indices);
+  auto *result1 = F->createSave("ret1", SLS);
+  auto *result2 = F->createSave("ret2", gather);
+
+  Function *F16 = F->clone("main16");
+
+  EE.compile(CompilationMode::Infer, F);
+  EE.run({}, {});
+  Tensor ref1, ref2;
+  ref1.copyFrom(&result1->getVariable()->getPayload());
+  ref2.copyFrom(&result2->getVariable()->getPayload());
+
+  // Both lookups read the same float16 copy of the table. The replaced float
+  // lookups are left to the DCE of the compilation.
+  EE.convertToFloat16(F16);
+  unsigned numFloat16Tables = 0;
+  for (auto *N : F16->getNodes()) {
+    if ((!llvm::isa<SparseLengthsWeightedSumNode>(N) &&
+         !llvm::isa<GatherNode>(N)) ||
+        N->getNumUsers() == 0) {
+      continue;
+    }
+    auto *table = llvm::dyn_cast<Variable>(N->getNthInput(0).getNode());
+    ASSERT_TRUE(table);
+    EXPECT_EQ(table->getElementType(), ElemKind::Float16Ty);
+    numFloat16Tables++;
+  }
+  EXPECT_EQ(numFloat16Tables, 2);
+
+  EE.compile(CompilationMode::Infer, F16);
+  EE.run({}, {});
+  EXPECT_TRUE(ref1.isEqual(result1->getVariable()->getPayload(), 0.01));
+  EXPECT_TRUE(ref2.isEqual(result2->getVariable()->getPayload(), 0.01));
+}
+
+/// Check that the engines that share a weight store keep the identical
+/// constant weights of their networks in memory once, and still compute the
+/// results of the unshared weights.
+TEST(Interpreter, shareWeightsAcrossEngines) {
+  auto store = std::make_shared<WeightStore>();
+  Tensor inputs(ElemKind::FloatTy, {2, 16});
+  inputs.getHandle().randomize(-1, 1);
+
+  // Build the same network in every engine, except that the bias of the
+  // last engine differs.
+  ExecutionEngine EEs[3];
+  Variable *input[3], *W[3], *B[3];
+  SaveNode *result[3];
+  for (unsigned i = 0; i < 3; i++) {
+    auto &mod = EEs[i].getModule();
+    Function *F = mod.createFunction("main");
+    input[i] = mod.createVariable(ElemKind::FloatTy, {2, 16}, "input",
+                                  VisibilityKind::Public,
+                                  Variable::TrainKind::None);
+    W[i] = mod.createVariable(ElemKind::FloatTy, {16, 8}, "W",
+                              VisibilityKind::Private,
+                              Variable::TrainKind::None);
+    B[i] = mod.createVariable(ElemKind::FloatTy, {8}, "B",
+                              VisibilityKind::Private,
+                              Variable::TrainKind::None);
+    auto WH = W[i]->getHandle();
+    for (size_t j = 0; j < WH.size(); j++) {
+      WH.raw(j) = float(j % 7) / 7 - 0.5;
+    }
+    B[i]->getHandle().clear(i == 2 ? 0.5 : 0.25);
+    auto *FC = F->createFullyConnected("fc", input[i], W[i], B[i]);
+    result[i] = F->createSave("ret", F->createTanh("tanh", FC));
+    if (i > 0) {
+      EEs[i].setWeightStore(store);
+    }
+    EEs[i].compile(CompilationMode::Infer, F);
+    EEs[i].run({input[i]}, {&inputs});
+  }
+
+  // The first engine doesn't use the store.
+  EXPECT_FALSE(W[0]->isPayloadShared());
+  EXPECT_TRUE(W[1]->isPayloadShared());
+  EXPECT_EQ(W[1]->getPayload().getUnsafePtr(),
+            W[2]->getPayload().getUnsafePtr());
+  EXPECT_NE(B[1]->getPayload().getUnsafePtr(),
+            B[2]->getPayload().getUnsafePtr());
+  EXPECT_EQ(store->getNumTensors(), 3);
+
+  EXPECT_TRUE(result[0]->getVariable()->getPayload().isEqual(
+      result[1]->getVariable()->getPayload()));
+  EXPECT_FALSE(result[1]->getVariable()->getPayload().isEqual(
+      result[2]->getVariable()->getPayload()));
+}
+
+/// Check that updating the weights of a compiled network, whose batch
+/// normalization is folded into the convolution, computes the results of the
+/// network compiled with the new weights.
+TEST(Interpreter, updateWeightsWithoutRecompiling) {
+  Tensor inputs(ElemKind::FloatTy, {1, 8, 8, 3});
+  inputs.getHandle().randomize(-1, 1);
+
+  // Fill the k-th weight with positive values that depend on the version.
+  auto fill = [](Tensor &T, size_t k, unsigned version) {
+    auto H = T.getHandle();
+    for (size_t j = 0; j < H.size(); j++) {
+      H.raw(j) = 0.1 + float((j * 7 + k + version) % 10) / 10;
+    }
+  };
+
+  ExecutionEngine EEs[2];
+  SaveNode *result[2];
+  std::vector<std::string> names;
+  std::vector<Tensor> newWeights;
+  for (unsigned i = 0; i < 2; i++) {
+    auto &mod = EEs[i].getModule();
+    Function *F = mod.createFunction("main");
+    auto *input = mod.createVariable(ElemKind::FloatTy, {1, 8, 8, 3}, "input",
+                                     VisibilityKind::Public,
+                                     Variable::TrainKind::None);
+    auto *CV = F->createConv("conv", input, 4, 3, 1, 1, 1);
+    auto *BN = F->createBatchNormalization("bn", CV, 3, 0.0001, 0.9);
+    result[i] = F->createSave("ret", BN);
+
+    // The first engine starts with the old weights and is updated to the new
+    // ones, with which the second engine is compiled.
+    size_t k = 0;
+    for (auto *V : mod.getVars()) {
+      if (!V->isPrivate()) {
+        continue;
+      }
+      fill(V->getPayload(), k, i);
+      if (i == 0) {
+        names.push_back(V->getName());
+        newWeights.emplace_back(*V->getType());
+        fill(newWeights.back(), k, 1);
+      }
+      k++;
+    }
+    if (i == 0) {
+      EEs[i].setUpdatableWeights(true);
+    }
+    EEs[i].compile(CompilationMode::Infer, F);
+    EEs[i].run({input}, {&inputs});
+  }
+
+  auto &out0 = result[0]->getVariable()->getPayload();
+  auto &out1 = result[1]->getVariable()->getPayload();
+  EXPECT_FALSE(out0.isEqual(out1));
+
+  std::vector<llvm::StringRef> nameRefs(names.begin(), names.end());
+  std::vector<Tensor *> weightPtrs;
+  for (auto &T : newWeights) {
+    weightPtrs.push_back(&T);
+  }
+  EEs[0].updateWeights(nameRefs, weightPtrs);
+  auto *input0 = EEs[0].getModule().getVariableByName("input");
+  EEs[0].run({input0}, {&inputs});
+  EXPECT_TRUE(out0.isEqual(out1));
+}
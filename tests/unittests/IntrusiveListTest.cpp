@@ -0,0 +1,172 @@
+/**
+ * Copyright (c) 2017-present, Facebook, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include "glow/Support/IntrusiveList.h"
+
+#include "gtest/gtest.h"
+
+#include <vector>
+
+using namespace glow;
+
+namespace {
+struct Item : public IntrusiveListNode<Item> {
+  int value;
+  explicit Item(int value) : value(value) {}
+};
+
+using ItemList = IntrusiveList<Item>;
+
+/// \returns the values of the items of \p list, in order.
+std::vector<int> values(const ItemList &list) {
+  std::vector<int> result;
+  for (auto *item : list) {
+    result.push_back(item->value);
+  }
+  return result;
+}
+
+/// \returns the values of the items of \p list, in reverse order.
+std::vector<int> reverseValues(const ItemList &list) {
+  std::vector<int> result;
+  for (auto it = list.rbegin(), e = list.rend(); it != e; ++it) {
+    result.push_back((*it)->value);
+  }
+  return result;
+}
+} // namespace
+
+TEST(IntrusiveList, insertAndRemove) {
+  Item a(1), b(2), c(3);
+  ItemList list;
+  EXPECT_TRUE(list.empty());
+  list.push_back(&b);
+  list.push_front(&a);
+  list.insert(list.end(), &c);
+  EXPECT_EQ(values(list), std::vector<int>({1, 2, 3}));
+  EXPECT_EQ(reverseValues(list), std::vector<int>({3, 2, 1}));
+  EXPECT_EQ(list.front(), &a);
+  EXPECT_EQ(list.back(), &c);
+
+  list.remove(&b);
+  EXPECT_FALSE(b.isLinked());
+  EXPECT_EQ(values(list), std::vector<int>({1, 3}));
+  // An object may move to another list once it is removed.
+  ItemList other;
+  other.push_back(&b);
+  EXPECT_EQ(values(other), std::vector<int>({2}));
+  other.clear();
+
+  list.pop_front();
+  list.pop_back();
+  EXPECT_TRUE(list.empty());
+  EXPECT_FALSE(a.isLinked());
+  EXPECT_FALSE(c.isLinked());
+}
+
+/// The links are not copied, so the copy of an object in a list is unlinked.
+TEST(IntrusiveList, copyIsUnlinked) {
+  Item a(1);
+  ItemList list;
+  list.push_back(&a);
+  Item copy(a);
+  EXPECT_TRUE(a.isLinked());
+  EXPECT_FALSE(copy.isLinked());
+  EXPECT_EQ(copy.value, 1);
+}
+
+TEST(IntrusiveList, reverse) {
+  ItemList list;
+  list.reverse();
+  EXPECT_TRUE(list.empty());
+
+  Item a(1), b(2), c(3), d(4);
+  list.push_back(&a);
+  list.reverse();
+  EXPECT_EQ(values(list), std::vector<int>({1}));
+
+  list.push_back(&b);
+  list.push_back(&c);
+  list.reverse();
+  EXPECT_EQ(values(list), std::vector<int>({3, 2, 1}));
+  EXPECT_EQ(reverseValues(list), std::vector<int>({1, 2, 3}));
+  EXPECT_EQ(list.front(), &c);
+  EXPECT_EQ(list.back(), &a);
+
+  // The reversed list stays consistent when it changes.
+  list.push_back(&d);
+  list.remove(&b);
+  EXPECT_EQ(values(list), std::vector<int>({3, 1, 4}));
+  list.reverse();
+  EXPECT_EQ(values(list), std::vector<int>({4, 1, 3}));
+  EXPECT_EQ(reverseValues(list), std::vector<int>({3, 1, 4}));
+  EXPECT_EQ(list.size(), 3);
+}
+
+/// erase() returns the iterator of the next object, and the iterators of the
+/// other objects stay valid.
+TEST(IntrusiveList, eraseWhileIterating) {
+  std::vector<Item> items;
+  for (int i = 0; i < 6; i++) {
+    items.emplace_back(i);
+  }
+  ItemList list;
+  for (auto &item : items) {
+    list.push_back(&item);
+  }
+
+  auto kept = list.getIterator(&items[4]);
+  for (auto it = list.begin(); it != list.end();) {
+    if ((*it)->value % 2) {
+      it = list.erase(it);
+    } else {
+      ++it;
+    }
+  }
+  EXPECT_EQ(values(list), std::vector<int>({0, 2, 4}));
+  EXPECT_EQ(list.size(), 3);
+  EXPECT_FALSE(items[5].isLinked());
+  EXPECT_EQ(*kept, &items[4]);
+  EXPECT_EQ(*std::prev(kept), &items[2]);
+  EXPECT_EQ(std::next(kept), list.end());
+
+  // Erasing every object in turn empties the list.
+  auto it = list.begin();
+  while (it != list.end()) {
+    it = list.erase(it);
+  }
+  EXPECT_TRUE(list.empty());
+  EXPECT_EQ(values(list), std::vector<int>());
+}
+
+TEST(IntrusiveList, getIterator) {
+  Item a(1), b(2), c(3);
+  ItemList list;
+  list.push_back(&a);
+  list.push_back(&c);
+  auto it = list.getIterator(&c);
+  EXPECT_EQ(*it, &c);
+  EXPECT_EQ(*std::prev(it), &a);
+  EXPECT_EQ(std::next(it), list.end());
+  EXPECT_EQ(*list.insert(it, &b), &b);
+  EXPECT_EQ(values(list), std::vector<int>({1, 2, 3}));
+
+  // The object must be in the list.
+  list.remove(&b);
+  EXPECT_FALSE(b.isLinked());
+#ifndef NDEBUG
+  EXPECT_DEATH(list.getIterator(&b), "Object not in a list");
+#endif
+}
@@ -17,16 +17,30 @@
 #include "BackendTestUtils.h"
 
 #include "glow/ExecutionEngine/ExecutionEngine.h"
+#include "glow/ExecutionEngine/ModelExecutor.h"
 #include "glow/Graph/Graph.h"
 #include "glow/IR/IR.h"
 #include "glow/IR/IRBuilder.h"
 #include "glow/IR/Instrs.h"
+#include "glow/Support/Memory.h"
+#include "glow/Support/Parallel.h"
 #include "glow/Support/Random.h"
+#include "glow/Support/Trace.h"
 
 #include "gtest/gtest.h"
 
+#include "llvm/ADT/SmallString.h"
+#include "llvm/Support/CommandLine.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/MemoryBuffer.h"
+
+#include <atomic>
 #include <cassert>
 #include <string>
+#include <thread>
+#include <tuple>
+
+#include <unistd.h>
 
 using namespace glow;
 using llvm::cast;
@@ -109,6 +123,27 @@ TEST(JITCorrectnessTest, quantizedConvTest) {
   EXPECT_TRUE(out1.isEqual(out2, 1.0));
 }
 
+TEST(JITCorrectnessTest, quantizedPrivateFilterConvTest) {
+  // The private int8 filter with an output depth that is a multiple of 8
+  // selects the blocked int8 convolution. The padding and the stride check the
+  // correction of the input offset at the borders.
+  Tensor inputs(ElemKind::Int8QTy, {2, 11, 10, 12}, 0.025, -7);
+  Tensor kernel(ElemKind::Int8QTy, {16, 3, 3, 12}, 0.003, 3);
+  Tensor bias(ElemKind::Int8QTy, {16}, 0.5, -4);
+  inputs.getHandle<int8_t>().randomize(-128, 127);
+  kernel.getHandle<int8_t>().randomize(-128, 127);
+  bias.getHandle<int8_t>().randomize(-11, 8);
+  Tensor out1(ElemKind::Int8QTy, {2, 6, 5, 16}, 0.05, -17);
+  Tensor out2(ElemKind::Int8QTy, {2, 6, 5, 16}, 0.05, -17);
+
+  inferPrivateFilterConvNet(&inputs, &kernel, &bias, &out1, 3, 2, 1,
+                            BackendKind::CPU);
+  inferPrivateFilterConvNet(&inputs, &kernel, &bias, &out2, 3, 2, 1,
+                            BackendKind::Interpreter);
+
+  EXPECT_TRUE(out1.isEqual(out2, 1.0));
+}
+
 TEST(JITCorrectnessTest, convGradTest) {
   Tensor inputs(ElemKind::FloatTy, {9, 8, 9, 4});
   Tensor kernel1(ElemKind::FloatTy, {3, 3, 3, 4});
@@ -162,6 +197,40 @@ TEST(JITCorrectnessTest, gatherTest) {
   EXPECT_TRUE(out1.isEqual(out2));
 }
 
+TEST(JITCorrectnessTest, loopTest) {
+  constexpr size_t maxSteps = 8;
+  constexpr size_t numSteps = 5;
+
+  Tensor inputs(ElemKind::FloatTy, {maxSteps, 3, 4});
+  inputs.getHandle().initXavier(1);
+
+  Tensor out1(ElemKind::FloatTy, {maxSteps, 3, 4});
+  Tensor out2(ElemKind::FloatTy, {maxSteps, 3, 4});
+
+  inferLoopNet(&inputs, numSteps, &out1, BackendKind::CPU);
+  inferLoopNet(&inputs, numSteps, &out2, BackendKind::Interpreter);
+
+  EXPECT_TRUE(out1.isEqual(out2));
+
+  // The state is carried over the first numSteps steps, and the rest of the
+  // output is not written.
+  auto inputsH = inputs.getHandle();
+  auto outH = out2.getHandle();
+  for (size_t i = 0; i < 3; i++) {
+    for (size_t j = 0; j < 4; j++) {
+      float state = 0;
+      for (size_t t = 0; t < maxSteps; t++) {
+        float expected = 0;
+        if (t < numSteps) {
+          state = std::tanh(state + inputsH.at({t, i, j}));
+          expected = state;
+        }
+        EXPECT_NEAR(outH.at({t, i, j}), expected, 1e-5);
+      }
+    }
+  }
+}
+
 TEST(JITCorrectnessTest, localResponseNormalizationTest) {
   Tensor inputs(ElemKind::FloatTy, {8, 15, 13, 30});
   inputs.getHandle().initXavier(1);
@@ -202,6 +271,37 @@ TEST(JITCorrectnessTest, localResponseNormalizationGradTest) {
   EXPECT_TRUE(out1.isEqual(out2));
 }
 
+TEST(JITCorrectnessTest, batchNormalizationTrainTest) {
+  Tensor inputs(ElemKind::FloatTy, {5, 4, 7, 3});
+  Tensor weights(ElemKind::FloatTy, {84, 180});
+  Tensor bias(ElemKind::FloatTy, {180});
+  Tensor selected(ElemKind::IndexTy, {5, 1});
+  inputs.getHandle().initXavier(1);
+  weights.getHandle().randomize(-2.0, 3.0);
+  bias.getHandle().randomize(-1.0, 1.3);
+  auto selectedH = selected.getHandle<size_t>();
+  for (size_t i = 0; i < 5; i++) {
+    selectedH.raw(i) = nextRandInt(0, 179);
+  }
+  std::array<size_t, 4> S1{{5, 4, 3, 15}};
+  llvm::ArrayRef<size_t> shape1(S1);
+  std::array<size_t, 2> S2{{5, 180}};
+  llvm::ArrayRef<size_t> shape2(S2);
+
+  // Normalize the innermost channels and the channels of the second
+  // dimension, which are strided.
+  for (size_t channelIdx : {3, 1}) {
+    Tensor out1(ElemKind::FloatTy, shape2);
+    Tensor out2(ElemKind::FloatTy, shape2);
+    trainBatchNormalizationNet(&inputs, &weights, &bias, &selected, shape1,
+                               shape2, channelIdx, &out1, BackendKind::CPU);
+    trainBatchNormalizationNet(&inputs, &weights, &bias, &selected, shape1,
+                               shape2, channelIdx, &out2,
+                               BackendKind::Interpreter);
+    EXPECT_TRUE(out1.isEqual(out2, 0.001));
+  }
+}
+
 TEST(JITCorrectnessTest, matMulTest) {
   Tensor lhs(ElemKind::FloatTy, {10, 9});
   Tensor rhs(ElemKind::FloatTy, {9, 8});
@@ -360,6 +460,34 @@ TEST(JITCorrectnessTest, quantizeTest) {
   EXPECT_TRUE(out1.isEqual(out2));
 }
 
+TEST(JITCorrectnessTest, quantizationProfileTest) {
+  // The second input extends the range of the histogram, which rescales it.
+  Tensor inputs1(ElemKind::FloatTy, {7, 145});
+  Tensor inputs2(ElemKind::FloatTy, {7, 145});
+  Tensor inputs3(ElemKind::FloatTy, {7, 145});
+  inputs1.getHandle().randomize(-1.0, 1.0);
+  inputs2.getHandle().randomize(-3.0, 2.0);
+  inputs3.getHandle().randomize(-0.5, 0.5);
+  Tensor hist1, hist2, info1, info2;
+
+  profileQuantizationNet({&inputs1, &inputs2, &inputs3}, &hist1, &info1,
+                         BackendKind::CPU);
+  profileQuantizationNet({&inputs1, &inputs2, &inputs3}, &hist2, &info2,
+                         BackendKind::Interpreter);
+
+  EXPECT_TRUE(info1.isEqual(info2));
+  // The elements on the edges of the bins may fall into the neighbouring bin,
+  // but no element is lost.
+  EXPECT_TRUE(hist1.isEqual(hist2, 1.0));
+  float count1 = 0, count2 = 0;
+  for (size_t i = 0, e = hist1.size(); i < e; i++) {
+    count1 += hist1.getHandle().raw(i);
+    count2 += hist2.getHandle().raw(i);
+  }
+  EXPECT_EQ(count1, 3 * 7 * 145);
+  EXPECT_EQ(count2, 3 * 7 * 145);
+}
+
 TEST(JITCorrectnessTest, reluTest) {
   Tensor inputs(ElemKind::FloatTy, {2, 16});
   inputs.getHandle().initXavier(1);
@@ -453,6 +581,79 @@ TEST(JITCorrectnessTest, softmaxTest) {
   EXPECT_TRUE(out1.isEqual(out2));
 }
 
+/// Compile and run the SoftMax of \p inputs followed by a TopK of \p k into
+/// \p values and \p indices, or, if \p k is zero, by the CrossEntropyLoss of
+/// the \p labels into \p values. The CPU backend fuses the SoftMax into both.
+static void inferSoftMaxConsumerNet(Tensor *inputs, Tensor *labels, size_t k,
+                                    Tensor *values, Tensor *indices,
+                                    BackendKind kind) {
+  ExecutionEngine EE(kind);
+  auto &mod = EE.getModule();
+  Function *F = mod.createFunction("main");
+  auto *var = mod.createVariable(&inputs->getType(), "inputs",
+                                 VisibilityKind::Public,
+                                 Variable::TrainKind::None);
+  auto *selected = mod.createVariable(ElemKind::IndexTy, {inputs->dims()[0], 1},
+                                      "selected", VisibilityKind::Public,
+                                      Variable::TrainKind::None);
+  auto *softmax = F->createSoftMax("softmax", var, selected);
+  if (k) {
+    auto *TK = F->createTopK("topk", softmax, k);
+    auto *valuesSave = F->createSave("values", TK->getValues());
+    auto *indicesSave = F->createSave("indices", TK->getIndices());
+    EE.compile(CompilationMode::Infer, F);
+    EE.run({var}, {inputs});
+    values->copyFrom(&valuesSave->getVariable()->getPayload());
+    indices->copyFrom(&indicesSave->getVariable()->getPayload());
+    return;
+  }
+  auto *labelsVar = mod.createVariable(&labels->getType(), "labels",
+                                       VisibilityKind::Public,
+                                       Variable::TrainKind::None);
+  auto *CE = F->createCrossEntropyLoss("loss", softmax, labelsVar);
+  auto *save = F->createSave("ret", CE);
+  EE.compile(CompilationMode::Infer, F);
+  EE.run({var, labelsVar}, {inputs, labels});
+  values->copyFrom(&save->getVariable()->getPayload());
+}
+
+TEST(JITCorrectnessTest, fusedSoftMaxTopKTest) {
+  // The rows are wider than a block of the single-pass SoftMax.
+  Tensor inputs(ElemKind::FloatTy, {6, 1000});
+  inputs.getHandle().randomize(-5.0, 5.0);
+  Tensor values1;
+  Tensor values2;
+  Tensor indices1;
+  Tensor indices2;
+
+  inferSoftMaxConsumerNet(&inputs, nullptr, 5, &values1, &indices1,
+                          BackendKind::CPU);
+  inferSoftMaxConsumerNet(&inputs, nullptr, 5, &values2, &indices2,
+                          BackendKind::Interpreter);
+
+  EXPECT_TRUE(values1.isEqual(values2));
+  EXPECT_TRUE(indices1.isEqual(indices2));
+}
+
+TEST(JITCorrectnessTest, fusedSoftMaxCrossEntropyLossTest) {
+  Tensor inputs(ElemKind::FloatTy, {6, 1000});
+  Tensor labels(ElemKind::IndexTy, {6});
+  inputs.getHandle().randomize(-5.0, 5.0);
+  auto labelsH = labels.getHandle<size_t>();
+  for (size_t i = 0; i < 6; i++) {
+    labelsH.raw(i) = nextRandInt(0, 999);
+  }
+  Tensor loss1;
+  Tensor loss2;
+
+  inferSoftMaxConsumerNet(&inputs, &labels, 0, &loss1, nullptr,
+                          BackendKind::CPU);
+  inferSoftMaxConsumerNet(&inputs, &labels, 0, &loss2, nullptr,
+                          BackendKind::Interpreter);
+
+  EXPECT_TRUE(loss1.isEqual(loss2, 0.005));
+}
+
 TEST(JITCorrectnessTest, softmaxGradTest) {
   std::array<size_t, 2> S{{8, 23}};
   llvm::ArrayRef<size_t> shape(S);
@@ -516,6 +717,358 @@ TEST(JITCorrectnessTest, convOps) {
   }
 }
 
+TEST(JITCorrectnessTest, im2colConvOps) {
+  // Construct networks with a convolution depth that selects the GEMM-based
+  // convolution, including one that doesn't fill the last packed panel.
+  for (auto depth : {16, 40}) {
+    Tensor inputs(ElemKind::FloatTy, {2, 3, 16, 16});
+    inputs.getHandle().initXavier(1);
+    Tensor out1;
+    Tensor out2;
+
+    inferBasicConvNet(&inputs, &out1, BackendKind::CPU, depth);
+    inferBasicConvNet(&inputs, &out2, BackendKind::Interpreter, depth);
+
+    EXPECT_TRUE(out1.isEqual(out2));
+  }
+}
+
+TEST(JITCorrectnessTest, winogradConvTest) {
+  // Use output sizes that don't divide into the 2x2 tiles with and without
+  // padding.
+  for (size_t pad : {0, 1}) {
+    Tensor inputs(ElemKind::FloatTy, {2, 9, 10, 16});
+    Tensor kernel(ElemKind::FloatTy, {24, 3, 3, 16});
+    Tensor bias(ElemKind::FloatTy, {24});
+    inputs.getHandle().randomize(-1.0, 1.0);
+    kernel.getHandle().randomize(-1.0, 1.0);
+    bias.getHandle().randomize(-0.5, 0.5);
+    std::array<size_t, 4> S{{2, 7 + 2 * pad, 8 + 2 * pad, 24}};
+    llvm::ArrayRef<size_t> shape(S);
+    Tensor out1(ElemKind::FloatTy, shape);
+    Tensor out2(ElemKind::FloatTy, shape);
+
+    inferPrivateFilterConvNet(&inputs, &kernel, &bias, &out1, 3, 1, pad,
+                              BackendKind::CPU);
+    inferPrivateFilterConvNet(&inputs, &kernel, &bias, &out2, 3, 1, pad,
+                              BackendKind::Interpreter);
+
+    EXPECT_TRUE(out1.isEqual(out2));
+  }
+}
+
+/// Compile and run the 3x3 or 5x5 convolution of \p inputs with \p filter and
+/// \p bias if \p kernel is not zero, or otherwise the fully connected layer
+/// with the weights \p filter and \p bias, followed by one of the activations
+/// that the CPU backend fuses into its kernels: ReLU, sigmoid or tanh,
+/// selected by \p activation.
+static void inferActivationNet(Tensor *inputs, Tensor *filter, Tensor *bias,
+                               Tensor *out, size_t kernel, unsigned activation,
+                               BackendKind kind) {
+  ExecutionEngine EE(kind);
+  auto &mod = EE.getModule();
+  Function *F = mod.createFunction("main");
+  auto *var = mod.createVariable(&inputs->getType(), "input",
+                                 VisibilityKind::Public,
+                                 Variable::TrainKind::None);
+  auto *filterVar =
+      mod.createVariable(&filter->getType(), "filter", VisibilityKind::Private,
+                         Variable::TrainKind::None);
+  auto *biasVar = mod.createVariable(&bias->getType(), "bias",
+                                     VisibilityKind::Private,
+                                     Variable::TrainKind::None);
+  filterVar->getPayload().copyFrom(filter);
+  biasVar->getPayload().copyFrom(bias);
+
+  Node *N;
+  if (kernel) {
+    ShapeNHWC idim(inputs->dims());
+    size_t pad = kernel / 2;
+    auto OT = mod.uniqueType(ElemKind::FloatTy,
+                             {idim.n, idim.h, idim.w, filter->dims()[0]});
+    N = F->createConv("conv", var, filterVar, biasVar, OT, kernel, 1, pad, 1);
+  } else {
+    N = F->createFullyConnected("fc", var, filterVar, biasVar);
+  }
+  if (activation == 0) {
+    N = F->createRELU("relu", N);
+  } else if (activation == 1) {
+    N = F->createSigmoid("sigmoid", N);
+  } else {
+    N = F->createTanh("tanh", N);
+  }
+  auto *result = F->createSave("ret", N);
+  EE.compile(CompilationMode::Infer, F);
+  EE.run({var}, {inputs});
+  out->copyFrom(&result->getVariable()->getPayload());
+}
+
+TEST(JITCorrectnessTest, fusedConvActivationTest) {
+  // Select the DKKC8 convolution with two and with one register of output
+  // channels per tile, and the Winograd convolution.
+  struct ConvParams {
+    size_t channels;
+    size_t depth;
+    size_t kernel;
+  };
+  for (auto P : {ConvParams{3, 64, 5}, ConvParams{32, 64, 5},
+                 ConvParams{5, 24, 5}, ConvParams{16, 24, 3}}) {
+    for (unsigned activation = 0; activation < 3; activation++) {
+      Tensor inputs(ElemKind::FloatTy, {2, 9, 10, P.channels});
+      Tensor filter(ElemKind::FloatTy,
+                    {P.depth, P.kernel, P.kernel, P.channels});
+      Tensor bias(ElemKind::FloatTy, {P.depth});
+      inputs.getHandle().randomize(-1.0, 1.0);
+      filter.getHandle().randomize(-0.2, 0.2);
+      bias.getHandle().randomize(-0.5, 0.5);
+      Tensor out1;
+      Tensor out2;
+
+      inferActivationNet(&inputs, &filter, &bias, &out1, P.kernel, activation,
+                         BackendKind::CPU);
+      inferActivationNet(&inputs, &filter, &bias, &out2, P.kernel, activation,
+                         BackendKind::Interpreter);
+
+      EXPECT_TRUE(out1.isEqual(out2));
+    }
+  }
+}
+
+TEST(JITCorrectnessTest, fusedFCActivationTest) {
+  // Use an output depth that doesn't fill the last packed panel.
+  for (unsigned activation = 0; activation < 3; activation++) {
+    Tensor inputs(ElemKind::FloatTy, {5, 48});
+    Tensor weights(ElemKind::FloatTy, {48, 40});
+    Tensor bias(ElemKind::FloatTy, {40});
+    inputs.getHandle().randomize(-1.0, 1.0);
+    weights.getHandle().randomize(-0.2, 0.2);
+    bias.getHandle().randomize(-0.5, 0.5);
+    Tensor out1;
+    Tensor out2;
+
+    inferActivationNet(&inputs, &weights, &bias, &out1, 0, activation,
+                       BackendKind::CPU);
+    inferActivationNet(&inputs, &weights, &bias, &out2, 0, activation,
+                       BackendKind::Interpreter);
+
+    EXPECT_TRUE(out1.isEqual(out2));
+  }
+}
+
+/// Compile and run a convolution of \p inputs with \p filter and \p bias whose
+/// result is added to \p shortcut and then rectified.
+static void inferResidualConvNet(Tensor *inputs, Tensor *shortcut,
+                                 Tensor *filter, Tensor *bias, Tensor *out,
+                                 BackendKind kind) {
+  ExecutionEngine EE(kind);
+  auto &mod = EE.getModule();
+  Function *F = mod.createFunction("main");
+  auto *var = mod.createVariable(&inputs->getType(), "input",
+                                 VisibilityKind::Public,
+                                 Variable::TrainKind::None);
+  auto *shortcutVar = mod.createVariable(&shortcut->getType(), "shortcut",
+                                         VisibilityKind::Public,
+                                         Variable::TrainKind::None);
+  auto *filterVar =
+      mod.createVariable(&filter->getType(), "filter", VisibilityKind::Private,
+                         Variable::TrainKind::None);
+  auto *biasVar = mod.createVariable(&bias->getType(), "bias",
+                                     VisibilityKind::Private,
+                                     Variable::TrainKind::None);
+  filterVar->getPayload().copyFrom(filter);
+  biasVar->getPayload().copyFrom(bias);
+
+  size_t kernel = filter->dims()[1];
+  auto OT = mod.uniqueType(ElemKind::FloatTy, shortcut->dims());
+  auto *conv = F->createConv("conv", var, filterVar, biasVar, OT, kernel, 1,
+                             kernel / 2, 1);
+  auto *add = F->createAdd("add", shortcutVar, conv);
+  auto *relu = F->createRELU("relu", add);
+  auto *result = F->createSave("ret", relu);
+  EE.compile(CompilationMode::Infer, F);
+  EE.run({var, shortcutVar}, {inputs, shortcut});
+  out->copyFrom(&result->getVariable()->getPayload());
+}
+
+TEST(JITCorrectnessTest, fusedResidualConvTest) {
+  // Select the DKKC8 convolution, which accumulates into the shortcut.
+  Tensor inputs(ElemKind::FloatTy, {2, 9, 10, 32});
+  Tensor shortcut(ElemKind::FloatTy, {2, 9, 10, 64});
+  Tensor filter(ElemKind::FloatTy, {64, 5, 5, 32});
+  Tensor bias(ElemKind::FloatTy, {64});
+  inputs.getHandle().randomize(-1.0, 1.0);
+  shortcut.getHandle().randomize(-1.0, 1.0);
+  filter.getHandle().randomize(-0.2, 0.2);
+  bias.getHandle().randomize(-0.5, 0.5);
+  Tensor out1;
+  Tensor out2;
+
+  inferResidualConvNet(&inputs, &shortcut, &filter, &bias, &out1,
+                       BackendKind::CPU);
+  inferResidualConvNet(&inputs, &shortcut, &filter, &bias, &out2,
+                       BackendKind::Interpreter);
+
+  EXPECT_TRUE(out1.isEqual(out2));
+}
+
+/// Compile and run a network of three convolutions whose channels divide into
+/// the blocks of the blocked layout, with the pooling, the activations and a
+/// residual addition between them, on \p inputs. The convolutions use the
+/// \p filters and the \p biases in order.
+static void inferBlockedConvNet(Tensor *inputs, Tensor *filters, Tensor *biases,
+                                Tensor *out, BackendKind kind) {
+  ExecutionEngine EE(kind);
+  auto &mod = EE.getModule();
+  Function *F = mod.createFunction("main");
+  auto *var = mod.createVariable(&inputs->getType(), "input",
+                                 VisibilityKind::Public,
+                                 Variable::TrainKind::None);
+  unsigned numConvs = 0;
+  auto createConv = [&](NodeValue in) -> Node * {
+    Tensor *filter = &filters[numConvs];
+    Tensor *bias = &biases[numConvs++];
+    auto *filterVar = mod.createVariable(&filter->getType(), "filter",
+                                         VisibilityKind::Private,
+                                         Variable::TrainKind::None);
+    auto *biasVar = mod.createVariable(&bias->getType(), "bias",
+                                       VisibilityKind::Private,
+                                       Variable::TrainKind::None);
+    filterVar->getPayload().copyFrom(filter);
+    biasVar->getPayload().copyFrom(bias);
+    ShapeNHWC idim(in.dims());
+    size_t kernel = filter->dims()[1];
+    auto OT = mod.uniqueType(ElemKind::FloatTy,
+                             {idim.n, idim.h, idim.w, filter->dims()[0]});
+    return F->createConv("conv", in, filterVar, biasVar, OT, kernel, 1,
+                         kernel / 2, 1);
+  };
+
+  Node *conv1 = F->createRELU("relu", createConv(var));
+  Node *pool = F->createPoolMax("pool", conv1, 2, 2, 0);
+  Node *conv2 = F->createTanh("tanh", createConv(pool));
+  Node *add = F->createAdd("add", conv2, pool);
+  Node *avg = F->createPoolAvg("avg", createConv(add), 3, 1, 1);
+  auto *result = F->createSave("ret", avg);
+  EE.compile(CompilationMode::Infer, F);
+  EE.run({var}, {inputs});
+  out->copyFrom(&result->getVariable()->getPayload());
+}
+
+TEST(JITCorrectnessTest, blockedConvNetTest) {
+  // The first convolution has input channels that don't divide into blocks
+  // in the first network.
+  for (size_t channels : {3, 8}) {
+    Tensor inputs(ElemKind::FloatTy, {2, 10, 9, channels});
+    Tensor filters[3] = {Tensor(ElemKind::FloatTy, {16, 3, 3, channels}),
+                         Tensor(ElemKind::FloatTy, {16, 3, 3, 16}),
+                         Tensor(ElemKind::FloatTy, {24, 1, 1, 16})};
+    Tensor biases[3] = {Tensor(ElemKind::FloatTy, {16}),
+                        Tensor(ElemKind::FloatTy, {16}),
+                        Tensor(ElemKind::FloatTy, {24})};
+    inputs.getHandle().randomize(-1.0, 1.0);
+    for (unsigned i = 0; i < 3; i++) {
+      filters[i].getHandle().randomize(-0.2, 0.2);
+      biases[i].getHandle().randomize(-0.5, 0.5);
+    }
+    Tensor out1;
+    Tensor out2;
+
+    inferBlockedConvNet(&inputs, filters, biases, &out1, BackendKind::CPU);
+    inferBlockedConvNet(&inputs, filters, biases, &out2,
+                        BackendKind::Interpreter);
+
+    EXPECT_TRUE(out1.isEqual(out2));
+  }
+}
+
+TEST(JITCorrectnessTest, stackedBroadcastTest) {
+  // The BatchedAdd and the Broadcast are stacked with the element-wise
+  // operations around them, and read their slice and source through index
+  // arithmetic.
+  Tensor batch(ElemKind::FloatTy, {8, 40});
+  Tensor slice(ElemKind::FloatTy, {40});
+  Tensor rows(ElemKind::FloatTy, {8});
+  batch.getHandle().randomize(-1.0, 1.0);
+  slice.getHandle().randomize(-1.0, 1.0);
+  rows.getHandle().randomize(-1.0, 1.0);
+  Tensor out[2];
+
+  BackendKind kinds[2] = {BackendKind::CPU, BackendKind::Interpreter};
+  for (unsigned i = 0; i < 2; i++) {
+    ExecutionEngine EE(kinds[i]);
+    auto &mod = EE.getModule();
+    Function *F = mod.createFunction("main");
+    auto *batchVar = mod.createVariable(&batch.getType(), "batch",
+                                        VisibilityKind::Public,
+                                        Variable::TrainKind::None);
+    auto *sliceVar = mod.createVariable(&slice.getType(), "slice",
+                                        VisibilityKind::Public,
+                                        Variable::TrainKind::None);
+    auto *rowsVar = mod.createVariable(&rows.getType(), "rows",
+                                       VisibilityKind::Public,
+                                       Variable::TrainKind::None);
+    auto *BA = F->createBatchedAdd("batchedadd", batchVar, sliceVar);
+    auto *tanh = F->createTanh("tanh", BA);
+    auto *B = F->createBroadcast("broadcast", rowsVar, {8, 40}, 0);
+    auto *add = F->createAdd("add", tanh, B);
+    auto *result = F->createSave("ret", add);
+    EE.compile(CompilationMode::Infer, F);
+    EE.run({batchVar, sliceVar, rowsVar}, {&batch, &slice, &rows});
+    out[i].copyFrom(&result->getVariable()->getPayload());
+  }
+
+  EXPECT_TRUE(out[0].isEqual(out[1]));
+}
+
+TEST(JITCorrectnessTest, fusedBroadcastTest) {
+  // The broadcasts of the channel vectors, like in the lowered batch
+  // normalization, pass their elements to the arithmetic in registers. The
+  // broadcast that is saved as well is still stored.
+  Tensor input(ElemKind::FloatTy, {2, 3, 4, 5});
+  Tensor mean(ElemKind::FloatTy, {3});
+  Tensor coef(ElemKind::FloatTy, {3});
+  Tensor beta(ElemKind::FloatTy, {5});
+  input.getHandle().randomize(-1.0, 1.0);
+  mean.getHandle().randomize(-1.0, 1.0);
+  coef.getHandle().randomize(-1.0, 1.0);
+  beta.getHandle().randomize(-1.0, 1.0);
+  Tensor out[2];
+  Tensor saved[2];
+
+  BackendKind kinds[2] = {BackendKind::CPU, BackendKind::Interpreter};
+  for (unsigned i = 0; i < 2; i++) {
+    ExecutionEngine EE(kinds[i]);
+    auto &mod = EE.getModule();
+    Function *F = mod.createFunction("main");
+    Variable *vars[4];
+    Tensor *tensors[4] = {&input, &mean, &coef, &beta};
+    const char *names[4] = {"input", "mean", "coef", "beta"};
+    for (unsigned j = 0; j < 4; j++) {
+      vars[j] = mod.createVariable(&tensors[j]->getType(), names[j],
+                                   VisibilityKind::Public,
+                                   Variable::TrainKind::None);
+    }
+    auto dims = input.dims();
+    auto *meanB = F->createBroadcast("meanB", vars[1], dims, 1);
+    auto *coefB = F->createBroadcast("coefB", vars[2], dims, 1);
+    auto *betaB = F->createBroadcast("betaB", vars[3], dims, 3);
+    Node *N = F->createSub("sub", vars[0], meanB);
+    N = F->createMul("mul", N, coefB);
+    N = F->createAdd("add", N, betaB);
+    N = F->createMax("max", N, coefB);
+    auto *result = F->createSave("ret", N);
+    auto *savedB = F->createSave("saved", betaB);
+    EE.compile(CompilationMode::Infer, F);
+    EE.run({vars[0], vars[1], vars[2], vars[3]},
+           {&input, &mean, &coef, &beta});
+    out[i].copyFrom(&result->getVariable()->getPayload());
+    saved[i].copyFrom(&savedB->getVariable()->getPayload());
+  }
+
+  EXPECT_TRUE(out[0].isEqual(out[1]));
+  EXPECT_TRUE(saved[0].isEqual(saved[1]));
+}
+
 TEST(JITCorrectnessTest, basicFCNet) {
   Tensor inputs(ElemKind::FloatTy, {2, 3, 16, 16});
   inputs.getHandle().initXavier(1);
@@ -549,3 +1102,674 @@ TEST(JITCorrectnessTest, complexNet1) {
 
   EXPECT_TRUE(out1.isEqual(out2));
 }
+
+TEST(JITCorrectnessTest, concurrentSessions) {
+  ExecutionEngine EE(BackendKind::CPU);
+  Variable *input, *output;
+  std::tie(input, output) = compileFCReluNet(EE);
+
+  constexpr unsigned numSessions = 4;
+  std::vector<Tensor> inputs;
+  std::vector<Tensor> expected(numSessions);
+  for (unsigned i = 0; i < numSessions; i++) {
+    inputs.emplace_back(ElemKind::FloatTy, std::vector<size_t>{4, 32});
+    inputs[i].getHandle().randomize(-1.0, 1.0);
+    EE.run({input}, {&inputs[i]});
+    expected[i].copyFrom(&output->getPayload());
+  }
+
+  std::vector<std::unique_ptr<ExecutionSession>> sessions;
+  std::vector<std::thread> threads;
+  for (unsigned i = 0; i < numSessions; i++) {
+    sessions.push_back(EE.createSession());
+  }
+  for (unsigned i = 0; i < numSessions; i++) {
+    threads.emplace_back([&, i]() {
+      for (unsigned iter = 0; iter < 20; iter++) {
+        EE.run(*sessions[i], {input}, {&inputs[i]});
+      }
+    });
+  }
+  for (auto &thread : threads) {
+    thread.join();
+  }
+
+  for (unsigned i = 0; i < numSessions; i++) {
+    EXPECT_TRUE(sessions[i]->getTensor(output).isEqual(expected[i]));
+  }
+}
+
+/// Check that concurrent sessions compute a GEMM that is large enough for the
+/// parallel libjit kernel, when their first runs start right after the
+/// compilation. With -cpu-lazy-jit, one of these runs compiles the code while
+/// the others wait, and the threads of the kernel must not compile.
+TEST(JITCorrectnessTest, concurrentThreadedGemm) {
+  size_t numThreads = glow_parallel_get_num_threads();
+  glow_parallel_set_num_threads(4);
+
+  Tensor lhs(ElemKind::FloatTy, {128, 256});
+  Tensor rhs(ElemKind::FloatTy, {256, 192});
+  lhs.getHandle().randomize(-1.0, 1.0);
+  rhs.getHandle().randomize(-1.0, 1.0);
+  Tensor expected(ElemKind::FloatTy, {128, 192});
+  inferMatMulNet(&lhs, &rhs, &expected, BackendKind::Interpreter);
+
+  ExecutionEngine EE(BackendKind::CPU);
+  auto &mod = EE.getModule();
+  Function *F = mod.createFunction("main");
+  auto *lhsVar = mod.createVariable(ElemKind::FloatTy, {128, 256}, "lhs",
+                                    VisibilityKind::Public,
+                                    Variable::TrainKind::None);
+  auto *rhsVar = mod.createVariable(ElemKind::FloatTy, {256, 192}, "rhs",
+                                    VisibilityKind::Private,
+                                    Variable::TrainKind::None);
+  rhsVar->copyFrom(&rhs);
+  auto *matmul = F->createMatMul("matmul", lhsVar, rhsVar);
+  auto *result = F->createSave("ret", matmul);
+  EE.compile(CompilationMode::Infer, F);
+
+  constexpr unsigned numSessions = 4;
+  std::vector<std::unique_ptr<ExecutionSession>> sessions;
+  std::vector<std::thread> threads;
+  for (unsigned i = 0; i < numSessions; i++) {
+    sessions.push_back(EE.createSession());
+  }
+  for (unsigned i = 0; i < numSessions; i++) {
+    threads.emplace_back([&, i]() {
+      for (unsigned iter = 0; iter < 5; iter++) {
+        EE.run(*sessions[i], {lhsVar}, {&lhs});
+      }
+    });
+  }
+  for (auto &thread : threads) {
+    thread.join();
+  }
+
+  for (unsigned i = 0; i < numSessions; i++) {
+    EXPECT_TRUE(sessions[i]->getTensor(result->getVariable()).isEqual(
+        expected, 0.001));
+  }
+  glow_parallel_set_num_threads(numThreads);
+}
+
+/// Check that the functions that run one at a time share the memory of their
+/// activations in an arena, and that concurrent sessions do so with an arena
+/// per thread.
+TEST(JITCorrectnessTest, sharedActivationArena) {
+  constexpr unsigned numModels = 3;
+  ExecutionEngine EEs[numModels];
+  Variable *inputs[numModels];
+  Variable *results[numModels];
+  Tensor in(ElemKind::FloatTy, {4, 32});
+  in.getHandle().randomize(-1.0, 1.0);
+  std::vector<Tensor> expected(numModels);
+  size_t maxSize = 0;
+  for (unsigned i = 0; i < numModels; i++) {
+    EEs[i].setBackend(BackendKind::CPU);
+    auto &mod = EEs[i].getModule();
+    Function *F = mod.createFunction("main");
+    inputs[i] = mod.createVariable(ElemKind::FloatTy, {4, 32}, "input",
+                                   VisibilityKind::Public,
+                                   Variable::TrainKind::None);
+    // The models have activations of different sizes.
+    Node *N = inputs[i];
+    for (unsigned j = 0; j <= i; j++) {
+      N = F->createRELU("relu", F->createFullyConnected("fc", N, 32 << i));
+    }
+    results[i] = F->createSave("ret", N)->getVariable();
+    EEs[i].compile(CompilationMode::Infer, F);
+    EEs[i].run({inputs[i]}, {&in});
+    expected[i].copyFrom(&results[i]->getPayload());
+    maxSize = std::max(maxSize, EEs[i].getActivationsSize());
+  }
+  EXPECT_GT(maxSize, 0);
+
+  ActivationArena arena;
+  for (unsigned i = 0; i < numModels; i++) {
+    EEs[i].setActivationArena(&arena);
+  }
+  EXPECT_EQ(arena.getSize(), maxSize);
+  for (unsigned iter = 0; iter < 2; iter++) {
+    for (unsigned i = 0; i < numModels; i++) {
+      results[i]->getPayload().zero();
+      EEs[i].run({inputs[i]}, {&in});
+      EXPECT_TRUE(results[i]->getPayload().isEqual(expected[i]));
+    }
+  }
+
+  // Every thread runs a session of every model in an arena of its own.
+  constexpr unsigned numThreads = 2;
+  std::vector<std::thread> threads;
+  std::vector<std::unique_ptr<ExecutionSession>> sessions;
+  for (unsigned t = 0; t < numThreads; t++) {
+    for (unsigned i = 0; i < numModels; i++) {
+      sessions.push_back(EEs[i].createSession());
+    }
+  }
+  for (unsigned t = 0; t < numThreads; t++) {
+    threads.emplace_back([&, t]() {
+      ActivationArena threadArena;
+      for (unsigned i = 0; i < numModels; i++) {
+        sessions[t * numModels + i]->setActivationArena(&threadArena);
+      }
+      for (unsigned iter = 0; iter < 10; iter++) {
+        for (unsigned i = 0; i < numModels; i++) {
+          EEs[i].run(*sessions[t * numModels + i], {inputs[i]}, {&in});
+        }
+      }
+      // The sessions must not use the arena after it is gone.
+      for (unsigned i = 0; i < numModels; i++) {
+        sessions[t * numModels + i]->setActivationArena(nullptr);
+      }
+    });
+  }
+  for (auto &thread : threads) {
+    thread.join();
+  }
+  for (unsigned t = 0; t < numThreads; t++) {
+    for (unsigned i = 0; i < numModels; i++) {
+      EXPECT_TRUE(sessions[t * numModels + i]
+                      ->getTensor(results[i])
+                      .isEqual(expected[i]));
+    }
+  }
+}
+
+TEST(JITCorrectnessTest, bindInputOutput) {
+  ExecutionEngine EE(BackendKind::CPU);
+  Variable *input, *output;
+  std::tie(input, output) = compileFCReluNet(EE);
+
+  Tensor in(ElemKind::FloatTy, {4, 32});
+  in.getHandle().randomize(-1.0, 1.0);
+  EE.run({input}, {&in});
+  Tensor expected;
+  expected.copyFrom(&output->getPayload());
+
+  // The code reads and writes the bound tensors in place.
+  Tensor boundIn(ElemKind::FloatTy, {4, 32});
+  Tensor boundOut(ElemKind::FloatTy, {4, 16});
+  EE.bind(input, &boundIn);
+  EE.bind(output, &boundOut);
+  boundIn.copyFrom(&in);
+  EE.run({input}, {&boundIn});
+  EXPECT_TRUE(boundOut.isEqual(expected));
+
+  // Unbinding keeps the last values.
+  EE.bind(output, nullptr);
+  EXPECT_TRUE(output->getPayload().isEqual(expected));
+  EXPECT_NE(output->getPayload().getUnsafePtr(), boundOut.getUnsafePtr());
+
+  auto session = EE.createSession();
+  Tensor sessionOut(ElemKind::FloatTy, {4, 16});
+  session->bind(input, &boundIn);
+  session->bind(output, &sessionOut);
+  EE.run(*session, {input}, {&boundIn});
+  EXPECT_TRUE(sessionOut.isEqual(expected));
+  EXPECT_EQ(&session->getTensor(output), &sessionOut);
+}
+
+TEST(JITCorrectnessTest, runAsync) {
+  ExecutionEngine EE(BackendKind::CPU);
+  Variable *input, *output;
+  std::tie(input, output) = compileFCReluNet(EE);
+
+  constexpr unsigned numRequests = 8;
+  std::vector<Tensor> inputs;
+  std::vector<Tensor> expected(numRequests);
+  for (unsigned i = 0; i < numRequests; i++) {
+    inputs.emplace_back(ElemKind::FloatTy, std::vector<size_t>{4, 32});
+    inputs[i].getHandle().randomize(-1.0, 1.0);
+    EE.run({input}, {&inputs[i]});
+    expected[i].copyFrom(&output->getPayload());
+  }
+
+  // All of the requests are in flight at once.
+  std::vector<std::unique_ptr<ExecutionSession>> sessions;
+  std::vector<std::future<void>> futures;
+  std::atomic<unsigned> numDone{0};
+  for (unsigned i = 0; i < numRequests; i++) {
+    sessions.push_back(EE.createSession());
+    futures.push_back(EE.runAsync(*sessions[i], {input}, {&inputs[i]},
+                                  [&]() { numDone++; }));
+  }
+  for (unsigned i = 0; i < numRequests; i++) {
+    futures[i].wait();
+    EXPECT_TRUE(sessions[i]->getTensor(output).isEqual(expected[i]));
+  }
+  EXPECT_EQ(numDone, numRequests);
+}
+
+/// Check that the requests of models with different priorities and core
+/// quotas that share a ModelExecutor compute the same results as the runs of
+/// their engines.
+TEST(JITCorrectnessTest, modelExecutor) {
+  constexpr unsigned numModels = 2;
+  constexpr unsigned numRequests = 12;
+  std::vector<std::unique_ptr<ExecutionEngine>> engines;
+  std::vector<Variable *> inputVars, outputVars;
+  std::vector<std::vector<Tensor>> inputs(numModels), expected(numModels);
+  for (unsigned m = 0; m < numModels; m++) {
+    engines.emplace_back(new ExecutionEngine(BackendKind::CPU));
+    auto &EE = *engines.back();
+    auto &mod = EE.getModule();
+    Function *F = mod.createFunction("main");
+    auto *input = mod.createVariable(ElemKind::FloatTy, {4, 32}, "input",
+                                     VisibilityKind::Public,
+                                     Variable::TrainKind::None);
+    auto *fc1 = F->createFullyConnected("fc1", input, 64);
+    auto *tanh = F->createTanh("tanh", fc1);
+    auto *fc2 = F->createFullyConnected("fc2", tanh, 16 * (m + 1));
+    auto *result = F->createSave("ret", fc2);
+    EE.compile(CompilationMode::Infer, F);
+    inputVars.push_back(input);
+    outputVars.push_back(result->getVariable());
+    for (unsigned r = 0; r < numRequests; r++) {
+      inputs[m].emplace_back(ElemKind::FloatTy, std::vector<size_t>{4, 32});
+      inputs[m][r].getHandle().randomize(-1.0, 1.0);
+      EE.run({input}, {&inputs[m][r]});
+      expected[m].emplace_back(result->getVariable()->getPayload().clone());
+    }
+  }
+
+  // The batch model may run two requests at once, and the latency-critical
+  // model preempts them.
+  ModelExecutor executor(3);
+  ModelQoS batchQoS;
+  batchQoS.coreQuota = 2;
+  ModelQoS criticalQoS;
+  criticalQoS.priority = 1;
+  criticalQoS.coresPerRequest = 3;
+  unsigned models[numModels] = {executor.addModel(*engines[0], batchQoS),
+                                executor.addModel(*engines[1], criticalQoS)};
+
+  std::vector<std::vector<Tensor>> results(numModels);
+  std::vector<std::future<void>> futures;
+  std::atomic<unsigned> numDone{0};
+  for (unsigned m = 0; m < numModels; m++) {
+    results[m].resize(numRequests);
+  }
+  for (unsigned r = 0; r < numRequests; r++) {
+    for (unsigned m = 0; m < numModels; m++) {
+      futures.push_back(executor.submit(
+          models[m], {inputVars[m]}, {&inputs[m][r]}, {outputVars[m]},
+          {&results[m][r]}, [&]() { numDone++; }));
+    }
+  }
+  for (auto &future : futures) {
+    future.wait();
+  }
+  EXPECT_EQ(numDone, numModels * numRequests);
+  for (unsigned m = 0; m < numModels; m++) {
+    for (unsigned r = 0; r < numRequests; r++) {
+      EXPECT_TRUE(results[m][r].isEqual(expected[m][r]));
+    }
+  }
+  EXPECT_EQ(executor.getNumPreemptions(models[1]), size_t(0));
+}
+
+TEST(JITCorrectnessTest, setBatchSize) {
+  ExecutionEngine EE(BackendKind::CPU);
+  auto &mod = EE.getModule();
+  Function *F = mod.createFunction("main");
+  auto *input = mod.createVariable(ElemKind::FloatTy, {8, 6, 6, 3}, "input",
+                                   VisibilityKind::Public,
+                                   Variable::TrainKind::None);
+  auto *conv = F->createConv("conv", input, 8, 3, 1, 1, 1);
+  auto *relu = F->createRELU("relu", conv);
+  auto *pool = F->createPoolMax("pool", relu, 2, 2, 0);
+  auto *fc = F->createFullyConnected("fc", pool, 10);
+  auto *tanh = F->createTanh("tanh", fc);
+  auto *result = F->createSave("ret", tanh);
+  auto *output = result->getVariable();
+  EE.compile(CompilationMode::Infer, F);
+
+  Tensor in(ElemKind::FloatTy, {8, 6, 6, 3});
+  in.getHandle().randomize(-1.0, 1.0);
+  EE.run({input}, {&in});
+  Tensor expected;
+  expected.copyFrom(&output->getPayload());
+
+  // The samples past the batch size don't affect the first ones. With
+  // -cpu-dynamic-batch only the first samples are computed.
+  constexpr size_t batchSize = 3;
+  auto inH = in.getHandle();
+  for (size_t i = batchSize * 6 * 6 * 3, e = inH.size(); i < e; i++) {
+    inH.raw(i) = 0;
+  }
+  EE.setBatchSize(batchSize);
+  EE.run({input}, {&in});
+  auto outH = output->getPayload().getHandle();
+  auto expectedH = expected.getHandle();
+  for (size_t i = 0; i < batchSize * 10; i++) {
+    EXPECT_NEAR(outH.raw(i), expectedH.raw(i), 1E-5);
+  }
+
+  // The sessions have their own batch sizes.
+  EE.setBatchSize(8);
+  auto session = EE.createSession();
+  session->setBatchSize(batchSize);
+  EE.run(*session, {input}, {&in});
+  auto sessionH = session->getTensor(output).getHandle();
+  for (size_t i = 0; i < batchSize * 10; i++) {
+    EXPECT_NEAR(sessionH.raw(i), expectedH.raw(i), 1E-5);
+  }
+}
+
+/// Check that the inputs and outputs bound to a shared memory segment are
+/// read and written in place through another mapping of the segment, as a
+/// frontend process would.
+TEST(JITCorrectnessTest, sharedMemoryIO) {
+  ExecutionEngine EE(BackendKind::CPU);
+  auto &mod = EE.getModule();
+  Function *F = mod.createFunction("main");
+  auto *input = mod.createVariable(ElemKind::FloatTy, {4, 32}, "input",
+                                   VisibilityKind::Public,
+                                   Variable::TrainKind::None);
+  auto *fc = F->createFullyConnected("fc", input, 16);
+  auto *result = F->createSave("ret", fc);
+  auto *output = result->getVariable();
+  EE.compile(CompilationMode::Infer, F);
+
+  Tensor in(ElemKind::FloatTy, {4, 32});
+  in.getHandle().randomize(-1.0, 1.0);
+  EE.run({input}, {&in});
+  Tensor expected;
+  expected.copyFrom(&output->getPayload());
+
+  std::string name = "/glow-test-io-" + std::to_string(getpid());
+  auto worker = SharedMemory::create(name, EE.getIOSize());
+  ASSERT_TRUE(worker);
+  auto frontend = SharedMemory::open(name);
+  ASSERT_TRUE(frontend);
+  EE.bindIO(worker->getData(), worker->getSize());
+
+  auto layout = EE.getIOLayout();
+  ASSERT_EQ(layout.size(), 2);
+  char *memory = static_cast<char *>(frontend->getData());
+  for (const auto &slot : layout) {
+    EXPECT_EQ(slot.offset % TensorAlignment, 0);
+    if (slot.var == input) {
+      memcpy(memory + slot.offset, in.getUnsafePtr(),
+             in.getType().getSizeInBytes());
+    }
+  }
+  EE.run({}, {});
+  for (const auto &slot : layout) {
+    if (slot.var == output) {
+      Tensor out(memory + slot.offset, output->getType());
+      EXPECT_TRUE(out.isEqual(expected));
+    }
+  }
+  EE.bindIO(nullptr, 0);
+  EXPECT_TRUE(output->getPayload().isEqual(expected));
+}
+
+TEST(JITCorrectnessTest, saveAndLoadCompiled) {
+  ExecutionEngine EE(BackendKind::CPU);
+  auto &mod = EE.getModule();
+  Function *F = mod.createFunction("main");
+  auto *input = mod.createVariable(ElemKind::FloatTy, {4, 8, 8, 4}, "input",
+                                   VisibilityKind::Public,
+                                   Variable::TrainKind::None);
+  auto *conv = F->createConv("conv", input, 16, 3, 1, 1, 1);
+  auto *relu = F->createRELU("relu", conv);
+  auto *fc = F->createFullyConnected("fc", relu, 128);
+  auto *result = F->createSave("ret", fc);
+
+  llvm::SmallString<64> path;
+  llvm::sys::fs::createTemporaryFile("compiled", "glow", path);
+  EE.saveCompiled(F, path);
+  Tensor in(ElemKind::FloatTy, {4, 8, 8, 4});
+  in.getHandle().randomize(-1.0, 1.0);
+  EE.run({input}, {&in});
+  Tensor expected;
+  expected.copyFrom(&result->getVariable()->getPayload());
+
+  // The loaded code runs on the variables of a module of its own.
+  ExecutionEngine loadedEE(BackendKind::CPU);
+  loadedEE.loadCompiled(path);
+  llvm::sys::fs::remove(path);
+  auto &loadedMod = loadedEE.getModule();
+  auto *loadedInput = loadedMod.getVariableByName("input");
+  auto *loadedOutput =
+      loadedMod.getVariableByName(result->getVariable()->getName());
+  ASSERT_TRUE(loadedInput && loadedOutput);
+  EXPECT_TRUE(loadedInput->getType()->isEqual(input->getType()));
+  loadedEE.run({loadedInput}, {&in});
+  EXPECT_TRUE(loadedOutput->getPayload().isEqual(expected));
+
+  auto session = loadedEE.createSession();
+  loadedEE.run(*session, {loadedInput}, {&in});
+  EXPECT_TRUE(session->getTensor(loadedOutput).isEqual(expected));
+}
+
+TEST(JITCorrectnessTest, partitionedNet) {
+  ExecutionEngine EE;
+  auto &mod = EE.getModule();
+  Function *F = mod.createFunction("main");
+  auto *input = mod.createVariable(ElemKind::FloatTy, {8, 64}, "input",
+                                   VisibilityKind::Public,
+                                   Variable::TrainKind::None);
+  auto *fc1 = F->createFullyConnected("fc1", input, 64);
+  // The CPU backend doesn't support float16, so these nodes run on the
+  // Interpreter.
+  auto *toHalf = F->createConvertTo("toHalf", fc1, ElemKind::Float16Ty);
+  auto *relu = F->createRELU("relu", toHalf);
+  auto *toFloat = F->createConvertTo("toFloat", relu, ElemKind::FloatTy);
+  auto *fc2 = F->createFullyConnected("fc2", toFloat, 32);
+  auto *result = F->createSave("ret", fc2);
+  auto *output = result->getVariable();
+
+  Tensor in(ElemKind::FloatTy, {8, 64});
+  in.getHandle().randomize(-1.0, 1.0);
+  EE.compile(CompilationMode::Infer, F);
+  EE.run({input}, {&in});
+  Tensor expected;
+  expected.copyFrom(&output->getPayload());
+
+  EE.compile(CompilationMode::Infer, F,
+             {BackendKind::CPU, BackendKind::Interpreter});
+  EXPECT_EQ(EE.getNumPartitions(), 3);
+  EE.run({input}, {&in});
+  EXPECT_TRUE(output->getPayload().isEqual(expected));
+}
+
+TEST(JITCorrectnessTest, partitionSmallRuns) {
+  ExecutionEngine EE;
+  auto &mod = EE.getModule();
+  Function *F = mod.createFunction("main");
+  auto *input = mod.createVariable(ElemKind::FloatTy, {2, 4}, "input",
+                                   VisibilityKind::Public,
+                                   Variable::TrainKind::None);
+  auto *tanh = F->createTanh("tanh", input);
+  auto *toHalf = F->createConvertTo("toHalf", tanh, ElemKind::Float16Ty);
+  auto *relu = F->createRELU("relu", toHalf);
+  auto *toFloat = F->createConvertTo("toFloat", relu, ElemKind::FloatTy);
+  auto *sigmoid = F->createSigmoid("sigmoid", toFloat);
+  F->createSave("ret", sigmoid);
+
+  // The float nodes don't compute enough to pay for the transfers to the
+  // CPU backend, so everything runs on the Interpreter.
+  EE.compile(CompilationMode::Infer, F,
+             {BackendKind::CPU, BackendKind::Interpreter});
+  EXPECT_EQ(EE.getNumPartitions(), 1);
+}
+
+TEST(JITCorrectnessTest, pipelinedNet) {
+  ExecutionEngine EE(BackendKind::CPU);
+  auto &mod = EE.getModule();
+  Function *F = mod.createFunction("main");
+  auto *input = mod.createVariable(ElemKind::FloatTy, {4, 32}, "input",
+                                   VisibilityKind::Public,
+                                   Variable::TrainKind::None);
+  auto *fc1 = F->createFullyConnected("fc1", input, 32);
+  auto *tanh = F->createTanh("tanh", fc1);
+  auto *fc2 = F->createFullyConnected("fc2", tanh, 32);
+  auto *sigmoid = F->createSigmoid("sigmoid", fc2);
+  auto *fc3 = F->createFullyConnected("fc3", sigmoid, 16);
+  auto *output = F->createSave("ret", fc3)->getVariable();
+
+  constexpr size_t numRequests = 7;
+  std::vector<Tensor> in(numRequests);
+  std::vector<Tensor> expected(numRequests);
+  EE.compile(CompilationMode::Infer, F);
+  for (size_t r = 0; r < numRequests; r++) {
+    in[r].reset(ElemKind::FloatTy, {4, 32});
+    in[r].getHandle().randomize(-1.0, 1.0);
+    EE.run({input}, {&in[r]});
+    expected[r].copyFrom(&output->getPayload());
+  }
+
+  EE.compilePipeline(CompilationMode::Infer, F, 3);
+  EXPECT_EQ(EE.getNumPartitions(), 3);
+  std::vector<Tensor> out(numRequests);
+  std::vector<std::vector<Tensor *>> inputs, results;
+  for (size_t r = 0; r < numRequests; r++) {
+    inputs.push_back({&in[r]});
+    results.push_back({&out[r]});
+  }
+  EE.runPipeline({input}, inputs, {output}, results);
+  for (size_t r = 0; r < numRequests; r++) {
+    EXPECT_TRUE(out[r].isEqual(expected[r]));
+  }
+}
+
+TEST(JITCorrectnessTest, traceTimeline) {
+  ExecutionEngine EE(BackendKind::CPU);
+  auto &mod = EE.getModule();
+  Function *F = mod.createFunction("main");
+  auto *input = mod.createVariable(ElemKind::FloatTy, {2, 8, 8, 4}, "input",
+                                   VisibilityKind::Public,
+                                   Variable::TrainKind::None);
+  auto *conv = F->createConv("conv", input, 8, 3, 1, 1, 1);
+  auto *relu = F->createRELU("relu", conv);
+  auto *fc = F->createFullyConnected("fc", relu, 16);
+  F->createSave("ret", fc);
+
+  // The kernels are traced if the code is compiled while tracing.
+  enableTrace(true);
+  clearTrace();
+  EE.compile(CompilationMode::Infer, F);
+  Tensor in(ElemKind::FloatTy, {2, 8, 8, 4});
+  in.getHandle().randomize(-1.0, 1.0);
+  EE.run({input}, {&in});
+  EE.run({input}, {&in});
+  enableTrace(false);
+
+  llvm::SmallString<64> path;
+  llvm::sys::fs::createTemporaryFile("trace", "json", path);
+  ASSERT_TRUE(writeTrace(path));
+  clearTrace();
+  auto file = llvm::MemoryBuffer::getFile(path);
+  llvm::sys::fs::remove(path);
+  ASSERT_TRUE(bool(file));
+  llvm::StringRef trace = (*file)->getBuffer();
+  EXPECT_TRUE(trace.startswith("{"));
+  EXPECT_NE(trace.find("\"traceEvents\""), llvm::StringRef::npos);
+  EXPECT_NE(trace.find("\"name\": \"optimize\""), llvm::StringRef::npos);
+  EXPECT_NE(trace.find("\"name\": \"LLVM opt\""), llvm::StringRef::npos);
+  EXPECT_EQ(trace.count("\"cat\": \"run\""), 2);
+  EXPECT_GE(trace.count("\"cat\": \"kernel\""), 2);
+}
+
+/// Create a small convolutional network in \p EE. \returns its input and
+/// its output variables.
+static std::pair<Variable *, Variable *> createWarmUpNet(ExecutionEngine &EE) {
+  auto &mod = EE.getModule();
+  Function *F = mod.createFunction("main");
+  auto *input = mod.createVariable(ElemKind::FloatTy, {4, 8, 8, 4}, "input",
+                                   VisibilityKind::Public,
+                                   Variable::TrainKind::None);
+  auto *conv = F->createConv("conv", input, 16, 3, 1, 1, 1);
+  auto *relu = F->createRELU("relu", conv);
+  auto *fc = F->createFullyConnected("fc", relu, 32);
+  auto *result = F->createSave("ret", fc);
+  return {input, result->getVariable()};
+}
+
+TEST(JITCorrectnessTest, warmUp) {
+  seedRandStream(1);
+  ExecutionEngine coldEE(BackendKind::CPU);
+  auto cold = createWarmUpNet(coldEE);
+  coldEE.compile(CompilationMode::Infer,
+                 coldEE.getModule().getFunction("main"));
+  EXPECT_EQ(coldEE.getWarmUpReport().coldSeconds, 0);
+
+  // The same weights, warmed up.
+  seedRandStream(1);
+  ExecutionEngine warmEE(BackendKind::CPU);
+  auto warm = createWarmUpNet(warmEE);
+  warmEE.setWarmUp(/* prefault */ true, /* numRuns */ 3);
+  warmEE.compile(CompilationMode::Infer,
+                 warmEE.getModule().getFunction("main"));
+  EXPECT_GT(warmEE.getWarmUpReport().coldSeconds, 0);
+  EXPECT_GT(warmEE.getWarmUpReport().warmSeconds, 0);
+
+  // The warm-up doesn't change the results.
+  Tensor in(ElemKind::FloatTy, {4, 8, 8, 4});
+  in.getHandle().randomize(-1.0, 1.0);
+  coldEE.run({cold.first}, {&in});
+  warmEE.run({warm.first}, {&in});
+  EXPECT_TRUE(warm.second->getPayload().isEqual(cold.second->getPayload(), 0));
+}
+
+/// \returns true if the tests run with the -cpu-tiered-jit option of the CPU
+/// backend.
+static bool isTieredJIT() {
+  auto &options = llvm::cl::getRegisteredOptions();
+  auto it = options.find("cpu-tiered-jit");
+  return it != options.end() &&
+         static_cast<llvm::cl::opt<bool> *>(it->second)->getValue();
+}
+
+/// With the tiered JIT the quick code runs until the optimized code replaces
+/// it, and both compute the same results.
+TEST(JITCorrectnessTest, tieredCode) {
+  seedRandStream(1);
+  ExecutionEngine EE(BackendKind::CPU);
+  auto net = createWarmUpNet(EE);
+  enableTrace(true);
+  clearTrace();
+  EE.compile(CompilationMode::Infer, EE.getModule().getFunction("main"));
+  Tensor in(ElemKind::FloatTy, {4, 8, 8, 4});
+  in.getHandle().randomize(-1.0, 1.0);
+  EE.run({net.first}, {&in});
+  Tensor first = net.second->getPayload().clone();
+
+  EXPECT_EQ(EE.waitForOptimizedCode(), isTieredJIT());
+  EE.run({net.first}, {&in});
+  enableTrace(false);
+  EXPECT_TRUE(net.second->getPayload().isEqual(first));
+
+  // The optimized code was compiled once, in the background.
+  llvm::SmallString<64> path;
+  llvm::sys::fs::createTemporaryFile("trace", "json", path);
+  ASSERT_TRUE(writeTrace(path));
+  clearTrace();
+  auto file = llvm::MemoryBuffer::getFile(path);
+  llvm::sys::fs::remove(path);
+  ASSERT_TRUE(bool(file));
+  EXPECT_EQ((*file)->getBuffer().count("\"name\": \"JIT optimized code\""),
+            isTieredJIT() ? 1 : 0);
+}
+
+/// The backend doesn't support float16, so the conversion leaves the net in
+/// float. The float16 nodes only run on the Interpreter.
+TEST(JITCorrectnessTest, convertToFloat16) {
+  Tensor inputs(ElemKind::FloatTy, {4, 16});
+  Tensor weights(ElemKind::FloatTy, {16, 8});
+  Tensor bias(ElemKind::FloatTy, {8});
+  inputs.getHandle().randomize(-1, 1);
+  weights.getHandle().randomize(-1, 1);
+  bias.getHandle().randomize(-1, 1);
+  Tensor out1;
+  Tensor out2;
+  EXPECT_EQ(inferFloat16FCNet(&inputs, &weights, &bias, &out1,
+                              BackendKind::CPU),
+            0);
+  EXPECT_GT(inferFloat16FCNet(&inputs, &weights, &bias, &out2,
+                              BackendKind::Interpreter),
+            0);
+  EXPECT_TRUE(out1.isEqual(out2, 0.02));
+}
@@ -26,6 +26,7 @@
 
 #include <cassert>
 #include <string>
+#include <vector>
 
 using namespace glow;
 using llvm::cast;
@@ -54,6 +55,132 @@ TEST(OpenCLCorrectnessTest, convOps) {
   EXPECT_TRUE(out1.isEqual(out2));
 }
 
+TEST(OpenCLCorrectnessTest, convTest) {
+  // The output pixels and channels don't divide into the tiles.
+  Tensor inputs(ElemKind::FloatTy, {2, 21, 17, 6});
+  Tensor kernel(ElemKind::FloatTy, {10, 5, 5, 6});
+  Tensor bias(ElemKind::FloatTy, {10});
+  inputs.getHandle().initXavier(1);
+  kernel.getHandle().randomize(-3.0, 3.0);
+  bias.getHandle().randomize(-0.5, 0.5);
+  std::array<size_t, 4> S{{2, 9, 7, 10}};
+  llvm::ArrayRef<size_t> shape(S);
+  Tensor out1(ElemKind::FloatTy, shape);
+  Tensor out2(ElemKind::FloatTy, shape);
+
+  inferConvNet(&inputs, &kernel, &bias, &out1, BackendKind::OpenCL);
+  inferConvNet(&inputs, &kernel, &bias, &out2, BackendKind::Interpreter);
+
+  EXPECT_TRUE(out1.isEqual(out2));
+}
+
+TEST(OpenCLCorrectnessTest, matMulTest) {
+  // None of the dimensions divide into the tiles.
+  Tensor lhs(ElemKind::FloatTy, {37, 29});
+  Tensor rhs(ElemKind::FloatTy, {29, 45});
+  lhs.getHandle().randomize(-7.2, 8.3);
+  rhs.getHandle().randomize(-6.3, 10.1);
+  std::array<size_t, 2> S{{37, 45}};
+  llvm::ArrayRef<size_t> shape(S);
+  Tensor out1(ElemKind::FloatTy, shape);
+  Tensor out2(ElemKind::FloatTy, shape);
+
+  inferMatMulNet(&lhs, &rhs, &out1, BackendKind::OpenCL);
+  inferMatMulNet(&lhs, &rhs, &out2, BackendKind::Interpreter);
+
+  EXPECT_TRUE(out1.isEqual(out2, 0.001));
+}
+
+TEST(OpenCLCorrectnessTest, poolAvgTest) {
+  Tensor inputs(ElemKind::FloatTy, {14, 12, 19, 7});
+  inputs.getHandle().initXavier(1);
+  Tensor out1;
+  Tensor out2;
+
+  inferPoolAvgNet(&inputs, &out1, BackendKind::OpenCL);
+  inferPoolAvgNet(&inputs, &out2, BackendKind::Interpreter);
+
+  EXPECT_TRUE(out1.isEqual(out2));
+}
+
+TEST(OpenCLCorrectnessTest, poolMaxTest) {
+  Tensor inputs(ElemKind::FloatTy, {5, 53, 71, 14});
+  inputs.getHandle().initXavier(1);
+  Tensor out1;
+  Tensor out2;
+
+  inferPoolMaxNet(&inputs, &out1, BackendKind::OpenCL);
+  inferPoolMaxNet(&inputs, &out2, BackendKind::Interpreter);
+
+  EXPECT_TRUE(out1.isEqual(out2));
+}
+
+TEST(OpenCLCorrectnessTest, quantizedMatMulTest) {
+  Tensor lhs(ElemKind::Int8QTy, {37, 29}, 2.7, 31);
+  Tensor rhs(ElemKind::Int8QTy, {29, 45}, 3.2, -12);
+  lhs.getHandle<int8_t>().randomize(-129, 128);
+  rhs.getHandle<int8_t>().randomize(-129, 128);
+  std::array<size_t, 2> S{{37, 45}};
+  llvm::ArrayRef<size_t> shape(S);
+  Tensor out1(ElemKind::Int8QTy, shape, 8.1, 7);
+  Tensor out2(ElemKind::Int8QTy, shape, 8.1, 7);
+
+  inferMatMulNet(&lhs, &rhs, &out1, BackendKind::OpenCL);
+  inferMatMulNet(&lhs, &rhs, &out2, BackendKind::Interpreter);
+
+  EXPECT_TRUE(out1.isEqual(out2));
+}
+
+TEST(OpenCLCorrectnessTest, quantizedConvTest) {
+  Tensor inputs(ElemKind::Int8QTy, {2, 21, 17, 6}, 0.025, -7);
+  Tensor kernel(ElemKind::Int8QTy, {10, 5, 5, 6}, 0.003, 3);
+  Tensor bias(ElemKind::Int8QTy, {10}, 0.5, -4);
+  inputs.getHandle<int8_t>().randomize(-129, 128);
+  kernel.getHandle<int8_t>().randomize(-129, 128);
+  bias.getHandle<int8_t>().randomize(-11, 8);
+  std::array<size_t, 4> S{{2, 9, 7, 10}};
+  llvm::ArrayRef<size_t> shape(S);
+  Tensor out1(ElemKind::Int8QTy, shape, 0.05, -17);
+  Tensor out2(ElemKind::Int8QTy, shape, 0.05, -17);
+
+  inferConvNet(&inputs, &kernel, &bias, &out1, BackendKind::OpenCL);
+  inferConvNet(&inputs, &kernel, &bias, &out2, BackendKind::Interpreter);
+
+  EXPECT_TRUE(out1.isEqual(out2, 1.0));
+}
+
+TEST(OpenCLCorrectnessTest, quantizedBatchedAddTest) {
+  std::array<size_t, 4> S{{10, 1, 1, 2}};
+  llvm::ArrayRef<size_t> shape(S);
+  Tensor batch(ElemKind::Int8QTy, shape, 0.875, -1);
+  Tensor slice(ElemKind::Int8QTy, {1, 1, 2}, 1.4, 5);
+  batch.getHandle<int8_t>().randomize(-129, 128);
+  slice.getHandle<int8_t>().randomize(-129, 128);
+  Tensor out1(ElemKind::Int8QTy, shape, 0.375, -10);
+  Tensor out2(ElemKind::Int8QTy, shape, 0.375, -10);
+
+  inferBatchedAddNet(&batch, &slice, &out1, BackendKind::OpenCL);
+  inferBatchedAddNet(&batch, &slice, &out2, BackendKind::Interpreter);
+
+  EXPECT_TRUE(out1.isEqual(out2));
+}
+
+TEST(OpenCLCorrectnessTest, quantizeTest) {
+  std::array<size_t, 4> S{{6, 21, 17, 32}};
+  llvm::ArrayRef<size_t> shape(S);
+  Tensor inputs(ElemKind::FloatTy, shape);
+  inputs.getHandle().randomize(-10000.0, 5000.0);
+  float scale{4500.0 / 128};
+  int32_t offset{-2500};
+  Tensor out1(ElemKind::FloatTy, shape);
+  Tensor out2(ElemKind::FloatTy, shape);
+
+  inferQuantizeNet(&inputs, scale, offset, &out1, BackendKind::OpenCL);
+  inferQuantizeNet(&inputs, scale, offset, &out2, BackendKind::Interpreter);
+
+  EXPECT_TRUE(out1.isEqual(out2));
+}
+
 TEST(OpenCLCorrectnessTest, basicFCNet) {
   Tensor inputs(ElemKind::FloatTy, {2, 3, 16, 16});
   inputs.getHandle().initXavier(1);
@@ -103,6 +230,76 @@ TEST(OpenCLCorrectnessTest, softmaxGradTest) {
   EXPECT_TRUE(out1.isEqual(out2));
 }
 
+TEST(OpenCLCorrectnessTest, localResponseNormalizationTest) {
+  Tensor inputs(ElemKind::FloatTy, {8, 15, 13, 30});
+  inputs.getHandle().initXavier(1);
+  Tensor out1;
+  Tensor out2;
+
+  inferLocalResponseNormalizationNet(&inputs, &out1, BackendKind::OpenCL);
+  inferLocalResponseNormalizationNet(&inputs, &out2, BackendKind::Interpreter);
+
+  EXPECT_TRUE(out1.isEqual(out2));
+}
+
+TEST(OpenCLCorrectnessTest, localResponseNormalizationGradTest) {
+  Tensor inputs(ElemKind::FloatTy, {5, 4, 7, 3});
+  Tensor weights(ElemKind::FloatTy, {84, 180});
+  Tensor bias(ElemKind::FloatTy, {180});
+  Tensor selected(ElemKind::IndexTy, {5, 1});
+  inputs.getHandle().initXavier(1);
+  weights.getHandle().randomize(-2.0, 3.0);
+  bias.getHandle().randomize(-1.0, 1.3);
+  auto selectedH = selected.getHandle<size_t>();
+  for (size_t i = 0; i < 5; i++) {
+    selectedH.raw(i) = nextRandInt(0, 179);
+  }
+  std::array<size_t, 4> S1{{5, 2, 2, 45}};
+  llvm::ArrayRef<size_t> shape1(S1);
+  std::array<size_t, 2> S2{{5, 180}};
+  llvm::ArrayRef<size_t> shape2(S2);
+  Tensor out1(ElemKind::FloatTy, shape2);
+  Tensor out2(ElemKind::FloatTy, shape1);
+
+  trainLocalResponseNormalizationNet(&inputs, &weights, &bias, &selected,
+                                     shape1, shape2, &out1,
+                                     BackendKind::OpenCL);
+  trainLocalResponseNormalizationNet(&inputs, &weights, &bias, &selected,
+                                     shape1, shape2, &out2,
+                                     BackendKind::Interpreter);
+
+  EXPECT_TRUE(out1.isEqual(out2));
+}
+
+TEST(OpenCLCorrectnessTest, batchNormalizationTrainTest) {
+  Tensor inputs(ElemKind::FloatTy, {5, 4, 7, 3});
+  Tensor weights(ElemKind::FloatTy, {84, 180});
+  Tensor bias(ElemKind::FloatTy, {180});
+  Tensor selected(ElemKind::IndexTy, {5, 1});
+  inputs.getHandle().initXavier(1);
+  weights.getHandle().randomize(-2.0, 3.0);
+  bias.getHandle().randomize(-1.0, 1.3);
+  auto selectedH = selected.getHandle<size_t>();
+  for (size_t i = 0; i < 5; i++) {
+    selectedH.raw(i) = nextRandInt(0, 179);
+  }
+  std::array<size_t, 4> S1{{5, 4, 3, 15}};
+  llvm::ArrayRef<size_t> shape1(S1);
+  std::array<size_t, 2> S2{{5, 180}};
+  llvm::ArrayRef<size_t> shape2(S2);
+  Tensor out1(ElemKind::FloatTy, shape2);
+  Tensor out2(ElemKind::FloatTy, shape2);
+
+  // The OpenCL backend lowers the batch normalization, and the interpreter
+  // runs the fused kernels.
+  trainBatchNormalizationNet(&inputs, &weights, &bias, &selected, shape1,
+                             shape2, 3, &out1, BackendKind::OpenCL);
+  trainBatchNormalizationNet(&inputs, &weights, &bias, &selected, shape1,
+                             shape2, 3, &out2, BackendKind::Interpreter);
+
+  EXPECT_TRUE(out1.isEqual(out2, 0.001));
+}
+
 TEST(OpenCLCorrectnessTest, gatherTest) {
   constexpr size_t nSlices = 16;
   constexpr size_t nGathered = 8;
@@ -124,3 +321,81 @@ TEST(OpenCLCorrectnessTest, gatherTest) {
 
   EXPECT_TRUE(out1.isEqual(out2));
 }
+
+TEST(OpenCLCorrectnessTest, stateTest) {
+  Tensor inputs(ElemKind::FloatTy, {4, 16});
+  inputs.getHandle().initXavier(1);
+  Tensor out1;
+  Tensor out2;
+
+  inferStateNet(&inputs, &out1, BackendKind::OpenCL);
+  inferStateNet(&inputs, &out2, BackendKind::Interpreter);
+
+  EXPECT_TRUE(out1.isEqual(out2));
+}
+
+/// The chains of element-wise operations run as fused kernels, with vector
+/// instructions if the size is a multiple of 8, and with scalars otherwise.
+TEST(OpenCLCorrectnessTest, fusedElementwiseTest) {
+  for (auto dims : {std::vector<size_t>{4, 16}, std::vector<size_t>{3, 5}}) {
+    Tensor inputs1(ElemKind::FloatTy, dims);
+    Tensor inputs2(ElemKind::FloatTy, dims);
+    inputs1.getHandle().randomize(-1.0, 1.0);
+    inputs2.getHandle().randomize(-1.0, 1.0);
+    Tensor out1;
+    Tensor out2;
+
+    inferElementwiseNet(&inputs1, &inputs2, &out1, BackendKind::OpenCL);
+    inferElementwiseNet(&inputs1, &inputs2, &out2, BackendKind::Interpreter);
+
+    EXPECT_TRUE(out1.isEqual(out2, 0.0001));
+  }
+}
+
+/// The batch normalization of inference is lowered to a broadcast and a pow
+/// that the OpenCL backend has no kernels for, so the partitioner runs it on
+/// the Interpreter instead of failing to compile it for OpenCL.
+TEST(OpenCLCorrectnessTest, partitionBatchNormalization) {
+  ExecutionEngine EE;
+  auto &mod = EE.getModule();
+  Function *F = mod.createFunction("main");
+  auto *input = mod.createVariable(ElemKind::FloatTy, {2, 8, 8, 4}, "input",
+                                   VisibilityKind::Public,
+                                   Variable::TrainKind::None);
+  auto *BN = F->createBatchNormalization("batch", input, 3, 0.0001, 0.9);
+  auto *conv = F->createConv("conv", BN, 8, 3, 1, 1, 1);
+  auto *relu = F->createRELU("relu", conv);
+  auto *output = F->createSave("ret", relu)->getVariable();
+
+  Tensor in(ElemKind::FloatTy, {2, 8, 8, 4});
+  in.getHandle().randomize(-1.0, 1.0);
+  EE.compile(CompilationMode::Infer, F);
+  EE.run({input}, {&in});
+  Tensor expected;
+  expected.copyFrom(&output->getPayload());
+
+  EE.compile(CompilationMode::Infer, F,
+             {BackendKind::OpenCL, BackendKind::Interpreter});
+  EE.run({input}, {&in});
+  EXPECT_TRUE(output->getPayload().isEqual(expected, 0.001));
+}
+
+/// The backend doesn't support float16, so the conversion leaves the net in
+/// float. The float16 nodes only run on the Interpreter.
+TEST(OpenCLCorrectnessTest, convertToFloat16) {
+  Tensor inputs(ElemKind::FloatTy, {4, 16});
+  Tensor weights(ElemKind::FloatTy, {16, 8});
+  Tensor bias(ElemKind::FloatTy, {8});
+  inputs.getHandle().randomize(-1, 1);
+  weights.getHandle().randomize(-1, 1);
+  bias.getHandle().randomize(-1, 1);
+  Tensor out1;
+  Tensor out2;
+  EXPECT_EQ(inferFloat16FCNet(&inputs, &weights, &bias, &out1,
+                              BackendKind::OpenCL),
+            0);
+  EXPECT_GT(inferFloat16FCNet(&inputs, &weights, &bias, &out2,
+                              BackendKind::Interpreter),
+            0);
+  EXPECT_TRUE(out1.isEqual(out2, 0.02));
+}
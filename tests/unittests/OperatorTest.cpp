@@ -19,14 +19,19 @@
 #include "glow/IR/IR.h"
 #include "glow/IR/IRBuilder.h"
 #include "glow/IR/Instrs.h"
+#include "glow/Optimizer/Optimizer.h"
 #include "glow/Quantization/Quantization.h"
 
 #include "gtest/gtest.h"
 
 #include "llvm/Support/raw_ostream.h"
 
+#include <algorithm>
 #include <cassert>
+#include <cmath>
+#include <limits>
 #include <string>
+#include <vector>
 
 using namespace glow;
 
@@ -102,6 +107,145 @@ TEST_P(Operator, matmul) {
   EXPECT_NEAR(H.at({2, 0}), 95, 0.001);
 }
 
+TEST_P(Operator, transposedMatmul) {
+  // The operands of the matmul test stored transposed.
+  auto *lhs = mod_.createVariable(ElemKind::FloatTy, {2, 3}, "lhs");
+  auto *rhs = mod_.createVariable(ElemKind::FloatTy, {1, 2}, "rhs");
+  auto *result = mod_.createVariable(ElemKind::FloatTy, {3, 1}, "result");
+  lhs->getPayload().getHandle() = {1, 3, 5, 2, 4, 6};
+  rhs->getPayload().getHandle() = {7, 10};
+
+  auto R = F_->createMatMul("MM", lhs, rhs, /* transposeLHS */ true,
+                            /* transposeRHS */ true);
+
+  F_->createSave("save", R, result);
+
+  EE_.compile(CompilationMode::Infer, F_);
+  EE_.run({}, {});
+
+  auto H = result->getPayload().getHandle();
+  EXPECT_NEAR(H.at({0, 0}), 27, 0.001);
+  EXPECT_NEAR(H.at({1, 0}), 61, 0.001);
+  EXPECT_NEAR(H.at({2, 0}), 95, 0.001);
+}
+
+/// Check that the fully connected layers with mostly zero weights compute the
+/// same results with the weights in the sparse format.
+TEST_P(Operator, sparseFullyConnected) {
+  auto *input = mod_.createVariable(ElemKind::FloatTy, {2, 2, 4}, "input");
+  auto *weights = mod_.createVariable(ElemKind::FloatTy, {8, 3}, "weights");
+  auto *bias = mod_.createVariable(ElemKind::FloatTy, {3}, "bias");
+  auto *result = mod_.createVariable(ElemKind::FloatTy, {2, 3}, "result");
+  auto IH = input->getPayload().getHandle();
+  for (size_t i = 0; i < 16; i++) {
+    IH.raw(i) = i + 1;
+  }
+  // Only 3 of the 24 weights are nonzero, and the last column is empty.
+  auto WH = weights->getPayload().getHandle();
+  WH.clear(0);
+  WH.at({0, 0}) = 1;
+  WH.at({7, 0}) = -1;
+  WH.at({5, 1}) = 2;
+  bias->getPayload().getHandle() = {0.5, 1, 2};
+
+  auto *FC = F_->createFullyConnected("fc", input, weights, bias);
+  F_->createSave("save", FC, result);
+
+  EE_.compile(CompilationMode::Infer, F_);
+  if (EE_.isOpSupported(Kinded::Kind::SparseFullyConnectedNodeKind,
+                        ElemKind::FloatTy)) {
+    unsigned numSparse = 0;
+    for (auto *N : F_->getNodes()) {
+      numSparse += llvm::isa<SparseFullyConnectedNode>(N);
+    }
+    EXPECT_EQ(numSparse, 1);
+  }
+  EE_.run({}, {});
+
+  auto H = result->getPayload().getHandle();
+  EXPECT_NEAR(H.at({0, 0}), -6.5, 0.001);
+  EXPECT_NEAR(H.at({0, 1}), 13, 0.001);
+  EXPECT_NEAR(H.at({0, 2}), 2, 0.001);
+  EXPECT_NEAR(H.at({1, 0}), -6.5, 0.001);
+  EXPECT_NEAR(H.at({1, 1}), 29, 0.001);
+  EXPECT_NEAR(H.at({1, 2}), 2, 0.001);
+}
+
+TEST_P(Operator, sparseLengthsSum) {
+  auto *data = mod_.createVariable(ElemKind::FloatTy, {3, 2}, "data");
+  auto *indices = mod_.createVariable(ElemKind::IndexTy, {8}, "indices");
+  auto *lengths = mod_.createVariable(ElemKind::IndexTy, {5}, "lengths");
+  auto *result = mod_.createVariable(ElemKind::FloatTy, {5, 2}, "result");
+  data->getPayload().getHandle() = {1, 2, 3, 4, 5, 6};
+  indices->getPayload().getHandle<size_t>() = {2, 0, 1, 2, 0, 0, 0, 0};
+  // The second segment is empty.
+  lengths->getPayload().getHandle<size_t>() = {2, 0, 2, 1, 3};
+
+  auto *R = F_->createSparseLengthsSum("SLS", data, indices, lengths);
+  F_->createSave("save", R, result);
+
+  EE_.compile(CompilationMode::Infer, F_);
+  EE_.run({}, {});
+
+  Tensor expected(ElemKind::FloatTy, {5, 2});
+  expected.getHandle() = {6, 8, 0, 0, 8, 10, 1, 2, 3, 6};
+  EXPECT_TRUE(expected.isEqual(result->getPayload()));
+}
+
+TEST_P(Operator, rowwiseQuantizedSparseLengthsWeightedSum) {
+  auto *data = mod_.createVariable(ElemKind::Int8QTy, {3, 2}, 1.0, 0, "data");
+  auto *scales = mod_.createVariable(ElemKind::FloatTy, {3}, "scales");
+  auto *offsets =
+      mod_.createVariable(ElemKind::Int32QTy, {3}, 1.0, 0, "offsets");
+  auto *weights = mod_.createVariable(ElemKind::FloatTy, {4}, "weights");
+  auto *indices = mod_.createVariable(ElemKind::IndexTy, {4}, "indices");
+  auto *lengths = mod_.createVariable(ElemKind::IndexTy, {3}, "lengths");
+  auto *result = mod_.createVariable(ElemKind::FloatTy, {3, 2}, "result");
+  // The rows are {5, 10}, {-20, 0} and {1, 11}.
+  data->getPayload().getHandle<int8_t>() = {10, 20, -5, 5, 0, 100};
+  scales->getPayload().getHandle() = {0.5, 2, 0.1};
+  offsets->getPayload().getHandle<int32_t>() = {0, 5, -10};
+  weights->getPayload().getHandle() = {1, 2, 0.5, -1};
+  indices->getPayload().getHandle<size_t>() = {0, 2, 1, 1};
+  lengths->getPayload().getHandle<size_t>() = {2, 0, 2};
+
+  auto *R = F_->createRowwiseQuantizedSparseLengthsWeightedSum(
+      "RQSLWS", data, scales, offsets, weights, indices, lengths);
+  F_->createSave("save", R, result);
+
+  EE_.compile(CompilationMode::Infer, F_);
+  EE_.run({}, {});
+
+  Tensor expected(ElemKind::FloatTy, {3, 2});
+  expected.getHandle() = {7, 32, 0, 0, 10, 0};
+  EXPECT_TRUE(expected.isEqual(result->getPayload(), 0.001));
+}
+
+TEST_P(Operator, rowwiseQuantizedGather) {
+  auto *data = mod_.createVariable(ElemKind::Int8QTy, {3, 2}, 1.0, 0, "data");
+  auto *scales = mod_.createVariable(ElemKind::FloatTy, {3}, "scales");
+  auto *offsets =
+      mod_.createVariable(ElemKind::Int32QTy, {3}, 1.0, 0, "offsets");
+  auto *indices = mod_.createVariable(ElemKind::IndexTy, {2, 2}, "indices");
+  auto *result = mod_.createVariable(ElemKind::FloatTy, {2, 2, 2}, "result");
+  // The rows are {5, 10}, {-20, 0} and {1, 11}.
+  data->getPayload().getHandle<int8_t>() = {10, 20, -5, 5, 0, 100};
+  scales->getPayload().getHandle() = {0.5, 2, 0.1};
+  offsets->getPayload().getHandle<int32_t>() = {0, 5, -10};
+  indices->getPayload().getHandle<size_t>() = {2, 0, 1, 2};
+
+  auto *R = F_->createRowwiseQuantizedGather("RQG", data, scales, offsets,
+                                             indices);
+  F_->createSave("save", R, result);
+
+  EE_.compile(CompilationMode::Infer, F_);
+  EE_.run({}, {});
+
+  Tensor expected(ElemKind::FloatTy, {2, 2, 2});
+  expected.getHandle() = {1, 11, 5, 10, -20, 0, 1, 11};
+  EXPECT_TRUE(expected.isEqual(result->getPayload(), 0.001));
+}
+
 TEST_P(Operator, batchedReduceAdd) {
   auto *batch = mod_.createVariable(ElemKind::FloatTy, {2, 4}, "batch");
   auto *result = mod_.createVariable(ElemKind::FloatTy, {4}, "result");
@@ -155,6 +299,61 @@ TEST_P(Operator, batchedReduceAddQuantized) {
   }
 }
 
+/// Check the reductions over the strided middle axis, over the outer and
+/// the innermost axes at once, and over the innermost axis.
+TEST_P(Operator, reduceAxes) {
+  auto *input = mod_.createVariable(ElemKind::FloatTy, {2, 3, 4}, "input");
+  auto *sum = mod_.createVariable(ElemKind::FloatTy, {2, 4}, "sum");
+  auto *mean = mod_.createVariable(ElemKind::FloatTy, {3}, "mean");
+  auto *max = mod_.createVariable(ElemKind::FloatTy, {2, 3, 1}, "max");
+  auto IH = input->getPayload().getHandle();
+  for (size_t i = 0; i < IH.size(); i++) {
+    IH.raw(i) = float((i * 7) % 11) - 5;
+  }
+
+  auto *RS = F_->createReduce("reduce.sum", input, {1}, ReduceMode::Sum);
+  auto *RM = F_->createReduce("reduce.mean", input, {0, 2}, ReduceMode::Mean);
+  auto *RX = F_->createReduce("reduce.max", input, {2}, ReduceMode::Max,
+                              /* keepDims */ true);
+  F_->createSave("save.sum", RS, sum);
+  F_->createSave("save.mean", RM, mean);
+  F_->createSave("save.max", RX, max);
+
+  EE_.compile(CompilationMode::Infer, F_);
+  EE_.run({}, {});
+
+  auto SH = sum->getPayload().getHandle();
+  auto MH = mean->getPayload().getHandle();
+  auto XH = max->getPayload().getHandle();
+  for (size_t n = 0; n < 2; n++) {
+    for (size_t c = 0; c < 4; c++) {
+      float expected = 0;
+      for (size_t h = 0; h < 3; h++) {
+        expected += IH.at({n, h, c});
+      }
+      EXPECT_NEAR(SH.at({n, c}), expected, 0.001);
+    }
+  }
+  for (size_t h = 0; h < 3; h++) {
+    float expected = 0;
+    for (size_t n = 0; n < 2; n++) {
+      for (size_t c = 0; c < 4; c++) {
+        expected += IH.at({n, h, c}) / 8;
+      }
+    }
+    EXPECT_NEAR(MH.at({h}), expected, 0.001);
+  }
+  for (size_t n = 0; n < 2; n++) {
+    for (size_t h = 0; h < 3; h++) {
+      float expected = IH.at({n, h, 0});
+      for (size_t c = 1; c < 4; c++) {
+        expected = std::max(expected, IH.at({n, h, c}));
+      }
+      EXPECT_EQ(XH.at({n, h, 0}), expected);
+    }
+  }
+}
+
 TEST_P(Operator, batchedBatchedAdd) {
   auto *batch = mod_.createVariable(ElemKind::FloatTy, {2, 3, 3}, "batch");
   auto *added = mod_.createVariable(ElemKind::FloatTy, {3, 3}, "added");
@@ -366,6 +565,226 @@ TEST_P(Operator, TopK) {
   EXPECT_EQ(I.at({2, 0, 2}), 3);
 }
 
+TEST_P(Operator, tensorStats) {
+  auto *inp = mod_.createVariable(ElemKind::FloatTy, {2, 4}, "input",
+                                  VisibilityKind::Public,
+                                  Variable::TrainKind::None);
+  float inf = std::numeric_limits<float>::infinity();
+  inp->getPayload().getHandle() = {
+      0, 1, -2, std::numeric_limits<float>::quiet_NaN(), inf, 0, 3, -inf};
+
+  F_->createTensorStats("stats", inp);
+  EE_.compile(CompilationMode::Infer, F_);
+  EE_.run({}, {});
+  EE_.run({}, {});
+
+  auto stats = getTensorStats(F_);
+  ASSERT_EQ(stats.size(), 1);
+  EXPECT_EQ(stats[0].nodeName, "input");
+  EXPECT_EQ(stats[0].resNo, 0);
+  EXPECT_EQ(stats[0].runs, 2);
+  EXPECT_EQ(stats[0].elements, 16);
+  EXPECT_EQ(stats[0].nans, 2);
+  EXPECT_EQ(stats[0].infs, 4);
+  EXPECT_EQ(stats[0].zeros, 4);
+  EXPECT_FLOAT_EQ(stats[0].min, -2);
+  EXPECT_FLOAT_EQ(stats[0].max, 3);
+  EXPECT_DOUBLE_EQ(stats[0].getSparsity(), 0.25);
+}
+
+/// Compute the hidden states of an LSTM cell that runs over the first
+/// \p numSteps steps of \p gates with the hidden state projection \p Wh.
+static Tensor referenceLSTMSequence(Tensor &gates, Tensor &Wh,
+                                    size_t numSteps) {
+  size_t T = gates.dims()[0], B = gates.dims()[1], H = Wh.dims()[0];
+  Tensor out(ElemKind::FloatTy, {T, B, H});
+  out.zero();
+  auto GH = gates.getHandle();
+  auto WH = Wh.getHandle();
+  auto OH = out.getHandle();
+  auto sigmoid = [](float x) { return 1 / (1 + std::exp(-x)); };
+  std::vector<float> h(B * H, 0), c(B * H, 0), g(4 * H);
+  for (size_t t = 0; t < std::min(numSteps, T); t++) {
+    std::vector<float> prevH = h;
+    for (size_t b = 0; b < B; b++) {
+      for (size_t j = 0; j < 4 * H; j++) {
+        g[j] = GH.at({t, b, j});
+        for (size_t k = 0; k < H; k++) {
+          g[j] += prevH[b * H + k] * WH.at({k, j});
+        }
+      }
+      for (size_t j = 0; j < H; j++) {
+        float &cell = c[b * H + j];
+        cell = sigmoid(g[j]) * cell +
+               sigmoid(g[H + j]) * std::tanh(g[3 * H + j]);
+        h[b * H + j] = sigmoid(g[2 * H + j]) * std::tanh(cell);
+        OH.at({t, b, j}) = h[b * H + j];
+      }
+    }
+  }
+  return out;
+}
+
+TEST_P(Operator, LSTMSequence) {
+  constexpr size_t T = 5, B = 2, H = 3;
+  auto *gates = mod_.createVariable(ElemKind::FloatTy, {T, B, 4 * H}, "gates");
+  auto *Wh = mod_.createVariable(ElemKind::FloatTy, {H, 4 * H}, "Wh");
+  auto *numSteps = mod_.createVariable(ElemKind::IndexTy, {1}, "numSteps",
+                                       VisibilityKind::Public,
+                                       Variable::TrainKind::None);
+  auto *result = mod_.createVariable(ElemKind::FloatTy, {T, B, H}, "result");
+  gates->getPayload().getHandle().randomize(-1.0, 1.0);
+  Wh->getPayload().getHandle().randomize(-1.0, 1.0);
+
+  auto *LS = F_->createLSTMSequence("lstm", gates, Wh, numSteps);
+  F_->createSave("save", LS, result);
+  EE_.compile(CompilationMode::Infer, F_);
+
+  // The same code runs the shorter sequences, and the longer ones are cut to
+  // the steps that the buffers have room for.
+  for (size_t steps : {3, 0, 100}) {
+    Tensor stepsT(ElemKind::IndexTy, {1});
+    stepsT.getHandle<size_t>().raw(0) = steps;
+    EE_.run({numSteps}, {&stepsT});
+    Tensor expected =
+        referenceLSTMSequence(gates->getPayload(), Wh->getPayload(), steps);
+    EXPECT_TRUE(result->getPayload().isEqual(expected, 1e-5));
+  }
+}
+
+/// Train a fully connected layer on the backend \p kind for a few batches,
+/// with momentum and both decays, and \returns its weights. The weights are
+/// updated by the SGD instruction of the backend, or by the element-wise
+/// nodes that SGD is lowered to if \p lowerSGD is set.
+static Tensor trainWithSGD(BackendKind kind, bool lowerSGD) {
+  ExecutionEngine EE(kind);
+  auto &config = EE.getConfig();
+  config.learningRate = 0.1;
+  config.momentum = 0.9;
+  config.L1Decay = 0.001;
+  config.L2Decay = 0.01;
+  config.batchSize = 2;
+
+  auto &mod = EE.getModule();
+  Function *F = mod.createFunction("main");
+  auto *A = mod.createVariable(ElemKind::FloatTy, {2, 8}, "A",
+                               VisibilityKind::Public,
+                               Variable::TrainKind::None);
+  auto *E = mod.createVariable(ElemKind::FloatTy, {2, 4}, "E",
+                               VisibilityKind::Public,
+                               Variable::TrainKind::None);
+  auto *FC = F->createFullyConnected("fc", A, 4);
+  auto *R = F->createRegression("reg", FC, E);
+  F->createSave("ret", R);
+
+  // Both of the runs start from the same weights.
+  auto *W = llvm::cast<Variable>(FC->getWeights());
+  auto WH = W->getPayload().getHandle();
+  for (size_t i = 0, e = WH.size(); i < e; i++) {
+    WH.raw(i) = std::sin(float(i)) * 0.5;
+  }
+  llvm::cast<Variable>(FC->getBias())->getPayload().zero();
+
+  Function *TF = glow::differentiate(F, config);
+  if (lowerSGD) {
+    ::glow::lower(TF, CompilationMode::Train);
+  }
+  EE.compile(CompilationMode::Train, TF);
+
+  Tensor inputs(ElemKind::FloatTy, {4, 8});
+  Tensor expected(ElemKind::FloatTy, {4, 4});
+  auto IH = inputs.getHandle();
+  auto EH = expected.getHandle();
+  for (size_t i = 0, e = IH.size(); i < e; i++) {
+    IH.raw(i) = std::cos(float(i));
+  }
+  for (size_t i = 0, e = EH.size(); i < e; i++) {
+    EH.raw(i) = std::sin(float(3 * i));
+  }
+  EE.runBatch(10, {A, E}, {&inputs, &expected});
+
+  Tensor trained;
+  trained.copyFrom(&W->getPayload());
+  return trained;
+}
+
+TEST_P(Operator, fusedSGD) {
+  Tensor fused = trainWithSGD(GetParam(), false);
+  Tensor lowered = trainWithSGD(GetParam(), true);
+  Tensor initial = fused.clone();
+  auto H = initial.getHandle();
+  for (size_t i = 0, e = H.size(); i < e; i++) {
+    H.raw(i) = std::sin(float(i)) * 0.5;
+  }
+  // The weights were trained, and both of the updates agree.
+  EXPECT_FALSE(fused.isEqual(initial, 1e-2));
+  EXPECT_TRUE(fused.isEqual(lowered, 1e-5));
+}
+
+TEST_P(Operator, state) {
+  auto *inp = mod_.createVariable(ElemKind::FloatTy, {2, 2}, "input",
+                                  VisibilityKind::Public,
+                                  Variable::TrainKind::None);
+  inp->getPayload().getHandle() = {1, 2, 3, 4};
+  auto *state = mod_.createState(ElemKind::FloatTy, {2, 2}, "state");
+  auto *add = F_->createAdd("add", state, inp);
+  F_->createSave("update", add, state);
+  EE_.compile(CompilationMode::Infer, F_);
+
+  EE_.run({}, {});
+  EE_.run({}, {});
+  auto H = EE_.readState(state).getHandle();
+  EXPECT_EQ(H.at({0, 0}), 2);
+  EXPECT_EQ(H.at({1, 1}), 8);
+
+  // Both rows continue from the second one.
+  EE_.reorderState(state, {1, 1});
+  EE_.run({}, {});
+  H = EE_.readState(state).getHandle();
+  EXPECT_EQ(H.at({0, 0}), 7);
+  EXPECT_EQ(H.at({0, 1}), 10);
+  EXPECT_EQ(H.at({1, 0}), 9);
+  EXPECT_EQ(H.at({1, 1}), 12);
+
+  EE_.resetState(state);
+  EE_.run({}, {});
+  H = EE_.readState(state).getHandle();
+  EXPECT_EQ(H.at({0, 0}), 1);
+  EXPECT_EQ(H.at({1, 1}), 4);
+}
+
+TEST_P(Operator, entries) {
+  auto *inp = mod_.createVariable(ElemKind::FloatTy, {4}, "input",
+                                  VisibilityKind::Public,
+                                  Variable::TrainKind::None);
+  auto *relu = F_->createRELU("relu", inp);
+  auto *features = F_->createSave("features", relu);
+  auto *add = F_->createAdd("add", relu, relu);
+  auto *logits = F_->createSave("logits", add);
+  EE_.compileEntries(CompilationMode::Infer, F_, {{logits}, {features}});
+  ASSERT_EQ(EE_.getNumEntries(), 2);
+
+  // The first entry computes the logits only.
+  Tensor input(ElemKind::FloatTy, {4});
+  input.getHandle() = {-1, 1, -2, 2};
+  EE_.run(0, {inp}, {&input});
+  auto logitsH = logits->getVariable()->getHandle();
+  auto featuresH = features->getVariable()->getHandle();
+  EXPECT_EQ(logitsH.at({1}), 2);
+  EXPECT_EQ(logitsH.at({3}), 4);
+  EXPECT_EQ(featuresH.at({1}), 0);
+
+  EE_.run(1, {inp}, {&input});
+  EXPECT_EQ(featuresH.at({1}), 1);
+  EXPECT_EQ(featuresH.at({3}), 2);
+
+  // The whole function computes both.
+  input.getHandle() = {3, 1, -2, 2};
+  EE_.run({inp}, {&input});
+  EXPECT_EQ(logitsH.at({0}), 6);
+  EXPECT_EQ(featuresH.at({0}), 3);
+}
+
 TEST_P(Operator, QuantizedTopK) {
   auto *INV =
       mod_.createVariable(ElemKind::Int8QTy, {3, 1, 5}, 1.2, 5, "input");
@@ -411,6 +830,45 @@ TEST_P(Operator, QuantizedTopK) {
   EXPECT_EQ(IH.at({2, 0, 2}), 4);
 }
 
+/// Check the selection from rows that are much wider than K, with many equal
+/// values, against a full sort of each row.
+TEST_P(Operator, TopKWideRows) {
+  const size_t rows = 4, n = 1000, k = 7;
+  auto *inp = mod_.createVariable(ElemKind::FloatTy, {rows, n}, "input");
+  auto *values = mod_.createVariable(ElemKind::FloatTy, {rows, k}, "values");
+  auto *indices = mod_.createVariable(ElemKind::IndexTy, {rows, k}, "indices");
+
+  auto IH = inp->getPayload().getHandle();
+  for (size_t i = 0; i < rows * n; i++) {
+    IH.raw(i) = float((i * 7919) % 997 / 3);
+  }
+
+  auto R = F_->createTopK("TopK", inp, k);
+  F_->createSave("save.values", {R, 0}, values);
+  F_->createSave("save.indices", {R, 1}, indices);
+
+  EE_.compile(CompilationMode::Infer, F_);
+  EE_.run({}, {});
+
+  auto V = values->getPayload().getHandle();
+  auto I = indices->getPayload().getHandle<size_t>();
+  for (size_t r = 0; r < rows; r++) {
+    std::vector<std::pair<float, size_t>> row;
+    for (size_t i = 0; i < n; i++) {
+      row.push_back({IH.at({r, i}), i});
+    }
+    std::stable_sort(row.begin(), row.end(),
+                     [](const std::pair<float, size_t> &a,
+                        const std::pair<float, size_t> &b) {
+                       return a.first > b.first;
+                     });
+    for (size_t i = 0; i < k; i++) {
+      EXPECT_EQ(V.at({r, i}), row[i].first);
+      EXPECT_EQ(I.at({r, i}), row[i].second);
+    }
+  }
+}
+
 TEST_P(Operator, Gather) {
   /*
     DATA  = [
@@ -476,6 +934,39 @@ TEST_P(Operator, Gather) {
   EXPECT_FLOAT_EQ(H.at({1, 3, 1}), 1.2);
 }
 
+/// Select the rows of the largest elements with TopK and gather them, with
+/// 32-bit indices.
+TEST_P(Operator, GatherTopKIndex32) {
+  auto *inp = mod_.createVariable(ElemKind::FloatTy, {1, 5}, "input");
+  auto *data = mod_.createVariable(ElemKind::FloatTy, {5, 2}, "data");
+  auto *indices = mod_.createVariable(ElemKind::Int32ITy, {1, 3}, "indices");
+  auto *result = mod_.createVariable(ElemKind::FloatTy, {1, 3, 2}, "result");
+
+  inp->getPayload().getHandle() = {3, 9, 1, 7, 5};
+  data->getPayload().getHandle() = {0, 1, 2, 3, 4, 5, 6, 7, 8, 9};
+
+  auto *TK = F_->createTopK("TopK", inp, 3, ElemKind::Int32ITy);
+  F_->createSave("save.indices", {TK, 1}, indices);
+  auto *G = F_->createGather("gather", data, {TK, 1});
+  F_->createSave("save", G, result);
+
+  EE_.compile(CompilationMode::Infer, F_);
+  EE_.run({}, {});
+
+  auto IH = indices->getPayload().getHandle<int32_t>();
+  EXPECT_EQ(IH.at({0, 0}), 1);
+  EXPECT_EQ(IH.at({0, 1}), 3);
+  EXPECT_EQ(IH.at({0, 2}), 4);
+
+  auto H = result->getPayload().getHandle();
+  EXPECT_FLOAT_EQ(H.at({0, 0, 0}), 2);
+  EXPECT_FLOAT_EQ(H.at({0, 0, 1}), 3);
+  EXPECT_FLOAT_EQ(H.at({0, 1, 0}), 6);
+  EXPECT_FLOAT_EQ(H.at({0, 1, 1}), 7);
+  EXPECT_FLOAT_EQ(H.at({0, 2, 0}), 8);
+  EXPECT_FLOAT_EQ(H.at({0, 2, 1}), 9);
+}
+
 TEST_P(Operator, QuantizeAndDequantize) {
   Tensor inputs(ElemKind::FloatTy, {1, 4});
   inputs.getHandle() = {1, 1.2, 0.5, 1.3};
@@ -1404,6 +1895,49 @@ TEST_P(Operator, GroupConvolution) {
   EXPECT_FLOAT_EQ(result.at({0, 1, 0, 5}), (13 + 14 + 15 + 16) * 100000);
 }
 
+/// Check the depthwise convolution, where every channel is a group, at the
+/// borders of the padded input.
+TEST_P(Operator, DepthwiseConvolution) {
+  auto *input = mod_.createVariable(ElemKind::FloatTy, {1, 3, 3, 2}, "input");
+  auto IH = input->getHandle();
+  for (size_t x = 0; x < 3; x++) {
+    for (size_t y = 0; y < 3; y++) {
+      IH.at({0, x, y, 0}) = 1;
+      IH.at({0, x, y, 1}) = 2;
+    }
+  }
+
+  auto *filter = mod_.createVariable(ElemKind::FloatTy, {2, 3, 3, 1}, "filter");
+  auto FH = filter->getHandle();
+  for (size_t x = 0; x < 3; x++) {
+    for (size_t y = 0; y < 3; y++) {
+      FH.at({0, x, y, 0}) = 1;
+      FH.at({1, x, y, 0}) = 10;
+    }
+  }
+
+  auto *bias = mod_.createVariable(ElemKind::FloatTy, {2}, "bias");
+  bias->getHandle() = {0, 1};
+
+  auto outTy = mod_.uniqueType(ElemKind::FloatTy, {1, 3, 3, 2});
+  ConvolutionNode *CN =
+      F_->createConv("Conv", input, filter, bias, outTy, 3, 1, 1, 2);
+  SaveNode *S = F_->createSave("save", CN);
+
+  EE_.compile(CompilationMode::Infer, F_);
+  EE_.run({}, {});
+
+  // The number of the filter taps that are inside the input.
+  const float taps[3][3] = {{4, 6, 4}, {6, 9, 6}, {4, 6, 4}};
+  auto result = llvm::cast<Variable>(S->getOutput())->getPayload().getHandle();
+  for (size_t x = 0; x < 3; x++) {
+    for (size_t y = 0; y < 3; y++) {
+      EXPECT_FLOAT_EQ(result.at({0, x, y, 0}), taps[x][y]);
+      EXPECT_FLOAT_EQ(result.at({0, x, y, 1}), taps[x][y] * 20 + 1);
+    }
+  }
+}
+
 INSTANTIATE_TEST_CASE_P(Interpreter, InterpOnly,
                         ::testing::Values(BackendKind::Interpreter));
 
@@ -0,0 +1,127 @@
+/**
+ * Copyright (c) 2017-present, Facebook, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include "glow/Support/Parallel.h"
+
+#include "gtest/gtest.h"
+
+#include <atomic>
+#include <thread>
+#include <vector>
+
+namespace {
+/// Counts the runs of every task.
+struct Counts {
+  std::vector<std::atomic<unsigned>> runs;
+  explicit Counts(size_t numTasks) : runs(numTasks) {
+    for (auto &r : runs) {
+      r = 0;
+    }
+  }
+  bool ranOnce() const {
+    for (auto &r : runs) {
+      if (r != 1) {
+        return false;
+      }
+    }
+    return true;
+  }
+};
+
+void countTask(void *ctx, size_t task) {
+  static_cast<Counts *>(ctx)->runs[task]++;
+}
+
+/// Every task runs a nested loop of 50 tasks.
+void nestedTask(void *ctx, size_t task) {
+  Counts inner(50);
+  glow_parallel_for(50, GLOW_PARALLEL_MAX_THREADS, countTask, &inner);
+  if (inner.ranOnce()) {
+    countTask(ctx, task);
+  }
+}
+} // namespace
+
+TEST(Parallel, runsEveryTaskOnce) {
+  glow_parallel_set_num_threads(4);
+  for (size_t numTasks : {0, 1, 3, 4, 5, 1000}) {
+    for (size_t numThreads : {1, 2, 4, 64}) {
+      Counts counts(numTasks);
+      glow_parallel_for(numTasks, numThreads, countTask, &counts);
+      EXPECT_TRUE(counts.ranOnce());
+    }
+  }
+}
+
+TEST(Parallel, singleThreadRunsOnCaller) {
+  glow_parallel_set_num_threads(1);
+  EXPECT_EQ(glow_parallel_get_num_threads(), size_t(1));
+  using CallerCheck = std::pair<std::thread::id, std::atomic<bool>>;
+  CallerCheck data;
+  data.first = std::this_thread::get_id();
+  data.second = true;
+  auto check = [](void *ctx, size_t) {
+    auto *data = static_cast<CallerCheck *>(ctx);
+    if (std::this_thread::get_id() != data->first) {
+      data->second = false;
+    }
+  };
+  glow_parallel_for(100, 8, check, &data);
+  EXPECT_TRUE(data.second);
+}
+
+TEST(Parallel, nestedAndConcurrentCalls) {
+  // The nested loops and the loops of the other callers only get the idle
+  // workers, and run on their calling thread when there are none.
+  glow_parallel_set_num_threads(4);
+  glow_parallel_set_spin_count(0);
+  std::vector<std::thread> callers;
+  std::atomic<unsigned> numFailures{0};
+  for (unsigned c = 0; c < 3; c++) {
+    callers.emplace_back([&]() {
+      for (unsigned i = 0; i < 20; i++) {
+        Counts counts(8);
+        glow_parallel_for(8, 4, nestedTask, &counts);
+        if (!counts.ranOnce()) {
+          numFailures++;
+        }
+      }
+    });
+  }
+  for (auto &caller : callers) {
+    caller.join();
+  }
+  EXPECT_EQ(numFailures, 0u);
+  glow_parallel_set_spin_count(1 << 14);
+}
+
+TEST(Parallel, threadLimit) {
+  // A limit of one thread runs the tasks on the caller.
+  glow_parallel_set_num_threads(4);
+  glow_parallel_set_thread_limit(1);
+  using CallerCheck = std::pair<std::thread::id, std::atomic<bool>>;
+  CallerCheck data;
+  data.first = std::this_thread::get_id();
+  data.second = true;
+  auto check = [](void *ctx, size_t) {
+    auto *data = static_cast<CallerCheck *>(ctx);
+    if (std::this_thread::get_id() != data->first) {
+      data->second = false;
+    }
+  };
+  glow_parallel_for(100, 4, check, &data);
+  EXPECT_TRUE(data.second);
+  glow_parallel_set_thread_limit(0);
+}
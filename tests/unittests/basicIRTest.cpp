@@ -18,7 +18,9 @@
 
 #include "glow/IR/IR.h"
 #include "glow/IR/IRBuilder.h"
+#include "glow/IR/IRCost.h"
 #include "glow/IR/Instrs.h"
+#include "glow/IR/PerfModel.h"
 
 #include "llvm/Support/Casting.h"
 
@@ -145,6 +147,92 @@ TEST(IR, allInstrs) {
   M.verify();
 }
 
+TEST(IR, instrCost) {
+  Module mod;
+  Function *F = mod.createFunction("main");
+  IRFunction M(F);
+  {
+    IRBuilder bb(&M);
+
+    auto *input = bb.createWeightVar(ElemKind::FloatTy, {1, 24, 24, 3});
+    auto *filter = bb.createWeightVar(ElemKind::FloatTy, {64, 7, 7, 3});
+    auto *bias = bb.createWeightVar(ElemKind::FloatTy, {64});
+    auto *output = bb.createWeightVar(ElemKind::FloatTy, {1, 12, 12, 64});
+    auto *conv = bb.createConvolutionInst("conv", output, input, filter, bias,
+                                          7, 2, 3, 1);
+    // Every output element is a dot product of 7 * 7 * 3 elements.
+    EXPECT_EQ(getCost(conv).flops, 2 * 12 * 12 * 64 * 7 * 7 * 3);
+    EXPECT_EQ(getCost(conv).bytes,
+              4 * (12 * 12 * 64 + 24 * 24 * 3 + 64 * 7 * 7 * 3 + 64));
+
+    auto *lhs = bb.createWeightVar(ElemKind::FloatTy, {4, 6});
+    auto *rhs = bb.createWeightVar(ElemKind::FloatTy, {6, 5});
+    auto *res = bb.createWeightVar(ElemKind::FloatTy, {4, 5});
+    auto *matmul = bb.createMatMulInst("matmul", res, lhs, rhs, 0, 0);
+    EXPECT_EQ(getCost(matmul).flops, 2 * 4 * 5 * 6);
+    EXPECT_EQ(getCost(matmul).bytes, 4 * (4 * 6 + 6 * 5 + 4 * 5));
+
+    // The data movement performs no operations, and the views are free.
+    auto *copy = bb.createCopyInst("copy", lhs, lhs);
+    EXPECT_EQ(getCost(copy).flops, 0);
+    EXPECT_EQ(getCost(copy).bytes, 2 * 4 * 4 * 6);
+    auto *view = bb.createTensorView(ElemKind::FloatTy, {24}, lhs, "view");
+    EXPECT_EQ(getCost(view).bytes, 0);
+
+    auto total = getCost(&M);
+    EXPECT_EQ(total.flops, getCost(conv).flops + getCost(matmul).flops);
+    EXPECT_EQ(total.bytes, getCost(conv).bytes + getCost(matmul).bytes +
+                               getCost(copy).bytes);
+  }
+}
+
+TEST(IR, perfEstimate) {
+  Module mod;
+  Function *F = mod.createFunction("main");
+  IRFunction M(F);
+  {
+    IRBuilder bb(&M);
+
+    auto *lhs = bb.createWeightVar(ElemKind::FloatTy, {4, 6});
+    auto *rhs = bb.createWeightVar(ElemKind::FloatTy, {6, 5});
+    auto *res = bb.createWeightVar(ElemKind::FloatTy, {4, 5});
+    auto *act = bb.createAllocActivationInst("act", ElemKind::FloatTy, {4, 5});
+    bb.createMatMulInst("matmul", act, lhs, rhs, 0, 0);
+    bb.createCopyInst("copy", res, act);
+  }
+
+  // A device of 2 GFLOP/s and 1 GB/s of memory, whose caches are twice as
+  // fast.
+  DeviceInfo device;
+  device.cores = 1;
+  device.simdWidth = 1;
+  device.fmaPerCycle = 1;
+  device.clockGHz = 1;
+  device.memBandwidth = 1;
+  device.l2Bandwidth = 2;
+  device.llcBandwidth = 2;
+  auto estimate = estimatePerf(&M, device);
+  ASSERT_EQ(estimate.instrs.size(), 2);
+
+  // All the operands of the matrix multiplication come from the memory.
+  const auto &matmul = estimate.instrs[0];
+  EXPECT_EQ(matmul.memBytes, 4 * (4 * 5 + 4 * 6 + 6 * 5));
+  EXPECT_EQ(matmul.l2Bytes, 0);
+  EXPECT_NEAR(matmul.computeTime, 2 * 4 * 5 * 6 / 2e9, 1e-12);
+  EXPECT_NEAR(matmul.time, matmul.memBytes / 1e9, 1e-12);
+
+  // The copy reads the activation from the cache that the matrix
+  // multiplication wrote it into.
+  const auto &copy = estimate.instrs[1];
+  EXPECT_EQ(copy.memBytes, 4 * 4 * 5);
+  EXPECT_EQ(copy.l2Bytes, 4 * 4 * 5);
+  EXPECT_NEAR(copy.time, 80 / 1e9 + 80 / 2e9, 1e-12);
+
+  EXPECT_NEAR(estimate.time, matmul.time + copy.time, 1e-12);
+  EXPECT_EQ(estimate.weightsSize, 4 * (4 * 6 + 6 * 5 + 4 * 5));
+  EXPECT_EQ(estimate.activationsPeak, 4 * 4 * 5);
+}
+
 TEST(IR, casting) {
   Module mod;
   Function *F = mod.createFunction("main");
@@ -445,6 +445,41 @@ TEST(Network, gradientCheckSigmoid) {
   performGradCheck(IP, result, A, Exp, &inputs, &outputs, 0.0001, 0.001);
 }
 
+TEST(Network, gradientCheckLSTMUnit) {
+  ExecutionEngine IP;
+
+  size_t batchSize = 2;
+  size_t hiddenSize = 5;
+
+  auto &mod = IP.getModule();
+  Function *F = mod.createFunction("main");
+  auto *A = mod.createVariable(ElemKind::FloatTy, {batchSize, 4 * hiddenSize},
+                               "A", VisibilityKind::Public,
+                               Variable::TrainKind::None);
+  auto *C = mod.createVariable(ElemKind::FloatTy, {batchSize, hiddenSize}, "C",
+                               VisibilityKind::Public,
+                               Variable::TrainKind::None);
+  auto *Exp =
+      mod.createVariable(ElemKind::FloatTy, {batchSize, hiddenSize}, "Exp",
+                         VisibilityKind::Public, Variable::TrainKind::None);
+  C->getPayload().getHandle().initXavier(1);
+
+  auto *LU = F->createLSTMUnit("lstm", A, C);
+  Node *FA = F->createRegression("reg", LU->getNewH(), Exp);
+  auto *result = F->createSave("ret", FA);
+
+  Tensor inputs(ElemKind::FloatTy, {batchSize, 4 * hiddenSize});
+  Tensor outputs(ElemKind::FloatTy, {batchSize, hiddenSize});
+
+  auto inputsH = inputs.getHandle<>();
+  auto outputsH = outputs.getHandle<>();
+
+  inputsH.initXavier(1);
+  outputsH.initXavier(1);
+
+  performGradCheck(IP, result, A, Exp, &inputs, &outputs, 0.0001, 0.001);
+}
+
 TEST(Network, gradientCheckRelu) {
   ExecutionEngine IP;
 
@@ -109,6 +109,40 @@ TEST_F(GraphOptz, transposePrivateVariable) {
   EXPECT_EQ(F_->getNodes().size(), 1);
 }
 
+TEST_F(GraphOptz, constantFold) {
+  auto *A =
+      mod_.createVariable(ElemKind::FloatTy, {2, 3}, "A",
+                          VisibilityKind::Private, Variable::TrainKind::None);
+  auto *B =
+      mod_.createVariable(ElemKind::FloatTy, {6}, "B", VisibilityKind::Private,
+                          Variable::TrainKind::None);
+  auto *input =
+      mod_.createVariable(ElemKind::FloatTy, {6}, "input",
+                          VisibilityKind::Public, Variable::TrainKind::None);
+  A->getHandle() = {1, 2, 3, 4, 5, 6};
+  B->getHandle() = {6, 5, 4, 3, 2, 1};
+  Node *R = F_->createReshape("reshape", A, {6});
+  Node *add = F_->createAdd("add", R, B);
+  Node *two = F_->createSplat("two", add->getType(), 2);
+  Node *mul = F_->createMul("mul", add, two);
+  // The computation that depends on the input remains.
+  Node *sub = F_->createSub("sub", input, mul);
+  auto *save = F_->createSave("ret", sub);
+  EXPECT_EQ(F_->getNodes().size(), 6);
+
+  ::glow::optimize(F_, CompilationMode::Infer);
+  EXPECT_EQ(F_->getNodes().size(), 2);
+  auto *SN = llvm::dyn_cast<SubNode>(save->getInput());
+  ASSERT_TRUE(SN);
+  EXPECT_EQ(SN->getLHS().getNode(), input);
+  auto *V = llvm::dyn_cast<Variable>(SN->getRHS());
+  ASSERT_TRUE(V);
+  auto H = V->getHandle();
+  for (size_t i = 0; i < 6; i++) {
+    EXPECT_EQ(H.at({i}), 14);
+  }
+}
+
 TEST_F(GraphOptz, BatchNormAfterConvNotOptimizeForTrain) {
   Node *A =
       mod_.createVariable(ElemKind::FloatTy, {1, 10, 20, 3}, "A",
@@ -531,6 +565,27 @@ TEST_F(GraphOptz, ZeroArithmetic) {
   EXPECT_EQ(O->getInput().getNode(), input);
 }
 
+TEST_F(GraphOptz, ZeroArithmeticChain) {
+  // Every step of the chain reads the previous step twice, like the hidden
+  // state of an unrolled RNN: h' = (h - 0) + (0 * h), which is h. The shared
+  // operands are simplified once, not once for every path to them.
+  Node *input = mod_.createVariable(ElemKind::FloatTy, {4, 10}, "input",
+                                    VisibilityKind::Public);
+  auto *zero = F_->createSplat("zero", input->getType(), 0.);
+  Node *h = input;
+  for (unsigned i = 0; i < 1000; i++) {
+    auto *sub = F_->createSub("sub", h, zero);
+    auto *mul = F_->createMul("mul", zero, h);
+    h = F_->createAdd("add", sub, mul);
+  }
+  SaveNode *O = F_->createSave("ret", h);
+
+  ::glow::optimize(F_, CompilationMode::Infer);
+
+  EXPECT_EQ(F_->getNodes().size(), 1);
+  EXPECT_EQ(O->getInput().getNode(), input);
+}
+
 TEST(GraphOptzTest, SliceOfSplatNodeChain) {
   for (int shouldReverse = 0; shouldReverse <= 1; shouldReverse++) {
     Module mod;
@@ -543,8 +598,7 @@ TEST(GraphOptzTest, SliceOfSplatNodeChain) {
     F->createSave("ret", S2);
 
     if (shouldReverse) {
-      auto &nodes = F->getNodes();
-      reverse(nodes.begin(), nodes.end());
+      F->getNodes().reverse();
     }
 
     EXPECT_EQ(F->getNodes().size(), 4);
@@ -665,3 +719,148 @@ TEST_F(GraphOptz, FuseRescaleIntoArithmetic) {
   EXPECT_EQ(mul->getNthInput(0).getType(), rescaleOutTy);
   EXPECT_EQ(div->getNthInput(0).getType(), rescaleOutTy);
 }
+
+TEST_F(GraphOptz, FuseRescaleIntoMatMul) {
+  // Check that the rescales are folded into the output types of the matrix
+  // multiplications, unless the product has other users.
+  auto opOutTy = mod_.uniqueType(ElemKind::Int8QTy, {4, 4}, 1, 0);
+  auto rescaleOutTy = mod_.uniqueType(ElemKind::Int8QTy, {4, 4}, 2, 1);
+
+  Node *LHS = mod_.createVariable(ElemKind::Int8QTy, {4, 4}, 0.4, 0, "LHS",
+                                  VisibilityKind::Public);
+  Node *RHS = mod_.createVariable(ElemKind::Int8QTy, {4, 4}, 0.3, 0, "RHS",
+                                  VisibilityKind::Public);
+  Node *slice = mod_.createVariable(ElemKind::Int8QTy, {4}, 0.3, 0, "slice",
+                                    VisibilityKind::Public);
+
+  Node *MM = F_->createMatMul("qMatMul", opOutTy, LHS, RHS);
+  MM = F_->createRescaleQuantized("rsMatMul", MM, rescaleOutTy);
+  MM = F_->createSave("saveMatMul", MM);
+
+  Node *BA = F_->createBatchedAdd("qBatchedAdd", opOutTy, LHS, slice);
+  BA = F_->createRescaleQuantized("rsBatchedAdd", BA, rescaleOutTy);
+  BA = F_->createSave("saveBatchedAdd", BA);
+
+  // The product is also saved, so the rescale stays.
+  Node *shared = F_->createMatMul("qShared", opOutTy, RHS, LHS);
+  F_->createSave("saveShared", shared);
+  Node *RS = F_->createRescaleQuantized("rsShared", shared, rescaleOutTy);
+  RS = F_->createSave("saveSharedRescaled", RS);
+
+  ::glow::optimize(F_, CompilationMode::Infer);
+
+  EXPECT_EQ(F_->getNodes().size(), 8);
+  EXPECT_EQ(MM->getNthInput(0).getType(), rescaleOutTy);
+  EXPECT_TRUE(llvm::isa<MatMulNode>(MM->getNthInput(0).getNode()));
+  EXPECT_EQ(BA->getNthInput(0).getType(), rescaleOutTy);
+  EXPECT_TRUE(llvm::isa<BatchedAddNode>(BA->getNthInput(0).getNode()));
+  EXPECT_TRUE(llvm::isa<RescaleQuantizedNode>(RS->getNthInput(0).getNode()));
+}
+
+TEST_F(GraphOptz, FoldTransposeIntoMatMul) {
+  // Check that the transposes of the operands are folded into the flags of
+  // the matrix multiplication, and that a transposed operand that is
+  // transposed again is read in the regular order.
+  Node *A = mod_.createVariable(ElemKind::FloatTy, {5, 3}, "A",
+                                VisibilityKind::Public);
+  Node *B = mod_.createVariable(ElemKind::FloatTy, {4, 5}, "B",
+                                VisibilityKind::Public);
+  Node *AT = F_->createTranspose("AT", A, {1, 0});
+  Node *BT = F_->createTranspose("BT", B, {1, 0});
+  Node *MM = F_->createMatMul("matmul", AT, BT);
+  Node *O = F_->createSave("ret", MM);
+  Node *MM2 = F_->createMatMul("matmul2", A, AT, /* transposeLHS */ true,
+                               /* transposeRHS */ true);
+  Node *O2 = F_->createSave("ret2", MM2);
+
+  EXPECT_EQ(F_->getNodes().size(), 6);
+
+  ::glow::optimize(F_, CompilationMode::Infer);
+
+  EXPECT_EQ(F_->getNodes().size(), 4);
+  auto *newMM =
+      llvm::dyn_cast<MatMulNode>(llvm::cast<SaveNode>(O)->getInput());
+  ASSERT_TRUE(newMM);
+  EXPECT_EQ(newMM->getLHS().getNode(), A);
+  EXPECT_EQ(newMM->getRHS().getNode(), B);
+  EXPECT_TRUE(newMM->getTransposeLHS());
+  EXPECT_TRUE(newMM->getTransposeRHS());
+  auto *newMM2 =
+      llvm::dyn_cast<MatMulNode>(llvm::cast<SaveNode>(O2)->getInput());
+  ASSERT_TRUE(newMM2);
+  EXPECT_EQ(newMM2->getLHS().getNode(), A);
+  EXPECT_EQ(newMM2->getRHS().getNode(), A);
+  EXPECT_TRUE(newMM2->getTransposeLHS());
+  EXPECT_FALSE(newMM2->getTransposeRHS());
+}
+
+TEST_F(GraphOptz, FuseChains) {
+  // Check that the chains of a fusion pattern are replaced by the fused
+  // nodes, unless an intermediate result has other users.
+  auto *in = mod_.createVariable(ElemKind::FloatTy, {2, 8}, "in",
+                                 VisibilityKind::Public);
+  auto *W = mod_.createVariable(ElemKind::FloatTy, {8, 4}, "W");
+  auto *B = mod_.createVariable(ElemKind::FloatTy, {4}, "B");
+
+  Node *MM = F_->createMatMul("matmul", in, W);
+  Node *BA = F_->createBatchedAdd("add", MM, B);
+  auto *save = F_->createSave("save", BA);
+
+  // The product is also saved, so it stays.
+  Node *sharedMM = F_->createMatMul("sharedMatmul", in, W);
+  F_->createSave("saveShared", sharedMM);
+  Node *sharedBA = F_->createBatchedAdd("sharedAdd", sharedMM, B);
+  auto *sharedSave = F_->createSave("saveSharedAdd", sharedBA);
+
+  FusionPattern pattern;
+  pattern.kinds = {Kinded::Kind::MatMulNodeKind,
+                   Kinded::Kind::BatchedAddNodeKind};
+  pattern.fuse = [](Function *F, llvm::ArrayRef<Node *> chain) -> Node * {
+    auto *MM = llvm::cast<MatMulNode>(chain[0]);
+    auto *BA = llvm::cast<BatchedAddNode>(chain[1]);
+    return F->createFullyConnected(BA->getName(), MM->getLHS(),
+                                   MM->getRHS().getNode(),
+                                   BA->getSlice().getNode(), BA->getType());
+  };
+  EXPECT_TRUE(::glow::fuse(F_, {pattern}));
+  ::glow::optimize(F_, CompilationMode::Infer);
+
+  EXPECT_TRUE(llvm::isa<FullyConnectedNode>(save->getInput().getNode()));
+  EXPECT_TRUE(llvm::isa<BatchedAddNode>(sharedSave->getInput().getNode()));
+  EXPECT_EQ(F_->getNodes().size(), 6);
+}
+
+TEST_F(GraphOptz, SplitBatches) {
+  // Check that a chain of per-sample layers is copied for every micro-batch,
+  // and that only the result that leaves the chain is concatenated.
+  auto *input = mod_.createVariable(ElemKind::FloatTy, {8, 8, 8, 3}, "input",
+                                    VisibilityKind::Public);
+  auto *conv = F_->createConv("conv", input, 4, 3, 1, 1, 1);
+  auto *relu = F_->createRELU("relu", conv);
+  auto *pool = F_->createPoolMax("pool", relu, 2, 2, 0);
+  auto *save = F_->createSave("ret", pool);
+
+  // The relu reads and writes 1024 bytes per sample, the most in the chain,
+  // so two samples fit in 4KB.
+  EXPECT_TRUE(::glow::splitBatches(F_, 4096));
+  ::glow::optimize(F_, CompilationMode::Infer);
+
+  auto *CN = llvm::dyn_cast<ConcatNode>(save->getInput().getNode());
+  ASSERT_TRUE(CN);
+  EXPECT_EQ(CN->getDim(), 0);
+  EXPECT_EQ(CN->getType(), pool->getType());
+  ASSERT_EQ(CN->getInputs().size(), 4);
+  for (auto &in : CN->getInputs()) {
+    // The optimizer moves the relu of every copy below its pool.
+    auto *RL = llvm::dyn_cast<ReluNode>(in.getNode());
+    ASSERT_TRUE(RL);
+    EXPECT_TRUE(llvm::isa<PoolMaxNode>(RL->getInput().getNode()));
+    EXPECT_EQ(RL->getResult().dims()[0], 2);
+  }
+  // 4 copies of the chain, their slices of the input, the concat and the
+  // save.
+  EXPECT_EQ(F_->getNodes().size(), 18);
+
+  // The chain already fits in the cache.
+  EXPECT_FALSE(::glow::splitBatches(F_, 1 << 20));
+}
@@ -16,6 +16,7 @@
 
 #include "glow/Graph/Graph.h"
 #include "glow/ExecutionEngine/ExecutionEngine.h"
+#include "glow/Graph/Cost.h"
 #include "glow/Graph/Node.h"
 #include "glow/Graph/Nodes.h"
 #include "glow/IR/IR.h"
@@ -27,6 +28,7 @@
 #include <cstddef>
 #include <cstdint>
 #include <iostream>
+#include <set>
 #include <string>
 
 using namespace glow;
@@ -75,6 +77,31 @@ TEST(Graph, simpleTestFC) {
   EXPECT_GT(M.getInstrs().size(), 0);
 }
 
+TEST(Graph, nodeCost) {
+  Module MD;
+  Function *F = MD.createFunction("F");
+  auto *input = MD.createVariable(ElemKind::FloatTy, {2, 8, 8, 4}, "input");
+  auto *conv = F->createConv("conv", input, 16, 3, 1, 1, 1);
+  auto *relu = F->createRELU("relu", conv);
+  auto *reshape = F->createReshape("reshape", relu, {2, 8 * 8 * 16});
+  auto *FC = F->createFullyConnected("fc", reshape, 10);
+  F->createSave("save", FC);
+
+  // Every output element of the convolution is a dot product of 3 * 3 * 4
+  // elements.
+  EXPECT_EQ(getCost(conv).flops, 2 * (2 * 8 * 8 * 16) * (3 * 3 * 4));
+  EXPECT_EQ(getCost(conv).bytes,
+            4 * (2 * 8 * 8 * 4 + 16 * 3 * 3 * 4 + 16 + 2 * 8 * 8 * 16));
+  EXPECT_EQ(getCost(relu).flops, 2 * 8 * 8 * 16);
+  EXPECT_EQ(getCost(FC).flops, 2 * (2 * 10) * (8 * 8 * 16));
+  EXPECT_EQ(getCost(reshape).bytes, 0);
+  EXPECT_EQ(getCost(input).bytes, 0);
+
+  auto total = getCost(F);
+  EXPECT_EQ(total.flops,
+            getCost(conv).flops + getCost(relu).flops + getCost(FC).flops);
+}
+
 TEST(Graph, QuantizationProfileNodes) {
   unsigned numInputs = 10;
   Module MD;
@@ -215,6 +242,23 @@ TEST(Graph, moduleTest) {
   M.dumpDAG();
 }
 
+TEST(Graph, uniqueNames) {
+  Module M;
+  auto *F = M.createFunction("main");
+  Node *K = M.createVariable(ElemKind::FloatTy, {4}, "input");
+  std::set<std::string> names;
+  for (unsigned i = 0; i < 20000; i++) {
+    K = F->createRELU("relu", K);
+    names.insert(K->getName().str());
+  }
+  EXPECT_EQ(names.size(), 20000);
+  EXPECT_EQ(K->getName(), "relu19999");
+
+  // The explicit names that look like the generated ones are still unique.
+  auto *R = F->createRELU("relu20000", K);
+  EXPECT_EQ(F->createRELU("relu", R)->getName(), "relu20001");
+}
+
 TEST(Graph, functionDependenciesTest) {
   Module M;
   auto F1 = M.createFunction("one");
@@ -253,6 +297,27 @@ TEST(Graph, cloneTest2) {
   EXPECT_EQ(newF->getParent(), F->getParent());
 }
 
+TEST(Graph, cloneForOutputs) {
+  Module M;
+
+  auto *F = M.createFunction("main");
+  Node *K = M.createVariable(ElemKind::FloatTy, {4, 10}, "input");
+  Node *relu = F->createRELU("Relu", K);
+  auto *features = F->createSave("features", relu);
+  Node *tanh = F->createTanh("Tanh", relu);
+  Node *sigmoid = F->createSigmoid("Sigmoid", tanh);
+  F->createSave("probs", sigmoid);
+
+  // Only the relu and the save of the features are left.
+  auto *newF = F->cloneForOutputs("features_only", {features});
+  newF->verify();
+  EXPECT_EQ(newF->getNodes().size(), 2);
+  EXPECT_EQ(F->getNodes().size(), 5);
+  for (auto *N : newF->getNodes()) {
+    EXPECT_TRUE(llvm::isa<ReluNode>(N) || llvm::isa<SaveNode>(N));
+  }
+}
+
 TEST(Graph, NodeValue) {
   ExecutionEngine EE;
   auto &mod = EE.getModule();
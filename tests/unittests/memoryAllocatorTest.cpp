@@ -15,9 +15,12 @@
  */
 
 #include "glow/CodeGen/MemoryAllocator.h"
+#include "glow/Support/Memory.h"
 
 #include "gtest/gtest.h"
 
+#include <algorithm>
+
 using namespace glow;
 
 TEST(MemAlloc, simple) {
@@ -111,3 +114,71 @@ TEST(MemAlloc, allocateToTheMax) {
 
   EXPECT_EQ(MA.getMaxMemoryUsage(), 128);
 }
+
+TEST(MemAlloc, offlineFragmentation) {
+  // The first fit allocation leaves a gap that is too small for the last
+  // buffer, the offline allocation places the large buffers first.
+  MemoryAllocator MA(0);
+  auto a = MA.allocate(64);
+  auto b = MA.allocate(128);
+  MA.deallocate(a);
+  auto c = MA.allocate(128);
+  MA.deallocate(b);
+  auto d = MA.allocate(256);
+  MA.deallocate(c);
+  MA.deallocate(d);
+  EXPECT_EQ(MA.getMaxMemoryUsage(), 576);
+
+  std::vector<LiveBuffer> buffers = {
+      {64, 0, 2}, {128, 1, 4}, {128, 3, 6}, {256, 5, 6}};
+  std::vector<size_t> addrs;
+  EXPECT_EQ(allocateOffline(buffers, addrs), 384);
+  EXPECT_EQ(addrs[3], 0);
+  EXPECT_EQ(addrs[2], 256);
+}
+
+TEST(MemAlloc, offlineNoOverlap) {
+  std::vector<LiveBuffer> buffers;
+  for (size_t i = 0; i < 200; i++) {
+    size_t start = (i * 7919) % 97;
+    buffers.emplace_back(64 * (1 + (i * 31) % 13), start,
+                         start + 1 + (i * 17) % 23);
+  }
+  std::vector<size_t> addrs;
+  size_t peak = allocateOffline(buffers, addrs);
+  ASSERT_EQ(addrs.size(), buffers.size());
+
+  // Check that the buffers that are live at the same time don't overlap.
+  for (size_t i = 0; i < buffers.size(); i++) {
+    EXPECT_LE(addrs[i] + buffers[i].size_, peak);
+    for (size_t j = i + 1; j < buffers.size(); j++) {
+      if (!buffers[i].interferesWith(buffers[j])) {
+        continue;
+      }
+      bool disjoint = addrs[i] + buffers[i].size_ <= addrs[j] ||
+                      addrs[j] + buffers[j].size_ <= addrs[i];
+      EXPECT_TRUE(disjoint);
+    }
+  }
+}
+
+TEST(MemAlloc, memoryPolicy) {
+  MemoryPolicy policies[3];
+  policies[1].hugePages = HugePageMode::Transparent;
+  policies[2].hugePages = HugePageMode::Explicit;
+  policies[2].numaNode = 0;
+  for (const auto &policy : policies) {
+    size_t size = 3 * HugePageSize + 100;
+    auto *p = static_cast<char *>(allocateMemory(size, policy));
+    ASSERT_NE(p, nullptr);
+    EXPECT_EQ(size_t(p) % TensorAlignment, 0);
+    // The memory is usable as a whole.
+    std::fill(p, p + size, 1);
+    EXPECT_EQ(size_t(std::count(p, p + size, 1)), size);
+    freeMemory(p, size, policy);
+  }
+
+  // The default policy leaves any memory as it is.
+  std::vector<char> buffer(100);
+  EXPECT_TRUE(applyMemoryPolicy(buffer.data(), buffer.size(), policies[0]));
+}
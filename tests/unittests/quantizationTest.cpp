@@ -38,7 +38,10 @@ protected:
 bool operator==(const NodeQuantizationInfo &lhs,
                 const NodeQuantizationInfo &rhs) {
   return lhs.Scale() == rhs.Scale() && lhs.Offset() == rhs.Offset() &&
-         lhs.nodeOutputName_ == rhs.nodeOutputName_;
+         lhs.nodeOutputName_ == rhs.nodeOutputName_ &&
+         lhs.histogramMin_ == rhs.histogramMin_ &&
+         lhs.histogramMax_ == rhs.histogramMax_ &&
+         lhs.histogram_ == rhs.histogram_ && lhs.quantize_ == rhs.quantize_;
 }
 
 void testSerialization(const std::vector<NodeQuantizationInfo> &expected) {
@@ -66,6 +69,52 @@ TEST(Quantization, SerializeEmpty) {
   testSerialization(expected);
 }
 
+TEST(Quantization, SerializeHistogram) {
+  std::vector<NodeQuantizationInfo> expected{{"first", {1, 10}},
+                                             {"second", {0.5, -3}}};
+  expected[1].histogramMin_ = -1.5;
+  expected[1].histogramMax_ = 2.25;
+  expected[1].histogram_ = {0, 1, 7, 3};
+
+  testSerialization(expected);
+}
+
+TEST(Quantization, SerializeSelection) {
+  std::vector<NodeQuantizationInfo> expected{{"first", {1, 10}},
+                                             {"second", {0.5, -3}}};
+  expected[1].quantize_ = false;
+
+  testSerialization(expected);
+}
+
+/// Check that the KL calibration clips a single outlier, which otherwise
+/// wastes most of the quantized range.
+TEST(Quantization, calibrateKLMinimization) {
+  // The values are around zero in [-1, 1], and one value is 99.
+  NodeQuantizationInfo info;
+  info.nodeOutputName_ = "node:0";
+  info.histogramMin_ = -1;
+  info.histogramMax_ = 99;
+  info.histogram_.resize(2000);
+  for (size_t i = 0; i < 40; i++) {
+    info.histogram_[i] = 20 - std::abs(float(i) - 19.5f);
+  }
+  info.histogram_.back() = 1;
+
+  std::vector<NodeQuantizationInfo> infos{info};
+  quantization::calibrateQuantizationInfos(
+      infos, quantization::CalibrationKind::None);
+  EXPECT_NEAR(infos[0].Scale(), 100.0 / 255, 1e-3);
+
+  quantization::calibrateQuantizationInfos(
+      infos, quantization::CalibrationKind::KLMinimization);
+  // The range still covers the bulk of the values, with a much finer scale.
+  // The narrowest candidate range has a bin per quantized value.
+  EXPECT_LT(infos[0].Scale(), 20.0 / 255);
+  EXPECT_GT(infos[0].Scale(), 1.0 / 255);
+  EXPECT_LT(infos[0].Int8Error(), 0.1);
+}
+
 template <typename From, typename To> static To clip(From in) {
   static_assert(sizeof(From) >= sizeof(To),
                 "Clip should reduce the variable size");
@@ -226,6 +275,284 @@ TEST_P(Quantization, end2end) {
   }
 }
 
+TEST_P(Quantization, end2endChannelwise) {
+  auto res = createSimpleGraphForQuantization(&interpreterEE.getModule());
+  Function *F1 = res.first;
+  SaveNode *result1 = res.second;
+
+  glow::profileQuantization(F1);
+  interpreterEE.compile(CompilationMode::Infer, F1);
+  interpreterEE.run({}, {});
+
+  std::vector<NodeQuantizationInfo> QI =
+      quantization::generateNodeQuantizationInfos(F1);
+
+  // Quantize the weights of the convolution and the fully connected node with
+  // a scale and offset per output channel.
+  auto res2 = createSimpleGraphForQuantization(&backendSpecificEE.getModule());
+  Function *F2 = res2.first;
+  SaveNode *result2 = res2.second;
+  quantization::generateQuantizedGraph(backendSpecificEE, F2, QI,
+                                       /* enableChannelwise */ true);
+
+  unsigned numChannelwise = 0;
+  for (auto *node : F2->getNodes()) {
+    if (llvm::isa<ChannelwiseQuantizedConvolutionNode>(node) ||
+        llvm::isa<ChannelwiseQuantizedFullyConnectedNode>(node)) {
+      numChannelwise++;
+    }
+  }
+  EXPECT_EQ(numChannelwise, 2);
+
+  backendSpecificEE.compile(CompilationMode::Infer, F2);
+  backendSpecificEE.run({}, {});
+
+  auto result1Handle = result1->getVariable()->getHandle();
+  auto result2Handle = result2->getVariable()->getHandle();
+  EXPECT_EQ(result1Handle.size(), result2Handle.size());
+
+  for (int i = 0, e = result1Handle.size(); i < e; ++i) {
+    float mx = result2Handle.raw(result2Handle.minMaxArg().second);
+    double diff = std::fabs(result2Handle.raw(i) - result1Handle.raw(i)) / mx;
+
+    // Allow 3% difference.
+    EXPECT_NEAR(diff, 0, 0.03);
+  }
+}
+
+TEST_P(Quantization, end2endInt16) {
+  auto res = createSimpleGraphForQuantization(&interpreterEE.getModule());
+  Function *F1 = res.first;
+  SaveNode *result1 = res.second;
+
+  glow::profileQuantization(F1);
+  interpreterEE.compile(CompilationMode::Infer, F1);
+  interpreterEE.run({}, {});
+
+  std::vector<NodeQuantizationInfo> QI =
+      quantization::generateNodeQuantizationInfos(F1);
+  for (const auto &info : QI) {
+    EXPECT_GE(info.Int8Error(), 0);
+  }
+
+  // Any quantization error is above the threshold, so the convolution and the
+  // fully connected node run with int16 activations.
+  auto res2 = createSimpleGraphForQuantization(&backendSpecificEE.getModule());
+  Function *F2 = res2.first;
+  SaveNode *result2 = res2.second;
+  quantization::generateQuantizedGraph(backendSpecificEE, F2, QI,
+                                       /* enableChannelwise */ false,
+                                       /* maxInt8Error */ 1e-9);
+
+  unsigned numInt16 = 0;
+  for (auto *node : F2->getNodes()) {
+    if ((llvm::isa<ConvolutionNode>(node) ||
+         llvm::isa<FullyConnectedNode>(node)) &&
+        node->getNthInput(0).getElementType() == ElemKind::Int16QTy) {
+      numInt16++;
+    }
+  }
+  EXPECT_EQ(numInt16, 2);
+
+  backendSpecificEE.compile(CompilationMode::Infer, F2);
+  backendSpecificEE.run({}, {});
+
+  auto result1Handle = result1->getVariable()->getHandle();
+  auto result2Handle = result2->getVariable()->getHandle();
+  EXPECT_EQ(result1Handle.size(), result2Handle.size());
+
+  for (int i = 0, e = result1Handle.size(); i < e; ++i) {
+    float mx = result2Handle.raw(result2Handle.minMaxArg().second);
+    double diff = std::fabs(result2Handle.raw(i) - result1Handle.raw(i)) / mx;
+
+    // Allow 3% difference.
+    EXPECT_NEAR(diff, 0, 0.03);
+  }
+}
+
+/// Builds a fully connected layer that is wider than the register tiles of
+/// the matrix multiplication kernels. \returns the function and its save node.
+static std::pair<Function *, SaveNode *>
+createWideFCForQuantization(Module *M) {
+  Function *F = M->createFunction("main");
+  auto *A = M->createVariable(ElemKind::FloatTy, {5, 40}, "A",
+                              VisibilityKind::Public,
+                              Variable::TrainKind::None);
+  fillStableRandomData(A->getHandle(), 1100, 1);
+  FullyConnectedNode *FC = F->createFullyConnected("fc", A, 70);
+  fillStableRandomData(cast<Variable>(FC->getBias())->getHandle(), 3001, 1);
+  fillStableRandomData(cast<Variable>(FC->getWeights())->getHandle(), 4000, 1);
+  SaveNode *SN = F->createSave("save", FC);
+  return {F, SN};
+}
+
+/// Checks the int16 matrix multiplication on both the full register tiles and
+/// the ragged rows and columns.
+TEST_P(Quantization, end2endInt16WideFC) {
+  auto res = createWideFCForQuantization(&interpreterEE.getModule());
+  glow::profileQuantization(res.first);
+  interpreterEE.compile(CompilationMode::Infer, res.first);
+  interpreterEE.run({}, {});
+  std::vector<NodeQuantizationInfo> QI =
+      quantization::generateNodeQuantizationInfos(res.first);
+
+  auto res2 = createWideFCForQuantization(&backendSpecificEE.getModule());
+  quantization::generateQuantizedGraph(backendSpecificEE, res2.first, QI,
+                                       /* enableChannelwise */ false,
+                                       /* maxInt8Error */ 1e-9);
+  backendSpecificEE.compile(CompilationMode::Infer, res2.first);
+  backendSpecificEE.run({}, {});
+
+  auto result1Handle = res.second->getVariable()->getHandle();
+  auto result2Handle = res2.second->getVariable()->getHandle();
+  float mx = std::fabs(result1Handle.raw(result1Handle.minMaxArg().second));
+  for (size_t i = 0, e = result1Handle.size(); i < e; ++i) {
+    EXPECT_NEAR(result2Handle.raw(i), result1Handle.raw(i), 0.03 * mx);
+  }
+}
+
+/// Builds a graph that pools the rows of an embedding table, whose rows have
+/// very different ranges. \returns the function and its save node.
+static std::pair<Function *, SaveNode *>
+createEmbeddingGraphForQuantization(Module *M) {
+  Function *F = M->createFunction("main");
+
+  auto *data = M->createVariable(ElemKind::FloatTy, {20, 8}, "data",
+                                 VisibilityKind::Private,
+                                 Variable::TrainKind::None);
+  auto DH = data->getHandle();
+  fillStableRandomData(DH, 5000, 1);
+  for (size_t i = 0, e = DH.size(); i < e; i++) {
+    DH.raw(i) *= 1 + i / 8;
+  }
+  auto *indices = M->createVariable(ElemKind::IndexTy, {10}, "indices",
+                                    VisibilityKind::Public,
+                                    Variable::TrainKind::None);
+  auto *lengths = M->createVariable(ElemKind::IndexTy, {4}, "lengths",
+                                    VisibilityKind::Public,
+                                    Variable::TrainKind::None);
+  indices->getHandle<size_t>() = {0, 19, 3, 7, 7, 12, 1, 18, 5, 10};
+  lengths->getHandle<size_t>() = {3, 1, 4, 2};
+
+  auto *SLS = F->createSparseLengthsSum("SLS", data, indices, lengths);
+  auto *gather = F->createGather("gather", data, indices);
+  auto *concat = F->createConcat("concat", {SLS, gather}, 0);
+  SaveNode *SN = F->createSave("save", concat);
+  return {F, SN};
+}
+
+TEST_P(Quantization, end2endRowwise) {
+  auto res = createEmbeddingGraphForQuantization(&interpreterEE.getModule());
+  Function *F1 = res.first;
+  SaveNode *result1 = res.second;
+
+  glow::profileQuantization(F1);
+  interpreterEE.compile(CompilationMode::Infer, F1);
+  interpreterEE.run({}, {});
+
+  std::vector<NodeQuantizationInfo> QI =
+      quantization::generateNodeQuantizationInfos(F1);
+
+  // Quantize the embedding table with a scale and offset per row.
+  auto res2 =
+      createEmbeddingGraphForQuantization(&backendSpecificEE.getModule());
+  Function *F2 = res2.first;
+  SaveNode *result2 = res2.second;
+  quantization::generateQuantizedGraph(backendSpecificEE, F2, QI,
+                                       /* enableChannelwise */ true);
+
+  unsigned numRowwise = 0;
+  for (auto *node : F2->getNodes()) {
+    if (llvm::isa<RowwiseQuantizedSparseLengthsWeightedSumNode>(node) ||
+        llvm::isa<RowwiseQuantizedGatherNode>(node)) {
+      numRowwise++;
+    }
+  }
+  EXPECT_EQ(numRowwise, 2);
+
+  backendSpecificEE.compile(CompilationMode::Infer, F2);
+  backendSpecificEE.run({}, {});
+
+  auto result1Handle = result1->getVariable()->getHandle();
+  auto result2Handle = result2->getVariable()->getHandle();
+  EXPECT_EQ(result1Handle.size(), result2Handle.size());
+
+  for (int i = 0, e = result1Handle.size(); i < e; ++i) {
+    float mx = result2Handle.raw(result2Handle.minMaxArg().second);
+    double diff = std::fabs(result2Handle.raw(i) - result1Handle.raw(i)) / mx;
+
+    // Allow 3% difference.
+    EXPECT_NEAR(diff, 0, 0.03);
+  }
+}
+
+/// Check that the quantization of every node is measured alone, and that only
+/// the selected nodes are quantized.
+TEST_P(Quantization, selectQuantizedNodes) {
+  auto res = createSimpleGraphForQuantization(&interpreterEE.getModule());
+  Function *F1 = res.first;
+  glow::profileQuantization(F1);
+  interpreterEE.compile(CompilationMode::Infer, F1);
+  interpreterEE.run({}, {});
+  std::vector<NodeQuantizationInfo> QI =
+      quantization::generateNodeQuantizationInfos(F1);
+
+  auto res2 = createSimpleGraphForQuantization(&backendSpecificEE.getModule());
+  Function *F2 = res2.first;
+  SaveNode *result2 = res2.second;
+  size_t numNodes = F2->getNodes().size();
+  auto effects = quantization::measureQuantizationEffects(
+      backendSpecificEE, F2, QI, {}, {}, /* timingRuns */ 0);
+  EXPECT_EQ(F2->getNodes().size(), numNodes);
+
+  // Pretend that only the convolution saves time.
+  bool hasConv = false;
+  for (auto &effect : effects) {
+    EXPECT_LT(effect.error_, 0.05);
+    effect.timeSaved_ = 0;
+    if (effect.nodeName_ == "conv") {
+      hasConv = true;
+      effect.timeSaved_ = 1;
+    }
+  }
+  EXPECT_TRUE(hasConv);
+  EXPECT_GT(effects.size(), 1);
+  quantization::selectQuantizedNodes(effects, 0.05, QI);
+
+  // Compile a copy for the reference, because the compilation lowers the
+  // nodes that the quantization infos refer to.
+  Function *F2Ref = F2->clone("mainRef");
+  backendSpecificEE.compile(CompilationMode::Infer, F2Ref);
+  backendSpecificEE.run({}, {});
+  Tensor ref;
+  ref.copyFrom(&result2->getVariable()->getPayload());
+
+  quantization::generateQuantizedGraph(backendSpecificEE, F2, QI);
+  unsigned numQuantized = 0;
+  for (auto *node : F2->getNodes()) {
+    if (llvm::isa<QuantizeNode>(node) || llvm::isa<DequantizeNode>(node) ||
+        node->getNumResults() != 1 || !node->hasUsers()) {
+      continue;
+    }
+    if (node->getType(0)->isQuantizedType()) {
+      EXPECT_TRUE(llvm::isa<ConvolutionNode>(node));
+      numQuantized++;
+    }
+  }
+  EXPECT_EQ(numQuantized, 1);
+
+  backendSpecificEE.compile(CompilationMode::Infer, F2);
+  backendSpecificEE.run({}, {});
+  // The outputs reach the thousands, so the tolerance is relative to them.
+  auto refH = ref.getHandle();
+  float maxAbs = 0;
+  for (size_t i = 0, e = refH.size(); i < e; i++) {
+    maxAbs = std::max(maxAbs, std::abs(refH.raw(i)));
+  }
+  EXPECT_TRUE(
+      ref.isEqual(result2->getVariable()->getPayload(), 0.01 * maxAbs));
+}
+
 TEST(Quantization, rescaleSameType) {
   ExecutionEngine EE;
   auto &mod = EE.getModule();
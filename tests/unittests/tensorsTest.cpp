@@ -15,9 +15,14 @@
  */
 
 #include "glow/Base/Tensor.h"
+#include "glow/Base/WeightStore.h"
+#include "glow/Support/Parallel.h"
 
 #include "gtest/gtest.h"
 
+#include <cmath>
+#include <thread>
+
 using namespace glow;
 
 TEST(Tensor, init) {
@@ -215,6 +220,42 @@ TEST(Tensor, concatTensors2D) {
   }
 }
 
+/// Insert and extract slices that span the inner dimensions entirely, which
+/// are copied as contiguous runs, and slices that don't.
+TEST(Tensor, insertExtractTensors3D) {
+  Tensor Z(ElemKind::FloatTy, {3, 4, 5});
+  auto zH = Z.getHandle<>();
+  zH.clear(0);
+
+  for (auto &sliceDims : std::vector<std::vector<size_t>>{
+           {1, 4, 5}, {2, 2, 5}, {3, 3, 2}}) {
+    Tensor X(ElemKind::FloatTy, sliceDims);
+    Tensor Y(ElemKind::FloatTy, sliceDims);
+    auto xH = X.getHandle<>();
+    auto yH = Y.getHandle<>();
+    for (size_t i = 0, e = xH.size(); i < e; i++) {
+      xH.raw(i) = i + 1;
+    }
+    std::vector<size_t> offset = {3 - sliceDims[0], 4 - sliceDims[1],
+                                  5 - sliceDims[2]};
+    zH.insertTensors(xH, offset);
+    zH.extractTensors(yH, offset);
+
+    for (size_t x = 0; x < sliceDims[0]; x++) {
+      for (size_t y = 0; y < sliceDims[1]; y++) {
+        for (size_t z = 0; z < sliceDims[2]; z++) {
+          EXPECT_EQ(zH.at({x + offset[0], y + offset[1], z + offset[2]}),
+                    xH.at({x, y, z}));
+          EXPECT_EQ(yH.at({x, y, z}), xH.at({x, y, z}));
+        }
+      }
+    }
+  }
+  // The elements outside of the slices are untouched.
+  EXPECT_EQ(zH.at({0, 0, 0}), 0);
+  EXPECT_EQ(zH.at({1, 1, 2}), 0);
+}
+
 TEST(Tensor, meanAndVariance) {
 
   Tensor T1 = {3, 4, 4, 5, 6, 8};
@@ -561,3 +602,207 @@ TEST(Tensor, integerTensors) {
   // These types have the same scale and offset.
   EXPECT_TRUE(I8Ty2.isEqual(I8Ty3));
 }
+
+TEST(Tensor, float16) {
+  // These values are exact in float16.
+  Tensor T(ElemKind::Float16Ty, {4});
+  auto H = T.getHandle<float16>();
+  H = {0.5f, -2.0f, 1024.0f, 0.125f};
+  EXPECT_EQ(T.getType().getSizeInBytes(), 8);
+  EXPECT_EQ(float(H.at({1})), -2.0);
+  EXPECT_EQ(float(H.at({2})), 1024.0);
+  EXPECT_EQ(float16(1.0f).getBits(), 0x3C00);
+
+  // The conversion rounds to the nearest float16 and saturates to infinity.
+  EXPECT_NEAR(float(float16(3.14159f)), 3.14159f, 0.002);
+  EXPECT_EQ(float16(1e6f).getBits(), 0x7C00);
+
+  Tensor O(ElemKind::Float16Ty, {4});
+  O.copyFrom(&T);
+  EXPECT_TRUE(O.isEqual(T));
+  O.getHandle<float16>().at({3}) = 0.25;
+  EXPECT_FALSE(O.isEqual(T));
+}
+
+/// Check that a weight store keeps the tensors with the same type and
+/// content once, and frees them with their last reference.
+TEST(Tensor, weightStore) {
+  WeightStore store;
+  Tensor A = {1.0, 2.0, 3.0};
+  Tensor B = {1.0, 2.0, 3.0};
+  Tensor C = {1.0, 2.0, 4.0};
+  Tensor D(ElemKind::FloatTy, {3, 1});
+  D.getHandle() = {1.0, 2.0, 3.0};
+  auto *payloadA = A.getUnsafePtr();
+
+  auto refA = store.intern(std::move(A));
+  auto refB = store.intern(std::move(B));
+  auto refC = store.intern(std::move(C));
+  EXPECT_EQ(refA->getUnsafePtr(), payloadA);
+  EXPECT_EQ(refA, refB);
+  EXPECT_NE(refA, refC);
+  EXPECT_EQ(store.getNumTensors(), 2);
+  EXPECT_EQ(store.getSizeInBytes(), 2 * 3 * sizeof(float));
+
+  // Tensors of other shapes are not merged, even with the same bytes.
+  {
+    auto refD = store.intern(std::move(D));
+    EXPECT_EQ(store.getNumTensors(), 3);
+  }
+  EXPECT_EQ(store.getNumTensors(), 2);
+
+  refA.reset();
+  EXPECT_EQ(store.getNumTensors(), 2);
+  refB.reset();
+  EXPECT_EQ(store.getNumTensors(), 1);
+}
+
+/// \returns the address of the payload of \p T without pinning it.
+static const float *getBuffer(const Tensor &T) {
+  return T.getRawDataPointer<float>();
+}
+
+/// Check that the copies of a tensor share its buffer until they are
+/// written.
+TEST(Tensor, copyOnWrite) {
+  Tensor A = {1.0, 2.0, 3.0};
+  Tensor B = A.clone();
+  Tensor C;
+  C.copyFrom(&A);
+  EXPECT_EQ(getBuffer(A), getBuffer(B));
+  EXPECT_EQ(getBuffer(A), getBuffer(C));
+
+  // Writing a copy gives it a buffer of its own.
+  B.getHandle().raw(0) = 5;
+  EXPECT_NE(getBuffer(A), getBuffer(B));
+  EXPECT_EQ(getBuffer(A), getBuffer(C));
+  EXPECT_EQ(getBuffer(A)[0], 1);
+  EXPECT_EQ(getBuffer(B)[0], 5);
+  EXPECT_EQ(getBuffer(C)[0], 1);
+
+  // Writing the original doesn't change the copies.
+  auto H = A.getHandle();
+  Tensor D = A.clone();
+  H.raw(1) = 7;
+  EXPECT_EQ(D.getHandle().raw(1), 2);
+  EXPECT_EQ(C.getHandle().raw(1), 2);
+  EXPECT_EQ(A.getHandle().raw(1), 7);
+
+  // Moving a tensor moves its buffer.
+  const float *buffer = getBuffer(D);
+  Tensor E(std::move(D));
+  EXPECT_EQ(getBuffer(E), buffer);
+}
+
+/// Check that the buffers whose addresses are handed out stay in place and
+/// are not shared.
+TEST(Tensor, copyOnWritePinned) {
+  Tensor A = {1.0, 2.0, 3.0};
+  Tensor B = A.clone();
+
+  // Taking the address of a shared buffer copies it first.
+  char *ptr = B.getUnsafePtr();
+  EXPECT_NE(getBuffer(A), getBuffer(B));
+  Tensor C = B.clone();
+  EXPECT_NE(getBuffer(B), getBuffer(C));
+  reinterpret_cast<float *>(ptr)[0] = 4;
+  EXPECT_EQ(C.getHandle().raw(0), 1);
+
+  // Copying into a pinned tensor writes its buffer in place.
+  Tensor D = {6.0, 7.0, 8.0};
+  B.copyFrom(&D);
+  EXPECT_EQ(B.getUnsafePtr(), ptr);
+  EXPECT_EQ(B.getHandle().raw(2), 8);
+
+  // A view writes the buffer of its tensor only.
+  Tensor E = D.clone();
+  Tensor view = D.getUnowned({3});
+  view.getHandle().raw(0) = 9;
+  EXPECT_EQ(D.getHandle().raw(0), 9);
+  EXPECT_EQ(E.getHandle().raw(0), 6);
+}
+
+/// Check that the writes through the addresses that a tensor handed out
+/// don't leak into the copies made after that.
+TEST(Tensor, copyOnWriteAliasing) {
+  // A raw pointer.
+  Tensor A = {1.0, 2.0, 3.0};
+  float *ptr = A.getRawDataPointer<float>();
+  Tensor B;
+  B.copyFrom(&A);
+  ptr[0] = 4;
+  EXPECT_EQ(getBuffer(A)[0], 4);
+  EXPECT_EQ(getBuffer(B)[0], 1);
+
+  // A reference from a handle.
+  Tensor C = {1.0, 2.0, 3.0};
+  auto H = C.getHandle();
+  float &ref = H.raw(1);
+  Tensor D = C.clone();
+  ref = 5;
+  EXPECT_EQ(H.raw(1), 5);
+  EXPECT_EQ(getBuffer(D)[1], 2);
+
+  // A raw pointer into a shared buffer.
+  Tensor E = {1.0, 2.0, 3.0};
+  Tensor F = E.clone();
+  F.getRawDataPointer<float>()[2] = 6;
+  EXPECT_EQ(getBuffer(E)[2], 3);
+  EXPECT_EQ(getBuffer(F)[2], 6);
+}
+
+/// Check that several threads may take the address of the same shared const
+/// tensor at once.
+TEST(Tensor, concurrentPin) {
+  Tensor A = {1.0, 2.0, 3.0};
+  const Tensor B = A.clone();
+  std::vector<char *> ptrs(8);
+  std::vector<std::thread> threads;
+  for (size_t i = 0; i < ptrs.size(); i++) {
+    threads.emplace_back([&B, &ptrs, i]() { ptrs[i] = B.getUnsafePtr(); });
+  }
+  for (auto &thread : threads) {
+    thread.join();
+  }
+  for (auto *ptr : ptrs) {
+    EXPECT_EQ(ptr, ptrs[0]);
+  }
+  EXPECT_NE(getBuffer(A), getBuffer(B));
+  EXPECT_EQ(getBuffer(B)[1], 2);
+}
+
+/// Check that the random fills stay in their ranges, and that they depend on
+/// the seed only, and not on the number of threads.
+TEST(Tensor, randomizeIsDeterministic) {
+  Tensor A(ElemKind::FloatTy, {100003});
+  Tensor B(ElemKind::FloatTy, {100003});
+  Tensor C(ElemKind::Int8QTy, {1000}, 1.0, 0);
+  size_t numThreads = glow_parallel_get_num_threads();
+
+  glow_parallel_set_num_threads(1);
+  seedRandStream(42);
+  A.getHandle().randomize(-2, 3);
+  C.getHandle<int8_t>().initXavier(1);
+  glow_parallel_set_num_threads(4);
+  seedRandStream(42);
+  B.getHandle().randomize(-2, 3);
+  EXPECT_TRUE(A.isEqual(B, 0));
+
+  auto AH = A.getHandle();
+  for (size_t i = 0, e = AH.size(); i < e; i++) {
+    EXPECT_GE(AH.raw(i), -2);
+    EXPECT_LE(AH.raw(i), 3);
+  }
+  auto CH = C.getHandle<int8_t>();
+  for (size_t i = 0, e = CH.size(); i < e; i++) {
+    EXPECT_LE(std::abs(CH.raw(i)), 1);
+  }
+
+  // The next fill continues the stream.
+  B.getHandle().randomize(-2, 3);
+  EXPECT_FALSE(A.isEqual(B, 0));
+
+  // Leave the pool and the stream as the other tests expect them.
+  glow_parallel_set_num_threads(numThreads);
+  seedRandStream(0);
+}
@@ -15,25 +15,126 @@
  */
 #ifdef GLOW_WITH_CPU
 
-BB.newBackendSpecificInstr("CPUMaxSplat")
+BB.newBackendSpecificInstr("CPUConvDKKC8")
     .addOperand("Dest", OperandKind::Out)
     .addOperand("Src", OperandKind::In)
-    .addMember(MemberType::Float, "SplatValue")
-    .inplaceOperand({"Dest", "Src"})
-    .dataParallel()
-    .autoIRGen();
+    .addOperand("Filter", OperandKind::In)
+    .addOperand("Bias", OperandKind::In)
+    .addMember(MemberType::SizeT, "Kernel")
+    .addMember(MemberType::SizeT, "Stride")
+    .addMember(MemberType::SizeT, "Pad")
+    .addMember(MemberType::Unsigned, "Activation")
+    .addMember(MemberType::Float, "ActivationParam")
+    .autoIRGen()
+    .autoVerify(VerifyKind::SameElementType, {"Dest", "Src", "Filter", "Bias"});
 
-BB.newBackendSpecificInstr("CPUConvDKKC8")
+BB.newBackendSpecificInstr("CPUResidualConvDKKC8")
+    .addOperand("Dest", OperandKind::Out)
+    .addOperand("Src", OperandKind::In)
+    .addOperand("Filter", OperandKind::In)
+    .addOperand("Bias", OperandKind::In)
+    .addOperand("Residual", OperandKind::In)
+    .addMember(MemberType::SizeT, "Kernel")
+    .addMember(MemberType::SizeT, "Stride")
+    .addMember(MemberType::SizeT, "Pad")
+    .addMember(MemberType::Unsigned, "Activation")
+    .addMember(MemberType::Float, "ActivationParam")
+    .inplaceOperand({"Dest", "Residual"})
+    .autoIRGen()
+    .autoVerify(VerifyKind::SameElementType,
+                {"Dest", "Src", "Filter", "Bias", "Residual"})
+    .autoVerify(VerifyKind::SameShape, {"Dest", "Residual"});
+
+BB.newBackendSpecificInstr("CPUQuantizedConvDKKC8")
     .addOperand("Dest", OperandKind::Out)
     .addOperand("Src", OperandKind::In)
     .addOperand("Filter", OperandKind::In)
+    .addOperand("TapSums", OperandKind::In)
     .addOperand("Bias", OperandKind::In)
     .addMember(MemberType::SizeT, "Kernel")
     .addMember(MemberType::SizeT, "Stride")
     .addMember(MemberType::SizeT, "Pad")
     .autoIRGen()
+    .autoVerify(VerifyKind::SameElementType, {"Dest", "Src", "Bias"});
+
+BB.newBackendSpecificInstr("CPUConvNCHWc")
+    .addOperand("Dest", OperandKind::Out)
+    .addOperand("Src", OperandKind::In)
+    .addOperand("Filter", OperandKind::In)
+    .addOperand("Bias", OperandKind::In)
+    .addMember(MemberType::SizeT, "Kernel")
+    .addMember(MemberType::SizeT, "Stride")
+    .addMember(MemberType::SizeT, "Pad")
+    .addMember(MemberType::Unsigned, "Activation")
+    .addMember(MemberType::Float, "ActivationParam")
+    .autoIRGen()
     .autoVerify(VerifyKind::SameElementType, {"Dest", "Src", "Filter", "Bias"});
 
+BB.newBackendSpecificInstr("CPUMatMulPacked")
+    .addOperand("Dest", OperandKind::Out)
+    .addOperand("LHS", OperandKind::In)
+    .addOperand("RHS", OperandKind::In)
+    .autoIRGen()
+    .autoVerify(VerifyKind::SameElementType, {"Dest", "LHS", "RHS"});
+
+BB.newBackendSpecificInstr("CPUFullyConnectedPacked")
+    .addOperand("Dest", OperandKind::Out)
+    .addOperand("LHS", OperandKind::In)
+    .addOperand("RHS", OperandKind::In)
+    .addOperand("Bias", OperandKind::In)
+    .addMember(MemberType::Unsigned, "Activation")
+    .addMember(MemberType::Float, "ActivationParam")
+    .autoIRGen()
+    .autoVerify(VerifyKind::SameElementType, {"Dest", "LHS", "RHS", "Bias"});
+
+BB.newBackendSpecificInstr("CPUIm2Col")
+    .addOperand("Dest", OperandKind::Out)
+    .addOperand("Src", OperandKind::In)
+    .addMember(MemberType::SizeT, "Kernel")
+    .addMember(MemberType::SizeT, "Stride")
+    .addMember(MemberType::SizeT, "Pad")
+    .autoIRGen()
+    .autoVerify(VerifyKind::SameElementType, {"Dest", "Src"});
+
+BB.newBackendSpecificInstr("CPUWinogradInput")
+    .addOperand("Dest", OperandKind::Out)
+    .addOperand("Src", OperandKind::In)
+    .addMember(MemberType::SizeT, "Pad")
+    .autoIRGen()
+    .autoVerify(VerifyKind::SameElementType, {"Dest", "Src"});
+
+BB.newBackendSpecificInstr("CPUWinogradMultiply")
+    .addOperand("Dest", OperandKind::Out)
+    .addOperand("Src", OperandKind::In)
+    .addOperand("Filter", OperandKind::In)
+    .autoIRGen()
+    .autoVerify(VerifyKind::SameElementType, {"Dest", "Src", "Filter"});
+
+BB.newBackendSpecificInstr("CPUWinogradOutput")
+    .addOperand("Dest", OperandKind::Out)
+    .addOperand("Src", OperandKind::In)
+    .addOperand("Bias", OperandKind::In)
+    .addMember(MemberType::Unsigned, "Activation")
+    .addMember(MemberType::Float, "ActivationParam")
+    .autoIRGen()
+    .autoVerify(VerifyKind::SameElementType, {"Dest", "Src", "Bias"});
+
+BB.newBackendSpecificInstr("CPUSoftMaxTopK")
+    .addOperand("Values", OperandKind::Out)
+    .addOperand("Indices", OperandKind::Out)
+    .addOperand("Input", OperandKind::In)
+    .addMember(MemberType::SizeT, "K")
+    .autoIRGen()
+    .autoVerify(VerifyKind::SameElementType, {"Values", "Input"})
+    .autoVerify(VerifyKind::SameShape, {"Values", "Indices"});
+
+BB.newBackendSpecificInstr("CPUSoftMaxCrossEntropyLoss")
+    .addOperand("CE", OperandKind::Out)
+    .addOperand("Input", OperandKind::In)
+    .addOperand("Labels", OperandKind::In)
+    .autoIRGen()
+    .autoVerify(VerifyKind::SameElementType, {"CE", "Input"});
+
 BB.includeBackendSpecificVerification("CPUSpecificInstrsVerification.h");
 
 #endif // GLOW_WITH_CPU
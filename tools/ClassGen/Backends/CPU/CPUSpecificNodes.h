@@ -15,12 +15,6 @@
  */
 #ifdef GLOW_WITH_CPU
 
-BB.newBackendSpecificNode("CPUMaxSplat")
-    .addInput("Input")
-    .addResult("Input.getType()")
-    .addMember(MemberType::Float, "SplatValue")
-    .setDocstring("A Max node with one splat input; CPU specific.");
-
 BB.newNode("CPUConvDKKC8")
     .addInput("Input")
     .addInput("Filter")
@@ -28,9 +22,135 @@ BB.newNode("CPUConvDKKC8")
     .addMember(MemberType::SizeT, "Kernel")
     .addMember(MemberType::SizeT, "Stride")
     .addMember(MemberType::SizeT, "Pad")
+    .addMember(MemberType::Unsigned, "Activation")
+    .addMember(MemberType::Float, "ActivationParam")
     .addResultFromCtorArg()
     .setDocstring("This is a cpu-specific convolution implementation where the "
-                  "filter is transposed to the shape [D/8, K, K, C, 8]");
+                  "filter is transposed to the shape [D/B, K, K, C, B], where "
+                  "the block B is 8, or 16 with AVX-512. The CPUActivation "
+                  "Activation is applied to the result");
+
+BB.newNode("CPUResidualConvDKKC8")
+    .addInput("Input")
+    .addInput("Filter")
+    .addInput("Bias")
+    .addInput("Residual")
+    .addMember(MemberType::SizeT, "Kernel")
+    .addMember(MemberType::SizeT, "Stride")
+    .addMember(MemberType::SizeT, "Pad")
+    .addMember(MemberType::Unsigned, "Activation")
+    .addMember(MemberType::Float, "ActivationParam")
+    .addResultFromCtorArg()
+    .setDocstring("A CPUConvDKKC8 whose result is added to the Residual, e.g. "
+                  "the shortcut of a residual block, before the CPUActivation "
+                  "Activation is applied. The output starts with the sum of "
+                  "the Residual and the bias, instead of the bias");
+
+BB.newNode("CPUQuantizedConvDKKC8")
+    .addInput("Input")
+    .addInput("Filter")
+    .addInput("TapSums")
+    .addInput("Bias")
+    .addMember(MemberType::SizeT, "Kernel")
+    .addMember(MemberType::SizeT, "Stride")
+    .addMember(MemberType::SizeT, "Pad")
+    .addResultFromCtorArg()
+    .setDocstring("This is a cpu-specific int8 convolution where the filter, "
+                  "with its offset subtracted, is widened to int16 and "
+                  "transposed to the shape [D/8, K, K, C, 8]. TapSums "
+                  "[D/8, K, K, 8] holds the sums of the filter over the input "
+                  "channels for every tap, from which the kernel computes the "
+                  "correction for the input offset");
+
+BB.newNode("CPUConvNCHWc")
+    .addInput("Input")
+    .addInput("Filter")
+    .addInput("Bias")
+    .addMember(MemberType::SizeT, "Kernel")
+    .addMember(MemberType::SizeT, "Stride")
+    .addMember(MemberType::SizeT, "Pad")
+    .addMember(MemberType::Unsigned, "Activation")
+    .addMember(MemberType::Float, "ActivationParam")
+    .addResultFromCtorArg()
+    .setDocstring("This is a cpu-specific convolution on the blocked "
+                  "activation layout [N, C/8, H, W, 8], which produces the "
+                  "blocked result [N, D/8, H, W, 8]. The filter is "
+                  "transposed to the shape [D/8, C/8, K, K, 8, 8], where the "
+                  "last two dimensions are the input and the output channels "
+                  "of the blocks. The CPUActivation Activation is applied to "
+                  "the result");
+
+BB.newNode("CPUMatMulPacked")
+    .addInput("LHS")
+    .addInput("RHS")
+    .addResultFromCtorArg()
+    .setDocstring("This is a cpu-specific matrix multiplication where the "
+                  "constant RHS matrix (K, N) is pre-packed into panels of the "
+                  "shape [ceil(N/32), K, 32]");
+
+BB.newNode("CPUFullyConnectedPacked")
+    .addInput("LHS")
+    .addInput("RHS")
+    .addInput("Bias")
+    .addMember(MemberType::Unsigned, "Activation")
+    .addMember(MemberType::Float, "ActivationParam")
+    .addResultFromCtorArg()
+    .setDocstring("A CPUMatMulPacked that adds the Bias to every row of the "
+                  "result and applies the CPUActivation Activation to it; CPU "
+                  "specific");
+
+BB.newNode("CPUIm2Col")
+    .addInput("Input")
+    .addMember(MemberType::SizeT, "Kernel")
+    .addMember(MemberType::SizeT, "Stride")
+    .addMember(MemberType::SizeT, "Pad")
+    .addResultFromCtorArg()
+    .setDocstring("Unfolds the NHWC input into a matrix of the shape "
+                  "[N * OH * OW, K * K * C], where each row is the input patch "
+                  "of one output pixel; CPU specific");
+
+BB.newNode("CPUWinogradInput")
+    .addInput("Input")
+    .addMember(MemberType::SizeT, "Pad")
+    .addResultFromCtorArg()
+    .setDocstring("Transforms the 4x4 input tiles of a Winograd F(2x2, 3x3) "
+                  "convolution into a [16, T, C] tensor, where T is the "
+                  "number of tiles; CPU specific");
+
+BB.newNode("CPUWinogradMultiply")
+    .addInput("Input")
+    .addInput("Filter")
+    .addResultFromCtorArg()
+    .setDocstring("Multiplies the transformed input tiles [16, T, C] with the "
+                  "transformed filter, which is pre-packed into the shape "
+                  "[16, ceil(D/32), C, 32]; CPU specific");
+
+BB.newNode("CPUWinogradOutput")
+    .addInput("Input")
+    .addInput("Bias")
+    .addMember(MemberType::Unsigned, "Activation")
+    .addMember(MemberType::Float, "ActivationParam")
+    .addResultFromCtorArg()
+    .setDocstring("Transforms the [16, T, D] products of a Winograd "
+                  "F(2x2, 3x3) convolution into the NHWC output, adds the "
+                  "bias and applies the CPUActivation Activation; CPU "
+                  "specific");
+
+BB.newNode("CPUSoftMaxTopK")
+    .addInput("Input")
+    .addMember(MemberType::SizeT, "K")
+    .addResultFromCtorArg("Values")
+    .addResultFromCtorArg("Indices")
+    .setDocstring("A TopK of the SoftMax of Input, which normalizes only the "
+                  "selected elements; CPU specific");
+
+BB.newNode("CPUSoftMaxCrossEntropyLoss")
+    .addInput("Input")
+    .addInput("Labels")
+    .addResultFromCtorArg("CE")
+    .setDocstring("A CrossEntropyLoss of the SoftMax of Input, which is "
+                  "computed from the logits without the distribution; CPU "
+                  "specific");
 
 BB.includeBackendSpecificVerification("CPUSpecificNodesVerification.h");
 
@@ -15,12 +15,17 @@
  */
 #ifdef GLOW_WITH_CPU
 
-void CPUMaxSplatNode::verify() const {
-  assert(getInput().getType() == getResult().getType() && "Invalid type");
-  assert(getInput().dims() == getResult().dims() && "Invalid shape");
+void CPUConvDKKC8Node::verify() const {
+  ShapeNHWC idim(getInput().getType()->dims());
+  ShapeNHWC odim(getResult().getType()->dims());
+  auto outSz = calculateConvOutputDims(idim.h, idim.w, getKernel(), getStride(),
+                                       getPad());
+  ShapeNHWC exp(idim.n, outSz.first, outSz.second, getBias().dims()[0]);
+  (void)exp;
+  assert(exp == odim && "Invalid output dimensions");
 }
 
-void CPUConvDKKC8Node::verify() const {
+void CPUResidualConvDKKC8Node::verify() const {
   ShapeNHWC idim(getInput().getType()->dims());
   ShapeNHWC odim(getResult().getType()->dims());
   auto outSz = calculateConvOutputDims(idim.h, idim.w, getKernel(), getStride(),
@@ -28,6 +33,161 @@ void CPUConvDKKC8Node::verify() const {
   ShapeNHWC exp(idim.n, outSz.first, outSz.second, getBias().dims()[0]);
   (void)exp;
   assert(exp == odim && "Invalid output dimensions");
+  assert(getResidual().getType() == getResult().getType() &&
+         "Invalid residual type");
+}
+
+void CPUQuantizedConvDKKC8Node::verify() const {
+  ShapeNHWC idim(getInput().getType()->dims());
+  ShapeNHWC odim(getResult().getType()->dims());
+  auto filter = getFilter().dims();
+  auto tapSums = getTapSums().dims();
+  auto outSz = calculateConvOutputDims(idim.h, idim.w, getKernel(), getStride(),
+                                       getPad());
+  ShapeNHWC exp(idim.n, outSz.first, outSz.second, getBias().dims()[0]);
+  (void)exp;
+  (void)filter;
+  (void)tapSums;
+  assert(exp == odim && "Invalid output dimensions");
+  assert(filter.size() == 5 && filter[0] * 8 == odim.c &&
+         filter[1] == getKernel() && filter[2] == getKernel() &&
+         filter[3] == idim.c && filter[4] == 8 && "Invalid filter shape");
+  assert(getFilter().getElementType() == ElemKind::Int16QTy &&
+         "Invalid filter type");
+  assert(tapSums.size() == 4 && tapSums[0] == filter[0] &&
+         tapSums[1] == getKernel() && tapSums[2] == getKernel() &&
+         tapSums[3] == 8 && "Invalid tap sums shape");
+  assert(getTapSums().getElementType() == ElemKind::Int32QTy &&
+         "Invalid tap sums type");
+}
+
+void CPUConvNCHWcNode::verify() const {
+  auto in = getInput().dims();
+  auto filter = getFilter().dims();
+  auto dest = getResult().dims();
+  (void)in;
+  (void)filter;
+  (void)dest;
+  assert(in.size() == 5 && dest.size() == 5 && in[4] == 8 && dest[4] == 8 &&
+         "Invalid blocked shape");
+  assert(filter.size() == 6 && filter[4] == 8 && filter[5] == 8 &&
+         "Invalid blocked filter shape");
+  assert(filter[0] == dest[1] && filter[1] == in[1] &&
+         filter[2] == getKernel() && filter[3] == getKernel() &&
+         "Mismatched filter shape");
+  auto outSz = calculateConvOutputDims(in[2], in[3], getKernel(), getStride(),
+                                       getPad());
+  (void)outSz;
+  assert(in[0] == dest[0] && dest[2] == outSz.first &&
+         dest[3] == outSz.second && "Invalid output dimensions");
+  assert(getBias().dims().size() == 1 && getBias().dims()[0] == 8 * dest[1] &&
+         "Invalid bias size");
+}
+
+void CPUMatMulPackedNode::verify() const {
+  auto lhs = getLHS().dims();
+  auto rhs = getRHS().dims();
+  auto dest = getResult().dims();
+  (void)lhs;
+  (void)rhs;
+  (void)dest;
+  assert(lhs.size() == 2 && dest.size() == 2 && "Invalid matrix shape");
+  assert(rhs.size() == 3 && rhs[2] == 32 && "Invalid packed matrix shape");
+  assert(lhs[0] == dest[0] && "Mismatched matrix sizes");
+  assert(lhs[1] == rhs[1] && "Mismatched matrix sizes");
+  assert(rhs[0] == (dest[1] + 31) / 32 && "Mismatched matrix sizes");
+}
+
+void CPUFullyConnectedPackedNode::verify() const {
+  auto lhs = getLHS().dims();
+  auto rhs = getRHS().dims();
+  auto dest = getResult().dims();
+  (void)lhs;
+  (void)rhs;
+  (void)dest;
+  assert(lhs.size() == 2 && dest.size() == 2 && "Invalid matrix shape");
+  assert(rhs.size() == 3 && rhs[2] == 32 && "Invalid packed matrix shape");
+  assert(lhs[0] == dest[0] && "Mismatched matrix sizes");
+  assert(lhs[1] == rhs[1] && "Mismatched matrix sizes");
+  assert(rhs[0] == (dest[1] + 31) / 32 && "Mismatched matrix sizes");
+  assert(getBias().dims().size() == 1 && getBias().dims()[0] == dest[1] &&
+         "Invalid bias size");
+}
+
+void CPUIm2ColNode::verify() const {
+  ShapeNHWC idim(getInput().getType()->dims());
+  auto dest = getResult().dims();
+  auto outSz = calculateConvOutputDims(idim.h, idim.w, getKernel(), getStride(),
+                                       getPad());
+  (void)dest;
+  (void)outSz;
+  assert(dest.size() == 2 && "Invalid matrix shape");
+  assert(dest[0] == idim.n * outSz.first * outSz.second &&
+         "Invalid number of rows");
+  assert(dest[1] == getKernel() * getKernel() * idim.c &&
+         "Invalid number of columns");
+  assert(getInput().getElementType() == getResult().getElementType() &&
+         "Invalid element type");
+}
+
+void CPUWinogradInputNode::verify() const {
+  ShapeNHWC idim(getInput().getType()->dims());
+  auto dest = getResult().dims();
+  auto outSz = calculateConvOutputDims(idim.h, idim.w, 3, 1, getPad());
+  (void)dest;
+  (void)outSz;
+  assert(dest.size() == 3 && dest[0] == 16 && "Invalid tile shape");
+  assert(dest[1] == idim.n * ((outSz.first + 1) / 2) *
+                        ((outSz.second + 1) / 2) &&
+         "Invalid number of tiles");
+  assert(dest[2] == idim.c && "Invalid number of channels");
+}
+
+void CPUWinogradMultiplyNode::verify() const {
+  auto in = getInput().dims();
+  auto filter = getFilter().dims();
+  auto dest = getResult().dims();
+  (void)in;
+  (void)filter;
+  (void)dest;
+  assert(in.size() == 3 && dest.size() == 3 && "Invalid tile shape");
+  assert(filter.size() == 4 && filter[0] == 16 && filter[3] == 32 &&
+         "Invalid packed filter shape");
+  assert(in[0] == 16 && dest[0] == 16 && in[1] == dest[1] &&
+         "Mismatched tile shapes");
+  assert(in[2] == filter[2] && "Mismatched number of channels");
+  assert(filter[1] == (dest[2] + 31) / 32 && "Mismatched output depth");
+}
+
+void CPUWinogradOutputNode::verify() const {
+  ShapeNHWC odim(getResult().getType()->dims());
+  auto in = getInput().dims();
+  (void)odim;
+  (void)in;
+  assert(in.size() == 3 && in[0] == 16 && "Invalid tile shape");
+  assert(in[1] == odim.n * ((odim.h + 1) / 2) * ((odim.w + 1) / 2) &&
+         "Invalid number of tiles");
+  assert(in[2] == odim.c && getBias().dims()[0] == odim.c &&
+         "Invalid output depth");
+}
+
+void CPUSoftMaxTopKNode::verify() const {
+  auto in = getInput().dims();
+  auto values = getValues().dims();
+  (void)in;
+  (void)values;
+  assert(in.size() == 2 && values.size() == 2 && in[0] == values[0] &&
+         values[1] == getK() && getK() <= in[1] && "Invalid TopK shape");
+  assert(getIndices().dims() == values && "Mismatched values and indices");
+}
+
+void CPUSoftMaxCrossEntropyLossNode::verify() const {
+  auto in = getInput().dims();
+  (void)in;
+  assert(in.size() == 2 && getLabels().dims().size() == 1 &&
+         getLabels().dims()[0] == in[0] && "Mismatched batch size");
+  assert(getCE().dims().size() == 1 && getCE().dims()[0] == 1 &&
+         "Invalid loss shape");
 }
 
 #endif // GLOW_WITH_CPU
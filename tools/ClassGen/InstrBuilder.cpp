@@ -205,6 +205,7 @@ void InstrBuilder::emitClass(std::ostream &os) const {
   }
 
   os << "\n  void dump(llvm::raw_ostream &os) const;\n";
+  os << "  Instruction *clone() const;\n";
 
   // If there is no auto-verification then we assume verification is manually
   // provided.
@@ -252,8 +253,25 @@ void InstrBuilder::emitClass(std::ostream &os) const {
   os << "};\n} // namespace glow\n";
 }
 
+void InstrBuilder::emitCloner(std::ostream &os) const {
+  os << "\nInstruction *" << name_ << "Inst::clone() const {\n";
+  os << "  return new " << name_ << "Inst(getParent(), getName()";
+
+  // The operands of the instruction class:
+  for (const auto &op : operands_) {
+    os << ", get" << op.first << "()";
+  }
+
+  // Extra class members:
+  for (const auto &op : members_) {
+    os << ", " << op.second << "_";
+  }
+  os << ");\n}\n";
+}
+
 void InstrBuilder::emitCppMethods(std::ostream &os) const {
   emitPrettyPrinter(os);
+  emitCloner(os);
 
   // Emit the "extra" method bodies.
   for (const auto &m : extraMethods_) {
@@ -266,6 +284,19 @@ InstrBuilder::~InstrBuilder() {
   emitCppMethods(cppStream);
   emitIRBuilderMethods(builderHeaderStream, builderCppStream);
   emitAutoIRGen(irGenStream);
+  emitLibjitKernel(defStream);
+}
+
+void InstrBuilder::emitLibjitKernel(std::ostream &os) const {
+  if (libjitKernel_.empty()) {
+    return;
+  }
+  if (libjitImm_.empty()) {
+    os << "DEF_LIBJIT_KERNEL(" << name_ << "Inst, " << libjitKernel_ << ")\n";
+    return;
+  }
+  os << "DEF_LIBJIT_KERNEL_WITH_IMM(" << name_ << "Inst, " << libjitKernel_
+     << ", " << libjitImm_ << ")\n";
 }
 
 void InstrBuilder::addGradientInstr(
@@ -327,8 +358,8 @@ void InstrBuilder::emitAutoIRGen(std::ostream &os) const {
 
   // Note: The convention is for Nodes to have 'Input's and 'Output's, and for
   // Instrs to have 'Src's and 'Dest's. Thus we map between the two below.
-  std::string destOpName = "";
-  std::string resNodeName = "";
+  // Format: (operand name, node result name).
+  std::vector<std::pair<std::string, std::string>> results;
   for (const auto &opPair : operands_) {
     if (opPair.second == OperandKind::In) {
       const std::string opNodeName =
@@ -336,24 +367,27 @@ void InstrBuilder::emitAutoIRGen(std::ostream &os) const {
       os << "  auto *" << opPair.first << " = valueForNode(CN__->get"
          << opNodeName << "());\n";
     } else if (opPair.second == OperandKind::Out) {
-      assert(resNodeName.empty() && destOpName.empty() &&
-             "Must have multiple results; don't support autogen yet.");
-      resNodeName = (opPair.first == "Dest") ? "Result" : opPair.first;
-      destOpName = opPair.first;
+      results.push_back(
+          {opPair.first, (opPair.first == "Dest") ? "Result" : opPair.first});
     }
   }
 
-  assert(!resNodeName.empty() && !destOpName.empty() &&
+  assert(!results.empty() &&
          "Didn't find a result; Maybe using InOut which isn't yet supported");
-  os << "  std::string allocName = std::string(N->getName()) + \".res\";\n";
-  os << "  auto *dest__ = builder_.createAllocActivationInst(allocName,"
-     << "CN__->get" << resNodeName << "()->getType());\n";
+
+  // Allocate the results. A single result is named after the node, and
+  // multiple results are named after their operands.
+  for (const auto &res : results) {
+    os << "  auto *" << res.first << "__ = builder_.createAllocActivationInst("
+       << "std::string(N->getName()) + \"."
+       << (results.size() == 1 ? "res" : glow::tolower(res.first))
+       << "\", CN__->get" << res.second << "()->getType());\n";
+  }
   os << "  auto *V = builder_.create" << name_ << "Inst(\"" << autoIRGenNodeName
-     << "\", dest__";
+     << "\"";
   for (const auto &opPair : operands_) {
-    if (opPair.second == OperandKind::In) {
-      os << ", " << opPair.first;
-    }
+    os << ", " << opPair.first
+       << (opPair.second == OperandKind::Out ? "__" : "");
   }
   for (const auto &memPair : members_) {
     os << ", CN__->get" << memPair.second << "()";
@@ -363,7 +397,10 @@ void InstrBuilder::emitAutoIRGen(std::ostream &os) const {
   os << "  V->setName(N->getName());\n";
   os << "  if (N->hasPredicate()) { "
         "V->setPredicate(valueForNode(N->getPredicate())); }";
-  os << "  registerIR(N, V->get" << destOpName << "());\n";
+  for (const auto &res : results) {
+    os << "  registerIR(CN__->get" << res.second << "(), V->get" << res.first
+       << "());\n";
+  }
   os << "  nodeToInstr_[N] = V;\n";
   os << "  break;\n";
   os << "}\n";
@@ -79,6 +79,11 @@ class InstrBuilder {
   /// If autoIRGen is used on this Instr, this is the name of the Node that
   /// generates to this Instr. If left empty then autoIRGen is not used.
   std::string autoIRGenNodeName;
+  /// The name of the data-parallel libjit kernel of this Instr and the member
+  /// that it takes as an immediate. If left empty then the Instr is not bound
+  /// to a kernel.
+  std::string libjitKernel_;
+  std::string libjitImm_;
 
   /// Header file stream.
   std::ofstream &headerStream;
@@ -151,7 +156,7 @@ public:
   InstrBuilder &inplaceOperand(llvm::ArrayRef<llvm::StringRef> lst) {
     assert(lst.size() > 1 && "Not enough operands");
     assert(!inplaceOperands_.size() && "Initializing field twice");
-    inplaceOperands_.insert(inplaceOperands_.begin(), lst.begin(), lst.end());
+    for (auto s : lst) inplaceOperands_.push_back(s.str());
     return *this;
   }
 
@@ -174,8 +179,7 @@ public:
       assert(operands.size() > 1 && "Must list 2 or more operands.");
     }
     auto newPair = std::make_pair(verif, std::vector<std::string>());
-    newPair.second.insert(newPair.second.begin(), operands.begin(),
-                          operands.end());
+    for (auto s : operands) newPair.second.push_back(s.str());
     autoVerificationPairs_.push_back(newPair);
     return *this;
   }
@@ -185,6 +189,19 @@ public:
     return *this;
   }
 
+  /// Binds this data-parallel Instr to the libjit kernel \p name, which
+  /// computes an element of Dest from the value of the member \p imm, if it
+  /// is not empty, and from the input operands, in order. The binding is
+  /// declared in the def file, where the backends that call libjit find the
+  /// kernels of the unquantized element types.
+  InstrBuilder &libjitKernel(const std::string &name,
+                             const std::string &imm = "") {
+    assert(isDataParallel_ && "The kernels compute a single element");
+    libjitKernel_ = name;
+    libjitImm_ = imm;
+    return *this;
+  }
+
   ~InstrBuilder();
 
 private:
@@ -220,6 +237,10 @@ private:
   /// Emit the methods that print a textual summary.
   void emitPrettyPrinter(std::ostream &os) const;
 
+  /// Emit the method that creates a copy of the instruction, with the same
+  /// operands, that is not inserted into the function.
+  void emitCloner(std::ostream &os) const;
+
   /// Emit the class definition.
   void emitClass(std::ostream &os) const;
 
@@ -229,6 +250,9 @@ private:
 
   /// Adds a case to AutoIRGen for generating this Instr from a Node.
   void emitAutoIRGen(std::ostream &os) const;
+
+  /// Declares the libjit kernel of this Instr in the def file.
+  void emitLibjitKernel(std::ostream &os) const;
 };
 
 class Builder {
@@ -267,6 +291,12 @@ public:
            "#endif\n"
            "#ifndef DEF_INSTR_RANGE\n"
            "#define DEF_INSTR_RANGE(ID, FIRST, LAST)\n"
+           "#endif\n"
+           "#ifndef DEF_LIBJIT_KERNEL\n"
+           "#define DEF_LIBJIT_KERNEL(CLASS, KERNEL)\n"
+           "#endif\n"
+           "#ifndef DEF_LIBJIT_KERNEL_WITH_IMM\n"
+           "#define DEF_LIBJIT_KERNEL_WITH_IMM(CLASS, KERNEL, IMM)\n"
            "#endif\n";
 
     builderCppStream << "#include \"glow/IR/IRBuilder.h\"\n"
@@ -280,7 +310,9 @@ public:
               << ", " << lastInstr << "Inst"
               << ")\n";
 
-    defStream << "#undef DEF_INSTR_RANGE\n"
+    defStream << "#undef DEF_LIBJIT_KERNEL_WITH_IMM\n"
+                 "#undef DEF_LIBJIT_KERNEL\n"
+                 "#undef DEF_INSTR_RANGE\n"
                  "#undef DEF_INSTR\n"
                  "#undef DEF_BACKEND_SPECIFIC_INSTR\n"
                  "#undef DEF_VALUE";
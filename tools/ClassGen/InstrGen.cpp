@@ -51,9 +51,12 @@ int main(int argc, char **argv) {
       .addMember(MemberType::TypeRef, "Ty")
       .setType("Ty");
 
+  /// A view of the elements of Src that start at Offsets, which are empty if
+  /// the view starts at the first element of Src.
   BB.newInstr("TensorView")
       .addOperand("Src", OperandKind::In)
       .addMember(MemberType::TypeRef, "Ty")
+      .addMember(MemberType::VectorSizeT, "Offsets")
       .setType("Ty");
 
   BB.newInstr("DeallocActivation")
@@ -85,8 +88,7 @@ int main(int argc, char **argv) {
       .addMember(MemberType::SizeT, "Pad")
       .addMember(MemberType::SizeT, "Group")
       .autoIRGen()
-      .autoVerify(VerifyKind::SameElementType,
-                  {"Dest", "Src", "Filter", "Bias"})
+      .autoVerify(VerifyKind::SameElementType, {"Dest", "Src"})
       .addGradientInstr({"Src", "Filter"}, {"Dest", "Src", "Filter", "Bias"});
 
   // PoolMax version caching XY coordinates to speedup gradient-based
@@ -139,6 +141,26 @@ int main(int argc, char **argv) {
       .autoVerify(VerifyKind::SameType, {"Dest", "Src", "Scale"})
       .addGradientInstr({"Dest", "Src", "Scale"}, {"Dest", "Src"});
 
+  /// Normalizes Src with the statistics of the batch, for training. The
+  /// statistics of every channel are blended into the running Mean and Var
+  /// with Momentum, and the blended ones normalize Src, like the lowered
+  /// graph. The kernels make two passes over Src, and the gradient two passes
+  /// over Src and DestGrad.
+  BB.newInstr("BatchNormalization")
+      .addOperand("Dest", OperandKind::Out)
+      .addOperand("Src", OperandKind::In)
+      .addOperand("Scale", OperandKind::In)
+      .addOperand("Bias", OperandKind::In)
+      .addOperand("Mean", OperandKind::InOut)
+      .addOperand("Var", OperandKind::InOut)
+      .addMember(MemberType::SizeT, "ChannelIdx")
+      .addMember(MemberType::Float, "Epsilon")
+      .addMember(MemberType::Float, "Momentum")
+      .autoVerify(VerifyKind::SameType, {"Dest", "Src"})
+      .autoVerify(VerifyKind::SameType, {"Scale", "Bias", "Mean", "Var"})
+      .addGradientInstr({"Src", "Scale", "Mean", "Var"},
+                        {"Dest", "Src", "Scale", "Bias"});
+
   //===--------------------------------------------------------------------===//
   //                      Loss functions
   //===--------------------------------------------------------------------===//
@@ -181,8 +203,24 @@ int main(int argc, char **argv) {
       .addOperand("Dest", OperandKind::Out)
       .addOperand("LHS", OperandKind::In)
       .addOperand("RHS", OperandKind::In)
-      .autoIRGen()
-      .autoVerify(VerifyKind::SameElementType, {"Dest", "LHS", "RHS"});
+      .addMember(MemberType::Unsigned, "TransposeLHS")
+      .addMember(MemberType::Unsigned, "TransposeRHS")
+      .autoIRGen();
+
+  /// Multiplies the 2D Src by the sparse weights in the compressed column
+  /// format, Values, Indices and Offsets, and adds the Bias.
+  BB.newInstr("SparseFullyConnected")
+      .addOperand("Dest", OperandKind::Out)
+      .addOperand("Src", OperandKind::In)
+      .addOperand("Values", OperandKind::In)
+      .addOperand("Indices", OperandKind::In)
+      .addOperand("Offsets", OperandKind::In)
+      .addOperand("Bias", OperandKind::In)
+      .autoVerify(VerifyKind::SameElementType,
+                  {"Dest", "Src", "Values", "Bias", "ElemKind::FloatTy"})
+      .autoVerify(VerifyKind::SameElementType,
+                  {"Indices", "Offsets", "ElemKind::Int32QTy"})
+      .autoIRGen();
 
   /// Accumulates all of the layers in the batch and produce a tensor that has
   /// the same dimensions as the input tensor without the first dimension.
@@ -192,6 +230,16 @@ int main(int argc, char **argv) {
       .autoVerify(VerifyKind::SameElementType, {"Dest", "Batch"})
       .autoIRGen();
 
+  /// Reduces the Src over the dimensions Axes with the ReduceMode Mode. The
+  /// Dest has the layout of the Src with the reduced dimensions removed.
+  BB.newInstr("Reduce")
+      .addOperand("Dest", OperandKind::Out)
+      .addOperand("Src", OperandKind::In)
+      .addMember(MemberType::VectorSizeT, "Axes")
+      .addMember(MemberType::Unsigned, "Mode")
+      .autoVerify(VerifyKind::SameElementType, {"Dest", "Src"})
+      .autoIRGen();
+
   /// Adds the 'Slice' operand to each one of the slices in the batch.
   BB.newInstr("BatchedAdd")
       .addOperand("Dest", OperandKind::Out)
@@ -207,6 +255,7 @@ int main(int argc, char **argv) {
       .addOperand("RHS", OperandKind::In)
       .inplaceOperand({"Dest", "LHS", "RHS"})
       .dataParallel()
+      .libjitKernel("element_add_kernel")
       .autoVerify(VerifyKind::SameShape, {"Dest", "LHS", "RHS"})
       .autoIRGen("Add");
 
@@ -216,6 +265,7 @@ int main(int argc, char **argv) {
       .addOperand("RHS", OperandKind::In)
       .inplaceOperand({"Dest", "LHS", "RHS"})
       .dataParallel()
+      .libjitKernel("element_sub_kernel")
       .autoVerify(VerifyKind::SameShape, {"Dest", "LHS", "RHS"})
       .autoIRGen("Sub");
 
@@ -225,6 +275,7 @@ int main(int argc, char **argv) {
       .addOperand("RHS", OperandKind::In)
       .inplaceOperand({"Dest", "LHS", "RHS"})
       .dataParallel()
+      .libjitKernel("element_mul_kernel")
       .autoVerify(VerifyKind::SameShape, {"Dest", "LHS", "RHS"})
       .autoIRGen("Mul");
 
@@ -234,6 +285,7 @@ int main(int argc, char **argv) {
       .addOperand("RHS", OperandKind::In)
       .inplaceOperand({"Dest", "LHS", "RHS"})
       .dataParallel()
+      .libjitKernel("element_div_kernel")
       .autoVerify(VerifyKind::SameShape, {"Dest", "LHS", "RHS"})
       .autoIRGen("Div");
 
@@ -243,6 +295,7 @@ int main(int argc, char **argv) {
       .addOperand("RHS", OperandKind::In)
       .inplaceOperand({"Dest", "LHS", "RHS"})
       .dataParallel()
+      .libjitKernel("elementmax_kernel")
       .autoVerify(VerifyKind::SameShape, {"Dest", "LHS", "RHS"})
       .autoIRGen("Max");
 
@@ -252,6 +305,7 @@ int main(int argc, char **argv) {
       .addOperand("RHS", OperandKind::In)
       .inplaceOperand({"Dest", "LHS", "RHS"})
       .dataParallel()
+      .libjitKernel("elementmin_kernel")
       .autoVerify(VerifyKind::SameShape, {"Dest", "LHS", "RHS"})
       .autoIRGen("Min");
 
@@ -261,6 +315,7 @@ int main(int argc, char **argv) {
       .addOperand("RHS", OperandKind::In)
       .inplaceOperand({"Dest", "LHS", "RHS"})
       .dataParallel()
+      .libjitKernel("element_cmp_lte_kernel")
       .autoVerify(VerifyKind::SameShape, {"Dest", "LHS", "RHS"})
       .autoIRGen("CmpLTE");
 
@@ -270,6 +325,7 @@ int main(int argc, char **argv) {
       .addMember(MemberType::Float, "Exp")
       .inplaceOperand({"Dest", "Base"})
       .dataParallel()
+      .libjitKernel("element_pow_kernel", "Exp")
       .autoVerify(VerifyKind::SameShape, {"Dest", "Base"})
       .autoIRGen("Pow");
 
@@ -280,9 +336,123 @@ int main(int argc, char **argv) {
       .addOperand("RHS", OperandKind::In)
       .inplaceOperand({"Dest", "LHS", "RHS", "Cond"})
       .dataParallel()
+      .libjitKernel("elementselect_kernel")
       .autoVerify(VerifyKind::SameShape, {"Dest", "Cond", "LHS", "RHS"})
       .autoIRGen("Select");
 
+  // The arithmetic with the value of a splat operand as an immediate.
+  BB.newInstr("ElementAddSplat")
+      .addOperand("Dest", OperandKind::Out)
+      .addOperand("Src", OperandKind::In)
+      .addMember(MemberType::Float, "SplatValue")
+      .inplaceOperand({"Dest", "Src"})
+      .dataParallel()
+      .libjitKernel("element_add_splat_kernel", "SplatValue")
+      .autoVerify(VerifyKind::SameShape, {"Dest", "Src"})
+      .autoIRGen("AddSplat");
+
+  BB.newInstr("ElementMulSplat")
+      .addOperand("Dest", OperandKind::Out)
+      .addOperand("Src", OperandKind::In)
+      .addMember(MemberType::Float, "SplatValue")
+      .inplaceOperand({"Dest", "Src"})
+      .dataParallel()
+      .libjitKernel("element_mul_splat_kernel", "SplatValue")
+      .autoVerify(VerifyKind::SameShape, {"Dest", "Src"})
+      .autoIRGen("MulSplat");
+
+  BB.newInstr("ElementMaxSplat")
+      .addOperand("Dest", OperandKind::Out)
+      .addOperand("Src", OperandKind::In)
+      .addMember(MemberType::Float, "SplatValue")
+      .inplaceOperand({"Dest", "Src"})
+      .dataParallel()
+      .libjitKernel("element_max_splat_kernel", "SplatValue")
+      .autoVerify(VerifyKind::SameShape, {"Dest", "Src"})
+      .autoIRGen("MaxSplat");
+
+  BB.newInstr("ElementMinSplat")
+      .addOperand("Dest", OperandKind::Out)
+      .addOperand("Src", OperandKind::In)
+      .addMember(MemberType::Float, "SplatValue")
+      .inplaceOperand({"Dest", "Src"})
+      .dataParallel()
+      .libjitKernel("element_min_splat_kernel", "SplatValue")
+      .autoVerify(VerifyKind::SameShape, {"Dest", "Src"})
+      .autoIRGen("MinSplat");
+
+  BB.newInstr("ElementSubSplatLHS")
+      .addOperand("Dest", OperandKind::Out)
+      .addOperand("Src", OperandKind::In)
+      .addMember(MemberType::Float, "SplatValue")
+      .inplaceOperand({"Dest", "Src"})
+      .dataParallel()
+      .libjitKernel("element_sub_splat_lhs_kernel", "SplatValue")
+      .autoVerify(VerifyKind::SameShape, {"Dest", "Src"})
+      .autoIRGen("SubSplatLHS");
+
+  BB.newInstr("ElementDivSplatLHS")
+      .addOperand("Dest", OperandKind::Out)
+      .addOperand("Src", OperandKind::In)
+      .addMember(MemberType::Float, "SplatValue")
+      .inplaceOperand({"Dest", "Src"})
+      .dataParallel()
+      .libjitKernel("element_div_splat_lhs_kernel", "SplatValue")
+      .autoVerify(VerifyKind::SameShape, {"Dest", "Src"})
+      .autoIRGen("DivSplatLHS");
+
+  BB.newInstr("ElementDivSplatRHS")
+      .addOperand("Dest", OperandKind::Out)
+      .addOperand("Src", OperandKind::In)
+      .addMember(MemberType::Float, "SplatValue")
+      .inplaceOperand({"Dest", "Src"})
+      .dataParallel()
+      .libjitKernel("element_div_splat_rhs_kernel", "SplatValue")
+      .autoVerify(VerifyKind::SameShape, {"Dest", "Src"})
+      .autoIRGen("DivSplatRHS");
+
+  BB.newInstr("ElementCmpLTESplatLHS")
+      .addOperand("Dest", OperandKind::Out)
+      .addOperand("Src", OperandKind::In)
+      .addMember(MemberType::Float, "SplatValue")
+      .inplaceOperand({"Dest", "Src"})
+      .dataParallel()
+      .libjitKernel("element_cmp_lte_splat_lhs_kernel", "SplatValue")
+      .autoVerify(VerifyKind::SameShape, {"Dest", "Src"})
+      .autoIRGen("CmpLTESplatLHS");
+
+  BB.newInstr("ElementCmpLTESplatRHS")
+      .addOperand("Dest", OperandKind::Out)
+      .addOperand("Src", OperandKind::In)
+      .addMember(MemberType::Float, "SplatValue")
+      .inplaceOperand({"Dest", "Src"})
+      .dataParallel()
+      .libjitKernel("element_cmp_lte_splat_rhs_kernel", "SplatValue")
+      .autoVerify(VerifyKind::SameShape, {"Dest", "Src"})
+      .autoIRGen("CmpLTESplatRHS");
+
+  BB.newInstr("ElementSelectSplatLHS")
+      .addOperand("Dest", OperandKind::Out)
+      .addOperand("Cond", OperandKind::In)
+      .addOperand("Src", OperandKind::In)
+      .addMember(MemberType::Float, "SplatValue")
+      .inplaceOperand({"Dest", "Src", "Cond"})
+      .dataParallel()
+      .libjitKernel("element_select_splat_lhs_kernel", "SplatValue")
+      .autoVerify(VerifyKind::SameShape, {"Dest", "Cond", "Src"})
+      .autoIRGen("SelectSplatLHS");
+
+  BB.newInstr("ElementSelectSplatRHS")
+      .addOperand("Dest", OperandKind::Out)
+      .addOperand("Cond", OperandKind::In)
+      .addOperand("Src", OperandKind::In)
+      .addMember(MemberType::Float, "SplatValue")
+      .inplaceOperand({"Dest", "Src", "Cond"})
+      .dataParallel()
+      .libjitKernel("element_select_splat_rhs_kernel", "SplatValue")
+      .autoVerify(VerifyKind::SameShape, {"Dest", "Cond", "Src"})
+      .autoIRGen("SelectSplatRHS");
+
   //===--------------------------------------------------------------------===//
   //                Non-linearities
   //===--------------------------------------------------------------------===//
@@ -295,6 +465,7 @@ int main(int argc, char **argv) {
           "Src",
       })
       .dataParallel()
+      .libjitKernel("sigmoid_kernel")
       .autoVerify(VerifyKind::SameType, {"Dest", "Src"})
       .autoIRGen();
 
@@ -306,9 +477,19 @@ int main(int argc, char **argv) {
           "Src",
       })
       .dataParallel()
+      .libjitKernel("tanh_kernel")
       .autoVerify(VerifyKind::SameType, {"Dest", "Src"})
       .autoIRGen();
 
+  BB.newInstr("LSTMUnit")
+      .addOperand("NewC", OperandKind::Out)
+      .addOperand("NewH", OperandKind::Out)
+      .addOperand("Input", OperandKind::In)
+      .addOperand("C", OperandKind::In)
+      .autoVerify(VerifyKind::SameType, {"NewC", "C"})
+      .autoVerify(VerifyKind::SameType, {"NewH", "C"})
+      .autoVerify(VerifyKind::SameElementType, {"Input", "C"});
+
   //===--------------------------------------------------------------------===//
   //                Shape transformations
   //===--------------------------------------------------------------------===//
@@ -332,6 +513,7 @@ int main(int argc, char **argv) {
       .addMember(MemberType::Float, "Value")
       .addOperand("Dest", OperandKind::Out)
       .dataParallel()
+      .libjitKernel("splat_kernel", "Value")
       .autoVerify(VerifyKind::NoVerify)
       .autoIRGen();
 
@@ -351,9 +533,20 @@ int main(int argc, char **argv) {
       .addOperand("Dest", OperandKind::Out)
       .addOperand("Data", OperandKind::In)
       .addOperand("Indices", OperandKind::In)
-      .autoVerify(VerifyKind::SameElementType, {"Dest", "Data"})
+      .autoVerify(VerifyKind::SameElementType, {"Dest", "Data"});
+
+  /// Sums the consecutive segments of Lengths slices of Data, gathered at
+  /// Indices and scaled by Weights, into the slices of Dest.
+  BB.newInstr("SparseLengthsWeightedSum")
+      .addOperand("Dest", OperandKind::Out)
+      .addOperand("Data", OperandKind::In)
+      .addOperand("Weights", OperandKind::In)
+      .addOperand("Indices", OperandKind::In)
+      .addOperand("Lengths", OperandKind::In)
+      .autoVerify(VerifyKind::SameElementType, {"Dest", "Data", "Weights"})
       .autoVerify(VerifyKind::SameElementType,
-                  {"Indices", "ElemKind::IndexTy"});
+                  {"Indices", "Lengths", "ElemKind::IndexTy"})
+      .autoIRGen();
 
   //===--------------------------------------------------------------------===//
   //             Instructions used for debugging/profiling/printing
@@ -363,6 +556,15 @@ int main(int argc, char **argv) {
       .addOperand("Src", OperandKind::In)
       .autoVerify(VerifyKind::NoVerify);
 
+  BB.newInstr("TensorStats")
+      .addOperand("Src", OperandKind::In)
+      .addOperand("Counters", OperandKind::InOut)
+      .addOperand("Range", OperandKind::InOut)
+      .autoVerify(VerifyKind::SameElementType, {"Src", "ElemKind::FloatTy"})
+      .autoVerify(VerifyKind::SameElementType, {"Range", "ElemKind::FloatTy"})
+      .autoVerify(VerifyKind::SameElementType,
+                  {"Counters", "ElemKind::IndexTy"});
+
   //===--------------------------------------------------------------------===//
   //             Instructions used for quantization
   //===--------------------------------------------------------------------===//
@@ -377,7 +579,6 @@ int main(int argc, char **argv) {
   BB.newInstr("Quantize")
       .addOperand("Dest", OperandKind::Out)
       .addOperand("Src", OperandKind::In)
-      .autoVerify(VerifyKind::SameElementType, {"Dest", "ElemKind::Int8QTy"})
       .autoVerify(VerifyKind::SameElementType, {"Src", "ElemKind::FloatTy"})
       .autoVerify(VerifyKind::SameShape, {"Dest", "Src"})
       .autoIRGen();
@@ -386,15 +587,90 @@ int main(int argc, char **argv) {
       .addOperand("Dest", OperandKind::Out)
       .addOperand("Src", OperandKind::In)
       .autoVerify(VerifyKind::SameElementType, {"Dest", "ElemKind::FloatTy"})
-      .autoVerify(VerifyKind::SameElementType, {"Src", "ElemKind::Int8QTy"})
       .autoVerify(VerifyKind::SameShape, {"Dest", "Src"})
       .autoIRGen();
 
   BB.newInstr("RescaleQuantized")
       .addOperand("Dest", OperandKind::Out)
       .addOperand("Src", OperandKind::In)
+      .autoVerify(VerifyKind::SameShape, {"Dest", "Src"})
+      .autoIRGen();
+
+  BB.newInstr("ChannelwiseQuantizedConvolution")
+      .addOperand("Dest", OperandKind::Out)
+      .addOperand("Src", OperandKind::In)
+      .addOperand("Filter", OperandKind::In)
+      .addOperand("Bias", OperandKind::In)
+      .addOperand("FilterScales", OperandKind::In)
+      .addOperand("FilterOffsets", OperandKind::In)
+      .addMember(MemberType::SizeT, "Kernel")
+      .addMember(MemberType::SizeT, "Stride")
+      .addMember(MemberType::SizeT, "Pad")
+      .addMember(MemberType::SizeT, "Group")
+      .autoVerify(VerifyKind::SameElementType,
+                  {"Dest", "Src", "Filter", "ElemKind::Int8QTy"})
+      .autoVerify(VerifyKind::SameElementType, {"Bias", "ElemKind::Int32QTy"})
+      .autoVerify(VerifyKind::SameElementType,
+                  {"FilterScales", "ElemKind::FloatTy"})
+      .autoVerify(VerifyKind::SameElementType,
+                  {"FilterOffsets", "ElemKind::Int32QTy"})
+      .autoIRGen();
+
+  BB.newInstr("ChannelwiseQuantizedFullyConnected")
+      .addOperand("Dest", OperandKind::Out)
+      .addOperand("Src", OperandKind::In)
+      .addOperand("Weights", OperandKind::In)
+      .addOperand("Bias", OperandKind::In)
+      .addOperand("WeightScales", OperandKind::In)
+      .addOperand("WeightOffsets", OperandKind::In)
+      .autoVerify(VerifyKind::SameElementType,
+                  {"Dest", "Src", "Weights", "ElemKind::Int8QTy"})
+      .autoVerify(VerifyKind::SameElementType, {"Bias", "ElemKind::Int32QTy"})
       .autoVerify(VerifyKind::SameElementType,
-                  {"Dest", "Src", "ElemKind::Int8QTy"})
+                  {"WeightScales", "ElemKind::FloatTy"})
+      .autoVerify(VerifyKind::SameElementType,
+                  {"WeightOffsets", "ElemKind::Int32QTy"})
+      .autoIRGen();
+
+  BB.newInstr("RowwiseQuantizedSparseLengthsWeightedSum")
+      .addOperand("Dest", OperandKind::Out)
+      .addOperand("Data", OperandKind::In)
+      .addOperand("Scales", OperandKind::In)
+      .addOperand("Offsets", OperandKind::In)
+      .addOperand("Weights", OperandKind::In)
+      .addOperand("Indices", OperandKind::In)
+      .addOperand("Lengths", OperandKind::In)
+      .autoVerify(VerifyKind::SameElementType, {"Data", "ElemKind::Int8QTy"})
+      .autoVerify(VerifyKind::SameElementType,
+                  {"Dest", "Scales", "Weights", "ElemKind::FloatTy"})
+      .autoVerify(VerifyKind::SameElementType,
+                  {"Offsets", "ElemKind::Int32QTy"})
+      .autoVerify(VerifyKind::SameElementType,
+                  {"Indices", "Lengths", "ElemKind::IndexTy"})
+      .autoIRGen();
+
+  BB.newInstr("RowwiseQuantizedGather")
+      .addOperand("Dest", OperandKind::Out)
+      .addOperand("Data", OperandKind::In)
+      .addOperand("Scales", OperandKind::In)
+      .addOperand("Offsets", OperandKind::In)
+      .addOperand("Indices", OperandKind::In)
+      .autoVerify(VerifyKind::SameElementType, {"Data", "ElemKind::Int8QTy"})
+      .autoVerify(VerifyKind::SameElementType,
+                  {"Dest", "Scales", "ElemKind::FloatTy"})
+      .autoVerify(VerifyKind::SameElementType,
+                  {"Offsets", "ElemKind::Int32QTy"})
+      .autoVerify(VerifyKind::SameElementType,
+                  {"Indices", "ElemKind::IndexTy"})
+      .autoIRGen();
+
+  //===--------------------------------------------------------------------===//
+  //                Instructions used for the conversion of the precision
+  //===--------------------------------------------------------------------===//
+
+  BB.newInstr("ConvertTo")
+      .addOperand("Dest", OperandKind::Out)
+      .addOperand("Src", OperandKind::In)
       .autoVerify(VerifyKind::SameShape, {"Dest", "Src"})
       .autoIRGen();
 
@@ -406,11 +682,59 @@ int main(int argc, char **argv) {
       .addOperand("Values", OperandKind::Out)
       .addOperand("Indices", OperandKind::Out)
       .addOperand("Input", OperandKind::In)
-      .addOperand("Scratch", OperandKind::InOut)
       .addMember(MemberType::SizeT, "K")
       .autoVerify(VerifyKind::SameElementType, {"Values", "Input"})
       .autoVerify(VerifyKind::SameShape, {"Values", "Indices"});
 
+  BB.newInstr("ScatterAssign")
+      .addOperand("Data", OperandKind::InOut)
+      .addOperand("Indices", OperandKind::In)
+      .addOperand("Slices", OperandKind::In)
+      .autoVerify(VerifyKind::SameElementType, {"Data", "Slices"})
+      .autoVerify(VerifyKind::SameElementType,
+                  {"Indices", "ElemKind::IndexTy"});
+
+  //===--------------------------------------------------------------------===//
+  //                Instructions used for network training
+  //===--------------------------------------------------------------------===//
+
+  /// Updates the Weight, and the momentum in Gsum, in a single pass over the
+  /// Gradient. Without momentum Gsum is void and is not accessed.
+  BB.newInstr("SGD")
+      .addOperand("Weight", OperandKind::InOut)
+      .addOperand("Gsum", OperandKind::InOut)
+      .addOperand("Gradient", OperandKind::In)
+      .addMember(MemberType::Float, "L1Decay")
+      .addMember(MemberType::Float, "L2Decay")
+      .addMember(MemberType::Float, "LearningRate")
+      .addMember(MemberType::Float, "Momentum")
+      .addMember(MemberType::Unsigned, "BatchSize")
+      .autoVerify(VerifyKind::SameType, {"Weight", "Gradient"});
+
+  //===--------------------------------------------------------------------===//
+  //                Control flow
+  //===--------------------------------------------------------------------===//
+
+  /// The loops run min(TripCount, MaxTripCount) times. MaxTripCount is the
+  /// number of the steps that the buffers of the body have room for.
+  BB.newInstr("LoopStart")
+      .addOperand("Counter", OperandKind::Out)
+      .addOperand("TripCount", OperandKind::In)
+      .addMember(MemberType::SizeT, "MaxTripCount")
+      .autoVerify(VerifyKind::SameElementType,
+                  {"Counter", "ElemKind::IndexTy"})
+      .autoVerify(VerifyKind::SameElementType,
+                  {"TripCount", "ElemKind::IndexTy"});
+
+  BB.newInstr("LoopEnd")
+      .addOperand("Counter", OperandKind::InOut)
+      .addOperand("TripCount", OperandKind::In)
+      .addMember(MemberType::SizeT, "MaxTripCount")
+      .autoVerify(VerifyKind::SameElementType,
+                  {"Counter", "ElemKind::IndexTy"})
+      .autoVerify(VerifyKind::SameElementType,
+                  {"TripCount", "ElemKind::IndexTy"});
+
   //===--------------------------------------------------------------------===//
   //                Backend-Specific Instructions
   //===--------------------------------------------------------------------===//
@@ -100,6 +100,19 @@ int main(int argc, char **argv) {
                     "Weights tensor are multiplied, and then the Bias tensor "
                     "is added to it, producing the Output.");
 
+  BB.newNode("SparseFullyConnected")
+      .addInput("Input")
+      .addInput("Values")
+      .addInput("Indices")
+      .addInput("Offsets")
+      .addInput("Bias")
+      .addResultFromCtorArg()
+      .setDocstring("Performs a FullyConnected of the 2D Input with sparse "
+                    "Weights. The nonzero weights of column d of the Weights "
+                    "are Values[Offsets[d]] to Values[Offsets[d + 1] - 1], "
+                    "and Indices holds their rows, the input channels they "
+                    "multiply.");
+
   //===--------------------------------------------------------------------===//
   //                     Normalization
   //===--------------------------------------------------------------------===//
@@ -225,6 +238,79 @@ int main(int argc, char **argv) {
                     "the value of Cond. Cond is generated by the compare "
                     "instruction, and is target- and type-specific.");
 
+  // The arithmetic with a splat operand, which takes the value of the splat
+  // as an immediate in place of the splat tensor. foldSplatOperands() creates
+  // them after lowering for the backends that support them.
+  BB.newNode("AddSplat")
+      .addInput("Input")
+      .addMember(MemberType::Float, "SplatValue")
+      .addResultFromCtorArg()
+      .setDocstring("Performs elementwise Input + SplatValue.");
+
+  BB.newNode("MulSplat")
+      .addInput("Input")
+      .addMember(MemberType::Float, "SplatValue")
+      .addResultFromCtorArg()
+      .setDocstring("Performs elementwise Input * SplatValue.");
+
+  BB.newNode("MaxSplat")
+      .addInput("Input")
+      .addMember(MemberType::Float, "SplatValue")
+      .addResultFromCtorArg()
+      .setDocstring("Performs elementwise max(Input, SplatValue).");
+
+  BB.newNode("MinSplat")
+      .addInput("Input")
+      .addMember(MemberType::Float, "SplatValue")
+      .addResultFromCtorArg()
+      .setDocstring("Performs elementwise min(Input, SplatValue).");
+
+  BB.newNode("SubSplatLHS")
+      .addInput("Input")
+      .addMember(MemberType::Float, "SplatValue")
+      .addResultFromCtorArg()
+      .setDocstring("Performs elementwise SplatValue - Input.");
+
+  BB.newNode("DivSplatLHS")
+      .addInput("Input")
+      .addMember(MemberType::Float, "SplatValue")
+      .addResultFromCtorArg()
+      .setDocstring("Performs elementwise SplatValue / Input.");
+
+  BB.newNode("DivSplatRHS")
+      .addInput("Input")
+      .addMember(MemberType::Float, "SplatValue")
+      .addResultFromCtorArg()
+      .setDocstring("Performs elementwise Input / SplatValue.");
+
+  BB.newNode("CmpLTESplatLHS")
+      .addInput("Input")
+      .addMember(MemberType::Float, "SplatValue")
+      .addResultFromCtorArg()
+      .setDocstring("Performs elementwise SplatValue <= Input.");
+
+  BB.newNode("CmpLTESplatRHS")
+      .addInput("Input")
+      .addMember(MemberType::Float, "SplatValue")
+      .addResultFromCtorArg()
+      .setDocstring("Performs elementwise Input <= SplatValue.");
+
+  BB.newNode("SelectSplatLHS")
+      .addInput("Cond")
+      .addInput("Input")
+      .addMember(MemberType::Float, "SplatValue")
+      .addResultFromCtorArg()
+      .setDocstring("Selects SplatValue where Cond is set and Input "
+                    "elsewhere.");
+
+  BB.newNode("SelectSplatRHS")
+      .addInput("Cond")
+      .addInput("Input")
+      .addMember(MemberType::Float, "SplatValue")
+      .addResultFromCtorArg()
+      .setDocstring("Selects Input where Cond is set and SplatValue "
+                    "elsewhere.");
+
   BB.newNode("BatchedAdd")
       .addInput("Batch")
       .addInput("Slice")
@@ -235,9 +321,15 @@ int main(int argc, char **argv) {
   BB.newNode("MatMul")
       .addInput("LHS")
       .addInput("RHS")
+      .addMember(MemberType::Unsigned, "TransposeLHS")
+      .addMember(MemberType::Unsigned, "TransposeRHS")
       .addResultFromCtorArg()
       .setDocstring("Performs matrix multiplication between the LHS RHS."
-                    "Example: (A, Z) x (Z, B) => (A, B)");
+                    "Example: (A, Z) x (Z, B) => (A, B). If TransposeLHS or "
+                    "TransposeRHS is set then the operand is stored "
+                    "transposed, e.g. the LHS as (Z, A). The transposed "
+                    "operands are only supported by the floating point "
+                    "matrix multiplication.");
 
   BB.newNode("BatchedReduceAdd")
       .addInput("Batch")
@@ -246,6 +338,16 @@ int main(int argc, char **argv) {
                     "tensor that has the same dimensions as the input tensor "
                     "without the first dimension.");
 
+  BB.newNode("Reduce")
+      .addInput("Input")
+      .addMember(MemberType::VectorSizeT, "Axes")
+      .addMember(MemberType::Unsigned, "Mode")
+      .addResultFromCtorArg()
+      .setDocstring("Reduces the Input over the dimensions Axes with the "
+                    "ReduceMode Mode. The result has the dimensions of the "
+                    "Input without the reduced ones, or with the reduced ones "
+                    "set to 1.");
+
   //===--------------------------------------------------------------------===//
   //                Non-linearities
   //===--------------------------------------------------------------------===//
@@ -271,6 +373,34 @@ int main(int argc, char **argv) {
       .setDocstring("Applies hyperbolic tangent to each element in the Input "
                     "tensor.");
 
+  BB.newNode("LSTMUnit")
+      .addInput("Input")
+      .addInput("C")
+      .addResult("C.getType()", "NewC")
+      .addResult("C.getType()", "NewH")
+      .addGradient()
+      .setDocstring("Computes one step of an LSTM cell. Input is the [B, 4H] "
+                    "matrix of the pre-activations of the forget, input, "
+                    "output and cell gates, in this order, and C is the [B, H] "
+                    "cell state. The new cell state is NewC = sigmoid(F) . C + "
+                    "sigmoid(I) . tanh(G) and the new hidden state is NewH = "
+                    "sigmoid(O) . tanh(NewC).");
+
+  BB.newNode("LSTMSequence")
+      .addInput("Gates")
+      .addInput("Wh")
+      .addInput("NumSteps")
+      .addResultFromCtorArg()
+      .setDocstring("Runs an LSTM cell over the first NumSteps steps of a "
+                    "sequence, with zero initial states. Gates is the "
+                    "[T, B, 4H] tensor of the input projections of the gates "
+                    "of every step, Wh is the [H, 4H] matrix of the hidden "
+                    "state projection and NumSteps is an index<1> tensor "
+                    "that is read when the code runs. The result is the "
+                    "[T, B, H] tensor of the hidden states of the steps. The "
+                    "node is computed in a loop over the steps instead of "
+                    "being unrolled.");
+
   //===--------------------------------------------------------------------===//
   //                Shape transformations
   //===--------------------------------------------------------------------===//
@@ -335,6 +465,19 @@ int main(int argc, char **argv) {
                     "{I_0, I_1, ... I_n, D_1, D_2, ... D_m}, where D_i and I_j "
                     "denote Data and Indices dimensions respectively.");
 
+  BB.newNode("SparseLengthsWeightedSum")
+      .addInput("Data")
+      .addInput("Weights")
+      .addInput("Indices")
+      .addInput("Lengths")
+      .addResultFromCtorArg()
+      .setDocstring("Gathers the slices of the outer-most dimension of Data "
+                    "indexed by Indices, scales them by Weights, and sums "
+                    "the consecutive segments of Lengths[i] slices into the "
+                    "slice i of the result, without materializing the "
+                    "gathered slices. Weights and Indices have one element "
+                    "per gathered slice.");
+
   //===--------------------------------------------------------------------===//
   //                Nodes used for network training
   //===--------------------------------------------------------------------===//
@@ -356,8 +499,11 @@ int main(int argc, char **argv) {
       .addMember(MemberType::Float, "Momentum")
       .addMember(MemberType::Unsigned, "BatchSize")
       .addOverwrittenInput("Weight")
+      .addOverwrittenInput("Gsum")
       .setHasSideEffects(true)
-      .setDocstring("Stochastic Gradient Descent node used during training.");
+      .setDocstring("Stochastic Gradient Descent node used during training. "
+                    "Gsum accumulates the momentum; without momentum it is "
+                    "void.");
 
   //===--------------------------------------------------------------------===//
   //                Nodes used by quantization.
@@ -390,6 +536,32 @@ int main(int argc, char **argv) {
           "ProfiledOutputNumber contains the position of the node's output "
           "which gets profiled.");
 
+  //===--------------------------------------------------------------------===//
+  //                Nodes used for instrumentation.
+  //===--------------------------------------------------------------------===//
+
+  BB.newNode("TensorStats")
+      .addInput("Input")
+      .addInput("Counters")
+      .addInput("Range")
+      .addMember(MemberType::String, "ProfiledNodeName")
+      .addMember(MemberType::Unsigned, "ProfiledOutputNumber")
+      .addExtraMethod("Variable *getCountersVar() const;",
+                      "Variable *TensorStatsNode::getCountersVar() const { "
+                      "return llvm::cast<Variable>(Counters_.getNode()); };")
+      .addExtraMethod("Variable *getRangeVar() const;",
+                      "Variable *TensorStatsNode::getRangeVar() const { "
+                      "return llvm::cast<Variable>(Range_.getNode()); };")
+      .addOverwrittenInput("Counters")
+      .addOverwrittenInput("Range")
+      .setHasSideEffects(true)
+      .setDocstring(
+          "Accumulate cheap statistics of the float Input tensor at every "
+          "run: Counters holds the number of runs, of elements, of NaNs, of "
+          "infinities and of zeros, and Range the min and the max of the "
+          "finite elements. ProfiledNodeName and ProfiledOutputNumber name "
+          "the observed result.");
+
   BB.newNode("Quantize")
       .addInput("Input")
       .addResultFromCtorArg()
@@ -411,6 +583,70 @@ int main(int argc, char **argv) {
       .setDocstring("Rescale input quantized tensor to a new Scale and "
                     "Offset.");
 
+  BB.newNode("ChannelwiseQuantizedConvolution")
+      .addInput("Input")
+      .addInput("Filter")
+      .addInput("Bias")
+      .addInput("FilterScales")
+      .addInput("FilterOffsets")
+      .addMember(MemberType::SizeT, "Kernel")
+      .addMember(MemberType::SizeT, "Stride")
+      .addMember(MemberType::SizeT, "Pad")
+      .addMember(MemberType::SizeT, "Group")
+      .addResultFromCtorArg()
+      .setDocstring("Performs a quantized Convolution where every output "
+                    "channel d of the Filter has its own scale and offset, "
+                    "FilterScales[d] and FilterOffsets[d]. The int32 Bias is "
+                    "quantized with the scale of the Input times "
+                    "FilterScales[d] and offset 0.");
+
+  BB.newNode("ChannelwiseQuantizedFullyConnected")
+      .addInput("Input")
+      .addInput("Weights")
+      .addInput("Bias")
+      .addInput("WeightScales")
+      .addInput("WeightOffsets")
+      .addResultFromCtorArg()
+      .setDocstring("Performs a quantized FullyConnected of the 2D Input, "
+                    "where every column d of the Weights has its own scale "
+                    "and offset, WeightScales[d] and WeightOffsets[d]. The "
+                    "int32 Bias is quantized with the scale of the Input "
+                    "times WeightScales[d] and offset 0.");
+
+  BB.newNode("RowwiseQuantizedSparseLengthsWeightedSum")
+      .addInput("Data")
+      .addInput("Scales")
+      .addInput("Offsets")
+      .addInput("Weights")
+      .addInput("Indices")
+      .addInput("Lengths")
+      .addResultFromCtorArg()
+      .setDocstring("Performs a SparseLengthsWeightedSum of the int8 2D Data, "
+                    "where every row r has its own scale and offset, "
+                    "Scales[r] and Offsets[r]. The result is float.");
+
+  BB.newNode("RowwiseQuantizedGather")
+      .addInput("Data")
+      .addInput("Scales")
+      .addInput("Offsets")
+      .addInput("Indices")
+      .addResultFromCtorArg()
+      .setDocstring("Performs a Gather of the rows of the int8 2D Data, where "
+                    "every row r has its own scale and offset, Scales[r] and "
+                    "Offsets[r]. The gathered rows are dequantized to the "
+                    "float result.");
+
+  //===--------------------------------------------------------------------===//
+  //                Nodes used for the conversion of the precision
+  //===--------------------------------------------------------------------===//
+
+  BB.newNode("ConvertTo")
+      .addInput("Input")
+      .addResultFromCtorArg()
+      .setDocstring("Convert the floating point input tensor to the floating "
+                    "point element type of the result, e.g. from float to "
+                    "float16. The shape of the tensor doesn't change.");
+
   //===--------------------------------------------------------------------===//
   //                Nodes used by RNN
   //===--------------------------------------------------------------------===//
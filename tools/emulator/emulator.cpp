@@ -14,4 +14,219 @@
  * limitations under the License.
  */
 
-int main() { return 0; }
+#include "glow/Base/Tensor.h"
+#include "glow/ExecutionEngine/ExecutionEngine.h"
+#include "glow/IR/PerfModel.h"
+#include "glow/Importer/Caffe2.h"
+#include "glow/Importer/ONNX.h"
+
+#include "llvm/Support/CommandLine.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/Format.h"
+#include "llvm/Support/raw_ostream.h"
+
+#include <string>
+#include <vector>
+
+using namespace glow;
+
+namespace {
+
+llvm::cl::OptionCategory emulatorCat("Emulator Options");
+
+llvm::cl::list<std::string> modelPathOpt(
+    "model",
+    llvm::cl::desc(
+        "Specify one of three:\n"
+        "1. Path to ONNX model file.\n"
+        "2. Two paths to Caffe2 model files: network structure and weight.\n"
+        "3. Path to directory with the Caffe2 network structure "
+        "<predict_net.pb> and weight <init_net.pb> files."),
+    llvm::cl::value_desc("modelPath"), llvm::cl::Required, llvm::cl::OneOrMore,
+    llvm::cl::cat(emulatorCat));
+llvm::cl::alias modelPathAOpt("m", llvm::cl::desc("Alias for -model"),
+                              llvm::cl::aliasopt(modelPathOpt),
+                              llvm::cl::cat(emulatorCat));
+
+llvm::cl::opt<std::string>
+    inputNameOpt("input", llvm::cl::desc("The name of the input of the model"),
+                 llvm::cl::init("data"), llvm::cl::cat(emulatorCat));
+
+llvm::cl::list<unsigned> inputDimsOpt(
+    "input-dims",
+    llvm::cl::desc("The dimensions of the input of the model. The first "
+                   "dimension is replaced by every one of the batch sizes"),
+    llvm::cl::CommaSeparated, llvm::cl::OneOrMore, llvm::cl::cat(emulatorCat));
+
+llvm::cl::list<unsigned>
+    batchSizesOpt("batch-sizes",
+                  llvm::cl::desc("The batch sizes to emulate (default 1)"),
+                  llvm::cl::CommaSeparated, llvm::cl::ZeroOrMore,
+                  llvm::cl::cat(emulatorCat));
+
+llvm::cl::opt<bool> instrsOpt(
+    "instrs",
+    llvm::cl::desc("Print the estimate of every instruction of the model"),
+    llvm::cl::init(false), llvm::cl::cat(emulatorCat));
+
+llvm::cl::opt<BackendKind> ExecutionBackend(
+    llvm::cl::desc("The backend whose instructions are emulated:"),
+    llvm::cl::values(clEnumValN(BackendKind::Interpreter, "interpreter",
+                                "Use interpreter"),
+                     clEnumValN(BackendKind::CPU, "cpu", "Use CPU"),
+                     clEnumValN(BackendKind::OpenCL, "opencl", "Use OpenCL")),
+    llvm::cl::init(BackendKind::Interpreter), llvm::cl::cat(emulatorCat));
+
+// The description of the emulated device. The defaults are those of
+// DeviceInfo.
+llvm::cl::OptionCategory deviceCat("Device Options");
+
+llvm::cl::opt<unsigned> coresOpt("cores",
+                                 llvm::cl::desc("The number of cores"),
+                                 llvm::cl::init(DeviceInfo().cores),
+                                 llvm::cl::cat(deviceCat));
+
+llvm::cl::opt<unsigned>
+    simdWidthOpt("simd-width",
+                 llvm::cl::desc("The number of float lanes of a vector"),
+                 llvm::cl::init(DeviceInfo().simdWidth),
+                 llvm::cl::cat(deviceCat));
+
+llvm::cl::opt<unsigned> fmaPerCycleOpt(
+    "fma-per-cycle",
+    llvm::cl::desc("The vector multiply-adds that a core issues per cycle"),
+    llvm::cl::init(DeviceInfo().fmaPerCycle), llvm::cl::cat(deviceCat));
+
+llvm::cl::opt<double> clockOpt("clock-ghz",
+                               llvm::cl::desc("The clock of the cores in GHz"),
+                               llvm::cl::init(DeviceInfo().clockGHz),
+                               llvm::cl::cat(deviceCat));
+
+llvm::cl::opt<unsigned>
+    l2SizeOpt("l2-kb",
+              llvm::cl::desc("The size of the private cache of a core in KB"),
+              llvm::cl::init(DeviceInfo().l2Size >> 10),
+              llvm::cl::cat(deviceCat));
+
+llvm::cl::opt<double> l2BandwidthOpt(
+    "l2-bandwidth",
+    llvm::cl::desc("The bandwidth of the private cache of a core in GB/s"),
+    llvm::cl::init(DeviceInfo().l2Bandwidth), llvm::cl::cat(deviceCat));
+
+llvm::cl::opt<unsigned>
+    llcSizeOpt("llc-kb",
+               llvm::cl::desc("The size of the shared last level cache in KB"),
+               llvm::cl::init(DeviceInfo().llcSize >> 10),
+               llvm::cl::cat(deviceCat));
+
+llvm::cl::opt<double> llcBandwidthOpt(
+    "llc-bandwidth",
+    llvm::cl::desc("The bandwidth of the shared last level cache in GB/s"),
+    llvm::cl::init(DeviceInfo().llcBandwidth), llvm::cl::cat(deviceCat));
+
+llvm::cl::opt<double>
+    memBandwidthOpt("mem-bandwidth",
+                    llvm::cl::desc("The bandwidth of the main memory in GB/s"),
+                    llvm::cl::init(DeviceInfo().memBandwidth),
+                    llvm::cl::cat(deviceCat));
+
+llvm::cl::opt<double> kernelOverheadOpt(
+    "kernel-overhead-us",
+    llvm::cl::desc("The time it takes to start a kernel in microseconds"),
+    llvm::cl::init(DeviceInfo().kernelOverheadUs), llvm::cl::cat(deviceCat));
+
+/// \returns the device that the options describe.
+DeviceInfo getDevice() {
+  DeviceInfo device;
+  device.cores = coresOpt;
+  device.simdWidth = simdWidthOpt;
+  device.fmaPerCycle = fmaPerCycleOpt;
+  device.clockGHz = clockOpt;
+  device.l2Size = size_t(l2SizeOpt) << 10;
+  device.l2Bandwidth = l2BandwidthOpt;
+  device.llcSize = size_t(llcSizeOpt) << 10;
+  device.llcBandwidth = llcBandwidthOpt;
+  device.memBandwidth = memBandwidthOpt;
+  device.kernelOverheadUs = kernelOverheadOpt;
+  return device;
+}
+
+/// Load the model with an input of the shape \p dims, compile it and
+/// \returns the estimate of its execution on \p device. The estimates of the
+/// instructions are printed with -instrs, and dropped, since the instructions
+/// are destroyed with the compiled model.
+PerfEstimate emulateModel(llvm::ArrayRef<size_t> dims,
+                          const DeviceInfo &device) {
+  ExecutionEngine EE(ExecutionBackend);
+  Function *F = EE.getModule().createFunction("model");
+  Tensor input(ElemKind::FloatTy, dims);
+  // The classifiers of the models take the expected labels as an input.
+  Tensor expectedSoftmax(ElemKind::IndexTy, {dims[0], 1});
+
+  if (modelPathOpt.size() == 2 ||
+      llvm::sys::fs::is_directory(modelPathOpt[0])) {
+    bool isDir = modelPathOpt.size() == 1;
+    std::string netDesc =
+        isDir ? modelPathOpt[0] + "/predict_net.pb" : modelPathOpt[0];
+    std::string netWeight =
+        isDir ? modelPathOpt[0] + "/init_net.pb" : modelPathOpt[1];
+    caffe2ModelLoader LD(netDesc, netWeight,
+                         {inputNameOpt.c_str(), "softmax_expected"},
+                         {&input, &expectedSoftmax}, *F);
+  } else {
+    ONNXModelLoader LD(modelPathOpt[0],
+                       {inputNameOpt.c_str(), "softmax_expected"},
+                       {&input, &expectedSoftmax}, *F);
+  }
+  EE.compile(CompilationMode::Infer, F);
+  PerfEstimate estimate = estimatePerf(&EE.getIR(), device);
+  if (instrsOpt) {
+    llvm::outs() << "Batch size " << dims[0] << ":\n";
+    dumpPerfEstimate(estimate, llvm::outs());
+    llvm::outs() << "\n";
+  }
+  estimate.instrs.clear();
+  return estimate;
+}
+
+} // namespace
+
+int main(int argc, char **argv) {
+  llvm::cl::ParseCommandLineOptions(
+      argc, argv,
+      " The Glow performance emulator\n\n"
+      "Compiles a model for a backend and predicts the latency of its "
+      "instructions and its peak memory on a device that the options "
+      "describe, without running it.\n");
+
+  if (modelPathOpt.size() > 2) {
+    llvm::errs() << "emulator: expected one or two model paths.\n";
+    return 1;
+  }
+
+  std::vector<unsigned> batchSizes(batchSizesOpt.begin(), batchSizesOpt.end());
+  if (batchSizes.empty()) {
+    batchSizes = {1};
+  }
+  DeviceInfo device = getDevice();
+  llvm::outs() << llvm::format("Device: %u cores, %.1f GFLOP/s, %.1f GB/s of "
+                               "memory\n\n",
+                               device.cores, device.getPeakFlops() / 1e9,
+                               device.memBandwidth);
+
+  std::vector<PerfEstimate> estimates;
+  for (auto batchSize : batchSizes) {
+    std::vector<size_t> dims(inputDimsOpt.begin(), inputDimsOpt.end());
+    dims[0] = batchSize;
+    estimates.push_back(emulateModel(dims, device));
+  }
+
+  llvm::outs() << "     batch  latency(ms)  throughput(/s)  peak memory(MB)\n";
+  for (size_t i = 0; i < batchSizes.size(); i++) {
+    const auto &E = estimates[i];
+    llvm::outs() << llvm::format("%10u %12.3f %15.1f %16.3f\n", batchSizes[i],
+                                 E.time * 1e3, batchSizes[i] / E.time,
+                                 E.getPeakMemory() / 1e6);
+  }
+  return 0;
+}
@@ -21,14 +21,29 @@
 #include "glow/Importer/Caffe2.h"
 #include "glow/Importer/ONNX.h"
 #include "glow/Quantization/Serialization.h"
+#include "glow/Support/Memory.h"
+#include "glow/Support/Parallel.h"
 
 #include "llvm/ADT/StringSwitch.h"
 #include "llvm/Support/CommandLine.h"
 #include "llvm/Support/FileSystem.h"
 #include "llvm/Support/FormatVariadic.h"
+#include "llvm/Support/Path.h"
 #include "llvm/Support/Timer.h"
 #include "llvm/Support/raw_ostream.h"
 
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <future>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
 using namespace glow;
 
 enum class ImageNormalizationMode {
@@ -59,46 +74,59 @@ std::pair<float, float> normModeToRange(ImageNormalizationMode mode) {
   GLOW_ASSERT(false && "Unknown image format");
 }
 
-/// Loads and normalizes all PNGs into a tensor in the NCHW 3x224x224 format.
+/// Loads all of the png and jpeg images into a tensor in the NCHW format with
+/// the channels in the BGR order, as the imagenet models expect. The images
+/// are decoded, resized, cropped and normalized as \p pp says straight into
+/// their slots of the tensor, in parallel, each by one of the hardware
+/// threads.
 void loadImagesAndPreprocess(const llvm::cl::list<std::string> &filenames,
-                             Tensor *result, ImageNormalizationMode normMode) {
+                             Tensor *result, ImagePreprocessing pp) {
   assert(filenames.size() > 0 &&
          "There must be at least one filename in filenames");
-  auto range = normModeToRange(normMode);
+  pp.bgr = true;
+  pp.chw = true;
   unsigned numImages = filenames.size();
 
   // Get first image's dimensions and check if grayscale or color.
   size_t imgHeight, imgWidth;
   bool isGray;
-  std::tie(imgHeight, imgWidth, isGray) = getPngInfo(filenames[0].c_str());
+  std::tie(imgHeight, imgWidth, isGray) = getImageInfo(filenames[0].c_str());
+  std::tie(imgHeight, imgWidth) = getPreprocessedSize(imgHeight, imgWidth, pp);
   const size_t numChannels = isGray ? 1 : 3;
 
   // N x C x H x W
   result->reset(ElemKind::FloatTy,
                 {numImages, numChannels, imgHeight, imgWidth});
-  auto RH = result->getHandle<>();
-  // We iterate over all the png files, reading them all into our result tensor
-  // for processing
-  for (unsigned n = 0; n < filenames.size(); n++) {
-    Tensor localCopy;
-    bool loadSuccess = !readPngImage(&localCopy, filenames[n].c_str(), range);
-    GLOW_ASSERT(loadSuccess && "Error reading input image.");
-    auto imageH = localCopy.getHandle<>();
-
-    auto dims = localCopy.dims();
-    assert((dims[0] == imgHeight && dims[1] == imgWidth) &&
-           "All images must have the same Height and Width");
-    assert(dims[2] == numChannels &&
-           "All images must have the same number of channels");
-
-    // Convert to BGR, as this is what imagenet models are expecting.
-    for (unsigned z = 0; z < numChannels; z++) {
-      for (unsigned y = 0; y < dims[1]; y++) {
-        for (unsigned x = 0; x < dims[0]; x++) {
-          RH.at({n, numChannels - 1 - z, x, y}) = (imageH.at({x, y, z}));
-        }
-      }
+  float *resultData = result->getRawDataPointer<float>();
+  const size_t imageSize = numChannels * imgHeight * imgWidth;
+
+  // Decode the image \p n into its slice of the result tensor.
+  auto loadImage = [&](unsigned n) {
+    bool failed = ::glow::loadImage(resultData + n * imageSize, imgHeight,
+                                    imgWidth, numChannels,
+                                    filenames[n].c_str(), pp);
+    (void)failed;
+    GLOW_ASSERT(!failed && "Error reading input image. All images must have "
+                           "the same number of channels, and the same Height "
+                           "and Width after the preprocessing.");
+  };
+
+  // The workers take the next image to decode from a shared counter.
+  std::atomic<unsigned> nextImage{0};
+  auto worker = [&]() {
+    for (unsigned n = nextImage++; n < numImages; n = nextImage++) {
+      loadImage(n);
     }
+  };
+  unsigned numThreads =
+      std::min(std::max(std::thread::hardware_concurrency(), 1u), numImages);
+  std::vector<std::thread> threads;
+  for (unsigned t = 1; t < numThreads; t++) {
+    threads.emplace_back(worker);
+  }
+  worker();
+  for (auto &thread : threads) {
+    thread.join();
   }
 }
 
@@ -139,6 +167,18 @@ llvm::cl::alias imageModeA("i", llvm::cl::desc("Alias for -image_mode"),
                            llvm::cl::aliasopt(imageMode),
                            llvm::cl::cat(loaderCat));
 
+llvm::cl::opt<unsigned> imageResizeOpt(
+    "image-resize",
+    llvm::cl::desc("Resize the images so that their shorter side has this "
+                   "size (default: keep their size)"),
+    llvm::cl::Optional, llvm::cl::init(0), llvm::cl::cat(loaderCat));
+
+llvm::cl::opt<unsigned> imageCropOpt(
+    "image-crop",
+    llvm::cl::desc("Crop a square of this size from the center of the "
+                   "resized images (default: keep them whole)"),
+    llvm::cl::Optional, llvm::cl::init(0), llvm::cl::cat(loaderCat));
+
 llvm::cl::opt<bool>
     verbose("verbose",
             llvm::cl::desc("Specify whether to run with verbose output"),
@@ -167,6 +207,85 @@ llvm::cl::opt<std::string> loadProfileFileOpt(
     llvm::cl::value_desc("profile.yaml"), llvm::cl::Optional,
     llvm::cl::cat(loaderCat));
 
+llvm::cl::opt<quantization::CalibrationKind> calibrationOpt(
+    "calibration",
+    llvm::cl::desc("Choose the quantized ranges from the loaded profile with "
+                   "the method:"),
+    llvm::cl::values(
+        clEnumValN(quantization::CalibrationKind::None, "none",
+                   "Cover the whole profiled range"),
+        clEnumValN(quantization::CalibrationKind::KLMinimization, "kl",
+                   "Clip the range to minimize the KL divergence between the "
+                   "profiled and the quantized distributions")),
+    llvm::cl::init(quantization::CalibrationKind::None),
+    llvm::cl::cat(loaderCat));
+
+llvm::cl::opt<bool> enableChannelwiseOpt(
+    "enable-channelwise",
+    llvm::cl::desc("Quantize the weights of the convolutions and the fully "
+                   "connected layers with a scale and offset per channel, "
+                   "and the embedding tables with a scale and offset per "
+                   "row"),
+    llvm::cl::Optional, llvm::cl::cat(loaderCat));
+
+llvm::cl::opt<float> maxInt8ErrorOpt(
+    "max-int8-error",
+    llvm::cl::desc("Quantize the activations of the convolutions and the "
+                   "matrix multiplications to int16 when the relative error "
+                   "of their int8 quantization exceeds this value"),
+    llvm::cl::init(0), llvm::cl::value_desc("error"), llvm::cl::Optional,
+    llvm::cl::cat(loaderCat));
+
+llvm::cl::opt<std::string> selectQuantizedNodesFileOpt(
+    "select_quantized_nodes",
+    llvm::cl::desc("Measure the error on the interpreter and the speedup on "
+                   "the backend of quantizing every node of the graph alone, "
+                   "keep in int8 the nodes that gain the most speed within "
+                   "-max-quantization-error, and write the loaded profile "
+                   "with the selection to the file"),
+    llvm::cl::value_desc("profile.yaml"), llvm::cl::Optional,
+    llvm::cl::cat(loaderCat));
+
+llvm::cl::opt<float> maxQuantizationErrorOpt(
+    "max-quantization-error",
+    llvm::cl::desc("The relative error of the results that the nodes selected "
+                   "by -select_quantized_nodes may add"),
+    llvm::cl::init(0.01), llvm::cl::value_desc("error"), llvm::cl::Optional,
+    llvm::cl::cat(loaderCat));
+
+llvm::cl::opt<unsigned> selectTimingRunsOpt(
+    "select-timing-runs",
+    llvm::cl::desc("The number of timed runs of every node that "
+                   "-select_quantized_nodes measures"),
+    llvm::cl::init(10), llvm::cl::Optional, llvm::cl::cat(loaderCat));
+
+llvm::cl::opt<bool> convertToFloat16Opt(
+    "convert-to-fp16",
+    llvm::cl::desc("Convert the nodes that the backend supports in float16 "
+                   "to float16"),
+    llvm::cl::Optional, llvm::cl::cat(loaderCat));
+
+llvm::cl::opt<unsigned> maxActivationsMBOpt(
+    "max-activations-mb",
+    llvm::cl::desc("The max number of megabytes of the activations that are "
+                   "live at once. The compilation reschedules the nodes and "
+                   "recomputes activations to fit, or fails with a report of "
+                   "the activations live at the peak"),
+    llvm::cl::init(0), llvm::cl::Optional, llvm::cl::cat(loaderCat));
+
+llvm::cl::opt<unsigned> numThreadsOpt(
+    "num-threads",
+    llvm::cl::desc("The number of threads of the pool that runs the parallel "
+                   "kernels of the Interpreter and of the CPU backend. Zero "
+                   "uses one thread per processor"),
+    llvm::cl::init(0), llvm::cl::Optional, llvm::cl::cat(loaderCat));
+
+llvm::cl::list<int> pinThreadsOpt(
+    "pin-threads",
+    llvm::cl::desc("The processors that the threads of the pool are pinned "
+                   "to, round-robin"),
+    llvm::cl::CommaSeparated, llvm::cl::ZeroOrMore, llvm::cl::cat(loaderCat));
+
 llvm::cl::opt<BackendKind> ExecutionBackend(
     llvm::cl::desc("Backend to use:"),
     llvm::cl::values(clEnumValN(BackendKind::Interpreter, "interpreter",
@@ -175,6 +294,25 @@ llvm::cl::opt<BackendKind> ExecutionBackend(
                      clEnumValN(BackendKind::OpenCL, "opencl", "Use OpenCL")),
     llvm::cl::init(BackendKind::Interpreter), llvm::cl::cat(loaderCat));
 
+/// Serving options.
+llvm::cl::OptionCategory serveCat("Serving Options");
+
+llvm::cl::opt<bool> serveOpt(
+    "serve",
+    llvm::cl::desc("Serve every input image as a separate request, batching "
+                   "the requests dynamically"),
+    llvm::cl::Optional, llvm::cl::cat(serveCat));
+
+llvm::cl::list<unsigned> serveBatchSizesOpt(
+    "serve-batch-sizes",
+    llvm::cl::desc("The batch sizes of the compiled variants of the model"),
+    llvm::cl::CommaSeparated, llvm::cl::ZeroOrMore, llvm::cl::cat(serveCat));
+
+llvm::cl::opt<unsigned> serveMaxLatencyOpt(
+    "serve-max-latency-ms",
+    llvm::cl::desc("How long a request may wait for a larger batch"),
+    llvm::cl::Optional, llvm::cl::init(5), llvm::cl::cat(serveCat));
+
 /// Debugging options.
 llvm::cl::OptionCategory
     modelExportCat("How to export the Glow Intermediate Representation/Graphs",
@@ -204,6 +342,12 @@ llvm::cl::opt<std::string>
     emitBundle("emit-bundle",
                llvm::cl::desc("Output directory for the bundle serialization"),
                llvm::cl::cat(loaderCat));
+
+llvm::cl::list<unsigned> bundleBatchSizesOpt(
+    "bundle-batch-sizes",
+    llvm::cl::desc("Emit a bundle with an entry for every one of the batch "
+                   "sizes, which share the constant weights"),
+    llvm::cl::CommaSeparated, llvm::cl::ZeroOrMore, llvm::cl::cat(loaderCat));
 } // namespace
 
 static bool commandLineIsInvalid() {
@@ -213,66 +357,128 @@ static bool commandLineIsInvalid() {
                  << " options may not be specified together.\n";
     return true;
   }
+  if (serveOpt && (!dumpProfileFileOpt.empty() || !emitBundle.empty())) {
+    llvm::errs() << "loader: the -" << serveOpt.ArgStr
+                 << " option may not be specified together with -"
+                 << dumpProfileFileOpt.ArgStr << " or -" << emitBundle.ArgStr
+                 << ".\n";
+    return true;
+  }
+  if (!selectQuantizedNodesFileOpt.empty() && loadProfileFileOpt.empty()) {
+    llvm::errs() << "loader: the -" << selectQuantizedNodesFileOpt.ArgStr
+                 << " option requires -" << loadProfileFileOpt.ArgStr << ".\n";
+    return true;
+  }
+  if (!selectQuantizedNodesFileOpt.empty() &&
+      (serveOpt || !bundleBatchSizesOpt.empty())) {
+    llvm::errs() << "loader: the -" << selectQuantizedNodesFileOpt.ArgStr
+                 << " option may not be specified together with -"
+                 << serveOpt.ArgStr << " or -" << bundleBatchSizesOpt.ArgStr
+                 << ".\n";
+    return true;
+  }
+  if (!bundleBatchSizesOpt.empty() && emitBundle.empty()) {
+    llvm::errs() << "loader: the -" << bundleBatchSizesOpt.ArgStr
+                 << " option requires -" << emitBundle.ArgStr << ".\n";
+    return true;
+  }
   return false;
 }
 
-int main(int argc, char **argv) {
-  llvm::cl::ParseCommandLineOptions(
-      argc, argv,
-      " The Glow compiler\n\n"
-      "Glow is a compiler for neural network accelerators.\n");
-
-  if (commandLineIsInvalid()) {
-    return 1;
-  }
-
-  Tensor data;
-  Tensor expectedSoftmax(ElemKind::IndexTy, {1, 1});
-
-  loadImagesAndPreprocess(inputImageFilenames, &data, imageMode);
-
-  assert(modelPathOpt.size() <= 2 &&
-         "-model flag should have either 1 or 2 paths assigned. "
-         "Please see flag's description.");
-
-  std::string caffe2NetDescFilename, caffe2NetWeightFilename, onnxModelFilename;
-  if (modelPathOpt.size() == 1) {
-    if (llvm::sys::fs::is_directory(*modelPathOpt.begin())) {
-      caffe2NetDescFilename = modelPathOpt[0] + "/predict_net.pb";
-      caffe2NetWeightFilename = modelPathOpt[0] + "/init_net.pb";
-    } else {
-      onnxModelFilename = modelPathOpt[0];
-    }
-  } else {
-    caffe2NetDescFilename = modelPathOpt[0];
-    caffe2NetWeightFilename = modelPathOpt[1];
-  }
+/// The files of the model to load.
+struct ModelFiles {
+  std::string caffe2NetDesc;
+  std::string caffe2NetWeight;
+  std::string onnxModel;
+};
 
-  ExecutionEngine EE(ExecutionBackend);
-  Function *F = EE.getModule().createFunction(modelPathOpt[0]);
+/// The nodes of a loaded model that the loader uses.
+struct LoadedModel {
+  Function *F;
   SaveNode *SM;
   Variable *i0;
   Variable *i1;
-  if (!caffe2NetDescFilename.empty()) {
-    caffe2ModelLoader LD(caffe2NetDescFilename, caffe2NetWeightFilename,
+};
+
+/// Load the model \p files into the function \p F, with the input shape of
+/// \p data.
+static LoadedModel loadModelFiles(Function *F, const ModelFiles &files,
+                                  Tensor &data) {
+  Tensor expectedSoftmax(ElemKind::IndexTy, {1, 1});
+  LoadedModel model;
+  model.F = F;
+  if (!files.caffe2NetDesc.empty()) {
+    caffe2ModelLoader LD(files.caffe2NetDesc, files.caffe2NetWeight,
                          {"data", "gpu_0/data", "softmax_expected"},
                          {&data, &data, &expectedSoftmax}, *F);
-    SM = LD.getRoot();
-    i0 = llvm::cast<Variable>(LD.getOrCreateNodeByName("gpu_0/data"));
-    i1 = llvm::cast<Variable>(LD.getOrCreateNodeByName("data"));
+    model.SM = LD.getRoot();
+    model.i0 = llvm::cast<Variable>(LD.getOrCreateNodeByName("gpu_0/data"));
+    model.i1 = llvm::cast<Variable>(LD.getOrCreateNodeByName("data"));
   } else {
-    assert(inputImageFilenames.size() == 1 &&
-           "Batch image inference is not supported by ONNX models.");
-    ONNXModelLoader LD(onnxModelFilename,
+    ONNXModelLoader LD(files.onnxModel,
                        {"data_0", "gpu_0/data_0", "softmax_expected"},
                        {&data, &data, &expectedSoftmax}, *F);
-    SM = LD.getRoot();
-    i0 = llvm::cast<Variable>(LD.getOrCreateNodeByName("gpu_0/data_0"));
-    i1 = llvm::cast<Variable>(LD.getOrCreateNodeByName("data_0"));
+    model.SM = LD.getRoot();
+    model.i0 = llvm::cast<Variable>(LD.getOrCreateNodeByName("gpu_0/data_0"));
+    model.i1 = llvm::cast<Variable>(LD.getOrCreateNodeByName("data_0"));
   }
 
-  assert(i0->getVisibilityKind() == VisibilityKind::Public);
-  assert(i1->getVisibilityKind() == VisibilityKind::Public);
+  assert(model.i0->getVisibilityKind() == VisibilityKind::Public);
+  assert(model.i1->getVisibilityKind() == VisibilityKind::Public);
+  return model;
+}
+
+/// Measure the effect of quantizing every node of \p model alone with
+/// \p quantizationInfos: the error on the interpreter, which computes the
+/// reference results, and the time on \p EE, for the input \p data. Mark
+/// the nodes that don't pay off to stay in float in \p quantizationInfos.
+static void
+selectQuantizedNodes(ExecutionEngine &EE, const LoadedModel &model,
+                     const ModelFiles &files, Tensor &data,
+                     std::vector<NodeQuantizationInfo> &quantizationInfos) {
+  auto effects = quantization::measureQuantizationEffects(
+      EE, model.F, quantizationInfos, {model.i0, model.i1}, {&data, &data},
+      selectTimingRunsOpt, enableChannelwiseOpt, maxInt8ErrorOpt);
+
+  if (ExecutionBackend != BackendKind::Interpreter) {
+    // The same model in the interpreter has nodes with the same names.
+    ExecutionEngine interpreterEE(BackendKind::Interpreter);
+    auto ref = loadModelFiles(
+        interpreterEE.getModule().createFunction(model.F->getName()), files,
+        data);
+    ::optimize(ref.F, glow::CompilationMode::Infer);
+    auto errors = quantization::measureQuantizationEffects(
+        interpreterEE, ref.F, quantizationInfos, {ref.i0, ref.i1},
+        {&data, &data}, 0, enableChannelwiseOpt, maxInt8ErrorOpt);
+    std::unordered_map<std::string, float> nodeErrors;
+    for (const auto &effect : errors) {
+      nodeErrors[effect.nodeName_] = effect.error_;
+    }
+    for (auto &effect : effects) {
+      auto it = nodeErrors.find(effect.nodeName_);
+      if (it != nodeErrors.end()) {
+        effect.error_ = it->second;
+      }
+    }
+  }
+
+  quantization::selectQuantizedNodes(effects, maxQuantizationErrorOpt,
+                                     quantizationInfos);
+  for (const auto &effect : effects) {
+    llvm::outs() << llvm::formatv(
+        "Node {0}: error {1:e2}, time saved (s) {2:f6}\n", effect.nodeName_,
+        effect.error_, effect.timeSaved_);
+  }
+}
+
+/// Load the model \p files into a new function \p name of \p EE, with the
+/// input shape of \p data, and apply the quantization profile, if any. The
+/// function is named after the model if \p name is empty.
+static LoadedModel loadModel(ExecutionEngine &EE, const ModelFiles &files,
+                             Tensor &data, llvm::StringRef name = "") {
+  Function *F = EE.getModule().createFunction(
+      name.empty() ? llvm::StringRef(modelPathOpt[0]) : name);
+  auto model = loadModelFiles(F, files, data);
 
   // Handle the request to profile the graph in preperation for quantization.
   if (!dumpProfileFileOpt.empty()) {
@@ -293,11 +499,332 @@ int main(int argc, char **argv) {
     ::optimize(F, glow::CompilationMode::Infer);
 
     auto quantizationInfos = deserializeFromYaml(loadProfileFileOpt);
+    quantization::calibrateQuantizationInfos(quantizationInfos, calibrationOpt);
+
+    // Keep in float the nodes whose quantization costs too much accuracy for
+    // the time it saves.
+    if (!selectQuantizedNodesFileOpt.empty()) {
+      selectQuantizedNodes(EE, model, files, data, quantizationInfos);
+      serializeToYaml(selectQuantizedNodesFileOpt, quantizationInfos);
+    }
 
     // Quantize the graph based on the captured profile.
-    quantization::generateQuantizedGraph(EE, F, quantizationInfos);
+    quantization::generateQuantizedGraph(EE, F, quantizationInfos,
+                                         enableChannelwiseOpt, maxInt8ErrorOpt);
   }
 
+  // Run the nodes that the backend supports in float16 in half precision.
+  if (convertToFloat16Opt) {
+    EE.convertToFloat16(F);
+  }
+  return model;
+}
+
+namespace {
+
+/// Serves the requests to classify single images. The server keeps a compiled
+/// variant of the model for every batch size. A dispatcher thread collects
+/// the incoming requests until the largest variant is full or until the
+/// oldest request has waited for the maximal latency. Then it runs the
+/// largest variant that the queued requests fill and returns the results to
+/// their callers.
+class BatchingServer {
+  using Clock = std::chrono::steady_clock;
+
+  /// A compiled variant of the model.
+  struct Variant {
+    size_t batchSize;
+    /// The batch of input images, bound to the inputs of the model.
+    Tensor batch;
+    std::unique_ptr<ExecutionEngine> EE;
+    LoadedModel model;
+  };
+  /// A request in the queue.
+  struct Request {
+    /// The input image, with a batch dimension of 1.
+    const Tensor *image;
+    Clock::time_point arrival;
+    std::promise<size_t> result;
+  };
+
+  /// The memory of the activations, which the variants share since they run
+  /// one at a time on the dispatcher thread.
+  ActivationArena arena_;
+  /// The variants, in increasing batch sizes.
+  std::vector<Variant> variants_;
+  /// How long a request may wait for a larger batch.
+  Clock::duration maxLatency_;
+
+  std::mutex mutex_;
+  /// Signals a new request or the shutdown to the dispatcher.
+  std::condition_variable wakeup_;
+  std::deque<Request> queue_;
+  bool shutdown_{false};
+  std::thread dispatcher_;
+
+  /// The number of batches run by every variant.
+  std::vector<size_t> numBatches_;
+  /// The sum and the maximum of the latencies of the requests.
+  Clock::duration totalLatency_{0};
+  Clock::duration maxObservedLatency_{0};
+  size_t numRequests_{0};
+
+  /// The main loop of the dispatcher thread.
+  void dispatch() {
+    std::unique_lock<std::mutex> lock(mutex_);
+    for (;;) {
+      wakeup_.wait(lock, [this]() { return shutdown_ || !queue_.empty(); });
+      if (queue_.empty()) {
+        return;
+      }
+      // Wait for the largest batch until the deadline of the oldest request.
+      auto deadline = queue_.front().arrival + maxLatency_;
+      size_t largest = variants_.back().batchSize;
+      wakeup_.wait_until(lock, deadline, [&]() {
+        return shutdown_ || queue_.size() >= largest;
+      });
+      // Pick the largest variant that the requests fill.
+      size_t idx = variants_.size() - 1;
+      while (variants_[idx].batchSize > queue_.size()) {
+        idx--;
+      }
+      std::vector<Request> requests;
+      for (size_t i = 0; i < variants_[idx].batchSize; i++) {
+        requests.push_back(std::move(queue_.front()));
+        queue_.pop_front();
+      }
+      lock.unlock();
+      runBatch(idx, requests);
+      lock.lock();
+    }
+  }
+
+  /// Run the variant \p idx on \p requests and fulfill them.
+  void runBatch(size_t idx, std::vector<Request> &requests) {
+    auto &V = variants_[idx];
+    auto imageDims = requests[0].image->dims();
+    for (size_t i = 0; i < requests.size(); i++) {
+      std::vector<size_t> offsets(imageDims.size(), 0);
+      offsets[0] = i;
+      auto slice = V.batch.getUnowned(imageDims, offsets);
+      slice.copyRawFrom(requests[i].image);
+    }
+    V.EE->run({V.model.i0, V.model.i1}, {&V.batch, &V.batch});
+
+    auto H = V.model.SM->getVariable()->getPayload().getHandle<>();
+    auto now = Clock::now();
+    for (size_t i = 0; i < requests.size(); i++) {
+      auto latency = now - requests[i].arrival;
+      totalLatency_ += latency;
+      maxObservedLatency_ = std::max(maxObservedLatency_, latency);
+      Tensor slice = H.extractSlice(i);
+      requests[i].result.set_value(slice.getHandle<>().minMaxArg().second);
+    }
+    numBatches_[idx]++;
+    numRequests_ += requests.size();
+  }
+
+public:
+  /// Compile the model \p files for every batch size in \p batchSizes. Every
+  /// request carries an image of the shape of \p image. Requests wait for a
+  /// larger batch for at most \p maxLatency.
+  BatchingServer(const ModelFiles &files, llvm::ArrayRef<unsigned> batchSizes,
+                 const Tensor &image, std::chrono::milliseconds maxLatency)
+      : maxLatency_(maxLatency) {
+    std::vector<unsigned> sizes(batchSizes.begin(), batchSizes.end());
+    std::sort(sizes.begin(), sizes.end());
+    sizes.erase(std::unique(sizes.begin(), sizes.end()), sizes.end());
+    GLOW_ASSERT(!sizes.empty() && sizes[0] == 1 &&
+                "The batch sizes must include 1");
+    for (auto batchSize : sizes) {
+      Variant V;
+      V.batchSize = batchSize;
+      auto dims = image.dims().vec();
+      dims[0] = batchSize;
+      V.batch.reset(ElemKind::FloatTy, dims);
+      V.EE.reset(new ExecutionEngine(ExecutionBackend));
+      V.EE->setActivationsLimit(size_t(maxActivationsMBOpt) << 20);
+      V.model = loadModel(*V.EE, files, V.batch);
+      V.EE->compile(CompilationMode::Infer, V.model.F);
+      // The model reads the batch in place.
+      V.EE->bind(V.model.i0, &V.batch);
+      V.EE->bind(V.model.i1, &V.batch);
+      V.EE->setActivationArena(&arena_);
+      variants_.push_back(std::move(V));
+    }
+    numBatches_.assign(variants_.size(), 0);
+    dispatcher_ = std::thread([this]() { dispatch(); });
+  }
+
+  /// Run the pending requests and stop the dispatcher.
+  ~BatchingServer() {
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      shutdown_ = true;
+    }
+    wakeup_.notify_one();
+    dispatcher_.join();
+  }
+
+  /// Queue the request to classify \p image, which must stay alive until the
+  /// request is done. \returns the future class of the image.
+  std::future<size_t> submit(const Tensor *image) {
+    Request R;
+    R.image = image;
+    R.arrival = Clock::now();
+    auto result = R.result.get_future();
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      queue_.push_back(std::move(R));
+    }
+    wakeup_.notify_one();
+    return result;
+  }
+
+  /// Print the statistics of the requests done so far.
+  void dumpStats(llvm::raw_ostream &os) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    using ms = std::chrono::duration<double, std::milli>;
+    for (size_t i = 0; i < variants_.size(); i++) {
+      os << llvm::formatv("Batch size {0}: {1} batches\n",
+                          variants_[i].batchSize, numBatches_[i]);
+    }
+    if (numRequests_) {
+      os << llvm::formatv(
+          "Request latency (ms): avg {0:f2}, max {1:f2}\n",
+          ms(totalLatency_).count() / numRequests_,
+          ms(maxObservedLatency_).count());
+    }
+  }
+};
+
+/// Classify every image of \p data as a separate request to a batching
+/// server, \p iterationsOpt times, and print the results.
+void serveImages(const ModelFiles &files, Tensor &data) {
+  std::vector<unsigned> batchSizes(serveBatchSizesOpt.begin(),
+                                   serveBatchSizesOpt.end());
+  if (batchSizes.empty()) {
+    batchSizes = {1, 4, 16, 64};
+  }
+  auto imageDims = data.dims().vec();
+  imageDims[0] = 1;
+  std::vector<Tensor> images;
+  for (size_t n = 0; n < inputImageFilenames.size(); n++) {
+    std::vector<size_t> offsets(imageDims.size(), 0);
+    offsets[0] = n;
+    images.push_back(data.getUnowned(imageDims, offsets));
+  }
+
+  BatchingServer server(files, batchSizes, images[0],
+                        std::chrono::milliseconds(serveMaxLatencyOpt));
+  llvm::Timer timer("Serve", "Serve");
+  timer.startTimer();
+  std::vector<std::future<size_t>> results;
+  for (unsigned i = 0; i < iterationsOpt; i++) {
+    for (const auto &image : images) {
+      results.push_back(server.submit(&image));
+    }
+  }
+  for (auto &result : results) {
+    result.wait();
+  }
+  timer.stopTimer();
+
+  llvm::outs() << "Model: " << modelPathOpt[0] << "\n";
+  for (unsigned i = 0; i < inputImageFilenames.size(); i++) {
+    llvm::outs() << " File: " << inputImageFilenames[i]
+                 << " Result:" << results[i].get() << "\n";
+  }
+  if (timeOpt) {
+    llvm::outs() << llvm::formatv("Requests per second: {0:f2}\n",
+                                  results.size() /
+                                      timer.getTotalTime().getWallTime());
+    server.dumpStats(llvm::outs());
+  }
+}
+
+/// Emit a bundle of the model \p files with an entry for every batch size of
+/// -bundle-batch-sizes. Every entry takes images of the shape of \p image.
+void emitMultiEntryBundle(const ModelFiles &files, const Tensor &image) {
+  ExecutionEngine EE(ExecutionBackend);
+  EE.setActivationsLimit(size_t(maxActivationsMBOpt) << 20);
+  std::string modelName = llvm::sys::path::filename(modelPathOpt[0]).str();
+  // The loaders only read the shape of the inputs, which must outlive them.
+  std::vector<Tensor> batches(bundleBatchSizesOpt.size());
+  std::vector<Function *> functions;
+  for (size_t i = 0, e = bundleBatchSizesOpt.size(); i < e; i++) {
+    auto dims = image.dims().vec();
+    dims[0] = bundleBatchSizesOpt[i];
+    batches[i].reset(ElemKind::FloatTy, dims);
+    auto name = modelName + "_" + std::to_string(bundleBatchSizesOpt[i]);
+    functions.push_back(loadModel(EE, files, batches[i], name).F);
+  }
+  EE.save(CompilationMode::Infer, functions, emitBundle, modelName);
+}
+
+} // namespace
+
+int main(int argc, char **argv) {
+  llvm::cl::ParseCommandLineOptions(
+      argc, argv,
+      " The Glow compiler\n\n"
+      "Glow is a compiler for neural network accelerators.\n");
+
+  if (commandLineIsInvalid()) {
+    return 1;
+  }
+
+  if (numThreadsOpt) {
+    glow_parallel_set_num_threads(numThreadsOpt);
+  }
+  if (!pinThreadsOpt.empty()) {
+    std::vector<int> cpus(pinThreadsOpt.begin(), pinThreadsOpt.end());
+    glow_parallel_set_affinity(cpus.data(), cpus.size());
+  }
+
+  Tensor data;
+
+  ImagePreprocessing pp;
+  pp.resizeShorterSide = imageResizeOpt;
+  pp.cropHeight = pp.cropWidth = imageCropOpt;
+  pp.range = normModeToRange(imageMode);
+  loadImagesAndPreprocess(inputImageFilenames, &data, pp);
+
+  assert(modelPathOpt.size() <= 2 &&
+         "-model flag should have either 1 or 2 paths assigned. "
+         "Please see flag's description.");
+
+  ModelFiles files;
+  if (modelPathOpt.size() == 1) {
+    if (llvm::sys::fs::is_directory(*modelPathOpt.begin())) {
+      files.caffe2NetDesc = modelPathOpt[0] + "/predict_net.pb";
+      files.caffe2NetWeight = modelPathOpt[0] + "/init_net.pb";
+    } else {
+      files.onnxModel = modelPathOpt[0];
+    }
+  } else {
+    files.caffe2NetDesc = modelPathOpt[0];
+    files.caffe2NetWeight = modelPathOpt[1];
+  }
+
+  if (serveOpt) {
+    serveImages(files, data);
+    return 0;
+  }
+
+  if (!bundleBatchSizesOpt.empty()) {
+    emitMultiEntryBundle(files, data);
+    return 0;
+  }
+
+  ExecutionEngine EE(ExecutionBackend);
+  EE.setActivationsLimit(size_t(maxActivationsMBOpt) << 20);
+  auto model = loadModel(EE, files, data);
+  Function *F = model.F;
+  SaveNode *SM = model.SM;
+  Variable *i0 = model.i0;
+  Variable *i1 = model.i1;
+
   if (!emitBundle.empty()) {
     // Emit IR for the graph, compile it and save as a bundle.
     EE.save(CompilationMode::Infer, F, emitBundle);
@@ -337,6 +864,8 @@ int main(int argc, char **argv) {
                                   timer.getTotalTime().getWallTime() /
                                       iterationsOpt);
   }
+  // Print the per-layer profile, if the backend collected one.
+  EE.dumpProfile();
 
   if (!dumpProfileFileOpt.empty()) {
     std::vector<NodeQuantizationInfo> QI =
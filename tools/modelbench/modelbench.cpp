@@ -0,0 +1,301 @@
+/**
+ * Copyright (c) 2017-present, Facebook, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "glow/Base/Tensor.h"
+#include "glow/ExecutionEngine/ExecutionEngine.h"
+#include "glow/Importer/Caffe2.h"
+#include "glow/Importer/ONNX.h"
+
+#include "llvm/Support/CommandLine.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/FormatVariadic.h"
+#include "llvm/Support/raw_ostream.h"
+
+#include <sys/resource.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <string>
+#include <vector>
+
+using namespace glow;
+
+namespace {
+
+llvm::cl::OptionCategory modelBenchCat("Model Benchmark Options");
+
+llvm::cl::list<std::string> modelPathOpt(
+    "model",
+    llvm::cl::desc(
+        "Specify one of three:\n"
+        "1. Path to ONNX model file.\n"
+        "2. Two paths to Caffe2 model files: network structure and weight.\n"
+        "3. Path to directory with the Caffe2 network structure "
+        "<predict_net.pb> and weight <init_net.pb> files."),
+    llvm::cl::value_desc("modelPath"), llvm::cl::Required, llvm::cl::OneOrMore,
+    llvm::cl::cat(modelBenchCat));
+llvm::cl::alias modelPathAOpt("m", llvm::cl::desc("Alias for -model"),
+                              llvm::cl::aliasopt(modelPathOpt),
+                              llvm::cl::cat(modelBenchCat));
+
+llvm::cl::opt<std::string>
+    inputNameOpt("input", llvm::cl::desc("The name of the input of the model"),
+                 llvm::cl::init("data"), llvm::cl::cat(modelBenchCat));
+
+llvm::cl::list<unsigned> inputDimsOpt(
+    "input-dims",
+    llvm::cl::desc("The dimensions of the input of the model. The first "
+                   "dimension is replaced by every one of the batch sizes"),
+    llvm::cl::CommaSeparated, llvm::cl::OneOrMore,
+    llvm::cl::cat(modelBenchCat));
+
+llvm::cl::list<unsigned>
+    batchSizesOpt("batch-sizes",
+                  llvm::cl::desc("The batch sizes to benchmark (default 1)"),
+                  llvm::cl::CommaSeparated, llvm::cl::ZeroOrMore,
+                  llvm::cl::cat(modelBenchCat));
+
+llvm::cl::list<unsigned> threadsOpt(
+    "threads",
+    llvm::cl::desc("The numbers of threads of the CPU kernels to benchmark "
+                   "(default 1)"),
+    llvm::cl::CommaSeparated, llvm::cl::ZeroOrMore,
+    llvm::cl::cat(modelBenchCat));
+
+llvm::cl::opt<unsigned>
+    warmupOpt("warmup",
+              llvm::cl::desc("Number of runs before the timed iterations"),
+              llvm::cl::init(5), llvm::cl::cat(modelBenchCat));
+
+llvm::cl::opt<unsigned>
+    iterationsOpt("iterations", llvm::cl::desc("Number of timed iterations"),
+                  llvm::cl::init(100), llvm::cl::cat(modelBenchCat));
+
+llvm::cl::opt<std::string> outputOpt(
+    "o", llvm::cl::desc("The file of the JSON report, or - for stdout"),
+    llvm::cl::value_desc("report.json"), llvm::cl::init("-"),
+    llvm::cl::cat(modelBenchCat));
+
+llvm::cl::opt<BackendKind> ExecutionBackend(
+    llvm::cl::desc("Backend to use:"),
+    llvm::cl::values(clEnumValN(BackendKind::Interpreter, "interpreter",
+                                "Use interpreter"),
+                     clEnumValN(BackendKind::CPU, "cpu", "Use CPU"),
+                     clEnumValN(BackendKind::OpenCL, "opencl", "Use OpenCL")),
+    llvm::cl::init(BackendKind::Interpreter), llvm::cl::cat(modelBenchCat));
+
+/// The measurements of the model for one batch size and thread count.
+struct BenchResult {
+  unsigned batchSize;
+  unsigned threads;
+  double compileTime;
+  /// The latencies of the timed iterations, in increasing order.
+  std::vector<double> latencies;
+
+  /// \returns the latency of the percentile \p p in [0, 100], with the
+  /// nearest rank method.
+  double percentile(double p) const {
+    size_t rank = std::ceil(p / 100 * latencies.size());
+    return latencies[std::max<size_t>(rank, 1) - 1];
+  }
+
+  /// \returns the number of inputs processed per second.
+  double throughput() const {
+    double total = 0;
+    for (double t : latencies) {
+      total += t;
+    }
+    return batchSize * latencies.size() / total;
+  }
+};
+
+using Clock = std::chrono::steady_clock;
+
+/// \returns the seconds elapsed since \p start.
+double secondsSince(Clock::time_point start) {
+  return std::chrono::duration<double>(Clock::now() - start).count();
+}
+
+/// Set the number of threads of the CPU kernels to \p threads. The CPU backend
+/// reads it from its command line option when it is created. \returns false
+/// if the CPU backend is not linked in.
+bool setCPUThreads(unsigned threads) {
+  auto &options = llvm::cl::getRegisteredOptions();
+  auto it = options.find("cpu-num-threads");
+  if (it == options.end()) {
+    return false;
+  }
+  static_cast<llvm::cl::opt<unsigned> *>(it->second)->setValue(threads);
+  return true;
+}
+
+/// Load the model into \p EE with an input of the shape \p dims, compile it
+/// and benchmark it. The batch size and thread count are reported with
+/// \p batchSize and \p threads.
+BenchResult benchModel(llvm::ArrayRef<size_t> dims, unsigned batchSize,
+                       unsigned threads) {
+  BenchResult result;
+  result.batchSize = batchSize;
+  result.threads = threads;
+
+  ExecutionEngine EE(ExecutionBackend);
+  Function *F = EE.getModule().createFunction("model");
+  Tensor input(ElemKind::FloatTy, dims);
+  input.getHandle().randomize(0.0, 1.0);
+  // The classifiers of the models take the expected labels as an input.
+  Tensor expectedSoftmax(ElemKind::IndexTy, {dims[0], 1});
+
+  auto start = Clock::now();
+  Variable *inputVar;
+  if (modelPathOpt.size() == 2 ||
+      llvm::sys::fs::is_directory(modelPathOpt[0])) {
+    bool isDir = modelPathOpt.size() == 1;
+    std::string netDesc =
+        isDir ? modelPathOpt[0] + "/predict_net.pb" : modelPathOpt[0];
+    std::string netWeight =
+        isDir ? modelPathOpt[0] + "/init_net.pb" : modelPathOpt[1];
+    caffe2ModelLoader LD(netDesc, netWeight,
+                         {inputNameOpt.c_str(), "softmax_expected"},
+                         {&input, &expectedSoftmax}, *F);
+    inputVar = llvm::cast<Variable>(LD.getOrCreateNodeByName(inputNameOpt));
+  } else {
+    ONNXModelLoader LD(modelPathOpt[0],
+                       {inputNameOpt.c_str(), "softmax_expected"},
+                       {&input, &expectedSoftmax}, *F);
+    inputVar = llvm::cast<Variable>(LD.getOrCreateNodeByName(inputNameOpt));
+  }
+  EE.compile(CompilationMode::Infer, F);
+  result.compileTime = secondsSince(start);
+
+  for (unsigned i = 0; i < warmupOpt; i++) {
+    EE.run({inputVar}, {&input});
+  }
+  for (unsigned i = 0; i < iterationsOpt; i++) {
+    auto runStart = Clock::now();
+    EE.run({inputVar}, {&input});
+    result.latencies.push_back(secondsSince(runStart));
+  }
+  std::sort(result.latencies.begin(), result.latencies.end());
+  return result;
+}
+
+/// \returns the peak resident set size of the process, in bytes.
+size_t getPeakRSS() {
+  struct rusage usage;
+  getrusage(RUSAGE_SELF, &usage);
+#ifdef __APPLE__
+  return usage.ru_maxrss;
+#else
+  return size_t(usage.ru_maxrss) * 1024;
+#endif
+}
+
+/// \returns \p str as a JSON string literal.
+std::string quoteJSON(llvm::StringRef str) {
+  std::string quoted = "\"";
+  for (char c : str) {
+    if (c == '"' || c == '\\') {
+      quoted += '\\';
+    }
+    quoted += c;
+  }
+  return quoted + "\"";
+}
+
+/// Print the report of \p results to \p os.
+void dumpJSON(llvm::raw_ostream &os, llvm::ArrayRef<BenchResult> results) {
+  static const char *backendNames[] = {"interpreter", "opencl", "cpu"};
+  std::string model;
+  for (const auto &path : modelPathOpt) {
+    model += (model.empty() ? "" : ",") + path;
+  }
+  os << "{\n";
+  os << "  \"model\": " << quoteJSON(model) << ",\n";
+  os << "  \"backend\": \""
+     << backendNames[unsigned(ExecutionBackend.getValue())] << "\",\n";
+  os << "  \"warmup\": " << warmupOpt << ",\n";
+  os << "  \"iterations\": " << iterationsOpt << ",\n";
+  os << "  \"peak_rss_bytes\": " << getPeakRSS() << ",\n";
+  os << "  \"results\": [\n";
+  for (size_t i = 0; i < results.size(); i++) {
+    const auto &R = results[i];
+    os << llvm::formatv(
+        "    {{\"batch_size\": {0}, \"threads\": {1}, "
+        "\"compile_time_s\": {2:f6}, \"latency_s\": {{\"p50\": {3:e}, "
+        "\"p90\": {4:e}, \"p99\": {5:e}, \"max\": {6:e}}, "
+        "\"throughput_per_s\": {7:f3}}",
+        R.batchSize, R.threads, R.compileTime, R.percentile(50),
+        R.percentile(90), R.percentile(99), R.latencies.back(),
+        R.throughput());
+    os << (i + 1 < results.size() ? ",\n" : "\n");
+  }
+  os << "  ]\n";
+  os << "}\n";
+}
+
+} // namespace
+
+int main(int argc, char **argv) {
+  llvm::cl::ParseCommandLineOptions(
+      argc, argv,
+      " The Glow model benchmark\n\n"
+      "Compiles a model for a backend and reports its compile time, the "
+      "percentiles of its latency and its throughput as JSON.\n");
+
+  if (modelPathOpt.size() > 2 || iterationsOpt == 0) {
+    llvm::errs() << "modelbench: expected one or two model paths and at least "
+                    "one iteration.\n";
+    return 1;
+  }
+
+  std::vector<unsigned> batchSizes(batchSizesOpt.begin(), batchSizesOpt.end());
+  if (batchSizes.empty()) {
+    batchSizes = {1};
+  }
+  std::vector<unsigned> threads(threadsOpt.begin(), threadsOpt.end());
+  if (threads.empty()) {
+    threads = {1};
+  }
+  if (threads != std::vector<unsigned>{1} &&
+      (ExecutionBackend != BackendKind::CPU || !setCPUThreads(1))) {
+    llvm::errs() << "modelbench: the -" << threadsOpt.ArgStr
+                 << " option requires the CPU backend.\n";
+    return 1;
+  }
+
+  std::vector<BenchResult> results;
+  for (auto batchSize : batchSizes) {
+    std::vector<size_t> dims(inputDimsOpt.begin(), inputDimsOpt.end());
+    dims[0] = batchSize;
+    for (auto numThreads : threads) {
+      if (ExecutionBackend == BackendKind::CPU) {
+        setCPUThreads(numThreads);
+      }
+      results.push_back(benchModel(dims, batchSize, numThreads));
+    }
+  }
+
+  std::error_code EC;
+  llvm::raw_fd_ostream os(outputOpt, EC, llvm::sys::fs::F_None);
+  if (EC) {
+    llvm::errs() << "modelbench: cannot open " << outputOpt << ": "
+                 << EC.message() << "\n";
+    return 1;
+  }
+  dumpJSON(os, results);
+  return 0;
+}